@@ -9,9 +9,21 @@
 /* Define if building for a RISC machine (assume slow byte access). */
 #undef CPU_RISC
 
+/* Define to use the table free, constant time bitsliced internal AES. */
+#undef ENABLE_AES_BITSLICE
+
 /* Define to enabled debug logging for all mudules. */
 #undef ENABLE_DEBUG_LOGGING
 
+/* Define to enable sampled debug traces in the packet path. */
+#undef ENABLE_PACKET_TRACE
+
+/* Define to enable USDT/SystemTap probes. */
+#undef ENABLE_USDT_PROBES
+
+/* Define to count the cycles spent in each stage of the packet path. */
+#undef ENABLE_STAGE_PROFILE
+
 /* Logging statments will be writen to this file. */
 #undef ERR_REPORTING_FILE
 
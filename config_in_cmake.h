@@ -9,6 +9,18 @@
 /* Define to enabled debug logging for all mudules. */
 #cmakedefine ENABLE_DEBUG_LOGGING 1
 
+/* Define to enable sampled debug traces in the packet path. */
+#cmakedefine ENABLE_PACKET_TRACE 1
+
+/* Define to use the table free, constant time bitsliced internal AES. */
+#cmakedefine ENABLE_AES_BITSLICE 1
+
+/* Define to enable USDT/SystemTap probes. */
+#cmakedefine ENABLE_USDT_PROBES 1
+
+/* Define to count the cycles spent in each stage of the packet path. */
+#cmakedefine ENABLE_STAGE_PROFILE 1
+
 /* Logging statments will be writen to this file. */
 #cmakedefine ERR_REPORTING_FILE "@ERR_REPORTING_FILE@"
 
@@ -27,12 +39,27 @@
 /* Define this to use MBEDTLS. */
 #cmakedefine MBEDTLS 1
 
+/* Define to the PSA key location of the driver for MBEDTLS keys. */
+#cmakedefine SRTP_PSA_KEY_LOCATION @SRTP_PSA_KEY_LOCATION@
+
 /* Define this to use NSS crypto. */
 #cmakedefine NSS 1
 
+/* Define this to use Windows CNG crypto. */
+#cmakedefine CNG 1
+
+/* Define this to use Apple CommonCrypto. */
+#cmakedefine COMMONCRYPTO 1
+
 /* Define this to use AES-GCM. */
 #cmakedefine GCM 1
 
+/* Define to leave AES-192 counter mode out of the build. */
+#cmakedefine SRTP_NO_AES_192 1
+
+/* Define to leave the AES-256 ciphers out of the build. */
+#cmakedefine SRTP_NO_AES_256 1
+
 /* Define if building for a CISC machine (e.g. Intel). */
 #define CPU_CISC 1
 
@@ -48,8 +48,38 @@
 #endif
 
 #include "aes.h"
+#include "cpu_features.h"
 #include "err.h"
 
+/*
+ * hardware AES support, used by srtp_aes_encrypt_blocks() when
+ * srtp_cpu_features() reports it. On aarch64 the crypto extensions are
+ * built when the compiler targets them, or on linux when building with gcc.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define SRTP_AES_X86 1
+#define SRTP_AES_X86_TARGET __attribute__((target("aes,sse2")))
+#include <wmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SRTP_AES_X86 1
+#define SRTP_AES_X86_TARGET
+#include <intrin.h>
+#include <wmmintrin.h>
+#elif defined(__aarch64__) &&                                                 \
+    (defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO))
+#define SRTP_AES_ARMV8 1
+#define SRTP_AES_ARMV8_TARGET
+#include <arm_neon.h>
+#elif defined(__aarch64__) && defined(__linux__) && defined(__GNUC__) &&      \
+    !defined(__clang__) && __GNUC__ >= 9
+#define SRTP_AES_ARMV8 1
+#define SRTP_AES_ARMV8_TARGET __attribute__((target("+crypto")))
+#include <arm_neon.h>
+#endif
+
+#ifndef ENABLE_AES_BITSLICE
+
 /*
  * we use the tables T0, T1, T2, T3, and T4 to compute AES, and
  * the tables U0, U1, U2, and U4 to compute its inverse
@@ -1389,6 +1419,447 @@ static const uint32_t U4[256] = {
 /* clang-format on */
 #endif /* CPU_RISC */
 
+#endif /* ! ENABLE_AES_BITSLICE */
+
+#ifdef ENABLE_AES_BITSLICE
+
+/*
+ * table free, constant time AES after the bitsliced aes_ct64 code of
+ * BearSSL: four blocks are handled at once in eight 64-bit words, word j
+ * holding bit j of every octet of the four blocks, and the S-box is the
+ * Boyar-Peralta circuit of logical operations on those words
+ */
+
+static void aes_bitslice_sbox(uint64_t *q)
+{
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    uint64_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    uint64_t y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    uint64_t z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint64_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint64_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint64_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    /* top linear transformation */
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    /* non-linear section */
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    /* bottom linear transformation */
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+/*
+ * the inverse S-box is the S-box between two applications of the
+ * inverse of its affine transformation
+ */
+static void aes_bitslice_inv_affine(uint64_t *q)
+{
+    uint64_t q0, q1, q2, q3, q4, q5, q6, q7;
+
+    q0 = ~q[0];
+    q1 = ~q[1];
+    q2 = q[2];
+    q3 = q[3];
+    q4 = q[4];
+    q5 = ~q[5];
+    q6 = ~q[6];
+    q7 = q[7];
+    q[7] = q1 ^ q4 ^ q6;
+    q[6] = q0 ^ q3 ^ q5;
+    q[5] = q7 ^ q2 ^ q4;
+    q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2;
+    q[2] = q4 ^ q7 ^ q1;
+    q[1] = q3 ^ q6 ^ q0;
+    q[0] = q2 ^ q5 ^ q7;
+}
+
+static void aes_bitslice_inv_sbox(uint64_t *q)
+{
+    aes_bitslice_inv_affine(q);
+    aes_bitslice_sbox(q);
+    aes_bitslice_inv_affine(q);
+}
+
+#define aes_bitslice_swap(cl, ch, s, x, y)                                     \
+    do {                                                                       \
+        uint64_t a_ = (x);                                                     \
+        uint64_t b_ = (y);                                                     \
+        (x) = (a_ & (cl)) | ((b_ & (cl)) << (s));                              \
+        (y) = ((a_ & (ch)) >> (s)) | (b_ & (ch));                              \
+    } while (0)
+
+#define aes_bitslice_swap2(x, y)                                               \
+    aes_bitslice_swap(0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, x, y)
+#define aes_bitslice_swap4(x, y)                                               \
+    aes_bitslice_swap(0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, x, y)
+#define aes_bitslice_swap8(x, y)                                               \
+    aes_bitslice_swap(0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, x, y)
+
+/*
+ * aes_bitslice_ortho(q) converts between the interleaved and the
+ * bitsliced representation, it is its own inverse
+ */
+static void aes_bitslice_ortho(uint64_t *q)
+{
+    aes_bitslice_swap2(q[0], q[1]);
+    aes_bitslice_swap2(q[2], q[3]);
+    aes_bitslice_swap2(q[4], q[5]);
+    aes_bitslice_swap2(q[6], q[7]);
+
+    aes_bitslice_swap4(q[0], q[2]);
+    aes_bitslice_swap4(q[1], q[3]);
+    aes_bitslice_swap4(q[4], q[6]);
+    aes_bitslice_swap4(q[5], q[7]);
+
+    aes_bitslice_swap8(q[0], q[4]);
+    aes_bitslice_swap8(q[1], q[5]);
+    aes_bitslice_swap8(q[2], q[6]);
+    aes_bitslice_swap8(q[3], q[7]);
+}
+
+/*
+ * aes_bitslice_interleave_in(q0, q1, octets) spreads a block over two
+ * words, aes_bitslice_interleave_out() gathers it again
+ */
+static void aes_bitslice_interleave_in(uint64_t *q0,
+                                       uint64_t *q1,
+                                       const uint8_t *octets)
+{
+    uint64_t x[4];
+
+    for (size_t i = 0; i < 4; i++) {
+        x[i] = (uint64_t)octets[4 * i] | ((uint64_t)octets[4 * i + 1] << 8) |
+               ((uint64_t)octets[4 * i + 2] << 16) |
+               ((uint64_t)octets[4 * i + 3] << 24);
+        x[i] |= x[i] << 16;
+        x[i] &= 0x0000FFFF0000FFFFULL;
+        x[i] |= x[i] << 8;
+        x[i] &= 0x00FF00FF00FF00FFULL;
+    }
+    *q0 = x[0] | (x[2] << 8);
+    *q1 = x[1] | (x[3] << 8);
+}
+
+static void aes_bitslice_interleave_out(uint8_t *octets,
+                                        uint64_t q0,
+                                        uint64_t q1)
+{
+    uint64_t x[4];
+
+    x[0] = q0 & 0x00FF00FF00FF00FFULL;
+    x[1] = q1 & 0x00FF00FF00FF00FFULL;
+    x[2] = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+    x[3] = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+    for (size_t i = 0; i < 4; i++) {
+        uint32_t w;
+
+        x[i] |= x[i] >> 8;
+        x[i] &= 0x0000FFFF0000FFFFULL;
+        w = (uint32_t)x[i] | (uint32_t)(x[i] >> 16);
+        octets[4 * i] = (uint8_t)w;
+        octets[4 * i + 1] = (uint8_t)(w >> 8);
+        octets[4 * i + 2] = (uint8_t)(w >> 16);
+        octets[4 * i + 3] = (uint8_t)(w >> 24);
+    }
+}
+
+static void aes_bitslice_add_round_key(uint64_t *q, const uint64_t *sk)
+{
+    for (size_t i = 0; i < 8; i++) {
+        q[i] ^= sk[i];
+    }
+}
+
+static void aes_bitslice_shift_rows(uint64_t *q)
+{
+    for (size_t i = 0; i < 8; i++) {
+        uint64_t x = q[i];
+
+        q[i] = (x & 0x000000000000FFFFULL) |
+               ((x & 0x00000000FFF00000ULL) >> 4) |
+               ((x & 0x00000000000F0000ULL) << 12) |
+               ((x & 0x0000FF0000000000ULL) >> 8) |
+               ((x & 0x000000FF00000000ULL) << 8) |
+               ((x & 0xF000000000000000ULL) >> 12) |
+               ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+static void aes_bitslice_inv_shift_rows(uint64_t *q)
+{
+    for (size_t i = 0; i < 8; i++) {
+        uint64_t x = q[i];
+
+        q[i] = (x & 0x000000000000FFFFULL) |
+               ((x & 0x000000000FFF0000ULL) << 4) |
+               ((x & 0x00000000F0000000ULL) >> 12) |
+               ((x & 0x000000FF00000000ULL) << 8) |
+               ((x & 0x0000FF0000000000ULL) >> 8) |
+               ((x & 0x000F000000000000ULL) << 12) |
+               ((x & 0xFFF0000000000000ULL) >> 4);
+    }
+}
+
+static inline uint64_t aes_bitslice_rotr32(uint64_t x)
+{
+    return (x << 32) | (x >> 32);
+}
+
+static void aes_bitslice_mix_columns(uint64_t *q)
+{
+    uint64_t q0, q1, q2, q3, q4, q5, q6, q7;
+    uint64_t r0, r1, r2, r3, r4, r5, r6, r7;
+
+    q0 = q[0];
+    q1 = q[1];
+    q2 = q[2];
+    q3 = q[3];
+    q4 = q[4];
+    q5 = q[5];
+    q6 = q[6];
+    q7 = q[7];
+    r0 = (q0 >> 16) | (q0 << 48);
+    r1 = (q1 >> 16) | (q1 << 48);
+    r2 = (q2 >> 16) | (q2 << 48);
+    r3 = (q3 >> 16) | (q3 << 48);
+    r4 = (q4 >> 16) | (q4 << 48);
+    r5 = (q5 >> 16) | (q5 << 48);
+    r6 = (q6 >> 16) | (q6 << 48);
+    r7 = (q7 >> 16) | (q7 << 48);
+
+    q[0] = q7 ^ r7 ^ r0 ^ aes_bitslice_rotr32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ aes_bitslice_rotr32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ aes_bitslice_rotr32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ aes_bitslice_rotr32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ aes_bitslice_rotr32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ aes_bitslice_rotr32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ aes_bitslice_rotr32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ aes_bitslice_rotr32(q7 ^ r7);
+}
+
+/* InvMixColumns is MixColumns applied three times */
+static void aes_bitslice_inv_mix_columns(uint64_t *q)
+{
+    aes_bitslice_mix_columns(q);
+    aes_bitslice_mix_columns(q);
+    aes_bitslice_mix_columns(q);
+}
+
+/*
+ * aes_bitslice_round_keys(expanded_key) sets the bitsliced round keys
+ * from the round keys, each repeated for the four blocks
+ */
+static void aes_bitslice_round_keys(srtp_aes_expanded_key_t *expanded_key)
+{
+    for (size_t i = 0; i <= expanded_key->num_rounds; i++) {
+        uint64_t *q = expanded_key->bitsliced[i];
+
+        aes_bitslice_interleave_in(&q[0], &q[4], expanded_key->round[i].v8);
+        q[1] = q[0];
+        q[2] = q[0];
+        q[3] = q[0];
+        q[5] = q[4];
+        q[6] = q[4];
+        q[7] = q[4];
+        aes_bitslice_ortho(q);
+    }
+}
+
+/* used by the key expansion, which then needs no S-box table either */
+static uint8_t aes_sub_byte(uint8_t x)
+{
+    uint64_t q[8] = { 0 };
+
+    q[0] = x;
+    aes_bitslice_ortho(q);
+    aes_bitslice_sbox(q);
+    aes_bitslice_ortho(q);
+
+    return (uint8_t)q[0];
+}
+
+/* number of blocks one pass of the bitsliced code encrypts */
+#define SRTP_AES_BITSLICE_BLOCKS 4
+
+static void aes_bitslice_encrypt(v128_t *blocks,
+                                 size_t num_blocks,
+                                 const srtp_aes_expanded_key_t *exp_key)
+{
+    uint64_t q[8] = { 0 };
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        aes_bitslice_interleave_in(&q[i], &q[i + 4], blocks[i].v8);
+    }
+    aes_bitslice_ortho(q);
+
+    aes_bitslice_add_round_key(q, exp_key->bitsliced[0]);
+    for (size_t r = 1; r < exp_key->num_rounds; r++) {
+        aes_bitslice_sbox(q);
+        aes_bitslice_shift_rows(q);
+        aes_bitslice_mix_columns(q);
+        aes_bitslice_add_round_key(q, exp_key->bitsliced[r]);
+    }
+    aes_bitslice_sbox(q);
+    aes_bitslice_shift_rows(q);
+    aes_bitslice_add_round_key(q, exp_key->bitsliced[exp_key->num_rounds]);
+
+    aes_bitslice_ortho(q);
+    for (size_t i = 0; i < num_blocks; i++) {
+        aes_bitslice_interleave_out(blocks[i].v8, q[i], q[i + 4]);
+    }
+}
+
+#else
+
+static inline uint8_t aes_sub_byte(uint8_t x)
+{
+    return aes_sbox[x];
+}
+
+#endif /* ENABLE_AES_BITSLICE */
+
 #define gf2_8_field_polynomial 0x1B
 /*
  * gf2_8_shift(z) returns the result of the GF(2^8) 'multiply by x'
@@ -1415,13 +1886,13 @@ static void aes_128_expand_encryption_key(const uint8_t *key,
     for (size_t i = 1; i < 11; i++) {
         /* munge first word of round key */
         expanded_key->round[i].v8[0] =
-            aes_sbox[expanded_key->round[i - 1].v8[13]] ^ rc;
+            aes_sub_byte(expanded_key->round[i - 1].v8[13]) ^ rc;
         expanded_key->round[i].v8[1] =
-            aes_sbox[expanded_key->round[i - 1].v8[14]];
+            aes_sub_byte(expanded_key->round[i - 1].v8[14]);
         expanded_key->round[i].v8[2] =
-            aes_sbox[expanded_key->round[i - 1].v8[15]];
+            aes_sub_byte(expanded_key->round[i - 1].v8[15]);
         expanded_key->round[i].v8[3] =
-            aes_sbox[expanded_key->round[i - 1].v8[12]];
+            aes_sub_byte(expanded_key->round[i - 1].v8[12]);
 
         expanded_key->round[i].v32[0] ^= expanded_key->round[i - 1].v32[0];
 
@@ -1442,6 +1913,51 @@ static void aes_128_expand_encryption_key(const uint8_t *key,
     }
 }
 
+static void aes_192_expand_encryption_key(const uint8_t *key,
+                                          srtp_aes_expanded_key_t *expanded_key)
+{
+    /*
+     * the six word key schedule does not line up with the round keys, so
+     * generate all 52 words into a buffer and copy them out afterwards
+     */
+    uint8_t w[13 * 16];
+    uint8_t rc = 1;
+
+    expanded_key->num_rounds = 12;
+
+    memcpy(w, key, 24);
+
+    for (size_t i = 24; i < sizeof(w); i += 4) {
+        uint8_t t0 = w[i - 4];
+        uint8_t t1 = w[i - 3];
+        uint8_t t2 = w[i - 2];
+        uint8_t t3 = w[i - 1];
+
+        /* munge first word of each group of six */
+        if (i % 24 == 0) {
+            uint8_t tmp = t0;
+            t0 = aes_sub_byte(t1) ^ rc;
+            t1 = aes_sub_byte(t2);
+            t2 = aes_sub_byte(t3);
+            t3 = aes_sub_byte(tmp);
+
+            /* modify round constant */
+            rc = gf2_8_shift(rc);
+        }
+
+        w[i] = w[i - 24] ^ t0;
+        w[i + 1] = w[i - 23] ^ t1;
+        w[i + 2] = w[i - 22] ^ t2;
+        w[i + 3] = w[i - 21] ^ t3;
+    }
+
+    for (size_t i = 0; i < 13; i++) {
+        v128_copy_octet_string(&expanded_key->round[i], w + 16 * i);
+    }
+
+    octet_string_set_to_zero(w, sizeof(w));
+}
+
 static void aes_256_expand_encryption_key(const uint8_t *key,
                                           srtp_aes_expanded_key_t *expanded_key)
 {
@@ -1458,25 +1974,25 @@ static void aes_256_expand_encryption_key(const uint8_t *key,
         /* munge first word of round key */
         if ((i & 1) == 0) {
             expanded_key->round[i].v8[0] =
-                aes_sbox[expanded_key->round[i - 1].v8[13]] ^ rc;
+                aes_sub_byte(expanded_key->round[i - 1].v8[13]) ^ rc;
             expanded_key->round[i].v8[1] =
-                aes_sbox[expanded_key->round[i - 1].v8[14]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[14]);
             expanded_key->round[i].v8[2] =
-                aes_sbox[expanded_key->round[i - 1].v8[15]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[15]);
             expanded_key->round[i].v8[3] =
-                aes_sbox[expanded_key->round[i - 1].v8[12]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[12]);
 
             /* modify round constant */
             rc = gf2_8_shift(rc);
         } else {
             expanded_key->round[i].v8[0] =
-                aes_sbox[expanded_key->round[i - 1].v8[12]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[12]);
             expanded_key->round[i].v8[1] =
-                aes_sbox[expanded_key->round[i - 1].v8[13]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[13]);
             expanded_key->round[i].v8[2] =
-                aes_sbox[expanded_key->round[i - 1].v8[14]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[14]);
             expanded_key->round[i].v8[3] =
-                aes_sbox[expanded_key->round[i - 1].v8[15]];
+                aes_sub_byte(expanded_key->round[i - 1].v8[15]);
         }
 
         expanded_key->round[i].v32[0] ^= expanded_key->round[i - 2].v32[0];
@@ -1495,23 +2011,220 @@ static void aes_256_expand_encryption_key(const uint8_t *key,
     }
 }
 
-srtp_err_status_t srtp_aes_expand_encryption_key(
+#if defined(SRTP_AES_X86) || defined(SRTP_AES_ARMV8)
+
+/*
+ * aes_expand_key_words() runs the key schedule of FIPS-197 a word at a
+ * time for a key of nk words, sub_word(t) applies the S-box to each octet
+ * of t with the AES instructions, which take constant time
+ */
+#ifdef WORDS_BIGENDIAN
+#define aes_rot_word(t) (((t) << 8) | ((t) >> 24))
+#define aes_rcon_word(rc) ((uint32_t)(rc) << 24)
+#else
+#define aes_rot_word(t) (((t) >> 8) | ((t) << 24))
+#define aes_rcon_word(rc) ((uint32_t)(rc))
+#endif
+
+static inline void aes_expand_key_words(const uint8_t *key,
+                                        size_t nk,
+                                        srtp_aes_expanded_key_t *expanded_key,
+                                        uint32_t (*sub_word)(uint32_t))
+{
+    uint32_t w[15 * 4];
+    size_t num_rounds = nk + 6;
+    size_t num_words = 4 * (num_rounds + 1);
+    uint8_t rc = 1;
+
+    expanded_key->num_rounds = num_rounds;
+
+    memcpy(w, key, nk * 4);
+
+    for (size_t i = nk; i < num_words; i++) {
+        uint32_t t = w[i - 1];
+
+        if (i % nk == 0) {
+            t = sub_word(t);
+            t = aes_rot_word(t) ^ aes_rcon_word(rc);
+            rc = gf2_8_shift(rc);
+        } else if (nk == 8 && i % nk == 4) {
+            t = sub_word(t);
+        }
+        w[i] = w[i - nk] ^ t;
+    }
+
+    memcpy(expanded_key->round, w, num_words * 4);
+    octet_string_set_to_zero(w, sizeof(w));
+}
+
+#endif
+
+#if defined(SRTP_AES_X86)
+
+/*
+ * aeskeygenassist sets the first word of its result to the S-box applied
+ * to the second word of its input
+ */
+SRTP_AES_X86_TARGET
+static inline uint32_t srtp_aes_x86_sub_word(uint32_t t)
+{
+    __m128i x = _mm_shuffle_epi32(_mm_cvtsi32_si128((int)t), 0);
+
+    return (uint32_t)_mm_cvtsi128_si32(_mm_aeskeygenassist_si128(x, 0));
+}
+
+/*
+ * srtp_aes_x86_expand_step(prev, assist) returns the next round key of
+ * the 128 and 256 bit key schedules, given the preceding round key of the
+ * same parity and the word from aeskeygenassist broadcast to all of assist
+ */
+SRTP_AES_X86_TARGET
+static inline __m128i srtp_aes_x86_expand_step(__m128i prev, __m128i assist)
+{
+    prev = _mm_xor_si128(prev, _mm_slli_si128(prev, 4));
+    prev = _mm_xor_si128(prev, _mm_slli_si128(prev, 4));
+    prev = _mm_xor_si128(prev, _mm_slli_si128(prev, 4));
+    return _mm_xor_si128(prev, assist);
+}
+
+/* the round constant of aeskeygenassist has to be an immediate */
+#define srtp_aes_x86_expand_rot(prev, key, rcon)                               \
+    srtp_aes_x86_expand_step(                                                  \
+        (prev), _mm_shuffle_epi32(_mm_aeskeygenassist_si128((key), (rcon)),  \
+                                  0xff))
+#define srtp_aes_x86_expand_sub(prev, key)                                     \
+    srtp_aes_x86_expand_step(                                                  \
+        (prev), _mm_shuffle_epi32(_mm_aeskeygenassist_si128((key), 0), 0xaa))
+
+SRTP_AES_X86_TARGET
+static void srtp_aes_x86_expand_encryption_key(
     const uint8_t *key,
     size_t key_len,
     srtp_aes_expanded_key_t *expanded_key)
 {
+    __m128i rk[15];
+    size_t num_rounds;
+
+    if (key_len == 24) {
+        aes_expand_key_words(key, 6, expanded_key, srtp_aes_x86_sub_word);
+        return;
+    }
+
+    rk[0] = _mm_loadu_si128((const __m128i *)key);
     if (key_len == 16) {
-        aes_128_expand_encryption_key(key, expanded_key);
-        return srtp_err_status_ok;
-    } else if (key_len == 24) {
-        /* AES-192 not yet supported */
-        return srtp_err_status_bad_param;
-    } else if (key_len == 32) {
-        aes_256_expand_encryption_key(key, expanded_key);
-        return srtp_err_status_ok;
+        num_rounds = 10;
+        rk[1] = srtp_aes_x86_expand_rot(rk[0], rk[0], 0x01);
+        rk[2] = srtp_aes_x86_expand_rot(rk[1], rk[1], 0x02);
+        rk[3] = srtp_aes_x86_expand_rot(rk[2], rk[2], 0x04);
+        rk[4] = srtp_aes_x86_expand_rot(rk[3], rk[3], 0x08);
+        rk[5] = srtp_aes_x86_expand_rot(rk[4], rk[4], 0x10);
+        rk[6] = srtp_aes_x86_expand_rot(rk[5], rk[5], 0x20);
+        rk[7] = srtp_aes_x86_expand_rot(rk[6], rk[6], 0x40);
+        rk[8] = srtp_aes_x86_expand_rot(rk[7], rk[7], 0x80);
+        rk[9] = srtp_aes_x86_expand_rot(rk[8], rk[8], 0x1b);
+        rk[10] = srtp_aes_x86_expand_rot(rk[9], rk[9], 0x36);
     } else {
+        num_rounds = 14;
+        rk[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+        rk[2] = srtp_aes_x86_expand_rot(rk[0], rk[1], 0x01);
+        rk[3] = srtp_aes_x86_expand_sub(rk[1], rk[2]);
+        rk[4] = srtp_aes_x86_expand_rot(rk[2], rk[3], 0x02);
+        rk[5] = srtp_aes_x86_expand_sub(rk[3], rk[4]);
+        rk[6] = srtp_aes_x86_expand_rot(rk[4], rk[5], 0x04);
+        rk[7] = srtp_aes_x86_expand_sub(rk[5], rk[6]);
+        rk[8] = srtp_aes_x86_expand_rot(rk[6], rk[7], 0x08);
+        rk[9] = srtp_aes_x86_expand_sub(rk[7], rk[8]);
+        rk[10] = srtp_aes_x86_expand_rot(rk[8], rk[9], 0x10);
+        rk[11] = srtp_aes_x86_expand_sub(rk[9], rk[10]);
+        rk[12] = srtp_aes_x86_expand_rot(rk[10], rk[11], 0x20);
+        rk[13] = srtp_aes_x86_expand_sub(rk[11], rk[12]);
+        rk[14] = srtp_aes_x86_expand_rot(rk[12], rk[13], 0x40);
+    }
+
+    expanded_key->num_rounds = num_rounds;
+    for (size_t r = 0; r <= num_rounds; r++) {
+        _mm_storeu_si128((__m128i *)&expanded_key->round[r], rk[r]);
+    }
+}
+
+#elif defined(SRTP_AES_ARMV8)
+
+/*
+ * with the same word in every column ShiftRows moves nothing, so aese
+ * with a zero round key only applies the S-box
+ */
+SRTP_AES_ARMV8_TARGET
+static inline uint32_t srtp_aes_armv8_sub_word(uint32_t t)
+{
+    uint8x16_t x = vreinterpretq_u8_u32(vdupq_n_u32(t));
+
+    x = vaeseq_u8(x, vdupq_n_u8(0));
+    return vgetq_lane_u32(vreinterpretq_u32_u8(x), 0);
+}
+
+SRTP_AES_ARMV8_TARGET
+static void srtp_aes_armv8_expand_encryption_key(
+    const uint8_t *key,
+    size_t key_len,
+    srtp_aes_expanded_key_t *expanded_key)
+{
+    aes_expand_key_words(key, key_len / 4, expanded_key,
+                         srtp_aes_armv8_sub_word);
+}
+
+#endif
+
+/*
+ * aes_hw_expand_encryption_key(key, key_len, expanded_key) expands the key
+ * with the AES instructions and returns true, or returns false if the cpu
+ * has none
+ */
+static bool aes_hw_expand_encryption_key(const uint8_t *key,
+                                         size_t key_len,
+                                         srtp_aes_expanded_key_t *expanded_key)
+{
+#if defined(SRTP_AES_X86)
+    if (srtp_cpu_has(SRTP_CPU_AES | SRTP_CPU_SSE2)) {
+        srtp_aes_x86_expand_encryption_key(key, key_len, expanded_key);
+        return true;
+    }
+#elif defined(SRTP_AES_ARMV8)
+    if (srtp_cpu_has(SRTP_CPU_AES)) {
+        srtp_aes_armv8_expand_encryption_key(key, key_len, expanded_key);
+        return true;
+    }
+#else
+    (void)key;
+    (void)key_len;
+    (void)expanded_key;
+#endif
+    return false;
+}
+
+srtp_err_status_t srtp_aes_expand_encryption_key(
+    const uint8_t *key,
+    size_t key_len,
+    srtp_aes_expanded_key_t *expanded_key)
+{
+    if (key_len != 16 && key_len != 24 && key_len != 32) {
         return srtp_err_status_bad_param;
     }
+
+    if (!aes_hw_expand_encryption_key(key, key_len, expanded_key)) {
+        if (key_len == 16) {
+            aes_128_expand_encryption_key(key, expanded_key);
+        } else if (key_len == 24) {
+            aes_192_expand_encryption_key(key, expanded_key);
+        } else {
+            aes_256_expand_encryption_key(key, expanded_key);
+        }
+    }
+
+#ifdef ENABLE_AES_BITSLICE
+    aes_bitslice_round_keys(expanded_key);
+#endif
+
+    return srtp_err_status_ok;
 }
 
 srtp_err_status_t srtp_aes_expand_decryption_key(
@@ -1520,13 +2233,15 @@ srtp_err_status_t srtp_aes_expand_decryption_key(
     srtp_aes_expanded_key_t *expanded_key)
 {
     srtp_err_status_t status;
-    size_t num_rounds = expanded_key->num_rounds;
 
     status = srtp_aes_expand_encryption_key(key, key_len, expanded_key);
     if (status) {
         return status;
     }
 
+#ifndef ENABLE_AES_BITSLICE
+    size_t num_rounds = expanded_key->num_rounds;
+
     /* invert the order of the round keys */
     for (size_t i = 0; i < num_rounds / 2; i++) {
         v128_t tmp;
@@ -1639,11 +2354,16 @@ srtp_err_status_t srtp_aes_expand_decryption_key(
 
 #endif
     }
+#endif /* ! ENABLE_AES_BITSLICE */
 
     return srtp_err_status_ok;
 }
 
-#ifdef CPU_CISC
+#if defined(ENABLE_AES_BITSLICE)
+
+/* the rounds are done by aes_bitslice_encrypt() */
+
+#elif defined(CPU_CISC)
 
 static inline void aes_round(v128_t *state, const v128_t *round_key)
 {
@@ -2099,6 +2819,37 @@ static inline void aes_inv_final_round(v128_t *state, const v128_t *round_key)
 
 #endif /* CPU type */
 
+#ifdef ENABLE_AES_BITSLICE
+
+void srtp_aes_encrypt(v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
+{
+    aes_bitslice_encrypt(plaintext, 1, exp_key);
+}
+
+void srtp_aes_decrypt(v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
+{
+    uint64_t q[8] = { 0 };
+
+    aes_bitslice_interleave_in(&q[0], &q[4], plaintext->v8);
+    aes_bitslice_ortho(q);
+
+    aes_bitslice_add_round_key(q, exp_key->bitsliced[exp_key->num_rounds]);
+    for (size_t r = exp_key->num_rounds - 1; r > 0; r--) {
+        aes_bitslice_inv_shift_rows(q);
+        aes_bitslice_inv_sbox(q);
+        aes_bitslice_add_round_key(q, exp_key->bitsliced[r]);
+        aes_bitslice_inv_mix_columns(q);
+    }
+    aes_bitslice_inv_shift_rows(q);
+    aes_bitslice_inv_sbox(q);
+    aes_bitslice_add_round_key(q, exp_key->bitsliced[0]);
+
+    aes_bitslice_ortho(q);
+    aes_bitslice_interleave_out(plaintext->v8, q[0], q[4]);
+}
+
+#else
+
 void srtp_aes_encrypt(v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
 {
     /* add in the subkey */
@@ -2158,3 +2909,269 @@ void srtp_aes_decrypt(v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
         aes_inv_final_round(plaintext, &exp_key->round[14]);
     }
 }
+
+#endif /* ENABLE_AES_BITSLICE */
+
+/*
+ * number of blocks the hardware implementations keep in flight, the AES
+ * instructions are pipelined so independent blocks can overlap
+ */
+#define SRTP_AES_PARALLEL_BLOCKS 8
+
+#if defined(SRTP_AES_X86)
+
+SRTP_AES_X86_TARGET
+static void srtp_aes_x86_encrypt_blocks(v128_t *blocks,
+                                        size_t num_blocks,
+                                        const srtp_aes_expanded_key_t *exp_key)
+{
+    size_t num_rounds = exp_key->num_rounds;
+    __m128i rk[15];
+    __m128i b[SRTP_AES_PARALLEL_BLOCKS];
+
+    for (size_t r = 0; r <= num_rounds; r++) {
+        rk[r] = _mm_loadu_si128((const __m128i *)&exp_key->round[r]);
+    }
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_AES_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_AES_PARALLEL_BLOCKS;
+
+        for (size_t i = 0; i < n; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&blocks[i]),
+                                 rk[0]);
+        }
+        for (size_t r = 1; r < num_rounds; r++) {
+            for (size_t i = 0; i < n; i++) {
+                b[i] = _mm_aesenc_si128(b[i], rk[r]);
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], rk[num_rounds]);
+            _mm_storeu_si128((__m128i *)&blocks[i], b[i]);
+        }
+
+        blocks += n;
+        num_blocks -= n;
+    }
+}
+
+/*
+ * srtp_aes_x86_encrypt_blocks_keys() keeps blocks of different keys in
+ * flight together, a pass at a time; the blocks of a pass share the number
+ * of rounds, and full passes have their length fixed so that the blocks
+ * stay in registers
+ */
+SRTP_AES_X86_TARGET
+static inline void srtp_aes_x86_encrypt_pass_keys(
+    v128_t *blocks,
+    const srtp_aes_expanded_key_t *const *exp_keys,
+    size_t n,
+    size_t num_rounds)
+{
+    __m128i b[SRTP_AES_PARALLEL_BLOCKS];
+
+    for (size_t i = 0; i < n; i++) {
+        b[i] = _mm_xor_si128(
+            _mm_loadu_si128((const __m128i *)&blocks[i]),
+            _mm_loadu_si128((const __m128i *)&exp_keys[i]->round[0]));
+    }
+    for (size_t r = 1; r < num_rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            b[i] = _mm_aesenc_si128(
+                b[i], _mm_loadu_si128((const __m128i *)&exp_keys[i]->round[r]));
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        b[i] = _mm_aesenclast_si128(
+            b[i], _mm_loadu_si128(
+                      (const __m128i *)&exp_keys[i]->round[num_rounds]));
+        _mm_storeu_si128((__m128i *)&blocks[i], b[i]);
+    }
+}
+
+SRTP_AES_X86_TARGET
+static void srtp_aes_x86_encrypt_blocks_keys(
+    v128_t *blocks,
+    const srtp_aes_expanded_key_t *const *exp_keys,
+    size_t num_blocks)
+{
+    while (num_blocks > 0) {
+        size_t num_rounds = exp_keys[0]->num_rounds;
+        size_t n = 1;
+
+        while (n < num_blocks && n < SRTP_AES_PARALLEL_BLOCKS &&
+               exp_keys[n]->num_rounds == num_rounds) {
+            n++;
+        }
+
+        if (n == SRTP_AES_PARALLEL_BLOCKS) {
+            srtp_aes_x86_encrypt_pass_keys(
+                blocks, exp_keys, SRTP_AES_PARALLEL_BLOCKS, num_rounds);
+        } else {
+            srtp_aes_x86_encrypt_pass_keys(blocks, exp_keys, n, num_rounds);
+        }
+
+        blocks += n;
+        exp_keys += n;
+        num_blocks -= n;
+    }
+}
+
+#elif defined(SRTP_AES_ARMV8)
+
+SRTP_AES_ARMV8_TARGET
+static void srtp_aes_armv8_encrypt_blocks(
+    v128_t *blocks,
+    size_t num_blocks,
+    const srtp_aes_expanded_key_t *exp_key)
+{
+    size_t num_rounds = exp_key->num_rounds;
+    uint8x16_t rk[15];
+    uint8x16_t b[SRTP_AES_PARALLEL_BLOCKS];
+
+    for (size_t r = 0; r <= num_rounds; r++) {
+        rk[r] = vld1q_u8(exp_key->round[r].v8);
+    }
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_AES_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_AES_PARALLEL_BLOCKS;
+
+        for (size_t i = 0; i < n; i++) {
+            b[i] = vld1q_u8(blocks[i].v8);
+        }
+        /* aese does AddRoundKey, SubBytes and ShiftRows */
+        for (size_t r = 0; r < num_rounds - 1; r++) {
+            for (size_t i = 0; i < n; i++) {
+                b[i] = vaesmcq_u8(vaeseq_u8(b[i], rk[r]));
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            b[i] = veorq_u8(vaeseq_u8(b[i], rk[num_rounds - 1]),
+                            rk[num_rounds]);
+            vst1q_u8(blocks[i].v8, b[i]);
+        }
+
+        blocks += n;
+        num_blocks -= n;
+    }
+}
+
+SRTP_AES_ARMV8_TARGET
+static void srtp_aes_armv8_encrypt_blocks_keys(
+    v128_t *blocks,
+    const srtp_aes_expanded_key_t *const *exp_keys,
+    size_t num_blocks)
+{
+    uint8x16_t b[SRTP_AES_PARALLEL_BLOCKS];
+
+    while (num_blocks > 0) {
+        size_t num_rounds = exp_keys[0]->num_rounds;
+        size_t n = 1;
+
+        while (n < num_blocks && n < SRTP_AES_PARALLEL_BLOCKS &&
+               exp_keys[n]->num_rounds == num_rounds) {
+            n++;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            b[i] = vld1q_u8(blocks[i].v8);
+        }
+        for (size_t r = 0; r < num_rounds - 1; r++) {
+            for (size_t i = 0; i < n; i++) {
+                b[i] = vaesmcq_u8(
+                    vaeseq_u8(b[i], vld1q_u8(exp_keys[i]->round[r].v8)));
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            b[i] = veorq_u8(
+                vaeseq_u8(b[i],
+                          vld1q_u8(exp_keys[i]->round[num_rounds - 1].v8)),
+                vld1q_u8(exp_keys[i]->round[num_rounds].v8));
+            vst1q_u8(blocks[i].v8, b[i]);
+        }
+
+        blocks += n;
+        exp_keys += n;
+        num_blocks -= n;
+    }
+}
+
+#endif
+
+void srtp_aes_encrypt_blocks(v128_t *blocks,
+                             size_t num_blocks,
+                             const srtp_aes_expanded_key_t *exp_key)
+{
+#if defined(SRTP_AES_X86)
+    if (srtp_cpu_has(SRTP_CPU_AES | SRTP_CPU_SSE2)) {
+        srtp_aes_x86_encrypt_blocks(blocks, num_blocks, exp_key);
+        return;
+    }
+#elif defined(SRTP_AES_ARMV8)
+    if (srtp_cpu_has(SRTP_CPU_AES)) {
+        srtp_aes_armv8_encrypt_blocks(blocks, num_blocks, exp_key);
+        return;
+    }
+#endif
+
+#ifdef ENABLE_AES_BITSLICE
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_AES_BITSLICE_BLOCKS
+                       ? num_blocks
+                       : SRTP_AES_BITSLICE_BLOCKS;
+
+        aes_bitslice_encrypt(blocks, n, exp_key);
+        blocks += n;
+        num_blocks -= n;
+    }
+#else
+    for (size_t i = 0; i < num_blocks; i++) {
+        srtp_aes_encrypt(&blocks[i], exp_key);
+    }
+#endif
+}
+
+bool srtp_aes_keys_interleaved(void)
+{
+#if defined(SRTP_AES_X86)
+    return srtp_cpu_has(SRTP_CPU_AES | SRTP_CPU_SSE2);
+#elif defined(SRTP_AES_ARMV8)
+    return srtp_cpu_has(SRTP_CPU_AES);
+#else
+    return false;
+#endif
+}
+
+void srtp_aes_encrypt_blocks_keys(
+    v128_t *blocks,
+    const srtp_aes_expanded_key_t *const *exp_keys,
+    size_t num_blocks)
+{
+#if defined(SRTP_AES_X86)
+    if (srtp_cpu_has(SRTP_CPU_AES | SRTP_CPU_SSE2)) {
+        srtp_aes_x86_encrypt_blocks_keys(blocks, exp_keys, num_blocks);
+        return;
+    }
+#elif defined(SRTP_AES_ARMV8)
+    if (srtp_cpu_has(SRTP_CPU_AES)) {
+        srtp_aes_armv8_encrypt_blocks_keys(blocks, exp_keys, num_blocks);
+        return;
+    }
+#endif
+
+    while (num_blocks > 0) {
+        size_t n = 1;
+
+        while (n < num_blocks && exp_keys[n] == exp_keys[0]) {
+            n++;
+        }
+        srtp_aes_encrypt_blocks(blocks, n, exp_keys[0]);
+        blocks += n;
+        exp_keys += n;
+        num_blocks -= n;
+    }
+}
@@ -0,0 +1,1211 @@
+/*
+ * aes_gcm.c
+ *
+ * AES Galois Counter Mode using the built in AES implementation
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2013-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "aes_gcm.h"
+#include "alloc.h"
+#include "key_store.h"
+#include "err.h" /* for srtp_debug */
+#include "crypto_types.h"
+#include "cipher_types.h"
+#include "cipher_test_cases.h"
+#include "cpu_features.h"
+
+/*
+ * carry-less multiply support; when the cpu has it the counter mode
+ * keystream and GHASH are computed in a single loop, otherwise the
+ * blocks go through srtp_aes_encrypt_blocks() and a 4-bit table GHASH
+ */
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define SRTP_GCM_X86 1
+#define SRTP_GCM_X86_TARGET __attribute__((target("aes,pclmul,ssse3,sse2")))
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SRTP_GCM_X86 1
+#define SRTP_GCM_X86_TARGET
+#include <intrin.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#elif defined(__aarch64__) &&                                                 \
+    (defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO))
+#define SRTP_GCM_ARMV8 1
+#define SRTP_GCM_ARMV8_TARGET
+#include <arm_neon.h>
+#elif defined(__aarch64__) && defined(__linux__) && defined(__GNUC__) &&      \
+    !defined(__clang__) && __GNUC__ >= 9
+#define SRTP_GCM_ARMV8 1
+#define SRTP_GCM_ARMV8_TARGET __attribute__((target("+crypto")))
+#include <arm_neon.h>
+#endif
+
+srtp_debug_module_t srtp_mod_aes_gcm = {
+    false,    /* debugging is off by default */
+    "aes gcm" /* printable module name       */
+};
+
+/*
+ * For now we only support 8 and 16 octet tags.  The spec allows for
+ * optional 12 byte tag, which may be supported in the future.
+ */
+#define GCM_AUTH_TAG_LEN 16
+#define GCM_AUTH_TAG_LEN_8 8
+
+/* number of blocks hashed with a single reduction */
+#define SRTP_GCM_PARALLEL_BLOCKS 8
+
+static uint64_t srtp_gcm_load_be64(const uint8_t *p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+           ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+           ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+           ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static void srtp_gcm_store_be64(uint8_t *p, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static void srtp_gcm_inc32(v128_t *ctr)
+{
+    ctr->v32[3] = htonl(ntohl(ctr->v32[3]) + 1);
+}
+
+/*
+ * 4-bit table GHASH, HL[i] and HH[i] are the low and high halves of
+ * i * H, reduction of the four bits shifted out is done with last4
+ */
+static const uint16_t srtp_gcm_last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void srtp_gcm_table_init(srtp_aes_gcm_key_t *key, const v128_t *H)
+{
+    uint64_t vh = srtp_gcm_load_be64(H->v8);
+    uint64_t vl = srtp_gcm_load_be64(H->v8 + 8);
+
+    key->HH[0] = 0;
+    key->HL[0] = 0;
+    key->HH[8] = vh;
+    key->HL[8] = vl;
+
+    for (size_t i = 4; i > 0; i >>= 1) {
+        uint32_t T = (uint32_t)(vl & 1) * 0xe1000000U;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ ((uint64_t)T << 32);
+        key->HH[i] = vh;
+        key->HL[i] = vl;
+    }
+
+    for (size_t i = 2; i <= 8; i *= 2) {
+        vh = key->HH[i];
+        vl = key->HL[i];
+        for (size_t j = 1; j < i; j++) {
+            key->HH[i + j] = vh ^ key->HH[j];
+            key->HL[i + j] = vl ^ key->HL[j];
+        }
+    }
+}
+
+static void srtp_gcm_table_mult(const srtp_aes_gcm_key_t *key, v128_t *X)
+{
+    const uint8_t *x = X->v8;
+    uint64_t zh, zl;
+    uint8_t lo, hi, rem;
+
+    lo = x[15] & 0xf;
+    zh = key->HH[lo];
+    zl = key->HL[lo];
+
+    for (int i = 15; i >= 0; i--) {
+        lo = x[i] & 0xf;
+        hi = (x[i] >> 4) & 0xf;
+
+        if (i != 15) {
+            rem = (uint8_t)zl & 0xf;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ ((uint64_t)srtp_gcm_last4[rem] << 48);
+            zh ^= key->HH[lo];
+            zl ^= key->HL[lo];
+        }
+
+        rem = (uint8_t)zl & 0xf;
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ ((uint64_t)srtp_gcm_last4[rem] << 48);
+        zh ^= key->HH[hi];
+        zl ^= key->HL[hi];
+    }
+
+    srtp_gcm_store_be64(X->v8, zh);
+    srtp_gcm_store_be64(X->v8 + 8, zl);
+}
+
+#if defined(SRTP_GCM_X86)
+
+/*
+ * GHASH is bit reflected, byte reversing the blocks lets the carry-less
+ * multiply work on them directly at the cost of a one bit shift of the
+ * product
+ */
+SRTP_GCM_X86_TARGET
+static inline __m128i srtp_gcm_x86_bswap(__m128i x)
+{
+    return _mm_shuffle_epi8(
+        x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/* accumulates the 256 bit product of a and b into lo and hi */
+SRTP_GCM_X86_TARGET
+static inline void srtp_gcm_x86_mul_wide(__m128i a,
+                                         __m128i b,
+                                         __m128i *lo,
+                                         __m128i *hi)
+{
+    __m128i t3 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t4 = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                               _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i t6 = _mm_clmulepi64_si128(a, b, 0x11);
+
+    *lo = _mm_xor_si128(*lo, _mm_xor_si128(t3, _mm_slli_si128(t4, 8)));
+    *hi = _mm_xor_si128(*hi, _mm_xor_si128(t6, _mm_srli_si128(t4, 8)));
+}
+
+/* reduces the 256 bit product modulo x^128 + x^7 + x^2 + x + 1 */
+SRTP_GCM_X86_TARGET
+static inline __m128i srtp_gcm_x86_reduce(__m128i lo, __m128i hi)
+{
+    __m128i t2, t4, t5, t7, t8, t9;
+
+    t7 = _mm_srli_epi32(lo, 31);
+    t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(hi, t8);
+    hi = _mm_or_si128(hi, t9);
+
+    t7 = _mm_slli_epi32(lo, 31);
+    t8 = _mm_slli_epi32(lo, 30);
+    t9 = _mm_slli_epi32(lo, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    lo = _mm_xor_si128(lo, t7);
+
+    t2 = _mm_srli_epi32(lo, 1);
+    t4 = _mm_srli_epi32(lo, 2);
+    t5 = _mm_srli_epi32(lo, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    lo = _mm_xor_si128(lo, t2);
+
+    return _mm_xor_si128(hi, lo);
+}
+
+/*
+ * hashes up to SRTP_GCM_PARALLEL_BLOCKS blocks into X, block j of n is
+ * multiplied by H^(n-j) so that a single reduction is needed
+ */
+SRTP_GCM_X86_TARGET
+static inline __m128i srtp_gcm_x86_ghash_chunk(__m128i X,
+                                               const uint8_t *data,
+                                               size_t n,
+                                               const __m128i *hp)
+{
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+
+    for (size_t j = 0; j < n; j++) {
+        __m128i d = srtp_gcm_x86_bswap(
+            _mm_loadu_si128((const __m128i *)(data + 16 * j)));
+        if (j == 0) {
+            d = _mm_xor_si128(d, X);
+        }
+        srtp_gcm_x86_mul_wide(d, hp[n - 1 - j], &lo, &hi);
+    }
+
+    return srtp_gcm_x86_reduce(lo, hi);
+}
+
+SRTP_GCM_X86_TARGET
+static void srtp_gcm_x86_init_powers(srtp_aes_gcm_key_t *key, const v128_t *H)
+{
+    __m128i h = srtp_gcm_x86_bswap(_mm_loadu_si128((const __m128i *)H));
+    __m128i p = h;
+
+    _mm_storeu_si128((__m128i *)&key->H_pow[0], p);
+    for (size_t i = 1; i < SRTP_GCM_PARALLEL_BLOCKS; i++) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        srtp_gcm_x86_mul_wide(p, h, &lo, &hi);
+        p = srtp_gcm_x86_reduce(lo, hi);
+        _mm_storeu_si128((__m128i *)&key->H_pow[i], p);
+    }
+}
+
+SRTP_GCM_X86_TARGET
+static void srtp_gcm_x86_ghash(srtp_aes_gcm_ctx_t *c,
+                               const uint8_t *data,
+                               size_t num_blocks)
+{
+    __m128i hp[SRTP_GCM_PARALLEL_BLOCKS];
+    __m128i X = srtp_gcm_x86_bswap(_mm_loadu_si128((const __m128i *)&c->X));
+
+    for (size_t i = 0; i < SRTP_GCM_PARALLEL_BLOCKS; i++) {
+        hp[i] = _mm_loadu_si128((const __m128i *)&c->key->H_pow[i]);
+    }
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_GCM_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_GCM_PARALLEL_BLOCKS;
+        X = srtp_gcm_x86_ghash_chunk(X, data, n, hp);
+        data += 16 * n;
+        num_blocks -= n;
+    }
+
+    _mm_storeu_si128((__m128i *)&c->X, srtp_gcm_x86_bswap(X));
+}
+
+/*
+ * counter mode and GHASH over whole blocks; the ciphertext hashed in an
+ * iteration is independent of the AES rounds of that iteration so the
+ * two interleave, for encryption that is the previous chunk
+ */
+SRTP_GCM_X86_TARGET
+static void srtp_gcm_x86_crypt(srtp_aes_gcm_ctx_t *c,
+                               const uint8_t *src,
+                               uint8_t *dst,
+                               size_t num_blocks,
+                               bool decrypt)
+{
+    const srtp_aes_expanded_key_t *exp_key = &c->key->expanded_key;
+    size_t num_rounds = exp_key->num_rounds;
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i rk[15];
+    __m128i hp[SRTP_GCM_PARALLEL_BLOCKS];
+    __m128i b[SRTP_GCM_PARALLEL_BLOCKS];
+    __m128i X, ctr;
+    const uint8_t *hash_src = NULL;
+    size_t hash_n = 0;
+
+    for (size_t r = 0; r <= num_rounds; r++) {
+        rk[r] = _mm_loadu_si128((const __m128i *)&exp_key->round[r]);
+    }
+    for (size_t i = 0; i < SRTP_GCM_PARALLEL_BLOCKS; i++) {
+        hp[i] = _mm_loadu_si128((const __m128i *)&c->key->H_pow[i]);
+    }
+    X = srtp_gcm_x86_bswap(_mm_loadu_si128((const __m128i *)&c->X));
+    ctr = srtp_gcm_x86_bswap(_mm_loadu_si128((const __m128i *)&c->counter));
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_GCM_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_GCM_PARALLEL_BLOCKS;
+
+        /* the counter is byte reversed, so this is inc32() */
+        for (size_t i = 0; i < n; i++) {
+            b[i] = _mm_xor_si128(srtp_gcm_x86_bswap(ctr), rk[0]);
+            ctr = _mm_add_epi32(ctr, one);
+        }
+
+        if (decrypt) {
+            hash_src = src;
+            hash_n = n;
+        }
+        if (hash_n > 0) {
+            X = srtp_gcm_x86_ghash_chunk(X, hash_src, hash_n, hp);
+        }
+
+        for (size_t r = 1; r < num_rounds; r++) {
+            for (size_t i = 0; i < n; i++) {
+                b[i] = _mm_aesenc_si128(b[i], rk[r]);
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], rk[num_rounds]);
+            b[i] = _mm_xor_si128(
+                b[i], _mm_loadu_si128((const __m128i *)(src + 16 * i)));
+            _mm_storeu_si128((__m128i *)(dst + 16 * i), b[i]);
+        }
+
+        if (!decrypt) {
+            hash_src = dst;
+            hash_n = n;
+        }
+        src += 16 * n;
+        dst += 16 * n;
+        num_blocks -= n;
+    }
+
+    if (!decrypt && hash_n > 0) {
+        X = srtp_gcm_x86_ghash_chunk(X, hash_src, hash_n, hp);
+    }
+
+    _mm_storeu_si128((__m128i *)&c->X, srtp_gcm_x86_bswap(X));
+    _mm_storeu_si128((__m128i *)&c->counter, srtp_gcm_x86_bswap(ctr));
+}
+
+#elif defined(SRTP_GCM_ARMV8)
+
+/* NEON equivalents of the SSE byte and lane shifts */
+#define SRTP_GCM_SHL128(x, n) vextq_u8(vdupq_n_u8(0), (x), 16 - (n))
+#define SRTP_GCM_SHR128(x, n) vextq_u8((x), vdupq_n_u8(0), (n))
+#define SRTP_GCM_SHL32(x, n)                                                   \
+    vreinterpretq_u8_u32(vshlq_n_u32(vreinterpretq_u32_u8(x), (n)))
+#define SRTP_GCM_SHR32(x, n)                                                   \
+    vreinterpretq_u8_u32(vshrq_n_u32(vreinterpretq_u32_u8(x), (n)))
+
+SRTP_GCM_ARMV8_TARGET
+static inline uint8x16_t srtp_gcm_armv8_bswap(uint8x16_t x)
+{
+    uint8x16_t r = vrev64q_u8(x);
+    return vextq_u8(r, r, 8);
+}
+
+SRTP_GCM_ARMV8_TARGET
+static inline uint8x16_t srtp_gcm_armv8_pmull(uint8x16_t a,
+                                              int la,
+                                              uint8x16_t b,
+                                              int lb)
+{
+    uint64x2_t a64 = vreinterpretq_u64_u8(a);
+    uint64x2_t b64 = vreinterpretq_u64_u8(b);
+    poly64_t x = (poly64_t)(la ? vgetq_lane_u64(a64, 1)
+                               : vgetq_lane_u64(a64, 0));
+    poly64_t y = (poly64_t)(lb ? vgetq_lane_u64(b64, 1)
+                               : vgetq_lane_u64(b64, 0));
+    return vreinterpretq_u8_p128(vmull_p64(x, y));
+}
+
+SRTP_GCM_ARMV8_TARGET
+static inline void srtp_gcm_armv8_mul_wide(uint8x16_t a,
+                                           uint8x16_t b,
+                                           uint8x16_t *lo,
+                                           uint8x16_t *hi)
+{
+    uint8x16_t t3 = srtp_gcm_armv8_pmull(a, 0, b, 0);
+    uint8x16_t t4 = veorq_u8(srtp_gcm_armv8_pmull(a, 0, b, 1),
+                             srtp_gcm_armv8_pmull(a, 1, b, 0));
+    uint8x16_t t6 = srtp_gcm_armv8_pmull(a, 1, b, 1);
+
+    *lo = veorq_u8(*lo, veorq_u8(t3, SRTP_GCM_SHL128(t4, 8)));
+    *hi = veorq_u8(*hi, veorq_u8(t6, SRTP_GCM_SHR128(t4, 8)));
+}
+
+SRTP_GCM_ARMV8_TARGET
+static inline uint8x16_t srtp_gcm_armv8_reduce(uint8x16_t lo, uint8x16_t hi)
+{
+    uint8x16_t t2, t4, t5, t7, t8, t9;
+
+    t7 = SRTP_GCM_SHR32(lo, 31);
+    t8 = SRTP_GCM_SHR32(hi, 31);
+    lo = SRTP_GCM_SHL32(lo, 1);
+    hi = SRTP_GCM_SHL32(hi, 1);
+    t9 = SRTP_GCM_SHR128(t7, 12);
+    t8 = SRTP_GCM_SHL128(t8, 4);
+    t7 = SRTP_GCM_SHL128(t7, 4);
+    lo = vorrq_u8(lo, t7);
+    hi = vorrq_u8(hi, t8);
+    hi = vorrq_u8(hi, t9);
+
+    t7 = SRTP_GCM_SHL32(lo, 31);
+    t8 = SRTP_GCM_SHL32(lo, 30);
+    t9 = SRTP_GCM_SHL32(lo, 25);
+    t7 = veorq_u8(t7, t8);
+    t7 = veorq_u8(t7, t9);
+    t8 = SRTP_GCM_SHR128(t7, 4);
+    t7 = SRTP_GCM_SHL128(t7, 12);
+    lo = veorq_u8(lo, t7);
+
+    t2 = SRTP_GCM_SHR32(lo, 1);
+    t4 = SRTP_GCM_SHR32(lo, 2);
+    t5 = SRTP_GCM_SHR32(lo, 7);
+    t2 = veorq_u8(t2, t4);
+    t2 = veorq_u8(t2, t5);
+    t2 = veorq_u8(t2, t8);
+    lo = veorq_u8(lo, t2);
+
+    return veorq_u8(hi, lo);
+}
+
+SRTP_GCM_ARMV8_TARGET
+static inline uint8x16_t srtp_gcm_armv8_ghash_chunk(uint8x16_t X,
+                                                    const uint8_t *data,
+                                                    size_t n,
+                                                    const uint8x16_t *hp)
+{
+    uint8x16_t lo = vdupq_n_u8(0);
+    uint8x16_t hi = vdupq_n_u8(0);
+
+    for (size_t j = 0; j < n; j++) {
+        uint8x16_t d = srtp_gcm_armv8_bswap(vld1q_u8(data + 16 * j));
+        if (j == 0) {
+            d = veorq_u8(d, X);
+        }
+        srtp_gcm_armv8_mul_wide(d, hp[n - 1 - j], &lo, &hi);
+    }
+
+    return srtp_gcm_armv8_reduce(lo, hi);
+}
+
+SRTP_GCM_ARMV8_TARGET
+static void srtp_gcm_armv8_init_powers(srtp_aes_gcm_key_t *key,
+                                       const v128_t *H)
+{
+    uint8x16_t h = srtp_gcm_armv8_bswap(vld1q_u8(H->v8));
+    uint8x16_t p = h;
+
+    vst1q_u8(key->H_pow[0].v8, p);
+    for (size_t i = 1; i < SRTP_GCM_PARALLEL_BLOCKS; i++) {
+        uint8x16_t lo = vdupq_n_u8(0);
+        uint8x16_t hi = vdupq_n_u8(0);
+        srtp_gcm_armv8_mul_wide(p, h, &lo, &hi);
+        p = srtp_gcm_armv8_reduce(lo, hi);
+        vst1q_u8(key->H_pow[i].v8, p);
+    }
+}
+
+SRTP_GCM_ARMV8_TARGET
+static void srtp_gcm_armv8_ghash(srtp_aes_gcm_ctx_t *c,
+                                 const uint8_t *data,
+                                 size_t num_blocks)
+{
+    uint8x16_t hp[SRTP_GCM_PARALLEL_BLOCKS];
+    uint8x16_t X = srtp_gcm_armv8_bswap(vld1q_u8(c->X.v8));
+
+    for (size_t i = 0; i < SRTP_GCM_PARALLEL_BLOCKS; i++) {
+        hp[i] = vld1q_u8(c->key->H_pow[i].v8);
+    }
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_GCM_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_GCM_PARALLEL_BLOCKS;
+        X = srtp_gcm_armv8_ghash_chunk(X, data, n, hp);
+        data += 16 * n;
+        num_blocks -= n;
+    }
+
+    vst1q_u8(c->X.v8, srtp_gcm_armv8_bswap(X));
+}
+
+SRTP_GCM_ARMV8_TARGET
+static void srtp_gcm_armv8_crypt(srtp_aes_gcm_ctx_t *c,
+                                 const uint8_t *src,
+                                 uint8_t *dst,
+                                 size_t num_blocks,
+                                 bool decrypt)
+{
+    const srtp_aes_expanded_key_t *exp_key = &c->key->expanded_key;
+    size_t num_rounds = exp_key->num_rounds;
+    const uint32x4_t one = vsetq_lane_u32(1, vdupq_n_u32(0), 0);
+    uint8x16_t rk[15];
+    uint8x16_t hp[SRTP_GCM_PARALLEL_BLOCKS];
+    uint8x16_t b[SRTP_GCM_PARALLEL_BLOCKS];
+    uint8x16_t X;
+    uint32x4_t ctr;
+    const uint8_t *hash_src = NULL;
+    size_t hash_n = 0;
+
+    for (size_t r = 0; r <= num_rounds; r++) {
+        rk[r] = vld1q_u8(exp_key->round[r].v8);
+    }
+    for (size_t i = 0; i < SRTP_GCM_PARALLEL_BLOCKS; i++) {
+        hp[i] = vld1q_u8(c->key->H_pow[i].v8);
+    }
+    X = srtp_gcm_armv8_bswap(vld1q_u8(c->X.v8));
+    ctr = vreinterpretq_u32_u8(srtp_gcm_armv8_bswap(vld1q_u8(c->counter.v8)));
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_GCM_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_GCM_PARALLEL_BLOCKS;
+
+        /* the counter is byte reversed, so this is inc32() */
+        for (size_t i = 0; i < n; i++) {
+            b[i] = srtp_gcm_armv8_bswap(vreinterpretq_u8_u32(ctr));
+            ctr = vaddq_u32(ctr, one);
+        }
+
+        if (decrypt) {
+            hash_src = src;
+            hash_n = n;
+        }
+        if (hash_n > 0) {
+            X = srtp_gcm_armv8_ghash_chunk(X, hash_src, hash_n, hp);
+        }
+
+        /* aese does AddRoundKey, SubBytes and ShiftRows */
+        for (size_t r = 0; r < num_rounds - 1; r++) {
+            for (size_t i = 0; i < n; i++) {
+                b[i] = vaesmcq_u8(vaeseq_u8(b[i], rk[r]));
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            b[i] = veorq_u8(vaeseq_u8(b[i], rk[num_rounds - 1]),
+                            rk[num_rounds]);
+            vst1q_u8(dst + 16 * i, veorq_u8(b[i], vld1q_u8(src + 16 * i)));
+        }
+
+        if (!decrypt) {
+            hash_src = dst;
+            hash_n = n;
+        }
+        src += 16 * n;
+        dst += 16 * n;
+        num_blocks -= n;
+    }
+
+    if (!decrypt && hash_n > 0) {
+        X = srtp_gcm_armv8_ghash_chunk(X, hash_src, hash_n, hp);
+    }
+
+    vst1q_u8(c->X.v8, srtp_gcm_armv8_bswap(X));
+    vst1q_u8(c->counter.v8, srtp_gcm_armv8_bswap(vreinterpretq_u8_u32(ctr)));
+}
+
+#endif
+
+/*
+ * the features never change once probed, so the keys prepared in
+ * srtp_aes_gcm_context_init() match the code used with them
+ */
+static bool srtp_gcm_hw_available(void)
+{
+#if defined(SRTP_GCM_X86)
+    return srtp_cpu_has(SRTP_CPU_AES | SRTP_CPU_CLMUL | SRTP_CPU_SSSE3 |
+                        SRTP_CPU_SSE2);
+#elif defined(SRTP_GCM_ARMV8)
+    return srtp_cpu_has(SRTP_CPU_AES | SRTP_CPU_CLMUL);
+#else
+    return false;
+#endif
+}
+
+static void srtp_aes_gcm_ghash(srtp_aes_gcm_ctx_t *c,
+                               const uint8_t *data,
+                               size_t num_blocks)
+{
+#if defined(SRTP_GCM_X86)
+    if (srtp_gcm_hw_available()) {
+        srtp_gcm_x86_ghash(c, data, num_blocks);
+        return;
+    }
+#elif defined(SRTP_GCM_ARMV8)
+    if (srtp_gcm_hw_available()) {
+        srtp_gcm_armv8_ghash(c, data, num_blocks);
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        for (size_t j = 0; j < 16; j++) {
+            c->X.v8[j] ^= data[16 * i + j];
+        }
+        srtp_gcm_table_mult(c->key, &c->X);
+    }
+}
+
+/*
+ * counter mode and GHASH over whole blocks, for decryption the
+ * ciphertext is hashed before it is overwritten so src may equal dst
+ */
+static void srtp_aes_gcm_crypt_blocks(srtp_aes_gcm_ctx_t *c,
+                                      const uint8_t *src,
+                                      uint8_t *dst,
+                                      size_t num_blocks,
+                                      bool decrypt)
+{
+    v128_t ks[SRTP_GCM_PARALLEL_BLOCKS];
+
+#if defined(SRTP_GCM_X86)
+    if (srtp_gcm_hw_available()) {
+        srtp_gcm_x86_crypt(c, src, dst, num_blocks, decrypt);
+        return;
+    }
+#elif defined(SRTP_GCM_ARMV8)
+    if (srtp_gcm_hw_available()) {
+        srtp_gcm_armv8_crypt(c, src, dst, num_blocks, decrypt);
+        return;
+    }
+#endif
+
+    while (num_blocks > 0) {
+        size_t n = num_blocks < SRTP_GCM_PARALLEL_BLOCKS
+                       ? num_blocks
+                       : SRTP_GCM_PARALLEL_BLOCKS;
+
+        for (size_t i = 0; i < n; i++) {
+            ks[i] = c->counter;
+            srtp_gcm_inc32(&c->counter);
+        }
+        srtp_aes_encrypt_blocks(ks, n, &c->key->expanded_key);
+
+        if (decrypt) {
+            srtp_aes_gcm_ghash(c, src, n);
+        }
+        for (size_t i = 0; i < 16 * n; i++) {
+            dst[i] = src[i] ^ ks[i / 16].v8[i % 16];
+        }
+        if (!decrypt) {
+            srtp_aes_gcm_ghash(c, dst, n);
+        }
+
+        src += 16 * n;
+        dst += 16 * n;
+        num_blocks -= n;
+    }
+
+    octet_string_set_to_zero(ks, sizeof(ks));
+}
+
+/*
+ * counter mode and GHASH over len octets, a partial last block is hashed
+ * zero padded
+ */
+static void srtp_aes_gcm_crypt(srtp_aes_gcm_ctx_t *c,
+                               const uint8_t *src,
+                               uint8_t *dst,
+                               size_t len,
+                               bool decrypt)
+{
+    size_t num_blocks = len / 16;
+    size_t tail = len % 16;
+
+    if (num_blocks > 0) {
+        srtp_aes_gcm_crypt_blocks(c, src, dst, num_blocks, decrypt);
+        src += 16 * num_blocks;
+        dst += 16 * num_blocks;
+    }
+
+    if (tail > 0) {
+        v128_t ks = c->counter;
+        uint8_t block[16] = { 0 };
+
+        srtp_gcm_inc32(&c->counter);
+        srtp_aes_encrypt_blocks(&ks, 1, &c->key->expanded_key);
+
+        if (decrypt) {
+            memcpy(block, src, tail);
+        }
+        for (size_t i = 0; i < tail; i++) {
+            dst[i] = src[i] ^ ks.v8[i];
+        }
+        if (!decrypt) {
+            memcpy(block, dst, tail);
+        }
+        srtp_aes_gcm_ghash(c, block, 1);
+
+        octet_string_set_to_zero(&ks, sizeof(ks));
+    }
+}
+
+/* hashes any AAD left in aad_buf, zero padded to a whole block */
+static void srtp_aes_gcm_flush_aad(srtp_aes_gcm_ctx_t *c)
+{
+    if (c->aad_buf_len > 0) {
+        memset(c->aad_buf + c->aad_buf_len, 0, 16 - c->aad_buf_len);
+        srtp_aes_gcm_ghash(c, c->aad_buf, 1);
+        c->aad_buf_len = 0;
+    }
+}
+
+/* computes the full 16 octet tag once all AAD and data are hashed */
+static void srtp_aes_gcm_compute_tag(srtp_aes_gcm_ctx_t *c,
+                                     size_t data_len,
+                                     uint8_t *tag)
+{
+    uint8_t len_block[16];
+    v128_t ek = c->J0;
+
+    srtp_gcm_store_be64(len_block, c->aad_len * 8);
+    srtp_gcm_store_be64(len_block + 8, (uint64_t)data_len * 8);
+    srtp_aes_gcm_ghash(c, len_block, 1);
+
+    srtp_aes_encrypt_blocks(&ek, 1, &c->key->expanded_key);
+    for (size_t i = 0; i < 16; i++) {
+        tag[i] = c->X.v8[i] ^ ek.v8[i];
+    }
+
+    octet_string_set_to_zero(&ek, sizeof(ek));
+}
+
+/*
+ * This function allocates a new instance of this crypto engine.
+ * The key_len parameter should be one of 28 or 44 for
+ * AES-128-GCM or AES-256-GCM respectively.  Note that the
+ * key length includes the 14 byte salt value that is used when
+ * initializing the KDF.
+ */
+static srtp_err_status_t srtp_aes_gcm_alloc(srtp_cipher_t **c,
+                                            size_t key_len,
+                                            size_t tlen)
+{
+    srtp_aes_gcm_ctx_t *gcm;
+
+    debug_print(srtp_mod_aes_gcm, "allocating cipher with key length %zu",
+                key_len);
+    debug_print(srtp_mod_aes_gcm, "allocating cipher with tag length %zu",
+                tlen);
+
+    /*
+     * Verify the key_len is valid for one of: AES-128/256
+     */
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    if (tlen != GCM_AUTH_TAG_LEN && tlen != GCM_AUTH_TAG_LEN_8) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* allocate memory a cipher of type aes_gcm */
+    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
+    if (*c == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    gcm = (srtp_aes_gcm_ctx_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_aes_gcm_ctx_t), SRTP_CACHE_LINE_SIZE);
+    if (gcm == NULL) {
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    /* set pointers */
+    (*c)->state = gcm;
+
+    /* setup cipher attributes */
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+        (*c)->type = &srtp_aes_gcm_128;
+        (*c)->algorithm = SRTP_AES_GCM_128;
+        gcm->key_size = SRTP_AES_128_KEY_LEN;
+        break;
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+        (*c)->type = &srtp_aes_gcm_256;
+        (*c)->algorithm = SRTP_AES_GCM_256;
+        gcm->key_size = SRTP_AES_256_KEY_LEN;
+        break;
+#endif
+    }
+    gcm->tag_len = tlen;
+
+    /* set key size        */
+    (*c)->key_len = key_len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function deallocates a GCM session
+ */
+static srtp_err_status_t srtp_aes_gcm_dealloc(srtp_cipher_t *c)
+{
+    srtp_aes_gcm_ctx_t *ctx;
+
+    ctx = (srtp_aes_gcm_ctx_t *)c->state;
+    if (ctx) {
+        srtp_key_store_release(ctx->key);
+
+        /* zeroize the key material */
+        octet_string_set_to_zero(ctx, sizeof(srtp_aes_gcm_ctx_t));
+        srtp_crypto_free(ctx);
+    }
+
+    /* free memory */
+    srtp_crypto_free(c);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * aes_gcm_expand_key(key, key_len, expanded) expands the key and derives
+ * the hash key H = E(K, 0^128) and its multiples, this is what the key
+ * store keeps for aes_gcm contexts
+ */
+static srtp_err_status_t srtp_aes_gcm_expand_key(const uint8_t *key,
+                                                 size_t key_len,
+                                                 void *expanded)
+{
+    srtp_aes_gcm_key_t *k = (srtp_aes_gcm_key_t *)expanded;
+    srtp_err_status_t status;
+    v128_t H;
+
+    status = srtp_aes_expand_encryption_key(key, key_len, &k->expanded_key);
+    if (status) {
+        return status;
+    }
+
+    v128_set_to_zero(&H);
+    srtp_aes_encrypt_blocks(&H, 1, &k->expanded_key);
+
+#if defined(SRTP_GCM_X86)
+    if (srtp_gcm_hw_available()) {
+        srtp_gcm_x86_init_powers(k, &H);
+    } else {
+        srtp_gcm_table_init(k, &H);
+    }
+#elif defined(SRTP_GCM_ARMV8)
+    if (srtp_gcm_hw_available()) {
+        srtp_gcm_armv8_init_powers(k, &H);
+    } else {
+        srtp_gcm_table_init(k, &H);
+    }
+#else
+    srtp_gcm_table_init(k, &H);
+#endif
+
+    octet_string_set_to_zero(&H, sizeof(H));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * aes_gcm_context_init(...) initializes the aes_gcm_context using the
+ * value in key[], the expanded key is shared with the other contexts
+ * that are keyed with the same key
+ *
+ * the key is the secret key
+ */
+static srtp_err_status_t srtp_aes_gcm_context_init(void *cv, const uint8_t *key)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    srtp_err_status_t status;
+    const void *expanded_key;
+
+    c->dir = srtp_direction_any;
+
+    debug_print(srtp_mod_aes_gcm, "key:  %s",
+                srtp_octet_string_hex_string(key, c->key_size));
+
+    if (c->key_size != SRTP_AES_128_KEY_LEN &&
+        c->key_size != SRTP_AES_256_KEY_LEN) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_key_store_release(c->key);
+    c->key = NULL;
+    status = srtp_key_store_acquire(srtp_aes_gcm_expand_key, key, c->key_size,
+                                    sizeof(srtp_aes_gcm_key_t), &expanded_key);
+    if (status) {
+        return status;
+    }
+    c->key = (const srtp_aes_gcm_key_t *)expanded_key;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * aes_gcm_set_iv(c, iv) sets J0 to the 12 octet iv followed by a 32 bit
+ * counter of one and resets the GHASH state
+ */
+static srtp_err_status_t srtp_aes_gcm_set_iv(void *cv,
+                                             uint8_t *iv,
+                                             srtp_cipher_direction_t direction)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    if (direction != srtp_direction_encrypt &&
+        direction != srtp_direction_decrypt) {
+        return srtp_err_status_bad_param;
+    }
+    c->dir = direction;
+
+    debug_trace(srtp_mod_aes_gcm, "setting iv: %s",
+                srtp_octet_string_hex_string(iv, 12));
+
+    memcpy(c->J0.v8, iv, 12);
+    c->J0.v32[3] = htonl(1);
+    c->counter = c->J0;
+    srtp_gcm_inc32(&c->counter);
+
+    v128_set_to_zero(&c->X);
+    c->aad_buf_len = 0;
+    c->aad_len = 0;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function processes the AAD, it may be called more than once
+ * before the data is encrypted or decrypted
+ *
+ * Parameters:
+ *	cv	Crypto context
+ *	aad	Additional data to process for AEAD cipher suites
+ *	aad_len	length of aad buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_set_aad(void *cv,
+                                              const uint8_t *aad,
+                                              size_t aad_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    debug_trace(srtp_mod_aes_gcm, "setting AAD: %s",
+                srtp_octet_string_hex_string(aad, aad_len));
+
+    if (c->dir != srtp_direction_encrypt &&
+        c->dir != srtp_direction_decrypt) {
+        return srtp_err_status_bad_param;
+    }
+
+    c->aad_len += aad_len;
+
+    if (c->aad_buf_len > 0) {
+        size_t n = 16 - c->aad_buf_len;
+        if (n > aad_len) {
+            n = aad_len;
+        }
+        memcpy(c->aad_buf + c->aad_buf_len, aad, n);
+        c->aad_buf_len += n;
+        aad += n;
+        aad_len -= n;
+        if (c->aad_buf_len == 16) {
+            srtp_aes_gcm_ghash(c, c->aad_buf, 1);
+            c->aad_buf_len = 0;
+        }
+    }
+
+    if (aad_len >= 16) {
+        size_t num_blocks = aad_len / 16;
+        srtp_aes_gcm_ghash(c, aad, num_blocks);
+        aad += 16 * num_blocks;
+        aad_len -= 16 * num_blocks;
+    }
+
+    if (aad_len > 0) {
+        memcpy(c->aad_buf, aad, aad_len);
+        c->aad_buf_len = aad_len;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function encrypts a buffer using AES GCM mode and appends the tag
+ *
+ * Parameters:
+ *	cv	Crypto context
+ *	src	data to encrypt
+ *	src_len	length of src
+ *	dst	receives the ciphertext and the tag, may equal src
+ *	dst_len	size of dst, set to src_len plus the tag length
+ */
+static srtp_err_status_t srtp_aes_gcm_encrypt(void *cv,
+                                              const uint8_t *src,
+                                              size_t src_len,
+                                              uint8_t *dst,
+                                              size_t *dst_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    uint8_t tag[GCM_AUTH_TAG_LEN];
+
+    if (c->dir != srtp_direction_encrypt) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (*dst_len < src_len + c->tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    srtp_aes_gcm_flush_aad(c);
+    srtp_aes_gcm_crypt(c, src, dst, src_len, false);
+    srtp_aes_gcm_compute_tag(c, src_len, tag);
+
+    memcpy(dst + src_len, tag, c->tag_len);
+    *dst_len = src_len + c->tag_len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function decrypts a buffer using AES GCM mode and checks its tag,
+ * on a tag mismatch the decrypted data is wiped
+ *
+ * Parameters:
+ *	cv	Crypto context
+ *	src	ciphertext followed by the tag
+ *	src_len	length of src, tag included
+ *	dst	receives the plaintext, may equal src
+ *	dst_len	size of dst, set to the length of the plaintext
+ */
+static srtp_err_status_t srtp_aes_gcm_decrypt(void *cv,
+                                              const uint8_t *src,
+                                              size_t src_len,
+                                              uint8_t *dst,
+                                              size_t *dst_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    uint8_t tag[GCM_AUTH_TAG_LEN];
+    uint8_t expected[GCM_AUTH_TAG_LEN];
+    size_t len;
+
+    if (c->dir != srtp_direction_decrypt) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (src_len < c->tag_len) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (*dst_len < src_len - c->tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    len = src_len - c->tag_len;
+    memcpy(expected, src + len, c->tag_len);
+
+    srtp_aes_gcm_flush_aad(c);
+    srtp_aes_gcm_crypt(c, src, dst, len, true);
+    srtp_aes_gcm_compute_tag(c, len, tag);
+
+    if (!srtp_octet_string_equal(tag, expected, c->tag_len)) {
+        if (len) {
+            octet_string_set_to_zero(dst, len);
+        }
+        return srtp_err_status_auth_fail;
+    }
+    *dst_len = len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function creates a context with a copy of the key schedule and
+ * hash key of an initialized one
+ */
+static srtp_err_status_t srtp_aes_gcm_clone(const srtp_cipher_t *c,
+                                            srtp_cipher_t **clone)
+{
+    const srtp_aes_gcm_ctx_t *gcm = (const srtp_aes_gcm_ctx_t *)c->state;
+    srtp_aes_gcm_ctx_t *new_gcm;
+    srtp_err_status_t status;
+
+    status = srtp_aes_gcm_alloc(clone, c->key_len, gcm->tag_len);
+    if (status) {
+        return status;
+    }
+
+    new_gcm = (srtp_aes_gcm_ctx_t *)(*clone)->state;
+    new_gcm->key = gcm->key;
+    srtp_key_store_retain(gcm->key);
+    new_gcm->dir = srtp_direction_any;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * Name of this crypto engine
+ */
+static const char srtp_aes_gcm_128_description[] = "AES-128 GCM";
+#ifndef SRTP_NO_AES_256
+static const char srtp_aes_gcm_256_description[] = "AES-256 GCM";
+#endif
+
+/*
+ * This is the vector function table for this crypto engine.
+ */
+/* clang-format off */
+const srtp_cipher_type_t srtp_aes_gcm_128 = {
+    srtp_aes_gcm_alloc,
+    srtp_aes_gcm_dealloc,
+    srtp_aes_gcm_context_init,
+    srtp_aes_gcm_set_aad,
+    srtp_aes_gcm_encrypt,
+    srtp_aes_gcm_decrypt,
+    srtp_aes_gcm_set_iv,
+    srtp_aes_gcm_128_description,
+    &srtp_aes_gcm_128_test_case_0,
+    SRTP_AES_GCM_128,
+    srtp_aes_gcm_clone,
+    NULL,
+    NULL
+};
+/* clang-format on */
+
+#ifndef SRTP_NO_AES_256
+/*
+ * This is the vector function table for this crypto engine.
+ */
+/* clang-format off */
+const srtp_cipher_type_t srtp_aes_gcm_256 = {
+    srtp_aes_gcm_alloc,
+    srtp_aes_gcm_dealloc,
+    srtp_aes_gcm_context_init,
+    srtp_aes_gcm_set_aad,
+    srtp_aes_gcm_encrypt,
+    srtp_aes_gcm_decrypt,
+    srtp_aes_gcm_set_iv,
+    srtp_aes_gcm_256_description,
+    &srtp_aes_gcm_256_test_case_0,
+    SRTP_AES_GCM_256,
+    srtp_aes_gcm_clone,
+    NULL,
+    NULL
+};
+/* clang-format on */
+#endif
@@ -0,0 +1,534 @@
+/*
+ * aes_gcm_cng.c
+ *
+ * AES Galois Counter Mode using the Windows CNG (bcrypt) API
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "aes_gcm.h"
+#include "alloc.h"
+#include "err.h" /* for srtp_debug */
+#include "crypto_types.h"
+#include "cipher_types.h"
+#include "cipher_test_cases.h"
+
+srtp_debug_module_t srtp_mod_aes_gcm = {
+    false,        /* debugging is off by default */
+    "aes gcm cng" /* printable module name       */
+};
+
+/*
+ * For now we only support 8 and 16 octet tags.  The spec allows for
+ * optional 12 byte tag, which may be supported in the future.
+ *
+ * CNG only computes tags of 12 to 16 octets, so the full tag is always
+ * computed and 8 octet tags are its truncation.
+ */
+#define GCM_IV_LEN 12
+#define GCM_AUTH_TAG_LEN 16
+#define GCM_AUTH_TAG_LEN_8 8
+
+/* returned by BCryptDecrypt() when the tag does not match */
+#ifndef STATUS_AUTH_TAG_MISMATCH
+#define STATUS_AUTH_TAG_MISMATCH ((NTSTATUS)0xC000A002L)
+#endif
+
+/* octets re-encrypted per call to check a truncated tag */
+#define SRTP_AES_GCM_CNG_CHUNK 512
+
+/*
+ * This function allocates a new instance of this crypto engine.
+ * The key_len parameter should be one of 28 or 44 for
+ * AES-128-GCM or AES-256-GCM respectively.  Note that the
+ * key length includes the 14 byte salt value that is used when
+ * initializing the KDF.
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_alloc(srtp_cipher_t **c,
+                                                size_t key_len,
+                                                size_t tlen)
+{
+    srtp_aes_gcm_ctx_t *gcm;
+    BCRYPT_ALG_HANDLE alg;
+
+    debug_print(srtp_mod_aes_gcm, "allocating cipher with key length %zu",
+                key_len);
+    debug_print(srtp_mod_aes_gcm, "allocating cipher with tag length %zu",
+                tlen);
+
+    /*
+     * Verify the key_len is valid for one of: AES-128/256
+     */
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
+        return (srtp_err_status_bad_param);
+    }
+
+    if (tlen != GCM_AUTH_TAG_LEN && tlen != GCM_AUTH_TAG_LEN_8) {
+        return (srtp_err_status_bad_param);
+    }
+
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(
+            &alg, BCRYPT_AES_ALGORITHM, NULL, 0))) {
+        return (srtp_err_status_cipher_fail);
+    }
+    if (!BCRYPT_SUCCESS(BCryptSetProperty(
+            alg, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_GCM,
+            sizeof(BCRYPT_CHAIN_MODE_GCM), 0))) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return (srtp_err_status_cipher_fail);
+    }
+
+    /* allocate memory a cipher of type aes_gcm */
+    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
+    if (*c == NULL) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return (srtp_err_status_alloc_fail);
+    }
+
+    gcm = (srtp_aes_gcm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_gcm_ctx_t));
+    if (gcm == NULL) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return (srtp_err_status_alloc_fail);
+    }
+
+    gcm->alg = alg;
+    gcm->key = NULL;
+
+    /* set pointers */
+    (*c)->state = gcm;
+
+    /* setup cipher attributes */
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+        (*c)->type = &srtp_aes_gcm_128;
+        (*c)->algorithm = SRTP_AES_GCM_128;
+        gcm->key_size = SRTP_AES_128_KEY_LEN;
+        gcm->tag_size = tlen;
+        break;
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+        (*c)->type = &srtp_aes_gcm_256;
+        (*c)->algorithm = SRTP_AES_GCM_256;
+        gcm->key_size = SRTP_AES_256_KEY_LEN;
+        gcm->tag_size = tlen;
+        break;
+#endif
+    default:
+        /* this should never hit, but to be sure... */
+        return (srtp_err_status_bad_param);
+    }
+
+    /* set key size and tag size*/
+    (*c)->key_len = key_len;
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function deallocates a GCM session
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_dealloc(srtp_cipher_t *c)
+{
+    srtp_aes_gcm_ctx_t *ctx;
+
+    ctx = (srtp_aes_gcm_ctx_t *)c->state;
+    if (ctx) {
+        /* release CNG resources */
+        if (ctx->key) {
+            BCryptDestroyKey(ctx->key);
+        }
+
+        if (ctx->alg) {
+            BCryptCloseAlgorithmProvider(ctx->alg, 0);
+        }
+
+        /* zeroize the key material */
+        octet_string_set_to_zero(ctx, sizeof(srtp_aes_gcm_ctx_t));
+        srtp_crypto_free(ctx);
+    }
+
+    /* free memory */
+    srtp_crypto_free(c);
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_gcm_cng_context_init(...) initializes the aes_gcm_context
+ * using the value in key[].
+ *
+ * the key is the secret key
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_context_init(void *cv,
+                                                       const uint8_t *key)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    c->dir = srtp_direction_any;
+    c->aad_size = 0;
+
+    debug_print(srtp_mod_aes_gcm, "key:  %s",
+                srtp_octet_string_hex_string(key, c->key_size));
+
+    if (c->key) {
+        BCryptDestroyKey(c->key);
+        c->key = NULL;
+    }
+
+    /* explicitly cast away const of key, CNG copies it into the key object */
+    if (!BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(
+            c->alg, &c->key, NULL, 0, (PUCHAR)(uintptr_t)key,
+            (ULONG)c->key_size, 0))) {
+        c->key = NULL;
+        return (srtp_err_status_cipher_fail);
+    }
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_gcm_cng_set_iv(c, iv) sets the counter value to the exor of iv with
+ * the offset
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_set_iv(
+    void *cv,
+    uint8_t *iv,
+    srtp_cipher_direction_t direction)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    if (direction != srtp_direction_encrypt &&
+        direction != srtp_direction_decrypt) {
+        return (srtp_err_status_bad_param);
+    }
+    c->dir = direction;
+
+    debug_trace(srtp_mod_aes_gcm, "setting iv: %s",
+                srtp_octet_string_hex_string(iv, GCM_IV_LEN));
+
+    memcpy(c->iv, iv, GCM_IV_LEN);
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function processes the AAD
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	aad	Additional data to process for AEAD cipher suites
+ *	aad_len	length of aad buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_set_aad(void *cv,
+                                                  const uint8_t *aad,
+                                                  size_t aad_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    debug_trace(srtp_mod_aes_gcm, "setting AAD: %s",
+                srtp_octet_string_hex_string(aad, aad_len));
+
+    if (aad_len + c->aad_size > MAX_AD_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
+    memcpy(c->aad + c->aad_size, aad, aad_len);
+    c->aad_size += aad_len;
+
+    return (srtp_err_status_ok);
+}
+
+static void srtp_aes_gcm_cng_mode_info(
+    srtp_aes_gcm_ctx_t *c,
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO *info,
+    uint8_t *tag)
+{
+    BCRYPT_INIT_AUTH_MODE_INFO(*info);
+    info->pbNonce = c->iv;
+    info->cbNonce = GCM_IV_LEN;
+    info->pbAuthData = c->aad;
+    info->cbAuthData = (ULONG)c->aad_size;
+    info->pbTag = tag;
+    info->cbTag = GCM_AUTH_TAG_LEN;
+}
+
+/*
+ * srtp_aes_gcm_cng_full_tag(c, plaintext, len, tag) computes the 16
+ * octet tag of encrypting plaintext, which is the tag of the ciphertext
+ * it was decrypted from. The ciphertext is written to a scratch buffer a
+ * chunk at a time with chained calls.
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_full_tag(srtp_aes_gcm_ctx_t *c,
+                                                   const uint8_t *plaintext,
+                                                   size_t len,
+                                                   uint8_t *tag)
+{
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+    uint8_t mac_context[GCM_AUTH_TAG_LEN];
+    uint8_t scratch[SRTP_AES_GCM_CNG_CHUNK];
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    srtp_aes_gcm_cng_mode_info(c, &info, tag);
+    info.pbMacContext = mac_context;
+    info.cbMacContext = sizeof(mac_context);
+    info.dwFlags = BCRYPT_AUTH_MODE_CHAIN_CALLS_FLAG;
+
+    do {
+        size_t n = len < sizeof(scratch) ? len : sizeof(scratch);
+        ULONG out_len = 0;
+
+        /* the last call completes the tag */
+        if (n == len) {
+            info.dwFlags &= ~BCRYPT_AUTH_MODE_CHAIN_CALLS_FLAG;
+        }
+        if (!BCRYPT_SUCCESS(BCryptEncrypt(
+                c->key, (PUCHAR)(uintptr_t)plaintext, (ULONG)n, &info, NULL,
+                0, scratch, (ULONG)n, &out_len, 0))) {
+            status = srtp_err_status_cipher_fail;
+            break;
+        }
+        plaintext += n;
+        len -= n;
+    } while (len > 0);
+
+    octet_string_set_to_zero(scratch, sizeof(scratch));
+    octet_string_set_to_zero(mac_context, sizeof(mac_context));
+
+    return status;
+}
+
+static srtp_err_status_t srtp_aes_gcm_cng_do_crypto(void *cv,
+                                                    bool encrypt,
+                                                    const uint8_t *src,
+                                                    size_t src_len,
+                                                    uint8_t *dst,
+                                                    size_t *dst_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+    uint8_t tag[GCM_AUTH_TAG_LEN];
+    srtp_err_status_t status = srtp_err_status_ok;
+    NTSTATUS rv;
+    ULONG out_len = 0;
+    size_t len;
+
+    if (encrypt) {
+        if (c->dir != srtp_direction_encrypt) {
+            return srtp_err_status_bad_param;
+        }
+
+        if (*dst_len < src_len + c->tag_size) {
+            return srtp_err_status_buffer_small;
+        }
+
+        len = src_len;
+        srtp_aes_gcm_cng_mode_info(c, &info, tag);
+        rv = BCryptEncrypt(c->key, (PUCHAR)(uintptr_t)src, (ULONG)len, &info,
+                           NULL, 0, dst, (ULONG)len, &out_len, 0);
+        if (BCRYPT_SUCCESS(rv)) {
+            memcpy(dst + len, tag, c->tag_size);
+            *dst_len = len + c->tag_size;
+        } else {
+            status = srtp_err_status_cipher_fail;
+        }
+    } else {
+        if (c->dir != srtp_direction_decrypt) {
+            return srtp_err_status_bad_param;
+        }
+
+        if (src_len < c->tag_size) {
+            return srtp_err_status_bad_param;
+        }
+
+        if (*dst_len < src_len - c->tag_size) {
+            return srtp_err_status_buffer_small;
+        }
+
+        len = src_len - c->tag_size;
+        if (c->tag_size == GCM_AUTH_TAG_LEN) {
+            /* explicitly cast away const of the tag, CNG only reads it */
+            srtp_aes_gcm_cng_mode_info(c, &info,
+                                       (uint8_t *)(uintptr_t)(src + len));
+            rv = BCryptDecrypt(c->key, (PUCHAR)(uintptr_t)src, (ULONG)len,
+                               &info, NULL, 0, dst, (ULONG)len, &out_len, 0);
+            if (rv == STATUS_AUTH_TAG_MISMATCH) {
+                status = srtp_err_status_auth_fail;
+            } else if (!BCRYPT_SUCCESS(rv)) {
+                status = srtp_err_status_cipher_fail;
+            }
+        } else {
+            /*
+             * a truncated tag can not be checked by BCryptDecrypt(), the
+             * counter mode half of encrypting the ciphertext decrypts it,
+             * then encrypting the plaintext gives the full tag
+             */
+            srtp_aes_gcm_cng_mode_info(c, &info, tag);
+            rv = BCryptEncrypt(c->key, (PUCHAR)(uintptr_t)src, (ULONG)len,
+                               &info, NULL, 0, dst, (ULONG)len, &out_len, 0);
+            if (!BCRYPT_SUCCESS(rv)) {
+                status = srtp_err_status_cipher_fail;
+            } else {
+                status = srtp_aes_gcm_cng_full_tag(c, dst, len, tag);
+            }
+            if (status == srtp_err_status_ok &&
+                !srtp_octet_string_equal(tag, src + len, c->tag_size)) {
+                status = srtp_err_status_auth_fail;
+            }
+        }
+        if (status == srtp_err_status_ok) {
+            *dst_len = len;
+        } else {
+            octet_string_set_to_zero(dst, len);
+        }
+    }
+
+    // Reset AAD
+    c->aad_size = 0;
+    octet_string_set_to_zero(tag, sizeof(tag));
+
+    return status;
+}
+
+/*
+ * This function encrypts a buffer using AES GCM mode
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to encrypt
+ *	enc_len	length of encrypt buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_encrypt(void *cv,
+                                                  const uint8_t *src,
+                                                  size_t src_len,
+                                                  uint8_t *dst,
+                                                  size_t *dst_len)
+{
+    return srtp_aes_gcm_cng_do_crypto(cv, true, src, src_len, dst, dst_len);
+}
+
+/*
+ * This function decrypts a buffer using AES GCM mode
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to encrypt
+ *	enc_len	length of encrypt buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_cng_decrypt(void *cv,
+                                                  const uint8_t *src,
+                                                  size_t src_len,
+                                                  uint8_t *dst,
+                                                  size_t *dst_len)
+{
+    uint8_t tagbuf[16];
+    uint8_t *non_null_dst_buf = dst;
+    if (!non_null_dst_buf && (*dst_len == 0)) {
+        non_null_dst_buf = tagbuf;
+        *dst_len = sizeof(tagbuf);
+    } else if (!non_null_dst_buf) {
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_aes_gcm_cng_do_crypto(cv, false, src, src_len,
+                                      non_null_dst_buf, dst_len);
+}
+
+/*
+ * Name of this crypto engine
+ */
+static const char srtp_aes_gcm_128_cng_description[] = "AES-128 GCM using CNG";
+#ifndef SRTP_NO_AES_256
+static const char srtp_aes_gcm_256_cng_description[] = "AES-256 GCM using CNG";
+#endif
+
+/*
+ * This is the vector function table for this crypto engine.
+ */
+/* clang-format off */
+const srtp_cipher_type_t srtp_aes_gcm_128 = {
+    srtp_aes_gcm_cng_alloc,
+    srtp_aes_gcm_cng_dealloc,
+    srtp_aes_gcm_cng_context_init,
+    srtp_aes_gcm_cng_set_aad,
+    srtp_aes_gcm_cng_encrypt,
+    srtp_aes_gcm_cng_decrypt,
+    srtp_aes_gcm_cng_set_iv,
+    srtp_aes_gcm_128_cng_description,
+    &srtp_aes_gcm_128_test_case_0,
+    SRTP_AES_GCM_128,
+    NULL,
+    NULL,
+    NULL
+};
+/* clang-format on */
+
+#ifndef SRTP_NO_AES_256
+/*
+ * This is the vector function table for this crypto engine.
+ */
+/* clang-format off */
+const srtp_cipher_type_t srtp_aes_gcm_256 = {
+    srtp_aes_gcm_cng_alloc,
+    srtp_aes_gcm_cng_dealloc,
+    srtp_aes_gcm_cng_context_init,
+    srtp_aes_gcm_cng_set_aad,
+    srtp_aes_gcm_cng_encrypt,
+    srtp_aes_gcm_cng_decrypt,
+    srtp_aes_gcm_cng_set_iv,
+    srtp_aes_gcm_256_cng_description,
+    &srtp_aes_gcm_256_test_case_0,
+    SRTP_AES_GCM_256,
+    NULL,
+    NULL,
+    NULL
+};
+/* clang-format on */
+#endif
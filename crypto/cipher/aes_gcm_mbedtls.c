@@ -54,6 +54,7 @@
 #include "crypto_types.h"
 #include "cipher_types.h"
 #include "cipher_test_cases.h"
+#include "psa_key_location.h"
 
 srtp_debug_module_t srtp_mod_aes_gcm = {
     false,            /* debugging is off by default */
@@ -90,7 +91,7 @@ srtp_debug_module_t srtp_mod_aes_gcm = {
 #define GCM_AUTH_TAG_LEN 16
 #define GCM_AUTH_TAG_LEN_8 8
 
-#define FUNC_ENTRY() debug_print(srtp_mod_aes_gcm, "%s entry", __func__);
+#define FUNC_ENTRY() debug_trace(srtp_mod_aes_gcm, "%s entry", __func__)
 
 /*
  * static function declarations.
@@ -130,8 +131,10 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_decrypt(void *cv,
  */
 static const char srtp_aes_gcm_128_mbedtls_description[] =
     "AES-128 GCM using mbedtls";
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_gcm_256_mbedtls_description[] =
     "AES-256 GCM using mbedtls";
+#endif
 
 /*
  * This is the vector function table for this crypto engine.
@@ -147,10 +150,14 @@ const srtp_cipher_type_t srtp_aes_gcm_128 = {
     srtp_aes_gcm_mbedtls_set_iv,
     srtp_aes_gcm_128_mbedtls_description,
     &srtp_aes_gcm_128_test_case_0,
-    SRTP_AES_GCM_128
+    SRTP_AES_GCM_128,
+    NULL,
+    NULL,
+    NULL
 };
 /* clang-format on */
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the vector function table for this crypto engine.
  */
@@ -165,9 +172,13 @@ const srtp_cipher_type_t srtp_aes_gcm_256 = {
     srtp_aes_gcm_mbedtls_set_iv,
     srtp_aes_gcm_256_mbedtls_description,
     &srtp_aes_gcm_256_test_case_0,
-    SRTP_AES_GCM_256
+    SRTP_AES_GCM_256,
+    NULL,
+    NULL,
+    NULL
 };
 /* clang-format on */
+#endif
 
 /*
  * This function allocates a new instance of this crypto engine.
@@ -191,8 +202,13 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/256
      */
-    if (key_len != SRTP_AES_GCM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_GCM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return (srtp_err_status_bad_param);
     }
 
@@ -233,12 +249,14 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_alloc(srtp_cipher_t **c,
         gcm->key_size = SRTP_AES_128_KEY_LEN;
         gcm->tag_len = tlen;
         break;
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_GCM_256_KEY_LEN_WSALT:
         (*c)->type = &srtp_aes_gcm_256;
         (*c)->algorithm = SRTP_AES_GCM_256;
         gcm->key_size = SRTP_AES_256_KEY_LEN;
         gcm->tag_len = tlen;
         break;
+#endif
     }
 
     /* set key size        */
@@ -300,6 +318,12 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_context_init(void *cv,
         &attr, PSA_ALG_AEAD_WITH_SHORTENED_TAG(PSA_ALG_GCM, c->tag_len));
     psa_set_key_type(&attr, PSA_KEY_TYPE_AES);
     psa_set_key_bits(&attr, key_len_in_bits);
+    srtp_psa_set_key_location(&attr);
+
+    if (c->ctx->key_id != PSA_KEY_ID_NULL) {
+        psa_destroy_key(c->ctx->key_id);
+        c->ctx->key_id = PSA_KEY_ID_NULL;
+    }
 
     status = psa_import_key(&attr, key, key_len_in_bits / 8, &c->ctx->key_id);
 
@@ -326,7 +350,7 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_set_iv(
     }
     c->dir = direction;
 
-    debug_print(srtp_mod_aes_gcm, "setting iv: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting iv: %s",
                 srtp_octet_string_hex_string(iv, GCM_IV_LEN));
     c->iv_len = GCM_IV_LEN;
     memcpy(c->iv, iv, c->iv_len);
@@ -348,7 +372,7 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_set_aad(void *cv,
     FUNC_ENTRY();
     srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
 
-    debug_print(srtp_mod_aes_gcm, "setting AAD: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting AAD: %s",
                 srtp_octet_string_hex_string(aad, aad_len));
 
     if (aad_len + c->aad_size > MAX_AD_SIZE) {
@@ -445,7 +469,7 @@ static srtp_err_status_t srtp_aes_gcm_mbedtls_decrypt(void *cv,
         return srtp_err_status_buffer_small;
     }
 
-    debug_print(srtp_mod_aes_gcm, "AAD: %s",
+    debug_trace(srtp_mod_aes_gcm, "AAD: %s",
                 srtp_octet_string_hex_string(c->aad, c->aad_size));
 
     size_t out_len = 0;
@@ -93,8 +93,13 @@ static srtp_err_status_t srtp_aes_gcm_nss_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/256
      */
-    if (key_len != SRTP_AES_GCM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_GCM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return (srtp_err_status_bad_param);
     }
 
@@ -140,6 +145,7 @@ static srtp_err_status_t srtp_aes_gcm_nss_alloc(srtp_cipher_t **c,
         gcm->tag_size = tlen;
         gcm->params.ulTagBits = 8 * tlen;
         break;
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_GCM_256_KEY_LEN_WSALT:
         (*c)->type = &srtp_aes_gcm_256;
         (*c)->algorithm = SRTP_AES_GCM_256;
@@ -147,6 +153,7 @@ static srtp_err_status_t srtp_aes_gcm_nss_alloc(srtp_cipher_t **c,
         gcm->tag_size = tlen;
         gcm->params.ulTagBits = 8 * tlen;
         break;
+#endif
     default:
         /* this should never hit, but to be sure... */
         return (srtp_err_status_bad_param);
@@ -254,7 +261,7 @@ static srtp_err_status_t srtp_aes_gcm_nss_set_iv(
     }
     c->dir = direction;
 
-    debug_print(srtp_mod_aes_gcm, "setting iv: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting iv: %s",
                 srtp_octet_string_hex_string(iv, GCM_IV_LEN));
 
     memcpy(c->iv, iv, GCM_IV_LEN);
@@ -276,7 +283,7 @@ static srtp_err_status_t srtp_aes_gcm_nss_set_aad(void *cv,
 {
     srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
 
-    debug_print(srtp_mod_aes_gcm, "setting AAD: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting AAD: %s",
                 srtp_octet_string_hex_string(aad, aad_len));
 
     if (aad_len + c->aad_size > MAX_AD_SIZE) {
@@ -402,7 +409,9 @@ static srtp_err_status_t srtp_aes_gcm_nss_decrypt(void *cv,
  * Name of this crypto engine
  */
 static const char srtp_aes_gcm_128_nss_description[] = "AES-128 GCM using NSS";
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_gcm_256_nss_description[] = "AES-256 GCM using NSS";
+#endif
 
 /*
  * This is the vector function table for this crypto engine.
@@ -418,10 +427,14 @@ const srtp_cipher_type_t srtp_aes_gcm_128 = {
     srtp_aes_gcm_nss_set_iv,
     srtp_aes_gcm_128_nss_description,
     &srtp_aes_gcm_128_test_case_0,
-    SRTP_AES_GCM_128
+    SRTP_AES_GCM_128,
+    NULL,
+    NULL,
+    NULL
 };
 /* clang-format on */
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the vector function table for this crypto engine.
  */
@@ -436,6 +449,10 @@ const srtp_cipher_type_t srtp_aes_gcm_256 = {
     srtp_aes_gcm_nss_set_iv,
     srtp_aes_gcm_256_nss_description,
     &srtp_aes_gcm_256_test_case_0,
-    SRTP_AES_GCM_256
+    SRTP_AES_GCM_256,
+    NULL,
+    NULL,
+    NULL
 };
 /* clang-format on */
+#endif
@@ -50,6 +50,9 @@
 
 #include <openssl/evp.h>
 #include "aes_gcm.h"
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+#include <openssl/core_names.h>
+#endif
 #include "alloc.h"
 #include "err.h" /* for srtp_debug */
 #include "crypto_types.h"
@@ -89,8 +92,13 @@ static srtp_err_status_t srtp_aes_gcm_openssl_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/256
      */
-    if (key_len != SRTP_AES_GCM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_GCM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return (srtp_err_status_bad_param);
     }
 
@@ -130,13 +138,30 @@ static srtp_err_status_t srtp_aes_gcm_openssl_alloc(srtp_cipher_t **c,
         gcm->key_size = SRTP_AES_128_KEY_LEN;
         gcm->tag_len = tlen;
         break;
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_GCM_256_KEY_LEN_WSALT:
         (*c)->type = &srtp_aes_gcm_256;
         (*c)->algorithm = SRTP_AES_GCM_256;
         gcm->key_size = SRTP_AES_256_KEY_LEN;
         gcm->tag_len = tlen;
         break;
+#endif
+    }
+
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+    gcm->evp = EVP_CIPHER_fetch(NULL,
+                                gcm->key_size == SRTP_AES_128_KEY_LEN
+                                    ? "AES-128-GCM"
+                                    : "AES-256-GCM",
+                                NULL);
+    if (gcm->evp == NULL) {
+        EVP_CIPHER_CTX_free(gcm->ctx);
+        srtp_crypto_free(gcm);
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return srtp_err_status_alloc_fail;
     }
+#endif
 
     /* set key size        */
     (*c)->key_len = key_len;
@@ -154,6 +179,9 @@ static srtp_err_status_t srtp_aes_gcm_openssl_dealloc(srtp_cipher_t *c)
     ctx = (srtp_aes_gcm_ctx_t *)c->state;
     if (ctx) {
         EVP_CIPHER_CTX_free(ctx->ctx);
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+        EVP_CIPHER_free(ctx->evp);
+#endif
         /* zeroize the key material */
         octet_string_set_to_zero(ctx, sizeof(srtp_aes_gcm_ctx_t));
         srtp_crypto_free(ctx);
@@ -182,6 +210,13 @@ static srtp_err_status_t srtp_aes_gcm_openssl_context_init(void *cv,
     debug_print(srtp_mod_aes_gcm, "key:  %s",
                 srtp_octet_string_hex_string(key, c->key_size));
 
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+    if (c->key_size != SRTP_AES_128_KEY_LEN &&
+        c->key_size != SRTP_AES_256_KEY_LEN) {
+        return srtp_err_status_bad_param;
+    }
+    evp = c->evp;
+#else
     switch (c->key_size) {
     case SRTP_AES_256_KEY_LEN:
         evp = EVP_aes_256_gcm();
@@ -193,6 +228,7 @@ static srtp_err_status_t srtp_aes_gcm_openssl_context_init(void *cv,
         return (srtp_err_status_bad_param);
         break;
     }
+#endif
 
     EVP_CIPHER_CTX_reset(c->ctx);
 
@@ -210,6 +246,9 @@ static srtp_err_status_t srtp_aes_gcm_openssl_context_init(void *cv,
 /*
  * aes_gcm_openssl_set_iv(c, iv) sets the counter value to the exor of iv with
  * the offset
+ *
+ * the key schedule set up by context_init is kept, only the iv and the
+ * direction are passed to the context
  */
 static srtp_err_status_t srtp_aes_gcm_openssl_set_iv(
     void *cv,
@@ -224,19 +263,70 @@ static srtp_err_status_t srtp_aes_gcm_openssl_set_iv(
     }
     c->dir = direction;
 
-    debug_print(srtp_mod_aes_gcm, "setting iv: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting iv: %s",
                 srtp_octet_string_hex_string(iv, 12));
 
-    if (c->dir == srtp_direction_encrypt) {
-        if (EVP_EncryptInit_ex(c->ctx, NULL, NULL, NULL, iv) != 1) {
-            return srtp_err_status_init_fail;
-        }
-    } else {
-        if (EVP_DecryptInit_ex(c->ctx, NULL, NULL, NULL, iv) != 1) {
-            return srtp_err_status_init_fail;
-        }
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+    if (EVP_CipherInit_ex2(c->ctx, NULL, NULL, iv,
+                           c->dir == srtp_direction_encrypt, NULL) != 1) {
+        return srtp_err_status_init_fail;
+    }
+#else
+    if (EVP_CipherInit_ex(c->ctx, NULL, NULL, NULL, iv,
+                          c->dir == srtp_direction_encrypt) != 1) {
+        return srtp_err_status_init_fail;
+    }
+#endif
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * the tag is moved with the AEAD tag parameter directly when the cipher
+ * was fetched, which skips translating the ctrl into parameters
+ */
+static srtp_err_status_t srtp_aes_gcm_openssl_get_tag(srtp_aes_gcm_ctx_t *c,
+                                                      uint8_t *tag)
+{
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+    OSSL_PARAM params[2];
+
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG,
+                                                  tag, c->tag_len);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if (EVP_CIPHER_CTX_get_params(c->ctx, params) != 1) {
+        return srtp_err_status_algo_fail;
+    }
+#else
+    if (EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_GET_TAG, (int)c->tag_len,
+                            tag) != 1) {
+        return srtp_err_status_algo_fail;
     }
+#endif
+    return srtp_err_status_ok;
+}
 
+static srtp_err_status_t srtp_aes_gcm_openssl_set_tag(srtp_aes_gcm_ctx_t *c,
+                                                      const uint8_t *tag)
+{
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+    OSSL_PARAM params[2];
+
+    /* explicitly cast away const of tag, it is only read */
+    params[0] = OSSL_PARAM_construct_octet_string(
+        OSSL_CIPHER_PARAM_AEAD_TAG, (void *)(uintptr_t)tag, c->tag_len);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if (EVP_CIPHER_CTX_set_params(c->ctx, params) != 1) {
+        return srtp_err_status_algo_fail;
+    }
+#else
+    if (EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_SET_TAG, (int)c->tag_len,
+                            (void *)(uintptr_t)tag) != 1) {
+        return srtp_err_status_algo_fail;
+    }
+#endif
     return srtp_err_status_ok;
 }
 
@@ -247,28 +337,25 @@ static srtp_err_status_t srtp_aes_gcm_openssl_set_iv(
  *	c	Crypto context
  *	aad	Additional data to process for AEAD cipher suites
  *	aad_len	length of aad buffer
+ *
+ * EVP_Cipher() goes straight to the cipher implementation, for GCM a
+ * NULL output means the input is AAD
  */
 static srtp_err_status_t srtp_aes_gcm_openssl_set_aad(void *cv,
                                                       const uint8_t *aad,
                                                       size_t aad_len)
 {
     srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
-    int len = 0;
 
-    debug_print(srtp_mod_aes_gcm, "setting AAD: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting AAD: %s",
                 srtp_octet_string_hex_string(aad, aad_len));
 
-    if (c->dir == srtp_direction_encrypt) {
-        if (EVP_EncryptUpdate(c->ctx, NULL, &len, aad, (int)aad_len) != 1) {
-            return srtp_err_status_algo_fail;
-        }
-    } else {
-        if (EVP_DecryptUpdate(c->ctx, NULL, &len, aad, (int)aad_len) != 1) {
-            return srtp_err_status_algo_fail;
-        }
+    if (aad_len == 0) {
+        return srtp_err_status_ok;
     }
 
-    if (len != (int)aad_len) {
+    if (EVP_Cipher(c->ctx, NULL, aad, (unsigned int)aad_len) !=
+        (int)aad_len) {
         return srtp_err_status_algo_fail;
     }
 
@@ -290,7 +377,6 @@ static srtp_err_status_t srtp_aes_gcm_openssl_encrypt(void *cv,
                                                       size_t *dst_len)
 {
     srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
-    int len = 0;
 
     if (c->dir != srtp_direction_encrypt) {
         return srtp_err_status_bad_param;
@@ -303,27 +389,25 @@ static srtp_err_status_t srtp_aes_gcm_openssl_encrypt(void *cv,
     /*
      * Encrypt the data
      */
-    if (EVP_EncryptUpdate(c->ctx, dst, &len, src, (int)src_len) != 1) {
+    if (src_len > 0 &&
+        EVP_Cipher(c->ctx, dst, src, (unsigned int)src_len) != (int)src_len) {
         return srtp_err_status_algo_fail;
     }
-    *dst_len = len;
 
     /*
-     * Calculate the tag
+     * Calculate the tag, a NULL input finishes the GHASH
      */
-    if (EVP_EncryptFinal_ex(c->ctx, dst + len, &len) != 1) {
+    if (EVP_Cipher(c->ctx, NULL, NULL, 0) < 0) {
         return srtp_err_status_algo_fail;
     }
-    *dst_len += len;
 
     /*
      * Retrieve the tag
      */
-    if (EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_GET_TAG, (int)c->tag_len,
-                            dst + *dst_len) != 1) {
+    if (srtp_aes_gcm_openssl_get_tag(c, dst + src_len)) {
         return srtp_err_status_algo_fail;
     }
-    *dst_len += c->tag_len;
+    *dst_len = src_len + c->tag_len;
 
     return srtp_err_status_ok;
 }
@@ -343,7 +427,7 @@ static srtp_err_status_t srtp_aes_gcm_openssl_decrypt(void *cv,
                                                       size_t *dst_len)
 {
     srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
-    int len = 0;
+    size_t len;
 
     if (c->dir != srtp_direction_decrypt) {
         return srtp_err_status_bad_param;
@@ -356,34 +440,59 @@ static srtp_err_status_t srtp_aes_gcm_openssl_decrypt(void *cv,
     if (*dst_len < src_len - c->tag_len) {
         return srtp_err_status_buffer_small;
     }
+    len = src_len - c->tag_len;
 
     /*
-     * Decrypt the data
+     * Set the tag before decrypting
      */
-    if (EVP_DecryptUpdate(c->ctx, dst, &len, src,
-                          (int)(src_len - c->tag_len)) != 1) {
+    if (srtp_aes_gcm_openssl_set_tag(c, src + len)) {
         return srtp_err_status_algo_fail;
     }
-    *dst_len = len;
 
     /*
-     * Set the tag before decrypting
-     *
-     * explicitly cast away const of src
+     * Decrypt the data
      */
-    if (EVP_CIPHER_CTX_ctrl(
-            c->ctx, EVP_CTRL_GCM_SET_TAG, (int)c->tag_len,
-            (void *)(uintptr_t)(src + (src_len - c->tag_len))) != 1) {
+    if (len > 0 &&
+        EVP_Cipher(c->ctx, dst, src, (unsigned int)len) != (int)len) {
         return srtp_err_status_algo_fail;
     }
 
     /*
      * Check the tag
      */
-    if (EVP_DecryptFinal_ex(c->ctx, dst + *dst_len, &len) != 1) {
+    if (EVP_Cipher(c->ctx, NULL, NULL, 0) < 0) {
         return srtp_err_status_auth_fail;
     }
-    *dst_len += len;
+    *dst_len = len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function creates a context sharing the key schedule of an
+ * initialized one, with its own copy of the EVP context for the iv, AAD
+ * and GHASH state
+ */
+static srtp_err_status_t srtp_aes_gcm_openssl_clone(const srtp_cipher_t *c,
+                                                    srtp_cipher_t **clone)
+{
+    const srtp_aes_gcm_ctx_t *gcm = (const srtp_aes_gcm_ctx_t *)c->state;
+    srtp_aes_gcm_ctx_t *new_gcm;
+    srtp_err_status_t status;
+
+    status = srtp_aes_gcm_openssl_alloc(clone, c->key_len, gcm->tag_len);
+    if (status) {
+        return status;
+    }
+
+    new_gcm = (srtp_aes_gcm_ctx_t *)(*clone)->state;
+    new_gcm->dir = srtp_direction_any;
+
+    if (!EVP_CIPHER_CTX_copy(new_gcm->ctx, gcm->ctx)) {
+        srtp_aes_gcm_openssl_dealloc(*clone);
+        *clone = NULL;
+        return srtp_err_status_fail;
+    }
 
     return srtp_err_status_ok;
 }
@@ -393,8 +502,10 @@ static srtp_err_status_t srtp_aes_gcm_openssl_decrypt(void *cv,
  */
 static const char srtp_aes_gcm_128_openssl_description[] =
     "AES-128 GCM using openssl";
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_gcm_256_openssl_description[] =
     "AES-256 GCM using openssl";
+#endif
 
 /*
  * This is the vector function table for this crypto engine.
@@ -410,10 +521,14 @@ const srtp_cipher_type_t srtp_aes_gcm_128 = {
     srtp_aes_gcm_openssl_set_iv,
     srtp_aes_gcm_128_openssl_description,
     &srtp_aes_gcm_128_test_case_0,
-    SRTP_AES_GCM_128
+    SRTP_AES_GCM_128,
+    srtp_aes_gcm_openssl_clone,
+    NULL,
+    NULL
 };
 /* clang-format on */
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the vector function table for this crypto engine.
  */
@@ -428,6 +543,10 @@ const srtp_cipher_type_t srtp_aes_gcm_256 = {
     srtp_aes_gcm_openssl_set_iv,
     srtp_aes_gcm_256_openssl_description,
     &srtp_aes_gcm_256_test_case_0,
-    SRTP_AES_GCM_256
+    SRTP_AES_GCM_256,
+    srtp_aes_gcm_openssl_clone,
+    NULL,
+    NULL
 };
 /* clang-format on */
+#endif
@@ -92,7 +92,7 @@ srtp_debug_module_t srtp_mod_aes_gcm = {
 #define GCM_AUTH_TAG_LEN AES_BLOCK_SIZE
 #define GCM_AUTH_TAG_LEN_8 8
 
-#define FUNC_ENTRY() debug_print(srtp_mod_aes_gcm, "%s entry", __func__);
+#define FUNC_ENTRY() debug_trace(srtp_mod_aes_gcm, "%s entry", __func__)
 
 /*
  * This function allocates a new instance of this crypto engine.
@@ -116,8 +116,13 @@ static srtp_err_status_t srtp_aes_gcm_wolfssl_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/256
      */
-    if (key_len != SRTP_AES_GCM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_GCM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return (srtp_err_status_bad_param);
     }
 
@@ -150,12 +155,14 @@ static srtp_err_status_t srtp_aes_gcm_wolfssl_alloc(srtp_cipher_t **c,
         gcm->key_size = SRTP_AES_128_KEY_LEN;
         gcm->tag_len = tlen;
         break;
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_GCM_256_KEY_LEN_WSALT:
         (*c)->type = &srtp_aes_gcm_256;
         (*c)->algorithm = SRTP_AES_GCM_256;
         gcm->key_size = SRTP_AES_256_KEY_LEN;
         gcm->tag_len = tlen;
         break;
+#endif
     }
 
     /* set key size        */
@@ -251,7 +258,7 @@ static srtp_err_status_t srtp_aes_gcm_wolfssl_set_iv(
     }
     c->dir = direction;
 
-    debug_print(srtp_mod_aes_gcm, "setting iv: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting iv: %s",
                 srtp_octet_string_hex_string(iv, GCM_NONCE_MID_SZ));
 #ifndef WOLFSSL_AESGCM_STREAM
     c->iv_len = GCM_NONCE_MID_SZ;
@@ -287,7 +294,7 @@ static srtp_err_status_t srtp_aes_gcm_wolfssl_set_aad(void *cv,
     int err;
 #endif
 
-    debug_print(srtp_mod_aes_gcm, "setting AAD: %s",
+    debug_trace(srtp_mod_aes_gcm, "setting AAD: %s",
                 srtp_octet_string_hex_string(aad, aad_len));
 
 #ifndef WOLFSSL_AESGCM_STREAM
@@ -398,7 +405,7 @@ static srtp_err_status_t srtp_aes_gcm_wolfssl_decrypt(void *cv,
     }
 
 #ifndef WOLFSSL_AESGCM_STREAM
-    debug_print(srtp_mod_aes_gcm, "AAD: %s",
+    debug_trace(srtp_mod_aes_gcm, "AAD: %s",
                 srtp_octet_string_hex_string(c->aad, c->aad_size));
 
     err = wc_AesGcmDecrypt(c->ctx, dst, src, (src_len - c->tag_len), c->iv,
@@ -434,8 +441,10 @@ static srtp_err_status_t srtp_aes_gcm_wolfssl_decrypt(void *cv,
  */
 static const char srtp_aes_gcm_128_wolfssl_description[] =
     "AES-128 GCM using wolfssl";
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_gcm_256_wolfssl_description[] =
     "AES-256 GCM using wolfssl";
+#endif
 
 /*
  * This is the vector function table for this crypto engine.
@@ -451,10 +460,14 @@ const srtp_cipher_type_t srtp_aes_gcm_128 = {
     srtp_aes_gcm_wolfssl_set_iv,
     srtp_aes_gcm_128_wolfssl_description,
     &srtp_aes_gcm_128_test_case_0,
-    SRTP_AES_GCM_128
+    SRTP_AES_GCM_128,
+    NULL,
+    NULL,
+    NULL
 };
 /* clang-format on */
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the vector function table for this crypto engine.
  */
@@ -469,6 +482,10 @@ const srtp_cipher_type_t srtp_aes_gcm_256 = {
     srtp_aes_gcm_wolfssl_set_iv,
     srtp_aes_gcm_256_wolfssl_description,
     &srtp_aes_gcm_256_test_case_0,
-    SRTP_AES_GCM_256
+    SRTP_AES_GCM_256,
+    NULL,
+    NULL,
+    NULL
 };
 /* clang-format on */
+#endif
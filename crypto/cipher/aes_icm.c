@@ -47,10 +47,9 @@
 #include <config.h>
 #endif
 
-#define ALIGN_32 0
-
 #include "aes_icm.h"
 #include "alloc.h"
+#include "key_store.h"
 #include "cipher_types.h"
 #include "cipher_test_cases.h"
 
@@ -109,8 +108,16 @@ static srtp_err_status_t srtp_aes_icm_alloc(srtp_cipher_t **c,
      * has not broken anything. Don't know what would be the
      * effect of skipping this check for srtp in general.
      */
-    if (key_len != SRTP_AES_ICM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return srtp_err_status_bad_param;
     }
 
@@ -120,7 +127,8 @@ static srtp_err_status_t srtp_aes_icm_alloc(srtp_cipher_t **c,
         return srtp_err_status_alloc_fail;
     }
 
-    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_icm_ctx_t));
+    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_aes_icm_ctx_t), SRTP_CACHE_LINE_SIZE);
     if (icm == NULL) {
         srtp_crypto_free(*c);
         *c = NULL;
@@ -131,10 +139,18 @@ static srtp_err_status_t srtp_aes_icm_alloc(srtp_cipher_t **c,
     (*c)->state = icm;
 
     switch (key_len) {
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_192;
+        (*c)->type = &srtp_aes_icm_192;
+        break;
+#endif
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_ICM_256_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_256;
         (*c)->type = &srtp_aes_icm_256;
         break;
+#endif
     default:
         (*c)->algorithm = SRTP_AES_ICM_128;
         (*c)->type = &srtp_aes_icm_128;
@@ -158,6 +174,8 @@ static srtp_err_status_t srtp_aes_icm_dealloc(srtp_cipher_t *c)
 
     ctx = (srtp_aes_icm_ctx_t *)c->state;
     if (ctx) {
+        srtp_key_store_release(ctx->key.expanded_key);
+
         /* zeroize the key material */
         octet_string_set_to_zero(ctx, sizeof(srtp_aes_icm_ctx_t));
         srtp_crypto_free(ctx);
@@ -169,6 +187,18 @@ static srtp_err_status_t srtp_aes_icm_dealloc(srtp_cipher_t *c)
     return srtp_err_status_ok;
 }
 
+/*
+ * aes_icm_expand_key(key, key_len, expanded) is the expansion the key
+ * store keeps for aes_icm contexts
+ */
+static srtp_err_status_t srtp_aes_icm_expand_key(const uint8_t *key,
+                                                 size_t key_len,
+                                                 void *expanded)
+{
+    return srtp_aes_expand_encryption_key(
+        key, key_len, (srtp_aes_expanded_key_t *)expanded);
+}
+
 /*
  * aes_icm_context_init(...) initializes the aes_icm_context
  * using the value in key[].
@@ -184,8 +214,10 @@ static srtp_err_status_t srtp_aes_icm_context_init(void *cv, const uint8_t *key)
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
     srtp_err_status_t status;
     size_t base_key_len, copy_len;
+    const void *expanded_key;
 
     if (c->key_size == SRTP_AES_ICM_128_KEY_LEN_WSALT ||
+        c->key_size == SRTP_AES_ICM_192_KEY_LEN_WSALT ||
         c->key_size == SRTP_AES_ICM_256_KEY_LEN_WSALT) {
         base_key_len = c->key_size - SRTP_SALT_LEN;
     } else {
@@ -197,7 +229,7 @@ static srtp_err_status_t srtp_aes_icm_context_init(void *cv, const uint8_t *key)
      * go past the end of the key buffer
      */
     v128_set_to_zero(&c->counter);
-    v128_set_to_zero(&c->offset);
+    v128_set_to_zero(&c->key.offset);
 
     copy_len = c->key_size - base_key_len;
     /* force last two octets of the offset to be left zero (for srtp
@@ -207,21 +239,25 @@ static srtp_err_status_t srtp_aes_icm_context_init(void *cv, const uint8_t *key)
     }
 
     memcpy(&c->counter, key + base_key_len, copy_len);
-    memcpy(&c->offset, key + base_key_len, copy_len);
+    memcpy(&c->key.offset, key + base_key_len, copy_len);
 
     debug_print(srtp_mod_aes_icm, "key:  %s",
                 srtp_octet_string_hex_string(key, base_key_len));
-    debug_print(srtp_mod_aes_icm, "offset: %s", v128_hex_string(&c->offset));
-
-    /* expand key */
-    status =
-        srtp_aes_expand_encryption_key(key, base_key_len, &c->expanded_key);
+    debug_print(srtp_mod_aes_icm, "offset: %s",
+                v128_hex_string(&c->key.offset));
+
+    /* expand key, or share the expansion of a context with the same key */
+    srtp_key_store_release(c->key.expanded_key);
+    c->key.expanded_key = NULL;
+    status = srtp_key_store_acquire(srtp_aes_icm_expand_key, key, base_key_len,
+                                    sizeof(srtp_aes_expanded_key_t),
+                                    &expanded_key);
     if (status) {
-        octet_string_set_to_zero(&c->expanded_key, sizeof(c->expanded_key));
+        octet_string_set_to_zero(&c->key, sizeof(c->key));
         v128_set_to_zero(&c->counter);
-        v128_set_to_zero(&c->offset);
         return status;
     }
+    c->key.expanded_key = (const srtp_aes_expanded_key_t *)expanded_key;
 
     /* indicate that the keystream_buffer is empty */
     c->bytes_in_buffer = 0;
@@ -245,11 +281,11 @@ static srtp_err_status_t srtp_aes_icm_set_iv(void *cv,
     /* set nonce (for alignment) */
     v128_copy_octet_string(&nonce, iv);
 
-    debug_print(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
 
-    v128_xor(&c->counter, &c->offset, &nonce);
+    v128_xor(&c->counter, &c->key.offset, &nonce);
 
-    debug_print(srtp_mod_aes_icm, "set_counter: %s",
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
                 v128_hex_string(&c->counter));
 
     /* indicate that the keystream_buffer is empty */
@@ -268,12 +304,12 @@ static void srtp_aes_icm_advance(srtp_aes_icm_ctx_t *c)
 {
     /* fill buffer with new keystream */
     v128_copy(&c->keystream_buffer, &c->counter);
-    srtp_aes_encrypt(&c->keystream_buffer, &c->expanded_key);
+    srtp_aes_encrypt(&c->keystream_buffer, c->key.expanded_key);
     c->bytes_in_buffer = sizeof(v128_t);
 
-    debug_print(srtp_mod_aes_icm, "counter:    %s",
+    debug_trace(srtp_mod_aes_icm, "counter:    %s",
                 v128_hex_string(&c->counter));
-    debug_print(srtp_mod_aes_icm, "ciphertext: %s",
+    debug_trace(srtp_mod_aes_icm, "ciphertext: %s",
                 v128_hex_string(&c->keystream_buffer));
 
     /* clock counter forward */
@@ -282,6 +318,31 @@ static void srtp_aes_icm_advance(srtp_aes_icm_ctx_t *c)
     }
 }
 
+/*
+ * aes_icm_advance_blocks(c, keystream, num_blocks) writes num_blocks blocks
+ * of keystream and advances the block index by num_blocks, the caller must
+ * have checked that the block index does not wrap
+ */
+#define SRTP_AES_ICM_KEYSTREAM_BLOCKS 8
+
+static void srtp_aes_icm_advance_blocks(srtp_aes_icm_ctx_t *c,
+                                        v128_t *keystream,
+                                        size_t num_blocks)
+{
+    uint16_t block_index = ntohs(c->counter.v16[7]);
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        v128_copy(&keystream[i], &c->counter);
+        keystream[i].v16[7] = htons((uint16_t)(block_index + i));
+    }
+    c->counter.v16[7] = htons((uint16_t)(block_index + num_blocks));
+
+    srtp_aes_encrypt_blocks(keystream, num_blocks, c->key.expanded_key);
+
+    debug_trace(srtp_mod_aes_icm, "counter:    %s",
+                v128_hex_string(&c->counter));
+}
+
 /*
  * icm_encrypt deals with the following cases:
  *
@@ -303,8 +364,6 @@ static srtp_err_status_t srtp_aes_icm_encrypt(void *cv,
 {
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
     size_t bytes_to_encr = src_len;
-    uint32_t *b;
-    const uint32_t *s;
 
     if (*dst_len < src_len) {
         return srtp_err_status_buffer_small;
@@ -321,7 +380,7 @@ static srtp_err_status_t srtp_aes_icm_encrypt(void *cv,
         return srtp_err_status_terminus;
     }
 
-    debug_print(srtp_mod_aes_icm, "block index: %d", htons(c->counter.v16[7]));
+    debug_trace(srtp_mod_aes_icm, "block index: %d", htons(c->counter.v16[7]));
     if (bytes_to_encr <= c->bytes_in_buffer) {
         /* deal with odd case of small bytes_to_encr */
         for (size_t i = (sizeof(v128_t) - c->bytes_in_buffer);
@@ -345,54 +404,37 @@ static srtp_err_status_t srtp_aes_icm_encrypt(void *cv,
         c->bytes_in_buffer = 0;
     }
 
-    /* now loop over entire 16-byte blocks of keystream */
-    for (size_t i = 0; i < (bytes_to_encr / sizeof(v128_t)); i++) {
-        /* fill buffer with new keystream */
-        srtp_aes_icm_advance(c);
+    /*
+     * now loop over entire 16-byte blocks of keystream, generating several
+     * blocks at a time so that the aes implementation can process them in
+     * parallel
+     */
+    size_t num_blocks = bytes_to_encr / sizeof(v128_t);
+    while (num_blocks > 0) {
+        v128_t keystream[SRTP_AES_ICM_KEYSTREAM_BLOCKS];
+        size_t n = num_blocks < SRTP_AES_ICM_KEYSTREAM_BLOCKS
+                       ? num_blocks
+                       : SRTP_AES_ICM_KEYSTREAM_BLOCKS;
+
+        srtp_aes_icm_advance_blocks(c, keystream, n);
 
         /*
-         * add keystream into the data buffer (this would be a lot faster
-         * if we could assume 32-bit alignment!)
+         * add keystream into the data buffer, the buffers need not be
+         * aligned, memcpy compiles to single unaligned vector loads and
+         * stores
          */
-
-#if ALIGN_32
-        b = (uint32_t *)buf;
-        s = (const uint32_t *)src;
-        *b++ = *s++ ^ c->keystream_buffer.v32[0];
-        *b++ = *s++ ^ c->keystream_buffer.v32[1];
-        *b++ = *s++ ^ c->keystream_buffer.v32[2];
-        *b++ = *s++ ^ c->keystream_buffer.v32[3];
-        buf = (uint8_t *)b;
-        src = (const uint8_t *)s;
-#else
-        if ((((uintptr_t)buf) & 0x03) != 0) {
-            *buf++ = *src++ ^ c->keystream_buffer.v8[0];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[1];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[2];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[3];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[4];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[5];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[6];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[7];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[8];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[9];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[10];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[11];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[12];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[13];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[14];
-            *buf++ = *src++ ^ c->keystream_buffer.v8[15];
-        } else {
-            b = (uint32_t *)buf;
-            s = (const uint32_t *)src;
-            *b++ = *s++ ^ c->keystream_buffer.v32[0];
-            *b++ = *s++ ^ c->keystream_buffer.v32[1];
-            *b++ = *s++ ^ c->keystream_buffer.v32[2];
-            *b++ = *s++ ^ c->keystream_buffer.v32[3];
-            buf = (uint8_t *)b;
-            src = (const uint8_t *)s;
+        for (size_t i = 0; i < n; i++) {
+            v128_t data;
+
+            memcpy(&data, src, sizeof(data));
+            v128_xor_eq(&data, &keystream[i]);
+            memcpy(buf, &data, sizeof(data));
+            buf += sizeof(v128_t);
+            src += sizeof(v128_t);
         }
-#endif /* #if ALIGN_32 */
+
+        octet_string_set_to_zero(keystream, sizeof(keystream));
+        num_blocks -= n;
     }
 
     /* if there is a tail end of the data, process it */
@@ -414,10 +456,131 @@ static srtp_err_status_t srtp_aes_icm_encrypt(void *cv,
     return srtp_err_status_ok;
 }
 
+/*
+ * aes_icm_clone(c, clone) allocates a context that shares the expanded key
+ * of c and has a copy of its offset, its counter is left at the offset as
+ * after init
+ */
+static srtp_err_status_t srtp_aes_icm_clone(const srtp_cipher_t *c,
+                                            srtp_cipher_t **clone)
+{
+    const srtp_aes_icm_ctx_t *icm = (const srtp_aes_icm_ctx_t *)c->state;
+    srtp_aes_icm_ctx_t *new_icm;
+    srtp_err_status_t status;
+
+    status = srtp_aes_icm_alloc(clone, c->key_len, 0);
+    if (status) {
+        return status;
+    }
+
+    new_icm = (srtp_aes_icm_ctx_t *)(*clone)->state;
+    new_icm->key = icm->key;
+    srtp_key_store_retain(icm->key.expanded_key);
+    v128_copy(&new_icm->counter, &icm->key.offset);
+    new_icm->bytes_in_buffer = 0;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * aes_icm_job_init(c, iv, job) takes the expanded key of c and the counter
+ * set_iv would give it. Jobs are only worth it when the AES instructions
+ * keep blocks of different keys in flight together.
+ */
+static srtp_err_status_t srtp_aes_icm_job_init(const void *cv,
+                                               const uint8_t *iv,
+                                               srtp_cipher_job_t *job)
+{
+    const srtp_aes_icm_ctx_t *c = (const srtp_aes_icm_ctx_t *)cv;
+    v128_t nonce, counter;
+
+    if (!srtp_aes_keys_interleaved()) {
+        return srtp_err_status_no_such_op;
+    }
+    if (c->key.expanded_key == NULL) {
+        return srtp_err_status_init_fail;
+    }
+
+    v128_copy_octet_string(&nonce, iv);
+    v128_xor(&counter, &c->key.offset, &nonce);
+    memcpy(job->counter, &counter, sizeof(job->counter));
+    job->key = c->key.expanded_key;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * aes_icm_compute_jobs(jobs, num_jobs) encrypts the counter blocks of all
+ * the jobs in one sequence, so that a job too short to fill the AES
+ * pipelines shares them with the next one
+ */
+#define SRTP_AES_ICM_JOB_BLOCKS 64
+
+static void srtp_aes_icm_job_blocks(v128_t *blocks,
+                                    const srtp_aes_expanded_key_t **keys,
+                                    uint8_t **out,
+                                    const size_t *out_len,
+                                    size_t num_blocks)
+{
+    srtp_aes_encrypt_blocks_keys(blocks, keys, num_blocks);
+    for (size_t i = 0; i < num_blocks; i++) {
+        if (out_len[i] == sizeof(v128_t)) {
+            memcpy(out[i], &blocks[i], sizeof(v128_t));
+        } else {
+            memcpy(out[i], &blocks[i], out_len[i]);
+        }
+    }
+}
+
+static void srtp_aes_icm_compute_jobs(srtp_cipher_job_t *jobs,
+                                      size_t num_jobs)
+{
+    v128_t blocks[SRTP_AES_ICM_JOB_BLOCKS];
+    const srtp_aes_expanded_key_t *keys[SRTP_AES_ICM_JOB_BLOCKS];
+    uint8_t *out[SRTP_AES_ICM_JOB_BLOCKS];
+    size_t out_len[SRTP_AES_ICM_JOB_BLOCKS];
+    size_t n = 0;
+
+    for (size_t j = 0; j < num_jobs; j++) {
+        const srtp_cipher_job_t *job = &jobs[j];
+        uint16_t block_index;
+        v128_t counter;
+
+        v128_copy_octet_string(&counter, job->counter);
+        block_index = ntohs(counter.v16[7]);
+
+        for (size_t pos = 0; pos < job->len; pos += sizeof(v128_t)) {
+            v128_copy(&blocks[n], &counter);
+            blocks[n].v16[7] = htons(block_index++);
+            keys[n] = (const srtp_aes_expanded_key_t *)job->key;
+            out[n] = job->keystream + pos;
+            out_len[n] = job->len - pos < sizeof(v128_t) ? job->len - pos
+                                                         : sizeof(v128_t);
+            n++;
+
+            if (n == SRTP_AES_ICM_JOB_BLOCKS) {
+                srtp_aes_icm_job_blocks(blocks, keys, out, out_len, n);
+                n = 0;
+            }
+        }
+    }
+    if (n > 0) {
+        srtp_aes_icm_job_blocks(blocks, keys, out, out_len, n);
+    }
+
+    octet_string_set_to_zero(blocks, sizeof(blocks));
+}
+
 static const char srtp_aes_icm_128_description[] =
     "AES-128 integer counter mode";
+#ifndef SRTP_NO_AES_192
+static const char srtp_aes_icm_192_description[] =
+    "AES-192 integer counter mode";
+#endif
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_icm_256_description[] =
     "AES-256 integer counter mode";
+#endif
 
 /*
  * note: the encrypt function is identical to the decrypt function
@@ -433,9 +596,31 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     srtp_aes_icm_set_iv,           /* */
     srtp_aes_icm_128_description,  /* */
     &srtp_aes_icm_128_test_case_0, /* */
-    SRTP_AES_ICM_128               /* */
+    SRTP_AES_ICM_128,              /* */
+    srtp_aes_icm_clone,            /* */
+    srtp_aes_icm_job_init,         /* */
+    srtp_aes_icm_compute_jobs      /* */
 };
 
+#ifndef SRTP_NO_AES_192
+const srtp_cipher_type_t srtp_aes_icm_192 = {
+    srtp_aes_icm_alloc,            /* */
+    srtp_aes_icm_dealloc,          /* */
+    srtp_aes_icm_context_init,     /* */
+    0,                             /* set_aad */
+    srtp_aes_icm_encrypt,          /* */
+    srtp_aes_icm_encrypt,          /* */
+    srtp_aes_icm_set_iv,           /* */
+    srtp_aes_icm_192_description,  /* */
+    &srtp_aes_icm_192_test_case_0, /* */
+    SRTP_AES_ICM_192,              /* */
+    srtp_aes_icm_clone,            /* */
+    srtp_aes_icm_job_init,         /* */
+    srtp_aes_icm_compute_jobs      /* */
+};
+#endif
+
+#ifndef SRTP_NO_AES_256
 const srtp_cipher_type_t srtp_aes_icm_256 = {
     srtp_aes_icm_alloc,            /* */
     srtp_aes_icm_dealloc,          /* */
@@ -446,5 +631,9 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     srtp_aes_icm_set_iv,           /* */
     srtp_aes_icm_256_description,  /* */
     &srtp_aes_icm_256_test_case_0, /* */
-    SRTP_AES_ICM_256               /* */
+    SRTP_AES_ICM_256,              /* */
+    srtp_aes_icm_clone,            /* */
+    srtp_aes_icm_job_init,         /* */
+    srtp_aes_icm_compute_jobs      /* */
 };
+#endif
@@ -0,0 +1,448 @@
+/*
+ * aes_icm_cc.c
+ *
+ * AES Integer Counter Mode using Apple CommonCrypto
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "aes_icm_ext.h"
+#include "crypto_types.h"
+#include "err.h" /* for srtp_debug */
+#include "alloc.h"
+#include "cipher_types.h"
+#include "cipher_test_cases.h"
+
+srtp_debug_module_t srtp_mod_aes_icm = {
+    false,                 /* debugging is off by default */
+    "aes icm commoncrypto" /* printable module name       */
+};
+
+/*
+ * integer counter mode works as follows:
+ *
+ * 16 bits
+ * <----->
+ * +------+------+------+------+------+------+------+------+
+ * |           nonce           |    packet index    |  ctr |---+
+ * +------+------+------+------+------+------+------+------+   |
+ *                                                             |
+ * +------+------+------+------+------+------+------+------+   v
+ * |                      salt                      |000000|->(+)
+ * +------+------+------+------+------+------+------+------+   |
+ *                                                             |
+ *                                                        +---------+
+ *                                                        | encrypt |
+ *                                                        +---------+
+ *                                                             |
+ * +------+------+------+------+------+------+------+------+   |
+ * |                    keystream block                    |<--+
+ * +------+------+------+------+------+------+------+------+
+ *
+ * All fields are big-endian
+ *
+ * ctr is the block counter, which increments from zero for
+ * each packet (16 bits wide)
+ *
+ * packet index is distinct for each packet (48 bits wide)
+ *
+ * nonce can be distinct across many uses of the same key, or
+ * can be a fixed value per key, or can be per-packet randomness
+ * (64 bits)
+ *
+ * The counter blocks are encrypted by a CommonCrypto AES-CTR cryptor,
+ * which is created once per key and only has its counter reset for
+ * each packet
+ */
+
+/*
+ * aes_icm_cc_create(c) creates the AES-CTR cryptor of c from the key
+ * kept in c, starting at the current counter value
+ */
+static srtp_err_status_t srtp_aes_icm_cc_create(srtp_aes_icm_ctx_t *c)
+{
+    if (c->ctx) {
+        CCCryptorRelease(c->ctx);
+        c->ctx = NULL;
+    }
+
+    if (CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES,
+                                ccNoPadding, c->counter.v8, c->key,
+                                c->key_size, NULL, 0, 0, kCCModeOptionCTR_BE,
+                                &c->ctx) != kCCSuccess) {
+        c->ctx = NULL;
+        return srtp_err_status_cipher_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function allocates a new instance of this crypto engine.
+ * The key_len parameter should be one of 30, 38, or 46 for
+ * AES-128, AES-192, and AES-256 respectively.  Note, this key_len
+ * value is inflated, as it also accounts for the 112 bit salt
+ * value.  The tlen argument is for the AEAD tag length, which
+ * isn't used in counter mode.
+ */
+static srtp_err_status_t srtp_aes_icm_cc_alloc(srtp_cipher_t **c,
+                                               size_t key_len,
+                                               size_t tlen)
+{
+    srtp_aes_icm_ctx_t *icm;
+    (void)tlen;
+
+    debug_print(srtp_mod_aes_icm, "allocating cipher with key length %zu",
+                key_len);
+
+    /*
+     * Verify the key_len is valid for one of: AES-128/192/256
+     */
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    /* allocate memory a cipher of type aes_icm */
+    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
+    if (*c == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_icm_ctx_t));
+    if (icm == NULL) {
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    icm->ctx = NULL;
+
+    /* set pointers */
+    (*c)->state = icm;
+
+    /* setup cipher parameters */
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_128;
+        (*c)->type = &srtp_aes_icm_128;
+        icm->key_size = SRTP_AES_128_KEY_LEN;
+        break;
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_192;
+        (*c)->type = &srtp_aes_icm_192;
+        icm->key_size = SRTP_AES_192_KEY_LEN;
+        break;
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_256;
+        (*c)->type = &srtp_aes_icm_256;
+        icm->key_size = SRTP_AES_256_KEY_LEN;
+        break;
+#endif
+    }
+
+    /* set key size        */
+    (*c)->key_len = key_len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function deallocates an instance of this engine
+ */
+static srtp_err_status_t srtp_aes_icm_cc_dealloc(srtp_cipher_t *c)
+{
+    srtp_aes_icm_ctx_t *ctx;
+
+    ctx = (srtp_aes_icm_ctx_t *)c->state;
+    if (ctx) {
+        /* free the cryptor, which zeroizes its key schedule */
+        if (ctx->ctx) {
+            CCCryptorRelease(ctx->ctx);
+            ctx->ctx = NULL;
+        }
+
+        /* zeroize everything */
+        octet_string_set_to_zero(ctx, sizeof(srtp_aes_icm_ctx_t));
+        srtp_crypto_free(ctx);
+    }
+
+    /* free memory */
+    srtp_crypto_free(c);
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_icm_cc_context_init(...) initializes the aes_icm_context
+ * using the value in key[].
+ *
+ * the key is the secret key
+ *
+ * the salt is unpredictable (but not necessarily secret) data which
+ * randomizes the starting point in the keystream
+ */
+static srtp_err_status_t srtp_aes_icm_cc_context_init(void *cv,
+                                                      const uint8_t *key)
+{
+    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+
+    /*
+     * set counter and initial values to 'offset' value, being careful not to
+     * go past the end of the key buffer
+     */
+    v128_set_to_zero(&c->counter);
+    v128_set_to_zero(&c->offset);
+    memcpy(&c->counter, key + c->key_size, SRTP_SALT_LEN);
+    memcpy(&c->offset, key + c->key_size, SRTP_SALT_LEN);
+
+    /* force last two octets of the offset to zero (for srtp compatibility) */
+    c->offset.v8[SRTP_SALT_LEN] = c->offset.v8[SRTP_SALT_LEN + 1] = 0;
+    c->counter.v8[SRTP_SALT_LEN] = c->counter.v8[SRTP_SALT_LEN + 1] = 0;
+
+    debug_print(srtp_mod_aes_icm, "key:  %s",
+                srtp_octet_string_hex_string(key, c->key_size));
+    debug_print(srtp_mod_aes_icm, "offset: %s", v128_hex_string(&c->offset));
+
+    memcpy(c->key, key, c->key_size);
+
+    return srtp_aes_icm_cc_create(c);
+}
+
+/*
+ * aes_icm_set_iv(c, iv) sets the counter value to the exor of iv with
+ * the offset
+ */
+static srtp_err_status_t srtp_aes_icm_cc_set_iv(void *cv,
+                                                uint8_t *iv,
+                                                srtp_cipher_direction_t dir)
+{
+    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+    v128_t nonce;
+    (void)dir;
+
+    /* set nonce (for alignment) */
+    v128_copy_octet_string(&nonce, iv);
+
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+
+    v128_xor(&c->counter, &c->offset, &nonce);
+
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
+                v128_hex_string(&c->counter));
+
+    if (c->ctx == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * resetting keeps the key schedule, releases before macOS 10.13 and
+     * iOS 11 only reset CBC cryptors, there the cryptor is created again
+     */
+    if (CCCryptorReset(c->ctx, c->counter.v8) == kCCSuccess) {
+        return srtp_err_status_ok;
+    }
+
+    return srtp_aes_icm_cc_create(c);
+}
+
+/*
+ * This function encrypts a buffer using AES CTR mode
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to encrypt
+ *	enc_len	length of encrypt buffer
+ */
+static srtp_err_status_t srtp_aes_icm_cc_encrypt(void *cv,
+                                                 const uint8_t *src,
+                                                 size_t src_len,
+                                                 uint8_t *dst,
+                                                 size_t *dst_len)
+{
+    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+    size_t moved = 0;
+
+    debug_trace(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
+
+    if (c->ctx == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (dst_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (*dst_len < src_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    /* a CTR cryptor keeps the unused keystream of a partial block */
+    if (CCCryptorUpdate(c->ctx, src, src_len, dst, *dst_len, &moved) !=
+            kCCSuccess ||
+        moved != src_len) {
+        return srtp_err_status_cipher_fail;
+    }
+    *dst_len = moved;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function creates a context keyed like an initialized one, with
+ * its own cryptor so that its counter state is separate
+ */
+static srtp_err_status_t srtp_aes_icm_cc_clone(const srtp_cipher_t *c,
+                                               srtp_cipher_t **clone)
+{
+    const srtp_aes_icm_ctx_t *icm = (const srtp_aes_icm_ctx_t *)c->state;
+    srtp_aes_icm_ctx_t *new_icm;
+    srtp_err_status_t status;
+
+    status = srtp_aes_icm_cc_alloc(clone, c->key_len, 0);
+    if (status) {
+        return status;
+    }
+
+    new_icm = (srtp_aes_icm_ctx_t *)(*clone)->state;
+    v128_copy(&new_icm->offset, &icm->offset);
+    v128_copy(&new_icm->counter, &icm->offset);
+    memcpy(new_icm->key, icm->key, icm->key_size);
+
+    status = srtp_aes_icm_cc_create(new_icm);
+    if (status) {
+        srtp_aes_icm_cc_dealloc(*clone);
+        *clone = NULL;
+        return status;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * Name of this crypto engine
+ */
+static const char srtp_aes_icm_128_cc_description[] =
+    "AES-128 counter mode using CommonCrypto";
+#ifndef SRTP_NO_AES_192
+static const char srtp_aes_icm_192_cc_description[] =
+    "AES-192 counter mode using CommonCrypto";
+#endif
+#ifndef SRTP_NO_AES_256
+static const char srtp_aes_icm_256_cc_description[] =
+    "AES-256 counter mode using CommonCrypto";
+#endif
+
+/*
+ * This is the function table for this crypto engine.
+ * note: the encrypt function is identical to the decrypt function
+ */
+const srtp_cipher_type_t srtp_aes_icm_128 = {
+    srtp_aes_icm_cc_alloc,           /* */
+    srtp_aes_icm_cc_dealloc,         /* */
+    srtp_aes_icm_cc_context_init,    /* */
+    0,                               /* set_aad */
+    srtp_aes_icm_cc_encrypt,         /* */
+    srtp_aes_icm_cc_encrypt,         /* */
+    srtp_aes_icm_cc_set_iv,          /* */
+    srtp_aes_icm_128_cc_description, /* */
+    &srtp_aes_icm_128_test_case_0,   /* */
+    SRTP_AES_ICM_128,                /* */
+    srtp_aes_icm_cc_clone,           /* */
+    NULL,                            /* job_init */
+    NULL                             /* compute_jobs */
+};
+
+#ifndef SRTP_NO_AES_192
+/*
+ * This is the function table for this crypto engine.
+ * note: the encrypt function is identical to the decrypt function
+ */
+const srtp_cipher_type_t srtp_aes_icm_192 = {
+    srtp_aes_icm_cc_alloc,           /* */
+    srtp_aes_icm_cc_dealloc,         /* */
+    srtp_aes_icm_cc_context_init,    /* */
+    0,                               /* set_aad */
+    srtp_aes_icm_cc_encrypt,         /* */
+    srtp_aes_icm_cc_encrypt,         /* */
+    srtp_aes_icm_cc_set_iv,          /* */
+    srtp_aes_icm_192_cc_description, /* */
+    &srtp_aes_icm_192_test_case_0,   /* */
+    SRTP_AES_ICM_192,                /* */
+    srtp_aes_icm_cc_clone,           /* */
+    NULL,                            /* job_init */
+    NULL                             /* compute_jobs */
+};
+#endif
+
+#ifndef SRTP_NO_AES_256
+/*
+ * This is the function table for this crypto engine.
+ * note: the encrypt function is identical to the decrypt function
+ */
+const srtp_cipher_type_t srtp_aes_icm_256 = {
+    srtp_aes_icm_cc_alloc,           /* */
+    srtp_aes_icm_cc_dealloc,         /* */
+    srtp_aes_icm_cc_context_init,    /* */
+    0,                               /* set_aad */
+    srtp_aes_icm_cc_encrypt,         /* */
+    srtp_aes_icm_cc_encrypt,         /* */
+    srtp_aes_icm_cc_set_iv,          /* */
+    srtp_aes_icm_256_cc_description, /* */
+    &srtp_aes_icm_256_test_case_0,   /* */
+    SRTP_AES_ICM_256,                /* */
+    srtp_aes_icm_cc_clone,           /* */
+    NULL,                            /* job_init */
+    NULL                             /* compute_jobs */
+};
+#endif
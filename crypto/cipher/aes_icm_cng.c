@@ -0,0 +1,514 @@
+/*
+ * aes_icm_cng.c
+ *
+ * AES Integer Counter Mode using the Windows CNG (bcrypt) API
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "aes_icm_ext.h"
+#include "crypto_types.h"
+#include "err.h" /* for srtp_debug */
+#include "alloc.h"
+#include "cipher_types.h"
+#include "cipher_test_cases.h"
+
+srtp_debug_module_t srtp_mod_aes_icm = {
+    false,        /* debugging is off by default */
+    "aes icm cng" /* printable module name       */
+};
+
+/*
+ * integer counter mode works as follows:
+ *
+ * 16 bits
+ * <----->
+ * +------+------+------+------+------+------+------+------+
+ * |           nonce           |    packet index    |  ctr |---+
+ * +------+------+------+------+------+------+------+------+   |
+ *                                                             |
+ * +------+------+------+------+------+------+------+------+   v
+ * |                      salt                      |000000|->(+)
+ * +------+------+------+------+------+------+------+------+   |
+ *                                                             |
+ *                                                        +---------+
+ *                                                        | encrypt |
+ *                                                        +---------+
+ *                                                             |
+ * +------+------+------+------+------+------+------+------+   |
+ * |                    keystream block                    |<--+
+ * +------+------+------+------+------+------+------+------+
+ *
+ * All fields are big-endian
+ *
+ * ctr is the block counter, which increments from zero for
+ * each packet (16 bits wide)
+ *
+ * packet index is distinct for each packet (48 bits wide)
+ *
+ * nonce can be distinct across many uses of the same key, or
+ * can be a fixed value per key, or can be per-packet randomness
+ * (64 bits)
+ *
+ * CNG has no counter mode, so the counter blocks are encrypted with an
+ * AES-ECB key object that is kept for the lifetime of the key
+ */
+
+/*
+ * This function allocates a new instance of this crypto engine.
+ * The key_len parameter should be one of 30, 38, or 46 for
+ * AES-128, AES-192, and AES-256 respectively.  Note, this key_len
+ * value is inflated, as it also accounts for the 112 bit salt
+ * value.  The tlen argument is for the AEAD tag length, which
+ * isn't used in counter mode.
+ */
+static srtp_err_status_t srtp_aes_icm_cng_alloc(srtp_cipher_t **c,
+                                                size_t key_len,
+                                                size_t tlen)
+{
+    srtp_aes_icm_ctx_t *icm;
+    BCRYPT_ALG_HANDLE alg;
+    (void)tlen;
+
+    debug_print(srtp_mod_aes_icm, "allocating cipher with key length %zu",
+                key_len);
+
+    /*
+     * Verify the key_len is valid for one of: AES-128/192/256
+     */
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(
+            &alg, BCRYPT_AES_ALGORITHM, NULL, 0))) {
+        return srtp_err_status_cipher_fail;
+    }
+    if (!BCRYPT_SUCCESS(BCryptSetProperty(
+            alg, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_ECB,
+            sizeof(BCRYPT_CHAIN_MODE_ECB), 0))) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return srtp_err_status_cipher_fail;
+    }
+
+    /* allocate memory a cipher of type aes_icm */
+    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
+    if (*c == NULL) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return srtp_err_status_alloc_fail;
+    }
+
+    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_icm_ctx_t));
+    if (icm == NULL) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    icm->alg = alg;
+    icm->key = NULL;
+
+    /* set pointers */
+    (*c)->state = icm;
+
+    /* setup cipher parameters */
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_128;
+        (*c)->type = &srtp_aes_icm_128;
+        icm->key_size = SRTP_AES_128_KEY_LEN;
+        break;
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_192;
+        (*c)->type = &srtp_aes_icm_192;
+        icm->key_size = SRTP_AES_192_KEY_LEN;
+        break;
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+        (*c)->algorithm = SRTP_AES_ICM_256;
+        (*c)->type = &srtp_aes_icm_256;
+        icm->key_size = SRTP_AES_256_KEY_LEN;
+        break;
+#endif
+    }
+
+    /* set key size        */
+    (*c)->key_len = key_len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function deallocates an instance of this engine
+ */
+static srtp_err_status_t srtp_aes_icm_cng_dealloc(srtp_cipher_t *c)
+{
+    srtp_aes_icm_ctx_t *ctx;
+
+    ctx = (srtp_aes_icm_ctx_t *)c->state;
+    if (ctx) {
+        /* free the CNG objects that have been created */
+        if (ctx->key) {
+            BCryptDestroyKey(ctx->key);
+            ctx->key = NULL;
+        }
+
+        if (ctx->alg) {
+            BCryptCloseAlgorithmProvider(ctx->alg, 0);
+            ctx->alg = NULL;
+        }
+
+        /* zeroize everything */
+        octet_string_set_to_zero(ctx, sizeof(srtp_aes_icm_ctx_t));
+        srtp_crypto_free(ctx);
+    }
+
+    /* free memory */
+    srtp_crypto_free(c);
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_icm_cng_context_init(...) initializes the aes_icm_context
+ * using the value in key[].
+ *
+ * the key is the secret key
+ *
+ * the salt is unpredictable (but not necessarily secret) data which
+ * randomizes the starting point in the keystream
+ */
+static srtp_err_status_t srtp_aes_icm_cng_context_init(void *cv,
+                                                       const uint8_t *key)
+{
+    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+
+    /*
+     * set counter and initial values to 'offset' value, being careful not to
+     * go past the end of the key buffer
+     */
+    v128_set_to_zero(&c->counter);
+    v128_set_to_zero(&c->offset);
+    memcpy(&c->counter, key + c->key_size, SRTP_SALT_LEN);
+    memcpy(&c->offset, key + c->key_size, SRTP_SALT_LEN);
+
+    /* force last two octets of the offset to zero (for srtp compatibility) */
+    c->offset.v8[SRTP_SALT_LEN] = c->offset.v8[SRTP_SALT_LEN + 1] = 0;
+    c->counter.v8[SRTP_SALT_LEN] = c->counter.v8[SRTP_SALT_LEN + 1] = 0;
+
+    debug_print(srtp_mod_aes_icm, "key:  %s",
+                srtp_octet_string_hex_string(key, c->key_size));
+    debug_print(srtp_mod_aes_icm, "offset: %s", v128_hex_string(&c->offset));
+
+    if (c->key) {
+        BCryptDestroyKey(c->key);
+        c->key = NULL;
+    }
+
+    c->bytes_in_buffer = 0;
+
+    /* explicitly cast away const of key, CNG copies it into the key object */
+    if (!BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(
+            c->alg, &c->key, NULL, 0, (PUCHAR)(uintptr_t)key,
+            (ULONG)c->key_size, 0))) {
+        c->key = NULL;
+        return srtp_err_status_cipher_fail;
+    }
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_icm_set_iv(c, iv) sets the counter value to the exor of iv with
+ * the offset
+ */
+static srtp_err_status_t srtp_aes_icm_cng_set_iv(void *cv,
+                                                 uint8_t *iv,
+                                                 srtp_cipher_direction_t dir)
+{
+    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+    v128_t nonce;
+    (void)dir;
+
+    /* set nonce (for alignment) */
+    v128_copy_octet_string(&nonce, iv);
+
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+
+    v128_xor(&c->counter, &c->offset, &nonce);
+
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
+                v128_hex_string(&c->counter));
+
+    /* indicate that the keystream_buffer is empty */
+    c->bytes_in_buffer = 0;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * SRTP_AES_ICM_CNG_KEYSTREAM_BLOCKS is the number of counter blocks that
+ * are encrypted with one call into CNG
+ */
+#define SRTP_AES_ICM_CNG_KEYSTREAM_BLOCKS 64
+
+/*
+ * aes_icm_cng_advance_blocks(c, keystream, num_blocks) writes the
+ * keystream of the next num_blocks counter values to keystream and
+ * advances the counter past them
+ */
+static srtp_err_status_t srtp_aes_icm_cng_advance_blocks(
+    srtp_aes_icm_ctx_t *c,
+    v128_t *keystream,
+    size_t num_blocks)
+{
+    uint16_t block_index = ntohs(c->counter.v16[7]);
+    ULONG len = (ULONG)(num_blocks * sizeof(v128_t));
+    ULONG out_len = 0;
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        v128_copy(&keystream[i], &c->counter);
+        keystream[i].v16[7] = htons((uint16_t)(block_index + i));
+    }
+    c->counter.v16[7] = htons((uint16_t)(block_index + num_blocks));
+
+    if (!BCRYPT_SUCCESS(BCryptEncrypt(c->key, (PUCHAR)keystream, len, NULL,
+                                      NULL, 0, (PUCHAR)keystream, len,
+                                      &out_len, 0)) ||
+        out_len != len) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    debug_trace(srtp_mod_aes_icm, "counter:    %s",
+                v128_hex_string(&c->counter));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function encrypts a buffer using AES CTR mode
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to encrypt
+ *	enc_len	length of encrypt buffer
+ */
+static srtp_err_status_t srtp_aes_icm_cng_encrypt(void *cv,
+                                                  const uint8_t *src,
+                                                  size_t src_len,
+                                                  uint8_t *dst,
+                                                  size_t *dst_len)
+{
+    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+    size_t bytes_to_encr = src_len;
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    if (!c->key) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (dst_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (*dst_len < src_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    *dst_len = src_len;
+
+    /* check that there's enough segment left */
+    if (bytes_to_encr > c->bytes_in_buffer) {
+        size_t blocks_of_new_keystream =
+            (bytes_to_encr - c->bytes_in_buffer + 15) >> 4;
+        if (blocks_of_new_keystream >
+            (size_t)0xffff - ntohs(c->counter.v16[7])) {
+            return srtp_err_status_terminus;
+        }
+    }
+
+    /* use up the keystream left over from the last call */
+    size_t n = bytes_to_encr < c->bytes_in_buffer ? bytes_to_encr
+                                                  : c->bytes_in_buffer;
+    size_t pos = sizeof(v128_t) - c->bytes_in_buffer;
+    for (size_t i = 0; i < n; i++) {
+        *dst++ = *src++ ^ c->keystream_buffer.v8[pos + i];
+    }
+    c->bytes_in_buffer -= n;
+    bytes_to_encr -= n;
+
+    /* then encrypt whole blocks, several counter blocks per call */
+    size_t num_blocks = bytes_to_encr / sizeof(v128_t);
+    while (num_blocks > 0) {
+        v128_t keystream[SRTP_AES_ICM_CNG_KEYSTREAM_BLOCKS];
+        size_t blocks = num_blocks < SRTP_AES_ICM_CNG_KEYSTREAM_BLOCKS
+                            ? num_blocks
+                            : SRTP_AES_ICM_CNG_KEYSTREAM_BLOCKS;
+
+        status = srtp_aes_icm_cng_advance_blocks(c, keystream, blocks);
+        if (status) {
+            octet_string_set_to_zero(keystream, sizeof(keystream));
+            return status;
+        }
+
+        for (size_t i = 0; i < blocks; i++) {
+            v128_t data;
+
+            memcpy(&data, src, sizeof(v128_t));
+            v128_xor_eq(&data, &keystream[i]);
+            memcpy(dst, &data, sizeof(v128_t));
+            src += sizeof(v128_t);
+            dst += sizeof(v128_t);
+        }
+
+        octet_string_set_to_zero(keystream, sizeof(keystream));
+        num_blocks -= blocks;
+        bytes_to_encr -= blocks * sizeof(v128_t);
+    }
+
+    /* if there is a tail end of the data, keep the rest of its block */
+    if (bytes_to_encr > 0) {
+        status =
+            srtp_aes_icm_cng_advance_blocks(c, &c->keystream_buffer, 1);
+        if (status) {
+            return status;
+        }
+
+        for (size_t i = 0; i < bytes_to_encr; i++) {
+            *dst++ = *src++ ^ c->keystream_buffer.v8[i];
+        }
+
+        c->bytes_in_buffer = sizeof(v128_t) - bytes_to_encr;
+    }
+
+    return status;
+}
+
+/*
+ * Name of this crypto engine
+ */
+static const char srtp_aes_icm_128_cng_description[] =
+    "AES-128 counter mode using CNG";
+#ifndef SRTP_NO_AES_192
+static const char srtp_aes_icm_192_cng_description[] =
+    "AES-192 counter mode using CNG";
+#endif
+#ifndef SRTP_NO_AES_256
+static const char srtp_aes_icm_256_cng_description[] =
+    "AES-256 counter mode using CNG";
+#endif
+
+/*
+ * This is the function table for this crypto engine.
+ * note: the encrypt function is identical to the decrypt function
+ */
+const srtp_cipher_type_t srtp_aes_icm_128 = {
+    srtp_aes_icm_cng_alloc,           /* */
+    srtp_aes_icm_cng_dealloc,         /* */
+    srtp_aes_icm_cng_context_init,    /* */
+    0,                                /* set_aad */
+    srtp_aes_icm_cng_encrypt,         /* */
+    srtp_aes_icm_cng_encrypt,         /* */
+    srtp_aes_icm_cng_set_iv,          /* */
+    srtp_aes_icm_128_cng_description, /* */
+    &srtp_aes_icm_128_test_case_0,    /* */
+    SRTP_AES_ICM_128,                 /* */
+    NULL,                             /* clone */
+    NULL,                             /* job_init */
+    NULL                              /* compute_jobs */
+};
+
+#ifndef SRTP_NO_AES_192
+/*
+ * This is the function table for this crypto engine.
+ * note: the encrypt function is identical to the decrypt function
+ */
+const srtp_cipher_type_t srtp_aes_icm_192 = {
+    srtp_aes_icm_cng_alloc,           /* */
+    srtp_aes_icm_cng_dealloc,         /* */
+    srtp_aes_icm_cng_context_init,    /* */
+    0,                                /* set_aad */
+    srtp_aes_icm_cng_encrypt,         /* */
+    srtp_aes_icm_cng_encrypt,         /* */
+    srtp_aes_icm_cng_set_iv,          /* */
+    srtp_aes_icm_192_cng_description, /* */
+    &srtp_aes_icm_192_test_case_0,    /* */
+    SRTP_AES_ICM_192,                 /* */
+    NULL,                             /* clone */
+    NULL,                             /* job_init */
+    NULL                              /* compute_jobs */
+};
+#endif
+
+#ifndef SRTP_NO_AES_256
+/*
+ * This is the function table for this crypto engine.
+ * note: the encrypt function is identical to the decrypt function
+ */
+const srtp_cipher_type_t srtp_aes_icm_256 = {
+    srtp_aes_icm_cng_alloc,           /* */
+    srtp_aes_icm_cng_dealloc,         /* */
+    srtp_aes_icm_cng_context_init,    /* */
+    0,                                /* set_aad */
+    srtp_aes_icm_cng_encrypt,         /* */
+    srtp_aes_icm_cng_encrypt,         /* */
+    srtp_aes_icm_cng_set_iv,          /* */
+    srtp_aes_icm_256_cng_description, /* */
+    &srtp_aes_icm_256_test_case_0,    /* */
+    SRTP_AES_ICM_256,                 /* */
+    NULL,                             /* clone */
+    NULL,                             /* job_init */
+    NULL                              /* compute_jobs */
+};
+#endif
@@ -54,6 +54,7 @@
 #include "alloc.h"
 #include "cipher_types.h"
 #include "cipher_test_cases.h"
+#include "psa_key_location.h"
 
 srtp_debug_module_t srtp_mod_aes_icm = {
     false,            /* debugging is off by default */
@@ -88,10 +89,14 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_encrypt(void *cv,
  */
 static const char srtp_aes_icm_128_mbedtls_description[] =
     "AES-128 counter mode using mbedtls";
+#ifndef SRTP_NO_AES_192
 static const char srtp_aes_icm_192_mbedtls_description[] =
     "AES-192 counter mode using mbedtls";
+#endif
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_icm_256_mbedtls_description[] =
     "AES-256 counter mode using mbedtls";
+#endif
 
 /*
  * This is the function table for this crypto engine.
@@ -107,9 +112,13 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     srtp_aes_icm_mbedtls_set_iv,          /* */
     srtp_aes_icm_128_mbedtls_description, /* */
     &srtp_aes_icm_128_test_case_0,        /* */
-    SRTP_AES_ICM_128                      /* */
+    SRTP_AES_ICM_128,                     /* */
+    NULL,                                 /* clone */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
 
+#ifndef SRTP_NO_AES_192
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -124,9 +133,14 @@ const srtp_cipher_type_t srtp_aes_icm_192 = {
     srtp_aes_icm_mbedtls_set_iv,          /* */
     srtp_aes_icm_192_mbedtls_description, /* */
     &srtp_aes_icm_192_test_case_0,        /* */
-    SRTP_AES_ICM_192                      /* */
+    SRTP_AES_ICM_192,                     /* */
+    NULL,                                 /* clone */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
+#endif
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -141,8 +155,12 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     srtp_aes_icm_mbedtls_set_iv,          /* */
     srtp_aes_icm_256_mbedtls_description, /* */
     &srtp_aes_icm_256_test_case_0,        /* */
-    SRTP_AES_ICM_256                      /* */
+    SRTP_AES_ICM_256,                     /* */
+    NULL,                                 /* clone */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
+#endif
 
 /*
  * integer counter mode works as follows:
@@ -212,9 +230,16 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/192/256
      */
-    if (key_len != SRTP_AES_ICM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_192_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return srtp_err_status_bad_param;
     }
 
@@ -254,16 +279,20 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_alloc(srtp_cipher_t **c,
         (*c)->type = &srtp_aes_icm_128;
         icm->key_size = SRTP_AES_128_KEY_LEN;
         break;
+#ifndef SRTP_NO_AES_192
     case SRTP_AES_ICM_192_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_192;
         (*c)->type = &srtp_aes_icm_192;
         icm->key_size = SRTP_AES_192_KEY_LEN;
         break;
+#endif
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_ICM_256_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_256;
         (*c)->type = &srtp_aes_icm_256;
         icm->key_size = SRTP_AES_256_KEY_LEN;
         break;
+#endif
     }
 
     /* set key size        */
@@ -350,6 +379,7 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_context_init(void *cv,
     psa_set_key_usage_flags(&attr,
                             PSA_KEY_USAGE_ENCRYPT | PSA_KEY_USAGE_DECRYPT);
     psa_set_key_algorithm(&attr, PSA_ALG_CTR);
+    srtp_psa_set_key_location(&attr);
 
     if (c->ctx->key_id != PSA_KEY_ID_NULL) {
         psa_destroy_key(c->ctx->key_id);
@@ -387,11 +417,11 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_set_iv(
     /* set nonce (for alignment) */
     v128_copy_octet_string(&nonce, iv);
 
-    debug_print(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
 
     v128_xor(&c->counter, &c->offset, &nonce);
 
-    debug_print(srtp_mod_aes_icm, "set_counter: %s",
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
                 v128_hex_string(&c->counter));
 
     status = psa_cipher_abort(&c->ctx->op);
@@ -440,8 +470,8 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_encrypt(void *cv,
     psa_status_t status = PSA_SUCCESS;
     size_t out_len = 0;
 
-    debug_print(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
-    debug_print(srtp_mod_aes_icm, "source: %s",
+    debug_trace(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
+    debug_trace(srtp_mod_aes_icm, "source: %s",
                 srtp_octet_string_hex_string(src, src_len));
 
     if (*dst_len < src_len) {
@@ -458,7 +488,7 @@ static srtp_err_status_t srtp_aes_icm_mbedtls_encrypt(void *cv,
     }
 
     *dst_len = out_len;
-    debug_print(srtp_mod_aes_icm, "encrypted: %s",
+    debug_trace(srtp_mod_aes_icm, "encrypted: %s",
                 srtp_octet_string_hex_string(dst, *dst_len));
 
     return srtp_err_status_ok;
@@ -116,9 +116,16 @@ static srtp_err_status_t srtp_aes_icm_nss_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/192/256
      */
-    if (key_len != SRTP_AES_ICM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_192_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return srtp_err_status_bad_param;
     }
 
@@ -160,16 +167,20 @@ static srtp_err_status_t srtp_aes_icm_nss_alloc(srtp_cipher_t **c,
         (*c)->type = &srtp_aes_icm_128;
         icm->key_size = SRTP_AES_128_KEY_LEN;
         break;
+#ifndef SRTP_NO_AES_192
     case SRTP_AES_ICM_192_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_192;
         (*c)->type = &srtp_aes_icm_192;
         icm->key_size = SRTP_AES_192_KEY_LEN;
         break;
+#endif
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_ICM_256_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_256;
         (*c)->type = &srtp_aes_icm_256;
         icm->key_size = SRTP_AES_256_KEY_LEN;
         break;
+#endif
     }
 
     /* set key size        */
@@ -245,12 +256,19 @@ static srtp_err_status_t srtp_aes_icm_nss_context_init(void *cv,
                 srtp_octet_string_hex_string(key, c->key_size));
     debug_print(srtp_mod_aes_icm, "offset: %s", v128_hex_string(&c->offset));
 
+    if (c->ctx) {
+        PK11_DestroyContext(c->ctx, PR_TRUE);
+        c->ctx = NULL;
+    }
+
     if (c->key) {
         PK11_FreeSymKey(c->key);
         c->key = NULL;
     }
 
-    PK11SlotInfo *slot = PK11_GetBestSlot(CKM_AES_CTR, NULL);
+    c->bytes_in_buffer = 0;
+
+    PK11SlotInfo *slot = PK11_GetBestSlot(CKM_AES_ECB, NULL);
     if (!slot) {
         return srtp_err_status_bad_param;
     }
@@ -264,9 +282,9 @@ static srtp_err_status_t srtp_aes_icm_nss_context_init(void *cv,
          * key material!
          */
         c->key =
-            import_sym_key_in_FIPS(slot, CKM_AES_CTR, CKA_ENCRYPT, &keyItem);
+            import_sym_key_in_FIPS(slot, CKM_AES_ECB, CKA_ENCRYPT, &keyItem);
     } else {
-        c->key = PK11_ImportSymKey(slot, CKM_AES_CTR, PK11_OriginUnwrap,
+        c->key = PK11_ImportSymKey(slot, CKM_AES_ECB, PK11_OriginUnwrap,
                                    CKA_ENCRYPT, &keyItem, NULL);
     }
     PK11_FreeSlot(slot);
@@ -275,6 +293,18 @@ static srtp_err_status_t srtp_aes_icm_nss_context_init(void *cv,
         return srtp_err_status_cipher_fail;
     }
 
+    /*
+     * the counter blocks are encrypted with a single ECB context for the
+     * lifetime of the key, rather than with a CTR context created for the
+     * iv of each packet, which costs a PKCS#11 session object per packet
+     */
+    SECItem paramItem = { siBuffer, NULL, 0 };
+    c->ctx = PK11_CreateContextBySymKey(CKM_AES_ECB, CKA_ENCRYPT, c->key,
+                                        &paramItem);
+    if (!c->ctx) {
+        return srtp_err_status_cipher_fail;
+    }
+
     return (srtp_err_status_ok);
 }
 
@@ -293,34 +323,54 @@ static srtp_err_status_t srtp_aes_icm_nss_set_iv(void *cv,
     /* set nonce (for alignment) */
     v128_copy_octet_string(&nonce, iv);
 
-    debug_print(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
 
     v128_xor(&c->counter, &c->offset, &nonce);
 
-    debug_print(srtp_mod_aes_icm, "set_counter: %s",
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
                 v128_hex_string(&c->counter));
 
-    /* set up the PK11 context now that we have all the info */
-    CK_AES_CTR_PARAMS param;
-    param.ulCounterBits = 16;
-    memcpy(param.cb, &c->counter, 16);
+    /* indicate that the keystream_buffer is empty */
+    c->bytes_in_buffer = 0;
 
-    if (!c->key) {
-        return srtp_err_status_bad_param;
-    }
+    return srtp_err_status_ok;
+}
 
-    if (c->ctx) {
-        PK11_DestroyContext(c->ctx, PR_TRUE);
+/*
+ * SRTP_AES_ICM_NSS_KEYSTREAM_BLOCKS is the number of counter blocks that
+ * are encrypted with one call into NSS
+ */
+#define SRTP_AES_ICM_NSS_KEYSTREAM_BLOCKS 64
+
+/*
+ * aes_icm_nss_advance_blocks(c, keystream, num_blocks) writes the
+ * keystream of the next num_blocks counter values to keystream and
+ * advances the counter past them
+ */
+static srtp_err_status_t srtp_aes_icm_nss_advance_blocks(
+    srtp_aes_icm_ctx_t *c,
+    v128_t *keystream,
+    size_t num_blocks)
+{
+    uint16_t block_index = ntohs(c->counter.v16[7]);
+    int out_len = 0;
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        v128_copy(&keystream[i], &c->counter);
+        keystream[i].v16[7] = htons((uint16_t)(block_index + i));
     }
+    c->counter.v16[7] = htons((uint16_t)(block_index + num_blocks));
 
-    SECItem paramItem = { siBuffer, (unsigned char *)&param,
-                          sizeof(CK_AES_CTR_PARAMS) };
-    c->ctx = PK11_CreateContextBySymKey(CKM_AES_CTR, CKA_ENCRYPT, c->key,
-                                        &paramItem);
-    if (!c->ctx) {
+    int len = (int)(num_blocks * sizeof(v128_t));
+    if (PK11_CipherOp(c->ctx, (uint8_t *)keystream, &out_len, len,
+                      (uint8_t *)keystream, len) != SECSuccess ||
+        out_len != len) {
         return srtp_err_status_cipher_fail;
     }
 
+    debug_trace(srtp_mod_aes_icm, "counter:    %s",
+                v128_hex_string(&c->counter));
+
     return srtp_err_status_ok;
 }
 
@@ -339,6 +389,8 @@ static srtp_err_status_t srtp_aes_icm_nss_encrypt(void *cv,
                                                   size_t *dst_len)
 {
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
+    size_t bytes_to_encr = src_len;
+    srtp_err_status_t status = srtp_err_status_ok;
 
     if (!c->ctx) {
         return srtp_err_status_bad_param;
@@ -352,12 +404,70 @@ static srtp_err_status_t srtp_aes_icm_nss_encrypt(void *cv,
         return srtp_err_status_buffer_small;
     }
 
-    int out_len = 0;
-    int rv = PK11_CipherOp(c->ctx, dst, &out_len, *dst_len, src, src_len);
-    *dst_len = out_len;
-    srtp_err_status_t status = srtp_err_status_ok;
-    if (rv != SECSuccess) {
-        status = srtp_err_status_cipher_fail;
+    *dst_len = src_len;
+
+    /* check that there's enough segment left */
+    if (bytes_to_encr > c->bytes_in_buffer) {
+        size_t blocks_of_new_keystream =
+            (bytes_to_encr - c->bytes_in_buffer + 15) >> 4;
+        if (blocks_of_new_keystream >
+            (size_t)0xffff - ntohs(c->counter.v16[7])) {
+            return srtp_err_status_terminus;
+        }
+    }
+
+    /* use up the keystream left over from the last call */
+    size_t n = bytes_to_encr < c->bytes_in_buffer ? bytes_to_encr
+                                                  : c->bytes_in_buffer;
+    size_t pos = sizeof(v128_t) - c->bytes_in_buffer;
+    for (size_t i = 0; i < n; i++) {
+        *dst++ = *src++ ^ c->keystream_buffer.v8[pos + i];
+    }
+    c->bytes_in_buffer -= n;
+    bytes_to_encr -= n;
+
+    /* then encrypt whole blocks, several counter blocks per call */
+    size_t num_blocks = bytes_to_encr / sizeof(v128_t);
+    while (num_blocks > 0) {
+        v128_t keystream[SRTP_AES_ICM_NSS_KEYSTREAM_BLOCKS];
+        size_t blocks = num_blocks < SRTP_AES_ICM_NSS_KEYSTREAM_BLOCKS
+                            ? num_blocks
+                            : SRTP_AES_ICM_NSS_KEYSTREAM_BLOCKS;
+
+        status = srtp_aes_icm_nss_advance_blocks(c, keystream, blocks);
+        if (status) {
+            octet_string_set_to_zero(keystream, sizeof(keystream));
+            return status;
+        }
+
+        for (size_t i = 0; i < blocks; i++) {
+            v128_t data;
+
+            memcpy(&data, src, sizeof(v128_t));
+            v128_xor_eq(&data, &keystream[i]);
+            memcpy(dst, &data, sizeof(v128_t));
+            src += sizeof(v128_t);
+            dst += sizeof(v128_t);
+        }
+
+        octet_string_set_to_zero(keystream, sizeof(keystream));
+        num_blocks -= blocks;
+        bytes_to_encr -= blocks * sizeof(v128_t);
+    }
+
+    /* if there is a tail end of the data, keep the rest of its block */
+    if (bytes_to_encr > 0) {
+        status =
+            srtp_aes_icm_nss_advance_blocks(c, &c->keystream_buffer, 1);
+        if (status) {
+            return status;
+        }
+
+        for (size_t i = 0; i < bytes_to_encr; i++) {
+            *dst++ = *src++ ^ c->keystream_buffer.v8[i];
+        }
+
+        c->bytes_in_buffer = sizeof(v128_t) - bytes_to_encr;
     }
 
     return status;
@@ -368,10 +478,14 @@ static srtp_err_status_t srtp_aes_icm_nss_encrypt(void *cv,
  */
 static const char srtp_aes_icm_128_nss_description[] =
     "AES-128 counter mode using NSS";
+#ifndef SRTP_NO_AES_192
 static const char srtp_aes_icm_192_nss_description[] =
     "AES-192 counter mode using NSS";
+#endif
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_icm_256_nss_description[] =
     "AES-256 counter mode using NSS";
+#endif
 
 /*
  * This is the function table for this crypto engine.
@@ -387,9 +501,13 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     srtp_aes_icm_nss_set_iv,          /* */
     srtp_aes_icm_128_nss_description, /* */
     &srtp_aes_icm_128_test_case_0,    /* */
-    SRTP_AES_ICM_128                  /* */
+    SRTP_AES_ICM_128,                 /* */
+    NULL,                             /* clone */
+    NULL,                             /* job_init */
+    NULL                              /* compute_jobs */
 };
 
+#ifndef SRTP_NO_AES_192
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -404,9 +522,14 @@ const srtp_cipher_type_t srtp_aes_icm_192 = {
     srtp_aes_icm_nss_set_iv,          /* */
     srtp_aes_icm_192_nss_description, /* */
     &srtp_aes_icm_192_test_case_0,    /* */
-    SRTP_AES_ICM_192                  /* */
+    SRTP_AES_ICM_192,                 /* */
+    NULL,                             /* clone */
+    NULL,                             /* job_init */
+    NULL                              /* compute_jobs */
 };
+#endif
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -421,5 +544,9 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     srtp_aes_icm_nss_set_iv,          /* */
     srtp_aes_icm_256_nss_description, /* */
     &srtp_aes_icm_256_test_case_0,    /* */
-    SRTP_AES_ICM_256                  /* */
+    SRTP_AES_ICM_256,                 /* */
+    NULL,                             /* clone */
+    NULL,                             /* job_init */
+    NULL                              /* compute_jobs */
 };
+#endif
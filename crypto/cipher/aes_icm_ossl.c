@@ -120,9 +120,16 @@ static srtp_err_status_t srtp_aes_icm_openssl_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/192/256
      */
-    if (key_len != SRTP_AES_ICM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_192_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return srtp_err_status_bad_param;
     }
 
@@ -157,16 +164,20 @@ static srtp_err_status_t srtp_aes_icm_openssl_alloc(srtp_cipher_t **c,
         (*c)->type = &srtp_aes_icm_128;
         icm->key_size = SRTP_AES_128_KEY_LEN;
         break;
+#ifndef SRTP_NO_AES_192
     case SRTP_AES_ICM_192_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_192;
         (*c)->type = &srtp_aes_icm_192;
         icm->key_size = SRTP_AES_192_KEY_LEN;
         break;
+#endif
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_ICM_256_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_256;
         (*c)->type = &srtp_aes_icm_256;
         icm->key_size = SRTP_AES_256_KEY_LEN;
         break;
+#endif
     }
 
     /* set key size */
@@ -275,11 +286,11 @@ static srtp_err_status_t srtp_aes_icm_openssl_set_iv(
     /* set nonce (for alignment) */
     v128_copy_octet_string(&nonce, iv);
 
-    debug_print(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
 
     v128_xor(&c->counter, &c->offset, &nonce);
 
-    debug_print(srtp_mod_aes_icm, "set_counter: %s",
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
                 v128_hex_string(&c->counter));
 
     if (!EVP_EncryptInit_ex(c->ctx, NULL, NULL, NULL, c->counter.v8)) {
@@ -306,7 +317,7 @@ static srtp_err_status_t srtp_aes_icm_openssl_encrypt(void *cv,
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
     int len = 0;
 
-    debug_print(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
+    debug_trace(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
 
     if (dst_len == NULL) {
         return srtp_err_status_bad_param;
@@ -329,15 +340,49 @@ static srtp_err_status_t srtp_aes_icm_openssl_encrypt(void *cv,
     return srtp_err_status_ok;
 }
 
+/*
+ * This function creates a context sharing the expanded key of an
+ * initialized one, the EVP context is duplicated so that its counter
+ * state is separate
+ */
+static srtp_err_status_t srtp_aes_icm_openssl_clone(const srtp_cipher_t *c,
+                                                    srtp_cipher_t **clone)
+{
+    const srtp_aes_icm_ctx_t *icm = (const srtp_aes_icm_ctx_t *)c->state;
+    srtp_aes_icm_ctx_t *new_icm;
+    srtp_err_status_t status;
+
+    status = srtp_aes_icm_openssl_alloc(clone, c->key_len, 0);
+    if (status) {
+        return status;
+    }
+
+    new_icm = (srtp_aes_icm_ctx_t *)(*clone)->state;
+    v128_copy(&new_icm->offset, &icm->offset);
+    v128_copy(&new_icm->counter, &icm->offset);
+
+    if (!EVP_CIPHER_CTX_copy(new_icm->ctx, icm->ctx)) {
+        srtp_aes_icm_openssl_dealloc(*clone);
+        *clone = NULL;
+        return srtp_err_status_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
 /*
  * Name of this crypto engine
  */
 static const char srtp_aes_icm_128_openssl_description[] =
     "AES-128 counter mode using openssl";
+#ifndef SRTP_NO_AES_192
 static const char srtp_aes_icm_192_openssl_description[] =
     "AES-192 counter mode using openssl";
+#endif
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_icm_256_openssl_description[] =
     "AES-256 counter mode using openssl";
+#endif
 
 /*
  * This is the function table for this crypto engine.
@@ -353,9 +398,13 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     srtp_aes_icm_openssl_set_iv,          /* */
     srtp_aes_icm_128_openssl_description, /* */
     &srtp_aes_icm_128_test_case_0,        /* */
-    SRTP_AES_ICM_128                      /* */
+    SRTP_AES_ICM_128,                     /* */
+    srtp_aes_icm_openssl_clone,           /* */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
 
+#ifndef SRTP_NO_AES_192
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -370,9 +419,14 @@ const srtp_cipher_type_t srtp_aes_icm_192 = {
     srtp_aes_icm_openssl_set_iv,          /* */
     srtp_aes_icm_192_openssl_description, /* */
     &srtp_aes_icm_192_test_case_0,        /* */
-    SRTP_AES_ICM_192                      /* */
+    SRTP_AES_ICM_192,                     /* */
+    srtp_aes_icm_openssl_clone,           /* */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
+#endif
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -387,5 +441,9 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     srtp_aes_icm_openssl_set_iv,          /* */
     srtp_aes_icm_256_openssl_description, /* */
     &srtp_aes_icm_256_test_case_0,        /* */
-    SRTP_AES_ICM_256                      /* */
+    SRTP_AES_ICM_256,                     /* */
+    srtp_aes_icm_openssl_clone,           /* */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
+#endif
@@ -130,9 +130,16 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_alloc(srtp_cipher_t **c,
     /*
      * Verify the key_len is valid for one of: AES-128/192/256
      */
-    if (key_len != SRTP_AES_ICM_128_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_192_KEY_LEN_WSALT &&
-        key_len != SRTP_AES_ICM_256_KEY_LEN_WSALT) {
+    switch (key_len) {
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+#endif
+        break;
+    default:
         return srtp_err_status_bad_param;
     }
 
@@ -159,16 +166,20 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_alloc(srtp_cipher_t **c,
         (*c)->type = &srtp_aes_icm_128;
         icm->key_size = SRTP_AES_128_KEY_LEN;
         break;
+#ifndef SRTP_NO_AES_192
     case SRTP_AES_ICM_192_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_192;
         (*c)->type = &srtp_aes_icm_192;
         icm->key_size = SRTP_AES_192_KEY_LEN;
         break;
+#endif
+#ifndef SRTP_NO_AES_256
     case SRTP_AES_ICM_256_KEY_LEN_WSALT:
         (*c)->algorithm = SRTP_AES_ICM_256;
         (*c)->type = &srtp_aes_icm_256;
         icm->key_size = SRTP_AES_256_KEY_LEN;
         break;
+#endif
     }
 
     /* set key size        */
@@ -195,6 +206,7 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_dealloc(srtp_cipher_t *c)
     if (ctx != NULL) {
         if (ctx->ctx != NULL) {
             wc_AesFree(ctx->ctx);
+            octet_string_set_to_zero(ctx->ctx, sizeof(Aes));
             srtp_crypto_free(ctx->ctx);
         }
         /* zeroize the key material */
@@ -256,11 +268,16 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_context_init(void *cv,
         break;
     }
 
-    /* Store key. */
-    if (c->key_size > sizeof(c->key)) {
-        return srtp_err_status_bad_param;
+    /*
+     * expand the key once, set_iv() only loads the counter; counter mode
+     * always encrypts
+     */
+    err = wc_AesSetKey(c->ctx, key, c->key_size, c->counter.v8,
+                       AES_ENCRYPTION);
+    if (err < 0) {
+        debug_print(srtp_mod_aes_icm, "wolfSSL error code: %d", err);
+        return srtp_err_status_init_fail;
     }
-    memcpy(c->key, key, c->key_size);
 
     return srtp_err_status_ok;
 }
@@ -282,16 +299,18 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_set_iv(
     /* set nonce (for alignment) */
     v128_copy_octet_string(&nonce, iv);
 
-    debug_print(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
+    debug_trace(srtp_mod_aes_icm, "setting iv: %s", v128_hex_string(&nonce));
 
     v128_xor(&c->counter, &c->offset, &nonce);
 
-    debug_print(srtp_mod_aes_icm, "set_counter: %s",
+    debug_trace(srtp_mod_aes_icm, "set_counter: %s",
                 v128_hex_string(&c->counter));
 
-    /* Counter mode always encrypts. */
-    err = wc_AesSetKey(c->ctx, c->key, c->key_size, c->counter.v8,
-                       AES_ENCRYPTION);
+    /*
+     * load the counter into the expanded key; wc_AesSetIV() also drops the
+     * keystream left over from the previous packet
+     */
+    err = wc_AesSetIV(c->ctx, c->counter.v8);
     if (err < 0) {
         debug_print(srtp_mod_aes_icm, "wolfSSL error code: %d", err);
         return srtp_err_status_fail;
@@ -317,7 +336,7 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_encrypt(void *cv,
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
 
     int err;
-    debug_print(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
+    debug_trace(srtp_mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
 
     if (dst_len == NULL) {
         return srtp_err_status_bad_param;
@@ -342,10 +361,14 @@ static srtp_err_status_t srtp_aes_icm_wolfssl_encrypt(void *cv,
  */
 static const char srtp_aes_icm_128_wolfssl_description[] =
     "AES-128 counter mode using wolfSSL";
+#ifndef SRTP_NO_AES_192
 static const char srtp_aes_icm_192_wolfssl_description[] =
     "AES-192 counter mode using wolfSSL";
+#endif
+#ifndef SRTP_NO_AES_256
 static const char srtp_aes_icm_256_wolfssl_description[] =
     "AES-256 counter mode using wolfSSL";
+#endif
 
 /*
  * This is the function table for this crypto engine.
@@ -361,9 +384,13 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     srtp_aes_icm_wolfssl_set_iv,          /* */
     srtp_aes_icm_128_wolfssl_description, /* */
     &srtp_aes_icm_128_test_case_0,        /* */
-    SRTP_AES_ICM_128                      /* */
+    SRTP_AES_ICM_128,                     /* */
+    NULL,                                 /* clone */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
 
+#ifndef SRTP_NO_AES_192
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -378,9 +405,14 @@ const srtp_cipher_type_t srtp_aes_icm_192 = {
     srtp_aes_icm_wolfssl_set_iv,          /* */
     srtp_aes_icm_192_wolfssl_description, /* */
     &srtp_aes_icm_192_test_case_0,        /* */
-    SRTP_AES_ICM_192                      /* */
+    SRTP_AES_ICM_192,                     /* */
+    NULL,                                 /* clone */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
+#endif
 
+#ifndef SRTP_NO_AES_256
 /*
  * This is the function table for this crypto engine.
  * note: the encrypt function is identical to the decrypt function
@@ -395,5 +427,9 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     srtp_aes_icm_wolfssl_set_iv,          /* */
     srtp_aes_icm_256_wolfssl_description, /* */
     &srtp_aes_icm_256_test_case_0,        /* */
-    SRTP_AES_ICM_256                      /* */
+    SRTP_AES_ICM_256,                     /* */
+    NULL,                                 /* clone */
+    NULL,                                 /* job_init */
+    NULL                                  /* compute_jobs */
 };
+#endif
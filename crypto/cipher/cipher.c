@@ -55,6 +55,7 @@
 #include "alloc.h" /* for crypto_alloc(), crypto_free()  */
 
 #include <stdlib.h>
+#include <string.h>
 
 srtp_debug_module_t srtp_mod_cipher = {
     false,   /* debugging is off by default */
@@ -151,6 +152,69 @@ srtp_err_status_t srtp_cipher_set_aad(srtp_cipher_t *c,
     return (((c)->type)->set_aad(((c)->state), aad, aad_len));
 }
 
+srtp_err_status_t srtp_cipher_clone(const srtp_cipher_t *c,
+                                    srtp_cipher_t **clone)
+{
+    if (!c || !c->type || !c->state || !clone) {
+        return (srtp_err_status_bad_param);
+    }
+    if (!((c)->type)->clone) {
+        return (srtp_err_status_no_such_op);
+    }
+
+    return (((c)->type)->clone(c, clone));
+}
+
+srtp_err_status_t srtp_cipher_job_init(const srtp_cipher_t *c,
+                                       const uint8_t *iv,
+                                       srtp_cipher_job_t *job)
+{
+    if (c->type->job_init == NULL || c->type->compute_jobs == NULL) {
+        return srtp_err_status_no_such_op;
+    }
+
+    job->type = c->type;
+    job->keystream = NULL;
+    job->len = 0;
+    return c->type->job_init(c->state, iv, job);
+}
+
+bool srtp_cipher_job_valid(const srtp_cipher_job_t *job,
+                           const srtp_cipher_t *c,
+                           const uint8_t *iv,
+                           size_t len)
+{
+    srtp_cipher_job_t check;
+
+    if (job->keystream == NULL || job->len < len ||
+        srtp_cipher_job_init(c, iv, &check)) {
+        return false;
+    }
+
+    /*
+     * the counter includes the salt, so a key replaced by one that got the
+     * same place in memory is still told apart
+     */
+    return check.type == job->type && check.key == job->key &&
+           memcmp(check.counter, job->counter, sizeof(check.counter)) == 0;
+}
+
+void srtp_cipher_compute_jobs(srtp_cipher_job_t *jobs, size_t num_jobs)
+{
+    size_t i = 0;
+
+    /* runs of jobs of the same type are handed over together */
+    while (i < num_jobs) {
+        size_t n = 1;
+
+        while (i + n < num_jobs && jobs[i + n].type == jobs[i].type) {
+            n++;
+        }
+        jobs[i].type->compute_jobs(jobs + i, n);
+        i += n;
+    }
+}
+
 /* some bookkeeping functions */
 
 size_t srtp_cipher_get_key_length(const srtp_cipher_t *c)
@@ -158,6 +222,28 @@ size_t srtp_cipher_get_key_length(const srtp_cipher_t *c)
     return c->key_len;
 }
 
+size_t srtp_cipher_get_memory_usage(const srtp_cipher_t *c)
+{
+    const uint8_t *block = (const uint8_t *)c;
+    const uint8_t *state;
+    size_t size;
+
+    if (c == NULL) {
+        return 0;
+    }
+
+    size = srtp_crypto_alloc_size(c);
+
+    /* the null cipher has no state, its pointer is only a marker */
+    state = (const uint8_t *)c->state;
+    if (c->algorithm != SRTP_NULL_CIPHER && state != NULL &&
+        (state < block || state >= block + size)) {
+        size += srtp_crypto_alloc_size(state);
+    }
+
+    return size;
+}
+
 /*
  * A trivial platform independent random source.
  * For use in test only.
@@ -188,6 +274,9 @@ uint32_t srtp_cipher_rand_u32_for_tests(void)
 }
 
 #define SELF_TEST_BUF_OCTETS 128
+
+/* enough jobs to keep a pass of the AES instructions busy */
+#define SELF_TEST_JOBS 8
 #define NUM_RAND_TESTS 128
 #define MAX_KEY_LEN 64
 /*
@@ -204,6 +293,8 @@ srtp_err_status_t srtp_cipher_type_test(
     srtp_err_status_t status;
     uint8_t buffer[SELF_TEST_BUF_OCTETS];
     uint8_t buffer2[SELF_TEST_BUF_OCTETS];
+    srtp_cipher_job_t jobs[SELF_TEST_JOBS];
+    uint8_t job_keystream[SELF_TEST_JOBS][SELF_TEST_BUF_OCTETS];
     size_t len;
     size_t case_num = 0;
 
@@ -408,6 +499,38 @@ srtp_err_status_t srtp_cipher_type_test(
             return srtp_err_status_algo_fail;
         }
 
+        /*
+         * jobs computed together give the same keystream, for lengths that
+         * end within a block as well
+         */
+        status = srtp_cipher_job_init(c, test_case->idx, &jobs[0]);
+        if (status == srtp_err_status_no_such_op) {
+            status = srtp_err_status_ok;
+        } else if (!status) {
+            for (size_t i = 0; i < SELF_TEST_JOBS; i++) {
+                jobs[i] = jobs[0];
+                jobs[i].keystream = job_keystream[i];
+                jobs[i].len = test_case->plaintext_length_octets > i
+                                  ? test_case->plaintext_length_octets - i
+                                  : 0;
+            }
+            srtp_cipher_compute_jobs(jobs, SELF_TEST_JOBS);
+            for (size_t i = 0; i < SELF_TEST_JOBS; i++) {
+                for (size_t k = 0; k < jobs[i].len; k++) {
+                    if ((test_case->plaintext[k] ^ job_keystream[i][k]) !=
+                        test_case->ciphertext[k]) {
+                        status = srtp_err_status_algo_fail;
+                    }
+                }
+            }
+        }
+        if (status) {
+            debug_print(srtp_mod_cipher, "test case %zu failed as a job",
+                        case_num);
+            srtp_cipher_dealloc(c);
+            return srtp_err_status_algo_fail;
+        }
+
         /* deallocate the cipher */
         status = srtp_cipher_dealloc(c);
         if (status) {
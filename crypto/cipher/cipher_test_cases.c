@@ -89,6 +89,7 @@ const srtp_cipher_test_case_t srtp_aes_icm_128_test_case_0 = {
     NULL                                     /* pointer to next testcase */
 };
 
+#ifndef SRTP_NO_AES_192
 /*
  * KAT values for AES-192-CTR self-test.  These
  * values came from section 7 of RFC 6188.
@@ -141,7 +142,9 @@ const srtp_cipher_test_case_t srtp_aes_icm_192_test_case_0 = {
     0,                                       /* */
     NULL                                     /* pointer to next testcase */
 };
+#endif
 
+#ifndef SRTP_NO_AES_256
 /*
  * KAT values for AES-256-CTR self-test.  These
  * values came from section 7 of RFC 6188.
@@ -195,7 +198,9 @@ const srtp_cipher_test_case_t srtp_aes_icm_256_test_case_0 = {
     0,                                       /* */
     NULL                                     /* pointer to next testcase */
 };
+#endif
 
+#ifdef GCM
 /*
  * KAT values for AES self-test.  These
  * values we're derived from independent test code
@@ -281,6 +286,7 @@ const srtp_cipher_test_case_t srtp_aes_gcm_128_test_case_0 = {
     &srtp_aes_gcm_128_test_case_0a           /* pointer to next testcase */
 };
 
+#ifndef SRTP_NO_AES_256
 /* clang-format off */
 static const uint8_t srtp_aes_gcm_256_test_case_0_key[SRTP_AES_GCM_256_KEY_LEN_WSALT] = {
     0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
@@ -363,3 +369,5 @@ const srtp_cipher_test_case_t srtp_aes_gcm_256_test_case_0 = {
     16,                                      /* */
     &srtp_aes_gcm_256_test_case_0a           /* pointer to next testcase */
 };
+#endif /* SRTP_NO_AES_256 */
+#endif /* GCM */
@@ -44,10 +44,18 @@
 #include "cipher.h"
 
 extern const srtp_cipher_test_case_t srtp_aes_icm_128_test_case_0;
+#ifndef SRTP_NO_AES_192
 extern const srtp_cipher_test_case_t srtp_aes_icm_192_test_case_0;
+#endif
+#ifndef SRTP_NO_AES_256
 extern const srtp_cipher_test_case_t srtp_aes_icm_256_test_case_0;
+#endif
 
+#ifdef GCM
 extern const srtp_cipher_test_case_t srtp_aes_gcm_128_test_case_0;
+#ifndef SRTP_NO_AES_256
 extern const srtp_cipher_test_case_t srtp_aes_gcm_256_test_case_0;
+#endif
+#endif
 
 #endif
@@ -132,6 +132,12 @@ static srtp_err_status_t srtp_null_cipher_encrypt(void *cv,
     return srtp_err_status_ok;
 }
 
+static srtp_err_status_t srtp_null_cipher_clone(const srtp_cipher_t *c,
+                                                srtp_cipher_t **clone)
+{
+    return srtp_null_cipher_alloc(clone, c->key_len, 0);
+}
+
 static const char srtp_null_cipher_description[] = "null cipher";
 
 static const srtp_cipher_test_case_t srtp_null_cipher_test_0 = {
@@ -162,5 +168,8 @@ const srtp_cipher_type_t srtp_null_cipher = {
     srtp_null_cipher_set_iv,      /* */
     srtp_null_cipher_description, /* */
     &srtp_null_cipher_test_0,     /* */
-    SRTP_NULL_CIPHER              /* */
+    SRTP_NULL_CIPHER,             /* */
+    srtp_null_cipher_clone,       /* */
+    NULL,                         /* job_init */
+    NULL                          /* compute_jobs */
 };
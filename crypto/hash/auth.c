@@ -50,6 +50,7 @@
 #include "auth.h"
 #include "err.h"       /* for srtp_debug */
 #include "datatypes.h" /* for octet_string */
+#include "alloc.h"
 
 /* the debug module for authentiation */
 
@@ -73,6 +74,120 @@ size_t srtp_auth_get_prefix_length(const srtp_auth_t *a)
     return a->prefix_len;
 }
 
+size_t srtp_auth_get_memory_usage(const srtp_auth_t *a)
+{
+    const uint8_t *block = (const uint8_t *)a;
+    const uint8_t *state;
+    size_t size;
+
+    if (a == NULL) {
+        return 0;
+    }
+
+    size = srtp_crypto_alloc_size(a);
+
+    /* some auth types keep their state in the allocation of a */
+    state = (const uint8_t *)a->state;
+    if (state != NULL && (state < block || state >= block + size)) {
+        size += srtp_crypto_alloc_size(state);
+    }
+
+    return size;
+}
+
+srtp_err_status_t srtp_auth_clone(const srtp_auth_t *a, srtp_auth_t **clone)
+{
+    if (!a || !a->type || !a->state || !clone) {
+        return srtp_err_status_bad_param;
+    }
+    if (!a->type->clone) {
+        return srtp_err_status_no_such_op;
+    }
+
+    return a->type->clone(a, clone);
+}
+
+/* the longest tag srtp_auth_verify() computes itself, a full digest */
+#define VERIFY_TAG_BUF_OCTETS 32
+
+srtp_err_status_t srtp_auth_verify(const srtp_auth_t *a,
+                                   const uint8_t *buf,
+                                   size_t len,
+                                   const uint8_t *tag)
+{
+    uint8_t computed[VERIFY_TAG_BUF_OCTETS];
+    srtp_err_status_t status;
+
+    if (a->type->verify) {
+        return a->type->verify(a->state, buf, len, a->out_len, tag);
+    }
+
+    if (a->out_len > sizeof(computed)) {
+        return srtp_err_status_bad_param;
+    }
+    status = a->type->compute(a->state, buf, len, a->out_len, computed);
+    if (!status && !srtp_octet_string_equal(computed, tag, a->out_len)) {
+        status = srtp_err_status_auth_fail;
+    }
+    octet_string_set_to_zero(computed, a->out_len);
+
+    return status;
+}
+
+srtp_err_status_t srtp_auth_job_init(const srtp_auth_t *a,
+                                     srtp_auth_job_t *job)
+{
+    if (a->type->job_init == NULL || a->type->compute_jobs == NULL) {
+        return srtp_err_status_no_such_op;
+    }
+
+    job->type = a->type;
+    octet_string_set_to_zero(job->key, sizeof(job->key));
+    job->tag_len = a->out_len;
+    job->suffix_len = 0;
+    return a->type->job_init(a->state, job);
+}
+
+bool srtp_auth_job_valid(const srtp_auth_job_t *job,
+                         const srtp_auth_t *a,
+                         const uint8_t *buffer,
+                         size_t len,
+                         const uint8_t *suffix,
+                         size_t suffix_len)
+{
+    srtp_auth_job_t check;
+    bool valid;
+
+    if (job->buffer != buffer || job->len != len ||
+        job->suffix_len != suffix_len ||
+        memcmp(job->suffix, suffix, suffix_len) != 0) {
+        return false;
+    }
+
+    valid = srtp_auth_job_init(a, &check) == srtp_err_status_ok &&
+            check.type == job->type && check.tag_len == job->tag_len &&
+            memcmp(check.key, job->key, sizeof(check.key)) == 0;
+    octet_string_set_to_zero(check.key, sizeof(check.key));
+
+    return valid;
+}
+
+void srtp_auth_compute_jobs(srtp_auth_job_t *jobs, size_t num_jobs)
+{
+    size_t i = 0;
+
+    /* runs of jobs of the same type are handed over together */
+    while (i < num_jobs) {
+        size_t n = 1;
+
+        while (i + n < num_jobs && jobs[i + n].type == jobs[i].type) {
+            n++;
+        }
+        jobs[i].type->compute_jobs(jobs + i, n);
+        i += n;
+    }
+}
+
 /*
  * srtp_auth_type_test() tests an auth function of type ct against
  * test cases provided in a list test_data of values of key, data, and tag
@@ -82,6 +197,9 @@ size_t srtp_auth_get_prefix_length(const srtp_auth_t *a)
 /* should be big enough for most occasions */
 #define SELF_TEST_TAG_BUF_OCTETS 32
 
+/* enough jobs to fill the widest vectors */
+#define SELF_TEST_JOBS 16
+
 srtp_err_status_t srtp_auth_type_test(const srtp_auth_type_t *at,
                                       const srtp_auth_test_case_t *test_data)
 {
@@ -89,6 +207,8 @@ srtp_err_status_t srtp_auth_type_test(const srtp_auth_type_t *at,
     srtp_auth_t *a;
     srtp_err_status_t status;
     uint8_t tag[SELF_TEST_TAG_BUF_OCTETS];
+    srtp_auth_job_t jobs[SELF_TEST_JOBS];
+    uint8_t job_tags[SELF_TEST_JOBS][SELF_TEST_TAG_BUF_OCTETS];
     size_t i = 0;
     size_t case_num = 0;
 
@@ -166,6 +286,59 @@ srtp_err_status_t srtp_auth_type_test(const srtp_auth_type_t *at,
             return srtp_err_status_algo_fail;
         }
 
+        /* the expected tag must verify, and no longer once altered */
+        status = srtp_auth_start(a);
+        if (!status) {
+            status = srtp_auth_verify(a, test_case->data,
+                                      test_case->data_length_octets,
+                                      test_case->tag);
+        }
+        if (!status && test_case->tag_length_octets != 0) {
+            memcpy(tag, test_case->tag, test_case->tag_length_octets);
+            tag[test_case->tag_length_octets - 1] ^= 0x01;
+            status = srtp_auth_start(a);
+            if (!status) {
+                status = srtp_auth_verify(a, test_case->data,
+                                          test_case->data_length_octets, tag);
+                status = status == srtp_err_status_auth_fail
+                             ? srtp_err_status_ok
+                             : srtp_err_status_algo_fail;
+            }
+        }
+        if (status) {
+            debug_print(srtp_mod_auth, "test case %zu failed to verify",
+                        case_num);
+            srtp_auth_dealloc(a);
+            return srtp_err_status_algo_fail;
+        }
+
+        /* jobs computed together give the same tags, whatever the lanes */
+        status = srtp_auth_job_init(a, &jobs[0]);
+        if (status == srtp_err_status_no_such_op) {
+            status = srtp_err_status_ok;
+        } else if (!status) {
+            for (i = 0; i < SELF_TEST_JOBS; i++) {
+                jobs[i] = jobs[0];
+                jobs[i].buffer = test_case->data;
+                jobs[i].len = test_case->data_length_octets;
+                jobs[i].tag = job_tags[i];
+            }
+            srtp_auth_compute_jobs(jobs, SELF_TEST_JOBS);
+            octet_string_set_to_zero(jobs, sizeof(jobs));
+            for (i = 0; i < SELF_TEST_JOBS; i++) {
+                if (!srtp_octet_string_equal(job_tags[i], test_case->tag,
+                                             test_case->tag_length_octets)) {
+                    status = srtp_err_status_algo_fail;
+                }
+            }
+        }
+        if (status) {
+            debug_print(srtp_mod_auth, "test case %zu failed as a job",
+                        case_num);
+            srtp_auth_dealloc(a);
+            return srtp_err_status_algo_fail;
+        }
+
         /* deallocate the auth function */
         status = srtp_auth_dealloc(a);
         if (status) {
@@ -192,3 +365,45 @@ srtp_err_status_t srtp_auth_type_self_test(const srtp_auth_type_t *at)
 {
     return srtp_auth_type_test(at, at->test_data);
 }
+
+/*
+ * srtp_auth_bits_per_second(a, l, t) is srtp_cipher_bits_per_second() for
+ * auth functions
+ */
+uint64_t srtp_auth_bits_per_second(srtp_auth_t *a,
+                                   size_t octets_in_buffer,
+                                   size_t num_trials)
+{
+    uint8_t tag[SELF_TEST_TAG_BUF_OCTETS];
+    uint8_t *buf;
+    clock_t timer;
+
+    if (a->out_len > sizeof(tag)) {
+        return 0;
+    }
+
+    buf = (uint8_t *)srtp_crypto_alloc(octets_in_buffer);
+    if (buf == NULL) {
+        return 0;
+    }
+
+    timer = clock();
+    for (size_t i = 0; i < num_trials; i++) {
+        if (srtp_auth_start(a) != srtp_err_status_ok ||
+            srtp_auth_compute(a, buf, octets_in_buffer, tag) !=
+                srtp_err_status_ok) {
+            srtp_crypto_free(buf);
+            return 0;
+        }
+    }
+    timer = clock() - timer;
+
+    srtp_crypto_free(buf);
+
+    if (timer == 0) {
+        /* Too fast! */
+        return 0;
+    }
+
+    return (uint64_t)CLOCKS_PER_SEC * num_trials * 8 * octets_in_buffer / timer;
+}
@@ -48,6 +48,7 @@
 
 #include "hmac.h"
 #include "alloc.h"
+#include "key_store.h"
 #include "cipher_types.h"
 #include "auth_test_cases.h"
 
@@ -103,6 +104,8 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
 
 static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
 {
+    srtp_key_store_release(((srtp_hmac_ctx_t *)a->state)->key);
+
     /* zeroize entire state*/
     octet_string_set_to_zero(a, sizeof(srtp_hmac_ctx_t) + sizeof(srtp_auth_t));
 
@@ -112,20 +115,18 @@ static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_hmac_init(void *statev,
-                                        const uint8_t *key,
-                                        size_t key_len)
+/*
+ * srtp_hmac_expand_key(key, key_len, expanded) computes the midstates the
+ * key store keeps for hmac contexts
+ */
+static srtp_err_status_t srtp_hmac_expand_key(const uint8_t *key,
+                                              size_t key_len,
+                                              void *expanded)
 {
-    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
+    srtp_hmac_key_t *k = (srtp_hmac_key_t *)expanded;
+    srtp_sha1_ctx_t ctx;
     uint8_t ipad[64];
-
-    /*
-     * check key length - note that we don't support keys larger
-     * than 20 bytes yet
-     */
-    if (key_len > 20) {
-        return srtp_err_status_bad_param;
-    }
+    uint8_t opad[64];
 
     /*
      * set values of ipad and opad by exoring the key into the
@@ -133,23 +134,61 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
      */
     for (size_t i = 0; i < key_len; i++) {
         ipad[i] = key[i] ^ 0x36;
-        state->opad[i] = key[i] ^ 0x5c;
+        opad[i] = key[i] ^ 0x5c;
     }
     /* set the rest of ipad, opad to constant values */
     for (size_t i = key_len; i < 64; i++) {
         ipad[i] = 0x36;
-        ((uint8_t *)state->opad)[i] = 0x5c;
+        opad[i] = 0x5c;
     }
 
     debug_print(srtp_mod_hmac, "ipad: %s",
                 srtp_octet_string_hex_string(ipad, 64));
 
-    /* initialize sha1 context */
-    srtp_sha1_init(&state->init_ctx);
+    /*
+     * both pads are exactly one block long, so hash them once here and
+     * keep only the resulting state vectors; each packet then starts
+     * from those instead of hashing the pads again
+     */
+    srtp_sha1_init(&ctx);
+    srtp_sha1_update(&ctx, opad, 64);
+    memcpy(k->outer_H, ctx.H, sizeof(k->outer_H));
+
+    srtp_sha1_init(&ctx);
+    srtp_sha1_update(&ctx, ipad, 64);
+    memcpy(k->inner_H, ctx.H, sizeof(k->inner_H));
 
-    /* hash ipad ^ key */
-    srtp_sha1_update(&state->init_ctx, ipad, 64);
-    memcpy(&state->ctx, &state->init_ctx, sizeof(srtp_sha1_ctx_t));
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+    octet_string_set_to_zero(&ctx, sizeof(ctx));
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_init(void *statev,
+                                        const uint8_t *key,
+                                        size_t key_len)
+{
+    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
+    srtp_err_status_t status;
+    const void *expanded_key;
+
+    /*
+     * check key length - note that we don't support keys larger
+     * than 20 bytes yet
+     */
+    if (key_len > 20) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_key_store_release(state->key);
+    state->key = NULL;
+    status = srtp_key_store_acquire(srtp_hmac_expand_key, key, key_len,
+                                    sizeof(srtp_hmac_key_t), &expanded_key);
+    if (status) {
+        return status;
+    }
+    state->key = (const srtp_hmac_key_t *)expanded_key;
 
     return srtp_err_status_ok;
 }
@@ -158,7 +197,7 @@ static srtp_err_status_t srtp_hmac_start(void *statev)
 {
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
 
-    memcpy(&state->ctx, &state->init_ctx, sizeof(srtp_sha1_ctx_t));
+    srtp_sha1_init_midstate(&state->ctx, state->key->inner_H, 1);
 
     return srtp_err_status_ok;
 }
@@ -169,7 +208,7 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
 {
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     /* hash message into sha1 context */
@@ -178,56 +217,267 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_hmac_compute(void *statev,
-                                           const uint8_t *message,
-                                           size_t msg_octets,
-                                           size_t tag_len,
-                                           uint8_t *result)
+/*
+ * srtp_hmac_final(state, message, msg_octets, hash_value) hashes message
+ * and writes the full HMAC of everything hashed since the start into
+ * hash_value
+ */
+static void srtp_hmac_final(srtp_hmac_ctx_t *state,
+                            const uint8_t *message,
+                            size_t msg_octets,
+                            uint32_t hash_value[5])
 {
-    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
-    uint32_t hash_value[5];
     uint32_t H[5];
-    size_t i;
-
-    /* check tag length, return error if we can't provide the value expected */
-    if (tag_len > 20) {
-        return srtp_err_status_bad_param;
-    }
 
     /* hash message, copy output into H */
     srtp_hmac_update(state, message, msg_octets);
     srtp_sha1_final(&state->ctx, H);
 
     /*
-     * note that we don't need to debug_print() the input, since the
+     * note that we don't need to debug_trace() the input, since the
      * function hmac_update() already did that for us
      */
-    debug_print(srtp_mod_hmac, "intermediate state: %s",
+    debug_trace(srtp_mod_hmac, "intermediate state: %s",
                 srtp_octet_string_hex_string((uint8_t *)H, 20));
 
-    /* re-initialize hash context */
-    srtp_sha1_init(&state->ctx);
-
-    /* hash opad ^ key  */
-    srtp_sha1_update(&state->ctx, (uint8_t *)state->opad, 64);
+    /* re-initialize hash context from the state after hashing opad ^ key */
+    srtp_sha1_init_midstate(&state->ctx, state->key->outer_H, 1);
 
     /* hash the result of the inner hash */
     srtp_sha1_update(&state->ctx, (uint8_t *)H, 20);
 
     /* the result is returned in the array hash_value[] */
     srtp_sha1_final(&state->ctx, hash_value);
+}
+
+static srtp_err_status_t srtp_hmac_compute(void *statev,
+                                           const uint8_t *message,
+                                           size_t msg_octets,
+                                           size_t tag_len,
+                                           uint8_t *result)
+{
+    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
+    uint32_t hash_value[5];
+    size_t i;
+
+    /* check tag length, return error if we can't provide the value expected */
+    if (tag_len > 20) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_hmac_final(state, message, msg_octets, hash_value);
 
     /* copy hash_value to *result */
     for (i = 0; i < tag_len; i++) {
         result[i] = ((uint8_t *)hash_value)[i];
     }
 
-    debug_print(srtp_mod_hmac, "output: %s",
+    debug_trace(srtp_mod_hmac, "output: %s",
                 srtp_octet_string_hex_string((uint8_t *)hash_value, tag_len));
 
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_hmac_verify() compares the digest with the tag where it was
+ * computed, without truncating it into a copy first
+ */
+static srtp_err_status_t srtp_hmac_verify(void *statev,
+                                          const uint8_t *message,
+                                          size_t msg_octets,
+                                          size_t tag_len,
+                                          const uint8_t *tag)
+{
+    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
+    uint32_t hash_value[5];
+    bool equal;
+
+    if (tag_len > 20) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_hmac_final(state, message, msg_octets, hash_value);
+
+    debug_trace(srtp_mod_hmac, "output: %s",
+                srtp_octet_string_hex_string((uint8_t *)hash_value, tag_len));
+
+    equal = srtp_octet_string_equal((uint8_t *)hash_value, tag, tag_len);
+    octet_string_set_to_zero(hash_value, sizeof(hash_value));
+
+    return equal ? srtp_err_status_ok : srtp_err_status_auth_fail;
+}
+
+static srtp_err_status_t srtp_hmac_clone(const srtp_auth_t *a,
+                                         srtp_auth_t **clone)
+{
+    const srtp_hmac_ctx_t *state = (const srtp_hmac_ctx_t *)a->state;
+    srtp_err_status_t status;
+
+    status = srtp_hmac_alloc(clone, a->key_len, a->out_len);
+    if (status) {
+        return status;
+    }
+
+    ((srtp_hmac_ctx_t *)(*clone)->state)->key = state->key;
+    srtp_key_store_retain(state->key);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_job_init(const void *statev,
+                                            srtp_auth_job_t *job)
+{
+    const srtp_hmac_ctx_t *state = (const srtp_hmac_ctx_t *)statev;
+
+    /* without vector lanes there is nothing to gain over one at a time */
+    if (srtp_sha1_lanes() == 1) {
+        return srtp_err_status_no_such_op;
+    }
+
+    if (job->tag_len > 20) {
+        return srtp_err_status_bad_param;
+    }
+
+    memcpy(job->key, state->key, sizeof(srtp_hmac_key_t));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_hmac_job_blocks(job) is the number of blocks of the inner hash of
+ * job after that of ipad: the message, the suffix and the padding
+ */
+static size_t srtp_hmac_job_blocks(const srtp_auth_job_t *job)
+{
+    return (job->len + job->suffix_len + 9 + 63) / 64;
+}
+
+/*
+ * srtp_hmac_job_block(job, index, buf) returns block index of the inner
+ * hash of job; blocks that lie within the message are hashed where they
+ * are, the others are assembled in buf
+ */
+static const uint8_t *srtp_hmac_job_block(const srtp_auth_job_t *job,
+                                          size_t index,
+                                          uint8_t buf[64])
+{
+    size_t start = index * 64;
+    size_t total = job->len + job->suffix_len;
+    size_t n = 0;
+
+    if (start + 64 <= job->len) {
+        return job->buffer + start;
+    }
+
+    if (start < job->len) {
+        n = job->len - start;
+        memcpy(buf, job->buffer + start, n);
+    }
+    while (n < 64 && start + n < total) {
+        buf[n] = job->suffix[start + n - job->len];
+        n++;
+    }
+    if (n < 64 && start + n == total) {
+        buf[n++] = 0x80;
+    }
+    memset(buf + n, 0, 64 - n);
+
+    /* the last block ends with the length of ipad and the message in bits */
+    if (index + 1 == srtp_hmac_job_blocks(job)) {
+        uint64_t bits = (uint64_t)(64 + total) * 8;
+
+        for (size_t i = 0; i < 8; i++) {
+            buf[63 - i] = (uint8_t)(bits >> (8 * i));
+        }
+    }
+
+    return buf;
+}
+
+/*
+ * srtp_hmac_compute_jobs() hashes the messages of up to
+ * SRTP_SHA1_MAX_LANES jobs at once, a block of each in turn; messages that
+ * end early drop out, those of a batch of packets tend to be of the same
+ * length anyway
+ */
+static void srtp_hmac_compute_jobs(srtp_auth_job_t *jobs, size_t num_jobs)
+{
+    uint32_t H[SRTP_SHA1_MAX_LANES][5];
+    uint32_t lane_H[SRTP_SHA1_MAX_LANES][5];
+    const uint8_t *blocks[SRTP_SHA1_MAX_LANES];
+    uint8_t bufs[SRTP_SHA1_MAX_LANES][64];
+    size_t num_blocks[SRTP_SHA1_MAX_LANES];
+    size_t lane_job[SRTP_SHA1_MAX_LANES];
+
+    while (num_jobs > 0) {
+        size_t n = num_jobs < SRTP_SHA1_MAX_LANES ? num_jobs
+                                                   : SRTP_SHA1_MAX_LANES;
+        size_t max_blocks = 0;
+
+        for (size_t j = 0; j < n; j++) {
+            const srtp_hmac_key_t *key = (const srtp_hmac_key_t *)jobs[j].key;
+
+            memcpy(H[j], key->inner_H, sizeof(H[j]));
+            num_blocks[j] = srtp_hmac_job_blocks(&jobs[j]);
+            if (num_blocks[j] > max_blocks) {
+                max_blocks = num_blocks[j];
+            }
+        }
+
+        for (size_t b = 0; b < max_blocks; b++) {
+            size_t lanes = 0;
+
+            for (size_t j = 0; j < n; j++) {
+                if (b < num_blocks[j]) {
+                    blocks[lanes] = srtp_hmac_job_block(&jobs[j], b, bufs[j]);
+                    lane_job[lanes++] = j;
+                }
+            }
+
+            if (lanes == n) {
+                srtp_sha1_core_lanes(H, blocks, n);
+                continue;
+            }
+            for (size_t l = 0; l < lanes; l++) {
+                memcpy(lane_H[l], H[lane_job[l]], sizeof(lane_H[l]));
+            }
+            srtp_sha1_core_lanes(lane_H, blocks, lanes);
+            for (size_t l = 0; l < lanes; l++) {
+                memcpy(H[lane_job[l]], lane_H[l], sizeof(lane_H[l]));
+            }
+        }
+
+        /* the outer hash takes a single block, the inner digest padded */
+        for (size_t j = 0; j < n; j++) {
+            const srtp_hmac_key_t *key = (const srtp_hmac_key_t *)jobs[j].key;
+
+            for (size_t i = 0; i < 20; i++) {
+                bufs[j][i] = (uint8_t)(H[j][i / 4] >> (24 - 8 * (i % 4)));
+            }
+            bufs[j][20] = 0x80;
+            memset(bufs[j] + 21, 0, 64 - 21 - 2);
+            bufs[j][62] = (uint8_t)(((64 + 20) * 8) >> 8);
+            bufs[j][63] = (uint8_t)((64 + 20) * 8);
+            blocks[j] = bufs[j];
+            memcpy(H[j], key->outer_H, sizeof(H[j]));
+        }
+        srtp_sha1_core_lanes(H, blocks, n);
+
+        for (size_t j = 0; j < n; j++) {
+            for (size_t i = 0; i < jobs[j].tag_len; i++) {
+                jobs[j].tag[i] = (uint8_t)(H[j][i / 4] >> (24 - 8 * (i % 4)));
+            }
+        }
+
+        jobs += n;
+        num_jobs -= n;
+    }
+
+    octet_string_set_to_zero(H, sizeof(H));
+    octet_string_set_to_zero(lane_H, sizeof(lane_H));
+    octet_string_set_to_zero(bufs, sizeof(bufs));
+}
+
 static const char srtp_hmac_description[] =
     "hmac sha-1 authentication function";
 
@@ -244,5 +494,9 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_start,        /* */
     srtp_hmac_description,  /* */
     &srtp_hmac_test_case_0, /* */
-    SRTP_HMAC_SHA1          /* */
+    SRTP_HMAC_SHA1,         /* */
+    srtp_hmac_clone,        /* */
+    srtp_hmac_verify,       /* */
+    srtp_hmac_job_init,     /* */
+    srtp_hmac_compute_jobs  /* */
 };
@@ -0,0 +1,282 @@
+/*
+ * hmac_cng.c
+ *
+ * HMAC-SHA1 using the Windows CNG (bcrypt) API
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "auth.h"
+#include "alloc.h"
+#include "err.h" /* for srtp_debug */
+#include "auth_test_cases.h"
+
+#include <windows.h>
+#include <bcrypt.h>
+
+#define SHA1_DIGEST_SIZE 20
+
+/* the debug module for authentiation */
+
+srtp_debug_module_t srtp_mod_hmac = {
+    false,           /* debugging is off by default */
+    "hmac sha-1 cng" /* printable name for module   */
+};
+
+/*
+ * the hash object is created with BCRYPT_HASH_REUSABLE_FLAG, so that
+ * BCryptFinishHash() leaves it ready for the next message with the same
+ * key instead of it being created again for every packet
+ */
+typedef struct {
+    BCRYPT_ALG_HANDLE alg;
+    BCRYPT_HASH_HANDLE hash;
+    bool in_progress; /* data was hashed since the last BCryptFinishHash() */
+} srtp_hmac_cng_ctx_t;
+
+static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
+                                         size_t key_len,
+                                         size_t out_len)
+{
+    extern const srtp_auth_type_t srtp_hmac;
+    srtp_hmac_cng_ctx_t *hmac;
+    BCRYPT_ALG_HANDLE alg;
+
+    debug_print(srtp_mod_hmac, "allocating auth func with key length %zu",
+                key_len);
+    debug_print(srtp_mod_hmac, "                          tag length %zu",
+                out_len);
+
+    /* check output length - should be less than 20 bytes */
+    if (out_len > SHA1_DIGEST_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(
+            &alg, BCRYPT_SHA1_ALGORITHM, NULL,
+            BCRYPT_ALG_HANDLE_HMAC_FLAG))) {
+        return srtp_err_status_auth_fail;
+    }
+
+    *a = (srtp_auth_t *)srtp_crypto_alloc(sizeof(srtp_auth_t));
+    if (*a == NULL) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        return srtp_err_status_alloc_fail;
+    }
+
+    hmac =
+        (srtp_hmac_cng_ctx_t *)srtp_crypto_alloc(sizeof(srtp_hmac_cng_ctx_t));
+    if (hmac == NULL) {
+        BCryptCloseAlgorithmProvider(alg, 0);
+        srtp_crypto_free(*a);
+        *a = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    hmac->alg = alg;
+    hmac->hash = NULL;
+    hmac->in_progress = false;
+
+    /* set pointers */
+    (*a)->state = hmac;
+    (*a)->type = &srtp_hmac;
+    (*a)->out_len = out_len;
+    (*a)->key_len = key_len;
+    (*a)->prefix_len = 0;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
+{
+    srtp_hmac_cng_ctx_t *hmac;
+
+    hmac = (srtp_hmac_cng_ctx_t *)a->state;
+    if (hmac) {
+        /* free the CNG objects that have been created */
+        if (hmac->hash) {
+            BCryptDestroyHash(hmac->hash);
+            hmac->hash = NULL;
+        }
+
+        if (hmac->alg) {
+            BCryptCloseAlgorithmProvider(hmac->alg, 0);
+            hmac->alg = NULL;
+        }
+
+        /* zeroize everything */
+        octet_string_set_to_zero(hmac, sizeof(srtp_hmac_cng_ctx_t));
+        srtp_crypto_free(hmac);
+    }
+
+    /* free memory */
+    srtp_crypto_free(a);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_start(void *statev)
+{
+    srtp_hmac_cng_ctx_t *hmac;
+    hmac = (srtp_hmac_cng_ctx_t *)statev;
+    uint8_t hash_value[SHA1_DIGEST_SIZE];
+
+    /* a reusable hash object is only reset by finishing it */
+    if (hmac->in_progress) {
+        hmac->in_progress = false;
+        if (!BCRYPT_SUCCESS(BCryptFinishHash(hmac->hash, hash_value,
+                                             sizeof(hash_value), 0))) {
+            return srtp_err_status_auth_fail;
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_init(void *statev,
+                                        const uint8_t *key,
+                                        size_t key_len)
+{
+    srtp_hmac_cng_ctx_t *hmac;
+    hmac = (srtp_hmac_cng_ctx_t *)statev;
+
+    if (hmac->hash) {
+        BCryptDestroyHash(hmac->hash);
+        hmac->hash = NULL;
+    }
+    hmac->in_progress = false;
+
+    /* explicitly cast away const of key, CNG copies it into the object */
+    if (!BCRYPT_SUCCESS(BCryptCreateHash(
+            hmac->alg, &hmac->hash, NULL, 0, (PUCHAR)(uintptr_t)key,
+            (ULONG)key_len, BCRYPT_HASH_REUSABLE_FLAG))) {
+        hmac->hash = NULL;
+        return srtp_err_status_auth_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_update(void *statev,
+                                          const uint8_t *message,
+                                          size_t msg_octets)
+{
+    srtp_hmac_cng_ctx_t *hmac;
+    hmac = (srtp_hmac_cng_ctx_t *)statev;
+
+    debug_trace(srtp_mod_hmac, "input: %s",
+                srtp_octet_string_hex_string(message, msg_octets));
+
+    hmac->in_progress = true;
+    if (!BCRYPT_SUCCESS(BCryptHashData(hmac->hash,
+                                       (PUCHAR)(uintptr_t)message,
+                                       (ULONG)msg_octets, 0))) {
+        return srtp_err_status_auth_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_compute(void *statev,
+                                           const uint8_t *message,
+                                           size_t msg_octets,
+                                           size_t tag_len,
+                                           uint8_t *result)
+{
+    srtp_hmac_cng_ctx_t *hmac;
+    hmac = (srtp_hmac_cng_ctx_t *)statev;
+    uint8_t hash_value[SHA1_DIGEST_SIZE];
+
+    debug_trace(srtp_mod_hmac, "input: %s",
+                srtp_octet_string_hex_string(message, msg_octets));
+
+    /* check tag length, return error if we can't provide the value expected */
+    if (tag_len > SHA1_DIGEST_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
+    hmac->in_progress = true;
+    if (!BCRYPT_SUCCESS(BCryptHashData(hmac->hash,
+                                       (PUCHAR)(uintptr_t)message,
+                                       (ULONG)msg_octets, 0))) {
+        return srtp_err_status_auth_fail;
+    }
+
+    hmac->in_progress = false;
+    if (!BCRYPT_SUCCESS(BCryptFinishHash(hmac->hash, hash_value,
+                                         sizeof(hash_value), 0))) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* copy hash_value to *result */
+    for (size_t i = 0; i < tag_len; i++) {
+        result[i] = hash_value[i];
+    }
+
+    debug_trace(srtp_mod_hmac, "output: %s",
+                srtp_octet_string_hex_string(hash_value, tag_len));
+
+    return srtp_err_status_ok;
+}
+
+static const char srtp_hmac_description[] =
+    "hmac sha-1 authentication function";
+
+/*
+ * srtp_auth_type_t hmac is the hmac metaobject
+ */
+
+const srtp_auth_type_t srtp_hmac = {
+    srtp_hmac_alloc,        /* */
+    srtp_hmac_dealloc,      /* */
+    srtp_hmac_init,         /* */
+    srtp_hmac_compute,      /* */
+    srtp_hmac_update,       /* */
+    srtp_hmac_start,        /* */
+    srtp_hmac_description,  /* */
+    &srtp_hmac_test_case_0, /* */
+    SRTP_HMAC_SHA1,         /* */
+    NULL,                   /* clone */
+    NULL,                   /* verify */
+    NULL,                   /* job_init */
+    NULL                    /* compute_jobs */
+};
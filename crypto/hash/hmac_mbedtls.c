@@ -49,6 +49,7 @@
 #include "alloc.h"
 #include "err.h" /* for srtp_debug */
 #include "auth_test_cases.h"
+#include "psa_key_location.h"
 #include <psa/crypto.h>
 
 typedef struct {
@@ -150,6 +151,12 @@ static srtp_err_status_t srtp_hmac_mbedtls_init(void *statev,
     psa_set_key_type(&attr, PSA_KEY_TYPE_HMAC);
     psa_set_key_usage_flags(&attr, PSA_KEY_USAGE_SIGN_MESSAGE);
     psa_set_key_algorithm(&attr, PSA_ALG_HMAC(PSA_ALG_SHA_1));
+    srtp_psa_set_key_location(&attr);
+
+    if (state->key_id != PSA_KEY_ID_NULL) {
+        psa_destroy_key(state->key_id);
+        state->key_id = PSA_KEY_ID_NULL;
+    }
 
     status = psa_import_key(&attr, key, key_len, &state->key_id);
     state->key_len = key_len;
@@ -168,7 +175,7 @@ static srtp_err_status_t srtp_hmac_mbedtls_update(void *statev,
 {
     psa_hmac_ctx_t *state = (psa_hmac_ctx_t *)statev;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     if (psa_mac_update(&state->op, message, msg_octets) != 0) {
@@ -217,7 +224,7 @@ static srtp_err_status_t srtp_hmac_mbedtls_compute(void *statev,
         result[i] = hash_value[i];
     }
 
-    debug_print(srtp_mod_hmac, "output: %s",
+    debug_trace(srtp_mod_hmac, "output: %s",
                 srtp_octet_string_hex_string(hash_value, tag_len));
 
     return srtp_err_status_ok;
@@ -241,5 +248,9 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_mbedtls_start,       /* */
     srtp_hmac_mbedtls_description, /* */
     &srtp_hmac_test_case_0,        /* */
-    SRTP_HMAC_SHA1                 /* */
+    SRTP_HMAC_SHA1,                /* */
+    NULL,                          /* clone */
+    NULL,                          /* verify */
+    NULL,                          /* job_init */
+    NULL                           /* compute_jobs */
 };
@@ -228,7 +228,7 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
     srtp_hmac_nss_ctx_t *hmac;
     hmac = (srtp_hmac_nss_ctx_t *)statev;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     if (PK11_DigestOp(hmac->ctx, message, msg_octets) != SECSuccess) {
@@ -249,7 +249,7 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
     uint8_t hash_value[SHA1_DIGEST_SIZE];
     unsigned int len;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     /* check tag length, return error if we can't provide the value expected */
@@ -275,7 +275,7 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
         result[i] = hash_value[i];
     }
 
-    debug_print(srtp_mod_hmac, "output: %s",
+    debug_trace(srtp_mod_hmac, "output: %s",
                 srtp_octet_string_hex_string(hash_value, tag_len));
 
     return srtp_err_status_ok;
@@ -297,5 +297,9 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_start,        /* */
     srtp_hmac_description,  /* */
     &srtp_hmac_test_case_0, /* */
-    SRTP_HMAC_SHA1          /* */
+    SRTP_HMAC_SHA1,         /* */
+    NULL,                   /* clone */
+    NULL,                   /* verify */
+    NULL,                   /* job_init */
+    NULL                    /* compute_jobs */
 };
@@ -46,6 +46,9 @@
 #include <config.h>
 #endif
 
+/* the SHA-1 midstate path uses the low level digest API */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
 #include "auth.h"
 #include "alloc.h"
 #include "err.h" /* for srtp_debug */
@@ -59,6 +62,20 @@
 #define SRTP_OSSL_MIN_REINIT_VERSION 0x30000030L
 #endif
 
+/*
+ * With the EVP_MAC API every restart of the HMAC copies the keyed digest
+ * context, which allocates a new provider context. Where the low level
+ * SHA-1 API is available the keyed inner and outer SHA-1 states are kept
+ * instead and each packet starts from a copy of the inner one, which
+ * needs no allocation. Builds using the OpenSSL KDF do so to keep all of
+ * the SRTP crypto in OpenSSL providers, so they stay with EVP_MAC.
+ */
+#if defined(SRTP_OSSL_USE_EVP_MAC) && !defined(OPENSSL_NO_DEPRECATED_3_0) &&  \
+    !defined(OPENSSL_KDF)
+#define SRTP_OSSL_USE_SHA1_MIDSTATE
+#include <openssl/sha.h>
+#endif
+
 #ifndef SRTP_OSSL_USE_EVP_MAC
 #include <openssl/hmac.h>
 #endif
@@ -83,10 +100,17 @@ srtp_debug_module_t srtp_mod_hmac = {
  * The distinction between cases 2 & 3 needs to be made at runtime, because in a
  * shared library context you might end up building against 3.0.3 and running
  * against 3.0.2.
+ *
+ * Where SRTP_OSSL_USE_SHA1_MIDSTATE is defined none of them is used for
+ * 3.0 and later, the HMAC is computed from SHA-1 midstates.
  */
 
 typedef struct {
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    SHA_CTX inner; /* sha1 state after hashing ipad ^ key */
+    SHA_CTX outer; /* sha1 state after hashing opad ^ key */
+    SHA_CTX ctx;   /* running hash of the message         */
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     EVP_MAC *mac;
     EVP_MAC_CTX *ctx;
     int use_dup;
@@ -126,7 +150,9 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
         return srtp_err_status_alloc_fail;
     }
 
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    debug_print0(srtp_mod_hmac, "using sha1 midstates");
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     hmac->mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
     if (hmac->mac == NULL) {
         srtp_crypto_free(hmac);
@@ -177,7 +203,9 @@ static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
     srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)a->state;
 
     if (hmac) {
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+        /* nothing but the states, which are zeroized below */
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
         EVP_MAC_CTX_free(hmac->ctx);
         EVP_MAC_CTX_free(hmac->ctx_dup);
         EVP_MAC_free(hmac->mac);
@@ -203,7 +231,9 @@ static srtp_err_status_t srtp_hmac_start(void *statev)
 {
     srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
 
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    hmac->ctx = hmac->inner;
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     if (hmac->use_dup) {
         EVP_MAC_CTX_free(hmac->ctx);
         hmac->ctx = EVP_MAC_CTX_dup(hmac->ctx_dup);
@@ -229,7 +259,41 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
 {
     srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
 
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    uint8_t key_hash[SHA1_DIGEST_SIZE];
+    uint8_t ipad[SHA_CBLOCK];
+    uint8_t opad[SHA_CBLOCK];
+
+    /* keys longer than a block are hashed first, as HMAC requires */
+    if (key_len > SHA_CBLOCK) {
+        SHA1(key, key_len, key_hash);
+        key = key_hash;
+        key_len = sizeof(key_hash);
+    }
+
+    for (size_t i = 0; i < key_len; i++) {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+    for (size_t i = key_len; i < SHA_CBLOCK; i++) {
+        ipad[i] = 0x36;
+        opad[i] = 0x5c;
+    }
+
+    if (SHA1_Init(&hmac->inner) == 0 ||
+        SHA1_Update(&hmac->inner, ipad, sizeof(ipad)) == 0 ||
+        SHA1_Init(&hmac->outer) == 0 ||
+        SHA1_Update(&hmac->outer, opad, sizeof(opad)) == 0) {
+        octet_string_set_to_zero(ipad, sizeof(ipad));
+        octet_string_set_to_zero(opad, sizeof(opad));
+        octet_string_set_to_zero(key_hash, sizeof(key_hash));
+        return srtp_err_status_auth_fail;
+    }
+
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+    octet_string_set_to_zero(key_hash, sizeof(key_hash));
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     OSSL_PARAM params[2];
 
     params[0] = OSSL_PARAM_construct_utf8_string("digest", "SHA1", 0);
@@ -253,10 +317,14 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
 {
     srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    if (SHA1_Update(&hmac->ctx, message, msg_octets) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     if (EVP_MAC_update(hmac->ctx, message, msg_octets) == 0) {
         return srtp_err_status_auth_fail;
     }
@@ -268,21 +336,27 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_hmac_compute(void *statev,
-                                           const uint8_t *message,
-                                           size_t msg_octets,
-                                           size_t tag_len,
-                                           uint8_t *result)
+/*
+ * srtp_hmac_final(hmac, message, msg_octets, tag_len, hash_value) hashes
+ * message and writes the full HMAC of everything hashed since the start
+ * into hash_value, which must hold at least tag_len octets of it
+ */
+static srtp_err_status_t srtp_hmac_final(srtp_hmac_ossl_ctx_t *hmac,
+                                         const uint8_t *message,
+                                         size_t msg_octets,
+                                         size_t tag_len,
+                                         uint8_t hash_value[SHA1_DIGEST_SIZE])
 {
-    srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
-    uint8_t hash_value[SHA1_DIGEST_SIZE];
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    uint8_t inner_hash[SHA1_DIGEST_SIZE];
+    size_t len = SHA1_DIGEST_SIZE;
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     size_t len;
 #else
     unsigned int len;
 #endif
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     /* check tag length, return error if we can't provide the value expected */
@@ -291,12 +365,25 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
     }
 
     /* hash message, copy output into H */
-#ifdef SRTP_OSSL_USE_EVP_MAC
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    if (SHA1_Update(&hmac->ctx, message, msg_octets) == 0 ||
+        SHA1_Final(inner_hash, &hmac->ctx) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* the outer hash continues from the state after hashing opad ^ key */
+    hmac->ctx = hmac->outer;
+    if (SHA1_Update(&hmac->ctx, inner_hash, sizeof(inner_hash)) == 0 ||
+        SHA1_Final(hash_value, &hmac->ctx) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+    octet_string_set_to_zero(inner_hash, sizeof(inner_hash));
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
     if (EVP_MAC_update(hmac->ctx, message, msg_octets) == 0) {
         return srtp_err_status_auth_fail;
     }
 
-    if (EVP_MAC_final(hmac->ctx, hash_value, &len, sizeof hash_value) == 0) {
+    if (EVP_MAC_final(hmac->ctx, hash_value, &len, SHA1_DIGEST_SIZE) == 0) {
         return srtp_err_status_auth_fail;
     }
 #else
@@ -312,13 +399,104 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
         return srtp_err_status_auth_fail;
     }
 
+    debug_trace(srtp_mod_hmac, "output: %s",
+                srtp_octet_string_hex_string(hash_value, tag_len));
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_compute(void *statev,
+                                           const uint8_t *message,
+                                           size_t msg_octets,
+                                           size_t tag_len,
+                                           uint8_t *result)
+{
+    srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
+    uint8_t hash_value[SHA1_DIGEST_SIZE];
+    srtp_err_status_t status;
+
+    status = srtp_hmac_final(hmac, message, msg_octets, tag_len, hash_value);
+    if (status) {
+        return status;
+    }
+
     /* copy hash_value to *result */
     for (size_t i = 0; i < tag_len; i++) {
         result[i] = hash_value[i];
     }
 
-    debug_print(srtp_mod_hmac, "output: %s",
-                srtp_octet_string_hex_string(hash_value, tag_len));
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_hmac_verify() compares the digest with the tag where it was
+ * computed, without truncating it into a copy first
+ */
+static srtp_err_status_t srtp_hmac_verify(void *statev,
+                                          const uint8_t *message,
+                                          size_t msg_octets,
+                                          size_t tag_len,
+                                          const uint8_t *tag)
+{
+    srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
+    uint8_t hash_value[SHA1_DIGEST_SIZE];
+    srtp_err_status_t status;
+
+    status = srtp_hmac_final(hmac, message, msg_octets, tag_len, hash_value);
+    if (!status && !srtp_octet_string_equal(hash_value, tag, tag_len)) {
+        status = srtp_err_status_auth_fail;
+    }
+    octet_string_set_to_zero(hash_value, sizeof(hash_value));
+
+    return status;
+}
+
+/*
+ * srtp_hmac_clone() duplicates the keyed context of an initialized auth
+ * function, after which the two hash messages independently
+ */
+static srtp_err_status_t srtp_hmac_clone(const srtp_auth_t *a,
+                                         srtp_auth_t **clone)
+{
+    const srtp_hmac_ossl_ctx_t *hmac = (const srtp_hmac_ossl_ctx_t *)a->state;
+    srtp_hmac_ossl_ctx_t *new_hmac;
+    srtp_err_status_t status;
+
+    status = srtp_hmac_alloc(clone, a->key_len, a->out_len);
+    if (status) {
+        return status;
+    }
+
+    new_hmac = (srtp_hmac_ossl_ctx_t *)(*clone)->state;
+
+#if defined(SRTP_OSSL_USE_SHA1_MIDSTATE)
+    new_hmac->inner = hmac->inner;
+    new_hmac->outer = hmac->outer;
+#elif defined(SRTP_OSSL_USE_EVP_MAC)
+    if (new_hmac->use_dup) {
+        EVP_MAC_CTX_free(new_hmac->ctx_dup);
+        new_hmac->ctx_dup = EVP_MAC_CTX_dup(hmac->ctx_dup);
+        if (new_hmac->ctx_dup == NULL) {
+            srtp_hmac_dealloc(*clone);
+            *clone = NULL;
+            return srtp_err_status_alloc_fail;
+        }
+    } else {
+        EVP_MAC_CTX_free(new_hmac->ctx);
+        new_hmac->ctx = EVP_MAC_CTX_dup(hmac->ctx);
+        if (new_hmac->ctx == NULL) {
+            srtp_hmac_dealloc(*clone);
+            *clone = NULL;
+            return srtp_err_status_alloc_fail;
+        }
+    }
+#else
+    if (HMAC_CTX_copy(new_hmac->ctx, hmac->ctx) == 0) {
+        srtp_hmac_dealloc(*clone);
+        *clone = NULL;
+        return srtp_err_status_auth_fail;
+    }
+#endif
 
     return srtp_err_status_ok;
 }
@@ -339,5 +517,9 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_start,        /* */
     srtp_hmac_description,  /* */
     &srtp_hmac_test_case_0, /* */
-    SRTP_HMAC_SHA1          /* */
+    SRTP_HMAC_SHA1,         /* */
+    srtp_hmac_clone,        /* */
+    srtp_hmac_verify,       /* */
+    NULL,                   /* */
+    NULL                    /* */
 };
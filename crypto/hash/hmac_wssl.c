@@ -151,7 +151,7 @@ static srtp_err_status_t srtp_hmac_wolfssl_update(void *statev,
     Hmac *state = (Hmac *)statev;
     int err;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     err = wc_HmacUpdate(state, message, msg_octets);
@@ -174,7 +174,7 @@ static srtp_err_status_t srtp_hmac_wolfssl_compute(void *statev,
     int err;
     int i;
 
-    debug_print(srtp_mod_hmac, "input: %s",
+    debug_trace(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
     /* check tag length, return error if we can't provide the value expected */
@@ -200,7 +200,7 @@ static srtp_err_status_t srtp_hmac_wolfssl_compute(void *statev,
         result[i] = hash_value[i];
     }
 
-    debug_print(srtp_mod_hmac, "output: %s",
+    debug_trace(srtp_mod_hmac, "output: %s",
                 srtp_octet_string_hex_string(hash_value, tag_len));
 
     return srtp_err_status_ok;
@@ -224,5 +224,9 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_wolfssl_start,       /* */
     srtp_hmac_wolfssl_description, /* */
     &srtp_hmac_test_case_0,        /* */
-    SRTP_HMAC_SHA1                 /* */
+    SRTP_HMAC_SHA1,                /* */
+    NULL,                          /* clone */
+    NULL,                          /* verify */
+    NULL,                          /* job_init */
+    NULL                           /* compute_jobs */
 };
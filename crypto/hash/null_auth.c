@@ -147,6 +147,12 @@ static srtp_err_status_t srtp_null_auth_start(void *statev)
     return srtp_err_status_ok;
 }
 
+static srtp_err_status_t srtp_null_auth_clone(const srtp_auth_t *a,
+                                              srtp_auth_t **clone)
+{
+    return srtp_null_auth_alloc(clone, a->key_len, a->out_len);
+}
+
 /*
  * srtp_auth_type_t - defines description, test case, and null_auth
  * metaobject
@@ -177,5 +183,9 @@ const srtp_auth_type_t srtp_null_auth = {
     srtp_null_auth_start,        /* */
     srtp_null_auth_description,  /* */
     &srtp_null_auth_test_case_0, /* */
-    SRTP_NULL_AUTH               /* */
+    SRTP_NULL_AUTH,              /* */
+    srtp_null_auth_clone,        /* */
+    NULL,                        /* */
+    NULL,                        /* */
+    NULL                         /* */
 };
@@ -49,6 +49,36 @@
 #endif
 
 #include "sha1.h"
+#include "cpu_features.h"
+
+#include <string.h>
+
+/*
+ * hardware SHA-1 support, used for the compression function when
+ * srtp_cpu_features() reports it. On aarch64 the crypto extensions are
+ * built when the compiler targets them, or on linux when building with gcc.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define SRTP_SHA1_X86 1
+#define SRTP_SHA1_X86_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SRTP_SHA1_X86 1
+#define SRTP_SHA1_X86_TARGET
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) &&                                                 \
+    (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define SRTP_SHA1_ARMV8 1
+#define SRTP_SHA1_ARMV8_TARGET
+#include <arm_neon.h>
+#elif defined(__aarch64__) && defined(__linux__) && defined(__GNUC__) &&      \
+    !defined(__clang__) && __GNUC__ >= 9
+#define SRTP_SHA1_ARMV8 1
+#define SRTP_SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+#include <arm_neon.h>
+#endif
 
 srtp_debug_module_t srtp_mod_sha1 = {
     false,  /* debugging is off by default */
@@ -227,227 +257,316 @@ void srtp_sha1_init(srtp_sha1_ctx_t *ctx)
     ctx->num_bits_in_msg = 0;
 }
 
-void srtp_sha1_update(srtp_sha1_ctx_t *ctx,
-                      const uint8_t *msg,
-                      size_t octets_in_msg)
+void srtp_sha1_init_midstate(srtp_sha1_ctx_t *ctx,
+                             const uint32_t H[5],
+                             size_t num_blocks)
 {
-    size_t i;
-    uint8_t *buf = (uint8_t *)ctx->M;
+    /* restore state vector */
+    ctx->H[0] = H[0];
+    ctx->H[1] = H[1];
+    ctx->H[2] = H[2];
+    ctx->H[3] = H[3];
+    ctx->H[4] = H[4];
 
-    /* update message bit-count */
-    ctx->num_bits_in_msg += (uint32_t)octets_in_msg * 8;
+    /* indicate that message buffer is empty */
+    ctx->octets_in_buffer = 0;
 
-    /* loop over 16-word blocks of M */
-    while (octets_in_msg > 0) {
-        if (octets_in_msg + ctx->octets_in_buffer >= 64) {
-            /*
-             * copy words of M into msg buffer until that buffer is full,
-             * converting them into host byte order as needed
-             */
-            octets_in_msg -= (64 - ctx->octets_in_buffer);
-            for (i = ctx->octets_in_buffer; i < 64; i++) {
-                buf[i] = *msg++;
-            }
-            ctx->octets_in_buffer = 0;
+    /* account for the blocks already hashed */
+    ctx->num_bits_in_msg = (uint32_t)num_blocks * 512;
+}
 
-            /* process a whole block */
+#if defined(SRTP_SHA1_X86)
 
-            debug_print0(srtp_mod_sha1, "(update) running srtp_sha1_core()");
+/*
+ * four rounds of the message schedule and compression, following the
+ * structure from the Intel SHA extensions documentation
+ */
+#define SRTP_SHA1_X86_QUAD(E_IN, E_OUT, W0, W1, W2, W3, F)                    \
+    E_IN = _mm_sha1nexte_epu32(E_IN, W0);                                      \
+    E_OUT = abcd;                                                              \
+    W1 = _mm_sha1msg2_epu32(W1, W0);                                           \
+    abcd = _mm_sha1rnds4_epu32(abcd, E_IN, F);                                 \
+    W3 = _mm_sha1msg1_epu32(W3, W0);                                           \
+    W2 = _mm_xor_si128(W2, W0)
+
+SRTP_SHA1_X86_TARGET
+static void srtp_sha1_x86_compress(uint32_t hash_value[5],
+                                   const uint8_t *blocks,
+                                   size_t num_blocks)
+{
+    const __m128i mask =
+        _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i m0, m1, m2, m3;
+
+    abcd = _mm_loadu_si128((const __m128i *)hash_value);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    e0 = _mm_set_epi32((int)hash_value[4], 0, 0, 0);
+
+    while (num_blocks-- > 0) {
+        abcd_save = abcd;
+        e0_save = e0;
+
+        /* rounds 0-3 */
+        m0 = _mm_loadu_si128((const __m128i *)(blocks + 0));
+        m0 = _mm_shuffle_epi8(m0, mask);
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        /* rounds 4-7 */
+        m1 = _mm_loadu_si128((const __m128i *)(blocks + 16));
+        m1 = _mm_shuffle_epi8(m1, mask);
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        /* rounds 8-11 */
+        m2 = _mm_loadu_si128((const __m128i *)(blocks + 32));
+        m2 = _mm_shuffle_epi8(m2, mask);
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        /* rounds 12-15 */
+        m3 = _mm_loadu_si128((const __m128i *)(blocks + 48));
+        m3 = _mm_shuffle_epi8(m3, mask);
+        SRTP_SHA1_X86_QUAD(e1, e0, m3, m0, m1, m2, 0);
+
+        /* rounds 16-63 */
+        SRTP_SHA1_X86_QUAD(e0, e1, m0, m1, m2, m3, 0);
+        SRTP_SHA1_X86_QUAD(e1, e0, m1, m2, m3, m0, 1);
+        SRTP_SHA1_X86_QUAD(e0, e1, m2, m3, m0, m1, 1);
+        SRTP_SHA1_X86_QUAD(e1, e0, m3, m0, m1, m2, 1);
+        SRTP_SHA1_X86_QUAD(e0, e1, m0, m1, m2, m3, 1);
+        SRTP_SHA1_X86_QUAD(e1, e0, m1, m2, m3, m0, 1);
+        SRTP_SHA1_X86_QUAD(e0, e1, m2, m3, m0, m1, 2);
+        SRTP_SHA1_X86_QUAD(e1, e0, m3, m0, m1, m2, 2);
+        SRTP_SHA1_X86_QUAD(e0, e1, m0, m1, m2, m3, 2);
+        SRTP_SHA1_X86_QUAD(e1, e0, m1, m2, m3, m0, 2);
+        SRTP_SHA1_X86_QUAD(e0, e1, m2, m3, m0, m1, 2);
+        SRTP_SHA1_X86_QUAD(e1, e0, m3, m0, m1, m2, 3);
+
+        /* rounds 64-67 */
+        SRTP_SHA1_X86_QUAD(e0, e1, m0, m1, m2, m3, 3);
+
+        /* rounds 68-71 */
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        m3 = _mm_xor_si128(m3, m1);
+
+        /* rounds 72-75 */
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+        /* rounds 76-79 */
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+        /* add the result of this block to the state */
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+
+        blocks += 64;
+    }
 
-            srtp_sha1_core(ctx->M, ctx->H);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i *)hash_value, abcd);
+    hash_value[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
 
-        } else {
-            debug_print0(srtp_mod_sha1,
-                         "(update) not running srtp_sha1_core()");
+#elif defined(SRTP_SHA1_ARMV8)
 
-            for (i = ctx->octets_in_buffer;
-                 i < (ctx->octets_in_buffer + octets_in_msg); i++) {
-                buf[i] = *msg++;
+SRTP_SHA1_ARMV8_TARGET
+static void srtp_sha1_armv8_compress(uint32_t hash_value[5],
+                                     const uint8_t *blocks,
+                                     size_t num_blocks)
+{
+    const uint32_t k[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+    uint32x4_t abcd = vld1q_u32(hash_value);
+    uint32_t e = hash_value[4];
+
+    while (num_blocks-- > 0) {
+        uint32x4_t abcd_save = abcd;
+        uint32_t e_save = e;
+        uint32x4_t w[4];
+        uint32x4_t wk[2];
+
+        for (size_t i = 0; i < 4; i++) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * i)));
+        }
+        wk[0] = vaddq_u32(w[0], vdupq_n_u32(k[0]));
+        wk[1] = vaddq_u32(w[1], vdupq_n_u32(k[0]));
+
+        /*
+         * each group g does four rounds using the words of group g, while
+         * the message schedule prepares the words of group g + 4 in place
+         */
+        for (size_t g = 0; g < 20; g++) {
+            uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+            if (g < 5) {
+                abcd = vsha1cq_u32(abcd, e, wk[g % 2]);
+            } else if (g < 10 || g >= 15) {
+                abcd = vsha1pq_u32(abcd, e, wk[g % 2]);
+            } else {
+                abcd = vsha1mq_u32(abcd, e, wk[g % 2]);
+            }
+            e = e_next;
+
+            if (g + 2 < 20) {
+                wk[g % 2] =
+                    vaddq_u32(w[(g + 2) % 4], vdupq_n_u32(k[(g + 2) / 5]));
+            }
+            if (g >= 1 && g <= 16) {
+                w[(g + 3) % 4] = vsha1su1q_u32(w[(g + 3) % 4], w[(g + 2) % 4]);
+            }
+            if (g <= 15) {
+                w[g % 4] =
+                    vsha1su0q_u32(w[g % 4], w[(g + 1) % 4], w[(g + 2) % 4]);
             }
-            ctx->octets_in_buffer += octets_in_msg;
-            octets_in_msg = 0;
         }
+
+        abcd = vaddq_u32(abcd, abcd_save);
+        e += e_save;
+
+        blocks += 64;
     }
+
+    vst1q_u32(hash_value, abcd);
+    hash_value[4] = e;
 }
 
+#endif
+
 /*
- * srtp_sha1_final(ctx, output) computes the result for ctx and copies it
- * into the twenty octets located at *output
+ * srtp_sha1_compress(hash_value, blocks, num_blocks) runs the compression
+ * function over num_blocks consecutive 64 octet blocks, which need not be
+ * aligned
+ */
+/*
+ * srtp_sha1_hw() is true if srtp_sha1_compress() uses the SHA instructions
  */
+static bool srtp_sha1_hw(void)
+{
+#if defined(SRTP_SHA1_X86)
+    return srtp_cpu_has(SRTP_CPU_SHA1 | SRTP_CPU_SSE41 | SRTP_CPU_SSSE3);
+#elif defined(SRTP_SHA1_ARMV8)
+    return srtp_cpu_has(SRTP_CPU_SHA1);
+#else
+    return false;
+#endif
+}
 
-void srtp_sha1_final(srtp_sha1_ctx_t *ctx, uint32_t output[5])
+static void srtp_sha1_compress(uint32_t hash_value[5],
+                               const uint8_t *blocks,
+                               size_t num_blocks)
 {
-    uint32_t A, B, C, D, E, TEMP;
-    uint32_t W[80];
-    size_t i, t;
+#if defined(SRTP_SHA1_X86)
+    if (srtp_sha1_hw()) {
+        srtp_sha1_x86_compress(hash_value, blocks, num_blocks);
+        return;
+    }
+#elif defined(SRTP_SHA1_ARMV8)
+    if (srtp_sha1_hw()) {
+        srtp_sha1_armv8_compress(hash_value, blocks, num_blocks);
+        return;
+    }
+#endif
 
-    /*
-     * process the remaining octets_in_buffer, padding and terminating as
-     * necessary
-     */
-    {
-        size_t tail = ctx->octets_in_buffer % 4;
+    for (size_t i = 0; i < num_blocks; i++) {
+        uint32_t M[16];
+        memcpy(M, blocks + 64 * i, sizeof(M));
+        srtp_sha1_core(M, hash_value);
+    }
+}
 
-        /* copy/xor message into array */
-        for (i = 0; i < (ctx->octets_in_buffer + 3) / 4; i++) {
-            W[i] = be32_to_cpu(ctx->M[i]);
-        }
+void srtp_sha1_update(srtp_sha1_ctx_t *ctx,
+                      const uint8_t *msg,
+                      size_t octets_in_msg)
+{
+    uint8_t *buf = (uint8_t *)ctx->M;
 
-        /* set the high bit of the octet immediately following the message */
-        switch (tail) {
-        case (3):
-            W[i - 1] = (be32_to_cpu(ctx->M[i - 1]) & 0xffffff00) | 0x80;
-            W[i] = 0x0;
-            break;
-        case (2):
-            W[i - 1] = (be32_to_cpu(ctx->M[i - 1]) & 0xffff0000) | 0x8000;
-            W[i] = 0x0;
-            break;
-        case (1):
-            W[i - 1] = (be32_to_cpu(ctx->M[i - 1]) & 0xff000000) | 0x800000;
-            W[i] = 0x0;
-            break;
-        case (0):
-            W[i] = 0x80000000;
-            break;
-        }
+    /* update message bit-count */
+    ctx->num_bits_in_msg += (uint32_t)octets_in_msg * 8;
 
-        /* zeroize remaining words */
-        for (i++; i < 15; i++) {
-            W[i] = 0x0;
+    /* complete a partially filled message buffer first */
+    if (ctx->octets_in_buffer > 0) {
+        size_t fill = 64 - ctx->octets_in_buffer;
+        if (fill > octets_in_msg) {
+            fill = octets_in_msg;
         }
+        memcpy(buf + ctx->octets_in_buffer, msg, fill);
+        ctx->octets_in_buffer += fill;
+        msg += fill;
+        octets_in_msg -= fill;
 
-        /*
-         * if there is room at the end of the word array, then set the
-         * last word to the bit-length of the message; otherwise, set that
-         * word to zero and then we need to do one more run of the
-         * compression algo.
-         */
-        if (ctx->octets_in_buffer < 56) {
-            W[15] = ctx->num_bits_in_msg;
-        } else if (ctx->octets_in_buffer < 60) {
-            W[15] = 0x0;
+        if (ctx->octets_in_buffer < 64) {
+            debug_trace0(srtp_mod_sha1,
+                         "(update) not running srtp_sha1_core()");
+            return;
         }
 
-        /* process the word array */
-        for (t = 16; t < 80; t++) {
-            TEMP = W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16];
-            W[t] = S1(TEMP);
-        }
+        debug_trace0(srtp_mod_sha1, "(update) running srtp_sha1_core()");
+        srtp_sha1_compress(ctx->H, buf, 1);
+        ctx->octets_in_buffer = 0;
+    }
 
-        A = ctx->H[0];
-        B = ctx->H[1];
-        C = ctx->H[2];
-        D = ctx->H[3];
-        E = ctx->H[4];
-
-        for (t = 0; t < 20; t++) {
-            TEMP = S5(A) + f0(B, C, D) + E + W[t] + SHA_K0;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
-        for (; t < 40; t++) {
-            TEMP = S5(A) + f1(B, C, D) + E + W[t] + SHA_K1;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
-        for (; t < 60; t++) {
-            TEMP = S5(A) + f2(B, C, D) + E + W[t] + SHA_K2;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
-        for (; t < 80; t++) {
-            TEMP = S5(A) + f3(B, C, D) + E + W[t] + SHA_K3;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
+    /* process whole blocks directly from the message */
+    if (octets_in_msg >= 64) {
+        size_t num_blocks = octets_in_msg / 64;
 
-        ctx->H[0] += A;
-        ctx->H[1] += B;
-        ctx->H[2] += C;
-        ctx->H[3] += D;
-        ctx->H[4] += E;
+        debug_trace(srtp_mod_sha1, "(update) running srtp_sha1_core() %zu times",
+                    num_blocks);
+        srtp_sha1_compress(ctx->H, msg, num_blocks);
+        msg += num_blocks * 64;
+        octets_in_msg -= num_blocks * 64;
     }
 
-    debug_print0(srtp_mod_sha1, "(final) running srtp_sha1_core()");
+    /* keep the remainder for the next call */
+    memcpy(buf, msg, octets_in_msg);
+    ctx->octets_in_buffer = octets_in_msg;
+}
 
-    if (ctx->octets_in_buffer >= 56) {
-        debug_print0(srtp_mod_sha1, "(final) running srtp_sha1_core() again");
+/*
+ * srtp_sha1_final(ctx, output) computes the result for ctx and copies it
+ * into the twenty octets located at *output
+ */
 
-        /* we need to do one final run of the compression algo */
+void srtp_sha1_final(srtp_sha1_ctx_t *ctx, uint32_t output[5])
+{
+    uint8_t *buf = (uint8_t *)ctx->M;
+    size_t n = ctx->octets_in_buffer;
 
-        /*
-         * set initial part of word array to zeros, and set the
-         * final part to the number of bits in the message
-         */
-        for (i = 0; i < 15; i++) {
-            W[i] = 0x0;
-        }
-        W[15] = ctx->num_bits_in_msg;
+    /* set the high bit of the octet immediately following the message */
+    buf[n++] = 0x80;
 
-        /* process the word array */
-        for (t = 16; t < 80; t++) {
-            TEMP = W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16];
-            W[t] = S1(TEMP);
-        }
+    /*
+     * if there is no room at the end of the block for the bit-length of
+     * the message, then we need to do one more run of the compression
+     * algo
+     */
+    if (n > 56) {
+        debug_trace0(srtp_mod_sha1, "(final) running srtp_sha1_core() again");
+        memset(buf + n, 0, 64 - n);
+        srtp_sha1_compress(ctx->H, buf, 1);
+        n = 0;
+    }
 
-        A = ctx->H[0];
-        B = ctx->H[1];
-        C = ctx->H[2];
-        D = ctx->H[3];
-        E = ctx->H[4];
-
-        for (t = 0; t < 20; t++) {
-            TEMP = S5(A) + f0(B, C, D) + E + W[t] + SHA_K0;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
-        for (; t < 40; t++) {
-            TEMP = S5(A) + f1(B, C, D) + E + W[t] + SHA_K1;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
-        for (; t < 60; t++) {
-            TEMP = S5(A) + f2(B, C, D) + E + W[t] + SHA_K2;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
-        for (; t < 80; t++) {
-            TEMP = S5(A) + f3(B, C, D) + E + W[t] + SHA_K3;
-            E = D;
-            D = C;
-            C = S30(B);
-            B = A;
-            A = TEMP;
-        }
+    /* zeroize the remaining octets and append the bit-length */
+    memset(buf + n, 0, 64 - n);
+    ctx->M[15] = be32_to_cpu(ctx->num_bits_in_msg);
 
-        ctx->H[0] += A;
-        ctx->H[1] += B;
-        ctx->H[2] += C;
-        ctx->H[3] += D;
-        ctx->H[4] += E;
-    }
+    debug_trace0(srtp_mod_sha1, "(final) running srtp_sha1_core()");
+    srtp_sha1_compress(ctx->H, buf, 1);
 
     /* copy result into output buffer */
     output[0] = be32_to_cpu(ctx->H[0]);
@@ -461,3 +580,198 @@ void srtp_sha1_final(srtp_sha1_ctx_t *ctx, uint32_t output[5])
 
     return;
 }
+
+/*
+ * multi-buffer SHA-1
+ *
+ * srtp_sha1_core_lanes() runs the compression function for independent
+ * messages at once, the state of each message in its own 32 bit lane of
+ * the vector registers. The vectors are those of the GCC vector
+ * extensions, so that the rounds are written once and compiled for each
+ * instruction set: SSE2 and NEON hold four lanes, AVX2 eight and AVX-512
+ * sixteen.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) &&                              \
+    (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#define SRTP_SHA1_LANES_SIMD 1
+
+typedef uint32_t srtp_sha1_vec4_t __attribute__((vector_size(16)));
+#if defined(__aarch64__)
+#define SRTP_SHA1_VEC4_TARGET
+#else
+#define SRTP_SHA1_LANES_X86 1
+typedef uint32_t srtp_sha1_vec8_t __attribute__((vector_size(32)));
+typedef uint32_t srtp_sha1_vec16_t __attribute__((vector_size(64)));
+#define SRTP_SHA1_VEC4_TARGET __attribute__((target("sse2")))
+#define SRTP_SHA1_VEC8_TARGET __attribute__((target("avx2")))
+#define SRTP_SHA1_VEC16_TARGET __attribute__((target("avx512f")))
+#endif
+
+static inline uint32_t srtp_sha1_load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+#define SRTP_SHA1_ROTL(X, N) (((X) << (N)) | ((X) >> (32 - (N))))
+
+/* the message schedule for round t, from t = 16 on */
+#define SRTP_SHA1_LANES_SCHEDULE(t)                                            \
+    w[(t)&15] = SRTP_SHA1_ROTL(w[((t) + 13) & 15] ^ w[((t) + 8) & 15] ^        \
+                                   w[((t) + 2) & 15] ^ w[(t)&15],              \
+                               1)
+
+#define SRTP_SHA1_LANES_ROUND(t, F, K)                                         \
+    tmp = SRTP_SHA1_ROTL(a, 5) + (F) + e + w[(t)&15] + (K);                    \
+    e = d;                                                                     \
+    d = c;                                                                     \
+    c = SRTP_SHA1_ROTL(b, 30);                                                 \
+    b = a;                                                                     \
+    a = tmp
+
+/*
+ * SRTP_SHA1_DEFINE_LANES(name, vec_t, num_lanes, target) defines
+ * name(H, blocks), which compresses the block blocks[i] into the state
+ * H[i] for each of the num_lanes lanes of vec_t
+ */
+#define SRTP_SHA1_DEFINE_LANES(name, vec_t, num_lanes, target)                 \
+    target static void name(uint32_t H[][5], const uint8_t *const blocks[])    \
+    {                                                                          \
+        vec_t a, b, c, d, e, tmp, w[16];                                       \
+        size_t t, l;                                                           \
+                                                                               \
+        for (t = 0; t < 16; t++) {                                             \
+            for (l = 0; l < (num_lanes); l++) {                                \
+                w[t][l] = srtp_sha1_load_be32(blocks[l] + 4 * t);              \
+            }                                                                  \
+        }                                                                      \
+        for (l = 0; l < (num_lanes); l++) {                                    \
+            a[l] = H[l][0];                                                    \
+            b[l] = H[l][1];                                                    \
+            c[l] = H[l][2];                                                    \
+            d[l] = H[l][3];                                                    \
+            e[l] = H[l][4];                                                    \
+        }                                                                      \
+                                                                               \
+        for (t = 0; t < 16; t++) {                                             \
+            SRTP_SHA1_LANES_ROUND(t, (b & c) | (~b & d), 0x5A827999u);         \
+        }                                                                      \
+        for (; t < 20; t++) {                                                  \
+            SRTP_SHA1_LANES_SCHEDULE(t);                                       \
+            SRTP_SHA1_LANES_ROUND(t, (b & c) | (~b & d), 0x5A827999u);         \
+        }                                                                      \
+        for (; t < 40; t++) {                                                  \
+            SRTP_SHA1_LANES_SCHEDULE(t);                                       \
+            SRTP_SHA1_LANES_ROUND(t, b ^ c ^ d, 0x6ED9EBA1u);                  \
+        }                                                                      \
+        for (; t < 60; t++) {                                                  \
+            SRTP_SHA1_LANES_SCHEDULE(t);                                       \
+            SRTP_SHA1_LANES_ROUND(t, (b & c) | (b & d) | (c & d),              \
+                                  0x8F1BBCDCu);                                \
+        }                                                                      \
+        for (; t < 80; t++) {                                                  \
+            SRTP_SHA1_LANES_SCHEDULE(t);                                       \
+            SRTP_SHA1_LANES_ROUND(t, b ^ c ^ d, 0xCA62C1D6u);                  \
+        }                                                                      \
+                                                                               \
+        for (l = 0; l < (num_lanes); l++) {                                    \
+            H[l][0] += a[l];                                                   \
+            H[l][1] += b[l];                                                   \
+            H[l][2] += c[l];                                                   \
+            H[l][3] += d[l];                                                   \
+            H[l][4] += e[l];                                                   \
+        }                                                                      \
+    }
+
+SRTP_SHA1_DEFINE_LANES(srtp_sha1_lanes_4, srtp_sha1_vec4_t, 4,
+                       SRTP_SHA1_VEC4_TARGET)
+#if defined(SRTP_SHA1_LANES_X86)
+SRTP_SHA1_DEFINE_LANES(srtp_sha1_lanes_8, srtp_sha1_vec8_t, 8,
+                       SRTP_SHA1_VEC8_TARGET)
+SRTP_SHA1_DEFINE_LANES(srtp_sha1_lanes_16, srtp_sha1_vec16_t, 16,
+                       SRTP_SHA1_VEC16_TARGET)
+#endif
+
+#endif /* SRTP_SHA1_LANES_SIMD */
+
+size_t srtp_sha1_lanes(void)
+{
+#if defined(SRTP_SHA1_LANES_X86)
+    if (srtp_cpu_has(SRTP_CPU_AVX512)) {
+        return 16;
+    }
+    if (srtp_cpu_has(SRTP_CPU_AVX2)) {
+        return 8;
+    }
+    /* four lanes of SSE2 do not keep up with the SHA instructions */
+    if (srtp_cpu_has(SRTP_CPU_SSE2) && !srtp_sha1_hw()) {
+        return 4;
+    }
+#elif defined(SRTP_SHA1_LANES_SIMD)
+    /* nor do four lanes of NEON with the ARMv8 ones */
+    if (!srtp_sha1_hw()) {
+        return 4;
+    }
+#endif
+    return 1;
+}
+
+void srtp_sha1_core_lanes(uint32_t H[][5],
+                          const uint8_t *const blocks[],
+                          size_t num_lanes)
+{
+    size_t max_lanes = srtp_sha1_lanes();
+    size_t min_width = 4;
+    size_t min_fill = 1;
+
+    /*
+     * a block takes the SHA instructions about as long as a vector of
+     * eight or sixteen lanes takes for all of them, so against those only
+     * the wider vectors are used and only when they are mostly full
+     */
+    if (max_lanes > 1 && srtp_sha1_hw()) {
+        min_width = 8;
+        min_fill = 6;
+    }
+
+    while (max_lanes > 1 && num_lanes >= min_fill) {
+        uint32_t lane_H[SRTP_SHA1_MAX_LANES][5];
+        const uint8_t *lane_blocks[SRTP_SHA1_MAX_LANES];
+        size_t width = min_width;
+        size_t n;
+
+        /* the narrowest vectors that take all the lanes left, if any do */
+        while (width < num_lanes && width < max_lanes) {
+            width *= 2;
+        }
+        n = num_lanes < width ? num_lanes : width;
+
+        /* unused lanes repeat the first one, their result is dropped */
+        for (size_t l = 0; l < width; l++) {
+            size_t from = l < n ? l : 0;
+            memcpy(lane_H[l], H[from], sizeof(lane_H[l]));
+            lane_blocks[l] = blocks[from];
+        }
+
+#if defined(SRTP_SHA1_LANES_X86)
+        if (width == 16) {
+            srtp_sha1_lanes_16(lane_H, lane_blocks);
+        } else if (width == 8) {
+            srtp_sha1_lanes_8(lane_H, lane_blocks);
+        } else {
+            srtp_sha1_lanes_4(lane_H, lane_blocks);
+        }
+#elif defined(SRTP_SHA1_LANES_SIMD)
+        srtp_sha1_lanes_4(lane_H, lane_blocks);
+#endif
+
+        memcpy(H, lane_H, n * sizeof(lane_H[0]));
+        H += n;
+        blocks += n;
+        num_lanes -= n;
+    }
+
+    for (size_t l = 0; l < num_lanes; l++) {
+        srtp_sha1_compress(H[l], blocks[l], 1);
+    }
+}
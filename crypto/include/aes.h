@@ -58,6 +58,9 @@ extern "C" {
 typedef struct {
     v128_t round[15];
     size_t num_rounds;
+#ifdef ENABLE_AES_BITSLICE
+    uint64_t bitsliced[15][8]; /* round keys for four blocks at once */
+#endif
 } srtp_aes_expanded_key_t;
 
 srtp_err_status_t srtp_aes_expand_encryption_key(
@@ -76,6 +79,34 @@ void srtp_aes_encrypt(v128_t *plaintext,
 void srtp_aes_decrypt(v128_t *plaintext,
                       const srtp_aes_expanded_key_t *exp_key);
 
+/*
+ * srtp_aes_encrypt_blocks(blocks, num_blocks, exp_key) encrypts num_blocks
+ * independent blocks in place. When the cpu provides AES instructions the
+ * blocks are processed in parallel, as they are four at a time by the
+ * bitsliced implementation, otherwise this is equivalent to calling
+ * srtp_aes_encrypt() on each block.
+ */
+void srtp_aes_encrypt_blocks(v128_t *blocks,
+                             size_t num_blocks,
+                             const srtp_aes_expanded_key_t *exp_key);
+
+/*
+ * srtp_aes_encrypt_blocks_keys(blocks, exp_keys, num_blocks) encrypts
+ * each of num_blocks independent blocks in place with its own key,
+ * exp_keys[i] for blocks[i]. With the AES instructions blocks of
+ * different keys are in flight together, otherwise runs of blocks with
+ * the same key are passed to srtp_aes_encrypt_blocks().
+ *
+ * srtp_aes_keys_interleaved() returns true if srtp_aes_encrypt_blocks_keys()
+ * keeps blocks of different keys in flight together.
+ */
+void srtp_aes_encrypt_blocks_keys(
+    v128_t *blocks,
+    const srtp_aes_expanded_key_t *const *exp_keys,
+    size_t num_blocks);
+
+bool srtp_aes_keys_interleaved(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -55,9 +55,17 @@
 #include <openssl/evp.h>
 #include <openssl/aes.h>
 
+#if defined(OPENSSL_VERSION_MAJOR) && (OPENSSL_VERSION_MAJOR >= 3)
+/* fetch the cipher once instead of on every EVP_CipherInit_ex() */
+#define SRTP_OSSL_USE_CIPHER_FETCH
+#endif
+
 typedef struct {
     size_t key_size;
     size_t tag_len;
+#ifdef SRTP_OSSL_USE_CIPHER_FETCH
+    EVP_CIPHER *evp;
+#endif
     EVP_CIPHER_CTX *ctx;
     srtp_cipher_direction_t dir;
 } srtp_aes_gcm_ctx_t;
@@ -138,4 +146,59 @@ typedef struct {
 
 #endif /* NSS */
 
+#ifdef CNG
+
+#include <windows.h>
+#include <bcrypt.h>
+
+#define MAX_AD_SIZE 2048
+
+typedef struct {
+    size_t key_size;
+    size_t tag_size;
+    srtp_cipher_direction_t dir;
+    BCRYPT_ALG_HANDLE alg;
+    BCRYPT_KEY_HANDLE key; /* AES-GCM key object, kept with the key */
+    uint8_t iv[12];
+    uint8_t aad[MAX_AD_SIZE];
+    size_t aad_size;
+} srtp_aes_gcm_ctx_t;
+
+#endif /* CNG */
+
+#if !defined(OPENSSL) && !defined(WOLFSSL) && !defined(MBEDTLS) &&            \
+    !defined(NSS) && !defined(CNG)
+
+#include "aes.h"
+
+/*
+ * srtp_aes_gcm_key_t holds everything derived from the key, the remaining
+ * fields of srtp_aes_gcm_ctx_t are the state of the packet being processed
+ *
+ * HL and HH hold the multiples of the hash key H for the 4-bit table
+ * GHASH, H_pow the byte reversed powers H^1..H^8 for the carry-less
+ * multiply GHASH
+ */
+typedef struct {
+    srtp_aes_expanded_key_t expanded_key;
+    v128_t H_pow[8];
+    uint64_t HL[16];
+    uint64_t HH[16];
+} srtp_aes_gcm_key_t;
+
+typedef struct {
+    const srtp_aes_gcm_key_t *key;
+    v128_t J0;           /* pre-counter block, used for the tag        */
+    v128_t counter;      /* counter block of the next block of data    */
+    v128_t X;            /* GHASH accumulator                          */
+    uint8_t aad_buf[16]; /* AAD that does not fill a block yet         */
+    size_t aad_buf_len;
+    uint64_t aad_len;
+    size_t key_size;
+    size_t tag_len;
+    srtp_cipher_direction_t dir;
+} srtp_aes_gcm_ctx_t;
+
+#endif /* internal crypto */
+
 #endif /* AES_GCM_H */
@@ -50,13 +50,25 @@
 #include "aes.h"
 #include "cipher.h"
 
+/*
+ * srtp_aes_icm_key_t is the part of the context that is set by the key
+ * and salt and only read when processing packets, the remaining fields
+ * of srtp_aes_icm_ctx_t change with every packet
+ *
+ * the expanded key is held in the key store, shared with every context
+ * keyed with the same key
+ */
+typedef struct {
+    const srtp_aes_expanded_key_t *expanded_key; /* the cipher key          */
+    v128_t offset;                               /* initial offset value    */
+} srtp_aes_icm_key_t;
+
 typedef struct {
-    v128_t counter;                       /* holds the counter value          */
-    v128_t offset;                        /* initial offset value             */
-    v128_t keystream_buffer;              /* buffers bytes of keystream       */
-    srtp_aes_expanded_key_t expanded_key; /* the cipher key                   */
-    size_t bytes_in_buffer;               /* number of unused bytes in buffer */
-    size_t key_size;                      /* AES key size + 14 byte SALT */
+    srtp_aes_icm_key_t key;  /* expanded key and offset          */
+    v128_t counter;          /* holds the counter value          */
+    v128_t keystream_buffer; /* buffers bytes of keystream       */
+    size_t bytes_in_buffer;  /* number of unused bytes in buffer */
+    size_t key_size;         /* AES key size + 14 byte SALT */
 } srtp_aes_icm_ctx_t;
 
 #endif /* AES_ICM_H */
@@ -69,9 +69,8 @@ typedef struct {
 typedef struct {
     v128_t counter; /* holds the counter value          */
     v128_t offset;  /* initial offset value             */
-    uint8_t key[SRTP_AES_256_KEY_LEN];
     size_t key_size;
-    Aes *ctx;
+    Aes *ctx; /* holds the expanded key           */
 } srtp_aes_icm_ctx_t;
 
 #endif /* WOLFSSL */
@@ -104,13 +103,45 @@ typedef struct {
 typedef struct {
     v128_t counter;
     v128_t offset;
+    v128_t keystream_buffer; /* buffers bytes of keystream        */
+    size_t bytes_in_buffer;  /* number of unused bytes in buffer  */
     size_t key_size;
-    uint8_t iv[16];
     NSSInitContext *nss;
     PK11SymKey *key;
-    PK11Context *ctx;
+    PK11Context *ctx; /* AES-ECB context, kept with the key */
 } srtp_aes_icm_ctx_t;
 
 #endif /* NSS */
 
+#ifdef CNG
+
+#include <windows.h>
+#include <bcrypt.h>
+
+typedef struct {
+    v128_t counter;
+    v128_t offset;
+    v128_t keystream_buffer; /* buffers bytes of keystream        */
+    size_t bytes_in_buffer;  /* number of unused bytes in buffer  */
+    size_t key_size;
+    BCRYPT_ALG_HANDLE alg;
+    BCRYPT_KEY_HANDLE key; /* AES-ECB key object, kept with the key */
+} srtp_aes_icm_ctx_t;
+
+#endif /* CNG */
+
+#ifdef COMMONCRYPTO
+
+#include <CommonCrypto/CommonCryptor.h>
+
+typedef struct {
+    v128_t counter; /* holds the counter value          */
+    v128_t offset;  /* initial offset value             */
+    size_t key_size;
+    uint8_t key[SRTP_AES_256_KEY_LEN]; /* to create the cryptor again */
+    CCCryptorRef ctx; /* AES-CTR cryptor, kept with the key */
+} srtp_aes_icm_ctx_t;
+
+#endif /* COMMONCRYPTO */
+
 #endif /* AES_ICM_H */
@@ -61,6 +61,35 @@ extern "C" {
  */
 void *srtp_crypto_alloc(size_t size);
 
+/*
+ * SRTP_CACHE_LINE_SIZE is the alignment used for contexts that are
+ * touched for every packet, so that they do not share a cache line
+ * with unrelated data
+ */
+#define SRTP_CACHE_LINE_SIZE 64
+
+/*
+ * srtp_crypto_alloc_aligned
+ *
+ * Like srtp_crypto_alloc, but the returned memory is aligned to alignment
+ * octets, which must be a power of two. Free the memory with a call to
+ * srtp_crypto_free.
+ *
+ * returns pointer to memory on success or else NULL
+ */
+void *srtp_crypto_alloc_aligned(size_t size, size_t alignment);
+
+/*
+ * srtp_crypto_alloc_set_node
+ *
+ * Makes the following allocations of the calling thread ask the
+ * allocator for memory on NUMA node, or on any node for
+ * SRTP_NUMA_NODE_ANY. Without thread local storage the node is ignored.
+ *
+ * returns the node that was set before
+ */
+int srtp_crypto_alloc_set_node(int node);
+
 /*
  * srtp_crypto_free
  *
@@ -69,6 +98,14 @@ void *srtp_crypto_alloc(size_t size);
  */
 void srtp_crypto_free(void *ptr);
 
+/*
+ * srtp_crypto_alloc_size
+ *
+ * Returns the size that was asked for when the block of memory ptr was
+ * allocated with srtp_crypto_alloc, or 0 if ptr is NULL
+ */
+size_t srtp_crypto_alloc_size(const void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
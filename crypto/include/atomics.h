@@ -0,0 +1,474 @@
+/*
+ * atomics.h
+ *
+ * atomic counters and spin locks used by the optional thread safe
+ * session mode and the allocation statistics
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_ATOMICS_H
+#define SRTP_ATOMICS_H
+
+#include "datatypes.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * srtp_atomic_add(var, n), srtp_atomic_sub(var, n) and srtp_atomic_get(var)
+ * operate on size_t counters that are only read for statistics, they do
+ * not order other memory accesses
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define SRTP_HAVE_ATOMICS 1
+#define srtp_atomic_add(var, n)                                                \
+    ((void)__atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED))
+#define srtp_atomic_sub(var, n)                                                \
+    ((void)__atomic_fetch_sub(&(var), (n), __ATOMIC_RELAXED))
+#define srtp_atomic_get(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#elif defined(_MSC_VER)
+#define SRTP_HAVE_ATOMICS 1
+#ifdef _WIN64
+#define srtp_atomic_add(var, n)                                                \
+    ((void)_InterlockedExchangeAdd64((volatile __int64 *)&(var), (__int64)(n)))
+#else
+#define srtp_atomic_add(var, n)                                                \
+    ((void)_InterlockedExchangeAdd((volatile long *)&(var), (long)(n)))
+#endif
+#define srtp_atomic_sub(var, n) srtp_atomic_add(var, 0 - (size_t)(n))
+#define srtp_atomic_get(var) (*(volatile size_t *)&(var))
+#else
+/* no atomics available, the counters are only exact single threaded */
+#define SRTP_HAVE_ATOMICS 0
+#define srtp_atomic_add(var, n) ((void)((var) += (n)))
+#define srtp_atomic_sub(var, n) ((void)((var) -= (n)))
+#define srtp_atomic_get(var) (var)
+#endif
+
+/*
+ * srtp_spinlock_t is a mutex for short critical sections, such as the
+ * processing of a single packet; srtp_rwlock_t additionally allows any
+ * number of concurrent readers and gives priority to a waiting writer
+ *
+ * both are zero initialized and need no cleanup; without atomics they
+ * are no-ops, which callers must check for with SRTP_HAVE_ATOMICS
+ */
+typedef struct {
+    volatile long locked;
+} srtp_spinlock_t;
+
+typedef struct {
+    volatile long state; /* number of readers, or'ed with writer bit */
+} srtp_rwlock_t;
+
+#define SRTP_RWLOCK_WRITER ((long)1 << 30)
+
+#if defined(__GNUC__) || defined(__clang__)
+static inline long srtp_lock_load(volatile long *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline bool srtp_lock_cas(volatile long *p, long expected, long desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void srtp_lock_add_release(volatile long *p, long n)
+{
+    __atomic_fetch_add(p, n, __ATOMIC_RELEASE);
+}
+#elif defined(_MSC_VER)
+static inline long srtp_lock_load(volatile long *p)
+{
+    return _InterlockedOr(p, 0);
+}
+
+static inline bool srtp_lock_cas(volatile long *p, long expected, long desired)
+{
+    return _InterlockedCompareExchange(p, desired, expected) == expected;
+}
+
+static inline void srtp_lock_add_release(volatile long *p, long n)
+{
+    _InterlockedExchangeAdd(p, n);
+}
+#else
+static inline long srtp_lock_load(volatile long *p)
+{
+    return *p;
+}
+
+static inline bool srtp_lock_cas(volatile long *p, long expected, long desired)
+{
+    (void)p;
+    (void)expected;
+    (void)desired;
+    return true;
+}
+
+static inline void srtp_lock_add_release(volatile long *p, long n)
+{
+    (void)p;
+    (void)n;
+}
+#endif
+
+/*
+ * srtp_lock_backoff() is called while waiting for a lock, after a few
+ * rounds of spinning it yields the processor in case the holder of the
+ * lock has been preempted
+ */
+static inline void srtp_lock_backoff(unsigned int *spins)
+{
+    if (++*spins < 64) {
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+        __builtin_ia32_pause();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_pause();
+#endif
+        return;
+    }
+    *spins = 0;
+#if defined(_WIN32)
+    SwitchToThread();
+#elif defined(__unix__) || defined(__APPLE__)
+    sched_yield();
+#endif
+}
+
+static inline void srtp_spinlock_lock(srtp_spinlock_t *lock)
+{
+    unsigned int spins = 0;
+
+    while (srtp_lock_load(&lock->locked) != 0 ||
+           !srtp_lock_cas(&lock->locked, 0, 1)) {
+        srtp_lock_backoff(&spins);
+    }
+}
+
+static inline void srtp_spinlock_unlock(srtp_spinlock_t *lock)
+{
+    srtp_lock_add_release(&lock->locked, -1);
+}
+
+static inline void srtp_rwlock_read_lock(srtp_rwlock_t *lock)
+{
+    unsigned int spins = 0;
+
+    for (;;) {
+        long state = srtp_lock_load(&lock->state);
+        if ((state & SRTP_RWLOCK_WRITER) == 0 &&
+            srtp_lock_cas(&lock->state, state, state + 1)) {
+            return;
+        }
+        srtp_lock_backoff(&spins);
+    }
+}
+
+static inline void srtp_rwlock_read_unlock(srtp_rwlock_t *lock)
+{
+    srtp_lock_add_release(&lock->state, -1);
+}
+
+static inline void srtp_rwlock_write_lock(srtp_rwlock_t *lock)
+{
+    unsigned int spins = 0;
+
+    /* claim the writer bit, which keeps new readers out */
+    for (;;) {
+        long state = srtp_lock_load(&lock->state);
+        if ((state & SRTP_RWLOCK_WRITER) == 0 &&
+            srtp_lock_cas(&lock->state, state, state | SRTP_RWLOCK_WRITER)) {
+            break;
+        }
+        srtp_lock_backoff(&spins);
+    }
+
+    /* then wait for the readers that got in before to leave */
+    while (srtp_lock_load(&lock->state) != SRTP_RWLOCK_WRITER) {
+        srtp_lock_backoff(&spins);
+    }
+}
+
+static inline void srtp_rwlock_write_unlock(srtp_rwlock_t *lock)
+{
+    srtp_lock_add_release(&lock->state, -SRTP_RWLOCK_WRITER);
+}
+
+/*
+ * srtp_atomic_set_flag(flags, flag) sets flag in flags and returns whether
+ * it was set already, srtp_atomic_clear_flag(flags, flag) clears it again
+ */
+#if defined(__GNUC__) || defined(__clang__)
+static inline bool srtp_atomic_set_flag(volatile uint8_t *flags, uint8_t flag)
+{
+    return (__atomic_fetch_or(flags, flag, __ATOMIC_ACQ_REL) & flag) != 0;
+}
+
+static inline void srtp_atomic_clear_flag(volatile uint8_t *flags,
+                                          uint8_t flag)
+{
+    __atomic_fetch_and(flags, (uint8_t)~flag, __ATOMIC_RELEASE);
+}
+#elif defined(_MSC_VER)
+static inline bool srtp_atomic_set_flag(volatile uint8_t *flags, uint8_t flag)
+{
+    return (_InterlockedOr8((volatile char *)flags, (char)flag) & flag) != 0;
+}
+
+static inline void srtp_atomic_clear_flag(volatile uint8_t *flags,
+                                          uint8_t flag)
+{
+    _InterlockedAnd8((volatile char *)flags, (char)~flag);
+}
+#else
+static inline bool srtp_atomic_set_flag(volatile uint8_t *flags, uint8_t flag)
+{
+    bool was_set = (*flags & flag) != 0;
+    *flags |= flag;
+    return was_set;
+}
+
+static inline void srtp_atomic_clear_flag(volatile uint8_t *flags,
+                                          uint8_t flag)
+{
+    *flags &= (uint8_t)~flag;
+}
+#endif
+
+/*
+ * srtp_atomic_cas_u8(p, expected, desired) and srtp_atomic_cas_u32() set
+ * *p to desired if it is expected and return whether they did, the latter
+ * updates *expected to the value it found otherwise, and
+ * srtp_atomic_load_u8(p) reads a value they may be setting
+ *
+ * srtp_atomic_cas_ptr(p, desired) sets *p to desired if it is NULL, so
+ * that of threads racing to create an object only one publishes it, and
+ * srtp_atomic_load_ptr(p) then sees the object initialized
+ */
+#if defined(__GNUC__) || defined(__clang__)
+static inline bool srtp_atomic_cas_u8(volatile uint8_t *p,
+                                      uint8_t expected,
+                                      uint8_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline uint8_t srtp_atomic_load_u8(const volatile uint8_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline bool srtp_atomic_cas_u32(volatile uint32_t *p,
+                                       uint32_t *expected,
+                                       uint32_t desired)
+{
+    return __atomic_compare_exchange_n(p, expected, desired, false,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline bool srtp_atomic_cas_ptr(void *volatile *p, void *desired)
+{
+    void *expected = NULL;
+
+    return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                       __ATOMIC_RELEASE, __ATOMIC_ACQUIRE);
+}
+
+static inline void *srtp_atomic_load_ptr(void *const volatile *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+#elif defined(_MSC_VER)
+static inline bool srtp_atomic_cas_u8(volatile uint8_t *p,
+                                      uint8_t expected,
+                                      uint8_t desired)
+{
+    return (uint8_t)_InterlockedCompareExchange8(
+               (volatile char *)p, (char)desired, (char)expected) == expected;
+}
+
+static inline uint8_t srtp_atomic_load_u8(const volatile uint8_t *p)
+{
+    /* aligned volatile loads are single copy atomic */
+    return *p;
+}
+
+static inline bool srtp_atomic_cas_u32(volatile uint32_t *p,
+                                       uint32_t *expected,
+                                       uint32_t desired)
+{
+    uint32_t found = (uint32_t)_InterlockedCompareExchange(
+        (volatile long *)p, (long)desired, (long)*expected);
+
+    if (found == *expected) {
+        return true;
+    }
+    *expected = found;
+    return false;
+}
+
+static inline bool srtp_atomic_cas_ptr(void *volatile *p, void *desired)
+{
+    return _InterlockedCompareExchangePointer(p, desired, NULL) == NULL;
+}
+
+static inline void *srtp_atomic_load_ptr(void *const volatile *p)
+{
+    return _InterlockedCompareExchangePointer((void *volatile *)p, NULL, NULL);
+}
+#else
+static inline bool srtp_atomic_cas_u8(volatile uint8_t *p,
+                                      uint8_t expected,
+                                      uint8_t desired)
+{
+    if (*p != expected) {
+        return false;
+    }
+    *p = desired;
+    return true;
+}
+
+static inline uint8_t srtp_atomic_load_u8(const volatile uint8_t *p)
+{
+    return *p;
+}
+
+static inline bool srtp_atomic_cas_u32(volatile uint32_t *p,
+                                       uint32_t *expected,
+                                       uint32_t desired)
+{
+    if (*p != *expected) {
+        *expected = *p;
+        return false;
+    }
+    *p = desired;
+    return true;
+}
+
+static inline bool srtp_atomic_cas_ptr(void *volatile *p, void *desired)
+{
+    if (*p != NULL) {
+        return false;
+    }
+    *p = desired;
+    return true;
+}
+
+static inline void *srtp_atomic_load_ptr(void *const volatile *p)
+{
+    return *p;
+}
+#endif
+
+/*
+ * srtp_refcount_t counts the owners of an object shared between them,
+ * srtp_refcount_release() returns true for the last owner, which then
+ * frees the object and sees all writes the other owners made to it
+ */
+typedef struct {
+    volatile long count;
+} srtp_refcount_t;
+
+#if defined(__GNUC__) || defined(__clang__)
+static inline void srtp_refcount_acquire(srtp_refcount_t *ref)
+{
+    __atomic_fetch_add(&ref->count, 1, __ATOMIC_RELAXED);
+}
+
+static inline bool srtp_refcount_release(srtp_refcount_t *ref)
+{
+    return __atomic_fetch_sub(&ref->count, 1, __ATOMIC_ACQ_REL) == 1;
+}
+
+static inline long srtp_refcount_get(const srtp_refcount_t *ref)
+{
+    return __atomic_load_n(&ref->count, __ATOMIC_ACQUIRE);
+}
+#elif defined(_MSC_VER)
+static inline void srtp_refcount_acquire(srtp_refcount_t *ref)
+{
+    _InterlockedIncrement(&ref->count);
+}
+
+static inline bool srtp_refcount_release(srtp_refcount_t *ref)
+{
+    return _InterlockedDecrement(&ref->count) == 0;
+}
+
+static inline long srtp_refcount_get(const srtp_refcount_t *ref)
+{
+    return _InterlockedOr((volatile long *)&ref->count, 0);
+}
+#else
+static inline void srtp_refcount_acquire(srtp_refcount_t *ref)
+{
+    ref->count++;
+}
+
+static inline bool srtp_refcount_release(srtp_refcount_t *ref)
+{
+    return --ref->count == 0;
+}
+
+static inline long srtp_refcount_get(const srtp_refcount_t *ref)
+{
+    return ref->count;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_ATOMICS_H */
@@ -78,6 +78,60 @@ typedef srtp_err_status_t (*srtp_auth_update_func)(void *state,
 
 typedef srtp_err_status_t (*srtp_auth_start_func)(void *state);
 
+/*
+ * a srtp_auth_clone_func allocates a new auth_t that is keyed like an
+ * initialized one, sharing none of its running hash state
+ */
+typedef srtp_err_status_t (*srtp_auth_clone_func)(const struct srtp_auth_t *a,
+                                                  srtp_auth_pointer_t *clone);
+
+/*
+ * a srtp_auth_verify_func finishes the tag over the octets hashed so far
+ * and buffer like a srtp_auth_compute_func, then compares its first
+ * tag_len octets with tag in constant time; it returns
+ * srtp_err_status_auth_fail if they differ
+ */
+typedef srtp_err_status_t (*srtp_auth_verify_func)(void *state,
+                                                   const uint8_t *buffer,
+                                                   size_t octets_to_auth,
+                                                   size_t tag_len,
+                                                   const uint8_t *tag);
+
+/*
+ * srtp_auth_job_t is a message whose tag srtp_auth_compute_jobs() computes
+ * together with those of other messages, which an auth type can do faster
+ * than one message after the other, for instance by hashing them in the
+ * lanes of vector registers. The key is copied into the job, so that the
+ * auth function it was taken from may change or go away before the tag is
+ * computed.
+ */
+#define SRTP_AUTH_JOB_MAX_SUFFIX 4
+
+typedef struct srtp_auth_job_t {
+    const struct srtp_auth_type_t *type; /* computes the tag           */
+    uint32_t key[16];                    /* the key, as type keeps it  */
+    const uint8_t *buffer;               /* the message                */
+    size_t len;                          /* octets in buffer           */
+    uint8_t suffix[SRTP_AUTH_JOB_MAX_SUFFIX]; /* authenticated after  */
+    size_t suffix_len;                        /* buffer, like the ROC */
+    uint8_t *tag;                        /* receives the tag           */
+    size_t tag_len;                      /* octets of the tag          */
+} srtp_auth_job_t;
+
+/*
+ * a srtp_auth_job_init_func copies the key of an initialized auth function
+ * into job->key
+ */
+typedef srtp_err_status_t (*srtp_auth_job_init_func)(const void *state,
+                                                     srtp_auth_job_t *job);
+
+/*
+ * a srtp_auth_compute_jobs_func computes the tags of num_jobs jobs of its
+ * type
+ */
+typedef void (*srtp_auth_compute_jobs_func)(srtp_auth_job_t *jobs,
+                                            size_t num_jobs);
+
 /* some syntactic sugar on these function types */
 #define srtp_auth_type_alloc(at, a, klen, outlen)                              \
     ((at)->alloc((a), (klen), (outlen)))
@@ -102,6 +156,57 @@ size_t srtp_auth_get_tag_length(const struct srtp_auth_t *a);
 
 size_t srtp_auth_get_prefix_length(const struct srtp_auth_t *a);
 
+/*
+ * srtp_auth_get_memory_usage(a) returns the octets allocated for a and
+ * its state through srtp_crypto_alloc(), what a crypto library allocates
+ * on its own is not included; a may be NULL
+ */
+size_t srtp_auth_get_memory_usage(const struct srtp_auth_t *a);
+
+/*
+ * srtp_auth_clone(a, clone) allocates an auth function keyed like a, which
+ * must be initialized, or returns srtp_err_status_no_such_op if the auth
+ * type does not support that
+ */
+srtp_err_status_t srtp_auth_clone(const struct srtp_auth_t *a,
+                                  struct srtp_auth_t **clone);
+
+/*
+ * srtp_auth_verify(a, buf, len, tag) finishes the tag of a over buf and
+ * checks it against the tag_len octets at tag, with the verify function
+ * of the auth type if it has one and by computing and comparing the tag
+ * otherwise; it returns srtp_err_status_auth_fail if they differ
+ */
+srtp_err_status_t srtp_auth_verify(const struct srtp_auth_t *a,
+                                   const uint8_t *buf,
+                                   size_t len,
+                                   const uint8_t *tag);
+
+/*
+ * srtp_auth_job_init(a, job) sets up job for a tag of a, leaving the
+ * message to the caller, or returns srtp_err_status_no_such_op if the auth
+ * type does not compute jobs
+ *
+ * srtp_auth_job_valid(job, a, buffer, len, suffix, suffix_len) is true if
+ * job was set up with the current key of a for that message, so that its
+ * tag is the one a computes for it
+ *
+ * srtp_auth_compute_jobs(jobs, num_jobs) computes the tags of the jobs,
+ * which may be of different types; the caller wipes their keys when it no
+ * longer needs them
+ */
+srtp_err_status_t srtp_auth_job_init(const struct srtp_auth_t *a,
+                                     srtp_auth_job_t *job);
+
+bool srtp_auth_job_valid(const srtp_auth_job_t *job,
+                         const struct srtp_auth_t *a,
+                         const uint8_t *buffer,
+                         size_t len,
+                         const uint8_t *suffix,
+                         size_t suffix_len);
+
+void srtp_auth_compute_jobs(srtp_auth_job_t *jobs, size_t num_jobs);
+
 /*
  * srtp_auth_test_case_t is a (list of) key/message/tag values that are
  * known to be correct for a particular cipher.  this data can be used
@@ -131,6 +236,10 @@ typedef struct srtp_auth_type_t {
     const char *description;
     const srtp_auth_test_case_t *test_data;
     srtp_auth_type_id_t id;
+    srtp_auth_clone_func clone;               /* optional, may be NULL */
+    srtp_auth_verify_func verify;             /* optional, may be NULL */
+    srtp_auth_job_init_func job_init;         /* optional, may be NULL */
+    srtp_auth_compute_jobs_func compute_jobs; /* with job_init         */
 } srtp_auth_type_t;
 
 typedef struct srtp_auth_t {
@@ -166,6 +275,28 @@ srtp_err_status_t srtp_auth_type_test(const srtp_auth_type_t *at,
 srtp_err_status_t srtp_replace_auth_type(const srtp_auth_type_t *ct,
                                          srtp_auth_type_id_t id);
 
+/*
+ * srtp_add_auth_type(at, id) is srtp_add_cipher_type() for auth types
+ */
+srtp_err_status_t srtp_add_auth_type(const srtp_auth_type_t *at,
+                                     srtp_auth_type_id_t id);
+
+/*
+ * srtp_get_auth_type(id) is srtp_get_cipher_type() for auth types
+ */
+const srtp_auth_type_t *srtp_get_auth_type(srtp_auth_type_id_t id);
+
+/*
+ * srtp_auth_bits_per_second(a, l, t) computes an estimate of the number
+ * of bits that an auth function, which MUST be allocated and initialized
+ * already, can authenticate in a second, from t tags over l octets each
+ *
+ * if an error is encountered, the value 0 is returned
+ */
+uint64_t srtp_auth_bits_per_second(srtp_auth_t *a,
+                                   size_t octets_in_buffer,
+                                   size_t num_trials);
+
 #ifdef __cplusplus
 }
 #endif
@@ -118,6 +118,47 @@ typedef srtp_err_status_t (*srtp_cipher_set_iv_func_t)(
     uint8_t *iv,
     srtp_cipher_direction_t direction);
 
+/*
+ * a srtp_cipher_clone_func_t allocates a new cipher_t that is keyed like an
+ * initialized one, sharing none of its per packet state, so that both can
+ * be used at the same time by different threads
+ */
+typedef srtp_err_status_t (*srtp_cipher_clone_func_t)(
+    const struct srtp_cipher_t *c,
+    srtp_cipher_pointer_t *clone);
+
+/*
+ * srtp_cipher_job_t is the keystream for a message that
+ * srtp_cipher_compute_jobs() computes together with that of other
+ * messages, which a cipher type can do faster than one message after the
+ * other, for instance by keeping the blocks of different keys in flight
+ * together. The key is referenced, not copied, so the keystream has to be
+ * computed while the cipher it was taken from is still keyed with it.
+ */
+typedef struct srtp_cipher_job_t {
+    const struct srtp_cipher_type_t *type; /* computes the keystream    */
+    const void *key;                       /* the key, as type keeps it */
+    uint8_t counter[16];                   /* the first counter block   */
+    uint8_t *keystream;                    /* receives the keystream    */
+    size_t len;                            /* octets of keystream       */
+} srtp_cipher_job_t;
+
+/*
+ * a srtp_cipher_job_init_func_t sets job->key and job->counter to those an
+ * initialized cipher would use after setting iv
+ */
+typedef srtp_err_status_t (*srtp_cipher_job_init_func_t)(
+    const void *state,
+    const uint8_t *iv,
+    srtp_cipher_job_t *job);
+
+/*
+ * a srtp_cipher_compute_jobs_func_t computes the keystream of num_jobs jobs
+ * of its type
+ */
+typedef void (*srtp_cipher_compute_jobs_func_t)(srtp_cipher_job_t *jobs,
+                                                size_t num_jobs);
+
 /*
  * srtp_cipher_test_case_t is a (list of) key, salt, plaintext, ciphertext,
  * and aad values that are known to be correct for a
@@ -152,6 +193,9 @@ typedef struct srtp_cipher_type_t {
     const char *description;
     const srtp_cipher_test_case_t *test_data;
     srtp_cipher_type_id_t id;
+    srtp_cipher_clone_func_t clone; /* optional, may be NULL */
+    srtp_cipher_job_init_func_t job_init;         /* optional, may be NULL */
+    srtp_cipher_compute_jobs_func_t compute_jobs; /* with job_init         */
 } srtp_cipher_type_t;
 
 /*
@@ -168,6 +212,13 @@ typedef struct srtp_cipher_t {
 /* some bookkeeping functions */
 size_t srtp_cipher_get_key_length(const srtp_cipher_t *c);
 
+/*
+ * srtp_cipher_get_memory_usage(c) returns the octets allocated for c and
+ * its state through srtp_crypto_alloc(), what a crypto library allocates
+ * on its own is not included; c may be NULL
+ */
+size_t srtp_cipher_get_memory_usage(const srtp_cipher_t *c);
+
 /*
  * srtp_cipher_type_self_test() tests a cipher against test cases provided in
  * an array of values of key/srtp_xtd_seq_num_t/plaintext/ciphertext
@@ -225,6 +276,37 @@ srtp_err_status_t srtp_cipher_set_aad(srtp_cipher_t *c,
                                       const uint8_t *aad,
                                       size_t aad_len);
 
+/*
+ * srtp_cipher_clone(c, clone) allocates a cipher keyed like c, which must
+ * be initialized, or returns srtp_err_status_no_such_op if the cipher type
+ * does not support that
+ */
+srtp_err_status_t srtp_cipher_clone(const srtp_cipher_t *c,
+                                    srtp_cipher_t **clone);
+
+/*
+ * srtp_cipher_job_init(c, iv, job) sets up job for the keystream c gives
+ * after setting iv, leaving the length and the buffer to the caller, or
+ * returns srtp_err_status_no_such_op if the cipher type does not compute
+ * jobs
+ *
+ * srtp_cipher_job_valid(job, c, iv, len) is true if job holds at least len
+ * octets of the keystream c gives after setting iv, with its current key
+ *
+ * srtp_cipher_compute_jobs(jobs, num_jobs) computes the keystream of the
+ * jobs, which may be of different types
+ */
+srtp_err_status_t srtp_cipher_job_init(const srtp_cipher_t *c,
+                                       const uint8_t *iv,
+                                       srtp_cipher_job_t *job);
+
+bool srtp_cipher_job_valid(const srtp_cipher_job_t *job,
+                           const srtp_cipher_t *c,
+                           const uint8_t *iv,
+                           size_t len);
+
+void srtp_cipher_compute_jobs(srtp_cipher_job_t *jobs, size_t num_jobs);
+
 /*
  * srtp_replace_cipher_type(ct, id)
  *
@@ -235,6 +317,24 @@ srtp_err_status_t srtp_cipher_set_aad(srtp_cipher_t *c,
 srtp_err_status_t srtp_replace_cipher_type(const srtp_cipher_type_t *ct,
                                            srtp_cipher_type_id_t id);
 
+/*
+ * srtp_add_cipher_type(ct, id)
+ *
+ * adds ct as another implementation of the cipher_type id, which
+ * srtp_calibrate_crypto() puts in use if it is the fastest. It must pass the
+ * same self tests as srtp_replace_cipher_type() requires.
+ */
+srtp_err_status_t srtp_add_cipher_type(const srtp_cipher_type_t *ct,
+                                       srtp_cipher_type_id_t id);
+
+/*
+ * srtp_get_cipher_type(id)
+ *
+ * returns the implementation of the cipher_type id that is in use, or
+ * NULL if there is none
+ */
+const srtp_cipher_type_t *srtp_get_cipher_type(srtp_cipher_type_id_t id);
+
 #ifdef __cplusplus
 }
 #endif
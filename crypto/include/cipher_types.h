@@ -46,12 +46,18 @@
 
 extern const srtp_cipher_type_t srtp_null_cipher;
 extern const srtp_cipher_type_t srtp_aes_icm_128;
+#ifndef SRTP_NO_AES_256
 extern const srtp_cipher_type_t srtp_aes_icm_256;
+#endif
 #ifdef GCM
+#ifndef SRTP_NO_AES_192
 extern const srtp_cipher_type_t srtp_aes_icm_192;
+#endif
 extern const srtp_cipher_type_t srtp_aes_gcm_128;
+#ifndef SRTP_NO_AES_256
 extern const srtp_cipher_type_t srtp_aes_gcm_256;
 #endif
+#endif
 
 /*
  * auth func types that can be included in the kernel
@@ -71,7 +77,7 @@ extern srtp_debug_module_t srtp_mod_alloc;
 /* debug modules for cipher types */
 extern srtp_debug_module_t srtp_mod_aes_icm;
 
-#if defined(OPENSSL) || defined(WOLFSSL) || defined(MBEDTLS) || defined(NSS)
+#ifdef GCM
 extern srtp_debug_module_t srtp_mod_aes_gcm;
 #endif
 
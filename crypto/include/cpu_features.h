@@ -0,0 +1,100 @@
+/*
+ * cpu_features.h
+ *
+ * run time detection of the cpu instructions used by the internal
+ * crypto implementations
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_CPU_FEATURES_H
+#define SRTP_CPU_FEATURES_H
+
+#include "datatypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * the features srtp_cpu_features() reports, the same bits are used for the
+ * equivalent x86 and aarch64 instructions
+ */
+#define SRTP_CPU_SSE2 (1u << 0)   /* x86 SSE2                          */
+#define SRTP_CPU_SSSE3 (1u << 1)  /* x86 SSSE3, for byte shuffles      */
+#define SRTP_CPU_SSE41 (1u << 2)  /* x86 SSE4.1                        */
+#define SRTP_CPU_AES (1u << 3)    /* AES-NI, or the ARMv8 AES insns    */
+#define SRTP_CPU_CLMUL (1u << 4)  /* PCLMULQDQ, or ARMv8 PMULL         */
+#define SRTP_CPU_SHA1 (1u << 5)   /* SHA-NI, or the ARMv8 SHA1 insns   */
+#define SRTP_CPU_AVX2 (1u << 6)   /* x86 AVX2, with OS support         */
+#define SRTP_CPU_AVX512 (1u << 7) /* x86 AVX-512F, with OS support     */
+
+/*
+ * srtp_cpu_features_init() probes the cpu, it is called by
+ * srtp_crypto_kernel_init(). Only the first call has any effect, so that
+ * the result never changes while keys prepared for it are in use.
+ *
+ * The environment variable SRTP_CPU_FEATURES, if set, restricts the
+ * features that are used. It is a comma separated list processed in
+ * order: "none" disables all features, "all" enables all of them, a
+ * feature name (sse2, ssse3, sse4.1, aes, clmul, sha1, avx2, avx512)
+ * enables that feature and the name preceded by '-' disables it. Features
+ * the cpu does not have are never enabled. For example "none,aes" only
+ * uses the AES instructions and "-sha1" uses everything except the SHA-1
+ * instructions.
+ */
+void srtp_cpu_features_init(void);
+
+/*
+ * srtp_cpu_features() returns the features that can be used, probing the
+ * cpu if that was not done yet
+ */
+uint32_t srtp_cpu_features(void);
+
+/*
+ * srtp_cpu_has(features) is true if all of features can be used
+ */
+static inline bool srtp_cpu_has(uint32_t features)
+{
+    return (srtp_cpu_features() & features) == features;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_CPU_FEATURES_H */
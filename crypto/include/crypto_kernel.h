@@ -50,6 +50,7 @@
 #include "err.h"
 #include "crypto_types.h"
 #include "key.h"
+#include "atomics.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,20 +68,34 @@ typedef enum {
 } srtp_crypto_kernel_state_t;
 
 /*
- * linked list of cipher types
+ * number of implementations of one cipher or auth type that
+ * srtp_crypto_kernel_calibrate() chooses between
+ */
+#define SRTP_KERNEL_MAX_CANDIDATES 4
+
+/*
+ * linked list of cipher types, cipher_type is the implementation in use
+ * and one of the candidates
  */
 typedef struct srtp_kernel_cipher_type {
     srtp_cipher_type_id_t id;
     const srtp_cipher_type_t *cipher_type;
+    bool tested; /* passed its self-test since it was loaded */
+    const srtp_cipher_type_t *candidates[SRTP_KERNEL_MAX_CANDIDATES];
+    size_t num_candidates;
     struct srtp_kernel_cipher_type *next;
 } srtp_kernel_cipher_type_t;
 
 /*
- * linked list of auth types
+ * linked list of auth types, auth_type is the implementation in use and
+ * one of the candidates
  */
 typedef struct srtp_kernel_auth_type {
     srtp_auth_type_id_t id;
     const srtp_auth_type_t *auth_type;
+    bool tested; /* passed its self-test since it was loaded */
+    const srtp_auth_type_t *candidates[SRTP_KERNEL_MAX_CANDIDATES];
+    size_t num_candidates;
     struct srtp_kernel_auth_type *next;
 } srtp_kernel_auth_type_t;
 
@@ -104,6 +119,8 @@ typedef struct {
     srtp_kernel_auth_type_t *auth_type_list; /* list of all auth func types */
     srtp_kernel_debug_module_t
         *debug_module_list; /* list of all debug modules   */
+    bool lazy_self_tests;   /* test types on first alloc   */
+    srtp_spinlock_t self_test_lock; /* serializes lazy self-tests */
 } srtp_crypto_kernel_t;
 
 /*
@@ -123,6 +140,16 @@ typedef struct {
  */
 srtp_err_status_t srtp_crypto_kernel_init(void);
 
+/*
+ * srtp_crypto_kernel_init_ex(lazy_self_tests) is srtp_crypto_kernel_init(),
+ * except that if lazy_self_tests is set the cipher and auth types are
+ * loaded without running their self-tests. Each type is then tested the
+ * first time it is allocated, and the allocation fails if it does not pass.
+ * Initializing a kernel that is already secure with lazy_self_tests set
+ * does not run any tests.
+ */
+srtp_err_status_t srtp_crypto_kernel_init_ex(bool lazy_self_tests);
+
 /*
  * The function srtp_crypto_kernel_shutdown() de-initializes the
  * crypto_kernel, zeroizes keys and other cryptographic material, and
@@ -166,6 +193,13 @@ srtp_err_status_t srtp_crypto_kernel_load_auth_type(const srtp_auth_type_t *ct,
 srtp_err_status_t srtp_crypto_kernel_load_debug_module(
     srtp_debug_module_t *new_dm);
 
+/*
+ * srtp_crypto_kernel_calibrate() times each candidate implementation of
+ * every cipher and auth type that has more than one, and puts the fastest
+ * of those that pass their self-tests in use
+ */
+srtp_err_status_t srtp_crypto_kernel_calibrate(void);
+
 /*
  * srtp_crypto_kernel_alloc_cipher(id, cp, key_len);
  *
@@ -164,6 +164,58 @@ typedef struct {
 
 #endif
 
+/*
+ * debug_trace0(), debug_trace() and debug_trace2() are the debug_print()s
+ * of the packet path; they are compiled out, without evaluating their
+ * arguments, unless ENABLE_PACKET_TRACE is defined
+ *
+ * when enabled they report only while their module is on, and then only
+ * every SRTP_PACKET_TRACE_INTERVAL th time each trace point is reached,
+ * so that a trace of a busy session stays usable and hex strings are not
+ * formatted for every packet
+ */
+#ifdef ENABLE_PACKET_TRACE
+
+#ifndef SRTP_PACKET_TRACE_INTERVAL
+#define SRTP_PACKET_TRACE_INTERVAL 1024
+#endif
+
+/*
+ * srtp_debug_trace_sample(count) advances the counter of a trace point
+ * and returns true if the trace point should report
+ */
+bool srtp_debug_trace_sample(size_t *count);
+
+#define debug_trace_if(mod)                                                    \
+    static size_t srtp_trace_count = 0;                                        \
+    if (mod.on && srtp_debug_trace_sample(&srtp_trace_count))
+
+#else
+
+#define debug_trace_if(mod) if (0)
+
+#endif
+
+#define debug_trace0(mod, format)                                              \
+    do {                                                                       \
+        debug_trace_if(mod) srtp_err_report(srtp_err_level_debug,              \
+                                            ("%s: " format "\n"), mod.name);   \
+    } while (0)
+
+#define debug_trace(mod, format, arg)                                          \
+    do {                                                                       \
+        debug_trace_if(mod)                                                    \
+            srtp_err_report(srtp_err_level_debug, ("%s: " format "\n"),        \
+                            mod.name, arg);                                    \
+    } while (0)
+
+#define debug_trace2(mod, format, arg1, arg2)                                  \
+    do {                                                                       \
+        debug_trace_if(mod)                                                    \
+            srtp_err_report(srtp_err_level_debug, ("%s: " format "\n"),        \
+                            mod.name, arg1, arg2);                             \
+    } while (0)
+
 #ifdef __cplusplus
 }
 #endif
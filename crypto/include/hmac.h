@@ -49,10 +49,20 @@
 #include "auth.h"
 #include "sha1.h"
 
+/*
+ * srtp_hmac_key_t holds the keyed midstates, which are only read once the
+ * key is set; they are held in the key store, shared with every context
+ * keyed with the same key. ctx is the running hash of the message being
+ * authenticated
+ */
+typedef struct {
+    uint32_t inner_H[5]; /* sha1 state after hashing ipad ^ key */
+    uint32_t outer_H[5]; /* sha1 state after hashing opad ^ key */
+} srtp_hmac_key_t;
+
 typedef struct {
-    uint8_t opad[64];
+    const srtp_hmac_key_t *key;
     srtp_sha1_ctx_t ctx;
-    srtp_sha1_ctx_t init_ctx;
 } srtp_hmac_ctx_t;
 
 #endif /* HMAC_H */
@@ -0,0 +1,115 @@
+/*
+ * key_store.h
+ *
+ * reference counted store of expanded keys, shared by the cipher and
+ * auth contexts that are keyed with the same key
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_KEY_STORE_H
+#define SRTP_KEY_STORE_H
+
+#include "datatypes.h"
+#include "err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * srtp_key_store_expand_func_t expands key, of key_len octets, into the
+ * zeroed buffer expanded; the function also identifies the kind of
+ * expansion, so that the same key expanded for different algorithms gives
+ * separate entries
+ */
+typedef srtp_err_status_t (*srtp_key_store_expand_func_t)(const uint8_t *key,
+                                                          size_t key_len,
+                                                          void *expanded);
+
+/*
+ * the longest key that can be stored
+ */
+#define SRTP_KEY_STORE_MAX_KEY_LEN 32
+
+/*
+ * srtp_key_store_acquire(expand, key, key_len, expanded_len, expanded)
+ * sets *expanded to the expansion of key by expand, of expanded_len
+ * octets. If a context holds the same expansion of the same key already,
+ * that one is returned, else a new one is made. The expansion is cache
+ * line aligned and must not be written to.
+ *
+ * Each successful call must be matched by a call to
+ * srtp_key_store_release(). The store is safe to use from several threads
+ * when SRTP_HAVE_ATOMICS is set.
+ */
+srtp_err_status_t srtp_key_store_acquire(srtp_key_store_expand_func_t expand,
+                                         const uint8_t *key,
+                                         size_t key_len,
+                                         size_t expanded_len,
+                                         const void **expanded);
+
+/*
+ * srtp_key_store_retain(expanded) adds a reference to an expansion
+ * returned by srtp_key_store_acquire(), for a context cloned from the one
+ * that holds it
+ */
+void srtp_key_store_retain(const void *expanded);
+
+/*
+ * srtp_key_store_release(expanded) drops a reference to an expansion, the
+ * last one zeroizes and frees it; expanded may be NULL
+ */
+void srtp_key_store_release(const void *expanded);
+
+/*
+ * srtp_key_store_count() returns the number of distinct expansions held
+ */
+size_t srtp_key_store_count(void);
+
+/*
+ * srtp_key_store_shared_count() returns the number of references held on
+ * expansions in the region set with srtp_shared_key_region_create() or
+ * srtp_shared_key_region_attach()
+ */
+size_t srtp_key_store_shared_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_KEY_STORE_H */
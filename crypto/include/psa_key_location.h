@@ -0,0 +1,76 @@
+/*
+ * psa_key_location.h
+ *
+ * placement of the keys of the mbedtls backend in a PSA crypto driver
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_PSA_KEY_LOCATION_H
+#define SRTP_PSA_KEY_LOCATION_H
+
+#include <psa/crypto.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * srtp_psa_set_key_location(attr) makes the keys created with attr
+ * volatile keys in the location SRTP_PSA_KEY_LOCATION, when the build
+ * defines it, so that the operations on them are dispatched to the
+ * opaque PSA driver of that location, such as a hardware AES engine
+ *
+ * without it keys are in the local location, where a transparent driver,
+ * if one is registered, or the mbedtls software takes the operations
+ */
+static inline void srtp_psa_set_key_location(psa_key_attributes_t *attr)
+{
+#ifdef SRTP_PSA_KEY_LOCATION
+    psa_set_key_lifetime(attr, PSA_KEY_LIFETIME_FROM_PERSISTENCE_AND_LOCATION(
+                                   PSA_KEY_PERSISTENCE_VOLATILE,
+                                   SRTP_PSA_KEY_LOCATION));
+#else
+    (void)attr;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_PSA_KEY_LOCATION_H */
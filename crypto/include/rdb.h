@@ -46,31 +46,49 @@
 #ifndef REPLAY_DB_H
 #define REPLAY_DB_H
 
-#include "datatypes.h" /* for v128_t       */
-#include "err.h"       /* for srtp_err_status_t */
+#include "datatypes.h"
+#include "err.h"           /* for srtp_err_status_t */
+#include "replay_window.h" /* for srtp_replay_window_t */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /*
- * if the ith least significant bit is one, then the packet index
- * window_end-i is in the database
+ * SRTP_RDB_DEFAULT_WINDOW_SIZE is the window used when a policy does not
+ * set one, SRTP_RDB_MAX_WINDOW_SIZE the largest window an srtp_rdb_t can
+ * hold; the bitmask is kept inside the srtp_rdb_t so that it can be
+ * copied by value
+ */
+#define SRTP_RDB_DEFAULT_WINDOW_SIZE 128
+#define SRTP_RDB_MAX_WINDOW_SIZE 1024
+
+/*
+ * the packet index window_start is the oldest bit of the window and
+ * window_start + window.length - 1 the newest
  */
 
 typedef struct {
-    uint32_t window_start; /* packet index of the first bit in bitmask */
-    v128_t bitmask;
+    uint32_t window_start; /* packet index of the oldest bit in bitmask */
+    srtp_replay_window_t window;
+    uint64_t bitmask[SRTP_REPLAY_WINDOW_WORDS(SRTP_RDB_MAX_WINDOW_SIZE)];
 } srtp_rdb_t;
 
 /*
  * srtp_rdb_init
  *
- * initalizes rdb
+ * initalizes rdb with a window of ws packets, rounded up to a multiple
+ * of 64
  *
- * returns srtp_err_status_ok on success, srtp_err_status_t_fail otherwise
+ * returns srtp_err_status_ok on success, srtp_err_status_bad_param if
+ * ws is zero or more than SRTP_RDB_MAX_WINDOW_SIZE
  */
-srtp_err_status_t srtp_rdb_init(srtp_rdb_t *rdb);
+srtp_err_status_t srtp_rdb_init(srtp_rdb_t *rdb, size_t ws);
+
+/*
+ * srtp_rdb_get_window_size(rdb) returns the window size of rdb
+ */
+size_t srtp_rdb_get_window_size(const srtp_rdb_t *rdb);
 
 /*
  * srtp_rdb_check
@@ -93,9 +111,10 @@ srtp_err_status_t srtp_rdb_check(const srtp_rdb_t *rdb, uint32_t rdb_index);
 srtp_err_status_t srtp_rdb_add_index(srtp_rdb_t *rdb, uint32_t rdb_index);
 
 /*
- * the functions srtp_rdb_increment() and srtp_rdb_get_value() are for use by
- * senders, not receivers - DO NOT use these functions on the same
- * srtp_rdb_t upon which srtp_rdb_add_index is used!
+ * the functions srtp_rdb_increment(), srtp_rdb_next_value() and
+ * srtp_rdb_get_value() are for use by senders, not receivers - DO NOT use
+ * these functions on the same srtp_rdb_t upon which srtp_rdb_add_index is
+ * used!
  */
 
 /*
@@ -110,6 +129,13 @@ srtp_err_status_t srtp_rdb_add_index(srtp_rdb_t *rdb, uint32_t rdb_index);
  */
 srtp_err_status_t srtp_rdb_increment(srtp_rdb_t *rdb);
 
+/*
+ * srtp_rdb_next_value(db, value) is srtp_rdb_increment() that also sets
+ * value to the sequence number it incremented to; it is lock-free, so
+ * concurrent callers each get a sequence number of their own
+ */
+srtp_err_status_t srtp_rdb_next_value(srtp_rdb_t *rdb, uint32_t *value);
+
 /*
  * srtp_rdb_get_value(db) returns the current sequence number of db
  */
@@ -49,6 +49,7 @@
 
 #include "datatypes.h"
 #include "err.h"
+#include "replay_window.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -79,13 +80,42 @@ typedef uint64_t srtp_xtd_seq_num_t;
 
 /*
  * An srtp_rdbx_t is a replay database with extended range; it uses an
- * xtd_seq_num_t and a bitmask of recently received indices.
+ * xtd_seq_num_t and a bitmask of recently received indices, kept as an
+ * srtp_replay_window_t whose newest bit stands for index.
+ *
+ * The window keeps the size it was initialized with unless a larger
+ * maximum is set with srtp_rdbx_set_max_window_size(); it then grows
+ * into memory of its own when accepted packets arrive reordered by half
+ * of it or more, and shrinks back after SRTP_RDBX_ADAPT_PERIOD indices
+ * in which they stayed within a quarter of it.
  */
 typedef struct {
     srtp_xtd_seq_num_t index;
-    bitvector_t bitmask;
+    srtp_replay_window_t window;
+    uint64_t *bitmask;
+    bool owns_bitmask;      /* of base_bitmask, false for _init_in()  */
+    uint64_t *base_bitmask; /* window memory of the initial size      */
+    size_t base_length;     /* initial window size, a multiple of 64  */
+    size_t max_length;      /* largest window size, >= base_length    */
+    size_t depth;           /* deepest reordering in this period      */
+    size_t period;          /* indices the window moved this period   */
 } srtp_rdbx_t;
 
+/*
+ * SRTP_RDBX_SENDER_WINDOW_SIZE is the window size given to streams that
+ * only send; a sender just has to catch reuse of its own recent indices,
+ * for which a single word of window is enough
+ */
+#define SRTP_RDBX_SENDER_WINDOW_SIZE 64
+
+/*
+ * SRTP_RDBX_ADAPTIVE_WINDOW_SIZE is the window size a stream whose window
+ * adapts starts with, and SRTP_RDBX_ADAPT_PERIOD the number of indices
+ * after which a grown window may shrink again
+ */
+#define SRTP_RDBX_ADAPTIVE_WINDOW_SIZE 128
+#define SRTP_RDBX_ADAPT_PERIOD 4096
+
 /*
  * srtp_rdbx_init(rdbx_ptr, ws)
  *
@@ -94,6 +124,52 @@ typedef struct {
  */
 srtp_err_status_t srtp_rdbx_init(srtp_rdbx_t *rdbx, size_t ws);
 
+/*
+ * srtp_rdbx_init_in(rdbx_ptr, ws, bitmask)
+ *
+ * like srtp_rdbx_init(), but keeps the window in the memory at
+ * bitmask, which must hold SRTP_REPLAY_WINDOW_WORDS(ws) words and is not
+ * freed by srtp_rdbx_dealloc()
+ */
+srtp_err_status_t srtp_rdbx_init_in(srtp_rdbx_t *rdbx,
+                                    size_t ws,
+                                    uint64_t *bitmask);
+
+/*
+ * srtp_rdbx_reset(rdbx_ptr)
+ *
+ * clears the replay window and index of an initialized rdbx without
+ * reallocating it, a window that has grown returns to its initial size
+ */
+void srtp_rdbx_reset(srtp_rdbx_t *rdbx);
+
+/*
+ * srtp_rdbx_set_max_window_size(rdbx_ptr, max_ws)
+ *
+ * lets the window of an initialized rdbx adapt between its initial size
+ * and max_ws, rounded up to a multiple of 64; max_ws equal to the initial
+ * size keeps it fixed
+ */
+srtp_err_status_t srtp_rdbx_set_max_window_size(srtp_rdbx_t *rdbx,
+                                                size_t max_ws);
+
+/*
+ * srtp_rdbx_get_max_window_size(rdbx_ptr)
+ *
+ * gets the largest window size the rdbx can grow to
+ */
+size_t srtp_rdbx_get_max_window_size(const srtp_rdbx_t *rdbx);
+
+/*
+ * srtp_rdbx_resize(rdbx_ptr, ws)
+ *
+ * changes the current window of the rdbx to ws bits, a multiple of 64
+ * between its initial and maximum sizes.  The indices still covered keep
+ * their state, those a larger window newly covers count as received, as
+ * whether they were is no longer known.
+ */
+srtp_err_status_t srtp_rdbx_resize(srtp_rdbx_t *rdbx, size_t ws);
+
 /*
  * srtp_rdbx_dealloc(rdbx_ptr)
  *
@@ -113,6 +189,19 @@ ssize_t srtp_rdbx_estimate_index(const srtp_rdbx_t *rdbx,
                                  srtp_xtd_seq_num_t *guess,
                                  srtp_sequence_number_t s);
 
+/*
+ * srtp_rdbx_estimate_indices(rdbx, s, num, guess, delta)
+ *
+ * is srtp_rdbx_estimate_index() for the num sequence numbers s[i] of a run
+ * of packets of the same stream, setting guess[i] and delta[i]; it is
+ * branch free within the run so that compilers can vectorize it
+ */
+void srtp_rdbx_estimate_indices(const srtp_rdbx_t *rdbx,
+                                const srtp_sequence_number_t *s,
+                                size_t num,
+                                srtp_xtd_seq_num_t *guess,
+                                ssize_t *delta);
+
 /*
  * srtp_rdbx_check(rdbx, delta);
  *
@@ -164,6 +253,14 @@ srtp_xtd_seq_num_t srtp_rdbx_get_packet_index(const srtp_rdbx_t *rdbx);
  */
 size_t srtp_rdbx_get_window_size(const srtp_rdbx_t *rdbx);
 
+/*
+ * srtp_rdbx_get_current_window_size(rdbx_ptr)
+ *
+ * gets the window size in use, which differs from the initial one while
+ * an adaptive window has grown
+ */
+size_t srtp_rdbx_get_current_window_size(const srtp_rdbx_t *rdbx);
+
 /* index_init(&pi) initializes a packet index pi (sets it to zero) */
 void srtp_index_init(srtp_xtd_seq_num_t *pi);
 
@@ -0,0 +1,123 @@
+/*
+ * replay_window.h
+ *
+ * a circular bitmask of recently received packet indices, shared by the
+ * SRTP and SRTCP replay databases
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_REPLAY_WINDOW_H
+#define SRTP_REPLAY_WINDOW_H
+
+#include "datatypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * an srtp_replay_window_t describes a window of length bits kept in an
+ * array of 64-bit words that is owned by the replay database using it
+ *
+ * head is the bit of the newest index in the window, the bit age places
+ * before it (wrapping around the end of the array) holds the index that
+ * is age less; moving the window forward only clears the bits passed
+ * over, so the cost does not depend on the window size
+ */
+typedef struct {
+    size_t length; /* number of bits, a multiple of 64 */
+    size_t head;   /* bit that holds the newest index  */
+} srtp_replay_window_t;
+
+/* number of words needed for a window of at least ws bits */
+#define SRTP_REPLAY_WINDOW_WORDS(ws) (((ws) + 63) / 64)
+
+/*
+ * srtp_replay_window_init(w, word, ws) sets up w for a window of ws bits
+ * rounded up to a multiple of 64, word must have room for
+ * SRTP_REPLAY_WINDOW_WORDS(ws) words and is cleared
+ */
+void srtp_replay_window_init(srtp_replay_window_t *w,
+                             uint64_t *word,
+                             size_t ws);
+
+/* srtp_replay_window_clear(w, word) marks every index as not received */
+void srtp_replay_window_clear(const srtp_replay_window_t *w, uint64_t *word);
+
+/*
+ * srtp_replay_window_advance(w, word, n) moves the newest index forward
+ * by n > 0, clearing the bits of the indices skipped over, and marks the
+ * new newest index as received
+ */
+void srtp_replay_window_advance(srtp_replay_window_t *w,
+                                uint64_t *word,
+                                size_t n);
+
+/* bit of the index age places before the newest, for age < length */
+static inline size_t srtp_replay_window_bit(const srtp_replay_window_t *w,
+                                            size_t age)
+{
+    return age <= w->head ? w->head - age : w->head + w->length - age;
+}
+
+/* srtp_replay_window_test(w, word, age) returns true if seen */
+static inline bool srtp_replay_window_test(const srtp_replay_window_t *w,
+                                           const uint64_t *word,
+                                           size_t age)
+{
+    size_t bit = srtp_replay_window_bit(w, age);
+
+    return ((word[bit >> 6] >> (bit & 63)) & 1) != 0;
+}
+
+/* srtp_replay_window_set(w, word, age) marks an index as received */
+static inline void srtp_replay_window_set(const srtp_replay_window_t *w,
+                                          uint64_t *word,
+                                          size_t age)
+{
+    size_t bit = srtp_replay_window_bit(w, age);
+
+    word[bit >> 6] |= (uint64_t)1 << (bit & 63);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_REPLAY_WINDOW_H */
@@ -77,12 +77,38 @@ typedef struct {
  */
 void srtp_sha1_init(srtp_sha1_ctx_t *ctx);
 
+/*
+ * srtp_sha1_init_midstate(&ctx, H, num_blocks) initializes the SHA1
+ * context ctx to continue a message of which num_blocks 64 octet blocks
+ * have already been hashed, resulting in the state vector H
+ */
+void srtp_sha1_init_midstate(srtp_sha1_ctx_t *ctx,
+                             const uint32_t H[5],
+                             size_t num_blocks);
+
 void srtp_sha1_update(srtp_sha1_ctx_t *ctx,
                       const uint8_t *M,
                       size_t octets_in_msg);
 
 void srtp_sha1_final(srtp_sha1_ctx_t *ctx, uint32_t output[5]);
 
+/*
+ * srtp_sha1_core_lanes(H, blocks, num_lanes) runs the compression function
+ * over the 64 octet block blocks[i] for the state vector H[i] (in host
+ * byte order) of each of num_lanes independent messages, hashing as many
+ * of them at once as the cpu allows
+ *
+ * srtp_sha1_lanes() returns how many that is, 1 when the messages are
+ * better hashed one after the other
+ */
+#define SRTP_SHA1_MAX_LANES 16
+
+void srtp_sha1_core_lanes(uint32_t H[][5],
+                          const uint8_t *const blocks[],
+                          size_t num_lanes);
+
+size_t srtp_sha1_lanes(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,9 +47,11 @@
 #endif
 
 #include "alloc.h"
+#include "atomics.h"
 #include "crypto_kernel.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 /* the debug module for memory allocation */
 
@@ -58,6 +60,143 @@ srtp_debug_module_t srtp_mod_alloc = {
     "alloc" /* printable name for module   */
 };
 
+/*
+ * every allocation is preceded by a header recording the block returned
+ * by the allocator, which may start before the header if padding was
+ * needed for alignment, and the size asked for by the caller
+ */
+typedef struct {
+    void *block;
+    size_t size;
+} srtp_alloc_header_t;
+
+/*
+ * all allocations are at least aligned for v128_t and the header
+ */
+#define SRTP_DEFAULT_ALIGNMENT 16
+
+static void *srtp_default_alloc_func(size_t size, void *data)
+{
+    (void)data;
+    return malloc(size);
+}
+
+static void srtp_default_free_func(void *ptr, void *data)
+{
+    (void)data;
+    free(ptr);
+}
+
+static srtp_alloc_func_t *srtp_alloc_func = srtp_default_alloc_func;
+static srtp_node_alloc_func_t *srtp_node_alloc_func = NULL;
+static srtp_free_func_t *srtp_free_func = srtp_default_free_func;
+static void *srtp_alloc_data = NULL;
+
+/*
+ * the NUMA node that the allocations of a thread are made on, which the
+ * session functions set for the duration of a call
+ */
+#if defined(_MSC_VER)
+#define SRTP_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define SRTP_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&              \
+    !defined(__STDC_NO_THREADS__)
+#define SRTP_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef SRTP_THREAD_LOCAL
+static SRTP_THREAD_LOCAL int srtp_alloc_node = SRTP_NUMA_NODE_ANY;
+
+int srtp_crypto_alloc_set_node(int node)
+{
+    int previous = srtp_alloc_node;
+
+    srtp_alloc_node = node;
+    return previous;
+}
+#else
+static const int srtp_alloc_node = SRTP_NUMA_NODE_ANY;
+
+int srtp_crypto_alloc_set_node(int node)
+{
+    (void)node;
+    return SRTP_NUMA_NODE_ANY;
+}
+#endif
+
+static size_t srtp_alloc_live_bytes = 0;
+static size_t srtp_alloc_live_allocations = 0;
+static size_t srtp_alloc_total_allocations = 0;
+
+srtp_err_status_t srtp_install_allocator(srtp_alloc_func_t alloc_func,
+                                         srtp_free_func_t free_func,
+                                         void *data)
+{
+    if ((alloc_func == NULL) != (free_func == NULL)) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* memory from the old allocator can not be returned to the new one */
+    if (srtp_atomic_get(srtp_alloc_live_allocations) != 0) {
+        return srtp_err_status_fail;
+    }
+
+    if (alloc_func == NULL) {
+        srtp_alloc_func = srtp_default_alloc_func;
+        srtp_free_func = srtp_default_free_func;
+        srtp_alloc_data = NULL;
+    } else {
+        srtp_alloc_func = alloc_func;
+        srtp_free_func = free_func;
+        srtp_alloc_data = data;
+    }
+    srtp_node_alloc_func = NULL;
+    srtp_alloc_total_allocations = 0;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_install_node_allocator(srtp_node_alloc_func_t alloc_func,
+                                              srtp_free_func_t free_func,
+                                              void *data)
+{
+    srtp_err_status_t status;
+
+    if ((alloc_func == NULL) != (free_func == NULL)) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* start from the default allocator, with the checks that entails */
+    status = srtp_install_allocator(NULL, NULL, NULL);
+    if (status) {
+        return status;
+    }
+
+    if (alloc_func != NULL) {
+        srtp_node_alloc_func = alloc_func;
+        srtp_free_func = free_func;
+        srtp_alloc_data = data;
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_get_alloc_stats(srtp_alloc_stats_t *stats)
+{
+    if (stats == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stats->live_bytes = srtp_atomic_get(srtp_alloc_live_bytes);
+    stats->live_allocations =
+        srtp_atomic_get(srtp_alloc_live_allocations);
+    stats->total_allocations =
+        srtp_atomic_get(srtp_alloc_total_allocations);
+
+    return srtp_err_status_ok;
+}
+
 /*
  * Nota bene: the debugging statements for srtp_crypto_alloc() and
  * srtp_crypto_free() have identical prefixes, which include the addresses
@@ -67,29 +206,93 @@ srtp_debug_module_t srtp_mod_alloc = {
  * address.
  */
 
-void *srtp_crypto_alloc(size_t size)
+void *srtp_crypto_alloc_aligned(size_t size, size_t alignment)
 {
-    void *ptr;
+    uint8_t *block;
+    uint8_t *ptr;
+    srtp_alloc_header_t header;
+    size_t padding;
 
     if (!size) {
         return NULL;
     }
 
-    ptr = calloc(1, size);
+    if (alignment < SRTP_DEFAULT_ALIGNMENT) {
+        alignment = SRTP_DEFAULT_ALIGNMENT;
+    }
+
+    if ((alignment & (alignment - 1)) != 0 ||
+        size > SIZE_MAX - sizeof(header) - (alignment - 1)) {
+        debug_print(srtp_mod_alloc, "allocation failed (asked for %zu bytes)\n",
+                    size);
+        return NULL;
+    }
 
-    if (ptr) {
-        debug_print(srtp_mod_alloc, "(location: %p) allocated", ptr);
+    if (srtp_node_alloc_func != NULL) {
+        block = (uint8_t *)srtp_node_alloc_func(
+            size + sizeof(header) + (alignment - 1), srtp_alloc_node,
+            srtp_alloc_data);
     } else {
+        block = (uint8_t *)srtp_alloc_func(
+            size + sizeof(header) + (alignment - 1), srtp_alloc_data);
+    }
+    if (block == NULL) {
         debug_print(srtp_mod_alloc, "allocation failed (asked for %zu bytes)\n",
                     size);
+        return NULL;
     }
 
+    padding = (alignment - ((uintptr_t)(block + sizeof(header)) &
+                            (alignment - 1))) &
+              (alignment - 1);
+    ptr = block + sizeof(header) + padding;
+
+    header.block = block;
+    header.size = size;
+    memcpy(ptr - sizeof(header), &header, sizeof(header));
+    memset(ptr, 0, size);
+
+    srtp_atomic_add(srtp_alloc_live_bytes, size);
+    srtp_atomic_add(srtp_alloc_live_allocations, 1);
+    srtp_atomic_add(srtp_alloc_total_allocations, 1);
+
+    debug_print(srtp_mod_alloc, "(location: %p) allocated", (void *)ptr);
+
     return ptr;
 }
 
+void *srtp_crypto_alloc(size_t size)
+{
+    return srtp_crypto_alloc_aligned(size, SRTP_DEFAULT_ALIGNMENT);
+}
+
 void srtp_crypto_free(void *ptr)
 {
+    srtp_alloc_header_t header;
+
     debug_print(srtp_mod_alloc, "(location: %p) freed", ptr);
 
-    free(ptr);
+    if (ptr == NULL) {
+        return;
+    }
+
+    memcpy(&header, (uint8_t *)ptr - sizeof(header), sizeof(header));
+
+    srtp_atomic_sub(srtp_alloc_live_bytes, header.size);
+    srtp_atomic_sub(srtp_alloc_live_allocations, 1);
+
+    srtp_free_func(header.block, srtp_alloc_data);
+}
+
+size_t srtp_crypto_alloc_size(const void *ptr)
+{
+    srtp_alloc_header_t header;
+
+    if (ptr == NULL) {
+        return 0;
+    }
+
+    memcpy(&header, (const uint8_t *)ptr - sizeof(header), sizeof(header));
+
+    return header.size;
 }
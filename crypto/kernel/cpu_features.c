@@ -0,0 +1,256 @@
+/*
+ * cpu_features.c
+ *
+ * run time detection of the cpu instructions used by the internal
+ * crypto implementations
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "cpu_features.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define SRTP_CPU_X86 1
+#include <cpuid.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SRTP_CPU_X86 1
+#include <intrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#define SRTP_CPU_ARMV8_HWCAP 1
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static const struct {
+    const char *name;
+    uint32_t feature;
+} srtp_cpu_feature_names[] = {
+    { "sse2", SRTP_CPU_SSE2 }, { "ssse3", SRTP_CPU_SSSE3 },
+    { "sse4.1", SRTP_CPU_SSE41 }, { "aes", SRTP_CPU_AES },
+    { "clmul", SRTP_CPU_CLMUL }, { "sha1", SRTP_CPU_SHA1 },
+    { "avx2", SRTP_CPU_AVX2 },   { "avx512", SRTP_CPU_AVX512 },
+};
+
+/*
+ * the result of the probe is stored with SRTP_CPU_PROBED in a single
+ * word, which is either zero or the final value, so a race between
+ * threads doing the first call is harmless
+ */
+#define SRTP_CPU_PROBED (1u << 31)
+
+static volatile uint32_t srtp_cpu_feature_bits = 0;
+
+#if defined(SRTP_CPU_X86)
+/*
+ * the register state the OS saves on a context switch, the AVX registers
+ * can only be used if it includes them
+ */
+#define SRTP_XCR0_AVX 0x06    /* XMM and YMM state          */
+#define SRTP_XCR0_AVX512 0xe6 /* and opmask and ZMM state   */
+
+static uint64_t srtp_cpu_xcr0(void)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+#endif
+
+static uint32_t srtp_cpu_probe(void)
+{
+    uint32_t features = 0;
+
+#if defined(SRTP_CPU_X86) && defined(_MSC_VER)
+    int regs[4];
+    uint64_t xcr0;
+
+    __cpuid(regs, 0);
+    if (regs[0] < 1) {
+        return 0;
+    }
+    __cpuid(regs, 1);
+    features |= (regs[3] & (1 << 26)) ? SRTP_CPU_SSE2 : 0;
+    features |= (regs[2] & (1 << 9)) ? SRTP_CPU_SSSE3 : 0;
+    features |= (regs[2] & (1 << 19)) ? SRTP_CPU_SSE41 : 0;
+    features |= (regs[2] & (1 << 25)) ? SRTP_CPU_AES : 0;
+    features |= (regs[2] & (1 << 1)) ? SRTP_CPU_CLMUL : 0;
+    xcr0 = (regs[2] & (1 << 27)) ? srtp_cpu_xcr0() : 0;
+    __cpuid(regs, 0);
+    if (regs[0] >= 7) {
+        __cpuidex(regs, 7, 0);
+        features |= (regs[1] & (1 << 29)) ? SRTP_CPU_SHA1 : 0;
+        if ((xcr0 & SRTP_XCR0_AVX) == SRTP_XCR0_AVX) {
+            features |= (regs[1] & (1 << 5)) ? SRTP_CPU_AVX2 : 0;
+        }
+        if ((xcr0 & SRTP_XCR0_AVX512) == SRTP_XCR0_AVX512) {
+            features |= (regs[1] & (1 << 16)) ? SRTP_CPU_AVX512 : 0;
+        }
+    }
+#elif defined(SRTP_CPU_X86)
+    unsigned int eax, ebx, ecx, edx;
+    uint64_t xcr0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    features |= (edx & bit_SSE2) ? SRTP_CPU_SSE2 : 0;
+    features |= (ecx & bit_SSSE3) ? SRTP_CPU_SSSE3 : 0;
+    features |= (ecx & bit_SSE4_1) ? SRTP_CPU_SSE41 : 0;
+    features |= (ecx & bit_AES) ? SRTP_CPU_AES : 0;
+    features |= (ecx & bit_PCLMUL) ? SRTP_CPU_CLMUL : 0;
+    xcr0 = (ecx & bit_OSXSAVE) ? srtp_cpu_xcr0() : 0;
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        features |= (ebx & bit_SHA) ? SRTP_CPU_SHA1 : 0;
+        if ((xcr0 & SRTP_XCR0_AVX) == SRTP_XCR0_AVX) {
+            features |= (ebx & bit_AVX2) ? SRTP_CPU_AVX2 : 0;
+        }
+        if ((xcr0 & SRTP_XCR0_AVX512) == SRTP_XCR0_AVX512) {
+            features |= (ebx & bit_AVX512F) ? SRTP_CPU_AVX512 : 0;
+        }
+    }
+#elif defined(SRTP_CPU_ARMV8_HWCAP)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+
+    features |= (hwcap & HWCAP_AES) ? SRTP_CPU_AES : 0;
+    features |= (hwcap & HWCAP_PMULL) ? SRTP_CPU_CLMUL : 0;
+    features |= (hwcap & HWCAP_SHA1) ? SRTP_CPU_SHA1 : 0;
+#elif defined(__aarch64__)
+    /* without a way to ask, rely on what the compiler was told to target */
+#if defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+    features |= SRTP_CPU_AES | SRTP_CPU_CLMUL;
+#endif
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+    features |= SRTP_CPU_SHA1;
+#endif
+#endif
+
+    return features;
+}
+
+/*
+ * srtp_cpu_parse_mask(spec) returns the features that SRTP_CPU_FEATURES
+ * allows, unknown names are ignored
+ */
+static uint32_t srtp_cpu_parse_mask(const char *spec)
+{
+    uint32_t mask = ~(uint32_t)0;
+
+    while (*spec != '\0') {
+        size_t len = strcspn(spec, ",");
+        bool disable = false;
+        const char *name = spec;
+        size_t name_len = len;
+
+        if (name_len > 0 && name[0] == '-') {
+            disable = true;
+            name++;
+            name_len--;
+        }
+
+        if (name_len == 4 && strncmp(name, "none", 4) == 0) {
+            mask = 0;
+        } else if (name_len == 3 && strncmp(name, "all", 3) == 0) {
+            mask = ~(uint32_t)0;
+        } else {
+            for (size_t i = 0; i < sizeof(srtp_cpu_feature_names) /
+                                       sizeof(srtp_cpu_feature_names[0]);
+                 i++) {
+                const char *feature = srtp_cpu_feature_names[i].name;
+
+                if (strlen(feature) == name_len &&
+                    strncmp(name, feature, name_len) == 0) {
+                    if (disable) {
+                        mask &= ~srtp_cpu_feature_names[i].feature;
+                    } else {
+                        mask |= srtp_cpu_feature_names[i].feature;
+                    }
+                }
+            }
+        }
+
+        spec += len;
+        if (*spec == ',') {
+            spec++;
+        }
+    }
+
+    return mask;
+}
+
+void srtp_cpu_features_init(void)
+{
+    uint32_t features;
+    const char *spec;
+
+    if (srtp_cpu_feature_bits & SRTP_CPU_PROBED) {
+        return;
+    }
+
+    features = srtp_cpu_probe();
+    spec = getenv("SRTP_CPU_FEATURES");
+    if (spec != NULL) {
+        features &= srtp_cpu_parse_mask(spec);
+    }
+
+    srtp_cpu_feature_bits = (features & ~SRTP_CPU_PROBED) | SRTP_CPU_PROBED;
+}
+
+uint32_t srtp_cpu_features(void)
+{
+    uint32_t features = srtp_cpu_feature_bits;
+
+    if (!(features & SRTP_CPU_PROBED)) {
+        srtp_cpu_features_init();
+        features = srtp_cpu_feature_bits;
+    }
+
+    return features & ~SRTP_CPU_PROBED;
+}
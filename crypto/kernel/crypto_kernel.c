@@ -49,6 +49,7 @@
 #include "crypto_kernel.h"
 #include "cipher_types.h"
 #include "alloc.h"
+#include "cpu_features.h"
 
 #include <stdlib.h>
 
@@ -65,12 +66,19 @@ static srtp_crypto_kernel_t crypto_kernel = {
     srtp_crypto_kernel_state_insecure, /* start off in insecure state */
     NULL,                              /* no cipher types yet         */
     NULL,                              /* no auth types yet           */
-    NULL                               /* no debug modules yet        */
+    NULL,                              /* no debug modules yet        */
+    false,                             /* self-tests run on load      */
+    { 0 }                              /* self-test lock is unlocked  */
 };
 
 #define MAX_RNG_TRIALS 25
 
 srtp_err_status_t srtp_crypto_kernel_init(void)
+{
+    return srtp_crypto_kernel_init_ex(false);
+}
+
+srtp_err_status_t srtp_crypto_kernel_init_ex(bool lazy_self_tests)
 {
     srtp_err_status_t status;
 
@@ -80,9 +88,17 @@ srtp_err_status_t srtp_crypto_kernel_init(void)
          * we're already in the secure state, but we've been asked to
          * re-initialize, so we just re-run the self-tests and then return
          */
+        if (lazy_self_tests) {
+            return srtp_err_status_ok;
+        }
         return srtp_crypto_kernel_status();
     }
 
+    crypto_kernel.lazy_self_tests = lazy_self_tests;
+
+    /* pick the hardware support used by the internal implementations */
+    srtp_cpu_features_init();
+
     /* initialize error reporting system */
     status = srtp_err_reporting_init();
     if (status) {
@@ -118,31 +134,37 @@ srtp_err_status_t srtp_crypto_kernel_init(void)
     if (status) {
         return status;
     }
+#ifndef SRTP_NO_AES_256
     status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_icm_256,
                                                  SRTP_AES_ICM_256);
     if (status) {
         return status;
     }
+#endif
     status = srtp_crypto_kernel_load_debug_module(&srtp_mod_aes_icm);
     if (status) {
         return status;
     }
 #ifdef GCM
+#ifndef SRTP_NO_AES_192
     status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_icm_192,
                                                  SRTP_AES_ICM_192);
     if (status) {
         return status;
     }
+#endif
     status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_gcm_128,
                                                  SRTP_AES_GCM_128);
     if (status) {
         return status;
     }
+#ifndef SRTP_NO_AES_256
     status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_gcm_256,
                                                  SRTP_AES_GCM_256);
     if (status) {
         return status;
     }
+#endif
     status = srtp_crypto_kernel_load_debug_module(&srtp_mod_aes_gcm);
     if (status) {
         return status;
@@ -187,6 +209,7 @@ srtp_err_status_t srtp_crypto_kernel_status(void)
             exit(status);
         }
         srtp_err_report(srtp_err_level_info, "passed\n");
+        ctype->tested = true;
         ctype = ctype->next;
     }
 
@@ -202,6 +225,7 @@ srtp_err_status_t srtp_crypto_kernel_status(void)
             exit(status);
         }
         srtp_err_report(srtp_err_level_info, "passed\n");
+        atype->tested = true;
         atype = atype->next;
     }
 
@@ -265,10 +289,32 @@ srtp_err_status_t srtp_crypto_kernel_shutdown(void)
 
     /* return to insecure state */
     crypto_kernel.state = srtp_crypto_kernel_state_insecure;
+    crypto_kernel.lazy_self_tests = false;
 
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_kernel_cipher_type_add_candidate(ctype, ct) records ct as an
+ * implementation of ctype, it returns false if there is no room for it
+ */
+static bool srtp_kernel_cipher_type_add_candidate(
+    srtp_kernel_cipher_type_t *ctype,
+    const srtp_cipher_type_t *ct)
+{
+    for (size_t i = 0; i < ctype->num_candidates; i++) {
+        if (ctype->candidates[i] == ct) {
+            return true;
+        }
+    }
+    if (ctype->num_candidates == SRTP_KERNEL_MAX_CANDIDATES) {
+        return false;
+    }
+    ctype->candidates[ctype->num_candidates++] = ct;
+
+    return true;
+}
+
 static inline srtp_err_status_t srtp_crypto_kernel_do_load_cipher_type(
     const srtp_cipher_type_t *new_ct,
     srtp_cipher_type_id_t id,
@@ -287,10 +333,12 @@ static inline srtp_err_status_t srtp_crypto_kernel_do_load_cipher_type(
         return srtp_err_status_bad_param;
     }
 
-    /* check cipher type by running self-test */
-    status = srtp_cipher_type_self_test(new_ct);
-    if (status) {
-        return status;
+    /* check cipher type by running self-test, unless that is deferred */
+    if (!crypto_kernel.lazy_self_tests) {
+        status = srtp_cipher_type_self_test(new_ct);
+        if (status) {
+            return status;
+        }
     }
 
     /* walk down list, checking if this type is in the list already  */
@@ -300,10 +348,12 @@ static inline srtp_err_status_t srtp_crypto_kernel_do_load_cipher_type(
             if (!replace) {
                 return srtp_err_status_bad_param;
             }
-            status =
-                srtp_cipher_type_test(new_ct, ctype->cipher_type->test_data);
-            if (status) {
-                return status;
+            if (!crypto_kernel.lazy_self_tests) {
+                status = srtp_cipher_type_test(new_ct,
+                                               ctype->cipher_type->test_data);
+                if (status) {
+                    return status;
+                }
             }
             new_ctype = ctype;
             break;
@@ -330,6 +380,8 @@ static inline srtp_err_status_t srtp_crypto_kernel_do_load_cipher_type(
     /* set fields */
     new_ctype->cipher_type = new_ct;
     new_ctype->id = id;
+    new_ctype->tested = !crypto_kernel.lazy_self_tests;
+    srtp_kernel_cipher_type_add_candidate(new_ctype, new_ct);
 
     return srtp_err_status_ok;
 }
@@ -347,6 +399,26 @@ srtp_err_status_t srtp_replace_cipher_type(const srtp_cipher_type_t *new_ct,
     return srtp_crypto_kernel_do_load_cipher_type(new_ct, id, true);
 }
 
+/*
+ * srtp_kernel_auth_type_add_candidate(atype, at) is
+ * srtp_kernel_cipher_type_add_candidate() for auth types
+ */
+static bool srtp_kernel_auth_type_add_candidate(srtp_kernel_auth_type_t *atype,
+                                                const srtp_auth_type_t *at)
+{
+    for (size_t i = 0; i < atype->num_candidates; i++) {
+        if (atype->candidates[i] == at) {
+            return true;
+        }
+    }
+    if (atype->num_candidates == SRTP_KERNEL_MAX_CANDIDATES) {
+        return false;
+    }
+    atype->candidates[atype->num_candidates++] = at;
+
+    return true;
+}
+
 srtp_err_status_t srtp_crypto_kernel_do_load_auth_type(
     const srtp_auth_type_t *new_at,
     srtp_auth_type_id_t id,
@@ -365,10 +437,12 @@ srtp_err_status_t srtp_crypto_kernel_do_load_auth_type(
         return srtp_err_status_bad_param;
     }
 
-    /* check auth type by running self-test */
-    status = srtp_auth_type_self_test(new_at);
-    if (status) {
-        return status;
+    /* check auth type by running self-test, unless that is deferred */
+    if (!crypto_kernel.lazy_self_tests) {
+        status = srtp_auth_type_self_test(new_at);
+        if (status) {
+            return status;
+        }
     }
 
     /* walk down list, checking if this type is in the list already  */
@@ -378,9 +452,12 @@ srtp_err_status_t srtp_crypto_kernel_do_load_auth_type(
             if (!replace) {
                 return srtp_err_status_bad_param;
             }
-            status = srtp_auth_type_test(new_at, atype->auth_type->test_data);
-            if (status) {
-                return status;
+            if (!crypto_kernel.lazy_self_tests) {
+                status =
+                    srtp_auth_type_test(new_at, atype->auth_type->test_data);
+                if (status) {
+                    return status;
+                }
             }
             new_atype = atype;
             break;
@@ -407,6 +484,8 @@ srtp_err_status_t srtp_crypto_kernel_do_load_auth_type(
     /* set fields */
     new_atype->auth_type = new_at;
     new_atype->id = id;
+    new_atype->tested = !crypto_kernel.lazy_self_tests;
+    srtp_kernel_auth_type_add_candidate(new_atype, new_at);
 
     return srtp_err_status_ok;
 }
@@ -424,6 +503,43 @@ srtp_err_status_t srtp_replace_auth_type(const srtp_auth_type_t *new_at,
     return srtp_crypto_kernel_do_load_auth_type(new_at, id, true);
 }
 
+srtp_err_status_t srtp_add_cipher_type(const srtp_cipher_type_t *ct,
+                                       srtp_cipher_type_id_t id)
+{
+    srtp_kernel_cipher_type_t *ctype;
+    srtp_err_status_t status;
+
+    if (ct == NULL || ct->id != id) {
+        return srtp_err_status_bad_param;
+    }
+
+    for (ctype = crypto_kernel.cipher_type_list; ctype != NULL;
+         ctype = ctype->next) {
+        if (id == ctype->id) {
+            break;
+        }
+    }
+    if (ctype == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* the first candidate is the implementation loaded at init */
+    status = srtp_cipher_type_self_test(ct);
+    if (status) {
+        return status;
+    }
+    status = srtp_cipher_type_test(ct, ctype->candidates[0]->test_data);
+    if (status) {
+        return status;
+    }
+
+    if (!srtp_kernel_cipher_type_add_candidate(ctype, ct)) {
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_err_status_ok;
+}
+
 const srtp_cipher_type_t *srtp_crypto_kernel_get_cipher_type(
     srtp_cipher_type_id_t id)
 {
@@ -442,12 +558,40 @@ const srtp_cipher_type_t *srtp_crypto_kernel_get_cipher_type(
     return NULL;
 }
 
+const srtp_cipher_type_t *srtp_get_cipher_type(srtp_cipher_type_id_t id)
+{
+    return srtp_crypto_kernel_get_cipher_type(id);
+}
+
+/*
+ * srtp_crypto_kernel_test_cipher_type(ctype) runs the deferred self-test
+ * of ctype if it has not passed it yet. The self-tests use their own
+ * ciphers, the lock only keeps two threads from testing the same type.
+ */
+static srtp_err_status_t srtp_crypto_kernel_test_cipher_type(
+    srtp_kernel_cipher_type_t *ctype)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    srtp_spinlock_lock(&crypto_kernel.self_test_lock);
+    if (!ctype->tested) {
+        debug_print(srtp_mod_crypto_kernel, "self-test of cipher %s",
+                    ctype->cipher_type->description);
+        status = srtp_cipher_type_self_test(ctype->cipher_type);
+        ctype->tested = status == srtp_err_status_ok;
+    }
+    srtp_spinlock_unlock(&crypto_kernel.self_test_lock);
+
+    return status;
+}
+
 srtp_err_status_t srtp_crypto_kernel_alloc_cipher(srtp_cipher_type_id_t id,
                                                   srtp_cipher_pointer_t *cp,
                                                   size_t key_len,
                                                   size_t tag_len)
 {
-    const srtp_cipher_type_t *ct;
+    srtp_kernel_cipher_type_t *ctype;
+    srtp_err_status_t status;
 
     /*
      * if the crypto_kernel is not yet initialized, we refuse to allocate
@@ -457,12 +601,60 @@ srtp_err_status_t srtp_crypto_kernel_alloc_cipher(srtp_cipher_type_id_t id,
         return srtp_err_status_init_fail;
     }
 
-    ct = srtp_crypto_kernel_get_cipher_type(id);
-    if (!ct) {
+    for (ctype = crypto_kernel.cipher_type_list; ctype != NULL;
+         ctype = ctype->next) {
+        if (id == ctype->id) {
+            break;
+        }
+    }
+    if (ctype == NULL) {
         return srtp_err_status_fail;
     }
 
-    return ((ct)->alloc(cp, key_len, tag_len));
+    if (crypto_kernel.lazy_self_tests) {
+        status = srtp_crypto_kernel_test_cipher_type(ctype);
+        if (status) {
+            return status;
+        }
+    }
+
+    return ctype->cipher_type->alloc(cp, key_len, tag_len);
+}
+
+srtp_err_status_t srtp_add_auth_type(const srtp_auth_type_t *at,
+                                     srtp_auth_type_id_t id)
+{
+    srtp_kernel_auth_type_t *atype;
+    srtp_err_status_t status;
+
+    if (at == NULL || at->id != id) {
+        return srtp_err_status_bad_param;
+    }
+
+    for (atype = crypto_kernel.auth_type_list; atype != NULL;
+         atype = atype->next) {
+        if (id == atype->id) {
+            break;
+        }
+    }
+    if (atype == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_auth_type_self_test(at);
+    if (status) {
+        return status;
+    }
+    status = srtp_auth_type_test(at, atype->candidates[0]->test_data);
+    if (status) {
+        return status;
+    }
+
+    if (!srtp_kernel_auth_type_add_candidate(atype, at)) {
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_err_status_ok;
 }
 
 const srtp_auth_type_t *srtp_crypto_kernel_get_auth_type(srtp_auth_type_id_t id)
@@ -482,12 +674,39 @@ const srtp_auth_type_t *srtp_crypto_kernel_get_auth_type(srtp_auth_type_id_t id)
     return NULL;
 }
 
+const srtp_auth_type_t *srtp_get_auth_type(srtp_auth_type_id_t id)
+{
+    return srtp_crypto_kernel_get_auth_type(id);
+}
+
+/*
+ * srtp_crypto_kernel_test_auth_type(atype) is
+ * srtp_crypto_kernel_test_cipher_type() for auth types
+ */
+static srtp_err_status_t srtp_crypto_kernel_test_auth_type(
+    srtp_kernel_auth_type_t *atype)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    srtp_spinlock_lock(&crypto_kernel.self_test_lock);
+    if (!atype->tested) {
+        debug_print(srtp_mod_crypto_kernel, "self-test of auth %s",
+                    atype->auth_type->description);
+        status = srtp_auth_type_self_test(atype->auth_type);
+        atype->tested = status == srtp_err_status_ok;
+    }
+    srtp_spinlock_unlock(&crypto_kernel.self_test_lock);
+
+    return status;
+}
+
 srtp_err_status_t srtp_crypto_kernel_alloc_auth(srtp_auth_type_id_t id,
                                                 srtp_auth_pointer_t *ap,
                                                 size_t key_len,
                                                 size_t tag_len)
 {
-    const srtp_auth_type_t *at;
+    srtp_kernel_auth_type_t *atype;
+    srtp_err_status_t status;
 
     /*
      * if the crypto_kernel is not yet initialized, we refuse to allocate
@@ -497,12 +716,150 @@ srtp_err_status_t srtp_crypto_kernel_alloc_auth(srtp_auth_type_id_t id,
         return srtp_err_status_init_fail;
     }
 
-    at = srtp_crypto_kernel_get_auth_type(id);
-    if (!at) {
+    for (atype = crypto_kernel.auth_type_list; atype != NULL;
+         atype = atype->next) {
+        if (id == atype->id) {
+            break;
+        }
+    }
+    if (atype == NULL) {
         return srtp_err_status_fail;
     }
 
-    return ((at)->alloc(ap, key_len, tag_len));
+    if (crypto_kernel.lazy_self_tests) {
+        status = srtp_crypto_kernel_test_auth_type(atype);
+        if (status) {
+            return status;
+        }
+    }
+
+    return atype->auth_type->alloc(ap, key_len, tag_len);
+}
+
+/*
+ * a calibration run times CALIBRATION_OCTETS octet messages, starting with
+ * CALIBRATION_TRIALS of them and taking more while the clock does not move
+ */
+#define CALIBRATION_OCTETS 1024
+#define CALIBRATION_TRIALS 256
+#define CALIBRATION_MAX_TRIALS 65536
+
+/*
+ * srtp_crypto_kernel_cipher_rate(ct) returns the bits per second of ct
+ * keyed with its first test case, or 0 if it fails its self-test
+ */
+static uint64_t srtp_crypto_kernel_cipher_rate(const srtp_cipher_type_t *ct)
+{
+    const srtp_cipher_test_case_t *test_case = ct->test_data;
+    srtp_cipher_t *c;
+    uint64_t rate = 0;
+
+    if (test_case == NULL || srtp_cipher_type_self_test(ct)) {
+        return 0;
+    }
+    if (srtp_cipher_type_alloc(ct, &c, test_case->key_length_octets,
+                               test_case->tag_length_octets)) {
+        return 0;
+    }
+    if (srtp_cipher_init(c, test_case->key) == srtp_err_status_ok) {
+        for (size_t trials = CALIBRATION_TRIALS;
+             rate == 0 && trials <= CALIBRATION_MAX_TRIALS; trials *= 4) {
+            rate = srtp_cipher_bits_per_second(c, CALIBRATION_OCTETS, trials);
+        }
+    }
+    srtp_cipher_dealloc(c);
+
+    return rate;
+}
+
+/*
+ * srtp_crypto_kernel_auth_rate(at) is srtp_crypto_kernel_cipher_rate()
+ * for auth types
+ */
+static uint64_t srtp_crypto_kernel_auth_rate(const srtp_auth_type_t *at)
+{
+    const srtp_auth_test_case_t *test_case = at->test_data;
+    srtp_auth_t *a;
+    uint64_t rate = 0;
+
+    if (test_case == NULL || srtp_auth_type_self_test(at)) {
+        return 0;
+    }
+    if (srtp_auth_type_alloc(at, &a, test_case->key_length_octets,
+                             test_case->tag_length_octets)) {
+        return 0;
+    }
+    if (srtp_auth_init(a, test_case->key) == srtp_err_status_ok) {
+        for (size_t trials = CALIBRATION_TRIALS;
+             rate == 0 && trials <= CALIBRATION_MAX_TRIALS; trials *= 4) {
+            rate = srtp_auth_bits_per_second(a, CALIBRATION_OCTETS, trials);
+        }
+    }
+    srtp_auth_dealloc(a);
+
+    return rate;
+}
+
+srtp_err_status_t srtp_crypto_kernel_calibrate(void)
+{
+    if (crypto_kernel.state != srtp_crypto_kernel_state_secure) {
+        return srtp_err_status_init_fail;
+    }
+
+    for (srtp_kernel_cipher_type_t *ctype = crypto_kernel.cipher_type_list;
+         ctype != NULL; ctype = ctype->next) {
+        const srtp_cipher_type_t *best = NULL;
+        uint64_t best_rate = 0;
+
+        if (ctype->num_candidates < 2) {
+            continue;
+        }
+        for (size_t i = 0; i < ctype->num_candidates; i++) {
+            uint64_t rate =
+                srtp_crypto_kernel_cipher_rate(ctype->candidates[i]);
+
+            debug_print2(srtp_mod_crypto_kernel, "cipher %s: %zu Mbit/s",
+                         ctype->candidates[i]->description,
+                         (size_t)(rate / 1000000));
+            if (rate > best_rate) {
+                best = ctype->candidates[i];
+                best_rate = rate;
+            }
+        }
+        if (best == NULL) {
+            return srtp_err_status_algo_fail;
+        }
+        ctype->cipher_type = best;
+        ctype->tested = true;
+    }
+
+    for (srtp_kernel_auth_type_t *atype = crypto_kernel.auth_type_list;
+         atype != NULL; atype = atype->next) {
+        const srtp_auth_type_t *best = NULL;
+        uint64_t best_rate = 0;
+
+        if (atype->num_candidates < 2) {
+            continue;
+        }
+        for (size_t i = 0; i < atype->num_candidates; i++) {
+            uint64_t rate = srtp_crypto_kernel_auth_rate(atype->candidates[i]);
+
+            debug_print2(srtp_mod_crypto_kernel, "auth %s: %zu Mbit/s",
+                         atype->candidates[i]->description,
+                         (size_t)(rate / 1000000));
+            if (rate > best_rate) {
+                best = atype->candidates[i];
+                best_rate = rate;
+            }
+        }
+        if (best == NULL) {
+            return srtp_err_status_algo_fail;
+        }
+        atype->auth_type = best;
+        atype->tested = true;
+    }
+
+    return srtp_err_status_ok;
 }
 
 srtp_err_status_t srtp_crypto_kernel_load_debug_module(
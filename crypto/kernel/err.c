@@ -48,6 +48,7 @@
 
 #include "err.h"
 #include "datatypes.h"
+#include "atomics.h"
 #include <string.h>
 
 /* srtp_err_file is the FILE to which errors are reported */
@@ -106,3 +107,15 @@ void srtp_err_report(srtp_err_reporting_level_t level, const char *format, ...)
         va_end(args);
     }
 }
+
+#ifdef ENABLE_PACKET_TRACE
+bool srtp_debug_trace_sample(size_t *count)
+{
+    size_t n = srtp_atomic_get(*count);
+
+    /* concurrent packets may both report, which is fine for a trace */
+    srtp_atomic_add(*count, 1);
+
+    return n % SRTP_PACKET_TRACE_INTERVAL == 0;
+}
+#endif
@@ -0,0 +1,616 @@
+/*
+ * key_store.c
+ *
+ * reference counted store of expanded keys
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "key_store.h"
+#include "alloc.h"
+#include "atomics.h"
+
+#include <limits.h>
+
+/*
+ * Streams that are keyed separately with the same master key, and so
+ * with the same session keys, would each hold an identical expansion of
+ * those keys. The store interns expansions instead: an entry holds the
+ * key, the function that expanded it and the expansion, and is shared by
+ * every context keyed with them. The expansions are only read once made,
+ * so the contexts sharing one can be used concurrently.
+ *
+ * Entries are chained in a hash table that doubles when it holds as many
+ * entries as it has buckets. The session keys are outputs of the KDF, so
+ * a plain FNV-1a hash of them is well distributed. The table is freed
+ * with its last entry, so that an idle store holds no memory.
+ */
+typedef struct srtp_key_store_entry_t {
+    struct srtp_key_store_entry_t *next;
+    srtp_key_store_expand_func_t expand;
+    size_t refs;
+    size_t key_len;
+    size_t expanded_len;
+    uint32_t hash;
+    uint8_t key[SRTP_KEY_STORE_MAX_KEY_LEN];
+} srtp_key_store_entry_t;
+
+/* the expansion follows the entry, on a cache line of its own */
+#define SRTP_KEY_STORE_ENTRY_LEN                                               \
+    ((sizeof(srtp_key_store_entry_t) + SRTP_CACHE_LINE_SIZE - 1) &             \
+     ~(size_t)(SRTP_CACHE_LINE_SIZE - 1))
+
+#define SRTP_KEY_STORE_MIN_BUCKETS 64
+
+static srtp_spinlock_t srtp_key_store_lock;
+static srtp_key_store_entry_t **srtp_key_store_buckets = NULL;
+static size_t srtp_key_store_num_buckets = 0;
+static size_t srtp_key_store_num_entries = 0;
+
+/*
+ * A shared region lets processes that key the same streams use a single
+ * copy of the expansions. The process that creates the region publishes
+ * every expansion it makes there, and the processes that attach to it,
+ * possibly through a read only mapping, look keys up there before
+ * expanding them on their own.
+ *
+ * Nothing in the region is freed or written again once published, so
+ * readers take no lock: the creator fills in an entry and then stores
+ * its offset in a free slot with release semantics. The slots are an open
+ * addressed table with linear probing, sized when the region is created.
+ * Offsets keep the region independent of where it is mapped, and the
+ * expansion function of an entry is stored relative to
+ * srtp_key_store_acquire(), which is the same in every process running
+ * the same build of libSRTP; the header records a fingerprint of that
+ * build, which srtp_shared_key_region_attach() checks.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t num_slots; /* a power of two          */
+    uint64_t build;     /* srtp_key_store_build()  */
+    uint64_t size;      /* of the region in octets */
+} srtp_key_store_region_t;
+
+typedef struct {
+    int64_t expand; /* relative to srtp_key_store_acquire() */
+    uint64_t expanded_len;
+    uint32_t hash;
+    uint32_t key_len;
+    uint8_t key[SRTP_KEY_STORE_MAX_KEY_LEN];
+} srtp_key_store_shared_entry_t;
+
+#define SRTP_KEY_STORE_REGION_MAGIC 0x5352534bu /* "SRSK" */
+
+#define SRTP_KEY_STORE_ROUND(len)                                             \
+    (((len) + SRTP_CACHE_LINE_SIZE - 1) & ~(size_t)(SRTP_CACHE_LINE_SIZE - 1))
+
+/* the expansion follows the entry, on a cache line of its own */
+#define SRTP_KEY_STORE_SHARED_ENTRY_LEN                                        \
+    SRTP_KEY_STORE_ROUND(sizeof(srtp_key_store_shared_entry_t))
+
+/* a slot per this many octets, the smallest expansions are about as big */
+#define SRTP_KEY_STORE_REGION_OCTETS_PER_SLOT 512
+#define SRTP_KEY_STORE_REGION_MIN_SLOTS 16
+
+static srtp_key_store_region_t *srtp_key_store_region = NULL;
+static bool srtp_key_store_region_writable = false;
+static size_t srtp_key_store_region_used = 0;    /* by the creator only   */
+static size_t srtp_key_store_region_entries = 0; /* published by creator  */
+static size_t srtp_key_store_region_refs = 0;    /* expansions handed out */
+
+static uint32_t srtp_key_store_hash(const uint8_t *key, size_t key_len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < key_len; i++) {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void *srtp_key_store_expansion(srtp_key_store_entry_t *entry)
+{
+    return (uint8_t *)entry + SRTP_KEY_STORE_ENTRY_LEN;
+}
+
+static srtp_key_store_entry_t *srtp_key_store_entry(const void *expanded)
+{
+    return (srtp_key_store_entry_t *)((uintptr_t)expanded -
+                                      SRTP_KEY_STORE_ENTRY_LEN);
+}
+
+/*
+ * srtp_key_store_find(expand, key, key_len, hash) returns the entry with
+ * that expansion of key, or NULL; the lock must be held
+ */
+static srtp_key_store_entry_t *srtp_key_store_find(
+    srtp_key_store_expand_func_t expand,
+    const uint8_t *key,
+    size_t key_len,
+    uint32_t hash)
+{
+    srtp_key_store_entry_t *entry;
+
+    if (srtp_key_store_buckets == NULL) {
+        return NULL;
+    }
+
+    entry = srtp_key_store_buckets[hash & (srtp_key_store_num_buckets - 1)];
+    for (; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->expand == expand &&
+            entry->key_len == key_len &&
+            srtp_octet_string_equal(entry->key, key, key_len)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * srtp_key_store_insert(entry) adds entry to the table, growing it first
+ * if it is full; the lock must be held
+ */
+static srtp_err_status_t srtp_key_store_insert(srtp_key_store_entry_t *entry)
+{
+    size_t slot;
+
+    if (srtp_key_store_num_entries >= srtp_key_store_num_buckets) {
+        size_t num_buckets = srtp_key_store_num_buckets
+                                 ? srtp_key_store_num_buckets * 2
+                                 : SRTP_KEY_STORE_MIN_BUCKETS;
+        srtp_key_store_entry_t **buckets;
+
+        buckets = (srtp_key_store_entry_t **)srtp_crypto_alloc(
+            num_buckets * sizeof(srtp_key_store_entry_t *));
+        if (buckets == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+
+        for (size_t i = 0; i < srtp_key_store_num_buckets; i++) {
+            srtp_key_store_entry_t *e = srtp_key_store_buckets[i];
+
+            while (e != NULL) {
+                srtp_key_store_entry_t *next = e->next;
+
+                slot = e->hash & (num_buckets - 1);
+                e->next = buckets[slot];
+                buckets[slot] = e;
+                e = next;
+            }
+        }
+
+        srtp_crypto_free(srtp_key_store_buckets);
+        srtp_key_store_buckets = buckets;
+        srtp_key_store_num_buckets = num_buckets;
+    }
+
+    slot = entry->hash & (srtp_key_store_num_buckets - 1);
+    entry->next = srtp_key_store_buckets[slot];
+    srtp_key_store_buckets[slot] = entry;
+    srtp_key_store_num_entries++;
+
+    return srtp_err_status_ok;
+}
+
+static int64_t srtp_key_store_kind(srtp_key_store_expand_func_t expand)
+{
+    return (int64_t)((intptr_t)expand - (intptr_t)&srtp_key_store_acquire);
+}
+
+/*
+ * srtp_key_store_build() tells builds of libSRTP apart, by the layout of
+ * shared entries and the distance between two of its functions
+ */
+static uint64_t srtp_key_store_build(void)
+{
+    uint64_t distance = (uint64_t)((intptr_t)&srtp_key_store_release -
+                                   (intptr_t)&srtp_key_store_acquire);
+
+    return (distance << 16) ^ (SRTP_KEY_STORE_SHARED_ENTRY_LEN << 8) ^
+           sizeof(void *);
+}
+
+static volatile long *srtp_key_store_region_slots(
+    const srtp_key_store_region_t *region)
+{
+    return (volatile long *)(uintptr_t)(region + 1);
+}
+
+/* octets taken by the header and the slots of a region */
+static size_t srtp_key_store_region_start(size_t num_slots)
+{
+    return SRTP_KEY_STORE_ROUND(sizeof(srtp_key_store_region_t) +
+                                num_slots * sizeof(long));
+}
+
+static bool srtp_key_store_in_region(const void *expanded)
+{
+    const uint8_t *region = (const uint8_t *)srtp_key_store_region;
+
+    return region != NULL && (const uint8_t *)expanded >= region &&
+           (const uint8_t *)expanded < region + srtp_key_store_region->size;
+}
+
+/*
+ * srtp_key_store_region_find(expand, key, key_len, hash) returns the
+ * expansion of key in the shared region, or NULL
+ */
+static const void *srtp_key_store_region_find(
+    srtp_key_store_expand_func_t expand,
+    const uint8_t *key,
+    size_t key_len,
+    uint32_t hash)
+{
+    const srtp_key_store_region_t *region = srtp_key_store_region;
+    volatile long *slots = srtp_key_store_region_slots(region);
+    size_t mask = region->num_slots - 1;
+    int64_t kind = srtp_key_store_kind(expand);
+
+    for (size_t i = 0, slot = hash & mask; i <= mask;
+         i++, slot = (slot + 1) & mask) {
+        long offset = srtp_lock_load(&slots[slot]);
+        const srtp_key_store_shared_entry_t *entry;
+
+        if (offset == 0) {
+            return NULL;
+        }
+
+        entry = (const srtp_key_store_shared_entry_t *)((const uint8_t *)
+                                                            region +
+                                                        offset);
+        if (entry->hash == hash && entry->expand == kind &&
+            entry->key_len == key_len &&
+            srtp_octet_string_equal(entry->key, key, key_len)) {
+            return (const uint8_t *)entry + SRTP_KEY_STORE_SHARED_ENTRY_LEN;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * srtp_key_store_region_add(expand, key, key_len, expanded_len, hash)
+ * expands key into the shared region and publishes it, returning the
+ * expansion, or NULL if the region is full; the lock must be held, which
+ * only delays the creator of the region, other processes read without it
+ */
+static const void *srtp_key_store_region_add(
+    srtp_key_store_expand_func_t expand,
+    const uint8_t *key,
+    size_t key_len,
+    size_t expanded_len,
+    uint32_t hash)
+{
+    srtp_key_store_region_t *region = srtp_key_store_region;
+    volatile long *slots = srtp_key_store_region_slots(region);
+    size_t mask = region->num_slots - 1;
+    size_t len = SRTP_KEY_STORE_SHARED_ENTRY_LEN +
+                 SRTP_KEY_STORE_ROUND(expanded_len);
+    srtp_key_store_shared_entry_t *entry;
+    size_t slot;
+
+    /* keep a quarter of the slots free so that probes stay short */
+    if (len > region->size - srtp_key_store_region_used ||
+        srtp_key_store_region_entries >= region->num_slots / 4 * 3) {
+        return NULL;
+    }
+
+    entry = (srtp_key_store_shared_entry_t *)((uint8_t *)region +
+                                              srtp_key_store_region_used);
+    if (expand(key, key_len,
+               (uint8_t *)entry + SRTP_KEY_STORE_SHARED_ENTRY_LEN)) {
+        octet_string_set_to_zero(entry, len);
+        return NULL;
+    }
+    entry->expand = srtp_key_store_kind(expand);
+    entry->expanded_len = expanded_len;
+    entry->hash = hash;
+    entry->key_len = (uint32_t)key_len;
+    memcpy(entry->key, key, key_len);
+
+    slot = hash & mask;
+    while (slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    srtp_lock_add_release(&slots[slot], (long)srtp_key_store_region_used);
+
+    srtp_key_store_region_used += len;
+    srtp_key_store_region_entries++;
+
+    return (const uint8_t *)entry + SRTP_KEY_STORE_SHARED_ENTRY_LEN;
+}
+
+srtp_err_status_t srtp_key_store_acquire(srtp_key_store_expand_func_t expand,
+                                         const uint8_t *key,
+                                         size_t key_len,
+                                         size_t expanded_len,
+                                         const void **expanded)
+{
+    srtp_key_store_entry_t *entry;
+    srtp_key_store_entry_t *found;
+    srtp_err_status_t status;
+    uint32_t hash;
+
+    if (expand == NULL || key_len > SRTP_KEY_STORE_MAX_KEY_LEN ||
+        expanded_len == 0 || expanded == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    hash = srtp_key_store_hash(key, key_len);
+
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    if (srtp_key_store_region != NULL) {
+        const void *shared;
+
+        shared = srtp_key_store_region_find(expand, key, key_len, hash);
+        if (shared == NULL && srtp_key_store_region_writable) {
+            shared = srtp_key_store_region_add(expand, key, key_len,
+                                               expanded_len, hash);
+        }
+        if (shared != NULL) {
+            srtp_key_store_region_refs++;
+            srtp_spinlock_unlock(&srtp_key_store_lock);
+            *expanded = shared;
+            return srtp_err_status_ok;
+        }
+    }
+    found = srtp_key_store_find(expand, key, key_len, hash);
+    if (found != NULL) {
+        found->refs++;
+    }
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    if (found != NULL) {
+        *expanded = srtp_key_store_expansion(found);
+        return srtp_err_status_ok;
+    }
+
+    /* expand outside of the lock, other threads may look up their keys */
+    entry = (srtp_key_store_entry_t *)srtp_crypto_alloc_aligned(
+        SRTP_KEY_STORE_ENTRY_LEN + expanded_len, SRTP_CACHE_LINE_SIZE);
+    if (entry == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    status = expand(key, key_len, srtp_key_store_expansion(entry));
+    if (status) {
+        octet_string_set_to_zero(entry,
+                                 SRTP_KEY_STORE_ENTRY_LEN + expanded_len);
+        srtp_crypto_free(entry);
+        return status;
+    }
+
+    entry->expand = expand;
+    entry->refs = 1;
+    entry->key_len = key_len;
+    entry->expanded_len = expanded_len;
+    entry->hash = hash;
+    memcpy(entry->key, key, key_len);
+
+    /* another thread may have stored the same key in the meantime */
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    found = srtp_key_store_find(expand, key, key_len, hash);
+    if (found != NULL) {
+        found->refs++;
+    } else {
+        status = srtp_key_store_insert(entry);
+    }
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    if (found != NULL || status) {
+        octet_string_set_to_zero(entry,
+                                 SRTP_KEY_STORE_ENTRY_LEN + expanded_len);
+        srtp_crypto_free(entry);
+        if (status) {
+            return status;
+        }
+        entry = found;
+    }
+
+    *expanded = srtp_key_store_expansion(entry);
+
+    return srtp_err_status_ok;
+}
+
+void srtp_key_store_retain(const void *expanded)
+{
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    if (srtp_key_store_in_region(expanded)) {
+        srtp_key_store_region_refs++;
+    } else {
+        srtp_key_store_entry(expanded)->refs++;
+    }
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+}
+
+void srtp_key_store_release(const void *expanded)
+{
+    srtp_key_store_entry_t *entry;
+    srtp_key_store_entry_t **prev;
+    srtp_key_store_entry_t **buckets = NULL;
+
+    if (expanded == NULL) {
+        return;
+    }
+
+    entry = srtp_key_store_entry(expanded);
+
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    if (srtp_key_store_in_region(expanded)) {
+        srtp_key_store_region_refs--;
+        srtp_spinlock_unlock(&srtp_key_store_lock);
+        return;
+    }
+    if (--entry->refs != 0) {
+        srtp_spinlock_unlock(&srtp_key_store_lock);
+        return;
+    }
+
+    prev = &srtp_key_store_buckets[entry->hash &
+                                   (srtp_key_store_num_buckets - 1)];
+    while (*prev != entry) {
+        prev = &(*prev)->next;
+    }
+    *prev = entry->next;
+
+    if (--srtp_key_store_num_entries == 0) {
+        buckets = srtp_key_store_buckets;
+        srtp_key_store_buckets = NULL;
+        srtp_key_store_num_buckets = 0;
+    }
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    octet_string_set_to_zero(entry,
+                             SRTP_KEY_STORE_ENTRY_LEN + entry->expanded_len);
+    srtp_crypto_free(entry);
+    srtp_crypto_free(buckets);
+}
+
+size_t srtp_key_store_count(void)
+{
+    size_t count;
+
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    count = srtp_key_store_num_entries;
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    return count;
+}
+
+srtp_err_status_t srtp_shared_key_region_create(void *region, size_t size)
+{
+    srtp_key_store_region_t *header = (srtp_key_store_region_t *)region;
+    size_t num_slots = SRTP_KEY_STORE_REGION_MIN_SLOTS;
+
+    if (region == NULL || (uintptr_t)region % SRTP_CACHE_LINE_SIZE != 0 ||
+        size > (size_t)LONG_MAX) {
+        return srtp_err_status_bad_param;
+    }
+    while (num_slots * 2 <= size / SRTP_KEY_STORE_REGION_OCTETS_PER_SLOT) {
+        num_slots *= 2;
+    }
+    if (size < srtp_key_store_region_start(num_slots)) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    if (srtp_key_store_region != NULL) {
+        srtp_spinlock_unlock(&srtp_key_store_lock);
+        return srtp_err_status_fail;
+    }
+
+    memset(region, 0, size);
+    header->magic = SRTP_KEY_STORE_REGION_MAGIC;
+    header->num_slots = (uint32_t)num_slots;
+    header->build = srtp_key_store_build();
+    header->size = size;
+
+    srtp_key_store_region = header;
+    srtp_key_store_region_writable = true;
+    srtp_key_store_region_used = srtp_key_store_region_start(num_slots);
+    srtp_key_store_region_entries = 0;
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_shared_key_region_attach(const void *region,
+                                                size_t size)
+{
+    const srtp_key_store_region_t *header =
+        (const srtp_key_store_region_t *)region;
+
+    if (region == NULL || (uintptr_t)region % SRTP_CACHE_LINE_SIZE != 0 ||
+        size < sizeof(srtp_key_store_region_t)) {
+        return srtp_err_status_bad_param;
+    }
+    if (header->magic != SRTP_KEY_STORE_REGION_MAGIC ||
+        header->build != srtp_key_store_build() || header->size != size ||
+        header->num_slots == 0 ||
+        (header->num_slots & (header->num_slots - 1)) != 0 ||
+        srtp_key_store_region_start(header->num_slots) > size) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    if (srtp_key_store_region != NULL) {
+        srtp_spinlock_unlock(&srtp_key_store_lock);
+        return srtp_err_status_fail;
+    }
+
+    /* only read through, the region may be mapped read only */
+    srtp_key_store_region = (srtp_key_store_region_t *)(uintptr_t)header;
+    srtp_key_store_region_writable = false;
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_shared_key_region_detach(void)
+{
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    if (srtp_key_store_region_refs != 0) {
+        srtp_spinlock_unlock(&srtp_key_store_lock);
+        return srtp_err_status_fail;
+    }
+    srtp_key_store_region = NULL;
+    srtp_key_store_region_writable = false;
+    srtp_key_store_region_used = 0;
+    srtp_key_store_region_entries = 0;
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    return srtp_err_status_ok;
+}
+
+size_t srtp_key_store_shared_count(void)
+{
+    size_t count;
+
+    srtp_spinlock_lock(&srtp_key_store_lock);
+    count = srtp_key_store_region_refs;
+    srtp_spinlock_unlock(&srtp_key_store_lock);
+
+    return count;
+}
@@ -48,33 +48,43 @@
 #endif
 
 #include "rdb.h"
-
-#define rdb_bits_in_bitmask (8 * sizeof(v128_t))
+#include "atomics.h"
 
 /*
  * this implementation of a replay database works as follows:
  *
  * window_start is the index of the first packet in the window
- * bitmask      a bit-buffer, containing the most recently entered
- *              index as the leftmost bit
+ * window       a replay window over bitmask, whose newest bit holds
+ *              the index window_start + window.length - 1
  *
  */
 
 /* srtp_rdb_init initalizes rdb */
-srtp_err_status_t srtp_rdb_init(srtp_rdb_t *rdb)
+srtp_err_status_t srtp_rdb_init(srtp_rdb_t *rdb, size_t ws)
 {
-    v128_set_to_zero(&rdb->bitmask);
+    if (ws == 0 || ws > SRTP_RDB_MAX_WINDOW_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_replay_window_init(&rdb->window, rdb->bitmask, ws);
     rdb->window_start = 0;
     return srtp_err_status_ok;
 }
 
+size_t srtp_rdb_get_window_size(const srtp_rdb_t *rdb)
+{
+    return rdb->window.length;
+}
+
 /*
  * srtp_rdb_check checks to see if index appears in rdb
  */
 srtp_err_status_t srtp_rdb_check(const srtp_rdb_t *rdb, uint32_t p_index)
 {
+    uint32_t window_end = rdb->window_start + (uint32_t)rdb->window.length;
+
     /* if the index appears after (or at very end of) the window, its good */
-    if (p_index >= rdb->window_start + rdb_bits_in_bitmask) {
+    if (p_index >= window_end) {
         return srtp_err_status_ok;
     }
 
@@ -84,7 +94,8 @@ srtp_err_status_t srtp_rdb_check(const srtp_rdb_t *rdb, uint32_t p_index)
     }
 
     /* otherwise, the index appears within the window, so check the bitmask */
-    if (v128_get_bit(&rdb->bitmask, (p_index - rdb->window_start)) == 1) {
+    if (srtp_replay_window_test(&rdb->window, rdb->bitmask,
+                                window_end - 1 - p_index)) {
         return srtp_err_status_replay_fail;
     }
 
@@ -102,23 +113,21 @@ srtp_err_status_t srtp_rdb_check(const srtp_rdb_t *rdb, uint32_t p_index)
  */
 srtp_err_status_t srtp_rdb_add_index(srtp_rdb_t *rdb, uint32_t p_index)
 {
-    uint32_t delta;
+    uint32_t window_end = rdb->window_start + (uint32_t)rdb->window.length;
 
     if (p_index < rdb->window_start) {
         return srtp_err_status_replay_fail;
     }
 
-    delta = (p_index - rdb->window_start);
-    if (delta < rdb_bits_in_bitmask) {
+    if (p_index < window_end) {
         /* if the p_index is within the window, set the appropriate bit */
-        v128_set_bit(&rdb->bitmask, delta);
-
+        srtp_replay_window_set(&rdb->window, rdb->bitmask,
+                               window_end - 1 - p_index);
     } else {
-        delta -= rdb_bits_in_bitmask - 1;
+        uint32_t delta = p_index - (window_end - 1);
 
-        /* shift the window forward by delta bits*/
-        v128_left_shift(&rdb->bitmask, delta);
-        v128_set_bit(&rdb->bitmask, rdb_bits_in_bitmask - 1);
+        /* move the window forward by delta bits */
+        srtp_replay_window_advance(&rdb->window, rdb->bitmask, delta);
         rdb->window_start += delta;
     }
 
@@ -127,10 +136,22 @@ srtp_err_status_t srtp_rdb_add_index(srtp_rdb_t *rdb, uint32_t p_index)
 
 srtp_err_status_t srtp_rdb_increment(srtp_rdb_t *rdb)
 {
-    if (rdb->window_start >= 0x7fffffff) {
-        return srtp_err_status_key_expired;
-    }
-    ++rdb->window_start;
+    uint32_t value;
+
+    return srtp_rdb_next_value(rdb, &value);
+}
+
+srtp_err_status_t srtp_rdb_next_value(srtp_rdb_t *rdb, uint32_t *value)
+{
+    uint32_t current = rdb->window_start;
+
+    do {
+        if (current >= 0x7fffffff) {
+            return srtp_err_status_key_expired;
+        }
+    } while (!srtp_atomic_cas_u32(&rdb->window_start, &current, current + 1));
+
+    *value = current + 1;
     return srtp_err_status_ok;
 }
 
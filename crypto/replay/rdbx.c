@@ -48,6 +48,7 @@
 #endif
 
 #include "rdbx.h"
+#include "alloc.h"
 
 /*
  * from RFC 3711:
@@ -83,7 +84,13 @@
  * A srtp_rdbx_t consists of a srtp_xtd_seq_num_t and a bitmask.  The index is
  * highest sequence number that has been received, and the bitmask indicates
  * which of the recent indicies have been received as well.  The
- * highest bit in the bitmask corresponds to the index in the bitmask.
+ * newest bit of the replay window corresponds to the index.
+ *
+ * An adaptive window only grows on the reordering of packets passed to
+ * srtp_rdbx_add_index(), which have been authenticated; a packet older
+ * than the window is rejected by srtp_rdbx_check() before that, so the
+ * window grows once packets are accepted at half its size or more, well
+ * before they start to fall out of it.
  */
 
 void srtp_index_init(srtp_xtd_seq_num_t *pi)
@@ -159,25 +166,196 @@ srtp_err_status_t srtp_rdbx_init(srtp_rdbx_t *rdbx, size_t ws)
         return srtp_err_status_bad_param;
     }
 
-    if (!bitvector_alloc(&rdbx->bitmask, ws)) {
+    rdbx->bitmask = (uint64_t *)srtp_crypto_alloc(
+        SRTP_REPLAY_WINDOW_WORDS(ws) * sizeof(uint64_t));
+    if (rdbx->bitmask == NULL) {
         return srtp_err_status_alloc_fail;
     }
 
+    rdbx->owns_bitmask = true;
+    srtp_replay_window_init(&rdbx->window, rdbx->bitmask, ws);
+    srtp_index_init(&rdbx->index);
+    rdbx->base_bitmask = rdbx->bitmask;
+    rdbx->base_length = rdbx->window.length;
+    rdbx->max_length = rdbx->window.length;
+    rdbx->depth = 0;
+    rdbx->period = 0;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_rdbx_init_in(srtp_rdbx_t *rdbx,
+                                    size_t ws,
+                                    uint64_t *bitmask)
+{
+    if (ws == 0 || bitmask == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    rdbx->bitmask = bitmask;
+    rdbx->owns_bitmask = false;
+    srtp_replay_window_init(&rdbx->window, rdbx->bitmask, ws);
     srtp_index_init(&rdbx->index);
+    rdbx->base_bitmask = rdbx->bitmask;
+    rdbx->base_length = rdbx->window.length;
+    rdbx->max_length = rdbx->window.length;
+    rdbx->depth = 0;
+    rdbx->period = 0;
 
     return srtp_err_status_ok;
 }
 
+/*
+ *  srtp_rdbx_reset(&r) clears the window and index of the srtp_rdbx_t
+ *  pointed to by r, keeping its initial window size and memory
+ */
+void srtp_rdbx_reset(srtp_rdbx_t *rdbx)
+{
+    if (rdbx->bitmask != rdbx->base_bitmask) {
+        srtp_crypto_free(rdbx->bitmask);
+        rdbx->bitmask = rdbx->base_bitmask;
+        srtp_replay_window_init(&rdbx->window, rdbx->bitmask,
+                                rdbx->base_length);
+    } else {
+        srtp_replay_window_clear(&rdbx->window, rdbx->bitmask);
+    }
+
+    srtp_index_init(&rdbx->index);
+    rdbx->depth = 0;
+    rdbx->period = 0;
+}
+
 /*
  *  srtp_rdbx_dealloc(&r) frees memory for the srtp_rdbx_t pointed to by r
  */
 srtp_err_status_t srtp_rdbx_dealloc(srtp_rdbx_t *rdbx)
 {
-    bitvector_dealloc(&rdbx->bitmask);
+    if (rdbx->bitmask != NULL && rdbx->bitmask != rdbx->base_bitmask) {
+        srtp_crypto_free(rdbx->bitmask);
+    }
+    if (rdbx->base_bitmask != NULL && rdbx->owns_bitmask) {
+        srtp_crypto_free(rdbx->base_bitmask);
+    }
+    rdbx->bitmask = NULL;
+    rdbx->base_bitmask = NULL;
 
     return srtp_err_status_ok;
 }
 
+srtp_err_status_t srtp_rdbx_set_max_window_size(srtp_rdbx_t *rdbx,
+                                                size_t max_ws)
+{
+    size_t max_length = SRTP_REPLAY_WINDOW_WORDS(max_ws) * 64;
+
+    if (max_length < rdbx->base_length) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (rdbx->window.length > max_length) {
+        srtp_err_status_t status = srtp_rdbx_resize(rdbx, rdbx->base_length);
+        if (status) {
+            return status;
+        }
+    }
+    rdbx->max_length = max_length;
+    rdbx->depth = 0;
+    rdbx->period = 0;
+
+    return srtp_err_status_ok;
+}
+
+size_t srtp_rdbx_get_max_window_size(const srtp_rdbx_t *rdbx)
+{
+    return rdbx->max_length;
+}
+
+/*
+ * srtp_rdbx_resize(&r, ws) moves the window of r to memory for ws bits,
+ * which is the initial memory for the initial size; the window is
+ * copied bit by bit, which is rare enough not to matter
+ */
+srtp_err_status_t srtp_rdbx_resize(srtp_rdbx_t *rdbx, size_t ws)
+{
+    srtp_replay_window_t window;
+    uint64_t *words;
+    size_t kept;
+
+    if (ws % 64 != 0 || ws < rdbx->base_length || ws > rdbx->max_length) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (ws == rdbx->window.length) {
+        return srtp_err_status_ok;
+    }
+
+    if (ws == rdbx->base_length) {
+        words = rdbx->base_bitmask;
+    } else {
+        words = (uint64_t *)srtp_crypto_alloc(SRTP_REPLAY_WINDOW_WORDS(ws) *
+                                              sizeof(uint64_t));
+        if (words == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+    }
+    srtp_replay_window_init(&window, words, ws);
+
+    kept = ws < rdbx->window.length ? ws : rdbx->window.length;
+    for (size_t age = 0; age < kept; age++) {
+        if (srtp_replay_window_test(&rdbx->window, rdbx->bitmask, age)) {
+            srtp_replay_window_set(&window, words, age);
+        }
+    }
+    for (size_t age = kept; age < ws; age++) {
+        srtp_replay_window_set(&window, words, age);
+    }
+
+    if (rdbx->bitmask != rdbx->base_bitmask) {
+        srtp_crypto_free(rdbx->bitmask);
+    }
+    rdbx->bitmask = words;
+    rdbx->window = window;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_rdbx_adapt(&r, delta) follows the reordering of the accepted
+ * index at r->index + delta: the window doubles, up to its maximum, when
+ * the index is half of it old or more, and halves, down to its initial
+ * size, at the end of a period in which no index was a quarter of it old
+ */
+static void srtp_rdbx_adapt(srtp_rdbx_t *rdbx, ssize_t delta)
+{
+    size_t length = rdbx->window.length;
+
+    if (delta > 0) {
+        rdbx->period += (size_t)delta;
+        if (rdbx->period < SRTP_RDBX_ADAPT_PERIOD) {
+            return;
+        }
+        if (length > rdbx->base_length && rdbx->depth < length / 4) {
+            size_t half = SRTP_REPLAY_WINDOW_WORDS(length / 2) * 64;
+
+            srtp_rdbx_resize(rdbx,
+                             half > rdbx->base_length ? half
+                                                      : rdbx->base_length);
+        }
+        rdbx->depth = 0;
+        rdbx->period = 0;
+        return;
+    }
+
+    if ((size_t)-delta > rdbx->depth) {
+        rdbx->depth = (size_t)-delta;
+    }
+    if ((size_t)-delta >= length / 2 && length < rdbx->max_length) {
+        /* a failed allocation keeps the current window */
+        srtp_rdbx_resize(rdbx, 2 * length < rdbx->max_length
+                                   ? 2 * length
+                                   : rdbx->max_length);
+    }
+}
+
 /*
  * srtp_rdbx_set_roc(rdbx, roc) initializes the srtp_rdbx_t at the location rdbx
  * to have the rollover counter value roc.  If that value is less than
@@ -187,7 +365,7 @@ srtp_err_status_t srtp_rdbx_dealloc(srtp_rdbx_t *rdbx)
  */
 srtp_err_status_t srtp_rdbx_set_roc(srtp_rdbx_t *rdbx, uint32_t roc)
 {
-    bitvector_set_to_zero(&rdbx->bitmask);
+    srtp_replay_window_clear(&rdbx->window, rdbx->bitmask);
 
     /* make sure that we're not moving backwards */
     if (roc < (rdbx->index >> 16)) {
@@ -217,7 +395,12 @@ srtp_xtd_seq_num_t srtp_rdbx_get_packet_index(const srtp_rdbx_t *rdbx)
  */
 size_t srtp_rdbx_get_window_size(const srtp_rdbx_t *rdbx)
 {
-    return bitvector_get_length(&rdbx->bitmask);
+    return rdbx->base_length;
+}
+
+size_t srtp_rdbx_get_current_window_size(const srtp_rdbx_t *rdbx)
+{
+    return rdbx->window.length;
 }
 
 /*
@@ -228,12 +411,11 @@ srtp_err_status_t srtp_rdbx_check(const srtp_rdbx_t *rdbx, ssize_t delta)
 {
     if (delta > 0) { /* if delta is positive, it's good */
         return srtp_err_status_ok;
-    } else if ((int)(bitvector_get_length(&rdbx->bitmask) - 1) + delta < 0) {
+    } else if ((ssize_t)(rdbx->window.length - 1) + delta < 0) {
         /* if delta is lower than the bitmask, it's bad */
         return srtp_err_status_replay_old;
-    } else if (bitvector_get_bit(&rdbx->bitmask,
-                                 (bitvector_get_length(&rdbx->bitmask) - 1) +
-                                     delta) == 1) {
+    } else if (srtp_replay_window_test(&rdbx->window, rdbx->bitmask,
+                                       (size_t)-delta)) {
         /* delta is within the window, so check the bitmask */
         return srtp_err_status_replay_fail;
     }
@@ -253,19 +435,21 @@ srtp_err_status_t srtp_rdbx_check(const srtp_rdbx_t *rdbx, ssize_t delta)
 srtp_err_status_t srtp_rdbx_add_index(srtp_rdbx_t *rdbx, ssize_t delta)
 {
     if (delta > 0) {
-        /* shift forward by delta */
+        /* move the window forward by delta, clearing the bits it passes */
         srtp_index_advance(&rdbx->index, (srtp_sequence_number_t)delta);
-        bitvector_left_shift(&rdbx->bitmask, delta);
-        bitvector_set_bit(&rdbx->bitmask,
-                          bitvector_get_length(&rdbx->bitmask) - 1);
+        srtp_replay_window_advance(&rdbx->window, rdbx->bitmask,
+                                   (size_t)delta);
     } else {
         /* delta is in window */
-        bitvector_set_bit(&rdbx->bitmask,
-                          bitvector_get_length(&rdbx->bitmask) - 1 + delta);
+        srtp_replay_window_set(&rdbx->window, rdbx->bitmask, (size_t)-delta);
     }
 
     /* note that we need not consider the case that delta == 0 */
 
+    if (rdbx->max_length > rdbx->base_length) {
+        srtp_rdbx_adapt(rdbx, delta);
+    }
+
     return srtp_err_status_ok;
 }
 
@@ -298,6 +482,49 @@ ssize_t srtp_rdbx_estimate_index(const srtp_rdbx_t *rdbx,
     return s - rdbx->index;
 }
 
+/*
+ * srtp_rdbx_estimate_indices(rdbx, s, num, guess, delta) makes the choice
+ * of srtp_index_guess() between the rollover counters around that of the
+ * local index once for the whole run, leaving only arithmetic per packet
+ */
+void srtp_rdbx_estimate_indices(const srtp_rdbx_t *rdbx,
+                                const srtp_sequence_number_t *s,
+                                size_t num,
+                                srtp_xtd_seq_num_t *guess,
+                                ssize_t *delta)
+{
+    uint32_t local_roc = (uint32_t)(rdbx->index >> 16);
+    uint16_t local_seq = (uint16_t)rdbx->index;
+
+    if (rdbx->index <= seq_num_median) {
+        for (size_t i = 0; i < num; i++) {
+            guess[i] = s[i];
+            delta[i] = (ssize_t)(s[i] - rdbx->index);
+        }
+        return;
+    }
+
+    if (local_seq < seq_num_median) {
+        /* a sequence number far above the local one is from before it */
+        for (size_t i = 0; i < num; i++) {
+            ssize_t d = (ssize_t)s[i] - local_seq;
+            uint32_t back = d > seq_num_median;
+
+            guess[i] = ((uint64_t)(local_roc - back) << 16) | s[i];
+            delta[i] = d - (ssize_t)back * seq_num_max;
+        }
+    } else {
+        /* one far below the local one is from after the next rollover */
+        for (size_t i = 0; i < num; i++) {
+            ssize_t d = (ssize_t)s[i] - local_seq;
+            uint32_t ahead = local_seq - seq_num_median > s[i];
+
+            guess[i] = ((uint64_t)(local_roc + ahead) << 16) | s[i];
+            delta[i] = d + (ssize_t)ahead * seq_num_max;
+        }
+    }
+}
+
 /*
  * srtp_rdbx_get_roc(rdbx)
  *
@@ -332,7 +559,7 @@ srtp_err_status_t srtp_rdbx_set_roc_seq(srtp_rdbx_t *rdbx,
     rdbx->index = seq;
     rdbx->index |= ((uint64_t)roc) << 16; /* set ROC */
 
-    bitvector_set_to_zero(&rdbx->bitmask);
+    srtp_replay_window_clear(&rdbx->window, rdbx->bitmask);
 
     return srtp_err_status_ok;
 }
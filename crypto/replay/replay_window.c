@@ -0,0 +1,118 @@
+/*
+ * replay_window.c
+ *
+ * a circular bitmask of recently received packet indices, shared by the
+ * SRTP and SRTCP replay databases
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "replay_window.h"
+
+#include <string.h>
+
+void srtp_replay_window_init(srtp_replay_window_t *w,
+                             uint64_t *word,
+                             size_t ws)
+{
+    w->length = SRTP_REPLAY_WINDOW_WORDS(ws) * 64;
+    w->head = w->length - 1;
+    srtp_replay_window_clear(w, word);
+}
+
+void srtp_replay_window_clear(const srtp_replay_window_t *w, uint64_t *word)
+{
+    memset(word, 0, w->length / 8);
+}
+
+void srtp_replay_window_advance(srtp_replay_window_t *w,
+                                uint64_t *word,
+                                size_t n)
+{
+    size_t bit;
+
+    if (n >= w->length) {
+        srtp_replay_window_clear(w, word);
+        w->head = (w->head + n) % w->length;
+        word[w->head >> 6] |= (uint64_t)1 << (w->head & 63);
+        return;
+    }
+
+    /* clear the n bits after head, whole words at a time where possible */
+    bit = w->head + 1;
+    w->head += n;
+    if (w->head >= w->length) {
+        w->head -= w->length;
+    }
+
+    while (n > 0) {
+        size_t offset, count;
+
+        if (bit == w->length) {
+            bit = 0;
+        }
+
+        offset = bit & 63;
+        if (offset == 0 && n >= 64) {
+            /* the length is a multiple of 64, so whole words never wrap */
+            size_t words = n / 64;
+            size_t left = (w->length - bit) / 64;
+            if (words > left) {
+                words = left;
+            }
+            memset(&word[bit >> 6], 0, words * sizeof(uint64_t));
+            count = words * 64;
+        } else {
+            /* less than a whole word, so count < 64 */
+            count = 64 - offset;
+            if (count > n) {
+                count = n;
+            }
+            word[bit >> 6] &= ~((((uint64_t)1 << count) - 1) << offset);
+        }
+
+        bit += count;
+        n -= count;
+    }
+
+    word[w->head >> 6] |= (uint64_t)1 << (w->head & 63);
+}
@@ -50,12 +50,22 @@
 #include "getopt_s.h"
 #include "cipher.h"
 #include "cipher_priv.h"
+#include "auth.h"
 #include "datatypes.h"
 #include "alloc.h"
 #include "util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+#if defined(GCM) && defined(OPENSSL)
+#include <openssl/evp.h>
+#endif
+
+#ifdef NSS
+#include "aes_icm_ext.h"
+#endif
 
 #define PRINT_DEBUG 0
 
@@ -67,11 +77,32 @@ srtp_err_status_t cipher_driver_test_api(srtp_cipher_type_t *ct,
                                          size_t key_len,
                                          size_t tag_len);
 
+srtp_err_status_t cipher_driver_test_clone(srtp_cipher_type_t *ct,
+                                           size_t key_len,
+                                           size_t tag_len);
+
 srtp_err_status_t cipher_driver_test_multi_aes_icm_128(void);
 #ifdef GCM
 srtp_err_status_t cipher_driver_test_multi_aes_gcm_128(void);
 #endif
 
+#if defined(GCM) && defined(OPENSSL)
+/*
+ * cipher_driver_compare_gcm_openssl(c, key) times the cipher api of the
+ * openssl GCM cipher against encrypting with the plain EVP_EncryptInit_ex,
+ * EVP_EncryptUpdate, EVP_EncryptFinal_ex and tag ctrl sequence
+ */
+void cipher_driver_compare_gcm_openssl(srtp_cipher_t *c, const uint8_t *key);
+#endif
+
+#ifdef NSS
+/*
+ * cipher_driver_compare_icm_nss(c, key) times the NSS counter mode cipher
+ * against creating a PK11 CTR context for the iv of each packet
+ */
+void cipher_driver_compare_icm_nss(srtp_cipher_t *c, const uint8_t *key);
+#endif
+
 /*
  * cipher_driver_test_buffering(ct) tests the cipher's output
  * buffering for correctness by checking the consistency of successive
@@ -89,6 +120,30 @@ srtp_err_status_t cipher_driver_test_array_throughput(srtp_cipher_type_t *ct,
 
 void cipher_array_test_throughput(srtp_cipher_t *ca[], size_t num_cipher);
 
+/*
+ * cipher_driver_test_key_agility(ct, klen) times packets of typical
+ * audio and video sizes, each with a new IV, and for growing numbers of
+ * keys, so that a per packet cost of setting the IV, like expanding the
+ * key again, shows up as a drop against the larger packets
+ */
+srtp_err_status_t cipher_driver_test_key_agility(srtp_cipher_type_t *ct,
+                                                 size_t klen);
+
+/*
+ * cipher_driver_test_key_setup(ct, klen) and
+ * cipher_driver_test_auth_key_setup(at, klen, tlen) time re-keying a
+ * single context while cycling over a growing number of random keys, so
+ * that a backend which only does well while the key stays the same shows
+ * a drop with more keys
+ */
+srtp_err_status_t cipher_driver_test_key_setup(srtp_cipher_type_t *ct,
+                                               size_t klen);
+
+srtp_err_status_t cipher_driver_test_auth_key_setup(
+    const srtp_auth_type_t *at,
+    size_t klen,
+    size_t tlen);
+
 uint64_t cipher_array_bits_per_second(srtp_cipher_t *cipher_array[],
                                       size_t num_cipher,
                                       size_t octets_in_buffer,
@@ -116,12 +171,19 @@ void usage(char *prog_name)
 
 extern srtp_cipher_type_t srtp_null_cipher;
 extern srtp_cipher_type_t srtp_aes_icm_128;
+#ifndef SRTP_NO_AES_256
 extern srtp_cipher_type_t srtp_aes_icm_256;
+#endif
 #ifdef GCM
+#ifndef SRTP_NO_AES_192
 extern srtp_cipher_type_t srtp_aes_icm_192;
+#endif
 extern srtp_cipher_type_t srtp_aes_gcm_128;
+#ifndef SRTP_NO_AES_256
 extern srtp_cipher_type_t srtp_aes_gcm_256;
 #endif
+#endif
+extern const srtp_auth_type_t srtp_hmac;
 
 int main(int argc, char *argv[])
 {
@@ -167,6 +229,11 @@ int main(int argc, char *argv[])
            "David A. McGrew\n"
            "Cisco Systems, Inc.\n");
 
+#if defined(MBEDTLS) && defined(SRTP_PSA_KEY_LOCATION)
+    /* tells runs with keys in a PSA driver from runs with local keys */
+    printf("PSA key location: 0x%06x\n", (unsigned)(SRTP_PSA_KEY_LOCATION));
+#endif
+
     if (!do_validation && !do_timing_test && !do_array_timing_test) {
         usage(argv[0]);
     }
@@ -186,43 +253,88 @@ int main(int argc, char *argv[])
                 &srtp_aes_icm_128, SRTP_AES_ICM_128_KEY_LEN_WSALT, num_cipher);
         }
 
+#ifndef SRTP_NO_AES_256
         for (num_cipher = 1; num_cipher < max_num_cipher; num_cipher *= 8) {
             cipher_driver_test_array_throughput(
                 &srtp_aes_icm_256, SRTP_AES_ICM_256_KEY_LEN_WSALT, num_cipher);
         }
+#endif
+
+        cipher_driver_test_key_agility(&srtp_aes_icm_128,
+                                       SRTP_AES_ICM_128_KEY_LEN_WSALT);
+#ifndef SRTP_NO_AES_256
+        cipher_driver_test_key_agility(&srtp_aes_icm_256,
+                                       SRTP_AES_ICM_256_KEY_LEN_WSALT);
+#endif
+        cipher_driver_test_key_setup(&srtp_aes_icm_128,
+                                     SRTP_AES_ICM_128_KEY_LEN_WSALT);
+#ifndef SRTP_NO_AES_256
+        cipher_driver_test_key_setup(&srtp_aes_icm_256,
+                                     SRTP_AES_ICM_256_KEY_LEN_WSALT);
+#endif
+        cipher_driver_test_auth_key_setup(&srtp_hmac, 20, 10);
 
 #ifdef GCM
+#ifndef SRTP_NO_AES_192
         for (num_cipher = 1; num_cipher < max_num_cipher; num_cipher *= 8) {
             cipher_driver_test_array_throughput(
                 &srtp_aes_icm_192, SRTP_AES_ICM_192_KEY_LEN_WSALT, num_cipher);
         }
+#endif
 
         for (num_cipher = 1; num_cipher < max_num_cipher; num_cipher *= 8) {
             cipher_driver_test_array_throughput(
                 &srtp_aes_gcm_128, SRTP_AES_GCM_128_KEY_LEN_WSALT, num_cipher);
         }
 
+#ifndef SRTP_NO_AES_256
         for (num_cipher = 1; num_cipher < max_num_cipher; num_cipher *= 8) {
             cipher_driver_test_array_throughput(
                 &srtp_aes_gcm_256, SRTP_AES_GCM_256_KEY_LEN_WSALT, num_cipher);
         }
+#endif
+
+        cipher_driver_test_key_agility(&srtp_aes_gcm_128,
+                                       SRTP_AES_GCM_128_KEY_LEN_WSALT);
+#ifndef SRTP_NO_AES_256
+        cipher_driver_test_key_agility(&srtp_aes_gcm_256,
+                                       SRTP_AES_GCM_256_KEY_LEN_WSALT);
+#endif
+        cipher_driver_test_key_setup(&srtp_aes_gcm_128,
+                                     SRTP_AES_GCM_128_KEY_LEN_WSALT);
+#ifndef SRTP_NO_AES_256
+        cipher_driver_test_key_setup(&srtp_aes_gcm_256,
+                                     SRTP_AES_GCM_256_KEY_LEN_WSALT);
+#endif
 #endif
     }
 
     if (do_validation) {
         cipher_driver_self_test(&srtp_null_cipher);
         cipher_driver_self_test(&srtp_aes_icm_128);
+#ifndef SRTP_NO_AES_256
         cipher_driver_self_test(&srtp_aes_icm_256);
+#endif
 #ifdef GCM
+#ifndef SRTP_NO_AES_192
         cipher_driver_self_test(&srtp_aes_icm_192);
+#endif
         cipher_driver_self_test(&srtp_aes_gcm_128);
+#ifndef SRTP_NO_AES_256
         cipher_driver_self_test(&srtp_aes_gcm_256);
+#endif
 #endif
         cipher_driver_test_api(&srtp_aes_icm_128,
                                SRTP_AES_ICM_128_KEY_LEN_WSALT, 0);
 #ifdef GCM
         cipher_driver_test_api(&srtp_aes_gcm_128,
                                SRTP_AES_GCM_128_KEY_LEN_WSALT, 16);
+#endif
+        cipher_driver_test_clone(&srtp_aes_icm_128,
+                                 SRTP_AES_ICM_128_KEY_LEN_WSALT, 0);
+#ifdef GCM
+        cipher_driver_test_clone(&srtp_aes_gcm_128,
+                                 SRTP_AES_GCM_128_KEY_LEN_WSALT, 16);
 #endif
         cipher_driver_test_multi_aes_icm_128();
 #ifdef GCM
@@ -260,6 +372,9 @@ int main(int argc, char *argv[])
 
     if (do_timing_test) {
         cipher_driver_test_throughput(c);
+#ifdef NSS
+        cipher_driver_compare_icm_nss(c, test_key);
+#endif
     }
 
     if (do_validation) {
@@ -270,6 +385,7 @@ int main(int argc, char *argv[])
     status = srtp_cipher_dealloc(c);
     CHECK_OK(status);
 
+#ifndef SRTP_NO_AES_256
     /* repeat the tests with 256-bit keys */
     status = srtp_cipher_type_alloc(&srtp_aes_icm_256, &c,
                                     SRTP_AES_ICM_256_KEY_LEN_WSALT, 0);
@@ -292,6 +408,7 @@ int main(int argc, char *argv[])
 
     status = srtp_cipher_dealloc(c);
     CHECK_OK(status);
+#endif
 
 #ifdef GCM
     /* run the throughput test on the aes_gcm_128 cipher */
@@ -305,6 +422,9 @@ int main(int argc, char *argv[])
     CHECK_OK(status);
     if (do_timing_test) {
         cipher_driver_test_throughput(c);
+#ifdef OPENSSL
+        cipher_driver_compare_gcm_openssl(c, test_key);
+#endif
     }
 
     // GCM ciphers don't do buffering; they're "one shot"
@@ -312,6 +432,7 @@ int main(int argc, char *argv[])
     status = srtp_cipher_dealloc(c);
     CHECK_OK(status);
 
+#ifndef SRTP_NO_AES_256
     /* run the throughput test on the aes_gcm_256 cipher */
     status = srtp_cipher_type_alloc(&srtp_aes_gcm_256, &c,
                                     SRTP_AES_GCM_256_KEY_LEN_WSALT, 16);
@@ -329,6 +450,7 @@ int main(int argc, char *argv[])
 
     status = srtp_cipher_dealloc(c);
     CHECK_OK(status);
+#endif
 #endif
 
     return 0;
@@ -355,6 +477,159 @@ void cipher_driver_test_throughput(srtp_cipher_t *c)
     }
 }
 
+#if defined(GCM) && defined(OPENSSL)
+static uint64_t evp_gcm_bits_per_second(EVP_CIPHER_CTX *ctx,
+                                        size_t octets_in_buffer,
+                                        size_t num_trials)
+{
+    uint8_t enc_buf[1400 + 16];
+    uint8_t aad[4] = { 0, 0, 0, 0 };
+    v128_t nonce;
+    clock_t timer;
+    int len;
+
+    if (octets_in_buffer > 1400) {
+        return 0;
+    }
+
+    v128_set_to_zero(&nonce);
+    memset(enc_buf, 0, sizeof(enc_buf));
+    timer = clock();
+    for (size_t i = 0; i < num_trials; i++, nonce.v32[3] = (uint32_t)i) {
+        if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce.v8) != 1 ||
+            EVP_EncryptUpdate(ctx, NULL, &len, aad, sizeof(aad)) != 1 ||
+            EVP_EncryptUpdate(ctx, enc_buf, &len, enc_buf,
+                              (int)octets_in_buffer) != 1 ||
+            EVP_EncryptFinal_ex(ctx, enc_buf + len, &len) != 1 ||
+            EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16,
+                                enc_buf + octets_in_buffer) != 1) {
+            return 0;
+        }
+    }
+    timer = clock() - timer;
+
+    if (timer == 0) {
+        return 0;
+    }
+
+    return (uint64_t)CLOCKS_PER_SEC * num_trials * 8 * octets_in_buffer / timer;
+}
+
+void cipher_driver_compare_gcm_openssl(srtp_cipher_t *c, const uint8_t *key)
+{
+    const size_t lens[] = { 64, 160, 320, 640, 1024, 1400 };
+    size_t num_trials = 1000000;
+    EVP_CIPHER_CTX *ctx;
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL ||
+        EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, NULL) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, 12, NULL) != 1) {
+        printf("error: can't set up EVP context\n");
+        exit(1);
+    }
+
+    printf("comparing %s against the EVP call sequence:\n",
+           c->type->description);
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        uint64_t api = srtp_cipher_bits_per_second(c, lens[i], num_trials);
+        uint64_t evp = evp_gcm_bits_per_second(ctx, lens[i], num_trials);
+        if (api == 0 || evp == 0) {
+            printf("error: throughput test failed\n");
+            exit(1);
+        }
+        printf("msg len: %zu\tgigabits per second: cipher api %f, "
+               "EVP sequence %f\n",
+               lens[i], api / 1e9, evp / 1e9);
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+}
+#endif
+
+#ifdef NSS
+static uint64_t pk11_ctr_bits_per_second(PK11SymKey *key,
+                                         size_t octets_in_buffer,
+                                         size_t num_trials)
+{
+    uint8_t enc_buf[1400];
+    CK_AES_CTR_PARAMS param;
+    SECItem param_item = { siBuffer, (unsigned char *)&param, sizeof(param) };
+    clock_t timer;
+    int len;
+
+    if (octets_in_buffer > sizeof(enc_buf)) {
+        return 0;
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.ulCounterBits = 16;
+    memset(enc_buf, 0, sizeof(enc_buf));
+    timer = clock();
+    for (size_t i = 0; i < num_trials; i++) {
+        PK11Context *ctx;
+        SECStatus rv;
+
+        memcpy(param.cb + 8, &i, sizeof(uint32_t));
+        ctx = PK11_CreateContextBySymKey(CKM_AES_CTR, CKA_ENCRYPT, key,
+                                         &param_item);
+        if (ctx == NULL) {
+            return 0;
+        }
+        rv = PK11_CipherOp(ctx, enc_buf, &len, (int)octets_in_buffer, enc_buf,
+                           (int)octets_in_buffer);
+        PK11_DestroyContext(ctx, PR_TRUE);
+        if (rv != SECSuccess) {
+            return 0;
+        }
+    }
+    timer = clock() - timer;
+
+    if (timer == 0) {
+        return 0;
+    }
+
+    return (uint64_t)CLOCKS_PER_SEC * num_trials * 8 * octets_in_buffer / timer;
+}
+
+void cipher_driver_compare_icm_nss(srtp_cipher_t *c, const uint8_t *key)
+{
+    const size_t lens[] = { 64, 160, 320, 640, 1024, 1400 };
+    size_t num_trials = 100000;
+    SECItem key_item = { siBuffer, (unsigned char *)(uintptr_t)key,
+                         SRTP_AES_128_KEY_LEN };
+    PK11SlotInfo *slot;
+    PK11SymKey *sym_key = NULL;
+
+    slot = PK11_GetBestSlot(CKM_AES_CTR, NULL);
+    if (slot != NULL) {
+        sym_key = PK11_ImportSymKey(slot, CKM_AES_CTR, PK11_OriginUnwrap,
+                                    CKA_ENCRYPT, &key_item, NULL);
+        PK11_FreeSlot(slot);
+    }
+    if (sym_key == NULL) {
+        printf("error: can't import key into NSS\n");
+        exit(1);
+    }
+
+    printf("comparing %s against a CTR context per packet:\n",
+           c->type->description);
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        uint64_t api = srtp_cipher_bits_per_second(c, lens[i], num_trials);
+        uint64_t ctr = pk11_ctr_bits_per_second(sym_key, lens[i], num_trials);
+        if (api == 0 || ctr == 0) {
+            printf("error: throughput test failed\n");
+            exit(1);
+        }
+        printf("msg len: %zu\tgigabits per second: cipher api %f, "
+               "context per packet %f\n",
+               lens[i], api / 1e9, ctr / 1e9);
+    }
+
+    PK11_FreeSymKey(sym_key);
+}
+#endif
+
 srtp_err_status_t cipher_driver_self_test(srtp_cipher_type_t *ct)
 {
     srtp_err_status_t status;
@@ -529,6 +804,109 @@ srtp_err_status_t cipher_driver_test_api(srtp_cipher_type_t *ct,
     return srtp_err_status_ok;
 }
 
+/*
+ * cipher_driver_test_clone(ct, key_len, tag_len) checks that a clone of a
+ * cipher produces the same output as the original and that setting the iv
+ * of one does not affect the other, ciphers that can not be cloned pass
+ */
+srtp_err_status_t cipher_driver_test_clone(srtp_cipher_type_t *ct,
+                                           size_t key_len,
+                                           size_t tag_len)
+{
+    srtp_err_status_t status;
+    srtp_cipher_t *c = NULL;
+    srtp_cipher_t *clone = NULL;
+
+    /* clang-format off */
+    uint8_t test_key[48] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+        0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+        0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+        0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+    };
+    uint8_t iv[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    uint8_t other_iv[16] = {
+        0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87,
+        0x78, 0x69, 0x5a, 0x4b, 0x3c, 0x2d, 0x1e};
+    /* clang-format on */
+    uint8_t plaintext[50];
+    uint8_t reference[66];
+    uint8_t encrypted[66];
+    uint8_t decrypted[66];
+    size_t len;
+
+    printf("testing cipher clone for %s...", ct->description);
+    fflush(stdout);
+
+    for (size_t i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = (uint8_t)i;
+    }
+
+    status = srtp_cipher_type_alloc(ct, &c, key_len, tag_len);
+    CHECK_OK(status);
+
+    reint_cipher(c, test_key, iv, srtp_direction_encrypt);
+    len = sizeof(reference);
+    status = srtp_cipher_encrypt(c, plaintext, sizeof(plaintext), reference,
+                                 &len);
+    CHECK_OK(status);
+    CHECK(len == sizeof(plaintext) + tag_len);
+
+    status = srtp_cipher_clone(c, &clone);
+    if (status == srtp_err_status_no_such_op) {
+        srtp_cipher_dealloc(c);
+        printf("not supported\n");
+        return srtp_err_status_ok;
+    }
+    CHECK_OK(status);
+    CHECK(clone->type == c->type);
+    CHECK(clone->algorithm == c->algorithm);
+
+    /* the clone's iv must not change the original's */
+    status = srtp_cipher_set_iv(c, iv, srtp_direction_encrypt);
+    CHECK_OK(status);
+    status = srtp_cipher_set_iv(clone, other_iv, srtp_direction_encrypt);
+    CHECK_OK(status);
+
+    len = sizeof(encrypted);
+    status = srtp_cipher_encrypt(c, plaintext, sizeof(plaintext), encrypted,
+                                 &len);
+    CHECK_OK(status);
+    CHECK_BUFFER_EQUAL(reference, encrypted, len);
+
+    /* and the clone must keep working once the original is gone */
+    status = srtp_cipher_dealloc(c);
+    CHECK_OK(status);
+
+    status = srtp_cipher_set_iv(clone, iv, srtp_direction_encrypt);
+    CHECK_OK(status);
+    len = sizeof(encrypted);
+    status = srtp_cipher_encrypt(clone, plaintext, sizeof(plaintext),
+                                 encrypted, &len);
+    CHECK_OK(status);
+    CHECK_BUFFER_EQUAL(reference, encrypted, len);
+
+    status = srtp_cipher_set_iv(clone, iv, srtp_direction_decrypt);
+    CHECK_OK(status);
+    len = sizeof(decrypted);
+    status = srtp_cipher_decrypt(clone, reference, sizeof(plaintext) + tag_len,
+                                 decrypted, &len);
+    CHECK_OK(status);
+    CHECK(len == sizeof(plaintext));
+    CHECK_BUFFER_EQUAL(plaintext, decrypted, len);
+
+    status = srtp_cipher_dealloc(clone);
+    CHECK_OK(status);
+
+    printf("passed\n");
+
+    return srtp_err_status_ok;
+}
+
 srtp_err_status_t cipher_driver_test_multi_aes_icm_128(void)
 {
     /* clang-format off */
@@ -1157,3 +1535,174 @@ srtp_err_status_t cipher_driver_test_array_throughput(srtp_cipher_type_t *ct,
 
     return srtp_err_status_ok;
 }
+
+srtp_err_status_t cipher_driver_test_key_agility(srtp_cipher_type_t *ct,
+                                                 size_t klen)
+{
+    const size_t lens[] = { 20, 60, 160, 320, 1200 };
+    const size_t num_ciphers[] = { 1, 16, 256 };
+    size_t num_trials = 200000;
+    srtp_cipher_t **ca = NULL;
+    srtp_err_status_t status;
+
+    for (size_t n = 0; n < sizeof(num_ciphers) / sizeof(num_ciphers[0]);
+         n++) {
+        status = cipher_array_alloc_init(&ca, num_ciphers[n], ct, klen);
+        if (status) {
+            printf("error: cipher_array_alloc_init() failed with error code "
+                   "%d\n",
+                   status);
+            return status;
+        }
+
+        printf("timing %s small packets with key length %zu, %zu keys:\n",
+               ca[0]->type->description, ca[0]->key_len, num_ciphers[n]);
+        for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            uint64_t bps = cipher_array_bits_per_second(ca, num_ciphers[n],
+                                                        lens[i], num_trials);
+            printf("msg len: %zu\tpackets per second: %.0f\t"
+                   "gigabits per second: %f\n",
+                   lens[i], bps / (8.0 * lens[i]), bps / 1e9);
+        }
+
+        cipher_array_delete(ca, num_ciphers[n]);
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t cipher_driver_test_key_setup(srtp_cipher_type_t *ct,
+                                               size_t klen)
+{
+    const size_t num_keys[] = { 1, 16, 256 };
+    const size_t max_keys = 256;
+    const size_t num_trials = 100000;
+    /* room for aes_icm reading 16 bytes for the 14-byte salt */
+    const size_t klen_pad = ((klen + 15) >> 4) << 4;
+    srtp_cipher_t *c = NULL;
+    uint8_t *keys;
+    uint8_t buf[64];
+    v128_t nonce;
+    srtp_err_status_t status;
+
+    keys = srtp_crypto_alloc(klen_pad * max_keys);
+    if (keys == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    for (size_t i = 0; i < max_keys; i++) {
+        srtp_cipher_rand_for_tests(keys + i * klen_pad, klen);
+    }
+
+    status = srtp_cipher_type_alloc(ct, &c, klen, 16);
+    if (status) {
+        printf("error: can't allocate cipher\n");
+        srtp_crypto_free(keys);
+        return status;
+    }
+
+    printf("timing %s key setup with key length %zu:\n", c->type->description,
+           c->key_len);
+    v128_set_to_zero(&nonce);
+    memset(buf, 0, sizeof(buf));
+    for (size_t n = 0; n < sizeof(num_keys) / sizeof(num_keys[0]); n++) {
+        clock_t init_time;
+        clock_t first_time;
+
+        /* only the key setup */
+        init_time = clock();
+        for (size_t i = 0; i < num_trials; i++) {
+            srtp_cipher_init(c, keys + (i % num_keys[n]) * klen_pad);
+        }
+        init_time = clock() - init_time;
+
+        /* key setup followed by the first packet under that key */
+        first_time = clock();
+        for (size_t i = 0; i < num_trials; i++) {
+            size_t len = 20;
+            srtp_cipher_init(c, keys + (i % num_keys[n]) * klen_pad);
+            srtp_cipher_set_iv(c, (uint8_t *)&nonce, srtp_direction_encrypt);
+            srtp_cipher_encrypt(c, buf, len, buf, &len);
+        }
+        first_time = clock() - first_time;
+
+        if (init_time == 0 || first_time == 0) {
+            /* too fast to measure */
+            continue;
+        }
+        printf("keys: %zu\tkey setups per second: %.0f\t"
+               "with first packet: %.0f\n",
+               num_keys[n], (double)num_trials * CLOCKS_PER_SEC / init_time,
+               (double)num_trials * CLOCKS_PER_SEC / first_time);
+    }
+
+    srtp_cipher_dealloc(c);
+    srtp_crypto_free(keys);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t cipher_driver_test_auth_key_setup(
+    const srtp_auth_type_t *at,
+    size_t klen,
+    size_t tlen)
+{
+    const size_t num_keys[] = { 1, 16, 256 };
+    const size_t max_keys = 256;
+    const size_t num_trials = 100000;
+    srtp_auth_t *a = NULL;
+    uint8_t *keys;
+    uint8_t buf[64];
+    uint8_t tag[20]; /* the longest HMAC-SHA1 tag */
+    srtp_err_status_t status;
+
+    keys = srtp_crypto_alloc(klen * max_keys);
+    if (keys == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    for (size_t i = 0; i < max_keys; i++) {
+        srtp_cipher_rand_for_tests(keys + i * klen, klen);
+    }
+
+    status = srtp_auth_type_alloc(at, &a, klen, tlen);
+    if (status) {
+        printf("error: can't allocate auth\n");
+        srtp_crypto_free(keys);
+        return status;
+    }
+
+    printf("timing %s key setup with key length %zu:\n", at->description,
+           klen);
+    memset(buf, 0, sizeof(buf));
+    for (size_t n = 0; n < sizeof(num_keys) / sizeof(num_keys[0]); n++) {
+        clock_t init_time;
+        clock_t first_time;
+
+        init_time = clock();
+        for (size_t i = 0; i < num_trials; i++) {
+            srtp_auth_init(a, keys + (i % num_keys[n]) * klen);
+        }
+        init_time = clock() - init_time;
+
+        first_time = clock();
+        for (size_t i = 0; i < num_trials; i++) {
+            srtp_auth_init(a, keys + (i % num_keys[n]) * klen);
+            srtp_auth_start(a);
+            srtp_auth_compute(a, buf, 20, tag);
+        }
+        first_time = clock() - first_time;
+
+        if (init_time == 0 || first_time == 0) {
+            /* too fast to measure */
+            continue;
+        }
+        printf("keys: %zu\tkey setups per second: %.0f\t"
+               "with first packet: %.0f\n",
+               num_keys[n], (double)num_trials * CLOCKS_PER_SEC / init_time,
+               (double)num_trials * CLOCKS_PER_SEC / first_time);
+    }
+
+    srtp_auth_dealloc(a);
+    srtp_crypto_free(keys);
+
+    return srtp_err_status_ok;
+}
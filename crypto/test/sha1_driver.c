@@ -48,6 +48,7 @@
 #endif
 
 #include "sha1.h"
+#include "auth.h"
 #include "util.h"
 
 #include <stdio.h>
@@ -128,6 +129,28 @@ srtp_err_status_t sha1_test_case_validate(const hash_test_case_t *test_case)
     srtp_sha1_init(&ctx);
     srtp_sha1_update(&ctx, test_case->data, test_case->data_len);
     srtp_sha1_final(&ctx, hash_value);
+
+    /*
+     * hash the data again in short, odd sized pieces so that both the
+     * buffered and the multi-block paths of srtp_sha1_update() are used
+     */
+    if (0 == memcmp(test_case->hash, hash_value, 20)) {
+        size_t offset = 0;
+        size_t piece = 7;
+
+        srtp_sha1_init(&ctx);
+        while (offset < test_case->data_len) {
+            size_t len = test_case->data_len - offset;
+            if (len > piece) {
+                len = piece;
+            }
+            srtp_sha1_update(&ctx, test_case->data + offset, len);
+            offset += len;
+            piece = piece * 3 % 197;
+        }
+        srtp_sha1_final(&ctx, hash_value);
+    }
+
     if (0 == memcmp(test_case->hash, hash_value, 20)) {
 #if VERBOSE
         printf("PASSED: reference value: %s\n",
@@ -407,6 +430,117 @@ srtp_err_status_t sha1_validate(void)
     return srtp_err_status_ok;
 }
 
+/*
+ * sha1_lanes_validate() checks srtp_sha1_core_lanes() against hashing the
+ * blocks one at a time, for every number of lanes
+ */
+srtp_err_status_t sha1_lanes_validate(void)
+{
+    uint8_t blocks[SRTP_SHA1_MAX_LANES][64];
+    const uint8_t *block_ptrs[SRTP_SHA1_MAX_LANES];
+    uint32_t start[SRTP_SHA1_MAX_LANES][5];
+    uint32_t H[SRTP_SHA1_MAX_LANES][5];
+    srtp_sha1_ctx_t ctx;
+
+    for (size_t num_lanes = 1; num_lanes <= SRTP_SHA1_MAX_LANES; num_lanes++) {
+        for (size_t l = 0; l < num_lanes; l++) {
+            for (size_t i = 0; i < 64; i++) {
+                blocks[l][i] = (uint8_t)(rand() & 0xff);
+            }
+            for (size_t i = 0; i < 5; i++) {
+                start[l][i] = (uint32_t)rand();
+            }
+            block_ptrs[l] = blocks[l];
+        }
+        memcpy(H, start, sizeof(H));
+
+        srtp_sha1_core_lanes(H, block_ptrs, num_lanes);
+
+        for (size_t l = 0; l < num_lanes; l++) {
+            srtp_sha1_init_midstate(&ctx, start[l], 0);
+            srtp_sha1_update(&ctx, blocks[l], 64);
+            if (memcmp(ctx.H, H[l], sizeof(ctx.H)) != 0) {
+                printf("lane %zu of %zu differs\n", l, num_lanes);
+                return srtp_err_status_algo_fail;
+            }
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * hmac_jobs_validate() checks the HMAC-SHA1 tags computed as jobs against
+ * those computed one message at a time, for messages of every length up
+ * to a few blocks, so that each ends at every offset of its last block
+ */
+#define HMAC_JOBS_MAX_LEN 200
+
+srtp_err_status_t hmac_jobs_validate(void)
+{
+    extern const srtp_auth_type_t srtp_hmac;
+    const uint8_t key[20] = { 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+                              0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+                              0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b };
+    const uint8_t roc[4] = { 0x00, 0x01, 0x02, 0x03 };
+    uint8_t msg[HMAC_JOBS_MAX_LEN];
+    uint8_t tags[HMAC_JOBS_MAX_LEN + 1][20];
+    uint8_t tag[20];
+    srtp_auth_job_t jobs[HMAC_JOBS_MAX_LEN + 1];
+    srtp_auth_t *a;
+    srtp_err_status_t status;
+
+    for (size_t i = 0; i < sizeof(msg); i++) {
+        msg[i] = (uint8_t)(rand() & 0xff);
+    }
+
+    status = srtp_auth_type_alloc(&srtp_hmac, &a, sizeof(key), sizeof(tag));
+    if (status) {
+        return status;
+    }
+    status = srtp_auth_init(a, key);
+
+    /* the lengths are mixed in the lanes as a batch would mix them */
+    for (size_t i = 0; !status && i <= HMAC_JOBS_MAX_LEN; i++) {
+        status = srtp_auth_job_init(a, &jobs[i]);
+        jobs[i].buffer = msg;
+        jobs[i].len = i;
+        jobs[i].tag = tags[i];
+        if (i % 2 == 0) {
+            memcpy(jobs[i].suffix, roc, sizeof(roc));
+            jobs[i].suffix_len = sizeof(roc);
+        }
+    }
+    if (status == srtp_err_status_no_such_op) {
+        /* without vector lanes there are no jobs to check */
+        srtp_auth_dealloc(a);
+        return srtp_err_status_ok;
+    }
+    if (!status) {
+        srtp_auth_compute_jobs(jobs, HMAC_JOBS_MAX_LEN + 1);
+    }
+
+    for (size_t i = 0; !status && i <= HMAC_JOBS_MAX_LEN; i++) {
+        status = srtp_auth_start(a);
+        if (!status && i % 2 == 0) {
+            status = srtp_auth_update(a, msg, i);
+            if (!status) {
+                status = srtp_auth_compute(a, roc, sizeof(roc), tag);
+            }
+        } else if (!status) {
+            status = srtp_auth_compute(a, msg, i, tag);
+        }
+        if (!status && memcmp(tag, tags[i], sizeof(tag)) != 0) {
+            printf("tag of job of %zu octets differs\n", i);
+            status = srtp_err_status_algo_fail;
+        }
+    }
+
+    srtp_auth_dealloc(a);
+
+    return status;
+}
+
 int main(void)
 {
     srtp_err_status_t err;
@@ -420,5 +554,20 @@ int main(void)
     }
     printf("SHA1 passed validation tests\n");
 
+    err = sha1_lanes_validate();
+    if (err) {
+        printf("SHA1 lanes did not pass validation testing\n");
+        return 1;
+    }
+    printf("SHA1 lanes passed validation tests (%zu lanes)\n",
+           srtp_sha1_lanes());
+
+    err = hmac_jobs_validate();
+    if (err) {
+        printf("HMAC-SHA1 jobs did not pass validation testing\n");
+        return 1;
+    }
+    printf("HMAC-SHA1 jobs passed validation tests\n");
+
     return 0;
 }
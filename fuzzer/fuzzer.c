@@ -6,6 +6,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <inttypes.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
 #include "srtp.h"
 #include "srtp_priv.h"
 #include "fuzzer.h"
@@ -18,6 +24,17 @@ static bool g_post_init =
     false; /* Set to true once past initialization phase */
 static bool g_write_input = false;
 
+/* Cost measurement, enabled by any of the --*cost* flags */
+static bool g_measure_cost = false;
+static uint64_t g_max_cost = 0;        /* --max_cost=<ticks>        */
+static uint64_t g_cost_per_octet = 0;  /* --cost_per_octet=<ticks>  */
+static const char *g_cost_corpus = NULL; /* --cost_corpus=<dir>     */
+static bool g_cost_abort = false;      /* --cost_abort              */
+static bool g_report_cost = false;     /* --report_cost             */
+static uint64_t g_worst_cost[FUZZ_NUM_SRTP_FUNCS];
+static const uint8_t *g_input = NULL; /* input of the current run   */
+static size_t g_input_size = 0;
+
 #ifdef FUZZ_32BIT
 #include <sys/mman.h>
 static bool g_no_mmap = false; /* Can be enabled with --no_mmap */
@@ -182,6 +199,108 @@ void fuzz_free(void *ptr)
     }
 }
 
+/* Cost measurement */
+
+/* Returns a timestamp in cycles where the CPU has a cycle counter, and in
+ * nanoseconds elsewhere; the cost flags are given in the same unit.
+ */
+static uint64_t fuzz_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void fuzz_store_cost_input(const char *func_name, uint64_t cost)
+{
+    char path[4096];
+    uint32_t hash = 2166136261u;
+    FILE *fp;
+
+    /* FNV-1a of the input tells inputs of the same cost apart */
+    for (size_t i = 0; i < g_input_size; i++) {
+        hash = (hash ^ g_input[i]) * 16777619u;
+    }
+
+    snprintf(path, sizeof(path), "%s/cost-%s-%016" PRIx64 "-%08" PRIx32,
+             g_cost_corpus, func_name, cost, hash);
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Cannot open %s\n", path);
+        return;
+    }
+    if (g_input_size != 0 && fwrite(g_input, g_input_size, 1, fp) != 1) {
+        printf("Cannot write %s\n", path);
+    }
+    fclose(fp);
+}
+
+/* Accounts a single call of srtp_funcs[func] on len octets that took ticks.
+ * The cost of a call is what it took beyond --cost_per_octet for each
+ * octet, so that long packets are not reported for their length alone.
+ * Inputs that raise the worst cost seen so far for a function are stored
+ * in --cost_corpus, those beyond --max_cost are reported as findings.
+ */
+static void fuzz_account_cost(size_t func, size_t len, uint64_t ticks)
+{
+    const char *func_name = srtp_funcs[func].name;
+    uint64_t allowance = g_cost_per_octet * len;
+    uint64_t cost = ticks > allowance ? ticks - allowance : 0;
+    bool stored = false;
+
+    if (g_report_cost) {
+        printf("cost: %s len %zu ticks %" PRIu64 " cost %" PRIu64 "\n",
+               func_name, len, ticks, cost);
+    }
+
+    if (cost > g_worst_cost[func]) {
+        g_worst_cost[func] = cost;
+        if (g_cost_corpus != NULL) {
+            fuzz_store_cost_input(func_name, cost);
+            stored = true;
+        }
+    }
+
+    if (g_max_cost != 0 && cost > g_max_cost) {
+        printf("==%s== cost %" PRIu64 " exceeds --max_cost=%" PRIu64
+               " (len %zu, %" PRIu64 " ticks)\n",
+               func_name, cost, g_max_cost, len, ticks);
+        if (g_cost_corpus != NULL && !stored) {
+            fuzz_store_cost_input(func_name, cost);
+        }
+        if (g_cost_abort) {
+            /* Let libFuzzer keep and minimize the input as a crash */
+            abort();
+        }
+    }
+}
+
+/* Calls srtp_funcs[func], measuring its cost if that is enabled */
+static srtp_err_status_t fuzz_call_srtp_func(size_t func,
+                                             srtp_t srtp_ctx,
+                                             uint8_t *hdr,
+                                             size_t *len,
+                                             size_t mki)
+{
+    srtp_err_status_t status;
+    size_t in_len = *len;
+    uint64_t start;
+
+    if (!g_measure_cost) {
+        return srtp_funcs[func].srtp_func(srtp_ctx, hdr, len, mki);
+    }
+
+    start = fuzz_ticks();
+    status = srtp_funcs[func].srtp_func(srtp_ctx, hdr, len, mki);
+    fuzz_account_cost(func, in_len, fuzz_ticks() - start);
+
+    return status;
+}
+
 static srtp_err_status_t fuzz_srtp_protect(srtp_t srtp_sender,
                                            void *hdr,
                                            size_t *len,
@@ -347,6 +466,7 @@ static srtp_policy_t extract_policy(const uint8_t **data, size_t *size)
     srtp_profile_t profile;
     size_t key_size;
     size_t salt_size;
+    bool use_cryptex;
     srtp_err_status_t status;
     struct {
         uint8_t srtp_profile;
@@ -363,6 +483,8 @@ static srtp_policy_t extract_policy(const uint8_t **data, size_t *size)
 
     params.srtp_profile %=
         sizeof(fuzz_srtp_profiles) / sizeof(fuzz_srtp_profiles[0]);
+    /* The second bit of allow_repeat_tx enables cryptex */
+    use_cryptex = (params.allow_repeat_tx & 2) != 0;
     params.allow_repeat_tx %= 2;
     params.ssrc_type %=
         sizeof(fuzz_ssrc_type_map) / sizeof(fuzz_ssrc_type_map[0]);
@@ -448,6 +570,11 @@ static srtp_policy_t extract_policy(const uint8_t **data, size_t *size)
         srtp_policy_destroy(policy);
         return NULL;
     }
+    status = srtp_policy_set_cryptex(policy, use_cryptex);
+    if (status != srtp_err_status_ok) {
+        srtp_policy_destroy(policy);
+        return NULL;
+    }
 
 end:
     return policy;
@@ -597,8 +724,8 @@ static uint8_t *run_srtp_func(const srtp_t srtp_ctx,
 
     EXTRACT(copy, *data, *size, params_1.size);
 
-    if (srtp_funcs[params_1.srtp_func].srtp_func(
-            srtp_ctx, copy, &ret_size, params_1.mki) != srtp_err_status_ok) {
+    if (fuzz_call_srtp_func(params_1.srtp_func, srtp_ctx, copy, &ret_size,
+                            params_1.mki) != srtp_err_status_ok) {
         fuzz_free(copy);
         goto end;
     }
@@ -634,8 +761,8 @@ static uint8_t *run_srtp_func(const srtp_t srtp_ctx,
     fuzz_free(copy);
     copy = copy_2;
 
-    if (srtp_funcs[params_2.srtp_func].srtp_func(
-            srtp_ctx, copy, &ret_size, params_2.mki) != srtp_err_status_ok) {
+    if (fuzz_call_srtp_func(params_2.srtp_func, srtp_ctx, copy, &ret_size,
+                            params_2.mki) != srtp_err_status_ok) {
         fuzz_free(copy);
         ret = NULL;
         goto end;
@@ -693,6 +820,19 @@ int LLVMFuzzerInitialize(int *argc, char ***argv)
             no_custom_event_handler = true;
         } else if (strcmp("--write_input", _argv[i]) == 0) {
             g_write_input = true;
+        } else if (strncmp("--max_cost=", _argv[i], 11) == 0) {
+            g_max_cost = strtoull(_argv[i] + 11, NULL, 0);
+            g_measure_cost = true;
+        } else if (strncmp("--cost_per_octet=", _argv[i], 17) == 0) {
+            g_cost_per_octet = strtoull(_argv[i] + 17, NULL, 0);
+        } else if (strncmp("--cost_corpus=", _argv[i], 14) == 0) {
+            g_cost_corpus = _argv[i] + 14;
+            g_measure_cost = true;
+        } else if (strcmp("--cost_abort", _argv[i]) == 0) {
+            g_cost_abort = true;
+        } else if (strcmp("--report_cost", _argv[i]) == 0) {
+            g_report_cost = true;
+            g_measure_cost = true;
         }
 #ifdef FUZZ_32BIT
         else if (strcmp("--no_mmap", _argv[i]) == 0) {
@@ -742,6 +882,9 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
         fuzz_write_input(data, size);
     }
 
+    g_input = data;
+    g_input_size = size;
+
     EXTRACT_IF(&randseed, data, size, sizeof(randseed));
     fuzz_mt19937_init(randseed);
     srand(randseed);
@@ -56,15 +56,19 @@ struct fuzz_srtp_func_ext {
     fuzz_srtp_func srtp_func;
     bool protect;
     fuzz_srtp_get_length_func get_length;
+    const char *name;
 };
 
 const struct fuzz_srtp_func_ext srtp_funcs[] = {
-    { fuzz_srtp_protect, true, fuzz_srtp_get_protect_length },
-    { fuzz_srtp_unprotect, false, NULL },
-    { fuzz_srtp_protect_rtcp, true, fuzz_srtp_get_protect_rtcp_length },
-    { fuzz_srtp_unprotect_rtcp, false, NULL }
+    { fuzz_srtp_protect, true, fuzz_srtp_get_protect_length, "srtp_protect" },
+    { fuzz_srtp_unprotect, false, NULL, "srtp_unprotect" },
+    { fuzz_srtp_protect_rtcp, true, fuzz_srtp_get_protect_rtcp_length,
+      "srtp_protect_rtcp" },
+    { fuzz_srtp_unprotect_rtcp, false, NULL, "srtp_unprotect_rtcp" }
 };
 
+#define FUZZ_NUM_SRTP_FUNCS (sizeof(srtp_funcs) / sizeof(srtp_funcs[0]))
+
 struct fuzz_srtp_profile_ext {
     srtp_profile_t profile;
     const char *name;
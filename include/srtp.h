@@ -114,10 +114,13 @@ extern "C" {
 
 /**
  * SRTP_MAX_NUM_MASTER_KEYS is the maximum number of Master keys for
- * MKI supported by libSRTP.
+ * MKI supported by libSRTP. It can be raised when building libSRTP, up
+ * to 65535. A policy only allocates storage for the keys added to it.
  *
  */
-#define SRTP_MAX_NUM_MASTER_KEYS 16
+#ifndef SRTP_MAX_NUM_MASTER_KEYS
+#define SRTP_MAX_NUM_MASTER_KEYS 1024
+#endif
 
 #define SRTP_MAX_NUM_ENC_HDR_XTND_IDS 16
 
@@ -219,6 +222,7 @@ typedef enum {
                                         /**< needed                          */
     srtp_err_status_buffer_small = 28,  /**< out buffer is too small         */
     srtp_err_status_cryptex_err = 29,   /**< unsupported cryptex operation   */
+    srtp_err_status_in_progress = 30,   /**< operation has not completed yet */
 } srtp_err_status_t;
 
 typedef struct srtp_ctx_t_ srtp_ctx_t;
@@ -317,7 +321,9 @@ srtp_err_status_t srtp_policy_create(srtp_policy_t *policy);
  * @param cloned_policy output pointer that receives the cloned policy.
  *
  * This copies all fields of the source policy, including configured keys. The
- * cloned policy can be modified independently from the source policy.
+ * cloned policy can be modified independently from the source policy; the
+ * keys are shared until either policy adds or removes keys, so cloning does
+ * not copy them.
  *
  * @return
  *    - srtp_err_status_ok if cloning succeeded.
@@ -445,6 +451,7 @@ srtp_err_status_t srtp_policy_get_mki_length(srtp_policy_t policy,
  *    - srtp_err_status_bad_param if policy is NULL, key/salt/MKI arguments are
  *      invalid, MKI state does not match mki_len, the non-MKI single-key limit
  *      or key limit is exceeded, or key/salt/MKI sizes exceed supported limits.
+ *    - srtp_err_status_alloc_fail if the keys could not be stored.
  */
 srtp_err_status_t srtp_policy_add_key(srtp_policy_t policy,
                                       const uint8_t *key,
@@ -475,7 +482,8 @@ srtp_err_status_t srtp_policy_remove_keys(srtp_policy_t policy);
  * @param policy policy handle.
  * @param window_size replay window size in packets.
  *
- * window_size must be 0 or in [64, 0x7fff].
+ * window_size must be 0 or in [64, 0x7fff]. Streams of an
+ * ssrc_any_outbound policy only send and always use a window of 64.
  *
  * @return
  *    - srtp_err_status_ok if value was accepted.
@@ -484,6 +492,47 @@ srtp_err_status_t srtp_policy_remove_keys(srtp_policy_t policy);
 srtp_err_status_t srtp_policy_set_window_size(srtp_policy_t policy,
                                               size_t window_size);
 
+/**
+ * @brief Let the replay window of each stream adapt to its reordering.
+ *
+ * @param policy policy handle.
+ * @param adaptive true to adapt the window, false for a fixed window.
+ *
+ * With an adaptive window the window size of the policy is the largest
+ * window a receiving stream uses. Each stream starts with a window of 128
+ * and doubles it when packets it accepts arrive reordered by half of the
+ * window or more, so that packets reordered further are still accepted
+ * once such reordering is seen. After 4096 packets without reordering by
+ * a quarter of the window it halves again. Only packets that passed
+ * authentication grow the window. Typical streams then keep a small
+ * window while streams on badly reordering paths get a larger one. It is
+ * off by default.
+ *
+ * @return
+ *    - srtp_err_status_ok if value was applied.
+ *    - srtp_err_status_bad_param if policy is NULL.
+ */
+srtp_err_status_t srtp_policy_set_adaptive_window(srtp_policy_t policy,
+                                                  bool adaptive);
+
+/**
+ * @brief Set SRTCP replay-window size.
+ *
+ * @param policy policy handle.
+ * @param window_size replay window size in packets.
+ *
+ * window_size must be 0 or in [64, 1024]. 0 selects the default of 128,
+ * other values are rounded up to a multiple of 64. A larger window lets
+ * frequent RTCP, such as transport-wide congestion control feedback,
+ * be reordered further before it is rejected as too old.
+ *
+ * @return
+ *    - srtp_err_status_ok if value was accepted.
+ *    - srtp_err_status_bad_param if policy is NULL or value is invalid.
+ */
+srtp_err_status_t srtp_policy_set_rtcp_window_size(srtp_policy_t policy,
+                                                   size_t window_size);
+
 /**
  * @brief Enable or disable repeat transmission for RTP.
  *
@@ -510,6 +559,104 @@ srtp_err_status_t srtp_policy_set_allow_repeat_tx(srtp_policy_t policy,
 srtp_err_status_t srtp_policy_set_cryptex(srtp_policy_t policy,
                                           bool use_cryptex);
 
+/**
+ * @brief Set the number of streams to preallocate for a wildcard policy.
+ *
+ * When a session with an SSRC_ANY_INBOUND or SSRC_ANY_OUTBOUND policy sees
+ * a new SSRC it creates a stream for it from the template. Setting a pool
+ * size makes srtp_create(), srtp_stream_add() and srtp_update() preallocate
+ * that many streams, so that new SSRCs and srtp_stream_remove() reuse them
+ * instead of allocating and freeing memory while processing packets. Once
+ * the pool is empty further streams are allocated as usual.
+ *
+ * The value is ignored for policies with a specific SSRC. The default of 0
+ * disables the pool.
+ *
+ * @param policy policy handle.
+ * @param num_streams number of streams to keep preallocated.
+ *
+ * @return
+ *    - srtp_err_status_ok if value was applied.
+ *    - srtp_err_status_bad_param if policy is NULL.
+ */
+srtp_err_status_t srtp_policy_set_stream_pool_size(srtp_policy_t policy,
+                                                   size_t num_streams);
+
+/**
+ * @brief Keep accepting the previous keys for a while after an update.
+ *
+ * By default srtp_update() and srtp_stream_update() replace the keys of a
+ * stream at once, so packets protected with the old keys that are still
+ * in flight fail to unprotect. When the update policy sets an overlap,
+ * each receiving stream that is updated keeps its previous keys until
+ * num_packets packets were unprotected with the new keys, or until the
+ * next update.
+ *
+ * During the overlap a packet is unprotected with the keys its MKI
+ * identifies. Without MKI, packets with an index below the first one seen
+ * under the new keys are tried with the previous keys first and the rest
+ * with the new keys first, and a packet that fails to authenticate with
+ * one set of keys is tried with the other. Streams that the session only
+ * sees after the update are created with the new keys.
+ *
+ * The default of 0 disables the overlap.
+ *
+ * @param policy policy handle.
+ * @param num_packets number of packets to keep the previous keys for.
+ *
+ * @return
+ *    - srtp_err_status_ok if value was applied.
+ *    - srtp_err_status_bad_param if policy is NULL.
+ */
+srtp_err_status_t srtp_policy_set_key_overlap(srtp_policy_t policy,
+                                              size_t num_packets);
+
+/**
+ * @brief Limit the number of streams cloned from a template.
+ *
+ * A session with a wildcard SSRC policy clones a stream for each SSRC it
+ * sees and keeps it until the stream is removed. With a limit set, a
+ * session that already holds max_streams clones removes the one that was
+ * used least recently before it clones a stream for a new SSRC. Recency
+ * is tracked per epoch, see srtp_session_gc(), streams last used in the
+ * same epoch are removed in no particular order.
+ *
+ * As with srtp_stream_remove(), the replay state of a removed stream is
+ * lost, so a removed SSRC that comes back starts a new stream.
+ *
+ * The value is ignored for policies with a specific SSRC. The default of 0
+ * disables the limit.
+ *
+ * @param policy policy handle.
+ * @param max_streams maximum number of cloned streams.
+ *
+ * @return
+ *    - srtp_err_status_ok if value was applied.
+ *    - srtp_err_status_bad_param if policy is NULL.
+ */
+srtp_err_status_t srtp_policy_set_max_clones(srtp_policy_t policy,
+                                             size_t max_streams);
+
+/**
+ * @brief Remove streams cloned from a template once they are idle.
+ *
+ * Streams cloned from the template that did not protect or unprotect a
+ * packet in the last num_epochs epochs are removed by srtp_session_gc(),
+ * which starts a new epoch each time it is called.
+ *
+ * The value is ignored for policies with a specific SSRC. The default of 0
+ * keeps idle streams.
+ *
+ * @param policy policy handle.
+ * @param num_epochs number of epochs without packets to keep a stream for.
+ *
+ * @return
+ *    - srtp_err_status_ok if value was applied.
+ *    - srtp_err_status_bad_param if policy is NULL.
+ */
+srtp_err_status_t srtp_policy_set_clone_idle_timeout(srtp_policy_t policy,
+                                                     size_t num_epochs);
+
 /**
  * @brief Add an encrypted header extension ID.
  *
@@ -580,6 +727,43 @@ srtp_err_status_t srtp_policy_validate(srtp_policy_t policy);
  */
 typedef srtp_ctx_t *srtp_t;
 
+/**
+ * @brief An srtp_prepared_stream_t points to an SRTP stream that has been
+ * allocated and keyed, but not yet added to a session.
+ *
+ * A prepared stream is created with srtp_stream_prepare() and handed to a
+ * session with srtp_stream_commit(). This datatype is intentionally opaque.
+ */
+typedef struct srtp_prepared_stream_ctx_t_ srtp_prepared_stream_ctx_t;
+typedef srtp_prepared_stream_ctx_t *srtp_prepared_stream_t;
+
+/**
+ * @brief An srtp_retired_t points to a session that srtp_dealloc_deferred()
+ * has retired, which srtp_reclaim() deallocates.
+ *
+ * This datatype is intentionally opaque.
+ */
+typedef struct srtp_retired_ctx_t_ srtp_retired_ctx_t;
+typedef srtp_retired_ctx_t *srtp_retired_t;
+
+/**
+ * @brief An srtp_reader_t points to a private copy of a receiving stream
+ * for decrypting recorded packets, see srtp_reader_create().
+ *
+ * This datatype is intentionally opaque.
+ */
+typedef struct srtp_reader_ctx_t_ srtp_reader_ctx_t;
+typedef srtp_reader_ctx_t *srtp_reader_t;
+
+/**
+ * @brief An srtp_batch_t points to a batch of packets submitted with
+ * srtp_batch_submit(), see there.
+ *
+ * This datatype is intentionally opaque.
+ */
+typedef struct srtp_batch_ctx_t_ srtp_batch_ctx_t;
+typedef srtp_batch_ctx_t *srtp_batch_t;
+
 /**
  * @brief srtp_init() initializes the srtp library.
  *
@@ -588,6 +772,54 @@ typedef srtp_ctx_t *srtp_t;
  */
 srtp_err_status_t srtp_init(void);
 
+/**
+ * @brief SRTP_INIT_LAZY_SELF_TESTS is a flag of srtp_init_ex() that defers
+ * the self-test of each cipher and authentication type until it is first
+ * used.
+ */
+#define SRTP_INIT_LAZY_SELF_TESTS 0x1
+
+/**
+ * @brief srtp_init_ex() initializes the srtp library like srtp_init().
+ *
+ * srtp_init() runs the self-tests of all cipher and authentication types
+ * before it returns. With SRTP_INIT_LAZY_SELF_TESTS set in flags each type
+ * is instead tested the first time a session or stream is created with it,
+ * which then fails if the test does not pass. Applications that have to
+ * test every algorithm at startup, as FIPS 140 requires, must not set it.
+ *
+ * @param flags is zero or SRTP_INIT_LAZY_SELF_TESTS.
+ *
+ * @return
+ *    - srtp_err_status_ok          the library was initialized.
+ *    - srtp_err_status_bad_param   flags has an unknown flag set.
+ *    - [other]                     a self-test failed.
+ */
+srtp_err_status_t srtp_init_ex(unsigned int flags);
+
+/**
+ * @brief srtp_calibrate_crypto() puts the fastest implementation of each
+ * cipher and authentication type in use.
+ *
+ * Only one crypto backend is built into the library, but an application
+ * can add further implementations of a type, for example one using a
+ * hardware accelerator, with srtp_add_cipher_type() and
+ * srtp_add_auth_type(). For every type that has more than one, this
+ * function times each implementation that passes its self-tests with a
+ * short run of 1 KB messages and puts the fastest in use.
+ * srtp_get_cipher_type() and srtp_get_auth_type() report the choice, and
+ * srtp_replace_cipher_type() or srtp_replace_auth_type() override it.
+ *
+ * Like the replace functions this must be called after srtp_init() and
+ * before any session is created.
+ *
+ * @return
+ *    - srtp_err_status_ok          the fastest implementations are in use.
+ *    - srtp_err_status_init_fail   the library is not initialized.
+ *    - srtp_err_status_algo_fail   no implementation of a type passed.
+ */
+srtp_err_status_t srtp_calibrate_crypto(void);
+
 /**
  * @brief srtp_shutdown() de-initializes the srtp library.
  *
@@ -610,8 +842,7 @@ srtp_err_status_t srtp_shutdown(void);
  * need not be consecutive, but they @b must be out of order by less
  * than 2^15 = 32,768 packets.
  *
- * @warning This function assumes that the RTP packet is aligned on a 32-bit
- * boundary.
+ * The packet may start at any address, it need not be aligned.
  *
  * @param ctx is the SRTP context to use in processing the packet.
  *
@@ -646,6 +877,80 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
                                size_t *srtp_len,
                                size_t mki_index);
 
+/**
+ * @brief srtp_rtp_header_desc_t describes the header of an RTP packet, as
+ * filled by srtp_rtp_header_parse() or by an application that has parsed
+ * the header itself, for srtp_protect_parsed().
+ */
+typedef struct srtp_rtp_header_desc_t {
+    size_t header_len;    /**< octets before the payload, including the */
+                          /**< CSRCs and the header extension           */
+    size_t csrc_count;    /**< number of CSRCs, the CC field            */
+    size_t xtn_offset;    /**< offset of the header extension, or 0     */
+    size_t xtn_len;       /**< octets in the header extension including */
+                          /**< its 4 octet header, or 0 if there is none */
+    uint16_t xtn_profile; /**< profile of the header extension, in host */
+                          /**< order, or 0 if there is none             */
+    size_t payload_len;   /**< octets from header_len to the end of the */
+                          /**< packet                                   */
+} srtp_rtp_header_desc_t;
+
+/**
+ * @brief srtp_rtp_header_parse() describes the header of an RTP packet.
+ *
+ * The function call srtp_rtp_header_parse(rtp, rtp_len, desc) checks that
+ * the header of the RTP packet rtp, which has length rtp_len, lies within
+ * the packet and fills desc with its layout.
+ *
+ * @param rtp is a pointer to the RTP packet.
+ *
+ * @param rtp_len is the length in octets of the complete RTP packet.
+ *
+ * @param desc is filled with the layout of the header.
+ *
+ * @return
+ *    - srtp_err_status_ok         if desc was filled.
+ *    - srtp_err_status_bad_param  if rtp or desc is NULL, or the header
+ *                                 does not fit in rtp_len octets.
+ */
+srtp_err_status_t srtp_rtp_header_parse(const uint8_t *rtp,
+                                        size_t rtp_len,
+                                        srtp_rtp_header_desc_t *desc);
+
+/**
+ * @brief srtp_protect_parsed() is srtp_protect() for a packet whose header
+ * was described already.
+ *
+ * The function call srtp_protect_parsed(ctx, rtp, rtp_len, desc, srtp,
+ * srtp_len, mki_index) protects the packet like srtp_protect(), but takes
+ * the layout of its header from desc instead of parsing it. An application
+ * that has built or parsed the header itself can fill desc without going
+ * through srtp_rtp_header_parse().
+ *
+ * desc is only checked against the fixed header and rtp_len, so that every
+ * offset it gives lies within the packet. The header extension itself is
+ * not read to check it; a desc that does not match it gives an SRTP packet
+ * that the receiver rejects.
+ *
+ * @param ctx, rtp, rtp_len, srtp, srtp_len and mki_index are as for
+ * srtp_protect().
+ *
+ * @param desc is the layout of the header of rtp.
+ *
+ * @return
+ *    - srtp_err_status_ok         on success.
+ *    - srtp_err_status_bad_param  if desc is NULL or does not describe a
+ *                                 header that fits in the packet.
+ *    - [other]                    as for srtp_protect().
+ */
+srtp_err_status_t srtp_protect_parsed(srtp_t ctx,
+                                      const uint8_t *rtp,
+                                      size_t rtp_len,
+                                      const srtp_rtp_header_desc_t *desc,
+                                      uint8_t *srtp,
+                                      size_t *srtp_len,
+                                      size_t mki_index);
+
 /**
  * @brief srtp_unprotect() is the Secure RTP receiver-side packet
  * processing function.
@@ -662,8 +967,7 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
  * need not be consecutive, but they @b must be out of order by less
  * than 2^15 = 32,768 packets.
  *
- * @warning This function assumes that the SRTP packet is aligned on a
- * 32-bit boundary.
+ * The packet may start at any address, it need not be aligned.
  *
  * @param ctx is the SRTP session which applies to the particular packet.
  *
@@ -679,7 +983,9 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
  * @param srtp_len is a pointer to the length of the rtp buffer before the
  * function call, and of the complete RTP packet after the call, if
  * srtp_err_status_ok was returned. Otherwise, the value of the data to which
- * it points is undefined.
+ * it points is undefined. For a cryptex packet with CSRCs and an AEAD
+ * profile that is not unprotected in place, the rtp buffer has to hold the
+ * packet up to the end of its tag.
  *
  * @return
  *    - srtp_err_status_ok          if the RTP packet is valid.
@@ -698,159 +1004,1059 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
                                  size_t *rtp_len);
 
 /**
- * @brief srtp_create() allocates and initializes an SRTP session.
+ * @brief srtp_stream_handle_t refers to a stream of a session, so that
+ * its packets can be processed without looking up their SSRC.
  *
- * The function call srtp_create(session, policy) allocates and
- * initializes an SRTP session context, applying the given policy.
+ * A handle is obtained with srtp_stream_lookup() and its fields are
+ * private to the library. It stays valid until a stream is removed from
+ * or replaced in its session, e.g. by srtp_stream_remove(),
+ * srtp_stream_update() or the eviction of a clone of the template;
+ * after that the functions taking it return srtp_err_status_no_ctx and
+ * the stream has to be looked up again.
+ */
+typedef struct srtp_stream_handle_t {
+    void *stream;        /**< private to the library                  */
+    uint32_t generation; /**< private to the library                  */
+} srtp_stream_handle_t;
+
+/**
+ * @brief srtp_stream_lookup() looks up the stream of an SSRC once for
+ * srtp_protect_stream() and srtp_unprotect_stream().
  *
- * @param session is a pointer to the SRTP session to which the policy is
- * to be added.
+ * The function call srtp_stream_lookup(session, ssrc, handle) sets
+ * handle to the stream of ssrc in session. Unlike srtp_protect() it
+ * does not create a stream from the template of the session, a clone
+ * can be looked up after its first packet has been processed.
  *
- * @param policy is an srtp_policy_t handle that describes one stream policy.
- * It may be NULL, in which case streams can be added later using
- * srtp_stream_add().
+ * @param session is the session containing the stream.
+ *
+ * @param ssrc is the SSRC of the stream, in host byte order.
+ *
+ * @param handle is set to the handle of the stream.
  *
  * @return
- *    - srtp_err_status_ok           if creation succeeded.
- *    - srtp_err_status_alloc_fail   if allocation failed.
- *    - srtp_err_status_init_fail    if initialization failed.
+ *    - srtp_err_status_ok         if the stream was found.
+ *    - srtp_err_status_no_ctx     if session has no stream for ssrc.
+ *    - srtp_err_status_bad_param  if session or handle is NULL.
  */
-srtp_err_status_t srtp_create(srtp_t *session, const srtp_policy_t policy);
+srtp_err_status_t srtp_stream_lookup(srtp_t session,
+                                     uint32_t ssrc,
+                                     srtp_stream_handle_t *handle);
 
 /**
- * @brief srtp_stream_add() allocates and initializes an SRTP stream
- * within a given SRTP session.
+ * @brief srtp_protect_stream() is srtp_protect() for a stream that was
+ * looked up with srtp_stream_lookup().
  *
- * The function call srtp_stream_add(session, policy) allocates and
- * initializes a new SRTP stream within a given, previously created
- * session, applying the policy given as the other argument to that
- * stream.
+ * The function call srtp_protect_stream(ctx, handle, rtp, rtp_len, srtp,
+ * srtp_len, mki_index) protects the packet like srtp_protect(), but
+ * takes its stream from handle instead of searching the streams of ctx
+ * for the SSRC of the packet.
  *
- * @return values:
- *    - srtp_err_status_ok           if stream creation succeeded.
- *    - srtp_err_status_alloc_fail   if stream allocation failed
- *    - srtp_err_status_init_fail    if stream initialization failed.
+ * @param ctx is the session the handle was looked up in.
+ *
+ * @param handle is the stream of the packet.
+ *
+ * @param rtp, rtp_len, srtp, srtp_len and mki_index are as for
+ * srtp_protect().
+ *
+ * @return
+ *    - srtp_err_status_ok         if the packet was protected.
+ *    - srtp_err_status_no_ctx     if handle is no longer valid.
+ *    - srtp_err_status_bad_param  if the SSRC of the packet is not that
+ *                                 of the stream.
+ *    - [other]                    as for srtp_protect().
  */
-srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t policy);
+srtp_err_status_t srtp_protect_stream(srtp_t ctx,
+                                      const srtp_stream_handle_t *handle,
+                                      const uint8_t *rtp,
+                                      size_t rtp_len,
+                                      uint8_t *srtp,
+                                      size_t *srtp_len,
+                                      size_t mki_index);
 
 /**
- * @brief srtp_stream_remove() deallocates an SRTP stream.
- *
- * The function call srtp_stream_remove(session, ssrc) removes
- * the SRTP stream with the SSRC value ssrc from the SRTP session
- * context given by the argument session.
+ * @brief srtp_unprotect_stream() is srtp_unprotect() for a stream that
+ * was looked up with srtp_stream_lookup().
  *
- * @param session is the SRTP session from which the stream
- * will be removed.
+ * The function call srtp_unprotect_stream(ctx, handle, srtp, srtp_len,
+ * rtp, rtp_len) verifies and decrypts the packet like srtp_unprotect(),
+ * but takes its stream from handle instead of searching the streams of
+ * ctx for the SSRC of the packet.
  *
- * @param ssrc is the SSRC value of the stream to be removed
- * in host byte order.
+ * @param ctx is the session the handle was looked up in.
  *
- * @attention In libSRTP version before 3.0.0 the SSRC param was in network
- * byte order, this was changed in 3.0.0 to host byte order to be
- * consistant with the rest of the api.
+ * @param handle is the stream of the packet.
  *
- * @warning Wildcard SSRC values cannot be removed from a
- * session.
+ * @param srtp, srtp_len, rtp and rtp_len are as for srtp_unprotect().
  *
  * @return
- *    - srtp_err_status_ok     if the stream deallocation succeeded.
- *    - [other]           otherwise.
- *
+ *    - srtp_err_status_ok         if the packet was verified.
+ *    - srtp_err_status_no_ctx     if handle is no longer valid.
+ *    - srtp_err_status_bad_param  if the SSRC of the packet is not that
+ *                                 of the stream.
+ *    - [other]                    as for srtp_unprotect().
  */
-srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc);
+srtp_err_status_t srtp_unprotect_stream(srtp_t ctx,
+                                        const srtp_stream_handle_t *handle,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        uint8_t *rtp,
+                                        size_t *rtp_len);
 
 /**
- * @brief srtp_update() updates all streams in the session.
+ * @brief srtp_packet_desc_t describes one packet of a batch passed to
+ * srtp_protect_batch(), srtp_unprotect_batch() or their SRTCP
+ * counterparts srtp_protect_rtcp_batch() and srtp_unprotect_rtcp_batch().
+ */
+typedef struct srtp_packet_desc_t {
+    const uint8_t *in;        /**< packet to be processed               */
+    size_t in_len;            /**< length in octets of in               */
+    uint8_t *out;             /**< output buffer, may be the same as in */
+    size_t out_len;           /**< length of out before the call, of    */
+                              /**< the processed packet after the call  */
+    size_t mki_index;         /**< session keys, when protecting        */
+    srtp_err_status_t status; /**< result of processing this packet     */
+} srtp_packet_desc_t;
+
+/**
+ * @brief srtp_protect_batch() applies SRTP protection to a vector of RTP
+ * packets.
  *
- * The function call srtp_update(session, policy) updates
- * all the streams in the session applying the given policy
- * and key. The existing ROC value of all streams will be
- * preserved.
+ * The function call srtp_protect_batch(ctx, pkts, num_pkts) is equivalent
+ * to calling srtp_protect(ctx, pkts[i].in, pkts[i].in_len, pkts[i].out,
+ * &pkts[i].out_len, pkts[i].mki_index) for each packet in order, storing the
+ * result in pkts[i].status. The stream lookup and session key selection are
+ * done once for each run of consecutive packets with the same SSRC and
+ * mki_index.
  *
- * @param session is the SRTP session that contains the streams
- *        to be updated.
+ * A failure to protect one packet does not stop the processing of the
+ * following packets.
  *
- * @param policy is an srtp_policy_t handle that describes the update policy
- * to apply to matching stream(s).
+ * @param ctx is the SRTP context to use in processing the packets.
  *
- * @return
- *    - srtp_err_status_ok           if stream creation succeed.
- *    - srtp_err_status_alloc_fail   if stream allocation failed
- *    - srtp_err_status_init_fail    if stream initialization failed.
- *    - [other]                 otherwise.
+ * @param pkts is a pointer to an array of num_pkts packet descriptors.
  *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok          if every packet was protected.
+ *    - srtp_err_status_bad_param   if ctx or pkts is NULL.
+ *    - [other]  the status of the first packet that failed.
  */
-srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t policy);
+srtp_err_status_t srtp_protect_batch(srtp_t ctx,
+                                     srtp_packet_desc_t *pkts,
+                                     size_t num_pkts);
 
 /**
- * @brief srtp_stream_update() updates a SRTP stream.
+ * @brief srtp_protect_strided() applies SRTP protection in place to RTP
+ * packets laid out at a fixed stride in one buffer.
  *
- * The function call srtp_stream_update(session, policy) updates
- * the stream(s) in the session that match applying the given
- * policy and key. The existing ROC value of all stream(s) will
- * be preserved.
+ * This suits a UDP GSO send, where the packets of a frame are written
+ * stride octets apart and the kernel splits the buffer into datagrams.
+ * Packet i starts at buf + i * stride and is lens[i] octets long. Each
+ * stride must have room after its packet for the SRTP trailer, that is
+ * the MKI and the authentication tag. The packets are protected as by
+ * srtp_protect_batch(), so consecutive packets of one SSRC share the
+ * stream lookup and their keystream is generated together.
  *
- * @param session is the SRTP session that contains the streams
- *        to be updated.
+ * On return lens[i] holds the length of protected packet i, or 0 if that
+ * packet could not be protected. A failure does not stop the processing
+ * of the following packets.
  *
- * @param policy is an srtp_policy_t handle that describes the update policy
- * to apply to matching stream(s).
+ * @param ctx is the SRTP context to use in processing the packets.
+ *
+ * @param buf is the buffer holding the packets.
+ *
+ * @param stride is the distance in octets between the starts of two
+ *        consecutive packets.
+ *
+ * @param lens is an array of num_pkts packet lengths.
+ *
+ * @param num_pkts is the number of packets in buf.
+ *
+ * @param mki_index is the index of the master key used for every packet.
  *
  * @return
- *    - srtp_err_status_ok           if stream creation succeeded.
- *    - srtp_err_status_alloc_fail   if stream allocation failed
- *    - srtp_err_status_init_fail    if stream initialization failed.
- *    - [other]                      otherwise.
+ *    - srtp_err_status_ok          if every packet was protected.
+ *    - srtp_err_status_bad_param   if ctx, buf or lens is NULL, stride is 0
+ *                                  or a length is larger than stride.
+ *    - srtp_err_status_buffer_small if a stride has no room for the
+ *                                  trailer of its packet.
+ *    - [other]  the status of the first packet that failed.
+ */
+srtp_err_status_t srtp_protect_strided(srtp_t ctx,
+                                       uint8_t *buf,
+                                       size_t stride,
+                                       size_t *lens,
+                                       size_t num_pkts,
+                                       size_t mki_index);
+
+/**
+ * @brief srtp_unprotect_headers() authenticates an SRTP packet and
+ * decrypts only its header.
+ *
+ * The function call srtp_unprotect_headers(ctx, srtp, srtp_len, rtp,
+ * rtp_len, update_replay) verifies the packet like srtp_unprotect() and
+ * writes its RTP header to rtp, with encrypted header extensions (RFC
+ * 6904) and cryptex blocks (RFC 9335) decrypted, and *rtp_len set to the
+ * length of the header including its extension. The payload is not
+ * decrypted, which saves that work for monitoring that only looks at
+ * headers. With the AES-GCM profiles the tag is only checked while
+ * decrypting the payload, so it is decrypted all the same and rtp must
+ * have room for the whole packet.
+ *
+ * If update_replay is false, the packet is neither checked against nor
+ * added to the replay database of its stream, and a packet verified with
+ * the template of the session does not add a stream for its SSRC, so the
+ * session keeps following the traffic it receives with srtp_unprotect().
+ * The index of the packet is still estimated from the database. The
+ * packet is not counted in the stream statistics, and the keys replaced
+ * by srtp_update() for a key overlap are not tried.
+ *
+ * @param ctx is the session to use.
+ * @param srtp is the SRTP packet.
+ * @param srtp_len is the length of the SRTP packet.
+ * @param rtp is where the RTP header is written, it may be srtp.
+ * @param rtp_len is the size of rtp, set to the length of the header.
+ * @param update_replay is whether the replay database is checked and
+ *        updated, as srtp_unprotect() does.
  *
+ * @return
+ *    - srtp_err_status_ok           if the packet was authenticated.
+ *    - srtp_err_status_auth_fail    if the packet failed authentication.
+ *    - srtp_err_status_replay_fail  if update_replay is set and the
+ *                                   packet is a replay.
+ *    - [other]                      as for srtp_unprotect().
  */
-srtp_err_status_t srtp_stream_update(srtp_t session,
-                                     const srtp_policy_t policy);
+srtp_err_status_t srtp_unprotect_headers(srtp_t ctx,
+                                         const uint8_t *srtp,
+                                         size_t srtp_len,
+                                         uint8_t *rtp,
+                                         size_t *rtp_len,
+                                         bool update_replay);
 
 /**
- * @brief srtp_dealloc() deallocates storage for an SRTP session
- * context.
+ * @brief srtp_unprotect_batch() verifies and removes SRTP protection from a
+ * vector of SRTP packets.
  *
- * The function call srtp_dealloc(s) deallocates storage for the
- * SRTP session context s.  This function should be called no more
- * than one time for each of the contexts allocated by the function
- * srtp_create().
+ * The function call srtp_unprotect_batch(ctx, pkts, num_pkts) is equivalent
+ * to calling srtp_unprotect(ctx, pkts[i].in, pkts[i].in_len, pkts[i].out,
+ * &pkts[i].out_len) for each packet in order, storing the result in
+ * pkts[i].status. The mki_index field is ignored. The stream lookup is done
+ * once for each run of consecutive packets with the same SSRC.
  *
- * @param s is the srtp_t for the session to be deallocated.
+ * A failure to unprotect one packet does not stop the processing of the
+ * following packets.
+ *
+ * @param ctx is the SRTP session which applies to the packets.
+ *
+ * @param pkts is a pointer to an array of num_pkts packet descriptors.
+ *
+ * @param num_pkts is the number of packets in the batch.
  *
  * @return
- *    - srtp_err_status_ok             if there no problems.
- *    - srtp_err_status_dealloc_fail   a memory deallocation failure occurred.
+ *    - srtp_err_status_ok          if every packet was valid.
+ *    - srtp_err_status_bad_param   if ctx or pkts is NULL.
+ *    - [other]  the status of the first packet that failed.
+ */
+srtp_err_status_t srtp_unprotect_batch(srtp_t ctx,
+                                       srtp_packet_desc_t *pkts,
+                                       size_t num_pkts);
+
+/**
+ * @brief srtp_transcrypt_target_t describes one session an SRTP packet is
+ * forwarded to by srtp_transcrypt().
+ */
+typedef struct srtp_transcrypt_target_t {
+    srtp_t session;           /**< session to protect the packet with   */
+    bool rewrite;             /**< replace the SSRC and sequence number */
+    uint32_t ssrc;            /**< new SSRC in host order, if rewrite   */
+    uint16_t seq;             /**< new sequence number, if rewrite      */
+    size_t mki_index;         /**< session keys to protect with         */
+    uint8_t *out;             /**< receives the protected packet        */
+    size_t out_len;           /**< length of out before the call, of    */
+                              /**< the protected packet after the call  */
+    srtp_err_status_t status; /**< result of protecting for the target  */
+} srtp_transcrypt_target_t;
+
+/**
+ * @brief srtp_transcrypt() verifies an SRTP packet once and protects it
+ * again for each of a number of sessions, as a selective forwarding unit
+ * does.
+ *
+ * The function call srtp_transcrypt(in_session, srtp, srtp_len, targets,
+ * num_targets) unprotects the packet with in_session like srtp_unprotect()
+ * and then, for each target in order, protects the RTP packet with
+ * targets[i].session like srtp_protect(), writing it to targets[i].out. If
+ * targets[i].rewrite is set the SSRC and sequence number of the packet are
+ * replaced first, as for switching between simulcast layers. The packet is
+ * decrypted into the out buffer of the last target, which the others copy
+ * it from. The out buffer of a target that fails is zeroed, so once the
+ * call returns no buffer of the caller holds the decrypted packet.
+ *
+ * This is only a convenience wrapper around srtp_unprotect() and
+ * srtp_protect(): the payload is still decrypted once and encrypted once
+ * per target, and the decrypted packet is copied to every target while
+ * the call runs. It saves neither work nor copies, and gives no security
+ * benefit, over calling those functions directly.
+ *
+ * The out buffer of the last target has to hold the SRTP packet as well as
+ * the packet protected for it. If the packet fails verification the status
+ * of every target is set to the failure.
+ *
+ * @param in_session is the session the packet was received on.
+ * @param srtp is the SRTP packet.
+ * @param srtp_len is the length of the SRTP packet.
+ * @param targets is a pointer to an array of num_targets targets.
+ * @param num_targets is the number of targets, at least one.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet was protected for every
+ *                                  target.
+ *    - srtp_err_status_bad_param   if in_session, srtp or targets is NULL
+ *                                  or num_targets is zero.
+ *    - [other]  the status of the failed verification, or of the first
+ *               target that failed.
+ */
+srtp_err_status_t srtp_transcrypt(srtp_t in_session,
+                                  const uint8_t *srtp,
+                                  size_t srtp_len,
+                                  srtp_transcrypt_target_t *targets,
+                                  size_t num_targets);
+
+/**
+ * @brief srtp_protect_double() protects an RTP packet twice, end-to-end
+ * and hop-by-hop, as PERC double encryption (RFC 8723) does.
+ *
+ * The function call srtp_protect_double(inner, outer, rtp, rtp_len, srtp,
+ * srtp_len, mki_index) first protects the packet with the inner session,
+ * whose keys are shared by the endpoints only. As RFC 8723 specifies, the
+ * inner transform covers the RTP header without its extension, which a
+ * media distributor may change or remove. An empty Original Header Block
+ * (OHB) is then appended and the result protected with the outer session,
+ * whose keys are shared with the next hop. The work is done in the srtp
+ * buffer, which may be rtp, without copying the payload between passes.
+ *
+ * The sessions are normally created with an AEAD profile, as RFC 8723
+ * requires, but any profile can be used for either.
+ *
+ * @param inner is the end-to-end session.
+ * @param outer is the hop-by-hop session.
+ * @param rtp is the RTP packet.
+ * @param rtp_len is the length of the RTP packet.
+ * @param srtp is the buffer that receives the SRTP packet.
+ * @param srtp_len is the length of srtp before the call, of the SRTP packet
+ * after it; it has to leave room for the tags of both sessions and a byte
+ * for the OHB.
+ * @param mki_index is the index of the keys to use in both sessions.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet was protected.
+ *    - srtp_err_status_bad_param   if a parameter is NULL or the RTP
+ *                                  header is malformed.
+ *    - srtp_err_status_buffer_small if srtp_len is too small.
+ *    - [other]  the status of the failed inner or outer transform.
+ */
+srtp_err_status_t srtp_protect_double(srtp_t inner,
+                                      srtp_t outer,
+                                      const uint8_t *rtp,
+                                      size_t rtp_len,
+                                      uint8_t *srtp,
+                                      size_t *srtp_len,
+                                      size_t mki_index);
+
+/**
+ * @brief srtp_unprotect_double() removes both layers of PERC double
+ * encryption from an SRTP packet.
+ *
+ * The function call srtp_unprotect_double(inner, outer, srtp, srtp_len,
+ * rtp, rtp_len) unprotects the packet with the outer session, reads the
+ * Original Header Block to recover the payload type, sequence number and
+ * marker bit the sender protected, and unprotects the inner layer against
+ * them. The RTP header returned is the one received from the last hop, with
+ * the changes made by media distributors, followed by the end-to-end
+ * payload.
+ *
+ * @param inner is the end-to-end session.
+ * @param outer is the hop-by-hop session.
+ * @param srtp is the SRTP packet.
+ * @param srtp_len is the length of the SRTP packet.
+ * @param rtp is the buffer that receives the RTP packet, it may be srtp.
+ * @param rtp_len is the length of rtp before the call, of the RTP packet
+ * after it.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet verified on both layers.
+ *    - srtp_err_status_bad_param   if a parameter is NULL.
+ *    - srtp_err_status_parse_err   if the OHB is missing or malformed.
+ *    - [other]  the status of the failed inner or outer transform.
  */
-srtp_err_status_t srtp_dealloc(srtp_t s);
+srtp_err_status_t srtp_unprotect_double(srtp_t inner,
+                                        srtp_t outer,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        uint8_t *rtp,
+                                        size_t *rtp_len);
 
 /**
- * @brief returns the master key length for a given SRTP profile
+ * @brief srtp_hop_header_t lists the changes a media distributor makes to
+ * the RTP header of a double encrypted packet with srtp_protect_hop().
  */
-size_t srtp_profile_get_master_key_length(srtp_profile_t profile);
+typedef struct srtp_hop_header_t {
+    bool set_pt;     /**< replace the payload type     */
+    uint8_t pt;      /**< new payload type, if set_pt  */
+    bool set_seq;    /**< replace the sequence number  */
+    uint16_t seq;    /**< new sequence number, in host */
+                     /**< order, if set_seq            */
+    bool set_marker; /**< replace the marker bit       */
+    bool marker;     /**< new marker bit, if set_marker */
+} srtp_hop_header_t;
 
 /**
- * @brief returns the master salt length for a given SRTP profile
+ * @brief srtp_unprotect_hop() removes the hop-by-hop layer of a PERC
+ * double encrypted packet, as a media distributor does.
+ *
+ * The function call srtp_unprotect_hop(outer, srtp, srtp_len, rtp, rtp_len)
+ * unprotects the packet like srtp_unprotect() and checks that it ends with
+ * a well-formed Original Header Block. The end-to-end payload stays
+ * encrypted, the distributor never holds the inner keys.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet verified.
+ *    - srtp_err_status_parse_err   if the OHB is missing or malformed.
+ *    - [other]  as for srtp_unprotect().
  */
-size_t srtp_profile_get_master_salt_length(srtp_profile_t profile);
+srtp_err_status_t srtp_unprotect_hop(srtp_t outer,
+                                     const uint8_t *srtp,
+                                     size_t srtp_len,
+                                     uint8_t *rtp,
+                                     size_t *rtp_len);
 
 /**
- * @brief appends the salt to the key
+ * @brief srtp_protect_hop() applies the hop-by-hop layer of PERC double
+ * encryption to a packet returned by srtp_unprotect_hop().
  *
- * The function call srtp_append_salt_to_key(k, klen, s, slen)
- * copies the string s to the location at klen bytes following
- * the location k.
+ * The function call srtp_protect_hop(outer, rtp, rtp_len, srtp, srtp_len,
+ * mki_index, changes) makes the changes to the RTP header, if changes is
+ * not NULL, recording in the Original Header Block the values the sender
+ * used that are not recorded there yet, and protects the packet with the
+ * outer session like srtp_protect(). Header extensions are outside the
+ * end-to-end layer and may be changed by the caller before the call.
  *
- * @warning There must be at least bytes_in_salt + bytes_in_key bytes
- *          available at the location pointed to by key.
+ * @return
+ *    - srtp_err_status_ok          if the packet was protected.
+ *    - srtp_err_status_parse_err   if the OHB is missing or malformed.
+ *    - srtp_err_status_buffer_small if srtp_len is too small for the
+ *                                  larger OHB and the tag.
+ *    - [other]  as for srtp_protect().
+ */
+srtp_err_status_t srtp_protect_hop(srtp_t outer,
+                                   const uint8_t *rtp,
+                                   size_t rtp_len,
+                                   uint8_t *srtp,
+                                   size_t *srtp_len,
+                                   size_t mki_index,
+                                   const srtp_hop_header_t *changes);
+
+/**
+ * @brief srtp_iovec_t is one segment of a packet passed to
+ * srtp_protect_iov() or srtp_unprotect_iov(), it has the layout of a POSIX
+ * struct iovec.
+ */
+typedef struct srtp_iovec_t {
+    uint8_t *base; /**< start of the segment         */
+    size_t len;    /**< length in octets of the segment */
+} srtp_iovec_t;
+
+/**
+ * @brief srtp_protect_iov() applies SRTP protection to an RTP packet held
+ * in a list of segments.
+ *
+ * The packet is the concatenation of the iov_count segments of iov, the
+ * first of which must contain the complete RTP header including any CSRCs
+ * and header extension. The segments are encrypted in place and the MKI, if
+ * used, followed by the authentication tag is written to trailer, which the
+ * caller sends after the last segment. The result is the same as that of
+ * srtp_protect() for the concatenated packet.
+ *
+ * For the AES counter mode profiles with HMAC-SHA1 the payload is encrypted
+ * and authenticated segment by segment. Other profiles, and streams using
+ * header extension encryption or cryptex, are processed in a copy of the
+ * packet held by the stream.
  *
+ * @param ctx is the SRTP context to use in processing the packet.
  *
- */
-void srtp_append_salt_to_key(uint8_t *key,
-                             size_t bytes_in_key,
-                             uint8_t *salt,
-                             size_t bytes_in_salt);
-
+ * @param iov is a pointer to the segments of the RTP packet.
+ *
+ * @param iov_count is the number of segments in iov.
+ *
+ * @param trailer is a pointer to a buffer that receives the MKI and the
+ * authentication tag. At most SRTP_MAX_TRAILER_LEN octets are written.
+ *
+ * @param trailer_len is a pointer to the length in octets of trailer, on
+ * return it is set to the number of octets written.
+ *
+ * @param mki_index integer value specifying which set of session keys should
+ * be used if use_mki in the policy was set. Otherwise ignored.
+ *
+ * @return
+ *    - srtp_err_status_ok            no problems
+ *    - srtp_err_status_bad_param     if the first segment does not hold the
+ *                                    RTP header
+ *    - srtp_err_status_buffer_small  if trailer is too small
+ *    - [other]                       if there was a failure in
+ *                                    the cryptographic mechanisms.
+ */
+srtp_err_status_t srtp_protect_iov(srtp_t ctx,
+                                   srtp_iovec_t *iov,
+                                   size_t iov_count,
+                                   uint8_t *trailer,
+                                   size_t *trailer_len,
+                                   size_t mki_index);
+
+/**
+ * @brief srtp_unprotect_iov() verifies and removes SRTP protection from an
+ * SRTP packet held in a list of segments.
+ *
+ * The packet is the concatenation of the iov_count segments of iov followed
+ * by the trailer_len octets of trailer, which hold the MKI, if used, and the
+ * authentication tag. The first segment must contain the complete RTP
+ * header. If the packet is valid the segments are decrypted in place,
+ * otherwise they are left unmodified except when processed in a copy of the
+ * packet, as described for srtp_protect_iov(). The result is the same as
+ * that of srtp_unprotect() for the concatenated packet.
+ *
+ * @param ctx is the SRTP session which applies to the packet.
+ *
+ * @param iov is a pointer to the segments of the SRTP packet.
+ *
+ * @param iov_count is the number of segments in iov.
+ *
+ * @param trailer is a pointer to the MKI and authentication tag of the
+ * packet.
+ *
+ * @param trailer_len is the length in octets of trailer.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet is valid.
+ *    - srtp_err_status_bad_param   if the first segment does not hold the
+ *                                  RTP header
+ *    - [other]                     as for srtp_unprotect().
+ */
+srtp_err_status_t srtp_unprotect_iov(srtp_t ctx,
+                                     srtp_iovec_t *iov,
+                                     size_t iov_count,
+                                     const uint8_t *trailer,
+                                     size_t trailer_len);
+
+/**
+ * @brief srtp_buffer_t describes a packet in a buffer that has room for its
+ * trailer after it, like the data room of a DPDK rte_mbuf or an AF_XDP
+ * frame.
+ *
+ * Protection never grows a packet at the front, so no headroom is needed.
+ */
+typedef struct srtp_buffer_t {
+    uint8_t *data;   /**< start of the packet                     */
+    size_t len;      /**< length in octets of the packet          */
+    size_t tailroom; /**< octets available after the end of data  */
+} srtp_buffer_t;
+
+/**
+ * @brief srtp_protect_buffer() applies SRTP protection in place to the RTP
+ * packet described by buf.
+ *
+ * The function call srtp_protect_buffer(ctx, buf, mki_index) is equivalent
+ * to srtp_protect(ctx, buf->data, buf->len, buf->data, &len, mki_index)
+ * with len set to buf->len + buf->tailroom. On success the trailer has been
+ * written to the tailroom, buf->len is the length of the SRTP packet and
+ * buf->tailroom is reduced by the length of the trailer.
+ *
+ * A packet using cryptex with CSRCs is only reordered while it is processed
+ * when an AEAD cipher is used, in no case is it copied.
+ *
+ * @param ctx is the SRTP context to use in processing the packet.
+ *
+ * @param buf is the buffer holding the RTP packet.
+ *
+ * @param mki_index integer value specifying which set of session keys should
+ * be used if use_mki in the policy was set. Otherwise ignored.
+ *
+ * @return
+ *    - srtp_err_status_ok            no problems
+ *    - srtp_err_status_bad_param     if buf is NULL
+ *    - srtp_err_status_buffer_small  if the tailroom is too small for the
+ *                                    trailer
+ *    - [other]                       as for srtp_protect().
+ */
+srtp_err_status_t srtp_protect_buffer(srtp_t ctx,
+                                      srtp_buffer_t *buf,
+                                      size_t mki_index);
+
+/**
+ * @brief srtp_unprotect_buffer() verifies and removes SRTP protection in
+ * place from the SRTP packet described by buf.
+ *
+ * On success buf->len is the length of the RTP packet and the octets of the
+ * trailer are added to buf->tailroom.
+ *
+ * @param ctx is the SRTP session which applies to the packet.
+ *
+ * @param buf is the buffer holding the SRTP packet.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet is valid.
+ *    - srtp_err_status_bad_param   if buf is NULL
+ *    - [other]                     as for srtp_unprotect().
+ */
+srtp_err_status_t srtp_unprotect_buffer(srtp_t ctx, srtp_buffer_t *buf);
+
+/**
+ * @brief srtp_protect_rtcp_buffer() is srtp_protect_buffer() for an RTCP
+ * packet, see srtp_protect_rtcp().
+ */
+srtp_err_status_t srtp_protect_rtcp_buffer(srtp_t ctx,
+                                           srtp_buffer_t *buf,
+                                           size_t mki_index);
+
+/**
+ * @brief srtp_unprotect_rtcp_buffer() is srtp_unprotect_buffer() for an
+ * SRTCP packet, see srtp_unprotect_rtcp().
+ */
+srtp_err_status_t srtp_unprotect_rtcp_buffer(srtp_t ctx, srtp_buffer_t *buf);
+
+/**
+ * @brief srtp_create() allocates and initializes an SRTP session.
+ *
+ * The function call srtp_create(session, policy) allocates and
+ * initializes an SRTP session context, applying the given policy.
+ *
+ * @param session is a pointer to the SRTP session to which the policy is
+ * to be added.
+ *
+ * @param policy is an srtp_policy_t handle that describes one stream policy.
+ * It may be NULL, in which case streams can be added later using
+ * srtp_stream_add().
+ *
+ * @return
+ *    - srtp_err_status_ok           if creation succeeded.
+ *    - srtp_err_status_alloc_fail   if allocation failed.
+ *    - srtp_err_status_init_fail    if initialization failed.
+ */
+srtp_err_status_t srtp_create(srtp_t *session, const srtp_policy_t policy);
+
+/**
+ * @brief srtp_create_on_node() allocates and initializes an SRTP session
+ * whose memory is placed on a NUMA node.
+ *
+ * The function call srtp_create_on_node(session, policy, node) is
+ * srtp_create(session, policy), except that the session, and everything
+ * that is allocated for it later, such as its streams, their keys and
+ * replay databases and the stream index, is allocated on node by the
+ * allocator installed with srtp_install_node_allocator(). State that is
+ * allocated on first use while processing packets is not bound and is
+ * normally placed on the node of the thread that processes them.
+ *
+ * @param session is a pointer to the SRTP session to create.
+ * @param policy is the srtp_policy_t struct that describes the streams
+ *        of the session, or NULL.
+ * @param node is the NUMA node, or SRTP_NUMA_NODE_ANY.
+ *
+ * @return
+ *    - srtp_err_status_ok           if creation succeeded.
+ *    - srtp_err_status_bad_param    if node is negative but not
+ *      SRTP_NUMA_NODE_ANY.
+ *    - srtp_err_status_alloc_fail   if allocation failed.
+ *    - srtp_err_status_init_fail    if encryption key initialization failed.
+ */
+srtp_err_status_t srtp_create_on_node(srtp_t *session,
+                                      const srtp_policy_t policy,
+                                      int node);
+
+/**
+ * @brief srtp_session_migrate() moves the streams of a session to another
+ * NUMA node.
+ *
+ * The function call srtp_session_migrate(session, node) binds the later
+ * allocations of session to node, like srtp_create_on_node(), and
+ * rebuilds its streams, their keys and the stream index there. The
+ * streams carry on with their replay databases, rollover counters, key
+ * usage counts and packet counters, as after srtp_session_export() and
+ * srtp_session_import(); keys that an update with a key overlap keeps are
+ * dropped. The session handle, and with it the session's own small
+ * context, stays where it is.
+ *
+ * A session that has streams must have been made exportable with
+ * srtp_set_exportable(). A thread safe session can be migrated while
+ * other threads process its packets, which wait for the migration.
+ *
+ * @param session is the session to move.
+ * @param node is the NUMA node, or SRTP_NUMA_NODE_ANY.
+ *
+ * @return
+ *    - srtp_err_status_ok           if the session was moved.
+ *    - srtp_err_status_bad_param    if session is NULL, node is invalid or
+ *      the session has streams but is not exportable.
+ *    - srtp_err_status_in_progress  if batches of the session are queued.
+ *    - srtp_err_status_alloc_fail   if allocation failed, the session is
+ *      then left unchanged.
+ */
+srtp_err_status_t srtp_session_migrate(srtp_t session, int node);
+
+/**
+ * @brief srtp_stream_add() allocates and initializes an SRTP stream
+ * within a given SRTP session.
+ *
+ * The function call srtp_stream_add(session, policy) allocates and
+ * initializes a new SRTP stream within a given, previously created
+ * session, applying the policy given as the other argument to that
+ * stream.
+ *
+ * @return values:
+ *    - srtp_err_status_ok           if stream creation succeeded.
+ *    - srtp_err_status_alloc_fail   if stream allocation failed
+ *    - srtp_err_status_init_fail    if stream initialization failed.
+ */
+srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t policy);
+
+/**
+ * @brief srtp_stream_prepare() allocates and initializes an SRTP stream
+ * outside of any session.
+ *
+ * The function call srtp_stream_prepare(policy, prepared) does the work of
+ * srtp_stream_add() that does not involve a session: it allocates the
+ * stream, derives its session keys and initializes its ciphers. As the
+ * session is not touched it can be called from any thread, for example to
+ * keep the key derivation off the thread that processes packets. The
+ * stream is added to a session later with srtp_stream_commit().
+ *
+ * @param policy is an srtp_policy_t handle that describes the stream, it
+ * is copied and can be deallocated or reused afterwards.
+ *
+ * @param prepared is set to the prepared stream on success.
+ *
+ * @return
+ *    - srtp_err_status_ok           if the stream was prepared.
+ *    - srtp_err_status_bad_param    if the policy is not valid.
+ *    - srtp_err_status_alloc_fail   if stream allocation failed
+ *    - srtp_err_status_init_fail    if stream initialization failed.
+ */
+srtp_err_status_t srtp_stream_prepare(const srtp_policy_t policy,
+                                      srtp_prepared_stream_t *prepared);
+
+/**
+ * @brief srtp_stream_commit() adds a prepared stream to a session.
+ *
+ * The function call srtp_stream_commit(session, prepared) adds the stream
+ * prepared by srtp_stream_prepare() to the session, as srtp_stream_add()
+ * would have with the same policy. No keys are derived, so in a thread
+ * safe session the lock is only held briefly.
+ *
+ * The session takes over the prepared stream whether or not the call
+ * succeeds, it must not be used or deallocated afterwards.
+ *
+ * @return
+ *    - srtp_err_status_ok           if the stream was added.
+ *    - srtp_err_status_bad_param    if the policy has a wildcard SSRC and
+ *                                   the session already has a template.
+ *    - [other]                      otherwise.
+ */
+srtp_err_status_t srtp_stream_commit(srtp_t session,
+                                     srtp_prepared_stream_t prepared);
+
+/**
+ * @brief srtp_prepared_stream_dealloc() deallocates a prepared stream that
+ * has not been committed to a session.
+ *
+ * @param prepared is the prepared stream, it may be NULL.
+ */
+void srtp_prepared_stream_dealloc(srtp_prepared_stream_t prepared);
+
+/**
+ * @brief srtp_stream_remove() deallocates an SRTP stream.
+ *
+ * The function call srtp_stream_remove(session, ssrc) removes
+ * the SRTP stream with the SSRC value ssrc from the SRTP session
+ * context given by the argument session.
+ *
+ * @param session is the SRTP session from which the stream
+ * will be removed.
+ *
+ * @param ssrc is the SSRC value of the stream to be removed
+ * in host byte order.
+ *
+ * @attention In libSRTP version before 3.0.0 the SSRC param was in network
+ * byte order, this was changed in 3.0.0 to host byte order to be
+ * consistant with the rest of the api.
+ *
+ * @warning Wildcard SSRC values cannot be removed from a
+ * session.
+ *
+ * @return
+ *    - srtp_err_status_ok     if the stream deallocation succeeded.
+ *    - [other]           otherwise.
+ *
+ */
+srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc);
+
+/**
+ * @brief srtp_stream_add_many() adds a stream for each of a number of
+ * policies to a session.
+ *
+ * The function call srtp_stream_add_many(session, policies, num_policies)
+ * has the effect of calling srtp_stream_add() for each policy, but sizes
+ * the index of the session's streams for all of them at once. In a thread
+ * safe session the keys of all streams are derived before the lock of the
+ * session is taken, which is then held once. Either all streams are added
+ * or, on failure, none.
+ *
+ * @param session is the session to add the streams to.
+ *
+ * @param policies points to num_policies policies, which must all have a
+ * specific SSRC; the SSRCs must be distinct and not yet in the session.
+ *
+ * @param num_policies is the number of policies.
+ *
+ * @return
+ *    - srtp_err_status_ok           if all streams were added.
+ *    - srtp_err_status_bad_param    if a policy is NULL, not valid or has
+ *                                   a wildcard SSRC.
+ *    - [other]                      if adding a stream failed.
+ */
+srtp_err_status_t srtp_stream_add_many(srtp_t session,
+                                       const srtp_policy_t *policies,
+                                       size_t num_policies);
+
+/**
+ * @brief srtp_stream_remove_many() removes a number of streams from a
+ * session.
+ *
+ * The function call srtp_stream_remove_many(session, ssrcs, num_ssrcs)
+ * removes the stream of each SSRC as srtp_stream_remove() would, taking
+ * the lock of a thread safe session only once.
+ *
+ * @param session is the session to remove the streams from.
+ *
+ * @param ssrcs points to num_ssrcs SSRC values in host byte order.
+ *
+ * @param num_ssrcs is the number of SSRC values.
+ *
+ * @return
+ *    - srtp_err_status_ok           if all streams were removed.
+ *    - srtp_err_status_no_ctx       if an SSRC has no stream, the streams
+ *                                   of the other SSRCs are still removed.
+ *    - [other]                      otherwise.
+ */
+srtp_err_status_t srtp_stream_remove_many(srtp_t session,
+                                          const uint32_t *ssrcs,
+                                          size_t num_ssrcs);
+
+/**
+ * @brief srtp_session_gc() removes the idle streams of a session.
+ *
+ * The function call srtp_session_gc(session) starts a new epoch of the
+ * session and removes the streams cloned from its template that were not
+ * used in the number of epochs set with
+ * srtp_policy_set_clone_idle_timeout(). Calling it at a fixed interval,
+ * for example once a second, makes the timeout that many intervals.
+ *
+ * Each protected or unprotected packet marks its stream as used in the
+ * current epoch, which srtp_policy_set_max_clones() also relies on.
+ *
+ * The SRTCP and header extension keys of a stream are derived when the
+ * first packet needs them, and until then its master key is kept in
+ * memory. srtp_session_gc() derives the keys still pending and wipes
+ * those master keys, so that none is kept for longer than an epoch;
+ * except that an exportable session keeps a copy of all its master keys,
+ * see srtp_set_exportable().
+ *
+ * @param session is the SRTP session to collect.
+ *
+ * @return
+ *    - srtp_err_status_ok        if the idle streams were removed.
+ *    - srtp_err_status_bad_param if session is NULL.
+ *    - [other]                   if deallocating a stream or deriving
+ *                                its keys failed.
+ */
+srtp_err_status_t srtp_session_gc(srtp_t session);
+
+/**
+ * @brief srtp_session_set_breaker() bounds the work spent on packets for
+ * SSRCs that have no stream of their own.
+ *
+ * Such packets are verified with the template stream of the session,
+ * which costs as much as accepting a packet, so a flood of forged packets
+ * with new SSRCs costs a full verification each. The function call
+ * srtp_session_set_breaker(session, max_failures, cooldown) makes the
+ * session reject the next cooldown packets for unknown SSRCs with
+ * srtp_err_status_no_ctx, without any cryptographic work, after
+ * max_failures of them failed in a row. The packet after those is
+ * verified again: if it is accepted the session goes back to verifying
+ * every packet, if not it rejects another cooldown packets.
+ *
+ * While the breaker is open new SSRCs can not join the session, packets
+ * of the streams it has are not affected. SRTP and SRTCP packets share
+ * the breaker.
+ *
+ * @param session is the SRTP session.
+ * @param max_failures is the number of failures in a row that open the
+ *        breaker, 0 turns it off, which is the default.
+ * @param cooldown is the number of packets rejected while it is open.
+ *
+ * @return
+ *    - srtp_err_status_ok        on success.
+ *    - srtp_err_status_bad_param if session is NULL, or cooldown is 0 and
+ *                                max_failures is not.
+ */
+srtp_err_status_t srtp_session_set_breaker(srtp_t session,
+                                           size_t max_failures,
+                                           size_t cooldown);
+
+/**
+ * @brief srtp_session_get_breaker_rejections() returns the number of
+ * packets the breaker set with srtp_session_set_breaker() has rejected.
+ *
+ * @return
+ *    - srtp_err_status_ok        on success.
+ *    - srtp_err_status_bad_param if an argument is NULL.
+ */
+srtp_err_status_t srtp_session_get_breaker_rejections(srtp_t session,
+                                                      uint64_t *rejected);
+
+/**
+ * @brief srtp_update() updates all streams in the session.
+ *
+ * The function call srtp_update(session, policy) updates
+ * all the streams in the session applying the given policy
+ * and key. The existing ROC value of all streams will be
+ * preserved.
+ *
+ * @param session is the SRTP session that contains the streams
+ *        to be updated.
+ *
+ * @param policy is an srtp_policy_t handle that describes the update policy
+ * to apply to matching stream(s).
+ *
+ * @return
+ *    - srtp_err_status_ok           if stream creation succeed.
+ *    - srtp_err_status_alloc_fail   if stream allocation failed
+ *    - srtp_err_status_init_fail    if stream initialization failed.
+ *    - [other]                 otherwise.
+ *
+ */
+srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t policy);
+
+/**
+ * @brief srtp_stream_update() updates a SRTP stream.
+ *
+ * The function call srtp_stream_update(session, policy) updates
+ * the stream(s) in the session that match applying the given
+ * policy and key. The existing ROC value of all stream(s) will
+ * be preserved.
+ *
+ * In a thread safe session the new keys are derived before the session
+ * is locked, so that packets of other streams are only held up while the
+ * updated streams are swapped in.
+ *
+ * @param session is the SRTP session that contains the streams
+ *        to be updated.
+ *
+ * @param policy is an srtp_policy_t handle that describes the update policy
+ * to apply to matching stream(s).
+ *
+ * @return
+ *    - srtp_err_status_ok           if stream creation succeeded.
+ *    - srtp_err_status_alloc_fail   if stream allocation failed
+ *    - srtp_err_status_init_fail    if stream initialization failed.
+ *    - [other]                      otherwise.
+ *
+ */
+srtp_err_status_t srtp_stream_update(srtp_t session,
+                                     const srtp_policy_t policy);
+
+/**
+ * @brief srtp_dealloc() deallocates storage for an SRTP session
+ * context.
+ *
+ * The function call srtp_dealloc(s) deallocates storage for the
+ * SRTP session context s.  This function should be called no more
+ * than one time for each of the contexts allocated by the function
+ * srtp_create().
+ *
+ * @param s is the srtp_t for the session to be deallocated.
+ *
+ * @return
+ *    - srtp_err_status_ok             if there no problems.
+ *    - srtp_err_status_dealloc_fail   a memory deallocation failure occurred.
+ */
+srtp_err_status_t srtp_dealloc(srtp_t s);
+
+/**
+ * @brief srtp_dealloc_deferred() retires an SRTP session so that its
+ * storage can be deallocated later, possibly on another thread.
+ *
+ * The function call srtp_dealloc_deferred(session, retired) does the part
+ * of srtp_dealloc() that has to happen in order with the use of the
+ * session: it checks that no batches are queued and, in a thread safe
+ * session, waits for the packets being processed. Zeroizing the keys and
+ * freeing the streams, which takes time in proportion to the number of
+ * streams, is left to srtp_reclaim(), which can be called from a
+ * background thread. The session must not be used afterwards.
+ *
+ * @param session is the session to retire.
+ *
+ * @param retired is set to the retired session.
+ *
+ * @return
+ *    - srtp_err_status_ok             if the session was retired.
+ *    - srtp_err_status_bad_param      if an argument is NULL.
+ *    - srtp_err_status_in_progress    if batches of the session are queued.
+ */
+srtp_err_status_t srtp_dealloc_deferred(srtp_t session,
+                                        srtp_retired_t *retired);
+
+/**
+ * @brief srtp_reclaim() deallocates a session retired by
+ * srtp_dealloc_deferred().
+ *
+ * It can be called from any thread, but only once for each retired
+ * session.
+ *
+ * @param retired is the retired session, it may be NULL.
+ *
+ * @return
+ *    - srtp_err_status_ok             if there no problems.
+ *    - srtp_err_status_dealloc_fail   a memory deallocation failure occurred.
+ */
+srtp_err_status_t srtp_reclaim(srtp_retired_t retired);
+
+/**
+ * @brief returns the master key length for a given SRTP profile
+ */
+size_t srtp_profile_get_master_key_length(srtp_profile_t profile);
+
+/**
+ * @brief returns the master salt length for a given SRTP profile
+ */
+size_t srtp_profile_get_master_salt_length(srtp_profile_t profile);
+
+/**
+ * @brief appends the salt to the key
+ *
+ * The function call srtp_append_salt_to_key(k, klen, s, slen)
+ * copies the string s to the location at klen bytes following
+ * the location k.
+ *
+ * @warning There must be at least bytes_in_salt + bytes_in_key bytes
+ *          available at the location pointed to by key.
+ *
+ *
+ */
+void srtp_append_salt_to_key(uint8_t *key,
+                             size_t bytes_in_key,
+                             uint8_t *salt,
+                             size_t bytes_in_salt);
+
 /**
  * @}
  */
@@ -885,8 +2091,7 @@ void srtp_append_salt_to_key(uint8_t *key,
  * *srtcp_len is the number of octets in that packet; otherwise, no
  * assumptions should be made about the value of either data elements.
  *
- * @warning This function assumes that the RTCP packet is aligned on a 32-bit
- * boundary.
+ * The packet may start at any address, it need not be aligned.
  *
  * @param ctx is the SRTP context to use in processing the packet.
  *
@@ -895,80 +2100,392 @@ void srtp_append_salt_to_key(uint8_t *key,
  * @param rtcp_len is the length in octets of the complete RTCP packet (header
  * and body).
  *
- * @param srtcp is a pointer to a buffer that after the function returns will
- * contain the complete SRTCP packet. The value of srtcp can be the same as rtcp
- * to support in-place io.
+ * @param srtcp is a pointer to a buffer that after the function returns will
+ * contain the complete SRTCP packet. The value of srtcp can be the same as rtcp
+ * to support in-place io.
+ *
+ * @param srtcp_len is a pointer to the length in octets of the srtcp buffer
+ * before the function call, and of the complete SRTCP packet after the call, if
+ * srtp_err_status_ok was returned. Otherwise, the value of the data to which it
+ * points is undefined.
+ *
+ * @param mki_index integer value specifying which set of session keys should be
+ * used if use_mki was set to true. Otherwise ignored.
+ *
+ * @return
+ *    - srtp_err_status_ok            if there were no problems.
+ *    - srtp_err_status_buffer_small  the srtcp buffer is too small for the
+ * SRTCP packet
+ *    - [other]                  if there was a failure in
+ *                               the cryptographic mechanisms.
+ */
+srtp_err_status_t srtp_protect_rtcp(srtp_t ctx,
+                                    const uint8_t *rtcp,
+                                    size_t rtcp_len,
+                                    uint8_t *srtcp,
+                                    size_t *srtcp_len,
+                                    size_t mki_index);
+
+/**
+ * @brief srtp_unprotect_rtcp() is the Secure RTCP receiver-side packet
+ * processing function.
+ *
+ * The function call srtp_unprotect_rtcp(ctx, srtcp, srtcp_len, rtcp, rtcp_len)
+ * verifies the Secure RTCP protection of the SRTCP packet pointed to
+ * by srtcp (which has length srtcp_len), using the SRTP session
+ * context ctx.  If srtp_err_status_ok is returned, then rtcp points
+ * to the resulting RTCP packet and *rtcp_len is the number of octets
+ * in that packet; otherwise, no assumptions should be made about the
+ * value of either data elements.
+ *
+ * The packet may start at any address, it need not be aligned.
+ *
+ * @param ctx is a pointer to the srtp_t which applies to the
+ * particular packet.
+ *
+ * @param srtcp is a pointer to the header of the SRTCP packet.
+ *
+ * @param srtcp_len is the length in octets of the complete SRTCP packet (header
+ * and body).
+ *
+ * @param rtcp is a pointer to a buffer that after the function returns will
+ * contain the complete RTCP packet. The value of rtcp can be the same as srtcp
+ * to support in-place io.
+ *
+ * @param rtcp_len is a pointer to the length of the rtcp buffer before the
+ * function call, and of the complete RTCP packet after the call, if
+ * srtp_err_status_ok was returned. Otherwise, the value of the data to which
+ * it points is undefined.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the RTCP packet is valid.
+ *    - srtp_err_status_auth_fail   if the SRTCP packet failed the message
+ *                             authentication check.
+ *    - srtp_err_status_replay_fail if the SRTCP packet is a replay (e.g. has
+ *                             already been processed and accepted).
+ *    - srtp_err_status_bad_mki     if the MKI in the packet is not a known MKI
+ *                                  id
+ *    - [other]  if there has been an error in the cryptographic mechanisms.
+ *
+ */
+srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
+                                      const uint8_t *srtcp,
+                                      size_t srtcp_len,
+                                      uint8_t *rtcp,
+                                      size_t *rtcp_len);
+
+/**
+ * @brief srtp_protect_rtcp_batch() applies SRTCP protection to a vector of
+ * RTCP packets.
+ *
+ * The function call srtp_protect_rtcp_batch(ctx, pkts, num_pkts) is
+ * equivalent to calling srtp_protect_rtcp(ctx, pkts[i].in, pkts[i].in_len,
+ * pkts[i].out, &pkts[i].out_len, pkts[i].mki_index) for each packet in
+ * order, storing the result in pkts[i].status. Each packet is a complete,
+ * possibly compound, RTCP packet. The stream lookup and session key
+ * selection are done once for each run of consecutive packets with the same
+ * sender SSRC and mki_index.
+ *
+ * A failure to protect one packet does not stop the processing of the
+ * following packets.
+ *
+ * @param ctx is the SRTP context to use in processing the packets.
+ *
+ * @param pkts is a pointer to an array of num_pkts packet descriptors.
+ *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok          if every packet was protected.
+ *    - srtp_err_status_bad_param   if ctx or pkts is NULL.
+ *    - [other]  the status of the first packet that failed.
+ */
+srtp_err_status_t srtp_protect_rtcp_batch(srtp_t ctx,
+                                          srtp_packet_desc_t *pkts,
+                                          size_t num_pkts);
+
+/**
+ * @brief srtp_unprotect_rtcp_batch() verifies and removes SRTCP protection
+ * from a vector of SRTCP packets.
+ *
+ * The function call srtp_unprotect_rtcp_batch(ctx, pkts, num_pkts) is
+ * equivalent to calling srtp_unprotect_rtcp(ctx, pkts[i].in, pkts[i].in_len,
+ * pkts[i].out, &pkts[i].out_len) for each packet in order, storing the
+ * result in pkts[i].status. The mki_index field is ignored. The stream
+ * lookup is done once for each run of consecutive packets with the same
+ * SSRC.
+ *
+ * A failure to unprotect one packet does not stop the processing of the
+ * following packets.
+ *
+ * @param ctx is the SRTP session which applies to the packets.
+ *
+ * @param pkts is a pointer to an array of num_pkts packet descriptors.
+ *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok          if every packet was valid.
+ *    - srtp_err_status_bad_param   if ctx or pkts is NULL.
+ *    - [other]  the status of the first packet that failed.
+ */
+srtp_err_status_t srtp_unprotect_rtcp_batch(srtp_t ctx,
+                                            srtp_packet_desc_t *pkts,
+                                            size_t num_pkts);
+
+/**
+ * @brief srtp_frame_desc_t describes a frame that srtp_unprotect_framed()
+ * found in its buffer.
+ */
+typedef struct srtp_frame_desc_t {
+    size_t offset;            /**< offset of the packet in the buffer,   */
+                              /**< after its length prefix               */
+    size_t len;               /**< length of the unprotected packet      */
+    bool rtcp;                /**< whether the packet is SRTCP           */
+    srtp_err_status_t status; /**< result of unprotecting this packet    */
+} srtp_frame_desc_t;
+
+/**
+ * @brief srtp_unprotect_framed() unprotects the SRTP and SRTCP packets
+ * framed in a byte stream, as RTP over TCP (RFC 4571) carries them.
+ *
+ * Every frame of buf is a 16-bit length in network byte order followed by
+ * a packet of that length. The function call srtp_unprotect_framed(ctx,
+ * buf, buf_len, frames, max_frames, &num_frames, &consumed) unprotects
+ * the packets of the complete frames in place, where they lie in buf, and
+ * describes each in frames[i]. Packets whose second octet is 192 to 223,
+ * the RTCP packet types, are given to srtp_unprotect_rtcp_batch(), the
+ * others to srtp_unprotect_batch(), a run of consecutive packets of the
+ * same kind at a time (see RFC 5761 for this demultiplexing). The packets
+ * need no particular alignment in buf.
+ *
+ * The function stops at the first frame that is not complete in buf, or
+ * after max_frames frames, setting consumed to the offset of that frame;
+ * the caller keeps the octets from there on to complete the frame with
+ * the next data it receives. A frame of length zero is described with
+ * the status srtp_err_status_bad_param.
+ *
+ * @param ctx is the SRTP session which applies to the packets.
+ * @param buf is the received byte stream.
+ * @param buf_len is the number of octets in buf.
+ * @param frames is an array of max_frames frame descriptors.
+ * @param max_frames is the number of frames that fit in frames.
+ * @param num_frames is set to the number of frames described.
+ * @param consumed is set to the number of octets of buf processed.
+ *
+ * @return
+ *    - srtp_err_status_ok          if every packet was valid.
+ *    - srtp_err_status_bad_param   if a pointer argument is NULL.
+ *    - [other]  the status of the first packet that failed.
+ */
+srtp_err_status_t srtp_unprotect_framed(srtp_t ctx,
+                                        uint8_t *buf,
+                                        size_t buf_len,
+                                        srtp_frame_desc_t *frames,
+                                        size_t max_frames,
+                                        size_t *num_frames,
+                                        size_t *consumed);
+
+/**
+ * @brief srtp_batch_op_t selects the batch function that a batch
+ * submitted with srtp_batch_submit() is processed with.
+ */
+typedef enum {
+    srtp_batch_protect = 0,        /**< srtp_protect_batch()        */
+    srtp_batch_unprotect = 1,      /**< srtp_unprotect_batch()      */
+    srtp_batch_protect_rtcp = 2,   /**< srtp_protect_rtcp_batch()   */
+    srtp_batch_unprotect_rtcp = 3, /**< srtp_unprotect_rtcp_batch() */
+} srtp_batch_op_t;
+
+/**
+ * @brief srtp_batch_done_func_t is called when a batch submitted with
+ * srtp_batch_submit() has been processed.
+ *
+ * It is called once per batch, in the order the batches of a session were
+ * submitted, on the thread that processed the batch. It may submit new
+ * batches and deallocate batch; batches it submits or runs are processed
+ * after it returns.
+ */
+typedef void (*srtp_batch_done_func_t)(srtp_batch_t batch, void *user_data);
+
+/**
+ * @brief srtp_offload_engine_t is the interface of an engine that
+ * processes the batches submitted to a session asynchronously.
+ *
+ * submit(engine_data, batch) is called by srtp_batch_submit() to hand a
+ * batch to the engine. It returns srtp_err_status_ok if the engine takes
+ * the batch, which it then passes to srtp_batch_run() exactly once, when
+ * and on the thread it sees fit: from a worker thread, from the
+ * completion handler of a device queue or from poll. Any other status
+ * refuses the batch.
+ *
+ * poll(engine_data), which may be NULL, is called by srtp_session_poll()
+ * to let an engine without threads of its own make progress; it returns
+ * the number of batches it passed to srtp_batch_run().
+ *
+ * The cipher and auth types of a hardware accelerator, registered with
+ * srtp_replace_cipher_type() and srtp_replace_auth_type(), do their work
+ * within srtp_batch_run().
+ */
+typedef struct srtp_offload_engine_t {
+    srtp_err_status_t (*submit)(void *engine_data, srtp_batch_t batch);
+    size_t (*poll)(void *engine_data);
+} srtp_offload_engine_t;
+
+/**
+ * @brief srtp_session_set_offload() sets the engine that processes the
+ * batches submitted to a session.
+ *
+ * The function call srtp_session_set_offload(session, engine,
+ * engine_data) makes srtp_batch_submit() hand batches of session to
+ * engine. With a NULL engine, which is the default, batches are processed
+ * within srtp_batch_submit(). An engine that calls srtp_batch_run() from
+ * another thread than the one submitting needs a thread safe session,
+ * see srtp_set_thread_safe().
  *
- * @param srtcp_len is a pointer to the length in octets of the srtcp buffer
- * before the function call, and of the complete SRTCP packet after the call, if
- * srtp_err_status_ok was returned. Otherwise, the value of the data to which it
- * points is undefined.
+ * @param session is the session to change.
+ * @param engine is the engine, it must outlive its use by session.
+ * @param engine_data is passed to the functions of engine.
  *
- * @param mki_index integer value specifying which set of session keys should be
- * used if use_mki was set to true. Otherwise ignored.
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if session is NULL or engine has no
+ *                                   submit function.
+ *    - srtp_err_status_in_progress  if batches of session are pending.
+ */
+srtp_err_status_t srtp_session_set_offload(srtp_t session,
+                                           const srtp_offload_engine_t *engine,
+                                           void *engine_data);
+
+/**
+ * @brief srtp_batch_submit() submits a batch of packets for asynchronous
+ * processing.
+ *
+ * The function call srtp_batch_submit(ctx, op, pkts, num_pkts, done,
+ * user_data, batch) creates a batch that, once run, has the effect of
+ * calling the batch function selected by op with ctx, pkts and num_pkts,
+ * and hands it to the offload engine of ctx. The packets and pkts must
+ * stay valid and untouched until the batch has been processed, which is
+ * signaled by a call to done, if not NULL, and by srtp_batch_get_status()
+ * no longer returning srtp_err_status_in_progress.
+ *
+ * Batches are processed in the order they were submitted, even if the
+ * engine runs them in another order, so the packet indices and replay
+ * databases of the streams are updated as if the batch functions had
+ * been called directly.
+ *
+ * Without an offload engine the batch is processed before the function
+ * returns, unless it is called from a done function.
+ *
+ * @param ctx is the session.
+ * @param op selects the batch function.
+ * @param pkts is the array of num_pkts packet descriptors.
+ * @param num_pkts is the number of packets in the batch.
+ * @param done is called when the batch was processed, it may be NULL.
+ * @param user_data is passed to done.
+ * @param batch is set to the new batch, which must be deallocated with
+ *        srtp_batch_dealloc() once it was processed.
  *
  * @return
- *    - srtp_err_status_ok            if there were no problems.
- *    - srtp_err_status_buffer_small  the srtcp buffer is too small for the
- * SRTCP packet
- *    - [other]                  if there was a failure in
- *                               the cryptographic mechanisms.
+ *    - srtp_err_status_ok           if the batch was submitted.
+ *    - srtp_err_status_bad_param    if an argument is invalid.
+ *    - srtp_err_status_alloc_fail   if memory could not be allocated.
+ *    - [other]                      the status the engine refused the
+ *                                   batch with.
  */
-srtp_err_status_t srtp_protect_rtcp(srtp_t ctx,
-                                    const uint8_t *rtcp,
-                                    size_t rtcp_len,
-                                    uint8_t *srtcp,
-                                    size_t *srtcp_len,
-                                    size_t mki_index);
+srtp_err_status_t srtp_batch_submit(srtp_t ctx,
+                                    srtp_batch_op_t op,
+                                    srtp_packet_desc_t *pkts,
+                                    size_t num_pkts,
+                                    srtp_batch_done_func_t done,
+                                    void *user_data,
+                                    srtp_batch_t *batch);
 
 /**
- * @brief srtp_unprotect_rtcp() is the Secure RTCP receiver-side packet
- * processing function.
+ * @brief srtp_batch_run() is called by an offload engine to process a
+ * batch it was given.
  *
- * The function call srtp_unprotect_rtcp(ctx, srtcp, srtcp_len, rtcp, rtcp_len)
- * verifies the Secure RTCP protection of the SRTCP packet pointed to
- * by srtcp (which has length srtcp_len), using the SRTP session
- * context ctx.  If srtp_err_status_ok is returned, then rtcp points
- * to the resulting RTCP packet and *rtcp_len is the number of octets
- * in that packet; otherwise, no assumptions should be made about the
- * value of either data elements.
+ * A batch that was submitted after a batch the engine has not run yet is
+ * only marked as ready, it is processed together with the earlier batch.
+ * Processing a batch stores the status of each packet in the packet
+ * descriptors and calls the done function of the batch.
  *
- * @warning This function assumes that the SRTCP packet is aligned on a
- * 32-bit boundary.
+ * @param batch is the batch to process.
  *
- * @param ctx is a pointer to the srtp_t which applies to the
- * particular packet.
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if batch is NULL or was already run.
+ */
+srtp_err_status_t srtp_batch_run(srtp_batch_t batch);
+
+/**
+ * @brief srtp_session_poll() lets the offload engine of a session make
+ * progress.
  *
- * @param srtcp is a pointer to the header of the SRTCP packet.
+ * @param session is the session.
  *
- * @param srtcp_len is the length in octets of the complete SRTCP packet (header
- * and body).
+ * @return the number of batches the engine has run, zero if the session
+ * has no engine or the engine has no poll function.
+ */
+size_t srtp_session_poll(srtp_t session);
+
+/**
+ * @brief srtp_batch_get_status() returns the status of a batch.
  *
- * @param rtcp is a pointer to a buffer that after the function returns will
- * contain the complete RTCP packet. The value of rtcp can be the same as srtcp
- * to support in-place io.
+ * @param batch is the batch.
  *
- * @param rtcp_len is a pointer to the length of the rtcp buffer before the
- * function call, and of the complete RTCP packet after the call, if
- * srtp_err_status_ok was returned. Otherwise, the value of the data to which
- * it points is undefined.
+ * @return
+ *    - srtp_err_status_in_progress  while the batch was not processed.
+ *    - srtp_err_status_bad_param    if batch is NULL.
+ *    - [other]                      the status the batch function
+ *                                   returned for the batch.
+ */
+srtp_err_status_t srtp_batch_get_status(srtp_batch_t batch);
+
+/**
+ * @brief srtp_batch_dealloc() deallocates a processed batch.
+ *
+ * @param batch is the batch.
  *
  * @return
- *    - srtp_err_status_ok          if the RTCP packet is valid.
- *    - srtp_err_status_auth_fail   if the SRTCP packet failed the message
- *                             authentication check.
- *    - srtp_err_status_replay_fail if the SRTCP packet is a replay (e.g. has
- *                             already been processed and accepted).
- *    - srtp_err_status_bad_mki     if the MKI in the packet is not a known MKI
- *                                  id
- *    - [other]  if there has been an error in the cryptographic mechanisms.
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if batch is NULL.
+ *    - srtp_err_status_in_progress  if batch was not processed yet.
+ */
+srtp_err_status_t srtp_batch_dealloc(srtp_batch_t batch);
+
+/**
+ * @brief srtp_set_thread_safe() makes a session usable from several
+ * threads at once.
+ *
+ * By default an srtp_t must not be used concurrently and the application
+ * has to serialize all calls for a session. In thread safe mode the
+ * session locks internally: packets of different SSRCs are protected and
+ * unprotected in parallel, as are the RTP and the RTCP packets of one
+ * SSRC, while RTP packets of the same SSRC, RTCP packets of the same SSRC,
+ * the first packet of a new SSRC seen through a template, and stream
+ * management calls such as srtp_stream_add(), srtp_stream_remove() and
+ * srtp_update() are serialized. RTCP packets are also serialized with the
+ * RTP packets of their SSRC while the stream still accepts the keys it
+ * was updated from. srtp_dealloc() must still not be called while the
+ * session is in use.
+ *
+ * Streams cloned from an SSRC_ANY_INBOUND or SSRC_ANY_OUTBOUND template
+ * get their own keys derived from a copy of the template's policy, which
+ * is kept until the session is deallocated. Their key usage limits are
+ * then also counted per stream, and stream pools set with
+ * srtp_policy_set_stream_pool_size() are not used.
  *
+ * @param session is the session to change.
+ * @param thread_safe true to enable internal locking.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if session is NULL or already has a
+ *      template stream; call this before adding wildcard policies.
+ *    - srtp_err_status_fail if the platform has no atomic operations.
  */
-srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
-                                      const uint8_t *srtcp,
-                                      size_t srtcp_len,
-                                      uint8_t *rtcp,
-                                      size_t *rtcp_len);
+srtp_err_status_t srtp_set_thread_safe(srtp_t session, bool thread_safe);
 
 /**
  * @defgroup User data associated to a SRTP session.
@@ -1062,8 +2579,11 @@ typedef enum {
                              /**< usage limit and will expire soon.     */
     event_key_hard_limit,    /**< An SRTP stream reached the hard       */
                              /**< key usage limit and has expired.      */
-    event_packet_index_limit /**< An SRTP stream reached the hard       */
-                             /**< packet limit (2^48 packets).          */
+    event_packet_index_limit, /**< An SRTP stream reached the hard      */
+                              /**< packet limit (2^48 packets).         */
+    event_queue_overflow      /**< Events were lost to a full event     */
+                              /**< queue, see                           */
+                              /**< srtp_session_set_event_queue().      */
 } srtp_event_t;
 
 /**
@@ -1106,6 +2626,56 @@ typedef void(srtp_event_handler_func_t)(srtp_event_data_t *data);
  */
 srtp_err_status_t srtp_install_event_handler(srtp_event_handler_func_t func);
 
+/**
+ * @brief srtp_session_set_event_queue() makes a session queue its events
+ * instead of calling the event handler.
+ *
+ * The function call srtp_session_set_event_queue(session, num_events)
+ * gives the session a queue for at least num_events events, rounded up to
+ * a power of two. The packet functions then only add their events to the
+ * queue, without locking, and a control thread takes them with
+ * srtp_session_poll_events(). An event that a stream already has in the
+ * queue is not queued again until it has been polled, so a storm of SSRC
+ * collisions or key limit events takes a single entry per stream. Events
+ * that do not fit are counted and reported as one event_queue_overflow.
+ *
+ * The queue should be set before packets are processed. Events still in a
+ * replaced queue are lost.
+ *
+ * @param session is the session.
+ *
+ * @param num_events is the number of events the queue holds at least, or
+ * 0 to remove the queue and call the event handler again.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the queue was set.
+ *    - srtp_err_status_bad_param   if session is NULL or num_events is too
+ *                                  large.
+ *    - srtp_err_status_fail        if atomic operations are not available.
+ *    - srtp_err_status_alloc_fail  if the queue could not be allocated.
+ */
+srtp_err_status_t srtp_session_set_event_queue(srtp_t session,
+                                               size_t num_events);
+
+/**
+ * @brief srtp_session_poll_events() takes the queued events of a session.
+ *
+ * The function call srtp_session_poll_events(session, events, max_events,
+ * num_events) moves up to max_events events from the queue set with
+ * srtp_session_set_event_queue() to events, oldest first, and sets
+ * num_events to their number. Only one thread may poll a session at a
+ * time, while any number of threads process its packets.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the events were taken.
+ *    - srtp_err_status_bad_param   if an argument is NULL or the session
+ *                                  has no event queue.
+ */
+srtp_err_status_t srtp_session_poll_events(srtp_t session,
+                                           srtp_event_data_t *events,
+                                           size_t max_events,
+                                           size_t *num_events);
+
 /**
  * @brief Returns the version string of the library.
  *
@@ -1179,6 +2749,282 @@ typedef void(srtp_log_handler_func_t)(srtp_log_level_t level,
 srtp_err_status_t srtp_install_log_handler(srtp_log_handler_func_t func,
                                            void *data);
 
+/**
+ * @brief srtp_alloc_func_t is the function prototype for a custom
+ * allocator.
+ *
+ * It returns a block of at least size octets suitably aligned for any
+ * type, like malloc(), or NULL on failure. The memory does not need to be
+ * zeroed. data is the user pointer given to srtp_install_allocator().
+ */
+typedef void *(srtp_alloc_func_t)(size_t size, void *data);
+
+/**
+ * @brief srtp_free_func_t is the function prototype for releasing memory
+ * obtained from the matching srtp_alloc_func_t.
+ */
+typedef void(srtp_free_func_t)(void *ptr, void *data);
+
+/**
+ * @brief sets the allocator used for all memory libSRTP allocates.
+ *
+ * The function call srtp_install_allocator(alloc_func, free_func, data)
+ * makes libSRTP obtain memory from alloc_func and release it with
+ * free_func, both called with data as their last argument. Passing NULL
+ * for both functions restores the default allocator, which uses malloc()
+ * and free().
+ *
+ * The allocator can only be changed while no memory allocated by libSRTP
+ * is in use, i.e. before srtp_init() or after all sessions have been
+ * deallocated and srtp_shutdown() has been called. There can only be a
+ * single, global allocator and installing it is not thread safe.
+ *
+ * @param alloc_func is the function used to allocate memory.
+ * @param free_func is the function used to free memory.
+ * @param data is a user pointer passed to alloc_func and free_func.
+ *
+ * @return
+ *    - srtp_err_status_ok if the allocator was installed.
+ *    - srtp_err_status_bad_param if only one of the functions is NULL.
+ *    - srtp_err_status_fail if memory allocated by libSRTP is still in use.
+ */
+srtp_err_status_t srtp_install_allocator(srtp_alloc_func_t alloc_func,
+                                         srtp_free_func_t free_func,
+                                         void *data);
+
+/**
+ * @brief SRTP_NUMA_NODE_ANY is the NUMA node of allocations that are not
+ * bound to a node.
+ */
+#define SRTP_NUMA_NODE_ANY (-1)
+
+/**
+ * @brief srtp_node_alloc_func_t is the function prototype for a custom
+ * allocator that places memory on a NUMA node.
+ *
+ * It is like srtp_alloc_func_t, with node set to the node of the session
+ * the memory is allocated for, see srtp_create_on_node(), or to
+ * SRTP_NUMA_NODE_ANY if the memory is not bound to a node.
+ */
+typedef void *(srtp_node_alloc_func_t)(size_t size, int node, void *data);
+
+/**
+ * @brief sets an allocator that places the memory of a session on the
+ * NUMA node it was created for or migrated to.
+ *
+ * The function call srtp_install_node_allocator(alloc_func, free_func,
+ * data) is srtp_install_allocator() for an allocator that is told the
+ * node of every allocation, e.g. one that uses numa_alloc_onnode() or
+ * mbind(). The same restrictions apply. Memory that a crypto library
+ * allocates by itself, such as the cipher contexts of OpenSSL, does not
+ * go through the allocator.
+ *
+ * @param alloc_func is the function used to allocate memory.
+ * @param free_func is the function used to free memory.
+ * @param data is a user pointer passed to alloc_func and free_func.
+ *
+ * @return
+ *    - srtp_err_status_ok if the allocator was installed.
+ *    - srtp_err_status_bad_param if only one of the functions is NULL.
+ *    - srtp_err_status_fail if memory allocated by libSRTP is still in use.
+ */
+srtp_err_status_t srtp_install_node_allocator(srtp_node_alloc_func_t alloc_func,
+                                              srtp_free_func_t free_func,
+                                              void *data);
+
+/**
+ * @brief srtp_alloc_stats_t reports the memory held by libSRTP.
+ *
+ * The counts cover all allocations made through the installed allocator,
+ * so sampling them before and after creating a session gives the memory
+ * used by that session.
+ */
+typedef struct srtp_alloc_stats_t {
+    size_t live_bytes;        /**< octets currently allocated              */
+    size_t live_allocations;  /**< number of allocations not yet freed     */
+    size_t total_allocations; /**< allocations since the allocator was set */
+} srtp_alloc_stats_t;
+
+/**
+ * @brief srtp_get_alloc_stats(stats) fills in the current allocation
+ * counters of the installed allocator.
+ *
+ * The counters are updated atomically where the compiler supports it, so
+ * they can be sampled while other threads use libSRTP.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if stats is NULL.
+ */
+srtp_err_status_t srtp_get_alloc_stats(srtp_alloc_stats_t *stats);
+
+/**
+ * @brief srtp_session_memory_t breaks down the memory held by a session.
+ *
+ * The categories do not overlap, total is their sum. Only memory
+ * allocated through the installed allocator is counted: the expanded
+ * keys, which the streams of all sessions share through a process wide
+ * store, and what a crypto library such as OpenSSL allocates on its own
+ * are not included.
+ */
+typedef struct srtp_session_memory_t {
+    size_t total;       /**< octets held by the session in all        */
+    size_t session;     /**< the session, its stream index, template  */
+                        /**< policy and event queue                   */
+    size_t streams;     /**< streams added explicitly                 */
+    size_t clones;      /**< streams cloned from the template         */
+    size_t templates;   /**< the template, and the one an update      */
+                        /**< replaced while clones still use it       */
+    size_t pool;        /**< free streams kept for cloning            */
+    size_t keys;        /**< cipher and authentication contexts and   */
+                        /**< key state of all of the above            */
+    size_t replay;      /**< replay windows of all of the above       */
+    size_t key_cache;   /**< keys kept to add streams without the KDF */
+    size_t num_streams; /**< streams in the session, with clones      */
+    size_t num_clones;  /**< streams cloned from the template         */
+} srtp_session_memory_t;
+
+/**
+ * @brief srtp_session_get_memory_usage(session, usage) reports the memory
+ * held by session, by category.
+ *
+ * The memory of a stream depends on its replay window size and number of
+ * master keys, so sampling a session after its streams are set up gives
+ * the cost of another session like it; a count of clones that keeps
+ * growing points at clones that are never removed, see
+ * srtp_session_gc(). Walking the streams takes time linear in their
+ * number, the function is meant to be called from a control thread.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if session or usage is NULL.
+ */
+srtp_err_status_t srtp_session_get_memory_usage(srtp_t session,
+                                                srtp_session_memory_t *usage);
+
+/**
+ * @brief srtp_stage_t names the stages of the packet path that
+ * srtp_get_stage_profile() reports.
+ *
+ * Where a stage does the work of another, such as an AEAD cipher or a
+ * single pass that encrypts and authenticates, the time is counted in
+ * srtp_stage_cipher.
+ */
+typedef enum {
+    srtp_stage_lookup = 0, /**< stream lookup and master key selection  */
+    srtp_stage_index = 1,  /**< index estimation and replay check       */
+    srtp_stage_cipher = 2, /**< keystream, encryption and decryption    */
+    srtp_stage_auth = 3,   /**< authentication tag                      */
+    srtp_stage_header = 4, /**< header extension encryption and cryptex */
+    srtp_stage_copy = 5,   /**< copies of packets not done in place     */
+    srtp_stage_other = 6   /**< parsing, key limits and the rest        */
+} srtp_stage_t;
+
+#define SRTP_NUM_STAGES 7
+
+/**
+ * @brief srtp_stage_counts_t holds the packets processed in one direction
+ * and the ticks spent in each stage on them.
+ */
+typedef struct srtp_stage_counts_t {
+    uint64_t packets;                /**< packets, RTP and RTCP */
+    uint64_t ticks[SRTP_NUM_STAGES]; /**< indexed by srtp_stage_t */
+} srtp_stage_counts_t;
+
+/**
+ * @brief srtp_stage_profile_t is what srtp_get_stage_profile() reports.
+ */
+typedef struct srtp_stage_profile_t {
+    srtp_stage_counts_t protect;   /**< srtp_protect() and the like   */
+    srtp_stage_counts_t unprotect; /**< srtp_unprotect() and the like */
+} srtp_stage_profile_t;
+
+/**
+ * @brief srtp_get_stage_profile(session, profile) reports the time the
+ * packets of session spent in each stage since it was created or
+ * srtp_reset_stage_profile() was last called.
+ *
+ * The counters exist only when libSRTP is built with ENABLE_STAGE_PROFILE
+ * (--enable-stage-profile), otherwise the packet path carries no trace of
+ * them. The ticks are those of the time stamp counter on x86 and of the
+ * virtual counter on ARMv8, which runs at a fixed frequency rather than
+ * that of the core; elsewhere they stay 0. Each stage boundary reads
+ * the counter, which adds a few tens of cycles to every stage of every
+ * packet, so the counts suit comparing stages more than measuring the
+ * total. The counters are not atomic: packets of a thread safe session
+ * processed at the same time may lose some counts.
+ *
+ * @return
+ *    - srtp_err_status_ok          on success.
+ *    - srtp_err_status_bad_param   if session or profile is NULL.
+ *    - srtp_err_status_no_such_op  if the counters were not built in.
+ */
+srtp_err_status_t srtp_get_stage_profile(srtp_t session,
+                                         srtp_stage_profile_t *profile);
+
+/**
+ * @brief srtp_reset_stage_profile(session) clears the counters
+ * srtp_get_stage_profile() reports.
+ *
+ * @return
+ *    - srtp_err_status_ok          on success.
+ *    - srtp_err_status_bad_param   if session is NULL.
+ *    - srtp_err_status_no_such_op  if the counters were not built in.
+ */
+srtp_err_status_t srtp_reset_stage_profile(srtp_t session);
+
+/**
+ * @brief srtp_shared_key_region_create(region, size) formats a region of
+ * memory, typically a shared mapping, to hold the expanded cipher and
+ * authentication keys of the streams keyed in this process.
+ *
+ * Once created, every key expanded by the process is placed in the region
+ * while it has room, and other processes that attach to it with
+ * srtp_shared_key_region_attach() use those expansions instead of making
+ * their own copy. Only the expansions are shared; policies, stream state
+ * and the key derivation stay in each process. Entries are never removed
+ * from the region, so it is meant for the keys of long lived sessions.
+ *
+ * The region must be aligned to 64 octets, a cache line, and stay
+ * mapped until srtp_shared_key_region_detach() succeeds. A process has at
+ * most one region.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if the region is misaligned or too small.
+ *    - srtp_err_status_fail if a region is in use already.
+ */
+srtp_err_status_t srtp_shared_key_region_create(void *region, size_t size);
+
+/**
+ * @brief srtp_shared_key_region_attach(region, size) uses the expansions
+ * in a region formatted by srtp_shared_key_region_create() in another
+ * process, which must run the same build of libSRTP.
+ *
+ * The region is only read, so it may be mapped read only; keys that are
+ * not found in it are expanded privately, as without a region.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if region is not a region of that size
+ *      created by the same build of libSRTP.
+ *    - srtp_err_status_fail if a region is in use already.
+ */
+srtp_err_status_t srtp_shared_key_region_attach(const void *region,
+                                                size_t size);
+
+/**
+ * @brief srtp_shared_key_region_detach() stops using the region set with
+ * srtp_shared_key_region_create() or srtp_shared_key_region_attach(),
+ * after which it may be unmapped.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_fail if sessions that use keys in the region still
+ *      exist.
+ */
+srtp_err_status_t srtp_shared_key_region_detach(void);
+
 /**
  * @brief srtp_get_protect_trailer_length(session, use_mki, mki_index, length)
  *
@@ -1210,6 +3056,41 @@ srtp_err_status_t srtp_get_protect_rtcp_trailer_length(srtp_t session,
                                                        size_t mki_index,
                                                        size_t *length);
 
+/**
+ * @brief srtp_stream_get_protect_trailer_length(session, ssrc, mki_index,
+ * length)
+ *
+ * Like srtp_get_protect_trailer_length(), but for the stream of the given
+ * SSRC only. An SSRC without a stream of its own gets the length for the
+ * template stream, if there is one.
+ *
+ * returns err_status_ok on success, err_status_bad_mki if the MKI index is
+ * invalid, srtp_err_status_bad_param if there is no stream found
+ *
+ */
+srtp_err_status_t srtp_stream_get_protect_trailer_length(srtp_t session,
+                                                         uint32_t ssrc,
+                                                         size_t mki_index,
+                                                         size_t *length);
+
+/**
+ * @brief srtp_stream_get_protect_rtcp_trailer_length(session, ssrc,
+ * mki_index, length)
+ *
+ * Like srtp_get_protect_rtcp_trailer_length(), but for the stream of the
+ * given SSRC only. An SSRC without a stream of its own gets the length for
+ * the template stream, if there is one.
+ *
+ * returns err_status_ok on success, err_status_bad_mki if the MKI index is
+ * invalid, srtp_err_status_bad_param if there is no stream found
+ *
+ */
+srtp_err_status_t srtp_stream_get_protect_rtcp_trailer_length(
+    srtp_t session,
+    uint32_t ssrc,
+    size_t mki_index,
+    size_t *length);
+
 /**
  * @brief srtp_stream_set_roc(session, ssrc, roc)
  *
@@ -1236,6 +3117,310 @@ srtp_err_status_t srtp_stream_get_roc(srtp_t session,
                                       uint32_t ssrc,
                                       uint32_t *roc);
 
+/**
+ * SRTP_MAX_KEYSTREAM_LEN is the largest payload length that
+ * srtp_stream_set_keystream_cache() computes keystream for.
+ */
+#define SRTP_MAX_KEYSTREAM_LEN 65536
+
+/**
+ * @brief srtp_stream_set_keystream_cache() sets up keystream computed ahead
+ * of time for a sending stream.
+ *
+ * The function call srtp_stream_set_keystream_cache(session, ssrc,
+ * num_packets, max_len) gives the stream for ssrc room for the keystream
+ * of num_packets packets of up to max_len octets of payload, which
+ * srtp_stream_fill_keystream() computes. srtp_protect() then only
+ * combines the payload of a packet with its keystream and authenticates
+ * it. A packet longer than max_len, or whose keystream was not computed,
+ * is protected as usual. Any keystream of the stream is discarded, and a
+ * num_packets of zero removes it.
+ *
+ * Keystream is only independent of the packet for the AES counter mode
+ * profiles. With cryptex the CSRCs of a packet count towards its payload.
+ *
+ * @param session is the session the stream is in.
+ * @param ssrc is the SSRC of the stream, in host order.
+ * @param num_packets is the number of packets to hold keystream for.
+ * @param max_len is the payload length, at most SRTP_MAX_KEYSTREAM_LEN.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if there is no stream for ssrc or
+ *                                   max_len is out of range.
+ *    - srtp_err_status_no_such_op   if the stream does not use AES counter
+ *                                   mode.
+ *    - srtp_err_status_alloc_fail   if memory could not be allocated.
+ */
+srtp_err_status_t srtp_stream_set_keystream_cache(srtp_t session,
+                                                  uint32_t ssrc,
+                                                  size_t num_packets,
+                                                  size_t max_len);
+
+/**
+ * @brief srtp_stream_fill_keystream() computes the keystream of the next
+ * packets of a stream.
+ *
+ * The function call srtp_stream_fill_keystream(session, ssrc, mki_index)
+ * computes, with the master key at mki_index, the keystream of the
+ * packets whose index follows that of the last packet the stream for
+ * ssrc protected, as many as srtp_stream_set_keystream_cache() made room
+ * for. Keystream that is already there is kept, so it can be called
+ * whenever the sender is idle, or by another thread of a thread safe
+ * session. Each keystream is used for one packet only.
+ *
+ * @param session is the session the stream is in.
+ * @param ssrc is the SSRC of the stream, in host order.
+ * @param mki_index is the index of the master key packets will be
+ *        protected with, it is ignored when the stream does not use MKI.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if there is no stream for ssrc or it
+ *                                   has no keystream cache.
+ *    - srtp_err_status_bad_mki      if mki_index is out of range.
+ *    - srtp_err_status_cipher_fail  if the keystream could not be computed.
+ */
+srtp_err_status_t srtp_stream_fill_keystream(srtp_t session,
+                                             uint32_t ssrc,
+                                             size_t mki_index);
+
+/**
+ * @brief srtp_reader_create() creates a reader for decrypting recorded
+ * packets of a stream out of order.
+ *
+ * The function call srtp_reader_create(session, ssrc, reader) copies the
+ * keys of the stream for ssrc into a new reader, which unprotects packets
+ * whose rollover counter is known, for example recorded together with
+ * srtp_stream_get_roc(), without a replay database. A reader does not
+ * change the session, and readers do not share any per packet state, so
+ * a recording can be split into segments that are decrypted in parallel,
+ * each by a thread with its own reader.
+ *
+ * The reader may refer to state of the stream, it must be deallocated
+ * before the stream is removed, updated or its session deallocated.
+ *
+ * @param session is the session the stream is in.
+ * @param ssrc is the SSRC of the stream, in host order.
+ * @param reader is set to the new reader.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if an argument is NULL.
+ *    - srtp_err_status_no_ctx       if the session has no stream for ssrc.
+ *    - srtp_err_status_no_such_op   if the keys of the stream can not be
+ *                                   copied by the crypto backend.
+ *    - srtp_err_status_alloc_fail   if memory could not be allocated.
+ */
+srtp_err_status_t srtp_reader_create(srtp_t session,
+                                     uint32_t ssrc,
+                                     srtp_reader_t *reader);
+
+/**
+ * @brief srtp_reader_unprotect() unprotects a recorded SRTP packet.
+ *
+ * The function call srtp_reader_unprotect(reader, roc, srtp, srtp_len,
+ * rtp, rtp_len) verifies and decrypts the packet as srtp_unprotect()
+ * does, but with the packet index made of roc and the sequence number of
+ * the packet instead of one estimated from the packets before it.
+ * Packets are not checked against replays, so the same packet can be
+ * decrypted again, and in any order.
+ *
+ * A reader must only be used by one thread at a time.
+ *
+ * @param reader is the reader from srtp_reader_create().
+ * @param roc is the rollover counter the packet was protected with.
+ * @param srtp is the SRTP packet.
+ * @param srtp_len is the length of the SRTP packet.
+ * @param rtp is where the RTP packet is written, it may be srtp.
+ * @param rtp_len is the size of rtp, set to the length of the RTP packet.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if an argument is NULL or the packet
+ *                                   is malformed.
+ *    - srtp_err_status_no_ctx       if the packet is of another SSRC.
+ *    - srtp_err_status_auth_fail    if the packet does not authenticate.
+ *    - [other]                      as for srtp_unprotect().
+ */
+srtp_err_status_t srtp_reader_unprotect(srtp_reader_t reader,
+                                        uint32_t roc,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        uint8_t *rtp,
+                                        size_t *rtp_len);
+
+/**
+ * @brief srtp_reader_dealloc() deallocates a reader created with
+ * srtp_reader_create().
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if reader is NULL.
+ */
+srtp_err_status_t srtp_reader_dealloc(srtp_reader_t reader);
+
+/**
+ * @brief srtp_stream_stats_t holds the packet counters of a stream.
+ *
+ * The byte counts are the lengths of the RTP and RTCP packets, before
+ * protection or after unprotection. Packets that are rejected before a
+ * stream for their SSRC exists, such as one that fails authentication
+ * with the template, are not counted.
+ */
+typedef struct srtp_stream_stats_t {
+    uint32_t ssrc;                     /**< SSRC of the stream, host order */
+    uint64_t rtp_packets_protected;    /**< RTP packets protected          */
+    uint64_t rtp_bytes_protected;      /**< octets in those packets        */
+    uint64_t rtp_packets_unprotected;  /**< SRTP packets accepted          */
+    uint64_t rtp_bytes_unprotected;    /**< octets in those packets        */
+    uint64_t rtcp_packets_protected;   /**< RTCP packets protected         */
+    uint64_t rtcp_bytes_protected;     /**< octets in those packets        */
+    uint64_t rtcp_packets_unprotected; /**< SRTCP packets accepted         */
+    uint64_t rtcp_bytes_unprotected;   /**< octets in those packets        */
+    uint64_t auth_fail;      /**< rejected with srtp_err_status_auth_fail   */
+    uint64_t replay_fail;    /**< rejected with srtp_err_status_replay_fail */
+    uint64_t replay_old;     /**< rejected with srtp_err_status_replay_old  */
+    uint64_t bad_mki;        /**< rejected with srtp_err_status_bad_mki     */
+    uint64_t key_soft_limit; /**< packets past the soft key usage limit     */
+} srtp_stream_stats_t;
+
+/**
+ * @brief srtp_stream_get_stats(session, ssrc, stats)
+ *
+ * Get the packet counters of the stream for a given SSRC. The counters
+ * are kept when the stream is updated and start from zero when it is
+ * added.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if there is no
+ * stream found
+ *
+ */
+srtp_err_status_t srtp_stream_get_stats(srtp_t session,
+                                        uint32_t ssrc,
+                                        srtp_stream_stats_t *stats);
+
+/**
+ * @brief srtp_stream_stats_func_t is the function prototype for the
+ * callback of srtp_session_for_each_stats().
+ *
+ * The stats are only valid for the duration of the call.
+ */
+typedef void(srtp_stream_stats_func_t)(const srtp_stream_stats_t *stats,
+                                       void *data);
+
+/**
+ * @brief srtp_session_for_each_stats(session, func, data)
+ *
+ * Call func with the packet counters of every stream in the session, in
+ * no particular order. func must not add, remove or update streams of
+ * the session.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if session or
+ * func is NULL
+ *
+ */
+srtp_err_status_t srtp_session_for_each_stats(srtp_t session,
+                                              srtp_stream_stats_func_t func,
+                                              void *data);
+
+/**
+ * @brief SRTP_SESSION_EXPORT_NONCE_LEN is the length of the nonce used to
+ * wrap an exported session.
+ */
+#define SRTP_SESSION_EXPORT_NONCE_LEN 12
+
+/**
+ * @brief srtp_set_exportable() lets srtp_session_export() save a session.
+ *
+ * An exportable session keeps a copy of the policy of every stream added
+ * for a specific SSRC and of the template's policy, master keys included,
+ * until the stream is removed or the session is deallocated. The master
+ * keys thus stay in memory for the life of the session, where
+ * srtp_session_gc() would otherwise have wiped them once the keys derived
+ * from them were all derived; only make a session exportable to export it.
+ *
+ * @param session is the session to change.
+ * @param exportable true to keep the policies.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if session is NULL or already has a
+ *      stream; call this before adding any policy.
+ */
+srtp_err_status_t srtp_set_exportable(srtp_t session, bool exportable);
+
+/**
+ * @brief srtp_session_export() saves the state of a session, so that it
+ * can be moved to another process with srtp_session_import().
+ *
+ * The export holds the policies of the template and of the streams added
+ * for specific SSRCs, the SSRCs of the streams cloned from the template,
+ * and for every stream its rollover counter set with
+ * srtp_stream_set_roc(), its SRTP and SRTCP replay databases, its key
+ * usage counts and its packet counters. Keys that an update with a key
+ * overlap keeps for a while are not exported.
+ *
+ * The export is made from the policies that srtp_set_exportable() keeps,
+ * master keys included, for the life of the session. The master keys are
+ * in the clear unless wrap_key is given, in which case everything after
+ * the format header is encrypted and authenticated with AES-GCM under
+ * wrap_key (SRTP_AES_128_KEY_LEN or SRTP_AES_256_KEY_LEN octets) and the
+ * SRTP_SESSION_EXPORT_NONCE_LEN octets of nonce, which must never be used
+ * twice with the same wrap_key.
+ *
+ * @param session is the exportable session to save.
+ * @param wrap_key is the key to encrypt the export with, or NULL.
+ * @param wrap_key_len is the length of wrap_key.
+ * @param nonce is the nonce to encrypt with, ignored without wrap_key.
+ * @param buf is where the export is written, NULL to query its length.
+ * @param len is the length of buf on input, and of the export on output.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if session was not made exportable with
+ *      srtp_set_exportable() or an argument is invalid.
+ *    - srtp_err_status_buffer_small if buf is NULL or shorter than the
+ *      export, *len is then set to the length needed.
+ *    - srtp_err_status_no_such_op if AES-GCM is not available to wrap.
+ */
+srtp_err_status_t srtp_session_export(srtp_t session,
+                                      const uint8_t *wrap_key,
+                                      size_t wrap_key_len,
+                                      const uint8_t *nonce,
+                                      uint8_t *buf,
+                                      size_t *len);
+
+/**
+ * @brief srtp_session_import() creates a session from the output of
+ * srtp_session_export().
+ *
+ * The new session is exportable, thread safe if the exported one was,
+ * and carries on with the replay databases, rollover counters and key
+ * usage counts of the exported session, so the exported session must
+ * not be used any more once the import is in use.
+ *
+ * @param session is set to the new session.
+ * @param buf is the export.
+ * @param len is the length of buf.
+ * @param wrap_key is the key the export was wrapped with, or NULL.
+ * @param wrap_key_len is the length of wrap_key.
+ *
+ * @return
+ *    - srtp_err_status_ok on success.
+ *    - srtp_err_status_bad_param if an argument is invalid or wrap_key
+ *      is missing for a wrapped export.
+ *    - srtp_err_status_auth_fail if a wrapped export does not match
+ *      wrap_key.
+ *    - srtp_err_status_parse_err if the export is malformed or of an
+ *      unknown version.
+ */
+srtp_err_status_t srtp_session_import(srtp_t *session,
+                                      const uint8_t *buf,
+                                      size_t len,
+                                      const uint8_t *wrap_key,
+                                      size_t wrap_key_len);
+
 /**
  * @}
  */
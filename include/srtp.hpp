@@ -0,0 +1,530 @@
+/*
+ * srtp.hpp
+ *
+ * header-only C++20 interface to libsrtp
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_SRTP_HPP
+#define SRTP_SRTP_HPP
+
+#if __cplusplus < 202002L && (!defined(_MSVC_LANG) || _MSVC_LANG < 202002L)
+#error "srtp.hpp requires C++20"
+#endif
+
+#include "srtp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+/**
+ * @brief The srtp namespace is a thin C++20 layer over the C interface.
+ *
+ * Policy and Session own a srtp_policy_t and a srtp_t, are move-only
+ * and release them when they go out of scope. Packets are passed as
+ * std::span and processed directly in the memory of the caller, nothing
+ * in this header allocates or throws; failures are reported with the
+ * srtp_err_status_t of the C function that was called.
+ *
+ * srtp_init() still has to be called before any session is created.
+ */
+namespace srtp {
+
+/**
+ * @brief rtp_tag_length() returns the length in octets of the
+ * authentication tag of an SRTP packet protected with profile.
+ */
+constexpr std::size_t rtp_tag_length(srtp_profile_t profile) noexcept
+{
+    switch (profile) {
+    case srtp_profile_aes128_cm_sha1_80:
+    case srtp_profile_aes192_cm_sha1_80:
+    case srtp_profile_aes256_cm_sha1_80:
+    case srtp_profile_null_sha1_80:
+        return 10;
+    case srtp_profile_aes128_cm_sha1_32:
+    case srtp_profile_aes192_cm_sha1_32:
+    case srtp_profile_aes256_cm_sha1_32:
+    case srtp_profile_null_sha1_32:
+        return 4;
+    case srtp_profile_aead_aes_128_gcm:
+    case srtp_profile_aead_aes_256_gcm:
+        return 16;
+    case srtp_profile_reserved:
+    case srtp_profile_null_null:
+        return 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief rtcp_tag_length() returns the length in octets of the
+ * authentication tag of an SRTCP packet protected with profile.
+ *
+ * The 32-bit tag profiles use an 80-bit tag for SRTCP, see RFC 3711.
+ */
+constexpr std::size_t rtcp_tag_length(srtp_profile_t profile) noexcept
+{
+    switch (profile) {
+    case srtp_profile_aes128_cm_sha1_32:
+        return rtp_tag_length(srtp_profile_aes128_cm_sha1_80);
+    case srtp_profile_aes192_cm_sha1_32:
+        return rtp_tag_length(srtp_profile_aes192_cm_sha1_80);
+    case srtp_profile_aes256_cm_sha1_32:
+        return rtp_tag_length(srtp_profile_aes256_cm_sha1_80);
+    case srtp_profile_null_sha1_32:
+        return rtp_tag_length(srtp_profile_null_sha1_80);
+    default:
+        return rtp_tag_length(profile);
+    }
+}
+
+/**
+ * @brief rtp_trailer_length() returns the number of octets that
+ * protecting an RTP packet with profile and an MKI of mki_len octets
+ * appends to it.
+ *
+ * It is constexpr, so that packet buffers can be sized at compile time:
+ *
+ *     std::array<uint8_t, 1200 + srtp::rtp_trailer_length(
+ *                                    srtp_profile_aead_aes_128_gcm)> buf;
+ */
+constexpr std::size_t rtp_trailer_length(srtp_profile_t profile,
+                                          std::size_t mki_len = 0) noexcept
+{
+    return rtp_tag_length(profile) + mki_len;
+}
+
+/**
+ * @brief rtcp_trailer_length() returns the number of octets that
+ * protecting an RTCP packet with profile and an MKI of mki_len octets
+ * appends to it, including the SRTCP index.
+ */
+constexpr std::size_t rtcp_trailer_length(srtp_profile_t profile,
+                                           std::size_t mki_len = 0) noexcept
+{
+    return SRTP_SRCTP_INDEX_LEN + rtcp_tag_length(profile) + mki_len;
+}
+
+/**
+ * @brief Result is the status of processing a packet and, if it is
+ * srtp_err_status_ok, the processed packet in the output buffer.
+ */
+struct Result {
+    srtp_err_status_t status;
+    std::span<std::uint8_t> packet;
+
+    constexpr explicit operator bool() const noexcept
+    {
+        return status == srtp_err_status_ok;
+    }
+};
+
+/**
+ * @brief Policy owns a srtp_policy_t.
+ *
+ * A default constructed Policy is empty, Policy::create() allocates the
+ * policy. The setters forward to the srtp_policy_*() functions of the
+ * same name.
+ */
+class Policy {
+  public:
+    Policy() noexcept = default;
+
+    /** @brief Policy takes ownership of policy. */
+    explicit Policy(srtp_policy_t policy) noexcept
+        : policy_(policy)
+    {
+    }
+
+    Policy(const Policy &) = delete;
+    Policy &operator=(const Policy &) = delete;
+
+    Policy(Policy &&other) noexcept
+        : policy_(std::exchange(other.policy_, nullptr))
+    {
+    }
+
+    Policy &operator=(Policy &&other) noexcept
+    {
+        if (this != &other) {
+            reset(std::exchange(other.policy_, nullptr));
+        }
+        return *this;
+    }
+
+    ~Policy() { reset(); }
+
+    /** @brief create() replaces policy with a newly allocated one. */
+    [[nodiscard]] static srtp_err_status_t create(Policy &policy) noexcept
+    {
+        srtp_policy_t p = nullptr;
+        srtp_err_status_t status = srtp_policy_create(&p);
+        if (status == srtp_err_status_ok) {
+            policy.reset(p);
+        }
+        return status;
+    }
+
+    /** @brief clone() replaces cloned with a copy of this policy. */
+    [[nodiscard]] srtp_err_status_t clone(Policy &cloned) const noexcept
+    {
+        srtp_policy_t p = nullptr;
+        srtp_err_status_t status = srtp_policy_clone(policy_, &p);
+        if (status == srtp_err_status_ok) {
+            cloned.reset(p);
+        }
+        return status;
+    }
+
+    [[nodiscard]] srtp_err_status_t set_ssrc(srtp_ssrc_t ssrc) noexcept
+    {
+        return srtp_policy_set_ssrc(policy_, ssrc);
+    }
+
+    [[nodiscard]] srtp_err_status_t set_profile(
+        srtp_profile_t profile) noexcept
+    {
+        return srtp_policy_set_profile(policy_, profile);
+    }
+
+    [[nodiscard]] srtp_err_status_t use_mki(std::size_t mki_len) noexcept
+    {
+        return srtp_policy_use_mki(policy_, mki_len);
+    }
+
+    [[nodiscard]] srtp_err_status_t add_key(
+        std::span<const std::uint8_t> key,
+        std::span<const std::uint8_t> salt,
+        std::span<const std::uint8_t> mki = {}) noexcept
+    {
+        return srtp_policy_add_key(policy_, key.data(), key.size(),
+                                   salt.data(), salt.size(), mki.data(),
+                                   mki.size());
+    }
+
+    [[nodiscard]] srtp_err_status_t remove_keys() noexcept
+    {
+        return srtp_policy_remove_keys(policy_);
+    }
+
+    [[nodiscard]] srtp_err_status_t set_window_size(
+        std::size_t window_size) noexcept
+    {
+        return srtp_policy_set_window_size(policy_, window_size);
+    }
+
+    [[nodiscard]] srtp_err_status_t set_adaptive_window(bool adaptive) noexcept
+    {
+        return srtp_policy_set_adaptive_window(policy_, adaptive);
+    }
+
+    [[nodiscard]] srtp_err_status_t set_allow_repeat_tx(bool allow) noexcept
+    {
+        return srtp_policy_set_allow_repeat_tx(policy_, allow);
+    }
+
+    [[nodiscard]] srtp_err_status_t set_cryptex(bool use_cryptex) noexcept
+    {
+        return srtp_policy_set_cryptex(policy_, use_cryptex);
+    }
+
+    [[nodiscard]] srtp_err_status_t validate() const noexcept
+    {
+        return srtp_policy_validate(policy_);
+    }
+
+    /** @brief get() returns the policy, which stays owned by this. */
+    srtp_policy_t get() const noexcept { return policy_; }
+
+    /** @brief release() gives up ownership of the policy. */
+    [[nodiscard]] srtp_policy_t release() noexcept
+    {
+        return std::exchange(policy_, nullptr);
+    }
+
+    /** @brief reset() destroys the policy and takes ownership of policy. */
+    void reset(srtp_policy_t policy = nullptr) noexcept
+    {
+        if (policy_ != nullptr) {
+            srtp_policy_destroy(policy_);
+        }
+        policy_ = policy;
+    }
+
+    explicit operator bool() const noexcept { return policy_ != nullptr; }
+
+  private:
+    srtp_policy_t policy_ = nullptr;
+};
+
+/**
+ * @brief Session owns a srtp_t.
+ *
+ * A default constructed Session is empty, Session::create() creates
+ * the session. The out-of-place functions read the input span and write
+ * to the output span, whose size is the capacity available to the C
+ * function; the in-place functions process a packet in its own buffer.
+ * On success Result::packet is the part of the output span holding the
+ * processed packet.
+ */
+class Session {
+  public:
+    Session() noexcept = default;
+
+    /** @brief Session takes ownership of session. */
+    explicit Session(srtp_t session) noexcept
+        : session_(session)
+    {
+    }
+
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+
+    Session(Session &&other) noexcept
+        : session_(std::exchange(other.session_, nullptr))
+    {
+    }
+
+    Session &operator=(Session &&other) noexcept
+    {
+        if (this != &other) {
+            reset(std::exchange(other.session_, nullptr));
+        }
+        return *this;
+    }
+
+    ~Session() { reset(); }
+
+    /**
+     * @brief create() replaces session with a new session with the
+     * stream of policy, or without any stream if policy is empty.
+     */
+    [[nodiscard]] static srtp_err_status_t create(
+        Session &session,
+        const Policy &policy) noexcept
+    {
+        srtp_t s = nullptr;
+        srtp_err_status_t status = srtp_create(&s, policy.get());
+        if (status == srtp_err_status_ok) {
+            session.reset(s);
+        }
+        return status;
+    }
+
+    [[nodiscard]] srtp_err_status_t add_stream(const Policy &policy) noexcept
+    {
+        return srtp_stream_add(session_, policy.get());
+    }
+
+    [[nodiscard]] srtp_err_status_t remove_stream(std::uint32_t ssrc) noexcept
+    {
+        return srtp_stream_remove(session_, ssrc);
+    }
+
+    [[nodiscard]] srtp_err_status_t update(const Policy &policy) noexcept
+    {
+        return srtp_update(session_, policy.get());
+    }
+
+    /** @brief protect() protects rtp into srtp, see srtp_protect(). */
+    [[nodiscard]] Result protect(std::span<const std::uint8_t> rtp,
+                                 std::span<std::uint8_t> srtp,
+                                 std::size_t mki_index = 0) noexcept
+    {
+        std::size_t len = srtp.size();
+        srtp_err_status_t status = srtp_protect(
+            session_, rtp.data(), rtp.size(), srtp.data(), &len, mki_index);
+        return make_result(status, srtp, len);
+    }
+
+    /**
+     * @brief protect_in_place() protects the RTP packet in the first
+     * rtp_len octets of buffer, the rest of buffer is room for the
+     * trailer.
+     */
+    [[nodiscard]] Result protect_in_place(std::span<std::uint8_t> buffer,
+                                          std::size_t rtp_len,
+                                          std::size_t mki_index = 0) noexcept
+    {
+        std::size_t len = buffer.size();
+        srtp_err_status_t status =
+            rtp_len > buffer.size()
+                ? srtp_err_status_bad_param
+                : srtp_protect(session_, buffer.data(), rtp_len,
+                               buffer.data(), &len, mki_index);
+        return make_result(status, buffer, len);
+    }
+
+    /** @brief unprotect() verifies srtp into rtp, see srtp_unprotect(). */
+    [[nodiscard]] Result unprotect(std::span<const std::uint8_t> srtp,
+                                   std::span<std::uint8_t> rtp) noexcept
+    {
+        std::size_t len = rtp.size();
+        srtp_err_status_t status = srtp_unprotect(
+            session_, srtp.data(), srtp.size(), rtp.data(), &len);
+        return make_result(status, rtp, len);
+    }
+
+    /** @brief unprotect_in_place() verifies the SRTP packet in packet. */
+    [[nodiscard]] Result unprotect_in_place(
+        std::span<std::uint8_t> packet) noexcept
+    {
+        std::size_t len = packet.size();
+        srtp_err_status_t status = srtp_unprotect(
+            session_, packet.data(), packet.size(), packet.data(), &len);
+        return make_result(status, packet, len);
+    }
+
+    /** @brief protect_rtcp() is protect() for RTCP packets. */
+    [[nodiscard]] Result protect_rtcp(std::span<const std::uint8_t> rtcp,
+                                      std::span<std::uint8_t> srtcp,
+                                      std::size_t mki_index = 0) noexcept
+    {
+        std::size_t len = srtcp.size();
+        srtp_err_status_t status =
+            srtp_protect_rtcp(session_, rtcp.data(), rtcp.size(),
+                              srtcp.data(), &len, mki_index);
+        return make_result(status, srtcp, len);
+    }
+
+    /** @brief protect_rtcp_in_place() is protect_in_place() for RTCP. */
+    [[nodiscard]] Result protect_rtcp_in_place(
+        std::span<std::uint8_t> buffer,
+        std::size_t rtcp_len,
+        std::size_t mki_index = 0) noexcept
+    {
+        std::size_t len = buffer.size();
+        srtp_err_status_t status =
+            rtcp_len > buffer.size()
+                ? srtp_err_status_bad_param
+                : srtp_protect_rtcp(session_, buffer.data(), rtcp_len,
+                                    buffer.data(), &len, mki_index);
+        return make_result(status, buffer, len);
+    }
+
+    /** @brief unprotect_rtcp() is unprotect() for SRTCP packets. */
+    [[nodiscard]] Result unprotect_rtcp(std::span<const std::uint8_t> srtcp,
+                                        std::span<std::uint8_t> rtcp) noexcept
+    {
+        std::size_t len = rtcp.size();
+        srtp_err_status_t status = srtp_unprotect_rtcp(
+            session_, srtcp.data(), srtcp.size(), rtcp.data(), &len);
+        return make_result(status, rtcp, len);
+    }
+
+    /** @brief unprotect_rtcp_in_place() is unprotect_in_place() for SRTCP. */
+    [[nodiscard]] Result unprotect_rtcp_in_place(
+        std::span<std::uint8_t> packet) noexcept
+    {
+        std::size_t len = packet.size();
+        srtp_err_status_t status = srtp_unprotect_rtcp(
+            session_, packet.data(), packet.size(), packet.data(), &len);
+        return make_result(status, packet, len);
+    }
+
+    /** @brief protect_batch() protects pkts, see srtp_protect_batch(). */
+    [[nodiscard]] srtp_err_status_t protect_batch(
+        std::span<srtp_packet_desc_t> pkts) noexcept
+    {
+        return srtp_protect_batch(session_, pkts.data(), pkts.size());
+    }
+
+    /** @brief unprotect_batch() verifies pkts, see srtp_unprotect_batch(). */
+    [[nodiscard]] srtp_err_status_t unprotect_batch(
+        std::span<srtp_packet_desc_t> pkts) noexcept
+    {
+        return srtp_unprotect_batch(session_, pkts.data(), pkts.size());
+    }
+
+    /** @brief protect_rtcp_batch() is protect_batch() for RTCP packets. */
+    [[nodiscard]] srtp_err_status_t protect_rtcp_batch(
+        std::span<srtp_packet_desc_t> pkts) noexcept
+    {
+        return srtp_protect_rtcp_batch(session_, pkts.data(), pkts.size());
+    }
+
+    /** @brief unprotect_rtcp_batch() is unprotect_batch() for SRTCP. */
+    [[nodiscard]] srtp_err_status_t unprotect_rtcp_batch(
+        std::span<srtp_packet_desc_t> pkts) noexcept
+    {
+        return srtp_unprotect_rtcp_batch(session_, pkts.data(), pkts.size());
+    }
+
+    /** @brief get() returns the session, which stays owned by this. */
+    srtp_t get() const noexcept { return session_; }
+
+    /** @brief release() gives up ownership of the session. */
+    [[nodiscard]] srtp_t release() noexcept
+    {
+        return std::exchange(session_, nullptr);
+    }
+
+    /**
+     * @brief reset() deallocates the session and takes ownership of
+     * session.
+     */
+    void reset(srtp_t session = nullptr) noexcept
+    {
+        if (session_ != nullptr) {
+            srtp_dealloc(session_);
+        }
+        session_ = session;
+    }
+
+    explicit operator bool() const noexcept { return session_ != nullptr; }
+
+  private:
+    static Result make_result(srtp_err_status_t status,
+                              std::span<std::uint8_t> buffer,
+                              std::size_t len) noexcept
+    {
+        if (status != srtp_err_status_ok) {
+            return Result{ status, {} };
+        }
+        return Result{ status, buffer.first(len) };
+    }
+
+    srtp_t session_ = nullptr;
+};
+
+} // namespace srtp
+
+#endif /* SRTP_SRTP_HPP */
@@ -57,6 +57,21 @@
 #include "auth.h"
 #include "aes.h"
 #include "crypto_kernel.h"
+#include "atomics.h"
+#include "alloc.h"
+
+#ifdef ENABLE_USDT_PROBES
+#include <sys/sdt.h>
+#endif
+
+#ifdef ENABLE_STAGE_PROFILE
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -86,6 +101,16 @@ typedef struct srtp_master_key_t {
     size_t mki_id_len;
 } srtp_master_key_t;
 
+/*
+ * the master keys of a policy are kept in an srtp_master_key_set_t, a
+ * header followed by capacity srtp_master_key_t, that policies cloned
+ * from it share until one of them changes its keys
+ */
+typedef struct srtp_master_key_set_t {
+    srtp_refcount_t refs;
+    size_t capacity;
+} srtp_master_key_set_t;
+
 typedef struct srtp_policy_ctx_t_ {
     srtp_profile_t profile; /**< The SRTP profile that this policy applies to */
     srtp_ssrc_t ssrc;       /**< The SSRC value of stream, or the    */
@@ -94,12 +119,18 @@ typedef struct srtp_policy_ctx_t_ {
                             /**< is used for this policy element.    */
     srtp_crypto_policy_t rtp;  /**< SRTP crypto policy.                 */
     srtp_crypto_policy_t rtcp; /**< SRTCP crypto policy.                */
-    srtp_master_key_t master_keys[SRTP_MAX_NUM_MASTER_KEYS];
+    srtp_master_key_set_t *key_set; /**< Shared storage of the keys,  */
+                                    /**< or NULL without keys.        */
+    srtp_master_key_t *master_keys; /**< The keys in key_set.         */
     size_t num_master_keys; /** Number of master keys                */
     bool use_mki;           /** Whether MKI is in use                */
     size_t mki_size;        /** Size of MKI when in use              */
     size_t window_size;     /**< The window size to use for replay   */
                             /**< protection.                         */
+    bool adaptive_window;   /**< Whether window_size is the largest  */
+                            /**< a stream's window grows to.         */
+    size_t rtcp_window_size; /**< The window size to use for SRTCP   */
+                             /**< replay protection.                 */
     bool allow_repeat_tx;   /**< Whether retransmissions of          */
                             /**< packets with the same sequence      */
                             /**< number are allowed.                 */
@@ -113,6 +144,13 @@ typedef struct srtp_policy_ctx_t_ {
                               /**<  ids.                               */
     bool use_cryptex;         /**< Encrypt header block and CSRCs with */
                               /**< cryptex, RFC 9335.                  */
+    size_t stream_pool_size;  /**< Number of streams to preallocate    */
+                              /**< for cloning from a template.        */
+    size_t key_overlap;       /**< Packets to accept the keys replaced */
+                              /**< by an update for.                   */
+    size_t max_clones;        /**< Number of streams cloned from the   */
+                              /**< template to keep at most.           */
+    size_t clone_idle_timeout; /**< Epochs to keep an idle clone for.  */
 } srtp_policy_ctx_t_;
 
 static inline bool srtp_policy_is_null_cipher_null_auth(
@@ -124,11 +162,25 @@ static inline bool srtp_policy_is_null_cipher_null_auth(
            policy->rtcp.auth_type == SRTP_NULL_AUTH;
 }
 
+/*
+ * srtp_policy_append_key(policy, key) adds a copy of key to the master
+ * keys of policy, which are copied first when shared with a clone; the
+ * caller checks key against the policy
+ */
+srtp_err_status_t srtp_policy_append_key(srtp_policy_t policy,
+                                         const srtp_master_key_t *key);
+
 static inline bool srtp_policy_is_valid_window_size(size_t window_size)
 {
     return window_size == 0 || (window_size >= 64 && window_size < 0x8000);
 }
 
+static inline bool srtp_policy_is_valid_rtcp_window_size(size_t window_size)
+{
+    return window_size == 0 ||
+           (window_size >= 64 && window_size <= SRTP_RDB_MAX_WINDOW_SIZE);
+}
+
 /*
  * the following declarations are libSRTP internal functions
  */
@@ -139,6 +191,13 @@ static inline bool srtp_policy_is_valid_window_size(size_t window_size)
  */
 srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
+/*
+ * srtp_stream_keys_can_clone(stream) returns true if all ciphers and auth
+ * functions of stream can be cloned, which streams need for their keys to
+ * be cached and shared
+ */
+bool srtp_stream_keys_can_clone(const srtp_stream_ctx_t *stream);
+
 /*
  * libsrtp internal datatypes
  */
@@ -148,6 +207,23 @@ typedef enum direction_t {
     dir_srtp_receiver = 2
 } direction_t;
 
+/*
+ * an srtp_pending_keys_t holds a master key until the SRTCP and header
+ * extension keys, which are only derived when the first packet needs
+ * them, have been derived from it; like the ciphers and auths it keys it
+ * is shared by a template and its clones. The master key is wiped when
+ * the first SRTCP packet derives the keys, or by the next
+ * srtp_session_gc(); without either it is kept until the stream is
+ * deallocated.
+ */
+typedef struct srtp_pending_keys_t {
+    srtp_spinlock_t lock;
+    bool rtcp;                          /* SRTCP keys not derived yet   */
+    bool xtn_hdr;                       /* header extension keys neither */
+    uint8_t master_key[SRTP_MAX_KEY_LEN];
+    uint8_t c_salt[SRTP_AEAD_SALT_LEN]; /* the SRTCP salt once derived  */
+} srtp_pending_keys_t;
+
 /*
  * srtp_session_keys_t will contain the encryption, hmac, salt keys
  * for both SRTP and SRTCP.  The session keys will also contain the
@@ -161,57 +237,533 @@ typedef struct srtp_session_keys_t {
     srtp_auth_t *rtcp_auth;
     uint8_t salt[SRTP_AEAD_SALT_LEN];
     uint8_t c_salt[SRTP_AEAD_SALT_LEN];
+    v128_t aead_iv_base;   /* salt xor'ed with iv_base_ssrc, RFC 7714 */
+    v128_t c_aead_iv_base; /* c_salt xor'ed with iv_base_ssrc        */
+    uint32_t iv_base_ssrc; /* SSRC in network order                  */
     uint8_t *mki_id;
     srtp_key_limit_ctx_t *limit;
+    srtp_pending_keys_t *pending; /* keys still to derive, or NULL      */
+    bool rtcp_pending;            /* c_salt not taken from pending yet  */
+    bool xtn_hdr_pending;
 } srtp_session_keys_t;
 
+/*
+ * srtp_protect_stream_func_t and srtp_unprotect_stream_func_t process an
+ * RTP packet whose header has been validated; each stream points at the
+ * variant that was specialised for its profile when its keys were set up.
+ * The protect variants take the header as parsed by their caller in desc
+ */
+typedef srtp_err_status_t (*srtp_protect_stream_func_t)(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *in,
+    size_t in_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *out,
+    size_t *out_len);
+
+typedef srtp_err_status_t (*srtp_unprotect_stream_func_t)(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *in,
+    size_t in_len,
+    uint8_t *out,
+    size_t *out_len);
+
+/*
+ * an srtp_key_overlap_t holds the stream an update with a key overlap
+ * replaced, so that packets still protected with its keys are accepted
+ * until the new keys have been used for remaining packets
+ *
+ * previous keeps its own replay databases, so each set of keys rejects
+ * replays of the packets it authenticated
+ */
+typedef struct srtp_key_overlap_t {
+    struct srtp_stream_ctx_t_ *previous; /* NULL when not overlapping */
+    const struct srtp_stream_ctx_t_ *previous_template; /* shares its keys */
+    size_t remaining;             /* packets until previous is retired */
+    bool rtp_switched;            /* rtp_index is valid                */
+    srtp_xtd_seq_num_t rtp_index; /* lowest index under the new keys   */
+    bool rtcp_switched;           /* SRTCP seen under the new keys     */
+    uint8_t *scratch;             /* copy of an in place AEAD packet   */
+    size_t scratch_len;
+} srtp_key_overlap_t;
+
+/*
+ * an srtp_keystream_cache_t holds RTP keystream computed ahead of time by
+ * srtp_stream_fill_keystream(), so that protecting the packet with that
+ * index only takes an exclusive or; the entry for an index is at
+ * entries[index % num_entries] and is used at most once
+ */
+typedef struct srtp_keystream_entry_t {
+    const srtp_session_keys_t *keys; /* NULL when the entry is unused */
+    srtp_xtd_seq_num_t index;
+    uint8_t *keystream; /* max_len octets */
+} srtp_keystream_entry_t;
+
+typedef struct srtp_keystream_cache_t {
+    size_t num_entries;
+    size_t max_len;
+    srtp_keystream_entry_t *entries;
+} srtp_keystream_cache_t;
+
+/*
+ * an srtp_stream_cold_t holds the state of a stream that only some uses
+ * need: the SRTCP replay database, the keys kept by an update with a key
+ * overlap, the scratch buffer of the segmented packet paths and the
+ * precomputed keystream of a sender
+ *
+ * it is allocated by srtp_stream_get_cold() when first needed, so that
+ * a stream that only carries RTP does without it
+ */
+typedef struct srtp_stream_cold_t {
+    srtp_rdb_t rtcp_rdb;
+    srtp_key_overlap_t overlap; /* keys replaced by the last update     */
+    uint8_t *iov_scratch; /* copy of a packet given in segments to a */
+    size_t iov_scratch_len; /* path without scatter-gather support   */
+    srtp_policy_t policy;   /* kept by an exportable session        */
+    srtp_keystream_cache_t *keystream; /* NULL unless configured     */
+} srtp_stream_cold_t;
+
+/*
+ * an srtp_stream_rtcp_t holds what the SRTCP packets of a stream change
+ * besides its SRTCP replay database: their counters and the epoch of the
+ * last of them. RTP packets change the rest of the stream, so a thread
+ * safe session processes the two under separate locks, see srtp.c.
+ */
+typedef struct srtp_stream_rtcp_t {
+    srtp_spinlock_t lock;      /* held while processing an SRTCP packet */
+    uint32_t last_used;        /* session epoch of the last packet      */
+    srtp_stream_stats_t stats; /* of SRTCP packets, rtp_* are unused    */
+} srtp_stream_rtcp_t;
+
 /*
  * an srtp_stream_t has its own SSRC, encryption key, authentication
  * key, sequence number, and replay database
  *
  * note that the keys might not actually be unique, in which case the
  * srtp_cipher_t and srtp_auth_t pointers will point to the same structures
+ *
+ * a stream is a single allocation aligned to a cache line, the fields
+ * every packet of the stream uses come first so that they share the
+ * first line, and the memory the stream owns follows the structure, see
+ * srtp_stream_layout(); what is rarely used is kept in cold
  */
 typedef struct srtp_stream_ctx_t_ {
     uint32_t ssrc;
+    uint32_t pending_roc;
+    volatile uint8_t direction; /* a direction_t, set once by a packet */
+    uint8_t rtp_services;  /* srtp_sec_serv_t of RTP and of RTCP     */
+    uint8_t rtcp_services;
+    bool use_mki : 1;
+    bool allow_repeat_tx : 1;
+    bool use_cryptex : 1;
+    bool from_template : 1; /* cloned from the session's template     */
+    uint8_t mki_size;
+    volatile uint8_t queued_events; /* bit per srtp_event_t in the queue */
+    uint16_t mki_map_mask;      /* number of slots in mki_map minus one */
+    uint16_t rtcp_window_size;  /* of the SRTCP replay database in cold  */
+    uint16_t num_master_keys;
+    uint32_t last_used;         /* session epoch of the last packet      */
+    uint32_t key_generation;    /* of the template keys a clone took     */
     srtp_session_keys_t *session_keys;
+    srtp_protect_stream_func_t protect_rtp;     /* RTP packet paths for */
+    srtp_unprotect_stream_func_t unprotect_rtp; /* the stream's profile */
+    srtp_spinlock_t lock; /* held while processing an RTP packet when */
+                          /* the session is thread safe               */
+    srtp_rdbx_t rtp_rdbx; /* its window is kept in the allocation */
+    uint16_t *mki_map; /* session key index + 1 by MKI hash, or NULL */
+    uint8_t *enc_xtn_hdr_mask; /* bit per extension id to encrypt, */
+    uint8_t *enc_xtn_hdr;      /* followed by the list of the ids  */
+    size_t enc_xtn_hdr_count;
+    srtp_stream_stats_t stats; /* packet counters, ssrc is unused     */
+    srtp_stream_cold_t *cold;  /* NULL until needed                   */
+    struct srtp_key_cache_entry_t *key_entry; /* keys it was added with */
+    size_t block_size; /* of the allocation holding the stream     */
+    srtp_stream_rtcp_t rtcp; /* away from the lines RTP packets write */
+} strp_stream_ctx_t_;
+
+/*
+ * an srtp_stream_pool_t holds preallocated streams that are handed out
+ * when a stream is cloned from the template and taken back when a cloned
+ * stream is removed, so that new SSRCs do not allocate in the packet path
+ *
+ * all streams in the pool have the same number of master keys, MKI size
+ * and replay window size, which are those of the template they were
+ * allocated for
+ */
+typedef struct srtp_stream_pool_t {
+    srtp_stream_ctx_t **streams; /* free streams ready for cloning  */
+    size_t count;                /* number of free streams          */
+    size_t capacity;             /* maximum number of free streams  */
+    size_t num_master_keys;      /* shape shared by pooled streams  */
+    size_t mki_size;
+    size_t window_size;
+} srtp_stream_pool_t;
+
+/*
+ * an srtp_key_cache_entry_t describes the keys of streams that were added
+ * for a specific SSRC, so that adding another stream with the same master
+ * keys copies the expanded keys instead of running the KDF again
+ *
+ * until a second stream uses the keys they are copied from donor, the
+ * first stream added with them; after that the entry holds a keyed copy
+ * of its own, so that it outlives any of the streams
+ */
+typedef struct srtp_key_cache_entry_t {
+    struct srtp_key_cache_entry_t *next; /* in the same bucket        */
+    uint32_t hash;                  /* of the first master key      */
+    srtp_crypto_policy_t rtp;       /* what the keys were derived for */
+    srtp_crypto_policy_t rtcp;
+    srtp_master_key_t *master_keys; /* num_master_keys master keys    */
     size_t num_master_keys;
     bool use_mki;
     size_t mki_size;
-    srtp_rdbx_t rtp_rdbx;
-    srtp_sec_serv_t rtp_services;
-    srtp_rdb_t rtcp_rdb;
-    srtp_sec_serv_t rtcp_services;
-    direction_t direction;
-    bool allow_repeat_tx;
-    uint8_t *enc_xtn_hdr;
-    size_t enc_xtn_hdr_count;
-    uint32_t pending_roc;
-    bool use_cryptex;
-} strp_stream_ctx_t_;
+    bool enc_xtn_hdr;           /* has a header extension cipher   */
+    srtp_stream_ctx_t *donor;   /* first stream, not owned         */
+    srtp_stream_ctx_t *keys;    /* owned copy, once keys are shared */
+    size_t refcount;            /* streams added with these keys    */
+} srtp_key_cache_entry_t;
+
+typedef struct srtp_key_cache_t {
+    srtp_key_cache_entry_t **buckets; /* entries chained by hash      */
+    size_t num_buckets;               /* zero or a power of two       */
+    size_t count;                     /* number of entries            */
+} srtp_key_cache_t;
+
+/*
+ * an srtp_breaker_t keeps a flood of packets for unknown SSRCs from
+ * costing a verification with the template each: after max_failures of
+ * them fail in a row it opens and rejects the next cooldown ones outright,
+ * then lets one through, whose verification closes it again or reopens it
+ */
+typedef struct {
+    size_t max_failures; /* 0 when the breaker is off           */
+    size_t cooldown;
+    size_t failures;     /* provisional packets failed in a row */
+    size_t skip;         /* packets left to reject while open   */
+    uint64_t rejected;   /* packets rejected while open         */
+} srtp_breaker_t;
 
 /*
  * an srtp_ctx_t holds a stream list and a service description
  */
+/*
+ * srtp_trailer_cache_t holds the longest protect trailers of the streams
+ * of a session for one MKI index, adding a stream folds it in while
+ * removing or updating streams makes the next query walk them again
+ */
+typedef struct {
+    bool valid;       /* rtp_len and rtcp_len hold for mki_index        */
+    bool found;       /* some stream can protect with mki_index         */
+    size_t mki_index;
+    size_t rtp_len;
+    size_t rtcp_len;
+} srtp_trailer_cache_t;
+
+/*
+ * an srtp_event_queue_t is a bounded queue of the events of a session,
+ * after the bounded MPMC queue of D. Vyukov: packet threads add events
+ * and a single control thread takes them with srtp_session_poll_events()
+ *
+ * the sequence number of a slot is its position in the queue when it is
+ * free, and that position plus one when it holds an event, so producers
+ * only contend on head and never wait for each other
+ */
+typedef struct srtp_event_slot_t {
+    volatile long seq;
+    uint32_t ssrc; /* host order */
+    srtp_event_t event;
+} srtp_event_slot_t;
+
+typedef struct srtp_event_queue_t {
+    volatile long head; /* next position to add an event at      */
+    long tail;          /* next position to take an event from   */
+    size_t mask;        /* number of slots minus one             */
+    size_t dropped;     /* events lost to a full queue           */
+    srtp_event_slot_t *slots; /* follow the queue in its allocation */
+} srtp_event_queue_t;
+
 typedef struct srtp_ctx_t_ {
     srtp_stream_list_t stream_list;             /* linked list of streams     */
     struct srtp_stream_ctx_t_ *stream_template; /* act as template for other  */
                                                 /* streams                    */
+    srtp_stream_pool_t stream_pool;             /* preallocated clones        */
     void *user_data;                            /* user custom data           */
+    bool thread_safe;                           /* use the locks below        */
+    bool exportable;                            /* keeps the policies         */
+    srtp_rwlock_t lock;                         /* shared for packets of      */
+                                                /* known streams, exclusive   */
+                                                /* to change the stream list  */
+    srtp_policy_t template_policy;              /* to key clones separately   */
+                                                /* or to export the session   */
+    srtp_key_cache_t key_cache;                 /* keys of explicit streams   */
+    struct srtp_stream_ctx_t_ *previous_template; /* replaced by an update, */
+                                                  /* kept for overlapping   */
+                                                  /* clones                 */
+    srtp_trailer_cache_t trailer_cache;           /* for the trailer length */
+                                                  /* queries                */
+    uint32_t epoch;                               /* advanced by            */
+                                                  /* srtp_session_gc()      */
+    size_t num_clones;                            /* streams in the list    */
+                                                  /* cloned from template   */
+    size_t max_clones;                            /* limits of the template */
+    size_t clone_idle_timeout;                    /* policy, 0 if unlimited */
+    srtp_breaker_t breaker;                       /* for unknown SSRCs      */
+    const srtp_offload_engine_t *offload;         /* runs the batches of    */
+    void *offload_data;                           /* srtp_batch_submit()    */
+    srtp_spinlock_t batch_lock;                   /* guards the queue       */
+    bool batch_running;                           /* a queue runner exists  */
+    struct srtp_batch_ctx_t_ *batch_head;         /* submitted batches not  */
+    struct srtp_batch_ctx_t_ *batch_tail;         /* yet processed          */
+    srtp_event_queue_t *events; /* NULL to call the global event handler */
+    int numa_node;              /* of the session's allocations           */
+    uint32_t stream_generation; /* advanced whenever a stream is removed  */
+                                /* or replaced, see srtp_stream_lookup()  */
+#ifdef ENABLE_STAGE_PROFILE
+    srtp_stage_profile_t stage_profile; /* see srtp_get_stage_profile() */
+#endif
 } srtp_ctx_t_;
 
+/*
+ * an srtp_prepared_stream_ctx_t holds a stream that srtp_stream_prepare()
+ * allocated and keyed, with a copy of its policy, until srtp_stream_commit()
+ * links it into a session
+ */
+typedef struct srtp_prepared_stream_ctx_t_ {
+    struct srtp_stream_ctx_t_ *stream;
+    srtp_policy_t policy;
+} srtp_prepared_stream_ctx_t_;
+
+/*
+ * an srtp_retired_ctx_t is a session handed over to srtp_reclaim() by
+ * srtp_dealloc_deferred(), it is the session's own allocation
+ */
+typedef struct srtp_retired_ctx_t_ {
+    srtp_ctx_t_ session;
+} srtp_retired_ctx_t_;
+
+/*
+ * an srtp_batch_ctx_t is a batch submitted with srtp_batch_submit(); it is
+ * queued in its session until it and every batch before it are ready
+ */
+typedef struct srtp_batch_ctx_t_ {
+    srtp_ctx_t_ *session;
+    srtp_batch_op_t op;
+    srtp_packet_desc_t *pkts;
+    size_t num_pkts;
+    srtp_batch_done_func_t done;
+    void *user_data;
+    bool ready;                      /* passed to srtp_batch_run()       */
+    srtp_err_status_t status;        /* in_progress until processed      */
+    struct srtp_batch_ctx_t_ *next;  /* in the queue of the session      */
+} srtp_batch_ctx_t_;
+
+/*
+ * an srtp_reader_ctx_t unprotects recorded packets with a private copy of
+ * a stream; the session it holds has no streams and only serves as the
+ * context of the packet paths
+ */
+typedef struct srtp_reader_ctx_t_ {
+    srtp_ctx_t_ session;
+    struct srtp_stream_ctx_t_ *stream;
+    const struct srtp_stream_ctx_t_ *source; /* the stream copied, which */
+                                             /* stream may share data of */
+} srtp_reader_ctx_t_;
+
+/*
+ * locking for thread safe sessions
+ *
+ * packets of streams that are already in the stream list are processed
+ * holding the session lock shared and a lock of the stream, so that
+ * different streams can be processed concurrently. anything that may add
+ * or remove streams, including the first packet of a new SSRC when there
+ * is a template, holds the session lock exclusively.
+ *
+ * RTP packets hold the lock of the stream and SRTCP packets the lock of
+ * its srtp_stream_rtcp_t, so that the two are processed concurrently as
+ * well. what both change is either set once atomically, the direction and
+ * the cold part of the stream, or belongs to a key overlap, whose end
+ * retires the keys both use: SRTCP packets of a stream in an overlap hold
+ * both locks. the other calls on a stream hold both locks too, always
+ * taking the lock of the stream first.
+ */
+#define SRTP_STREAM_LOCK_RTP 1u  /* stream->lock      */
+#define SRTP_STREAM_LOCK_RTCP 2u /* stream->rtcp.lock */
+#define SRTP_STREAM_LOCK_BOTH (SRTP_STREAM_LOCK_RTP | SRTP_STREAM_LOCK_RTCP)
+
+static inline void srtp_stream_lock(srtp_stream_ctx_t *stream,
+                                    unsigned int locks)
+{
+    if (locks & SRTP_STREAM_LOCK_RTP) {
+        srtp_spinlock_lock(&stream->lock);
+    }
+    if (locks & SRTP_STREAM_LOCK_RTCP) {
+        srtp_spinlock_lock(&stream->rtcp.lock);
+    }
+}
+
+static inline void srtp_stream_unlock(srtp_stream_ctx_t *stream,
+                                      unsigned int locks)
+{
+    if (locks & SRTP_STREAM_LOCK_RTCP) {
+        srtp_spinlock_unlock(&stream->rtcp.lock);
+    }
+    if (locks & SRTP_STREAM_LOCK_RTP) {
+        srtp_spinlock_unlock(&stream->lock);
+    }
+}
+
+/*
+ * srtp_session_bind_allocs(ctx) makes the allocations of the calling
+ * thread go to the NUMA node of session ctx until the node it returns is
+ * set again with srtp_crypto_alloc_set_node()
+ */
+static inline int srtp_session_bind_allocs(const srtp_ctx_t *ctx)
+{
+    return srtp_crypto_alloc_set_node(ctx != NULL ? ctx->numa_node
+                                                  : SRTP_NUMA_NODE_ANY);
+}
+
+/*
+ * srtp_session_copy_locked(session, node, copy) sets *copy to a new
+ * session holding copies of the template and streams of session, made
+ * through an export and allocated on node; the lock of a thread safe
+ * session is held by the caller
+ */
+srtp_err_status_t srtp_session_copy_locked(srtp_t session,
+                                           int node,
+                                           srtp_t *copy);
+
+/*
+ * srtp_stream_get_counters(stream, stats) sets stats to the counters of
+ * all packets of stream, its ssrc is left to the caller
+ */
+void srtp_stream_get_counters(const srtp_stream_ctx_t *stream,
+                              srtp_stream_stats_t *stats);
+
+/*
+ * srtp_session_clone_stream(ctx, ssrc, new) creates the stream for a new
+ * ssrc from the session's template, first making room for it if the
+ * session holds as many clones as the template allows
+ */
+srtp_err_status_t srtp_session_clone_stream(srtp_t ctx,
+                                            uint32_t ssrc,
+                                            srtp_stream_ctx_t **str_ptr);
+
+/*
+ * srtp_session_insert_clone(ctx, stream) links a stream that
+ * srtp_session_clone_stream() created into the session, it is deallocated
+ * if that fails
+ */
+srtp_err_status_t srtp_session_insert_clone(srtp_t ctx,
+                                            srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_stream_add_unlocked(session, policy) is srtp_stream_add(), with the
+ * lock of a thread safe session held exclusively by the caller
+ */
+srtp_err_status_t srtp_stream_add_unlocked(srtp_t session,
+                                           const srtp_policy_t policy);
+
+/* srtp_stream_rtcp_rdb(stream) is the SRTCP replay database of stream */
+srtp_rdb_t *srtp_stream_rtcp_rdb(srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_unprotect_rtp_parsed(ctx, stream, srtp, srtp_len, desc, rtp,
+ * rtp_len) unprotects an RTP packet of stream whose header the caller
+ * has parsed into desc, with the packet path the stream was set up for
+ */
+srtp_err_status_t srtp_unprotect_rtp_parsed(srtp_ctx_t *ctx,
+                                            srtp_stream_ctx_t *stream,
+                                            const uint8_t *srtp,
+                                            size_t srtp_len,
+                                            const srtp_rtp_header_desc_t *desc,
+                                            uint8_t *rtp,
+                                            size_t *rtp_len);
+
+/*
+ * srtp_stream_dealloc(stream, stream_template) deallocates stream, except
+ * for what it shares with stream_template, which may be NULL
+ */
+srtp_err_status_t srtp_stream_dealloc(srtp_stream_ctx_t *stream,
+                                      const srtp_stream_ctx_t *stream_template);
+
+/*
+ * srtp_stream_clone(pool, stream_template, ssrc, new) initializes a new
+ * stream using the cipher and auth of the stream_template, taking it
+ * from the pool if possible and allocating it otherwise
+ *
+ * the only unique data in a cloned stream is the replay database and
+ * the SSRC
+ */
+srtp_err_status_t srtp_stream_clone(srtp_stream_pool_t *pool,
+                                    const srtp_stream_ctx_t *stream_template,
+                                    uint32_t ssrc,
+                                    srtp_stream_ctx_t **str_ptr);
+
+/*
+ * srtp_stream_clone_keys(stream_template, str) replaces the cipher, auth
+ * and key limit that str, a clone of stream_template, shares with the
+ * template by private copies. The copies are keyed from the template's
+ * expanded keys, skipping the key derivation. Returns
+ * srtp_err_status_no_such_op if a cipher or auth type can not be cloned;
+ * on failure str still holds all the pointers that were not replaced, so
+ * that it can be deallocated against the template.
+ */
+srtp_err_status_t srtp_stream_clone_keys(
+    const srtp_stream_ctx_t *stream_template,
+    srtp_stream_ctx_t *str);
+
+/*
+ * srtp_stream_clone_from_policy(stream_template, policy, ssrc, new) creates
+ * a stream for ssrc from the policy the template was created from. Unlike
+ * srtp_stream_clone() the new stream has its own cipher, auth and key
+ * limit, so that it can be used concurrently with other clones.
+ */
+srtp_err_status_t srtp_stream_clone_from_policy(
+    const srtp_stream_ctx_t *stream_template,
+    const srtp_policy_t policy,
+    uint32_t ssrc,
+    srtp_stream_ctx_t **str_ptr);
+
+/*
+ * srtp_session_enter(ctx, ssrc) is srtp_session_enter_locks() for a call
+ * that uses the whole stream
+ */
+srtp_stream_ctx_t *srtp_session_enter(srtp_t ctx, uint32_t ssrc);
+
+/* srtp_session_leave(ctx, stream) releases what srtp_session_enter took */
+void srtp_session_leave(srtp_t ctx, srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_event_queue_push(session, stream, event) adds event of stream to
+ * the event queue of session, unless the same event of stream is queued
+ * already; a full queue counts the event as dropped instead
+ */
+void srtp_event_queue_push(srtp_t session,
+                           srtp_stream_ctx_t *stream,
+                           srtp_event_t event);
+
 /*
  * srtp_hdr_t represents an RTP or SRTP header.  The bit-fields in
  * this structure should be declared "unsigned int" instead of
  * "unsigned char", but doing so causes the MS compiler to not
  * fully pack the bit fields.
  *
- * In this implementation, an srtp_hdr_t is assumed to be 32-bit aligned
+ * The packet headers below are packed, their alignment is one octet, so
+ * that packets can be parsed at any offset in a buffer, for instance
+ * after the framing of RFC 4571 or a TURN ChannelData header; the
+ * compiler then reads their fields with unaligned loads, which cost the
+ * same as aligned ones on current x86 and ARM processors.
  *
  * (note that this definition follows that of RFC 1889 Appendix A, but
  * is not identical)
  */
 
+#pragma pack(push, 1)
+
 #ifndef WORDS_BIGENDIAN
 
 typedef struct {
@@ -249,9 +801,6 @@ typedef struct {
 
 /*
  * srtcp_hdr_t represents a secure rtcp header
- *
- * in this implementation, an srtcp header is assumed to be 32-bit
- * aligned
  */
 
 #ifndef WORDS_BIGENDIAN
@@ -292,22 +841,93 @@ typedef struct {
 
 #endif
 
+#pragma pack(pop)
+
+/*
+ * SRTP_PROBEn(name, ...) marks a USDT (SystemTap/DTrace) probe point
+ * named libsrtp:name with n integer arguments. With ENABLE_USDT_PROBES
+ * a probe costs a single nop until a tracer such as bpftrace or perf
+ * attaches to it; otherwise it expands to nothing and its arguments are
+ * not evaluated.
+ */
+#ifdef ENABLE_USDT_PROBES
+#define SRTP_PROBE2(name, a1, a2) DTRACE_PROBE2(libsrtp, name, a1, a2)
+#define SRTP_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(libsrtp, name, a1, a2, a3)
+#else
+#define SRTP_PROBE2(name, a1, a2)
+#define SRTP_PROBE3(name, a1, a2, a3)
+#endif
+
 /*
- * srtp_handle_event(srtp, srtm, evnt) calls the event handling
- * function, if there is one.
+ * SRTP_STAGE_START(t) starts the stage clock t of a function of the
+ * packet path, and each SRTP_STAGE_LAP(ctx, dir, stage, t) adds the
+ * ticks since then to stage in the dir (protect or unprotect) counts of
+ * session ctx and restarts the clock; SRTP_STAGE_RESTART(t) restarts it
+ * without adding the ticks anywhere, after a call that counted them
+ * itself, and SRTP_STAGE_PACKET(ctx, dir) counts a packet. Without
+ * ENABLE_STAGE_PROFILE they expand to nothing.
+ */
+#ifdef ENABLE_STAGE_PROFILE
+static inline uint64_t srtp_stage_clock(void)
+{
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+    return __rdtsc();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    uint64_t ticks;
+
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return 0;
+#endif
+}
+
+static inline void srtp_stage_lap(srtp_stage_counts_t *counts,
+                                  srtp_stage_t stage,
+                                  uint64_t *t)
+{
+    uint64_t now = srtp_stage_clock();
+
+    counts->ticks[stage] += now - *t;
+    *t = now;
+}
+
+#define SRTP_STAGE_START(t) uint64_t t = srtp_stage_clock()
+#define SRTP_STAGE_LAP(ctx, dir, stage, t)                                     \
+    srtp_stage_lap(&(ctx)->stage_profile.dir, stage, &(t))
+#define SRTP_STAGE_RESTART(t) ((t) = srtp_stage_clock())
+#define SRTP_STAGE_PACKET(ctx, dir) ((ctx)->stage_profile.dir.packets++)
+#else
+#define SRTP_STAGE_START(t)
+#define SRTP_STAGE_LAP(ctx, dir, stage, t)
+#define SRTP_STAGE_RESTART(t)
+#define SRTP_STAGE_PACKET(ctx, dir) ((void)(ctx))
+#endif
+
+/*
+ * srtp_handle_event(srtp, srtm, evnt) fires the event probe and calls
+ * the event handling function, if there is one.
  *
  * This macro is not included in the documentation as it is
  * an internal-only function.
  */
 
 #define srtp_handle_event(srtp, strm, evnt)                                    \
-    if (srtp_event_handler) {                                                  \
-        srtp_event_data_t data;                                                \
-        data.session = srtp;                                                   \
-        data.ssrc = ntohl(strm->ssrc);                                         \
-        data.event = evnt;                                                     \
-        srtp_event_handler(&data);                                             \
-    }
+    do {                                                                       \
+        SRTP_PROBE2(event, ntohl(strm->ssrc), evnt);                           \
+        if ((srtp)->events != NULL) {                                          \
+            srtp_event_queue_push(srtp, strm, evnt);                           \
+        } else if (srtp_event_handler) {                                       \
+            srtp_event_data_t data;                                            \
+            data.session = srtp;                                               \
+            data.ssrc = ntohl(strm->ssrc);                                     \
+            data.event = evnt;                                                 \
+            srtp_event_handler(&data);                                         \
+        }                                                                      \
+    } while (0)
 
 #ifdef __cplusplus
 }
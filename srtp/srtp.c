@@ -98,18 +98,6 @@ static size_t srtp_get_rtp_hdr_len(const srtp_hdr_t *hdr)
     return octets_in_rtp_header + 4 * hdr->cc;
 }
 
-/*
- * Returns the location of the header extention cast to a srtp_hdr_xtnd_t
- * struct. Will always return a value and assumes that the caller has already
- * verified that a header extension is present by checking the x bit of
- * srtp_hdr_t.
- */
-static srtp_hdr_xtnd_t *srtp_get_rtp_xtn_hdr(const srtp_hdr_t *hdr,
-                                             uint8_t *rtp)
-{
-    return (srtp_hdr_xtnd_t *)(rtp + srtp_get_rtp_hdr_len(hdr));
-}
-
 /*
  * Returns the length of the extension header including the extension header
  * header so will return a minium of 4. Assumes the srtp_hdr_t is a valid
@@ -132,92 +120,148 @@ static uint16_t srtp_get_rtp_hdr_xtnd_profile(const srtp_hdr_t *hdr,
     return ntohs(xtn_hdr->profile_specific);
 }
 
-static void srtp_cryptex_move_hdr_xtnd_hdr_before_csrc(const srtp_hdr_t *hdr,
-                                                       uint8_t *rtp)
+/*
+ * srtp_rtp_header_describe(rtp, rtp_len, desc) fills desc for a packet
+ * whose header has been validated, see srtp_rtp_header_parse()
+ */
+static void srtp_rtp_header_describe(const uint8_t *rtp,
+                                     size_t rtp_len,
+                                     srtp_rtp_header_desc_t *desc)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+
+    desc->csrc_count = hdr->cc;
+    desc->header_len = srtp_get_rtp_hdr_len(hdr);
+    if (hdr->x == 1) {
+        desc->xtn_offset = desc->header_len;
+        desc->xtn_len = srtp_get_rtp_hdr_xtnd_len(hdr, rtp);
+        desc->xtn_profile = srtp_get_rtp_hdr_xtnd_profile(hdr, rtp);
+        desc->header_len += desc->xtn_len;
+    } else {
+        desc->xtn_offset = 0;
+        desc->xtn_len = 0;
+        desc->xtn_profile = 0;
+    }
+    desc->payload_len = rtp_len - desc->header_len;
+}
+
+static void srtp_cryptex_move_hdr_xtnd_hdr_before_csrc(
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *rtp)
 {
-    if (hdr->cc) {
+    if (desc->csrc_count) {
         uint8_t tmp[4];
-        uint8_t *xtn_hdr = rtp + srtp_get_rtp_hdr_len(hdr);
+        uint8_t *xtn_hdr = rtp + desc->xtn_offset;
         uint8_t *csrc_list = rtp + octets_in_rtp_header;
-        size_t csrc_list_size = hdr->cc * 4;
+        size_t csrc_list_size = desc->csrc_count * 4;
         memcpy(tmp, xtn_hdr, 4);
         memmove(csrc_list + 4, csrc_list, csrc_list_size);
         memcpy(csrc_list, tmp, 4);
     }
 }
 
-static void srtp_cryptex_move_csrc_before_hdr_xtnd_hdr(const srtp_hdr_t *hdr,
-                                                       uint8_t *rtp)
+static void srtp_cryptex_move_csrc_before_hdr_xtnd_hdr(
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *rtp)
 {
-    if (hdr->cc) {
+    if (desc->csrc_count) {
         uint8_t tmp[4];
-        uint8_t *xtn_hdr = rtp + srtp_get_rtp_hdr_len(hdr);
+        uint8_t *xtn_hdr = rtp + desc->xtn_offset;
         uint8_t *csrc_list = rtp + octets_in_rtp_header;
-        size_t csrc_list_size = hdr->cc * 4;
+        size_t csrc_list_size = desc->csrc_count * 4;
         memcpy(tmp, csrc_list, 4);
         memmove(csrc_list, csrc_list + 4, csrc_list_size);
         memcpy(xtn_hdr, tmp, 4);
     }
 }
 
+/*
+ * srtp_cryptex_protect_init() and srtp_cryptex_unprotect_init() find out
+ * whether cryptex applies to the packet and adjust enc_start to the start
+ * of the encrypted portion. Set contiguous when the cipher has to get the
+ * CSRCs and the header extension in a single call, as the AEAD ciphers do.
+ * Then an in place packet has its extension header moved in front of the
+ * CSRCs while it is processed and *inplace is set. Otherwise the CSRCs are
+ * processed on their own before the rest of the packet, which needs no
+ * reordering in place either.
+ */
 static srtp_err_status_t srtp_cryptex_protect_init(
     const srtp_stream_ctx_t *stream,
-    const srtp_hdr_t *hdr,
+    const srtp_rtp_header_desc_t *desc,
     const uint8_t *rtp,
     const uint8_t *srtp,
+    bool contiguous,
     bool *inuse,
     bool *inplace,
     size_t *enc_start)
 {
     if (stream->use_cryptex && (stream->rtp_services & sec_serv_conf)) {
-        if (hdr->cc && hdr->x == 0) {
+        if (desc->csrc_count && desc->xtn_len == 0) {
             /* Cryptex can only encrypt CSRCs if header extension is present */
             return srtp_err_status_cryptex_err;
         }
-        *inuse = hdr->x == 1;
+        *inuse = desc->xtn_len != 0;
     } else {
         *inuse = false;
     }
 
-    *inplace = *inuse && rtp == srtp;
+    *inplace = *inuse && contiguous && rtp == srtp;
 
     if (*inuse) {
-        *enc_start -=
-            (srtp_get_rtp_hdr_xtnd_len(hdr, rtp) - octets_in_rtp_xtn_hdr);
+        *enc_start -= (desc->xtn_len - octets_in_rtp_xtn_hdr);
         if (*inplace) {
-            *enc_start -= (hdr->cc * 4);
+            *enc_start -= (desc->csrc_count * 4);
         }
     }
 
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_cryptex_protect(bool inplace,
-                                              const srtp_hdr_t *hdr,
-                                              uint8_t *srtp,
-                                              srtp_cipher_t *rtp_cipher)
+static void srtp_keystream_xor(uint8_t *out,
+                               const uint8_t *in,
+                               const uint8_t *keystream,
+                               size_t len);
+
+/*
+ * srtp_cryptex_protect() marks the header extension as encrypted and,
+ * unless the packet is reordered in place, encrypts the CSRCs where they
+ * are. They take the first octets of the keystream, the header extension
+ * and the payload the rest; if keystream points to keystream computed
+ * ahead of time it is used and advanced past the CSRCs, otherwise the
+ * cipher is.
+ */
+static srtp_err_status_t srtp_cryptex_protect(
+    bool inplace,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    srtp_cipher_t *rtp_cipher,
+    const uint8_t **keystream)
 {
-    srtp_hdr_xtnd_t *xtn_hdr = srtp_get_rtp_xtn_hdr(hdr, srtp);
-    uint16_t profile = ntohs(xtn_hdr->profile_specific);
-    if (profile == xtn_hdr_one_byte_profile) {
+    srtp_hdr_xtnd_t *xtn_hdr = (srtp_hdr_xtnd_t *)(srtp + desc->xtn_offset);
+    if (desc->xtn_profile == xtn_hdr_one_byte_profile) {
         xtn_hdr->profile_specific = htons(cryptex_one_byte_profile);
-    } else if (profile == xtn_hdr_two_byte_profile) {
+    } else if (desc->xtn_profile == xtn_hdr_two_byte_profile) {
         xtn_hdr->profile_specific = htons(cryptex_two_byte_profile);
     } else {
         return srtp_err_status_parse_err;
     }
 
     if (inplace) {
-        srtp_cryptex_move_hdr_xtnd_hdr_before_csrc(hdr, srtp);
+        srtp_cryptex_move_hdr_xtnd_hdr_before_csrc(desc, srtp);
     } else {
-        if (hdr->cc) {
+        if (desc->csrc_count) {
             uint8_t *cc_list = srtp + octets_in_rtp_header;
-            size_t cc_list_size = hdr->cc * 4;
+            size_t cc_list_size = desc->csrc_count * 4;
             /* CSRCs are in dst header already, enc in place */
-            srtp_err_status_t status = srtp_cipher_encrypt(
-                rtp_cipher, cc_list, cc_list_size, cc_list, &cc_list_size);
-            if (status) {
-                return srtp_err_status_cipher_fail;
+            if (keystream != NULL && *keystream != NULL) {
+                srtp_keystream_xor(cc_list, cc_list, *keystream, cc_list_size);
+                *keystream += cc_list_size;
+            } else {
+                srtp_err_status_t status = srtp_cipher_encrypt(
+                    rtp_cipher, cc_list, cc_list_size, cc_list, &cc_list_size);
+                if (status) {
+                    return srtp_err_status_cipher_fail;
+                }
             }
         }
     }
@@ -226,55 +270,56 @@ static srtp_err_status_t srtp_cryptex_protect(bool inplace,
 }
 
 static void srtp_cryptex_protect_cleanup(bool inplace,
-                                         const srtp_hdr_t *hdr,
+                                         const srtp_rtp_header_desc_t *desc,
                                          uint8_t *srtp)
 {
     if (inplace) {
-        srtp_cryptex_move_csrc_before_hdr_xtnd_hdr(hdr, srtp);
+        srtp_cryptex_move_csrc_before_hdr_xtnd_hdr(desc, srtp);
     }
 }
 
 static srtp_err_status_t srtp_cryptex_unprotect_init(
     const srtp_stream_ctx_t *stream,
-    const srtp_hdr_t *hdr,
+    const srtp_rtp_header_desc_t *desc,
     const uint8_t *srtp,
     const uint8_t *rtp,
+    bool contiguous,
     bool *inuse,
     bool *inplace,
     size_t *enc_start)
 {
-    if (stream->use_cryptex && hdr->x == 1) {
-        uint16_t profile = srtp_get_rtp_hdr_xtnd_profile(hdr, rtp);
-        *inuse = profile == cryptex_one_byte_profile ||
-                 profile == cryptex_two_byte_profile;
+    /* desc was parsed from srtp, rtp has not been written yet */
+    if (stream->use_cryptex && desc->xtn_len != 0) {
+        *inuse = desc->xtn_profile == cryptex_one_byte_profile ||
+                 desc->xtn_profile == cryptex_two_byte_profile;
     } else {
         *inuse = false;
     }
 
-    *inplace = *inuse && srtp == rtp;
+    *inplace = *inuse && contiguous && srtp == rtp;
 
     if (*inuse) {
-        *enc_start -=
-            (srtp_get_rtp_hdr_xtnd_len(hdr, rtp) - octets_in_rtp_xtn_hdr);
+        *enc_start -= (desc->xtn_len - octets_in_rtp_xtn_hdr);
         if (*inplace) {
-            *enc_start -= (hdr->cc * 4);
+            *enc_start -= (desc->csrc_count * 4);
         }
     }
 
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_cryptex_unprotect(bool inplace,
-                                                const srtp_hdr_t *hdr,
-                                                uint8_t *rtp,
-                                                srtp_cipher_t *rtp_cipher)
+static srtp_err_status_t srtp_cryptex_unprotect(
+    bool inplace,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *rtp,
+    srtp_cipher_t *rtp_cipher)
 {
     if (inplace) {
-        srtp_cryptex_move_hdr_xtnd_hdr_before_csrc(hdr, rtp);
+        srtp_cryptex_move_hdr_xtnd_hdr_before_csrc(desc, rtp);
     } else {
-        if (hdr->cc) {
+        if (desc->csrc_count) {
             uint8_t *cc_list = rtp + octets_in_rtp_header;
-            size_t cc_list_size = hdr->cc * 4;
+            size_t cc_list_size = desc->csrc_count * 4;
             /* CSRCs are in dst header already, enc in place */
             srtp_err_status_t status = srtp_cipher_decrypt(
                 rtp_cipher, cc_list, cc_list_size, cc_list, &cc_list_size);
@@ -288,48 +333,105 @@ static srtp_err_status_t srtp_cryptex_unprotect(bool inplace,
 }
 
 static void srtp_cryptex_unprotect_cleanup(bool inplace,
-                                           const srtp_hdr_t *hdr,
+                                           const srtp_rtp_header_desc_t *desc,
                                            uint8_t *rtp)
 {
     if (inplace) {
-        srtp_cryptex_move_csrc_before_hdr_xtnd_hdr(hdr, rtp);
+        srtp_cryptex_move_csrc_before_hdr_xtnd_hdr(desc, rtp);
     }
 
-    srtp_hdr_xtnd_t *xtn_hdr = srtp_get_rtp_xtn_hdr(hdr, rtp);
-    uint16_t profile = ntohs(xtn_hdr->profile_specific);
-    if (profile == cryptex_one_byte_profile) {
+    srtp_hdr_xtnd_t *xtn_hdr = (srtp_hdr_xtnd_t *)(rtp + desc->xtn_offset);
+    if (desc->xtn_profile == cryptex_one_byte_profile) {
         xtn_hdr->profile_specific = htons(xtn_hdr_one_byte_profile);
-    } else if (profile == cryptex_two_byte_profile) {
+    } else if (desc->xtn_profile == cryptex_two_byte_profile) {
         xtn_hdr->profile_specific = htons(xtn_hdr_two_byte_profile);
     }
 }
 
-static srtp_err_status_t srtp_validate_rtp_header(const uint8_t *rtp,
-                                                  size_t pkt_octet_len)
+srtp_err_status_t srtp_rtp_header_parse(const uint8_t *rtp,
+                                        size_t rtp_len,
+                                        srtp_rtp_header_desc_t *desc)
 {
     const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
-    size_t rtp_header_len;
 
-    if (pkt_octet_len < octets_in_rtp_header) {
+    if (rtp == NULL || desc == NULL || rtp_len < octets_in_rtp_header) {
         return srtp_err_status_bad_param;
     }
 
     /* Check RTP header length */
-    rtp_header_len = srtp_get_rtp_hdr_len(hdr);
-    if (pkt_octet_len < rtp_header_len) {
+    desc->csrc_count = hdr->cc;
+    desc->header_len = srtp_get_rtp_hdr_len(hdr);
+    if (rtp_len < desc->header_len) {
         return srtp_err_status_bad_param;
     }
 
     /* Verifying profile length. */
     if (hdr->x == 1) {
-        if (pkt_octet_len < rtp_header_len + octets_in_rtp_xtn_hdr) {
+        if (rtp_len < desc->header_len + octets_in_rtp_xtn_hdr) {
+            return srtp_err_status_bad_param;
+        }
+
+        desc->xtn_offset = desc->header_len;
+        desc->xtn_len = srtp_get_rtp_hdr_xtnd_len(hdr, rtp);
+        desc->xtn_profile = srtp_get_rtp_hdr_xtnd_profile(hdr, rtp);
+        desc->header_len += desc->xtn_len;
+        if (rtp_len < desc->header_len) {
             return srtp_err_status_bad_param;
         }
+    } else {
+        desc->xtn_offset = 0;
+        desc->xtn_len = 0;
+        desc->xtn_profile = 0;
+    }
+    desc->payload_len = rtp_len - desc->header_len;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_validate_rtp_header(const uint8_t *rtp,
+                                                  size_t pkt_octet_len)
+{
+    srtp_rtp_header_desc_t desc;
+
+    return srtp_rtp_header_parse(rtp, pkt_octet_len, &desc);
+}
+
+/*
+ * srtp_rtp_header_desc_check(rtp, rtp_len, desc) checks a desc that was
+ * filled by the application against the fixed header and the length of
+ * the packet, which is enough for every offset it gives to lie within the
+ * packet; the header extension is not read
+ */
+static srtp_err_status_t srtp_rtp_header_desc_check(
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+    size_t base_len;
+
+    if (rtp == NULL || rtp_len < octets_in_rtp_header) {
+        return srtp_err_status_bad_param;
+    }
 
-        rtp_header_len += srtp_get_rtp_hdr_xtnd_len(hdr, rtp);
-        if (pkt_octet_len < rtp_header_len) {
+    base_len = srtp_get_rtp_hdr_len(hdr);
+    if (base_len > rtp_len || desc->csrc_count != hdr->cc) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (hdr->x == 1) {
+        if (desc->xtn_offset != base_len ||
+            desc->xtn_len < octets_in_rtp_xtn_hdr || desc->xtn_len % 4 ||
+            desc->xtn_len > rtp_len - base_len) {
             return srtp_err_status_bad_param;
         }
+    } else if (desc->xtn_offset != 0 || desc->xtn_len != 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (desc->header_len != base_len + desc->xtn_len ||
+        desc->payload_len != rtp_len - desc->header_len) {
+        return srtp_err_status_bad_param;
     }
 
     return srtp_err_status_ok;
@@ -374,9 +476,149 @@ unsigned int srtp_get_version(void)
     return rv;
 }
 
-static srtp_err_status_t srtp_stream_dealloc(
-    srtp_stream_ctx_t *stream,
-    const srtp_stream_ctx_t *stream_template)
+/*
+ * srtp_stream_layout_t places what a stream owns behind the stream in a
+ * single allocation: the session keys, their key limits and MKI ids, the
+ * list of encrypted header extension ids and the RTP replay window. The
+ * offsets of the parts that are not owned are zero.
+ */
+typedef struct {
+    size_t session_keys;
+    size_t limits;
+    size_t mki_ids;
+    size_t enc_xtn_hdr;
+    size_t bitmask;
+    size_t size;
+} srtp_stream_layout_t;
+
+#define SRTP_STREAM_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+/* octets of the bitmap of header extension ids to encrypt */
+#define SRTP_ENC_XTN_HDR_MASK_LEN 32
+
+/*
+ * srtp_stream_layout(num_master_keys, mki_size, own_limits,
+ * enc_xtn_hdr_count, window_size, layout) computes the layout of a stream,
+ * window_size is zero if the replay window is allocated separately
+ */
+static void srtp_stream_layout(size_t num_master_keys,
+                               size_t mki_size,
+                               bool own_limits,
+                               size_t enc_xtn_hdr_count,
+                               size_t window_size,
+                               srtp_stream_layout_t *layout)
+{
+    size_t offset = SRTP_STREAM_ALIGN(sizeof(srtp_stream_ctx_t));
+
+    memset(layout, 0, sizeof(*layout));
+
+    layout->session_keys = offset;
+    offset += SRTP_STREAM_ALIGN(num_master_keys * sizeof(srtp_session_keys_t));
+
+    if (own_limits) {
+        layout->limits = offset;
+        offset +=
+            SRTP_STREAM_ALIGN(num_master_keys * sizeof(srtp_key_limit_ctx_t));
+    }
+
+    if (mki_size != 0) {
+        layout->mki_ids = offset;
+        offset += SRTP_STREAM_ALIGN(num_master_keys * mki_size);
+    }
+
+    if (enc_xtn_hdr_count != 0) {
+        layout->enc_xtn_hdr = offset;
+        offset +=
+            SRTP_STREAM_ALIGN(SRTP_ENC_XTN_HDR_MASK_LEN + enc_xtn_hdr_count);
+    }
+
+    if (window_size != 0) {
+        layout->bitmask = offset;
+        offset += SRTP_REPLAY_WINDOW_WORDS(window_size) * sizeof(uint64_t);
+    }
+
+    layout->size = offset;
+}
+
+/*
+ * srtp_stream_alloc_block(layout, num_master_keys, mki_size) allocates a
+ * stream laid out by layout and points it at the parts it owns
+ */
+static srtp_stream_ctx_t *srtp_stream_alloc_block(
+    const srtp_stream_layout_t *layout,
+    size_t num_master_keys,
+    size_t mki_size)
+{
+    srtp_stream_ctx_t *str;
+    uint8_t *block;
+
+    block = (uint8_t *)srtp_crypto_alloc_aligned(layout->size,
+                                                 SRTP_CACHE_LINE_SIZE);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    str = (srtp_stream_ctx_t *)block;
+    str->block_size = layout->size;
+    str->num_master_keys = (uint16_t)num_master_keys;
+    str->session_keys = (srtp_session_keys_t *)(block + layout->session_keys);
+
+    for (size_t i = 0; i < num_master_keys; i++) {
+        srtp_session_keys_t *session_keys = &str->session_keys[i];
+
+        if (layout->limits) {
+            session_keys->limit =
+                (srtp_key_limit_ctx_t *)(block + layout->limits) + i;
+        }
+        if (layout->mki_ids) {
+            session_keys->mki_id = block + layout->mki_ids + i * mki_size;
+        }
+    }
+
+    if (layout->enc_xtn_hdr) {
+        str->enc_xtn_hdr_mask = block + layout->enc_xtn_hdr;
+        str->enc_xtn_hdr = str->enc_xtn_hdr_mask + SRTP_ENC_XTN_HDR_MASK_LEN;
+    }
+
+    return str;
+}
+
+/*
+ * srtp_stream_owns(stream, ptr) returns true if ptr points into the
+ * allocation of stream, and so must not be freed on its own
+ */
+static bool srtp_stream_owns(const srtp_stream_ctx_t *stream, const void *ptr)
+{
+    uintptr_t base = (uintptr_t)stream;
+
+    return (uintptr_t)ptr >= base && (uintptr_t)ptr < base + stream->block_size;
+}
+
+/*
+ * srtp_keystream_cache_size(num_entries, max_len) is the size of the
+ * single allocation that holds a keystream cache, its entries and their
+ * keystream
+ */
+static size_t srtp_keystream_cache_size(size_t num_entries, size_t max_len)
+{
+    return sizeof(srtp_keystream_cache_t) +
+           num_entries * (sizeof(srtp_keystream_entry_t) + max_len);
+}
+
+/* srtp_keystream_cache_free(cache) clears and frees cache, if any */
+static void srtp_keystream_cache_free(srtp_keystream_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    octet_string_set_to_zero(
+        cache, srtp_keystream_cache_size(cache->num_entries, cache->max_len));
+    srtp_crypto_free(cache);
+}
+
+srtp_err_status_t srtp_stream_dealloc(srtp_stream_ctx_t *stream,
+                                      const srtp_stream_ctx_t *stream_template)
 {
     srtp_err_status_t status;
     srtp_session_keys_t *session_keys = NULL;
@@ -387,6 +629,25 @@ static srtp_err_status_t srtp_stream_dealloc(
      * fails, then we report that fact without trying to deallocate
      * anything else
      */
+    if (stream->cold != NULL) {
+        srtp_stream_cold_t *cold = stream->cold;
+
+        if (cold->overlap.previous) {
+            status = srtp_stream_dealloc(cold->overlap.previous,
+                                         cold->overlap.previous_template);
+            if (status) {
+                return status;
+            }
+            cold->overlap.previous = NULL;
+        }
+        srtp_crypto_free(cold->overlap.scratch);
+        srtp_crypto_free(cold->iov_scratch);
+        srtp_keystream_cache_free(cold->keystream);
+        srtp_policy_destroy(cold->policy);
+        srtp_crypto_free(cold);
+        stream->cold = NULL;
+    }
+
     if (stream->session_keys) {
         for (size_t i = 0; i < stream->num_master_keys; i++) {
             session_keys = &stream->session_keys[i];
@@ -470,11 +731,15 @@ static srtp_err_status_t srtp_stream_dealloc(
              */
             octet_string_set_to_zero(session_keys->salt, SRTP_AEAD_SALT_LEN);
             octet_string_set_to_zero(session_keys->c_salt, SRTP_AEAD_SALT_LEN);
+            v128_set_to_zero(&session_keys->aead_iv_base);
+            v128_set_to_zero(&session_keys->c_aead_iv_base);
 
             if (session_keys->mki_id) {
                 octet_string_set_to_zero(session_keys->mki_id,
                                          stream->mki_size);
-                srtp_crypto_free(session_keys->mki_id);
+                if (!srtp_stream_owns(stream, session_keys->mki_id)) {
+                    srtp_crypto_free(session_keys->mki_id);
+                }
                 session_keys->mki_id = NULL;
             }
 
@@ -485,11 +750,22 @@ static srtp_err_status_t srtp_stream_dealloc(
             if (template_session_keys &&
                 session_keys->limit == template_session_keys->limit) {
                 /* do nothing */
-            } else if (session_keys->limit) {
+            } else if (session_keys->limit &&
+                       !srtp_stream_owns(stream, session_keys->limit)) {
                 srtp_crypto_free(session_keys->limit);
             }
+
+            /* and the master key kept for deriving keys on first use */
+            if (template_session_keys &&
+                session_keys->pending == template_session_keys->pending) {
+                /* do nothing */
+            } else if (session_keys->pending) {
+                octet_string_set_to_zero(session_keys->pending,
+                                         sizeof(srtp_pending_keys_t));
+                srtp_crypto_free(session_keys->pending);
+            }
+            session_keys->pending = NULL;
         }
-        srtp_crypto_free(stream->session_keys);
     }
 
     status = srtp_rdbx_dealloc(&stream->rtp_rdbx);
@@ -500,16 +776,239 @@ static srtp_err_status_t srtp_stream_dealloc(
     if (stream_template &&
         stream->enc_xtn_hdr == stream_template->enc_xtn_hdr) {
         /* do nothing */
-    } else if (stream->enc_xtn_hdr) {
+    } else if (stream->enc_xtn_hdr &&
+               !srtp_stream_owns(stream, stream->enc_xtn_hdr)) {
         srtp_crypto_free(stream->enc_xtn_hdr);
     }
 
+    if (stream_template && stream->mki_map == stream_template->mki_map) {
+        /* do nothing */
+    } else {
+        srtp_crypto_free(stream->mki_map);
+    }
+
     /* deallocate srtp stream context */
     srtp_crypto_free(stream);
 
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_stream_cold(stream) returns the cold part of stream if it has one,
+ * which in a thread safe session the packets of the other kind may have
+ * just allocated
+ */
+static inline srtp_stream_cold_t *srtp_stream_cold(
+    const srtp_stream_ctx_t *stream)
+{
+    return (srtp_stream_cold_t *)srtp_atomic_load_ptr(
+        (void *const volatile *)&stream->cold);
+}
+
+/*
+ * srtp_stream_get_cold(stream) returns the cold part of stream, which is
+ * allocated with an empty SRTCP replay database on first use, or NULL if
+ * that allocation failed
+ *
+ * the RTP and SRTCP packets of a stream in a thread safe session may both
+ * need it first, the one that loses the race frees its allocation
+ */
+static srtp_stream_cold_t *srtp_stream_get_cold(srtp_stream_ctx_t *stream)
+{
+    srtp_stream_cold_t *cold = srtp_stream_cold(stream);
+
+    if (cold == NULL) {
+        cold = (srtp_stream_cold_t *)srtp_crypto_alloc(sizeof(*cold));
+        if (cold == NULL) {
+            return NULL;
+        }
+        /* the window size was validated by srtp_stream_init() */
+        srtp_rdb_init(&cold->rtcp_rdb, stream->rtcp_window_size);
+        if (!srtp_atomic_cas_ptr((void *volatile *)&stream->cold, cold)) {
+            srtp_crypto_free(cold);
+            cold = srtp_stream_cold(stream);
+        }
+    }
+
+    return cold;
+}
+
+/*
+ * srtp_stream_keep_policy(stream, policy) keeps a copy of the policy that
+ * stream was keyed from in its cold part, for srtp_session_export()
+ */
+static srtp_err_status_t srtp_stream_keep_policy(srtp_stream_ctx_t *stream,
+                                                 const srtp_policy_t policy)
+{
+    srtp_stream_cold_t *cold = srtp_stream_get_cold(stream);
+
+    if (cold == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    return srtp_policy_clone(policy, &cold->policy);
+}
+
+/* srtp_stream_rtcp_rdb(stream) is the SRTCP replay database of stream */
+srtp_rdb_t *srtp_stream_rtcp_rdb(srtp_stream_ctx_t *stream)
+{
+    srtp_stream_cold_t *cold = srtp_stream_get_cold(stream);
+
+    return cold != NULL ? &cold->rtcp_rdb : NULL;
+}
+
+/*
+ * srtp_stream_in_overlap(stream) returns true while stream also accepts
+ * the keys an update replaced
+ */
+static inline bool srtp_stream_in_overlap(const srtp_stream_ctx_t *stream)
+{
+    const srtp_stream_cold_t *cold = srtp_stream_cold(stream);
+
+    return cold != NULL && cold->overlap.previous != NULL;
+}
+
+/*
+ * srtp_stream_retire_previous(stream) ends a key overlap, deallocating
+ * the stream with the keys that stream replaced
+ */
+static void srtp_stream_retire_previous(srtp_stream_ctx_t *stream)
+{
+    srtp_key_overlap_t *overlap;
+
+    if (stream->cold == NULL) {
+        return;
+    }
+
+    overlap = &stream->cold->overlap;
+    if (overlap->previous != NULL) {
+        srtp_stream_dealloc(overlap->previous, overlap->previous_template);
+    }
+    srtp_crypto_free(overlap->scratch);
+    memset(overlap, 0, sizeof(*overlap));
+}
+
+/*
+ * srtp_stream_begin_overlap(stream, previous, previous_template, packets)
+ * lets stream accept the keys of previous, the stream it replaced, until
+ * packets packets were unprotected with its own keys
+ *
+ * if stream has no room for the overlap previous is deallocated, so that
+ * its keys are retired right away
+ */
+static srtp_err_status_t srtp_stream_begin_overlap(
+    srtp_stream_ctx_t *stream,
+    srtp_stream_ctx_t *previous,
+    const srtp_stream_ctx_t *previous_template,
+    size_t packets)
+{
+    srtp_stream_cold_t *cold;
+
+    srtp_stream_retire_previous(previous);
+    srtp_stream_retire_previous(stream);
+
+    cold = srtp_stream_get_cold(stream);
+    if (cold == NULL) {
+        srtp_stream_dealloc(previous, previous_template);
+        return srtp_err_status_alloc_fail;
+    }
+
+    cold->overlap.previous = previous;
+    cold->overlap.previous_template = previous_template;
+    cold->overlap.remaining = packets;
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_stats_count(ctx, stream, rtp, protect, status, len) counts a
+ * packet of len octets that stream processed and the error, if any,
+ * that it was rejected with; an accepted packet marks stream as used in
+ * the current epoch of ctx. SRTCP packets are counted apart, see
+ * srtp_stream_rtcp_t.
+ */
+static inline void srtp_stream_stats_count(const srtp_ctx_t *ctx,
+                                           srtp_stream_ctx_t *stream,
+                                           bool rtp,
+                                           bool protect,
+                                           srtp_err_status_t status,
+                                           size_t len)
+{
+    srtp_stream_stats_t *stats = rtp ? &stream->stats : &stream->rtcp.stats;
+
+    switch (status) {
+    case srtp_err_status_ok:
+        if (rtp) {
+            stream->last_used = ctx->epoch;
+        } else {
+            stream->rtcp.last_used = ctx->epoch;
+        }
+        if (rtp && protect) {
+            stats->rtp_packets_protected++;
+            stats->rtp_bytes_protected += len;
+        } else if (rtp) {
+            stats->rtp_packets_unprotected++;
+            stats->rtp_bytes_unprotected += len;
+        } else if (protect) {
+            stats->rtcp_packets_protected++;
+            stats->rtcp_bytes_protected += len;
+        } else {
+            stats->rtcp_packets_unprotected++;
+            stats->rtcp_bytes_unprotected += len;
+        }
+        break;
+    case srtp_err_status_auth_fail:
+        stats->auth_fail++;
+        SRTP_PROBE3(auth_fail, ntohl(stream->ssrc), rtp, len);
+        break;
+    case srtp_err_status_replay_fail:
+        stats->replay_fail++;
+        SRTP_PROBE3(replay_fail, ntohl(stream->ssrc), rtp, status);
+        break;
+    case srtp_err_status_replay_old:
+        stats->replay_old++;
+        SRTP_PROBE3(replay_fail, ntohl(stream->ssrc), rtp, status);
+        break;
+    case srtp_err_status_bad_mki:
+        stats->bad_mki++;
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * srtp_stream_get_counters(stream, stats) sets stats to the counters of
+ * all packets of stream, its ssrc is left to the caller
+ */
+void srtp_stream_get_counters(const srtp_stream_ctx_t *stream,
+                              srtp_stream_stats_t *stats)
+{
+    const srtp_stream_stats_t *rtcp = &stream->rtcp.stats;
+
+    *stats = stream->stats;
+    stats->rtcp_packets_protected += rtcp->rtcp_packets_protected;
+    stats->rtcp_bytes_protected += rtcp->rtcp_bytes_protected;
+    stats->rtcp_packets_unprotected += rtcp->rtcp_packets_unprotected;
+    stats->rtcp_bytes_unprotected += rtcp->rtcp_bytes_unprotected;
+    stats->auth_fail += rtcp->auth_fail;
+    stats->replay_fail += rtcp->replay_fail;
+    stats->replay_old += rtcp->replay_old;
+    stats->bad_mki += rtcp->bad_mki;
+}
+
+/*
+ * srtp_stream_last_used(ctx, stream) is the epoch of ctx in which the last
+ * packet of stream was accepted
+ */
+static uint32_t srtp_stream_last_used(const srtp_ctx_t *ctx,
+                                      const srtp_stream_ctx_t *stream)
+{
+    if (ctx->epoch - stream->rtcp.last_used < ctx->epoch - stream->last_used) {
+        return stream->rtcp.last_used;
+    }
+    return stream->last_used;
+}
+
 /* try to insert stream in list or deallocate it */
 static srtp_err_status_t srtp_insert_or_dealloc_stream(srtp_stream_list_t list,
                                                        srtp_stream_t stream,
@@ -523,9 +1022,16 @@ static srtp_err_status_t srtp_insert_or_dealloc_stream(srtp_stream_list_t list,
     return status;
 }
 
+/* see the stream list implementation at the end of this file */
+static srtp_err_status_t srtp_stream_list_reserve(srtp_stream_list_t list,
+                                                  size_t num);
+static void srtp_stream_list_drain(srtp_stream_list_t list,
+                                   bool (*callback)(srtp_stream_t, void *),
+                                   void *data);
+static size_t srtp_stream_list_memory_usage(srtp_stream_list_t list);
+
 struct remove_and_dealloc_streams_data {
     srtp_err_status_t status;
-    srtp_stream_list_t list;
     srtp_stream_t template;
 };
 
@@ -533,7 +1039,6 @@ static bool remove_and_dealloc_streams_cb(srtp_stream_t stream, void *data)
 {
     struct remove_and_dealloc_streams_data *d =
         (struct remove_and_dealloc_streams_data *)data;
-    srtp_stream_list_remove(d->list, stream);
     d->status = srtp_stream_dealloc(stream, d->template);
     if (d->status) {
         return false;
@@ -541,23 +1046,33 @@ static bool remove_and_dealloc_streams_cb(srtp_stream_t stream, void *data)
     return true;
 }
 
+/*
+ * srtp_remove_and_dealloc_streams(list, template) empties list in a
+ * single pass, deallocating its streams
+ */
 static srtp_err_status_t srtp_remove_and_dealloc_streams(
     srtp_stream_list_t list,
     srtp_stream_t template)
 {
-    struct remove_and_dealloc_streams_data data = { srtp_err_status_ok, list,
+    struct remove_and_dealloc_streams_data data = { srtp_err_status_ok,
                                                     template };
-    srtp_stream_list_for_each(list, remove_and_dealloc_streams_cb, &data);
+    srtp_stream_list_drain(list, remove_and_dealloc_streams_cb, &data);
     return data.status;
 }
 
-static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
-                                           const srtp_policy_t p)
+static srtp_err_status_t srtp_stream_alloc(
+    srtp_stream_ctx_t **str_ptr,
+    const srtp_policy_t p,
+    const srtp_stream_ctx_t *key_donor)
 {
     srtp_stream_ctx_t *str;
     srtp_err_status_t stat;
     size_t i = 0;
     srtp_session_keys_t *session_keys = NULL;
+    srtp_stream_layout_t layout;
+    size_t num_master_keys;
+    size_t window_size = p->window_size != 0 ? p->window_size : 128;
+    size_t max_window_size = 0;
 
     /*
      * This function allocates the stream context, rtp and rtcp ciphers
@@ -565,42 +1080,70 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
      * failure during allocation, we free all previously allocated
      * memory and return a failure code.  The code could probably
      * be improved, but it works and should be clear.
+     *
+     * If key_donor is set the ciphers, auth functions and key limits are
+     * left unset, srtp_stream_init() copies them from key_donor.
      */
 
-    /* allocate srtp stream and set str_ptr */
-    str = (srtp_stream_ctx_t *)srtp_crypto_alloc(sizeof(srtp_stream_ctx_t));
-    if (str == NULL) {
-        return srtp_err_status_alloc_fail;
-    }
-
-    *str_ptr = str;
-
     /*
      * To keep backwards API compatible if someone is using multiple master
      * keys then key should be set to NULL
      */
     if (p->num_master_keys > 0) {
-        str->num_master_keys = p->num_master_keys;
+        num_master_keys = p->num_master_keys;
     } else if (srtp_policy_is_null_cipher_null_auth(p)) {
         /* Protect/unprotect paths still require a runtime session key slot. */
-        str->num_master_keys = 1;
+        num_master_keys = 1;
     } else {
-        srtp_stream_dealloc(str, NULL);
         return srtp_err_status_bad_param;
     }
 
-    if (str->num_master_keys) {
-        str->session_keys = (srtp_session_keys_t *)srtp_crypto_alloc(
-            sizeof(srtp_session_keys_t) * str->num_master_keys);
+    /*
+     * streams cloned from an outbound template never receive, so they
+     * get the small sender window whatever the policy asks for
+     */
+    if (p->ssrc.type == ssrc_any_outbound) {
+        window_size = SRTP_RDBX_SENDER_WINDOW_SIZE;
+    } else if (p->adaptive_window &&
+               window_size > SRTP_RDBX_ADAPTIVE_WINDOW_SIZE) {
+        /* an adaptive window starts small and grows up to window_size */
+        max_window_size = window_size;
+        window_size = SRTP_RDBX_ADAPTIVE_WINDOW_SIZE;
+    }
 
-        if (str->session_keys == NULL) {
-            srtp_stream_dealloc(str, NULL);
-            return srtp_err_status_alloc_fail;
+    /*
+     * allocate srtp stream and set str_ptr, together with the memory it
+     * owns; srtp_stream_init() rejects an invalid window size, which then
+     * gets no room in the allocation
+     */
+    srtp_stream_layout(num_master_keys, p->mki_size, key_donor == NULL,
+                       p->enc_xtn_hdr_count,
+                       srtp_policy_is_valid_window_size(p->window_size)
+                           ? window_size
+                           : 0,
+                       &layout);
+    str = srtp_stream_alloc_block(&layout, num_master_keys, p->mki_size);
+    if (str == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    *str_ptr = str;
+
+    if (layout.bitmask) {
+        srtp_rdbx_init_in(&str->rtp_rdbx, window_size,
+                          (uint64_t *)((uint8_t *)str + layout.bitmask));
+        if (max_window_size != 0) {
+            srtp_rdbx_set_max_window_size(&str->rtp_rdbx, max_window_size);
         }
     }
+
     for (i = 0; i < str->num_master_keys; i++) {
         session_keys = &str->session_keys[i];
 
+        if (key_donor != NULL) {
+            continue;
+        }
+
         /* allocate cipher */
         stat = srtp_crypto_kernel_alloc_cipher(
             p->rtp.cipher_type, &session_keys->rtp_cipher,
@@ -640,31 +1183,21 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
             return stat;
         }
 
-        session_keys->mki_id = NULL;
-
-        /* allocate key limit structure */
-        session_keys->limit = (srtp_key_limit_ctx_t *)srtp_crypto_alloc(
-            sizeof(srtp_key_limit_ctx_t));
-        if (session_keys->limit == NULL) {
-            srtp_stream_dealloc(str, NULL);
-            return srtp_err_status_alloc_fail;
-        }
-    }
+    }
 
     if (p->enc_xtn_hdr_count > 0) {
         srtp_cipher_type_id_t enc_xtn_hdr_cipher_type;
         size_t enc_xtn_hdr_cipher_key_len;
 
-        str->enc_xtn_hdr = (uint8_t *)srtp_crypto_alloc(
-            p->enc_xtn_hdr_count * sizeof(p->enc_xtn_hdr[0]));
-        if (!str->enc_xtn_hdr) {
-            srtp_stream_dealloc(str, NULL);
-            return srtp_err_status_alloc_fail;
-        }
         memcpy(str->enc_xtn_hdr, p->enc_xtn_hdr,
                p->enc_xtn_hdr_count * sizeof(p->enc_xtn_hdr[0]));
         str->enc_xtn_hdr_count = p->enc_xtn_hdr_count;
 
+        for (i = 0; i < p->enc_xtn_hdr_count; i++) {
+            uint8_t id = p->enc_xtn_hdr[i];
+            str->enc_xtn_hdr_mask[id >> 3] |= (uint8_t)(1 << (id & 7));
+        }
+
         /*
          * For GCM ciphers, the corresponding ICM cipher is used for header
          * extensions encryption.
@@ -684,7 +1217,7 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
             break;
         }
 
-        for (i = 0; i < str->num_master_keys; i++) {
+        for (i = 0; key_donor == NULL && i < str->num_master_keys; i++) {
             session_keys = &str->session_keys[i];
 
             /* allocate cipher for extensions header encryption */
@@ -703,6 +1236,7 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
         }
 
         str->enc_xtn_hdr = NULL;
+        str->enc_xtn_hdr_mask = NULL;
         str->enc_xtn_hdr_count = 0;
     }
 
@@ -712,17 +1246,254 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
 }
 
 /*
- * srtp_stream_clone(stream_template, new) allocates a new stream and
- * initializes it using the cipher and auth of the stream_template
+ * srtp_stream_clone_alloc(num_master_keys, mki_size, window_size, new)
+ * allocates the memory a stream cloned from a template with the given
+ * number of master keys, MKI size and replay window size owns, leaving
+ * the cipher, auth and key limit pointers unset
+ */
+static srtp_err_status_t srtp_stream_clone_alloc(size_t num_master_keys,
+                                                 size_t mki_size,
+                                                 size_t window_size,
+                                                 srtp_stream_ctx_t **str_ptr)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *str;
+    srtp_stream_layout_t layout;
+
+    /*
+     * allocate srtp stream and set str_ptr, together with its MKI ids and
+     * replay database
+     */
+    srtp_stream_layout(num_master_keys, mki_size, false, 0, window_size,
+                       &layout);
+    str = srtp_stream_alloc_block(&layout, num_master_keys, mki_size);
+    if (str == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    str->mki_size = (uint8_t)mki_size;
+
+    status = srtp_rdbx_init_in(&str->rtp_rdbx, window_size,
+                               (uint64_t *)((uint8_t *)str + layout.bitmask));
+    if (status) {
+        srtp_stream_dealloc(str, NULL);
+        return status;
+    }
+
+    *str_ptr = str;
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_pool_matches(pool, stream_template) returns true if the
+ * streams in the pool can be used as clones of stream_template
+ */
+static bool srtp_stream_pool_matches(const srtp_stream_pool_t *pool,
+                                     const srtp_stream_ctx_t *stream_template)
+{
+    return pool->capacity != 0 && stream_template != NULL &&
+           pool->num_master_keys == stream_template->num_master_keys &&
+           pool->mki_size == stream_template->mki_size &&
+           pool->window_size ==
+               srtp_rdbx_get_window_size(&stream_template->rtp_rdbx);
+}
+
+/*
+ * srtp_stream_pool_get(pool, stream_template) takes a free stream that
+ * fits stream_template from the pool, or returns NULL if there is none
+ */
+static srtp_stream_ctx_t *srtp_stream_pool_get(
+    srtp_stream_pool_t *pool,
+    const srtp_stream_ctx_t *stream_template)
+{
+    if (pool->count == 0 || !srtp_stream_pool_matches(pool, stream_template)) {
+        return NULL;
+    }
+
+    return pool->streams[--pool->count];
+}
+
+/*
+ * srtp_stream_pool_put(pool, stream_template, stream) returns a stream
+ * cloned from stream_template to the pool, wiping its keying material.
+ * Returns false, leaving the stream untouched, if the pool is full or the
+ * stream is not a clone that fits the pool.
+ */
+static bool srtp_stream_pool_put(srtp_stream_pool_t *pool,
+                                 const srtp_stream_ctx_t *stream_template,
+                                 srtp_stream_ctx_t *stream)
+{
+    if (pool->count == pool->capacity ||
+        !srtp_stream_pool_matches(pool, stream_template) ||
+        stream->num_master_keys != pool->num_master_keys ||
+        stream->mki_size != pool->mki_size ||
+        srtp_rdbx_get_window_size(&stream->rtp_rdbx) != pool->window_size ||
+        stream->session_keys[0].rtp_auth !=
+            stream_template->session_keys[0].rtp_auth) {
+        return false;
+    }
+
+    srtp_stream_retire_previous(stream);
+    if (stream->cold != NULL) {
+        srtp_crypto_free(stream->cold->iov_scratch);
+        srtp_keystream_cache_free(stream->cold->keystream);
+        srtp_crypto_free(stream->cold);
+        stream->cold = NULL;
+    }
+
+    /*
+     * the cipher, auth and key limit are those of the template, clear
+     * them so that freeing the pool later does not touch the template
+     */
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        srtp_session_keys_t *session_keys = &stream->session_keys[i];
+
+        session_keys->rtp_cipher = NULL;
+        session_keys->rtp_auth = NULL;
+        session_keys->rtp_xtn_hdr_cipher = NULL;
+        session_keys->rtcp_cipher = NULL;
+        session_keys->rtcp_auth = NULL;
+        session_keys->limit = NULL;
+        session_keys->pending = NULL;
+        session_keys->rtcp_pending = false;
+        session_keys->xtn_hdr_pending = false;
+        octet_string_set_to_zero(session_keys->salt, SRTP_AEAD_SALT_LEN);
+        octet_string_set_to_zero(session_keys->c_salt, SRTP_AEAD_SALT_LEN);
+        v128_set_to_zero(&session_keys->aead_iv_base);
+        v128_set_to_zero(&session_keys->c_aead_iv_base);
+        if (session_keys->mki_id) {
+            octet_string_set_to_zero(session_keys->mki_id, stream->mki_size);
+        }
+    }
+    stream->enc_xtn_hdr = NULL;
+    stream->enc_xtn_hdr_mask = NULL;
+    stream->mki_map = NULL;
+
+    pool->streams[pool->count++] = stream;
+    return true;
+}
+
+/*
+ * srtp_stream_pool_dealloc(pool) frees all streams in the pool and the
+ * pool itself
+ */
+static void srtp_stream_pool_dealloc(srtp_stream_pool_t *pool)
+{
+    while (pool->count > 0) {
+        srtp_stream_dealloc(pool->streams[--pool->count], NULL);
+    }
+
+    if (pool->streams) {
+        srtp_crypto_free(pool->streams);
+    }
+    pool->streams = NULL;
+    pool->capacity = 0;
+}
+
+/*
+ * srtp_stream_pool_setup(pool, stream_template, num_streams) makes the
+ * pool hold num_streams free streams that fit stream_template, dropping
+ * any streams that were allocated for a template of a different shape
+ */
+static srtp_err_status_t srtp_stream_pool_setup(
+    srtp_stream_pool_t *pool,
+    const srtp_stream_ctx_t *stream_template,
+    size_t num_streams)
+{
+    if (!srtp_stream_pool_matches(pool, stream_template) ||
+        pool->capacity != num_streams) {
+        srtp_stream_pool_dealloc(pool);
+    }
+
+    if (num_streams == 0) {
+        return srtp_err_status_ok;
+    }
+
+    if (pool->streams == NULL) {
+        if (num_streams > SIZE_MAX / sizeof(srtp_stream_ctx_t *)) {
+            return srtp_err_status_bad_param;
+        }
+        pool->streams = (srtp_stream_ctx_t **)srtp_crypto_alloc(
+            sizeof(srtp_stream_ctx_t *) * num_streams);
+        if (pool->streams == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+        pool->capacity = num_streams;
+        pool->num_master_keys = stream_template->num_master_keys;
+        pool->mki_size = stream_template->mki_size;
+        pool->window_size =
+            srtp_rdbx_get_window_size(&stream_template->rtp_rdbx);
+    }
+
+    while (pool->count < pool->capacity) {
+        srtp_err_status_t status = srtp_stream_clone_alloc(
+            pool->num_master_keys, pool->mki_size, pool->window_size,
+            &pool->streams[pool->count]);
+        if (status) {
+            srtp_stream_pool_dealloc(pool);
+            return status;
+        }
+        pool->count++;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_iv_xor_ssrc(iv, ssrc) xors ssrc, in network order, into octets 2
+ * to 5 of iv, where RFC 7714 places the SSRC for both SRTP and SRTCP
+ */
+static inline void srtp_iv_xor_ssrc(v128_t *iv, uint32_t ssrc)
+{
+    uint8_t octets[4];
+
+    memcpy(octets, &ssrc, sizeof(octets));
+    for (size_t i = 0; i < sizeof(octets); i++) {
+        iv->v8[2 + i] ^= octets[i];
+    }
+}
+
+/*
+ * srtp_iv_base_init(iv_base, salt, ssrc) sets iv_base to salt xor'ed
+ * with ssrc
+ */
+static void srtp_iv_base_init(v128_t *iv_base,
+                              const uint8_t *salt,
+                              uint32_t ssrc)
+{
+    v128_set_to_zero(iv_base);
+    memcpy(iv_base->v8, salt, SRTP_AEAD_SALT_LEN);
+    srtp_iv_xor_ssrc(iv_base, ssrc);
+}
+
+/*
+ * srtp_session_keys_set_iv_base(session_keys, ssrc) precomputes the part
+ * of the AEAD IVs that does not change from packet to packet, the salt
+ * xor'ed with the SSRC; the packet index is added by srtp_calc_aead_iv()
+ * and srtp_calc_aead_iv_srtcp()
+ */
+static void srtp_session_keys_set_iv_base(srtp_session_keys_t *session_keys,
+                                          uint32_t ssrc)
+{
+    srtp_iv_base_init(&session_keys->aead_iv_base, session_keys->salt, ssrc);
+    srtp_iv_base_init(&session_keys->c_aead_iv_base, session_keys->c_salt,
+                      ssrc);
+    session_keys->iv_base_ssrc = ssrc;
+}
+
+/*
+ * srtp_stream_clone(pool, stream_template, ssrc, new) initializes a new
+ * stream using the cipher and auth of the stream_template, taking it
+ * from the pool if possible and allocating it otherwise
  *
  * the only unique data in a cloned stream is the replay database and
  * the SSRC
  */
 
-static srtp_err_status_t srtp_stream_clone(
-    const srtp_stream_ctx_t *stream_template,
-    uint32_t ssrc,
-    srtp_stream_ctx_t **str_ptr)
+srtp_err_status_t srtp_stream_clone(srtp_stream_pool_t *pool,
+                                    const srtp_stream_ctx_t *stream_template,
+                                    uint32_t ssrc,
+                                    srtp_stream_ctx_t **str_ptr)
 {
     srtp_err_status_t status;
     srtp_stream_ctx_t *str;
@@ -732,23 +1503,20 @@ static srtp_err_status_t srtp_stream_clone(
     debug_print(mod_srtp, "cloning stream (SSRC: 0x%08x)",
                 (unsigned int)ntohl(ssrc));
 
-    /* allocate srtp stream and set str_ptr */
-    str = (srtp_stream_ctx_t *)srtp_crypto_alloc(sizeof(srtp_stream_ctx_t));
+    str = srtp_stream_pool_get(pool, stream_template);
     if (str == NULL) {
-        return srtp_err_status_alloc_fail;
+        status = srtp_stream_clone_alloc(
+            stream_template->num_master_keys, stream_template->mki_size,
+            srtp_rdbx_get_window_size(&stream_template->rtp_rdbx), &str);
+        if (status) {
+            SRTP_PROBE2(stream_clone, ntohl(ssrc), status);
+            return status;
+        }
+    } else {
+        srtp_rdbx_reset(&str->rtp_rdbx);
     }
     *str_ptr = str;
 
-    str->num_master_keys = stream_template->num_master_keys;
-    str->session_keys = (srtp_session_keys_t *)srtp_crypto_alloc(
-        sizeof(srtp_session_keys_t) * str->num_master_keys);
-
-    if (str->session_keys == NULL) {
-        srtp_stream_dealloc(*str_ptr, stream_template);
-        *str_ptr = NULL;
-        return srtp_err_status_alloc_fail;
-    }
-
     for (size_t i = 0; i < stream_template->num_master_keys; i++) {
         session_keys = &str->session_keys[i];
         template_session_keys = &stream_template->session_keys[i];
@@ -761,16 +1529,12 @@ static srtp_err_status_t srtp_stream_clone(
         session_keys->rtcp_cipher = template_session_keys->rtcp_cipher;
         session_keys->rtcp_auth = template_session_keys->rtcp_auth;
 
-        if (stream_template->mki_size == 0) {
-            session_keys->mki_id = NULL;
-        } else {
-            session_keys->mki_id = srtp_crypto_alloc(stream_template->mki_size);
+        /* and the keys the template has not derived yet */
+        session_keys->pending = template_session_keys->pending;
+        session_keys->rtcp_pending = template_session_keys->rtcp_pending;
+        session_keys->xtn_hdr_pending = template_session_keys->xtn_hdr_pending;
 
-            if (session_keys->mki_id == NULL) {
-                srtp_stream_dealloc(*str_ptr, stream_template);
-                *str_ptr = NULL;
-                return srtp_err_status_init_fail;
-            }
+        if (stream_template->mki_size != 0) {
             memcpy(session_keys->mki_id, template_session_keys->mki_id,
                    stream_template->mki_size);
         }
@@ -786,29 +1550,40 @@ static srtp_err_status_t srtp_stream_clone(
         if (status) {
             srtp_stream_dealloc(*str_ptr, stream_template);
             *str_ptr = NULL;
+            SRTP_PROBE2(stream_clone, ntohl(ssrc), status);
             return status;
         }
     }
 
     str->use_mki = stream_template->use_mki;
-    str->mki_size = stream_template->mki_size;
+    str->mki_map = stream_template->mki_map;
+    str->mki_map_mask = stream_template->mki_map_mask;
 
-    /* initialize replay databases */
-    status = srtp_rdbx_init(
-        &str->rtp_rdbx, srtp_rdbx_get_window_size(&stream_template->rtp_rdbx));
+    str->rtcp_window_size = stream_template->rtcp_window_size;
+    str->allow_repeat_tx = stream_template->allow_repeat_tx;
+
+    /* the replay window adapts like that of the template */
+    status = srtp_rdbx_set_max_window_size(
+        &str->rtp_rdbx,
+        srtp_rdbx_get_max_window_size(&stream_template->rtp_rdbx));
     if (status) {
         srtp_stream_dealloc(*str_ptr, stream_template);
         *str_ptr = NULL;
+        SRTP_PROBE2(stream_clone, ntohl(ssrc), status);
         return status;
     }
-    srtp_rdb_init(&str->rtcp_rdb);
-    str->allow_repeat_tx = stream_template->allow_repeat_tx;
 
     /* set ssrc to that provided */
     str->ssrc = ssrc;
+    for (size_t i = 0; i < str->num_master_keys; i++) {
+        srtp_session_keys_set_iv_base(&str->session_keys[i], ssrc);
+    }
 
-    /* reset pending ROC */
+    /* reset pending ROC and the counters of a pooled stream */
     str->pending_roc = 0;
+    str->queued_events = 0;
+    memset(&str->stats, 0, sizeof(str->stats));
+    memset(&str->rtcp, 0, sizeof(str->rtcp));
 
     /* set direction and security services */
     str->direction = stream_template->direction;
@@ -818,7 +1593,13 @@ static srtp_err_status_t srtp_stream_clone(
     /* copy information about extensions header encryption */
     str->enc_xtn_hdr = stream_template->enc_xtn_hdr;
     str->enc_xtn_hdr_count = stream_template->enc_xtn_hdr_count;
+    str->enc_xtn_hdr_mask = stream_template->enc_xtn_hdr_mask;
     str->use_cryptex = stream_template->use_cryptex;
+    str->protect_rtp = stream_template->protect_rtp;
+    str->unprotect_rtp = stream_template->unprotect_rtp;
+    str->from_template = true;
+    str->key_generation = stream_template->key_generation;
+    SRTP_PROBE2(stream_clone, ntohl(ssrc), srtp_err_status_ok);
     return srtp_err_status_ok;
 }
 
@@ -835,6 +1616,11 @@ static srtp_err_status_t srtp_stream_clone(
  * of the key in octets is provided as keylen.  this function
  * should be called once for each subkey that is derived.
  *
+ * srtp_kdf_generate_all(&kdf, outputs, n) derives the n keys described by
+ * outputs. With the internal crypto this is done in one pass over all of
+ * their counter blocks and is the only way to derive keys, otherwise it
+ * calls srtp_kdf_generate() for each key.
+ *
  * srtp_kdf_clear(&kdf) zeroizes and deallocates the kdf state
  */
 
@@ -849,6 +1635,15 @@ typedef enum {
     label_rtp_header_salt = 0x07
 } srtp_prf_label;
 
+/*
+ * srtp_kdf_output_t is one key for srtp_kdf_generate_all()
+ */
+typedef struct {
+    srtp_prf_label label;
+    uint8_t *key;
+    size_t length;
+} srtp_kdf_output_t;
+
 #define MAX_SRTP_KEY_LEN 256
 
 #if defined(OPENSSL) && defined(OPENSSL_KDF)
@@ -1017,7 +1812,129 @@ static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf)
     return srtp_err_status_ok;
 }
 
-#else  /* if OPENSSL_KDF || WOLFSSL_KDF */
+#elif !defined(OPENSSL) && !defined(WOLFSSL) && !defined(MBEDTLS) &&          \
+    !defined(NSS) && !defined(CNG) && !defined(COMMONCRYPTO)
+
+#define SRTP_KDF_ONE_PASS 1
+
+/* counter blocks encrypted together by srtp_kdf_generate_all() */
+#define SRTP_KDF_BLOCKS 16
+
+/*
+ * srtp_kdf_t represents a key derivation function.  The SRTP
+ * default KDF is the only one implemented at present.
+ *
+ * With the internal crypto the KDF is AES in counter mode, computed
+ * directly from a key schedule held in the srtp_kdf_t itself, so that
+ * keying a stream, which keeps its srtp_kdf_t on the stack, allocates
+ * nothing for the KDF.
+ */
+typedef struct {
+    srtp_aes_expanded_key_t key; /* the master key schedule          */
+    v128_t salt;                 /* the master salt, zero padded     */
+} srtp_kdf_t;
+
+static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf,
+                                       const uint8_t *key,
+                                       size_t key_len)
+{
+    srtp_err_status_t stat;
+    size_t base_key_len;
+
+    switch (key_len) {
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+    case SRTP_AES_ICM_192_KEY_LEN_WSALT:
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+        base_key_len = key_len - SRTP_SALT_LEN;
+        break;
+    default:
+        return srtp_err_status_bad_param;
+        break;
+    }
+
+    stat = srtp_aes_expand_encryption_key(key, base_key_len, &kdf->key);
+    if (stat) {
+        octet_string_set_to_zero(kdf, sizeof(srtp_kdf_t));
+        return stat;
+    }
+
+    /* as for srtp_aes_icm, the last two octets are the block counter */
+    v128_set_to_zero(&kdf->salt);
+    memcpy(&kdf->salt, key + base_key_len, SRTP_SALT_LEN);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_kdf_flush() encrypts num_blocks counter blocks and copies each to
+ * its key
+ */
+static void srtp_kdf_flush(const srtp_kdf_t *kdf,
+                           v128_t *blocks,
+                           uint8_t *const *dst,
+                           const size_t *dst_len,
+                           size_t num_blocks)
+{
+    srtp_aes_encrypt_blocks(blocks, num_blocks, &kdf->key);
+    for (size_t i = 0; i < num_blocks; i++) {
+        memcpy(dst[i], &blocks[i], dst_len[i]);
+    }
+}
+
+static srtp_err_status_t srtp_kdf_generate_all(srtp_kdf_t *kdf,
+                                               const srtp_kdf_output_t *outputs,
+                                               size_t num_outputs)
+{
+    v128_t blocks[SRTP_KDF_BLOCKS];
+    uint8_t *dst[SRTP_KDF_BLOCKS];
+    size_t dst_len[SRTP_KDF_BLOCKS];
+    size_t num_blocks = 0;
+
+    /*
+     * the keystream block i of label l is the encryption of the salt with
+     * l added into its eighth octet and i in its last two, the blocks of
+     * all the keys are collected and encrypted together
+     */
+    for (size_t i = 0; i < num_outputs; i++) {
+        const srtp_kdf_output_t *out = &outputs[i];
+
+        if (out->length > (size_t)0xffff * sizeof(v128_t)) {
+            octet_string_set_to_zero(blocks, sizeof(blocks));
+            return srtp_err_status_terminus;
+        }
+
+        for (size_t offset = 0; offset < out->length;
+             offset += sizeof(v128_t)) {
+            uint16_t index = (uint16_t)(offset / sizeof(v128_t));
+            size_t len = out->length - offset;
+
+            v128_copy(&blocks[num_blocks], &kdf->salt);
+            blocks[num_blocks].v8[7] ^= (uint8_t)out->label;
+            blocks[num_blocks].v16[7] = htons(index);
+            dst[num_blocks] = out->key + offset;
+            dst_len[num_blocks] = len < sizeof(v128_t) ? len : sizeof(v128_t);
+
+            if (++num_blocks == SRTP_KDF_BLOCKS) {
+                srtp_kdf_flush(kdf, blocks, dst, dst_len, num_blocks);
+                num_blocks = 0;
+            }
+        }
+    }
+    srtp_kdf_flush(kdf, blocks, dst, dst_len, num_blocks);
+
+    octet_string_set_to_zero(blocks, sizeof(blocks));
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf)
+{
+    octet_string_set_to_zero(kdf, sizeof(srtp_kdf_t));
+
+    return srtp_err_status_ok;
+}
+
+#else /* if OPENSSL_KDF || WOLFSSL_KDF || internal crypto */
 
 /*
  * srtp_kdf_t represents a key derivation function.  The SRTP
@@ -1100,12 +2017,63 @@ static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf)
     kdf->cipher = NULL;
     return srtp_err_status_ok;
 }
-#endif /* else OPENSSL_KDF || WOLFSSL_KDF */
+#endif /* else OPENSSL_KDF || WOLFSSL_KDF || internal crypto */
+
+#ifndef SRTP_KDF_ONE_PASS
+static srtp_err_status_t srtp_kdf_generate_all(srtp_kdf_t *kdf,
+                                               const srtp_kdf_output_t *outputs,
+                                               size_t num_outputs)
+{
+    srtp_err_status_t status;
+
+    for (size_t i = 0; i < num_outputs; i++) {
+        status = srtp_kdf_generate(kdf, outputs[i].label, outputs[i].key,
+                                   outputs[i].length);
+        if (status) {
+            return status;
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+#endif
 
 /*
  *  end of key derivation functions
  */
 
+/* Whether the cipher is an AEAD cipher, constant when the build has no
+ * AEAD profile so that the AEAD paths fold away. */
+static inline bool srtp_cipher_is_aead(const srtp_cipher_t *c)
+{
+#if defined(GCM) && !defined(SRTP_NO_AES_256)
+    return c->algorithm == SRTP_AES_GCM_128 ||
+           c->algorithm == SRTP_AES_GCM_256;
+#elif defined(GCM)
+    return c->algorithm == SRTP_AES_GCM_128;
+#else
+    (void)c;
+    return false;
+#endif
+}
+
+/* Whether the cipher is AES counter mode, of any key size built in. */
+static inline bool srtp_cipher_is_icm(const srtp_cipher_t *c)
+{
+    switch (c->type->id) {
+    case SRTP_AES_ICM_128:
+#ifndef SRTP_NO_AES_192
+    case SRTP_AES_ICM_192:
+#endif
+#ifndef SRTP_NO_AES_256
+    case SRTP_AES_ICM_256:
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
 /* Get the base key length corresponding to a given combined key+salt
  * length for the given cipher.
  * TODO: key and salt lengths should be separate fields in the policy.  */
@@ -1190,38 +2158,31 @@ void srtp_inject_mki(uint8_t *mki_tag_location,
     }
 }
 
-srtp_err_status_t srtp_stream_init_keys(srtp_session_keys_t *session_keys,
-                                        const srtp_master_key_t *master_key,
-                                        size_t mki_size)
+/*
+ * srtp_derived_keys_t holds the keys srtp_stream_init_keys() derives from
+ * a master key before they are used to key the ciphers and auths
+ */
+typedef struct {
+    uint8_t rtp[MAX_SRTP_KEY_LEN]; /* rtp key followed by its salt    */
+    uint8_t rtp_xtn_hdr[MAX_SRTP_KEY_LEN];
+    uint8_t rtp_auth[MAX_SRTP_KEY_LEN];
+    uint8_t rtcp[MAX_SRTP_KEY_LEN]; /* rtcp key followed by its salt */
+    uint8_t rtcp_auth[MAX_SRTP_KEY_LEN];
+} srtp_derived_keys_t;
+
+/* the keys srtp_session_keys_derive() can derive */
+#define SRTP_DERIVE_RTP 0x1
+#define SRTP_DERIVE_XTN_HDR 0x2
+#define SRTP_DERIVE_RTCP 0x4
+
+/*
+ * srtp_session_keys_master_key_len(session_keys) returns the length of
+ * the master key and salt that the keys of session_keys are derived from
+ */
+static size_t srtp_session_keys_master_key_len(
+    const srtp_session_keys_t *session_keys)
 {
-    srtp_err_status_t stat;
-    srtp_kdf_t kdf;
-    uint8_t tmp_key[MAX_SRTP_KEY_LEN];
     size_t input_keylen, full_keylen;
-    size_t kdf_keylen = 30, rtp_keylen, rtcp_keylen;
-    size_t rtp_base_key_len, rtp_salt_len;
-    size_t rtcp_base_key_len, rtcp_salt_len;
-
-    /* If RTP or RTCP have a key length > AES-128, assume matching kdf. */
-    /* TODO: kdf algorithm, master key length, and master salt length should
-     * be part of srtp_policy_t.
-     */
-
-    /* initialize key limit to maximum value */
-    srtp_key_limit_set(session_keys->limit, 0xffffffffffffLL);
-
-    if (mki_size != 0) {
-        if (master_key->mki_id_len == 0 || master_key->mki_id_len != mki_size) {
-            return srtp_err_status_bad_param;
-        }
-        session_keys->mki_id = srtp_crypto_alloc(mki_size);
-        if (session_keys->mki_id == NULL) {
-            return srtp_err_status_init_fail;
-        }
-        memcpy(session_keys->mki_id, master_key->mki_id, mki_size);
-    } else {
-        session_keys->mki_id = NULL;
-    }
 
     /* Find the maximum key length */
     input_keylen = full_key_length(session_keys->rtp_cipher->type);
@@ -1238,6 +2199,48 @@ srtp_err_status_t srtp_stream_init_keys(srtp_session_keys_t *session_keys,
         input_keylen = full_keylen;
     }
 
+    return input_keylen;
+}
+
+/*
+ * srtp_session_keys_derive(session_keys, master_key, which, salt, c_salt)
+ * derives the keys selected by which from master_key and keys the
+ * ciphers and auths of session_keys with them; the SRTP salt is stored
+ * in salt and the SRTCP salt in c_salt, either may be NULL if its keys
+ * are not selected
+ */
+static srtp_err_status_t srtp_session_keys_derive(
+    const srtp_session_keys_t *session_keys,
+    const uint8_t *master_key,
+    unsigned int which,
+    uint8_t *salt,
+    uint8_t *c_salt)
+{
+    srtp_err_status_t stat = srtp_err_status_ok;
+    srtp_kdf_t kdf;
+    srtp_kdf_t xtn_hdr_kdf;
+    bool separate_xtn_hdr_kdf = false;
+    uint8_t tmp_key[MAX_SRTP_KEY_LEN];
+    uint8_t tmp_xtn_hdr_key[MAX_SRTP_KEY_LEN];
+    srtp_derived_keys_t keys;
+    srtp_kdf_output_t outputs[8];
+    srtp_kdf_output_t xtn_hdr_outputs[2];
+    size_t num_outputs = 0, num_xtn_hdr_outputs;
+    size_t input_keylen;
+    size_t kdf_keylen = 30, rtp_keylen, rtcp_keylen;
+    size_t rtp_base_key_len, rtp_salt_len;
+    size_t rtcp_base_key_len, rtcp_salt_len;
+    size_t rtp_xtn_hdr_keylen;
+    size_t rtp_xtn_hdr_base_key_len = 0, rtp_xtn_hdr_salt_len = 0;
+    size_t rtp_auth_keylen, rtcp_auth_keylen;
+
+    /* If RTP or RTCP have a key length > AES-128, assume matching kdf. */
+    /* TODO: kdf algorithm, master key length, and master salt length should
+     * be part of srtp_policy_t.
+     */
+
+    input_keylen = srtp_session_keys_master_key_len(session_keys);
+
     rtp_keylen = srtp_cipher_get_key_length(session_keys->rtp_cipher);
     rtcp_keylen = srtp_cipher_get_key_length(session_keys->rtcp_cipher);
     rtp_base_key_len =
@@ -1284,71 +2287,34 @@ srtp_err_status_t srtp_stream_init_keys(srtp_session_keys_t *session_keys,
      * the legacy CTR mode KDF, which uses a 112 bit master SALT.
      */
     memset(tmp_key, 0x0, MAX_SRTP_KEY_LEN);
-    memcpy(tmp_key, master_key->key, input_keylen);
-
-/* initialize KDF state     */
-#if defined(OPENSSL) && defined(OPENSSL_KDF)
-    stat = srtp_kdf_init(&kdf, tmp_key, rtp_base_key_len, rtp_salt_len);
-#else
-    stat = srtp_kdf_init(&kdf, tmp_key, kdf_keylen);
-#endif
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
-    }
+    memcpy(tmp_key, master_key, input_keylen);
 
-    /* generate encryption key  */
-    stat = srtp_kdf_generate(&kdf, label_rtp_encryption, tmp_key,
-                             rtp_base_key_len);
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
-    }
-    debug_print(mod_srtp, "cipher key: %s",
-                srtp_octet_string_hex_string(tmp_key, rtp_base_key_len));
+    rtcp_base_key_len =
+        base_key_length(session_keys->rtcp_cipher->type, rtcp_keylen);
+    rtcp_salt_len = rtcp_keylen - rtcp_base_key_len;
+    rtp_auth_keylen = srtp_auth_get_key_length(session_keys->rtp_auth);
+    rtcp_auth_keylen = srtp_auth_get_key_length(session_keys->rtcp_auth);
+    debug_print(mod_srtp, "rtcp salt len: %zu", rtcp_salt_len);
 
     /*
-     * if the cipher in the srtp context uses a salt, then we need
-     * to generate the salt value
+     * every key is derived into a buffer of its own, so that all of them
+     * can be derived before any cipher or auth is keyed; a cipher's salt
+     * is put after its key
      */
-    if (rtp_salt_len > 0) {
-        debug_print0(mod_srtp, "found rtp_salt_len > 0, generating salt");
-
-        /* generate encryption salt, put after encryption key */
-        stat = srtp_kdf_generate(&kdf, label_rtp_salt,
-                                 tmp_key + rtp_base_key_len, rtp_salt_len);
-        if (stat) {
-            /* zeroize temp buffer */
-            octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-            return srtp_err_status_init_fail;
+    memset(&keys, 0x0, sizeof(keys));
+    if (which & SRTP_DERIVE_RTP) {
+        outputs[num_outputs++] = (srtp_kdf_output_t){ label_rtp_encryption,
+                                                      keys.rtp,
+                                                      rtp_base_key_len };
+        if (rtp_salt_len > 0) {
+            debug_print0(mod_srtp, "found rtp_salt_len > 0, generating salt");
+            outputs[num_outputs++] = (srtp_kdf_output_t){
+                label_rtp_salt, keys.rtp + rtp_base_key_len, rtp_salt_len
+            };
         }
-        memcpy(session_keys->salt, tmp_key + rtp_base_key_len,
-               SRTP_AEAD_SALT_LEN);
-    }
-    if (rtp_salt_len > 0) {
-        debug_print(mod_srtp, "cipher salt: %s",
-                    srtp_octet_string_hex_string(tmp_key + rtp_base_key_len,
-                                                 rtp_salt_len));
     }
 
-    /* initialize cipher */
-    stat = srtp_cipher_init(session_keys->rtp_cipher, tmp_key);
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
-    }
-
-    if (session_keys->rtp_xtn_hdr_cipher) {
-        /* generate extensions header encryption key  */
-        size_t rtp_xtn_hdr_keylen;
-        size_t rtp_xtn_hdr_base_key_len;
-        size_t rtp_xtn_hdr_salt_len;
-        srtp_kdf_t tmp_kdf;
-        srtp_kdf_t *xtn_hdr_kdf;
-
+    if ((which & SRTP_DERIVE_XTN_HDR) && session_keys->rtp_xtn_hdr_cipher) {
         if (session_keys->rtp_xtn_hdr_cipher->type !=
             session_keys->rtp_cipher->type) {
             /*
@@ -1356,7 +2322,6 @@ srtp_err_status_t srtp_stream_init_keys(srtp_session_keys_t *session_keys,
              * the corresponding ICM cipher.
              * See https://tools.ietf.org/html/rfc7714#section-8.3
              */
-            uint8_t tmp_xtn_hdr_key[MAX_SRTP_KEY_LEN];
             rtp_xtn_hdr_keylen =
                 srtp_cipher_get_key_length(session_keys->rtp_xtn_hdr_cipher);
             rtp_xtn_hdr_base_key_len = base_key_length(
@@ -1380,252 +2345,635 @@ srtp_err_status_t srtp_stream_init_keys(srtp_session_keys_t *session_keys,
                 }
             }
             memset(tmp_xtn_hdr_key, 0x0, MAX_SRTP_KEY_LEN);
-            memcpy(tmp_xtn_hdr_key, master_key->key,
+            memcpy(tmp_xtn_hdr_key, master_key,
                    (rtp_xtn_hdr_base_key_len + rtp_xtn_hdr_salt_len));
-            xtn_hdr_kdf = &tmp_kdf;
 
-/* initialize KDF state */
-#if defined(OPENSSL) && defined(OPENSSL_KDF)
-            stat =
-                srtp_kdf_init(xtn_hdr_kdf, tmp_xtn_hdr_key,
-                              rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len);
-#else
-            stat = srtp_kdf_init(xtn_hdr_kdf, tmp_xtn_hdr_key, kdf_keylen);
-#endif
-            octet_string_set_to_zero(tmp_xtn_hdr_key, MAX_SRTP_KEY_LEN);
-            if (stat) {
-                /* zeroize temp buffer */
-                octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-                return srtp_err_status_init_fail;
-            }
+            /*
+             * the KDF of the header extension keys only needs a state of
+             * its own if it is keyed differently from the main one
+             */
+            separate_xtn_hdr_kdf =
+                rtp_xtn_hdr_base_key_len != rtp_base_key_len ||
+                rtp_xtn_hdr_salt_len != rtp_salt_len ||
+                !srtp_octet_string_equal(tmp_xtn_hdr_key, tmp_key,
+                                         MAX_SRTP_KEY_LEN);
         } else {
             /* Reuse main KDF. */
-            rtp_xtn_hdr_keylen = rtp_keylen;
             rtp_xtn_hdr_base_key_len = rtp_base_key_len;
             rtp_xtn_hdr_salt_len = rtp_salt_len;
-            xtn_hdr_kdf = &kdf;
         }
 
-        stat = srtp_kdf_generate(xtn_hdr_kdf, label_rtp_header_encryption,
-                                 tmp_key, rtp_xtn_hdr_base_key_len);
-        if (stat) {
-            /* zeroize temp buffer */
-            octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-            return srtp_err_status_init_fail;
-        }
-        debug_print(
-            mod_srtp, "extensions cipher key: %s",
-            srtp_octet_string_hex_string(tmp_key, rtp_xtn_hdr_base_key_len));
-
-        /*
-         * if the cipher in the srtp context uses a salt, then we need
-         * to generate the salt value
-         */
+        xtn_hdr_outputs[0] = (srtp_kdf_output_t){ label_rtp_header_encryption,
+                                                  keys.rtp_xtn_hdr,
+                                                  rtp_xtn_hdr_base_key_len };
+        num_xtn_hdr_outputs = 1;
         if (rtp_xtn_hdr_salt_len > 0) {
             debug_print0(mod_srtp,
                          "found rtp_xtn_hdr_salt_len > 0, generating salt");
+            xtn_hdr_outputs[num_xtn_hdr_outputs++] = (srtp_kdf_output_t){
+                label_rtp_header_salt,
+                keys.rtp_xtn_hdr + rtp_xtn_hdr_base_key_len,
+                rtp_xtn_hdr_salt_len
+            };
+        }
 
-            /* generate encryption salt, put after encryption key */
-            stat = srtp_kdf_generate(xtn_hdr_kdf, label_rtp_header_salt,
-                                     tmp_key + rtp_xtn_hdr_base_key_len,
-                                     rtp_xtn_hdr_salt_len);
-            if (stat) {
-                /* zeroize temp buffer */
-                octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-                return srtp_err_status_init_fail;
+        if (separate_xtn_hdr_kdf) {
+/* initialize KDF state */
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+            stat =
+                srtp_kdf_init(&xtn_hdr_kdf, tmp_xtn_hdr_key,
+                              rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len);
+#else
+            stat = srtp_kdf_init(&xtn_hdr_kdf, tmp_xtn_hdr_key, kdf_keylen);
+#endif
+            if (!stat) {
+                stat = srtp_kdf_generate_all(&xtn_hdr_kdf, xtn_hdr_outputs,
+                                             num_xtn_hdr_outputs);
+                /* release memory for custom header extension encryption kdf */
+                if (srtp_kdf_clear(&xtn_hdr_kdf) && !stat) {
+                    stat = srtp_err_status_init_fail;
+                }
+            }
+        } else {
+            for (size_t i = 0; i < num_xtn_hdr_outputs; i++) {
+                outputs[num_outputs++] = xtn_hdr_outputs[i];
             }
         }
-        if (rtp_xtn_hdr_salt_len > 0) {
-            debug_print(
-                mod_srtp, "extensions cipher salt: %s",
-                srtp_octet_string_hex_string(tmp_key + rtp_xtn_hdr_base_key_len,
-                                             rtp_xtn_hdr_salt_len));
-        }
+        octet_string_set_to_zero(tmp_xtn_hdr_key, MAX_SRTP_KEY_LEN);
+    }
 
-        /* initialize extensions header cipher */
-        stat = srtp_cipher_init(session_keys->rtp_xtn_hdr_cipher, tmp_key);
-        if (stat) {
-            /* zeroize temp buffer */
-            octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-            return srtp_err_status_init_fail;
+    if (which & SRTP_DERIVE_RTP) {
+        outputs[num_outputs++] = (srtp_kdf_output_t){ label_rtp_msg_auth,
+                                                      keys.rtp_auth,
+                                                      rtp_auth_keylen };
+    }
+    if (which & SRTP_DERIVE_RTCP) {
+        outputs[num_outputs++] = (srtp_kdf_output_t){ label_rtcp_encryption,
+                                                      keys.rtcp,
+                                                      rtcp_base_key_len };
+        if (rtcp_salt_len > 0) {
+            debug_print0(mod_srtp,
+                         "found rtcp_salt_len > 0, generating rtcp salt");
+            outputs[num_outputs++] = (srtp_kdf_output_t){
+                label_rtcp_salt, keys.rtcp + rtcp_base_key_len, rtcp_salt_len
+            };
         }
+        outputs[num_outputs++] = (srtp_kdf_output_t){ label_rtcp_msg_auth,
+                                                      keys.rtcp_auth,
+                                                      rtcp_auth_keylen };
+    }
 
-        if (xtn_hdr_kdf != &kdf) {
-            /* release memory for custom header extension encryption kdf */
-            stat = srtp_kdf_clear(xtn_hdr_kdf);
-            if (stat) {
-                /* zeroize temp buffer */
-                octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-                return srtp_err_status_init_fail;
+    if (!stat && num_outputs > 0) {
+/* initialize KDF state     */
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+        stat = srtp_kdf_init(&kdf, tmp_key, rtp_base_key_len, rtp_salt_len);
+#else
+        stat = srtp_kdf_init(&kdf, tmp_key, kdf_keylen);
+#endif
+        if (!stat) {
+            stat = srtp_kdf_generate_all(&kdf, outputs, num_outputs);
+            if (srtp_kdf_clear(&kdf) && !stat) {
+                stat = srtp_err_status_init_fail;
             }
         }
     }
-
-    /* generate authentication key */
-    stat = srtp_kdf_generate(&kdf, label_rtp_msg_auth, tmp_key,
-                             srtp_auth_get_key_length(session_keys->rtp_auth));
+    octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
     if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+        octet_string_set_to_zero(&keys, sizeof(keys));
         return srtp_err_status_init_fail;
     }
-    debug_print(mod_srtp, "auth key:   %s",
-                srtp_octet_string_hex_string(
-                    tmp_key, srtp_auth_get_key_length(session_keys->rtp_auth)));
 
-    /* initialize auth function */
-    stat = srtp_auth_init(session_keys->rtp_auth, tmp_key);
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
+    if (which & SRTP_DERIVE_RTP) {
+        debug_print(mod_srtp, "cipher key: %s",
+                    srtp_octet_string_hex_string(keys.rtp, rtp_base_key_len));
+        if (rtp_salt_len > 0) {
+            debug_print(mod_srtp, "cipher salt: %s",
+                        srtp_octet_string_hex_string(
+                            keys.rtp + rtp_base_key_len, rtp_salt_len));
+            memcpy(salt, keys.rtp + rtp_base_key_len, SRTP_AEAD_SALT_LEN);
+        }
+
+        /* initialize cipher */
+        stat = srtp_cipher_init(session_keys->rtp_cipher, keys.rtp);
+    }
+
+    if (!stat && (which & SRTP_DERIVE_XTN_HDR) &&
+        session_keys->rtp_xtn_hdr_cipher) {
+        debug_print(mod_srtp, "extensions cipher key: %s",
+                    srtp_octet_string_hex_string(keys.rtp_xtn_hdr,
+                                                 rtp_xtn_hdr_base_key_len));
+        if (rtp_xtn_hdr_salt_len > 0) {
+            debug_print(mod_srtp, "extensions cipher salt: %s",
+                        srtp_octet_string_hex_string(
+                            keys.rtp_xtn_hdr + rtp_xtn_hdr_base_key_len,
+                            rtp_xtn_hdr_salt_len));
+        }
+
+        /* initialize extensions header cipher */
+        stat =
+            srtp_cipher_init(session_keys->rtp_xtn_hdr_cipher, keys.rtp_xtn_hdr);
+    }
+
+    if (!stat && (which & SRTP_DERIVE_RTP)) {
+        debug_print(mod_srtp, "auth key:   %s",
+                    srtp_octet_string_hex_string(keys.rtp_auth,
+                                                 rtp_auth_keylen));
+
+        /* initialize auth function */
+        stat = srtp_auth_init(session_keys->rtp_auth, keys.rtp_auth);
     }
 
     /*
      * ...now initialize SRTCP keys
      */
+    if (!stat && (which & SRTP_DERIVE_RTCP)) {
+        if (rtcp_salt_len > 0) {
+            memcpy(c_salt, keys.rtcp + rtcp_base_key_len, SRTP_AEAD_SALT_LEN);
+        }
+        debug_print(mod_srtp, "rtcp cipher key: %s",
+                    srtp_octet_string_hex_string(keys.rtcp, rtcp_base_key_len));
+        if (rtcp_salt_len > 0) {
+            debug_print(mod_srtp, "rtcp cipher salt: %s",
+                        srtp_octet_string_hex_string(
+                            keys.rtcp + rtcp_base_key_len, rtcp_salt_len));
+        }
 
-    rtcp_base_key_len =
-        base_key_length(session_keys->rtcp_cipher->type, rtcp_keylen);
-    rtcp_salt_len = rtcp_keylen - rtcp_base_key_len;
-    debug_print(mod_srtp, "rtcp salt len: %zu", rtcp_salt_len);
+        /* initialize cipher */
+        stat = srtp_cipher_init(session_keys->rtcp_cipher, keys.rtcp);
+    }
+
+    if (!stat && (which & SRTP_DERIVE_RTCP)) {
+        debug_print(mod_srtp, "rtcp auth key:   %s",
+                    srtp_octet_string_hex_string(keys.rtcp_auth,
+                                                 rtcp_auth_keylen));
 
-    /* generate encryption key  */
-    stat = srtp_kdf_generate(&kdf, label_rtcp_encryption, tmp_key,
-                             rtcp_base_key_len);
+        /* initialize auth function */
+        stat = srtp_auth_init(session_keys->rtcp_auth, keys.rtcp_auth);
+    }
+
+    /* clear memory then return */
+    octet_string_set_to_zero(&keys, sizeof(keys));
     if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
         return srtp_err_status_init_fail;
     }
 
-    /*
-     * if the cipher in the srtp context uses a salt, then we need
-     * to generate the salt value
-     */
-    if (rtcp_salt_len > 0) {
-        debug_print0(mod_srtp, "found rtcp_salt_len > 0, generating rtcp salt");
+    return srtp_err_status_ok;
+}
 
-        /* generate encryption salt, put after encryption key */
-        stat = srtp_kdf_generate(&kdf, label_rtcp_salt,
-                                 tmp_key + rtcp_base_key_len, rtcp_salt_len);
-        if (stat) {
-            /* zeroize temp buffer */
-            octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-            return srtp_err_status_init_fail;
+/*
+ * srtp_stream_init_keys() only derives the SRTP keys, the SRTCP and
+ * header extension keys are derived on first use by
+ * srtp_session_keys_ready() from the master key kept in
+ * session_keys->pending
+ */
+srtp_err_status_t srtp_stream_init_keys(srtp_session_keys_t *session_keys,
+                                        const srtp_master_key_t *master_key,
+                                        size_t mki_size)
+{
+    srtp_pending_keys_t *pending = session_keys->pending;
+    size_t input_keylen = srtp_session_keys_master_key_len(session_keys);
+
+    /* initialize key limit to maximum value */
+    srtp_key_limit_set(session_keys->limit, 0xffffffffffffLL);
+
+    if (mki_size != 0) {
+        if (master_key->mki_id_len == 0 || master_key->mki_id_len != mki_size) {
+            return srtp_err_status_bad_param;
         }
-        memcpy(session_keys->c_salt, tmp_key + rtcp_base_key_len,
-               SRTP_AEAD_SALT_LEN);
-    }
-    debug_print(mod_srtp, "rtcp cipher key: %s",
-                srtp_octet_string_hex_string(tmp_key, rtcp_base_key_len));
-    if (rtcp_salt_len > 0) {
-        debug_print(mod_srtp, "rtcp cipher salt: %s",
-                    srtp_octet_string_hex_string(tmp_key + rtcp_base_key_len,
-                                                 rtcp_salt_len));
+        if (session_keys->mki_id == NULL) {
+            session_keys->mki_id = srtp_crypto_alloc(mki_size);
+            if (session_keys->mki_id == NULL) {
+                return srtp_err_status_init_fail;
+            }
+        }
+        memcpy(session_keys->mki_id, master_key->mki_id, mki_size);
+    } else {
+        session_keys->mki_id = NULL;
     }
 
-    /* initialize cipher */
-    stat = srtp_cipher_init(session_keys->rtcp_cipher, tmp_key);
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
+    if (input_keylen > SRTP_MAX_KEY_LEN) {
+        return srtp_err_status_bad_param;
     }
 
-    /* generate authentication key */
-    stat = srtp_kdf_generate(&kdf, label_rtcp_msg_auth, tmp_key,
-                             srtp_auth_get_key_length(session_keys->rtcp_auth));
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
+    if (pending == NULL) {
+        pending = (srtp_pending_keys_t *)srtp_crypto_alloc(
+            sizeof(srtp_pending_keys_t));
+        if (pending == NULL) {
+            return srtp_err_status_init_fail;
+        }
+        session_keys->pending = pending;
     }
+    memcpy(pending->master_key, master_key->key, input_keylen);
+    pending->rtcp = true;
+    pending->xtn_hdr = session_keys->rtp_xtn_hdr_cipher != NULL;
+    session_keys->rtcp_pending = pending->rtcp;
+    session_keys->xtn_hdr_pending = pending->xtn_hdr;
 
-    debug_print(
-        mod_srtp, "rtcp auth key:   %s",
-        srtp_octet_string_hex_string(
-            tmp_key, srtp_auth_get_key_length(session_keys->rtcp_auth)));
+    return srtp_session_keys_derive(session_keys, master_key->key,
+                                    SRTP_DERIVE_RTP, session_keys->salt, NULL);
+}
 
-    /* initialize auth function */
-    stat = srtp_auth_init(session_keys->rtcp_auth, tmp_key);
-    if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
+/*
+ * srtp_pending_keys_derive(session_keys, which) derives those of the keys
+ * selected by which that have not been derived from the master key in
+ * session_keys->pending yet. The master key is wiped once all are; the
+ * header extension keys are derived along with the SRTCP keys so that
+ * this happens as soon as the SRTCP keys are derived.
+ */
+static srtp_err_status_t srtp_pending_keys_derive(
+    const srtp_session_keys_t *session_keys,
+    unsigned int which)
+{
+    srtp_pending_keys_t *pending = session_keys->pending;
+    srtp_err_status_t status = srtp_err_status_ok;
+    unsigned int missing = 0;
+
+    srtp_spinlock_lock(&pending->lock);
+    if ((which & SRTP_DERIVE_RTCP) && pending->rtcp) {
+        missing |= SRTP_DERIVE_RTCP;
+    }
+    if ((missing != 0 || (which & SRTP_DERIVE_XTN_HDR)) && pending->xtn_hdr) {
+        missing |= SRTP_DERIVE_XTN_HDR;
+    }
+    if (missing != 0) {
+        debug_print(mod_srtp, "deriving pending keys: 0x%x", missing);
+        status = srtp_session_keys_derive(session_keys, pending->master_key,
+                                          missing, NULL, pending->c_salt);
+        if (status == srtp_err_status_ok) {
+            pending->rtcp = pending->rtcp && !(missing & SRTP_DERIVE_RTCP);
+            pending->xtn_hdr =
+                pending->xtn_hdr && !(missing & SRTP_DERIVE_XTN_HDR);
+            if (!pending->rtcp && !pending->xtn_hdr) {
+                octet_string_set_to_zero(pending->master_key,
+                                         SRTP_MAX_KEY_LEN);
+            }
+        }
     }
+    srtp_spinlock_unlock(&pending->lock);
 
-    /* clear memory then return */
-    stat = srtp_kdf_clear(&kdf);
-    octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-    if (stat) {
-        return srtp_err_status_init_fail;
+    return status;
+}
+
+/*
+ * srtp_stream_derive_pending_keys(stream) derives the keys of stream that
+ * no packet has needed yet, which wipes the master keys kept for them
+ */
+static srtp_err_status_t srtp_stream_derive_pending_keys(
+    const srtp_stream_ctx_t *stream)
+{
+    srtp_err_status_t status;
+
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        const srtp_session_keys_t *session_keys = &stream->session_keys[i];
+
+        if (session_keys->pending != NULL) {
+            status = srtp_pending_keys_derive(
+                session_keys, SRTP_DERIVE_RTCP | SRTP_DERIVE_XTN_HDR);
+            if (status) {
+                return status;
+            }
+        }
     }
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_stream_init_all_master_keys(srtp_stream_ctx_t *srtp,
-                                                   const srtp_policy_t p)
+static srtp_err_status_t srtp_session_keys_complete(
+    srtp_session_keys_t *session_keys,
+    unsigned int which)
 {
-    srtp_err_status_t status = srtp_err_status_ok;
-    if (p->num_master_keys > SRTP_MAX_NUM_MASTER_KEYS) {
-        return srtp_err_status_bad_param;
-    }
-    if (p->use_mki && p->mki_size == 0) {
-        return srtp_err_status_bad_param;
+    srtp_err_status_t status;
+
+    status = srtp_pending_keys_derive(session_keys, which);
+    if (status) {
+        return status;
     }
 
-    srtp->use_mki = p->use_mki;
-    srtp->mki_size = p->mki_size;
+    /*
+     * only the SRTCP fields are written here, a thread safe session may
+     * be protecting RTP with the same keys under the other lock
+     */
+    if ((which & SRTP_DERIVE_RTCP) && session_keys->rtcp_pending) {
+        memcpy(session_keys->c_salt, session_keys->pending->c_salt,
+               SRTP_AEAD_SALT_LEN);
+        srtp_iv_base_init(&session_keys->c_aead_iv_base, session_keys->c_salt,
+                          session_keys->iv_base_ssrc);
+        session_keys->rtcp_pending = false;
+    }
+    if (which & SRTP_DERIVE_XTN_HDR) {
+        session_keys->xtn_hdr_pending = false;
+    }
 
-    if (p->num_master_keys == 0) {
-        srtp_session_keys_t *session_keys;
+    return srtp_err_status_ok;
+}
 
-        if (!srtp_policy_is_null_cipher_null_auth(p) || p->use_mki ||
-            srtp->num_master_keys != 1) {
-            return srtp_err_status_bad_param;
-        }
+/*
+ * srtp_session_keys_ready(session_keys, which) makes sure the keys
+ * selected by which have been derived; it has to be called before the
+ * cipher or auth they key is used, including setting an IV
+ */
+static inline srtp_err_status_t srtp_session_keys_ready(
+    srtp_session_keys_t *session_keys,
+    unsigned int which)
+{
+    if (((which & SRTP_DERIVE_RTCP) && session_keys->rtcp_pending) ||
+        ((which & SRTP_DERIVE_XTN_HDR) && session_keys->xtn_hdr_pending)) {
+        return srtp_session_keys_complete(session_keys, which);
+    }
+    return srtp_err_status_ok;
+}
 
-        session_keys = &srtp->session_keys[0];
-        srtp_key_limit_set(session_keys->limit, 0xffffffffffffLL);
+/*
+ * srtp_stream_clone_keys(stream_template, str) replaces the cipher, auth
+ * and key limit that str, a clone of stream_template, shares with the
+ * template by private copies. The copies are keyed from the template's
+ * expanded keys, skipping the key derivation. Returns
+ * srtp_err_status_no_such_op if a cipher or auth type can not be cloned;
+ * on failure str still holds all the pointers that were not replaced, so
+ * that it can be deallocated against the template.
+ */
+srtp_err_status_t srtp_stream_clone_keys(
+    const srtp_stream_ctx_t *stream_template,
+    srtp_stream_ctx_t *str)
+{
+    srtp_err_status_t status;
 
-        status = srtp_cipher_init(session_keys->rtp_cipher, NULL);
-        if (status) {
-            return status;
+    for (size_t i = 0; i < str->num_master_keys; i++) {
+        srtp_session_keys_t *session_keys = &str->session_keys[i];
+        const srtp_session_keys_t *template_session_keys =
+            &stream_template->session_keys[i];
+        const srtp_pending_keys_t *pending = template_session_keys->pending;
+        srtp_key_limit_ctx_t *limit;
+
+        /* only keyed ciphers and auths can be copied */
+        if (pending != NULL) {
+            status = srtp_pending_keys_derive(
+                template_session_keys, SRTP_DERIVE_RTCP | SRTP_DERIVE_XTN_HDR);
+            if (status) {
+                return status;
+            }
         }
-        status = srtp_auth_init(session_keys->rtp_auth, NULL);
+
+        status = srtp_cipher_clone(template_session_keys->rtp_cipher,
+                                   &session_keys->rtp_cipher);
         if (status) {
+            session_keys->rtp_cipher = template_session_keys->rtp_cipher;
             return status;
         }
-        if (session_keys->rtp_xtn_hdr_cipher != NULL) {
-            status = srtp_cipher_init(session_keys->rtp_xtn_hdr_cipher, NULL);
+
+        if (template_session_keys->rtp_xtn_hdr_cipher) {
+            status = srtp_cipher_clone(
+                template_session_keys->rtp_xtn_hdr_cipher,
+                &session_keys->rtp_xtn_hdr_cipher);
             if (status) {
+                session_keys->rtp_xtn_hdr_cipher =
+                    template_session_keys->rtp_xtn_hdr_cipher;
                 return status;
             }
         }
-        status = srtp_cipher_init(session_keys->rtcp_cipher, NULL);
+
+        status = srtp_cipher_clone(template_session_keys->rtcp_cipher,
+                                   &session_keys->rtcp_cipher);
         if (status) {
+            session_keys->rtcp_cipher = template_session_keys->rtcp_cipher;
             return status;
         }
-        return srtp_auth_init(session_keys->rtcp_auth, NULL);
-    }
 
-    for (size_t i = 0; i < srtp->num_master_keys; i++) {
-        status = srtp_stream_init_keys(&srtp->session_keys[i],
-                                       &(p->master_keys[i]), srtp->mki_size);
+        status = srtp_auth_clone(template_session_keys->rtp_auth,
+                                 &session_keys->rtp_auth);
         if (status) {
+            session_keys->rtp_auth = template_session_keys->rtp_auth;
             return status;
         }
-    }
 
-    return status;
-}
+        status = srtp_auth_clone(template_session_keys->rtcp_auth,
+                                 &session_keys->rtcp_auth);
+        if (status) {
+            session_keys->rtcp_auth = template_session_keys->rtcp_auth;
+            return status;
+        }
 
-static srtp_err_status_t srtp_stream_init(srtp_stream_ctx_t *srtp,
-                                          const srtp_policy_t p)
-{
-    srtp_err_status_t err;
+        /* carry over how much of the key the template has used up */
+        limit = (srtp_key_limit_ctx_t *)srtp_crypto_alloc(
+            sizeof(srtp_key_limit_ctx_t));
+        if (limit == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+        *limit = *template_session_keys->limit;
+        session_keys->limit = limit;
+
+        /* the copies are keyed, the template may not have its salt yet */
+        if (pending != NULL) {
+            memcpy(session_keys->c_salt, pending->c_salt, SRTP_AEAD_SALT_LEN);
+        } else {
+            memcpy(session_keys->c_salt, template_session_keys->c_salt,
+                   SRTP_AEAD_SALT_LEN);
+        }
+        srtp_session_keys_set_iv_base(session_keys, session_keys->iv_base_ssrc);
+        session_keys->pending = NULL;
+        session_keys->rtcp_pending = false;
+        session_keys->xtn_hdr_pending = false;
+    }
+
+    return srtp_err_status_ok;
+}
+
+#if SRTP_MAX_NUM_MASTER_KEYS > 0xffff
+#error "the MKI map can index at most 65535 master keys"
+#endif
+
+/*
+ * the MKI map finds the session keys for the MKI of a packet in about one
+ * probe: its slots hold the index of a session key plus one, or zero when
+ * free, starting at the slot the MKI hashes to. A one octet MKI is used
+ * as the slot number directly.
+ */
+#define SRTP_MKI_MAP_DIRECT_SLOTS 256
+
+static inline uint32_t srtp_mki_hash(const uint8_t *mki, size_t mki_size)
+{
+    uint32_t hash = 2166136261u;
+
+    if (mki_size == 1) {
+        return mki[0];
+    }
+
+    /* FNV-1a */
+    for (size_t i = 0; i < mki_size; i++) {
+        hash = (hash ^ mki[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * srtp_stream_build_mki_map(srtp) indexes the MKIs of the session keys of
+ * srtp; a stream with a single master key just compares against it. A
+ * map srtp already has is rebuilt in place, as the clones of a template
+ * rekeyed by srtp_template_rekey() share it.
+ */
+static srtp_err_status_t srtp_stream_build_mki_map(srtp_stream_ctx_t *srtp)
+{
+    size_t num_slots = 4;
+    uint16_t *slots;
+
+    if (!srtp->use_mki || srtp->num_master_keys < 2) {
+        return srtp_err_status_ok;
+    }
+
+    if (srtp->mki_size == 1) {
+        num_slots = SRTP_MKI_MAP_DIRECT_SLOTS;
+    } else {
+        while (num_slots < 2 * srtp->num_master_keys) {
+            num_slots *= 2;
+        }
+    }
+
+    if (srtp->mki_map != NULL) {
+        slots = srtp->mki_map;
+        memset(slots, 0, num_slots * sizeof(uint16_t));
+    } else {
+        slots = (uint16_t *)srtp_crypto_alloc(num_slots * sizeof(uint16_t));
+        if (slots == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+    }
+
+    for (size_t i = 0; i < srtp->num_master_keys; i++) {
+        const uint8_t *mki = srtp->session_keys[i].mki_id;
+        size_t slot = srtp_mki_hash(mki, srtp->mki_size) & (num_slots - 1);
+
+        /* of keys with the same MKI the first one is used */
+        while (slots[slot] != 0 &&
+               memcmp(srtp->session_keys[slots[slot] - 1].mki_id, mki,
+                      srtp->mki_size) != 0) {
+            slot = (slot + 1) & (num_slots - 1);
+        }
+        if (slots[slot] == 0) {
+            slots[slot] = (uint16_t)(i + 1);
+        }
+    }
+
+    srtp->mki_map = slots;
+    srtp->mki_map_mask = (uint16_t)(num_slots - 1);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_copy_all_master_keys(srtp, p, key_donor) keys srtp, which
+ * was allocated without ciphers and auths for a policy p with the same
+ * master keys as key_donor, by copying key_donor's expanded keys; the key
+ * limits start out fresh as if the keys had been derived again
+ *
+ * on failure srtp may still share pointers with key_donor, so it has to
+ * be deallocated against key_donor
+ */
+static srtp_err_status_t srtp_stream_copy_all_master_keys(
+    srtp_stream_ctx_t *srtp,
+    const srtp_policy_t p,
+    const srtp_stream_ctx_t *key_donor)
+{
+    srtp_err_status_t status;
+
+    srtp->use_mki = p->use_mki;
+    srtp->mki_size = (uint8_t)p->mki_size;
+
+    status = srtp_stream_clone_keys(key_donor, srtp);
+    if (status) {
+        return status;
+    }
+
+    for (size_t i = 0; i < srtp->num_master_keys; i++) {
+        srtp_session_keys_t *session_keys = &srtp->session_keys[i];
+        const srtp_session_keys_t *donor_session_keys =
+            &key_donor->session_keys[i];
+
+        if (srtp->mki_size != 0) {
+            if (session_keys->mki_id == NULL) {
+                session_keys->mki_id = srtp_crypto_alloc(srtp->mki_size);
+                if (session_keys->mki_id == NULL) {
+                    return srtp_err_status_alloc_fail;
+                }
+            }
+            memcpy(session_keys->mki_id, donor_session_keys->mki_id,
+                   srtp->mki_size);
+        }
+        memcpy(session_keys->salt, donor_session_keys->salt,
+               SRTP_AEAD_SALT_LEN);
+        srtp_key_limit_set(session_keys->limit, 0xffffffffffffLL);
+        srtp_session_keys_set_iv_base(session_keys, srtp->ssrc);
+    }
+
+    return srtp_stream_build_mki_map(srtp);
+}
+
+srtp_err_status_t srtp_stream_init_all_master_keys(srtp_stream_ctx_t *srtp,
+                                                   const srtp_policy_t p)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+    if (p->num_master_keys > SRTP_MAX_NUM_MASTER_KEYS) {
+        return srtp_err_status_bad_param;
+    }
+    if (p->use_mki && p->mki_size == 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp->use_mki = p->use_mki;
+    srtp->mki_size = (uint8_t)p->mki_size;
+
+    if (p->num_master_keys == 0) {
+        srtp_session_keys_t *session_keys;
+
+        if (!srtp_policy_is_null_cipher_null_auth(p) || p->use_mki ||
+            srtp->num_master_keys != 1) {
+            return srtp_err_status_bad_param;
+        }
+
+        session_keys = &srtp->session_keys[0];
+        srtp_key_limit_set(session_keys->limit, 0xffffffffffffLL);
+
+        status = srtp_cipher_init(session_keys->rtp_cipher, NULL);
+        if (status) {
+            return status;
+        }
+        status = srtp_auth_init(session_keys->rtp_auth, NULL);
+        if (status) {
+            return status;
+        }
+        if (session_keys->rtp_xtn_hdr_cipher != NULL) {
+            status = srtp_cipher_init(session_keys->rtp_xtn_hdr_cipher, NULL);
+            if (status) {
+                return status;
+            }
+        }
+        status = srtp_cipher_init(session_keys->rtcp_cipher, NULL);
+        if (status) {
+            return status;
+        }
+        return srtp_auth_init(session_keys->rtcp_auth, NULL);
+    }
+
+    for (size_t i = 0; i < srtp->num_master_keys; i++) {
+        status = srtp_stream_init_keys(&srtp->session_keys[i],
+                                       &(p->master_keys[i]), srtp->mki_size);
+        SRTP_PROBE3(stream_init_keys, ntohl(srtp->ssrc), i, status);
+        if (status) {
+            return status;
+        }
+        srtp_session_keys_set_iv_base(&srtp->session_keys[i], srtp->ssrc);
+    }
+
+    return srtp_stream_build_mki_map(srtp);
+}
+
+static void srtp_stream_select_rtp_paths(srtp_stream_ctx_t *stream);
+
+static srtp_err_status_t srtp_stream_init(srtp_stream_ctx_t *srtp,
+                                          const srtp_policy_t p,
+                                          const srtp_stream_ctx_t *key_donor)
+{
+    srtp_err_status_t err = srtp_err_status_ok;
 
     debug_print(mod_srtp, "initializing stream (SSRC: 0x%08x)",
                 (unsigned int)p->ssrc.value);
@@ -1642,7 +2990,10 @@ static srtp_err_status_t srtp_stream_init(srtp_stream_ctx_t *srtp,
         return srtp_err_status_bad_param;
     }
 
-    if (p->window_size != 0) {
+    /* srtp_stream_alloc() has set up the window in the stream already */
+    if (srtp->rtp_rdbx.bitmask != NULL) {
+        srtp_rdbx_reset(&srtp->rtp_rdbx);
+    } else if (p->window_size != 0) {
         err = srtp_rdbx_init(&srtp->rtp_rdbx, p->window_size);
     } else {
         err = srtp_rdbx_init(&srtp->rtp_rdbx, 128);
@@ -1669,20 +3020,169 @@ static srtp_err_status_t srtp_stream_init(srtp_stream_ctx_t *srtp,
     srtp->direction = dir_unknown;
 
     /* initialize SRTCP replay database */
-    srtp_rdb_init(&srtp->rtcp_rdb);
+    if (!srtp_policy_is_valid_rtcp_window_size(p->rtcp_window_size)) {
+        srtp_rdbx_dealloc(&srtp->rtp_rdbx);
+        return srtp_err_status_bad_param;
+    }
+
+    /* the database itself is set up by the first SRTCP packet */
+    if (p->rtcp_window_size != 0) {
+        srtp->rtcp_window_size = (uint16_t)p->rtcp_window_size;
+    } else {
+        srtp->rtcp_window_size = SRTP_RDB_DEFAULT_WINDOW_SIZE;
+    }
 
     /* initialize allow_repeat_tx */
     srtp->allow_repeat_tx = p->allow_repeat_tx;
 
     /* DAM - no RTCP key limit at present */
 
-    /* initialize keys */
-    err = srtp_stream_init_all_master_keys(srtp, p);
+    /* initialize keys, or copy them from a stream with the same keys */
+    if (key_donor != NULL) {
+        err = srtp_stream_copy_all_master_keys(srtp, p, key_donor);
+    } else {
+        err = srtp_stream_init_all_master_keys(srtp, p);
+    }
     if (err) {
         srtp_rdbx_dealloc(&srtp->rtp_rdbx);
         return err;
     }
 
+    srtp_stream_select_rtp_paths(srtp);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_clone_from_policy(stream_template, policy, ssrc, new) creates
+ * a stream for ssrc from the policy the template was created from. Unlike
+ * srtp_stream_clone() the new stream has its own cipher, auth and key
+ * limit, so that it can be used concurrently with other clones.
+ */
+srtp_err_status_t srtp_stream_clone_from_policy(
+    const srtp_stream_ctx_t *stream_template,
+    const srtp_policy_t policy,
+    uint32_t ssrc,
+    srtp_stream_ctx_t **str_ptr)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *str;
+
+    debug_print(mod_srtp, "keying cloned stream (SSRC: 0x%08x)",
+                (unsigned int)ntohl(ssrc));
+
+    status = srtp_stream_alloc(&str, policy, NULL);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_stream_init(str, policy, NULL);
+    if (status) {
+        srtp_stream_dealloc(str, NULL);
+        return status;
+    }
+
+    str->ssrc = ssrc;
+    for (size_t i = 0; i < str->num_master_keys; i++) {
+        srtp_session_keys_set_iv_base(&str->session_keys[i], ssrc);
+    }
+    str->direction = stream_template->direction;
+    str->from_template = true;
+
+    *str_ptr = str;
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_clone_private(pool, stream_template, policy, ssrc, new)
+ * creates a stream for ssrc that has its own per packet cipher and auth
+ * state, it copies the template's keys when the crypto backend supports
+ * that and falls back to deriving them again from policy otherwise
+ */
+static srtp_err_status_t srtp_stream_clone_private(
+    srtp_stream_pool_t *pool,
+    const srtp_stream_ctx_t *stream_template,
+    const srtp_policy_t policy,
+    uint32_t ssrc,
+    srtp_stream_ctx_t **str_ptr)
+{
+    srtp_err_status_t status;
+
+    status = srtp_stream_clone(pool, stream_template, ssrc, str_ptr);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_stream_clone_keys(stream_template, *str_ptr);
+    if (status == srtp_err_status_ok) {
+        return status;
+    }
+
+    srtp_stream_dealloc(*str_ptr, stream_template);
+    *str_ptr = NULL;
+    if (status != srtp_err_status_no_such_op) {
+        return status;
+    }
+
+    return srtp_stream_clone_from_policy(stream_template, policy, ssrc,
+                                         str_ptr);
+}
+
+static srtp_err_status_t srtp_session_evict_clone(srtp_t ctx);
+
+/*
+ * srtp_session_clone_stream(ctx, ssrc, new) creates the stream for a new
+ * ssrc from the session's template, first making room for it if the
+ * session holds as many clones as the template allows
+ */
+srtp_err_status_t srtp_session_clone_stream(srtp_t ctx,
+                                            uint32_t ssrc,
+                                            srtp_stream_ctx_t **str_ptr)
+{
+    srtp_err_status_t status;
+    int node;
+
+    if (ctx->max_clones != 0 && ctx->num_clones >= ctx->max_clones) {
+        status = srtp_session_evict_clone(ctx);
+        if (status) {
+            return status;
+        }
+    }
+
+    node = srtp_session_bind_allocs(ctx);
+    /* in a thread safe session clones can not share per packet state */
+    if (ctx->thread_safe) {
+        status = srtp_stream_clone_private(&ctx->stream_pool,
+                                           ctx->stream_template,
+                                           ctx->template_policy, ssrc, str_ptr);
+    } else {
+        status = srtp_stream_clone(&ctx->stream_pool, ctx->stream_template,
+                                   ssrc, str_ptr);
+    }
+    srtp_crypto_alloc_set_node(node);
+
+    return status;
+}
+
+/*
+ * srtp_session_insert_clone(ctx, stream) links a stream that
+ * srtp_session_clone_stream() created into the session, it is deallocated
+ * if that fails
+ */
+srtp_err_status_t srtp_session_insert_clone(srtp_t ctx,
+                                            srtp_stream_ctx_t *stream)
+{
+    srtp_err_status_t status;
+
+    status = srtp_insert_or_dealloc_stream(ctx->stream_list, stream,
+                                           ctx->stream_template);
+    if (status) {
+        return status;
+    }
+
+    stream->last_used = ctx->epoch;
+    ctx->num_clones++;
+
     return srtp_err_status_ok;
 }
 
@@ -1712,6 +3212,10 @@ void srtp_event_reporter(srtp_event_data_t *data)
         srtp_err_report(srtp_err_level_warning,
                         "\tpacket index limit reached\n");
         break;
+    case event_queue_overflow:
+        srtp_err_report(srtp_err_level_warning,
+                        "\tevents lost to a full event queue\n");
+        break;
     default:
         srtp_err_report(srtp_err_level_warning,
                         "\tunknown event reported to handler\n");
@@ -1743,51 +3247,119 @@ srtp_err_status_t srtp_install_event_handler(srtp_event_handler_func_t func)
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_stream_check_direction(ctx, stream, direction) lets stream take
+ * direction when its first packet is processed and reports an SSRC
+ * collision if it was used for the other direction before; the RTP and
+ * SRTCP packets of a thread safe session may race to set it
+ */
+static void srtp_stream_check_direction(srtp_ctx_t *ctx,
+                                        srtp_stream_ctx_t *stream,
+                                        direction_t direction)
+{
+    if (srtp_atomic_load_u8(&stream->direction) == direction ||
+        srtp_atomic_cas_u8(&stream->direction, dir_unknown,
+                           (uint8_t)direction) ||
+        srtp_atomic_load_u8(&stream->direction) == direction) {
+        return;
+    }
+
+    srtp_handle_event(ctx, stream, event_ssrc_collision);
+}
+
 /*
  * Check if the given extension header id is / should be encrypted.
  * Returns true if yes, otherwise false.
  */
-static bool srtp_protect_extension_header(srtp_stream_ctx_t *stream, uint8_t id)
+static inline bool srtp_protect_extension_header(
+    const srtp_stream_ctx_t *stream,
+    uint8_t id)
 {
-    uint8_t *enc_xtn_hdr = stream->enc_xtn_hdr;
-    size_t count = stream->enc_xtn_hdr_count;
+    return (stream->enc_xtn_hdr_mask[id >> 3] >> (id & 7)) & 1;
+}
 
-    if (!enc_xtn_hdr || count <= 0) {
-        return false;
-    }
+/*
+ * keystream for the header extension block, generated lazily a buffer
+ * at a time; start and end are the offsets within the keystream of the
+ * bytes held in buf and limit bounds how much will ever be needed
+ */
+typedef struct {
+    uint8_t buf[256];
+    size_t start;
+    size_t end;
+    size_t limit;
+} srtp_xtn_keystream_t;
+
+/*
+ * xor len bytes of data with the keystream starting at offset pos, the
+ * offsets passed in by successive calls must not decrease
+ */
+static srtp_err_status_t srtp_xtn_keystream_xor(srtp_cipher_t *cipher,
+                                                srtp_xtn_keystream_t *ks,
+                                                size_t pos,
+                                                uint8_t *data,
+                                                size_t len)
+{
+    while (len > 0) {
+        size_t n;
 
-    while (count > 0) {
-        if (*enc_xtn_hdr == id) {
-            return true;
+        if (pos >= ks->end) {
+            n = ks->limit - ks->end;
+            if (n > sizeof(ks->buf)) {
+                n = sizeof(ks->buf);
+            }
+            if (n == 0 || srtp_cipher_output(cipher, ks->buf, &n)) {
+                return srtp_err_status_cipher_fail;
+            }
+            ks->start = ks->end;
+            ks->end += n;
+            continue;
         }
 
-        enc_xtn_hdr++;
-        count--;
+        n = ks->end - pos;
+        if (n > len) {
+            n = len;
+        }
+        for (size_t i = 0; i < n; i++) {
+            data[i] ^= ks->buf[pos - ks->start + i];
+        }
+        data += n;
+        pos += n;
+        len -= n;
     }
-    return false;
+
+    return srtp_err_status_ok;
 }
 
 /*
  * extensions header encryption RFC 6904
+ *
+ * every element, header included, takes its length of keystream while
+ * padding between elements takes none; the keystream is only generated
+ * once an element that is to be encrypted is found, normally in a
+ * single call covering the whole block
  */
 static srtp_err_status_t srtp_process_header_encryption(
     srtp_stream_ctx_t *stream,
-    srtp_hdr_xtnd_t *xtn_hdr,
+    uint8_t *pkt,
+    const srtp_rtp_header_desc_t *desc,
     srtp_session_keys_t *session_keys)
 {
     srtp_err_status_t status;
-    uint8_t keystream[257]; /* Maximum 2 bytes header + 255 bytes data. */
-    size_t keystream_pos;
-    uint8_t *xtn_hdr_data = ((uint8_t *)xtn_hdr) + octets_in_rtp_xtn_hdr;
-    uint8_t *xtn_hdr_end =
-        xtn_hdr_data + (ntohs(xtn_hdr->length) * sizeof(uint32_t));
+    srtp_xtn_keystream_t ks;
+    size_t keystream_pos = 0;
+    uint8_t *xtn_hdr_data = pkt + desc->xtn_offset + octets_in_rtp_xtn_hdr;
+    uint8_t *xtn_hdr_end = pkt + desc->xtn_offset + desc->xtn_len;
 
-    if (ntohs(xtn_hdr->profile_specific) == xtn_hdr_one_byte_profile) {
+    ks.start = 0;
+    ks.end = 0;
+    ks.limit = (size_t)(xtn_hdr_end - xtn_hdr_data);
+
+    if (desc->xtn_profile == xtn_hdr_one_byte_profile) {
         /* RFC 5285, section 4.2. One-Byte Header */
         while (xtn_hdr_data < xtn_hdr_end) {
             uint8_t xid = (*xtn_hdr_data & 0xf0) >> 4;
             size_t xlen = (*xtn_hdr_data & 0x0f) + 1;
-            size_t xlen_with_header = 1 + xlen;
             xtn_hdr_data++;
 
             if (xtn_hdr_data + xlen > xtn_hdr_end) {
@@ -1799,57 +3371,43 @@ static srtp_err_status_t srtp_process_header_encryption(
                 break;
             }
 
-            status = srtp_cipher_output(session_keys->rtp_xtn_hdr_cipher,
-                                        keystream, &xlen_with_header);
-            if (status) {
-                return srtp_err_status_cipher_fail;
-            }
-
             if (srtp_protect_extension_header(stream, xid)) {
-                keystream_pos = 1;
-                while (xlen > 0) {
-                    *xtn_hdr_data ^= keystream[keystream_pos++];
-                    xtn_hdr_data++;
-                    xlen--;
+                status = srtp_xtn_keystream_xor(
+                    session_keys->rtp_xtn_hdr_cipher, &ks, keystream_pos + 1,
+                    xtn_hdr_data, xlen);
+                if (status) {
+                    return status;
                 }
-            } else {
-                xtn_hdr_data += xlen;
             }
+            xtn_hdr_data += xlen;
+            keystream_pos += 1 + xlen;
 
             /* skip padding bytes */
             while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
                 xtn_hdr_data++;
             }
         }
-    } else if ((ntohs(xtn_hdr->profile_specific) & 0xfff0) ==
-               xtn_hdr_two_byte_profile) {
+    } else if ((desc->xtn_profile & 0xfff0) == xtn_hdr_two_byte_profile) {
         /* RFC 5285, section 4.3. Two-Byte Header */
         while (xtn_hdr_data + 1 < xtn_hdr_end) {
             uint8_t xid = *xtn_hdr_data;
             size_t xlen = *(xtn_hdr_data + 1);
-            size_t xlen_with_header = 2 + xlen;
             xtn_hdr_data += 2;
 
             if (xtn_hdr_data + xlen > xtn_hdr_end) {
                 return srtp_err_status_parse_err;
             }
 
-            status = srtp_cipher_output(session_keys->rtp_xtn_hdr_cipher,
-                                        keystream, &xlen_with_header);
-            if (status) {
-                return srtp_err_status_cipher_fail;
-            }
-
             if (xlen > 0 && srtp_protect_extension_header(stream, xid)) {
-                keystream_pos = 2;
-                while (xlen > 0) {
-                    *xtn_hdr_data ^= keystream[keystream_pos++];
-                    xtn_hdr_data++;
-                    xlen--;
+                status = srtp_xtn_keystream_xor(
+                    session_keys->rtp_xtn_hdr_cipher, &ks, keystream_pos + 2,
+                    xtn_hdr_data, xlen);
+                if (status) {
+                    return status;
                 }
-            } else {
-                xtn_hdr_data += xlen;
             }
+            xtn_hdr_data += xlen;
+            keystream_pos += 2 + xlen;
 
             /* skip padding bytes. */
             while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
@@ -1885,7 +3443,7 @@ static srtp_err_status_t srtp_process_header_encryption(
  *            +--+--+--+--+--+--+--+--+--+--+--+--+*
  *
  * Input:  *session_keys - pointer to SRTP stream context session keys,
- *                         used to retrieve the SALT
+ *                         holding the salt xor'ed with the SSRC
  *         *iv     - Pointer to receive the calculated IV
  *         *seq    - The ROC and SEQ value to use for the
  *                   IV calculation.
@@ -1898,35 +3456,18 @@ static void srtp_calc_aead_iv(srtp_session_keys_t *session_keys,
                               srtp_xtd_seq_num_t *seq,
                               const srtp_hdr_t *hdr)
 {
-    v128_t in;
-    v128_t salt;
-
-    uint32_t local_roc = (uint32_t)(*seq >> 16);
-    uint16_t local_seq = (uint16_t)*seq;
+    *iv = session_keys->aead_iv_base;
 
-    memset(&in, 0, sizeof(v128_t));
-    memset(&salt, 0, sizeof(v128_t));
-
-    in.v16[5] = htons(local_seq);
-    local_roc = htonl(local_roc);
-    memcpy(&in.v16[3], &local_roc, sizeof(local_roc));
-
-    /*
-     * Copy in the RTP SSRC value
-     */
-    memcpy(&in.v8[2], &hdr->ssrc, 4);
-    debug_print(mod_srtp, "Pre-salted RTP IV = %s\n", v128_hex_string(&in));
+    /* a template can be used for packets of any SSRC */
+    if (hdr->ssrc != session_keys->iv_base_ssrc) {
+        srtp_iv_xor_ssrc(iv, hdr->ssrc ^ session_keys->iv_base_ssrc);
+    }
 
-    /*
-     * Get the SALT value from the context
-     */
-    memcpy(salt.v8, session_keys->salt, SRTP_AEAD_SALT_LEN);
-    debug_print(mod_srtp, "RTP SALT = %s\n", v128_hex_string(&salt));
+    /* the 48-bit ROC and SEQ go in octets 6 to 11 */
+    iv->v16[3] ^= htons((uint16_t)(*seq >> 32));
+    iv->v32[2] ^= htonl((uint32_t)*seq);
 
-    /*
-     * Finally, apply tyhe SALT to the input
-     */
-    v128_xor(iv, &in, &salt);
+    debug_trace(mod_srtp, "RTP IV = %s\n", v128_hex_string(iv));
 }
 
 static srtp_err_status_t srtp_get_session_keys_for_packet(
@@ -1946,6 +3487,7 @@ static srtp_err_status_t srtp_get_session_keys_for_packet(
     }
 
     size_t mki_start_location = pkt_octet_len;
+    const uint8_t *mki;
 
     if (tag_len > mki_start_location) {
         return srtp_err_status_bad_mki;
@@ -1958,10 +3500,29 @@ static srtp_err_status_t srtp_get_session_keys_for_packet(
     }
 
     mki_start_location -= stream->mki_size;
+    mki = hdr + mki_start_location;
+
+    if (stream->mki_map != NULL) {
+        size_t slot =
+            srtp_mki_hash(mki, stream->mki_size) & stream->mki_map_mask;
+
+        while (stream->mki_map[slot] != 0) {
+            srtp_session_keys_t *keys =
+                &stream->session_keys[stream->mki_map[slot] - 1];
+
+            if (memcmp(mki, keys->mki_id, stream->mki_size) == 0) {
+                *session_keys = keys;
+                return srtp_err_status_ok;
+            }
+            slot = (slot + 1) & stream->mki_map_mask;
+        }
+
+        return srtp_err_status_bad_mki;
+    }
 
     for (size_t i = 0; i < stream->num_master_keys; i++) {
-        if (memcmp(hdr + mki_start_location, stream->session_keys[i].mki_id,
-                   stream->mki_size) == 0) {
+        if (memcmp(mki, stream->session_keys[i].mki_id, stream->mki_size) ==
+            0) {
             *session_keys = &stream->session_keys[i];
             return srtp_err_status_ok;
         }
@@ -1983,8 +3544,7 @@ static srtp_err_status_t srtp_get_session_keys_for_rtp_packet(
     }
 
     // Determine the authentication tag size
-    if (stream->session_keys[0].rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        stream->session_keys[0].rtp_cipher->algorithm == SRTP_AES_GCM_256) {
+    if (srtp_cipher_is_aead(stream->session_keys[0].rtp_cipher)) {
         tag_len = 0;
     } else {
         tag_len = srtp_auth_get_tag_length(stream->session_keys[0].rtp_auth);
@@ -2007,8 +3567,7 @@ static srtp_err_status_t srtp_get_session_keys_for_rtcp_packet(
     }
 
     // Determine the authentication tag size
-    if (stream->session_keys[0].rtcp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        stream->session_keys[0].rtcp_cipher->algorithm == SRTP_AES_GCM_256) {
+    if (srtp_cipher_is_aead(stream->session_keys[0].rtcp_cipher)) {
         tag_len = 0;
     } else {
         tag_len = srtp_auth_get_tag_length(stream->session_keys[0].rtcp_auth);
@@ -2058,7 +3617,7 @@ static srtp_err_status_t srtp_get_est_pkt_index(const srtp_hdr_t *hdr,
             srtp_rdbx_estimate_index(&stream->rtp_rdbx, est, ntohs(hdr->seq));
     }
 
-    debug_print(mod_srtp, "estimated u_packet index: %016" PRIx64, *est);
+    debug_trace(mod_srtp, "estimated u_packet index: %016" PRIx64, *est);
 
     return result;
 }
@@ -2070,11 +3629,12 @@ static srtp_err_status_t srtp_get_est_pkt_index(const srtp_hdr_t *hdr,
  */
 static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
                                            srtp_stream_ctx_t *stream,
+                                           srtp_session_keys_t *session_keys,
                                            const uint8_t *rtp,
                                            size_t rtp_len,
+                                           const srtp_rtp_header_desc_t *desc,
                                            uint8_t *srtp,
-                                           size_t *srtp_len,
-                                           srtp_session_keys_t *session_keys)
+                                           size_t *srtp_len)
 {
     const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
     size_t enc_start;         /* offset to start of encrypted portion   */
@@ -2085,8 +3645,10 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
     size_t tag_len;
     v128_t iv;
     size_t aad_len;
+    SRTP_STAGE_START(t);
 
-    debug_print0(mod_srtp, "function srtp_protect_aead");
+    debug_trace0(mod_srtp, "function srtp_protect_aead");
+    SRTP_STAGE_PACKET(ctx, protect);
 
     /*
      * update the key usage limit, and check it to make sure that we
@@ -2101,6 +3663,7 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
         return srtp_err_status_key_expired;
     case srtp_key_event_soft_limit:
     default:
+        stream->stats.key_soft_limit++;
         srtp_handle_event(ctx, stream, event_key_soft_limit);
         break;
     }
@@ -2119,23 +3682,32 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
      * extension, if present; otherwise, it starts after the last csrc,
      * if any are present
      */
-    enc_start = srtp_get_rtp_hdr_len(hdr);
-    if (hdr->x == 1) {
-        enc_start += srtp_get_rtp_hdr_xtnd_len(hdr, rtp);
-    }
+    enc_start = desc->header_len;
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
 
     bool cryptex_inuse, cryptex_inplace;
-    status = srtp_cryptex_protect_init(stream, hdr, rtp, srtp, &cryptex_inuse,
-                                       &cryptex_inplace, &enc_start);
+    status = srtp_cryptex_protect_init(stream, desc, rtp, srtp, true,
+                                       &cryptex_inuse, &cryptex_inplace,
+                                       &enc_start);
     if (status) {
         return status;
     }
 
-    if (cryptex_inuse && !cryptex_inplace && hdr->cc) {
-        debug_print0(mod_srtp,
-                     "unsupported cryptex mode, AEAD, CC and not inplace io");
-        return srtp_err_status_cryptex_err;
+    /*
+     * the AEAD ciphers take the CSRCs, the header extension and the
+     * payload as one piece, which they only are in place once the
+     * extension header has been moved in front of the CSRCs; so the
+     * packet is laid out in srtp and protected in place there
+     */
+    if (cryptex_inuse && !cryptex_inplace && desc->csrc_count) {
+        memcpy(srtp, rtp, rtp_len);
+        rtp = srtp;
+        hdr = (const srtp_hdr_t *)srtp;
+        cryptex_inplace = true;
+        enc_start -= desc->csrc_count * 4;
     }
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_header, t);
 
     /* note: the passed size is without the auth tag */
     if (enc_start > rtp_len) {
@@ -2146,6 +3718,7 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
     /* if not-inplace then need to copy full rtp header */
     if (rtp != srtp) {
         memcpy(srtp, rtp, enc_start);
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_copy, t);
     }
 
     /*
@@ -2173,7 +3746,16 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
         srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
 
-    debug_print(mod_srtp, "estimated packet index: %016" PRIx64, est);
+    debug_trace(mod_srtp, "estimated packet index: %016" PRIx64, est);
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_index, t);
+
+    /* the header extension keys wait for the first packet that has any */
+    if (desc->xtn_len != 0) {
+        status = srtp_session_keys_ready(session_keys, SRTP_DERIVE_XTN_HDR);
+        if (status) {
+            return status;
+        }
+    }
 
     /*
      * AEAD uses a new IV formation method
@@ -2184,7 +3766,8 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
 
     status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
                                 srtp_direction_encrypt);
-    if (!status && session_keys->rtp_xtn_hdr_cipher) {
+    if (!status && session_keys->rtp_xtn_hdr_cipher &&
+        !session_keys->xtn_hdr_pending) {
         iv.v32[0] = 0;
         iv.v32[1] = hdr->ssrc;
         iv.v64[1] = est;
@@ -2195,25 +3778,29 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
         return srtp_err_status_cipher_fail;
     }
 
-    if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher) {
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+
+    if (desc->xtn_len != 0 && session_keys->rtp_xtn_hdr_cipher) {
         /*
          * extensions header encryption RFC 6904
          */
-        status = srtp_process_header_encryption(
-            stream, srtp_get_rtp_xtn_hdr(hdr, srtp), session_keys);
+        status = srtp_process_header_encryption(stream, srtp, desc,
+                                                session_keys);
         if (status) {
             return status;
         }
     }
 
     if (cryptex_inuse) {
-        status = srtp_cryptex_protect(cryptex_inplace, hdr, srtp,
-                                      session_keys->rtp_cipher);
+        status = srtp_cryptex_protect(cryptex_inplace, desc, srtp,
+                                      session_keys->rtp_cipher, NULL);
         if (status) {
             return status;
         }
     }
 
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_header, t);
+
     /*
      * Set the AAD over the RTP header
      */
@@ -2238,9 +3825,11 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
     }
 
     if (cryptex_inuse) {
-        srtp_cryptex_protect_cleanup(cryptex_inplace, hdr, srtp);
+        srtp_cryptex_protect_cleanup(cryptex_inplace, desc, srtp);
     }
 
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+
     *srtp_len = enc_start + enc_octet_len;
 
     /* increase the packet length by the length of the mki_size */
@@ -2254,7 +3843,9 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
  * which currently supports AES-GCM encryption.  All packets are
  * encrypted and authenticated.  Note, the auth tag is at the end
  * of the packet stream and is automatically checked by GCM
- * when decrypting the payload.
+ * when decrypting the payload.  Unless update_replay is set, the
+ * packet is neither added to the replay database nor does it make the
+ * template clone a stream.
  */
 static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
                                              srtp_stream_ctx_t *stream,
@@ -2262,10 +3853,12 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
                                              srtp_xtd_seq_num_t est,
                                              const uint8_t *srtp,
                                              size_t srtp_len,
+                                             const srtp_rtp_header_desc_t *desc,
                                              uint8_t *rtp,
                                              size_t *rtp_len,
                                              srtp_session_keys_t *session_keys,
-                                             bool advance_packet_index)
+                                             bool advance_packet_index,
+                                             bool update_replay)
 {
     const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
     size_t enc_start;         /* offset to start of encrypted portion  */
@@ -2274,54 +3867,47 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
     srtp_err_status_t status;
     size_t tag_len;
     size_t aad_len;
+    SRTP_STAGE_START(t);
 
-    debug_print0(mod_srtp, "function srtp_unprotect_aead");
+    debug_trace0(mod_srtp, "function srtp_unprotect_aead");
 
-    debug_print(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
+    debug_trace(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
 
     /* get tag length from stream */
     tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
 
-    /*
-     * AEAD uses a new IV formation method
-     */
-    srtp_calc_aead_iv(session_keys, &iv, &est, hdr);
-    status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
-                                srtp_direction_decrypt);
-    if (!status && session_keys->rtp_xtn_hdr_cipher) {
-        iv.v32[0] = 0;
-        iv.v32[1] = hdr->ssrc;
-        iv.v64[1] = be64_to_cpu(est << 16);
-        status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
-                                    (uint8_t *)&iv, srtp_direction_encrypt);
-    }
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
-
-    enc_start = srtp_get_rtp_hdr_len(hdr);
-    if (hdr->x == 1) {
-        enc_start += srtp_get_rtp_hdr_xtnd_len(hdr, srtp);
-    }
+    enc_start = desc->header_len;
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
 
     bool cryptex_inuse, cryptex_inplace;
-    status = srtp_cryptex_unprotect_init(stream, hdr, srtp, rtp, &cryptex_inuse,
-                                         &cryptex_inplace, &enc_start);
+    status = srtp_cryptex_unprotect_init(stream, desc, srtp, rtp, true,
+                                         &cryptex_inuse, &cryptex_inplace,
+                                         &enc_start);
     if (status) {
         return status;
     }
 
-    if (cryptex_inuse && !cryptex_inplace && hdr->cc) {
-        debug_print0(mod_srtp,
-                     "unsupported cryptex mode, AEAD, CC and not inplace io");
-        return srtp_err_status_cryptex_err;
-    }
-
     if (tag_len + stream->mki_size > srtp_len ||
         enc_start > srtp_len - tag_len - stream->mki_size) {
         return srtp_err_status_parse_err;
     }
 
+    /*
+     * as in srtp_protect_aead(), the packet is laid out in rtp and
+     * unprotected in place there, which takes room for the tag in rtp
+     */
+    if (cryptex_inuse && !cryptex_inplace && desc->csrc_count) {
+        if (*rtp_len < srtp_len - stream->mki_size) {
+            return srtp_err_status_buffer_small;
+        }
+        memcpy(rtp, srtp, srtp_len - stream->mki_size);
+        srtp = rtp;
+        hdr = (const srtp_hdr_t *)rtp;
+        cryptex_inplace = true;
+        enc_start -= desc->csrc_count * 4;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_header, t);
+
     /*
      * We pass the tag down to the cipher when doing GCM mode
      */
@@ -2341,9 +3927,39 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
         return srtp_err_status_buffer_small;
     }
 
+    /* the header extension keys wait for the first packet that has any */
+    if (desc->xtn_len != 0) {
+        status = srtp_session_keys_ready(session_keys, SRTP_DERIVE_XTN_HDR);
+        if (status) {
+            return status;
+        }
+    }
+
+    /*
+     * AEAD uses a new IV formation method; it is only set up once the
+     * packet has been checked to be well formed, so that malformed ones
+     * are rejected without touching the cipher
+     */
+    srtp_calc_aead_iv(session_keys, &iv, &est, hdr);
+    status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
+                                srtp_direction_decrypt);
+    if (!status && session_keys->rtp_xtn_hdr_cipher &&
+        !session_keys->xtn_hdr_pending) {
+        iv.v32[0] = 0;
+        iv.v32[1] = hdr->ssrc;
+        iv.v64[1] = be64_to_cpu(est << 16);
+        status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
+                                    (uint8_t *)&iv, srtp_direction_encrypt);
+    }
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+
     /* if not-inplace then need to copy full rtp header */
     if (srtp != rtp) {
         memcpy(rtp, srtp, enc_start);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_copy, t);
     }
 
     /*
@@ -2355,6 +3971,7 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
     case srtp_key_event_normal:
         break;
     case srtp_key_event_soft_limit:
+        stream->stats.key_soft_limit++;
         srtp_handle_event(ctx, stream, event_key_soft_limit);
         break;
     case srtp_key_event_hard_limit:
@@ -2364,13 +3981,16 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
         break;
     }
 
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
+
     if (cryptex_inuse) {
-        status = srtp_cryptex_unprotect(cryptex_inplace, hdr, rtp,
+        status = srtp_cryptex_unprotect(cryptex_inplace, desc, rtp,
                                         session_keys->rtp_cipher);
         if (status) {
             return status;
         }
     }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_header, t);
 
     /*
      * Set the AAD for AES-GCM, which is the RTP header
@@ -2389,21 +4009,23 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
     if (status) {
         return status;
     }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
 
-    if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher) {
+    if (desc->xtn_len != 0 && session_keys->rtp_xtn_hdr_cipher) {
         /*
          * extensions header encryption RFC 6904
          */
-        status = srtp_process_header_encryption(
-            stream, srtp_get_rtp_xtn_hdr(hdr, rtp), session_keys);
+        status =
+            srtp_process_header_encryption(stream, rtp, desc, session_keys);
         if (status) {
             return status;
         }
     }
 
     if (cryptex_inuse) {
-        srtp_cryptex_unprotect_cleanup(cryptex_inplace, hdr, rtp);
+        srtp_cryptex_unprotect_cleanup(cryptex_inplace, desc, rtp);
     }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_header, t);
 
     /*
      * verify that stream is for received traffic - this check will
@@ -2415,20 +4037,14 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
      * latter check will catch any attempts to fool us into thinking
      * that we've got a collision
      */
-    if (stream->direction != dir_srtp_receiver) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_receiver;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
-    }
+    srtp_stream_check_direction(ctx, stream, dir_srtp_receiver);
 
     /*
      * if the stream is a 'provisional' one, in which the template context
      * is used, then we need to allocate a new stream at this point, since
      * the authentication passed
      */
-    if (stream == ctx->stream_template) {
+    if (update_replay && stream == ctx->stream_template) {
         srtp_stream_ctx_t *new_stream;
 
         /*
@@ -2438,15 +4054,13 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
          * stream, and some implementations will want to not return
          * failure here
          */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
+        status = srtp_session_clone_stream(ctx, hdr->ssrc, &new_stream);
         if (status) {
             return status;
         }
 
         /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
+        status = srtp_session_insert_clone(ctx, new_stream);
         if (status) {
             return status;
         }
@@ -2454,12 +4068,15 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
         /* set stream (the pointer used in this function) */
         stream = new_stream;
     }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
 
     /*
      * the message authentication function passed, so add the packet
      * index into the replay database
      */
-    if (advance_packet_index) {
+    if (!update_replay) {
+        /* the packet was only verified, the database stays as it was */
+    } else if (advance_packet_index) {
         uint32_t roc_to_set = (uint32_t)(est >> 16);
         uint16_t seq_to_set = (uint16_t)(est & 0xFFFF);
         srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, roc_to_set, seq_to_set);
@@ -2469,44 +4086,137 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
         srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
 
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+
     *rtp_len = enc_start + enc_octet_len;
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_protect(srtp_t ctx,
-                               const uint8_t *rtp,
-                               size_t rtp_len,
-                               uint8_t *srtp,
-                               size_t *srtp_len,
-                               size_t mki_index)
+/*
+ * the RTP packet paths are expanded once per SRTP_RTP_PATH_ value, which
+ * tells the variant what it may take for granted about the stream:
+ *
+ * SRTP_RTP_PATH_ANY checks everything per packet
+ * SRTP_RTP_PATH_ICM_HMAC is AES-ICM and HMAC-SHA1 with both encryption
+ * and authentication, and neither header extension encryption nor
+ * cryptex; SRTP_RTP_PATH_MKI adds an MKI to that
+ * SRTP_RTP_PATH_AEAD is AES-GCM
+ * SRTP_RTP_PATH_CLEAR is the null cipher without cryptex, the payload is
+ * only copied and no cipher is called; SRTP_RTP_PATH_NO_AUTH adds the
+ * null authenticator to that, which also leaves out the key usage limit
+ * as there is no key in use
+ *
+ * SRTP_RTP_PATH_HEADERS and SRTP_RTP_PATH_NO_REPLAY are not variants of a
+ * profile but modes of srtp_unprotect_headers(), added to the variant of
+ * the stream: the first verifies the packet and decrypts only its header,
+ * the second neither checks nor updates the replay database
+ *
+ * SRTP_FORCE_INLINE makes sure the constant reaches the expanded body
+ */
+#define SRTP_RTP_PATH_ANY 0x0
+#define SRTP_RTP_PATH_ICM_HMAC 0x1
+#define SRTP_RTP_PATH_MKI 0x2
+#define SRTP_RTP_PATH_AEAD 0x4
+#define SRTP_RTP_PATH_CLEAR 0x8
+#define SRTP_RTP_PATH_NO_AUTH 0x10
+#define SRTP_RTP_PATH_HEADERS 0x20
+#define SRTP_RTP_PATH_NO_REPLAY 0x40
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SRTP_FORCE_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define SRTP_FORCE_INLINE static __forceinline
+#else
+#define SRTP_FORCE_INLINE static inline
+#endif
+
+/*
+ * the payload is processed in chunks small enough to still be in the
+ * first level cache when the authentication function reads back what the
+ * cipher has just written
+ */
+#define SRTP_SINGLE_PASS_CHUNK_LEN 512
+
+/*
+ * srtp_encrypt_and_auth_update() is the payload loop of
+ * srtp_encrypt_and_auth() below, it encrypts payload_len octets from src
+ * into dst and runs the already started authentication function over them
+ */
+static srtp_err_status_t srtp_encrypt_and_auth_update(srtp_cipher_t *cipher,
+                                                      srtp_auth_t *auth,
+                                                      const uint8_t *src,
+                                                      size_t payload_len,
+                                                      uint8_t *dst)
 {
-    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
-    size_t enc_start;         /* offset to start of encrypted portion   */
-    uint8_t *auth_start;      /* pointer to start of auth. portion      */
-    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
-    srtp_xtd_seq_num_t est;   /* estimated xtd_seq_num_t of *hdr        */
-    ssize_t delta;            /* delta of local pkt idx and that in hdr */
-    uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
     srtp_err_status_t status;
-    size_t tag_len;
-    srtp_stream_ctx_t *stream;
-    size_t prefix_len;
-    srtp_session_keys_t *session_keys = NULL;
 
-    debug_print0(mod_srtp, "function srtp_protect");
+    while (payload_len > 0) {
+        size_t len = payload_len < SRTP_SINGLE_PASS_CHUNK_LEN
+                         ? payload_len
+                         : SRTP_SINGLE_PASS_CHUNK_LEN;
+        size_t out_len = len;
 
-    /* Verify RTP header */
-    status = srtp_validate_rtp_header(rtp, rtp_len);
+        status = srtp_cipher_encrypt(cipher, src, len, dst, &out_len);
+        if (status || out_len != len) {
+            return srtp_err_status_cipher_fail;
+        }
+
+        status = srtp_auth_update(auth, dst, len);
+        if (status) {
+            return status;
+        }
+
+        src += len;
+        dst += len;
+        payload_len -= len;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_encrypt_and_auth() encrypts the payload and runs the authentication
+ * function over the header followed by the encrypted payload in a single
+ * pass, leaving the auth function ready for srtp_auth_compute(). hdr is the
+ * already protected header of hdr_len octets, the payload of payload_len
+ * octets is encrypted from src into dst.
+ */
+static srtp_err_status_t srtp_encrypt_and_auth(srtp_cipher_t *cipher,
+                                               srtp_auth_t *auth,
+                                               const uint8_t *hdr,
+                                               size_t hdr_len,
+                                               const uint8_t *src,
+                                               size_t payload_len,
+                                               uint8_t *dst)
+{
+    srtp_err_status_t status;
+
+    status = srtp_auth_start(auth);
     if (status) {
         return status;
     }
 
-    /* check the packet length - it must at least contain a full header */
-    if (rtp_len < octets_in_rtp_header) {
-        return srtp_err_status_bad_param;
+    status = srtp_auth_update(auth, hdr, hdr_len);
+    if (status) {
+        return status;
     }
 
+    return srtp_encrypt_and_auth_update(cipher, auth, src, payload_len, dst);
+}
+
+/*
+ * srtp_protect_get_stream() looks up the sending stream for ssrc, cloning
+ * the template stream if there is one and this ssrc has not been seen
+ * before.
+ */
+static srtp_err_status_t srtp_protect_get_stream(srtp_ctx_t *ctx,
+                                                 uint32_t ssrc,
+                                                 srtp_stream_ctx_t **stream_ptr)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *stream;
+
     /*
      * look up ssrc in srtp_stream list, and process the packet with
      * the appropriate stream.  if we haven't seen this stream before,
@@ -2514,21 +4224,19 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
      * supports key-sharing, then we assume that a new stream using
      * that key has just started up
      */
-    stream = srtp_get_stream(ctx, hdr->ssrc);
+    stream = srtp_get_stream(ctx, ssrc);
     if (stream == NULL) {
         if (ctx->stream_template != NULL) {
             srtp_stream_ctx_t *new_stream;
 
             /* allocate and initialize a new stream */
-            status =
-                srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
+            status = srtp_session_clone_stream(ctx, ssrc, &new_stream);
             if (status) {
                 return status;
             }
 
             /* add new stream to the list */
-            status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                                   ctx->stream_template);
+            status = srtp_session_insert_clone(ctx, new_stream);
             if (status) {
                 return status;
             }
@@ -2550,39 +4258,121 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
      * srtp_protect() and srtp_unprotect() will fail this test in one of
      * those functions.
      */
+    srtp_stream_check_direction(ctx, stream, dir_srtp_sender);
 
-    if (stream->direction != dir_srtp_sender) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_sender;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
+    *stream_ptr = stream;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_keystream_take(stream, session_keys, index, len) returns the
+ * keystream srtp_stream_fill_keystream() computed with session_keys for
+ * the packet with the given index, if it covers len octets, or NULL; the
+ * entry is used up, so that no keystream is ever used twice
+ */
+static const uint8_t *srtp_keystream_take(srtp_stream_ctx_t *stream,
+                                          const srtp_session_keys_t *keys,
+                                          srtp_xtd_seq_num_t index,
+                                          size_t len)
+{
+    srtp_keystream_cache_t *cache = stream->cold->keystream;
+    srtp_keystream_entry_t *entry;
+
+    if (cache == NULL) {
+        return NULL;
     }
 
-    status = srtp_get_session_keys(stream, mki_index, &session_keys);
-    if (status) {
-        return status;
+    entry = &cache->entries[index % cache->num_entries];
+    if (entry->keys != keys || entry->index != index) {
+        return NULL;
     }
 
-    /*
-     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-     * the request to our AEAD handler.
-     */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_protect_aead(ctx, stream, rtp, rtp_len, srtp, srtp_len,
-                                 session_keys);
+    entry->keys = NULL;
+    return len <= cache->max_len ? entry->keystream : NULL;
+}
+
+/*
+ * srtp_keystream_xor(out, in, keystream, len) sets out to in exored with
+ * keystream a block at a time, out may be in
+ */
+static void srtp_keystream_xor(uint8_t *out,
+                               const uint8_t *in,
+                               const uint8_t *keystream,
+                               size_t len)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(v128_t) <= len; i += sizeof(v128_t)) {
+        v128_t data, key;
+
+        memcpy(&data, in + i, sizeof(data));
+        memcpy(&key, keystream + i, sizeof(key));
+        v128_xor(&data, &data, &key);
+        memcpy(out + i, &data, sizeof(data));
     }
+    for (; i < len; i++) {
+        out[i] = in[i] ^ keystream[i];
+    }
+}
+
+/*
+ * srtp_protect_rtp_path() applies SRTP protection to a packet whose
+ * header has already been validated and parsed into desc, using the given
+ * stream and session keys. It is expanded once for each of the
+ * SRTP_RTP_PATH_ variants that do not use AEAD, path is a constant in each
+ * of them. Unless job is NULL the tag is not computed, the message and the
+ * place of the tag are left in job, whose key is set up, for
+ * srtp_auth_compute_jobs().
+ */
+SRTP_FORCE_INLINE srtp_err_status_t
+srtp_protect_rtp_path(srtp_ctx_t *ctx,
+                      srtp_stream_ctx_t *stream,
+                      srtp_session_keys_t *session_keys,
+                      const uint8_t *rtp,
+                      size_t rtp_len,
+                      const srtp_rtp_header_desc_t *desc,
+                      uint8_t *srtp,
+                      size_t *srtp_len,
+                      srtp_auth_job_t *job,
+                      const srtp_cipher_job_t *cipher_job,
+                      unsigned int path)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+    size_t enc_start;         /* offset to start of encrypted portion   */
+    uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
+    srtp_xtd_seq_num_t est;   /* estimated xtd_seq_num_t of *hdr        */
+    ssize_t delta;            /* delta of local pkt idx and that in hdr */
+    uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_err_status_t status;
+    size_t tag_len;
+    size_t prefix_len;
+    const bool icm_hmac = (path & SRTP_RTP_PATH_ICM_HMAC) != 0;
+    const bool clear = (path & SRTP_RTP_PATH_CLEAR) != 0;
+    const bool no_auth = (path & SRTP_RTP_PATH_NO_AUTH) != 0;
+    const bool use_mki =
+        icm_hmac ? (path & SRTP_RTP_PATH_MKI) != 0 : stream->use_mki;
+    const size_t mki_size = use_mki ? stream->mki_size : 0;
+    const bool conf =
+        !clear && (icm_hmac || (stream->rtp_services & sec_serv_conf));
+    const bool auth =
+        !no_auth && (icm_hmac || (stream->rtp_services & sec_serv_auth));
+    SRTP_STAGE_START(t);
+
+    SRTP_STAGE_PACKET(ctx, protect);
 
     /*
      * update the key usage limit, and check it to make sure that we
      * didn't just hit either the soft limit or the hard limit, and call
      * the event handler if we hit either.
      */
-    switch (srtp_key_limit_update(session_keys->limit)) {
+    switch (no_auth ? srtp_key_event_normal
+                    : srtp_key_limit_update(session_keys->limit)) {
     case srtp_key_event_normal:
         break;
     case srtp_key_event_soft_limit:
+        stream->stats.key_soft_limit++;
         srtp_handle_event(ctx, stream, event_key_soft_limit);
         break;
     case srtp_key_event_hard_limit:
@@ -2593,10 +4383,10 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
     }
 
     /* get tag length from stream */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    tag_len = no_auth ? 0 : srtp_auth_get_tag_length(session_keys->rtp_auth);
 
     /* check output length */
-    if (*srtp_len < rtp_len + stream->mki_size + tag_len) {
+    if (*srtp_len < rtp_len + mki_size + tag_len) {
         return srtp_err_status_buffer_small;
     }
 
@@ -2604,32 +4394,40 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
      * find starting point for encryption and length of data to be
      * encrypted - the encrypted portion starts after the rtp header
      * extension, if present; otherwise, it starts after the last csrc,
-     * if any are present
+     * if any are present. nothing is encrypted on the clear paths, the
+     * whole packet is then treated as payload so that it takes a single
+     * copy when not in place
      */
-    enc_start = srtp_get_rtp_hdr_len(hdr);
-    if (hdr->x == 1) {
-        enc_start += srtp_get_rtp_hdr_xtnd_len(hdr, rtp);
+    if (clear) {
+        enc_start = 0;
+    } else {
+        enc_start = desc->header_len;
     }
 
-    bool cryptex_inuse, cryptex_inplace;
-    status = srtp_cryptex_protect_init(stream, hdr, rtp, srtp, &cryptex_inuse,
-                                       &cryptex_inplace, &enc_start);
-    if (status) {
-        return status;
+    bool cryptex_inuse = false, cryptex_inplace = false;
+    if (!icm_hmac && !clear) {
+        status = srtp_cryptex_protect_init(stream, desc, rtp, srtp, false,
+                                           &cryptex_inuse, &cryptex_inplace,
+                                           &enc_start);
+        if (status) {
+            return status;
+        }
     }
 
     if (enc_start > rtp_len) {
         return srtp_err_status_parse_err;
     }
     enc_octet_len = rtp_len - enc_start;
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
 
     /* if not-inplace then need to copy full rtp header */
     if (rtp != srtp) {
         memcpy(srtp, rtp, enc_start);
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_copy, t);
     }
 
-    if (stream->use_mki) {
-        srtp_inject_mki(srtp + rtp_len, session_keys, stream->mki_size);
+    if (use_mki) {
+        srtp_inject_mki(srtp + rtp_len, session_keys, mki_size);
     }
 
     /*
@@ -2637,9 +4435,9 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
      * pointers to the proper locations; otherwise, set auth_start to NULL
      * to indicate that no authentication is needed
      */
-    if (stream->rtp_services & sec_serv_auth) {
+    if (auth) {
         auth_start = srtp;
-        auth_tag = srtp + rtp_len + stream->mki_size;
+        auth_tag = srtp + rtp_len + mki_size;
     } else {
         auth_start = NULL;
         auth_tag = NULL;
@@ -2670,22 +4468,54 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
         srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
 
-    debug_print(mod_srtp, "estimated packet index: %016" PRIx64, est);
+    debug_trace(mod_srtp, "estimated packet index: %016" PRIx64, est);
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_index, t);
+
+    /*
+     * use keystream computed ahead of time for this index, if any; only
+     * counter mode streams have it. With cryptex the CSRCs take its first
+     * octets, see srtp_cryptex_protect()
+     */
+    const uint8_t *keystream = NULL;
+    if (conf && srtp_stream_cold(stream) != NULL) {
+        keystream = srtp_keystream_take(
+            stream, session_keys, est,
+            enc_octet_len + (cryptex_inuse ? desc->csrc_count * 4u : 0));
+    }
+
+    /* the header extension keys wait for the first packet that has any */
+    if (desc->xtn_len != 0) {
+        status = srtp_session_keys_ready(session_keys, SRTP_DERIVE_XTN_HDR);
+        if (status) {
+            return status;
+        }
+    }
 
     /*
      * if we're using rindael counter mode, set nonce and seq
      */
-    if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+    if (clear) {
+        status = srtp_err_status_ok;
+    } else if (icm_hmac ||
+               srtp_cipher_is_icm(session_keys->rtp_cipher)) {
         v128_t iv;
 
         iv.v32[0] = 0;
         iv.v32[1] = hdr->ssrc;
         iv.v64[1] = be64_to_cpu(est << 16);
-        status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_encrypt);
-        if (!status && session_keys->rtp_xtn_hdr_cipher) {
+        status = srtp_err_status_ok;
+        /* a batch may have computed the keystream for this iv already */
+        if (keystream == NULL && icm_hmac && cipher_job != NULL && conf &&
+            srtp_cipher_job_valid(cipher_job, session_keys->rtp_cipher,
+                                  (uint8_t *)&iv, enc_octet_len)) {
+            keystream = cipher_job->keystream;
+        }
+        if (keystream == NULL) {
+            status = srtp_cipher_set_iv(session_keys->rtp_cipher,
+                                        (uint8_t *)&iv, srtp_direction_encrypt);
+        }
+        if (!status && !icm_hmac && session_keys->rtp_xtn_hdr_cipher &&
+            !session_keys->xtn_hdr_pending) {
             status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
                                         (uint8_t *)&iv, srtp_direction_encrypt);
         }
@@ -2697,7 +4527,8 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
         iv.v64[1] = be64_to_cpu(est);
         status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
                                     srtp_direction_encrypt);
-        if (!status && session_keys->rtp_xtn_hdr_cipher) {
+        if (!status && session_keys->rtp_xtn_hdr_cipher &&
+            !session_keys->xtn_hdr_pending) {
             status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
                                         (uint8_t *)&iv, srtp_direction_encrypt);
         }
@@ -2713,7 +4544,7 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
      * if we're authenticating using a universal hash, put the keystream
      * prefix into the authentication tag
      */
-    if (auth_start) {
+    if (auth_start && !icm_hmac && !clear) {
         prefix_len = srtp_auth_get_prefix_length(session_keys->rtp_auth);
         if (prefix_len) {
             status = srtp_cipher_output(session_keys->rtp_cipher, auth_tag,
@@ -2721,32 +4552,57 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
             if (status) {
                 return srtp_err_status_cipher_fail;
             }
-            debug_print(mod_srtp, "keystream prefix: %s",
+            debug_trace(mod_srtp, "keystream prefix: %s",
                         srtp_octet_string_hex_string(auth_tag, prefix_len));
         }
     }
 
-    if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher) {
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+
+    if (!icm_hmac && !clear && desc->xtn_len != 0 &&
+        session_keys->rtp_xtn_hdr_cipher) {
         /*
          * extensions header encryption RFC 6904
          */
-        status = srtp_process_header_encryption(
-            stream, srtp_get_rtp_xtn_hdr(hdr, srtp), session_keys);
+        status =
+            srtp_process_header_encryption(stream, srtp, desc, session_keys);
         if (status) {
             return status;
         }
     }
 
     if (cryptex_inuse) {
-        status = srtp_cryptex_protect(cryptex_inplace, hdr, srtp,
-                                      session_keys->rtp_cipher);
+        status = srtp_cryptex_protect(cryptex_inplace, desc, srtp,
+                                      session_keys->rtp_cipher,
+                                      &keystream);
         if (status) {
             return status;
         }
     }
 
-    /* if we're encrypting, exor keystream into the message */
-    if (stream->rtp_services & sec_serv_conf) {
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_header, t);
+
+    /*
+     * when both encrypting and authenticating, do it in a single pass over
+     * the payload; the CSRCs of a cryptex packet are encrypted where they
+     * are by now, so the header is final
+     */
+    bool single_pass = auth_start != NULL && conf && !cryptex_inplace &&
+                       keystream == NULL && job == NULL;
+
+    if (keystream != NULL) {
+        srtp_keystream_xor(srtp + enc_start, rtp + enc_start, keystream,
+                           enc_octet_len);
+    } else if (single_pass) {
+        status = srtp_encrypt_and_auth(session_keys->rtp_cipher,
+                                       session_keys->rtp_auth, srtp, enc_start,
+                                       rtp + enc_start, enc_octet_len,
+                                       srtp + enc_start);
+        if (status) {
+            return status;
+        }
+    } else if (conf) {
+        /* if we're encrypting, exor keystream into the message */
         status = srtp_cipher_encrypt(session_keys->rtp_cipher, rtp + enc_start,
                                      enc_octet_len, srtp + enc_start,
                                      &enc_octet_len);
@@ -2759,96 +4615,488 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
     }
 
     if (cryptex_inuse) {
-        srtp_cryptex_protect_cleanup(cryptex_inplace, hdr, srtp);
+        srtp_cryptex_protect_cleanup(cryptex_inplace, desc, srtp);
     }
+    SRTP_STAGE_LAP(ctx, protect, conf ? srtp_stage_cipher : srtp_stage_copy, t);
 
     /*
      *  if we're authenticating, run authentication function and put result
      *  into the auth_tag
      */
-    if (auth_start) {
-        /* initialize auth func context */
-        status = srtp_auth_start(session_keys->rtp_auth);
-        if (status) {
-            return status;
-        }
+    if (auth_start && job != NULL) {
+        job->buffer = auth_start;
+        job->len = rtp_len;
+        memcpy(job->suffix, &est, 4);
+        job->suffix_len = 4;
+        job->tag = auth_tag;
+    } else if (auth_start) {
+        if (!single_pass) {
+            /* initialize auth func context */
+            status = srtp_auth_start(session_keys->rtp_auth);
+            if (status) {
+                return status;
+            }
 
-        /* run auth func over packet */
-        status = srtp_auth_update(session_keys->rtp_auth, auth_start, rtp_len);
-        if (status) {
-            return status;
+            /* run auth func over packet */
+            status =
+                srtp_auth_update(session_keys->rtp_auth, auth_start, rtp_len);
+            if (status) {
+                return status;
+            }
         }
 
         /* run auth func over ROC, put result into auth_tag */
-        debug_print(mod_srtp, "estimated packet index: %016" PRIx64, est);
+        debug_trace(mod_srtp, "estimated packet index: %016" PRIx64, est);
         status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4,
                                    auth_tag);
-        debug_print(mod_srtp, "srtp auth tag:    %s",
+        debug_trace(mod_srtp, "srtp auth tag:    %s",
                     srtp_octet_string_hex_string(auth_tag, tag_len));
         if (status) {
             return status;
         }
     }
 
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_auth, t);
+
     *srtp_len = enc_start + enc_octet_len;
 
     /* increase the packet length by the length of the auth tag */
     *srtp_len += tag_len;
 
     /* increate the packet length by the mki size if used */
-    *srtp_len += stream->mki_size;
+    *srtp_len += mki_size;
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_unprotect(srtp_t ctx,
-                                 const uint8_t *srtp,
-                                 size_t srtp_len,
-                                 uint8_t *rtp,
-                                 size_t *rtp_len)
+/*
+ * the srtp_protect_stream_func_t variants, srtp_stream_select_rtp_paths()
+ * picks one for each stream
+ */
+static srtp_err_status_t srtp_protect_rtp_any(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len)
 {
-    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
-    size_t enc_start;               /* pointer to start of encrypted portion  */
-    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    return srtp_protect_rtp_path(ctx, stream, session_keys, rtp, rtp_len,
+                                 desc, srtp, srtp_len, NULL, NULL,
+                                 SRTP_RTP_PATH_ANY);
+}
+
+static srtp_err_status_t srtp_protect_rtp_icm_hmac(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len)
+{
+    return srtp_protect_rtp_path(ctx, stream, session_keys, rtp, rtp_len,
+                                 desc, srtp, srtp_len, NULL, NULL,
+                                 SRTP_RTP_PATH_ICM_HMAC);
+}
+
+static srtp_err_status_t srtp_protect_rtp_icm_hmac_mki(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len)
+{
+    return srtp_protect_rtp_path(ctx, stream, session_keys, rtp, rtp_len,
+                                 desc, srtp, srtp_len, NULL, NULL,
+                                 SRTP_RTP_PATH_ICM_HMAC | SRTP_RTP_PATH_MKI);
+}
+
+static srtp_err_status_t srtp_protect_rtp_clear(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len)
+{
+    return srtp_protect_rtp_path(ctx, stream, session_keys, rtp, rtp_len,
+                                 desc, srtp, srtp_len, NULL, NULL,
+                                 SRTP_RTP_PATH_CLEAR);
+}
+
+static srtp_err_status_t srtp_protect_rtp_null(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len)
+{
+    return srtp_protect_rtp_path(ctx, stream, session_keys, rtp, rtp_len,
+                                 desc, srtp, srtp_len, NULL, NULL,
+                                 SRTP_RTP_PATH_CLEAR | SRTP_RTP_PATH_NO_AUTH);
+}
+
+/*
+ * srtp_protect_with_stream() applies SRTP protection to a packet whose header
+ * has already been validated and parsed into desc, using the given stream
+ * and session keys.
+ */
+static srtp_err_status_t srtp_protect_with_stream(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len)
+{
+    return stream->protect_rtp(ctx, stream, session_keys, rtp, rtp_len, desc,
+                               srtp, srtp_len);
+}
+
+/*
+ * srtp_protect_job_init(stream, session_keys, job) sets up job for the tag
+ * of a packet of stream, returning false unless the stream uses one of the
+ * SRTP_RTP_PATH_ICM_HMAC paths and its auth function computes jobs
+ */
+static bool srtp_protect_job_init(const srtp_stream_ctx_t *stream,
+                                  const srtp_session_keys_t *session_keys,
+                                  srtp_auth_job_t *job)
+{
+    if (stream->protect_rtp != srtp_protect_rtp_icm_hmac &&
+        stream->protect_rtp != srtp_protect_rtp_icm_hmac_mki) {
+        return false;
+    }
+
+    return srtp_auth_job_init(session_keys->rtp_auth, job) ==
+           srtp_err_status_ok;
+}
+
+/*
+ * srtp_protect_rtp_job() is srtp_protect_with_stream() for the batch functions;
+ * on the SRTP_RTP_PATH_ICM_HMAC paths the tag is left to be computed with
+ * job and the keystream computed ahead in cipher_job is used, either may
+ * be NULL
+ */
+static srtp_err_status_t srtp_protect_rtp_job(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len,
+    srtp_auth_job_t *job,
+    const srtp_cipher_job_t *cipher_job)
+{
+    if (stream->protect_rtp == srtp_protect_rtp_icm_hmac) {
+        return srtp_protect_rtp_path(ctx, stream, session_keys, rtp, rtp_len,
+                                     desc, srtp, srtp_len, job, cipher_job,
+                                     SRTP_RTP_PATH_ICM_HMAC);
+    }
+    if (stream->protect_rtp == srtp_protect_rtp_icm_hmac_mki) {
+        return srtp_protect_rtp_path(
+            ctx, stream, session_keys, rtp, rtp_len, desc, srtp, srtp_len,
+            job, cipher_job, SRTP_RTP_PATH_ICM_HMAC | SRTP_RTP_PATH_MKI);
+    }
+    return srtp_protect_with_stream(ctx, stream, session_keys, rtp, rtp_len,
+                                    desc, srtp, srtp_len);
+}
+
+/*
+ * srtp_session_enter_locks(ctx, ssrc, locks) acquires the session lock and
+ * the *locks of the stream of ssrc and returns the stream, or NULL if the
+ * stream is not known and the session lock is held exclusively instead;
+ * the RTP lock is added to *locks for an SRTCP packet of a key overlap
+ */
+static srtp_stream_ctx_t *srtp_session_enter_locks(srtp_t ctx,
+                                                   uint32_t ssrc,
+                                                   unsigned int *locks)
+{
+    srtp_stream_ctx_t *stream;
+
+    srtp_rwlock_read_lock(&ctx->lock);
+    stream = srtp_get_stream(ctx, ssrc);
+    if (stream != NULL) {
+        /*
+         * an overlap only begins with the session lock held exclusively,
+         * so an overlap that ends meanwhile merely takes a lock too many
+         */
+        if (*locks == SRTP_STREAM_LOCK_RTCP &&
+            srtp_stream_in_overlap(stream)) {
+            *locks = SRTP_STREAM_LOCK_BOTH;
+        }
+        srtp_stream_lock(stream, *locks);
+        return stream;
+    }
+    srtp_rwlock_read_unlock(&ctx->lock);
+
+    srtp_rwlock_write_lock(&ctx->lock);
+    return NULL;
+}
+
+/*
+ * srtp_session_enter(ctx, ssrc) is srtp_session_enter_locks() for a call
+ * that uses the whole stream
+ */
+srtp_stream_ctx_t *srtp_session_enter(srtp_t ctx, uint32_t ssrc)
+{
+    unsigned int locks = SRTP_STREAM_LOCK_BOTH;
+
+    return srtp_session_enter_locks(ctx, ssrc, &locks);
+}
+
+/*
+ * srtp_probe_ssrc(pkt, pkt_len, ssrc_offset) is the SSRC at ssrc_offset
+ * in the packet in host order, or zero if the packet is too short, for
+ * the probe arguments
+ */
+static inline uint32_t srtp_probe_ssrc(const uint8_t *pkt,
+                                       size_t pkt_len,
+                                       size_t ssrc_offset)
+{
+    uint32_t ssrc;
+
+    if (pkt == NULL || pkt_len < ssrc_offset + sizeof(ssrc)) {
+        return 0;
+    }
+    memcpy(&ssrc, pkt + ssrc_offset, sizeof(ssrc));
+    return ntohl(ssrc);
+}
+
+/*
+ * srtp_session_enter_packet(ctx, pkt, pkt_len, ssrc_offset, locks) is
+ * srtp_session_enter_locks() for the SSRC at ssrc_offset in the packet,
+ * packets too short to contain it are left to be rejected holding the
+ * session lock exclusively
+ */
+static srtp_stream_ctx_t *srtp_session_enter_packet(srtp_t ctx,
+                                                    const uint8_t *pkt,
+                                                    size_t pkt_len,
+                                                    size_t ssrc_offset,
+                                                    unsigned int *locks)
+{
+    uint32_t ssrc;
+
+    if (pkt == NULL || pkt_len < ssrc_offset + sizeof(ssrc)) {
+        srtp_rwlock_write_lock(&ctx->lock);
+        return NULL;
+    }
+
+    memcpy(&ssrc, pkt + ssrc_offset, sizeof(ssrc));
+    return srtp_session_enter_locks(ctx, ssrc, locks);
+}
+
+/*
+ * srtp_session_leave_locks(ctx, stream, locks) releases what
+ * srtp_session_enter_locks() took
+ */
+static void srtp_session_leave_locks(srtp_t ctx,
+                                     srtp_stream_ctx_t *stream,
+                                     unsigned int locks)
+{
+    if (stream != NULL) {
+        srtp_stream_unlock(stream, locks);
+        srtp_rwlock_read_unlock(&ctx->lock);
+    } else {
+        srtp_rwlock_write_unlock(&ctx->lock);
+    }
+}
+
+/* srtp_session_leave(ctx, stream) releases what srtp_session_enter took */
+void srtp_session_leave(srtp_t ctx, srtp_stream_ctx_t *stream)
+{
+    srtp_session_leave_locks(ctx, stream, SRTP_STREAM_LOCK_BOTH);
+}
+
+/*
+ * srtp_protect_unlocked() is srtp_protect() without the locking of thread
+ * safe sessions; desc is checked when the application filled it, NULL
+ * has the header parsed here instead
+ */
+static srtp_err_status_t srtp_protect_unlocked(
+    srtp_t ctx,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len,
+    size_t mki_index)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+    srtp_rtp_header_desc_t parsed;
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *stream;
+    srtp_session_keys_t *session_keys = NULL;
+    SRTP_STAGE_START(t);
+
+    debug_trace0(mod_srtp, "function srtp_protect");
+
+    /* Verify RTP header, it is not parsed again by the later stages */
+    if (desc == NULL) {
+        status = srtp_rtp_header_parse(rtp, rtp_len, &parsed);
+        desc = &parsed;
+    } else {
+        status = srtp_rtp_header_desc_check(rtp, rtp_len, desc);
+    }
+    if (status) {
+        return status;
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
+
+    status = srtp_protect_get_stream(ctx, hdr->ssrc, &stream);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_get_session_keys(stream, mki_index, &session_keys);
+    if (status) {
+        srtp_stream_stats_count(ctx, stream, true, true, status, rtp_len);
+        return status;
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_lookup, t);
+
+    status = srtp_protect_with_stream(ctx, stream, session_keys, rtp, rtp_len,
+                                      desc, srtp, srtp_len);
+    srtp_stream_stats_count(ctx, stream, true, true, status, rtp_len);
+
+    return status;
+}
+
+/*
+ * srtp_protect_locked() is srtp_protect_unlocked() with the locking of
+ * thread safe sessions, for srtp_protect() and srtp_protect_parsed()
+ */
+static srtp_err_status_t srtp_protect_locked(
+    srtp_t ctx,
+    const uint8_t *rtp,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *srtp,
+    size_t *srtp_len,
+    size_t mki_index)
+{
+    srtp_stream_ctx_t *stream;
+    unsigned int locks = SRTP_STREAM_LOCK_RTP;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || !ctx->thread_safe) {
+        status = srtp_protect_unlocked(ctx, rtp, rtp_len, desc, srtp,
+                                       srtp_len, mki_index);
+    } else {
+        stream = srtp_session_enter_packet(ctx, rtp, rtp_len, 8, &locks);
+        status = srtp_protect_unlocked(ctx, rtp, rtp_len, desc, srtp,
+                                       srtp_len, mki_index);
+        srtp_session_leave_locks(ctx, stream, locks);
+    }
+    SRTP_PROBE3(protect, srtp_probe_ssrc(rtp, rtp_len, 8), rtp_len, status);
+
+    return status;
+}
+
+srtp_err_status_t srtp_protect(srtp_t ctx,
+                               const uint8_t *rtp,
+                               size_t rtp_len,
+                               uint8_t *srtp,
+                               size_t *srtp_len,
+                               size_t mki_index)
+{
+    return srtp_protect_locked(ctx, rtp, rtp_len, NULL, srtp, srtp_len,
+                               mki_index);
+}
+
+srtp_err_status_t srtp_protect_parsed(srtp_t ctx,
+                                      const uint8_t *rtp,
+                                      size_t rtp_len,
+                                      const srtp_rtp_header_desc_t *desc,
+                                      uint8_t *srtp,
+                                      size_t *srtp_len,
+                                      size_t mki_index)
+{
+    if (desc == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_protect_locked(ctx, rtp, rtp_len, desc, srtp, srtp_len,
+                               mki_index);
+}
+
+/*
+ * srtp_unprotect_rtp_path() verifies and decrypts a packet whose header
+ * has already been validated. stream is the result of looking up the
+ * packet's ssrc and may be NULL, in which case the template stream is
+ * used provisionally. Like srtp_protect_rtp_path() it is expanded once
+ * for each SRTP_RTP_PATH_ variant. Unless job is NULL it holds the tag
+ * srtp_unprotect_batch() computed ahead for the packet, which is compared
+ * instead of computing it again if it is still valid. parsed is the
+ * header as the caller parsed it, or NULL to have it described here.
+ */
+SRTP_FORCE_INLINE srtp_err_status_t
+srtp_unprotect_rtp_path(srtp_ctx_t *ctx,
+                        srtp_stream_ctx_t *stream,
+                        const uint8_t *srtp,
+                        size_t srtp_len,
+                        const srtp_rtp_header_desc_t *parsed,
+                        uint8_t *rtp,
+                        size_t *rtp_len,
+                        const srtp_auth_job_t *job,
+                        const srtp_cipher_job_t *cipher_job,
+                        unsigned int path)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    size_t enc_start;               /* pointer to start of encrypted portion  */
+    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
     size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
     const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
     srtp_xtd_seq_num_t est;         /* estimated xtd_seq_num_t of *hdr        */
     ssize_t delta;                  /* delta of local pkt idx and that in hdr */
     v128_t iv;
     srtp_err_status_t status;
-    srtp_stream_ctx_t *stream;
     uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
     size_t tag_len, prefix_len;
     srtp_session_keys_t *session_keys = NULL;
     bool advance_packet_index = false;
     uint32_t roc_to_set = 0;
     uint16_t seq_to_set = 0;
-
-    debug_print0(mod_srtp, "function srtp_unprotect");
-
-    /* Verify RTP header */
-    status = srtp_validate_rtp_header(srtp, srtp_len);
-    if (status) {
-        return status;
-    }
-
-    /* check the packet length - it must at least contain a full header */
-    if (srtp_len < octets_in_rtp_header) {
-        return srtp_err_status_bad_param;
-    }
+    const bool icm_hmac = (path & SRTP_RTP_PATH_ICM_HMAC) != 0;
+    const bool clear = (path & SRTP_RTP_PATH_CLEAR) != 0;
+    const bool no_auth = (path & SRTP_RTP_PATH_NO_AUTH) != 0;
+    const bool headers = (path & SRTP_RTP_PATH_HEADERS) != 0;
+    const bool no_replay = (path & SRTP_RTP_PATH_NO_REPLAY) != 0;
+    srtp_rtp_header_desc_t desc;
+    size_t hdr_end;
+    bool use_mki;
+    size_t mki_size;
+    const uint8_t *keystream = NULL;
+    SRTP_STAGE_START(t);
+
+    SRTP_STAGE_PACKET(ctx, unprotect);
 
     /*
-     * look up ssrc in srtp_stream list, and process the packet with
-     * the appropriate stream.  if we haven't seen this stream before,
-     * there's only one key for this srtp_session, and the cipher
-     * supports key-sharing, then we assume that a new stream using
-     * that key has just started up
+     * if we haven't seen this stream before, there's only one key for
+     * this srtp_session, and the cipher supports key-sharing, then we
+     * assume that a new stream using that key has just started up
      */
-    stream = srtp_get_stream(ctx, hdr->ssrc);
     if (stream == NULL) {
         if (ctx->stream_template != NULL) {
             stream = ctx->stream_template;
-            debug_print(mod_srtp, "using provisional stream (SSRC: 0x%08x)",
+            debug_trace(mod_srtp, "using provisional stream (SSRC: 0x%08x)",
                         (unsigned int)ntohl(hdr->ssrc));
 
             /*
@@ -2878,7 +5126,7 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
         }
 
         /* check replay database */
-        if (!advance_packet_index) {
+        if (!advance_packet_index && !no_replay) {
             status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
             if (status) {
                 return status;
@@ -2886,42 +5134,109 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
         }
     }
 
-    debug_print(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
+    debug_trace(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
 
     /* Determine if MKI is being used and what session keys should be used */
-    status = srtp_get_session_keys_for_rtp_packet(stream, srtp, srtp_len,
-                                                  &session_keys);
-    if (status) {
-        return status;
+    use_mki = icm_hmac ? (path & SRTP_RTP_PATH_MKI) != 0 : stream->use_mki;
+    mki_size = use_mki ? stream->mki_size : 0;
+    if (icm_hmac && !use_mki) {
+        if (stream->num_master_keys == 0 || stream->session_keys == NULL) {
+            return srtp_err_status_no_ctx;
+        }
+        session_keys = &stream->session_keys[0];
+    } else {
+        status = srtp_get_session_keys_for_rtp_packet(stream, srtp, srtp_len,
+                                                      &session_keys);
+        if (status) {
+            return status;
+        }
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
+
+    if (parsed != NULL) {
+        desc = *parsed;
+    } else {
+        srtp_rtp_header_describe(srtp, srtp_len, &desc);
     }
 
     /*
-     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-     * the request to our AEAD handler.
+     * GCM only checks the tag while decrypting all of the packet, so the
+     * headers mode only shortens the result
      */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_unprotect_aead(ctx, stream, delta, est, srtp, srtp_len, rtp,
-                                   rtp_len, session_keys, advance_packet_index);
+    if (path & SRTP_RTP_PATH_AEAD) {
+        status = srtp_unprotect_aead(ctx, stream, delta, est, srtp, srtp_len,
+                                     &desc, rtp, rtp_len, session_keys,
+                                     advance_packet_index, !no_replay);
+        if (!status && headers) {
+            *rtp_len = desc.header_len;
+        }
+        return status;
     }
 
     /* get tag length from stream */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    tag_len = no_auth ? 0 : srtp_auth_get_tag_length(session_keys->rtp_auth);
+
+    enc_start = desc.header_len;
+    hdr_end = enc_start;
+
+    bool cryptex_inuse = false, cryptex_inplace = false;
+    if (!icm_hmac && !clear) {
+        status = srtp_cryptex_unprotect_init(stream, &desc, srtp, rtp, false,
+                                             &cryptex_inuse, &cryptex_inplace,
+                                             &enc_start);
+        if (status) {
+            return status;
+        }
+    }
+
+    if (tag_len + mki_size > srtp_len ||
+        enc_start > srtp_len - tag_len - mki_size) {
+        return srtp_err_status_parse_err;
+    }
+    enc_octet_len = srtp_len - enc_start - mki_size - tag_len;
+
+    /* check output length */
+    if (*rtp_len < (headers ? hdr_end : srtp_len - mki_size - tag_len)) {
+        return srtp_err_status_buffer_small;
+    }
+
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
+
+    /* the header extension keys wait for the first packet that has any */
+    if (desc.xtn_len != 0) {
+        status = srtp_session_keys_ready(session_keys, SRTP_DERIVE_XTN_HDR);
+        if (status) {
+            return status;
+        }
+    }
 
     /*
      * set the cipher's IV properly, depending on whatever cipher we
-     * happen to be using
+     * happen to be using; this waits until the packet has been checked
+     * to be well formed, so that malformed ones are rejected without
+     * touching the cipher
      */
-    if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+    if (clear) {
+        status = srtp_err_status_ok;
+    } else if (icm_hmac ||
+               srtp_cipher_is_icm(session_keys->rtp_cipher)) {
         /* aes counter mode */
         iv.v32[0] = 0;
         iv.v32[1] = hdr->ssrc; /* still in network order */
         iv.v64[1] = be64_to_cpu(est << 16);
-        status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_decrypt);
-        if (!status && session_keys->rtp_xtn_hdr_cipher) {
+        status = srtp_err_status_ok;
+        /* a batch may have computed the keystream for this iv already */
+        if (icm_hmac && cipher_job != NULL &&
+            srtp_cipher_job_valid(cipher_job, session_keys->rtp_cipher,
+                                  (uint8_t *)&iv, enc_octet_len)) {
+            keystream = cipher_job->keystream;
+        } else {
+            status = srtp_cipher_set_iv(session_keys->rtp_cipher,
+                                        (uint8_t *)&iv, srtp_direction_decrypt);
+        }
+        if (!status && !icm_hmac && session_keys->rtp_xtn_hdr_cipher &&
+            !session_keys->xtn_hdr_pending) {
             status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
                                         (uint8_t *)&iv, srtp_direction_decrypt);
         }
@@ -2931,7 +5246,8 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
         iv.v64[1] = be64_to_cpu(est);
         status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
                                     srtp_direction_decrypt);
-        if (!status && session_keys->rtp_xtn_hdr_cipher) {
+        if (!status && session_keys->rtp_xtn_hdr_cipher &&
+            !session_keys->xtn_hdr_pending) {
             status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
                                         (uint8_t *)&iv, srtp_direction_decrypt);
         }
@@ -2939,36 +5255,24 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
     if (status) {
         return srtp_err_status_cipher_fail;
     }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
 
     /* shift est, put into network byte order */
     est = be64_to_cpu(est << 16);
 
-    enc_start = srtp_get_rtp_hdr_len(hdr);
-    if (hdr->x == 1) {
-        enc_start += srtp_get_rtp_hdr_xtnd_len(hdr, srtp);
-    }
-
-    bool cryptex_inuse, cryptex_inplace;
-    status = srtp_cryptex_unprotect_init(stream, hdr, srtp, rtp, &cryptex_inuse,
-                                         &cryptex_inplace, &enc_start);
-    if (status) {
-        return status;
-    }
-
-    if (tag_len + stream->mki_size > srtp_len ||
-        enc_start > srtp_len - tag_len - stream->mki_size) {
-        return srtp_err_status_parse_err;
-    }
-    enc_octet_len = srtp_len - enc_start - stream->mki_size - tag_len;
-
-    /* check output length */
-    if (*rtp_len < srtp_len - stream->mki_size - tag_len) {
-        return srtp_err_status_buffer_small;
+    /*
+     * the clear paths copy the whole packet at once with the payload, the
+     * header has been checked to fit all the same
+     */
+    if (clear) {
+        enc_octet_len += enc_start;
+        enc_start = 0;
     }
 
     /* if not-inplace then need to copy full rtp header */
     if (srtp != rtp) {
         memcpy(rtp, srtp, enc_start);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_copy, t);
     }
 
     /*
@@ -2976,7 +5280,7 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
      * pointers to the proper locations; otherwise, set auth_start to NULL
      * to indicate that no authentication is needed
      */
-    if (stream->rtp_services & sec_serv_auth) {
+    if (!no_auth && (icm_hmac || (stream->rtp_services & sec_serv_auth))) {
         auth_start = srtp;
         auth_tag = srtp + srtp_len - tag_len;
     } else {
@@ -2996,56 +5300,62 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
          * if the keystream prefix length is zero, then we know that
          * the authenticator isn't using a universal hash function
          */
-        if (session_keys->rtp_auth->prefix_len != 0) {
+        if (!icm_hmac && !clear && session_keys->rtp_auth->prefix_len != 0) {
             prefix_len = srtp_auth_get_prefix_length(session_keys->rtp_auth);
             status = srtp_cipher_output(session_keys->rtp_cipher, tmp_tag,
                                         &prefix_len);
-            debug_print(mod_srtp, "keystream prefix: %s",
+            debug_trace(mod_srtp, "keystream prefix: %s",
                         srtp_octet_string_hex_string(tmp_tag, prefix_len));
             if (status) {
                 return srtp_err_status_cipher_fail;
             }
         }
 
-        /* initialize auth func context */
-        status = srtp_auth_start(session_keys->rtp_auth);
-        if (status) {
-            return status;
-        }
-
-        /* now compute auth function over packet */
-        status = srtp_auth_update(session_keys->rtp_auth, auth_start,
-                                  srtp_len - tag_len - stream->mki_size);
-        if (status) {
-            return status;
-        }
+        if (job != NULL &&
+            srtp_auth_job_valid(job, session_keys->rtp_auth, auth_start,
+                                srtp_len - tag_len - mki_size,
+                                (const uint8_t *)&est, 4)) {
+            if (!srtp_octet_string_equal(job->tag, auth_tag, tag_len)) {
+                return srtp_err_status_auth_fail;
+            }
+        } else {
+            /* initialize auth func context */
+            status = srtp_auth_start(session_keys->rtp_auth);
+            if (status) {
+                return status;
+            }
 
-        /* run auth func over ROC, then write tmp tag */
-        status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4,
-                                   tmp_tag);
-
-        debug_print(mod_srtp, "computed auth tag:    %s",
-                    srtp_octet_string_hex_string(tmp_tag, tag_len));
-        debug_print(mod_srtp, "packet auth tag:      %s",
-                    srtp_octet_string_hex_string(auth_tag, tag_len));
-        if (status) {
-            return srtp_err_status_auth_fail;
-        }
+            /* now compute auth function over packet */
+            status = srtp_auth_update(session_keys->rtp_auth, auth_start,
+                                      srtp_len - tag_len - mki_size);
+            if (status) {
+                return status;
+            }
 
-        if (!srtp_octet_string_equal(tmp_tag, auth_tag, tag_len)) {
-            return srtp_err_status_auth_fail;
+            /* run auth func over ROC, then check the tag of the packet */
+            debug_trace(mod_srtp, "packet auth tag:      %s",
+                        srtp_octet_string_hex_string(auth_tag, tag_len));
+            status = srtp_auth_verify(session_keys->rtp_auth, (uint8_t *)&est,
+                                      4, auth_tag);
+            if (status) {
+                return srtp_err_status_auth_fail;
+            }
         }
     }
 
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_auth, t);
+
     /*
      * update the key usage limit, and check it to make sure that we
      * didn't just hit either the soft limit or the hard limit, and call
      * the event handler if we hit either.
      */
-    switch (srtp_key_limit_update(session_keys->limit)) {
+    switch (no_auth ? srtp_key_event_normal
+                    : srtp_key_limit_update(session_keys->limit)) {
     case srtp_key_event_normal:
         break;
     case srtp_key_event_soft_limit:
+        stream->stats.key_soft_limit++;
         srtp_handle_event(ctx, stream, event_key_soft_limit);
         break;
     case srtp_key_event_hard_limit:
@@ -3055,38 +5365,58 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
         break;
     }
 
-    if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher) {
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
+
+    if (!icm_hmac && !clear && desc.xtn_len != 0 &&
+        session_keys->rtp_xtn_hdr_cipher) {
         /* extensions header encryption RFC 6904 */
-        status = srtp_process_header_encryption(
-            stream, srtp_get_rtp_xtn_hdr(hdr, rtp), session_keys);
+        status =
+            srtp_process_header_encryption(stream, rtp, &desc, session_keys);
         if (status) {
             return status;
         }
     }
 
     if (cryptex_inuse) {
-        status = srtp_cryptex_unprotect(cryptex_inplace, hdr, rtp,
+        status = srtp_cryptex_unprotect(cryptex_inplace, &desc, rtp,
                                         session_keys->rtp_cipher);
         if (status) {
             return status;
         }
     }
 
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_header, t);
+
+    /*
+     * in the headers mode the payload is left out, only the part of a
+     * cryptex block in front of it is decrypted
+     */
+    if (headers) {
+        enc_octet_len = hdr_end - enc_start;
+    }
+
     /* if we're decrypting, add keystream into ciphertext */
-    if (stream->rtp_services & sec_serv_conf) {
+    if (keystream != NULL) {
+        srtp_keystream_xor(rtp + enc_start, srtp + enc_start, keystream,
+                           enc_octet_len);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+    } else if (!clear && (icm_hmac || (stream->rtp_services & sec_serv_conf))) {
         status =
             srtp_cipher_decrypt(session_keys->rtp_cipher, srtp + enc_start,
                                 enc_octet_len, rtp + enc_start, &enc_octet_len);
         if (status) {
             return srtp_err_status_cipher_fail;
         }
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
     } else if (rtp != srtp) {
         /* if no encryption and not-inplace then need to copy rest of packet */
         memcpy(rtp + enc_start, srtp + enc_start, enc_octet_len);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_copy, t);
     }
 
     if (cryptex_inuse) {
-        srtp_cryptex_unprotect_cleanup(cryptex_inplace, hdr, rtp);
+        srtp_cryptex_unprotect_cleanup(cryptex_inplace, &desc, rtp);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_header, t);
     }
 
     /*
@@ -3099,20 +5429,14 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
      * latter check will catch any attempts to fool us into thinking
      * that we've got a collision
      */
-    if (stream->direction != dir_srtp_receiver) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_receiver;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
-    }
+    srtp_stream_check_direction(ctx, stream, dir_srtp_receiver);
 
     /*
      * if the stream is a 'provisional' one, in which the template context
      * is used, then we need to allocate a new stream at this point, since
      * the authentication passed
      */
-    if (stream == ctx->stream_template) {
+    if (!no_replay && stream == ctx->stream_template) {
         srtp_stream_ctx_t *new_stream;
 
         /*
@@ -3122,15 +5446,13 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
          * stream, and some implementations will want to not return
          * failure here
          */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
+        status = srtp_session_clone_stream(ctx, hdr->ssrc, &new_stream);
         if (status) {
             return status;
         }
 
         /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
+        status = srtp_session_insert_clone(ctx, new_stream);
         if (status) {
             return status;
         }
@@ -3138,12 +5460,15 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
         /* set stream (the pointer used in this function) */
         stream = new_stream;
     }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
 
     /*
      * the message authentication function passed, so add the packet
      * index into the replay database
      */
-    if (advance_packet_index) {
+    if (no_replay) {
+        /* the packet was only verified, the database stays as it was */
+    } else if (advance_packet_index) {
         srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, roc_to_set, seq_to_set);
         stream->pending_roc = 0;
         srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
@@ -3151,1293 +5476,4814 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
         srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
 
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+
     *rtp_len = enc_start + enc_octet_len;
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_init(void)
+/*
+ * the srtp_unprotect_stream_func_t variants, the AEAD one only shares the
+ * lookup of the stream and keys and leaves the rest to
+ * srtp_unprotect_aead()
+ */
+static srtp_err_status_t srtp_unprotect_rtp_any(srtp_ctx_t *ctx,
+                                                srtp_stream_ctx_t *stream,
+                                                const uint8_t *srtp,
+                                                size_t srtp_len,
+                                                uint8_t *rtp,
+                                                size_t *rtp_len)
 {
-    srtp_err_status_t status;
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL, SRTP_RTP_PATH_ANY);
+}
 
-    /* initialize crypto kernel */
-    status = srtp_crypto_kernel_init();
-    if (status) {
-        return status;
-    }
+static srtp_err_status_t srtp_unprotect_rtp_icm_hmac(srtp_ctx_t *ctx,
+                                                     srtp_stream_ctx_t *stream,
+                                                     const uint8_t *srtp,
+                                                     size_t srtp_len,
+                                                     uint8_t *rtp,
+                                                     size_t *rtp_len)
+{
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL, SRTP_RTP_PATH_ICM_HMAC);
+}
 
-    /* load srtp debug module into the kernel */
-    status = srtp_crypto_kernel_load_debug_module(&mod_srtp);
-    if (status) {
-        return status;
-    }
+static srtp_err_status_t srtp_unprotect_rtp_icm_hmac_mki(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *srtp,
+    size_t srtp_len,
+    uint8_t *rtp,
+    size_t *rtp_len)
+{
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL,
+                                   SRTP_RTP_PATH_ICM_HMAC | SRTP_RTP_PATH_MKI);
+}
 
-    return srtp_err_status_ok;
+static srtp_err_status_t srtp_unprotect_rtp_aead(srtp_ctx_t *ctx,
+                                                 srtp_stream_ctx_t *stream,
+                                                 const uint8_t *srtp,
+                                                 size_t srtp_len,
+                                                 uint8_t *rtp,
+                                                 size_t *rtp_len)
+{
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL, SRTP_RTP_PATH_AEAD);
 }
 
-srtp_err_status_t srtp_shutdown(void)
+static srtp_err_status_t srtp_unprotect_rtp_clear(srtp_ctx_t *ctx,
+                                                  srtp_stream_ctx_t *stream,
+                                                  const uint8_t *srtp,
+                                                  size_t srtp_len,
+                                                  uint8_t *rtp,
+                                                  size_t *rtp_len)
 {
-    srtp_err_status_t status;
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL, SRTP_RTP_PATH_CLEAR);
+}
 
-    /* shut down crypto kernel */
-    status = srtp_crypto_kernel_shutdown();
-    if (status) {
-        return status;
+static srtp_err_status_t srtp_unprotect_rtp_null(srtp_ctx_t *ctx,
+                                                 srtp_stream_ctx_t *stream,
+                                                 const uint8_t *srtp,
+                                                 size_t srtp_len,
+                                                 uint8_t *rtp,
+                                                 size_t *rtp_len)
+{
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL,
+                                   SRTP_RTP_PATH_CLEAR | SRTP_RTP_PATH_NO_AUTH);
+}
+
+/*
+ * srtp_unprotect_rtp_path_of(stream) returns the SRTP_RTP_PATH_ variant
+ * that the unprotect_rtp function of stream expands
+ */
+static unsigned int srtp_unprotect_rtp_path_of(const srtp_stream_ctx_t *stream)
+{
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_icm_hmac) {
+        return SRTP_RTP_PATH_ICM_HMAC;
+    }
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_icm_hmac_mki) {
+        return SRTP_RTP_PATH_ICM_HMAC | SRTP_RTP_PATH_MKI;
+    }
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_aead) {
+        return SRTP_RTP_PATH_AEAD;
     }
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_clear) {
+        return SRTP_RTP_PATH_CLEAR;
+    }
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_null) {
+        return SRTP_RTP_PATH_CLEAR | SRTP_RTP_PATH_NO_AUTH;
+    }
+    return SRTP_RTP_PATH_ANY;
+}
 
-    /* shutting down crypto kernel frees the srtp debug module as well */
+/*
+ * srtp_unprotect_rtp_parsed() unprotects a packet whose header the caller
+ * parsed into desc, see srtp_priv.h
+ */
+srtp_err_status_t srtp_unprotect_rtp_parsed(srtp_ctx_t *ctx,
+                                            srtp_stream_ctx_t *stream,
+                                            const uint8_t *srtp,
+                                            size_t srtp_len,
+                                            const srtp_rtp_header_desc_t *desc,
+                                            uint8_t *rtp,
+                                            size_t *rtp_len)
+{
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, desc, rtp,
+                                   rtp_len, NULL, NULL,
+                                   srtp_unprotect_rtp_path_of(stream));
+}
 
-    return srtp_err_status_ok;
+/*
+ * srtp_stream_select_rtp_paths(stream) points the stream at the RTP packet
+ * paths for its profile, all of its master keys use the same one
+ */
+static void srtp_stream_select_rtp_paths(srtp_stream_ctx_t *stream)
+{
+    const srtp_session_keys_t *keys = &stream->session_keys[0];
+
+    if (srtp_cipher_is_aead(keys->rtp_cipher)) {
+        stream->protect_rtp = srtp_protect_aead;
+        stream->unprotect_rtp = srtp_unprotect_rtp_aead;
+    } else if (srtp_cipher_is_icm(keys->rtp_cipher) &&
+               keys->rtp_auth->type->id == SRTP_HMAC_SHA1 &&
+               stream->rtp_services == sec_serv_conf_and_auth &&
+               stream->enc_xtn_hdr_count == 0 && !stream->use_cryptex) {
+        if (stream->use_mki) {
+            stream->protect_rtp = srtp_protect_rtp_icm_hmac_mki;
+            stream->unprotect_rtp = srtp_unprotect_rtp_icm_hmac_mki;
+        } else {
+            stream->protect_rtp = srtp_protect_rtp_icm_hmac;
+            stream->unprotect_rtp = srtp_unprotect_rtp_icm_hmac;
+        }
+    } else if (keys->rtp_cipher->type->id == SRTP_NULL_CIPHER &&
+               !stream->use_cryptex) {
+        if (keys->rtp_auth->type->id == SRTP_NULL_AUTH) {
+            stream->protect_rtp = srtp_protect_rtp_null;
+            stream->unprotect_rtp = srtp_unprotect_rtp_null;
+        } else {
+            stream->protect_rtp = srtp_protect_rtp_clear;
+            stream->unprotect_rtp = srtp_unprotect_rtp_clear;
+        }
+    } else {
+        stream->protect_rtp = srtp_protect_rtp_any;
+        stream->unprotect_rtp = srtp_unprotect_rtp_any;
+    }
 }
 
-srtp_stream_ctx_t *srtp_get_stream(srtp_t srtp, uint32_t ssrc)
+/*
+ * srtp_unprotect_with_stream() verifies and decrypts a packet whose header has
+ * already been validated. stream is the result of looking up the packet's
+ * ssrc and may be NULL, in which case the template stream is used
+ * provisionally.
+ */
+static srtp_err_status_t srtp_unprotect_with_stream(srtp_ctx_t *ctx,
+                                                    srtp_stream_ctx_t *stream,
+                                                    const uint8_t *srtp,
+                                                    size_t srtp_len,
+                                                    uint8_t *rtp,
+                                                    size_t *rtp_len)
 {
-    return srtp_stream_list_get(srtp->stream_list, ssrc);
+    const srtp_stream_ctx_t *paths =
+        stream != NULL ? stream : ctx->stream_template;
+
+    /*
+     * no stream corresponding to SSRC found, and we don't do key-sharing,
+     * so return an error
+     */
+    if (paths == NULL) {
+        return srtp_err_status_no_ctx;
+    }
+
+    return paths->unprotect_rtp(ctx, stream, srtp, srtp_len, rtp, rtp_len);
 }
 
-srtp_err_status_t srtp_dealloc(srtp_t session)
+/*
+ * srtp_unprotect_rtp_job() is srtp_unprotect_with_stream() for a packet whose
+ * tag, keystream or both srtp_unprotect_batch() computed ahead with job
+ * and cipher_job, either of which may be NULL
+ */
+static srtp_err_status_t srtp_unprotect_rtp_job(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *srtp,
+    size_t srtp_len,
+    uint8_t *rtp,
+    size_t *rtp_len,
+    const srtp_auth_job_t *job,
+    const srtp_cipher_job_t *cipher_job)
 {
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_icm_hmac) {
+        return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL,
+                                       rtp, rtp_len, job, cipher_job,
+                                       SRTP_RTP_PATH_ICM_HMAC);
+    }
+    if (stream->unprotect_rtp == srtp_unprotect_rtp_icm_hmac_mki) {
+        return srtp_unprotect_rtp_path(
+            ctx, stream, srtp, srtp_len, NULL, rtp, rtp_len, job, cipher_job,
+            SRTP_RTP_PATH_ICM_HMAC | SRTP_RTP_PATH_MKI);
+    }
+    return srtp_unprotect_with_stream(ctx, stream, srtp, srtp_len, rtp,
+                                      rtp_len);
+}
+
+/*
+ * srtp_unprotect_overlap(ctx, stream, unprotect, prefer_previous, ...)
+ * unprotects a packet of a stream that still accepts the keys an update
+ * replaced. The keys that most likely protected the packet are tried
+ * first and the other ones only if it does not authenticate; *new_keys
+ * is set to whether the stream's own keys were used.
+ */
+static srtp_err_status_t srtp_unprotect_overlap(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_unprotect_stream_func_t unprotect,
+    bool prefer_previous,
+    const uint8_t *in,
+    size_t in_len,
+    uint8_t *out,
+    size_t *out_len,
+    bool *new_keys)
+{
+    srtp_key_overlap_t *overlap = &stream->cold->overlap;
+    srtp_stream_ctx_t *first = prefer_previous ? overlap->previous : stream;
+    srtp_stream_ctx_t *second = prefer_previous ? stream : overlap->previous;
+    const srtp_cipher_t *cipher = first->session_keys[0].rtp_cipher;
+    bool can_retry = true;
+    size_t len = *out_len;
     srtp_err_status_t status;
 
     /*
-     * we take a conservative deallocation strategy - if we encounter an
-     * error deallocating a stream, then we stop trying to deallocate
-     * memory and just return an error
+     * a failed AEAD decryption has already overwritten the payload, so a
+     * packet unprotected in place is saved to be tried again
      */
-
-    /* deallocate streams */
-    status = srtp_remove_and_dealloc_streams(session->stream_list,
-                                             session->stream_template);
-    if (status) {
-        return status;
+    if (in == out && srtp_cipher_is_aead(cipher)) {
+        if (overlap->scratch_len < in_len) {
+            uint8_t *scratch = (uint8_t *)srtp_crypto_alloc(in_len);
+            if (scratch != NULL) {
+                srtp_crypto_free(overlap->scratch);
+                overlap->scratch = scratch;
+                overlap->scratch_len = in_len;
+            }
+        }
+        can_retry = overlap->scratch_len >= in_len;
+        if (can_retry) {
+            memcpy(overlap->scratch, in, in_len);
+        }
     }
 
-    /* deallocate stream template, if there is one */
-    if (session->stream_template != NULL) {
-        status = srtp_stream_dealloc(session->stream_template, NULL);
-        if (status) {
-            return status;
+    status = unprotect(ctx, first, in, in_len, out, &len);
+    if (can_retry && (status == srtp_err_status_auth_fail ||
+                      status == srtp_err_status_bad_mki)) {
+        if (in == out && overlap->scratch_len >= in_len) {
+            memcpy(out, overlap->scratch, in_len);
         }
+        len = *out_len;
+        first = second;
+        status = unprotect(ctx, first, in, in_len, out, &len);
     }
-
-    /* deallocate stream list */
-    status = srtp_stream_list_dealloc(session->stream_list);
     if (status) {
         return status;
     }
 
-    /* deallocate session context */
-    srtp_crypto_free(session);
+    *out_len = len;
+    *new_keys = first == stream;
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t policy)
+/*
+ * srtp_stream_overlap_count(stream) accounts for a packet unprotected with
+ * the new keys of stream, retiring the previous keys after the last one
+ */
+static void srtp_stream_overlap_count(srtp_stream_ctx_t *stream)
 {
-    srtp_err_status_t status;
-    srtp_stream_t tmp;
-
-    /* sanity check arguments */
-    if (session == NULL) {
-        return srtp_err_status_bad_param;
+    if (--stream->cold->overlap.remaining == 0) {
+        srtp_stream_retire_previous(stream);
     }
+}
 
-    status = srtp_policy_validate(policy);
-    if (status != srtp_err_status_ok) {
-        return status;
-    }
+/*
+ * srtp_unprotect_rtp_overlap() unprotects an SRTP packet of a stream in a
+ * key overlap. Packets with an index below the lowest one seen under the
+ * new keys were most likely sent before the sender switched to them.
+ */
+static srtp_err_status_t srtp_unprotect_rtp_overlap(srtp_ctx_t *ctx,
+                                                    srtp_stream_ctx_t *stream,
+                                                    const uint8_t *srtp,
+                                                    size_t srtp_len,
+                                                    uint8_t *rtp,
+                                                    size_t *rtp_len)
+{
+    srtp_key_overlap_t *overlap = &stream->cold->overlap;
+    srtp_xtd_seq_num_t est;
+    ssize_t delta;
+    bool before_switch;
+    bool new_keys;
+    srtp_err_status_t status;
 
-    /* allocate stream  */
-    status = srtp_stream_alloc(&tmp, policy);
-    if (status) {
-        return status;
-    }
+    srtp_get_est_pkt_index((const srtp_hdr_t *)srtp, stream, &est, &delta);
+    before_switch = !overlap->rtp_switched || est < overlap->rtp_index;
 
-    /* initialize stream  */
-    status = srtp_stream_init(tmp, policy);
-    if (status) {
-        srtp_stream_dealloc(tmp, NULL);
+    status = srtp_unprotect_overlap(ctx, stream, srtp_unprotect_with_stream,
+                                    before_switch, srtp, srtp_len, rtp,
+                                    rtp_len, &new_keys);
+    if (status || !new_keys) {
         return status;
     }
 
-    /*
-     * set the head of the stream list or the template to point to the
-     * stream that we've just alloced and init'ed, depending on whether
-     * or not it has a wildcard SSRC value or not
-     *
-     * if the template stream has already been set, then the policy is
-     * inconsistent, so we return a bad_param error code
-     */
-    switch (policy->ssrc.type) {
-    case (ssrc_any_outbound):
-        if (session->stream_template) {
-            srtp_stream_dealloc(tmp, NULL);
-            return srtp_err_status_bad_param;
-        }
-        session->stream_template = tmp;
-        session->stream_template->direction = dir_srtp_sender;
-        break;
-    case (ssrc_any_inbound):
-        if (session->stream_template) {
-            srtp_stream_dealloc(tmp, NULL);
-            return srtp_err_status_bad_param;
-        }
-        session->stream_template = tmp;
-        session->stream_template->direction = dir_srtp_receiver;
-        break;
-    case (ssrc_specific):
-        status = srtp_insert_or_dealloc_stream(session->stream_list, tmp,
-                                               session->stream_template);
-        if (status) {
-            return status;
-        }
-        break;
-    case (ssrc_undefined):
-    default:
-        srtp_stream_dealloc(tmp, NULL);
-        return srtp_err_status_bad_param;
+    if (before_switch) {
+        overlap->rtp_index = est;
+        overlap->rtp_switched = true;
     }
+    srtp_stream_overlap_count(stream);
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_create(srtp_t *session, /* handle for session     */
-                              const srtp_policy_t policy)
-{ /* SRTP policy (list)     */
-    srtp_err_status_t stat;
-    srtp_ctx_t *ctx;
-
-    /* sanity check arguments */
-    if (session == NULL) {
-        return srtp_err_status_bad_param;
-    }
+/*
+ * srtp_breaker_allow(ctx) returns false if a packet for an unknown SSRC
+ * is to be rejected without being verified with the template, see
+ * srtp_breaker_t
+ */
+static bool srtp_breaker_allow(srtp_ctx_t *ctx)
+{
+    srtp_breaker_t *breaker = &ctx->breaker;
 
-    if (policy) {
-        stat = srtp_policy_validate(policy);
-        if (stat != srtp_err_status_ok) {
-            return stat;
-        }
+    if (breaker->skip == 0) {
+        return true;
     }
+    breaker->skip--;
+    breaker->rejected++;
 
-    /* allocate srtp context and set ctx_ptr */
-    ctx = (srtp_ctx_t *)srtp_crypto_alloc(sizeof(srtp_ctx_t));
-    if (ctx == NULL) {
-        return srtp_err_status_alloc_fail;
-    }
-    *session = ctx;
+    return false;
+}
 
-    ctx->stream_template = NULL;
-    ctx->stream_list = NULL;
-    ctx->user_data = NULL;
+/*
+ * srtp_breaker_count(ctx, status) accounts for the result of verifying a
+ * packet for an unknown SSRC with the template
+ */
+static void srtp_breaker_count(srtp_ctx_t *ctx, srtp_err_status_t status)
+{
+    srtp_breaker_t *breaker = &ctx->breaker;
 
-    /* allocate stream list */
-    stat = srtp_stream_list_alloc(&ctx->stream_list);
-    if (stat) {
-        /* clean up everything */
-        srtp_dealloc(*session);
-        *session = NULL;
-        return stat;
+    if (breaker->max_failures == 0) {
+        return;
     }
-
-    /*
-     * loop over elements in the policy list, allocating and
-     * initializing a stream for each element
-     */
-    if (policy != NULL) {
-        stat = srtp_stream_add(ctx, policy);
-        if (stat) {
-            /* clean up everything */
-            srtp_dealloc(*session);
-            *session = NULL;
-            return stat;
-        }
+    if (status == srtp_err_status_ok) {
+        breaker->failures = 0;
+        return;
     }
 
-    return srtp_err_status_ok;
+    /* once open, a single failure of the packet let through reopens it */
+    if (++breaker->failures >= breaker->max_failures) {
+        breaker->failures = breaker->max_failures - 1;
+        breaker->skip = breaker->cooldown;
+    }
 }
 
-srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc)
+/*
+ * srtp_unprotect_rtp_counted(ctx, stream, ...) unprotects a validated RTP
+ * packet with stream, the result of looking up its SSRC, and counts it in
+ * the statistics of its stream. If the packet was accepted with the
+ * template, *stream_ptr is updated to the stream cloned for its SSRC;
+ * packets rejected without a stream of their own are not counted. job and
+ * cipher_job are NULL unless srtp_unprotect_batch() computed the tag or the
+ * keystream of the packet ahead.
+ */
+static srtp_err_status_t srtp_unprotect_rtp_counted(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t **stream_ptr,
+    const uint8_t *srtp,
+    size_t srtp_len,
+    uint8_t *rtp,
+    size_t *rtp_len,
+    const srtp_auth_job_t *job,
+    const srtp_cipher_job_t *cipher_job)
 {
-    srtp_stream_ctx_t *stream;
+    srtp_stream_ctx_t *stream = *stream_ptr;
     srtp_err_status_t status;
+    bool provisional = stream == NULL && ctx->stream_template != NULL;
 
-    /* sanity check arguments */
-    if (session == NULL) {
+    /* only RTP version 2 can be SRTP, anything else is not worth a look */
+    if (((const srtp_hdr_t *)srtp)->version != 2) {
         return srtp_err_status_bad_param;
     }
 
-    /* find and remove stream from the list */
-    stream = srtp_stream_list_get(session->stream_list, htonl(ssrc));
-    if (stream == NULL) {
+    if (provisional && !srtp_breaker_allow(ctx)) {
         return srtp_err_status_no_ctx;
     }
 
-    srtp_stream_list_remove(session->stream_list, stream);
+    if (stream != NULL && srtp_stream_in_overlap(stream)) {
+        status = srtp_unprotect_rtp_overlap(ctx, stream, srtp, srtp_len, rtp,
+                                            rtp_len);
+    } else if (stream != NULL && (job != NULL || cipher_job != NULL)) {
+        status = srtp_unprotect_rtp_job(ctx, stream, srtp, srtp_len, rtp,
+                                        rtp_len, job, cipher_job);
+    } else {
+        status = srtp_unprotect_with_stream(ctx, stream, srtp, srtp_len, rtp,
+                                            rtp_len);
+    }
 
-    /* deallocate the stream */
-    status = srtp_stream_dealloc(stream, session->stream_template);
-    if (status) {
-        return status;
+    if (provisional) {
+        srtp_breaker_count(ctx, status);
     }
 
-    return srtp_err_status_ok;
+    if (stream == NULL) {
+        if (status) {
+            return status;
+        }
+        stream = srtp_get_stream(ctx, ((const srtp_hdr_t *)rtp)->ssrc);
+        *stream_ptr = stream;
+        if (stream == NULL) {
+            return status;
+        }
+    }
+
+    srtp_stream_stats_count(ctx, stream, true, false, status, *rtp_len);
+
+    return status;
 }
 
-srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t policy)
+static srtp_err_status_t srtp_unprotect_unlocked(srtp_t ctx,
+                                                 const uint8_t *srtp,
+                                                 size_t srtp_len,
+                                                 uint8_t *rtp,
+                                                 size_t *rtp_len)
 {
-    srtp_err_status_t stat;
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+    SRTP_STAGE_START(t);
 
-    /* sanity check arguments */
-    if (session == NULL) {
-        return srtp_err_status_bad_param;
-    }
+    debug_trace0(mod_srtp, "function srtp_unprotect");
 
-    stat = srtp_policy_validate(policy);
-    if (stat != srtp_err_status_ok) {
-        return stat;
+    /* Verify RTP header */
+    status = srtp_validate_rtp_header(srtp, srtp_len);
+    if (status) {
+        return status;
     }
 
-    if (policy != NULL) {
-        stat = srtp_stream_update(session, policy);
-        if (stat) {
-            return stat;
-        }
+    /* check the packet length - it must at least contain a full header */
+    if (srtp_len < octets_in_rtp_header) {
+        return srtp_err_status_bad_param;
     }
-    return srtp_err_status_ok;
-}
 
-struct update_template_stream_data {
-    srtp_err_status_t status;
-    srtp_t session;
-    srtp_stream_t new_stream_template;
-    srtp_stream_list_t new_stream_list;
-};
+    /*
+     * look up ssrc in srtp_stream list, and process the packet with
+     * the appropriate stream.
+     */
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
 
-static bool update_template_stream_cb(srtp_stream_t stream, void *raw_data)
+    return srtp_unprotect_rtp_counted(ctx, &stream, srtp, srtp_len, rtp,
+                                      rtp_len, NULL, NULL);
+}
+
+srtp_err_status_t srtp_unprotect(srtp_t ctx,
+                                 const uint8_t *srtp,
+                                 size_t srtp_len,
+                                 uint8_t *rtp,
+                                 size_t *rtp_len)
 {
-    struct update_template_stream_data *data =
-        (struct update_template_stream_data *)raw_data;
-    srtp_t session = data->session;
-    uint32_t ssrc = stream->ssrc;
-    srtp_xtd_seq_num_t old_index;
-    srtp_rdb_t old_rtcp_rdb;
+    srtp_stream_ctx_t *stream;
+    unsigned int locks = SRTP_STREAM_LOCK_RTP;
+    srtp_err_status_t status;
 
-    /* old / non-template streams are copied unchanged */
-    if (stream->session_keys[0].rtp_auth !=
-        session->stream_template->session_keys[0].rtp_auth) {
-        srtp_stream_list_remove(session->stream_list, stream);
-        data->status = srtp_insert_or_dealloc_stream(
-            data->new_stream_list, stream, session->stream_template);
-        if (data->status) {
-            return false;
-        }
-        return true;
+    if (ctx == NULL || !ctx->thread_safe) {
+        status = srtp_unprotect_unlocked(ctx, srtp, srtp_len, rtp, rtp_len);
+    } else {
+        stream = srtp_session_enter_packet(ctx, srtp, srtp_len, 8, &locks);
+        status = srtp_unprotect_unlocked(ctx, srtp, srtp_len, rtp, rtp_len);
+        srtp_session_leave_locks(ctx, stream, locks);
     }
+    SRTP_PROBE3(unprotect, srtp_probe_ssrc(srtp, srtp_len, 8), srtp_len,
+                status);
 
-    /* save old extended seq */
-    old_index = stream->rtp_rdbx.index;
-    old_rtcp_rdb = stream->rtcp_rdb;
+    return status;
+}
 
-    /* remove stream */
-    data->status = srtp_stream_remove(session, ntohl(ssrc));
-    if (data->status) {
-        return false;
+srtp_err_status_t srtp_stream_lookup(srtp_t session,
+                                     uint32_t ssrc,
+                                     srtp_stream_handle_t *handle)
+{
+    srtp_stream_ctx_t *stream;
+
+    if (session == NULL || handle == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    /* allocate and initialize a new stream */
-    data->status = srtp_stream_clone(data->new_stream_template, ssrc, &stream);
-    if (data->status) {
-        return false;
+    if (session->thread_safe) {
+        srtp_rwlock_read_lock(&session->lock);
+    }
+    stream = srtp_get_stream(session, htonl(ssrc));
+    handle->stream = stream;
+    handle->generation = session->stream_generation;
+    if (session->thread_safe) {
+        srtp_rwlock_read_unlock(&session->lock);
     }
 
-    /* add new stream to the head of the new_stream_list */
-    data->status = srtp_insert_or_dealloc_stream(data->new_stream_list, stream,
-                                                 data->new_stream_template);
-    if (data->status) {
-        return false;
+    return stream != NULL ? srtp_err_status_ok : srtp_err_status_no_ctx;
+}
+
+/*
+ * srtp_handle_enter(ctx, handle) returns the stream of handle, with the
+ * locks for processing one of its RTP packets acquired in a thread safe
+ * session, or NULL if a stream was removed or replaced since the lookup
+ * of handle; the stream list does not change while the session lock is
+ * held shared, so the generation is only compared under it
+ */
+static srtp_stream_ctx_t *srtp_handle_enter(srtp_t ctx,
+                                            const srtp_stream_handle_t *handle)
+{
+    srtp_stream_ctx_t *stream = (srtp_stream_ctx_t *)handle->stream;
+
+    if (ctx->thread_safe) {
+        srtp_rwlock_read_lock(&ctx->lock);
+    }
+    if (stream == NULL || handle->generation != ctx->stream_generation) {
+        if (ctx->thread_safe) {
+            srtp_rwlock_read_unlock(&ctx->lock);
+        }
+        return NULL;
+    }
+    if (ctx->thread_safe) {
+        srtp_spinlock_lock(&stream->lock);
     }
 
-    /* restore old extended seq */
-    stream->rtp_rdbx.index = old_index;
-    stream->rtcp_rdb = old_rtcp_rdb;
+    return stream;
+}
 
-    return true;
+/* srtp_handle_leave(ctx, stream) releases what srtp_handle_enter took */
+static void srtp_handle_leave(srtp_t ctx, srtp_stream_ctx_t *stream)
+{
+    if (ctx->thread_safe) {
+        srtp_spinlock_unlock(&stream->lock);
+        srtp_rwlock_read_unlock(&ctx->lock);
+    }
 }
 
-static srtp_err_status_t is_update_policy_compatable(srtp_stream_t stream,
-                                                     const srtp_policy_t policy)
+/*
+ * srtp_protect_handle_unlocked() is srtp_protect_unlocked() for a stream
+ * that is known already, there is no template to clone from
+ */
+static srtp_err_status_t srtp_protect_handle_unlocked(srtp_t ctx,
+                                                      srtp_stream_ctx_t *stream,
+                                                      const uint8_t *rtp,
+                                                      size_t rtp_len,
+                                                      uint8_t *srtp,
+                                                      size_t *srtp_len,
+                                                      size_t mki_index)
 {
-    if (stream->use_mki != policy->use_mki) {
-        return srtp_err_status_bad_param;
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+    srtp_rtp_header_desc_t desc;
+    srtp_session_keys_t *session_keys = NULL;
+    srtp_err_status_t status;
+
+    status = srtp_rtp_header_parse(rtp, rtp_len, &desc);
+    if (status) {
+        return status;
     }
 
-    if (stream->use_mki && stream->mki_size != policy->mki_size) {
+    /* the packet has to belong to the stream, its SSRC is in the IV */
+    if (hdr->ssrc != stream->ssrc) {
         return srtp_err_status_bad_param;
     }
 
-    return srtp_err_status_ok;
+    /*
+     * verify that stream is for sending traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     */
+    srtp_stream_check_direction(ctx, stream, dir_srtp_sender);
+
+    status = srtp_get_session_keys(stream, mki_index, &session_keys);
+    if (status == srtp_err_status_ok) {
+        status = srtp_protect_with_stream(ctx, stream, session_keys, rtp,
+                                          rtp_len, &desc, srtp, srtp_len);
+    }
+    srtp_stream_stats_count(ctx, stream, true, true, status, rtp_len);
+
+    return status;
 }
 
-static srtp_err_status_t update_template_streams(srtp_t session,
-                                                 const srtp_policy_t policy)
+srtp_err_status_t srtp_protect_stream(srtp_t ctx,
+                                      const srtp_stream_handle_t *handle,
+                                      const uint8_t *rtp,
+                                      size_t rtp_len,
+                                      uint8_t *srtp,
+                                      size_t *srtp_len,
+                                      size_t mki_index)
 {
+    srtp_stream_ctx_t *stream;
     srtp_err_status_t status;
-    srtp_stream_t new_stream_template;
-    srtp_stream_list_t new_stream_list;
 
-    if (session->stream_template == NULL) {
+    if (ctx == NULL || handle == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    status = is_update_policy_compatable(session->stream_template, policy);
-    if (status != srtp_err_status_ok) {
-        return status;
+    stream = srtp_handle_enter(ctx, handle);
+    if (stream == NULL) {
+        return srtp_err_status_no_ctx;
     }
+    status = srtp_protect_handle_unlocked(ctx, stream, rtp, rtp_len, srtp,
+                                          srtp_len, mki_index);
+    srtp_handle_leave(ctx, stream);
+    SRTP_PROBE3(protect, srtp_probe_ssrc(rtp, rtp_len, 8), rtp_len, status);
 
-    /* allocate new template stream  */
-    status = srtp_stream_alloc(&new_stream_template, policy);
-    if (status) {
-        return status;
-    }
+    return status;
+}
 
-    /* initialize new template stream  */
-    status = srtp_stream_init(new_stream_template, policy);
-    if (status) {
-        srtp_crypto_free(new_stream_template);
-        return status;
+srtp_err_status_t srtp_unprotect_stream(srtp_t ctx,
+                                        const srtp_stream_handle_t *handle,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        uint8_t *rtp,
+                                        size_t *rtp_len)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || handle == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    /* allocate new stream list */
-    status = srtp_stream_list_alloc(&new_stream_list);
-    if (status) {
-        srtp_crypto_free(new_stream_template);
-        return status;
+    stream = srtp_handle_enter(ctx, handle);
+    if (stream == NULL) {
+        return srtp_err_status_no_ctx;
     }
 
-    /* process streams */
-    struct update_template_stream_data data = { srtp_err_status_ok, session,
-                                                new_stream_template,
-                                                new_stream_list };
-    srtp_stream_list_for_each(session->stream_list, update_template_stream_cb,
-                              &data);
-    if (data.status) {
-        /* free new allocations */
-        srtp_remove_and_dealloc_streams(new_stream_list, new_stream_template);
-        srtp_stream_list_dealloc(new_stream_list);
-        srtp_stream_dealloc(new_stream_template, NULL);
-        return data.status;
+    status = srtp_validate_rtp_header(srtp, srtp_len);
+    if (status == srtp_err_status_ok && srtp_len < octets_in_rtp_header) {
+        status = srtp_err_status_bad_param;
+    }
+    if (status == srtp_err_status_ok &&
+        ((const srtp_hdr_t *)srtp)->ssrc != stream->ssrc) {
+        status = srtp_err_status_bad_param;
+    }
+    if (status == srtp_err_status_ok) {
+        status = srtp_unprotect_rtp_counted(ctx, &stream, srtp, srtp_len, rtp,
+                                            rtp_len, NULL, NULL);
     }
 
-    /* dealloc old list / template */
-    srtp_remove_and_dealloc_streams(session->stream_list,
-                                    session->stream_template);
-    srtp_stream_list_dealloc(session->stream_list);
-    srtp_stream_dealloc(session->stream_template, NULL);
+    srtp_handle_leave(ctx, stream);
+    SRTP_PROBE3(unprotect, srtp_probe_ssrc(srtp, srtp_len, 8), srtp_len,
+                status);
 
-    /* set new list / template */
-    session->stream_template = new_stream_template;
-    session->stream_list = new_stream_list;
-    return srtp_err_status_ok;
+    return status;
 }
 
-static srtp_err_status_t stream_update(srtp_t session,
-                                       const srtp_policy_t policy)
+/*
+ * srtp_unprotect_headers_unlocked() does the work of
+ * srtp_unprotect_headers(); the modes are added to the packet path at run
+ * time, as they are not worth an expansion for each profile
+ */
+static srtp_err_status_t srtp_unprotect_headers_unlocked(srtp_t ctx,
+                                                         const uint8_t *srtp,
+                                                         size_t srtp_len,
+                                                         uint8_t *rtp,
+                                                         size_t *rtp_len,
+                                                         bool update_replay)
 {
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    const srtp_stream_ctx_t *paths;
+    srtp_stream_ctx_t *stream;
+    unsigned int path = SRTP_RTP_PATH_HEADERS;
     srtp_err_status_t status;
-    srtp_xtd_seq_num_t old_index;
-    srtp_rdb_t old_rtcp_rdb;
-    srtp_stream_t stream;
 
-    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
-    if (stream == NULL) {
+    if (ctx == NULL || rtp == NULL || rtp_len == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    status = is_update_policy_compatable(stream, policy);
-    if (status != srtp_err_status_ok) {
+    status = srtp_validate_rtp_header(srtp, srtp_len);
+    if (status) {
         return status;
     }
+    if (hdr->version != 2) {
+        return srtp_err_status_bad_param;
+    }
 
-    /* save old extendard seq */
-    old_index = stream->rtp_rdbx.index;
-    old_rtcp_rdb = stream->rtcp_rdb;
-
-    status = srtp_stream_remove(session, policy->ssrc.value);
-    if (status) {
-        return status;
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    paths = stream != NULL ? stream : ctx->stream_template;
+    if (paths == NULL) {
+        return srtp_err_status_no_ctx;
     }
 
-    status = srtp_stream_add(session, policy);
-    if (status) {
-        return status;
+    if (paths->unprotect_rtp == srtp_unprotect_rtp_aead) {
+        path |= SRTP_RTP_PATH_AEAD;
+    }
+    if (!update_replay) {
+        path |= SRTP_RTP_PATH_NO_REPLAY;
     }
 
-    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
-    if (stream == NULL) {
-        return srtp_err_status_fail;
+    return srtp_unprotect_rtp_path(ctx, stream, srtp, srtp_len, NULL, rtp,
+                                   rtp_len, NULL, NULL, path);
+}
+
+srtp_err_status_t srtp_unprotect_headers(srtp_t ctx,
+                                         const uint8_t *srtp,
+                                         size_t srtp_len,
+                                         uint8_t *rtp,
+                                         size_t *rtp_len,
+                                         bool update_replay)
+{
+    srtp_stream_ctx_t *stream;
+    unsigned int locks = SRTP_STREAM_LOCK_RTP;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || !ctx->thread_safe) {
+        return srtp_unprotect_headers_unlocked(ctx, srtp, srtp_len, rtp,
+                                               rtp_len, update_replay);
     }
 
-    /* restore old extended seq */
-    stream->rtp_rdbx.index = old_index;
-    stream->rtcp_rdb = old_rtcp_rdb;
+    stream = srtp_session_enter_packet(ctx, srtp, srtp_len, 8, &locks);
+    status = srtp_unprotect_headers_unlocked(ctx, srtp, srtp_len, rtp, rtp_len,
+                                             update_replay);
+    srtp_session_leave_locks(ctx, stream, locks);
 
-    return srtp_err_status_ok;
+    return status;
 }
 
-srtp_err_status_t srtp_stream_update(srtp_t session, const srtp_policy_t policy)
+srtp_err_status_t srtp_transcrypt(srtp_t in_session,
+                                  const uint8_t *srtp,
+                                  size_t srtp_len,
+                                  srtp_transcrypt_target_t *targets,
+                                  size_t num_targets)
 {
     srtp_err_status_t status;
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    uint8_t *rtp;
+    size_t rtp_len;
 
-    /* sanity check arguments */
-    if (session == NULL) {
+    if (in_session == NULL || srtp == NULL || targets == NULL ||
+        num_targets == 0) {
         return srtp_err_status_bad_param;
     }
 
-    status = srtp_policy_validate(policy);
-    if (status != srtp_err_status_ok) {
+    /*
+     * the packet is decrypted into the buffer of the last target, which
+     * is protected last, so that the others can copy it from there
+     */
+    rtp = targets[num_targets - 1].out;
+    rtp_len = targets[num_targets - 1].out_len;
+    if (rtp == NULL) {
+        status = srtp_err_status_bad_param;
+    } else {
+        status = srtp_unprotect(in_session, srtp, srtp_len, rtp, &rtp_len);
+    }
+    if (status) {
+        for (size_t i = 0; i < num_targets; i++) {
+            targets[i].status = status;
+        }
         return status;
     }
 
-    switch (policy->ssrc.type) {
-    case (ssrc_any_outbound):
-    case (ssrc_any_inbound):
-        status = update_template_streams(session, policy);
-        break;
-    case (ssrc_specific):
-        status = stream_update(session, policy);
-        break;
-    case (ssrc_undefined):
-    default:
-        return srtp_err_status_bad_param;
+    for (size_t i = 0; i < num_targets; i++) {
+        srtp_transcrypt_target_t *target = &targets[i];
+        srtp_hdr_t *hdr = (srtp_hdr_t *)target->out;
+
+        if (target->session == NULL || target->out == NULL) {
+            target->status = srtp_err_status_bad_param;
+        } else if (target->out != rtp && target->out_len < rtp_len) {
+            target->status = srtp_err_status_buffer_small;
+        } else {
+            if (target->out != rtp) {
+                memcpy(target->out, rtp, rtp_len);
+            }
+            if (target->rewrite) {
+                hdr->ssrc = htonl(target->ssrc);
+                hdr->seq = htons(target->seq);
+            }
+            target->status =
+                srtp_protect(target->session, target->out, rtp_len,
+                             target->out, &target->out_len, target->mki_index);
+            /* the copy was not protected, or not entirely */
+            if (target->status) {
+                octet_string_set_to_zero(target->out, rtp_len);
+            }
+        }
+        if (target->status && first_failure == srtp_err_status_ok) {
+            first_failure = target->status;
+        }
     }
 
-    return status;
+    /* no copy of the decrypted packet is left behind */
+    if (targets[num_targets - 1].status) {
+        octet_string_set_to_zero(rtp, rtp_len);
+    }
+
+    return first_failure;
 }
 
 /*
- * secure rtcp functions
+ * SRTP_PREFETCH(addr) hints that the cache line holding addr is to be
+ * read soon; it never faults, so addr need not be valid
  */
+#if defined(__GNUC__) || defined(__clang__)
+#define SRTP_PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define SRTP_PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#else
+#define SRTP_PREFETCH(addr) ((void)(addr))
+#endif
 
 /*
- * AEAD uses a new IV formation method.  This function implements
- * section 9.1 (SRTCP IV Formation for AES-GCM) from RFC7714.
- * The calculation is defined as, where (+) is the xor operation:
+ * The state a packet needs is reached through a chain of pointers, from
+ * the stream to its session keys, to their cipher and authentication
+ * contexts and to the state of those, and once the streams outgrow the
+ * caches each link is a miss. The batch functions walk the chain ahead of
+ * the packet they process, a link further for each packet closer to it:
  *
- *                0  1  2  3  4  5  6  7  8  9 10 11
- *               +--+--+--+--+--+--+--+--+--+--+--+--+
- *               |00|00|    SSRC   |00|00|0+SRTCP Idx|---+
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *                                                       |
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *               |         Encryption Salt           |->(+)
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *                                                       |
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *               |       Initialization Vector       |<--+
- *               +--+--+--+--+--+--+--+--+--+--+--+--+*
- *
- * Input:  *session_keys - pointer to SRTP stream context session keys,
- *                        used to retrieve the SALT
- *         *iv           - Pointer to recieve the calculated IV
- *         seq_num       - The SEQ value to use for the IV calculation.
- *         *hdr          - The RTP header, used to get the SSRC value
+ *   packet i + 5  its header
+ *   packet i + 4  the stream
+ *   packet i + 3  the session keys and the replay window
+ *   packet i + 2  the cipher and authentication contexts
+ *   packet i + 1  the state of those
  *
- * Returns: srtp_err_status_ok if no error or srtp_err_status_bad_param
- *          if seq_num is invalid
+ * so that the misses of the next packets overlap the work on packet i,
+ * and every link read at a stage was prefetched by the previous one.
  *
+ * Each stage looks the stream up again instead of keeping it, since
+ * processing a packet can remove streams; the lookup of a stream reached
+ * before hits the cache.
  */
-static srtp_err_status_t srtp_calc_aead_iv_srtcp(
-    srtp_session_keys_t *session_keys,
-    v128_t *iv,
-    uint32_t seq_num,
-    const srtcp_hdr_t *hdr)
-{
-    v128_t in;
-    v128_t salt;
+#define SRTP_BATCH_PREFETCH_DEPTH 4
 
-    memset(&in, 0, sizeof(v128_t));
-    memset(&salt, 0, sizeof(v128_t));
+/*
+ * The batch functions also compute the tags of up to SRTP_BATCH_JOBS
+ * packets of streams on the SRTP_RTP_PATH_ICM_HMAC paths together, with
+ * srtp_auth_compute_jobs(), when their auth function can do that faster.
+ * srtp_protect_batch() leaves the tags of the packets it protects until it
+ * has a full set, srtp_unprotect_batch() computes those of a set before
+ * processing its packets, and each of these only compares its tag if its
+ * stream still has the key and the ROC the tag was computed with.
+ */
+#define SRTP_BATCH_JOBS 16
+
+/*
+ * The keystream of the packets of a set is computed together too, with
+ * srtp_cipher_compute_jobs(), when their cipher can do that; then the
+ * blocks of the packets of different streams, and so of different keys,
+ * are in flight together instead of one short packet after the other.
+ * Up to SRTP_BATCH_KEYSTREAM_OCTETS of keystream are computed per set,
+ * which covers the small packets of audio streams that gain the most, and
+ * a packet only uses it if its stream still has the key and the ROC it
+ * was computed with.
+ */
+#define SRTP_BATCH_KEYSTREAM_OCTETS 4096
 
-    in.v16[0] = 0;
-    memcpy(&in.v16[1], &hdr->ssrc, 4); /* still in network order! */
-    in.v16[3] = 0;
+typedef struct {
+    srtp_cipher_job_t jobs[SRTP_BATCH_JOBS];
+    const srtp_cipher_job_t *pkt_jobs[SRTP_BATCH_JOBS];
+    uint8_t keystream[SRTP_BATCH_KEYSTREAM_OCTETS];
+} srtp_batch_keystream_t;
 
-    /*
-     *  The SRTCP index (seq_num) spans bits 0 through 30 inclusive.
-     *  The most significant bit should be zero.
-     */
-    if (seq_num & 0x80000000UL) {
-        return srtp_err_status_bad_param;
+/*
+ * srtp_batch_ssrc(pkt, ssrc) sets ssrc to that of the RTP packet pkt,
+ * returning false if it is too short to have one
+ */
+static bool srtp_batch_ssrc(const srtp_packet_desc_t *pkt, uint32_t *ssrc)
+{
+    if (pkt->in == NULL || pkt->in_len < octets_in_rtp_header) {
+        return false;
     }
-    in.v32[2] = htonl(seq_num);
+    *ssrc = ((const srtp_hdr_t *)pkt->in)->ssrc;
+    return true;
+}
 
-    debug_print(mod_srtp, "Pre-salted RTCP IV = %s\n", v128_hex_string(&in));
+/*
+ * srtp_batch_prefetch(ctx, pkts, num_pkts, i, protect) advances the
+ * prefetch of the packets after pkts[i] by a stage, see above; the
+ * session must not be thread safe
+ */
+static void srtp_batch_prefetch(srtp_ctx_t *ctx,
+                                const srtp_packet_desc_t *pkts,
+                                size_t num_pkts,
+                                size_t i,
+                                bool protect)
+{
+    uint32_t previous = 0;
+    bool have_previous = srtp_batch_ssrc(&pkts[i], &previous);
+
+    for (size_t ahead = 1; ahead <= SRTP_BATCH_PREFETCH_DEPTH + 1; ahead++) {
+        const srtp_packet_desc_t *pkt;
+        srtp_stream_ctx_t *stream;
+        const srtp_session_keys_t *keys;
+        size_t mki_index = 0;
+        uint32_t ssrc;
+        bool same;
+
+        if (i + ahead >= num_pkts) {
+            break;
+        }
+        pkt = &pkts[i + ahead];
 
-    /*
-     * Get the SALT value from the context
-     */
-    memcpy(salt.v8, session_keys->c_salt, 12);
-    debug_print(mod_srtp, "RTCP SALT = %s\n", v128_hex_string(&salt));
+        if (ahead > SRTP_BATCH_PREFETCH_DEPTH) {
+            SRTP_PREFETCH(pkt->in);
+            break;
+        }
 
-    /*
-     * Finally, apply the SALT to the input
-     */
-    v128_xor(iv, &in, &salt);
+        /* the stream of a run of packets is only walked for the first */
+        same = have_previous;
+        have_previous = srtp_batch_ssrc(pkt, &ssrc);
+        if (!have_previous || (same && ssrc == previous)) {
+            previous = ssrc;
+            continue;
+        }
+        previous = ssrc;
 
-    return srtp_err_status_ok;
+        stream = srtp_get_stream(ctx, ssrc);
+        if (stream == NULL) {
+            /* the packet is for, or clones, the template */
+            stream = ctx->stream_template;
+            if (stream == NULL) {
+                continue;
+            }
+        }
+
+        if (ahead == SRTP_BATCH_PREFETCH_DEPTH) {
+            for (size_t off = 0; off < sizeof(*stream);
+                 off += SRTP_CACHE_LINE_SIZE) {
+                SRTP_PREFETCH((const uint8_t *)stream + off);
+            }
+            continue;
+        }
+
+        if (protect && pkt->mki_index < stream->num_master_keys) {
+            mki_index = pkt->mki_index;
+        }
+        keys = &stream->session_keys[mki_index];
+
+        switch (ahead) {
+        case 3:
+            SRTP_PREFETCH(keys);
+            SRTP_PREFETCH(stream->rtp_rdbx.bitmask);
+            break;
+        case 2:
+            SRTP_PREFETCH(keys->rtp_cipher);
+            SRTP_PREFETCH(keys->rtp_auth);
+            break;
+        default:
+            if (keys->rtp_cipher != NULL) {
+                SRTP_PREFETCH(keys->rtp_cipher->state);
+                SRTP_PREFETCH((const uint8_t *)keys->rtp_cipher->state +
+                              SRTP_CACHE_LINE_SIZE);
+            }
+            if (keys->rtp_auth != NULL) {
+                SRTP_PREFETCH(keys->rtp_auth->state);
+                SRTP_PREFETCH((const uint8_t *)keys->rtp_auth->state +
+                              SRTP_CACHE_LINE_SIZE);
+            }
+            break;
+        }
+    }
 }
 
 /*
- * This code handles AEAD ciphers for outgoing RTCP.  We currently support
- * AES-GCM mode with 128 or 256 bit keys.
+ * srtp_batch_info_t is what the jobs of a set need to know of a packet,
+ * stream is NULL for packets that are left to their stream
  */
-static srtp_err_status_t srtp_protect_rtcp_aead(
-    srtp_stream_ctx_t *stream,
-    const uint8_t *rtcp,
-    size_t rtcp_len,
-    uint8_t *srtcp,
-    size_t *srtcp_len,
-    srtp_session_keys_t *session_keys)
-{
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
-    size_t enc_start;         /* pointer to start of encrypted portion  */
-    uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;         /* trailer value                          */
-    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
-    srtp_err_status_t status;
-    size_t tag_len;
-    uint32_t seq_num;
-    v128_t iv;
-
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+typedef struct {
+    srtp_stream_ctx_t *stream;
+    srtp_session_keys_t *session_keys;
+    size_t trailer_len; /* MKI and tag of a packet to unprotect */
+    srtp_xtd_seq_num_t est;
+    srtp_err_status_t parse_status; /* of the header, described in desc */
+    srtp_rtp_header_desc_t desc;    /* unless parse_status is set      */
+} srtp_batch_info_t;
 
-    /*
-     * set encryption start and encryption length - if we're not
-     * providing confidentiality, set enc_start to NULL
-     */
-    enc_start = octets_in_rtcp_header;
-    enc_octet_len = rtcp_len - enc_start;
+/*
+ * srtp_batch_packet(ctx, pkt, protect, info) parses the header of pkt and
+ * finds its stream and session keys for the jobs of a set, returning false
+ * for packets that are left to their stream, which includes those of
+ * streams not on the SRTP_RTP_PATH_ICM_HMAC paths, of the template and of
+ * streams with overlapping keys
+ */
+static bool srtp_batch_packet(srtp_ctx_t *ctx,
+                              const srtp_packet_desc_t *pkt,
+                              bool protect,
+                              srtp_batch_info_t *info)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)pkt->in;
+    srtp_stream_ctx_t *stream;
+    size_t mki_size = 0;
 
-    /* check output length */
-    if (*srtcp_len <
-        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
-        return srtp_err_status_buffer_small;
+    info->parse_status = srtp_rtp_header_parse(pkt->in, pkt->in_len,
+                                               &info->desc);
+    if (info->parse_status || (!protect && hdr->version != 2)) {
+        return false;
     }
 
-    /* if not-inplace then need to copy full rtcp header */
-    if (rtcp != srtcp) {
-        memcpy(srtcp, rtcp, enc_start);
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL || stream->num_master_keys == 0 ||
+        stream->session_keys == NULL) {
+        return false;
     }
 
-    /* NOTE: hdr->length is not usable - it refers to only the first
-     * RTCP report in the compound packet!
-     */
-    trailer_p = srtcp + enc_start + enc_octet_len + tag_len;
-
-    if (stream->rtcp_services & sec_serv_conf) {
-        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
+    if (protect) {
+        if (stream->protect_rtp != srtp_protect_rtp_icm_hmac &&
+            stream->protect_rtp != srtp_protect_rtp_icm_hmac_mki) {
+            return false;
+        }
+        if (srtp_get_session_keys(stream, pkt->mki_index,
+                                  &info->session_keys)) {
+            return false;
+        }
+        info->trailer_len = 0;
     } else {
-        /* 0 is network-order independent */
-        trailer = 0x00000000; /* set encrypt bit */
+        if (srtp_stream_in_overlap(stream)) {
+            return false;
+        }
+        if (stream->unprotect_rtp == srtp_unprotect_rtp_icm_hmac) {
+            info->session_keys = &stream->session_keys[0];
+        } else if (stream->unprotect_rtp == srtp_unprotect_rtp_icm_hmac_mki) {
+            mki_size = stream->mki_size;
+            if (srtp_get_session_keys_for_rtp_packet(
+                    stream, pkt->in, pkt->in_len, &info->session_keys)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        info->trailer_len =
+            srtp_auth_get_tag_length(info->session_keys->rtp_auth) + mki_size;
     }
 
-    if (stream->use_mki) {
-        srtp_inject_mki(srtcp + rtcp_len + tag_len + sizeof(srtcp_trailer_t),
-                        session_keys, stream->mki_size);
-    }
+    info->stream = stream;
+    return true;
+}
 
-    /*
-     * check sequence number for overruns, and copy it into the packet
-     * if its value isn't too big
-     */
-    status = srtp_rdb_increment(&stream->rtcp_rdb);
-    if (status) {
-        return status;
+/*
+ * srtp_batch_estimate_run(pkts, info, num, protect) estimates the indices
+ * of a run of num packets of the same stream against its replay window as
+ * it is before the run; packets to unprotect that the window or an
+ * earlier packet of the run already has are then dropped from the jobs.
+ * Those are only spared the work of the jobs, each packet is still
+ * checked against the window when it is processed, after the packets in
+ * front of it, and added to it only once its tag is verified.
+ */
+static void srtp_batch_estimate_run(const srtp_packet_desc_t *pkts,
+                                    srtp_batch_info_t *info,
+                                    size_t num,
+                                    bool protect)
+{
+    srtp_stream_ctx_t *stream = info[0].stream;
+    srtp_sequence_number_t seq[SRTP_BATCH_JOBS] = { 0 };
+    srtp_xtd_seq_num_t est[SRTP_BATCH_JOBS];
+    ssize_t delta[SRTP_BATCH_JOBS];
+
+    for (size_t j = 0; j < num; j++) {
+        seq[j] = ntohs(((const srtp_hdr_t *)pkts[j].in)->seq);
     }
-    seq_num = srtp_rdb_get_value(&stream->rtcp_rdb);
-    trailer |= htonl(seq_num);
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
 
-    memcpy(trailer_p, &trailer, sizeof(trailer));
+    if (stream->pending_roc) {
+        for (size_t j = 0; j < num; j++) {
+            srtp_err_status_t status = srtp_estimate_index(
+                &stream->rtp_rdbx, stream->pending_roc, &est[j], seq[j],
+                &delta[j]);
 
-    /*
-     * Calculate and set the IV
-     */
-    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
-    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                srtp_direction_encrypt);
-    if (status) {
-        return srtp_err_status_cipher_fail;
+            if (status && status != srtp_err_status_pkt_idx_adv) {
+                info[j].stream = NULL;
+            }
+        }
+    } else {
+        srtp_rdbx_estimate_indices(&stream->rtp_rdbx, seq, num, est, delta);
     }
 
-    /*
-     * Set the AAD for GCM mode
-     */
-    if (stream->rtcp_services & sec_serv_conf) {
-        /*
-         * If payload encryption is enabled, then the AAD consist of
-         * the RTCP header and the seq# at the end of the packet
-         */
-        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp,
-                                     octets_in_rtcp_header);
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    for (size_t j = 0; j < num; j++) {
+        info[j].est = est[j];
+        if (protect || info[j].stream == NULL) {
+            continue;
         }
-    } else {
-        /*
-         * Since payload encryption is not enabled, we must authenticate
-         * the entire packet as described in RFC 7714 (Section 9.3. Data
-         * Types in Unencrypted SRTCP Compound Packets)
-         */
-        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp, rtcp_len);
-        if (status) {
-            return (srtp_err_status_cipher_fail);
+        if (delta[j] <= 0 && srtp_rdbx_check(&stream->rtp_rdbx, delta[j])) {
+            info[j].stream = NULL;
+            continue;
+        }
+        for (size_t k = 0; k < j; k++) {
+            if (est[k] == est[j]) {
+                info[j].stream = NULL;
+                break;
+            }
         }
     }
-    /*
-     * Process the sequence# as AAD
-     */
-    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
-                                 sizeof(trailer));
-    if (status) {
-        return (srtp_err_status_cipher_fail);
+}
+
+/*
+ * srtp_batch_set_info(ctx, pkts, num, protect, info) sets up info for the
+ * set of num packets at pkts, estimating the indices a run of packets of
+ * the same stream at a time
+ */
+static void srtp_batch_set_info(srtp_ctx_t *ctx,
+                                const srtp_packet_desc_t *pkts,
+                                size_t num,
+                                bool protect,
+                                srtp_batch_info_t *info)
+{
+    size_t start = 0;
+
+    for (size_t j = 0; j < num; j++) {
+        if (!srtp_batch_packet(ctx, &pkts[j], protect, &info[j])) {
+            info[j].stream = NULL;
+        }
     }
 
-    /* if we're encrypting, exor keystream into the message */
-    if (stream->rtcp_services & sec_serv_conf) {
-        size_t out_len = *srtcp_len - enc_start;
-        status =
-            srtp_cipher_encrypt(session_keys->rtcp_cipher, rtcp + enc_start,
-                                enc_octet_len, srtcp + enc_start, &out_len);
-        enc_octet_len = out_len;
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    while (start < num) {
+        size_t end = start + 1;
+
+        if (info[start].stream == NULL) {
+            start++;
+            continue;
         }
-    } else {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        if (rtcp != srtcp) {
-            memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+        while (end < num && info[end].stream == info[start].stream) {
+            end++;
         }
+        srtp_batch_estimate_run(&pkts[start], &info[start], end - start,
+                                protect);
+        start = end;
+    }
+}
 
-        /*
-         * Even though we're not encrypting the payload, we need
-         * to run the cipher to get the auth tag.
-         */
-        uint8_t *auth_tag = srtcp + enc_start + enc_octet_len;
-        size_t out_len = *srtcp_len - enc_start - enc_octet_len;
-        status = srtp_cipher_encrypt(session_keys->rtcp_cipher, NULL, 0,
-                                     auth_tag, &out_len);
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
-        enc_octet_len += out_len;
+/*
+ * srtp_unprotect_batch_job(pkt, info, job, tag) sets up job to compute the
+ * tag of pkt into tag before it is processed, returning false for packets
+ * that srtp_unprotect_rtp_path() is left to authenticate on its own
+ */
+static bool srtp_unprotect_batch_job(const srtp_packet_desc_t *pkt,
+                                     const srtp_batch_info_t *info,
+                                     srtp_auth_job_t *job,
+                                     uint8_t *tag)
+{
+    srtp_xtd_seq_num_t est;
+    size_t tag_len;
+
+    if (info->stream == NULL) {
+        return false;
     }
 
-    *srtcp_len = octets_in_rtcp_header + enc_octet_len;
+    tag_len = srtp_auth_get_tag_length(info->session_keys->rtp_auth);
+    if (tag_len > SRTP_MAX_TAG_LEN || info->trailer_len > pkt->in_len ||
+        srtp_auth_job_init(info->session_keys->rtp_auth, job)) {
+        return false;
+    }
 
-    /* increase the packet length by the length of the seq_num*/
-    *srtcp_len += sizeof(srtcp_trailer_t);
+    /* shift est, put into network byte order */
+    est = be64_to_cpu(info->est << 16);
 
-    /* increase the packet by the mki_size */
-    *srtcp_len += stream->mki_size;
+    job->buffer = pkt->in;
+    job->len = pkt->in_len - info->trailer_len;
+    memcpy(job->suffix, &est, 4);
+    job->suffix_len = 4;
+    job->tag = tag;
 
-    return srtp_err_status_ok;
+    return true;
 }
 
 /*
- * This function handles incoming SRTCP packets while in AEAD mode,
- * which currently supports AES-GCM encryption.  Note, the auth tag is
- * at the end of the packet stream and is automatically checked by GCM
- * when decrypting the payload.
+ * srtp_batch_cipher_job(pkt, info, job, keystream, keystream_len) sets up
+ * job to compute the keystream of the payload of pkt into keystream,
+ * returning false for packets that are left to their stream or whose
+ * payload is longer than keystream_len
  */
-static srtp_err_status_t srtp_unprotect_rtcp_aead(
-    srtp_t ctx,
-    srtp_stream_ctx_t *stream,
-    const uint8_t *srtcp,
-    size_t srtcp_len,
-    uint8_t *rtcp,
-    size_t *rtcp_len,
-    srtp_session_keys_t *session_keys)
+static bool srtp_batch_cipher_job(const srtp_packet_desc_t *pkt,
+                                  const srtp_batch_info_t *info,
+                                  srtp_cipher_job_t *job,
+                                  uint8_t *keystream,
+                                  size_t keystream_len)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
-    size_t enc_start;               /* pointer to start of encrypted portion  */
-    const uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;               /* trailer value                          */
-    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
-    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
-    srtp_err_status_t status;
-    size_t tag_len;
-    size_t tmp_len;
-    uint32_t seq_num;
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)pkt->in;
+    size_t trailer_len = info->trailer_len;
+    size_t enc_start = info->desc.header_len;
     v128_t iv;
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
-
-    enc_start = octets_in_rtcp_header;
-
-    /*
-     * set encryption start, encryption length, and trailer
-     */
-    /* index & E (encryption) bit follow normal data. hdr->len is the number of
-     * words (32-bit) in the normal packet minus 1
-     */
-    /* This should point trailer to the word past the end of the normal data. */
-    /* This would need to be modified for optional mikey data */
-    trailer_p = srtcp + srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size;
-    memcpy(&trailer, trailer_p, sizeof(trailer));
-
-    /*
-     * We pass the tag down to the cipher when doing GCM mode
-     */
-    enc_octet_len = srtcp_len - (octets_in_rtcp_header +
-                                 sizeof(srtcp_trailer_t) + stream->mki_size);
-    auth_tag = srtcp + (srtcp_len - tag_len - stream->mki_size -
-                        sizeof(srtcp_trailer_t));
-
-    /*
-     * check the sequence number for replays
-     */
-    /* this is easier than dealing with bitfield access */
-    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
-    status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
-    if (status) {
-        return status;
+    if (info->stream == NULL || info->session_keys->rtp_cipher == NULL) {
+        return false;
     }
 
-    /*
-     * Calculate and set the IV
-     */
-    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
-    if (status) {
-        return srtp_err_status_cipher_fail;
+    if (trailer_len > pkt->in_len || enc_start > pkt->in_len - trailer_len ||
+        pkt->in_len - trailer_len - enc_start > keystream_len) {
+        return false;
     }
-    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                srtp_direction_decrypt);
-    if (status) {
-        return srtp_err_status_cipher_fail;
+
+    iv.v32[0] = 0;
+    iv.v32[1] = hdr->ssrc;
+    iv.v64[1] = be64_to_cpu(info->est << 16);
+    if (srtp_cipher_job_init(info->session_keys->rtp_cipher, (uint8_t *)&iv,
+                             job)) {
+        return false;
     }
 
-    /* check output length */
-    if (*rtcp_len <
-        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
-        return srtp_err_status_buffer_small;
+    job->keystream = keystream;
+    job->len = pkt->in_len - trailer_len - enc_start;
+
+    return true;
+}
+
+/*
+ * srtp_batch_keystream(ks, pkts, info, num) computes the keystream of the
+ * set of num packets at pkts
+ */
+static void srtp_batch_keystream(srtp_batch_keystream_t *ks,
+                                 const srtp_packet_desc_t *pkts,
+                                 const srtp_batch_info_t *info,
+                                 size_t num)
+{
+    size_t num_jobs = 0;
+    size_t used = 0;
+
+    for (size_t j = 0; j < num; j++) {
+        srtp_cipher_job_t *job = &ks->jobs[num_jobs];
+
+        ks->pkt_jobs[j] = NULL;
+        if (srtp_batch_cipher_job(&pkts[j], &info[j], job,
+                                  ks->keystream + used,
+                                  sizeof(ks->keystream) - used)) {
+            ks->pkt_jobs[j] = job;
+            used += job->len;
+            num_jobs++;
+        }
     }
+    srtp_cipher_compute_jobs(ks->jobs, num_jobs);
+}
 
-    /* if not inplace need to copy rtcp header */
-    if (srtcp != rtcp) {
-        memcpy(rtcp, srtcp, enc_start);
+srtp_err_status_t srtp_protect_batch(srtp_t ctx,
+                                     srtp_packet_desc_t *pkts,
+                                     size_t num_pkts)
+{
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    srtp_stream_ctx_t *stream = NULL;
+    srtp_session_keys_t *session_keys = NULL;
+    uint32_t cached_ssrc = 0;
+    size_t cached_mki_index = 0;
+    srtp_auth_job_t jobs[SRTP_BATCH_JOBS];
+    size_t num_jobs = 0;
+    srtp_batch_keystream_t ks;
+    srtp_batch_info_t info[SRTP_BATCH_JOBS];
+    size_t set_start = 0;
+    SRTP_STAGE_START(t);
+
+    debug_trace0(mod_srtp, "function srtp_protect_batch");
+
+    if (ctx == NULL || (pkts == NULL && num_pkts != 0)) {
+        return srtp_err_status_bad_param;
     }
 
     /*
-     * Set the AAD for GCM mode
+     * a thread safe session locks every packet, so the stream can not be
+     * kept from one packet to the next
      */
-    if (*trailer_p & SRTCP_E_BYTE_BIT) {
-        /*
-         * If payload encryption is enabled, then the AAD consist of
-         * the RTCP header and the seq# at the end of the packet
-         */
-        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, srtcp,
-                                     octets_in_rtcp_header);
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    if (ctx->thread_safe) {
+        for (size_t i = 0; i < num_pkts; i++) {
+            srtp_packet_desc_t *pkt = &pkts[i];
+
+            pkt->status = srtp_protect(ctx, pkt->in, pkt->in_len, pkt->out,
+                                       &pkt->out_len, pkt->mki_index);
+            if (pkt->status && first_failure == srtp_err_status_ok) {
+                first_failure = pkt->status;
+            }
         }
-    } else {
+        return first_failure;
+    }
+
+    for (size_t i = 0; i < num_pkts; i++) {
+        srtp_packet_desc_t *pkt = &pkts[i];
+        const srtp_hdr_t *hdr = (const srtp_hdr_t *)pkt->in;
+        const srtp_rtp_header_desc_t *desc;
+        srtp_err_status_t status;
+
+        /* the keystream of a set of packets is computed before any of them */
+        if (i % SRTP_BATCH_JOBS == 0) {
+            size_t set_len = num_pkts - i < SRTP_BATCH_JOBS ? num_pkts - i
+                                                             : SRTP_BATCH_JOBS;
+
+            set_start = i;
+            SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
+            srtp_batch_set_info(ctx, &pkts[i], set_len, true, info);
+            SRTP_STAGE_LAP(ctx, protect, srtp_stage_index, t);
+            srtp_batch_keystream(&ks, &pkts[i], info, set_len);
+            SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+        }
+
+        srtp_batch_prefetch(ctx, pkts, num_pkts, i, true);
+
+        /* the header was parsed for the set already */
+        status = info[i - set_start].parse_status;
+        desc = &info[i - set_start].desc;
+
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
+
         /*
-         * Since payload encryption is not enabled, we must authenticate
-         * the entire packet as described in RFC 7714 (Section 9.3. Data
-         * Types in Unencrypted SRTCP Compound Packets)
+         * consecutive packets of the same stream and key reuse the
+         * result of the previous lookup
          */
-        status = srtp_cipher_set_aad(
-            session_keys->rtcp_cipher, srtcp,
-            (srtcp_len - tag_len - sizeof(srtcp_trailer_t) - stream->mki_size));
-        if (status) {
-            return (srtp_err_status_cipher_fail);
+        if (!status && (stream == NULL || hdr->ssrc != cached_ssrc ||
+                        pkt->mki_index != cached_mki_index)) {
+            stream = NULL;
+            status = srtp_protect_get_stream(ctx, hdr->ssrc, &stream);
+            if (!status) {
+                status = srtp_get_session_keys(stream, pkt->mki_index,
+                                               &session_keys);
+                if (status) {
+                    srtp_stream_stats_count(ctx, stream, true, true, status,
+                                            pkt->in_len);
+                }
+            }
+            if (status) {
+                stream = NULL;
+            } else {
+                cached_ssrc = hdr->ssrc;
+                cached_mki_index = pkt->mki_index;
+            }
         }
-    }
 
-    /*
-     * Process the sequence# as AAD
-     */
-    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
-                                 sizeof(trailer));
-    if (status) {
-        return (srtp_err_status_cipher_fail);
-    }
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_lookup, t);
 
-    /* if we're decrypting, exor keystream into the message */
-    if (*trailer_p & SRTCP_E_BYTE_BIT) {
-        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
-                                     srtcp + enc_start, enc_octet_len,
-                                     rtcp + enc_start, &enc_octet_len);
-        if (status) {
-            return status;
+        if (!status) {
+            srtp_auth_job_t *job = &jobs[num_jobs];
+
+            if (!srtp_protect_job_init(stream, session_keys, job)) {
+                job = NULL;
+            }
+            status = srtp_protect_rtp_job(ctx, stream, session_keys, pkt->in,
+                                          pkt->in_len, desc, pkt->out,
+                                          &pkt->out_len, job,
+                                          ks.pkt_jobs[i - set_start]);
+            SRTP_STAGE_RESTART(t);
+            if (!status && job != NULL) {
+                num_jobs++;
+            }
+            srtp_stream_stats_count(ctx, stream, true, true, status,
+                                    pkt->in_len);
         }
-    } else {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        if (rtcp != srtcp) {
-            memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
+
+        /* the tags left to the jobs are computed a full set at a time */
+        if (num_jobs == SRTP_BATCH_JOBS ||
+            (num_jobs != 0 && i + 1 == num_pkts)) {
+            SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
+            srtp_auth_compute_jobs(jobs, num_jobs);
+            SRTP_STAGE_LAP(ctx, protect, srtp_stage_auth, t);
+            num_jobs = 0;
         }
 
-        /*
-         * Still need to run the cipher to check the tag
-         */
-        tmp_len = 0;
-        status = srtp_cipher_decrypt(session_keys->rtcp_cipher, auth_tag,
-                                     tag_len, NULL, &tmp_len);
-        if (status) {
-            return status;
+        pkt->status = status;
+        if (status && first_failure == srtp_err_status_ok) {
+            first_failure = status;
         }
     }
 
-    *rtcp_len = srtcp_len;
+    octet_string_set_to_zero(jobs, sizeof(jobs));
+    octet_string_set_to_zero(&ks, sizeof(ks));
 
-    /* decrease the packet length by the length of the auth tag and seq_num*/
-    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t) + stream->mki_size);
+    return first_failure;
+}
 
-    /*
-     * verify that stream is for received traffic - this check will
-     * detect SSRC collisions, since a stream that appears in both
-     * srtp_protect() and srtp_unprotect() will fail this test in one of
-     * those functions.
-     *
-     * we do this check *after* the authentication check, so that the
-     * latter check will catch any attempts to fool us into thinking
-     * that we've got a collision
-     */
-    if (stream->direction != dir_srtp_receiver) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_receiver;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
+/*
+ * number of descriptors srtp_protect_strided() hands to
+ * srtp_protect_batch() at a time
+ */
+#define SRTP_STRIDED_CHUNK (4 * SRTP_BATCH_JOBS)
+
+srtp_err_status_t srtp_protect_strided(srtp_t ctx,
+                                       uint8_t *buf,
+                                       size_t stride,
+                                       size_t *lens,
+                                       size_t num_pkts,
+                                       size_t mki_index)
+{
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    srtp_packet_desc_t pkts[SRTP_STRIDED_CHUNK];
+    size_t index[SRTP_STRIDED_CHUNK];
+    size_t done = 0;
+
+    debug_trace0(mod_srtp, "function srtp_protect_strided");
+
+    if (ctx == NULL || stride == 0 ||
+        ((buf == NULL || lens == NULL) && num_pkts != 0)) {
+        return srtp_err_status_bad_param;
     }
 
-    /*
-     * if the stream is a 'provisional' one, in which the template context
-     * is used, then we need to allocate a new stream at this point, since
-     * the authentication passed
-     */
-    if (stream == ctx->stream_template) {
-        srtp_stream_ctx_t *new_stream;
+    while (done < num_pkts) {
+        size_t n = num_pkts - done;
+        size_t num_descs = 0;
+        size_t i;
+
+        if (n > SRTP_STRIDED_CHUNK) {
+            n = SRTP_STRIDED_CHUNK;
+        }
 
         /*
-         * allocate and initialize a new stream
-         *
-         * note that we indicate failure if we can't allocate the new
-         * stream, and some implementations will want to not return
-         * failure here
+         * a packet which does not fit in its stride is not handed on, so
+         * the batch only ever writes inside the stride of each packet
          */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-        if (status) {
-            return status;
-        }
+        for (i = 0; i < n; i++) {
+            uint8_t *pkt = buf + (done + i) * stride;
 
-        /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
-        if (status) {
-            return status;
+            if (lens[done + i] > stride) {
+                lens[done + i] = 0;
+                if (first_failure == srtp_err_status_ok) {
+                    first_failure = srtp_err_status_bad_param;
+                }
+                continue;
+            }
+            pkts[num_descs].in = pkt;
+            pkts[num_descs].in_len = lens[done + i];
+            pkts[num_descs].out = pkt;
+            pkts[num_descs].out_len = stride;
+            pkts[num_descs].mki_index = mki_index;
+            pkts[num_descs].status = srtp_err_status_ok;
+            index[num_descs++] = done + i;
         }
 
-        /* set stream (the pointer used in this function) */
-        stream = new_stream;
-    }
+        srtp_protect_batch(ctx, pkts, num_descs);
 
-    /* we've passed the authentication check, so add seq_num to the rdb */
-    srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
+        for (i = 0; i < num_descs; i++) {
+            size_t *len = &lens[index[i]];
 
-    return srtp_err_status_ok;
+            if (pkts[i].status) {
+                *len = 0;
+                if (first_failure == srtp_err_status_ok) {
+                    first_failure = pkts[i].status;
+                }
+            } else {
+                *len = pkts[i].out_len;
+            }
+        }
+        done += n;
+    }
+
+    return first_failure;
 }
 
-srtp_err_status_t srtp_protect_rtcp(srtp_t ctx,
-                                    const uint8_t *rtcp,
-                                    size_t rtcp_len,
-                                    uint8_t *srtcp,
-                                    size_t *srtcp_len,
-                                    size_t mki_index)
+srtp_err_status_t srtp_unprotect_batch(srtp_t ctx,
+                                       srtp_packet_desc_t *pkts,
+                                       size_t num_pkts)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
-    size_t enc_start;         /* pointer to start of encrypted portion  */
-    uint8_t *auth_start;      /* pointer to start of auth. portion      */
-    uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;         /* trailer value                          */
-    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
-    uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
-    srtp_err_status_t status;
-    size_t tag_len;
-    srtp_stream_ctx_t *stream;
-    size_t prefix_len;
-    uint32_t seq_num;
-    srtp_session_keys_t *session_keys = NULL;
-
-    /* check the packet length - it must at least contain a full header */
-    if (rtcp_len < octets_in_rtcp_header) {
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    srtp_stream_ctx_t *stream = NULL;
+    uint32_t cached_ssrc = 0;
+    srtp_auth_job_t jobs[SRTP_BATCH_JOBS];
+    const srtp_auth_job_t *pkt_jobs[SRTP_BATCH_JOBS];
+    uint8_t tags[SRTP_BATCH_JOBS][SRTP_MAX_TAG_LEN];
+    srtp_batch_keystream_t ks;
+    srtp_batch_info_t info[SRTP_BATCH_JOBS];
+    size_t set_start = 0;
+    SRTP_STAGE_START(t);
+
+    debug_trace0(mod_srtp, "function srtp_unprotect_batch");
+
+    if (ctx == NULL || (pkts == NULL && num_pkts != 0)) {
         return srtp_err_status_bad_param;
     }
 
-    /*
-     * look up ssrc in srtp_stream list, and process the packet with
-     * the appropriate stream.  if we haven't seen this stream before,
-     * there's only one key for this srtp_session, and the cipher
-     * supports key-sharing, then we assume that a new stream using
-     * that key has just started up
-     */
-    stream = srtp_get_stream(ctx, hdr->ssrc);
-    if (stream == NULL) {
-        if (ctx->stream_template != NULL) {
-            srtp_stream_ctx_t *new_stream;
+    if (ctx->thread_safe) {
+        for (size_t i = 0; i < num_pkts; i++) {
+            srtp_packet_desc_t *pkt = &pkts[i];
 
-            /* allocate and initialize a new stream */
-            status =
-                srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-            if (status) {
-                return status;
+            pkt->status = srtp_unprotect(ctx, pkt->in, pkt->in_len, pkt->out,
+                                         &pkt->out_len);
+            if (pkt->status && first_failure == srtp_err_status_ok) {
+                first_failure = pkt->status;
             }
+        }
+        return first_failure;
+    }
 
-            /* add new stream to the list */
-            status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                                   ctx->stream_template);
-            if (status) {
-                return status;
+    for (size_t i = 0; i < num_pkts; i++) {
+        srtp_packet_desc_t *pkt = &pkts[i];
+        const srtp_hdr_t *hdr = (const srtp_hdr_t *)pkt->in;
+        srtp_err_status_t status;
+
+        /*
+         * the tags and keystream of a set of packets are computed before
+         * any of them
+         */
+        if (i % SRTP_BATCH_JOBS == 0) {
+            size_t set_len = num_pkts - i < SRTP_BATCH_JOBS ? num_pkts - i
+                                                             : SRTP_BATCH_JOBS;
+            size_t num_jobs = 0;
+
+            set_start = i;
+            SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
+            srtp_batch_set_info(ctx, &pkts[i], set_len, false, info);
+            SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+            for (size_t j = 0; j < set_len; j++) {
+                pkt_jobs[j] = NULL;
+                if (srtp_unprotect_batch_job(&pkts[i + j], &info[j],
+                                             &jobs[num_jobs], tags[j])) {
+                    pkt_jobs[j] = &jobs[num_jobs++];
+                }
             }
+            srtp_auth_compute_jobs(jobs, num_jobs);
+            SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_auth, t);
+            srtp_batch_keystream(&ks, &pkts[i], info, set_len);
+            SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+        }
 
-            /* set stream (the pointer used in this function) */
-            stream = new_stream;
-        } else {
-            /* no template stream, so we return an error */
-            return srtp_err_status_no_ctx;
+        srtp_batch_prefetch(ctx, pkts, num_pkts, i, false);
+
+        status = srtp_validate_rtp_header(pkt->in, pkt->in_len);
+        if (!status && pkt->in_len < octets_in_rtp_header) {
+            status = srtp_err_status_bad_param;
+        }
+
+        if (!status) {
+            /*
+             * only streams found in the list are reused, a provisional
+             * template stream is replaced by a real one once a packet
+             * authenticates so it has to be looked up again
+             */
+            SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_other, t);
+            if (stream == NULL || hdr->ssrc != cached_ssrc) {
+                stream = srtp_get_stream(ctx, hdr->ssrc);
+                cached_ssrc = hdr->ssrc;
+            }
+            SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
+            status = srtp_unprotect_rtp_counted(
+                ctx, &stream, pkt->in, pkt->in_len, pkt->out, &pkt->out_len,
+                pkt_jobs[i - set_start], ks.pkt_jobs[i - set_start]);
+            SRTP_STAGE_RESTART(t);
+        }
+
+        pkt->status = status;
+        if (status && first_failure == srtp_err_status_ok) {
+            first_failure = status;
         }
     }
 
-    /*
-     * verify that stream is for sending traffic - this check will
-     * detect SSRC collisions, since a stream that appears in both
-     * srtp_protect() and srtp_unprotect() will fail this test in one of
-     * those functions.
-     */
-    if (stream->direction != dir_srtp_sender) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_sender;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
-    }
+    octet_string_set_to_zero(jobs, sizeof(jobs));
+    octet_string_set_to_zero(&ks, sizeof(ks));
 
-    status = srtp_get_session_keys(stream, mki_index, &session_keys);
-    if (status) {
-        return status;
-    }
-
-    /*
-     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-     * the request to our AEAD handler.
-     */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_protect_rtcp_aead(stream, rtcp, rtcp_len, srtcp, srtcp_len,
-                                      session_keys);
-    }
+    return first_failure;
+}
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+/*
+ * scatter-gather protection
+ *
+ * srtp_protect_iov() and srtp_unprotect_iov() process the payload segment
+ * by segment for streams using the SRTP_RTP_PATH_ICM_HMAC paths, any
+ * other stream is given a copy of the packet in its iov_scratch buffer
+ */
 
-    /*
-     * set encryption start and encryption length
-     */
-    enc_start = octets_in_rtcp_header;
-    enc_octet_len = rtcp_len - enc_start;
+static size_t srtp_iov_len(const srtp_iovec_t *iov, size_t iov_count)
+{
+    size_t len = 0;
 
-    /* check output length */
-    if (*srtcp_len <
-        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
-        return srtp_err_status_buffer_small;
+    for (size_t i = 0; i < iov_count; i++) {
+        len += iov[i].len;
     }
 
-    /* if not in place then need to copy rtcp header */
-    if (rtcp != srtcp) {
-        memcpy(srtcp, rtcp, enc_start);
-    }
+    return len;
+}
 
-    /* all of the packet, except the header, gets encrypted */
-    /*
-     * NOTE: hdr->length is not usable - it refers to only the first RTCP report
-     * in the compound packet!
-     */
-    trailer_p = srtcp + enc_start + enc_octet_len;
+/*
+ * srtp_iov_validate(iov, iov_count, desc) checks that the segments describe
+ * an RTP packet whose header is contained in the first segment and fills
+ * desc for the whole packet
+ */
+static srtp_err_status_t srtp_iov_validate(const srtp_iovec_t *iov,
+                                           size_t iov_count,
+                                           srtp_rtp_header_desc_t *desc)
+{
+    srtp_err_status_t status;
 
-    if (stream->rtcp_services & sec_serv_conf) {
-        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
-    } else {
-        /* 0 is network-order independant */
-        trailer = 0x00000000; /* set encrypt bit */
+    if (iov == NULL || iov_count == 0 || iov[0].base == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    if (stream->use_mki) {
-        srtp_inject_mki(srtcp + rtcp_len + sizeof(srtcp_trailer_t),
-                        session_keys, stream->mki_size);
+    for (size_t i = 1; i < iov_count; i++) {
+        if (iov[i].base == NULL && iov[i].len != 0) {
+            return srtp_err_status_bad_param;
+        }
     }
 
-    /*
-     * set the auth_start and auth_tag pointers to the proper locations
-     * (note that srtpc *always* provides authentication, unlike srtp)
-     */
-    /* Note: This would need to change for optional mikey data */
-    auth_start = srtcp;
-    auth_tag = srtcp + rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size;
-
-    /*
-     * check sequence number for overruns, and copy it into the packet
-     * if its value isn't too big
-     */
-    status = srtp_rdb_increment(&stream->rtcp_rdb);
+    status = srtp_rtp_header_parse(iov[0].base, iov[0].len, desc);
     if (status) {
         return status;
     }
-    seq_num = srtp_rdb_get_value(&stream->rtcp_rdb);
-    trailer |= htonl(seq_num);
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+    desc->payload_len = srtp_iov_len(iov, iov_count) - desc->header_len;
 
-    memcpy(trailer_p, &trailer, sizeof(trailer));
+    return srtp_err_status_ok;
+}
 
-    /*
-     * if we're using rindael counter mode, set nonce and seq
-     */
-    if (session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_256) {
-        v128_t iv;
+/*
+ * srtp_iov_scratch(stream, len) returns the scratch buffer of stream after
+ * growing it to at least len octets, or NULL if that failed
+ */
+static uint8_t *srtp_iov_scratch(srtp_stream_ctx_t *stream, size_t len)
+{
+    srtp_stream_cold_t *cold = srtp_stream_get_cold(stream);
 
-        iv.v32[0] = 0;
-        iv.v32[1] = hdr->ssrc; /* still in network order! */
-        iv.v32[2] = htonl(seq_num >> 16);
-        iv.v32[3] = htonl(seq_num << 16);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_encrypt);
+    if (cold == NULL) {
+        return NULL;
+    }
 
-    } else {
-        v128_t iv;
+    if (cold->iov_scratch_len < len) {
+        uint8_t *scratch = (uint8_t *)srtp_crypto_alloc(len);
+        if (scratch == NULL) {
+            return NULL;
+        }
+        srtp_crypto_free(cold->iov_scratch);
+        cold->iov_scratch = scratch;
+        cold->iov_scratch_len = len;
+    }
 
-        /* otherwise, just set the index to seq_num */
-        iv.v32[0] = 0;
-        iv.v32[1] = 0;
-        iv.v32[2] = 0;
-        iv.v32[3] = htonl(seq_num);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_encrypt);
+    return cold->iov_scratch;
+}
+
+static void srtp_iov_gather(const srtp_iovec_t *iov,
+                            size_t iov_count,
+                            uint8_t *buf)
+{
+    for (size_t i = 0; i < iov_count; i++) {
+        if (iov[i].len != 0) {
+            memcpy(buf, iov[i].base, iov[i].len);
+            buf += iov[i].len;
+        }
     }
-    if (status) {
+}
+
+static void srtp_iov_scatter(srtp_iovec_t *iov,
+                             size_t iov_count,
+                             const uint8_t *buf)
+{
+    for (size_t i = 0; i < iov_count; i++) {
+        if (iov[i].len != 0) {
+            memcpy(iov[i].base, buf, iov[i].len);
+            buf += iov[i].len;
+        }
+    }
+}
+
+/*
+ * srtp_iov_is_icm_hmac(stream) is true when the packets of stream are
+ * processed by the SRTP_RTP_PATH_ICM_HMAC paths, which srtp_protect_iov()
+ * and srtp_unprotect_iov() can follow segment by segment
+ */
+static bool srtp_iov_is_icm_hmac(const srtp_stream_ctx_t *stream)
+{
+    return stream->protect_rtp == srtp_protect_rtp_icm_hmac ||
+           stream->protect_rtp == srtp_protect_rtp_icm_hmac_mki;
+}
+
+/*
+ * srtp_iov_set_icm_iv(session_keys, hdr, est, direction) sets the counter
+ * mode IV of the packet with index est
+ */
+static srtp_err_status_t srtp_iov_set_icm_iv(srtp_session_keys_t *session_keys,
+                                             const srtp_hdr_t *hdr,
+                                             srtp_xtd_seq_num_t est,
+                                             srtp_cipher_direction_t direction)
+{
+    v128_t iv;
+
+    iv.v32[0] = 0;
+    iv.v32[1] = hdr->ssrc;
+    iv.v64[1] = be64_to_cpu(est << 16);
+    if (srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
+                           direction)) {
         return srtp_err_status_cipher_fail;
     }
 
-    /*
-     * if we're authenticating using a universal hash, put the keystream
-     * prefix into the authentication tag
-     */
+    return srtp_err_status_ok;
+}
 
-    /* if auth_start is non-null, then put keystream into tag  */
-    if (auth_start) {
-        /* put keystream prefix into auth_tag */
-        prefix_len = srtp_auth_get_prefix_length(session_keys->rtcp_auth);
-        status = srtp_cipher_output(session_keys->rtcp_cipher, auth_tag,
-                                    &prefix_len);
+/*
+ * srtp_protect_iov_icm_hmac() is srtp_protect_rtp_path() for
+ * SRTP_RTP_PATH_ICM_HMAC applied to a packet in segments, the header of
+ * hdr_len octets is at the start of the first segment
+ */
+static srtp_err_status_t srtp_protect_iov_icm_hmac(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    srtp_iovec_t *iov,
+    size_t iov_count,
+    size_t hdr_len,
+    uint8_t *trailer,
+    size_t *trailer_len)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)iov[0].base;
+    const size_t mki_size = stream->use_mki ? stream->mki_size : 0;
+    srtp_xtd_seq_num_t est;
+    ssize_t delta;
+    srtp_err_status_t status;
+    size_t tag_len;
 
-        debug_print(mod_srtp, "keystream prefix: %s",
-                    srtp_octet_string_hex_string(auth_tag, prefix_len));
+    switch (srtp_key_limit_update(session_keys->limit)) {
+    case srtp_key_event_normal:
+        break;
+    case srtp_key_event_soft_limit:
+        stream->stats.key_soft_limit++;
+        srtp_handle_event(ctx, stream, event_key_soft_limit);
+        break;
+    case srtp_key_event_hard_limit:
+        srtp_handle_event(ctx, stream, event_key_hard_limit);
+        return srtp_err_status_key_expired;
+    default:
+        break;
+    }
 
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
+    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    if (*trailer_len < mki_size + tag_len) {
+        return srtp_err_status_buffer_small;
     }
 
-    /* if we're encrypting, exor keystream into the message */
-    if (stream->rtcp_services & sec_serv_conf) {
-        status = srtp_cipher_encrypt(session_keys->rtcp_cipher,
-                                     rtcp + enc_start, enc_octet_len,
-                                     srtcp + enc_start, &enc_octet_len);
+    status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+    if (status && (status != srtp_err_status_pkt_idx_adv)) {
+        return status;
+    }
+
+    if (status == srtp_err_status_pkt_idx_adv) {
+        srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, (uint32_t)(est >> 16),
+                              (uint16_t)(est & 0xFFFF));
+        stream->pending_roc = 0;
+        srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+        status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
         if (status) {
-            return srtp_err_status_cipher_fail;
+            if (status != srtp_err_status_replay_fail ||
+                !stream->allow_repeat_tx)
+                return status; /* we've been asked to reuse an index */
         }
-    } else if (rtcp != srtcp) {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+        srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
 
-    /* initialize auth func context */
-    status = srtp_auth_start(session_keys->rtcp_auth);
+    debug_trace(mod_srtp, "estimated packet index: %016" PRIx64, est);
+
+    status = srtp_iov_set_icm_iv(session_keys, hdr, est,
+                                 srtp_direction_encrypt);
     if (status) {
         return status;
     }
 
-    /*
-     * run auth func over packet (including trailer), and write the
-     * result at auth_tag
-     */
-    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start,
-                               rtcp_len + sizeof(srtcp_trailer_t), auth_tag);
-    debug_print(mod_srtp, "srtcp auth tag:    %s",
-                srtp_octet_string_hex_string(auth_tag, tag_len));
+    /* shift est, put into network byte order */
+    est = be64_to_cpu(est << 16);
+
+    status = srtp_encrypt_and_auth(session_keys->rtp_cipher,
+                                   session_keys->rtp_auth, iov[0].base, hdr_len,
+                                   iov[0].base + hdr_len, iov[0].len - hdr_len,
+                                   iov[0].base + hdr_len);
+    for (size_t i = 1; !status && i < iov_count; i++) {
+        status = srtp_encrypt_and_auth_update(session_keys->rtp_cipher,
+                                              session_keys->rtp_auth,
+                                              iov[i].base, iov[i].len,
+                                              iov[i].base);
+    }
     if (status) {
-        return srtp_err_status_auth_fail;
+        return status;
     }
 
-    *srtcp_len = enc_start + enc_octet_len;
+    if (mki_size) {
+        srtp_inject_mki(trailer, session_keys, mki_size);
+    }
 
-    /* increase the packet length by the length of the auth tag and seq_num*/
-    *srtcp_len += (tag_len + sizeof(srtcp_trailer_t));
+    /* run auth func over ROC, put result into the trailer after the MKI */
+    status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4,
+                               trailer + mki_size);
+    if (status) {
+        return status;
+    }
 
-    /* increase the packet by the mki_size */
-    *srtcp_len += stream->mki_size;
+    *trailer_len = mki_size + tag_len;
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
-                                      const uint8_t *srtcp,
-                                      size_t srtcp_len,
-                                      uint8_t *rtcp,
-                                      size_t *rtcp_len)
+/*
+ * srtp_protect_iov_copy() protects a packet in segments with any stream,
+ * by protecting a copy of it and scattering the result back
+ */
+static srtp_err_status_t srtp_protect_iov_copy(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    srtp_iovec_t *iov,
+    size_t iov_count,
+    size_t rtp_len,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *trailer,
+    size_t *trailer_len)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
-    size_t enc_start;               /* pointer to start of encrypted portion  */
-    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
-    const uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;               /* trailer value                          */
-    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
-    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
-    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+    size_t trailer_max = *trailer_len < SRTP_MAX_TRAILER_LEN
+                             ? *trailer_len
+                             : SRTP_MAX_TRAILER_LEN;
+    size_t srtp_len = rtp_len + trailer_max;
     srtp_err_status_t status;
-    size_t auth_len;
-    size_t tag_len;
-    srtp_stream_ctx_t *stream;
-    size_t prefix_len;
-    uint32_t seq_num;
-    bool e_bit_in_packet;          /* E-bit was found in the packet */
-    bool sec_serv_confidentiality; /* whether confidentiality was requested */
-    srtp_session_keys_t *session_keys = NULL;
+    uint8_t *buf;
 
-    /*
-     * check that the length value is sane; we'll check again once we
-     * know the tag length, but we at least want to know that it is
-     * a positive value
-     */
-    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t)) {
-        return srtp_err_status_bad_param;
+    buf = srtp_iov_scratch(stream, srtp_len);
+    if (buf == NULL) {
+        return srtp_err_status_alloc_fail;
     }
 
-    /*
-     * look up ssrc in srtp_stream list, and process the packet with
-     * the appropriate stream.  if we haven't seen this stream before,
-     * there's only one key for this srtp_session, and the cipher
-     * supports key-sharing, then we assume that a new stream using
-     * that key has just started up
-     */
-    stream = srtp_get_stream(ctx, hdr->ssrc);
-    if (stream == NULL) {
-        if (ctx->stream_template != NULL) {
-            stream = ctx->stream_template;
-
-            debug_print(mod_srtp,
-                        "srtcp using provisional stream (SSRC: 0x%08x)",
-                        (unsigned int)ntohl(hdr->ssrc));
-        } else {
-            /* no template stream, so we return an error */
-            return srtp_err_status_no_ctx;
+    srtp_iov_gather(iov, iov_count, buf);
+    status = srtp_protect_with_stream(ctx, stream, session_keys, buf, rtp_len,
+                                      desc, buf, &srtp_len);
+    if (status) {
+        return status;
+    }
+    if (srtp_len < rtp_len) {
+        return srtp_err_status_parse_err;
+    }
+
+    srtp_iov_scatter(iov, iov_count, buf);
+    memcpy(trailer, buf + rtp_len, srtp_len - rtp_len);
+    *trailer_len = srtp_len - rtp_len;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_protect_iov_unlocked(
+    srtp_t ctx,
+    srtp_iovec_t *iov,
+    size_t iov_count,
+    const srtp_rtp_header_desc_t *desc,
+    uint8_t *trailer,
+    size_t *trailer_len,
+    size_t mki_index)
+{
+    const srtp_hdr_t *hdr;
+    srtp_stream_ctx_t *stream;
+    srtp_session_keys_t *session_keys = NULL;
+    srtp_err_status_t status;
+    size_t rtp_len;
+
+    debug_trace0(mod_srtp, "function srtp_protect_iov");
+
+    hdr = (const srtp_hdr_t *)iov[0].base;
+    rtp_len = srtp_iov_len(iov, iov_count);
+
+    status = srtp_protect_get_stream(ctx, hdr->ssrc, &stream);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_get_session_keys(stream, mki_index, &session_keys);
+    if (status) {
+        srtp_stream_stats_count(ctx, stream, true, true, status, rtp_len);
+        return status;
+    }
+
+    if (srtp_iov_is_icm_hmac(stream)) {
+        status = srtp_protect_iov_icm_hmac(ctx, stream, session_keys, iov,
+                                           iov_count, desc->header_len,
+                                           trailer, trailer_len);
+    } else {
+        status = srtp_protect_iov_copy(ctx, stream, session_keys, iov,
+                                       iov_count, rtp_len, desc, trailer,
+                                       trailer_len);
+    }
+    srtp_stream_stats_count(ctx, stream, true, true, status, rtp_len);
+
+    return status;
+}
+
+srtp_err_status_t srtp_protect_iov(srtp_t ctx,
+                                   srtp_iovec_t *iov,
+                                   size_t iov_count,
+                                   uint8_t *trailer,
+                                   size_t *trailer_len,
+                                   size_t mki_index)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_rtp_header_desc_t desc;
+    unsigned int locks = SRTP_STREAM_LOCK_RTP;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || trailer == NULL || trailer_len == NULL ||
+        srtp_iov_validate(iov, iov_count, &desc)) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (!ctx->thread_safe) {
+        return srtp_protect_iov_unlocked(ctx, iov, iov_count, &desc, trailer,
+                                         trailer_len, mki_index);
+    }
+
+    stream =
+        srtp_session_enter_packet(ctx, iov[0].base, iov[0].len, 8, &locks);
+    status = srtp_protect_iov_unlocked(ctx, iov, iov_count, &desc, trailer,
+                                       trailer_len, mki_index);
+    srtp_session_leave_locks(ctx, stream, locks);
+
+    return status;
+}
+
+/*
+ * srtp_unprotect_iov_icm_hmac() is srtp_unprotect_rtp_path() for
+ * SRTP_RTP_PATH_ICM_HMAC applied to a packet in segments, with a stream
+ * of its own; the trailer holds the MKI and the authentication tag
+ */
+static srtp_err_status_t srtp_unprotect_iov_icm_hmac(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_iovec_t *iov,
+    size_t iov_count,
+    size_t hdr_len,
+    const uint8_t *trailer,
+    size_t trailer_len)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)iov[0].base;
+    const size_t mki_size = stream->use_mki ? stream->mki_size : 0;
+    srtp_session_keys_t *session_keys = NULL;
+    srtp_xtd_seq_num_t est, roc;
+    ssize_t delta;
+    srtp_err_status_t status;
+    size_t tag_len;
+    bool advance_packet_index = false;
+
+    status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+    if (status && (status != srtp_err_status_pkt_idx_adv)) {
+        return status;
+    }
+
+    if (status == srtp_err_status_pkt_idx_adv) {
+        advance_packet_index = true;
+    } else {
+        status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+        if (status) {
+            return status;
         }
     }
 
-    /*
-     * Determine if MKI is being used and what session keys should be used
-     */
-    status = srtp_get_session_keys_for_rtcp_packet(stream, srtcp, srtcp_len,
-                                                   &session_keys);
+    debug_trace(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
+
+    if (stream->num_master_keys == 0 || stream->session_keys == NULL) {
+        return srtp_err_status_no_ctx;
+    }
+    tag_len = srtp_auth_get_tag_length(stream->session_keys[0].rtp_auth);
+    status = srtp_get_session_keys_for_packet(stream, trailer, trailer_len,
+                                              tag_len, &session_keys);
     if (status) {
         return status;
     }
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    if (trailer_len < mki_size + tag_len) {
+        return srtp_err_status_parse_err;
+    }
 
-    /* check the packet length - it must contain at least a full RTCP
-       header, an auth tag (if applicable), and the SRTCP encrypted flag
-       and 31-bit index value */
-    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t) +
-                        stream->mki_size + tag_len) {
+    status = srtp_iov_set_icm_iv(session_keys, hdr, est,
+                                 srtp_direction_decrypt);
+    if (status) {
+        return status;
+    }
+
+    /* authenticate the header and the payload, then the ROC */
+    status = srtp_auth_start(session_keys->rtp_auth);
+    for (size_t i = 0; !status && i < iov_count; i++) {
+        status = srtp_auth_update(session_keys->rtp_auth, iov[i].base,
+                                  iov[i].len);
+    }
+    if (status) {
+        return status;
+    }
+
+    /* the ROC in network byte order, est is still needed below */
+    roc = be64_to_cpu(est << 16);
+    status = srtp_auth_verify(session_keys->rtp_auth, (uint8_t *)&roc, 4,
+                              trailer + trailer_len - tag_len);
+    if (status) {
+        return srtp_err_status_auth_fail;
+    }
+
+    switch (srtp_key_limit_update(session_keys->limit)) {
+    case srtp_key_event_normal:
+        break;
+    case srtp_key_event_soft_limit:
+        stream->stats.key_soft_limit++;
+        srtp_handle_event(ctx, stream, event_key_soft_limit);
+        break;
+    case srtp_key_event_hard_limit:
+        srtp_handle_event(ctx, stream, event_key_hard_limit);
+        return srtp_err_status_key_expired;
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < iov_count; i++) {
+        uint8_t *enc = iov[i].base;
+        size_t enc_len = iov[i].len;
+
+        if (i == 0) {
+            enc += hdr_len;
+            enc_len -= hdr_len;
+        }
+        if (enc_len == 0) {
+            continue;
+        }
+        status = srtp_cipher_decrypt(session_keys->rtp_cipher, enc, enc_len,
+                                     enc, &enc_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    }
+
+    srtp_stream_check_direction(ctx, stream, dir_srtp_receiver);
+
+    if (advance_packet_index) {
+        srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, (uint32_t)(est >> 16),
+                              (uint16_t)(est & 0xFFFF));
+        stream->pending_roc = 0;
+        srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+        srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_unprotect_iov_copy() unprotects a packet in segments like
+ * srtp_unprotect(), using a copy of the packet in the scratch buffer of
+ * buf_stream, and scatters the result back if the packet is valid
+ */
+static srtp_err_status_t srtp_unprotect_iov_copy(srtp_ctx_t *ctx,
+                                                 srtp_stream_ctx_t *stream,
+                                                 srtp_stream_ctx_t *buf_stream,
+                                                 srtp_iovec_t *iov,
+                                                 size_t iov_count,
+                                                 const uint8_t *trailer,
+                                                 size_t trailer_len)
+{
+    size_t payload_len = srtp_iov_len(iov, iov_count);
+    size_t srtp_len = payload_len + trailer_len;
+    size_t rtp_len = srtp_len;
+    srtp_err_status_t status;
+    uint8_t *buf;
+
+    buf = srtp_iov_scratch(buf_stream, srtp_len);
+    if (buf == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    srtp_iov_gather(iov, iov_count, buf);
+    memcpy(buf + payload_len, trailer, trailer_len);
+    status = srtp_unprotect_rtp_counted(ctx, &stream, buf, srtp_len, buf,
+                                        &rtp_len, NULL, NULL);
+    if (status) {
+        return status;
+    }
+    if (rtp_len != payload_len) {
+        return srtp_err_status_parse_err;
+    }
+
+    srtp_iov_scatter(iov, iov_count, buf);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_unprotect_iov_unlocked(
+    srtp_t ctx,
+    srtp_iovec_t *iov,
+    size_t iov_count,
+    const srtp_rtp_header_desc_t *desc,
+    const uint8_t *trailer,
+    size_t trailer_len)
+{
+    const srtp_hdr_t *hdr;
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    debug_trace0(mod_srtp, "function srtp_unprotect_iov");
+
+    hdr = (const srtp_hdr_t *)iov[0].base;
+
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+
+    if (stream == NULL || srtp_stream_in_overlap(stream) ||
+        !srtp_iov_is_icm_hmac(stream)) {
+        srtp_stream_ctx_t *buf_stream =
+            stream != NULL ? stream : ctx->stream_template;
+
+        if (buf_stream == NULL) {
+            return srtp_err_status_no_ctx;
+        }
+        return srtp_unprotect_iov_copy(ctx, stream, buf_stream, iov,
+                                       iov_count, trailer, trailer_len);
+    }
+
+    status = srtp_unprotect_iov_icm_hmac(ctx, stream, iov, iov_count,
+                                         desc->header_len, trailer,
+                                         trailer_len);
+    srtp_stream_stats_count(ctx, stream, true, false, status,
+                            srtp_iov_len(iov, iov_count));
+
+    return status;
+}
+
+srtp_err_status_t srtp_unprotect_iov(srtp_t ctx,
+                                     srtp_iovec_t *iov,
+                                     size_t iov_count,
+                                     const uint8_t *trailer,
+                                     size_t trailer_len)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_rtp_header_desc_t desc;
+    unsigned int locks = SRTP_STREAM_LOCK_RTP;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || (trailer == NULL && trailer_len != 0) ||
+        srtp_iov_validate(iov, iov_count, &desc)) {
         return srtp_err_status_bad_param;
     }
 
-    /*
-     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-     * the request to our AEAD handler.
-     */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_unprotect_rtcp_aead(ctx, stream, srtcp, srtcp_len, rtcp,
-                                        rtcp_len, session_keys);
+    if (!ctx->thread_safe) {
+        return srtp_unprotect_iov_unlocked(ctx, iov, iov_count, &desc,
+                                           trailer, trailer_len);
     }
 
-    sec_serv_confidentiality = stream->rtcp_services == sec_serv_conf ||
-                               stream->rtcp_services == sec_serv_conf_and_auth;
+    stream =
+        srtp_session_enter_packet(ctx, iov[0].base, iov[0].len, 8, &locks);
+    status = srtp_unprotect_iov_unlocked(ctx, iov, iov_count, &desc, trailer,
+                                         trailer_len);
+    srtp_session_leave_locks(ctx, stream, locks);
 
-    /*
-     * set encryption start, encryption length, and trailer
-     */
-    enc_start = octets_in_rtcp_header;
-    enc_octet_len = srtcp_len - (octets_in_rtcp_header + tag_len +
-                                 stream->mki_size + sizeof(srtcp_trailer_t));
-    /*
-     *index & E (encryption) bit follow normal data. hdr->len is the number of
-     * words (32-bit) in the normal packet minus 1
-     */
-    /* This should point trailer to the word past the end of the normal data. */
-    /* This would need to be modified for optional mikey data */
-    trailer_p = srtcp + srtcp_len -
-                (tag_len + stream->mki_size + sizeof(srtcp_trailer_t));
-    memcpy(&trailer, trailer_p, sizeof(trailer));
+    return status;
+}
 
-    e_bit_in_packet = (*trailer_p & SRTCP_E_BYTE_BIT) == SRTCP_E_BYTE_BIT;
-    if (e_bit_in_packet != sec_serv_confidentiality) {
-        return srtp_err_status_cant_check;
+srtp_err_status_t srtp_init(void)
+{
+    return srtp_init_ex(0);
+}
+
+srtp_err_status_t srtp_init_ex(unsigned int flags)
+{
+    srtp_err_status_t status;
+
+    if (flags & ~(unsigned int)SRTP_INIT_LAZY_SELF_TESTS) {
+        return srtp_err_status_bad_param;
     }
 
-    /*
-     * set the auth_start and auth_tag pointers to the proper locations
-     * (note that srtcp *always* uses authentication, unlike srtp)
-     */
-    auth_start = srtcp;
+    /* initialize crypto kernel */
+    status =
+        srtp_crypto_kernel_init_ex((flags & SRTP_INIT_LAZY_SELF_TESTS) != 0);
+    if (status) {
+        return status;
+    }
 
-    /*
-     * The location of the auth tag in the packet needs to know MKI
-     * could be present.  The data needed to calculate the Auth tag
-     * must not include the MKI
-     */
-    auth_len = srtcp_len - tag_len - stream->mki_size;
-    auth_tag = srtcp + auth_len + stream->mki_size;
+    /* load srtp debug module into the kernel */
+    status = srtp_crypto_kernel_load_debug_module(&mod_srtp);
+    if (status) {
+        return status;
+    }
 
-    /*
-     * check the sequence number for replays
-     */
-    /* this is easier than dealing with bitfield access */
-    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
-    status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_calibrate_crypto(void)
+{
+    return srtp_crypto_kernel_calibrate();
+}
+
+srtp_err_status_t srtp_shutdown(void)
+{
+    srtp_err_status_t status;
+
+    /* shut down crypto kernel */
+    status = srtp_crypto_kernel_shutdown();
     if (status) {
         return status;
     }
 
-    /*
-     * if we're using aes counter mode, set nonce and seq
-     */
-    if (session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_256) {
-        v128_t iv;
+    /* shutting down crypto kernel frees the srtp debug module as well */
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_rebind_keys(stream_template, stream) brings stream, a clone
+ * of stream_template, up to date with the keys the template was rekeyed
+ * with in place. The ciphers, auths and key limit are shared and already
+ * hold them, the MKIs, salts and IVs are the clone's own; its replay
+ * state and counters are kept, while precomputed keystream is dropped.
+ */
+static void srtp_stream_rebind_keys(const srtp_stream_ctx_t *stream_template,
+                                    srtp_stream_ctx_t *stream)
+{
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        srtp_session_keys_t *session_keys = &stream->session_keys[i];
+        const srtp_session_keys_t *template_session_keys =
+            &stream_template->session_keys[i];
+
+        if (stream->mki_size != 0) {
+            memcpy(session_keys->mki_id, template_session_keys->mki_id,
+                   stream->mki_size);
+        }
+        memcpy(session_keys->salt, template_session_keys->salt,
+               SRTP_AEAD_SALT_LEN);
+        memcpy(session_keys->c_salt, template_session_keys->c_salt,
+               SRTP_AEAD_SALT_LEN);
+        session_keys->rtcp_pending = template_session_keys->rtcp_pending;
+        session_keys->xtn_hdr_pending = template_session_keys->xtn_hdr_pending;
+        srtp_session_keys_set_iv_base(session_keys, stream->ssrc);
+    }
+
+    if (stream->cold != NULL && stream->cold->keystream != NULL) {
+        srtp_keystream_cache_t *cache = stream->cold->keystream;
+
+        for (size_t i = 0; i < cache->num_entries; i++) {
+            cache->entries[i].keys = NULL;
+            octet_string_set_to_zero(cache->entries[i].keystream,
+                                     cache->max_len);
+        }
+    }
+
+    stream->key_generation = stream_template->key_generation;
+}
+
+/*
+ * srtp_get_stream(srtp, ssrc) looks up the stream for ssrc, in network
+ * order; a clone that has not seen the latest rekey of the template yet
+ * takes its keys on the way
+ */
+srtp_stream_ctx_t *srtp_get_stream(srtp_t srtp, uint32_t ssrc)
+{
+    srtp_stream_ctx_t *stream = srtp_stream_list_get(srtp->stream_list, ssrc);
+
+    if (stream != NULL && stream->from_template &&
+        stream->key_generation != srtp->stream_template->key_generation) {
+        srtp_stream_rebind_keys(srtp->stream_template, stream);
+    }
+
+    return stream;
+}
+
+static bool srtp_crypto_policy_equal(const srtp_crypto_policy_t *a,
+                                     const srtp_crypto_policy_t *b)
+{
+    return a->cipher_type == b->cipher_type &&
+           a->cipher_key_len == b->cipher_key_len &&
+           a->auth_type == b->auth_type && a->auth_key_len == b->auth_key_len &&
+           a->auth_tag_len == b->auth_tag_len && a->sec_serv == b->sec_serv;
+}
+
+/*
+ * srtp_key_cache_matches(entry, p) returns true if a stream for policy p
+ * would derive the same keys as the streams of entry
+ */
+static bool srtp_key_cache_matches(const srtp_key_cache_entry_t *entry,
+                                   const srtp_policy_t p)
+{
+    if (entry->num_master_keys != p->num_master_keys ||
+        entry->use_mki != p->use_mki || entry->mki_size != p->mki_size ||
+        entry->enc_xtn_hdr != (p->enc_xtn_hdr_count > 0) ||
+        !srtp_crypto_policy_equal(&entry->rtp, &p->rtp) ||
+        !srtp_crypto_policy_equal(&entry->rtcp, &p->rtcp)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < entry->num_master_keys; i++) {
+        const srtp_master_key_t *a = &entry->master_keys[i];
+        const srtp_master_key_t *b = &p->master_keys[i];
+
+        if (a->key_len != b->key_len || a->salt_len != b->salt_len ||
+            a->mki_id_len != b->mki_id_len ||
+            !srtp_octet_string_equal(a->key, b->key,
+                                     a->key_len + a->salt_len) ||
+            memcmp(a->mki_id, b->mki_id, a->mki_id_len) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * srtp_key_cache_hash(p) hashes the first master key of policy p (FNV-1a),
+ * it only spreads the entries over the buckets
+ */
+static uint32_t srtp_key_cache_hash(const srtp_policy_t p)
+{
+    const srtp_master_key_t *master_key = &p->master_keys[0];
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < master_key->key_len + master_key->salt_len; i++) {
+        hash = (hash ^ master_key->key[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * srtp_key_cache_find(cache, p) returns the entry with the keys of
+ * policy p, or NULL if no stream of the session uses them
+ */
+static srtp_key_cache_entry_t *srtp_key_cache_find(
+    const srtp_key_cache_t *cache,
+    const srtp_policy_t p)
+{
+    srtp_key_cache_entry_t *entry;
+    uint32_t hash;
+
+    if (cache->count == 0 || p->num_master_keys == 0) {
+        return NULL;
+    }
+
+    hash = srtp_key_cache_hash(p);
+    entry = cache->buckets[hash & (cache->num_buckets - 1)];
+    for (; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && srtp_key_cache_matches(entry, p)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * srtp_key_cache_insert(cache, entry) adds entry to cache, doubling the
+ * number of buckets when there are more entries than buckets
+ */
+static srtp_err_status_t srtp_key_cache_insert(srtp_key_cache_t *cache,
+                                               srtp_key_cache_entry_t *entry)
+{
+    srtp_key_cache_entry_t **bucket;
+
+    if (cache->count >= cache->num_buckets) {
+        size_t num_buckets = cache->num_buckets ? cache->num_buckets * 2 : 16;
+        srtp_key_cache_entry_t **buckets;
+
+        buckets = (srtp_key_cache_entry_t **)srtp_crypto_alloc(
+            sizeof(srtp_key_cache_entry_t *) * num_buckets);
+        if (buckets == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+
+        for (size_t i = 0; i < cache->num_buckets; i++) {
+            while (cache->buckets[i] != NULL) {
+                srtp_key_cache_entry_t *e = cache->buckets[i];
+
+                cache->buckets[i] = e->next;
+                e->next = buckets[e->hash & (num_buckets - 1)];
+                buckets[e->hash & (num_buckets - 1)] = e;
+            }
+        }
+        srtp_crypto_free(cache->buckets);
+        cache->buckets = buckets;
+        cache->num_buckets = num_buckets;
+    }
+
+    bucket = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    cache->count++;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_key_cache_get_keys(entry, p, keys) sets keys to a stream that
+ * holds the expanded keys of entry, making the entry's own copy from its
+ * donor the first time the keys are shared
+ */
+static srtp_err_status_t srtp_key_cache_get_keys(
+    srtp_key_cache_entry_t *entry,
+    const srtp_policy_t p,
+    const srtp_stream_ctx_t **keys)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *str;
+
+    if (entry->keys == NULL) {
+        status = srtp_stream_alloc(&str, p, entry->donor);
+        if (status) {
+            return status;
+        }
+
+        status = srtp_stream_init(str, p, entry->donor);
+        if (status) {
+            srtp_stream_dealloc(str, entry->donor);
+            return status;
+        }
+
+        entry->keys = str;
+        entry->donor = NULL;
+    }
+
+    *keys = entry->keys;
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_keys_can_clone(stream) returns true if all ciphers and auth
+ * functions of stream can be cloned
+ */
+bool srtp_stream_keys_can_clone(const srtp_stream_ctx_t *stream)
+{
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        const srtp_session_keys_t *session_keys = &stream->session_keys[i];
+
+        if (session_keys->rtp_cipher->type->clone == NULL ||
+            session_keys->rtcp_cipher->type->clone == NULL ||
+            session_keys->rtp_auth->type->clone == NULL ||
+            session_keys->rtcp_auth->type->clone == NULL ||
+            (session_keys->rtp_xtn_hdr_cipher != NULL &&
+             session_keys->rtp_xtn_hdr_cipher->type->clone == NULL)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void srtp_key_cache_entry_dealloc(srtp_key_cache_entry_t *entry)
+{
+    if (entry->keys != NULL) {
+        srtp_stream_dealloc(entry->keys, NULL);
+    }
+    octet_string_set_to_zero(entry->master_keys,
+                             sizeof(srtp_master_key_t) *
+                                 entry->num_master_keys);
+    srtp_crypto_free(entry);
+}
+
+/*
+ * srtp_key_cache_add(session, p, stream) records the keys stream was
+ * keyed with from policy p. The cache is only an optimization, so if the
+ * keys can not be copied or the entry can not be allocated the stream is
+ * simply not recorded.
+ */
+static void srtp_key_cache_add(srtp_t session,
+                               const srtp_policy_t p,
+                               srtp_stream_ctx_t *stream)
+{
+    srtp_key_cache_entry_t *entry;
+
+    if (p->num_master_keys == 0 || !srtp_stream_keys_can_clone(stream)) {
+        return;
+    }
+
+    /* the master keys are kept in the same allocation, after the entry */
+    entry = (srtp_key_cache_entry_t *)srtp_crypto_alloc(
+        sizeof(srtp_key_cache_entry_t) +
+        sizeof(srtp_master_key_t) * p->num_master_keys);
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->master_keys = (srtp_master_key_t *)(entry + 1);
+    memcpy(entry->master_keys, p->master_keys,
+           sizeof(srtp_master_key_t) * p->num_master_keys);
+    entry->num_master_keys = p->num_master_keys;
+    entry->rtp = p->rtp;
+    entry->rtcp = p->rtcp;
+    entry->use_mki = p->use_mki;
+    entry->mki_size = p->mki_size;
+    entry->enc_xtn_hdr = p->enc_xtn_hdr_count > 0;
+    entry->hash = srtp_key_cache_hash(p);
+    entry->donor = stream;
+    entry->keys = NULL;
+    entry->refcount = 1;
+
+    if (srtp_key_cache_insert(&session->key_cache, entry)) {
+        srtp_key_cache_entry_dealloc(entry);
+        return;
+    }
+    stream->key_entry = entry;
+}
+
+/*
+ * srtp_key_cache_release(session, stream) drops the reference stream
+ * holds on its keys, freeing the entry when no stream uses them anymore
+ */
+static void srtp_key_cache_release(srtp_t session, srtp_stream_ctx_t *stream)
+{
+    srtp_key_cache_t *cache = &session->key_cache;
+    srtp_key_cache_entry_t *entry = stream->key_entry;
+    srtp_key_cache_entry_t **prev;
+
+    if (entry == NULL) {
+        return;
+    }
+    stream->key_entry = NULL;
+
+    if (entry->donor == stream) {
+        entry->donor = NULL;
+    }
+    if (--entry->refcount != 0) {
+        return;
+    }
+
+    prev = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+    while (*prev != entry) {
+        prev = &(*prev)->next;
+    }
+    *prev = entry->next;
+    cache->count--;
+    srtp_key_cache_entry_dealloc(entry);
+}
+
+static void srtp_key_cache_dealloc(srtp_key_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->num_buckets; i++) {
+        while (cache->buckets[i] != NULL) {
+            srtp_key_cache_entry_t *entry = cache->buckets[i];
+
+            cache->buckets[i] = entry->next;
+            srtp_key_cache_entry_dealloc(entry);
+        }
+    }
+    srtp_crypto_free(cache->buckets);
+    memset(cache, 0, sizeof(*cache));
+}
+
+/*
+ * srtp_session_free(session) deallocates session and everything it holds
+ */
+static srtp_err_status_t srtp_session_free(srtp_t session)
+{
+    srtp_err_status_t status;
+
+    /*
+     * we take a conservative deallocation strategy - if we encounter an
+     * error deallocating a stream, then we stop trying to deallocate
+     * memory and just return an error
+     */
+
+    /* deallocate streams */
+    status = srtp_remove_and_dealloc_streams(session->stream_list,
+                                             session->stream_template);
+    if (status) {
+        return status;
+    }
+
+    /* deallocate stream template, if there is one */
+    if (session->stream_template != NULL) {
+        status = srtp_stream_dealloc(session->stream_template, NULL);
+        if (status) {
+            return status;
+        }
+    }
+
+    /* deallocate preallocated streams */
+    srtp_stream_pool_dealloc(&session->stream_pool);
+
+    /* deallocate the template replaced by an update with key overlap */
+    if (session->previous_template != NULL) {
+        status = srtp_stream_dealloc(session->previous_template, NULL);
+        if (status) {
+            return status;
+        }
+    }
+
+    /* wipe the policy kept for keying clones */
+    srtp_policy_destroy(session->template_policy);
+
+    /* and the keys kept for explicit streams */
+    srtp_key_cache_dealloc(&session->key_cache);
+
+    srtp_crypto_free(session->events);
+
+    /* deallocate stream list */
+    status = srtp_stream_list_dealloc(session->stream_list);
+    if (status) {
+        return status;
+    }
+
+    /* deallocate session context */
+    srtp_crypto_free(session);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_dealloc(srtp_t session)
+{
+    /* the streams of queued batches must outlive them */
+    if (session->batch_head != NULL) {
+        return srtp_err_status_in_progress;
+    }
+
+    return srtp_session_free(session);
+}
+
+srtp_err_status_t srtp_dealloc_deferred(srtp_t session, srtp_retired_t *retired)
+{
+    if (session == NULL || retired == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (session->batch_head != NULL) {
+        return srtp_err_status_in_progress;
+    }
+
+    /* wait for the packets that are still being processed */
+    if (session->thread_safe) {
+        srtp_rwlock_write_lock(&session->lock);
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    *retired = (srtp_retired_t)session;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_reclaim(srtp_retired_t retired)
+{
+    if (retired == NULL) {
+        return srtp_err_status_ok;
+    }
+
+    return srtp_session_free(&retired->session);
+}
+
+static void srtp_trailer_cache_add(srtp_trailer_cache_t *cache,
+                                   srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_session_insert_stream(session, tmp, policy, key_entry) links the
+ * stream tmp, initialized from policy, into session. key_entry is the key
+ * cache entry for the keys of policy, if there is one. On failure the
+ * stream is deallocated.
+ */
+static srtp_err_status_t srtp_session_insert_stream(
+    srtp_t session,
+    srtp_stream_t tmp,
+    const srtp_policy_t policy,
+    srtp_key_cache_entry_t *key_entry)
+{
+    srtp_err_status_t status;
+
+    /*
+     * set the head of the stream list or the template to point to the
+     * stream that we've just alloced and init'ed, depending on whether
+     * or not it has a wildcard SSRC value or not
+     *
+     * if the template stream has already been set, then the policy is
+     * inconsistent, so we return a bad_param error code
+     */
+    switch (policy->ssrc.type) {
+    case (ssrc_any_outbound):
+        if (session->stream_template) {
+            srtp_stream_dealloc(tmp, NULL);
+            return srtp_err_status_bad_param;
+        }
+        session->stream_template = tmp;
+        session->stream_template->direction = dir_srtp_sender;
+        break;
+    case (ssrc_any_inbound):
+        if (session->stream_template) {
+            srtp_stream_dealloc(tmp, NULL);
+            return srtp_err_status_bad_param;
+        }
+        session->stream_template = tmp;
+        session->stream_template->direction = dir_srtp_receiver;
+        break;
+    case (ssrc_specific):
+        if (session->exportable) {
+            status = srtp_stream_keep_policy(tmp, policy);
+            if (status) {
+                srtp_stream_dealloc(tmp, NULL);
+                return status;
+            }
+        }
+        status = srtp_insert_or_dealloc_stream(session->stream_list, tmp,
+                                               session->stream_template);
+        if (status) {
+            return status;
+        }
+        if (key_entry != NULL) {
+            tmp->key_entry = key_entry;
+            key_entry->refcount++;
+        } else {
+            srtp_key_cache_add(session, policy, tmp);
+        }
+        break;
+    case (ssrc_undefined):
+    default:
+        srtp_stream_dealloc(tmp, NULL);
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * a thread safe session keeps the policy to key clones separately,
+     * otherwise preallocate the streams that will be cloned from the
+     * template; an exportable session keeps the policy in either case
+     */
+    if (session->stream_template == tmp) {
+        session->max_clones = policy->max_clones;
+        session->clone_idle_timeout = policy->clone_idle_timeout;
+        status = srtp_err_status_ok;
+        if (session->thread_safe || session->exportable) {
+            status = srtp_policy_clone(policy, &session->template_policy);
+        }
+        if (!status && !session->thread_safe) {
+            status = srtp_stream_pool_setup(&session->stream_pool, tmp,
+                                            policy->stream_pool_size);
+        }
+        if (status) {
+            srtp_policy_destroy(session->template_policy);
+            session->template_policy = NULL;
+            session->stream_template = NULL;
+            srtp_stream_dealloc(tmp, NULL);
+            return status;
+        }
+    }
+
+    srtp_trailer_cache_add(&session->trailer_cache, tmp);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_stream_add_unlocked(srtp_t session,
+                                           const srtp_policy_t policy)
+{
+    srtp_err_status_t status;
+    srtp_stream_t tmp;
+    srtp_key_cache_entry_t *key_entry = NULL;
+    const srtp_stream_ctx_t *key_donor = NULL;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_policy_validate(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    /* a stream with the keys of an existing stream copies its keys */
+    if (policy->ssrc.type == ssrc_specific) {
+        key_entry = srtp_key_cache_find(&session->key_cache, policy);
+        if (key_entry != NULL) {
+            status = srtp_key_cache_get_keys(key_entry, policy, &key_donor);
+            if (status) {
+                return status;
+            }
+        }
+    }
+
+    /* allocate stream  */
+    status = srtp_stream_alloc(&tmp, policy, key_donor);
+    if (status) {
+        return status;
+    }
+
+    /* initialize stream  */
+    status = srtp_stream_init(tmp, policy, key_donor);
+    if (status) {
+        srtp_stream_dealloc(tmp, key_donor);
+        return status;
+    }
+
+    return srtp_session_insert_stream(session, tmp, policy, key_entry);
+}
+
+srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t policy)
+{
+    srtp_err_status_t status;
+    int node;
+
+    if (session == NULL || !session->thread_safe) {
+        node = srtp_session_bind_allocs(session);
+        status = srtp_stream_add_unlocked(session, policy);
+        srtp_crypto_alloc_set_node(node);
+        return status;
+    }
+
+    node = srtp_session_bind_allocs(session);
+    srtp_rwlock_write_lock(&session->lock);
+    status = srtp_stream_add_unlocked(session, policy);
+    srtp_rwlock_write_unlock(&session->lock);
+    srtp_crypto_alloc_set_node(node);
+
+    return status;
+}
+
+srtp_err_status_t srtp_stream_prepare(const srtp_policy_t policy,
+                                      srtp_prepared_stream_t *prepared)
+{
+    srtp_err_status_t status;
+    srtp_prepared_stream_ctx_t *ctx;
+
+    if (prepared == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    *prepared = NULL;
+
+    status = srtp_policy_validate(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    ctx = (srtp_prepared_stream_ctx_t *)srtp_crypto_alloc(
+        sizeof(srtp_prepared_stream_ctx_t));
+    if (ctx == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    /* the copy is needed to link the stream in and to key its clones */
+    status = srtp_policy_clone(policy, &ctx->policy);
+    if (status) {
+        srtp_crypto_free(ctx);
+        return status;
+    }
+
+    status = srtp_stream_alloc(&ctx->stream, policy, NULL);
+    if (status) {
+        srtp_policy_destroy(ctx->policy);
+        srtp_crypto_free(ctx);
+        return status;
+    }
+
+    status = srtp_stream_init(ctx->stream, policy, NULL);
+    if (status) {
+        srtp_stream_dealloc(ctx->stream, NULL);
+        srtp_policy_destroy(ctx->policy);
+        srtp_crypto_free(ctx);
+        return status;
+    }
+
+    *prepared = ctx;
+    return srtp_err_status_ok;
+}
+
+void srtp_prepared_stream_dealloc(srtp_prepared_stream_t prepared)
+{
+    if (prepared == NULL) {
+        return;
+    }
+
+    if (prepared->stream != NULL) {
+        srtp_stream_dealloc(prepared->stream, NULL);
+    }
+    srtp_policy_destroy(prepared->policy);
+    srtp_crypto_free(prepared);
+}
+
+/*
+ * srtp_stream_commit_unlocked(session, prepared) links the stream of
+ * prepared into session, leaving prepared itself to the caller
+ */
+static srtp_err_status_t srtp_stream_commit_unlocked(
+    srtp_t session,
+    srtp_prepared_stream_t prepared)
+{
+    srtp_key_cache_entry_t *key_entry = NULL;
+    srtp_stream_t stream = prepared->stream;
+
+    /* let streams added later with the same keys share them */
+    if (prepared->policy->ssrc.type == ssrc_specific) {
+        key_entry = srtp_key_cache_find(&session->key_cache, prepared->policy);
+    }
+
+    prepared->stream = NULL;
+    return srtp_session_insert_stream(session, stream, prepared->policy,
+                                      key_entry);
+}
+
+srtp_err_status_t srtp_stream_commit(srtp_t session,
+                                     srtp_prepared_stream_t prepared)
+{
+    srtp_err_status_t status;
+    int node;
+
+    if (prepared == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (session == NULL) {
+        srtp_prepared_stream_dealloc(prepared);
+        return srtp_err_status_bad_param;
+    }
+
+    node = srtp_session_bind_allocs(session);
+    if (session->thread_safe) {
+        srtp_rwlock_write_lock(&session->lock);
+        status = srtp_stream_commit_unlocked(session, prepared);
+        srtp_rwlock_write_unlock(&session->lock);
+    } else {
+        status = srtp_stream_commit_unlocked(session, prepared);
+    }
+    srtp_crypto_alloc_set_node(node);
+    srtp_prepared_stream_dealloc(prepared);
+
+    return status;
+}
+
+/*
+ * srtp_session_create(session, policy) is srtp_create(), with the
+ * allocations bound to a NUMA node by the caller
+ */
+static srtp_err_status_t srtp_session_create(srtp_t *session,
+                                             const srtp_policy_t policy,
+                                             int node)
+{
+    srtp_err_status_t stat;
+    srtp_ctx_t *ctx;
+
+    if (policy) {
+        stat = srtp_policy_validate(policy);
+        if (stat != srtp_err_status_ok) {
+            return stat;
+        }
+    }
+
+    /* allocate srtp context and set ctx_ptr */
+    ctx = (srtp_ctx_t *)srtp_crypto_alloc(sizeof(srtp_ctx_t));
+    if (ctx == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    *session = ctx;
+
+    ctx->stream_template = NULL;
+    ctx->stream_list = NULL;
+    memset(&ctx->stream_pool, 0, sizeof(ctx->stream_pool));
+    ctx->user_data = NULL;
+    ctx->thread_safe = false;
+    ctx->exportable = false;
+    ctx->lock.state = 0;
+    ctx->template_policy = NULL;
+    memset(&ctx->key_cache, 0, sizeof(ctx->key_cache));
+    ctx->previous_template = NULL;
+    memset(&ctx->trailer_cache, 0, sizeof(ctx->trailer_cache));
+    ctx->numa_node = node;
+
+    /* allocate stream list */
+    stat = srtp_stream_list_alloc(&ctx->stream_list);
+    if (stat) {
+        /* clean up everything */
+        srtp_dealloc(*session);
+        *session = NULL;
+        return stat;
+    }
+
+    /*
+     * loop over elements in the policy list, allocating and
+     * initializing a stream for each element
+     */
+    if (policy != NULL) {
+        stat = srtp_stream_add_unlocked(ctx, policy);
+        if (stat) {
+            /* clean up everything */
+            srtp_dealloc(*session);
+            *session = NULL;
+            return stat;
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_create(srtp_t *session, /* handle for session     */
+                              const srtp_policy_t policy)
+{ /* SRTP policy (list)     */
+    return srtp_create_on_node(session, policy, SRTP_NUMA_NODE_ANY);
+}
+
+srtp_err_status_t srtp_create_on_node(srtp_t *session,
+                                      const srtp_policy_t policy,
+                                      int node)
+{
+    srtp_err_status_t stat;
+    int previous;
+
+    /* sanity check arguments */
+    if (session == NULL || node < SRTP_NUMA_NODE_ANY) {
+        return srtp_err_status_bad_param;
+    }
+
+    previous = srtp_crypto_alloc_set_node(node);
+    stat = srtp_session_create(session, policy, node);
+    srtp_crypto_alloc_set_node(previous);
+
+    return stat;
+}
+
+static srtp_err_status_t srtp_stream_remove_unlocked(srtp_t session,
+                                                     uint32_t ssrc)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* find and remove stream from the list */
+    stream = srtp_stream_list_get(session->stream_list, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_no_ctx;
+    }
+
+    srtp_stream_list_remove(session->stream_list, stream);
+    srtp_key_cache_release(session, stream);
+    session->trailer_cache.valid = false;
+    session->stream_generation++;
+    if (stream->from_template) {
+        session->num_clones--;
+    }
+
+    /* return the stream to the pool, or deallocate it */
+    if (srtp_stream_pool_put(&session->stream_pool, session->stream_template,
+                             stream)) {
+        return srtp_err_status_ok;
+    }
+
+    status = srtp_stream_dealloc(stream, session->stream_template);
+    if (status) {
+        return status;
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc)
+{
+    srtp_err_status_t status;
+
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_remove_unlocked(session, ssrc);
+    }
+
+    srtp_rwlock_write_lock(&session->lock);
+    status = srtp_stream_remove_unlocked(session, ssrc);
+    srtp_rwlock_write_unlock(&session->lock);
+
+    return status;
+}
+
+/*
+ * srtp_stream_add_many_prepared(session, policies, num) adds the streams
+ * for policies to a thread safe session. Their keys are derived before
+ * the lock is taken, which is then held once for all of them.
+ */
+static srtp_err_status_t srtp_stream_add_many_prepared(
+    srtp_t session,
+    const srtp_policy_t *policies,
+    size_t num)
+{
+    srtp_prepared_stream_t *prepared;
+    srtp_err_status_t status = srtp_err_status_ok;
+    size_t added = 0;
+
+    if (num > SIZE_MAX / sizeof(srtp_prepared_stream_t)) {
+        return srtp_err_status_alloc_fail;
+    }
+    prepared = (srtp_prepared_stream_t *)srtp_crypto_alloc(
+        num * sizeof(srtp_prepared_stream_t));
+    if (prepared == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    for (size_t i = 0; i < num && !status; i++) {
+        status = srtp_stream_prepare(policies[i], &prepared[i]);
+    }
+
+    if (!status) {
+        srtp_rwlock_write_lock(&session->lock);
+        status = srtp_stream_list_reserve(session->stream_list, num);
+        for (; added < num && !status; added++) {
+            status = srtp_stream_commit_unlocked(session, prepared[added]);
+            if (status) {
+                break;
+            }
+        }
+        /* the stream of a failed commit is already deallocated */
+        for (size_t i = 0; status && i < added; i++) {
+            srtp_stream_remove_unlocked(session, policies[i]->ssrc.value);
+        }
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        srtp_prepared_stream_dealloc(prepared[i]);
+    }
+    srtp_crypto_free(prepared);
+
+    return status;
+}
+
+srtp_err_status_t srtp_stream_add_many(srtp_t session,
+                                       const srtp_policy_t *policies,
+                                       size_t num_policies)
+{
+    srtp_err_status_t status;
+    size_t added;
+    int node;
+
+    if (session == NULL || (policies == NULL && num_policies > 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* check all policies up front, so that nothing is added on failure */
+    for (size_t i = 0; i < num_policies; i++) {
+        if (policies[i] == NULL ||
+            policies[i]->ssrc.type != ssrc_specific) {
+            return srtp_err_status_bad_param;
+        }
+        status = srtp_policy_validate(policies[i]);
+        if (status) {
+            return status;
+        }
+    }
+
+    if (num_policies == 0) {
+        return srtp_err_status_ok;
+    }
+
+    node = srtp_session_bind_allocs(session);
+    if (session->thread_safe) {
+        status = srtp_stream_add_many_prepared(session, policies, num_policies);
+        srtp_crypto_alloc_set_node(node);
+        return status;
+    }
+
+    status = srtp_stream_list_reserve(session->stream_list, num_policies);
+    if (status) {
+        srtp_crypto_alloc_set_node(node);
+        return status;
+    }
+
+    for (added = 0; added < num_policies; added++) {
+        status = srtp_stream_add_unlocked(session, policies[added]);
+        if (status) {
+            break;
+        }
+    }
+    srtp_crypto_alloc_set_node(node);
+
+    if (status) {
+        for (size_t i = 0; i < added; i++) {
+            srtp_stream_remove_unlocked(session, policies[i]->ssrc.value);
+        }
+    }
+
+    return status;
+}
+
+srtp_err_status_t srtp_stream_remove_many(srtp_t session,
+                                          const uint32_t *ssrcs,
+                                          size_t num_ssrcs)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    if (session == NULL || (ssrcs == NULL && num_ssrcs > 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (session->thread_safe) {
+        srtp_rwlock_write_lock(&session->lock);
+    }
+
+    /* remove every stream found, reporting the first failure */
+    for (size_t i = 0; i < num_ssrcs; i++) {
+        srtp_err_status_t err = srtp_stream_remove_unlocked(session, ssrcs[i]);
+        if (err && !status) {
+            status = err;
+        }
+    }
+
+    if (session->thread_safe) {
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    return status;
+}
+
+struct srtp_clone_gc_data {
+    srtp_t session;
+    srtp_stream_ctx_t *oldest; /* clone used least recently */
+    srtp_err_status_t status;
+};
+
+static bool srtp_find_oldest_clone_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct srtp_clone_gc_data *data = (struct srtp_clone_gc_data *)raw_data;
+    uint32_t epoch = data->session->epoch;
+
+    if (stream->from_template &&
+        (data->oldest == NULL ||
+         epoch - srtp_stream_last_used(data->session, stream) >
+             epoch - srtp_stream_last_used(data->session, data->oldest))) {
+        data->oldest = stream;
+    }
+
+    return true;
+}
+
+/*
+ * srtp_session_evict_clone(ctx) removes the clone of ctx that was used
+ * least recently
+ */
+static srtp_err_status_t srtp_session_evict_clone(srtp_t ctx)
+{
+    struct srtp_clone_gc_data data = { ctx, NULL, srtp_err_status_ok };
+
+    srtp_stream_list_for_each(ctx->stream_list, srtp_find_oldest_clone_cb,
+                              &data);
+    if (data.oldest == NULL) {
+        return srtp_err_status_ok;
+    }
+
+    debug_print(mod_srtp, "evicting stream (SSRC: 0x%08x)",
+                (unsigned int)ntohl(data.oldest->ssrc));
+
+    return srtp_stream_remove_unlocked(ctx, ntohl(data.oldest->ssrc));
+}
+
+static bool srtp_remove_idle_clone_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct srtp_clone_gc_data *data = (struct srtp_clone_gc_data *)raw_data;
+    srtp_t session = data->session;
+
+    if (stream->from_template &&
+        session->epoch - srtp_stream_last_used(session, stream) >
+            session->clone_idle_timeout) {
+        data->status =
+            srtp_stream_remove_unlocked(session, ntohl(stream->ssrc));
+        return data->status == srtp_err_status_ok;
+    }
+
+    return true;
+}
+
+static bool srtp_derive_pending_keys_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct srtp_clone_gc_data *data = (struct srtp_clone_gc_data *)raw_data;
+
+    data->status = srtp_stream_derive_pending_keys(stream);
+    return data->status == srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_session_gc_unlocked(srtp_t session)
+{
+    struct srtp_clone_gc_data data = { session, NULL, srtp_err_status_ok };
+
+    session->epoch++;
+
+    if (session->clone_idle_timeout != 0) {
+        srtp_stream_list_for_each(session->stream_list,
+                                  srtp_remove_idle_clone_cb, &data);
+        if (data.status) {
+            return data.status;
+        }
+    }
+
+    /* no master key is kept for longer than an epoch */
+    if (session->stream_template) {
+        data.status = srtp_stream_derive_pending_keys(session->stream_template);
+    }
+    if (!data.status && session->previous_template) {
+        data.status =
+            srtp_stream_derive_pending_keys(session->previous_template);
+    }
+    if (!data.status) {
+        srtp_stream_list_for_each(session->stream_list,
+                                  srtp_derive_pending_keys_cb, &data);
+    }
+
+    return data.status;
+}
+
+srtp_err_status_t srtp_session_gc(srtp_t session)
+{
+    srtp_err_status_t status;
+
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (!session->thread_safe) {
+        return srtp_session_gc_unlocked(session);
+    }
+
+    srtp_rwlock_write_lock(&session->lock);
+    status = srtp_session_gc_unlocked(session);
+    srtp_rwlock_write_unlock(&session->lock);
+
+    return status;
+}
+
+srtp_err_status_t srtp_session_set_breaker(srtp_t session,
+                                           size_t max_failures,
+                                           size_t cooldown)
+{
+    if (session == NULL || (max_failures != 0 && cooldown == 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (session->thread_safe) {
+        srtp_rwlock_write_lock(&session->lock);
+    }
+    session->breaker.max_failures = max_failures;
+    session->breaker.cooldown = cooldown;
+    session->breaker.failures = 0;
+    session->breaker.skip = 0;
+    if (session->thread_safe) {
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_session_get_breaker_rejections(srtp_t session,
+                                                      uint64_t *rejected)
+{
+    if (session == NULL || rejected == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* the breaker only changes under the exclusive lock */
+    if (session->thread_safe) {
+        srtp_rwlock_read_lock(&session->lock);
+    }
+    *rejected = session->breaker.rejected;
+    if (session->thread_safe) {
+        srtp_rwlock_read_unlock(&session->lock);
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t policy)
+{
+    srtp_err_status_t stat;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stat = srtp_policy_validate(policy);
+    if (stat != srtp_err_status_ok) {
+        return stat;
+    }
+
+    if (policy != NULL) {
+        int node = srtp_session_bind_allocs(session);
+        stat = srtp_stream_update(session, policy);
+        srtp_crypto_alloc_set_node(node);
+        if (stat) {
+            return stat;
+        }
+    }
+    return srtp_err_status_ok;
+}
+
+struct update_template_stream_data {
+    srtp_err_status_t status;
+    srtp_t session;
+    srtp_stream_t new_stream_template;
+    srtp_stream_list_t new_stream_list;
+    srtp_policy_t policy;
+};
+
+static bool update_template_stream_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct update_template_stream_data *data =
+        (struct update_template_stream_data *)raw_data;
+    srtp_t session = data->session;
+    uint32_t ssrc = stream->ssrc;
+    srtp_xtd_seq_num_t old_index;
+    srtp_rdb_t old_rtcp_rdb;
+    bool has_rtcp_rdb;
+    srtp_stream_stats_t old_stats;
+    uint32_t old_last_used;
+    srtp_stream_t previous = NULL;
+
+    /* old / non-template streams are copied unchanged */
+    if (!stream->from_template) {
+        srtp_stream_list_remove(session->stream_list, stream);
+        data->status = srtp_insert_or_dealloc_stream(
+            data->new_stream_list, stream, session->stream_template);
+        if (data->status) {
+            return false;
+        }
+        return true;
+    }
+
+    /* save old extended seq and counters */
+    old_index = stream->rtp_rdbx.index;
+    has_rtcp_rdb = stream->cold != NULL;
+    if (has_rtcp_rdb) {
+        old_rtcp_rdb = stream->cold->rtcp_rdb;
+    }
+    srtp_stream_get_counters(stream, &old_stats);
+    old_last_used = srtp_stream_last_used(session, stream);
+
+    /* remove stream, or keep it to accept its keys for a while */
+    if (data->policy->key_overlap != 0 &&
+        stream->direction != dir_srtp_sender) {
+        srtp_stream_list_remove(session->stream_list, stream);
+        session->stream_generation++;
+        previous = stream;
+    } else {
+        data->status = srtp_stream_remove_unlocked(session, ntohl(ssrc));
+        if (data->status) {
+            return false;
+        }
+    }
+
+    /* allocate and initialize a new stream */
+    if (session->thread_safe) {
+        data->status = srtp_stream_clone_private(
+            &session->stream_pool, data->new_stream_template, data->policy,
+            ssrc, &stream);
+    } else {
+        data->status = srtp_stream_clone(
+            &session->stream_pool, data->new_stream_template, ssrc, &stream);
+    }
+    if (data->status) {
+        if (previous != NULL) {
+            srtp_stream_dealloc(previous, session->stream_template);
+        }
+        return false;
+    }
+
+    /* add new stream to the head of the new_stream_list */
+    data->status = srtp_insert_or_dealloc_stream(data->new_stream_list, stream,
+                                                 data->new_stream_template);
+    if (data->status) {
+        if (previous != NULL) {
+            srtp_stream_dealloc(previous, session->stream_template);
+        }
+        return false;
+    }
+
+    /* the clone takes the place of the one removed above */
+    if (previous == NULL) {
+        session->num_clones++;
+    }
+
+    /* restore old extended seq and counters */
+    stream->rtp_rdbx.index = old_index;
+    stream->stats = old_stats;
+    stream->last_used = old_last_used;
+    stream->rtcp.last_used = old_last_used;
+    if (has_rtcp_rdb) {
+        srtp_rdb_t *rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+        if (rtcp_rdb == NULL) {
+            if (previous != NULL) {
+                srtp_stream_dealloc(previous, session->stream_template);
+            }
+            data->status = srtp_err_status_alloc_fail;
+            return false;
+        }
+        *rtcp_rdb = old_rtcp_rdb;
+    }
+
+    if (previous != NULL) {
+        data->status = srtp_stream_begin_overlap(
+            stream, previous, session->stream_template,
+            data->policy->key_overlap);
+        if (data->status) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static srtp_err_status_t is_update_policy_compatable(srtp_stream_t stream,
+                                                     const srtp_policy_t policy)
+{
+    if (stream->use_mki != policy->use_mki) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (stream->use_mki && stream->mki_size != policy->mki_size) {
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static bool srtp_cipher_same_shape(const srtp_cipher_t *a,
+                                   const srtp_cipher_t *b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return a->type == b->type && a->key_len == b->key_len;
+}
+
+static bool srtp_auth_same_shape(const srtp_auth_t *a, const srtp_auth_t *b)
+{
+    return a->type == b->type && a->key_len == b->key_len &&
+           a->out_len == b->out_len;
+}
+
+/*
+ * srtp_template_rekeyable(session, policy) returns true if the template
+ * of session can be rekeyed with policy in place: nothing but the master
+ * keys may differ, which is found by allocating, but not keying, a
+ * template for policy and comparing the two
+ */
+static bool srtp_template_rekeyable(srtp_t session, const srtp_policy_t policy)
+{
+    const srtp_stream_ctx_t *stream_template = session->stream_template;
+    srtp_stream_ctx_t *str;
+    size_t rtcp_window_size = policy->rtcp_window_size != 0
+                                  ? policy->rtcp_window_size
+                                  : SRTP_RDB_DEFAULT_WINDOW_SIZE;
+    bool rekeyable;
+
+    if (session->thread_safe || policy->key_overlap != 0 ||
+        session->previous_template != NULL ||
+        stream_template->rtp_services != policy->rtp.sec_serv ||
+        stream_template->rtcp_services != policy->rtcp.sec_serv ||
+        stream_template->rtcp_window_size != rtcp_window_size ||
+        stream_template->allow_repeat_tx != policy->allow_repeat_tx) {
+        return false;
+    }
+
+    if (srtp_stream_alloc(&str, policy, NULL)) {
+        return false;
+    }
+
+    rekeyable =
+        str->num_master_keys == stream_template->num_master_keys &&
+        str->mki_size == stream_template->mki_size &&
+        str->use_cryptex == stream_template->use_cryptex &&
+        srtp_rdbx_get_window_size(&str->rtp_rdbx) ==
+            srtp_rdbx_get_window_size(&stream_template->rtp_rdbx) &&
+        srtp_rdbx_get_max_window_size(&str->rtp_rdbx) ==
+            srtp_rdbx_get_max_window_size(&stream_template->rtp_rdbx) &&
+        str->enc_xtn_hdr_count == stream_template->enc_xtn_hdr_count &&
+        (str->enc_xtn_hdr_count == 0 ||
+         memcmp(str->enc_xtn_hdr, stream_template->enc_xtn_hdr,
+                str->enc_xtn_hdr_count) == 0);
+    for (size_t i = 0; rekeyable && i < str->num_master_keys; i++) {
+        const srtp_session_keys_t *a = &str->session_keys[i];
+        const srtp_session_keys_t *b = &stream_template->session_keys[i];
+
+        rekeyable = srtp_cipher_same_shape(a->rtp_cipher, b->rtp_cipher) &&
+                    srtp_cipher_same_shape(a->rtp_xtn_hdr_cipher,
+                                           b->rtp_xtn_hdr_cipher) &&
+                    srtp_cipher_same_shape(a->rtcp_cipher, b->rtcp_cipher) &&
+                    srtp_auth_same_shape(a->rtp_auth, b->rtp_auth) &&
+                    srtp_auth_same_shape(a->rtcp_auth, b->rtcp_auth);
+    }
+
+    srtp_stream_dealloc(str, NULL);
+
+    return rekeyable;
+}
+
+/*
+ * srtp_template_rekey(session, policy) rekeys the template of session
+ * with policy without replacing it. Its clones share its ciphers and
+ * auths, so they take the new keys at once whatever their number; what
+ * else they copied from the template is brought up to date by
+ * srtp_get_stream() when each of them is next looked up.
+ */
+static srtp_err_status_t srtp_template_rekey(srtp_t session,
+                                             const srtp_policy_t policy)
+{
+    srtp_stream_ctx_t *stream_template = session->stream_template;
+    srtp_policy_t new_template_policy = NULL;
+    srtp_err_status_t status;
+
+    debug_print(mod_srtp, "rekeying template in place, %zu clones",
+                session->num_clones);
+
+    if (session->exportable) {
+        status = srtp_policy_clone(policy, &new_template_policy);
+        if (status) {
+            return status;
+        }
+    }
+
+    /* even a failed rekey may have changed some keys of the template */
+    status = srtp_stream_init_all_master_keys(stream_template, policy);
+    stream_template->key_generation++;
+    if (status) {
+        srtp_policy_destroy(new_template_policy);
+        return status;
+    }
+
+    session->max_clones = policy->max_clones;
+    session->clone_idle_timeout = policy->clone_idle_timeout;
+    if (session->exportable) {
+        srtp_policy_destroy(session->template_policy);
+        session->template_policy = new_template_policy;
+    }
+
+    return srtp_stream_pool_setup(&session->stream_pool, stream_template,
+                                  policy->stream_pool_size);
+}
+
+/*
+ * update_template_streams(session, policy, prepared) replaces the template
+ * and rekeys the streams cloned from it. If prepared is not NULL it holds
+ * the new template, already keyed from policy, which is then taken over.
+ * A template whose policy only changes the master keys is rekeyed in
+ * place by srtp_template_rekey() instead, without visiting the clones.
+ */
+static srtp_err_status_t update_template_streams(
+    srtp_t session,
+    const srtp_policy_t policy,
+    srtp_prepared_stream_t prepared)
+{
+    srtp_err_status_t status;
+    srtp_stream_t new_stream_template;
+    srtp_stream_list_t new_stream_list;
+    srtp_policy_t new_template_policy = NULL;
+
+    if (session->stream_template == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = is_update_policy_compatable(session->stream_template, policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    if (prepared == NULL && srtp_template_rekeyable(session, policy)) {
+        return srtp_template_rekey(session, policy);
+    }
+
+    if (prepared != NULL) {
+        new_stream_template = prepared->stream;
+        prepared->stream = NULL;
+    } else {
+        /* allocate new template stream  */
+        status = srtp_stream_alloc(&new_stream_template, policy, NULL);
+        if (status) {
+            return status;
+        }
+
+        /* initialize new template stream  */
+        status = srtp_stream_init(new_stream_template, policy, NULL);
+        if (status) {
+            srtp_stream_dealloc(new_stream_template, NULL);
+            return status;
+        }
+    }
+
+    /* allocate new stream list */
+    status = srtp_stream_list_alloc(&new_stream_list);
+    if (status) {
+        srtp_stream_dealloc(new_stream_template, NULL);
+        return status;
+    }
+
+    /*
+     * a thread safe session keys each clone from a copy of the policy,
+     * which an exportable session keeps too
+     */
+    if (session->thread_safe || session->exportable) {
+        if (prepared != NULL) {
+            new_template_policy = prepared->policy;
+            prepared->policy = NULL;
+        } else {
+            status = srtp_policy_clone(policy, &new_template_policy);
+        }
+        if (status) {
+            srtp_stream_list_dealloc(new_stream_list);
+            srtp_stream_dealloc(new_stream_template, NULL);
+            return status;
+        }
+    }
+
+    /* process streams */
+    struct update_template_stream_data data = {
+        srtp_err_status_ok, session, new_stream_template, new_stream_list,
+        policy
+    };
+    srtp_stream_list_for_each(session->stream_list, update_template_stream_cb,
+                              &data);
+    if (data.status) {
+        /* free new allocations */
+        srtp_remove_and_dealloc_streams(new_stream_list, new_stream_template);
+        srtp_stream_list_dealloc(new_stream_list);
+        srtp_stream_dealloc(new_stream_template, NULL);
+        srtp_policy_destroy(new_template_policy);
+        return data.status;
+    }
+
+    /* dealloc old list / template */
+    srtp_remove_and_dealloc_streams(session->stream_list,
+                                    session->stream_template);
+    srtp_stream_list_dealloc(session->stream_list);
+
+    /*
+     * the clones have retired the keys of an earlier update, while with an
+     * overlap they keep sharing those of the template being replaced
+     */
+    if (session->previous_template != NULL) {
+        srtp_stream_dealloc(session->previous_template, NULL);
+        session->previous_template = NULL;
+    }
+    if (policy->key_overlap != 0) {
+        session->previous_template = session->stream_template;
+    } else {
+        srtp_stream_dealloc(session->stream_template, NULL);
+    }
+
+    /* set new list / template */
+    session->stream_template = new_stream_template;
+    session->max_clones = policy->max_clones;
+    session->clone_idle_timeout = policy->clone_idle_timeout;
+    session->stream_list = new_stream_list;
+
+    if (session->thread_safe || session->exportable) {
+        srtp_policy_destroy(session->template_policy);
+        session->template_policy = new_template_policy;
+    }
+    if (session->thread_safe) {
+        return srtp_err_status_ok;
+    }
+
+    /* refill the pool for the new template */
+    return srtp_stream_pool_setup(&session->stream_pool, new_stream_template,
+                                  policy->stream_pool_size);
+}
+
+/*
+ * stream_update(session, policy, prepared) replaces the stream for the
+ * SSRC of policy, keeping its replay state. If prepared is not NULL its
+ * stream, already keyed from policy, is linked in instead of a new one.
+ */
+static srtp_err_status_t stream_update(srtp_t session,
+                                       const srtp_policy_t policy,
+                                       srtp_prepared_stream_t prepared)
+{
+    srtp_err_status_t status;
+    srtp_xtd_seq_num_t old_index;
+    srtp_rdb_t old_rtcp_rdb;
+    bool has_rtcp_rdb;
+    srtp_stream_stats_t old_stats;
+    srtp_stream_t stream;
+    srtp_stream_t previous = NULL;
+
+    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = is_update_policy_compatable(stream, policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    /* save old extendard seq and counters */
+    old_index = stream->rtp_rdbx.index;
+    has_rtcp_rdb = stream->cold != NULL;
+    if (has_rtcp_rdb) {
+        old_rtcp_rdb = stream->cold->rtcp_rdb;
+    }
+    srtp_stream_get_counters(stream, &old_stats);
+
+    /*
+     * remove stream, or keep it to accept its keys for a while; a clone
+     * shares its keys with the template, which an update of the template
+     * may deallocate, so it is always removed
+     */
+    if (policy->key_overlap != 0 && stream->direction != dir_srtp_sender &&
+        !stream->from_template) {
+        srtp_stream_list_remove(session->stream_list, stream);
+        srtp_key_cache_release(session, stream);
+        session->stream_generation++;
+        previous = stream;
+    } else {
+        status = srtp_stream_remove_unlocked(session, policy->ssrc.value);
+        if (status) {
+            return status;
+        }
+    }
+
+    if (prepared != NULL) {
+        status = srtp_stream_commit_unlocked(session, prepared);
+    } else {
+        status = srtp_stream_add_unlocked(session, policy);
+    }
+    if (status) {
+        if (previous != NULL) {
+            srtp_stream_dealloc(previous, session->stream_template);
+        }
+        return status;
+    }
+
+    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+    if (stream == NULL) {
+        return srtp_err_status_fail;
+    }
+
+    /* restore old extended seq and counters */
+    stream->rtp_rdbx.index = old_index;
+    stream->stats = old_stats;
+    if (has_rtcp_rdb) {
+        srtp_rdb_t *rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+        if (rtcp_rdb == NULL) {
+            if (previous != NULL) {
+                srtp_stream_dealloc(previous, session->stream_template);
+            }
+            return srtp_err_status_alloc_fail;
+        }
+        *rtcp_rdb = old_rtcp_rdb;
+    }
+
+    if (previous != NULL) {
+        return srtp_stream_begin_overlap(stream, previous, NULL,
+                                         policy->key_overlap);
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_stream_update_unlocked(
+    srtp_t session,
+    const srtp_policy_t policy,
+    srtp_prepared_stream_t prepared)
+{
+    srtp_err_status_t status;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_policy_validate(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    /* the new keys may come with different tag lengths */
+    session->trailer_cache.valid = false;
+
+    switch (policy->ssrc.type) {
+    case (ssrc_any_outbound):
+    case (ssrc_any_inbound):
+        status = update_template_streams(session, policy, prepared);
+        break;
+    case (ssrc_specific):
+        status = stream_update(session, policy, prepared);
+        break;
+    case (ssrc_undefined):
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    return status;
+}
+
+srtp_err_status_t srtp_stream_update(srtp_t session, const srtp_policy_t policy)
+{
+    srtp_err_status_t status;
+
+    srtp_prepared_stream_t prepared;
+
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_update_unlocked(session, policy, NULL);
+    }
+
+    /*
+     * derive the new keys before taking the lock, so that packets of the
+     * other streams are only held up while the new streams are linked in
+     */
+    status = srtp_stream_prepare(policy, &prepared);
+    if (status) {
+        return status;
+    }
+
+    srtp_rwlock_write_lock(&session->lock);
+    status = srtp_stream_update_unlocked(session, policy, prepared);
+    srtp_rwlock_write_unlock(&session->lock);
+
+    srtp_prepared_stream_dealloc(prepared);
+
+    return status;
+}
+
+/*
+ * secure rtcp functions
+ */
+
+/*
+ * AEAD uses a new IV formation method.  This function implements
+ * section 9.1 (SRTCP IV Formation for AES-GCM) from RFC7714.
+ * The calculation is defined as, where (+) is the xor operation:
+ *
+ *                0  1  2  3  4  5  6  7  8  9 10 11
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+
+ *               |00|00|    SSRC   |00|00|0+SRTCP Idx|---+
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *                                                       |
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *               |         Encryption Salt           |->(+)
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *                                                       |
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *               |       Initialization Vector       |<--+
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+*
+ *
+ * Input:  *session_keys - pointer to SRTP stream context session keys,
+ *                        holding the salt xor'ed with the SSRC
+ *         *iv           - Pointer to recieve the calculated IV
+ *         seq_num       - The SEQ value to use for the IV calculation.
+ *         *hdr          - The RTP header, used to get the SSRC value
+ *
+ * Returns: srtp_err_status_ok if no error or srtp_err_status_bad_param
+ *          if seq_num is invalid
+ *
+ */
+static srtp_err_status_t srtp_calc_aead_iv_srtcp(
+    srtp_session_keys_t *session_keys,
+    v128_t *iv,
+    uint32_t seq_num,
+    const srtcp_hdr_t *hdr)
+{
+    /*
+     *  The SRTCP index (seq_num) spans bits 0 through 30 inclusive.
+     *  The most significant bit should be zero.
+     */
+    if (seq_num & 0x80000000UL) {
+        return srtp_err_status_bad_param;
+    }
+
+    *iv = session_keys->c_aead_iv_base;
+
+    /* a template can be used for packets of any SSRC */
+    if (hdr->ssrc != session_keys->iv_base_ssrc) {
+        srtp_iv_xor_ssrc(iv, hdr->ssrc ^ session_keys->iv_base_ssrc);
+    }
+
+    iv->v32[2] ^= htonl(seq_num);
+
+    debug_trace(mod_srtp, "RTCP IV = %s\n", v128_hex_string(iv));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This code handles AEAD ciphers for outgoing RTCP.  We currently support
+ * AES-GCM mode with 128 or 256 bit keys.
+ */
+static srtp_err_status_t srtp_protect_rtcp_aead(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *rtcp,
+    size_t rtcp_len,
+    uint8_t *srtcp,
+    size_t *srtcp_len,
+    srtp_session_keys_t *session_keys)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
+    size_t enc_start;         /* pointer to start of encrypted portion  */
+    uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;         /* trailer value                          */
+    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
+    srtp_err_status_t status;
+    size_t tag_len;
+    uint32_t seq_num;
+    srtp_rdb_t *rtcp_rdb;
+    v128_t iv;
+    SRTP_STAGE_START(t);
+
+    SRTP_STAGE_PACKET(ctx, protect);
+
+    /* get tag length from stream context */
+    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+
+    /*
+     * set encryption start and encryption length - if we're not
+     * providing confidentiality, set enc_start to NULL
+     */
+    enc_start = octets_in_rtcp_header;
+    enc_octet_len = rtcp_len - enc_start;
+
+    /* check output length */
+    if (*srtcp_len <
+        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
+
+    /* if not-inplace then need to copy full rtcp header */
+    if (rtcp != srtcp) {
+        memcpy(srtcp, rtcp, enc_start);
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_copy, t);
+    }
+
+    /* NOTE: hdr->length is not usable - it refers to only the first
+     * RTCP report in the compound packet!
+     */
+    trailer_p = srtcp + enc_start + enc_octet_len + tag_len;
+
+    if (stream->rtcp_services & sec_serv_conf) {
+        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
+    } else {
+        /* 0 is network-order independent */
+        trailer = 0x00000000; /* set encrypt bit */
+    }
+
+    if (stream->use_mki) {
+        srtp_inject_mki(srtcp + rtcp_len + tag_len + sizeof(srtcp_trailer_t),
+                        session_keys, stream->mki_size);
+    }
+
+    /*
+     * check sequence number for overruns, and copy it into the packet
+     * if its value isn't too big
+     */
+    rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+    if (rtcp_rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    status = srtp_rdb_next_value(rtcp_rdb, &seq_num);
+    if (status) {
+        return status;
+    }
+    trailer |= htonl(seq_num);
+    debug_trace(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+
+    memcpy(trailer_p, &trailer, sizeof(trailer));
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_index, t);
+
+    /*
+     * Calculate and set the IV
+     */
+    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                srtp_direction_encrypt);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /*
+     * Set the AAD for GCM mode
+     */
+    if (stream->rtcp_services & sec_serv_conf) {
+        /*
+         * If payload encryption is enabled, then the AAD consist of
+         * the RTCP header and the seq# at the end of the packet
+         */
+        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp,
+                                     octets_in_rtcp_header);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else {
+        /*
+         * Since payload encryption is not enabled, we must authenticate
+         * the entire packet as described in RFC 7714 (Section 9.3. Data
+         * Types in Unencrypted SRTCP Compound Packets)
+         */
+        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp, rtcp_len);
+        if (status) {
+            return (srtp_err_status_cipher_fail);
+        }
+    }
+    /*
+     * Process the sequence# as AAD
+     */
+    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
+                                 sizeof(trailer));
+    if (status) {
+        return (srtp_err_status_cipher_fail);
+    }
+
+    /* if we're encrypting, exor keystream into the message */
+    if (stream->rtcp_services & sec_serv_conf) {
+        size_t out_len = *srtcp_len - enc_start;
+        status =
+            srtp_cipher_encrypt(session_keys->rtcp_cipher, rtcp + enc_start,
+                                enc_octet_len, srtcp + enc_start, &out_len);
+        enc_octet_len = out_len;
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        if (rtcp != srtcp) {
+            memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+        }
+
+        /*
+         * Even though we're not encrypting the payload, we need
+         * to run the cipher to get the auth tag.
+         */
+        uint8_t *auth_tag = srtcp + enc_start + enc_octet_len;
+        size_t out_len = *srtcp_len - enc_start - enc_octet_len;
+        status = srtp_cipher_encrypt(session_keys->rtcp_cipher, NULL, 0,
+                                     auth_tag, &out_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+        enc_octet_len += out_len;
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+
+    *srtcp_len = octets_in_rtcp_header + enc_octet_len;
+
+    /* increase the packet length by the length of the seq_num*/
+    *srtcp_len += sizeof(srtcp_trailer_t);
+
+    /* increase the packet by the mki_size */
+    *srtcp_len += stream->mki_size;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function handles incoming SRTCP packets while in AEAD mode,
+ * which currently supports AES-GCM encryption.  Note, the auth tag is
+ * at the end of the packet stream and is automatically checked by GCM
+ * when decrypting the payload.
+ */
+static srtp_err_status_t srtp_unprotect_rtcp_aead(
+    srtp_t ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *srtcp,
+    size_t srtcp_len,
+    uint8_t *rtcp,
+    size_t *rtcp_len,
+    srtp_session_keys_t *session_keys)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
+    size_t enc_start;               /* pointer to start of encrypted portion  */
+    const uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;               /* trailer value                          */
+    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
+    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_err_status_t status;
+    size_t tag_len;
+    size_t tmp_len;
+    uint32_t seq_num;
+    srtp_rdb_t *rtcp_rdb;
+    v128_t iv;
+    SRTP_STAGE_START(t);
+
+    SRTP_STAGE_PACKET(ctx, unprotect);
+
+    /* get tag length from stream context */
+    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+
+    enc_start = octets_in_rtcp_header;
+
+    /*
+     * set encryption start, encryption length, and trailer
+     */
+    /* index & E (encryption) bit follow normal data. hdr->len is the number of
+     * words (32-bit) in the normal packet minus 1
+     */
+    /* This should point trailer to the word past the end of the normal data. */
+    /* This would need to be modified for optional mikey data */
+    trailer_p = srtcp + srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size;
+    memcpy(&trailer, trailer_p, sizeof(trailer));
+
+    /*
+     * We pass the tag down to the cipher when doing GCM mode
+     */
+    enc_octet_len = srtcp_len - (octets_in_rtcp_header +
+                                 sizeof(srtcp_trailer_t) + stream->mki_size);
+    auth_tag = srtcp + (srtcp_len - tag_len - stream->mki_size -
+                        sizeof(srtcp_trailer_t));
+
+    /*
+     * check the sequence number for replays
+     */
+    /* this is easier than dealing with bitfield access */
+    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
+    debug_trace(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+    rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+    if (rtcp_rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    status = srtp_rdb_check(rtcp_rdb, seq_num);
+    if (status) {
+        return status;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+
+    /*
+     * Calculate and set the IV
+     */
+    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                srtp_direction_decrypt);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /* check output length */
+    if (*rtcp_len <
+        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+
+    /* if not inplace need to copy rtcp header */
+    if (srtcp != rtcp) {
+        memcpy(rtcp, srtcp, enc_start);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_copy, t);
+    }
+
+    /*
+     * Set the AAD for GCM mode
+     */
+    if (*trailer_p & SRTCP_E_BYTE_BIT) {
+        /*
+         * If payload encryption is enabled, then the AAD consist of
+         * the RTCP header and the seq# at the end of the packet
+         */
+        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, srtcp,
+                                     octets_in_rtcp_header);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else {
+        /*
+         * Since payload encryption is not enabled, we must authenticate
+         * the entire packet as described in RFC 7714 (Section 9.3. Data
+         * Types in Unencrypted SRTCP Compound Packets)
+         */
+        status = srtp_cipher_set_aad(
+            session_keys->rtcp_cipher, srtcp,
+            (srtcp_len - tag_len - sizeof(srtcp_trailer_t) - stream->mki_size));
+        if (status) {
+            return (srtp_err_status_cipher_fail);
+        }
+    }
+
+    /*
+     * Process the sequence# as AAD
+     */
+    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
+                                 sizeof(trailer));
+    if (status) {
+        return (srtp_err_status_cipher_fail);
+    }
+
+    /* if we're decrypting, exor keystream into the message */
+    if (*trailer_p & SRTCP_E_BYTE_BIT) {
+        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
+                                     srtcp + enc_start, enc_octet_len,
+                                     rtcp + enc_start, &enc_octet_len);
+        if (status) {
+            return status;
+        }
+    } else {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        if (rtcp != srtcp) {
+            memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
+        }
+
+        /*
+         * Still need to run the cipher to check the tag
+         */
+        tmp_len = 0;
+        status = srtp_cipher_decrypt(session_keys->rtcp_cipher, auth_tag,
+                                     tag_len, NULL, &tmp_len);
+        if (status) {
+            return status;
+        }
+    }
+
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+
+    *rtcp_len = srtcp_len;
+
+    /* decrease the packet length by the length of the auth tag and seq_num*/
+    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t) + stream->mki_size);
+
+    /*
+     * verify that stream is for received traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     *
+     * we do this check *after* the authentication check, so that the
+     * latter check will catch any attempts to fool us into thinking
+     * that we've got a collision
+     */
+    srtp_stream_check_direction(ctx, stream, dir_srtp_receiver);
+
+    /*
+     * if the stream is a 'provisional' one, in which the template context
+     * is used, then we need to allocate a new stream at this point, since
+     * the authentication passed
+     */
+    if (stream == ctx->stream_template) {
+        srtp_stream_ctx_t *new_stream;
+
+        /*
+         * allocate and initialize a new stream
+         *
+         * note that we indicate failure if we can't allocate the new
+         * stream, and some implementations will want to not return
+         * failure here
+         */
+        status = srtp_session_clone_stream(ctx, hdr->ssrc, &new_stream);
+        if (status) {
+            return status;
+        }
+
+        /* add new stream to the list */
+        status = srtp_session_insert_clone(ctx, new_stream);
+        if (status) {
+            return status;
+        }
+
+        /* set stream (the pointer used in this function) */
+        stream = new_stream;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
+
+    /* we've passed the authentication check, so add seq_num to the rdb */
+    rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+    if (rtcp_rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    srtp_rdb_add_index(rtcp_rdb, seq_num);
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_protect_rtcp_keys() protects an RTCP packet of stream with
+ * session_keys, which have already been selected by the caller
+ */
+static srtp_err_status_t srtp_protect_rtcp_keys(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    srtp_session_keys_t *session_keys,
+    const uint8_t *rtcp,
+    size_t rtcp_len,
+    uint8_t *srtcp,
+    size_t *srtcp_len)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
+    size_t enc_start;         /* pointer to start of encrypted portion  */
+    uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;         /* trailer value                          */
+    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
+    uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_err_status_t status;
+    size_t tag_len;
+    size_t prefix_len;
+    uint32_t seq_num;
+    srtp_rdb_t *rtcp_rdb;
+    SRTP_STAGE_START(t);
+
+    status = srtp_session_keys_ready(session_keys, SRTP_DERIVE_RTCP);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
+     * the request to our AEAD handler.
+     */
+    if (srtp_cipher_is_aead(session_keys->rtp_cipher)) {
+        return srtp_protect_rtcp_aead(ctx, stream, rtcp, rtcp_len, srtcp,
+                                      srtcp_len, session_keys);
+    }
+    SRTP_STAGE_PACKET(ctx, protect);
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_lookup, t);
+
+    /* get tag length from stream context */
+    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+
+    /*
+     * set encryption start and encryption length
+     */
+    enc_start = octets_in_rtcp_header;
+    enc_octet_len = rtcp_len - enc_start;
+
+    /* check output length */
+    if (*srtcp_len <
+        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_other, t);
+
+    /* if not in place then need to copy rtcp header */
+    if (rtcp != srtcp) {
+        memcpy(srtcp, rtcp, enc_start);
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_copy, t);
+    }
+
+    /* all of the packet, except the header, gets encrypted */
+    /*
+     * NOTE: hdr->length is not usable - it refers to only the first RTCP report
+     * in the compound packet!
+     */
+    trailer_p = srtcp + enc_start + enc_octet_len;
+
+    if (stream->rtcp_services & sec_serv_conf) {
+        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
+    } else {
+        /* 0 is network-order independant */
+        trailer = 0x00000000; /* set encrypt bit */
+    }
+
+    if (stream->use_mki) {
+        srtp_inject_mki(srtcp + rtcp_len + sizeof(srtcp_trailer_t),
+                        session_keys, stream->mki_size);
+    }
+
+    /*
+     * set the auth_start and auth_tag pointers to the proper locations
+     * (note that srtpc *always* provides authentication, unlike srtp)
+     */
+    /* Note: This would need to change for optional mikey data */
+    auth_start = srtcp;
+    auth_tag = srtcp + rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size;
+
+    /*
+     * check sequence number for overruns, and copy it into the packet
+     * if its value isn't too big
+     */
+    rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+    if (rtcp_rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    status = srtp_rdb_next_value(rtcp_rdb, &seq_num);
+    if (status) {
+        return status;
+    }
+    trailer |= htonl(seq_num);
+    debug_trace(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+
+    memcpy(trailer_p, &trailer, sizeof(trailer));
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_index, t);
+
+    /*
+     * if we're using rindael counter mode, set nonce and seq
+     */
+    if (srtp_cipher_is_icm(session_keys->rtcp_cipher)) {
+        v128_t iv;
+
+        iv.v32[0] = 0;
+        iv.v32[1] = hdr->ssrc; /* still in network order! */
+        iv.v32[2] = htonl(seq_num >> 16);
+        iv.v32[3] = htonl(seq_num << 16);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_encrypt);
+
+    } else {
+        v128_t iv;
+
+        /* otherwise, just set the index to seq_num */
+        iv.v32[0] = 0;
+        iv.v32[1] = 0;
+        iv.v32[2] = 0;
+        iv.v32[3] = htonl(seq_num);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_encrypt);
+    }
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /*
+     * if we're authenticating using a universal hash, put the keystream
+     * prefix into the authentication tag
+     */
+
+    /* if auth_start is non-null, then put keystream into tag  */
+    if (auth_start) {
+        /* put keystream prefix into auth_tag */
+        prefix_len = srtp_auth_get_prefix_length(session_keys->rtcp_auth);
+        status = srtp_cipher_output(session_keys->rtcp_cipher, auth_tag,
+                                    &prefix_len);
+
+        debug_trace(mod_srtp, "keystream prefix: %s",
+                    srtp_octet_string_hex_string(auth_tag, prefix_len));
+
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    }
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+
+    /* if we're encrypting, exor keystream into the message */
+    if (stream->rtcp_services & sec_serv_conf) {
+        status = srtp_cipher_encrypt(session_keys->rtcp_cipher,
+                                     rtcp + enc_start, enc_octet_len,
+                                     srtcp + enc_start, &enc_octet_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_cipher, t);
+    } else if (rtcp != srtcp) {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+        SRTP_STAGE_LAP(ctx, protect, srtp_stage_copy, t);
+    }
+
+    /* initialize auth func context */
+    status = srtp_auth_start(session_keys->rtcp_auth);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * run auth func over packet (including trailer), and write the
+     * result at auth_tag
+     */
+    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start,
+                               rtcp_len + sizeof(srtcp_trailer_t), auth_tag);
+    debug_trace(mod_srtp, "srtcp auth tag:    %s",
+                srtp_octet_string_hex_string(auth_tag, tag_len));
+    if (status) {
+        return srtp_err_status_auth_fail;
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_auth, t);
+
+    *srtcp_len = enc_start + enc_octet_len;
+
+    /* increase the packet length by the length of the auth tag and seq_num*/
+    *srtcp_len += (tag_len + sizeof(srtcp_trailer_t));
+
+    /* increase the packet by the mki_size */
+    *srtcp_len += stream->mki_size;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_protect_rtcp_stream() protects an RTCP packet with the keys of
+ * stream, the stream its SSRC belongs to
+ */
+static srtp_err_status_t srtp_protect_rtcp_stream(srtp_t ctx,
+                                                  srtp_stream_ctx_t *stream,
+                                                  const uint8_t *rtcp,
+                                                  size_t rtcp_len,
+                                                  uint8_t *srtcp,
+                                                  size_t *srtcp_len,
+                                                  size_t mki_index)
+{
+    srtp_err_status_t status;
+    srtp_session_keys_t *session_keys = NULL;
+
+    /*
+     * verify that stream is for sending traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     */
+    srtp_stream_check_direction(ctx, stream, dir_srtp_sender);
+
+    status = srtp_get_session_keys(stream, mki_index, &session_keys);
+    if (status) {
+        return status;
+    }
+
+    return srtp_protect_rtcp_keys(ctx, stream, session_keys, rtcp, rtcp_len,
+                                  srtcp, srtcp_len);
+}
+
+static srtp_err_status_t srtp_protect_rtcp_unlocked(srtp_t ctx,
+                                                    const uint8_t *rtcp,
+                                                    size_t rtcp_len,
+                                                    uint8_t *srtcp,
+                                                    size_t *srtcp_len,
+                                                    size_t mki_index)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+    SRTP_STAGE_START(t);
+
+    /* check the packet length - it must at least contain a full header */
+    if (rtcp_len < octets_in_rtcp_header) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * look up ssrc in srtp_stream list, and process the packet with
+     * the appropriate stream.  if we haven't seen this stream before,
+     * there's only one key for this srtp_session, and the cipher
+     * supports key-sharing, then we assume that a new stream using
+     * that key has just started up
+     */
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template != NULL) {
+            srtp_stream_ctx_t *new_stream;
+
+            /* allocate and initialize a new stream */
+            status = srtp_session_clone_stream(ctx, hdr->ssrc, &new_stream);
+            if (status) {
+                return status;
+            }
+
+            /* add new stream to the list */
+            status = srtp_session_insert_clone(ctx, new_stream);
+            if (status) {
+                return status;
+            }
+
+            /* set stream (the pointer used in this function) */
+            stream = new_stream;
+        } else {
+            /* no template stream, so we return an error */
+            return srtp_err_status_no_ctx;
+        }
+    }
+
+    SRTP_STAGE_LAP(ctx, protect, srtp_stage_lookup, t);
+
+    status = srtp_protect_rtcp_stream(ctx, stream, rtcp, rtcp_len, srtcp,
+                                      srtcp_len, mki_index);
+    srtp_stream_stats_count(ctx, stream, false, true, status, rtcp_len);
+
+    return status;
+}
+
+srtp_err_status_t srtp_protect_rtcp(srtp_t ctx,
+                                    const uint8_t *rtcp,
+                                    size_t rtcp_len,
+                                    uint8_t *srtcp,
+                                    size_t *srtcp_len,
+                                    size_t mki_index)
+{
+    srtp_stream_ctx_t *stream;
+    unsigned int locks = SRTP_STREAM_LOCK_RTCP;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || !ctx->thread_safe) {
+        status = srtp_protect_rtcp_unlocked(ctx, rtcp, rtcp_len, srtcp,
+                                            srtcp_len, mki_index);
+    } else {
+        stream = srtp_session_enter_packet(ctx, rtcp, rtcp_len, 4, &locks);
+        status = srtp_protect_rtcp_unlocked(ctx, rtcp, rtcp_len, srtcp,
+                                            srtcp_len, mki_index);
+        srtp_session_leave_locks(ctx, stream, locks);
+    }
+    SRTP_PROBE3(protect_rtcp, srtp_probe_ssrc(rtcp, rtcp_len, 4), rtcp_len,
+                status);
+
+    return status;
+}
+
+/*
+ * srtp_unprotect_rtcp_stream() verifies and decrypts an SRTCP packet with
+ * the keys of stream, or of the template if stream is NULL
+ */
+static srtp_err_status_t srtp_unprotect_rtcp_stream(srtp_ctx_t *ctx,
+                                                    srtp_stream_ctx_t *stream,
+                                                    const uint8_t *srtcp,
+                                                    size_t srtcp_len,
+                                                    uint8_t *rtcp,
+                                                    size_t *rtcp_len)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
+    size_t enc_start;               /* pointer to start of encrypted portion  */
+    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    const uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;               /* trailer value                          */
+    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
+    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+    srtp_err_status_t status;
+    size_t auth_len;
+    size_t tag_len;
+    size_t prefix_len;
+    uint32_t seq_num;
+    srtp_rdb_t *rtcp_rdb;
+    bool e_bit_in_packet;          /* E-bit was found in the packet */
+    bool sec_serv_confidentiality; /* whether confidentiality was requested */
+    srtp_session_keys_t *session_keys = NULL;
+    SRTP_STAGE_START(t);
+
+    /*
+     * check that the length value is sane; we'll check again once we
+     * know the tag length, but we at least want to know that it is
+     * a positive value
+     */
+    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t)) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * if we haven't seen this stream before, there's only one key for
+     * this srtp_session, and the cipher supports key-sharing, then we
+     * assume that a new stream using that key has just started up
+     */
+    if (stream == NULL) {
+        if (ctx->stream_template != NULL) {
+            stream = ctx->stream_template;
+
+            debug_trace(mod_srtp,
+                        "srtcp using provisional stream (SSRC: 0x%08x)",
+                        (unsigned int)ntohl(hdr->ssrc));
+        } else {
+            /* no template stream, so we return an error */
+            return srtp_err_status_no_ctx;
+        }
+    }
+
+    /*
+     * Determine if MKI is being used and what session keys should be used
+     */
+    status = srtp_get_session_keys_for_rtcp_packet(stream, srtcp, srtcp_len,
+                                                   &session_keys);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_session_keys_ready(session_keys, SRTP_DERIVE_RTCP);
+    if (status) {
+        return status;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
+
+    /* get tag length from stream context */
+    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+
+    /* check the packet length - it must contain at least a full RTCP
+       header, an auth tag (if applicable), and the SRTCP encrypted flag
+       and 31-bit index value */
+    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t) +
+                        stream->mki_size + tag_len) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
+     * the request to our AEAD handler.
+     */
+    if (srtp_cipher_is_aead(session_keys->rtp_cipher)) {
+        return srtp_unprotect_rtcp_aead(ctx, stream, srtcp, srtcp_len, rtcp,
+                                        rtcp_len, session_keys);
+    }
+    SRTP_STAGE_PACKET(ctx, unprotect);
+
+    sec_serv_confidentiality = stream->rtcp_services == sec_serv_conf ||
+                               stream->rtcp_services == sec_serv_conf_and_auth;
+
+    /*
+     * set encryption start, encryption length, and trailer
+     */
+    enc_start = octets_in_rtcp_header;
+    enc_octet_len = srtcp_len - (octets_in_rtcp_header + tag_len +
+                                 stream->mki_size + sizeof(srtcp_trailer_t));
+    /*
+     *index & E (encryption) bit follow normal data. hdr->len is the number of
+     * words (32-bit) in the normal packet minus 1
+     */
+    /* This should point trailer to the word past the end of the normal data. */
+    /* This would need to be modified for optional mikey data */
+    trailer_p = srtcp + srtcp_len -
+                (tag_len + stream->mki_size + sizeof(srtcp_trailer_t));
+    memcpy(&trailer, trailer_p, sizeof(trailer));
+
+    e_bit_in_packet = (*trailer_p & SRTCP_E_BYTE_BIT) == SRTCP_E_BYTE_BIT;
+    if (e_bit_in_packet != sec_serv_confidentiality) {
+        return srtp_err_status_cant_check;
+    }
+
+    /*
+     * set the auth_start and auth_tag pointers to the proper locations
+     * (note that srtcp *always* uses authentication, unlike srtp)
+     */
+    auth_start = srtcp;
+
+    /*
+     * The location of the auth tag in the packet needs to know MKI
+     * could be present.  The data needed to calculate the Auth tag
+     * must not include the MKI
+     */
+    auth_len = srtcp_len - tag_len - stream->mki_size;
+    auth_tag = srtcp + auth_len + stream->mki_size;
+
+    /*
+     * check the sequence number for replays
+     */
+    /* this is easier than dealing with bitfield access */
+    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
+    debug_trace(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+    rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+    if (rtcp_rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    status = srtp_rdb_check(rtcp_rdb, seq_num);
+    if (status) {
+        return status;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+
+    /*
+     * if we're using aes counter mode, set nonce and seq
+     */
+    if (srtp_cipher_is_icm(session_keys->rtcp_cipher)) {
+        v128_t iv;
 
         iv.v32[0] = 0;
         iv.v32[1] = hdr->ssrc; /* still in network order! */
@@ -4446,418 +10292,1602 @@ srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
         status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
                                     srtp_direction_decrypt);
 
-    } else {
-        v128_t iv;
+    } else {
+        v128_t iv;
+
+        /* otherwise, just set the index to seq_num */
+        iv.v32[0] = 0;
+        iv.v32[1] = 0;
+        iv.v32[2] = 0;
+        iv.v32[3] = htonl(seq_num);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_decrypt);
+    }
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /*
+     * if we're authenticating using a universal hash, put the keystream
+     * prefix into the authentication tag
+     */
+    prefix_len = srtp_auth_get_prefix_length(session_keys->rtcp_auth);
+    if (prefix_len) {
+        status =
+            srtp_cipher_output(session_keys->rtcp_cipher, tmp_tag, &prefix_len);
+        debug_trace(mod_srtp, "keystream prefix: %s",
+                    srtp_octet_string_hex_string(tmp_tag, prefix_len));
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+
+    /* initialize auth func context */
+    status = srtp_auth_start(session_keys->rtcp_auth);
+    if (status) {
+        return status;
+    }
+
+    /* run auth func over packet and check the tag in the packet */
+    debug_trace(mod_srtp, "srtcp tag from packet:    %s",
+                srtp_octet_string_hex_string(auth_tag, tag_len));
+    status = srtp_auth_verify(session_keys->rtcp_auth, auth_start, auth_len,
+                              auth_tag);
+    if (status) {
+        return srtp_err_status_auth_fail;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_auth, t);
+
+    /* check output length */
+    if (*rtcp_len <
+        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    /* if not inplace need to copy rtcp header */
+    if (srtcp != rtcp) {
+        memcpy(rtcp, srtcp, enc_start);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_copy, t);
+    }
+
+    /* if we're decrypting, exor keystream into the message */
+    if (sec_serv_confidentiality) {
+        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
+                                     srtcp + enc_start, enc_octet_len,
+                                     rtcp + enc_start, &enc_octet_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_cipher, t);
+    } else if (srtcp != rtcp) {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
+        SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_copy, t);
+    }
+
+    *rtcp_len = srtcp_len;
+
+    /* decrease the packet length by the length of the auth tag and seq_num */
+    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t));
+
+    /* decrease the packet length by the length of the mki_size */
+    *rtcp_len -= stream->mki_size;
+
+    /*
+     * verify that stream is for received traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     *
+     * we do this check *after* the authentication check, so that the
+     * latter check will catch any attempts to fool us into thinking
+     * that we've got a collision
+     */
+    srtp_stream_check_direction(ctx, stream, dir_srtp_receiver);
+
+    /*
+     * if the stream is a 'provisional' one, in which the template context
+     * is used, then we need to allocate a new stream at this point, since
+     * the authentication passed
+     */
+    if (stream == ctx->stream_template) {
+        srtp_stream_ctx_t *new_stream;
+
+        /*
+         * allocate and initialize a new stream
+         *
+         * note that we indicate failure if we can't allocate the new
+         * stream, and some implementations will want to not return
+         * failure here
+         */
+        status = srtp_session_clone_stream(ctx, hdr->ssrc, &new_stream);
+        if (status) {
+            return status;
+        }
+
+        /* add new stream to the list */
+        status = srtp_session_insert_clone(ctx, new_stream);
+        if (status) {
+            return status;
+        }
+
+        /* set stream (the pointer used in this function) */
+        stream = new_stream;
+    }
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
+
+    /* we've passed the authentication check, so add seq_num to the rdb */
+    rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+    if (rtcp_rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    srtp_rdb_add_index(rtcp_rdb, seq_num);
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_index, t);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_unprotect_rtcp_overlap() unprotects an SRTCP packet of a stream in
+ * a key overlap. Until an SRTCP packet authenticates with the new keys
+ * the previous ones are tried first; as SRTCP is infrequent, reordered
+ * packets protected with the previous keys then simply take a second try.
+ */
+static srtp_err_status_t srtp_unprotect_rtcp_overlap(srtp_ctx_t *ctx,
+                                                     srtp_stream_ctx_t *stream,
+                                                     const uint8_t *srtcp,
+                                                     size_t srtcp_len,
+                                                     uint8_t *rtcp,
+                                                     size_t *rtcp_len)
+{
+    srtp_err_status_t status;
+    bool new_keys;
+
+    status = srtp_unprotect_overlap(
+        ctx, stream, srtp_unprotect_rtcp_stream,
+        !stream->cold->overlap.rtcp_switched, srtcp, srtcp_len, rtcp, rtcp_len,
+        &new_keys);
+    if (status || !new_keys) {
+        return status;
+    }
+
+    stream->cold->overlap.rtcp_switched = true;
+    srtp_stream_overlap_count(stream);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_unprotect_rtcp_counted() is the SRTCP counterpart of
+ * srtp_unprotect_rtp_counted()
+ */
+static srtp_err_status_t srtp_unprotect_rtcp_counted(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t **stream_ptr,
+    const uint8_t *srtcp,
+    size_t srtcp_len,
+    uint8_t *rtcp,
+    size_t *rtcp_len)
+{
+    srtp_stream_ctx_t *stream = *stream_ptr;
+    srtp_err_status_t status;
+    bool provisional = stream == NULL && ctx->stream_template != NULL;
+
+    if (((const srtcp_hdr_t *)srtcp)->version != 2) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (provisional && !srtp_breaker_allow(ctx)) {
+        return srtp_err_status_no_ctx;
+    }
+
+    if (stream != NULL && srtp_stream_in_overlap(stream)) {
+        status = srtp_unprotect_rtcp_overlap(ctx, stream, srtcp, srtcp_len,
+                                             rtcp, rtcp_len);
+    } else {
+        status = srtp_unprotect_rtcp_stream(ctx, stream, srtcp, srtcp_len,
+                                            rtcp, rtcp_len);
+    }
+
+    if (provisional) {
+        srtp_breaker_count(ctx, status);
+    }
+
+    /* packets rejected without a stream of their own are not counted */
+    if (stream == NULL) {
+        if (status) {
+            return status;
+        }
+        stream = srtp_get_stream(ctx, ((const srtcp_hdr_t *)rtcp)->ssrc);
+        *stream_ptr = stream;
+        if (stream == NULL) {
+            return status;
+        }
+    }
+
+    srtp_stream_stats_count(ctx, stream, false, false, status, *rtcp_len);
+
+    return status;
+}
+
+static srtp_err_status_t srtp_unprotect_rtcp_unlocked(srtp_t ctx,
+                                                      const uint8_t *srtcp,
+                                                      size_t srtcp_len,
+                                                      uint8_t *rtcp,
+                                                      size_t *rtcp_len)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
+    srtp_stream_ctx_t *stream;
+    SRTP_STAGE_START(t);
+
+    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t)) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * look up ssrc in srtp_stream list, and process the packet with
+     * the appropriate stream
+     */
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    SRTP_STAGE_LAP(ctx, unprotect, srtp_stage_lookup, t);
+
+    return srtp_unprotect_rtcp_counted(ctx, &stream, srtcp, srtcp_len, rtcp,
+                                       rtcp_len);
+}
+
+srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
+                                      const uint8_t *srtcp,
+                                      size_t srtcp_len,
+                                      uint8_t *rtcp,
+                                      size_t *rtcp_len)
+{
+    srtp_stream_ctx_t *stream;
+    unsigned int locks = SRTP_STREAM_LOCK_RTCP;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || !ctx->thread_safe) {
+        status =
+            srtp_unprotect_rtcp_unlocked(ctx, srtcp, srtcp_len, rtcp, rtcp_len);
+    } else {
+        stream = srtp_session_enter_packet(ctx, srtcp, srtcp_len, 4, &locks);
+        status =
+            srtp_unprotect_rtcp_unlocked(ctx, srtcp, srtcp_len, rtcp, rtcp_len);
+        srtp_session_leave_locks(ctx, stream, locks);
+    }
+    SRTP_PROBE3(unprotect_rtcp, srtp_probe_ssrc(srtcp, srtcp_len, 4),
+                srtcp_len, status);
+
+    return status;
+}
+
+srtp_err_status_t srtp_protect_rtcp_batch(srtp_t ctx,
+                                          srtp_packet_desc_t *pkts,
+                                          size_t num_pkts)
+{
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    srtp_stream_ctx_t *stream = NULL;
+    srtp_session_keys_t *session_keys = NULL;
+    uint32_t cached_ssrc = 0;
+    size_t cached_mki_index = 0;
+
+    debug_trace0(mod_srtp, "function srtp_protect_rtcp_batch");
+
+    if (ctx == NULL || (pkts == NULL && num_pkts != 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (ctx->thread_safe) {
+        for (size_t i = 0; i < num_pkts; i++) {
+            srtp_packet_desc_t *pkt = &pkts[i];
+
+            pkt->status = srtp_protect_rtcp(ctx, pkt->in, pkt->in_len,
+                                            pkt->out, &pkt->out_len,
+                                            pkt->mki_index);
+            if (pkt->status && first_failure == srtp_err_status_ok) {
+                first_failure = pkt->status;
+            }
+        }
+        return first_failure;
+    }
+
+    for (size_t i = 0; i < num_pkts; i++) {
+        srtp_packet_desc_t *pkt = &pkts[i];
+        const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)pkt->in;
+        srtp_err_status_t status = srtp_err_status_ok;
+
+        if (pkt->in_len < octets_in_rtcp_header) {
+            status = srtp_err_status_bad_param;
+        }
+
+        /*
+         * the reports of a compound packet and the packets following it
+         * usually share the sender ssrc, which then only needs one lookup
+         */
+        if (!status && (stream == NULL || hdr->ssrc != cached_ssrc ||
+                        pkt->mki_index != cached_mki_index)) {
+            stream = NULL;
+            status = srtp_protect_get_stream(ctx, hdr->ssrc, &stream);
+            if (!status) {
+                status = srtp_get_session_keys(stream, pkt->mki_index,
+                                               &session_keys);
+                if (status) {
+                    srtp_stream_stats_count(ctx, stream, false, true, status,
+                                            pkt->in_len);
+                }
+            }
+            if (status) {
+                stream = NULL;
+            } else {
+                cached_ssrc = hdr->ssrc;
+                cached_mki_index = pkt->mki_index;
+            }
+        }
+
+        if (!status) {
+            status = srtp_protect_rtcp_keys(ctx, stream, session_keys,
+                                            pkt->in, pkt->in_len, pkt->out,
+                                            &pkt->out_len);
+            srtp_stream_stats_count(ctx, stream, false, true, status,
+                                    pkt->in_len);
+        }
+
+        pkt->status = status;
+        if (status && first_failure == srtp_err_status_ok) {
+            first_failure = status;
+        }
+    }
+
+    return first_failure;
+}
+
+srtp_err_status_t srtp_unprotect_rtcp_batch(srtp_t ctx,
+                                            srtp_packet_desc_t *pkts,
+                                            size_t num_pkts)
+{
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    srtp_stream_ctx_t *stream = NULL;
+    uint32_t cached_ssrc = 0;
+
+    debug_trace0(mod_srtp, "function srtp_unprotect_rtcp_batch");
+
+    if (ctx == NULL || (pkts == NULL && num_pkts != 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (ctx->thread_safe) {
+        for (size_t i = 0; i < num_pkts; i++) {
+            srtp_packet_desc_t *pkt = &pkts[i];
+
+            pkt->status = srtp_unprotect_rtcp(ctx, pkt->in, pkt->in_len,
+                                              pkt->out, &pkt->out_len);
+            if (pkt->status && first_failure == srtp_err_status_ok) {
+                first_failure = pkt->status;
+            }
+        }
+        return first_failure;
+    }
+
+    for (size_t i = 0; i < num_pkts; i++) {
+        srtp_packet_desc_t *pkt = &pkts[i];
+        const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)pkt->in;
+        srtp_err_status_t status = srtp_err_status_ok;
+
+        if (pkt->in_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t)) {
+            status = srtp_err_status_bad_param;
+        }
+
+        if (!status) {
+            /* as in srtp_unprotect_batch(), template streams are not kept */
+            if (stream == NULL || hdr->ssrc != cached_ssrc) {
+                stream = srtp_get_stream(ctx, hdr->ssrc);
+                cached_ssrc = hdr->ssrc;
+            }
+            status = srtp_unprotect_rtcp_counted(ctx, &stream, pkt->in,
+                                                 pkt->in_len, pkt->out,
+                                                 &pkt->out_len);
+        }
+
+        pkt->status = status;
+        if (status && first_failure == srtp_err_status_ok) {
+            first_failure = status;
+        }
+    }
+
+    return first_failure;
+}
+
+/*
+ * srtp_framed_flush(ctx, buf, frames, num, pkts, first_failure) unprotects
+ * the run of num frames of the same kind at frames with the batch function
+ * for their kind, keeping the first failure in first_failure
+ */
+static void srtp_framed_flush(srtp_t ctx,
+                              uint8_t *buf,
+                              srtp_frame_desc_t *frames,
+                              size_t num,
+                              srtp_packet_desc_t *pkts,
+                              srtp_err_status_t *first_failure)
+{
+    srtp_err_status_t status;
+
+    if (num == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        pkts[i].in = buf + frames[i].offset;
+        pkts[i].in_len = frames[i].len;
+        pkts[i].out = buf + frames[i].offset;
+        pkts[i].out_len = frames[i].len;
+        pkts[i].mki_index = 0;
+    }
+
+    if (frames[0].rtcp) {
+        status = srtp_unprotect_rtcp_batch(ctx, pkts, num);
+    } else {
+        status = srtp_unprotect_batch(ctx, pkts, num);
+    }
+    if (status && *first_failure == srtp_err_status_ok) {
+        *first_failure = status;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        frames[i].status = pkts[i].status;
+        if (!pkts[i].status) {
+            frames[i].len = pkts[i].out_len;
+        }
+    }
+}
+
+/* number of frames srtp_unprotect_framed() hands to a batch function */
+#define SRTP_FRAMED_BATCH 32
+
+srtp_err_status_t srtp_unprotect_framed(srtp_t ctx,
+                                        uint8_t *buf,
+                                        size_t buf_len,
+                                        srtp_frame_desc_t *frames,
+                                        size_t max_frames,
+                                        size_t *num_frames,
+                                        size_t *consumed)
+{
+    srtp_err_status_t first_failure = srtp_err_status_ok;
+    srtp_packet_desc_t pkts[SRTP_FRAMED_BATCH];
+    size_t run_start = 0;
+    size_t offset = 0;
+    size_t n = 0;
+
+    if (ctx == NULL || (buf == NULL && buf_len != 0) || num_frames == NULL ||
+        consumed == NULL || (frames == NULL && max_frames != 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    for (; n < max_frames && buf_len - offset >= 2; n++) {
+        srtp_frame_desc_t *frame = &frames[n];
+        size_t len = ((size_t)buf[offset] << 8) | buf[offset + 1];
+
+        if (buf_len - offset - 2 < len) {
+            break;
+        }
+
+        frame->offset = offset + 2;
+        frame->len = len;
+        frame->rtcp =
+            len >= 2 && buf[offset + 3] >= 192 && buf[offset + 3] <= 223;
+        offset += 2 + len;
+
+        /* a run ends where the kind changes and when it fills a batch */
+        if (n > run_start && (frame->rtcp != frames[run_start].rtcp ||
+                              n - run_start == SRTP_FRAMED_BATCH)) {
+            srtp_framed_flush(ctx, buf, &frames[run_start], n - run_start,
+                              pkts, &first_failure);
+            run_start = n;
+        }
+
+        /* a frame without a packet ends the run without joining it */
+        if (len == 0) {
+            srtp_framed_flush(ctx, buf, &frames[run_start], n - run_start,
+                              pkts, &first_failure);
+            frame->status = srtp_err_status_bad_param;
+            if (first_failure == srtp_err_status_ok) {
+                first_failure = frame->status;
+            }
+            run_start = n + 1;
+        }
+    }
+    srtp_framed_flush(ctx, buf, &frames[run_start], n - run_start, pkts,
+                      &first_failure);
+
+    *num_frames = n;
+    *consumed = offset;
+
+    return first_failure;
+}
+
+/*
+ * the srtp_buffer_t variants process the packet in place, with the
+ * tailroom as the space for the trailer
+ */
+srtp_err_status_t srtp_protect_buffer(srtp_t ctx,
+                                      srtp_buffer_t *buf,
+                                      size_t mki_index)
+{
+    srtp_err_status_t status;
+    size_t len;
+
+    if (buf == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    len = buf->len + buf->tailroom;
+    status = srtp_protect(ctx, buf->data, buf->len, buf->data, &len,
+                          mki_index);
+    if (status) {
+        return status;
+    }
+
+    buf->tailroom -= len - buf->len;
+    buf->len = len;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_unprotect_buffer(srtp_t ctx, srtp_buffer_t *buf)
+{
+    srtp_err_status_t status;
+    size_t len;
+
+    if (buf == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    len = buf->len;
+    status = srtp_unprotect(ctx, buf->data, buf->len, buf->data, &len);
+    if (status) {
+        return status;
+    }
+
+    buf->tailroom += buf->len - len;
+    buf->len = len;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_protect_rtcp_buffer(srtp_t ctx,
+                                           srtp_buffer_t *buf,
+                                           size_t mki_index)
+{
+    srtp_err_status_t status;
+    size_t len;
+
+    if (buf == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    len = buf->len + buf->tailroom;
+    status = srtp_protect_rtcp(ctx, buf->data, buf->len, buf->data, &len,
+                               mki_index);
+    if (status) {
+        return status;
+    }
+
+    buf->tailroom -= len - buf->len;
+    buf->len = len;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_unprotect_rtcp_buffer(srtp_t ctx, srtp_buffer_t *buf)
+{
+    srtp_err_status_t status;
+    size_t len;
+
+    if (buf == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    len = buf->len;
+    status = srtp_unprotect_rtcp(ctx, buf->data, buf->len, buf->data, &len);
+    if (status) {
+        return status;
+    }
+
+    buf->tailroom += buf->len - len;
+    buf->len = len;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * user data within srtp_t context
+ */
+
+void srtp_set_user_data(srtp_t ctx, void *data)
+{
+    ctx->user_data = data;
+}
+
+void *srtp_get_user_data(srtp_t ctx)
+{
+    return ctx->user_data;
+}
+
+srtp_err_status_t srtp_set_thread_safe(srtp_t session, bool thread_safe)
+{
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* clones of an existing template share its cipher and auth */
+    if (session->stream_template != NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (thread_safe && !SRTP_HAVE_ATOMICS) {
+        return srtp_err_status_fail;
+    }
+
+    session->thread_safe = thread_safe;
+
+    return srtp_err_status_ok;
+}
+
+void srtp_append_salt_to_key(uint8_t *key,
+                             size_t bytes_in_key,
+                             uint8_t *salt,
+                             size_t bytes_in_salt)
+{
+    memcpy(key + bytes_in_key, salt, bytes_in_salt);
+}
+
+size_t srtp_profile_get_master_key_length(srtp_profile_t profile)
+{
+    switch (profile) {
+    case srtp_profile_reserved:
+        return 0; /* indicate error by returning a zero */
+    case srtp_profile_null_null:
+        return 0;
+    case srtp_profile_aes128_cm_sha1_80:
+    case srtp_profile_aes128_cm_sha1_32:
+        return SRTP_AES_128_KEY_LEN;
+    case srtp_profile_aes192_cm_sha1_80:
+    case srtp_profile_aes192_cm_sha1_32:
+        return SRTP_AES_192_KEY_LEN;
+    case srtp_profile_aes256_cm_sha1_80:
+    case srtp_profile_aes256_cm_sha1_32:
+        return SRTP_AES_256_KEY_LEN;
+    case srtp_profile_null_sha1_80:
+    case srtp_profile_null_sha1_32:
+        return SRTP_AES_128_KEY_LEN;
+    case srtp_profile_aead_aes_128_gcm:
+        return SRTP_AES_128_KEY_LEN;
+    case srtp_profile_aead_aes_256_gcm:
+        return SRTP_AES_256_KEY_LEN;
+    }
+    return 0; /* indicate error by returning a zero */
+}
+
+size_t srtp_profile_get_master_salt_length(srtp_profile_t profile)
+{
+    switch (profile) {
+    case srtp_profile_reserved:
+        return 0; /* indicate error by returning a zero */
+    case srtp_profile_null_null:
+        return 0;
+    case srtp_profile_aes128_cm_sha1_80:
+    case srtp_profile_aes128_cm_sha1_32:
+    case srtp_profile_aes192_cm_sha1_80:
+    case srtp_profile_aes192_cm_sha1_32:
+    case srtp_profile_aes256_cm_sha1_80:
+    case srtp_profile_aes256_cm_sha1_32:
+    case srtp_profile_null_sha1_80:
+    case srtp_profile_null_sha1_32:
+        return SRTP_SALT_LEN;
+    case srtp_profile_aead_aes_128_gcm:
+    case srtp_profile_aead_aes_256_gcm:
+        return SRTP_AEAD_SALT_LEN;
+    }
+    return 0; /* indicate error by returning a zero */
+}
+
+srtp_err_status_t stream_get_protect_trailer_length(srtp_stream_ctx_t *stream,
+                                                    bool is_rtp,
+                                                    size_t mki_index,
+                                                    size_t *length)
+{
+    srtp_session_keys_t *session_key;
+
+    *length = 0;
+
+    if (stream->use_mki) {
+        if (mki_index >= stream->num_master_keys) {
+            return srtp_err_status_bad_mki;
+        }
+        session_key = &stream->session_keys[mki_index];
+
+        *length += stream->mki_size;
+
+    } else {
+        session_key = &stream->session_keys[0];
+    }
+    if (is_rtp) {
+        *length += srtp_auth_get_tag_length(session_key->rtp_auth);
+    } else {
+        *length += srtp_auth_get_tag_length(session_key->rtcp_auth);
+        *length += sizeof(srtcp_trailer_t);
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_trailer_cache_add(cache, stream) folds the trailers of a stream
+ * that is being added to the session into the cache
+ */
+static void srtp_trailer_cache_add(srtp_trailer_cache_t *cache,
+                                   srtp_stream_ctx_t *stream)
+{
+    size_t rtp_len, rtcp_len;
+
+    if (!cache->valid ||
+        stream_get_protect_trailer_length(stream, true, cache->mki_index,
+                                          &rtp_len) != srtp_err_status_ok ||
+        stream_get_protect_trailer_length(stream, false, cache->mki_index,
+                                          &rtcp_len) != srtp_err_status_ok) {
+        return;
+    }
+
+    cache->found = true;
+    if (rtp_len > cache->rtp_len) {
+        cache->rtp_len = rtp_len;
+    }
+    if (rtcp_len > cache->rtcp_len) {
+        cache->rtcp_len = rtcp_len;
+    }
+}
+
+static bool srtp_trailer_cache_add_cb(srtp_stream_t stream, void *raw_data)
+{
+    srtp_trailer_cache_add((srtp_trailer_cache_t *)raw_data, stream);
+    return true;
+}
+
+/*
+ * srtp_trailer_cache_fill(session, mki_index) walks all streams of the
+ * session to rebuild the cache for mki_index
+ */
+static void srtp_trailer_cache_fill(srtp_t session, size_t mki_index)
+{
+    srtp_trailer_cache_t *cache = &session->trailer_cache;
+
+    cache->valid = true;
+    cache->found = false;
+    cache->mki_index = mki_index;
+    cache->rtp_len = 0;
+    cache->rtcp_len = 0;
+
+    if (session->stream_template != NULL) {
+        srtp_trailer_cache_add(cache, session->stream_template);
+    }
+    srtp_stream_list_for_each(session->stream_list, srtp_trailer_cache_add_cb,
+                              cache);
+}
+
+static bool srtp_trailer_cache_get(const srtp_trailer_cache_t *cache,
+                                   bool is_rtp,
+                                   size_t mki_index,
+                                   srtp_err_status_t *status,
+                                   size_t *length)
+{
+    if (!cache->valid || cache->mki_index != mki_index) {
+        return false;
+    }
+
+    if (!cache->found) {
+        *status = srtp_err_status_bad_param;
+    } else {
+        *status = srtp_err_status_ok;
+        *length = is_rtp ? cache->rtp_len : cache->rtcp_len;
+    }
+    return true;
+}
+
+/*
+ * get_protect_trailer_length() answers from the session's trailer cache,
+ * walking the streams only after they were removed or updated, or when
+ * asked about another MKI index than the last time
+ */
+srtp_err_status_t get_protect_trailer_length(srtp_t session,
+                                             bool is_rtp,
+                                             size_t mki_index,
+                                             size_t *length)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+    bool cached;
+
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (!session->thread_safe) {
+        if (!srtp_trailer_cache_get(&session->trailer_cache, is_rtp,
+                                    mki_index, &status, length)) {
+            srtp_trailer_cache_fill(session, mki_index);
+            srtp_trailer_cache_get(&session->trailer_cache, is_rtp, mki_index,
+                                   &status, length);
+        }
+        return status;
+    }
+
+    /* the cache only changes with the stream list, or on a miss */
+    srtp_rwlock_read_lock(&session->lock);
+    cached = srtp_trailer_cache_get(&session->trailer_cache, is_rtp,
+                                    mki_index, &status, length);
+    srtp_rwlock_read_unlock(&session->lock);
+
+    if (!cached) {
+        srtp_rwlock_write_lock(&session->lock);
+        if (!srtp_trailer_cache_get(&session->trailer_cache, is_rtp,
+                                    mki_index, &status, length)) {
+            srtp_trailer_cache_fill(session, mki_index);
+            srtp_trailer_cache_get(&session->trailer_cache, is_rtp, mki_index,
+                                   &status, length);
+        }
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    return status;
+}
+
+srtp_err_status_t srtp_get_protect_trailer_length(srtp_t session,
+                                                  size_t mki_index,
+                                                  size_t *length)
+{
+    return get_protect_trailer_length(session, true, mki_index, length);
+}
+
+srtp_err_status_t srtp_get_protect_rtcp_trailer_length(srtp_t session,
+                                                       size_t mki_index,
+                                                       size_t *length)
+{
+    return get_protect_trailer_length(session, false, mki_index, length);
+}
+
+/*
+ * the trailer of a single stream, an SSRC without a stream of its own
+ * gets the trailer of the template it would be cloned from
+ */
+static srtp_err_status_t stream_get_protect_trailer_length_unlocked(
+    srtp_t session,
+    uint32_t ssrc,
+    bool is_rtp,
+    size_t mki_index,
+    size_t *length)
+{
+    srtp_stream_t stream;
+
+    if (session == NULL || length == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        stream = session->stream_template;
+    }
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    return stream_get_protect_trailer_length(stream, is_rtp, mki_index,
+                                             length);
+}
+
+static srtp_err_status_t stream_get_protect_trailer_length_locked(
+    srtp_t session,
+    uint32_t ssrc,
+    bool is_rtp,
+    size_t mki_index,
+    size_t *length)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (session == NULL || !session->thread_safe) {
+        return stream_get_protect_trailer_length_unlocked(
+            session, ssrc, is_rtp, mki_index, length);
+    }
+
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = stream_get_protect_trailer_length_unlocked(session, ssrc, is_rtp,
+                                                        mki_index, length);
+    srtp_session_leave(session, stream);
+
+    return status;
+}
+
+srtp_err_status_t srtp_stream_get_protect_trailer_length(srtp_t session,
+                                                         uint32_t ssrc,
+                                                         size_t mki_index,
+                                                         size_t *length)
+{
+    return stream_get_protect_trailer_length_locked(session, ssrc, true,
+                                                    mki_index, length);
+}
+
+srtp_err_status_t srtp_stream_get_protect_rtcp_trailer_length(
+    srtp_t session,
+    uint32_t ssrc,
+    size_t mki_index,
+    size_t *length)
+{
+    return stream_get_protect_trailer_length_locked(session, ssrc, false,
+                                                    mki_index, length);
+}
+
+/*
+ * SRTP debug interface
+ */
+srtp_err_status_t srtp_set_debug_module(const char *mod_name, bool v)
+{
+    return srtp_crypto_kernel_set_debug_module(mod_name, v);
+}
+
+srtp_err_status_t srtp_list_debug_modules(void)
+{
+    return srtp_crypto_kernel_list_debug_modules();
+}
+
+/*
+ * srtp_log_handler is a global variable holding a pointer to the
+ * log handler function; this function is called for any log
+ * output.
+ */
+
+static srtp_log_handler_func_t *srtp_log_handler = NULL;
+static void *srtp_log_handler_data = NULL;
+
+static void srtp_err_handler(srtp_err_reporting_level_t level, const char *msg)
+{
+    if (srtp_log_handler) {
+        srtp_log_level_t log_level = srtp_log_level_error;
+        switch (level) {
+        case srtp_err_level_error:
+            log_level = srtp_log_level_error;
+            break;
+        case srtp_err_level_warning:
+            log_level = srtp_log_level_warning;
+            break;
+        case srtp_err_level_info:
+            log_level = srtp_log_level_info;
+            break;
+        case srtp_err_level_debug:
+            log_level = srtp_log_level_debug;
+            break;
+        }
+
+        srtp_log_handler(log_level, msg, srtp_log_handler_data);
+    }
+}
+
+srtp_err_status_t srtp_install_log_handler(srtp_log_handler_func_t func,
+                                           void *data)
+{
+    /*
+     * note that we accept NULL arguments intentionally - calling this
+     * function with a NULL arguments removes a log handler that's
+     * been previously installed
+     */
+
+    if (srtp_log_handler) {
+        srtp_install_err_report_handler(NULL);
+    }
+    srtp_log_handler = func;
+    srtp_log_handler_data = data;
+    if (srtp_log_handler) {
+        srtp_install_err_report_handler(srtp_err_handler);
+    }
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_stream_set_roc_unlocked(srtp_t session,
+                                                      uint32_t ssrc,
+                                                      uint32_t roc)
+{
+    srtp_stream_t stream;
+
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stream->pending_roc = roc;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_stream_set_roc(srtp_t session,
+                                      uint32_t ssrc,
+                                      uint32_t roc)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_set_roc_unlocked(session, ssrc, roc);
+    }
+
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = srtp_stream_set_roc_unlocked(session, ssrc, roc);
+    srtp_session_leave(session, stream);
+
+    return status;
+}
+
+static srtp_err_status_t srtp_stream_get_roc_unlocked(srtp_t session,
+                                                      uint32_t ssrc,
+                                                      uint32_t *roc)
+{
+    srtp_stream_t stream;
+
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    *roc = srtp_rdbx_get_roc(&stream->rtp_rdbx);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_stream_get_roc(srtp_t session,
+                                      uint32_t ssrc,
+                                      uint32_t *roc)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_get_roc_unlocked(session, ssrc, roc);
+    }
+
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = srtp_stream_get_roc_unlocked(session, ssrc, roc);
+    srtp_session_leave(session, stream);
+
+    return status;
+}
+
+static srtp_err_status_t srtp_stream_set_keystream_cache_unlocked(
+    srtp_t session,
+    uint32_t ssrc,
+    size_t num_packets,
+    size_t max_len)
+{
+    srtp_stream_t stream;
+    srtp_stream_cold_t *cold;
+    srtp_keystream_cache_t *cache;
+    const srtp_session_keys_t *keys;
+    uint8_t *keystream;
 
-        /* otherwise, just set the index to seq_num */
-        iv.v32[0] = 0;
-        iv.v32[1] = 0;
-        iv.v32[2] = 0;
-        iv.v32[3] = htonl(seq_num);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_decrypt);
-    }
-    if (status) {
-        return srtp_err_status_cipher_fail;
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    /*
-     * if we're authenticating using a universal hash, put the keystream
-     * prefix into the authentication tag
-     */
-    prefix_len = srtp_auth_get_prefix_length(session_keys->rtcp_auth);
-    if (prefix_len) {
-        status =
-            srtp_cipher_output(session_keys->rtcp_cipher, tmp_tag, &prefix_len);
-        debug_print(mod_srtp, "keystream prefix: %s",
-                    srtp_octet_string_hex_string(tmp_tag, prefix_len));
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    if (num_packets == 0) {
+        if (stream->cold != NULL) {
+            srtp_keystream_cache_free(stream->cold->keystream);
+            stream->cold->keystream = NULL;
         }
+        return srtp_err_status_ok;
     }
 
-    /* initialize auth func context */
-    status = srtp_auth_start(session_keys->rtcp_auth);
-    if (status) {
-        return status;
+    if (max_len == 0 || max_len > SRTP_MAX_KEYSTREAM_LEN) {
+        return srtp_err_status_bad_param;
     }
 
-    /* run auth func over packet, put result into tmp_tag */
-    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start, auth_len,
-                               tmp_tag);
-    debug_print(mod_srtp, "srtcp computed tag:       %s",
-                srtp_octet_string_hex_string(tmp_tag, tag_len));
-    if (status) {
-        return srtp_err_status_auth_fail;
+    /*
+     * only counter mode keystream is independent of the packet, and it
+     * can not be used if a universal hash takes a prefix of it
+     */
+    keys = &stream->session_keys[0];
+    if (!srtp_cipher_is_icm(keys->rtp_cipher) ||
+        srtp_auth_get_prefix_length(keys->rtp_auth) != 0) {
+        return srtp_err_status_no_such_op;
     }
 
-    /* compare the tag just computed with the one in the packet */
-    debug_print(mod_srtp, "srtcp tag from packet:    %s",
-                srtp_octet_string_hex_string(auth_tag, tag_len));
-    if (!srtp_octet_string_equal(tmp_tag, auth_tag, tag_len)) {
-        return srtp_err_status_auth_fail;
+    cold = srtp_stream_get_cold(stream);
+    if (cold == NULL) {
+        return srtp_err_status_alloc_fail;
     }
 
-    /* check output length */
-    if (*rtcp_len <
-        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
-        return srtp_err_status_buffer_small;
+    cache = (srtp_keystream_cache_t *)srtp_crypto_alloc(
+        srtp_keystream_cache_size(num_packets, max_len));
+    if (cache == NULL) {
+        return srtp_err_status_alloc_fail;
     }
-
-    /* if not inplace need to copy rtcp header */
-    if (srtcp != rtcp) {
-        memcpy(rtcp, srtcp, enc_start);
+    cache->num_entries = num_packets;
+    cache->max_len = max_len;
+    cache->entries = (srtp_keystream_entry_t *)(cache + 1);
+    keystream = (uint8_t *)(cache->entries + num_packets);
+    for (size_t i = 0; i < num_packets; i++) {
+        cache->entries[i].keystream = keystream + i * max_len;
     }
 
-    /* if we're decrypting, exor keystream into the message */
-    if (sec_serv_confidentiality) {
-        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
-                                     srtcp + enc_start, enc_octet_len,
-                                     rtcp + enc_start, &enc_octet_len);
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
-    } else if (srtcp != rtcp) {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
+    srtp_keystream_cache_free(cold->keystream);
+    cold->keystream = cache;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_stream_set_keystream_cache(srtp_t session,
+                                                  uint32_t ssrc,
+                                                  size_t num_packets,
+                                                  size_t max_len)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_set_keystream_cache_unlocked(session, ssrc,
+                                                        num_packets, max_len);
     }
 
-    *rtcp_len = srtcp_len;
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = srtp_stream_set_keystream_cache_unlocked(session, ssrc,
+                                                      num_packets, max_len);
+    srtp_session_leave(session, stream);
 
-    /* decrease the packet length by the length of the auth tag and seq_num */
-    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t));
+    return status;
+}
 
-    /* decrease the packet length by the length of the mki_size */
-    *rtcp_len -= stream->mki_size;
+static srtp_err_status_t srtp_stream_fill_keystream_unlocked(
+    srtp_t session,
+    uint32_t ssrc,
+    size_t mki_index)
+{
+    srtp_stream_t stream;
+    srtp_keystream_cache_t *cache;
+    srtp_session_keys_t *keys;
+    srtp_err_status_t status;
 
-    /*
-     * verify that stream is for received traffic - this check will
-     * detect SSRC collisions, since a stream that appears in both
-     * srtp_protect() and srtp_unprotect() will fail this test in one of
-     * those functions.
-     *
-     * we do this check *after* the authentication check, so that the
-     * latter check will catch any attempts to fool us into thinking
-     * that we've got a collision
-     */
-    if (stream->direction != dir_srtp_receiver) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_receiver;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    /*
-     * if the stream is a 'provisional' one, in which the template context
-     * is used, then we need to allocate a new stream at this point, since
-     * the authentication passed
-     */
-    if (stream == ctx->stream_template) {
-        srtp_stream_ctx_t *new_stream;
+    cache = stream->cold != NULL ? stream->cold->keystream : NULL;
+    if (cache == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-        /*
-         * allocate and initialize a new stream
-         *
-         * note that we indicate failure if we can't allocate the new
-         * stream, and some implementations will want to not return
-         * failure here
-         */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-        if (status) {
-            return status;
+    status = srtp_get_session_keys(stream, mki_index, &keys);
+    if (status) {
+        return status;
+    }
+
+    /* compute the keystream of the packets that follow the last one */
+    for (size_t i = 1; i <= cache->num_entries; i++) {
+        srtp_xtd_seq_num_t index = stream->rtp_rdbx.index + i;
+        srtp_keystream_entry_t *entry =
+            &cache->entries[index % cache->num_entries];
+        size_t len = cache->max_len;
+        v128_t iv;
+
+        if (entry->keys == keys && entry->index == index) {
+            continue;
         }
 
-        /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
+        entry->keys = NULL;
+        iv.v32[0] = 0;
+        iv.v32[1] = stream->ssrc;
+        iv.v64[1] = be64_to_cpu(index << 16);
+        status = srtp_cipher_set_iv(keys->rtp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_encrypt);
         if (status) {
-            return status;
+            return srtp_err_status_cipher_fail;
         }
-
-        /* set stream (the pointer used in this function) */
-        stream = new_stream;
+        status = srtp_cipher_output(keys->rtp_cipher, entry->keystream, &len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+        entry->keys = keys;
+        entry->index = index;
     }
 
-    /* we've passed the authentication check, so add seq_num to the rdb */
-    srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
-
     return srtp_err_status_ok;
 }
 
-/*
- * user data within srtp_t context
- */
-
-void srtp_set_user_data(srtp_t ctx, void *data)
+srtp_err_status_t srtp_stream_fill_keystream(srtp_t session,
+                                             uint32_t ssrc,
+                                             size_t mki_index)
 {
-    ctx->user_data = data;
-}
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
 
-void *srtp_get_user_data(srtp_t ctx)
-{
-    return ctx->user_data;
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_fill_keystream_unlocked(session, ssrc, mki_index);
+    }
+
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = srtp_stream_fill_keystream_unlocked(session, ssrc, mki_index);
+    srtp_session_leave(session, stream);
+
+    return status;
 }
 
-void srtp_append_salt_to_key(uint8_t *key,
-                             size_t bytes_in_key,
-                             uint8_t *salt,
-                             size_t bytes_in_salt)
+static srtp_err_status_t srtp_stream_get_stats_unlocked(
+    srtp_t session,
+    uint32_t ssrc,
+    srtp_stream_stats_t *stats)
 {
-    memcpy(key + bytes_in_key, salt, bytes_in_salt);
+    srtp_stream_t stream;
+
+    if (stats == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_stream_get_counters(stream, stats);
+    stats->ssrc = ssrc;
+
+    return srtp_err_status_ok;
 }
 
-size_t srtp_profile_get_master_key_length(srtp_profile_t profile)
+srtp_err_status_t srtp_stream_get_stats(srtp_t session,
+                                        uint32_t ssrc,
+                                        srtp_stream_stats_t *stats)
 {
-    switch (profile) {
-    case srtp_profile_reserved:
-        return 0; /* indicate error by returning a zero */
-    case srtp_profile_null_null:
-        return 0;
-    case srtp_profile_aes128_cm_sha1_80:
-    case srtp_profile_aes128_cm_sha1_32:
-        return SRTP_AES_128_KEY_LEN;
-    case srtp_profile_aes192_cm_sha1_80:
-    case srtp_profile_aes192_cm_sha1_32:
-        return SRTP_AES_192_KEY_LEN;
-    case srtp_profile_aes256_cm_sha1_80:
-    case srtp_profile_aes256_cm_sha1_32:
-        return SRTP_AES_256_KEY_LEN;
-    case srtp_profile_null_sha1_80:
-    case srtp_profile_null_sha1_32:
-        return SRTP_AES_128_KEY_LEN;
-    case srtp_profile_aead_aes_128_gcm:
-        return SRTP_AES_128_KEY_LEN;
-    case srtp_profile_aead_aes_256_gcm:
-        return SRTP_AES_256_KEY_LEN;
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (session == NULL || !session->thread_safe) {
+        return srtp_stream_get_stats_unlocked(session, ssrc, stats);
     }
-    return 0; /* indicate error by returning a zero */
+
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = srtp_stream_get_stats_unlocked(session, ssrc, stats);
+    srtp_session_leave(session, stream);
+
+    return status;
 }
 
-size_t srtp_profile_get_master_salt_length(srtp_profile_t profile)
+struct for_each_stats_data {
+    bool thread_safe;
+    srtp_stream_stats_func_t *func;
+    void *data;
+};
+
+static bool for_each_stats_cb(srtp_stream_t stream, void *raw_data)
 {
-    switch (profile) {
-    case srtp_profile_reserved:
-        return 0; /* indicate error by returning a zero */
-    case srtp_profile_null_null:
-        return 0;
-    case srtp_profile_aes128_cm_sha1_80:
-    case srtp_profile_aes128_cm_sha1_32:
-    case srtp_profile_aes192_cm_sha1_80:
-    case srtp_profile_aes192_cm_sha1_32:
-    case srtp_profile_aes256_cm_sha1_80:
-    case srtp_profile_aes256_cm_sha1_32:
-    case srtp_profile_null_sha1_80:
-    case srtp_profile_null_sha1_32:
-        return SRTP_SALT_LEN;
-    case srtp_profile_aead_aes_128_gcm:
-    case srtp_profile_aead_aes_256_gcm:
-        return SRTP_AEAD_SALT_LEN;
+    struct for_each_stats_data *data = (struct for_each_stats_data *)raw_data;
+    srtp_stream_stats_t stats;
+
+    /* copy the counters so that the stream is not locked during func */
+    if (data->thread_safe) {
+        srtp_stream_lock(stream, SRTP_STREAM_LOCK_BOTH);
     }
-    return 0; /* indicate error by returning a zero */
+    srtp_stream_get_counters(stream, &stats);
+    if (data->thread_safe) {
+        srtp_stream_unlock(stream, SRTP_STREAM_LOCK_BOTH);
+    }
+    stats.ssrc = ntohl(stream->ssrc);
+
+    data->func(&stats, data->data);
+
+    return true;
 }
 
-srtp_err_status_t stream_get_protect_trailer_length(srtp_stream_ctx_t *stream,
-                                                    bool is_rtp,
-                                                    size_t mki_index,
-                                                    size_t *length)
+srtp_err_status_t srtp_session_for_each_stats(srtp_t session,
+                                              srtp_stream_stats_func_t func,
+                                              void *data)
 {
-    srtp_session_keys_t *session_key;
-
-    *length = 0;
+    struct for_each_stats_data cb_data;
 
-    if (stream->use_mki) {
-        if (mki_index >= stream->num_master_keys) {
-            return srtp_err_status_bad_mki;
-        }
-        session_key = &stream->session_keys[mki_index];
+    if (session == NULL || func == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-        *length += stream->mki_size;
+    cb_data.thread_safe = session->thread_safe;
+    cb_data.func = func;
+    cb_data.data = data;
 
-    } else {
-        session_key = &stream->session_keys[0];
+    /* the stream list does not change while it is held shared */
+    if (session->thread_safe) {
+        srtp_rwlock_read_lock(&session->lock);
     }
-    if (is_rtp) {
-        *length += srtp_auth_get_tag_length(session_key->rtp_auth);
-    } else {
-        *length += srtp_auth_get_tag_length(session_key->rtcp_auth);
-        *length += sizeof(srtcp_trailer_t);
+
+    srtp_stream_list_for_each(session->stream_list, for_each_stats_cb,
+                              &cb_data);
+
+    if (session->thread_safe) {
+        srtp_rwlock_read_unlock(&session->lock);
     }
 
     return srtp_err_status_ok;
 }
 
-struct get_protect_trailer_length_data {
-    bool found_stream; /* whether at least one matching stream was found */
-    size_t length;     /* maximum trailer length found so far */
-    bool is_rtp;
-    size_t mki_index;
-};
+/*
+ * srtp_policy_memory_usage(policy) is the memory of policy, with its share
+ * of the master key set it may have in common with clones of it
+ */
+static size_t srtp_policy_memory_usage(const srtp_policy_t policy)
+{
+    size_t size;
+
+    if (policy == NULL) {
+        return 0;
+    }
 
-static bool get_protect_trailer_length_cb(srtp_stream_t stream, void *raw_data)
-{
-    struct get_protect_trailer_length_data *data =
-        (struct get_protect_trailer_length_data *)raw_data;
-    size_t temp_length;
+    size = srtp_crypto_alloc_size(policy);
+    if (policy->key_set != NULL) {
+        long refs = srtp_refcount_get(&policy->key_set->refs);
 
-    if (stream_get_protect_trailer_length(stream, data->is_rtp, data->mki_index,
-                                          &temp_length) == srtp_err_status_ok) {
-        data->found_stream = true;
-        if (temp_length > data->length) {
-            data->length = temp_length;
-        }
+        size += srtp_crypto_alloc_size(policy->key_set) /
+                (size_t)(refs > 0 ? refs : 1);
     }
 
-    return true;
+    return size;
 }
 
-srtp_err_status_t get_protect_trailer_length(srtp_t session,
-                                             bool is_rtp,
-                                             size_t mki_index,
-                                             size_t *length)
+/*
+ * srtp_stream_memory_usage(stream, stream_template, usage) returns the
+ * memory of stream apart from its keys and replay windows, which it adds
+ * to usage; like srtp_stream_dealloc() it leaves out what stream shares
+ * with stream_template
+ */
+static size_t srtp_stream_memory_usage(const srtp_stream_ctx_t *stream,
+                                       const srtp_stream_ctx_t *stream_template,
+                                       srtp_session_memory_t *usage)
 {
-    srtp_stream_ctx_t *stream;
-    struct get_protect_trailer_length_data data = { false, 0, is_rtp,
-                                                    mki_index };
+    size_t size = stream->block_size;
+    const uint64_t *bitmask = stream->rtp_rdbx.base_bitmask;
+    size_t window;
 
-    if (session == NULL) {
-        return srtp_err_status_bad_param;
+    /* the RTP replay window is usually part of the stream's allocation */
+    window = SRTP_REPLAY_WINDOW_WORDS(
+                 srtp_rdbx_get_window_size(&stream->rtp_rdbx)) *
+             sizeof(uint64_t);
+    if (bitmask != NULL && srtp_stream_owns(stream, bitmask)) {
+        size -= window;
+        usage->replay += window;
+    } else if (bitmask != NULL && stream->rtp_rdbx.owns_bitmask) {
+        usage->replay += srtp_crypto_alloc_size(bitmask);
+    }
+    if (stream->rtp_rdbx.bitmask != bitmask) {
+        /* an adaptive window that has grown */
+        usage->replay += srtp_crypto_alloc_size(stream->rtp_rdbx.bitmask);
     }
 
-    stream = session->stream_template;
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        const srtp_session_keys_t *keys = &stream->session_keys[i];
+        const srtp_session_keys_t *template_keys = NULL;
 
-    if (stream != NULL) {
-        data.found_stream = true;
-        stream_get_protect_trailer_length(stream, is_rtp, mki_index,
-                                          &data.length);
+        if (stream_template != NULL &&
+            stream->num_master_keys == stream_template->num_master_keys) {
+            template_keys = &stream_template->session_keys[i];
+        }
+
+        if (template_keys == NULL ||
+            keys->rtp_cipher != template_keys->rtp_cipher) {
+            usage->keys += srtp_cipher_get_memory_usage(keys->rtp_cipher);
+        }
+        if (template_keys == NULL ||
+            keys->rtp_xtn_hdr_cipher != template_keys->rtp_xtn_hdr_cipher) {
+            usage->keys +=
+                srtp_cipher_get_memory_usage(keys->rtp_xtn_hdr_cipher);
+        }
+        if (template_keys == NULL ||
+            keys->rtcp_cipher != template_keys->rtcp_cipher) {
+            usage->keys += srtp_cipher_get_memory_usage(keys->rtcp_cipher);
+        }
+        if (template_keys == NULL ||
+            keys->rtp_auth != template_keys->rtp_auth) {
+            usage->keys += srtp_auth_get_memory_usage(keys->rtp_auth);
+        }
+        if (template_keys == NULL ||
+            keys->rtcp_auth != template_keys->rtcp_auth) {
+            usage->keys += srtp_auth_get_memory_usage(keys->rtcp_auth);
+        }
+        if (keys->limit != NULL && !srtp_stream_owns(stream, keys->limit) &&
+            (template_keys == NULL || keys->limit != template_keys->limit)) {
+            usage->keys += srtp_crypto_alloc_size(keys->limit);
+        }
+        if (keys->mki_id != NULL && !srtp_stream_owns(stream, keys->mki_id)) {
+            usage->keys += srtp_crypto_alloc_size(keys->mki_id);
+        }
+        if (template_keys == NULL || keys->pending != template_keys->pending) {
+            usage->keys += srtp_crypto_alloc_size(keys->pending);
+        }
     }
 
-    srtp_stream_list_for_each(session->stream_list,
-                              get_protect_trailer_length_cb, &data);
+    if (stream->enc_xtn_hdr != NULL &&
+        !srtp_stream_owns(stream, stream->enc_xtn_hdr) &&
+        (stream_template == NULL ||
+         stream->enc_xtn_hdr != stream_template->enc_xtn_hdr)) {
+        size += srtp_crypto_alloc_size(stream->enc_xtn_hdr);
+    }
+    if (stream_template == NULL ||
+        stream->mki_map != stream_template->mki_map) {
+        size += srtp_crypto_alloc_size(stream->mki_map);
+    }
 
-    if (!data.found_stream) {
-        return srtp_err_status_bad_param;
+    if (stream->cold != NULL) {
+        const srtp_stream_cold_t *cold = stream->cold;
+
+        size += srtp_crypto_alloc_size(cold) - sizeof(cold->rtcp_rdb);
+        usage->replay += sizeof(cold->rtcp_rdb);
+        size += srtp_crypto_alloc_size(cold->overlap.scratch);
+        size += srtp_crypto_alloc_size(cold->iov_scratch);
+        size += srtp_crypto_alloc_size(cold->keystream);
+        size += srtp_policy_memory_usage(cold->policy);
+        if (cold->overlap.previous != NULL) {
+            size += srtp_stream_memory_usage(cold->overlap.previous,
+                                             cold->overlap.previous_template,
+                                             usage);
+        }
     }
 
-    *length = data.length;
-    return srtp_err_status_ok;
+    return size;
 }
 
-srtp_err_status_t srtp_get_protect_trailer_length(srtp_t session,
-                                                  size_t mki_index,
-                                                  size_t *length)
-{
-    return get_protect_trailer_length(session, true, mki_index, length);
-}
+struct memory_usage_data {
+    const srtp_stream_ctx_t *stream_template;
+    srtp_session_memory_t *usage;
+};
 
-srtp_err_status_t srtp_get_protect_rtcp_trailer_length(srtp_t session,
-                                                       size_t mki_index,
-                                                       size_t *length)
+static bool memory_usage_cb(srtp_stream_t stream, void *raw_data)
 {
-    return get_protect_trailer_length(session, false, mki_index, length);
-}
+    struct memory_usage_data *data = (struct memory_usage_data *)raw_data;
+    srtp_session_memory_t *usage = data->usage;
+    size_t size;
 
-/*
- * SRTP debug interface
- */
-srtp_err_status_t srtp_set_debug_module(const char *mod_name, bool v)
-{
-    return srtp_crypto_kernel_set_debug_module(mod_name, v);
-}
+    size = srtp_stream_memory_usage(stream, data->stream_template, usage);
+    usage->num_streams++;
+    if (stream->from_template) {
+        usage->num_clones++;
+        usage->clones += size;
+    } else {
+        usage->streams += size;
+    }
 
-srtp_err_status_t srtp_list_debug_modules(void)
-{
-    return srtp_crypto_kernel_list_debug_modules();
+    return true;
 }
 
 /*
- * srtp_log_handler is a global variable holding a pointer to the
- * log handler function; this function is called for any log
- * output.
+ * srtp_key_cache_memory_usage(cache) is the memory of cache, with the
+ * copies of keys its entries own
  */
+static size_t srtp_key_cache_memory_usage(const srtp_key_cache_t *cache)
+{
+    size_t size = srtp_crypto_alloc_size(cache->buckets);
 
-static srtp_log_handler_func_t *srtp_log_handler = NULL;
-static void *srtp_log_handler_data = NULL;
+    for (size_t i = 0; i < cache->num_buckets; i++) {
+        const srtp_key_cache_entry_t *entry;
 
-static void srtp_err_handler(srtp_err_reporting_level_t level, const char *msg)
-{
-    if (srtp_log_handler) {
-        srtp_log_level_t log_level = srtp_log_level_error;
-        switch (level) {
-        case srtp_err_level_error:
-            log_level = srtp_log_level_error;
-            break;
-        case srtp_err_level_warning:
-            log_level = srtp_log_level_warning;
-            break;
-        case srtp_err_level_info:
-            log_level = srtp_log_level_info;
-            break;
-        case srtp_err_level_debug:
-            log_level = srtp_log_level_debug;
-            break;
-        }
+        for (entry = cache->buckets[i]; entry != NULL; entry = entry->next) {
+            size += srtp_crypto_alloc_size(entry);
+            if (entry->keys != NULL) {
+                srtp_session_memory_t keys;
 
-        srtp_log_handler(log_level, msg, srtp_log_handler_data);
+                memset(&keys, 0, sizeof(keys));
+                size += srtp_stream_memory_usage(entry->keys, NULL, &keys);
+                size += keys.keys + keys.replay;
+            }
+        }
     }
+
+    return size;
 }
 
-srtp_err_status_t srtp_install_log_handler(srtp_log_handler_func_t func,
-                                           void *data)
+srtp_err_status_t srtp_session_get_memory_usage(srtp_t session,
+                                                srtp_session_memory_t *usage)
 {
-    /*
-     * note that we accept NULL arguments intentionally - calling this
-     * function with a NULL arguments removes a log handler that's
-     * been previously installed
-     */
+    struct memory_usage_data cb_data;
+    const srtp_stream_pool_t *pool;
 
-    if (srtp_log_handler) {
-        srtp_install_err_report_handler(NULL);
+    if (session == NULL || usage == NULL) {
+        return srtp_err_status_bad_param;
     }
-    srtp_log_handler = func;
-    srtp_log_handler_data = data;
-    if (srtp_log_handler) {
-        srtp_install_err_report_handler(srtp_err_handler);
+
+    memset(usage, 0, sizeof(*usage));
+    cb_data.stream_template = session->stream_template;
+    cb_data.usage = usage;
+
+    /* the stream list and the template do not change while it is held */
+    if (session->thread_safe) {
+        srtp_rwlock_read_lock(&session->lock);
+    }
+
+    usage->session = srtp_crypto_alloc_size(session) +
+                     srtp_stream_list_memory_usage(session->stream_list) +
+                     srtp_policy_memory_usage(session->template_policy) +
+                     srtp_crypto_alloc_size(session->events);
+
+    srtp_stream_list_for_each(session->stream_list, memory_usage_cb,
+                              &cb_data);
+
+    if (session->stream_template != NULL) {
+        usage->templates +=
+            srtp_stream_memory_usage(session->stream_template, NULL, usage);
+    }
+    if (session->previous_template != NULL) {
+        usage->templates +=
+            srtp_stream_memory_usage(session->previous_template, NULL, usage);
+    }
+
+    pool = &session->stream_pool;
+    usage->pool = srtp_crypto_alloc_size(pool->streams);
+    for (size_t i = 0; i < pool->count; i++) {
+        usage->pool += srtp_stream_memory_usage(pool->streams[i], NULL, usage);
+    }
+
+    usage->key_cache = srtp_key_cache_memory_usage(&session->key_cache);
+
+    if (session->thread_safe) {
+        srtp_rwlock_read_unlock(&session->lock);
     }
+
+    usage->total = usage->session + usage->streams + usage->clones +
+                   usage->templates + usage->pool + usage->keys +
+                   usage->replay + usage->key_cache;
+
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_stream_set_roc(srtp_t session,
-                                      uint32_t ssrc,
-                                      uint32_t roc)
+srtp_err_status_t srtp_get_stage_profile(srtp_t session,
+                                         srtp_stage_profile_t *profile)
 {
-    srtp_stream_t stream;
-
-    stream = srtp_get_stream(session, htonl(ssrc));
-    if (stream == NULL) {
+    if (session == NULL || profile == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    stream->pending_roc = roc;
-
+#ifdef ENABLE_STAGE_PROFILE
+    *profile = session->stage_profile;
     return srtp_err_status_ok;
+#else
+    memset(profile, 0, sizeof(*profile));
+    return srtp_err_status_no_such_op;
+#endif
 }
 
-srtp_err_status_t srtp_stream_get_roc(srtp_t session,
-                                      uint32_t ssrc,
-                                      uint32_t *roc)
+srtp_err_status_t srtp_reset_stage_profile(srtp_t session)
 {
-    srtp_stream_t stream;
-
-    stream = srtp_get_stream(session, htonl(ssrc));
-    if (stream == NULL) {
+    if (session == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    *roc = srtp_rdbx_get_roc(&stream->rtp_rdbx);
-
+#ifdef ENABLE_STAGE_PROFILE
+    memset(&session->stage_profile, 0, sizeof(session->stage_profile));
     return srtp_err_status_ok;
+#else
+    return srtp_err_status_no_such_op;
+#endif
 }
 
 #ifndef SRTP_NO_STREAM_LIST
 
-#define INITIAL_STREAM_INDEX_SIZE 2
+/*
+ * The default stream list is an open addressing hash table indexed by
+ * SSRC using Robin Hood probing.  Lookups are O(1) on average and the
+ * probe sequence length stays short even at high load factors because
+ * an inserted entry displaces any entry that is closer to its home slot.
+ * Removal uses backward shift deletion, so no tombstones are needed and
+ * the table never degrades after churn.
+ *
+ * An empty slot is marked by a NULL stream pointer. The capacity is
+ * always a power of two.
+ */
+
+#define INITIAL_STREAM_INDEX_SIZE 8
+
+/* grow the table when it would become more than 7/8 full */
+#define STREAM_INDEX_MAX_LOAD_NUM 7
+#define STREAM_INDEX_MAX_LOAD_DEN 8
 
 typedef struct list_entry {
     uint32_t ssrc;
@@ -4870,6 +11900,91 @@ typedef struct srtp_stream_list_ctx_t_ {
     size_t size;
 } srtp_stream_list_ctx_t_;
 
+/*
+ * SSRCs are chosen randomly by well behaved endpoints but may be picked
+ * by an attacker, so mix all bits into the slot index rather than using
+ * the low bits directly.
+ */
+static inline size_t srtp_stream_list_home(const srtp_stream_list_t list,
+                                           uint32_t ssrc)
+{
+    uint32_t h = ssrc;
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    h ^= h >> 16;
+    return (size_t)h & (list->capacity - 1);
+}
+
+static inline size_t srtp_stream_list_probe_distance(
+    const srtp_stream_list_t list,
+    size_t slot,
+    uint32_t ssrc)
+{
+    return (slot - srtp_stream_list_home(list, ssrc)) & (list->capacity - 1);
+}
+
+/*
+ * place an entry into the table, the caller must ensure there is at least
+ * one free slot and that the ssrc is not already present.
+ */
+static void srtp_stream_list_place(srtp_stream_list_t list, list_entry entry)
+{
+    size_t mask = list->capacity - 1;
+    size_t slot = srtp_stream_list_home(list, entry.ssrc);
+    size_t dist = 0;
+
+    while (list->entries[slot].stream != NULL) {
+        size_t existing_dist = srtp_stream_list_probe_distance(
+            list, slot, list->entries[slot].ssrc);
+        if (existing_dist < dist) {
+            /* take from the rich, continue placing the displaced entry */
+            list_entry tmp = list->entries[slot];
+            list->entries[slot] = entry;
+            entry = tmp;
+            dist = existing_dist;
+        }
+        slot = (slot + 1) & mask;
+        dist++;
+    }
+
+    list->entries[slot] = entry;
+}
+
+static srtp_err_status_t srtp_stream_list_resize(srtp_stream_list_t list,
+                                                 size_t new_capacity)
+{
+    list_entry *old_entries = list->entries;
+    size_t old_capacity = list->capacity;
+
+    // Check for capacity overflow.
+    if (new_capacity < old_capacity ||
+        new_capacity > SIZE_MAX / sizeof(list_entry)) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    list_entry *new_entries =
+        srtp_crypto_alloc(sizeof(list_entry) * new_capacity);
+    if (new_entries == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    list->entries = new_entries;
+    list->capacity = new_capacity;
+
+    // Re-hash previous entries into the new buffer.
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].stream != NULL) {
+            srtp_stream_list_place(list, old_entries[i]);
+        }
+    }
+
+    srtp_crypto_free(old_entries);
+
+    return srtp_err_status_ok;
+}
+
 srtp_err_status_t srtp_stream_list_alloc(srtp_stream_list_t *list_ptr)
 {
     srtp_stream_list_t list =
@@ -4878,6 +11993,7 @@ srtp_err_status_t srtp_stream_list_alloc(srtp_stream_list_t *list_ptr)
         return srtp_err_status_alloc_fail;
     }
 
+    /* srtp_crypto_alloc zeroes memory, so all slots start out empty */
     list->entries =
         srtp_crypto_alloc(sizeof(list_entry) * INITIAL_STREAM_INDEX_SIZE);
     if (list->entries == NULL) {
@@ -4907,118 +12023,246 @@ srtp_err_status_t srtp_stream_list_dealloc(srtp_stream_list_t list)
 }
 
 /*
- * inserting a new entry in the list may require reallocating memory in order
- * to keep all the items in a contiguous memory block.
+ * make room for num more entries with a single resize, so that adding
+ * many streams at once re-hashes the existing entries at most once
  */
-srtp_err_status_t srtp_stream_list_insert(srtp_stream_list_t list,
-                                          srtp_stream_t stream)
+static srtp_err_status_t srtp_stream_list_reserve(srtp_stream_list_t list,
+                                                  size_t num)
 {
-    /*
-     * there is no space to hold the new entry in the entries buffer,
-     * double the size of the buffer.
-     */
-    if (list->size == list->capacity) {
-        size_t new_capacity = list->capacity * 2;
+    size_t capacity = list->capacity;
 
-        // Check for capacity overflow.
-        if (new_capacity < list->capacity ||
-            new_capacity > SIZE_MAX / sizeof(list_entry)) {
-            return srtp_err_status_alloc_fail;
-        }
+    if (num > SIZE_MAX / STREAM_INDEX_MAX_LOAD_DEN - list->size) {
+        return srtp_err_status_alloc_fail;
+    }
 
-        list_entry *new_entries =
-            srtp_crypto_alloc(sizeof(list_entry) * new_capacity);
-        if (new_entries == NULL) {
+    while ((list->size + num) * STREAM_INDEX_MAX_LOAD_DEN >
+           capacity * STREAM_INDEX_MAX_LOAD_NUM) {
+        if (capacity > SIZE_MAX / 2) {
             return srtp_err_status_alloc_fail;
         }
+        capacity *= 2;
+    }
 
-        // Copy previous entries into the new buffer.
-        memcpy(new_entries, list->entries, sizeof(list_entry) * list->capacity);
-
-        // Release previous entries.
-        srtp_crypto_free(list->entries);
+    if (capacity == list->capacity) {
+        return srtp_err_status_ok;
+    }
 
-        // Assign new entries to the list.
-        list->entries = new_entries;
+    return srtp_stream_list_resize(list, capacity);
+}
 
-        // Update list capacity.
-        list->capacity = new_capacity;
+/*
+ * inserting a new entry may require growing the table, in which case all
+ * existing entries are re-hashed into a table of twice the size.
+ */
+srtp_err_status_t srtp_stream_list_insert(srtp_stream_list_t list,
+                                          srtp_stream_t stream)
+{
+    if ((list->size + 1) * STREAM_INDEX_MAX_LOAD_DEN >
+        list->capacity * STREAM_INDEX_MAX_LOAD_NUM) {
+        srtp_err_status_t status =
+            srtp_stream_list_resize(list, list->capacity * 2);
+        if (status) {
+            return status;
+        }
     }
 
-    // fill the first available entry
-    size_t next_index = list->size;
-    list->entries[next_index].ssrc = stream->ssrc;
-    list->entries[next_index].stream = stream;
+    list_entry entry;
+    entry.ssrc = stream->ssrc;
+    entry.stream = stream;
+    srtp_stream_list_place(list, entry);
 
-    // update size value
     list->size++;
 
     return srtp_err_status_ok;
 }
 
 /*
- * removing an entry from the list performs a memory move of the following
- * entries one position back in order to keep all the entries in the buffer
- * contiguous.
+ * remove all entries in one pass over the table, passing each stream to
+ * callback once it is out of the list. As nothing is looked up meanwhile
+ * the slots are just cleared, without the backward shift of
+ * srtp_stream_list_remove(); if callback returns false the walk stops and
+ * the list can only be deallocated.
  */
-void srtp_stream_list_remove(srtp_stream_list_t list,
-                             srtp_stream_t stream_to_remove)
+static void srtp_stream_list_drain(srtp_stream_list_t list,
+                                   bool (*callback)(srtp_stream_t, void *),
+                                   void *data)
 {
-    size_t end = list->size;
+    for (size_t slot = 0; slot < list->capacity && list->size > 0; slot++) {
+        srtp_stream_t stream = list->entries[slot].stream;
+
+        if (stream == NULL) {
+            continue;
+        }
+        list->entries[slot].ssrc = 0;
+        list->entries[slot].stream = NULL;
+        list->size--;
+        if (!callback(stream, data)) {
+            return;
+        }
+    }
+}
 
-    for (size_t i = 0; i < end; i++) {
-        if (list->entries[i].ssrc == stream_to_remove->ssrc) {
-            size_t entries_to_move = list->size - i - 1;
-            memmove(&list->entries[i], &list->entries[i + 1],
-                    sizeof(list_entry) * entries_to_move);
-            list->size--;
+/*
+ * find the slot holding ssrc, returns capacity if not present. The probe
+ * can stop as soon as it reaches an entry that is closer to its home slot
+ * than the ssrc being looked for would be.
+ */
+static size_t srtp_stream_list_find_slot(srtp_stream_list_t list,
+                                         uint32_t ssrc)
+{
+    size_t mask = list->capacity - 1;
+    size_t slot = srtp_stream_list_home(list, ssrc);
+    const list_entry *entries = list->entries;
 
+    for (size_t dist = 0; dist <= mask; dist++) {
+        if (entries[slot].stream == NULL) {
+            break;
+        }
+        if (entries[slot].ssrc == ssrc) {
+            return slot;
+        }
+        if (srtp_stream_list_probe_distance(list, slot, entries[slot].ssrc) <
+            dist) {
             break;
         }
+        slot = (slot + 1) & mask;
     }
+
+    return list->capacity;
 }
 
-srtp_stream_t srtp_stream_list_get(srtp_stream_list_t list, uint32_t ssrc)
+/*
+ * removing an entry shifts the following entries of the same probe run one
+ * slot back towards their home slot, leaving the table as if the removed
+ * entry had never been inserted.
+ */
+void srtp_stream_list_remove(srtp_stream_list_t list,
+                             srtp_stream_t stream_to_remove)
 {
-    size_t end = list->size;
+    size_t mask = list->capacity - 1;
+    size_t slot = srtp_stream_list_find_slot(list, stream_to_remove->ssrc);
 
-    list_entry *entries = list->entries;
+    if (slot == list->capacity) {
+        return;
+    }
 
-    for (size_t i = 0; i < end; i++) {
-        if (entries[i].ssrc == ssrc) {
-            return entries[i].stream;
-        }
+    size_t next = (slot + 1) & mask;
+    while (list->entries[next].stream != NULL &&
+           srtp_stream_list_probe_distance(list, next,
+                                           list->entries[next].ssrc) != 0) {
+        list->entries[slot] = list->entries[next];
+        slot = next;
+        next = (next + 1) & mask;
     }
 
-    return NULL;
+    list->entries[slot].ssrc = 0;
+    list->entries[slot].stream = NULL;
+    list->size--;
+}
+
+srtp_stream_t srtp_stream_list_get(srtp_stream_list_t list, uint32_t ssrc)
+{
+    size_t slot = srtp_stream_list_find_slot(list, ssrc);
+
+    if (slot == list->capacity) {
+        return NULL;
+    }
+
+    return list->entries[slot].stream;
 }
 
 void srtp_stream_list_for_each(srtp_stream_list_t list,
                                bool (*callback)(srtp_stream_t, void *),
                                void *data)
 {
-    list_entry *entries = list->entries;
-
-    size_t size = list->size;
+    size_t mask = list->capacity - 1;
+    size_t remaining = list->size;
 
     /*
-     * the second statement of the expression needs to be recalculated on each
-     * iteration as the available number of entries may change within the given
-     * callback.
-     * Ie: in case the callback calls srtp_stream_list_remove().
+     * start the walk at the beginning of a probe run, ie: an empty slot or
+     * an entry sitting in its home slot. Backward shift deletion never moves
+     * entries across such a slot, so when the callback removes the current
+     * entry the only entry that can move is the next one of the run, and it
+     * lands in the current slot.
      */
-    for (size_t i = 0; i < list->size;) {
-        if (!callback(entries[i].stream, data)) {
+    size_t start = 0;
+    while (start < list->capacity && list->entries[start].stream != NULL &&
+           srtp_stream_list_probe_distance(list, start,
+                                           list->entries[start].ssrc) != 0) {
+        start++;
+    }
+
+    size_t n = 0;
+    while (remaining > 0 && n < list->capacity) {
+        size_t slot = (start + n) & mask;
+        srtp_stream_t stream = list->entries[slot].stream;
+
+        if (stream == NULL) {
+            n++;
+            continue;
+        }
+
+        remaining--;
+
+        size_t size = list->size;
+        if (!callback(stream, data)) {
             break;
         }
 
-        // the entry was not removed, increase the counter.
+        // the entry was not removed, move on to the next slot.
         if (size == list->size) {
-            ++i;
+            n++;
         }
-
-        size = list->size;
     }
 }
 
+/* the memory of the list and its table */
+static size_t srtp_stream_list_memory_usage(srtp_stream_list_t list)
+{
+    return srtp_crypto_alloc_size(list) + srtp_crypto_alloc_size(list->entries);
+}
+
+#else
+
+/* an external stream list grows as streams are inserted */
+static srtp_err_status_t srtp_stream_list_reserve(srtp_stream_list_t list,
+                                                  size_t num)
+{
+    (void)list;
+    (void)num;
+    return srtp_err_status_ok;
+}
+
+struct srtp_stream_list_drain_data {
+    srtp_stream_list_t list;
+    bool (*callback)(srtp_stream_t, void *);
+    void *data;
+};
+
+static bool srtp_stream_list_drain_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct srtp_stream_list_drain_data *d =
+        (struct srtp_stream_list_drain_data *)raw_data;
+
+    srtp_stream_list_remove(d->list, stream);
+    return d->callback(stream, d->data);
+}
+
+/* an external stream list is emptied one stream at a time */
+static void srtp_stream_list_drain(srtp_stream_list_t list,
+                                   bool (*callback)(srtp_stream_t, void *),
+                                   void *data)
+{
+    struct srtp_stream_list_drain_data d = { list, callback, data };
+
+    srtp_stream_list_for_each(list, srtp_stream_list_drain_cb, &d);
+}
+
+/* the memory of an external stream list is not known */
+static size_t srtp_stream_list_memory_usage(srtp_stream_list_t list)
+{
+    (void)list;
+    return 0;
+}
+
 #endif
@@ -0,0 +1,215 @@
+/*
+ * srtp_events.c
+ *
+ * per session event queues for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "srtp_priv.h"
+#include "stream_list_priv.h"
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#elif defined(HAVE_WINSOCK2_H)
+#include <winsock2.h>
+#endif
+
+#include "alloc.h"
+
+/*
+ * srtp_event_queue_push(session, stream, event) adds event of stream to
+ * the event queue of session, unless the same event of stream is queued
+ * already; a full queue counts the event as dropped instead
+ */
+void srtp_event_queue_push(srtp_t session,
+                           srtp_stream_ctx_t *stream,
+                           srtp_event_t event)
+{
+    srtp_event_queue_t *queue = session->events;
+    uint8_t flag = (uint8_t)(1u << event);
+    srtp_event_slot_t *slot;
+    long pos;
+
+    if (srtp_atomic_set_flag(&stream->queued_events, flag)) {
+        return;
+    }
+
+    pos = srtp_lock_load(&queue->head);
+    for (;;) {
+        long diff;
+
+        slot = &queue->slots[(size_t)pos & queue->mask];
+        diff = (long)((unsigned long)srtp_lock_load(&slot->seq) -
+                      (unsigned long)pos);
+        if (diff == 0 &&
+            srtp_lock_cas(&queue->head, pos,
+                          (long)((unsigned long)pos + 1))) {
+            break;
+        }
+        if (diff < 0) {
+            /* the slot still holds the event of the previous round */
+            srtp_atomic_clear_flag(&stream->queued_events, flag);
+            srtp_atomic_add(queue->dropped, 1);
+            return;
+        }
+        pos = srtp_lock_load(&queue->head);
+    }
+
+    slot->ssrc = ntohl(stream->ssrc);
+    slot->event = event;
+    srtp_lock_add_release(&slot->seq, 1);
+}
+
+static bool srtp_clear_queued_events_cb(srtp_stream_t stream, void *raw_data)
+{
+    (void)raw_data;
+    stream->queued_events = 0;
+    return true;
+}
+
+srtp_err_status_t srtp_session_set_event_queue(srtp_t session,
+                                               size_t num_events)
+{
+    srtp_event_queue_t *queue = NULL;
+    size_t num_slots = 2;
+
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (num_events > 0 && !SRTP_HAVE_ATOMICS) {
+        return srtp_err_status_fail;
+    }
+
+    if (num_events > 0) {
+        if (num_events > (SIZE_MAX - sizeof(*queue)) / 2 /
+                             sizeof(srtp_event_slot_t)) {
+            return srtp_err_status_bad_param;
+        }
+        while (num_slots < num_events) {
+            num_slots *= 2;
+        }
+
+        int node = srtp_session_bind_allocs(session);
+        queue = (srtp_event_queue_t *)srtp_crypto_alloc(
+            sizeof(*queue) + num_slots * sizeof(srtp_event_slot_t));
+        srtp_crypto_alloc_set_node(node);
+        if (queue == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+        queue->mask = num_slots - 1;
+        queue->slots = (srtp_event_slot_t *)(queue + 1);
+        for (size_t i = 0; i < num_slots; i++) {
+            queue->slots[i].seq = (long)i;
+        }
+    }
+
+    /* events still queued are lost with the queue */
+    if (session->thread_safe) {
+        srtp_rwlock_write_lock(&session->lock);
+    }
+    srtp_crypto_free(session->events);
+    session->events = queue;
+    srtp_stream_list_for_each(session->stream_list,
+                              srtp_clear_queued_events_cb, NULL);
+    if (session->thread_safe) {
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_session_poll_events(srtp_t session,
+                                           srtp_event_data_t *events,
+                                           size_t max_events,
+                                           size_t *num_events)
+{
+    srtp_event_queue_t *queue;
+    size_t dropped;
+    size_t n = 0;
+
+    if (num_events != NULL) {
+        *num_events = 0;
+    }
+    if (session == NULL || num_events == NULL ||
+        (events == NULL && max_events > 0) || session->events == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    queue = session->events;
+
+    dropped = srtp_atomic_get(queue->dropped);
+    if (dropped != 0 && max_events > 0) {
+        srtp_atomic_sub(queue->dropped, dropped);
+        events[n].session = session;
+        events[n].ssrc = 0;
+        events[n].event = event_queue_overflow;
+        n++;
+    }
+
+    /* the streams are looked up to let them queue their events again */
+    if (session->thread_safe) {
+        srtp_rwlock_read_lock(&session->lock);
+    }
+    while (n < max_events) {
+        srtp_event_slot_t *slot = &queue->slots[(size_t)queue->tail &
+                                                queue->mask];
+        long next = (long)((unsigned long)queue->tail + 1);
+        srtp_stream_ctx_t *stream;
+
+        if (srtp_lock_load(&slot->seq) != next) {
+            break;
+        }
+
+        events[n].session = session;
+        events[n].ssrc = slot->ssrc;
+        events[n].event = slot->event;
+        n++;
+
+        stream = srtp_get_stream(session, htonl(slot->ssrc));
+        if (stream != NULL) {
+            srtp_atomic_clear_flag(&stream->queued_events,
+                                   (uint8_t)(1u << slot->event));
+        }
+
+        /* free the slot for the next round of the queue */
+        srtp_lock_add_release(&slot->seq, (long)queue->mask);
+        queue->tail = next;
+    }
+    if (session->thread_safe) {
+        srtp_rwlock_read_unlock(&session->lock);
+    }
+
+    *num_events = n;
+
+    return srtp_err_status_ok;
+}
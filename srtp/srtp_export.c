@@ -0,0 +1,963 @@
+/*
+ * srtp_export.c
+ *
+ * session export and import for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "srtp_priv.h"
+#include "stream_list_priv.h"
+
+#include <string.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#elif defined(HAVE_WINSOCK2_H)
+#include <winsock2.h>
+#endif
+
+#include "alloc.h"
+
+static bool srtp_session_has_stream_cb(srtp_stream_t stream, void *raw_data)
+{
+    (void)stream;
+    *(bool *)raw_data = true;
+    return false;
+}
+
+srtp_err_status_t srtp_set_exportable(srtp_t session, bool exportable)
+{
+    bool has_stream = false;
+
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* the policies of streams that are already keyed are gone */
+    srtp_stream_list_for_each(session->stream_list, srtp_session_has_stream_cb,
+                              &has_stream);
+    if (has_stream || session->stream_template != NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    session->exportable = exportable;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * an export starts with a header of SRTP_EXPORT_HEADER_LEN octets
+ *
+ *   "SRTX", version, flags, two zero octets, nonce, length of the body
+ *
+ * and the body follows, encrypted and followed by an AES-GCM tag computed
+ * over the header too when the export is wrapped. The body holds the
+ * session flags, the template's policy and key usage when there is a
+ * template, then a record per stream started by a one octet and ended by
+ * a zero octet. All fields are in network order.
+ */
+#define SRTP_EXPORT_VERSION 3
+#define SRTP_EXPORT_HEADER_LEN (8 + SRTP_SESSION_EXPORT_NONCE_LEN + 4)
+#define SRTP_EXPORT_TAG_LEN 16
+
+#define SRTP_EXPORT_WRAPPED 0x01       /* header flags  */
+#define SRTP_EXPORT_THREAD_SAFE 0x01   /* session flags */
+#define SRTP_EXPORT_FROM_TEMPLATE 0x01 /* stream flags  */
+#define SRTP_EXPORT_HAS_RTCP_RDB 0x02
+
+static const uint8_t srtp_export_magic[4] = { 'S', 'R', 'T', 'X' };
+
+/*
+ * an srtp_export_writer_t appends fields to buf, once a field does not
+ * fit nothing more is written but len keeps counting the octets needed
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t len;
+} srtp_export_writer_t;
+
+static void srtp_export_put(srtp_export_writer_t *w,
+                            const void *data,
+                            size_t len)
+{
+    if (w->buf != NULL && len <= w->capacity && w->len <= w->capacity - len) {
+        memcpy(w->buf + w->len, data, len);
+    }
+    w->len += len;
+}
+
+/* srtp_export_put_uint(w, value, len) appends value as len octets */
+static void srtp_export_put_uint(srtp_export_writer_t *w,
+                                 uint64_t value,
+                                 size_t len)
+{
+    uint8_t octets[8];
+
+    for (size_t i = 0; i < len; i++) {
+        octets[i] = (uint8_t)(value >> (8 * (len - 1 - i)));
+    }
+    srtp_export_put(w, octets, len);
+}
+
+/*
+ * an srtp_export_reader_t takes fields from buf, ok is cleared by the
+ * first field that runs past the end and the fields read after it are zero
+ */
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool ok;
+} srtp_export_reader_t;
+
+static const uint8_t *srtp_export_get(srtp_export_reader_t *r, size_t len)
+{
+    const uint8_t *data;
+
+    if (!r->ok || r->len - r->pos < len) {
+        r->ok = false;
+        return NULL;
+    }
+    data = r->buf + r->pos;
+    r->pos += len;
+
+    return data;
+}
+
+static uint64_t srtp_export_get_uint(srtp_export_reader_t *r, size_t len)
+{
+    const uint8_t *octets = srtp_export_get(r, len);
+    uint64_t value = 0;
+
+    if (octets == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        value = (value << 8) | octets[i];
+    }
+
+    return value;
+}
+
+static void srtp_export_put_crypto_policy(srtp_export_writer_t *w,
+                                          const srtp_crypto_policy_t *p)
+{
+    srtp_export_put_uint(w, p->cipher_type, 4);
+    srtp_export_put_uint(w, p->cipher_key_len, 4);
+    srtp_export_put_uint(w, p->auth_type, 4);
+    srtp_export_put_uint(w, p->auth_key_len, 4);
+    srtp_export_put_uint(w, p->auth_tag_len, 4);
+    srtp_export_put_uint(w, p->sec_serv, 1);
+}
+
+static void srtp_export_get_crypto_policy(srtp_export_reader_t *r,
+                                          srtp_crypto_policy_t *p)
+{
+    p->cipher_type = (srtp_cipher_type_id_t)srtp_export_get_uint(r, 4);
+    p->cipher_key_len = (size_t)srtp_export_get_uint(r, 4);
+    p->auth_type = (srtp_auth_type_id_t)srtp_export_get_uint(r, 4);
+    p->auth_key_len = (size_t)srtp_export_get_uint(r, 4);
+    p->auth_tag_len = (size_t)srtp_export_get_uint(r, 4);
+    p->sec_serv = (srtp_sec_serv_t)srtp_export_get_uint(r, 1);
+}
+
+static void srtp_export_put_policy(srtp_export_writer_t *w,
+                                   const srtp_policy_t p)
+{
+    srtp_export_put_uint(w, p->profile, 4);
+    srtp_export_put_uint(w, p->ssrc.type, 1);
+    srtp_export_put_uint(w, p->ssrc.value, 4);
+    srtp_export_put_crypto_policy(w, &p->rtp);
+    srtp_export_put_crypto_policy(w, &p->rtcp);
+    srtp_export_put_uint(w, p->num_master_keys, 2);
+    for (size_t i = 0; i < p->num_master_keys; i++) {
+        const srtp_master_key_t *master_key = &p->master_keys[i];
+
+        srtp_export_put_uint(w, master_key->key_len, 1);
+        srtp_export_put_uint(w, master_key->salt_len, 1);
+        srtp_export_put(w, master_key->key,
+                        master_key->key_len + master_key->salt_len);
+        srtp_export_put_uint(w, master_key->mki_id_len, 1);
+        srtp_export_put(w, master_key->mki_id, master_key->mki_id_len);
+    }
+    srtp_export_put_uint(w, p->use_mki, 1);
+    srtp_export_put_uint(w, p->mki_size, 1);
+    srtp_export_put_uint(w, p->window_size, 4);
+    srtp_export_put_uint(w, p->adaptive_window, 1);
+    srtp_export_put_uint(w, p->rtcp_window_size, 4);
+    srtp_export_put_uint(w, p->allow_repeat_tx, 1);
+    srtp_export_put_uint(w, p->enc_xtn_hdr_count, 1);
+    srtp_export_put(w, p->enc_xtn_hdr, p->enc_xtn_hdr_count);
+    srtp_export_put_uint(w, p->use_cryptex, 1);
+    srtp_export_put_uint(w, p->stream_pool_size, 8);
+    srtp_export_put_uint(w, p->key_overlap, 8);
+    srtp_export_put_uint(w, p->max_clones, 8);
+    srtp_export_put_uint(w, p->clone_idle_timeout, 8);
+}
+
+/*
+ * srtp_export_get_policy(r, p) reads a policy into p, only the lengths
+ * are checked here, srtp_stream_add() validates the rest
+ */
+static srtp_err_status_t srtp_export_get_policy(srtp_export_reader_t *r,
+                                                srtp_policy_t p)
+{
+    const uint8_t *data;
+    size_t num_master_keys;
+
+    srtp_policy_remove_keys(p);
+    srtp_policy_remove_enc_hdr_xtnd_ids(p);
+
+    p->profile = (srtp_profile_t)srtp_export_get_uint(r, 4);
+    p->ssrc.type = (srtp_ssrc_type_t)srtp_export_get_uint(r, 1);
+    p->ssrc.value = (uint32_t)srtp_export_get_uint(r, 4);
+    srtp_export_get_crypto_policy(r, &p->rtp);
+    srtp_export_get_crypto_policy(r, &p->rtcp);
+    num_master_keys = (size_t)srtp_export_get_uint(r, 2);
+    if (num_master_keys > SRTP_MAX_NUM_MASTER_KEYS) {
+        return srtp_err_status_parse_err;
+    }
+    for (size_t i = 0; i < num_master_keys; i++) {
+        srtp_master_key_t master_key;
+        srtp_err_status_t status;
+
+        memset(&master_key, 0, sizeof(master_key));
+        master_key.key_len = (size_t)srtp_export_get_uint(r, 1);
+        master_key.salt_len = (size_t)srtp_export_get_uint(r, 1);
+        if (master_key.key_len + master_key.salt_len > SRTP_MAX_KEY_LEN) {
+            return srtp_err_status_parse_err;
+        }
+        data = srtp_export_get(r, master_key.key_len + master_key.salt_len);
+        if (data != NULL) {
+            memcpy(master_key.key, data,
+                   master_key.key_len + master_key.salt_len);
+        }
+        master_key.mki_id_len = (size_t)srtp_export_get_uint(r, 1);
+        if (master_key.mki_id_len > SRTP_MAX_MKI_LEN) {
+            return srtp_err_status_parse_err;
+        }
+        data = srtp_export_get(r, master_key.mki_id_len);
+        if (data != NULL) {
+            memcpy(master_key.mki_id, data, master_key.mki_id_len);
+        }
+        status = srtp_policy_append_key(p, &master_key);
+        octet_string_set_to_zero(&master_key, sizeof(master_key));
+        if (status) {
+            return status;
+        }
+    }
+    p->use_mki = srtp_export_get_uint(r, 1) != 0;
+    p->mki_size = (size_t)srtp_export_get_uint(r, 1);
+    p->window_size = (size_t)srtp_export_get_uint(r, 4);
+    p->adaptive_window = srtp_export_get_uint(r, 1) != 0;
+    p->rtcp_window_size = (size_t)srtp_export_get_uint(r, 4);
+    p->allow_repeat_tx = srtp_export_get_uint(r, 1) != 0;
+    p->enc_xtn_hdr_count = (size_t)srtp_export_get_uint(r, 1);
+    if (p->enc_xtn_hdr_count > SRTP_MAX_NUM_ENC_HDR_XTND_IDS) {
+        return srtp_err_status_parse_err;
+    }
+    data = srtp_export_get(r, p->enc_xtn_hdr_count);
+    if (data != NULL) {
+        memcpy(p->enc_xtn_hdr, data, p->enc_xtn_hdr_count);
+    }
+    p->use_cryptex = srtp_export_get_uint(r, 1) != 0;
+    p->stream_pool_size = (size_t)srtp_export_get_uint(r, 8);
+    p->key_overlap = (size_t)srtp_export_get_uint(r, 8);
+    p->max_clones = (size_t)srtp_export_get_uint(r, 8);
+    p->clone_idle_timeout = (size_t)srtp_export_get_uint(r, 8);
+
+    return r->ok ? srtp_err_status_ok : srtp_err_status_parse_err;
+}
+
+/*
+ * srtp_export_put_window(w, window, word) appends the length of a replay
+ * window and its bits, the newest index first, so that the export does
+ * not depend on where the window starts in word
+ */
+static void srtp_export_put_window(srtp_export_writer_t *w,
+                                   const srtp_replay_window_t *window,
+                                   const uint64_t *word)
+{
+    srtp_export_put_uint(w, window->length, 4);
+    for (size_t age = 0; age < window->length; age += 8) {
+        uint8_t octet = 0;
+
+        for (size_t i = 0; i < 8; i++) {
+            if (srtp_replay_window_test(window, word, age + i)) {
+                octet |= (uint8_t)(1 << i);
+            }
+        }
+        srtp_export_put(w, &octet, 1);
+    }
+}
+
+/*
+ * srtp_export_get_window_bits(r, window, word) reads the bits of a replay
+ * window whose length has been read already
+ */
+static srtp_err_status_t srtp_export_get_window_bits(
+    srtp_export_reader_t *r,
+    const srtp_replay_window_t *window,
+    uint64_t *word)
+{
+    const uint8_t *octets;
+
+    octets = srtp_export_get(r, window->length / 8);
+    if (octets == NULL) {
+        return srtp_err_status_parse_err;
+    }
+
+    srtp_replay_window_clear(window, word);
+    for (size_t age = 0; age < window->length; age++) {
+        if (octets[age / 8] & (1 << (age % 8))) {
+            srtp_replay_window_set(window, word, age);
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_export_get_window(
+    srtp_export_reader_t *r,
+    const srtp_replay_window_t *window,
+    uint64_t *word)
+{
+    /* the window was sized from the same policy */
+    if (srtp_export_get_uint(r, 4) != window->length) {
+        return srtp_err_status_parse_err;
+    }
+
+    return srtp_export_get_window_bits(r, window, word);
+}
+
+/*
+ * srtp_export_get_rdbx_window(r, rdbx) reads the RTP replay window into
+ * rdbx, an adaptive window is first resized to the size it had grown to
+ */
+static srtp_err_status_t srtp_export_get_rdbx_window(srtp_export_reader_t *r,
+                                                     srtp_rdbx_t *rdbx)
+{
+    size_t length = (size_t)srtp_export_get_uint(r, 4);
+
+    if (!r->ok || srtp_rdbx_resize(rdbx, length) != srtp_err_status_ok) {
+        return srtp_err_status_parse_err;
+    }
+
+    return srtp_export_get_window_bits(r, &rdbx->window, rdbx->bitmask);
+}
+
+static void srtp_export_put_key_limits(srtp_export_writer_t *w,
+                                       const srtp_stream_ctx_t *stream)
+{
+    srtp_export_put_uint(w, stream->num_master_keys, 1);
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        const srtp_key_limit_ctx_t *limit = stream->session_keys[i].limit;
+
+        srtp_export_put_uint(w, limit->num_left, 8);
+        srtp_export_put_uint(w, limit->state, 1);
+    }
+}
+
+static srtp_err_status_t srtp_export_get_key_limits(srtp_export_reader_t *r,
+                                                    srtp_stream_ctx_t *stream)
+{
+    if (srtp_export_get_uint(r, 1) != stream->num_master_keys) {
+        return srtp_err_status_parse_err;
+    }
+    for (size_t i = 0; i < stream->num_master_keys; i++) {
+        srtp_key_limit_ctx_t *limit = stream->session_keys[i].limit;
+        uint64_t num_left = srtp_export_get_uint(r, 8);
+        uint64_t state = srtp_export_get_uint(r, 1);
+
+        if (state > srtp_key_state_expired) {
+            return srtp_err_status_parse_err;
+        }
+        limit->num_left = num_left;
+        limit->state = (srtp_key_state_t)state;
+    }
+
+    return r->ok ? srtp_err_status_ok : srtp_err_status_parse_err;
+}
+
+static void srtp_export_put_stats(srtp_export_writer_t *w,
+                                  const srtp_stream_stats_t *stats)
+{
+    srtp_export_put_uint(w, stats->rtp_packets_protected, 8);
+    srtp_export_put_uint(w, stats->rtp_bytes_protected, 8);
+    srtp_export_put_uint(w, stats->rtp_packets_unprotected, 8);
+    srtp_export_put_uint(w, stats->rtp_bytes_unprotected, 8);
+    srtp_export_put_uint(w, stats->rtcp_packets_protected, 8);
+    srtp_export_put_uint(w, stats->rtcp_bytes_protected, 8);
+    srtp_export_put_uint(w, stats->rtcp_packets_unprotected, 8);
+    srtp_export_put_uint(w, stats->rtcp_bytes_unprotected, 8);
+    srtp_export_put_uint(w, stats->auth_fail, 8);
+    srtp_export_put_uint(w, stats->replay_fail, 8);
+    srtp_export_put_uint(w, stats->replay_old, 8);
+    srtp_export_put_uint(w, stats->bad_mki, 8);
+    srtp_export_put_uint(w, stats->key_soft_limit, 8);
+}
+
+static void srtp_export_get_stats(srtp_export_reader_t *r,
+                                  srtp_stream_stats_t *stats)
+{
+    stats->rtp_packets_protected = srtp_export_get_uint(r, 8);
+    stats->rtp_bytes_protected = srtp_export_get_uint(r, 8);
+    stats->rtp_packets_unprotected = srtp_export_get_uint(r, 8);
+    stats->rtp_bytes_unprotected = srtp_export_get_uint(r, 8);
+    stats->rtcp_packets_protected = srtp_export_get_uint(r, 8);
+    stats->rtcp_bytes_protected = srtp_export_get_uint(r, 8);
+    stats->rtcp_packets_unprotected = srtp_export_get_uint(r, 8);
+    stats->rtcp_bytes_unprotected = srtp_export_get_uint(r, 8);
+    stats->auth_fail = srtp_export_get_uint(r, 8);
+    stats->replay_fail = srtp_export_get_uint(r, 8);
+    stats->replay_old = srtp_export_get_uint(r, 8);
+    stats->bad_mki = srtp_export_get_uint(r, 8);
+    stats->key_soft_limit = srtp_export_get_uint(r, 8);
+}
+
+struct srtp_export_stream_data {
+    srtp_export_writer_t *w;
+    bool thread_safe;
+    srtp_err_status_t status;
+};
+
+static bool srtp_export_stream_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct srtp_export_stream_data *data =
+        (struct srtp_export_stream_data *)raw_data;
+    srtp_export_writer_t *w = data->w;
+    const srtp_stream_cold_t *cold;
+    srtp_stream_stats_t stats;
+    uint8_t flags = 0;
+
+    if (data->thread_safe) {
+        srtp_stream_lock(stream, SRTP_STREAM_LOCK_BOTH);
+    }
+
+    cold = stream->cold;
+    if (stream->from_template) {
+        flags |= SRTP_EXPORT_FROM_TEMPLATE;
+    } else if (cold == NULL || cold->policy == NULL) {
+        data->status = srtp_err_status_bad_param;
+    }
+    if (cold != NULL) {
+        flags |= SRTP_EXPORT_HAS_RTCP_RDB;
+    }
+
+    if (data->status == srtp_err_status_ok) {
+        srtp_export_put_uint(w, 1, 1);
+        srtp_export_put_uint(w, ntohl(stream->ssrc), 4);
+        srtp_export_put_uint(w, stream->direction, 1);
+        srtp_export_put_uint(w, flags, 1);
+        if (!stream->from_template) {
+            srtp_export_put_policy(w, cold->policy);
+        }
+        srtp_export_put_uint(w, stream->pending_roc, 4);
+        srtp_export_put_uint(w, stream->rtp_rdbx.index, 8);
+        srtp_export_put_window(w, &stream->rtp_rdbx.window,
+                               stream->rtp_rdbx.bitmask);
+        if (cold != NULL) {
+            srtp_export_put_uint(w, cold->rtcp_rdb.window_start, 4);
+            srtp_export_put_window(w, &cold->rtcp_rdb.window,
+                                   cold->rtcp_rdb.bitmask);
+        }
+        srtp_export_put_key_limits(w, stream);
+        srtp_stream_get_counters(stream, &stats);
+        srtp_export_put_stats(w, &stats);
+    }
+
+    if (data->thread_safe) {
+        srtp_stream_unlock(stream, SRTP_STREAM_LOCK_BOTH);
+    }
+
+    return data->status == srtp_err_status_ok;
+}
+
+#ifdef GCM
+/*
+ * srtp_export_cipher(wrap_key, wrap_key_len, nonce, direction, aad, c)
+ * sets c to an AES-GCM cipher keyed with wrap_key that is ready to wrap or
+ * unwrap the body of an export with header aad
+ */
+static srtp_err_status_t srtp_export_cipher(const uint8_t *wrap_key,
+                                            size_t wrap_key_len,
+                                            const uint8_t *nonce,
+                                            srtp_cipher_direction_t direction,
+                                            const uint8_t *aad,
+                                            srtp_cipher_t **c)
+{
+    uint8_t key[SRTP_AES_GCM_256_KEY_LEN_WSALT];
+    srtp_cipher_type_id_t id;
+    size_t key_len;
+    v128_t iv;
+    srtp_err_status_t status;
+
+    if (wrap_key_len == SRTP_AES_128_KEY_LEN) {
+        id = SRTP_AES_GCM_128;
+        key_len = SRTP_AES_GCM_128_KEY_LEN_WSALT;
+    } else if (wrap_key_len == SRTP_AES_256_KEY_LEN) {
+        id = SRTP_AES_GCM_256;
+        key_len = SRTP_AES_GCM_256_KEY_LEN_WSALT;
+    } else {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_crypto_kernel_alloc_cipher(id, c, key_len,
+                                             SRTP_EXPORT_TAG_LEN);
+    if (status) {
+        return status;
+    }
+
+    /* the cipher is allocated with a salt, but the nonce is the whole IV */
+    memset(key, 0, sizeof(key));
+    memcpy(key, wrap_key, wrap_key_len);
+    status = srtp_cipher_init(*c, key);
+    octet_string_set_to_zero(key, sizeof(key));
+
+    if (status == srtp_err_status_ok) {
+        v128_set_to_zero(&iv);
+        memcpy(&iv, nonce, SRTP_SESSION_EXPORT_NONCE_LEN);
+        status = srtp_cipher_set_iv(*c, (uint8_t *)&iv, direction);
+    }
+    if (status == srtp_err_status_ok) {
+        status = srtp_cipher_set_aad(*c, aad, SRTP_EXPORT_HEADER_LEN);
+    }
+    if (status) {
+        srtp_cipher_dealloc(*c);
+        *c = NULL;
+        return srtp_err_status_cipher_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+#endif
+
+/*
+ * srtp_session_export_locked(session, ..., lock) is srtp_session_export(),
+ * which holds the lock of a thread safe session shared only if lock is
+ * true, for callers that hold it already
+ */
+static srtp_err_status_t srtp_session_export_locked(srtp_t session,
+                                                    const uint8_t *wrap_key,
+                                                    size_t wrap_key_len,
+                                                    const uint8_t *nonce,
+                                                    uint8_t *buf,
+                                                    size_t *len,
+                                                    bool lock)
+{
+    srtp_export_writer_t w;
+    struct srtp_export_stream_data cb_data;
+    size_t body_len, total_len;
+
+    if (session == NULL || len == NULL || !session->exportable) {
+        return srtp_err_status_bad_param;
+    }
+    if (wrap_key != NULL) {
+        if (nonce == NULL || (wrap_key_len != SRTP_AES_128_KEY_LEN &&
+                              wrap_key_len != SRTP_AES_256_KEY_LEN)) {
+            return srtp_err_status_bad_param;
+        }
+#ifndef GCM
+        return srtp_err_status_no_such_op;
+#endif
+    }
+
+    w.buf = buf;
+    w.capacity = buf != NULL ? *len : 0;
+    w.len = 0;
+
+    srtp_export_put(&w, srtp_export_magic, sizeof(srtp_export_magic));
+    srtp_export_put_uint(&w, SRTP_EXPORT_VERSION, 1);
+    srtp_export_put_uint(&w, wrap_key != NULL ? SRTP_EXPORT_WRAPPED : 0, 1);
+    srtp_export_put_uint(&w, 0, 2);
+    for (size_t i = 0; i < SRTP_SESSION_EXPORT_NONCE_LEN; i++) {
+        srtp_export_put_uint(&w, wrap_key != NULL ? nonce[i] : 0, 1);
+    }
+    srtp_export_put_uint(&w, 0, 4); /* the length of the body, set below */
+
+    cb_data.w = &w;
+    cb_data.thread_safe = session->thread_safe;
+    cb_data.status = srtp_err_status_ok;
+
+    /* the stream list does not change while it is held shared */
+    if (session->thread_safe && lock) {
+        srtp_rwlock_read_lock(&session->lock);
+    }
+
+    srtp_export_put_uint(&w, session->thread_safe ? SRTP_EXPORT_THREAD_SAFE : 0,
+                         1);
+    if (session->stream_template != NULL) {
+        if (session->template_policy == NULL) {
+            cb_data.status = srtp_err_status_bad_param;
+        } else {
+            srtp_export_put_uint(&w, 1, 1);
+            srtp_export_put_policy(&w, session->template_policy);
+            srtp_export_put_key_limits(&w, session->stream_template);
+        }
+    } else {
+        srtp_export_put_uint(&w, 0, 1);
+    }
+    if (cb_data.status == srtp_err_status_ok) {
+        srtp_stream_list_for_each(session->stream_list, srtp_export_stream_cb,
+                                  &cb_data);
+    }
+    srtp_export_put_uint(&w, 0, 1);
+
+    if (session->thread_safe && lock) {
+        srtp_rwlock_read_unlock(&session->lock);
+    }
+
+    body_len = w.len - SRTP_EXPORT_HEADER_LEN;
+    total_len = w.len + (wrap_key != NULL ? SRTP_EXPORT_TAG_LEN : 0);
+
+    /* what was written holds master keys */
+    if (cb_data.status || buf == NULL || total_len > *len) {
+        if (buf != NULL) {
+            octet_string_set_to_zero(buf, w.len < *len ? w.len : *len);
+        }
+        if (cb_data.status) {
+            return cb_data.status;
+        }
+        *len = total_len;
+        return srtp_err_status_buffer_small;
+    }
+
+    w.len = SRTP_EXPORT_HEADER_LEN - 4;
+    srtp_export_put_uint(&w, body_len, 4);
+
+#ifdef GCM
+    if (wrap_key != NULL) {
+        srtp_cipher_t *c;
+        size_t out_len = body_len + SRTP_EXPORT_TAG_LEN;
+        srtp_err_status_t status;
+
+        status = srtp_export_cipher(wrap_key, wrap_key_len, nonce,
+                                    srtp_direction_encrypt, buf, &c);
+        if (status == srtp_err_status_ok) {
+            status = srtp_cipher_encrypt(c, buf + SRTP_EXPORT_HEADER_LEN,
+                                         body_len,
+                                         buf + SRTP_EXPORT_HEADER_LEN,
+                                         &out_len);
+            srtp_cipher_dealloc(c);
+        }
+        if (status) {
+            octet_string_set_to_zero(buf, total_len);
+            return srtp_err_status_cipher_fail;
+        }
+    }
+#endif
+
+    *len = total_len;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_session_export(srtp_t session,
+                                      const uint8_t *wrap_key,
+                                      size_t wrap_key_len,
+                                      const uint8_t *nonce,
+                                      uint8_t *buf,
+                                      size_t *len)
+{
+    return srtp_session_export_locked(session, wrap_key, wrap_key_len, nonce,
+                                      buf, len, true);
+}
+
+/*
+ * srtp_import_stream(r, ctx, policy) adds the stream of the next record of
+ * r to ctx and restores its state, policy is scratch space
+ */
+static srtp_err_status_t srtp_import_stream(srtp_export_reader_t *r,
+                                            srtp_t ctx,
+                                            srtp_policy_t policy)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *stream;
+    uint32_t ssrc = (uint32_t)srtp_export_get_uint(r, 4);
+    uint8_t direction = (uint8_t)srtp_export_get_uint(r, 1);
+    uint8_t flags = (uint8_t)srtp_export_get_uint(r, 1);
+
+    if (!r->ok || direction > dir_srtp_receiver ||
+        srtp_get_stream(ctx, htonl(ssrc)) != NULL) {
+        return srtp_err_status_parse_err;
+    }
+
+    if (flags & SRTP_EXPORT_FROM_TEMPLATE) {
+        if (ctx->stream_template == NULL) {
+            return srtp_err_status_parse_err;
+        }
+        status = srtp_session_clone_stream(ctx, htonl(ssrc), &stream);
+        if (status) {
+            return status;
+        }
+        status = srtp_session_insert_clone(ctx, stream);
+    } else {
+        status = srtp_export_get_policy(r, policy);
+        if (status) {
+            return status;
+        }
+        if (policy->ssrc.type != ssrc_specific || policy->ssrc.value != ssrc) {
+            return srtp_err_status_parse_err;
+        }
+        status = srtp_stream_add_unlocked(ctx, policy);
+        stream = srtp_get_stream(ctx, htonl(ssrc));
+    }
+    if (status) {
+        return status;
+    }
+
+    stream->direction = direction;
+    stream->pending_roc = (uint32_t)srtp_export_get_uint(r, 4);
+    stream->rtp_rdbx.index = srtp_export_get_uint(r, 8);
+    status = srtp_export_get_rdbx_window(r, &stream->rtp_rdbx);
+    if (status) {
+        return status;
+    }
+
+    if (flags & SRTP_EXPORT_HAS_RTCP_RDB) {
+        srtp_rdb_t *rtcp_rdb = srtp_stream_rtcp_rdb(stream);
+
+        if (rtcp_rdb == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+        rtcp_rdb->window_start = (uint32_t)srtp_export_get_uint(r, 4);
+        status = srtp_export_get_window(r, &rtcp_rdb->window,
+                                        rtcp_rdb->bitmask);
+        if (status) {
+            return status;
+        }
+    }
+
+    status = srtp_export_get_key_limits(r, stream);
+    if (status) {
+        return status;
+    }
+
+    srtp_export_get_stats(r, &stream->stats);
+
+    return r->ok ? srtp_err_status_ok : srtp_err_status_parse_err;
+}
+
+/*
+ * srtp_import_session(r, session, node) creates a session on NUMA node
+ * from the body of an export
+ */
+static srtp_err_status_t srtp_import_session(srtp_export_reader_t *r,
+                                             srtp_t *session,
+                                             int node)
+{
+    srtp_err_status_t status;
+    srtp_policy_t policy;
+    srtp_t ctx;
+
+    status = srtp_policy_create(&policy);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_create_on_node(&ctx, NULL, node);
+    if (status) {
+        srtp_policy_destroy(policy);
+        return status;
+    }
+    ctx->exportable = true;
+
+    if (srtp_export_get_uint(r, 1) & SRTP_EXPORT_THREAD_SAFE) {
+        status = srtp_set_thread_safe(ctx, true);
+    }
+
+    if (status == srtp_err_status_ok && srtp_export_get_uint(r, 1) != 0) {
+        status = srtp_export_get_policy(r, policy);
+        if (status == srtp_err_status_ok &&
+            policy->ssrc.type != ssrc_any_inbound &&
+            policy->ssrc.type != ssrc_any_outbound) {
+            status = srtp_err_status_parse_err;
+        }
+        if (status == srtp_err_status_ok) {
+            status = srtp_stream_add_unlocked(ctx, policy);
+        }
+        if (status == srtp_err_status_ok) {
+            status = srtp_export_get_key_limits(r, ctx->stream_template);
+        }
+    }
+
+    while (status == srtp_err_status_ok) {
+        uint64_t record = srtp_export_get_uint(r, 1);
+
+        if (!r->ok) {
+            status = srtp_err_status_parse_err;
+        } else if (record == 0) {
+            break;
+        } else {
+            status = srtp_import_stream(r, ctx, policy);
+        }
+    }
+
+    if (status == srtp_err_status_ok && (!r->ok || r->pos != r->len)) {
+        status = srtp_err_status_parse_err;
+    }
+
+    srtp_policy_destroy(policy);
+    if (status) {
+        srtp_dealloc(ctx);
+        return status;
+    }
+
+    *session = ctx;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_session_import(srtp_t *session,
+                                      const uint8_t *buf,
+                                      size_t len,
+                                      const uint8_t *wrap_key,
+                                      size_t wrap_key_len)
+{
+    srtp_export_reader_t r;
+    srtp_err_status_t status;
+    uint8_t *body = NULL;
+    size_t body_len;
+    bool wrapped;
+
+    if (session == NULL || buf == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    *session = NULL;
+
+    r.buf = buf;
+    r.len = len;
+    r.pos = 0;
+    r.ok = true;
+
+    if (len < SRTP_EXPORT_HEADER_LEN ||
+        memcmp(buf, srtp_export_magic, sizeof(srtp_export_magic)) != 0 ||
+        buf[4] != SRTP_EXPORT_VERSION) {
+        return srtp_err_status_parse_err;
+    }
+    wrapped = (buf[5] & SRTP_EXPORT_WRAPPED) != 0;
+    r.pos = SRTP_EXPORT_HEADER_LEN - 4;
+    body_len = (size_t)srtp_export_get_uint(&r, 4);
+
+    if (wrapped != (wrap_key != NULL)) {
+        return srtp_err_status_bad_param;
+    }
+    if (body_len == 0 || len - SRTP_EXPORT_HEADER_LEN !=
+                             body_len + (wrapped ? SRTP_EXPORT_TAG_LEN : 0)) {
+        return srtp_err_status_parse_err;
+    }
+
+    if (wrapped) {
+#ifdef GCM
+        srtp_cipher_t *c;
+        size_t out_len = body_len;
+
+        body = (uint8_t *)srtp_crypto_alloc(body_len);
+        if (body == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+
+        status = srtp_export_cipher(wrap_key, wrap_key_len,
+                                    buf + SRTP_EXPORT_HEADER_LEN -
+                                        4 - SRTP_SESSION_EXPORT_NONCE_LEN,
+                                    srtp_direction_decrypt, buf, &c);
+        if (status == srtp_err_status_ok) {
+            status = srtp_cipher_decrypt(c, buf + SRTP_EXPORT_HEADER_LEN,
+                                         len - SRTP_EXPORT_HEADER_LEN, body,
+                                         &out_len);
+            srtp_cipher_dealloc(c);
+        }
+        if (status) {
+            octet_string_set_to_zero(body, body_len);
+            srtp_crypto_free(body);
+            return status;
+        }
+        r.buf = body;
+        r.len = body_len;
+        r.pos = 0;
+#else
+        (void)wrap_key_len;
+        return srtp_err_status_no_such_op;
+#endif
+    }
+
+    status = srtp_import_session(&r, session, SRTP_NUMA_NODE_ANY);
+
+    if (body != NULL) {
+        octet_string_set_to_zero(body, body_len);
+        srtp_crypto_free(body);
+    }
+
+    return status;
+}
+
+srtp_err_status_t srtp_session_copy_locked(srtp_t session,
+                                           int node,
+                                           srtp_t *copy)
+{
+    srtp_err_status_t status;
+    srtp_export_reader_t r;
+    uint8_t *buf;
+    size_t len = 0;
+    int previous;
+
+    status = srtp_session_export_locked(session, NULL, 0, NULL, NULL, &len,
+                                        false);
+    if (status != srtp_err_status_buffer_small) {
+        return status ? status : srtp_err_status_fail;
+    }
+
+    buf = (uint8_t *)srtp_crypto_alloc(len);
+    if (buf == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    status = srtp_session_export_locked(session, NULL, 0, NULL, buf, &len,
+                                        false);
+    if (status == srtp_err_status_ok) {
+        r.buf = buf;
+        r.len = len;
+        r.pos = SRTP_EXPORT_HEADER_LEN;
+        r.ok = true;
+
+        previous = srtp_crypto_alloc_set_node(node);
+        status = srtp_import_session(&r, copy, node);
+        srtp_crypto_alloc_set_node(previous);
+    }
+
+    /* the export holds the master keys in the clear */
+    octet_string_set_to_zero(buf, len);
+    srtp_crypto_free(buf);
+
+    return status;
+}
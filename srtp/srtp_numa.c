@@ -0,0 +1,167 @@
+/*
+ * srtp_numa.c
+ *
+ * NUMA migration of sessions for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "srtp_priv.h"
+#include "stream_list_priv.h"
+
+#include "alloc.h"
+
+/*
+ * srtp_session_swap_streams(a, b) exchanges the streams of sessions a and
+ * b, with everything that refers to them
+ */
+static void srtp_session_swap_streams(srtp_t a, srtp_t b)
+{
+    srtp_ctx_t tmp;
+
+    tmp.stream_list = a->stream_list;
+    tmp.stream_template = a->stream_template;
+    tmp.stream_pool = a->stream_pool;
+    tmp.template_policy = a->template_policy;
+    tmp.key_cache = a->key_cache;
+    tmp.previous_template = a->previous_template;
+    tmp.trailer_cache = a->trailer_cache;
+    tmp.epoch = a->epoch;
+    tmp.num_clones = a->num_clones;
+    tmp.max_clones = a->max_clones;
+    tmp.clone_idle_timeout = a->clone_idle_timeout;
+
+    a->stream_list = b->stream_list;
+    a->stream_template = b->stream_template;
+    a->stream_pool = b->stream_pool;
+    a->template_policy = b->template_policy;
+    a->key_cache = b->key_cache;
+    a->previous_template = b->previous_template;
+    a->trailer_cache = b->trailer_cache;
+    a->epoch = b->epoch;
+    a->num_clones = b->num_clones;
+    a->max_clones = b->max_clones;
+    a->clone_idle_timeout = b->clone_idle_timeout;
+
+    b->stream_list = tmp.stream_list;
+    b->stream_template = tmp.stream_template;
+    b->stream_pool = tmp.stream_pool;
+    b->template_policy = tmp.template_policy;
+    b->key_cache = tmp.key_cache;
+    b->previous_template = tmp.previous_template;
+    b->trailer_cache = tmp.trailer_cache;
+    b->epoch = tmp.epoch;
+    b->num_clones = tmp.num_clones;
+    b->max_clones = tmp.max_clones;
+    b->clone_idle_timeout = tmp.clone_idle_timeout;
+
+    /* the stream handles of neither session refer to its streams anymore */
+    a->stream_generation++;
+    b->stream_generation++;
+}
+
+/*
+ * srtp_session_migrate_unlocked(session, node) rebuilds the streams of
+ * session on node, with the lock of a thread safe session held
+ * exclusively
+ */
+static srtp_err_status_t srtp_session_migrate_unlocked(srtp_t session,
+                                                       int node)
+{
+    srtp_err_status_t status;
+    srtp_t moved = NULL;
+
+    status = srtp_session_copy_locked(session, node, &moved);
+    if (status) {
+        return status;
+    }
+
+    /* the old streams leave with the session that was imported */
+    srtp_session_swap_streams(session, moved);
+    session->numa_node = node;
+
+    return srtp_dealloc(moved);
+}
+
+static bool srtp_stream_found_cb(srtp_stream_t stream, void *raw_data)
+{
+    (void)stream;
+    *(bool *)raw_data = true;
+    return false;
+}
+
+srtp_err_status_t srtp_session_migrate(srtp_t session, int node)
+{
+    srtp_err_status_t status;
+    bool has_streams;
+    int previous;
+
+    if (session == NULL || node < SRTP_NUMA_NODE_ANY) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (session->batch_head != NULL) {
+        return srtp_err_status_in_progress;
+    }
+
+    if (session->thread_safe) {
+        srtp_rwlock_write_lock(&session->lock);
+    }
+
+    has_streams = session->stream_template != NULL;
+    srtp_stream_list_for_each(session->stream_list, srtp_stream_found_cb,
+                              &has_streams);
+
+    if (has_streams) {
+        status = session->exportable
+                     ? srtp_session_migrate_unlocked(session, node)
+                     : srtp_err_status_bad_param;
+    } else {
+        /* without streams only the index has to move */
+        srtp_stream_list_t list;
+
+        previous = srtp_crypto_alloc_set_node(node);
+        status = srtp_stream_list_alloc(&list);
+        srtp_crypto_alloc_set_node(previous);
+        if (status == srtp_err_status_ok) {
+            srtp_stream_list_dealloc(session->stream_list);
+            session->stream_list = list;
+            session->numa_node = node;
+        }
+    }
+
+    if (session->thread_safe) {
+        srtp_rwlock_write_unlock(&session->lock);
+    }
+
+    return status;
+}
@@ -0,0 +1,264 @@
+/*
+ * srtp_offload.c
+ *
+ * asynchronous batches and crypto offload for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "srtp_priv.h"
+
+#include "alloc.h"
+
+srtp_err_status_t srtp_session_set_offload(srtp_t session,
+                                           const srtp_offload_engine_t *engine,
+                                           void *engine_data)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    if (session == NULL || (engine != NULL && engine->submit == NULL)) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_spinlock_lock(&session->batch_lock);
+    if (session->batch_head != NULL) {
+        status = srtp_err_status_in_progress;
+    } else {
+        session->offload = engine;
+        session->offload_data = engine_data;
+    }
+    srtp_spinlock_unlock(&session->batch_lock);
+
+    return status;
+}
+
+static srtp_err_status_t srtp_batch_process(srtp_batch_ctx_t *batch)
+{
+    switch (batch->op) {
+    case srtp_batch_protect:
+        return srtp_protect_batch(batch->session, batch->pkts,
+                                  batch->num_pkts);
+    case srtp_batch_unprotect:
+        return srtp_unprotect_batch(batch->session, batch->pkts,
+                                    batch->num_pkts);
+    case srtp_batch_protect_rtcp:
+        return srtp_protect_rtcp_batch(batch->session, batch->pkts,
+                                       batch->num_pkts);
+    case srtp_batch_unprotect_rtcp:
+        return srtp_unprotect_rtcp_batch(batch->session, batch->pkts,
+                                         batch->num_pkts);
+    }
+    return srtp_err_status_bad_param;
+}
+
+srtp_err_status_t srtp_batch_submit(srtp_t ctx,
+                                    srtp_batch_op_t op,
+                                    srtp_packet_desc_t *pkts,
+                                    size_t num_pkts,
+                                    srtp_batch_done_func_t done,
+                                    void *user_data,
+                                    srtp_batch_t *batch)
+{
+    srtp_batch_ctx_t *b;
+    srtp_batch_ctx_t *prev;
+    const srtp_offload_engine_t *engine;
+    void *engine_data;
+    srtp_err_status_t status;
+
+    if (ctx == NULL || batch == NULL || (pkts == NULL && num_pkts != 0) ||
+        op > srtp_batch_unprotect_rtcp) {
+        return srtp_err_status_bad_param;
+    }
+
+    b = (srtp_batch_ctx_t *)srtp_crypto_alloc(sizeof(srtp_batch_ctx_t));
+    if (b == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    b->session = ctx;
+    b->op = op;
+    b->pkts = pkts;
+    b->num_pkts = num_pkts;
+    b->done = done;
+    b->user_data = user_data;
+    b->status = srtp_err_status_in_progress;
+
+    /*
+     * queue the batch before handing it to the engine, which may run it
+     * right away
+     */
+    srtp_spinlock_lock(&ctx->batch_lock);
+    engine = ctx->offload;
+    engine_data = ctx->offload_data;
+    prev = ctx->batch_tail;
+    if (prev != NULL) {
+        prev->next = b;
+    } else {
+        ctx->batch_head = b;
+    }
+    ctx->batch_tail = b;
+    srtp_spinlock_unlock(&ctx->batch_lock);
+
+    *batch = b;
+
+    if (engine == NULL) {
+        return srtp_batch_run(b);
+    }
+
+    status = engine->submit(engine_data, b);
+    if (status) {
+        /*
+         * a refused batch can only be run by the submitter, so it is still
+         * the tail and no later batch depends on it
+         */
+        srtp_spinlock_lock(&ctx->batch_lock);
+        if (prev != NULL) {
+            prev->next = NULL;
+        } else {
+            ctx->batch_head = NULL;
+        }
+        ctx->batch_tail = prev;
+        srtp_spinlock_unlock(&ctx->batch_lock);
+        srtp_crypto_free(b);
+        *batch = NULL;
+        return status;
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_batch_run(srtp_batch_t batch)
+{
+    srtp_ctx_t *session;
+
+    if (batch == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    session = batch->session;
+
+    /*
+     * the first caller to find the head of the queue ready processes it
+     * and every ready batch after it, so the streams see the batches in
+     * the order they were submitted; callers meanwhile, including the done
+     * functions of the batches being processed, only mark their batch
+     */
+    srtp_spinlock_lock(&session->batch_lock);
+    if (batch->ready) {
+        srtp_spinlock_unlock(&session->batch_lock);
+        return srtp_err_status_bad_param;
+    }
+    batch->ready = true;
+
+    if (session->batch_running) {
+        srtp_spinlock_unlock(&session->batch_lock);
+        return srtp_err_status_ok;
+    }
+    session->batch_running = true;
+
+    while (session->batch_head != NULL && session->batch_head->ready) {
+        srtp_batch_ctx_t *b = session->batch_head;
+        srtp_err_status_t status;
+
+        session->batch_head = b->next;
+        if (session->batch_head == NULL) {
+            session->batch_tail = NULL;
+        }
+        srtp_spinlock_unlock(&session->batch_lock);
+
+        status = srtp_batch_process(b);
+
+        srtp_spinlock_lock(&session->batch_lock);
+        b->status = status;
+        srtp_spinlock_unlock(&session->batch_lock);
+
+        /* b may be deallocated from here on */
+        if (b->done != NULL) {
+            b->done(b, b->user_data);
+        }
+
+        srtp_spinlock_lock(&session->batch_lock);
+    }
+    session->batch_running = false;
+    srtp_spinlock_unlock(&session->batch_lock);
+
+    return srtp_err_status_ok;
+}
+
+size_t srtp_session_poll(srtp_t session)
+{
+    const srtp_offload_engine_t *engine;
+    void *engine_data;
+
+    if (session == NULL) {
+        return 0;
+    }
+
+    srtp_spinlock_lock(&session->batch_lock);
+    engine = session->offload;
+    engine_data = session->offload_data;
+    srtp_spinlock_unlock(&session->batch_lock);
+
+    if (engine == NULL || engine->poll == NULL) {
+        return 0;
+    }
+
+    return engine->poll(engine_data);
+}
+
+srtp_err_status_t srtp_batch_get_status(srtp_batch_t batch)
+{
+    srtp_err_status_t status;
+
+    if (batch == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_spinlock_lock(&batch->session->batch_lock);
+    status = batch->status;
+    srtp_spinlock_unlock(&batch->session->batch_lock);
+
+    return status;
+}
+
+srtp_err_status_t srtp_batch_dealloc(srtp_batch_t batch)
+{
+    if (batch == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (srtp_batch_get_status(batch) == srtp_err_status_in_progress) {
+        return srtp_err_status_in_progress;
+    }
+
+    srtp_crypto_free(batch);
+
+    return srtp_err_status_ok;
+}
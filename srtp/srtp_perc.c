@@ -0,0 +1,355 @@
+/*
+ * srtp_perc.c
+ *
+ * PERC double encryption (RFC 8723) for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "srtp_priv.h"
+
+#include <string.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#elif defined(HAVE_WINSOCK2_H)
+#include <winsock2.h>
+#endif
+
+/*
+ * PERC double encryption (RFC 8723)
+ *
+ * The inner, end-to-end transform protects a synthetic packet made of the
+ * RTP header without its extension and the payload. The outer, hop-by-hop
+ * transform protects the whole packet, whose payload is the inner SRTP
+ * payload and tag followed by the Original Header Block:
+ *
+ *   [ PT (if P) ][ SEQ (if Q) ][ config: R R R R B M P Q ]
+ *
+ * which records the header fields a media distributor changed, so that
+ * the receiver can rebuild the synthetic packet the sender protected. The
+ * synthetic packet is built in place, by moving the base header over the
+ * end of the header extension and putting back what it covered afterwards.
+ */
+#define SRTP_OHB_SEQ 0x01
+#define SRTP_OHB_PT 0x02
+#define SRTP_OHB_M 0x04
+#define SRTP_OHB_B 0x08
+#define SRTP_OHB_RESERVED 0xf0
+
+#define SRTP_MAX_RTP_BASE_HDR_LEN (12 + 15 * 4)
+
+typedef struct {
+    uint8_t config;
+    uint8_t pt;
+    uint16_t seq;
+    size_t len;
+} srtp_ohb_t;
+
+/*
+ * srtp_ohb_parse(pkt, len, hdr_len, ohb) reads the OHB at the end of the
+ * packet pkt, whose header and header extension take hdr_len octets
+ */
+static srtp_err_status_t srtp_ohb_parse(const uint8_t *pkt,
+                                        size_t len,
+                                        size_t hdr_len,
+                                        srtp_ohb_t *ohb)
+{
+    const uint8_t *p;
+
+    ohb->pt = 0;
+    ohb->seq = 0;
+    if (len <= hdr_len) {
+        return srtp_err_status_parse_err;
+    }
+    ohb->config = pkt[len - 1];
+    if (ohb->config & SRTP_OHB_RESERVED) {
+        return srtp_err_status_parse_err;
+    }
+    ohb->len = 1;
+    if (ohb->config & SRTP_OHB_PT) {
+        ohb->len += 1;
+    }
+    if (ohb->config & SRTP_OHB_SEQ) {
+        ohb->len += 2;
+    }
+    if (len - hdr_len < ohb->len) {
+        return srtp_err_status_parse_err;
+    }
+
+    p = pkt + len - ohb->len;
+    if (ohb->config & SRTP_OHB_PT) {
+        if (*p & 0x80) {
+            return srtp_err_status_parse_err;
+        }
+        ohb->pt = *p++;
+    }
+    if (ohb->config & SRTP_OHB_SEQ) {
+        ohb->seq = (uint16_t)((p[0] << 8) | p[1]);
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_ohb_write(p, ohb) writes the OHB to p and returns its length
+ */
+static size_t srtp_ohb_write(uint8_t *p, const srtp_ohb_t *ohb)
+{
+    size_t len = 0;
+
+    if (ohb->config & SRTP_OHB_PT) {
+        p[len++] = ohb->pt;
+    }
+    if (ohb->config & SRTP_OHB_SEQ) {
+        p[len++] = (uint8_t)(ohb->seq >> 8);
+        p[len++] = (uint8_t)ohb->seq;
+    }
+    p[len++] = ohb->config;
+
+    return len;
+}
+
+srtp_err_status_t srtp_protect_double(srtp_t inner,
+                                      srtp_t outer,
+                                      const uint8_t *rtp,
+                                      size_t rtp_len,
+                                      uint8_t *srtp,
+                                      size_t *srtp_len,
+                                      size_t mki_index)
+{
+    srtp_err_status_t status;
+    srtp_rtp_header_desc_t desc;
+    uint8_t saved[SRTP_MAX_RTP_BASE_HDR_LEN];
+    uint8_t *synth;
+    size_t base_len, xtn_len, inner_len;
+
+    if (inner == NULL || outer == NULL || rtp == NULL || srtp == NULL ||
+        srtp_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    status = srtp_rtp_header_parse(rtp, rtp_len, &desc);
+    if (status) {
+        return status;
+    }
+    if (*srtp_len <= rtp_len) {
+        return srtp_err_status_buffer_small;
+    }
+    if (srtp != rtp) {
+        memmove(srtp, rtp, rtp_len);
+    }
+
+    xtn_len = desc.xtn_len;
+    base_len = desc.header_len - xtn_len;
+
+    /* the synthetic packet ends where the RTP packet does */
+    synth = srtp + xtn_len;
+    memcpy(saved, synth, base_len);
+    memmove(synth, srtp, base_len);
+    ((srtp_hdr_t *)synth)->x = 0;
+
+    /* a byte is kept for the OHB */
+    inner_len = *srtp_len - xtn_len - 1;
+    status = srtp_protect(inner, synth, rtp_len - xtn_len, synth, &inner_len,
+                          mki_index);
+    memcpy(synth, saved, base_len);
+    if (status) {
+        return status;
+    }
+
+    /* an empty OHB, no distributor has changed the header yet */
+    srtp[xtn_len + inner_len] = 0;
+
+    return srtp_protect(outer, srtp, xtn_len + inner_len + 1, srtp, srtp_len,
+                        mki_index);
+}
+
+srtp_err_status_t srtp_unprotect_double(srtp_t inner,
+                                        srtp_t outer,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        uint8_t *rtp,
+                                        size_t *rtp_len)
+{
+    srtp_err_status_t status;
+    srtp_rtp_header_desc_t desc;
+    uint8_t saved[SRTP_MAX_RTP_BASE_HDR_LEN];
+    srtp_ohb_t ohb;
+    srtp_hdr_t *hdr;
+    uint8_t *synth;
+    size_t len, base_len, xtn_len, inner_len;
+
+    if (inner == NULL || outer == NULL || srtp == NULL || rtp == NULL ||
+        rtp_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    len = *rtp_len;
+    status = srtp_unprotect(outer, srtp, srtp_len, rtp, &len);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_rtp_header_parse(rtp, len, &desc);
+    if (status) {
+        return status;
+    }
+    xtn_len = desc.xtn_len;
+    base_len = desc.header_len - xtn_len;
+    status = srtp_ohb_parse(rtp, len, desc.header_len, &ohb);
+    if (status) {
+        return status;
+    }
+
+    /* rebuild the header the sender protected end-to-end */
+    synth = rtp + xtn_len;
+    memcpy(saved, synth, base_len);
+    memmove(synth, rtp, base_len);
+    hdr = (srtp_hdr_t *)synth;
+    hdr->x = 0;
+    if (ohb.config & SRTP_OHB_PT) {
+        hdr->pt = ohb.pt;
+    }
+    if (ohb.config & SRTP_OHB_SEQ) {
+        hdr->seq = htons(ohb.seq);
+    }
+    if (ohb.config & SRTP_OHB_B) {
+        hdr->m = (ohb.config & SRTP_OHB_M) ? 1 : 0;
+    }
+
+    inner_len = len - xtn_len - ohb.len;
+    status = srtp_unprotect(inner, synth, inner_len, synth, &inner_len);
+    memcpy(synth, saved, base_len);
+    if (status) {
+        return status;
+    }
+
+    *rtp_len = xtn_len + inner_len;
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_unprotect_hop(srtp_t outer,
+                                     const uint8_t *srtp,
+                                     size_t srtp_len,
+                                     uint8_t *rtp,
+                                     size_t *rtp_len)
+{
+    srtp_err_status_t status;
+    srtp_rtp_header_desc_t desc;
+    srtp_ohb_t ohb;
+
+    if (outer == NULL || srtp == NULL || rtp == NULL || rtp_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_unprotect(outer, srtp, srtp_len, rtp, rtp_len);
+    if (status) {
+        return status;
+    }
+    status = srtp_rtp_header_parse(rtp, *rtp_len, &desc);
+    if (status) {
+        return status;
+    }
+
+    return srtp_ohb_parse(rtp, *rtp_len, desc.header_len, &ohb);
+}
+
+srtp_err_status_t srtp_protect_hop(srtp_t outer,
+                                   const uint8_t *rtp,
+                                   size_t rtp_len,
+                                   uint8_t *srtp,
+                                   size_t *srtp_len,
+                                   size_t mki_index,
+                                   const srtp_hop_header_t *changes)
+{
+    srtp_err_status_t status;
+    srtp_rtp_header_desc_t desc;
+    srtp_ohb_t ohb;
+    srtp_hdr_t *hdr;
+    uint8_t ohb_buf[4];
+    size_t body_len, ohb_len;
+
+    if (outer == NULL || rtp == NULL || srtp == NULL || srtp_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    status = srtp_rtp_header_parse(rtp, rtp_len, &desc);
+    if (status) {
+        return status;
+    }
+    status = srtp_ohb_parse(rtp, rtp_len, desc.header_len, &ohb);
+    if (status) {
+        return status;
+    }
+    if (*srtp_len < rtp_len) {
+        return srtp_err_status_buffer_small;
+    }
+    if (srtp != rtp) {
+        memmove(srtp, rtp, rtp_len);
+    }
+
+    /* the first distributor to change a field records its original value */
+    hdr = (srtp_hdr_t *)srtp;
+    if (changes != NULL) {
+        if (changes->set_pt && hdr->pt != (changes->pt & 0x7f)) {
+            if (!(ohb.config & SRTP_OHB_PT)) {
+                ohb.config |= SRTP_OHB_PT;
+                ohb.pt = hdr->pt;
+            }
+            hdr->pt = changes->pt & 0x7f;
+        }
+        if (changes->set_seq && ntohs(hdr->seq) != changes->seq) {
+            if (!(ohb.config & SRTP_OHB_SEQ)) {
+                ohb.config |= SRTP_OHB_SEQ;
+                ohb.seq = ntohs(hdr->seq);
+            }
+            hdr->seq = htons(changes->seq);
+        }
+        if (changes->set_marker && hdr->m != (changes->marker ? 1 : 0)) {
+            if (!(ohb.config & SRTP_OHB_B)) {
+                ohb.config |= SRTP_OHB_B;
+                if (hdr->m) {
+                    ohb.config |= SRTP_OHB_M;
+                }
+            }
+            hdr->m = changes->marker ? 1 : 0;
+        }
+    }
+
+    body_len = rtp_len - ohb.len;
+    ohb_len = srtp_ohb_write(ohb_buf, &ohb);
+    if (*srtp_len < body_len + ohb_len) {
+        return srtp_err_status_buffer_small;
+    }
+    memcpy(srtp + body_len, ohb_buf, ohb_len);
+
+    return srtp_protect(outer, srtp, body_len + ohb_len, srtp, srtp_len,
+                        mki_index);
+}
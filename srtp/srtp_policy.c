@@ -703,18 +703,30 @@ srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtp(
     case srtp_profile_aes128_cm_sha1_32:
         srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(policy);
         return srtp_err_status_ok;
+#ifndef SRTP_NO_AES_192
     case srtp_profile_aes192_cm_sha1_80:
         srtp_crypto_policy_set_aes_cm_192_hmac_sha1_80(policy);
         return srtp_err_status_ok;
     case srtp_profile_aes192_cm_sha1_32:
         srtp_crypto_policy_set_aes_cm_192_hmac_sha1_32(policy);
         return srtp_err_status_ok;
+#else
+    case srtp_profile_aes192_cm_sha1_80:
+    case srtp_profile_aes192_cm_sha1_32:
+        return srtp_err_status_bad_param;
+#endif
+#ifndef SRTP_NO_AES_256
     case srtp_profile_aes256_cm_sha1_80:
         srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80(policy);
         return srtp_err_status_ok;
     case srtp_profile_aes256_cm_sha1_32:
         srtp_crypto_policy_set_aes_cm_256_hmac_sha1_32(policy);
         return srtp_err_status_ok;
+#else
+    case srtp_profile_aes256_cm_sha1_80:
+    case srtp_profile_aes256_cm_sha1_32:
+        return srtp_err_status_bad_param;
+#endif
     case srtp_profile_null_sha1_80:
         srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
         return srtp_err_status_ok;
@@ -722,9 +734,14 @@ srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtp(
     case srtp_profile_aead_aes_128_gcm:
         srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
         return srtp_err_status_ok;
+#ifndef SRTP_NO_AES_256
     case srtp_profile_aead_aes_256_gcm:
         srtp_crypto_policy_set_aes_gcm_256_16_auth(policy);
         return srtp_err_status_ok;
+#else
+    case srtp_profile_aead_aes_256_gcm:
+        return srtp_err_status_bad_param;
+#endif
 #else
     case srtp_profile_aead_aes_128_gcm:
         return srtp_err_status_bad_param;
@@ -759,6 +776,7 @@ srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtcp(
          * this is not compliant with RFC 3711 */
         srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
         return srtp_err_status_ok;
+#ifndef SRTP_NO_AES_192
     case srtp_profile_aes192_cm_sha1_80:
         srtp_crypto_policy_set_aes_cm_192_hmac_sha1_80(policy);
         return srtp_err_status_ok;
@@ -767,6 +785,12 @@ srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtcp(
          * this is not compliant with RFC 3711 */
         srtp_crypto_policy_set_aes_cm_192_hmac_sha1_80(policy);
         return srtp_err_status_ok;
+#else
+    case srtp_profile_aes192_cm_sha1_80:
+    case srtp_profile_aes192_cm_sha1_32:
+        return srtp_err_status_bad_param;
+#endif
+#ifndef SRTP_NO_AES_256
     case srtp_profile_aes256_cm_sha1_80:
         srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80(policy);
         return srtp_err_status_ok;
@@ -775,6 +799,11 @@ srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtcp(
          * this is not compliant with RFC 6188 */
         srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80(policy);
         return srtp_err_status_ok;
+#else
+    case srtp_profile_aes256_cm_sha1_80:
+    case srtp_profile_aes256_cm_sha1_32:
+        return srtp_err_status_bad_param;
+#endif
     case srtp_profile_null_sha1_80:
         srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
         return srtp_err_status_ok;
@@ -782,9 +811,14 @@ srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtcp(
     case srtp_profile_aead_aes_128_gcm:
         srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
         return srtp_err_status_ok;
+#ifndef SRTP_NO_AES_256
     case srtp_profile_aead_aes_256_gcm:
         srtp_crypto_policy_set_aes_gcm_256_16_auth(policy);
         return srtp_err_status_ok;
+#else
+    case srtp_profile_aead_aes_256_gcm:
+        return srtp_err_status_bad_param;
+#endif
 #else
     case srtp_profile_aead_aes_128_gcm:
         return srtp_err_status_bad_param;
@@ -834,19 +868,42 @@ srtp_err_status_t srtp_policy_clone(srtp_policy_t policy,
     }
 
     memcpy(p, policy, sizeof(*p));
+    if (p->key_set != NULL) {
+        srtp_refcount_acquire(&p->key_set->refs);
+    }
 
     *cloned_policy = p;
 
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_policy_release_keys(policy) drops the reference policy holds to
+ * its master keys, they are zeroized when it was the last one
+ */
+static void srtp_policy_release_keys(srtp_policy_t policy)
+{
+    srtp_master_key_set_t *key_set = policy->key_set;
+
+    if (key_set != NULL && srtp_refcount_release(&key_set->refs)) {
+        octet_string_set_to_zero(policy->master_keys,
+                                 sizeof(srtp_master_key_t) *
+                                     key_set->capacity);
+        srtp_crypto_free(key_set);
+    }
+
+    policy->key_set = NULL;
+    policy->master_keys = NULL;
+    policy->num_master_keys = 0;
+}
+
 void srtp_policy_destroy(srtp_policy_t policy)
 {
     if (policy == NULL) {
         return;
     }
 
-    octet_string_set_to_zero(policy->master_keys, sizeof(policy->master_keys));
+    srtp_policy_release_keys(policy);
     srtp_crypto_free(policy);
 }
 
@@ -917,6 +974,10 @@ srtp_err_status_t srtp_policy_validate(srtp_policy_t policy)
         return srtp_err_status_bad_param;
     }
 
+    if (!srtp_policy_is_valid_rtcp_window_size(policy->rtcp_window_size)) {
+        return srtp_err_status_bad_param;
+    }
+
     // Not a valid combination
     if (policy->enc_xtn_hdr_count > 0 && policy->use_cryptex) {
         return srtp_err_status_bad_param;
@@ -1061,20 +1122,71 @@ srtp_err_status_t srtp_policy_add_key(srtp_policy_t policy,
         return srtp_err_status_bad_param;
     }
 
-    if (policy->num_master_keys >= SRTP_MAX_NUM_MASTER_KEYS) {
+    srtp_master_key_t master_key;
+    srtp_err_status_t status;
+
+    memcpy(master_key.key, key, key_len);
+    master_key.key_len = key_len;
+    memcpy(master_key.key + key_len, salt, salt_len);
+    master_key.salt_len = salt_len;
+    if (mki_len > 0) {
+        memcpy(master_key.mki_id, mki, mki_len);
+    }
+    master_key.mki_id_len = mki_len;
+
+    status = srtp_policy_append_key(policy, &master_key);
+    octet_string_set_to_zero(&master_key, sizeof(master_key));
+
+    return status;
+}
+
+srtp_err_status_t srtp_policy_append_key(srtp_policy_t policy,
+                                         const srtp_master_key_t *key)
+{
+    srtp_master_key_set_t *key_set = policy->key_set;
+    size_t num_keys = policy->num_master_keys;
+
+    if (num_keys >= SRTP_MAX_NUM_MASTER_KEYS) {
         return srtp_err_status_bad_param;
     }
 
-    size_t key_index = policy->num_master_keys;
-    memcpy(policy->master_keys[key_index].key, key, key_len);
-    policy->master_keys[key_index].key_len = key_len;
-    memcpy(policy->master_keys[key_index].key + key_len, salt, salt_len);
-    policy->master_keys[key_index].salt_len = salt_len;
-    if (mki_len > 0) {
-        memcpy(policy->master_keys[key_index].mki_id, mki, mki_len);
+    /*
+     * the keys are copied into a set of their own when they are shared
+     * with a clone or the set is full; a set holds just the first key
+     * until a second one is added, then grows by doubling
+     */
+    if (key_set == NULL || key_set->capacity == num_keys ||
+        srtp_refcount_get(&key_set->refs) != 1) {
+        size_t capacity = 1;
+        srtp_master_key_set_t *new_set;
+
+        while (capacity <= num_keys) {
+            capacity *= 2;
+        }
+        if (capacity > SRTP_MAX_NUM_MASTER_KEYS) {
+            capacity = SRTP_MAX_NUM_MASTER_KEYS;
+        }
+
+        new_set = (srtp_master_key_set_t *)srtp_crypto_alloc(
+            sizeof(srtp_master_key_set_t) +
+            capacity * sizeof(srtp_master_key_t));
+        if (new_set == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+        new_set->refs.count = 1;
+        new_set->capacity = capacity;
+        if (num_keys > 0) {
+            memcpy(new_set + 1, policy->master_keys,
+                   num_keys * sizeof(srtp_master_key_t));
+        }
+
+        srtp_policy_release_keys(policy);
+        policy->key_set = new_set;
+        policy->master_keys = (srtp_master_key_t *)(new_set + 1);
     }
-    policy->master_keys[key_index].mki_id_len = mki_len;
-    policy->num_master_keys++;
+
+    policy->master_keys[num_keys] = *key;
+    policy->num_master_keys = num_keys + 1;
 
     return srtp_err_status_ok;
 }
@@ -1085,8 +1197,7 @@ srtp_err_status_t srtp_policy_remove_keys(srtp_policy_t policy)
         return srtp_err_status_bad_param;
     }
 
-    octet_string_set_to_zero(policy->master_keys, sizeof(policy->master_keys));
-    policy->num_master_keys = 0;
+    srtp_policy_release_keys(policy);
 
     return srtp_err_status_ok;
 }
@@ -1107,6 +1218,34 @@ srtp_err_status_t srtp_policy_set_window_size(srtp_policy_t policy,
     return srtp_err_status_ok;
 }
 
+srtp_err_status_t srtp_policy_set_adaptive_window(srtp_policy_t policy,
+                                                  bool adaptive)
+{
+    if (policy == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    policy->adaptive_window = adaptive;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_policy_set_rtcp_window_size(srtp_policy_t policy,
+                                                   size_t window_size)
+{
+    if (policy == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (!srtp_policy_is_valid_rtcp_window_size(window_size)) {
+        return srtp_err_status_bad_param;
+    }
+
+    policy->rtcp_window_size = window_size;
+
+    return srtp_err_status_ok;
+}
+
 srtp_err_status_t srtp_policy_set_allow_repeat_tx(srtp_policy_t policy,
                                                   bool allow)
 {
@@ -1131,6 +1270,54 @@ srtp_err_status_t srtp_policy_set_cryptex(srtp_policy_t policy,
     return srtp_err_status_ok;
 }
 
+srtp_err_status_t srtp_policy_set_stream_pool_size(srtp_policy_t policy,
+                                                   size_t num_streams)
+{
+    if (policy == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    policy->stream_pool_size = num_streams;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_policy_set_key_overlap(srtp_policy_t policy,
+                                              size_t num_packets)
+{
+    if (policy == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    policy->key_overlap = num_packets;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_policy_set_max_clones(srtp_policy_t policy,
+                                             size_t max_streams)
+{
+    if (policy == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    policy->max_clones = max_streams;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_policy_set_clone_idle_timeout(srtp_policy_t policy,
+                                                     size_t num_epochs)
+{
+    if (policy == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    policy->clone_idle_timeout = num_epochs;
+
+    return srtp_err_status_ok;
+}
+
 srtp_err_status_t srtp_policy_add_enc_hdr_xtnd_id(srtp_policy_t policy,
                                                   uint8_t hdr_xtnd_id)
 {
@@ -0,0 +1,209 @@
+/*
+ * srtp_reader.c
+ *
+ * readers of recorded packets for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "srtp_priv.h"
+
+#include <string.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#elif defined(HAVE_WINSOCK2_H)
+#include <winsock2.h>
+#endif
+
+#include "alloc.h"
+
+/*
+ * srtp_reader_copy_stream(session, source, stream) copies source into a
+ * stream with its own per packet state, from its keys if the crypto
+ * backend can copy them and from the policy it was keyed with otherwise
+ */
+static srtp_err_status_t srtp_reader_copy_stream(
+    srtp_t session,
+    const srtp_stream_ctx_t *source,
+    srtp_stream_ctx_t **str_ptr)
+{
+    /* an empty pool, the session's is kept for clones of its template */
+    srtp_stream_pool_t pool = { 0 };
+    srtp_policy_t policy = NULL;
+    srtp_err_status_t status;
+
+    status = srtp_stream_clone(&pool, source, source->ssrc, str_ptr);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_stream_clone_keys(source, *str_ptr);
+    if (status == srtp_err_status_ok) {
+        return status;
+    }
+
+    srtp_stream_dealloc(*str_ptr, source);
+    *str_ptr = NULL;
+    if (status != srtp_err_status_no_such_op) {
+        return status;
+    }
+
+    if (source->from_template) {
+        policy = session->template_policy;
+    } else if (source->cold != NULL) {
+        policy = source->cold->policy;
+    }
+    if (policy == NULL) {
+        return srtp_err_status_no_such_op;
+    }
+
+    return srtp_stream_clone_from_policy(source, policy, source->ssrc,
+                                         str_ptr);
+}
+
+static srtp_err_status_t srtp_reader_create_unlocked(srtp_t session,
+                                                     uint32_t ssrc,
+                                                     srtp_reader_t *reader)
+{
+    srtp_reader_ctx_t *r;
+    srtp_stream_ctx_t *source;
+    srtp_err_status_t status;
+
+    source = srtp_get_stream(session, htonl(ssrc));
+    if (source == NULL) {
+        return srtp_err_status_no_ctx;
+    }
+
+    r = (srtp_reader_ctx_t *)srtp_crypto_alloc(sizeof(*r));
+    if (r == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    status = srtp_reader_copy_stream(session, source, &r->stream);
+    if (status) {
+        srtp_crypto_free(r);
+        return status;
+    }
+    r->source = source;
+
+    /* a recording of sent packets is read all the same */
+    r->stream->direction = dir_srtp_receiver;
+
+    *reader = r;
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_reader_create(srtp_t session,
+                                     uint32_t ssrc,
+                                     srtp_reader_t *reader)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    if (session == NULL || reader == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    *reader = NULL;
+
+    if (!session->thread_safe) {
+        return srtp_reader_create_unlocked(session, ssrc, reader);
+    }
+
+    stream = srtp_session_enter(session, htonl(ssrc));
+    status = srtp_reader_create_unlocked(session, ssrc, reader);
+    srtp_session_leave(session, stream);
+
+    return status;
+}
+
+srtp_err_status_t srtp_reader_unprotect(srtp_reader_t reader,
+                                        uint32_t roc,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        uint8_t *rtp,
+                                        size_t *rtp_len)
+{
+    srtp_rtp_header_desc_t desc;
+    srtp_stream_ctx_t *stream;
+    srtp_xtd_seq_num_t index;
+    srtp_err_status_t status;
+    uint32_t ssrc;
+
+    if (reader == NULL || srtp == NULL || rtp == NULL || rtp_len == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    stream = reader->stream;
+
+    status = srtp_rtp_header_parse(srtp, srtp_len, &desc);
+    if (status) {
+        return status;
+    }
+    if (srtp[0] >> 6 != 2) {
+        return srtp_err_status_bad_param;
+    }
+    memcpy(&ssrc, srtp + 8, sizeof(ssrc));
+    if (ssrc != stream->ssrc) {
+        return srtp_err_status_no_ctx;
+    }
+
+    /*
+     * place the replay database just before the packet, so that the
+     * index estimated for it is the one given and it is never a replay
+     */
+    index = ((srtp_xtd_seq_num_t)roc << 16) |
+            (srtp_xtd_seq_num_t)(srtp[2] << 8 | srtp[3]);
+    srtp_rdbx_reset(&stream->rtp_rdbx);
+    if (index != 0) {
+        srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, (uint32_t)((index - 1) >> 16),
+                              (uint16_t)(index - 1));
+    }
+
+    return srtp_unprotect_rtp_parsed(&reader->session, stream, srtp, srtp_len,
+                                     &desc, rtp, rtp_len);
+}
+
+srtp_err_status_t srtp_reader_dealloc(srtp_reader_t reader)
+{
+    srtp_err_status_t status;
+
+    if (reader == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_stream_dealloc(reader->stream, reader->source);
+    if (status) {
+        return status;
+    }
+    srtp_crypto_free(reader);
+
+    return srtp_err_status_ok;
+}
@@ -63,6 +63,8 @@ srtp_err_status_t test_replay_dbx(size_t num_trials, size_t ws);
 
 srtp_err_status_t test_replay_dbx_boundaries(size_t ws);
 
+srtp_err_status_t test_replay_dbx_adaptive(void);
+
 double rdbx_check_adds_per_second(size_t num_trials, size_t ws);
 
 void usage(char *prog_name)
@@ -123,13 +125,37 @@ int main(int argc, char *argv[])
             exit(1);
         }
         printf("passed\n");
+
+        /* the largest window a policy allows is 0x7fff, which rounds up
+         * to this */
+        printf("testing srtp_rdbx_t (ws=32768)...\n");
+
+        status = test_replay_dbx(1 << 12, 32768);
+        if (status) {
+            printf("failed\n");
+            exit(1);
+        }
+        printf("passed\n");
+
+        printf("testing adaptive srtp_rdbx_t (ws=128, max=1024)...");
+
+        status = test_replay_dbx_adaptive();
+        if (status) {
+            printf("failed\n");
+            exit(1);
+        }
+        printf("passed\n");
     }
 
     if (do_timing_test) {
-        rate = rdbx_check_adds_per_second(1 << 18, 128);
-        printf("rdbx_check/replay_adds per second (ws=128): %e\n", rate);
-        rate = rdbx_check_adds_per_second(1 << 18, 1024);
-        printf("rdbx_check/replay_adds per second (ws=1024): %e\n", rate);
+        const size_t window_sizes[] = { 64, 128, 1024, 4096, 0x7fff };
+
+        for (size_t i = 0; i < sizeof(window_sizes) / sizeof(window_sizes[0]);
+             i++) {
+            rate = rdbx_check_adds_per_second(1 << 18, window_sizes[i]);
+            printf("rdbx_check/replay_adds per second (ws=%zu): %e\n",
+                   window_sizes[i], rate);
+        }
     }
 
     return 0;
@@ -385,6 +411,93 @@ srtp_err_status_t test_replay_dbx_boundaries(size_t ws)
     return srtp_err_status_ok;
 }
 
+srtp_err_status_t test_replay_dbx_adaptive(void)
+{
+    srtp_rdbx_t rdbx;
+
+    if (srtp_rdbx_init(&rdbx, 128) != srtp_err_status_ok ||
+        srtp_rdbx_set_max_window_size(&rdbx, 1024) != srtp_err_status_ok) {
+        printf("replay_init failed\n");
+        return srtp_err_status_init_fail;
+    }
+
+    if (srtp_rdbx_resize(&rdbx, 64) != srtp_err_status_bad_param ||
+        srtp_rdbx_resize(&rdbx, 2048) != srtp_err_status_bad_param ||
+        srtp_rdbx_resize(&rdbx, 200) != srtp_err_status_bad_param) {
+        printf("rdbx_resize accepted a size out of range\n");
+        return srtp_err_status_algo_fail;
+    }
+
+    /* in order, the window keeps its initial size */
+    for (uint32_t idx = 0; idx <= 1000; idx++) {
+        if (idx != 900 && idx != 990 && rdbx_check_add(&rdbx, idx)) {
+            return srtp_err_status_algo_fail;
+        }
+    }
+    if (srtp_rdbx_get_current_window_size(&rdbx) != 128) {
+        printf("window grew without reordering\n");
+        return srtp_err_status_algo_fail;
+    }
+
+    /* 100 late doubles it, and the newly covered ages count as received */
+    if (rdbx_check_add(&rdbx, 900)) {
+        return srtp_err_status_algo_fail;
+    }
+    if (srtp_rdbx_get_current_window_size(&rdbx) != 256) {
+        printf("window was %zu, expected 256\n",
+               srtp_rdbx_get_current_window_size(&rdbx));
+        return srtp_err_status_algo_fail;
+    }
+    if (srtp_rdbx_check(&rdbx, -100) != srtp_err_status_replay_fail ||
+        srtp_rdbx_check(&rdbx, -200) != srtp_err_status_replay_fail ||
+        srtp_rdbx_check(&rdbx, -10) != srtp_err_status_ok ||
+        srtp_rdbx_check(&rdbx, -256) != srtp_err_status_replay_old) {
+        printf("grown window has wrong contents\n");
+        return srtp_err_status_algo_fail;
+    }
+
+    /* it never grows beyond the maximum */
+    for (size_t ws = 256; ws <= 1024; ws *= 2) {
+        if (srtp_rdbx_add_index(&rdbx, -(ssize_t)(ws / 2)) !=
+            srtp_err_status_ok) {
+            return srtp_err_status_algo_fail;
+        }
+    }
+    if (srtp_rdbx_get_current_window_size(&rdbx) != 1024) {
+        printf("window was %zu, expected 1024\n",
+               srtp_rdbx_get_current_window_size(&rdbx));
+        return srtp_err_status_algo_fail;
+    }
+
+    /* and shrinks back once packets stop arriving late */
+    for (uint32_t idx = 1001; idx < 1001 + 4 * SRTP_RDBX_ADAPT_PERIOD;
+         idx++) {
+        if (rdbx_check_add(&rdbx, idx)) {
+            return srtp_err_status_algo_fail;
+        }
+    }
+    if (srtp_rdbx_get_current_window_size(&rdbx) != 128) {
+        printf("window was %zu, expected 128\n",
+               srtp_rdbx_get_current_window_size(&rdbx));
+        return srtp_err_status_algo_fail;
+    }
+
+    if (srtp_rdbx_resize(&rdbx, 512) != srtp_err_status_ok) {
+        return srtp_err_status_algo_fail;
+    }
+    srtp_rdbx_reset(&rdbx);
+    if (srtp_rdbx_get_current_window_size(&rdbx) != 128 ||
+        srtp_rdbx_get_window_size(&rdbx) != 128 ||
+        srtp_rdbx_get_max_window_size(&rdbx) != 1024) {
+        printf("rdbx_reset did not restore the initial window\n");
+        return srtp_err_status_algo_fail;
+    }
+
+    srtp_rdbx_dealloc(&rdbx);
+
+    return srtp_err_status_ok;
+}
+
 #include <time.h> /* for clock()  */
 
 double rdbx_check_adds_per_second(size_t num_trials, size_t ws)
@@ -65,7 +65,9 @@ srtp_err_status_t test_rdb_db(void);
 
 srtp_err_status_t test_rdb_boundaries(void);
 
-double rdb_check_adds_per_second(void);
+srtp_err_status_t test_rdb_window_size(size_t ws);
+
+double rdb_check_adds_per_second(size_t ws);
 
 int main(void)
 {
@@ -79,7 +81,20 @@ int main(void)
     }
     printf("done\n");
 
-    printf("rdb_check/rdb_adds per second: %e\n", rdb_check_adds_per_second());
+    printf("testing srtp_rdb_t window sizes...\n");
+    for (size_t ws = 64; ws <= SRTP_RDB_MAX_WINDOW_SIZE; ws *= 2) {
+        err = test_rdb_window_size(ws);
+        if (err) {
+            printf("failed (ws=%zu)\n", ws);
+            exit(1);
+        }
+    }
+    printf("done\n");
+
+    for (size_t ws = 64; ws <= SRTP_RDB_MAX_WINDOW_SIZE; ws *= 4) {
+        printf("rdb_check/rdb_adds per second (ws=%zu): %e\n", ws,
+               rdb_check_adds_per_second(ws));
+    }
 
     return 0;
 }
@@ -137,11 +152,12 @@ srtp_err_status_t rdb_check_add_unordered(srtp_rdb_t *rdb, uint32_t idx)
 srtp_err_status_t test_rdb_db(void)
 {
     srtp_rdb_t rdb;
-    uint32_t ircvd;
+    uint32_t ircvd, value;
     ut_connection utc;
     srtp_err_status_t err;
 
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_init_fail;
     }
@@ -163,7 +179,8 @@ srtp_err_status_t test_rdb_db(void)
     }
 
     /* re-initialize */
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_fail;
     }
@@ -184,7 +201,8 @@ srtp_err_status_t test_rdb_db(void)
     }
 
     /* re-initialize */
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_fail;
     }
@@ -204,7 +222,8 @@ srtp_err_status_t test_rdb_db(void)
     }
 
     /* re-initialize */
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_fail;
     }
@@ -226,11 +245,17 @@ srtp_err_status_t test_rdb_db(void)
     }
 
     /* test for key expired */
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_fail;
     }
-    rdb.window_start = 0x7ffffffe;
+    rdb.window_start = 0x7ffffffd;
+    if (srtp_rdb_next_value(&rdb, &value) != srtp_err_status_ok ||
+        value != 0x7ffffffe) {
+        printf("srtp_rdb_next_value of 0x7ffffffd failed\n");
+        return srtp_err_status_fail;
+    }
     if (srtp_rdb_increment(&rdb) != srtp_err_status_ok) {
         printf("srtp_rdb_increment of 0x7ffffffe failed\n");
         return srtp_err_status_fail;
@@ -248,6 +273,11 @@ srtp_err_status_t test_rdb_db(void)
         printf("rdb valiue was not 0x7fffffff\n");
         return srtp_err_status_fail;
     }
+    if (srtp_rdb_next_value(&rdb, &value) != srtp_err_status_key_expired) {
+        printf("srtp_rdb_next_value of 0x7fffffff did not return "
+               "srtp_err_status_key_expired\n");
+        return srtp_err_status_fail;
+    }
 
     err = test_rdb_boundaries();
     if (err) {
@@ -261,7 +291,8 @@ srtp_err_status_t test_rdb_boundaries(void)
 {
     srtp_rdb_t rdb;
 
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_fail;
     }
@@ -299,7 +330,8 @@ srtp_err_status_t test_rdb_boundaries(void)
         return srtp_err_status_fail;
     }
 
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, SRTP_RDB_DEFAULT_WINDOW_SIZE) !=
+        srtp_err_status_ok) {
         printf("rdb_init failed\n");
         return srtp_err_status_fail;
     }
@@ -321,17 +353,75 @@ srtp_err_status_t test_rdb_boundaries(void)
     return srtp_err_status_ok;
 }
 
+/*
+ * test_rdb_window_size(ws) checks that an rdb with a window of ws packets
+ * keeps exactly the last ws indices, including when packets arrive up to
+ * ws - 1 places out of order
+ */
+srtp_err_status_t test_rdb_window_size(size_t ws)
+{
+    srtp_rdb_t rdb;
+    uint32_t w = (uint32_t)ws;
+
+    if (srtp_rdb_init(&rdb, 0) != srtp_err_status_bad_param ||
+        srtp_rdb_init(&rdb, SRTP_RDB_MAX_WINDOW_SIZE + 1) !=
+            srtp_err_status_bad_param) {
+        printf("rdb_init accepted an invalid window size\n");
+        return srtp_err_status_fail;
+    }
+
+    if (srtp_rdb_init(&rdb, ws) != srtp_err_status_ok ||
+        srtp_rdb_get_window_size(&rdb) != ws) {
+        printf("rdb_init failed\n");
+        return srtp_err_status_fail;
+    }
+
+    if (srtp_rdb_add_index(&rdb, 0) != srtp_err_status_ok ||
+        srtp_rdb_check(&rdb, w - 1) != srtp_err_status_ok ||
+        srtp_rdb_add_index(&rdb, w - 1) != srtp_err_status_ok ||
+        srtp_rdb_check(&rdb, 0) != srtp_err_status_replay_fail) {
+        printf("rdb failed at the end of the window\n");
+        return srtp_err_status_fail;
+    }
+    if (srtp_rdb_add_index(&rdb, w) != srtp_err_status_ok ||
+        rdb.window_start != 1 ||
+        srtp_rdb_check(&rdb, 0) != srtp_err_status_replay_old) {
+        printf("rdb failed to age out index 0\n");
+        return srtp_err_status_fail;
+    }
+
+    /* receive each block of ws packets in reverse order */
+    if (srtp_rdb_init(&rdb, ws) != srtp_err_status_ok) {
+        printf("rdb_init failed\n");
+        return srtp_err_status_fail;
+    }
+    for (uint32_t block = 0; block < 8 * w; block += w) {
+        for (uint32_t i = w; i > 0; i--) {
+            if (rdb_check_add(&rdb, block + i - 1)) {
+                return srtp_err_status_fail;
+            }
+        }
+        for (uint32_t i = 0; i < w; i++) {
+            if (rdb_check_expect_failure(&rdb, block + i)) {
+                return srtp_err_status_fail;
+            }
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
 #include <time.h>   /* for clock()  */
 #include <stdlib.h> /* for random() */
 
 #define REPLAY_NUM_TRIALS 10000000
 
-double rdb_check_adds_per_second(void)
+double rdb_check_adds_per_second(size_t ws)
 {
     srtp_rdb_t rdb;
     clock_t timer;
 
-    if (srtp_rdb_init(&rdb) != srtp_err_status_ok) {
+    if (srtp_rdb_init(&rdb, ws) != srtp_err_status_ok) {
         printf("rdb_init failed\n");
         exit(1);
     }
@@ -66,6 +66,8 @@ srtp_err_status_t roc_test(size_t num_trials);
 
 srtp_err_status_t roc_boundary_test(void);
 
+srtp_err_status_t roc_run_test(size_t num_trials);
+
 int main(void)
 {
     srtp_err_status_t status;
@@ -85,6 +87,11 @@ int main(void)
         printf("failed\n");
         exit(status);
     }
+    status = roc_run_test(1 << 12);
+    if (status) {
+        printf("failed\n");
+        exit(status);
+    }
     printf("passed\n");
     return 0;
 }
@@ -203,3 +210,66 @@ srtp_err_status_t roc_boundary_test(void)
 
     return srtp_err_status_ok;
 }
+
+/*
+ * roc_run_test(num_trials) checks srtp_rdbx_estimate_indices() against
+ * srtp_rdbx_estimate_index() for runs of sequence numbers around local
+ * indices on either side of the median and of a rollover
+ */
+#define ROC_RUN_LEN 16
+
+srtp_err_status_t roc_run_test(size_t num_trials)
+{
+    const srtp_xtd_seq_num_t locals[] = {
+        0,       0x10,    0x8000,  0x8001,   0x1fffe,
+        0x2000f, 0x27fff, 0x28000, 0x3ffff0, 0xffffffff0000,
+    };
+    srtp_rdbx_t rdbx;
+    srtp_sequence_number_t s[ROC_RUN_LEN];
+    srtp_xtd_seq_num_t guess[ROC_RUN_LEN];
+    ssize_t delta[ROC_RUN_LEN];
+
+    if (srtp_rdbx_init(&rdbx, 128)) {
+        return srtp_err_status_init_fail;
+    }
+
+    for (size_t t = 0; t < num_trials; t++) {
+        size_t num = 1 + (size_t)rand() % ROC_RUN_LEN;
+
+        /* a quarter of the runs are random */
+        rdbx.index = locals[t % (sizeof(locals) / sizeof(locals[0]))];
+        for (size_t i = 0; i < num; i++) {
+            s[i] = (srtp_sequence_number_t)rand();
+        }
+        /*
+         * the others are consecutive around the local index and around
+         * the sequence numbers half way from it, where the guess changes
+         * rollover counter
+         */
+        if (t % 4 != 0) {
+            srtp_xtd_seq_num_t center =
+                rdbx.index + (t % 4 - 2) * seq_num_median;
+
+            for (size_t i = 0; i < num; i++) {
+                s[i] = (srtp_sequence_number_t)(center + i - num / 2);
+            }
+        }
+
+        srtp_rdbx_estimate_indices(&rdbx, s, num, guess, delta);
+        for (size_t i = 0; i < num; i++) {
+            srtp_xtd_seq_num_t est;
+            ssize_t d = srtp_rdbx_estimate_index(&rdbx, &est, s[i]);
+
+            if (est != guess[i] || d != delta[i]) {
+                printf("estimate of run differs at local %llu, seq %u\n",
+                       (unsigned long long)rdbx.index, (unsigned int)s[i]);
+                srtp_rdbx_dealloc(&rdbx);
+                return srtp_err_status_algo_fail;
+            }
+        }
+    }
+
+    srtp_rdbx_dealloc(&rdbx);
+
+    return srtp_err_status_ok;
+}
@@ -43,6 +43,10 @@
  *
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for sendmmsg() and recvmmsg() */
+#endif
+
 #include "rtp.h"
 
 #include "cipher_priv.h"
@@ -50,11 +54,23 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
 
+#if defined(__linux__)
+#define RTP_LOAD_MMSG 1
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
 #define PRINT_DEBUG 0   /* set to 1 to print out debugging data */
 #define VERBOSE_DEBUG 0 /* set to 1 to print out more data      */
 
@@ -235,3 +251,416 @@ void rtp_receiver_dealloc(rtp_receiver_t rtp_ctx)
 {
     free(rtp_ctx);
 }
+
+/*
+ * load generation
+ *
+ * rtp_load_send() and rtp_load_recv() move a batch of packets per call,
+ * protected and verified with srtp_protect_batch() and
+ * srtp_unprotect_batch(). On Linux a batch takes a single sendmmsg() or
+ * recvmmsg() call, and with segmentation the kernel also splits and
+ * coalesces the datagrams (UDP_SEGMENT and UDP_GRO); elsewhere the
+ * packets are sent and received one at a time.
+ */
+
+/* room for a packet of RTP_LOAD_MAX_PAYLOAD octets and its trailer */
+#define RTP_LOAD_SLOT_LEN 2048
+
+/* the largest datagram that the kernel coalesces with UDP_GRO */
+#define RTP_LOAD_GRO_LEN 65536
+
+/* the most segments in one UDP_SEGMENT send or UDP_GRO receive */
+#define RTP_LOAD_MAX_SEGMENTS 64
+
+/* packets sent for one SSRC before moving to the next */
+#define RTP_LOAD_RUN_LEN 4
+
+struct rtp_load_ctx_t {
+    size_t batch_size;
+    size_t payload_len;
+    bool segment;
+    uint32_t first_ssrc;
+    size_t num_ssrcs;
+    size_t num_sent; /* packets built so far, selects the next SSRC */
+    uint16_t *seq;   /* next sequence number of each SSRC           */
+    uint8_t *buffers;
+    size_t buffer_len; /* size of a receive buffer */
+    srtp_packet_desc_t *pkts;
+#ifdef RTP_LOAD_MMSG
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    uint8_t *cmsgs;
+#endif
+};
+
+#ifdef RTP_LOAD_MMSG
+#define RTP_LOAD_CMSG_LEN CMSG_SPACE(sizeof(int))
+#endif
+
+double rtp_load_now(void)
+{
+#ifdef HAVE_WINDOWS_H
+    LARGE_INTEGER count, freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+rtp_load_t rtp_load_alloc(size_t batch_size,
+                          size_t payload_len,
+                          uint32_t first_ssrc,
+                          size_t num_ssrcs,
+                          bool segment)
+{
+    rtp_load_t load;
+    size_t max_pkts;
+
+    if (batch_size == 0 || batch_size > RTP_LOAD_MAX_BATCH ||
+        payload_len > RTP_LOAD_MAX_PAYLOAD || num_ssrcs == 0) {
+        return NULL;
+    }
+#ifndef RTP_LOAD_MMSG
+    if (segment) {
+        return NULL;
+    }
+#endif
+
+    load = (rtp_load_t)calloc(1, sizeof(*load));
+    if (load == NULL) {
+        return NULL;
+    }
+    load->batch_size = batch_size;
+    load->payload_len = payload_len;
+    load->segment = segment;
+    load->first_ssrc = first_ssrc;
+    load->num_ssrcs = num_ssrcs;
+    load->buffer_len = segment ? RTP_LOAD_GRO_LEN : RTP_LOAD_SLOT_LEN;
+
+    /* a coalesced datagram holds several packets */
+    max_pkts = segment ? batch_size * RTP_LOAD_MAX_SEGMENTS : batch_size;
+
+    load->seq = (uint16_t *)calloc(num_ssrcs, sizeof(*load->seq));
+    load->buffers = (uint8_t *)malloc(batch_size * load->buffer_len);
+    load->pkts =
+        (srtp_packet_desc_t *)calloc(max_pkts, sizeof(srtp_packet_desc_t));
+#ifdef RTP_LOAD_MMSG
+    load->msgs = (struct mmsghdr *)calloc(batch_size, sizeof(*load->msgs));
+    load->iovs = (struct iovec *)calloc(batch_size, sizeof(*load->iovs));
+    load->cmsgs = (uint8_t *)calloc(batch_size, RTP_LOAD_CMSG_LEN);
+    if (load->msgs == NULL || load->iovs == NULL || load->cmsgs == NULL) {
+        rtp_load_dealloc(load);
+        return NULL;
+    }
+#endif
+    if (load->seq == NULL || load->buffers == NULL || load->pkts == NULL) {
+        rtp_load_dealloc(load);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num_ssrcs; i++) {
+        load->seq[i] = (uint16_t)srtp_cipher_rand_u32_for_tests();
+    }
+    memset(load->buffers, 0xab, batch_size * load->buffer_len);
+
+    return load;
+}
+
+void rtp_load_dealloc(rtp_load_t load)
+{
+    if (load == NULL) {
+        return;
+    }
+#ifdef RTP_LOAD_MMSG
+    free(load->cmsgs);
+    free(load->iovs);
+    free(load->msgs);
+#endif
+    free(load->pkts);
+    free(load->buffers);
+    free(load->seq);
+    free(load);
+}
+
+int rtp_load_init_socket(rtp_load_t load, int sock, bool receiver)
+{
+    int bufsize = 4 * 1024 * 1024;
+
+    /* a deep socket buffer absorbs the bursts of a batch */
+    setsockopt(sock, SOL_SOCKET, receiver ? SO_RCVBUF : SO_SNDBUF,
+               (const void *)&bufsize, sizeof(bufsize));
+
+#ifdef RTP_LOAD_MMSG
+    if (receiver && load->segment) {
+        int on = 1;
+
+        if (setsockopt(sock, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+            return -1;
+        }
+    }
+#else
+    (void)load;
+#endif
+
+    return 0;
+}
+
+/*
+ * rtp_load_build() writes the header of the next packet into buf, the
+ * SSRCs take turns every RTP_LOAD_RUN_LEN packets
+ */
+static void rtp_load_build(rtp_load_t load, uint8_t *buf)
+{
+    srtp_hdr_t *hdr = (srtp_hdr_t *)buf;
+    size_t index = (load->num_sent / RTP_LOAD_RUN_LEN) % load->num_ssrcs;
+
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->x = 0;
+    hdr->cc = 0;
+    hdr->m = 0;
+    hdr->pt = 0x1;
+    hdr->seq = htons(load->seq[index]++);
+    hdr->ts = htonl((uint32_t)load->num_sent);
+    hdr->ssrc = htonl(load->first_ssrc + (uint32_t)index);
+    load->num_sent++;
+}
+
+#ifdef RTP_LOAD_MMSG
+/*
+ * rtp_load_sendmmsg() passes num_msgs prepared messages to the kernel,
+ * and returns the number of packets they carried or -1
+ */
+static ssize_t rtp_load_sendmmsg(rtp_load_t load,
+                                 int sock,
+                                 size_t num_msgs,
+                                 const size_t *msg_pkts)
+{
+    size_t done = 0;
+    ssize_t pkts = 0;
+
+    while (done < num_msgs) {
+        int ret = sendmmsg(sock, load->msgs + done,
+                           (unsigned int)(num_msgs - done), 0);
+        if (ret < 0) {
+            return pkts > 0 ? pkts : -1;
+        }
+        for (int i = 0; i < ret; i++) {
+            pkts += (ssize_t)msg_pkts[done + (size_t)i];
+        }
+        done += (size_t)ret;
+    }
+
+    return pkts;
+}
+#endif
+
+ssize_t rtp_load_send(rtp_load_t load, rtp_sender_t sender)
+{
+    size_t rtp_len = RTP_HEADER_LEN + load->payload_len;
+    size_t num_ok = 0;
+
+    for (size_t i = 0; i < load->batch_size; i++) {
+        srtp_packet_desc_t *pkt = &load->pkts[i];
+        uint8_t *buf = load->buffers + i * RTP_LOAD_SLOT_LEN;
+
+        rtp_load_build(load, buf);
+        pkt->in = buf;
+        pkt->in_len = rtp_len;
+        pkt->out = buf;
+        pkt->out_len = RTP_LOAD_SLOT_LEN;
+        pkt->mki_index = 0;
+    }
+
+    srtp_protect_batch(sender->srtp_ctx, load->pkts, load->batch_size);
+
+#ifdef RTP_LOAD_MMSG
+    {
+        size_t msg_pkts[RTP_LOAD_MAX_BATCH];
+        size_t num_msgs = 0;
+        size_t i = 0;
+
+        while (i < load->batch_size) {
+            struct mmsghdr *msg = &load->msgs[num_msgs];
+            size_t first = i;
+            size_t seg_len;
+            size_t n = 0;
+
+            if (load->pkts[i].status) {
+                i++;
+                continue;
+            }
+
+            /*
+             * with segmentation one message carries a run of packets of
+             * the same length, which the kernel sends as separate
+             * datagrams
+             */
+            seg_len = load->pkts[i].out_len;
+            while (i < load->batch_size && load->pkts[i].status == 0 &&
+                   load->pkts[i].out_len == seg_len &&
+                   (n == 0 || (load->segment && n < RTP_LOAD_MAX_SEGMENTS &&
+                               (n + 1) * seg_len < RTP_LOAD_GRO_LEN))) {
+                load->iovs[i].iov_base = (void *)load->pkts[i].out;
+                load->iovs[i].iov_len = seg_len;
+                n++;
+                i++;
+            }
+
+            memset(msg, 0, sizeof(*msg));
+            msg->msg_hdr.msg_name = &sender->addr;
+            msg->msg_hdr.msg_namelen = sizeof(sender->addr);
+            msg->msg_hdr.msg_iov = &load->iovs[first];
+            msg->msg_hdr.msg_iovlen = n;
+            if (n > 1) {
+                uint8_t *control = load->cmsgs + num_msgs * RTP_LOAD_CMSG_LEN;
+                struct cmsghdr *cmsg;
+                uint16_t gso_size = (uint16_t)seg_len;
+
+                msg->msg_hdr.msg_control = control;
+                msg->msg_hdr.msg_controllen = CMSG_SPACE(sizeof(gso_size));
+                cmsg = CMSG_FIRSTHDR(&msg->msg_hdr);
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(gso_size));
+                memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            }
+            msg_pkts[num_msgs++] = n;
+            num_ok += n;
+        }
+
+        if (num_ok == 0) {
+            return 0;
+        }
+        return rtp_load_sendmmsg(load, sender->socket, num_msgs, msg_pkts);
+    }
+#else
+    {
+        ssize_t sent = 0;
+
+        for (size_t i = 0; i < load->batch_size; i++) {
+            srtp_packet_desc_t *pkt = &load->pkts[i];
+
+            if (pkt->status) {
+                continue;
+            }
+            num_ok++;
+            if (sendto(sender->socket, (const void *)pkt->out, pkt->out_len,
+                       0, (struct sockaddr *)&sender->addr,
+                       sizeof(struct sockaddr_in)) == (ssize_t)pkt->out_len) {
+                sent++;
+            }
+        }
+        return num_ok > 0 && sent == 0 ? -1 : sent;
+    }
+#endif
+}
+
+#ifdef RTP_LOAD_MMSG
+/*
+ * rtp_load_segment_len() returns the size of the packets coalesced into
+ * the datagram msg was received into, or 0 if it is a single packet
+ */
+static size_t rtp_load_segment_len(struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gso_size;
+
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            return gso_size > 0 ? (size_t)gso_size : 0;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+ssize_t rtp_load_recv(rtp_load_t load,
+                      rtp_receiver_t receiver,
+                      size_t *num_errors)
+{
+    size_t num_pkts = 0;
+    ssize_t num_ok = 0;
+
+#ifdef RTP_LOAD_MMSG
+    int ret;
+
+    for (size_t i = 0; i < load->batch_size; i++) {
+        struct mmsghdr *msg = &load->msgs[i];
+
+        load->iovs[i].iov_base = load->buffers + i * load->buffer_len;
+        load->iovs[i].iov_len = load->buffer_len;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_hdr.msg_iov = &load->iovs[i];
+        msg->msg_hdr.msg_iovlen = 1;
+        if (load->segment) {
+            msg->msg_hdr.msg_control = load->cmsgs + i * RTP_LOAD_CMSG_LEN;
+            msg->msg_hdr.msg_controllen = RTP_LOAD_CMSG_LEN;
+        }
+    }
+
+    ret = recvmmsg(receiver->socket, load->msgs, (unsigned int)load->batch_size,
+                   MSG_WAITFORONE, NULL);
+    if (ret < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < ret; i++) {
+        struct mmsghdr *msg = &load->msgs[i];
+        uint8_t *data = (uint8_t *)load->iovs[i].iov_base;
+        size_t len = msg->msg_len;
+        size_t seg_len = 0;
+
+        if (load->segment) {
+            seg_len = rtp_load_segment_len(&msg->msg_hdr);
+        }
+        if (seg_len == 0) {
+            seg_len = len;
+        }
+
+        /* split a coalesced datagram back into its packets */
+        for (size_t off = 0; off < len; off += seg_len) {
+            srtp_packet_desc_t *pkt = &load->pkts[num_pkts++];
+
+            pkt->in = data + off;
+            pkt->in_len = len - off < seg_len ? len - off : seg_len;
+            pkt->out = data + off;
+            pkt->out_len = pkt->in_len;
+        }
+    }
+#else
+    {
+        ssize_t ret = recvfrom(receiver->socket, (void *)load->buffers,
+                               load->buffer_len, 0, (struct sockaddr *)NULL, 0);
+        if (ret < 0) {
+            return -1;
+        }
+        load->pkts[0].in = load->buffers;
+        load->pkts[0].in_len = (size_t)ret;
+        load->pkts[0].out = load->buffers;
+        load->pkts[0].out_len = (size_t)ret;
+        num_pkts = 1;
+    }
+#endif
+
+    srtp_unprotect_batch(receiver->srtp_ctx, load->pkts, num_pkts);
+    for (size_t i = 0; i < num_pkts; i++) {
+        if (load->pkts[i].status) {
+            (*num_errors)++;
+        } else {
+            num_ok++;
+        }
+    }
+
+    return num_ok;
+}
@@ -132,6 +132,55 @@ rtp_receiver_t rtp_receiver_alloc(void);
 
 void rtp_receiver_dealloc(rtp_receiver_t rtp_ctx);
 
+/*
+ * rtp_load_t is the state of the load generation mode of rtpw, which
+ * sends and receives batch_size packets at a time for num_ssrcs streams
+ * with consecutive SSRCs starting at first_ssrc
+ */
+#define RTP_LOAD_MAX_BATCH 1024
+#define RTP_LOAD_MAX_PAYLOAD 1400
+
+typedef struct rtp_load_ctx_t *rtp_load_t;
+
+/*
+ * segment enables UDP segmentation offload when sending and the
+ * coalescing of received datagrams, which is only supported on Linux
+ */
+rtp_load_t rtp_load_alloc(size_t batch_size,
+                          size_t payload_len,
+                          uint32_t first_ssrc,
+                          size_t num_ssrcs,
+                          bool segment);
+
+void rtp_load_dealloc(rtp_load_t load);
+
+/*
+ * rtp_load_init_socket() prepares sock for rtp_load_send() or, if
+ * receiver is set, for rtp_load_recv(); it returns -1 on failure
+ */
+int rtp_load_init_socket(rtp_load_t load, int sock, bool receiver);
+
+/*
+ * rtp_load_send() protects and sends the next batch of packets, it
+ * returns the number of packets sent or -1 if nothing could be sent
+ */
+ssize_t rtp_load_send(rtp_load_t load, rtp_sender_t sender);
+
+/*
+ * rtp_load_recv() waits for at least one packet and unprotects all that
+ * have arrived, up to a batch; it returns the number of valid packets
+ * and adds the number of invalid ones to *num_errors, or returns -1 if
+ * the receive failed
+ */
+ssize_t rtp_load_recv(rtp_load_t load,
+                      rtp_receiver_t receiver,
+                      size_t *num_errors);
+
+/*
+ * rtp_load_now() returns a monotonic time in seconds
+ */
+double rtp_load_now(void);
+
 #ifdef __cplusplus
 }
 #endif
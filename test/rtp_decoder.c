@@ -71,6 +71,15 @@
 #include <assert.h> /* for assert()  */
 #include <stdlib.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define RTP_DECODER_PARALLEL 1
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifndef timersub
 #define timersub(a, b, result)                                                 \
     do {                                                                       \
@@ -130,6 +139,9 @@ static struct srtp_crypto_suite srtp_crypto_suites[] = {
     { .can_name = NULL }
 };
 
+static void rtp_decoder_report_rate(size_t frames,
+                                    const struct timeval *start);
+
 void rtp_decoder_srtp_log_handler(srtp_log_level_t level,
                                   const char *msg,
                                   void *data)
@@ -186,6 +198,8 @@ int main(int argc, char *argv[])
     int len;
     int expected_len;
     int do_list_mods = 0;
+    size_t num_threads = 0;
+    struct timeval start;
 
     fprintf(stderr, "Using %s [0x%x]\n", srtp_get_version_string(),
             srtp_get_version());
@@ -207,7 +221,7 @@ int main(int argc, char *argv[])
 
     /* check args */
     while (1) {
-        c = getopt_s(argc, argv, "b:k:i:gt:ae:ld:f:c:m:p:o:s:r:");
+        c = getopt_s(argc, argv, "b:k:i:gt:ae:ld:f:c:m:p:o:s:r:j:");
         if (c == -1) {
             break;
         }
@@ -315,6 +329,13 @@ int main(int argc, char *argv[])
         case 'r':
             roc = atoi(optarg_s);
             break;
+        case 'j':
+            num_threads = strtoul(optarg_s, NULL, 0);
+            if (num_threads == 0) {
+                fprintf(stderr, "error: number of threads must be > 0\n");
+                exit(1);
+            }
+            break;
         default:
             usage(argv[0]);
         }
@@ -476,6 +497,24 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (num_threads > 0) {
+        int ret = rtp_decoder_run_parallel(pcap_file, filter_exp, num_threads,
+                                           policy, mode, rtp_packet_offset,
+                                           ssrc.value, roc);
+        if (ret != 0) {
+            return ret;
+        }
+
+        status = srtp_shutdown();
+        if (status) {
+            fprintf(stderr,
+                    "error: srtp shutdown failed with error code %d\n",
+                    status);
+            exit(1);
+        }
+        return 0;
+    }
+
     pcap_handle = pcap_open_offline(pcap_file, errbuf);
 
     if (!pcap_handle) {
@@ -505,6 +544,7 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    gettimeofday(&start, NULL);
     pcap_loop(pcap_handle, 0, rtp_decoder_handle_pkt, (u_char *)dec);
 
     if (dec->mode == mode_rtp || dec->mode == mode_rtcp_mux) {
@@ -514,6 +554,7 @@ int main(int argc, char *argv[])
         fprintf(stderr, "RTCP packets decoded: %zu\n", dec->rtcp_cnt);
     }
     fprintf(stderr, "Packet decode errors: %zu\n", dec->error_cnt);
+    rtp_decoder_report_rate((size_t)(dec->frame_nr + 1), &start);
 
     rtp_decoder_deinit(dec);
     rtp_decoder_dealloc(dec);
@@ -534,6 +575,7 @@ void usage(char *string)
         stderr,
         "usage: %s [-d <debug>]* [[-k][-b] <key>] [-a][-t][-e] [-c "
         "<srtp-crypto-suite>] [-m <mode>] [-s <ssrc> [-r <roc>]]\n"
+        "       [-j <threads>]\n"
         "or     %s -l\n"
         "where  -a use message authentication\n"
         "       -e <key size> use encryption (use 128 or 256 for key size)\n"
@@ -553,7 +595,9 @@ void usage(char *string)
         "       -s <ssrc> restrict decrypting to the given SSRC (in host byte "
         "order)\n"
         "       -r <roc> initial rollover counter, requires -s <ssrc> "
-        "(defaults to 0)\n",
+        "(defaults to 0)\n"
+        "       -j <threads> decode with that many threads, packets are\n"
+        "          split between them by SSRC; requires -p <pcap file>\n",
         string, string);
     exit(1);
 }
@@ -631,76 +675,653 @@ void hexdump(const void *ptr, size_t size)
     }
 }
 
+/*
+ * rtp_decoder_is_rtp() tells whether the packet at the rtp offset of a
+ * capture is RTP or RTCP
+ */
+static bool rtp_decoder_is_rtp(rtp_decoder_mode_t mode,
+                               const uint8_t *packet,
+                               size_t len)
+{
+    if (mode == mode_rtp) {
+        return true;
+    }
+    if (mode == mode_rtcp) {
+        return false;
+    }
+    if (len >= 2) {
+        /* rfc5761 */
+        u_char payload_type = packet[1] & 0x7f;
+        return payload_type < 64 || payload_type > 95;
+    }
+    return true;
+}
+
+/*
+ * rtp_decoder_decode() decrypts the captured frame bytes into message,
+ * it returns false if the frame was skipped or could not be decrypted
+ */
+static bool rtp_decoder_decode(rtp_decoder_t dcdr,
+                               const u_char *bytes,
+                               size_t caplen,
+                               rtp_msg_t *message,
+                               size_t *octets_recvd)
+{
+    srtp_err_status_t status;
+    size_t pktsize;
+
+    if (caplen < dcdr->rtp_offset) {
+        return false;
+    }
+    const uint8_t *rtp_packet = bytes + dcdr->rtp_offset;
+    pktsize = caplen - dcdr->rtp_offset;
+
+    if (pktsize > sizeof(*message)) {
+        dcdr->error_cnt++;
+        return false;
+    }
+    memcpy((void *)message, rtp_packet, pktsize);
+
+    *octets_recvd = pktsize;
+
+    if (rtp_decoder_is_rtp(dcdr->mode, rtp_packet, pktsize)) {
+        /* verify rtp header */
+        if (message->header.version != 2) {
+            return false;
+        }
+
+        status =
+            srtp_unprotect(dcdr->srtp_ctx, (uint8_t *)message, *octets_recvd,
+                           (uint8_t *)message, octets_recvd);
+        if (status) {
+            dcdr->error_cnt++;
+            return false;
+        }
+        dcdr->rtp_cnt++;
+    } else {
+        status = srtp_unprotect_rtcp(dcdr->srtp_ctx, (uint8_t *)message,
+                                     *octets_recvd, (uint8_t *)message,
+                                     octets_recvd);
+        if (status) {
+            dcdr->error_cnt++;
+            return false;
+        }
+        dcdr->rtcp_cnt++;
+    }
+
+    return true;
+}
+
 void rtp_decoder_handle_pkt(u_char *arg,
                             const struct pcap_pkthdr *hdr,
                             const u_char *bytes)
 {
     rtp_decoder_t dcdr = (rtp_decoder_t)arg;
     rtp_msg_t message;
-    bool rtp;
-    ssize_t pktsize;
     struct timeval delta;
     size_t octets_recvd;
-    srtp_err_status_t status;
     dcdr->frame_nr++;
 
     if ((dcdr->start_tv.tv_sec == 0) && (dcdr->start_tv.tv_usec == 0)) {
         dcdr->start_tv = hdr->ts;
     }
 
-    if (hdr->caplen < dcdr->rtp_offset) {
+    if (!rtp_decoder_decode(dcdr, bytes, hdr->caplen, &message,
+                            &octets_recvd)) {
         return;
     }
-    const void *rtp_packet = bytes + dcdr->rtp_offset;
+    timersub(&hdr->ts, &dcdr->start_tv, &delta);
+    fprintf(stdout, "%02ld:%02d.%06ld\n", (long)(delta.tv_sec / 60),
+            (int)(delta.tv_sec % 60), (long)delta.tv_usec);
+    hexdump(&message, octets_recvd);
+}
+
+/*
+ * rtp_decoder_report_rate() prints the number of frames read per second
+ * of wall clock time since start
+ */
+static void rtp_decoder_report_rate(size_t frames, const struct timeval *start)
+{
+    struct timeval now, elapsed;
+    double secs;
+
+    gettimeofday(&now, NULL);
+    timersub(&now, start, &elapsed);
+    secs = (double)elapsed.tv_sec + (double)elapsed.tv_usec / 1e6;
+    fprintf(stderr, "Frames read: %zu in %.3f s (%.0f packets/s)\n", frames,
+            secs, secs > 0 ? (double)frames / secs : 0.0);
+}
+
+#ifdef RTP_DECODER_PARALLEL
+
+/*
+ * parallel decoding
+ *
+ * With -j <threads> the capture file is mapped into memory and parsed
+ * here instead of by libpcap, which saves copying every frame. The main
+ * thread hands each frame to the worker owning its SSRC; every worker
+ * has its own decoder and srtp session, so the replay and rollover state
+ * of a stream stays on one thread and the library needs no locking.
+ *
+ * The workers decrypt and format a frame into its slot of a ring of
+ * RTP_DECODER_RING_SIZE slots, and a writer thread outputs the slots in
+ * capture order.
+ */
+#define RTP_DECODER_RING_SIZE 4096
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_FILE_HDR_LEN 24
+#define PCAP_RECORD_HDR_LEN 16
+
+typedef struct {
+    const uint8_t *data;
+    size_t caplen;
+    struct timeval ts;
+    bool done;
+    char *text; /* formatted output of the frame */
+    size_t text_len;
+    size_t text_cap;
+} rtp_decoder_slot_t;
+
+typedef struct rtp_decoder_pool_t rtp_decoder_pool_t;
+
+typedef struct {
+    rtp_decoder_pool_t *pool;
+    rtp_decoder_t dec;
+    pthread_t thread;
+    pthread_cond_t work;
+    size_t queue[RTP_DECODER_RING_SIZE]; /* frame numbers to decode */
+    size_t head;                         /* next frame to decode    */
+    size_t tail;                         /* next free queue entry   */
+    rtp_msg_t message;
+} rtp_decoder_worker_t;
+
+struct rtp_decoder_pool_t {
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_done;
+    rtp_decoder_slot_t slots[RTP_DECODER_RING_SIZE];
+    size_t num_read;    /* frames handed to the workers */
+    size_t num_written; /* frames written to stdout     */
+    bool eof;
+    struct timeval start_tv;
+    rtp_decoder_mode_t mode;
+    size_t rtp_offset;
+    rtp_decoder_worker_t *workers;
+    size_t num_workers;
+};
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    bool swapped; /* file byte order differs from ours */
+    bool nsec;    /* timestamps in nanoseconds         */
+    uint32_t snaplen;
+    uint32_t linktype;
+} rtp_decoder_map_t;
+
+static uint32_t rtp_decoder_map_u32(const rtp_decoder_map_t *map,
+                                    const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    if (map->swapped) {
+        v = ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) |
+            (v >> 24);
+    }
+    return v;
+}
 
-    memcpy((void *)&message, rtp_packet, hdr->caplen - dcdr->rtp_offset);
-    pktsize = hdr->caplen - dcdr->rtp_offset;
+/*
+ * rtp_decoder_map_open() maps the capture file and checks its header,
+ * only the classic pcap format is understood
+ */
+static bool rtp_decoder_map_open(rtp_decoder_map_t *map, const char *path)
+{
+    struct stat st;
+    uint32_t magic;
+    void *data;
+    int fd;
 
-    if (pktsize < 0) {
-        return;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: failed to open '%s'\n", path);
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < PCAP_FILE_HDR_LEN) {
+        fprintf(stderr, "error: '%s' is not a pcap file\n", path);
+        close(fd);
+        return false;
     }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "error: failed to map '%s'\n", path);
+        return false;
+    }
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    map->data = data;
+    map->len = (size_t)st.st_size;
+    map->swapped = false;
+    magic = rtp_decoder_map_u32(map, map->data);
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        map->swapped = true;
+        magic = rtp_decoder_map_u32(map, map->data);
+    }
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        fprintf(stderr,
+                "error: '%s' is not a pcap file, captures in other "
+                "formats can only be decoded without -j\n",
+                path);
+        munmap(data, map->len);
+        return false;
+    }
+    map->nsec = magic == PCAP_MAGIC_NSEC;
+    map->snaplen = rtp_decoder_map_u32(map, map->data + 16);
+    map->linktype = rtp_decoder_map_u32(map, map->data + 20);
+
+    return true;
+}
 
-    octets_recvd = pktsize;
+/*
+ * rtp_decoder_map_next() reads the frame at *offset into hdr and data and
+ * advances *offset, it returns false at the end of the file
+ */
+static bool rtp_decoder_map_next(const rtp_decoder_map_t *map,
+                                 size_t *offset,
+                                 struct pcap_pkthdr *hdr,
+                                 const uint8_t **data)
+{
+    const uint8_t *rec = map->data + *offset;
+    uint32_t frac;
+
+    if (map->len - *offset < PCAP_RECORD_HDR_LEN) {
+        return false;
+    }
+    hdr->ts.tv_sec = rtp_decoder_map_u32(map, rec);
+    frac = rtp_decoder_map_u32(map, rec + 4);
+    hdr->ts.tv_usec = map->nsec ? frac / 1000 : frac;
+    hdr->caplen = rtp_decoder_map_u32(map, rec + 8);
+    hdr->len = rtp_decoder_map_u32(map, rec + 12);
+    if (hdr->caplen > map->len - *offset - PCAP_RECORD_HDR_LEN) {
+        fprintf(stderr, "warning: capture truncated in the last frame\n");
+        return false;
+    }
+    *data = rec + PCAP_RECORD_HDR_LEN;
+    *offset += PCAP_RECORD_HDR_LEN + hdr->caplen;
+
+    return true;
+}
 
-    if (dcdr->mode == mode_rtp) {
-        rtp = true;
-    } else if (dcdr->mode == mode_rtcp) {
-        rtp = false;
+/*
+ * rtp_decoder_shard() selects the worker for a frame by the SSRC of the
+ * packet it carries, frames too short to have one all go to the first
+ */
+static size_t rtp_decoder_shard(const rtp_decoder_pool_t *pool,
+                                const uint8_t *data,
+                                size_t caplen)
+{
+    const uint8_t *packet = data + pool->rtp_offset;
+    size_t len;
+    uint32_t ssrc;
+
+    if (caplen < pool->rtp_offset + 12) {
+        return 0;
+    }
+    len = caplen - pool->rtp_offset;
+    if (rtp_decoder_is_rtp(pool->mode, packet, len)) {
+        memcpy(&ssrc, packet + 8, sizeof(ssrc));
     } else {
-        rtp = true;
-        if (octets_recvd >= 2) {
-            /* rfc5761 */
-            u_char payload_type = *(bytes + dcdr->rtp_offset + 1) & 0x7f;
-            rtp = payload_type < 64 || payload_type > 95;
+        memcpy(&ssrc, packet + 4, sizeof(ssrc));
+    }
+
+    return ((ssrc * 2654435761u) >> 16) % pool->num_workers;
+}
+
+/*
+ * rtp_decoder_format() writes the same text as rtp_decoder_handle_pkt()
+ * for a packet into out, which must have room for
+ * RTP_DECODER_TEXT_LEN(size) characters
+ */
+#define RTP_DECODER_TEXT_LEN(size) (64 + ((size) + 15) / 16 * 72)
+
+static size_t rtp_decoder_format(char *out,
+                                 const struct timeval *delta,
+                                 const void *ptr,
+                                 size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *cptr = ptr;
+    char *p = out;
+
+    p += sprintf(p, "%02ld:%02d.%06ld\n", (long)(delta->tv_sec / 60),
+                 (int)(delta->tv_sec % 60), (long)delta->tv_usec);
+    for (size_t i = 0; i < size; i += 16) {
+        p += sprintf(p, "%04zx ", i);
+        for (size_t j = 0; j < 16 && i + j < size; j++) {
+            *p++ = hex[cptr[i + j] >> 4];
+            *p++ = hex[cptr[i + j] & 0xf];
+            *p++ = ' ';
         }
+        *p++ = '\n';
     }
 
-    if (rtp) {
-        /* verify rtp header */
-        if (message.header.version != 2) {
-            return;
+    return (size_t)(p - out);
+}
+
+static void rtp_decoder_decode_slot(rtp_decoder_worker_t *w,
+                                    rtp_decoder_slot_t *slot)
+{
+    struct timeval delta;
+    size_t len;
+
+    slot->text_len = 0;
+    if (!rtp_decoder_decode(w->dec, slot->data, slot->caplen, &w->message,
+                            &len)) {
+        return;
+    }
+
+    if (slot->text_cap < RTP_DECODER_TEXT_LEN(len)) {
+        char *text = realloc(slot->text, RTP_DECODER_TEXT_LEN(len));
+        if (text == NULL) {
+            fprintf(stderr, "error: malloc() failed\n");
+            exit(1);
         }
+        slot->text = text;
+        slot->text_cap = RTP_DECODER_TEXT_LEN(len);
+    }
 
-        status =
-            srtp_unprotect(dcdr->srtp_ctx, (uint8_t *)&message, octets_recvd,
-                           (uint8_t *)&message, &octets_recvd);
-        if (status) {
-            dcdr->error_cnt++;
-            return;
+    timersub(&slot->ts, &w->pool->start_tv, &delta);
+    slot->text_len = rtp_decoder_format(slot->text, &delta, &w->message, len);
+}
+
+/*
+ * a worker takes all queued frames at once, so the lock is only taken
+ * once per batch rather than once per frame
+ */
+static void *rtp_decoder_worker_run(void *arg)
+{
+    rtp_decoder_worker_t *w = arg;
+    rtp_decoder_pool_t *pool = w->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        size_t end = w->tail;
+
+        if (w->head == end) {
+            if (pool->eof) {
+                break;
+            }
+            pthread_cond_wait(&w->work, &pool->lock);
+            continue;
         }
-        dcdr->rtp_cnt++;
-    } else {
-        status = srtp_unprotect_rtcp(dcdr->srtp_ctx, (uint8_t *)&message,
-                                     octets_recvd, (uint8_t *)&message,
-                                     &octets_recvd);
-        if (status) {
-            dcdr->error_cnt++;
-            return;
+        pthread_mutex_unlock(&pool->lock);
+
+        for (size_t i = w->head; i != end; i++) {
+            size_t frame = w->queue[i % RTP_DECODER_RING_SIZE];
+            rtp_decoder_decode_slot(
+                w, &pool->slots[frame % RTP_DECODER_RING_SIZE]);
         }
-        dcdr->rtcp_cnt++;
+
+        pthread_mutex_lock(&pool->lock);
+        for (size_t i = w->head; i != end; i++) {
+            size_t frame = w->queue[i % RTP_DECODER_RING_SIZE];
+            pool->slots[frame % RTP_DECODER_RING_SIZE].done = true;
+        }
+        w->head = end;
+        pthread_cond_signal(&pool->slot_done);
     }
-    timersub(&hdr->ts, &dcdr->start_tv, &delta);
-    fprintf(stdout, "%02ld:%02d.%06ld\n", (long)(delta.tv_sec / 60),
-            (int)(delta.tv_sec % 60), (long)delta.tv_usec);
-    hexdump(&message, octets_recvd);
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
 }
+
+/*
+ * the writer outputs every run of consecutive decoded frames, a frame
+ * whose worker is still busy holds back the ones behind it
+ */
+static void *rtp_decoder_writer_run(void *arg)
+{
+    rtp_decoder_pool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        size_t begin = pool->num_written;
+        size_t end = begin;
+
+        while (end != pool->num_read &&
+               pool->slots[end % RTP_DECODER_RING_SIZE].done) {
+            end++;
+        }
+        if (end == begin) {
+            if (pool->eof && begin == pool->num_read) {
+                break;
+            }
+            pthread_cond_wait(&pool->slot_done, &pool->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        for (size_t i = begin; i != end; i++) {
+            rtp_decoder_slot_t *slot = &pool->slots[i % RTP_DECODER_RING_SIZE];
+            fwrite(slot->text, 1, slot->text_len, stdout);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        for (size_t i = begin; i != end; i++) {
+            pool->slots[i % RTP_DECODER_RING_SIZE].done = false;
+        }
+        pool->num_written = end;
+        pthread_cond_signal(&pool->slot_free);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/*
+ * rtp_decoder_dispatch() queues a frame for its worker, waiting for the
+ * writer if the ring is full
+ */
+static void rtp_decoder_dispatch(rtp_decoder_pool_t *pool,
+                                 const struct pcap_pkthdr *hdr,
+                                 const uint8_t *data)
+{
+    rtp_decoder_worker_t *w =
+        &pool->workers[rtp_decoder_shard(pool, data, hdr->caplen)];
+    rtp_decoder_slot_t *slot;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->num_read - pool->num_written == RTP_DECODER_RING_SIZE) {
+        pthread_cond_wait(&pool->slot_free, &pool->lock);
+    }
+    if (pool->num_read == 0) {
+        pool->start_tv = hdr->ts;
+    }
+    slot = &pool->slots[pool->num_read % RTP_DECODER_RING_SIZE];
+    slot->data = data;
+    slot->caplen = hdr->caplen;
+    slot->ts = hdr->ts;
+    slot->done = false;
+
+    if (w->head == w->tail) {
+        pthread_cond_signal(&w->work);
+    }
+    w->queue[w->tail % RTP_DECODER_RING_SIZE] = pool->num_read;
+    w->tail++;
+    pool->num_read++;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int rtp_decoder_run_parallel(const char *pcap_file,
+                             const char *filter_exp,
+                             size_t num_threads,
+                             srtp_policy_t policy,
+                             rtp_decoder_mode_t mode,
+                             size_t rtp_packet_offset,
+                             uint32_t ssrc,
+                             uint32_t roc)
+{
+    rtp_decoder_pool_t *pool;
+    rtp_decoder_map_t map;
+    struct bpf_program fp;
+    bool use_filter = filter_exp[0] != '\0';
+    struct pcap_pkthdr hdr;
+    const uint8_t *data;
+    size_t offset = PCAP_FILE_HDR_LEN;
+    pthread_t writer;
+    struct timeval start;
+    size_t rtp_cnt = 0, rtcp_cnt = 0, error_cnt = 0;
+
+    if (strcmp(pcap_file, "-") == 0) {
+        fprintf(stderr, "error: decoding with -j needs a pcap file (-p)\n");
+        return 1;
+    }
+    if (!rtp_decoder_map_open(&map, pcap_file)) {
+        return 1;
+    }
+
+    if (use_filter) {
+        pcap_t *dead = pcap_open_dead((int)map.linktype, (int)map.snaplen);
+        if (dead == NULL ||
+            pcap_compile(dead, &fp, filter_exp, 1, PCAP_NETMASK_UNKNOWN) ==
+                -1) {
+            fprintf(stderr, "Couldn't parse filter %s\n", filter_exp);
+            return 2;
+        }
+        pcap_close(dead);
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool != NULL) {
+        pool->workers = calloc(num_threads, sizeof(*pool->workers));
+    }
+    if (pool == NULL || pool->workers == NULL) {
+        fprintf(stderr, "error: malloc() failed\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->slot_free, NULL);
+    pthread_cond_init(&pool->slot_done, NULL);
+    pool->mode = mode;
+    pool->rtp_offset = rtp_packet_offset;
+    pool->num_workers = num_threads;
+
+    fprintf(stderr, "Starting decoder with %zu threads\n", num_threads);
+    gettimeofday(&start, NULL);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        rtp_decoder_worker_t *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->dec = rtp_decoder_alloc();
+        if (w->dec == NULL) {
+            fprintf(stderr, "error: malloc() failed\n");
+            exit(1);
+        }
+        if (rtp_decoder_init(w->dec, policy, mode, rtp_packet_offset, ssrc,
+                             roc)) {
+            fprintf(stderr, "error: init failed\n");
+            exit(1);
+        }
+        pthread_cond_init(&w->work, NULL);
+        if (pthread_create(&w->thread, NULL, rtp_decoder_worker_run, w)) {
+            fprintf(stderr, "error: failed to start thread\n");
+            exit(1);
+        }
+    }
+    if (pthread_create(&writer, NULL, rtp_decoder_writer_run, pool)) {
+        fprintf(stderr, "error: failed to start thread\n");
+        exit(1);
+    }
+
+    while (rtp_decoder_map_next(&map, &offset, &hdr, &data)) {
+        if (use_filter && !pcap_offline_filter(&fp, &hdr, data)) {
+            continue;
+        }
+        rtp_decoder_dispatch(pool, &hdr, data);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->eof = true;
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_cond_signal(&pool->workers[i].work);
+    }
+    pthread_cond_signal(&pool->slot_done);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        rtp_decoder_worker_t *w = &pool->workers[i];
+
+        pthread_join(w->thread, NULL);
+        rtp_cnt += w->dec->rtp_cnt;
+        rtcp_cnt += w->dec->rtcp_cnt;
+        error_cnt += w->dec->error_cnt;
+    }
+    pthread_join(writer, NULL);
+    fflush(stdout);
+
+    if (mode == mode_rtp || mode == mode_rtcp_mux) {
+        fprintf(stderr, "RTP packets decoded: %zu\n", rtp_cnt);
+    }
+    if (mode == mode_rtcp || mode == mode_rtcp_mux) {
+        fprintf(stderr, "RTCP packets decoded: %zu\n", rtcp_cnt);
+    }
+    fprintf(stderr, "Packet decode errors: %zu\n", error_cnt);
+    rtp_decoder_report_rate(pool->num_read, &start);
+
+    /* the policy is shared, it is destroyed with the first decoder */
+    for (size_t i = 0; i < num_threads; i++) {
+        rtp_decoder_worker_t *w = &pool->workers[i];
+
+        if (i != 0) {
+            w->dec->policy = NULL;
+        }
+        rtp_decoder_deinit(w->dec);
+        rtp_decoder_dealloc(w->dec);
+        pthread_cond_destroy(&w->work);
+    }
+    for (size_t i = 0; i < RTP_DECODER_RING_SIZE; i++) {
+        free(pool->slots[i].text);
+    }
+    pthread_cond_destroy(&pool->slot_done);
+    pthread_cond_destroy(&pool->slot_free);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+
+    if (use_filter) {
+        pcap_freecode(&fp);
+    }
+    munmap((void *)map.data, map.len);
+
+    return 0;
+}
+
+#else
+
+int rtp_decoder_run_parallel(const char *pcap_file,
+                             const char *filter_exp,
+                             size_t num_threads,
+                             srtp_policy_t policy,
+                             rtp_decoder_mode_t mode,
+                             size_t rtp_packet_offset,
+                             uint32_t ssrc,
+                             uint32_t roc)
+{
+    (void)pcap_file;
+    (void)filter_exp;
+    (void)num_threads;
+    (void)mode;
+    (void)rtp_packet_offset;
+    (void)ssrc;
+    (void)roc;
+    srtp_policy_destroy(policy);
+    fprintf(stderr, "error: -j is not supported on this platform\n");
+    return 1;
+}
+
+#endif /* RTP_DECODER_PARALLEL */
@@ -116,4 +116,18 @@ void rtp_decoder_srtp_log_handler(srtp_log_level_t level,
                                   const char *msg,
                                   void *data);
 
+/*
+ * decodes the capture file pcap_file with num_threads threads, the
+ * packets are split between the threads by SSRC and output in capture
+ * order; the policy is destroyed when done, returns the exit code
+ */
+int rtp_decoder_run_parallel(const char *pcap_file,
+                             const char *filter_exp,
+                             size_t num_threads,
+                             srtp_policy_t policy,
+                             rtp_decoder_mode_t mode,
+                             size_t rtp_packet_offset,
+                             uint32_t ssrc,
+                             uint32_t roc);
+
 #endif /* RTP_DECODER_H */
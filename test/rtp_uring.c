@@ -0,0 +1,871 @@
+/*
+ * rtp_uring.c
+ *
+ * SRTP packet pipeline driven by io_uring: packets protected in batches
+ * are sent from registered buffers over a loopback UDP socket pair, and
+ * received with a multishot receive into a ring of provided buffers,
+ * then unprotected in batches as their completions arrive. The time
+ * spent in each stage is reported as a latency histogram, to tell
+ * whether crypto or I/O bounds the packet rate.
+ *
+ * The ring is set up with the raw system calls so that liburing is not
+ * needed, only the kernel headers.
+ *
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>  /* for printf()          */
+#include <stdlib.h> /* for malloc(), atoi()  */
+#include <string.h> /* for memcpy()          */
+#include <time.h>   /* for clock_gettime()   */
+
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "getopt_s.h"
+#include "srtp.h"
+
+/* size of a send or receive buffer, room for a packet and its trailer */
+#define URING_BUF_LEN 2048
+
+/* number of provided receive buffers, a power of two */
+#define URING_NUM_RECV_BUFS 1024
+
+#define URING_BUF_GROUP 0
+
+#define URING_MAX_PAYLOAD 1400
+
+/* payload prefix holding the time the packet was built */
+#define URING_STAMP_LEN 8
+
+/* how long to wait for a packet before counting the missing ones lost */
+#define URING_TIMEOUT_NS 100000000LL
+
+/* kinds of completions, stored in the upper half of the user data */
+#define URING_OP_SEND 1ULL
+#define URING_OP_RECV 2ULL
+
+static const uint8_t uring_key[46] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0, 0xd6, 0x4f, 0xa3, 0x2c,
+    0x06, 0xde, 0x41, 0x39, 0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73, 0xc3, 0x17, 0xf2, 0xda,
+    0xbe, 0x35, 0x77, 0x93, 0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+/*
+ * uring_t holds the mapped submission and completion queues
+ */
+typedef struct {
+    int fd;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    struct io_uring_cqe *cqes;
+    unsigned cq_mask;
+    unsigned to_submit;
+} uring_t;
+
+/*
+ * uring_hist_t is a histogram of latencies in nanoseconds, bucket i
+ * counting the samples below 2^i ns
+ */
+#define URING_HIST_BUCKETS 40
+
+typedef struct {
+    const char *name;
+    uint64_t count;
+    uint64_t max;
+    uint64_t bucket[URING_HIST_BUCKETS];
+} uring_hist_t;
+
+enum {
+    stage_protect,     /* srtp_protect_batch(), per packet           */
+    stage_send,        /* submission to completion of the send       */
+    stage_transit,     /* built to its receive completion was reaped */
+    stage_unprotect,   /* srtp_unprotect_batch(), per packet         */
+    stage_end_to_end,  /* built to unprotected                       */
+    num_stages
+};
+
+typedef struct {
+    size_t num_ssrcs;
+    size_t num_packets;
+    size_t payload_len;
+    size_t batch_size;
+    size_t depth; /* send buffers, and so packets in flight */
+    bool gcm;
+} uring_params_t;
+
+typedef struct {
+    uring_params_t params;
+    uring_t ring;
+    int send_sock;
+    int recv_sock;
+    srtp_t sender;
+    srtp_t receiver;
+
+    /* send buffers, registered with the ring */
+    uint8_t *send_bufs;
+    uint64_t *send_time;
+    size_t *free_slots;
+    size_t num_free;
+
+    /* provided receive buffers */
+    uint8_t *recv_bufs;
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_len;
+    unsigned short buf_tail;
+    bool recv_armed;
+
+    /* receive completions waiting to be unprotected */
+    srtp_packet_desc_t *pkts;
+    uint64_t *recv_time;
+    unsigned short *recv_bid;
+    size_t num_pkts;
+
+    uint16_t *seq;
+    size_t num_built;
+    size_t num_sent;
+    size_t num_received;
+    size_t num_invalid;
+    size_t num_lost;
+    size_t num_send_errors;
+
+    uring_hist_t hist[num_stages];
+} uring_harness_t;
+
+static uint64_t uring_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void uring_hist_add(uring_hist_t *hist, uint64_t ns)
+{
+    size_t i = 0;
+
+    while (i < URING_HIST_BUCKETS - 1 && ns >= (1ULL << i)) {
+        i++;
+    }
+    hist->bucket[i]++;
+    hist->count++;
+    if (ns > hist->max) {
+        hist->max = ns;
+    }
+}
+
+/*
+ * uring_hist_percentile() returns the upper bound of the bucket holding
+ * the given percentile
+ */
+static uint64_t uring_hist_percentile(const uring_hist_t *hist, double pct)
+{
+    uint64_t rank = (uint64_t)((double)hist->count * pct / 100.0);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < URING_HIST_BUCKETS; i++) {
+        seen += hist->bucket[i];
+        if (seen > rank) {
+            return 1ULL << i;
+        }
+    }
+    return hist->max;
+}
+
+static void uring_hist_print(const uring_hist_t *hist)
+{
+    printf("%s: %llu samples, p50 < %llu ns, p99 < %llu ns, max %llu ns\n",
+           hist->name, (unsigned long long)hist->count,
+           (unsigned long long)uring_hist_percentile(hist, 50),
+           (unsigned long long)uring_hist_percentile(hist, 99),
+           (unsigned long long)hist->max);
+    for (size_t i = 0; i < URING_HIST_BUCKETS; i++) {
+        if (hist->bucket[i] != 0) {
+            printf("  < %12llu ns %10llu\n", 1ULL << i,
+                   (unsigned long long)hist->bucket[i]);
+        }
+    }
+}
+
+/*
+ * ring setup and submission
+ */
+
+static int uring_setup(uring_t *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    bool single_mmap;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = 4 * URING_NUM_RECV_BUFS;
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (single_mmap && ring->cq_len > ring->sq_len) {
+        ring->sq_len = ring->cq_len;
+    }
+
+    ring->sq_ptr =
+        mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        return -1;
+    }
+    if (single_mmap) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr =
+            mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            return -1;
+        }
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    ring->sq_head = (unsigned *)((uint8_t *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned *)((uint8_t *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_array = (unsigned *)((uint8_t *)ring->sq_ptr + p.sq_off.array);
+    ring->sq_mask = *(unsigned *)((uint8_t *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_entries = p.sq_entries;
+    ring->cq_head = (unsigned *)((uint8_t *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((uint8_t *)ring->cq_ptr + p.cq_off.tail);
+    ring->cqes = (struct io_uring_cqe *)((uint8_t *)ring->cq_ptr +
+                                         p.cq_off.cqes);
+    ring->cq_mask = *(unsigned *)((uint8_t *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->to_submit = 0;
+
+    return 0;
+}
+
+static void uring_teardown(uring_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+/*
+ * uring_enter() submits the queued entries and waits for min_complete
+ * completions, or at most timeout_ns if that is not zero
+ */
+static int uring_enter(uring_t *ring,
+                       unsigned min_complete,
+                       long long timeout_ns)
+{
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void *argp = NULL;
+    size_t argsz = 0;
+    int ret;
+
+    if (min_complete != 0 && timeout_ns != 0) {
+        ts.tv_sec = timeout_ns / 1000000000LL;
+        ts.tv_nsec = timeout_ns % 1000000000LL;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        argp = &arg;
+        argsz = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit,
+                       min_complete, flags, argp, argsz);
+    if (ret >= 0) {
+        ring->to_submit = 0;
+    }
+    return ret;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - head >= ring->sq_entries) {
+        if (uring_enter(ring, 0, 0) < 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+
+    return sqe;
+}
+
+/*
+ * harness
+ */
+
+static void uring_fail(const char *what)
+{
+    fprintf(stderr, "error: %s failed: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static void uring_provide_buffer(uring_harness_t *h, unsigned short bid)
+{
+    struct io_uring_buf *buf =
+        &h->buf_ring->bufs[h->buf_tail & (URING_NUM_RECV_BUFS - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(h->recv_bufs + bid * URING_BUF_LEN);
+    buf->len = URING_BUF_LEN;
+    buf->bid = bid;
+    h->buf_tail++;
+}
+
+static void uring_publish_buffers(uring_harness_t *h)
+{
+    __atomic_store_n(&h->buf_ring->tail, h->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_arm_recv(uring_harness_t *h)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&h->ring);
+
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = h->recv_sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = URING_OP_RECV << 32;
+    h->recv_armed = true;
+}
+
+static void uring_open_sockets(uring_harness_t *h)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int bufsize = 4 * 1024 * 1024;
+
+    h->recv_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    h->send_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (h->recv_sock < 0 || h->send_sock < 0) {
+        uring_fail("socket()");
+    }
+    setsockopt(h->recv_sock, SOL_SOCKET, SO_RCVBUF, &bufsize,
+               sizeof(bufsize));
+    setsockopt(h->send_sock, SOL_SOCKET, SO_SNDBUF, &bufsize,
+               sizeof(bufsize));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(h->recv_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(h->recv_sock, (struct sockaddr *)&addr, &addr_len) < 0) {
+        uring_fail("bind()");
+    }
+    if (connect(h->send_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        uring_fail("connect()");
+    }
+}
+
+static srtp_t uring_create_session(const uring_params_t *params,
+                                   srtp_ssrc_type_t ssrc_type)
+{
+    srtp_profile_t profile = params->gcm ? srtp_profile_aead_aes_128_gcm
+                                         : srtp_profile_aes128_cm_sha1_80;
+    srtp_policy_t policy;
+    srtp_t session;
+    size_t key_len = srtp_profile_get_master_key_length(profile);
+    size_t salt_len = srtp_profile_get_master_salt_length(profile);
+
+    if (srtp_policy_create(&policy) ||
+        srtp_policy_set_profile(policy, profile) ||
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_type, 0 }) ||
+        srtp_policy_add_key(policy, uring_key, key_len, uring_key + key_len,
+                            salt_len, NULL, 0) ||
+        srtp_create(&session, policy)) {
+        fprintf(stderr, "error: failed to create srtp session\n");
+        exit(1);
+    }
+    srtp_policy_destroy(policy);
+
+    return session;
+}
+
+static void uring_harness_init(uring_harness_t *h,
+                               const uring_params_t *params)
+{
+    size_t depth = params->depth;
+    struct io_uring_buf_reg reg;
+    struct iovec *iovs;
+    static const char *stage_names[num_stages] = {
+        "protect", "send", "transit", "unprotect", "end to end"
+    };
+
+    memset(h, 0, sizeof(*h));
+    h->params = *params;
+    for (size_t i = 0; i < num_stages; i++) {
+        h->hist[i].name = stage_names[i];
+    }
+
+    if (uring_setup(&h->ring, (unsigned)(2 * depth + 8)) < 0) {
+        uring_fail("io_uring_setup()");
+    }
+    uring_open_sockets(h);
+    h->sender = uring_create_session(params, ssrc_any_outbound);
+    h->receiver = uring_create_session(params, ssrc_any_inbound);
+
+    /* send buffers are registered once, and written with WRITE_FIXED */
+    h->send_bufs = malloc(depth * URING_BUF_LEN);
+    h->send_time = calloc(depth, sizeof(*h->send_time));
+    h->free_slots = calloc(depth, sizeof(*h->free_slots));
+    iovs = calloc(depth, sizeof(*iovs));
+    h->recv_bufs = malloc(URING_NUM_RECV_BUFS * URING_BUF_LEN);
+    h->pkts = calloc(URING_NUM_RECV_BUFS, sizeof(*h->pkts));
+    h->recv_time = calloc(URING_NUM_RECV_BUFS, sizeof(*h->recv_time));
+    h->recv_bid = calloc(URING_NUM_RECV_BUFS, sizeof(*h->recv_bid));
+    h->seq = calloc(params->num_ssrcs, sizeof(*h->seq));
+    if (h->send_bufs == NULL || h->send_time == NULL ||
+        h->free_slots == NULL || iovs == NULL || h->recv_bufs == NULL ||
+        h->pkts == NULL || h->recv_time == NULL || h->recv_bid == NULL ||
+        h->seq == NULL) {
+        fprintf(stderr, "error: malloc() failed\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < depth; i++) {
+        iovs[i].iov_base = h->send_bufs + i * URING_BUF_LEN;
+        iovs[i].iov_len = URING_BUF_LEN;
+        h->free_slots[i] = depth - 1 - i;
+    }
+    h->num_free = depth;
+    if (syscall(__NR_io_uring_register, h->ring.fd, IORING_REGISTER_BUFFERS,
+                iovs, (unsigned)depth) < 0) {
+        uring_fail("IORING_REGISTER_BUFFERS");
+    }
+    free(iovs);
+
+    /* the kernel picks the receive buffers from this ring */
+    h->buf_ring_len = URING_NUM_RECV_BUFS * sizeof(struct io_uring_buf);
+    h->buf_ring = mmap(NULL, h->buf_ring_len, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (h->buf_ring == MAP_FAILED) {
+        uring_fail("mmap()");
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)h->buf_ring;
+    reg.ring_entries = URING_NUM_RECV_BUFS;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, h->ring.fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+        uring_fail("IORING_REGISTER_PBUF_RING");
+    }
+    for (unsigned short bid = 0; bid < URING_NUM_RECV_BUFS; bid++) {
+        uring_provide_buffer(h, bid);
+    }
+    uring_publish_buffers(h);
+
+    uring_arm_recv(h);
+}
+
+static void uring_harness_deinit(uring_harness_t *h)
+{
+    uring_teardown(&h->ring);
+    munmap(h->buf_ring, h->buf_ring_len);
+    close(h->send_sock);
+    close(h->recv_sock);
+    srtp_dealloc(h->sender);
+    srtp_dealloc(h->receiver);
+    free(h->seq);
+    free(h->recv_bid);
+    free(h->recv_time);
+    free(h->pkts);
+    free(h->recv_bufs);
+    free(h->free_slots);
+    free(h->send_time);
+    free(h->send_bufs);
+}
+
+/*
+ * uring_build() writes the next packet into buf, each SSRC sends a run
+ * of four packets before the next one takes over
+ */
+static size_t uring_build(uring_harness_t *h, uint8_t *buf, uint64_t now)
+{
+    size_t index = (h->num_built / 4) % h->params.num_ssrcs;
+    uint16_t seq = htons(h->seq[index]++);
+    uint32_t ts = htonl((uint32_t)h->num_built);
+    uint32_t ssrc = htonl(0x10000 + (uint32_t)index);
+
+    buf[0] = 0x80;
+    buf[1] = 0x01;
+    memcpy(buf + 2, &seq, sizeof(seq));
+    memcpy(buf + 4, &ts, sizeof(ts));
+    memcpy(buf + 8, &ssrc, sizeof(ssrc));
+    memcpy(buf + 12, &now, sizeof(now));
+    memset(buf + 12 + URING_STAMP_LEN, 0xab,
+           h->params.payload_len - URING_STAMP_LEN);
+    h->num_built++;
+
+    return 12 + h->params.payload_len;
+}
+
+/*
+ * uring_send_batch() protects a batch of packets with one call to
+ * srtp_protect_batch() and queues their sends
+ */
+static void uring_send_batch(uring_harness_t *h)
+{
+    srtp_packet_desc_t pkts[256];
+    size_t slots[256];
+    size_t n = h->params.batch_size;
+    uint64_t start, end;
+
+    if (n > h->num_free) {
+        n = h->num_free;
+    }
+    if (n > h->params.num_packets - h->num_built) {
+        n = h->params.num_packets - h->num_built;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    start = uring_now_ns();
+    for (size_t i = 0; i < n; i++) {
+        uint8_t *buf;
+
+        slots[i] = h->free_slots[--h->num_free];
+        buf = h->send_bufs + slots[i] * URING_BUF_LEN;
+        pkts[i].in = buf;
+        pkts[i].in_len = uring_build(h, buf, start);
+        pkts[i].out = buf;
+        pkts[i].out_len = URING_BUF_LEN;
+        pkts[i].mki_index = 0;
+    }
+    srtp_protect_batch(h->sender, pkts, n);
+    end = uring_now_ns();
+    uring_hist_add(&h->hist[stage_protect], (end - start) / n);
+
+    for (size_t i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe;
+
+        if (pkts[i].status || (sqe = uring_get_sqe(&h->ring)) == NULL) {
+            h->num_send_errors++;
+            h->free_slots[h->num_free++] = slots[i];
+            continue;
+        }
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = h->send_sock;
+        sqe->addr = (uint64_t)(uintptr_t)pkts[i].out;
+        sqe->len = (uint32_t)pkts[i].out_len;
+        sqe->off = (uint64_t)-1;
+        sqe->buf_index = (uint16_t)slots[i];
+        sqe->user_data = (URING_OP_SEND << 32) | slots[i];
+        h->send_time[slots[i]] = end;
+        h->num_sent++;
+    }
+}
+
+/*
+ * uring_unprotect_pending() unprotects the packets received since the
+ * last call with one call to srtp_unprotect_batch() and returns their
+ * buffers to the kernel
+ */
+static void uring_unprotect_pending(uring_harness_t *h)
+{
+    size_t done = 0;
+
+    while (done < h->num_pkts) {
+        size_t n = h->num_pkts - done;
+        uint64_t start, end;
+
+        if (n > h->params.batch_size) {
+            n = h->params.batch_size;
+        }
+        start = uring_now_ns();
+        srtp_unprotect_batch(h->receiver, h->pkts + done, n);
+        end = uring_now_ns();
+        uring_hist_add(&h->hist[stage_unprotect], (end - start) / n);
+
+        for (size_t i = done; i < done + n; i++) {
+            srtp_packet_desc_t *pkt = &h->pkts[i];
+            uint64_t built;
+
+            if (pkt->status || pkt->out_len < 12 + URING_STAMP_LEN) {
+                h->num_invalid++;
+            } else {
+                memcpy(&built, pkt->out + 12, sizeof(built));
+                uring_hist_add(&h->hist[stage_transit],
+                               h->recv_time[i] - built);
+                uring_hist_add(&h->hist[stage_end_to_end], end - built);
+                h->num_received++;
+            }
+            uring_provide_buffer(h, h->recv_bid[i]);
+        }
+        done += n;
+    }
+    h->num_pkts = 0;
+    uring_publish_buffers(h);
+}
+
+/*
+ * uring_reap() handles all available completions, it returns the number
+ * of completions seen
+ */
+static size_t uring_reap(uring_harness_t *h)
+{
+    uring_t *ring = &h->ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    uint64_t now = uring_now_ns();
+    size_t seen = 0;
+
+    for (; head != tail; head++, seen++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        uint64_t op = cqe->user_data >> 32;
+
+        if (op == URING_OP_SEND) {
+            size_t slot = (size_t)(cqe->user_data & 0xffffffff);
+
+            if (cqe->res < 0) {
+                h->num_send_errors++;
+            }
+            uring_hist_add(&h->hist[stage_send], now - h->send_time[slot]);
+            h->free_slots[h->num_free++] = slot;
+        } else if (op == URING_OP_RECV) {
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                h->recv_armed = false;
+            }
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                unsigned short bid =
+                    (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                uint8_t *buf = h->recv_bufs + bid * URING_BUF_LEN;
+                srtp_packet_desc_t *pkt = &h->pkts[h->num_pkts];
+
+                pkt->in = buf;
+                pkt->in_len = (size_t)cqe->res;
+                pkt->out = buf;
+                pkt->out_len = (size_t)cqe->res;
+                h->recv_time[h->num_pkts] = now;
+                h->recv_bid[h->num_pkts] = bid;
+                h->num_pkts++;
+            } else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+                errno = -cqe->res;
+                uring_fail("receive");
+            }
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return seen;
+}
+
+static void uring_run(uring_harness_t *h)
+{
+    const uring_params_t *params = &h->params;
+
+    while (h->num_received + h->num_invalid + h->num_lost <
+           params->num_packets) {
+        size_t in_flight = h->num_sent - h->num_received - h->num_invalid -
+                           h->num_lost - h->num_send_errors;
+        int ret;
+
+        /* keep the sends going while earlier packets are in flight */
+        while (h->num_built < params->num_packets && h->num_free != 0 &&
+               in_flight + params->batch_size <= params->depth) {
+            size_t sent = h->num_sent;
+
+            uring_send_batch(h);
+            in_flight += h->num_sent - sent;
+            if (h->num_sent == sent) {
+                break;
+            }
+        }
+
+        if (!h->recv_armed) {
+            uring_arm_recv(h);
+        }
+
+        ret = uring_enter(&h->ring, 1, URING_TIMEOUT_NS);
+        if (ret < 0 && errno != ETIME && errno != EINTR) {
+            uring_fail("io_uring_enter()");
+        }
+
+        if (uring_reap(h) == 0 && ret < 0 && errno == ETIME &&
+            h->num_built == params->num_packets) {
+            /* whatever has not arrived by now is not coming */
+            h->num_lost = h->num_sent - h->num_received - h->num_invalid -
+                          h->num_send_errors;
+            break;
+        }
+        uring_unprotect_pending(h);
+    }
+}
+
+static void usage(char *prog_name)
+{
+    printf("usage: %s [-n <ssrcs>] [-c <count>] [-z <size>] [-B <batch>]\n"
+           "       [-q <depth>] [-g]\n"
+           "where  -n <ssrcs> number of streams (default 16)\n"
+           "       -c <count> number of packets (default 1000000)\n"
+           "       -z <size> payload size in octets (default 160)\n"
+           "       -B <batch> packets per protect batch (default 32)\n"
+           "       -q <depth> packets in flight (default 256)\n"
+           "       -g use AES-GCM rather than AES-CM with HMAC-SHA1\n",
+           prog_name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uring_params_t params = { 16, 1000000, 160, 32, 256, false };
+    uring_harness_t harness;
+    uint64_t start, elapsed;
+    double secs;
+    int c;
+
+    while (1) {
+        c = getopt_s(argc, argv, "n:c:z:B:q:g");
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'n':
+            params.num_ssrcs = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'c':
+            params.num_packets = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'z':
+            params.payload_len = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'B':
+            params.batch_size = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'q':
+            params.depth = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'g':
+            params.gcm = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (params.num_ssrcs == 0 || params.num_packets == 0 ||
+        params.payload_len < URING_STAMP_LEN ||
+        params.payload_len > URING_MAX_PAYLOAD || params.batch_size == 0 ||
+        params.batch_size > 256 || params.depth < params.batch_size ||
+        params.depth > URING_NUM_RECV_BUFS) {
+        usage(argv[0]);
+    }
+
+    if (srtp_init()) {
+        fprintf(stderr, "error: srtp initialization failed\n");
+        exit(1);
+    }
+
+    printf("Using %s [0x%x]\n", srtp_get_version_string(), srtp_get_version());
+    printf("%zu packets of %zu octets on %zu streams, batches of %zu, "
+           "%zu in flight\n",
+           params.num_packets, params.payload_len, params.num_ssrcs,
+           params.batch_size, params.depth);
+
+    uring_harness_init(&harness, &params);
+    start = uring_now_ns();
+    uring_run(&harness);
+    elapsed = uring_now_ns() - start;
+    secs = (double)elapsed / 1e9;
+
+    printf("sent %zu, received %zu, invalid %zu, lost %zu, send errors %zu\n",
+           harness.num_sent, harness.num_received, harness.num_invalid,
+           harness.num_lost, harness.num_send_errors);
+    printf("%.3f s, %.0f packets/s\n", secs,
+           secs > 0 ? (double)harness.num_received / secs : 0.0);
+    for (size_t i = 0; i < num_stages; i++) {
+        uring_hist_print(&harness.hist[i]);
+    }
+
+    uring_harness_deinit(&harness);
+
+    if (srtp_shutdown()) {
+        fprintf(stderr, "error: srtp shutdown failed\n");
+        exit(1);
+    }
+
+    return harness.num_invalid == 0 && harness.num_send_errors == 0 ? 0 : 1;
+}
@@ -133,6 +133,32 @@ volatile int interrupted = 0;
 
 typedef enum { sender, receiver, unknown } program_type;
 
+/*
+ * load_params_t holds the options of the load generation mode, which is
+ * used instead of sending words when num_ssrcs is not zero
+ */
+typedef struct {
+    size_t num_ssrcs;
+    size_t num_packets; /* stop after this many packets, 0 for never */
+    size_t payload_len;
+    size_t batch_size;
+    bool segment;
+} load_params_t;
+
+/*
+ * run_load_sender(...) and run_load_receiver(...) send or receive
+ * packets in batches until interrupted, then report the packet rate
+ */
+void run_load_sender(rtp_sender_t snd,
+                     int sock,
+                     load_params_t *load_params,
+                     uint32_t ssrc);
+
+void run_load_receiver(rtp_receiver_t rcvr,
+                       int sock,
+                       load_params_t *load_params,
+                       uint32_t ssrc);
+
 int main(int argc, char *argv[])
 {
     char *dictfile = DICT_FILE;
@@ -164,6 +190,7 @@ int main(int argc, char *argv[])
     size_t expected_len;
     bool do_list_mods = false;
     uint32_t ssrc = 0xdeadbeef; /* ssrc value hardcoded for now */
+    load_params_t load_params = { 0, 0, 160, 32, false };
 #ifdef RTPW_USE_WINSOCK2
     WORD wVersionRequested = MAKEWORD(2, 0);
     WSADATA wsaData;
@@ -191,7 +218,7 @@ int main(int argc, char *argv[])
 
     /* check args */
     while (1) {
-        c = getopt_s(argc, argv, "b:k:rsgt:ae:ld:w:");
+        c = getopt_s(argc, argv, "b:k:rsgt:ae:ld:w:n:c:z:B:G");
         if (c == -1) {
             break;
         }
@@ -244,6 +271,32 @@ int main(int argc, char *argv[])
         case 'w':
             dictfile = optarg_s;
             break;
+        case 'n':
+            load_params.num_ssrcs = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'c':
+            load_params.num_packets = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'z':
+            load_params.payload_len = strtoul(optarg_s, NULL, 0);
+            if (load_params.payload_len > RTP_LOAD_MAX_PAYLOAD) {
+                printf("error: payload size must be at most %d (%zu)\n",
+                       RTP_LOAD_MAX_PAYLOAD, load_params.payload_len);
+                exit(1);
+            }
+            break;
+        case 'B':
+            load_params.batch_size = strtoul(optarg_s, NULL, 0);
+            if (load_params.batch_size == 0 ||
+                load_params.batch_size > RTP_LOAD_MAX_BATCH) {
+                printf("error: batch size must be 1 to %d (%zu)\n",
+                       RTP_LOAD_MAX_BATCH, load_params.batch_size);
+                exit(1);
+            }
+            break;
+        case 'G':
+            load_params.segment = true;
+            break;
         default:
             usage(argv[0]);
         }
@@ -383,9 +436,13 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
-        if (srtp_policy_set_ssrc(policy,
-                                 (srtp_ssrc_t){ ssrc_specific, ssrc }) !=
-            srtp_err_status_ok) {
+        /* the load generation mode has a stream for each of its SSRCs */
+        srtp_ssrc_t policy_ssrc = { ssrc_specific, ssrc };
+        if (load_params.num_ssrcs != 0) {
+            policy_ssrc.type =
+                prog_type == sender ? ssrc_any_outbound : ssrc_any_inbound;
+        }
+        if (srtp_policy_set_ssrc(policy, policy_ssrc) != srtp_err_status_ok) {
             fprintf(stderr, "error: failed to set SSRC in policy\n");
             exit(1);
         }
@@ -471,33 +528,38 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
-        /* open dictionary */
-        dict = fopen(dictfile, "r");
-        if (dict == NULL) {
-            fprintf(stderr, "%s: couldn't open file %s\n", argv[0], dictfile);
-            if (ADDR_IS_MULTICAST(rcvr_addr.s_addr)) {
-                leave_group(sock, mreq, argv[0]);
+        if (load_params.num_ssrcs != 0) {
+            run_load_sender(snd, sock, &load_params, ssrc);
+        } else {
+            /* open dictionary */
+            dict = fopen(dictfile, "r");
+            if (dict == NULL) {
+                fprintf(stderr, "%s: couldn't open file %s\n", argv[0],
+                        dictfile);
+                if (ADDR_IS_MULTICAST(rcvr_addr.s_addr)) {
+                    leave_group(sock, mreq, argv[0]);
+                }
+                exit(1);
             }
-            exit(1);
-        }
-
-        /* read words from dictionary, then send them off */
-        while (!interrupted && fgets(word, MAX_WORD_LEN, dict) != NULL) {
-            len = strlen(word) + 1; /* plus one for null */
 
-            if (len > MAX_WORD_LEN) {
-                printf("error: word %s too large to send\n", word);
-            } else {
-                rtp_sendto(snd, word, len);
-                printf("sending word: %s", word);
+            /* read words from dictionary, then send them off */
+            while (!interrupted && fgets(word, MAX_WORD_LEN, dict) != NULL) {
+                len = strlen(word) + 1; /* plus one for null */
+
+                if (len > MAX_WORD_LEN) {
+                    printf("error: word %s too large to send\n", word);
+                } else {
+                    rtp_sendto(snd, word, len);
+                    printf("sending word: %s", word);
+                }
+                usleep(USEC_RATE);
             }
-            usleep(USEC_RATE);
+
+            fclose(dict);
         }
 
         rtp_sender_deinit_srtp(snd);
         rtp_sender_dealloc(snd);
-
-        fclose(dict);
     } else { /* prog_type == receiver */
         rtp_receiver_t rcvr;
 
@@ -524,11 +586,15 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
-        /* get next word and loop */
-        while (!interrupted) {
-            len = MAX_WORD_LEN;
-            if (rtp_recvfrom(rcvr, word, &len) > -1) {
-                printf("\tword: %s\n", word);
+        if (load_params.num_ssrcs != 0) {
+            run_load_receiver(rcvr, sock, &load_params, ssrc);
+        } else {
+            /* get next word and loop */
+            while (!interrupted) {
+                len = MAX_WORD_LEN;
+                if (rtp_recvfrom(rcvr, word, &len) > -1) {
+                    printf("\tword: %s\n", word);
+                }
             }
         }
 
@@ -580,11 +646,113 @@ void usage(char *string)
            "       -r act as rtp receiver\n"
            "       -l list debug modules\n"
            "       -d <debug> turn on debugging for module <debug>\n"
-           "       -w <wordsfile> use <wordsfile> for input, rather than %s\n",
+           "       -w <wordsfile> use <wordsfile> for input, rather than %s\n"
+           "       -n <ssrcs> generate load with <ssrcs> streams instead of\n"
+           "          sending words\n"
+           "       -c <count> stop after <count> packets (load mode)\n"
+           "       -z <size> payload size in octets (load mode, default 160)\n"
+           "       -B <batch> packets per batch (load mode, default 32)\n"
+           "       -G use UDP segmentation offload and receive coalescing\n"
+           "          (load mode, Linux only)\n",
            string, string, DICT_FILE);
     exit(1);
 }
 
+/*
+ * report_rate() prints the number of packets handled per second, and
+ * the equivalent payload bit rate
+ */
+static void report_rate(const char *what,
+                        size_t packets,
+                        size_t payload_len,
+                        double secs)
+{
+    double pps = secs > 0 ? (double)packets / secs : 0.0;
+
+    printf("%s %zu packets in %.3f s (%.0f packets/s, %.1f Mbit/s payload)\n",
+           what, packets, secs, pps, pps * (double)payload_len * 8 / 1e6);
+}
+
+void run_load_sender(rtp_sender_t snd,
+                     int sock,
+                     load_params_t *load_params,
+                     uint32_t ssrc)
+{
+    rtp_load_t load;
+    size_t sent = 0;
+    double start;
+
+    load = rtp_load_alloc(load_params->batch_size, load_params->payload_len,
+                          ssrc, load_params->num_ssrcs, load_params->segment);
+    if (load == NULL || rtp_load_init_socket(load, sock, false) < 0) {
+        fprintf(stderr, "error: failed to set up load generation\n");
+        exit(1);
+    }
+
+    printf("sending %zu streams in batches of %zu packets\n",
+           load_params->num_ssrcs, load_params->batch_size);
+    start = rtp_load_now();
+    while (!interrupted &&
+           (load_params->num_packets == 0 || sent < load_params->num_packets)) {
+        ssize_t n = rtp_load_send(load, snd);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("error: send failed");
+            break;
+        }
+        sent += (size_t)n;
+    }
+    report_rate("sent", sent, load_params->payload_len,
+                rtp_load_now() - start);
+
+    rtp_load_dealloc(load);
+}
+
+void run_load_receiver(rtp_receiver_t rcvr,
+                       int sock,
+                       load_params_t *load_params,
+                       uint32_t ssrc)
+{
+    rtp_load_t load;
+    size_t received = 0;
+    size_t errors = 0;
+    double start = 0;
+    double last = 0;
+
+    load = rtp_load_alloc(load_params->batch_size, load_params->payload_len,
+                          ssrc, load_params->num_ssrcs, load_params->segment);
+    if (load == NULL || rtp_load_init_socket(load, sock, true) < 0) {
+        fprintf(stderr, "error: failed to set up load generation\n");
+        exit(1);
+    }
+
+    while (!interrupted && (load_params->num_packets == 0 ||
+                            received < load_params->num_packets)) {
+        ssize_t n = rtp_load_recv(load, rcvr, &errors);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("error: receive failed");
+            break;
+        }
+        /* the rate is measured from the first to the last packet */
+        if (n > 0) {
+            last = rtp_load_now();
+            if (received == 0) {
+                start = last;
+            }
+        }
+        received += (size_t)n;
+    }
+    report_rate("received", received, load_params->payload_len, last - start);
+    printf("invalid packets: %zu\n", errors);
+
+    rtp_load_dealloc(load);
+}
+
 void leave_group(int sock, struct ip_mreq mreq, char *name)
 {
     int ret;
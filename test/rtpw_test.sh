@@ -169,6 +169,45 @@ kill $sender_pid
 wait $receiver_pid 2>/dev/null
 wait $sender_pid 2>/dev/null
 
+
+# load generation mode, with many streams sent in batches
+
+ARGS="$ARGS -n 16"
+
+echo  $0 ": starting rtpw load receiver process... "
+
+$RTPW $* $ARGS -r 0.0.0.0 $DEST_PORT  &
+
+receiver_pid=$!
+
+echo $0 ": receiver PID = $receiver_pid"
+
+sleep 1
+
+# verify that the background job is running
+ps -e | grep -q $receiver_pid
+retval=$?
+echo $retval
+if [ $retval != 0 ]; then
+    echo $0 ": error"
+    exit 254
+fi
+
+echo  $0 ": starting rtpw load sender process..."
+
+$RTPW $* $ARGS -c 100000 -s 127.0.0.1 $DEST_PORT
+retval=$?
+if [ $retval != 0 ]; then
+    echo $0 ": error"
+    exit 255
+fi
+
+sleep 1
+
+kill $receiver_pid
+
+wait $receiver_pid 2>/dev/null
+
 echo $0 ": done (test passed)"
 
 else 
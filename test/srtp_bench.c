@@ -0,0 +1,2207 @@
+/*
+ * srtp_bench.c
+ *
+ * benchmark of srtp_protect() and srtp_unprotect() across the SRTP
+ * profiles, packet sizes and stream options, reporting percentiles of the
+ * time per packet as JSON so that runs of different releases can be
+ * compared
+ *
+ * With -l it instead times every call on its own, to report the tail
+ * latency of the packets that clone a stream, roll over the sequence
+ * number, follow a rekey or are rejected
+ *
+ * With -m it protects and unprotects packets spread over many streams,
+ * one at a time and in batches, to show the cost of the cache misses on
+ * the state of the streams once it no longer fits in the caches; run it
+ * under perf stat -e LLC-load-misses to count them
+ *
+ * With -r it measures how many invalid packets of each kind, malformed,
+ * replayed or forged, srtp_unprotect() rejects per second
+ *
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for sched_setaffinity() */
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>  /* for printf(), fopen() */
+#include <stdlib.h> /* for malloc(), qsort() */
+#include <string.h> /* for memcpy()          */
+#include <time.h>   /* for clock_gettime()   */
+
+#ifdef HAVE_WINDOWS_H
+#include <windows.h> /* for QueryPerformanceCounter() */
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAVE_TSC 1
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h> /* for sysconf() */
+#define BENCH_HAVE_THREADS 1
+#else
+#define BENCH_HAVE_THREADS 0
+#endif
+
+#if BENCH_HAVE_THREADS && defined(__linux__)
+#include <sched.h>       /* for sched_setaffinity() */
+#include <sys/mman.h>    /* for mmap()              */
+#include <sys/syscall.h> /* for SYS_mbind           */
+#define BENCH_HAVE_NUMA 1
+#else
+#define BENCH_HAVE_NUMA 0
+#endif
+
+#include "getopt_s.h" /* for local getopt()  */
+#include "srtp.h"
+
+#define BENCH_MAX_PACKET_LEN 2048
+#define BENCH_SSRC 0xcafebabe
+#define BENCH_XTN_ID 1
+#define BENCH_MKI_LEN 4
+
+/* latency mode: payload of the packets, in octets */
+#define BENCH_LATENCY_PAYLOAD_LEN 160
+
+/* latency mode: packets sent by each SSRC cloned from the template */
+#define BENCH_CLONE_RUN 8
+
+/* latency mode: clones kept by the template sessions */
+#define BENCH_MAX_CLONES 64
+
+/* latency mode: the sequence number steps by the stride so that the ROC
+   increments every 4096 packets, a stride within the replay window */
+#define BENCH_ROLLOVER_STRIDE 16
+
+/* latency mode: packets between two rekeys */
+#define BENCH_REKEY_INTERVAL 1024
+
+/* scaling mode: the most threads measured */
+#define BENCH_SCALE_MAX_THREADS 1024
+
+/* streams mode: the fewest streams measured, a set that stays cached */
+#define BENCH_STREAMS_FEW 16
+
+/* numa mode: the mbind() policy that only allows pages on the node */
+#define BENCH_MPOL_BIND 2
+
+/* rejection mode: the breaker of the session flooded with new SSRCs */
+#define BENCH_BREAKER_FAILURES 16
+#define BENCH_BREAKER_COOLDOWN 1024
+
+/* rejection mode: packets unprotected between two looks at the clock */
+#define BENCH_REJECT_CHUNK 64
+
+/* setup mode: streams with keys of their own that are added in turn */
+#define BENCH_SETUP_KEYS 256
+
+/*
+ * the payload sizes cover audio frames up to full size video packets
+ */
+static const size_t bench_payload_lens[] = { 20, 160, 500, 1200 };
+
+static const struct {
+    srtp_profile_t profile;
+    const char *name;
+} bench_profiles[] = {
+    { srtp_profile_null_null, "null_null" },
+    { srtp_profile_aes128_cm_sha1_80, "aes128_cm_sha1_80" },
+    { srtp_profile_aes128_cm_sha1_32, "aes128_cm_sha1_32" },
+    { srtp_profile_aes192_cm_sha1_80, "aes192_cm_sha1_80" },
+    { srtp_profile_aes192_cm_sha1_32, "aes192_cm_sha1_32" },
+    { srtp_profile_aes256_cm_sha1_80, "aes256_cm_sha1_80" },
+    { srtp_profile_aes256_cm_sha1_32, "aes256_cm_sha1_32" },
+    { srtp_profile_null_sha1_80, "null_sha1_80" },
+    { srtp_profile_null_sha1_32, "null_sha1_32" },
+    { srtp_profile_aead_aes_128_gcm, "aead_aes_128_gcm" },
+    { srtp_profile_aead_aes_256_gcm, "aead_aes_256_gcm" },
+};
+
+/*
+ * the stream options a profile is measured with, all but plain packets
+ * carry a one-byte header extension element
+ */
+typedef enum {
+    bench_variant_plain,
+    bench_variant_mki,
+    bench_variant_xtn,
+    bench_variant_enc_xtn,
+    bench_variant_cryptex
+} bench_variant_t;
+
+static const char *const bench_variant_names[] = {
+    "plain", "mki", "header_extension", "encrypted_header_extension", "cryptex"
+};
+
+#define BENCH_NUM_VARIANTS                                                     \
+    (sizeof(bench_variant_names) / sizeof(bench_variant_names[0]))
+#define BENCH_NUM_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct {
+    size_t warmup;      /* packets processed before measuring  */
+    size_t samples;     /* number of timed batches             */
+    size_t batch;       /* packets in each timed batch         */
+    const char *filter; /* only profiles whose name has this   */
+    size_t calls;       /* packets per scenario in latency mode */
+    size_t threads;     /* most threads in scaling mode        */
+    size_t duration_ms; /* time of each scaling measurement    */
+    size_t streams;     /* most streams in streams mode        */
+    bool rejections;    /* measure the rejection mode          */
+    bool setup;         /* measure the stream setup mode       */
+    bool numa;          /* scale with local and remote sessions */
+} bench_config_t;
+
+typedef struct {
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+} bench_percentiles_t;
+
+typedef struct {
+    bench_percentiles_t ns;    /* nanoseconds per packet            */
+    bench_percentiles_t ticks; /* TSC ticks per packet, if available */
+} bench_result_t;
+
+static const uint8_t bench_key[SRTP_MAX_KEY_LEN] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0, 0xd6, 0x4f, 0xa3, 0x2c,
+    0x06, 0xde, 0x41, 0x39, 0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73, 0xc3, 0x17, 0xf2, 0xda,
+    0xbe, 0x35, 0x77, 0x93, 0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+static const uint8_t bench_mki[BENCH_MKI_LEN] = { 0xe1, 0xf9, 0x7a, 0x0d };
+
+/* the key the rekey scenario alternates with bench_key */
+static const uint8_t bench_rekey_key[SRTP_MAX_KEY_LEN] = {
+    0x3a, 0xa7, 0xe7, 0xfa, 0x2a, 0xd1, 0x9f, 0x28, 0x57, 0x20, 0x7e, 0x1c,
+    0x85, 0x7d, 0x1e, 0x55, 0xc7, 0x15, 0xe2, 0xea, 0xfe, 0x55, 0x67, 0x96,
+    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb, 0xb6, 0x96, 0x0b, 0x3a,
+    0xab, 0xe6, 0xc1, 0x73, 0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35
+};
+
+/*
+ * the scenarios of the latency mode
+ */
+typedef enum {
+    bench_scenario_steady,   /* one stream, also rejects replays and
+                                forged tags                           */
+    bench_scenario_template, /* a new SSRC cloned every few packets   */
+    bench_scenario_rollover, /* frequent ROC increments, reordered    */
+    bench_scenario_rekey     /* srtp_update() every so many packets   */
+} bench_scenario_t;
+
+static const char *const bench_scenario_names[] = {
+    "steady", "template_clone", "rollover", "rekey"
+};
+
+typedef enum {
+    bench_op_protect,
+    bench_op_unprotect,
+    bench_op_protect_clone,
+    bench_op_unprotect_clone,
+    bench_op_reject_replay,
+    bench_op_reject_auth,
+    bench_op_update
+} bench_op_t;
+
+static const char *const bench_op_names[] = {
+    "protect",            "unprotect",          "protect_new_ssrc",
+    "unprotect_new_ssrc", "unprotect_replayed", "unprotect_forged",
+    "update"
+};
+
+#define BENCH_NUM_OPS BENCH_NUM_ELEMS(bench_op_names)
+
+/*
+ * bench_hist_t counts latencies in buckets a thirty-second of a power of
+ * two wide, like an HDR histogram, so that a percentile read from it is
+ * within about 3% of the exact one at any magnitude
+ */
+#define BENCH_HIST_SUB_BITS 5
+#define BENCH_HIST_SUB (1 << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS ((64 - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB)
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long max;
+    double sum;
+    unsigned long long bucket[BENCH_HIST_BUCKETS];
+} bench_hist_t;
+
+/*
+ * bench_now_ns() returns a monotonic time in nanoseconds
+ */
+static double bench_now_ns(void)
+{
+#ifdef HAVE_WINDOWS_H
+    LARGE_INTEGER count, freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static unsigned long long bench_ticks(void)
+{
+#if BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * bench_create_packet(buffer, payload_len, ssrc, seq, with_xtn) writes an
+ * RTP packet to buffer and returns its length
+ */
+static size_t bench_create_packet(uint8_t *buffer,
+                                  size_t payload_len,
+                                  uint32_t ssrc,
+                                  uint16_t seq,
+                                  bool with_xtn)
+{
+    size_t len = 12;
+
+    buffer[0] = with_xtn ? 0x90 : 0x80; /* version 2, extension bit */
+    buffer[1] = 0x0f;                   /* payload type             */
+    buffer[2] = (uint8_t)(seq >> 8);
+    buffer[3] = (uint8_t)seq;
+    memset(buffer + 4, 0, 4); /* timestamp */
+    buffer[8] = (uint8_t)(ssrc >> 24);
+    buffer[9] = (uint8_t)(ssrc >> 16);
+    buffer[10] = (uint8_t)(ssrc >> 8);
+    buffer[11] = (uint8_t)ssrc;
+
+    if (with_xtn) {
+        /* one-byte header extension with a single four octet element */
+        static const uint8_t xtn[] = { 0xbe, 0xde, 0x00, 0x02,
+                                       (BENCH_XTN_ID << 4) | 3,
+                                       0x01, 0x02, 0x03, 0x04,
+                                       0x00, 0x00, 0x00 };
+        memcpy(buffer + len, xtn, sizeof(xtn));
+        len += sizeof(xtn);
+    }
+
+    memset(buffer + len, 0xab, payload_len);
+    return len + payload_len;
+}
+
+/*
+ * bench_create_policy(policy, profile, variant, key) creates the policy of
+ * a stream for BENCH_SSRC, key holds the master key followed by the salt
+ */
+static srtp_err_status_t bench_create_policy(srtp_policy_t *policy_ptr,
+                                             srtp_profile_t profile,
+                                             bench_variant_t variant,
+                                             const uint8_t *key)
+{
+    srtp_policy_t policy;
+    srtp_err_status_t status;
+    size_t key_len = srtp_profile_get_master_key_length(profile);
+    size_t salt_len = srtp_profile_get_master_salt_length(profile);
+    bool use_mki = variant == bench_variant_mki;
+
+    status = srtp_policy_create(&policy);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_policy_set_profile(policy, profile);
+    if (!status) {
+        status = srtp_policy_set_ssrc(
+            policy, (srtp_ssrc_t){ ssrc_specific, BENCH_SSRC });
+    }
+    if (!status && use_mki) {
+        status = srtp_policy_use_mki(policy, BENCH_MKI_LEN);
+    }
+    /* the null profile has no keys */
+    if (!status && (key_len != 0 || use_mki)) {
+        status = srtp_policy_add_key(
+            policy, key, key_len, key + key_len, salt_len,
+            use_mki ? bench_mki : NULL, use_mki ? BENCH_MKI_LEN : 0);
+    }
+    if (!status && variant == bench_variant_enc_xtn) {
+        status = srtp_policy_add_enc_hdr_xtnd_id(policy, BENCH_XTN_ID);
+    }
+    if (!status && variant == bench_variant_cryptex) {
+        status = srtp_policy_set_cryptex(policy, true);
+    }
+
+    if (status) {
+        srtp_policy_destroy(policy);
+        return status;
+    }
+
+    *policy_ptr = policy;
+    return srtp_err_status_ok;
+}
+
+/*
+ * bench_create_session(srtp, profile, variant) creates a session with a
+ * stream for BENCH_SSRC, it fails when the profile is not supported by
+ * this build
+ */
+static srtp_err_status_t bench_create_session_on_node(srtp_t *srtp,
+                                                      srtp_profile_t profile,
+                                                      bench_variant_t variant,
+                                                      int node)
+{
+    srtp_policy_t policy;
+    srtp_err_status_t status;
+
+    status = bench_create_policy(&policy, profile, variant, bench_key);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_create_on_node(srtp, policy, node);
+
+    srtp_policy_destroy(policy);
+    return status;
+}
+
+static srtp_err_status_t bench_create_session(srtp_t *srtp,
+                                              srtp_profile_t profile,
+                                              bench_variant_t variant)
+{
+    return bench_create_session_on_node(srtp, profile, variant,
+                                        SRTP_NUMA_NODE_ANY);
+}
+
+/*
+ * bench_stream_memory(profile, variant, bytes, allocations) measures the
+ * memory taken by a stream, as the growth of the allocation statistics
+ * when a second stream is added to a session
+ */
+static srtp_err_status_t bench_stream_memory(srtp_profile_t profile,
+                                             bench_variant_t variant,
+                                             size_t *bytes,
+                                             size_t *allocations)
+{
+    srtp_policy_t policy;
+    srtp_t srtp;
+    srtp_alloc_stats_t before;
+    srtp_alloc_stats_t after;
+    srtp_err_status_t status;
+
+    status = bench_create_policy(&policy, profile, variant, bench_key);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_create(&srtp, policy);
+    if (status) {
+        srtp_policy_destroy(policy);
+        return status;
+    }
+
+    status = srtp_policy_set_ssrc(
+        policy, (srtp_ssrc_t){ ssrc_specific, BENCH_SSRC + 1 });
+    if (!status) {
+        status = srtp_get_alloc_stats(&before);
+    }
+    if (!status) {
+        status = srtp_stream_add(srtp, policy);
+    }
+    if (!status) {
+        status = srtp_get_alloc_stats(&after);
+    }
+    if (!status) {
+        *bytes = after.live_bytes - before.live_bytes;
+        *allocations = after.live_allocations - before.live_allocations;
+    }
+
+    srtp_dealloc(srtp);
+    srtp_policy_destroy(policy);
+    return status;
+}
+
+static int bench_compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * bench_percentiles(values, n) sorts values and returns its percentiles,
+ * using the nearest rank
+ */
+static bench_percentiles_t bench_percentiles(double *values, size_t n)
+{
+    bench_percentiles_t p;
+
+    qsort(values, n, sizeof(double), bench_compare_doubles);
+    p.min = values[0];
+    p.p50 = values[(n - 1) * 50 / 100];
+    p.p90 = values[(n - 1) * 90 / 100];
+    p.p99 = values[(n - 1) * 99 / 100];
+    p.max = values[n - 1];
+
+    return p;
+}
+
+/*
+ * bench_run(config, profile, variant, payload_len, in_place, unprotect,
+ * result) measures one configuration; every timed batch processes fresh
+ * copies of the packets, so that the replay check and cryptex, which
+ * changes the header in place, see the same input each time
+ */
+static srtp_err_status_t bench_run(const bench_config_t *config,
+                                   srtp_profile_t profile,
+                                   bench_variant_t variant,
+                                   size_t payload_len,
+                                   bool in_place,
+                                   bool unprotect,
+                                   bench_result_t *result)
+{
+    srtp_err_status_t status;
+    srtp_t sender, receiver;
+    uint8_t *in, *out;
+    size_t *in_lens;
+    double *ns, *ticks;
+    size_t num_batches = config->samples;
+    size_t warmup_batches =
+        (config->warmup + config->batch - 1) / config->batch;
+    uint16_t seq = 0;
+    bool with_xtn = variant != bench_variant_plain &&
+                    variant != bench_variant_mki;
+
+    memset(result, 0, sizeof(*result));
+
+    status = bench_create_session(&sender, profile, variant);
+    if (status) {
+        return status;
+    }
+    status = bench_create_session(&receiver, profile, variant);
+    if (status) {
+        srtp_dealloc(sender);
+        return status;
+    }
+
+    in = malloc(config->batch * BENCH_MAX_PACKET_LEN);
+    out = malloc(config->batch * BENCH_MAX_PACKET_LEN);
+    in_lens = malloc(config->batch * sizeof(size_t));
+    ns = malloc(num_batches * sizeof(double));
+    ticks = malloc(num_batches * sizeof(double));
+    if (in == NULL || out == NULL || in_lens == NULL || ns == NULL ||
+        ticks == NULL) {
+        status = srtp_err_status_alloc_fail;
+        goto done;
+    }
+
+    /* the warmup batches are run the same way but not recorded */
+    for (size_t b = 0; b < warmup_batches + num_batches; b++) {
+        double start_ns, end_ns;
+        unsigned long long start_ticks, end_ticks;
+
+        /* prepare the input of the batch, untimed */
+        for (size_t i = 0; i < config->batch; i++) {
+            uint8_t *pkt = in + i * BENCH_MAX_PACKET_LEN;
+
+            in_lens[i] = bench_create_packet(pkt, payload_len, BENCH_SSRC,
+                                             seq++, with_xtn);
+            if (unprotect) {
+                size_t len = BENCH_MAX_PACKET_LEN;
+                status = srtp_protect(sender, pkt, in_lens[i], pkt, &len, 0);
+                if (status) {
+                    goto done;
+                }
+                in_lens[i] = len;
+            }
+        }
+
+        start_ns = bench_now_ns();
+        start_ticks = bench_ticks();
+        for (size_t i = 0; i < config->batch; i++) {
+            uint8_t *pkt = in + i * BENCH_MAX_PACKET_LEN;
+            uint8_t *dst = in_place ? pkt : out + i * BENCH_MAX_PACKET_LEN;
+            size_t len = BENCH_MAX_PACKET_LEN;
+
+            if (unprotect) {
+                status = srtp_unprotect(receiver, pkt, in_lens[i], dst, &len);
+            } else {
+                status = srtp_protect(sender, pkt, in_lens[i], dst, &len, 0);
+            }
+            if (status) {
+                goto done;
+            }
+        }
+        end_ticks = bench_ticks();
+        end_ns = bench_now_ns();
+
+        if (b >= warmup_batches) {
+            ns[b - warmup_batches] = (end_ns - start_ns) / config->batch;
+            ticks[b - warmup_batches] =
+                (double)(end_ticks - start_ticks) / config->batch;
+        }
+    }
+
+    result->ns = bench_percentiles(ns, num_batches);
+    result->ticks = bench_percentiles(ticks, num_batches);
+
+done:
+    free(in);
+    free(out);
+    free(in_lens);
+    free(ns);
+    free(ticks);
+    srtp_dealloc(sender);
+    srtp_dealloc(receiver);
+
+    return status;
+}
+
+static void bench_print_percentiles(FILE *f,
+                                    const char *name,
+                                    const bench_percentiles_t *p)
+{
+    fprintf(f,
+            "\"%s\": {\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, "
+            "\"p99\": %.2f, \"max\": %.2f}",
+            name, p->min, p->p50, p->p90, p->p99, p->max);
+}
+
+static void bench_hist_add(bench_hist_t *hist, double ns)
+{
+    unsigned long long v = ns > 0 ? (unsigned long long)(ns + 0.5) : 0;
+    size_t index = (size_t)v;
+
+    if (v >= BENCH_HIST_SUB) {
+        unsigned msb = 0;
+
+        while ((v >> msb) > 1) {
+            msb++;
+        }
+        index = (msb - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB +
+                (size_t)(v >> (msb - BENCH_HIST_SUB_BITS)) - BENCH_HIST_SUB;
+    }
+
+    hist->bucket[index]++;
+    hist->count++;
+    hist->sum += (double)v;
+    if (v > hist->max) {
+        hist->max = v;
+    }
+}
+
+/*
+ * bench_hist_percentile(hist, pct) returns the highest value of the
+ * bucket holding the given percentile, or the maximum if that is lower
+ */
+static unsigned long long bench_hist_percentile(const bench_hist_t *hist,
+                                                double pct)
+{
+    unsigned long long rank =
+        (unsigned long long)((double)hist->count * pct / 100.0 + 0.5);
+    unsigned long long seen = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (size_t i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        seen += hist->bucket[i];
+        if (seen >= rank) {
+            size_t range = i / BENCH_HIST_SUB;
+            unsigned long long high = i;
+
+            if (range > 0) {
+                high = ((unsigned long long)(BENCH_HIST_SUB +
+                                             i % BENCH_HIST_SUB + 1)
+                        << (range - 1)) -
+                       1;
+            }
+            return high < hist->max ? high : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+static void bench_print_hist(FILE *f, const bench_hist_t *hist)
+{
+    fprintf(f,
+            "\"calls\": %llu, \"ns\": {\"mean\": %.1f, \"p50\": %llu, "
+            "\"p90\": %llu, \"p99\": %llu, \"p99.9\": %llu, "
+            "\"p99.99\": %llu, \"max\": %llu}",
+            hist->count, hist->sum / (double)hist->count,
+            bench_hist_percentile(hist, 50),
+            bench_hist_percentile(hist, 90),
+            bench_hist_percentile(hist, 99),
+            bench_hist_percentile(hist, 99.9),
+            bench_hist_percentile(hist, 99.99), hist->max);
+}
+
+/*
+ * bench_latency_unprotect(receiver, pkt, len, forge, expected, hist)
+ * unprotects a copy of the protected packet, with its last octet flipped
+ * if forge is set, records the time taken and fails unless the result is
+ * the expected one
+ */
+static srtp_err_status_t bench_latency_unprotect(srtp_t receiver,
+                                                 const uint8_t *pkt,
+                                                 size_t len,
+                                                 bool forge,
+                                                 srtp_err_status_t expected,
+                                                 bench_hist_t *hist)
+{
+    uint8_t work[BENCH_MAX_PACKET_LEN];
+    size_t out_len = sizeof(work);
+    srtp_err_status_t status;
+    double start;
+
+    memcpy(work, pkt, len);
+    if (forge) {
+        work[len - 1] ^= 0x01;
+    }
+
+    start = bench_now_ns();
+    status = srtp_unprotect(receiver, work, len, work, &out_len);
+    bench_hist_add(hist, bench_now_ns() - start);
+
+    return status == expected ? srtp_err_status_ok : srtp_err_status_fail;
+}
+
+/*
+ * bench_latency_run(config, profile, scenario, hists) times each call of
+ * one scenario, the packets are protected in pairs and each pair is
+ * unprotected before the next one, backwards in the rollover scenario
+ */
+static srtp_err_status_t bench_latency_run(const bench_config_t *config,
+                                           srtp_profile_t profile,
+                                           bench_scenario_t scenario,
+                                           bench_hist_t *hists)
+{
+    srtp_err_status_t status;
+    srtp_policy_t policy = NULL;
+    srtp_policy_t rekey_policy = NULL;
+    srtp_t sender = NULL;
+    srtp_t receiver = NULL;
+    uint8_t pkts[2][BENCH_MAX_PACKET_LEN];
+    size_t lens[2];
+    bool template = scenario == bench_scenario_template;
+    bool authenticated = profile != srtp_profile_null_null;
+
+    status = bench_create_policy(&policy, profile, bench_variant_plain,
+                                 bench_key);
+    if (!status && template) {
+        status = srtp_policy_set_max_clones(policy, BENCH_MAX_CLONES);
+    }
+    if (!status && template) {
+        status = srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_outbound, 0 });
+    }
+    if (!status) {
+        status = srtp_create(&sender, policy);
+    }
+    if (!status && template) {
+        status = srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_inbound, 0 });
+    }
+    if (!status) {
+        status = srtp_create(&receiver, policy);
+    }
+    if (!status && scenario == bench_scenario_rekey) {
+        status = bench_create_policy(&rekey_policy, profile,
+                                     bench_variant_plain, bench_rekey_key);
+    }
+
+    for (size_t i = 0; !status && i < config->calls; i += 2) {
+        /* the rekey happens between pairs, on both sides at once */
+        if (scenario == bench_scenario_rekey && i != 0 &&
+            i % BENCH_REKEY_INTERVAL == 0) {
+            srtp_policy_t next = (i / BENCH_REKEY_INTERVAL) % 2
+                                     ? rekey_policy
+                                     : policy;
+            double start = bench_now_ns();
+
+            status = srtp_update(sender, next);
+            bench_hist_add(&hists[bench_op_update], bench_now_ns() - start);
+            if (!status) {
+                start = bench_now_ns();
+                status = srtp_update(receiver, next);
+                bench_hist_add(&hists[bench_op_update],
+                               bench_now_ns() - start);
+            }
+        }
+
+        for (size_t j = 0; !status && j < 2; j++) {
+            size_t n = i + j;
+            uint32_t ssrc = BENCH_SSRC;
+            uint16_t seq = (uint16_t)n;
+            bool first = false;
+            size_t len;
+            double start;
+
+            if (template) {
+                ssrc = BENCH_SSRC + (uint32_t)(n / BENCH_CLONE_RUN);
+                seq = (uint16_t)(n % BENCH_CLONE_RUN);
+                first = seq == 0;
+            } else if (scenario == bench_scenario_rollover) {
+                seq = (uint16_t)(n * BENCH_ROLLOVER_STRIDE);
+            }
+
+            len = bench_create_packet(pkts[j], BENCH_LATENCY_PAYLOAD_LEN,
+                                      ssrc, seq, false);
+            lens[j] = BENCH_MAX_PACKET_LEN;
+            start = bench_now_ns();
+            status = srtp_protect(sender, pkts[j], len, pkts[j], &lens[j], 0);
+            bench_hist_add(
+                &hists[first ? bench_op_protect_clone : bench_op_protect],
+                bench_now_ns() - start);
+        }
+
+        for (size_t k = 0; !status && k < 2; k++) {
+            size_t j = scenario == bench_scenario_rollover ? 1 - k : k;
+            bool first = template && (i + j) % BENCH_CLONE_RUN == 0;
+
+            /* a forged tag is rejected before the packet is accepted,
+               a replay after */
+            if (scenario == bench_scenario_steady && authenticated) {
+                status = bench_latency_unprotect(
+                    receiver, pkts[j], lens[j], true,
+                    srtp_err_status_auth_fail,
+                    &hists[bench_op_reject_auth]);
+            }
+            if (!status) {
+                status = bench_latency_unprotect(
+                    receiver, pkts[j], lens[j], false, srtp_err_status_ok,
+                    &hists[first ? bench_op_unprotect_clone
+                                 : bench_op_unprotect]);
+            }
+            if (!status && scenario == bench_scenario_steady) {
+                status = bench_latency_unprotect(
+                    receiver, pkts[j], lens[j], false,
+                    srtp_err_status_replay_fail,
+                    &hists[bench_op_reject_replay]);
+            }
+        }
+    }
+
+    srtp_dealloc(sender);
+    srtp_dealloc(receiver);
+    srtp_policy_destroy(policy);
+    srtp_policy_destroy(rekey_policy);
+
+    return status;
+}
+
+/*
+ * bench_latency(f, config) runs the latency scenarios of every profile
+ * and writes their histograms
+ */
+static void bench_latency(FILE *f, const bench_config_t *config)
+{
+    bench_hist_t *hists = malloc(BENCH_NUM_OPS * sizeof(bench_hist_t));
+    bool first = true;
+
+    if (hists == NULL) {
+        fprintf(stderr, "error: malloc() failed\n");
+        exit(1);
+    }
+
+    /* the time read around each call is included in its latency */
+    memset(hists, 0, sizeof(bench_hist_t));
+    for (size_t i = 0; i < config->calls; i++) {
+        double start = bench_now_ns();
+        bench_hist_add(hists, bench_now_ns() - start);
+    }
+    fprintf(f, "  \"calls_per_scenario\": %zu,\n", config->calls);
+    fprintf(f, "  \"timer_overhead\": {");
+    bench_print_hist(f, hists);
+    fprintf(f, "},\n  \"latency\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t sc = 0; sc < BENCH_NUM_ELEMS(bench_scenario_names);
+             sc++) {
+            srtp_err_status_t status;
+
+            memset(hists, 0, BENCH_NUM_OPS * sizeof(bench_hist_t));
+            status = bench_latency_run(config, bench_profiles[p].profile,
+                                       (bench_scenario_t)sc, hists);
+            if (status) {
+                fprintf(stderr, "error: %s %s failed with %d\n",
+                        bench_profiles[p].name, bench_scenario_names[sc],
+                        status);
+                exit(1);
+            }
+
+            for (size_t op = 0; op < BENCH_NUM_OPS; op++) {
+                if (hists[op].count == 0) {
+                    continue;
+                }
+                fprintf(f,
+                        "%s\n    {\"profile\": \"%s\", \"scenario\": \"%s\", "
+                        "\"operation\": \"%s\",\n     ",
+                        first ? "" : ",", bench_profiles[p].name,
+                        bench_scenario_names[sc], bench_op_names[op]);
+                bench_print_hist(f, &hists[op]);
+                fprintf(f, "}");
+                first = false;
+            }
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+    free(hists);
+}
+
+/*
+ * bench_streams_session(srtp, profile, streams) creates a session with
+ * the given number of streams, each keyed separately so that no two of
+ * them share their expanded keys
+ */
+static srtp_err_status_t bench_streams_session(srtp_t *srtp,
+                                               srtp_profile_t profile,
+                                               size_t streams)
+{
+    srtp_err_status_t status;
+    uint8_t key[SRTP_MAX_KEY_LEN];
+
+    *srtp = NULL;
+    status = srtp_create(srtp, NULL);
+    for (size_t i = 0; !status && i < streams; i++) {
+        srtp_policy_t policy;
+
+        memcpy(key, bench_key, sizeof(key));
+        key[0] ^= (uint8_t)i;
+        key[1] ^= (uint8_t)(i >> 8);
+        key[2] ^= (uint8_t)(i >> 16);
+        status = bench_create_policy(&policy, profile, bench_variant_plain,
+                                     key);
+        if (!status) {
+            status = srtp_policy_set_ssrc(
+                policy,
+                (srtp_ssrc_t){ ssrc_specific, BENCH_SSRC + (uint32_t)i });
+            if (!status) {
+                status = srtp_stream_add(*srtp, policy);
+            }
+            srtp_policy_destroy(policy);
+        }
+    }
+
+    if (status && *srtp != NULL) {
+        srtp_dealloc(*srtp);
+        *srtp = NULL;
+    }
+    return status;
+}
+
+/*
+ * bench_streams_run(config, profile, streams, unprotect, batch, result)
+ * measures packets of streams picked at random, through srtp_protect() or
+ * srtp_unprotect() for each packet, or through their batch variants when
+ * batch is set
+ */
+static srtp_err_status_t bench_streams_run(const bench_config_t *config,
+                                           srtp_profile_t profile,
+                                           size_t streams,
+                                           bool unprotect,
+                                           bool batch,
+                                           bench_result_t *result)
+{
+    srtp_err_status_t status;
+    srtp_t sender = NULL;
+    srtp_t receiver = NULL;
+    uint8_t *in, *out;
+    uint16_t *seqs;
+    srtp_packet_desc_t *descs;
+    double *ns, *ticks;
+    size_t num_batches = config->samples;
+    size_t warmup_batches =
+        (config->warmup + config->batch - 1) / config->batch;
+    uint32_t lcg = 1;
+
+    memset(result, 0, sizeof(*result));
+
+    status = bench_streams_session(&sender, profile, streams);
+    if (status) {
+        return status;
+    }
+    status = bench_streams_session(&receiver, profile, streams);
+    if (status) {
+        srtp_dealloc(sender);
+        return status;
+    }
+
+    in = malloc(config->batch * BENCH_MAX_PACKET_LEN);
+    out = malloc(config->batch * BENCH_MAX_PACKET_LEN);
+    seqs = calloc(streams, sizeof(uint16_t));
+    descs = malloc(config->batch * sizeof(srtp_packet_desc_t));
+    ns = malloc(num_batches * sizeof(double));
+    ticks = malloc(num_batches * sizeof(double));
+    if (in == NULL || out == NULL || seqs == NULL || descs == NULL ||
+        ns == NULL || ticks == NULL) {
+        status = srtp_err_status_alloc_fail;
+        goto done;
+    }
+
+    for (size_t b = 0; b < warmup_batches + num_batches; b++) {
+        double start_ns, end_ns;
+        unsigned long long start_ticks, end_ticks;
+
+        /* prepare the input of the batch, untimed */
+        for (size_t i = 0; i < config->batch; i++) {
+            uint8_t *pkt = in + i * BENCH_MAX_PACKET_LEN;
+            size_t stream;
+
+            lcg = lcg * 1103515245u + 12345u;
+            stream = (lcg >> 8) % streams;
+            descs[i].in = pkt;
+            descs[i].in_len = bench_create_packet(
+                pkt, BENCH_LATENCY_PAYLOAD_LEN, BENCH_SSRC + (uint32_t)stream,
+                seqs[stream]++, false);
+            descs[i].out = out + i * BENCH_MAX_PACKET_LEN;
+            descs[i].out_len = BENCH_MAX_PACKET_LEN;
+            descs[i].mki_index = 0;
+            if (unprotect) {
+                size_t len = BENCH_MAX_PACKET_LEN;
+                status =
+                    srtp_protect(sender, pkt, descs[i].in_len, pkt, &len, 0);
+                if (status) {
+                    goto done;
+                }
+                descs[i].in_len = len;
+            }
+        }
+
+        start_ns = bench_now_ns();
+        start_ticks = bench_ticks();
+        if (batch && unprotect) {
+            status = srtp_unprotect_batch(receiver, descs, config->batch);
+        } else if (batch) {
+            status = srtp_protect_batch(sender, descs, config->batch);
+        }
+        for (size_t i = 0; !batch && !status && i < config->batch; i++) {
+            srtp_packet_desc_t *d = &descs[i];
+
+            if (unprotect) {
+                status = srtp_unprotect(receiver, d->in, d->in_len, d->out,
+                                        &d->out_len);
+            } else {
+                status = srtp_protect(sender, d->in, d->in_len, d->out,
+                                      &d->out_len, 0);
+            }
+        }
+        end_ticks = bench_ticks();
+        end_ns = bench_now_ns();
+        if (status) {
+            goto done;
+        }
+
+        if (b >= warmup_batches) {
+            ns[b - warmup_batches] = (end_ns - start_ns) / config->batch;
+            ticks[b - warmup_batches] =
+                (double)(end_ticks - start_ticks) / config->batch;
+        }
+    }
+
+    result->ns = bench_percentiles(ns, num_batches);
+    result->ticks = bench_percentiles(ticks, num_batches);
+
+done:
+    free(in);
+    free(out);
+    free(seqs);
+    free(descs);
+    free(ns);
+    free(ticks);
+    srtp_dealloc(sender);
+    srtp_dealloc(receiver);
+
+    return status;
+}
+
+/*
+ * bench_streams(f, config) measures each profile with a few streams and
+ * with config->streams, per packet and in batches, and writes the
+ * percentiles of the time per packet
+ */
+static void bench_streams(FILE *f, const bench_config_t *config)
+{
+    const size_t counts[] = { BENCH_STREAMS_FEW, config->streams };
+    bool first = true;
+
+    fprintf(f, "  \"warmup_packets\": %zu,\n", config->warmup);
+    fprintf(f, "  \"samples\": %zu,\n", config->samples);
+    fprintf(f, "  \"packets_per_sample\": %zu,\n", config->batch);
+    fprintf(f, "  \"streams\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t c = 0; c < BENCH_NUM_ELEMS(counts); c++) {
+            if (c != 0 && counts[c] <= BENCH_STREAMS_FEW) {
+                continue;
+            }
+
+            for (int mode = 0; mode < 4; mode++) {
+                bool batch = (mode & 1) != 0;
+                bool unprotect = (mode & 2) != 0;
+                bench_result_t r;
+                srtp_err_status_t status;
+
+                status = bench_streams_run(config, bench_profiles[p].profile,
+                                           counts[c], unprotect, batch, &r);
+                if (status) {
+                    fprintf(stderr,
+                            "error: %s %s %s over %zu streams failed with "
+                            "%d\n",
+                            bench_profiles[p].name,
+                            unprotect ? "unprotect" : "protect",
+                            batch ? "batch" : "per_packet", counts[c],
+                            status);
+                    exit(1);
+                }
+
+                fprintf(f,
+                        "%s\n    {\"profile\": \"%s\", \"streams\": %zu, "
+                        "\"direction\": \"%s\", \"api\": \"%s\",\n     ",
+                        first ? "" : ",", bench_profiles[p].name, counts[c],
+                        unprotect ? "unprotect" : "protect",
+                        batch ? "batch" : "per_packet");
+                bench_print_percentiles(f, "ns_per_packet", &r.ns);
+                if (BENCH_HAVE_TSC) {
+                    fprintf(f, ",\n     ");
+                    bench_print_percentiles(f, "tsc_per_packet", &r.ticks);
+                }
+                fprintf(f, "}");
+                first = false;
+            }
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+}
+
+/*
+ * the invalid packets of the rejection mode
+ */
+typedef enum {
+    bench_reject_malformed,   /* an RTP version other than 2         */
+    bench_reject_unknown,     /* an SSRC without a stream            */
+    bench_reject_replay,      /* a packet accepted before            */
+    bench_reject_bad_mki,     /* an MKI the stream does not have     */
+    bench_reject_forged,      /* a wrong tag on a known stream       */
+    bench_reject_new_ssrc,    /* a wrong tag on a new SSRC, verified
+                                 with the template                   */
+    bench_reject_new_ssrc_breaker /* the same with the breaker on    */
+} bench_reject_t;
+
+static const char *const bench_reject_names[] = {
+    "malformed",     "unknown_ssrc",  "replayed",
+    "unknown_mki",   "forged",        "new_ssrc_forged",
+    "new_ssrc_forged_breaker"
+};
+
+/*
+ * bench_reject_run(config, profile, kind, rate) unprotects the same
+ * invalid packet for config->duration_ms and returns the rejections per
+ * second; it fails with srtp_err_status_no_such_op if the profile can not
+ * produce that kind of packet
+ */
+static srtp_err_status_t bench_reject_run(const bench_config_t *config,
+                                          srtp_profile_t profile,
+                                          bench_reject_t kind,
+                                          double *rate)
+{
+    srtp_err_status_t status;
+    srtp_policy_t policy = NULL;
+    srtp_t sender = NULL;
+    srtp_t receiver = NULL;
+    uint8_t pkt[BENCH_MAX_PACKET_LEN];
+    uint8_t out[BENCH_MAX_PACKET_LEN];
+    size_t len = BENCH_MAX_PACKET_LEN;
+    size_t in_len;
+    bool template =
+        kind == bench_reject_new_ssrc || kind == bench_reject_new_ssrc_breaker;
+    bench_variant_t variant =
+        kind == bench_reject_bad_mki ? bench_variant_mki : bench_variant_plain;
+    unsigned long long n = 0;
+    double start, end, deadline;
+
+    status = bench_create_policy(&policy, profile, variant, bench_key);
+    if (!status && template) {
+        status = srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_outbound, 0 });
+    }
+    if (!status) {
+        status = srtp_create(&sender, policy);
+    }
+    if (!status && template) {
+        status = srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_inbound, 0 });
+    }
+    if (!status) {
+        status = srtp_create(&receiver, policy);
+    }
+    if (!status && kind == bench_reject_new_ssrc_breaker) {
+        status = srtp_session_set_breaker(receiver, BENCH_BREAKER_FAILURES,
+                                          BENCH_BREAKER_COOLDOWN);
+    }
+
+    in_len = bench_create_packet(pkt, BENCH_LATENCY_PAYLOAD_LEN,
+                                 kind == bench_reject_unknown ? BENCH_SSRC + 1
+                                                              : BENCH_SSRC,
+                                 1, false);
+    if (!status && kind != bench_reject_malformed &&
+        kind != bench_reject_unknown) {
+        status = srtp_protect(sender, pkt, in_len, pkt, &len, 0);
+        in_len = len;
+    }
+
+    if (!status) {
+        size_t trailer;
+
+        switch (kind) {
+        case bench_reject_malformed:
+            pkt[0] = 0x00;
+            break;
+        case bench_reject_replay:
+            len = sizeof(out);
+            status = srtp_unprotect(receiver, pkt, in_len, out, &len);
+            break;
+        case bench_reject_bad_mki:
+            status = srtp_get_protect_trailer_length(sender, 0, &trailer);
+            if (!status) {
+                pkt[in_len - trailer] ^= 0xff;
+            }
+            break;
+        case bench_reject_forged:
+        case bench_reject_new_ssrc:
+        case bench_reject_new_ssrc_breaker:
+            pkt[in_len - 1] ^= 0x01;
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* the packet must be rejected to be measured */
+    if (!status) {
+        len = sizeof(out);
+        if (srtp_unprotect(receiver, pkt, in_len, out, &len) ==
+            srtp_err_status_ok) {
+            status = srtp_err_status_no_such_op;
+        }
+    }
+
+    start = bench_now_ns();
+    deadline = start + config->duration_ms * 1e6;
+    end = start;
+    while (!status && end < deadline) {
+        for (size_t i = 0; i < BENCH_REJECT_CHUNK; i++, n++) {
+            len = sizeof(out);
+            srtp_unprotect(receiver, pkt, in_len, out, &len);
+        }
+        end = bench_now_ns();
+    }
+    *rate = end > start ? (double)n * 1e9 / (end - start) : 0;
+
+    srtp_dealloc(sender);
+    srtp_dealloc(receiver);
+    srtp_policy_destroy(policy);
+
+    return status;
+}
+
+/*
+ * bench_rejections(f, config) measures each profile and kind of invalid
+ * packet and writes the rejections per second
+ */
+static void bench_rejections(FILE *f, const bench_config_t *config)
+{
+    bool first = true;
+
+    fprintf(f, "  \"duration_ms\": %zu,\n", config->duration_ms);
+    fprintf(f, "  \"rejections\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t k = 0; k < BENCH_NUM_ELEMS(bench_reject_names); k++) {
+            double rate;
+            srtp_err_status_t status;
+
+            status = bench_reject_run(config, bench_profiles[p].profile,
+                                      (bench_reject_t)k, &rate);
+            if (status == srtp_err_status_no_such_op) {
+                fprintf(stderr, "skipping %s %s\n", bench_profiles[p].name,
+                        bench_reject_names[k]);
+                continue;
+            }
+            if (status) {
+                fprintf(stderr, "error: %s %s failed with %d\n",
+                        bench_profiles[p].name, bench_reject_names[k],
+                        status);
+                exit(1);
+            }
+
+            fprintf(f,
+                    "%s\n    {\"profile\": \"%s\", \"packet\": \"%s\", "
+                    "\"rejections_per_second\": %.0f}",
+                    first ? "" : ",", bench_profiles[p].name,
+                    bench_reject_names[k], rate);
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+}
+
+/*
+ * bench_setup_run(config, profile, variant, rate) adds streams to a
+ * session and removes them again for config->duration_ms, each with
+ * master keys of its own so that every stream runs the KDF and expands
+ * its cipher keys, and sets rate to the streams set up per second
+ */
+static srtp_err_status_t bench_setup_run(const bench_config_t *config,
+                                         srtp_profile_t profile,
+                                         bench_variant_t variant,
+                                         double *rate)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+    srtp_policy_t policies[BENCH_SETUP_KEYS] = { NULL };
+    srtp_t session = NULL;
+    uint8_t key[SRTP_MAX_KEY_LEN];
+    size_t added = 0;
+    double start_ns = 0, end_ns = 0;
+
+    *rate = 0;
+
+    for (size_t i = 0; !status && i < BENCH_SETUP_KEYS; i++) {
+        memcpy(key, bench_key, sizeof(key));
+        key[0] ^= (uint8_t)i;
+        key[1] ^= (uint8_t)(i >> 8);
+        status = bench_create_policy(&policies[i], profile, variant, key);
+        if (!status) {
+            status = srtp_policy_set_ssrc(
+                policies[i],
+                (srtp_ssrc_t){ ssrc_specific, BENCH_SSRC + (uint32_t)i });
+        }
+    }
+    if (!status) {
+        status = srtp_create(&session, NULL);
+    }
+
+    /* the first round warms up the allocator and the caches, untimed */
+    for (int round = 0; !status; round++) {
+        for (size_t i = 0; !status && i < BENCH_SETUP_KEYS; i++) {
+            status = srtp_stream_add(session, policies[i]);
+            if (!status) {
+                status =
+                    srtp_stream_remove(session, BENCH_SSRC + (uint32_t)i);
+            }
+        }
+        if (round == 0) {
+            start_ns = bench_now_ns();
+            continue;
+        }
+        added += BENCH_SETUP_KEYS;
+        end_ns = bench_now_ns();
+        if (end_ns - start_ns >= (double)config->duration_ms * 1e6) {
+            break;
+        }
+    }
+
+    if (!status) {
+        *rate = (double)added * 1e9 / (end_ns - start_ns);
+    }
+
+    if (session != NULL) {
+        srtp_dealloc(session);
+    }
+    for (size_t i = 0; i < BENCH_SETUP_KEYS; i++) {
+        if (policies[i] != NULL) {
+            srtp_policy_destroy(policies[i]);
+        }
+    }
+
+    return status;
+}
+
+/*
+ * bench_setup(f, config) measures the streams per second that one thread
+ * sets up for each profile, with and without an encrypted header
+ * extension, which has a cipher of its own; running it again with
+ * SRTP_CPU_FEATURES=none compares the AES instructions with the portable
+ * key expansion
+ */
+static void bench_setup(FILE *f, const bench_config_t *config)
+{
+    const bench_variant_t variants[] = { bench_variant_plain,
+                                         bench_variant_enc_xtn };
+    const char *cpu_features = getenv("SRTP_CPU_FEATURES");
+    bool first = true;
+
+    fprintf(f, "  \"cpu_features\": \"%s\",\n",
+            cpu_features != NULL ? cpu_features : "all");
+    fprintf(f, "  \"duration_ms\": %zu,\n", config->duration_ms);
+    fprintf(f, "  \"stream_setup\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t v = 0; v < BENCH_NUM_ELEMS(variants); v++) {
+            srtp_err_status_t status;
+            double rate;
+
+            status = bench_setup_run(config, bench_profiles[p].profile,
+                                     variants[v], &rate);
+            if (status) {
+                fprintf(stderr, "error: %s %s stream setup failed with %d\n",
+                        bench_profiles[p].name,
+                        bench_variant_names[variants[v]], status);
+                exit(1);
+            }
+
+            fprintf(f,
+                    "%s\n    {\"profile\": \"%s\", \"variant\": \"%s\", "
+                    "\"streams_per_second\": %.0f}",
+                    first ? "" : ",", bench_profiles[p].name,
+                    bench_variant_names[variants[v]], rate);
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+}
+
+#if BENCH_HAVE_THREADS
+
+/*
+ * the workloads of the scaling mode
+ */
+typedef enum {
+    bench_workload_specific, /* sessions with a stream of their own      */
+    bench_workload_template  /* sessions of one shared template policy,
+                                cloning a stream every few packets       */
+} bench_workload_t;
+
+static const char *const bench_workload_names[] = { "specific",
+                                                    "template_clone" };
+
+/* sessions each thread protects packets for in turn */
+#define BENCH_SCALE_SESSIONS 4
+
+/* SSRCs a template session cycles through, more than it keeps clones of
+   so that streams keep being cloned and removed */
+#define BENCH_SCALE_SSRCS 256
+
+/* packets protected between two looks at the clock */
+#define BENCH_SCALE_CHUNK 64
+
+/*
+ * bench_gate_t holds the threads of a measurement until all of them have
+ * set up their sessions, then starts them at once
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t ready;
+    bool started;
+    double deadline_ns;
+} bench_gate_t;
+
+/*
+ * bench_placement_t is where the numa mode runs the threads of a
+ * measurement, and where their sessions are allocated
+ */
+typedef struct {
+    int node; /* of the sessions */
+#if BENCH_HAVE_NUMA
+    cpu_set_t cpus; /* the threads run on */
+#endif
+} bench_placement_t;
+
+typedef struct {
+    pthread_t thread;
+    bench_gate_t *gate;
+    srtp_profile_t profile;
+    bench_workload_t workload;
+    srtp_policy_t template_policy;
+    const bench_placement_t *placement; /* NULL to let the OS decide */
+    unsigned long long packets;
+    double end_ns;
+    srtp_err_status_t status;
+} bench_worker_t;
+
+static void *bench_scale_worker(void *arg)
+{
+    bench_worker_t *w = (bench_worker_t *)arg;
+    bench_gate_t *gate = w->gate;
+    srtp_t sessions[BENCH_SCALE_SESSIONS] = { NULL };
+    uint8_t in[BENCH_MAX_PACKET_LEN];
+    uint8_t out[BENCH_MAX_PACKET_LEN];
+    size_t in_len;
+    unsigned long long n = 0;
+    srtp_err_status_t status = srtp_err_status_ok;
+    int node = SRTP_NUMA_NODE_ANY;
+    double deadline;
+
+    if (w->placement != NULL) {
+        node = w->placement->node;
+#if BENCH_HAVE_NUMA
+        if (sched_setaffinity(0, sizeof(w->placement->cpus),
+                              &w->placement->cpus) != 0) {
+            status = srtp_err_status_fail;
+        }
+#endif
+    }
+
+    /* the sessions are set up concurrently too, as they are in use */
+    for (size_t i = 0; !status && i < BENCH_SCALE_SESSIONS; i++) {
+        if (w->workload == bench_workload_template) {
+            status =
+                srtp_create_on_node(&sessions[i], w->template_policy, node);
+        } else {
+            status = bench_create_session_on_node(
+                &sessions[i], w->profile, bench_variant_plain, node);
+        }
+    }
+    in_len = bench_create_packet(in, BENCH_LATENCY_PAYLOAD_LEN, BENCH_SSRC,
+                                 0, false);
+
+    pthread_mutex_lock(&gate->lock);
+    gate->ready++;
+    pthread_cond_broadcast(&gate->cond);
+    while (!gate->started) {
+        pthread_cond_wait(&gate->cond, &gate->lock);
+    }
+    deadline = gate->deadline_ns;
+    pthread_mutex_unlock(&gate->lock);
+
+    while (!status && bench_now_ns() < deadline) {
+        for (size_t i = 0; !status && i < BENCH_SCALE_CHUNK; i++, n++) {
+            /* each session sees its sequence number advance by one */
+            uint16_t seq = (uint16_t)(n / BENCH_SCALE_SESSIONS);
+            size_t out_len = sizeof(out);
+
+            in[2] = (uint8_t)(seq >> 8);
+            in[3] = (uint8_t)seq;
+            if (w->workload == bench_workload_template) {
+                uint32_t ssrc =
+                    BENCH_SSRC +
+                    (uint32_t)((n / (BENCH_SCALE_SESSIONS * BENCH_CLONE_RUN)) %
+                               BENCH_SCALE_SSRCS);
+
+                in[8] = (uint8_t)(ssrc >> 24);
+                in[9] = (uint8_t)(ssrc >> 16);
+                in[10] = (uint8_t)(ssrc >> 8);
+                in[11] = (uint8_t)ssrc;
+            }
+            status = srtp_protect(sessions[n % BENCH_SCALE_SESSIONS], in,
+                                  in_len, out, &out_len, 0);
+        }
+    }
+    w->end_ns = bench_now_ns();
+    w->packets = n;
+    w->status = status;
+
+    for (size_t i = 0; i < BENCH_SCALE_SESSIONS; i++) {
+        if (sessions[i] != NULL) {
+            srtp_dealloc(sessions[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * bench_scale_run(config, profile, workload, placement, threads, rate,
+ * allocations) protects packets on the given number of threads for
+ * config->duration_ms and returns the packets protected per second by all
+ * threads, and the allocations made per packet
+ */
+static srtp_err_status_t bench_scale_run(const bench_config_t *config,
+                                         srtp_profile_t profile,
+                                         bench_workload_t workload,
+                                         const bench_placement_t *placement,
+                                         size_t threads,
+                                         double *rate,
+                                         double *allocations)
+{
+    bench_gate_t gate;
+    bench_worker_t *workers;
+    srtp_policy_t template_policy = NULL;
+    srtp_alloc_stats_t before;
+    srtp_alloc_stats_t after;
+    srtp_err_status_t status = srtp_err_status_ok;
+    unsigned long long packets = 0;
+    size_t started = 0;
+    double start_ns;
+    double end_ns;
+
+    workers = calloc(threads, sizeof(bench_worker_t));
+    if (workers == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    if (workload == bench_workload_template) {
+        status = bench_create_policy(&template_policy, profile,
+                                     bench_variant_plain, bench_key);
+        if (!status) {
+            status = srtp_policy_set_ssrc(
+                template_policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 });
+        }
+        if (!status) {
+            status =
+                srtp_policy_set_max_clones(template_policy, BENCH_MAX_CLONES);
+        }
+        if (status) {
+            srtp_policy_destroy(template_policy);
+            free(workers);
+            return status;
+        }
+    }
+
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    gate.ready = 0;
+    gate.started = false;
+    gate.deadline_ns = 0;
+
+    for (; started < threads; started++) {
+        bench_worker_t *w = &workers[started];
+
+        w->gate = &gate;
+        w->profile = profile;
+        w->workload = workload;
+        w->template_policy = template_policy;
+        w->placement = placement;
+        if (pthread_create(&w->thread, NULL, bench_scale_worker, w) != 0) {
+            status = srtp_err_status_fail;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&gate.lock);
+    while (gate.ready < started) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+    srtp_get_alloc_stats(&before);
+    start_ns = bench_now_ns();
+    /* threads that could not all be started are stopped right away */
+    gate.deadline_ns = status ? start_ns : start_ns + config->duration_ms * 1e6;
+    gate.started = true;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+
+    end_ns = start_ns;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (!status) {
+            status = workers[i].status;
+        }
+        packets += workers[i].packets;
+        if (workers[i].end_ns > end_ns) {
+            end_ns = workers[i].end_ns;
+        }
+    }
+    srtp_get_alloc_stats(&after);
+
+    *rate = end_ns > start_ns ? (double)packets * 1e9 / (end_ns - start_ns)
+                              : 0;
+    *allocations =
+        packets != 0
+            ? (double)(after.total_allocations - before.total_allocations) /
+                  (double)packets
+            : 0;
+
+    pthread_cond_destroy(&gate.cond);
+    pthread_mutex_destroy(&gate.lock);
+    srtp_policy_destroy(template_policy);
+    free(workers);
+
+    return status;
+}
+
+/*
+ * bench_scaling(f, config) measures each profile and workload on one to
+ * config->threads threads and writes the packet rates
+ */
+static void bench_scaling(FILE *f, const bench_config_t *config)
+{
+    bool first = true;
+
+    fprintf(f, "  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(f, "  \"duration_ms\": %zu,\n", config->duration_ms);
+    fprintf(f, "  \"scaling\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t wl = 0; wl < BENCH_NUM_ELEMS(bench_workload_names);
+             wl++) {
+            double single_rate = 0;
+
+            for (size_t t = 1; t <= config->threads; t++) {
+                double rate;
+                double allocations;
+                srtp_err_status_t status;
+
+                status = bench_scale_run(config, bench_profiles[p].profile,
+                                         (bench_workload_t)wl, NULL, t, &rate,
+                                         &allocations);
+                if (status) {
+                    fprintf(stderr,
+                            "error: %s %s on %zu threads failed with %d\n",
+                            bench_profiles[p].name, bench_workload_names[wl],
+                            t, status);
+                    exit(1);
+                }
+                if (t == 1) {
+                    single_rate = rate;
+                }
+
+                fprintf(f,
+                        "%s\n    {\"profile\": \"%s\", \"workload\": \"%s\", "
+                        "\"threads\": %zu,\n     \"packets_per_second\": "
+                        "%.0f, \"per_thread\": %.0f, \"efficiency\": %.3f, "
+                        "\"allocations_per_packet\": %.4f}",
+                        first ? "" : ",", bench_profiles[p].name,
+                        bench_workload_names[wl], t, rate, rate / (double)t,
+                        single_rate > 0 ? rate / (single_rate * (double)t)
+                                        : 0,
+                        allocations);
+                first = false;
+            }
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+}
+
+#if BENCH_HAVE_NUMA
+
+/*
+ * bench_node_alloc() and bench_node_free() are the allocator of the numa
+ * mode: memory for a node is mapped and bound to it with mbind(), which
+ * takes a page per allocation but leaves no doubt where it is; the first
+ * 16 octets hold the length of the mapping, or 0 for memory from malloc()
+ */
+#define BENCH_NODE_HEADER 16
+
+static void *bench_node_alloc(size_t size, int node, void *data)
+{
+    uint8_t *p;
+    size_t len;
+    unsigned long mask;
+
+    (void)data;
+    if (node == SRTP_NUMA_NODE_ANY || node >= (int)(8 * sizeof(mask))) {
+        p = malloc(size + BENCH_NODE_HEADER);
+        if (p == NULL) {
+            return NULL;
+        }
+        len = 0;
+    } else {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+        len = (size + BENCH_NODE_HEADER + page - 1) / page * page;
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return NULL;
+        }
+        /* without NUMA support the pages just stay where they fault in */
+        mask = 1UL << node;
+        (void)syscall(SYS_mbind, p, len, BENCH_MPOL_BIND, &mask,
+                      8 * sizeof(mask), 0);
+    }
+    memcpy(p, &len, sizeof(len));
+
+    return p + BENCH_NODE_HEADER;
+}
+
+static void bench_node_free(void *ptr, void *data)
+{
+    uint8_t *p = (uint8_t *)ptr - BENCH_NODE_HEADER;
+    size_t len;
+
+    (void)data;
+    memcpy(&len, p, sizeof(len));
+    if (len == 0) {
+        free(p);
+    } else {
+        munmap(p, len);
+    }
+}
+
+/*
+ * bench_read_cpus(path, cpus) parses a list of CPUs or nodes as the
+ * kernel writes them, e.g. "0-7,16-23", into cpus and returns the number
+ * of entries, or 0 if the file could not be read
+ */
+static size_t bench_read_cpus(const char *path, cpu_set_t *cpus)
+{
+    FILE *f = fopen(path, "r");
+    unsigned long first, last;
+    size_t count = 0;
+    int c;
+
+    CPU_ZERO(cpus);
+    if (f == NULL) {
+        return 0;
+    }
+    while (fscanf(f, "%lu", &first) == 1) {
+        last = first;
+        c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%lu", &last) != 1) {
+                break;
+            }
+            c = fgetc(f);
+        }
+        for (unsigned long i = first; i <= last && i < CPU_SETSIZE; i++) {
+            CPU_SET(i, cpus);
+            count++;
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(f);
+
+    return count;
+}
+
+/*
+ * bench_numa(f, config) measures the specific workload of the scaling
+ * mode with the threads pinned to the CPUs of node 0, once with the
+ * sessions allocated on node 0 and once on the last node, and writes the
+ * packet rates of both
+ */
+static void bench_numa(FILE *f, const bench_config_t *config)
+{
+    bench_placement_t local, remote;
+    cpu_set_t nodes;
+    size_t num_nodes;
+    int remote_node = 0;
+    bool first = true;
+
+    num_nodes = bench_read_cpus("/sys/devices/system/node/online", &nodes);
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &nodes)) {
+            remote_node = i;
+        }
+    }
+    local.node = 0;
+    remote.node = remote_node;
+    if (bench_read_cpus("/sys/devices/system/node/node0/cpulist",
+                        &local.cpus) == 0) {
+        fprintf(stderr, "error: the CPUs of NUMA node 0 are not known\n");
+        exit(1);
+    }
+    remote.cpus = local.cpus;
+
+    fprintf(f, "  \"nodes\": %zu,\n", num_nodes);
+    fprintf(f, "  \"local_node\": %d,\n", local.node);
+    fprintf(f, "  \"remote_node\": %d,\n", remote.node);
+    fprintf(f, "  \"duration_ms\": %zu,\n", config->duration_ms);
+    fprintf(f, "  \"numa\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t t = 1; t <= config->threads; t++) {
+            double local_rate, remote_rate;
+            double allocations;
+            srtp_err_status_t status;
+
+            status = bench_scale_run(config, bench_profiles[p].profile,
+                                     bench_workload_specific, &local, t,
+                                     &local_rate, &allocations);
+            if (!status) {
+                status = bench_scale_run(config, bench_profiles[p].profile,
+                                         bench_workload_specific, &remote, t,
+                                         &remote_rate, &allocations);
+            }
+            if (status) {
+                fprintf(stderr, "error: %s on %zu threads failed with %d\n",
+                        bench_profiles[p].name, t, status);
+                exit(1);
+            }
+
+            fprintf(f,
+                    "%s\n    {\"profile\": \"%s\", \"threads\": %zu,\n"
+                    "     \"local_packets_per_second\": %.0f, "
+                    "\"remote_packets_per_second\": %.0f, "
+                    "\"remote_ratio\": %.3f}",
+                    first ? "" : ",", bench_profiles[p].name, t, local_rate,
+                    remote_rate, local_rate > 0 ? remote_rate / local_rate : 0);
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+}
+
+#endif
+
+#endif
+
+/*
+ * bench_throughput(f, config) measures every profile, stream option and
+ * packet size in batches and writes the percentiles of the time per
+ * packet and the memory taken by each stream
+ */
+static void bench_throughput(FILE *f, const bench_config_t *config)
+{
+    bool first = true;
+
+    fprintf(f, "  \"warmup_packets\": %zu,\n", config->warmup);
+    fprintf(f, "  \"samples\": %zu,\n", config->samples);
+    fprintf(f, "  \"packets_per_sample\": %zu,\n", config->batch);
+    fprintf(f, "  \"results\": [");
+
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t v = 0; v < BENCH_NUM_VARIANTS; v++) {
+            srtp_t probe;
+
+            /* skip what this build of libSRTP or the profile can't do */
+            if (bench_create_session(&probe, bench_profiles[p].profile,
+                                     (bench_variant_t)v)) {
+                fprintf(stderr, "skipping %s %s\n", bench_profiles[p].name,
+                        bench_variant_names[v]);
+                continue;
+            }
+            srtp_dealloc(probe);
+
+            for (size_t l = 0; l < BENCH_NUM_ELEMS(bench_payload_lens); l++) {
+                for (int io = 0; io < 4; io++) {
+                    bool in_place = (io & 1) == 0;
+                    bool unprotect = (io & 2) != 0;
+                    size_t payload_len = bench_payload_lens[l];
+                    bench_result_t r;
+                    srtp_err_status_t status;
+
+                    status = bench_run(config, bench_profiles[p].profile,
+                                       (bench_variant_t)v, payload_len,
+                                       in_place, unprotect, &r);
+                    if (status) {
+                        fprintf(stderr,
+                                "error: %s %s %s %s of %zu octets failed "
+                                "with %d\n",
+                                bench_profiles[p].name, bench_variant_names[v],
+                                unprotect ? "unprotect" : "protect",
+                                in_place ? "in_place" : "out_of_place",
+                                payload_len, status);
+                        exit(1);
+                    }
+
+                    fprintf(f, "%s\n    {\"profile\": \"%s\", ",
+                            first ? "" : ",", bench_profiles[p].name);
+                    fprintf(f,
+                            "\"variant\": \"%s\", \"direction\": \"%s\", "
+                            "\"io\": \"%s\", \"payload_len\": %zu,\n     ",
+                            bench_variant_names[v],
+                            unprotect ? "unprotect" : "protect",
+                            in_place ? "in_place" : "out_of_place",
+                            payload_len);
+                    bench_print_percentiles(f, "ns_per_packet", &r.ns);
+                    if (BENCH_HAVE_TSC) {
+                        fprintf(f, ",\n     ");
+                        bench_print_percentiles(f, "tsc_per_packet", &r.ticks);
+                    }
+                    fprintf(f, ",\n     \"mbps_p50\": %.2f}",
+                            payload_len * 8 * 1e3 / r.ns.p50);
+                    first = false;
+                }
+            }
+        }
+    }
+
+    /* the memory used by each stream, to compare stream layouts */
+    fprintf(f, "\n  ],\n  \"stream_memory\": [");
+    first = true;
+    for (size_t p = 0; p < BENCH_NUM_ELEMS(bench_profiles); p++) {
+        if (config->filter != NULL &&
+            strstr(bench_profiles[p].name, config->filter) == NULL) {
+            continue;
+        }
+
+        for (size_t v = 0; v < BENCH_NUM_VARIANTS; v++) {
+            size_t bytes;
+            size_t allocations;
+
+            if (bench_stream_memory(bench_profiles[p].profile,
+                                    (bench_variant_t)v, &bytes,
+                                    &allocations)) {
+                continue;
+            }
+
+            fprintf(f,
+                    "%s\n    {\"profile\": \"%s\", \"variant\": \"%s\", "
+                    "\"bytes\": %zu, \"allocations\": %zu}",
+                    first ? "" : ",", bench_profiles[p].name,
+                    bench_variant_names[v], bytes, allocations);
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n  ]\n");
+}
+
+static void usage(char *prog_name)
+{
+    printf("usage: %s [ -w <warmup> ][ -s <samples> ][ -b <batch> ]"
+           "[ -p <profile> ][ -o <file> ][ -l <calls> ]\n"
+           "       [ -t <threads> ][ -d <ms> ][ -n ][ -m <streams> ][ -r ]"
+           "[ -k ]\n"
+           "  -w <warmup>   packets processed before measuring (default "
+           "1024)\n"
+           "  -s <samples>  timed batches per configuration (default 101)\n"
+           "  -b <batch>    packets per timed batch (default 32)\n"
+           "  -p <profile>  only run profiles whose name contains <profile>\n"
+           "  -o <file>     write the JSON results to <file> instead of "
+           "stdout\n"
+           "  -l <calls>    time each call of <calls> packets per latency "
+           "scenario\n"
+           "                instead of measuring throughput\n"
+           "  -t <threads>  measure how throughput scales from 1 to "
+           "<threads>\n"
+           "                threads, 0 for the number of CPUs\n"
+           "  -d <ms>       time of each scaling or setup measurement "
+           "(default 250)\n"
+           "  -n            with -t, compare sessions allocated on the NUMA "
+           "node\n"
+           "                of the threads with sessions on another node\n"
+           "  -m <streams>  measure packets spread over up to <streams>\n"
+           "                streams, per packet and in batches\n"
+           "  -r            measure the rejections per second of invalid "
+           "packets\n"
+           "  -k            measure the streams per second added to a "
+           "session\n",
+           prog_name);
+    exit(255);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_config_t config = { 1024, 101, 32, NULL, 0, 0, 250, 0,
+                              false, false, false };
+    bool scaling = false;
+    const char *output = NULL;
+    FILE *f = stdout;
+    int q;
+
+    while (1) {
+        q = getopt_s(argc, argv, "w:s:b:p:o:l:t:d:nm:rk");
+        if (q == -1) {
+            break;
+        }
+        switch (q) {
+        case 'w':
+            config.warmup = (size_t)strtoul(optarg_s, NULL, 10);
+            break;
+        case 's':
+            config.samples = (size_t)strtoul(optarg_s, NULL, 10);
+            break;
+        case 'b':
+            config.batch = (size_t)strtoul(optarg_s, NULL, 10);
+            break;
+        case 'p':
+            config.filter = optarg_s;
+            break;
+        case 'o':
+            output = optarg_s;
+            break;
+        case 'l':
+            config.calls = (size_t)strtoul(optarg_s, NULL, 10);
+            if (config.calls == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 't':
+            config.threads = (size_t)strtoul(optarg_s, NULL, 10);
+            scaling = true;
+            break;
+        case 'd':
+            config.duration_ms = (size_t)strtoul(optarg_s, NULL, 10);
+            break;
+        case 'n':
+            config.numa = true;
+            break;
+        case 'm':
+            config.streams = (size_t)strtoul(optarg_s, NULL, 10);
+            if (config.streams == 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'r':
+            config.rejections = true;
+            break;
+        case 'k':
+            config.setup = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (config.samples == 0 || config.batch == 0 ||
+        config.duration_ms == 0 || config.threads > BENCH_SCALE_MAX_THREADS ||
+        (config.numa && !scaling)) {
+        usage(argv[0]);
+    }
+
+    if (config.numa) {
+#if BENCH_HAVE_NUMA
+        /* the allocator can only be installed while nothing is allocated */
+        if (srtp_install_node_allocator(bench_node_alloc, bench_node_free,
+                                        NULL)) {
+            fprintf(stderr, "error: could not install the node allocator\n");
+            exit(1);
+        }
+#else
+        fprintf(stderr, "error: -n is not supported on this platform\n");
+        exit(1);
+#endif
+    }
+
+    if (scaling) {
+#if BENCH_HAVE_THREADS
+        if (config.threads == 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            config.threads = cpus > 0 ? (size_t)cpus : 1;
+        }
+#else
+        fprintf(stderr, "error: -t is not supported on this platform\n");
+        exit(1);
+#endif
+    }
+
+    if (srtp_init()) {
+        fprintf(stderr, "error: srtp initialization failed\n");
+        exit(1);
+    }
+
+    if (output != NULL) {
+        f = fopen(output, "w");
+        if (f == NULL) {
+            fprintf(stderr, "error: could not open %s\n", output);
+            exit(1);
+        }
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": \"%s\",\n", srtp_get_version_string());
+    fprintf(f, "  \"timer\": \"%s\",\n",
+#ifdef HAVE_WINDOWS_H
+            "QueryPerformanceCounter"
+#else
+            "clock_gettime"
+#endif
+    );
+    fprintf(f, "  \"tsc\": %s,\n", BENCH_HAVE_TSC ? "true" : "false");
+    if (config.numa) {
+#if BENCH_HAVE_NUMA
+        bench_numa(f, &config);
+#endif
+    } else if (scaling) {
+#if BENCH_HAVE_THREADS
+        bench_scaling(f, &config);
+#endif
+    } else if (config.calls != 0) {
+        bench_latency(f, &config);
+    } else if (config.rejections) {
+        bench_rejections(f, &config);
+    } else if (config.setup) {
+        bench_setup(f, &config);
+    } else if (config.streams != 0) {
+        bench_streams(f, &config);
+    } else {
+        bench_throughput(f, &config);
+    }
+    fprintf(f, "}\n");
+
+    if (f != stdout) {
+        fclose(f);
+    }
+
+    if (srtp_shutdown()) {
+        fprintf(stderr, "error: srtp deinitialization failed\n");
+        exit(1);
+    }
+
+    return 0;
+}
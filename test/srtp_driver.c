@@ -49,6 +49,7 @@
 #include "getopt_s.h" /* for local getopt()    */
 
 #include "srtp_priv.h"
+#include "key_store.h"
 #include "stream_list_priv.h"
 #include "util.h"
 
@@ -95,11 +96,15 @@ srtp_err_status_t srtp_validate_encrypted_extensions_headers(void);
 
 #ifdef GCM
 srtp_err_status_t srtp_validate_encrypted_extensions_headers_gcm(void);
+
+srtp_err_status_t srtp_test_encrypted_extensions_headers_long(void);
 #endif
 
+#ifndef SRTP_NO_AES_256
 srtp_err_status_t srtp_validate_aes_256(void);
+#endif
 
-#ifdef GCM
+#if defined(GCM) && !defined(SRTP_NO_AES_192)
 srtp_err_status_t srtp_validate_aes_192(void);
 #endif
 
@@ -117,10 +122,14 @@ srtp_err_status_t srtp_test_update(void);
 
 srtp_err_status_t srtp_test_update_mki(void);
 
+srtp_err_status_t srtp_test_many_mki(void);
+
 srtp_err_status_t srtp_test_protect_trailer_length(void);
 
 srtp_err_status_t srtp_test_protect_rtcp_trailer_length(void);
 
+srtp_err_status_t srtp_test_protect_trailer_length_changes(void);
+
 srtp_err_status_t srtp_test_out_of_order_after_rollover(void);
 
 srtp_err_status_t srtp_test_get_roc(void);
@@ -133,9 +142,97 @@ srtp_err_status_t srtp_test_set_sender_roc(void);
 
 srtp_err_status_t srtp_test_cryptex_csrc_but_no_extension_header(void);
 srtp_err_status_t srtp_test_cryptex_disable(void);
+srtp_err_status_t srtp_test_cryptex_not_in_place_io(void);
 
 srtp_err_status_t srtp_test_missing_session_keys(void);
 
+srtp_err_status_t srtp_test_protect_batch(void);
+
+srtp_err_status_t srtp_test_batch_tags(void);
+
+srtp_err_status_t srtp_test_batch_keystream(void);
+
+srtp_err_status_t srtp_test_protect_strided(void);
+
+srtp_err_status_t srtp_test_protect_rtcp_batch(bool thread_safe);
+
+srtp_err_status_t srtp_test_unprotect_framed(void);
+
+srtp_err_status_t srtp_test_stream_pool(void);
+
+srtp_err_status_t srtp_test_template_rekey(void);
+
+srtp_err_status_t srtp_test_allocator(void);
+
+srtp_err_status_t srtp_test_numa_node(void);
+
+srtp_err_status_t srtp_test_thread_safe(void);
+
+srtp_err_status_t srtp_test_key_cache(void);
+
+srtp_err_status_t srtp_test_key_store(void);
+
+srtp_err_status_t srtp_test_shared_key_region(void);
+
+srtp_err_status_t srtp_test_breaker(void);
+
+srtp_err_status_t srtp_test_session_export(void);
+
+srtp_err_status_t srtp_test_reader(void);
+
+srtp_err_status_t srtp_test_unprotect_headers(void);
+
+srtp_err_status_t srtp_test_transcrypt(void);
+srtp_err_status_t srtp_test_double(void);
+
+srtp_err_status_t srtp_test_keystream_cache(void);
+
+srtp_err_status_t srtp_test_batch_offload(void);
+
+srtp_err_status_t srtp_test_lazy_keys(void);
+
+srtp_err_status_t srtp_test_sender_window(void);
+
+srtp_err_status_t srtp_test_adaptive_window(void);
+
+srtp_err_status_t srtp_test_prepare_commit(void);
+
+srtp_err_status_t srtp_test_stream_add_many(void);
+
+srtp_err_status_t srtp_test_dealloc_deferred(void);
+
+srtp_err_status_t srtp_test_event_queue(void);
+
+srtp_err_status_t srtp_test_key_overlap(void);
+
+srtp_err_status_t srtp_test_stream_stats(void);
+
+srtp_err_status_t srtp_test_stream_cold(void);
+
+srtp_err_status_t srtp_test_clone_limits(void);
+
+srtp_err_status_t srtp_test_memory_usage(void);
+
+void srtp_report_stream_memory(const test_policy_t *policy);
+
+srtp_err_status_t srtp_test_stage_profile(void);
+
+void srtp_report_stage_profile(const test_policy_t *policy);
+
+srtp_err_status_t srtp_test_protect_iov(void);
+
+srtp_err_status_t srtp_test_protect_buffer(void);
+
+srtp_err_status_t srtp_test_init_lazy_self_tests(void);
+
+srtp_err_status_t srtp_test_calibrate_crypto(void);
+
+srtp_err_status_t srtp_test_unaligned(void);
+
+srtp_err_status_t srtp_test_stream_handle(bool thread_safe);
+
+srtp_err_status_t srtp_test_protect_parsed(void);
+
 double srtp_bits_per_second(size_t msg_len_octets,
                             const test_policy_t *test_policy);
 
@@ -146,6 +243,8 @@ void srtp_do_timing(const test_policy_t *policy);
 
 void srtp_do_rejection_timing(const test_policy_t *policy);
 
+void srtp_do_setup_timing(const test_policy_t *policy);
+
 srtp_err_status_t srtp_test(const test_policy_t *policy,
                             bool test_extension_headers,
                             bool use_mki,
@@ -175,6 +274,20 @@ double mips_estimate(size_t num_trials, size_t *ignore);
 
 srtp_err_status_t srtp_stream_list_test(void);
 
+/*
+ * the linked list used with SRTP_USE_TEST_STREAM_LIST is linear in the
+ * number of streams, keep the scaling test short in that case
+ */
+#ifdef SRTP_USE_TEST_STREAM_LIST
+#define STREAM_LIST_TEST_MAX_STREAMS 1000
+#else
+#define STREAM_LIST_TEST_MAX_STREAMS 100000
+#endif
+
+double srtp_stream_list_lookups_per_second(size_t num_streams);
+
+double srtp_mki_lookups_per_second(size_t num_keys);
+
 srtp_err_status_t policy_set_key(srtp_policy_t policy, const uint8_t *key);
 srtp_err_status_t policy_add_keys(srtp_policy_t policy,
                                   test_master_key_t **keys,
@@ -209,6 +322,7 @@ typedef struct test_vectors_t {
 
 extern uint8_t test_key[46];
 extern uint8_t test_key_2[46];
+extern uint8_t test_alt_key[46];
 extern uint8_t test_mki_id[TEST_MKI_ID_SIZE];
 extern uint8_t test_mki_id_2[TEST_MKI_ID_SIZE];
 extern uint8_t test_key_gcm[28];
@@ -358,13 +472,15 @@ srtp_err_status_t call_srtp_unprotect_rtcp(srtp_ctx_t *ctx,
 
 void usage(char *prog_name)
 {
-    printf("usage: %s [ -t ][ -c ][ -v ][ -s ][ -o ][-d <debug_module> ]* [ -l "
-           "][ -n ]\n"
+    printf("usage: %s [ -t ][ -c ][ -v ][ -s ][ -m ][ -p ][ -o ]"
+           "[-d <debug_module> ]* [ -l ][ -n ]\n"
            "  -t         run timing test\n"
            "  -r         run rejection timing test\n"
            "  -c         run codec timing test\n"
            "  -v         run validation tests\n"
            "  -s         run stream list tests only\n"
+           "  -m         report the memory used by each stream\n"
+           "  -p         report the ticks spent in each packet stage\n"
            "  -o         output logging to stdout\n"
            "  -d <mod>   turn on debugging module <mod>\n"
            "  -l         list debugging modules\n"
@@ -426,6 +542,8 @@ int main(int argc, char *argv[])
     bool do_codec_timing = false;
     bool do_validation = false;
     bool do_stream_list = false;
+    bool do_memory_report = false;
+    bool do_stage_report = false;
     bool do_list_mods = false;
     bool do_log_stdout = false;
     srtp_err_status_t status;
@@ -460,7 +578,7 @@ int main(int argc, char *argv[])
 
     /* process input arguments */
     while (1) {
-        q = getopt_s(argc, argv, "trcvsold:n");
+        q = getopt_s(argc, argv, "trcvsmpold:n");
         if (q == -1) {
             break;
         }
@@ -481,6 +599,12 @@ int main(int argc, char *argv[])
         case 's':
             do_stream_list = true;
             break;
+        case 'm':
+            do_memory_report = true;
+            break;
+        case 'p':
+            do_stage_report = true;
+            break;
         case 'o':
             do_log_stdout = true;
             break;
@@ -504,7 +628,8 @@ int main(int argc, char *argv[])
     }
 
     if (!do_validation && !do_timing_test && !do_codec_timing &&
-        !do_list_mods && !do_rejection_test && !do_stream_list) {
+        !do_list_mods && !do_rejection_test && !do_stream_list &&
+        !do_memory_report && !do_stage_report) {
         usage(argv[0]);
     }
 
@@ -780,9 +905,19 @@ int main(int argc, char *argv[])
             printf("failed\n");
             exit(1);
         }
+
+        printf("testing encrypted extension headers longer than the "
+               "keystream buffer\n");
+        if (srtp_test_encrypted_extensions_headers_long() ==
+            srtp_err_status_ok) {
+            printf("passed\n\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 #endif
 
-#ifdef GCM
+#if defined(GCM) && !defined(SRTP_NO_AES_192)
         /*
          * run validation test against the reference packets for
          * AES-192
@@ -797,6 +932,7 @@ int main(int argc, char *argv[])
         }
 #endif
 
+#ifndef SRTP_NO_AES_256
         /*
          * run validation test against the reference packets for
          * AES-256
@@ -809,6 +945,7 @@ int main(int argc, char *argv[])
             printf("failed\n");
             exit(1);
         }
+#endif
 
         /*
          * test packets with empty payload
@@ -873,6 +1010,17 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
+        /*
+         * test MKI lookups on a stream with many master keys
+         */
+        printf("testing MKI lookups with many master keys...");
+        if (srtp_test_many_mki() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
         /*
          * test the functions srtp_get_protect_trailer_length
          * and srtp_get_protect_rtcp_trailer_length
@@ -893,6 +1041,14 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
+        printf("testing trailer lengths as streams change...");
+        if (srtp_test_protect_trailer_length_changes() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
         printf("testing srtp_test_out_of_order_after_rollover()...");
         if (srtp_test_out_of_order_after_rollover() == srtp_err_status_ok) {
             printf("passed\n");
@@ -950,6 +1106,14 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
+        printf("testing cryptex_not_in_place_io()...");
+        if (srtp_test_cryptex_not_in_place_io() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
         printf("testing missing session keys handling()...");
         if (srtp_test_missing_session_keys() == srtp_err_status_ok) {
             printf("passed\n");
@@ -957,2523 +1121,7313 @@ int main(int argc, char *argv[])
             printf("failed\n");
             exit(1);
         }
-    }
 
-    if (do_stream_list) {
-        printf("testing srtp_stream_list...");
-        if (srtp_stream_list_test() == srtp_err_status_ok) {
+        printf("testing srtp_protect_batch and srtp_unprotect_batch()...");
+        if (srtp_test_protect_batch() == srtp_err_status_ok &&
+            srtp_test_batch_tags() == srtp_err_status_ok &&
+            srtp_test_batch_keystream() == srtp_err_status_ok) {
             printf("passed\n");
         } else {
             printf("failed\n");
             exit(1);
         }
-    }
 
-    if (do_timing_test) {
-        const test_policy_t **policy = policy_array;
+        printf("testing srtp_protect_strided()...");
+        if (srtp_test_protect_strided() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-        /* loop over policies, run timing test for each */
-        while (*policy != NULL) {
-            srtp_print_policy(*policy);
-            srtp_do_timing(*policy);
-            policy++;
+        printf("testing srtp_protect_rtcp_batch and "
+               "srtp_unprotect_rtcp_batch()...");
+        if (srtp_test_protect_rtcp_batch(false) == srtp_err_status_ok &&
+            srtp_test_protect_rtcp_batch(true) == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
         }
-    }
 
-    if (do_rejection_test) {
-        const test_policy_t **policy = policy_array;
+        printf("testing srtp_unprotect_framed()...");
+        if (srtp_test_unprotect_framed() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-        /* loop over policies, run rejection timing test for each */
-        while (*policy != NULL) {
-            srtp_print_policy(*policy);
-            srtp_do_rejection_timing(*policy);
-            policy++;
+        printf("testing srtp_policy_set_stream_pool_size()...");
+        if (srtp_test_stream_pool() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
         }
-    }
 
-    if (do_codec_timing) {
-        test_policy_t policy;
-        size_t ignore;
-        double mips_value = mips_estimate(1000000000, &ignore);
+        printf("testing srtp_update() of a template in place...");
+        if (srtp_test_template_rekey() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-        memset(&policy, 0, sizeof(policy));
-        policy.profile = srtp_profile_aes128_cm_sha1_80;
-        policy.ssrc.type = ssrc_specific;
-        policy.ssrc.value = 0xdecafbad;
-        policy.keys = test_keys;
-        policy.num_master_keys = 1;
+        printf("testing srtp_install_allocator()...");
+        if (srtp_test_allocator() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-        printf("mips estimate: %e\n", mips_value);
+        printf("testing srtp_create_on_node()...");
+        if (srtp_test_numa_node() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-        printf("testing srtp processing time for voice codecs:\n");
-        printf("codec\t\tlength (octets)\t\tsrtp instructions/second\n");
-        printf("G.711\t\t%d\t\t\t%e\n", 80,
-               (double)mips_value * (80 * 8) /
-                   srtp_bits_per_second(80, &policy) / .01);
-        printf("G.711\t\t%d\t\t\t%e\n", 160,
-               (double)mips_value * (160 * 8) /
-                   srtp_bits_per_second(160, &policy) / .02);
-        printf("G.726-32\t%d\t\t\t%e\n", 40,
-               (double)mips_value * (40 * 8) /
-                   srtp_bits_per_second(40, &policy) / .01);
-        printf("G.726-32\t%d\t\t\t%e\n", 80,
-               (double)mips_value * (80 * 8) /
-                   srtp_bits_per_second(80, &policy) / .02);
-        printf("G.729\t\t%d\t\t\t%e\n", 10,
-               (double)mips_value * (10 * 8) /
-                   srtp_bits_per_second(10, &policy) / .01);
-        printf("G.729\t\t%d\t\t\t%e\n", 20,
-               (double)mips_value * (20 * 8) /
-                   srtp_bits_per_second(20, &policy) / .02);
-        printf("Wideband\t%d\t\t\t%e\n", 320,
-               (double)mips_value * (320 * 8) /
-                   srtp_bits_per_second(320, &policy) / .01);
-        printf("Wideband\t%d\t\t\t%e\n", 640,
-               (double)mips_value * (640 * 8) /
-                   srtp_bits_per_second(640, &policy) / .02);
-    }
+        printf("testing srtp_set_thread_safe()...");
+        if (srtp_test_thread_safe() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-    status = srtp_shutdown();
-    if (status) {
-        printf("error: srtp shutdown failed with error code %d\n", status);
-        exit(1);
-    }
+        printf("testing streams added with the same keys...");
+        if (srtp_test_key_cache() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-    return 0;
-}
+        printf("testing expanded keys shared between sessions...");
+        if (srtp_test_key_store() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-srtp_err_status_t policy_set_key(srtp_policy_t policy, const uint8_t *key)
-{
-    CHECK_OK(srtp_policy_remove_keys(policy));
-    srtp_profile_t profile;
-    CHECK_OK(srtp_policy_get_profile(policy, &profile));
-    size_t key_len = srtp_profile_get_master_key_length(profile);
-    size_t salt_len = srtp_profile_get_master_salt_length(profile);
-    return srtp_policy_add_key(policy, key, key_len, key + key_len, salt_len,
-                               NULL, 0);
-}
+        printf("testing expanded keys shared through a memory region...");
+        if (srtp_test_shared_key_region() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-srtp_err_status_t policy_add_keys(srtp_policy_t policy,
-                                  test_master_key_t **keys,
-                                  size_t num_keys)
-{
-    srtp_profile_t profile;
-    CHECK_OK(srtp_policy_get_profile(policy, &profile));
-    size_t key_len = srtp_profile_get_master_key_length(profile);
-    size_t salt_len = srtp_profile_get_master_salt_length(profile);
-    size_t mki_len;
-    CHECK_OK(srtp_policy_get_mki_length(policy, &mki_len));
-    for (size_t i = 0; i < num_keys; i++) {
-        test_master_key_t *mkey = keys[i];
-        CHECK_OK(srtp_policy_add_key(policy, mkey->key, key_len,
-                                     mkey->key + key_len, salt_len,
-                                     mkey->mki_id, mki_len));
-    }
-    return srtp_err_status_ok;
-}
+        printf("testing srtp_session_set_breaker()...");
+        if (srtp_test_breaker() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-srtp_err_status_t policy_from_test_policy(srtp_policy_t *policy,
-                                          const test_policy_t *test_policy,
-                                          bool enable_mki)
-{
-    CHECK_OK(srtp_policy_create(policy));
-    CHECK_OK(srtp_policy_set_ssrc(*policy, test_policy->ssrc));
-    CHECK_OK(srtp_policy_set_profile(*policy, test_policy->profile));
-    CHECK_OK(srtp_policy_set_sec_serv(*policy, test_policy->rtp_sec_serv,
-                                      test_policy->rtcp_sec_serv));
+        printf("testing srtp_session_export() and srtp_session_import()...");
+        if (srtp_test_session_export() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
 
-    if (enable_mki) {
-        CHECK_OK(srtp_policy_use_mki(*policy, test_policy->mki_size));
+        printf("testing srtp_reader_unprotect()...");
+        if (srtp_test_reader() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_unprotect_headers()...");
+        if (srtp_test_unprotect_headers() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_transcrypt()...");
+        if (srtp_test_transcrypt() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect_double()...");
+        if (srtp_test_double() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_stream_fill_keystream()...");
+        if (srtp_test_keystream_cache() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_batch_submit()...");
+        if (srtp_test_batch_offload() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing key derivation on first use...");
+        if (srtp_test_lazy_keys() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing the replay window of sending streams...");
+        if (srtp_test_sender_window() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing adaptive replay windows...");
+        if (srtp_test_adaptive_window() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_stream_prepare() and srtp_stream_commit()...");
+        if (srtp_test_prepare_commit() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_stream_add_many() and "
+               "srtp_stream_remove_many()...");
+        if (srtp_test_stream_add_many() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_dealloc_deferred() and srtp_reclaim()...");
+        if (srtp_test_dealloc_deferred() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_session_poll_events()...");
+        if (srtp_test_event_queue() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_update() with a key overlap...");
+        if (srtp_test_key_overlap() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_stream_get_stats()...");
+        if (srtp_test_stream_stats() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing the SRTCP state of streams...");
+        if (srtp_test_stream_cold() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_policy_set_max_clones() and srtp_session_gc()...");
+        if (srtp_test_clone_limits() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_session_get_memory_usage()...");
+        if (srtp_test_memory_usage() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_get_stage_profile()...");
+        if (srtp_test_stage_profile() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect_iov() and srtp_unprotect_iov()...");
+        if (srtp_test_protect_iov() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect_buffer() and srtp_unprotect_buffer()...");
+        if (srtp_test_protect_buffer() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_init_ex() with lazy self-tests...");
+        if (srtp_test_init_lazy_self_tests() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_calibrate_crypto()...");
+        if (srtp_test_calibrate_crypto() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect() and srtp_unprotect() on unaligned "
+               "packets...");
+        if (srtp_test_unaligned() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect_stream() and "
+               "srtp_unprotect_stream()...");
+        if (srtp_test_stream_handle(false) == srtp_err_status_ok &&
+            srtp_test_stream_handle(true) == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_rtp_header_parse() and srtp_protect_parsed()...");
+        if (srtp_test_protect_parsed() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+    }
+
+    if (do_stream_list) {
+        printf("testing srtp_stream_list...");
+        if (srtp_stream_list_test() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+    }
+
+    if (do_timing_test) {
+        const test_policy_t **policy = policy_array;
+
+        printf("streams\tsrtp_stream_list_get lookups/second\n");
+        for (size_t n = 1; n <= STREAM_LIST_TEST_MAX_STREAMS; n *= 10) {
+            printf("%zu\t%e\n", n, srtp_stream_list_lookups_per_second(n));
+        }
+
+        printf("master keys\tunknown MKI lookups/second\n");
+        for (size_t n = 1; n <= SRTP_MAX_NUM_MASTER_KEYS; n *= 2) {
+            printf("%zu\t%e\n", n, srtp_mki_lookups_per_second(n));
+        }
+
+        /* loop over policies, run timing test for each */
+        while (*policy != NULL) {
+            srtp_print_policy(*policy);
+            srtp_do_timing(*policy);
+            srtp_do_setup_timing(*policy);
+            policy++;
+        }
+    }
+
+    if (do_memory_report) {
+        const test_policy_t **policy = policy_array;
+
+        printf("stream context: %zu octets\n", sizeof(srtp_stream_ctx_t));
+        while (*policy != NULL) {
+            srtp_print_policy(*policy);
+            srtp_report_stream_memory(*policy);
+            policy++;
+        }
+    }
+
+    if (do_stage_report) {
+        const test_policy_t **policy = policy_array;
+
+        while (*policy != NULL) {
+            srtp_print_policy(*policy);
+            srtp_report_stage_profile(*policy);
+            policy++;
+        }
+    }
+
+    if (do_rejection_test) {
+        const test_policy_t **policy = policy_array;
+
+        /* loop over policies, run rejection timing test for each */
+        while (*policy != NULL) {
+            srtp_print_policy(*policy);
+            srtp_do_rejection_timing(*policy);
+            policy++;
+        }
+    }
+
+    if (do_codec_timing) {
+        test_policy_t policy;
+        size_t ignore;
+        double mips_value = mips_estimate(1000000000, &ignore);
+
+        memset(&policy, 0, sizeof(policy));
+        policy.profile = srtp_profile_aes128_cm_sha1_80;
+        policy.ssrc.type = ssrc_specific;
+        policy.ssrc.value = 0xdecafbad;
+        policy.keys = test_keys;
+        policy.num_master_keys = 1;
+
+        printf("mips estimate: %e\n", mips_value);
+
+        printf("testing srtp processing time for voice codecs:\n");
+        printf("codec\t\tlength (octets)\t\tsrtp instructions/second\n");
+        printf("G.711\t\t%d\t\t\t%e\n", 80,
+               (double)mips_value * (80 * 8) /
+                   srtp_bits_per_second(80, &policy) / .01);
+        printf("G.711\t\t%d\t\t\t%e\n", 160,
+               (double)mips_value * (160 * 8) /
+                   srtp_bits_per_second(160, &policy) / .02);
+        printf("G.726-32\t%d\t\t\t%e\n", 40,
+               (double)mips_value * (40 * 8) /
+                   srtp_bits_per_second(40, &policy) / .01);
+        printf("G.726-32\t%d\t\t\t%e\n", 80,
+               (double)mips_value * (80 * 8) /
+                   srtp_bits_per_second(80, &policy) / .02);
+        printf("G.729\t\t%d\t\t\t%e\n", 10,
+               (double)mips_value * (10 * 8) /
+                   srtp_bits_per_second(10, &policy) / .01);
+        printf("G.729\t\t%d\t\t\t%e\n", 20,
+               (double)mips_value * (20 * 8) /
+                   srtp_bits_per_second(20, &policy) / .02);
+        printf("Wideband\t%d\t\t\t%e\n", 320,
+               (double)mips_value * (320 * 8) /
+                   srtp_bits_per_second(320, &policy) / .01);
+        printf("Wideband\t%d\t\t\t%e\n", 640,
+               (double)mips_value * (640 * 8) /
+                   srtp_bits_per_second(640, &policy) / .02);
+    }
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return 0;
+}
+
+srtp_err_status_t policy_set_key(srtp_policy_t policy, const uint8_t *key)
+{
+    CHECK_OK(srtp_policy_remove_keys(policy));
+    srtp_profile_t profile;
+    CHECK_OK(srtp_policy_get_profile(policy, &profile));
+    size_t key_len = srtp_profile_get_master_key_length(profile);
+    size_t salt_len = srtp_profile_get_master_salt_length(profile);
+    return srtp_policy_add_key(policy, key, key_len, key + key_len, salt_len,
+                               NULL, 0);
+}
+
+srtp_err_status_t policy_add_keys(srtp_policy_t policy,
+                                  test_master_key_t **keys,
+                                  size_t num_keys)
+{
+    srtp_profile_t profile;
+    CHECK_OK(srtp_policy_get_profile(policy, &profile));
+    size_t key_len = srtp_profile_get_master_key_length(profile);
+    size_t salt_len = srtp_profile_get_master_salt_length(profile);
+    size_t mki_len;
+    CHECK_OK(srtp_policy_get_mki_length(policy, &mki_len));
+    for (size_t i = 0; i < num_keys; i++) {
+        test_master_key_t *mkey = keys[i];
+        CHECK_OK(srtp_policy_add_key(policy, mkey->key, key_len,
+                                     mkey->key + key_len, salt_len,
+                                     mkey->mki_id, mki_len));
+    }
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t policy_from_test_policy(srtp_policy_t *policy,
+                                          const test_policy_t *test_policy,
+                                          bool enable_mki)
+{
+    CHECK_OK(srtp_policy_create(policy));
+    CHECK_OK(srtp_policy_set_ssrc(*policy, test_policy->ssrc));
+    CHECK_OK(srtp_policy_set_profile(*policy, test_policy->profile));
+    CHECK_OK(srtp_policy_set_sec_serv(*policy, test_policy->rtp_sec_serv,
+                                      test_policy->rtcp_sec_serv));
+
+    if (enable_mki) {
+        CHECK_OK(srtp_policy_use_mki(*policy, test_policy->mki_size));
+    }
+    if (test_policy->keys) {
+        if (enable_mki) {
+            CHECK_OK(policy_add_keys(*policy, test_policy->keys,
+                                     test_policy->num_master_keys));
+        } else if (test_policy->num_master_keys > 0 && test_policy->keys[0]) {
+            CHECK_OK(policy_set_key(*policy, test_policy->keys[0]->key));
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * create_rtp_test_packet returns a pointer to a (malloced) example
+ * RTP packet whose data field has the length given by payload_len.
+ * There is room at the end of the packet for the max SRTP trailer.
+ * The space for the trailer space and the following four bytes
+ * are filled with overrun marker to enable testing for overwrites.
+ *
+ * The size of the packet is returned rtp_len, the complete size of
+ * the buffer is returned in buffer_len.
+ *
+ * note that the location of the test packet must be
+ * deallocated with the free() call once it is no longer needed.
+ */
+uint8_t *create_rtp_test_packet(size_t payload_len,
+                                uint32_t ssrc,
+                                uint16_t seq,
+                                uint32_t ts,
+                                bool add_hdr_xtn,
+                                size_t *rtp_len,
+                                size_t *buffer_len)
+{
+    uint8_t *buffer;
+    srtp_hdr_t *hdr;
+    size_t bytes_in_hdr = 12;
+    size_t len = 0;
+
+    *rtp_len = payload_len + bytes_in_hdr;
+
+    if (add_hdr_xtn) {
+        *rtp_len += sizeof(rtp_test_packet_extension_header);
+    }
+
+    // allocate enough for max trailer and 4 byte overrun detection
+    len = *rtp_len + SRTP_MAX_TRAILER_LEN + 4;
+
+    buffer = (uint8_t *)malloc(len);
+    if (!buffer) {
+        printf("rtp test packet allocation failed\n");
+        exit(1);
+    }
+
+    overrun_check_prepare(buffer, 0, len);
+
+    hdr = (srtp_hdr_t *)buffer;
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->x = add_hdr_xtn ? 1 : 0;
+    hdr->cc = 0;
+    hdr->m = 0;
+    hdr->pt = 0xf;
+    hdr->seq = htons(seq);
+    hdr->ts = htonl(ts);
+    hdr->ssrc = htonl(ssrc);
+    buffer += bytes_in_hdr;
+
+    if (add_hdr_xtn) {
+        memcpy(buffer, rtp_test_packet_extension_header,
+               sizeof(rtp_test_packet_extension_header));
+        buffer += sizeof(rtp_test_packet_extension_header);
+    }
+
+    /* set RTP data to 0xab */
+    memset(buffer, 0xab, payload_len);
+    buffer += payload_len;
+
+    if (buffer_len) {
+        *buffer_len = len;
+    }
+
+    return buffer - *rtp_len;
+}
+
+uint8_t *create_rtcp_test_packet(size_t payload_len,
+                                 uint32_t ssrc,
+                                 size_t *rtcp_len,
+                                 size_t *buffer_len)
+{
+    uint8_t *buffer;
+    srtcp_hdr_t *hdr;
+    size_t bytes_in_hdr = 8;
+    size_t len = 0;
+
+    *rtcp_len = payload_len + bytes_in_hdr;
+
+    // allocate enough for max trailer and 4 byte overrun detection
+    len = *rtcp_len + SRTP_MAX_SRTCP_TRAILER_LEN + 4;
+
+    buffer = (uint8_t *)malloc(len);
+    if (!buffer) {
+        printf("rtcp test packet allocation failed\n");
+        exit(1);
+    }
+
+    overrun_check_prepare(buffer, 0, len);
+
+    hdr = (srtcp_hdr_t *)buffer;
+    hdr->version = 2; /* RTP version two     */
+    hdr->p = 0;       /* no padding needed   */
+    hdr->rc = 0;      /* no reports          */
+    hdr->pt = 0xc8;   /* sender report (200) */
+    hdr->len = ((bytes_in_hdr + payload_len) % 4) - 1;
+    hdr->ssrc = htonl(ssrc); /* synch. source       */
+    buffer += bytes_in_hdr;
+
+    /* set data to 0xab */
+    memset(buffer, 0xab, payload_len);
+    buffer += payload_len;
+
+    if (buffer_len) {
+        *buffer_len = len;
+    }
+
+    return buffer - *rtcp_len;
+}
+
+static uint16_t get_xtn_profile(const uint8_t *packet)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)packet;
+    const srtp_hdr_xtnd_t *xtn_hdr;
+
+    if (!hdr->x) {
+        return 0;
+    }
+
+    xtn_hdr = (const srtp_hdr_xtnd_t *)(packet + sizeof(srtp_hdr_t) +
+                                        (hdr->cc * sizeof(uint32_t)));
+    return ntohs(xtn_hdr->profile_specific);
+}
+
+void srtp_do_timing(const test_policy_t *policy)
+{
+    int len;
+
+    /*
+     * note: the output of this function is formatted so that it
+     * can be used in gnuplot.  '#' indicates a comment, and "\r\n"
+     * terminates a record
+     */
+
+    printf("# testing srtp throughput:\r\n");
+    printf("# mesg length (octets)\tthroughput (megabits per second)\r\n");
+
+    for (len = 16; len <= 2048; len *= 2) {
+        printf("%d\t\t\t%f\r\n", len,
+               srtp_bits_per_second(len, policy) / 1.0E6);
+    }
+
+    /* these extra linefeeds let gnuplot know that a dataset is done */
+    printf("\r\n\r\n");
+}
+
+void srtp_do_rejection_timing(const test_policy_t *policy)
+{
+    int len;
+
+    /*
+     * note: the output of this function is formatted so that it
+     * can be used in gnuplot.  '#' indicates a comment, and "\r\n"
+     * terminates a record
+     */
+
+    printf("# testing srtp rejection throughput:\r\n");
+    printf("# mesg length (octets)\trejections per second\r\n");
+
+    for (len = 8; len <= 2048; len *= 2) {
+        printf("%d\t\t\t%e\r\n", len, srtp_rejections_per_second(len, policy));
+    }
+
+    /* these extra linefeeds let gnuplot know that a dataset is done */
+    printf("\r\n\r\n");
+}
+
+/*
+ * srtp_do_setup_timing() times setting up streams: whole sessions with
+ * srtp_create(), streams added to one session with srtp_stream_add(), and
+ * streams cloned from an any_outbound template by the first packet of a
+ * new SSRC. Each session and added stream gets a master key of its own,
+ * a session would otherwise take the keys of a stream added with the same
+ * master key from its key cache instead of deriving them; that case is
+ * timed separately, cycling over SETUP_TIMING_SHARED_KEYS keys.
+ */
+#define SETUP_TIMING_NUM_STREAMS 5000
+#define SETUP_TIMING_SHARED_KEYS 16
+
+static double srtp_setup_per_second(clock_t timer)
+{
+    return SETUP_TIMING_NUM_STREAMS * (double)CLOCKS_PER_SEC /
+           (timer ? timer : 1);
+}
+
+void srtp_do_setup_timing(const test_policy_t *test_policy)
+{
+    srtp_policy_t *policies;
+    uint8_t *keys;
+    srtp_ssrc_t ssrc = { ssrc_specific, 0 };
+    srtp_ssrc_t any = { ssrc_any_outbound, 0 };
+    srtp_profile_t profile;
+    srtp_t srtp;
+    uint8_t *template_pkt;
+    uint8_t pkt[64 + SRTP_MAX_TRAILER_LEN];
+    size_t rtp_len;
+    size_t key_len = 0;
+    clock_t timer;
+
+    policies = (srtp_policy_t *)malloc(SETUP_TIMING_NUM_STREAMS *
+                                       sizeof(srtp_policy_t));
+    keys = (uint8_t *)malloc(SETUP_TIMING_NUM_STREAMS * SRTP_MAX_KEY_LEN);
+    if (policies == NULL || keys == NULL) {
+        exit(1);
+    }
+
+    for (size_t i = 0; i < SETUP_TIMING_NUM_STREAMS; i++) {
+        uint8_t *key = keys + i * SRTP_MAX_KEY_LEN;
+
+        CHECK_OK(policy_from_test_policy(&policies[i], test_policy, false));
+        ssrc.value = 0x10000 + (uint32_t)i;
+        CHECK_OK(srtp_policy_set_ssrc(policies[i], ssrc));
+        if (i == 0) {
+            CHECK_OK(srtp_policy_get_profile(policies[0], &profile));
+            key_len = srtp_profile_get_master_key_length(profile) +
+                      srtp_profile_get_master_salt_length(profile);
+        }
+        if (test_policy->keys == NULL || key_len == 0) {
+            continue;
+        }
+        memcpy(key, test_policy->keys[0]->key, key_len);
+        key[0] ^= (uint8_t)i;
+        key[1] ^= (uint8_t)(i >> 8);
+        CHECK_OK(policy_set_key(policies[i], key));
+    }
+
+    printf("# testing srtp stream setup:\r\n");
+    printf("# operation\t\t\tstreams per second\r\n");
+
+    timer = clock();
+    for (size_t i = 0; i < SETUP_TIMING_NUM_STREAMS; i++) {
+        CHECK_OK(srtp_create(&srtp, policies[i]));
+        CHECK_OK(srtp_dealloc(srtp));
+    }
+    timer = clock() - timer;
+    printf("srtp_create\t\t\t%e\r\n", srtp_setup_per_second(timer));
+
+    CHECK_OK(srtp_create(&srtp, NULL));
+    timer = clock();
+    for (size_t i = 0; i < SETUP_TIMING_NUM_STREAMS; i++) {
+        CHECK_OK(srtp_stream_add(srtp, policies[i]));
+    }
+    timer = clock() - timer;
+    CHECK_OK(srtp_dealloc(srtp));
+    printf("srtp_stream_add\t\t\t%e\r\n", srtp_setup_per_second(timer));
+
+    /* streams with the same master key share its derived keys */
+    CHECK_OK(srtp_create(&srtp, NULL));
+    timer = clock();
+    for (size_t i = 0; i < SETUP_TIMING_NUM_STREAMS; i++) {
+        srtp_policy_t policy = policies[i % SETUP_TIMING_SHARED_KEYS];
+        ssrc.value = 0x20000 + (uint32_t)i;
+        CHECK_OK(srtp_policy_set_ssrc(policy, ssrc));
+        CHECK_OK(srtp_stream_add(srtp, policy));
+    }
+    timer = clock() - timer;
+    CHECK_OK(srtp_dealloc(srtp));
+    printf("srtp_stream_add, %d keys\t%e\r\n", SETUP_TIMING_SHARED_KEYS,
+           srtp_setup_per_second(timer));
+
+    /* the clone is made by the first packet, which is timed with it */
+    CHECK_OK(srtp_policy_set_ssrc(policies[0], any));
+    CHECK_OK(srtp_create(&srtp, policies[0]));
+    template_pkt =
+        create_rtp_test_packet(20, 0x10000, 1, 1, false, &rtp_len, NULL);
+    if (template_pkt == NULL) {
+        exit(1);
+    }
+    timer = clock();
+    for (size_t i = 0; i < SETUP_TIMING_NUM_STREAMS; i++) {
+        srtp_hdr_t *hdr = (srtp_hdr_t *)pkt;
+        size_t len = rtp_len;
+        memcpy(pkt, template_pkt, rtp_len);
+        hdr->ssrc = htonl(0x10000 + (uint32_t)i);
+        CHECK_OK(call_srtp_protect(srtp, pkt, &len, 0));
+    }
+    timer = clock() - timer;
+    free(template_pkt);
+    CHECK_OK(srtp_dealloc(srtp));
+    printf("template clone\t\t\t%e\r\n", srtp_setup_per_second(timer));
+
+    for (size_t i = 0; i < SETUP_TIMING_NUM_STREAMS; i++) {
+        srtp_policy_destroy(policies[i]);
+    }
+    free(policies);
+    free(keys);
+
+    /* these extra linefeeds let gnuplot know that a dataset is done */
+    printf("\r\n\r\n");
+}
+
+#define MAX_MSG_LEN 1024
+
+double srtp_bits_per_second(size_t msg_len_octets,
+                            const test_policy_t *test_policy)
+{
+    srtp_t srtp;
+    srtp_policy_t policy;
+    uint8_t *mesg;
+    clock_t timer;
+    size_t num_trials = 100000;
+    size_t input_len, len;
+    uint32_t ssrc;
+    srtp_err_status_t status;
+
+    CHECK_OK(policy_from_test_policy(&policy, test_policy, false));
+
+    /*
+     * allocate and initialize an srtp session
+     */
+    status = srtp_create(&srtp, policy);
+    if (status) {
+        printf("error: srtp_create() failed with error code %d\n", status);
+        exit(1);
+    }
+
+    srtp_policy_destroy(policy);
+
+    /*
+     * if the ssrc is unspecified, use a predetermined one
+     */
+    if (test_policy->ssrc.type != ssrc_specific) {
+        ssrc = 0xdeadbeef;
+    } else {
+        ssrc = test_policy->ssrc.value;
+    }
+
+    /*
+     * create a test packet
+     */
+    mesg = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1, false, &input_len,
+                                  NULL);
+    if (mesg == NULL) {
+        return 0.0; /* indicate failure by returning zero */
+    }
+    timer = clock();
+    for (size_t i = 0; i < num_trials; i++) {
+        len = input_len;
+        /* srtp protect message */
+        status = call_srtp_protect(srtp, mesg, &len, 0);
+        if (status) {
+            printf("error: srtp_protect() failed with error code %d\n", status);
+            exit(1);
+        }
+
+        /* increment message number */
+        {
+            /* hack sequence to avoid problems with macros for htons/ntohs on
+             * some systems */
+            srtp_hdr_t *hdr = (srtp_hdr_t *)mesg;
+            short new_seq = ntohs(hdr->seq) + 1;
+            hdr->seq = htons(new_seq);
+        }
+    }
+    timer = clock() - timer;
+
+    free(mesg);
+
+    status = srtp_dealloc(srtp);
+    if (status) {
+        printf("error: srtp_dealloc() failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return msg_len_octets * 8.0 * num_trials * CLOCKS_PER_SEC / timer;
+}
+
+double srtp_rejections_per_second(size_t msg_len_octets,
+                                  const test_policy_t *test_policy)
+{
+    srtp_ctx_t *srtp;
+    srtp_policy_t policy;
+    uint8_t *mesg;
+    size_t len;
+    clock_t timer;
+    size_t num_trials = 1000000;
+    uint32_t ssrc = test_policy->ssrc.value;
+    srtp_err_status_t status;
+
+    CHECK_OK(policy_from_test_policy(&policy, test_policy, false));
+
+    /*
+     * allocate and initialize an srtp session
+     */
+    status = srtp_create(&srtp, policy);
+    if (status) {
+        printf("error: srtp_create() failed with error code %d\n", status);
+        exit(1);
+    }
+
+    srtp_policy_destroy(policy);
+
+    mesg =
+        create_rtp_test_packet(msg_len_octets, ssrc, 1, 1, false, &len, NULL);
+    if (mesg == NULL) {
+        return 0.0; /* indicate failure by returning zero */
+    }
+    call_srtp_protect(srtp, mesg, &len, 0);
+
+    timer = clock();
+    for (size_t i = 0; i < num_trials; i++) {
+        len = msg_len_octets;
+        call_srtp_unprotect(srtp, mesg, &len);
+    }
+    timer = clock() - timer;
+
+    free(mesg);
+
+    status = srtp_dealloc(srtp);
+    if (status) {
+        printf("error: srtp_dealloc() failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return (double)num_trials * CLOCKS_PER_SEC / timer;
+}
+
+srtp_err_status_t srtp_test(const test_policy_t *policy,
+                            bool test_extension_headers,
+                            bool use_mki,
+                            size_t mki_index)
+{
+    size_t i;
+    srtp_t srtp_sender;
+    srtp_t srtp_rcvr;
+    srtp_err_status_t status = srtp_err_status_ok;
+    uint8_t *hdr, *hdr2;
+    uint8_t hdr_enc[128];
+    size_t msg_len_octets, msg_len_enc, msg_len;
+    size_t len, len2;
+    size_t tag_length;
+    size_t buffer_len;
+    uint32_t ssrc;
+    srtp_policy_t send_policy;
+    srtp_policy_t rcvr_policy;
+    uint8_t header = 1;
+
+    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+
+    if (test_extension_headers) {
+        CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(send_policy, header));
+    }
+
+    CHECK_OK(srtp_create(&srtp_sender, send_policy));
+
+    /* print out policy */
+    CHECK_OK(srtp_session_print_policy(srtp_sender));
+
+    /*
+     * initialize data buffer, using the ssrc in the policy unless that
+     * value is a wildcard, in which case we'll just use an arbitrary
+     * one
+     */
+    if (policy->ssrc.type != ssrc_specific) {
+        ssrc = 0xdecafbad;
+    } else {
+        ssrc = policy->ssrc.value;
+    }
+    msg_len_octets = 28;
+    hdr = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
+                                 test_extension_headers, &len, &buffer_len);
+    hdr2 = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
+                                  test_extension_headers, &len2, NULL);
+
+    /* save original msg len */
+    msg_len = len;
+
+    if (hdr == NULL) {
+        free(hdr2);
+        return srtp_err_status_alloc_fail;
+    }
+    if (hdr2 == NULL) {
+        free(hdr);
+        return srtp_err_status_alloc_fail;
+    }
+
+    debug_print(mod_driver, "before protection:\n%s",
+                srtp_packet_to_string(hdr, len));
+
+#if PRINT_REFERENCE_PACKET
+    debug_print(mod_driver, "reference packet before protection:\n%s",
+                octet_string_hex_string(hdr, len));
+#endif
+    CHECK_OK(call_srtp_protect(srtp_sender, hdr, &len, mki_index));
+
+    debug_print(mod_driver, "after protection:\n%s",
+                srtp_packet_to_string(hdr, len));
+#if PRINT_REFERENCE_PACKET
+    debug_print(mod_driver, "after protection:\n%s",
+                octet_string_hex_string(hdr, len));
+#endif
+
+    /* save protected message and length */
+    memcpy(hdr_enc, hdr, len);
+    msg_len_enc = len;
+
+    /*
+     * check for overrun of the srtp_protect() function
+     *
+     * The packet is followed by a value of 0xffffffff; if the value of the
+     * data following the packet is different, then we know that the
+     * protect function is overwriting the end of the packet.
+     */
+    CHECK_OK(
+        srtp_get_protect_trailer_length(srtp_sender, mki_index, &tag_length));
+    CHECK_OVERRUN(hdr, msg_len + tag_length, buffer_len);
+
+    /*
+     * if the policy includes confidentiality, check that ciphertext is
+     * different than plaintext
+     *
+     * Note that this check will give false negatives, with some small
+     * probability, especially if the packets are short.  For that
+     * reason, we skip this check if the plaintext is less than four
+     * octets long.
+     */
+    if ((policy->rtp_sec_serv & sec_serv_conf) && (msg_len_octets >= 4)) {
+        printf("testing that ciphertext is distinct from plaintext...");
+        status = srtp_err_status_algo_fail;
+        for (i = 12; i < msg_len_octets + 12; i++) {
+            if (hdr[i] != hdr2[i]) {
+                status = srtp_err_status_ok;
+            }
+        }
+        if (status) {
+            printf("failed\n");
+            free(hdr);
+            free(hdr2);
+            return status;
+        }
+        printf("passed\n");
+    }
+
+    CHECK_OK(srtp_policy_clone(send_policy, &rcvr_policy));
+    CHECK_OK(srtp_policy_set_ssrc(rcvr_policy,
+                                  (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+
+    CHECK_OK(srtp_create(&srtp_rcvr, rcvr_policy));
+
+    CHECK_OK(call_srtp_unprotect(srtp_rcvr, hdr, &len));
+
+    debug_print(mod_driver, "after unprotection:\n%s",
+                srtp_packet_to_string(hdr, len));
+
+    /* verify that the unprotected packet matches the original one */
+    for (i = 0; i < len; i++) {
+        if (hdr[i] != hdr2[i]) {
+            fprintf(stdout, "mismatch at octet %zu\n", i);
+            status = srtp_err_status_algo_fail;
+        }
+    }
+    if (status) {
+        free(hdr);
+        free(hdr2);
+        return status;
+    }
+
+    /*
+     * if the policy includes authentication, then test for false positives
+     */
+    if (policy->rtp_sec_serv & sec_serv_auth) {
+        uint8_t *data = hdr + (test_extension_headers ? 24 : 12);
+
+        printf("testing for false positives in replay check...");
+
+        /* unprotect a second time - should fail with a replay error */
+        status = call_srtp_unprotect(srtp_rcvr, hdr, &msg_len_enc);
+        if (status != srtp_err_status_replay_fail) {
+            printf("failed with error code %d\n", status);
+            free(hdr);
+            free(hdr2);
+            return srtp_err_status_algo_fail;
+        } else {
+            printf("passed\n");
+        }
+
+        printf("testing for false positives in auth check...");
+
+        /* increment sequence number in header */
+        ((srtp_hdr_t *)hdr)->seq++;
+
+        /* apply protection */
+        CHECK_OK(call_srtp_protect(srtp_sender, hdr, &len, mki_index));
+
+        /* flip bits in packet */
+        data[0] ^= 0xff;
+
+        /* unprotect, and check for authentication failure */
+        status = call_srtp_unprotect(srtp_rcvr, hdr, &len);
+        if (status != srtp_err_status_auth_fail) {
+            printf("failed with error code %d\n", status);
+            printf("failed\n");
+            free(hdr);
+            free(hdr2);
+            return srtp_err_status_algo_fail;
+        } else {
+            printf("passed\n");
+        }
+    }
+
+    CHECK_OK(srtp_dealloc(srtp_sender));
+    CHECK_OK(srtp_dealloc(srtp_rcvr));
+
+    srtp_policy_destroy(send_policy);
+    srtp_policy_destroy(rcvr_policy);
+
+    free(hdr);
+    free(hdr2);
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_io_lengths(const test_policy_t *policy,
+                                       bool test_extension_headers,
+                                       bool use_mki,
+                                       size_t mki_index)
+{
+    srtp_t srtp_sender;
+    srtp_policy_t send_policy;
+    uint32_t ssrc;
+    uint16_t seq = 1;
+    uint32_t ts = 1234;
+    uint8_t *rtp;
+    size_t rtp_len, buffer_len, srtp_len;
+    size_t rtp_header_len = 12;
+    uint8_t xtn_header_id = 1;
+
+    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+
+    if (test_extension_headers) {
+        CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(send_policy, xtn_header_id));
+        rtp_header_len += sizeof(rtp_test_packet_extension_header);
+    }
+
+    CHECK_OK(srtp_create(&srtp_sender, send_policy));
+
+    // get required trailer length
+    size_t trailer_len;
+    CHECK_OK(
+        srtp_get_protect_trailer_length(srtp_sender, mki_index, &trailer_len));
+
+    CHECK_OK(srtp_session_print_policy(srtp_sender));
+
+    if (policy->ssrc.type != ssrc_specific) {
+        ssrc = 0xdecafbad;
+    } else {
+        ssrc = policy->ssrc.value;
+    }
+
+    // 0 byte input
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = buffer_len;
+    overrun_check_prepare(rtp, 0, buffer_len);
+    CHECK_RETURN(call_srtp_protect2(srtp_sender, rtp, 0, &srtp_len, mki_index),
+                 srtp_err_status_bad_param);
+    CHECK_OVERRUN(rtp, 0, buffer_len);
+    free(rtp);
+
+    // 1 byte input
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = buffer_len;
+    overrun_check_prepare(rtp, 1, buffer_len);
+    CHECK_RETURN(call_srtp_protect2(srtp_sender, rtp, 1, &srtp_len, mki_index),
+                 srtp_err_status_bad_param);
+    CHECK_OVERRUN(rtp, 1, buffer_len);
+    free(rtp);
+
+    // too short header
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = buffer_len;
+    overrun_check_prepare(rtp, rtp_header_len - 1, buffer_len);
+    CHECK_RETURN(call_srtp_protect2(srtp_sender, rtp, rtp_header_len - 1,
+                                    &srtp_len, mki_index),
+                 srtp_err_status_bad_param);
+    CHECK_OVERRUN(rtp, rtp_header_len - 1, buffer_len);
+    free(rtp);
+
+    // zero payload
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = buffer_len;
+    overrun_check_prepare(rtp, rtp_header_len, buffer_len);
+    CHECK_OK(call_srtp_protect2(srtp_sender, rtp, rtp_header_len, &srtp_len,
+                                mki_index));
+    CHECK(srtp_len == rtp_header_len + trailer_len);
+    CHECK_OVERRUN(rtp, srtp_len, buffer_len);
+    free(rtp);
+
+    // 1 byte payload
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = buffer_len;
+    overrun_check_prepare(rtp, rtp_header_len + 1, buffer_len);
+    CHECK_OK(call_srtp_protect2(srtp_sender, rtp, rtp_header_len + 1, &srtp_len,
+                                mki_index));
+    CHECK(srtp_len == rtp_header_len + 1 + trailer_len);
+    CHECK_OVERRUN(rtp, srtp_len, buffer_len);
+    free(rtp);
+
+    // 0 byte output
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = 0;
+    overrun_check_prepare(rtp, rtp_len, buffer_len);
+    CHECK_RETURN(
+        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
+        srtp_err_status_buffer_small);
+    CHECK_OVERRUN(rtp, rtp_len, buffer_len);
+    free(rtp);
+
+    // 1 byte output
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = 1;
+    overrun_check_prepare(rtp, rtp_len, buffer_len);
+    CHECK_RETURN(
+        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
+        srtp_err_status_buffer_small);
+    CHECK_OVERRUN(rtp, rtp_len, buffer_len);
+    free(rtp);
+
+    if (trailer_len != 0) {
+        // no space for trailer output
+        rtp = create_rtp_test_packet(
+            28, ssrc, seq++, ts, test_extension_headers, &rtp_len, &buffer_len);
+        srtp_len = rtp_len;
+        overrun_check_prepare(rtp, rtp_len, buffer_len);
+        CHECK_RETURN(
+            call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
+            srtp_err_status_buffer_small);
+        CHECK_OVERRUN(rtp, rtp_len, buffer_len);
+        free(rtp);
+    }
+
+    // 1 byte too small output
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = rtp_len + trailer_len - 1;
+    overrun_check_prepare(rtp, rtp_len, buffer_len);
+    CHECK_RETURN(
+        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
+        srtp_err_status_buffer_small);
+    CHECK_OVERRUN(rtp, rtp_len, buffer_len);
+    free(rtp);
+
+    // full payload
+    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
+                                 &rtp_len, &buffer_len);
+    srtp_len = buffer_len;
+    CHECK_OK(
+        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index));
+    CHECK(srtp_len == rtp_len + trailer_len);
+    CHECK_OVERRUN(rtp, srtp_len, buffer_len);
+
+    CHECK_OK(srtp_dealloc(srtp_sender));
+
+    // unprotect
+    srtp_t srtp_receiver;
+    srtp_policy_t receive_policy;
+
+    CHECK_OK(srtp_policy_clone(send_policy, &receive_policy));
+    CHECK_OK(srtp_policy_set_ssrc(receive_policy,
+                                  (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+
+    CHECK_OK(srtp_create(&srtp_receiver, receive_policy));
+
+    // unprotect zero byte input
+    rtp_len = buffer_len;
+    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, 0, &rtp_len),
+                 srtp_err_status_bad_param);
+
+    // unprotect 1 byte input
+    rtp_len = buffer_len;
+    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, 1, &rtp_len),
+                 srtp_err_status_bad_param);
+
+    // unprotect short header
+    rtp_len = buffer_len;
+    CHECK_RETURN(
+        call_srtp_unprotect2(srtp_receiver, rtp, rtp_header_len - 1, &rtp_len),
+        srtp_err_status_bad_param);
+
+    // 0 byte output
+    rtp_len = 0;
+    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len),
+                 srtp_err_status_buffer_small);
+
+    // 1 byte output
+    rtp_len = 1;
+    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len),
+                 srtp_err_status_buffer_small);
+
+    // 1 byte too small output
+    rtp_len = srtp_len - trailer_len - 1;
+    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len),
+                 srtp_err_status_buffer_small);
+
+    // full unprotect
+    rtp_len = buffer_len;
+    CHECK_OK(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len));
+    CHECK(rtp_len == srtp_len - trailer_len);
+
+    free(rtp);
+
+    CHECK_OK(srtp_dealloc(srtp_receiver));
+
+    srtp_policy_destroy(send_policy);
+    srtp_policy_destroy(receive_policy);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtcp_test(const test_policy_t *policy,
+                             bool use_mki,
+                             size_t mki_index)
+{
+    srtp_t srtcp_sender;
+    srtp_t srtcp_rcvr;
+    srtp_err_status_t status = srtp_err_status_ok;
+    uint8_t *hdr, *hdr2;
+    uint8_t hdr_enc[128];
+    size_t msg_len_octets, msg_len_enc, msg_len;
+    size_t len, len2;
+    size_t buffer_len;
+    size_t tag_length;
+    uint32_t ssrc;
+    srtp_policy_t send_policy;
+    srtp_policy_t rcvr_policy;
+
+    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+
+    CHECK_OK(srtp_create(&srtcp_sender, send_policy));
+
+    /* print out policy */
+    CHECK_OK(srtp_session_print_policy(srtcp_sender));
+
+    /*
+     * initialize data buffer, using the ssrc in the policy unless that
+     * value is a wildcard, in which case we'll just use an arbitrary
+     * one
+     */
+    if (policy->ssrc.type != ssrc_specific) {
+        ssrc = 0xdecafbad;
+    } else {
+        ssrc = policy->ssrc.value;
+    }
+    msg_len_octets = 28;
+    hdr = create_rtcp_test_packet(msg_len_octets, ssrc, &len, &buffer_len);
+    /* save message len */
+    msg_len = len;
+
+    if (hdr == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    hdr2 = create_rtcp_test_packet(msg_len_octets, ssrc, &len2, NULL);
+    if (hdr2 == NULL) {
+        free(hdr);
+        return srtp_err_status_alloc_fail;
+    }
+
+    debug_print(mod_driver, "before protection:\n%s",
+                srtp_rtcp_packet_to_string(hdr, len));
+
+#if PRINT_REFERENCE_PACKET
+    debug_print(mod_driver, "reference packet before protection:\n%s",
+                octet_string_hex_string(hdr, len));
+#endif
+    CHECK_OK(call_srtp_protect_rtcp(srtcp_sender, hdr, &len, mki_index));
+
+    debug_print(mod_driver, "after protection:\n%s",
+                srtp_rtcp_packet_to_string(hdr, len));
+#if PRINT_REFERENCE_PACKET
+    debug_print(mod_driver, "after protection:\n%s",
+                octet_string_hex_string(hdr, len));
+#endif
+
+    /* save protected message and length */
+    memcpy(hdr_enc, hdr, len);
+    msg_len_enc = len;
+
+    /*
+     * check for overrun of the srtp_protect_rtcp() function
+     *
+     * The packet is followed by a value of 0xffffffff; if the value of the
+     * data following the packet is different, then we know that the
+     * protect function is overwriting the end of the packet.
+     */
+    srtp_get_protect_rtcp_trailer_length(srtcp_sender, mki_index, &tag_length);
+    CHECK_OVERRUN(hdr, msg_len + tag_length, buffer_len);
+
+    /*
+     * if the policy includes confidentiality, check that ciphertext is
+     * different than plaintext
+     *
+     * Note that this check will give false negatives, with some small
+     * probability, especially if the packets are short.  For that
+     * reason, we skip this check if the plaintext is less than four
+     * octets long.
+     */
+    if ((policy->rtcp_sec_serv & sec_serv_conf) && (msg_len_octets >= 4)) {
+        printf("testing that ciphertext is distinct from plaintext...");
+        status = srtp_err_status_algo_fail;
+        for (size_t i = 12; i < msg_len_octets + 12; i++) {
+            if (hdr[i] != hdr2[i]) {
+                status = srtp_err_status_ok;
+            }
+        }
+        if (status) {
+            printf("failed\n");
+            free(hdr);
+            free(hdr2);
+            return status;
+        }
+        printf("passed\n");
+    }
+
+    CHECK_OK(srtp_policy_clone(send_policy, &rcvr_policy));
+    if (policy->ssrc.type == ssrc_any_outbound) {
+        CHECK_OK(srtp_policy_set_ssrc(rcvr_policy,
+                                      (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    }
+
+    CHECK_OK(srtp_create(&srtcp_rcvr, rcvr_policy));
+
+    CHECK_OK(call_srtp_unprotect_rtcp(srtcp_rcvr, hdr, &len));
+
+    debug_print(mod_driver, "after unprotection:\n%s",
+                srtp_rtcp_packet_to_string(hdr, len));
+
+    /* verify that the unprotected packet matches the original one */
+    for (size_t i = 0; i < len; i++) {
+        if (hdr[i] != hdr2[i]) {
+            fprintf(stdout, "mismatch at octet %zu\n", i);
+            status = srtp_err_status_algo_fail;
+        }
+    }
+    if (status) {
+        free(hdr);
+        free(hdr2);
+        return status;
+    }
+
+    /*
+     * if the policy includes authentication, then test for false positives
+     */
+    if (policy->rtcp_sec_serv & sec_serv_auth) {
+        uint8_t *data = hdr + 12;
+
+        printf("testing for false positives in replay check...");
+
+        /* unprotect a second time - should fail with a replay error */
+        status = call_srtp_unprotect_rtcp(srtcp_rcvr, hdr, &msg_len_enc);
+        if (status != srtp_err_status_replay_fail) {
+            printf("failed with error code %d\n", status);
+            free(hdr);
+            free(hdr2);
+            return srtp_err_status_algo_fail;
+        } else {
+            printf("passed\n");
+        }
+
+        printf("testing for false positives in auth check...");
+
+        /* apply protection */
+        CHECK_OK(call_srtp_protect_rtcp(srtcp_sender, hdr, &len, mki_index));
+
+        /* flip bits in packet */
+        data[0] ^= 0xff;
+
+        /* unprotect, and check for authentication failure */
+        status = call_srtp_unprotect_rtcp(srtcp_rcvr, hdr, &len);
+        if (status != srtp_err_status_auth_fail) {
+            printf("failed with error code %d\n", status);
+            printf("failed\n");
+            free(hdr);
+            free(hdr2);
+            return srtp_err_status_algo_fail;
+        } else {
+            printf("passed\n");
+        }
+    }
+
+    CHECK_OK(srtp_dealloc(srtcp_sender));
+    CHECK_OK(srtp_dealloc(srtcp_rcvr));
+
+    srtp_policy_destroy(send_policy);
+    srtp_policy_destroy(rcvr_policy);
+
+    free(hdr);
+    free(hdr2);
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtcp_test_io_lengths(const test_policy_t *policy,
+                                        bool use_mki,
+                                        size_t mki_index)
+{
+    srtp_t srtp_sender;
+    srtp_policy_t send_policy;
+    uint32_t ssrc;
+    uint8_t *rtcp;
+    size_t rtcp_len, buffer_len, srtcp_len;
+    size_t rtcp_header_len = 8;
+
+    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+
+    CHECK_OK(srtp_create(&srtp_sender, send_policy));
+
+    // get required trailer length
+    size_t trailer_len;
+    CHECK_OK(srtp_get_protect_rtcp_trailer_length(srtp_sender, mki_index,
+                                                  &trailer_len));
+
+    CHECK_OK(srtp_session_print_policy(srtp_sender));
+
+    if (policy->ssrc.type != ssrc_specific) {
+        ssrc = 0xdecafbad;
+    } else {
+        ssrc = policy->ssrc.value;
+    }
+
+    // 0 byte input
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    overrun_check_prepare(rtcp, 0, buffer_len);
+    CHECK_RETURN(
+        call_srtp_protect_rtcp2(srtp_sender, rtcp, 0, &srtcp_len, mki_index),
+        srtp_err_status_bad_param);
+    CHECK_OVERRUN(rtcp, 0, buffer_len);
+    free(rtcp);
+
+    // 1 byte input
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    overrun_check_prepare(rtcp, 1, buffer_len);
+    CHECK_RETURN(
+        call_srtp_protect_rtcp2(srtp_sender, rtcp, 1, &srtcp_len, mki_index),
+        srtp_err_status_bad_param);
+    CHECK_OVERRUN(rtcp, 1, buffer_len);
+    free(rtcp);
+
+    // too short header
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    overrun_check_prepare(rtcp, rtcp_header_len - 1, buffer_len);
+    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_header_len - 1,
+                                         &srtcp_len, mki_index),
+                 srtp_err_status_bad_param);
+    CHECK_OVERRUN(rtcp, rtcp_header_len - 1, buffer_len);
+    free(rtcp);
+
+    // zero payload
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    overrun_check_prepare(rtcp, rtcp_header_len, buffer_len);
+    CHECK_OK(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_header_len,
+                                     &srtcp_len, mki_index));
+    CHECK(srtcp_len == rtcp_header_len + trailer_len);
+    CHECK_OVERRUN(rtcp, srtcp_len, buffer_len);
+    free(rtcp);
+
+    // 1 byte payload
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    overrun_check_prepare(rtcp, rtcp_header_len + 1, buffer_len);
+    CHECK_OK(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_header_len + 1,
+                                     &srtcp_len, mki_index));
+    CHECK(srtcp_len == rtcp_header_len + 1 + trailer_len);
+    CHECK_OVERRUN(rtcp, srtcp_len, buffer_len);
+    free(rtcp);
+
+    // 0 byte output
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = 0;
+    overrun_check_prepare(rtcp, rtcp_len, buffer_len);
+    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
+                                         &srtcp_len, mki_index),
+                 srtp_err_status_buffer_small);
+    CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
+    free(rtcp);
+
+    // 1 byte output
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = 1;
+    overrun_check_prepare(rtcp, rtcp_len, buffer_len);
+    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
+                                         &srtcp_len, mki_index),
+                 srtp_err_status_buffer_small);
+    CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
+    free(rtcp);
+
+    if (trailer_len != 0) {
+        // no space for trailer output
+        rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+        srtcp_len = rtcp_len;
+        overrun_check_prepare(rtcp, rtcp_len, buffer_len);
+        CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
+                                             &srtcp_len, mki_index),
+                     srtp_err_status_buffer_small);
+        CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
+        free(rtcp);
+    }
+
+    // 1 byte too small output
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = rtcp_len + trailer_len - 1;
+    overrun_check_prepare(rtcp, rtcp_len, buffer_len);
+    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
+                                         &srtcp_len, mki_index),
+                 srtp_err_status_buffer_small);
+    CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
+    free(rtcp);
+
+    // full payload
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    CHECK_OK(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len, &srtcp_len,
+                                     mki_index));
+    CHECK(srtcp_len == rtcp_len + trailer_len);
+    CHECK_OVERRUN(rtcp, srtcp_len, buffer_len);
+
+    CHECK_OK(srtp_dealloc(srtp_sender));
+
+    // unprotect
+    srtp_t srtp_receiver;
+    srtp_policy_t receive_policy;
+
+    CHECK_OK(srtp_policy_clone(send_policy, &receive_policy));
+    CHECK_OK(srtp_policy_set_ssrc(receive_policy,
+                                  (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+
+    CHECK_OK(srtp_create(&srtp_receiver, receive_policy));
+
+    // unprotect zero byte input
+    rtcp_len = buffer_len;
+    CHECK_RETURN(call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, 0, &rtcp_len),
+                 srtp_err_status_bad_param);
+
+    // unprotect 1 byte input
+    rtcp_len = buffer_len;
+    CHECK_RETURN(call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, 1, &rtcp_len),
+                 srtp_err_status_bad_param);
+
+    // unprotect short header
+    rtcp_len = buffer_len;
+    CHECK_RETURN(call_srtp_unprotect_rtcp2(srtp_receiver, rtcp,
+                                           rtcp_header_len - 1, &rtcp_len),
+                 srtp_err_status_bad_param);
+
+    // 0 byte output
+    rtcp_len = 0;
+    CHECK_RETURN(
+        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len),
+        srtp_err_status_buffer_small);
+
+    // 1 byte output
+    rtcp_len = 1;
+    CHECK_RETURN(
+        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len),
+        srtp_err_status_buffer_small);
+
+    // 1 byte too small output
+    rtcp_len = srtcp_len - trailer_len - 1;
+    CHECK_RETURN(
+        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len),
+        srtp_err_status_buffer_small);
+
+    // full unprotect
+    rtcp_len = buffer_len;
+    CHECK_OK(
+        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len));
+    CHECK(rtcp_len == srtcp_len - trailer_len);
+
+    free(rtcp);
+
+    CHECK_OK(srtp_dealloc(srtp_receiver));
+
+    srtp_policy_destroy(send_policy);
+    srtp_policy_destroy(receive_policy);
+
+    return srtp_err_status_ok;
+}
+
+struct srtp_session_print_stream_data {
+    // set by callback to indicate failure
+    srtp_err_status_t status;
+    // indicates if it is the template stream or a regular stream
+    int is_template;
+};
+
+bool srtp_session_print_stream(srtp_stream_t stream, void *raw_data)
+{
+    static const char *serv_descr[4] = { "none", "confidentiality",
+                                         "authentication",
+                                         "confidentiality and authentication" };
+    static const char *direction[3] = { "unknown", "outbound", "inbound" };
+
+    struct srtp_session_print_stream_data *data =
+        (struct srtp_session_print_stream_data *)raw_data;
+    srtp_session_keys_t *session_keys = &stream->session_keys[0];
+    char ssrc_text[32];
+
+    if (!data->is_template && stream->rtp_services > sec_serv_conf_and_auth) {
+        data->status = srtp_err_status_bad_param;
+        return false;
+    }
+
+    if (data->is_template) {
+        snprintf(ssrc_text, sizeof(ssrc_text), "any %s",
+                 direction[stream->direction]);
+    } else {
+        snprintf(ssrc_text, sizeof(ssrc_text), "0x%08x", stream->ssrc);
+    }
+
+    printf("# SSRC:          %s\r\n"
+           "# rtp cipher:    %s\r\n"
+           "# rtp auth:      %s\r\n"
+           "# rtp services:  %s\r\n"
+           "# rtcp cipher:   %s\r\n"
+           "# rtcp auth:     %s\r\n"
+           "# rtcp services: %s\r\n"
+           "# num keys:      %zu\r\n"
+           "# use mki:       %s\r\n"
+           "# mki size:      %zu\r\n"
+           "# window size:   %zu\r\n"
+           "# tx rtx allowed:%s\r\n",
+           ssrc_text, session_keys->rtp_cipher->type->description,
+           session_keys->rtp_auth->type->description,
+           serv_descr[stream->rtp_services],
+           session_keys->rtcp_cipher->type->description,
+           session_keys->rtcp_auth->type->description,
+           serv_descr[stream->rtcp_services], (size_t)stream->num_master_keys,
+           stream->use_mki ? "true" : "false", (size_t)stream->mki_size,
+           srtp_rdbx_get_window_size(&stream->rtp_rdbx),
+           stream->allow_repeat_tx ? "true" : "false");
+
+    printf("# Encrypted extension headers: ");
+    if (stream->enc_xtn_hdr && stream->enc_xtn_hdr_count > 0) {
+        uint8_t *enc_xtn_hdr = stream->enc_xtn_hdr;
+        size_t count = stream->enc_xtn_hdr_count;
+        while (count > 0) {
+            printf("%d ", *enc_xtn_hdr);
+            enc_xtn_hdr++;
+            count--;
+        }
+        printf("\n");
+    } else {
+        printf("none\n");
+    }
+
+    return true;
+}
+
+srtp_err_status_t srtp_session_print_policy(srtp_t srtp)
+{
+    struct srtp_session_print_stream_data data = { srtp_err_status_ok, 0 };
+
+    /* sanity checking */
+    if (srtp == NULL) {
+        return srtp_err_status_fail;
+    }
+
+    /* if there's a template stream, print it out */
+    if (srtp->stream_template != NULL) {
+        data.is_template = 1;
+        srtp_session_print_stream(srtp->stream_template, &data);
+    }
+
+    /* loop over streams in session, printing the policy of each */
+    data.is_template = 0;
+    srtp_stream_list_for_each(srtp->stream_list, srtp_session_print_stream,
+                              &data);
+
+    return data.status;
+}
+
+srtp_err_status_t srtp_print_policy(const test_policy_t *test_policy)
+{
+    srtp_err_status_t status;
+    srtp_policy_t policy;
+    srtp_t session;
+    CHECK_OK(policy_from_test_policy(&policy, test_policy, false));
+
+    status = srtp_create(&session, policy);
+    if (status) {
+        return status;
+    }
+    status = srtp_session_print_policy(session);
+    if (status) {
+        return status;
+    }
+    status = srtp_dealloc(session);
+    if (status) {
+        return status;
+    }
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_print_packet(...) is for debugging only
+ * it prints an RTP packet to the stdout
+ *
+ * note that this function is *not* threadsafe
+ */
+
+#include <stdio.h>
+
+#define MTU 2048
+
+char packet_string[MTU];
+
+char *srtp_packet_to_string(uint8_t *packet, size_t pkt_octet_len)
+{
+    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
+    size_t octets_in_rtp_header = 12;
+    uint8_t *data = packet + octets_in_rtp_header;
+    size_t data_len = pkt_octet_len - octets_in_rtp_header;
+
+    /* sanity checking */
+    if ((hdr == NULL) || (pkt_octet_len > MTU)) {
+        return NULL;
+    }
+
+    /* write packet into string */
+    int offset = snprintf(packet_string, sizeof(packet_string),
+                          "(s)rtp packet: {\n"
+                          "   version:\t%d\n"
+                          "   p:\t\t%d\n"
+                          "   x:\t\t%d\n"
+                          "   cc:\t\t%d\n"
+                          "   m:\t\t%d\n"
+                          "   pt:\t\t%x\n"
+                          "   seq:\t\t%x\n"
+                          "   ts:\t\t%x\n"
+                          "   ssrc:\t%x",
+                          hdr->version, hdr->p, hdr->x, hdr->cc, hdr->m,
+                          hdr->pt, hdr->seq, hdr->ts, hdr->ssrc);
+
+    if (hdr->cc) {
+        offset += snprintf(packet_string + offset,
+                           sizeof(packet_string) - offset, "\n   csrc:\t");
+        for (int i = 0; i < hdr->cc; i++) {
+            offset +=
+                snprintf(packet_string + offset, sizeof(packet_string) - offset,
+                         "%x ", *((&hdr->ssrc) + 1 + i));
+        }
+        data += 4 * hdr->cc;
+        data_len -= 4 * hdr->cc;
+    }
+
+    if (hdr->x) {
+        uint16_t profile = *((uint16_t *)data);
+        data += 2;
+        data_len -= 2;
+        uint16_t length = ntohs(*((uint16_t *)data)) * 4;
+        data += 2;
+        data_len -= 2;
+        offset += snprintf(packet_string + offset,
+                           sizeof(packet_string) - offset, "\n   xtn:\t\t%x %s",
+                           profile, octet_string_hex_string(data, length));
+        data += length;
+        data_len -= length;
+    }
+
+    snprintf(packet_string + offset, sizeof(packet_string) - offset,
+             "\n   data:\t%s\n"
+             "} (%zu octets in total)\n",
+             octet_string_hex_string(data, data_len), pkt_octet_len);
+
+    return packet_string;
+}
+
+char *srtp_rtcp_packet_to_string(uint8_t *packet, size_t pkt_octet_len)
+{
+    srtcp_hdr_t *hdr = (srtcp_hdr_t *)packet;
+    size_t octets_in_rtcp_header = 8;
+    uint8_t *data = packet + octets_in_rtcp_header;
+    size_t hex_len = pkt_octet_len - octets_in_rtcp_header;
+
+    /* sanity checking */
+    if ((hdr == NULL) || (pkt_octet_len > MTU)) {
+        return NULL;
+    }
+
+    /* write packet into string */
+    snprintf(packet_string, sizeof(packet_string),
+             "(s)rtcp packet: {\n"
+             "   version:\t%d\n"
+             "   p:\t\t%d\n"
+             "   rc:\t\t%d\n"
+             "   pt:\t\t%x\n"
+             "   len:\t\t%x\n"
+             "   ssrc:\t%x\n"
+             "   data:\t%s\n"
+             "} (%zu octets in total)\n",
+             hdr->version, hdr->p, hdr->rc, hdr->pt, hdr->len, hdr->ssrc,
+             octet_string_hex_string(data, hex_len), pkt_octet_len);
+
+    return packet_string;
+}
+
+/*
+ * mips_estimate() is a simple function to estimate the number of
+ * instructions per second that the host can perform.  note that this
+ * function can be grossly wrong; you may want to have a manual sanity
+ * check of its output!
+ *
+ * the 'ignore' pointer is there to convince the compiler to not just
+ * optimize away the function
+ */
+
+double mips_estimate(size_t num_trials, size_t *ignore)
+{
+    clock_t t;
+    volatile size_t sum;
+
+    sum = 0;
+    t = clock();
+    for (size_t i = 0; i < num_trials; i++) {
+        sum += i;
+    }
+    t = clock() - t;
+    if (t < 1) {
+        t = 1;
+    }
+
+    /*   printf("%d\n", sum); */
+    *ignore = sum;
+
+    return (double)num_trials * CLOCKS_PER_SEC / t;
+}
+
+/*
+ * srtp_validate() verifies the correctness of libsrtp by comparing
+ * some computed packets against some pre-computed reference values.
+ * These packets were made with the default SRTP policy.
+ */
+
+srtp_err_status_t srtp_validate(void)
+{
+    // clang-format off
+    uint8_t srtp_plaintext_ref[28] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab
+    };
+    uint8_t srtp_plaintext[38] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    uint8_t srtp_ciphertext[38] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0x4e, 0x55, 0xdc, 0x4c,
+        0xe7, 0x99, 0x78, 0xd8, 0x8c, 0xa4, 0xd2, 0x15,
+        0x94, 0x9d, 0x24, 0x02, 0xb7, 0x8d, 0x6a, 0xcc,
+        0x99, 0xea, 0x17, 0x9b, 0x8d, 0xbb
+    };
+    uint8_t rtcp_plaintext_ref[24] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+    };
+    uint8_t rtcp_plaintext[38] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    uint8_t srtcp_ciphertext[38] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0x71, 0x28, 0x03, 0x5b, 0xe4, 0x87, 0xb9, 0xbd,
+        0xbe, 0xf8, 0x90, 0x41, 0xf9, 0x77, 0xa5, 0xa8,
+        0x80, 0x00, 0x00, 0x01, 0x99, 0x3e, 0x08, 0xcd,
+        0x54, 0xd6, 0xc1, 0x23, 0x07, 0x98
+    };
+    // clang-format on
+
+    srtp_t srtp_snd, srtp_recv;
+    srtp_err_status_t status;
+    size_t len;
+    srtp_policy_t policy;
+
+    /*
+     * create a session with a single stream using the default srtp
+     * policy and with the SSRC value 0xcafebabe
+     */
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(policy_set_key(policy, test_key));
+
+    status = srtp_create(&srtp_snd, policy);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * protect plaintext, then compare with ciphertext
+     */
+    len = 28;
+    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
+    if (status || (len != 38)) {
+        return srtp_err_status_fail;
+    }
+
+    debug_print(mod_driver, "ciphertext:\n  %s",
+                octet_string_hex_string(srtp_plaintext, len));
+    debug_print(mod_driver, "ciphertext reference:\n  %s",
+                octet_string_hex_string(srtp_ciphertext, len));
+
+    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * protect plaintext rtcp, then compare with srtcp ciphertext
+     */
+    len = 24;
+    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
+    if (status || (len != 38)) {
+        return srtp_err_status_fail;
+    }
+
+    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
+                octet_string_hex_string(rtcp_plaintext, len));
+    debug_print(mod_driver, "srtcp ciphertext reference:\n  %s",
+                octet_string_hex_string(srtcp_ciphertext, len));
+
+    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * create a receiver session context comparable to the one created
+     * above - we need to do this so that the replay checking doesn't
+     * complain
+     */
+    status = srtp_create(&srtp_recv, policy);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * unprotect ciphertext, then compare with plaintext
+     */
+    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
+    if (status || (len != 28)) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * unprotect srtcp ciphertext, then compare with rtcp plaintext
+     */
+    len = 38;
+    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
+    if (status || (len != 24)) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    status = srtp_dealloc(srtp_snd);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_dealloc(srtp_recv);
+    if (status) {
+        return status;
+    }
+
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_validate_mki() verifies the correctness of libsrtp by comparing
+ * some computed packets against some pre-computed reference values.
+ * These packets were made with the default SRTP policy.
+ */
+
+srtp_err_status_t srtp_validate_mki(void)
+{
+    // clang-format off
+    uint8_t srtp_plaintext_ref[28] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab
+    };
+    uint8_t srtp_plaintext[42] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00
+    };
+    uint8_t srtp_ciphertext[42] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0x4e, 0x55, 0xdc, 0x4c,
+        0xe7, 0x99, 0x78, 0xd8, 0x8c, 0xa4, 0xd2, 0x15,
+        0x94, 0x9d, 0x24, 0x02, 0xe1, 0xf9, 0x7a, 0x0d,
+        0xb7, 0x8d, 0x6a, 0xcc, 0x99, 0xea, 0x17, 0x9b,
+        0x8d, 0xbb
+    };
+    uint8_t rtcp_plaintext_ref[24] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+    };
+    uint8_t rtcp_plaintext[42] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00
+    };
+    uint8_t srtcp_ciphertext[42] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0x71, 0x28, 0x03, 0x5b, 0xe4, 0x87, 0xb9, 0xbd,
+        0xbe, 0xf8, 0x90, 0x41, 0xf9, 0x77, 0xa5, 0xa8,
+        0x80, 0x00, 0x00, 0x01, 0xe1, 0xf9, 0x7a, 0x0d,
+        0x99, 0x3e, 0x08, 0xcd, 0x54, 0xd6, 0xc1, 0x23,
+        0x07, 0x98
+    };
+    // clang-format on
+
+    srtp_t srtp_snd, srtp_recv;
+    srtp_err_status_t status;
+    size_t len;
+    srtp_policy_t policy;
+
+    /*
+     * create a session with a single stream using the default srtp
+     * policy and with the SSRC value 0xcafebabe
+     */
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(srtp_policy_use_mki(policy, TEST_MKI_ID_SIZE));
+    CHECK_OK(policy_add_keys(policy, test_keys, 2));
+
+    status = srtp_create(&srtp_snd, policy);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * protect plaintext, then compare with ciphertext
+     */
+    len = 28;
+    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
+    if (status) {
+        return status;
+    }
+
+    debug_print(mod_driver, "ciphertext:\n  %s",
+                octet_string_hex_string(srtp_plaintext, len));
+    debug_print(
+        mod_driver, "ciphertext reference:\n  %s",
+        octet_string_hex_string(srtp_ciphertext, sizeof(srtp_ciphertext)));
+
+    if (len != sizeof(srtp_ciphertext)) {
+        return srtp_err_status_fail;
+    }
+
+    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * protect plaintext rtcp, then compare with srtcp ciphertext
+     */
+    len = 24;
+    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
+    if (status) {
+        return status;
+    }
+
+    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
+                octet_string_hex_string(rtcp_plaintext, len));
+    debug_print(
+        mod_driver, "srtcp ciphertext reference:\n  %s",
+        octet_string_hex_string(srtcp_ciphertext, sizeof(srtcp_ciphertext)));
+
+    if (len != sizeof(srtcp_ciphertext)) {
+        return srtp_err_status_fail;
+    }
+
+    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * create a receiver session context comparable to the one created
+     * above - we need to do this so that the replay checking doesn't
+     * complain
+     */
+    status = srtp_create(&srtp_recv, policy);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * unprotect ciphertext, then compare with plaintext
+     */
+    len = 42;
+    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
+    if (status || (len != 28)) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * unprotect srtcp ciphertext, then compare with rtcp plaintext
+     */
+    len = 42;
+    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
+    if (status || (len != 24)) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    status = srtp_dealloc(srtp_snd);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_dealloc(srtp_recv);
+    if (status) {
+        return status;
+    }
+
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_validate_null_sha1_80() verifies the correctness of libsrtp by comparing
+ * some computed packets against some pre-computed reference values.
+ * These packets were made with a policy that applies null encryption
+ * and HMAC authentication.
+ */
+
+srtp_err_status_t srtp_validate_null_sha1_80(void)
+{
+    // clang-format off
+    uint8_t srtp_plaintext_ref[28] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab
+    };
+    uint8_t srtp_plaintext[38] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    uint8_t srtp_ciphertext[38] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xa1, 0x36, 0x27,
+        0x0b, 0x67, 0x91, 0x34, 0xce, 0x9b
+    };
+    uint8_t rtcp_plaintext_ref[24] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+    };
+    uint8_t rtcp_plaintext[38] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    uint8_t srtcp_ciphertext[38] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0x00, 0x00, 0x00, 0x01, 0xfe, 0x88, 0xc7, 0xfd,
+        0xfd, 0x37, 0xeb, 0xce, 0x61, 0x5d,
+    };
+    // clang-format on
+
+    srtp_t srtp_snd, srtp_recv;
+    srtp_err_status_t status;
+    size_t len;
+    srtp_policy_t policy;
+
+    /*
+     * create a session with a single stream using the null cipher
+     * and sha1_80 policy and with the SSRC value 0xcafebabe
+     */
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_null_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(policy_set_key(policy, test_key));
+
+    status = srtp_create(&srtp_snd, policy);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * protect plaintext, then compare with ciphertext
+     */
+    len = 28;
+    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
+    if (status || (len != 38)) {
+        return srtp_err_status_fail;
+    }
+
+    debug_print(mod_driver, "ciphertext:\n  %s",
+                octet_string_hex_string(srtp_plaintext, len));
+    debug_print(mod_driver, "ciphertext reference:\n  %s",
+                octet_string_hex_string(srtp_ciphertext, len));
+
+    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * protect plaintext rtcp, then compare with srtcp ciphertext
+     */
+    len = 24;
+    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
+    if (status || (len != 38)) {
+        return srtp_err_status_fail;
+    }
+
+    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
+                octet_string_hex_string(rtcp_plaintext, len));
+    debug_print(mod_driver, "srtcp ciphertext reference:\n  %s",
+                octet_string_hex_string(srtcp_ciphertext, len));
+
+    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * create a receiver session context comparable to the one created
+     * above - we need to do this so that the replay checking doesn't
+     * complain
+     */
+    status = srtp_create(&srtp_recv, policy);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * unprotect ciphertext, then compare with plaintext
+     */
+    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
+    if (status || (len != 28)) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * unprotect srtcp ciphertext, then compare with rtcp plaintext
+     */
+    len = 38;
+    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
+    if (status || (len != 24)) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    status = srtp_dealloc(srtp_snd);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_dealloc(srtp_recv);
+    if (status) {
+        return status;
+    }
+
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_validate_null_null() verifies the correctness of libsrtp by comparing
+ * some computed packets against some pre-computed reference values.
+ * These packets were made with a policy that applies null encryption
+ * and null authentication.
+ */
+
+srtp_err_status_t srtp_validate_null_null(void)
+{
+    // clang-format off
+    uint8_t srtp_plaintext_ref[28] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab
+    };
+    uint8_t srtp_plaintext[28] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab,
+    };
+    uint8_t srtp_ciphertext[28] = {
+        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab,
+    };
+    uint8_t rtcp_plaintext_ref[24] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+    };
+    uint8_t rtcp_plaintext[28] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0x00, 0x00, 0x00, 0x00,
+    };
+    uint8_t srtcp_ciphertext[28] = {
+        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+        0x00, 0x00, 0x00, 0x01,
+    };
+    // clang-format on
+
+    srtp_t srtp_snd, srtp_recv;
+    srtp_err_status_t status;
+    size_t len;
+    srtp_policy_t policy;
+
+    /*
+     * create a session with a single stream using the null cipher
+     * and null hmac policy and with the SSRC value 0xcafebabe
+     */
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_null_null));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+
+    CHECK_OK(srtp_policy_validate(policy));
+
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+
+    /*
+     * protect plaintext, then compare with ciphertext
+     */
+    len = 28;
+    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
+    if (!status && (len != 28)) {
+        status = srtp_err_status_fail;
+    }
+    if (status) {
+        return status;
+    }
+
+    debug_print(mod_driver, "ciphertext:\n  %s",
+                octet_string_hex_string(srtp_plaintext, len));
+    debug_print(mod_driver, "ciphertext reference:\n  %s",
+                octet_string_hex_string(srtp_ciphertext, len));
+
+    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * protect plaintext rtcp, then compare with srtcp ciphertext
+     */
+    len = 24;
+    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
+    if (!status && (len != 28)) {
+        status = srtp_err_status_fail;
+    }
+    if (status) {
+        return status;
+    }
+
+    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
+                octet_string_hex_string(rtcp_plaintext, len));
+    debug_print(mod_driver, "srtcp ciphertext reference:\n  %s",
+                octet_string_hex_string(srtcp_ciphertext, len));
+
+    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * create a receiver session context comparable to the one created
+     * above - we need to do this so that the replay checking doesn't
+     * complain
+     */
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    /*
+     * unprotect ciphertext, then compare with plaintext
+     */
+    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
+    if (!status && (len != 28)) {
+        status = srtp_err_status_fail;
+    }
+    if (status) {
+        return status;
+    }
+
+    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    /*
+     * unprotect srtcp ciphertext, then compare with rtcp plaintext
+     */
+    len = 28;
+    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
+    if (!status && (len != 24)) {
+        status = srtp_err_status_fail;
+    }
+
+    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
+        return srtp_err_status_fail;
+    }
+
+    status = srtp_dealloc(srtp_snd);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_dealloc(srtp_recv);
+    if (status) {
+        return status;
+    }
+
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_validate_cryptex() verifies the correctness of libsrtp by comparing
+ * some computed packets against some pre-computed reference values.
+ * These packets were made with the default SRTP policy.
+ */
+srtp_err_status_t srtp_validate_cryptex(void)
+{
+    // clang-format off
+    /* Plaintext packet with 1-byte header extension */
+    const char *srtp_1bytehdrext_ref =
+        "900f1235"
+        "decafbad"
+        "cafebabe"
+        "bede0001"
+        "51000200"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+
+    /* AES-CTR/HMAC-SHA1 Ciphertext packet with 1-byte header extension */
+    const char *srtp_1bytehdrext_cryptex =
+        "900f1235"
+        "decafbad"
+        "cafebabe"
+        "c0de0001"
+        "eb923652"
+        "51c3e036"
+        "f8de27e9"
+        "c27ee3e0"
+        "b4651d9f"
+        "bc4218a7"
+        "0244522f"
+        "34a5";
+
+    /* Plaintext packet with 2-byte header extension */
+    const char *srtp_2bytehdrext_ref =
+        "900f1236"
+        "decafbad"
+        "cafebabe"
+        "10000001"
+        "05020002"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+
+    /* AES-CTR/HMAC-SHA1 Ciphertext packet with 2-byte header extension */
+    const char *srtp_2bytehdrext_cryptex =
+        "900f1236"
+        "decafbad"
+        "cafebabe"
+        "c2de0001"
+        "4ed9cc4e"
+        "6a712b30"
+        "96c5ca77"
+        "339d4204"
+        "ce0d7739"
+        "6cab6958"
+        "5fbce381"
+        "94a5";
+
+    /* Plaintext packet with 1-byte header extension and CSRC fields. */
+    const char *srtp_1bytehdrext_cc_ref =
+        "920f1238"
+        "decafbad"
+        "cafebabe"
+        "0001e240"
+        "0000b26e"
+        "bede0001"
+        "51000200"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+
+    const char *srtp_1bytehdrext_cc_cryptex =
+        "920f1238"
+        "decafbad"
+        "cafebabe"
+        "8bb6e12b"
+        "5cff16dd"
+        "c0de0001"
+        "92838c8c"
+        "09e58393"
+        "e1de3a9a"
+        "74734d67"
+        "45671338"
+        "c3acf11d"
+        "a2df8423"
+        "bee0";
+
+    /* Plaintext packet with 2-byte header extension and CSRC fields. */
+    const char *srtp_2bytehdrext_cc_ref =
+        "920f1239"
+        "decafbad"
+        "cafebabe"
+        "0001e240"
+        "0000b26e"
+        "10000001"
+        "05020002"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+
+    const char *srtp_2bytehdrext_cc_cryptex =
+        "920f1239"
+        "decafbad"
+        "cafebabe"
+        "f70e513e"
+        "b90b9b25"
+        "c2de0001"
+        "bbed4848"
+        "faa64466"
+        "5f3d7f34"
+        "125914e9"
+        "f4d0ae92"
+        "3c6f479b"
+        "95a0f7b5"
+        "3133";
+
+    /* Plaintext packet with empty 1-byte header extension and CSRC fields. */
+    const char *srtp_1byte_empty_hdrext_cc_ref =
+        "920f123a"
+        "decafbad"
+        "cafebabe"
+        "0001e240"
+        "0000b26e"
+        "bede0000"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+
+    const char *srtp_1byte_empty_hdrext_cc_cryptex =
+        "920f123a"
+        "decafbad"
+        "cafebabe"
+        "7130b6ab"
+        "fe2ab0e3"
+        "c0de0000"
+        "e3d9f64b"
+        "25c9e74c"
+        "b4cf8e43"
+        "fb92e378"
+        "1c2c0cea"
+        "b6b3a499"
+        "a14c";
+
+    /* Plaintext packet with empty 2-byte header extension and CSRC fields. */
+    const char *srtp_2byte_empty_hdrext_cc_ref =
+        "920f123b"
+        "decafbad"
+        "cafebabe"
+        "0001e240"
+        "0000b26e"
+        "10000000"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+
+    const char *srtp_2byte_empty_hdrext_cc_cryptex =
+        "920f123b"
+        "decafbad"
+        "cafebabe"
+        "cbf24c12"
+        "4330e1c8"
+        "c2de0000"
+        "599dd45b"
+        "c9d687b6"
+        "03e8b59d"
+        "771fd38e"
+        "88b170e0"
+        "cd31e125"
+        "eabe";
+
+    // clang-format on
+
+    const struct test_vectors_t vectors[6] = {
+        { "Plaintext packet with 1-byte header extension", srtp_1bytehdrext_ref,
+          srtp_1bytehdrext_cryptex },
+        { "Plaintext packet with 2-byte header extension", srtp_2bytehdrext_ref,
+          srtp_2bytehdrext_cryptex },
+        { "Plaintext packet with 1-byte header extension and CSRC fields",
+          srtp_1bytehdrext_cc_ref, srtp_1bytehdrext_cc_cryptex },
+        { "Plaintext packet with 2-byte header extension and CSRC fields",
+          srtp_2bytehdrext_cc_ref, srtp_2bytehdrext_cc_cryptex },
+        { "Plaintext packet with empty 1-byte header extension and CSRC fields",
+          srtp_1byte_empty_hdrext_cc_ref, srtp_1byte_empty_hdrext_cc_cryptex },
+        { "Plaintext packet with empty 2-byte header extension and CSRC fields",
+          srtp_2byte_empty_hdrext_cc_ref, srtp_2byte_empty_hdrext_cc_cryptex },
+    };
+    const size_t num_vectors = sizeof(vectors) / sizeof(vectors[0]);
+
+    srtp_t srtp_snd, srtp_recv;
+    size_t len, ref_len, enc_len;
+    srtp_policy_t policy;
+
+    /*
+     * create a session with a single stream using the default srtp
+     * policy and with the SSRC value 0xcafebabe
+     */
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+
+    for (size_t i = 0; i < num_vectors; ++i) {
+        uint8_t packet[1400];
+        uint8_t reference[1400];
+        uint8_t ciphertext[1400];
+
+        /* Initialize reference test vectors */
+        ref_len = hex_string_to_octet_string(reference, vectors[i].plaintext,
+                                             sizeof(reference)) /
+                  2;
+        enc_len = hex_string_to_octet_string(ciphertext, vectors[i].ciphertext,
+                                             sizeof(ciphertext)) /
+                  2;
+
+        /* Initialize test packet */
+        len = ref_len;
+        memcpy(packet, reference, len);
+        printf("%s\n", vectors[i].name);
+        /*
+         * protect plaintext, then compare with ciphertext
+         */
+        debug_print(mod_driver, "test vector: %s\n", vectors[i].name);
+
+        CHECK_OK(srtp_create(&srtp_snd, policy));
+
+        CHECK_OK(call_srtp_protect(srtp_snd, packet, &len, 0));
+        CHECK(len == enc_len);
+
+        debug_print(mod_driver, "ciphertext:\n  %s",
+                    octet_string_hex_string(packet, len));
+        debug_print(mod_driver, "ciphertext reference:\n  %s",
+                    octet_string_hex_string(ciphertext, len));
+
+        CHECK_BUFFER_EQUAL(packet, ciphertext, len);
+
+        CHECK_OK(srtp_dealloc(srtp_snd));
+
+        CHECK_OK(srtp_create(&srtp_recv, policy));
+
+        /*
+         * unprotect ciphertext, then compare with plaintext
+         */
+        CHECK_OK(call_srtp_unprotect(srtp_recv, packet, &len));
+        CHECK(len == ref_len);
+
+        CHECK_BUFFER_EQUAL(packet, reference, len);
+
+        CHECK_OK(srtp_dealloc(srtp_recv));
+    }
+
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_cryptex_csrc_but_no_extension_header(void)
+{
+    // clang-format off
+    /* Plaintext packet with no header extension but CSRC fields. */
+    const char *srtp_cc_ref =
+        "820f1238"
+        "decafbad"
+        "cafebabe"
+        "0001e240"
+        "0000b26e"
+        "abababab"
+        "abababab"
+        "abababab"
+        "abababab";
+    // clang-format on
+
+    /*
+     * create a session with a single stream using the default srtp
+     * policy and with the SSRC value 0xcafebabe
+     */
+    srtp_policy_t policy;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+
+    srtp_t srtp_snd;
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+
+    srtp_policy_destroy(policy);
+
+    uint8_t packet[1400];
+    size_t packet_len =
+        hex_string_to_octet_string(packet, srtp_cc_ref, sizeof(packet)) / 2;
+
+    CHECK_RETURN(call_srtp_protect(srtp_snd, packet, &packet_len, 0),
+                 srtp_err_status_cryptex_err);
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_cryptex_disable(void)
+{
+    const uint32_t test_ssrc = 0xcafebabe;
+    srtp_policy_t policy;
+    srtp_t srtp_snd, srtp_recv;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, test_ssrc }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    size_t packet_len;
+    uint8_t *packet = create_rtp_test_packet(100, test_ssrc, 1, 1000, true,
+                                             &packet_len, NULL);
+
+    uint8_t clear_text[1400];
+    memcpy(clear_text, packet, packet_len);
+    size_t clear_text_len = packet_len;
+
+    CHECK_OK(call_srtp_protect(srtp_snd, packet, &packet_len, 0));
+    CHECK(packet_len > clear_text_len);
+    CHECK(memcmp(packet, clear_text, clear_text_len) != 0);
+
+    // clear text uses original one byte header extension profile
+    CHECK(get_xtn_profile(clear_text) == 0xbede);
+    // packet uses cryptex one byte header extension profile
+    CHECK(get_xtn_profile(packet) == 0xc0de);
+
+    CHECK_OK(call_srtp_unprotect(srtp_recv, packet, &packet_len));
+    CHECK(packet_len == clear_text_len);
+    CHECK_BUFFER_EQUAL(packet, clear_text, clear_text_len);
+
+    // update squence number for next packet
+    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
+    hdr->seq = htons(ntohs(hdr->seq) + 1);
+    memcpy(clear_text, packet, packet_len);
+
+    // disable cryptex at sender only
+    CHECK_OK(srtp_policy_set_cryptex(policy, false));
+    CHECK_OK(srtp_update(srtp_snd, policy));
+
+    CHECK_OK(call_srtp_protect(srtp_snd, packet, &packet_len, 0));
+    CHECK(packet_len > clear_text_len);
+    CHECK(memcmp(packet, clear_text, clear_text_len) != 0);
+
+    // both use original one byte header extension profile as cryptex is
+    // disabled
+    CHECK(get_xtn_profile(clear_text) == 0xbede);
+    CHECK(get_xtn_profile(packet) == 0xbede);
+
+    // unprotect should work as cryptex is detected dynamically
+    CHECK_OK(call_srtp_unprotect(srtp_recv, packet, &packet_len));
+    CHECK(packet_len == clear_text_len);
+    CHECK_BUFFER_EQUAL(packet, clear_text, clear_text_len);
+
+    free(packet);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_test_cryptex_io_profile(srtp_profile_t profile)
+{
+    const uint32_t test_ssrc = 0xcafebabe;
+    srtp_policy_t policy;
+    srtp_t srtp_snd, srtp_recv;
+    uint8_t srtp_packet[1400];
+    uint8_t rtp_packet[1400];
+    size_t srtp_len = sizeof(srtp_packet);
+    size_t rtp_len = sizeof(rtp_packet);
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, test_ssrc }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    size_t packet_len;
+    uint8_t *packet = create_rtp_test_packet(100, test_ssrc, 1, 1000, true,
+                                             &packet_len, NULL);
+
+    CHECK_OK(srtp_protect(srtp_snd, packet, packet_len, srtp_packet,
+                          &srtp_len, 0));
+    CHECK(get_xtn_profile(srtp_packet) == 0xc0de);
+
+    /* the output buffer does not start out with a copy of the header */
+    memset(rtp_packet, 0, sizeof(rtp_packet));
+    CHECK_OK(
+        srtp_unprotect(srtp_recv, srtp_packet, srtp_len, rtp_packet, &rtp_len));
+    CHECK(rtp_len == packet_len);
+    CHECK_BUFFER_EQUAL(rtp_packet, packet, packet_len);
+
+    free(packet);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_cryptex_not_in_place_io() checks that a cryptex packet can be
+ * unprotected into a buffer that does not hold a copy of it
+ */
+srtp_err_status_t srtp_test_cryptex_not_in_place_io(void)
+{
+    CHECK_OK(srtp_test_cryptex_io_profile(srtp_profile_aes128_cm_sha1_80));
+#ifdef GCM
+    CHECK_OK(srtp_test_cryptex_io_profile(srtp_profile_aead_aes_128_gcm));
+#endif
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_missing_session_keys(void)
+{
+    // Not sure if this test is valid as this is not a state that should be
+    // possible to reach with the public API.
+
+    srtp_t srtp_receiver;
+    srtp_policy_t policy;
+    srtp_stream_ctx_t *stream;
+    srtp_session_keys_t *session_keys;
+    size_t num_master_keys;
+    uint8_t *packet;
+    size_t packet_len;
+    size_t buffer_len;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(policy_set_key(policy, test_key));
+
+    CHECK_OK(srtp_create(&srtp_receiver, policy));
+    CHECK(srtp_receiver->stream_template != NULL);
+
+    stream = srtp_receiver->stream_template;
+    session_keys = stream->session_keys;
+    num_master_keys = stream->num_master_keys;
+    stream->session_keys = NULL;
+    stream->num_master_keys = 0;
+
+    packet = create_rtp_test_packet(0, 0xcafebabe, 1, 1, false, &packet_len,
+                                    &buffer_len);
+    packet_len = buffer_len;
+    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, packet, sizeof(srtp_hdr_t),
+                                      &packet_len),
+                 srtp_err_status_no_ctx);
+
+    stream->session_keys = session_keys;
+    stream->num_master_keys = num_master_keys;
+
+    free(packet);
+    CHECK_OK(srtp_dealloc(srtp_receiver));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_protect_batch() checks that the batch functions produce the
+ * same packets as the single packet functions, across runs of different
+ * SSRCs, and that a failing packet does not affect the rest of the batch.
+ */
+#define BATCH_TEST_NUM_PKTS 8
+
+srtp_err_status_t srtp_test_protect_batch(void)
+{
+    const uint32_t ssrcs[BATCH_TEST_NUM_PKTS] = {
+        0xcafebabe, 0xcafebabe, 0xcafebabe, 0xdecafbad,
+        0xdecafbad, 0xcafebabe, 0xfeedface, 0xfeedface,
+    };
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    uint8_t *ref[BATCH_TEST_NUM_PKTS];
+    uint8_t *pkt[BATCH_TEST_NUM_PKTS];
+    size_t ref_len[BATCH_TEST_NUM_PKTS];
+    size_t rtp_len[BATCH_TEST_NUM_PKTS];
+    srtp_packet_desc_t desc[BATCH_TEST_NUM_PKTS];
+    size_t buffer_len;
+    const size_t hdr_len = 12;
+    const size_t bad_pkt = 3;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_create(&srtp_ref, policy));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        ref[i] = create_rtp_test_packet(64 + i, ssrcs[i], (uint16_t)i, 0,
+                                        false, &ref_len[i], &buffer_len);
+        pkt[i] = create_rtp_test_packet(64 + i, ssrcs[i], (uint16_t)i, 0,
+                                        false, &rtp_len[i], &buffer_len);
+        CHECK_OK(srtp_protect(srtp_ref, ref[i], ref_len[i], ref[i],
+                              &buffer_len, 0));
+        ref_len[i] = buffer_len;
+
+        desc[i].in = pkt[i];
+        desc[i].in_len = rtp_len[i];
+        desc[i].out = pkt[i];
+        desc[i].out_len = rtp_len[i] + SRTP_MAX_TRAILER_LEN;
+        desc[i].mki_index = 0;
+        desc[i].status = srtp_err_status_fail;
     }
-    if (test_policy->keys) {
-        if (enable_mki) {
-            CHECK_OK(policy_add_keys(*policy, test_policy->keys,
-                                     test_policy->num_master_keys));
-        } else if (test_policy->num_master_keys > 0 && test_policy->keys[0]) {
-            CHECK_OK(policy_set_key(*policy, test_policy->keys[0]->key));
+
+    CHECK_OK(srtp_protect_batch(srtp_snd, desc, BATCH_TEST_NUM_PKTS));
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == ref_len[i]);
+        CHECK_BUFFER_EQUAL(pkt[i], ref[i], ref_len[i]);
+    }
+
+    /* corrupt the payload of one packet */
+    pkt[bad_pkt][hdr_len] ^= 0xff;
+
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        desc[i].in_len = desc[i].out_len;
+        desc[i].status = srtp_err_status_fail;
+    }
+
+    CHECK_RETURN(srtp_unprotect_batch(srtp_recv, desc, BATCH_TEST_NUM_PKTS),
+                 srtp_err_status_auth_fail);
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        if (i == bad_pkt) {
+            CHECK_RETURN(desc[i].status, srtp_err_status_auth_fail);
+            continue;
         }
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == rtp_len[i]);
+        CHECK(pkt[i][hdr_len] == 0xab);
+    }
+
+    /* the bad packet did not update the replay database */
+    CHECK_OK(srtp_unprotect(srtp_recv, ref[bad_pkt], ref_len[bad_pkt],
+                            ref[bad_pkt], &ref_len[bad_pkt]));
+
+    CHECK_RETURN(srtp_protect_batch(NULL, desc, BATCH_TEST_NUM_PKTS),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_protect_batch(srtp_snd, NULL, 0));
+
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        free(ref[i]);
+        free(pkt[i]);
     }
 
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
     return srtp_err_status_ok;
 }
 
 /*
- * create_rtp_test_packet returns a pointer to a (malloced) example
- * RTP packet whose data field has the length given by payload_len.
- * There is room at the end of the packet for the max SRTP trailer.
- * The space for the trailer space and the following four bytes
- * are filled with overrun marker to enable testing for overwrites.
- *
- * The size of the packet is returned rtp_len, the complete size of
- * the buffer is returned in buffer_len.
- *
- * note that the location of the test packet must be
- * deallocated with the free() call once it is no longer needed.
+ * srtp_test_batch_tags() checks the batch functions on more packets of
+ * known streams than they compute the tags of at once, with a packet
+ * whose tag is wrong and one that replays the packet in front of it
+ * within the same set
  */
-uint8_t *create_rtp_test_packet(size_t payload_len,
-                                uint32_t ssrc,
-                                uint16_t seq,
-                                uint32_t ts,
-                                bool add_hdr_xtn,
-                                size_t *rtp_len,
-                                size_t *buffer_len)
+#define BATCH_TAGS_NUM_PKTS 40
+
+srtp_err_status_t srtp_test_batch_tags(void)
 {
-    uint8_t *buffer;
-    srtp_hdr_t *hdr;
-    size_t bytes_in_hdr = 12;
-    size_t len = 0;
+    const uint32_t ssrc = 0xcafebabe;
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    uint8_t *ref[BATCH_TAGS_NUM_PKTS];
+    uint8_t *pkt[BATCH_TAGS_NUM_PKTS];
+    size_t ref_len[BATCH_TAGS_NUM_PKTS];
+    size_t rtp_len[BATCH_TAGS_NUM_PKTS];
+    srtp_packet_desc_t desc[BATCH_TAGS_NUM_PKTS];
+    uint8_t *replay;
+    size_t buffer_len;
+    const size_t hdr_len = 12;
+    const size_t bad_pkt = 5;
+    const size_t replay_pkt = 20;
 
-    *rtp_len = payload_len + bytes_in_hdr;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_create(&srtp_ref, policy));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    if (add_hdr_xtn) {
-        *rtp_len += sizeof(rtp_test_packet_extension_header);
+    /* the lengths take the messages across the SHA-1 block boundaries */
+    for (size_t i = 0; i < BATCH_TAGS_NUM_PKTS; i++) {
+        ref[i] = create_rtp_test_packet(20 + 7 * i, ssrc, (uint16_t)(1000 + i),
+                                        0, false, &ref_len[i], &buffer_len);
+        pkt[i] = create_rtp_test_packet(20 + 7 * i, ssrc, (uint16_t)(1000 + i),
+                                        0, false, &rtp_len[i], &buffer_len);
+        CHECK_OK(srtp_protect(srtp_ref, ref[i], ref_len[i], ref[i],
+                              &buffer_len, 0));
+        ref_len[i] = buffer_len;
+
+        desc[i].in = pkt[i];
+        desc[i].in_len = rtp_len[i];
+        desc[i].out = pkt[i];
+        desc[i].out_len = rtp_len[i] + SRTP_MAX_TRAILER_LEN;
+        desc[i].mki_index = 0;
+        desc[i].status = srtp_err_status_fail;
+    }
+
+    CHECK_OK(srtp_protect_batch(srtp_snd, desc, BATCH_TAGS_NUM_PKTS));
+    for (size_t i = 0; i < BATCH_TAGS_NUM_PKTS; i++) {
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == ref_len[i]);
+        CHECK_BUFFER_EQUAL(pkt[i], ref[i], ref_len[i]);
+    }
+
+    /* break the tag of one packet, replace another by its predecessor */
+    pkt[bad_pkt][ref_len[bad_pkt] - 1] ^= 0x01;
+    replay = malloc(ref_len[replay_pkt - 1]);
+    CHECK(replay != NULL);
+    memcpy(replay, ref[replay_pkt - 1], ref_len[replay_pkt - 1]);
+
+    for (size_t i = 0; i < BATCH_TAGS_NUM_PKTS; i++) {
+        desc[i].in_len = desc[i].out_len;
+        desc[i].status = srtp_err_status_fail;
+    }
+    desc[replay_pkt].in = replay;
+    desc[replay_pkt].in_len = ref_len[replay_pkt - 1];
+    desc[replay_pkt].out = replay;
+    desc[replay_pkt].out_len = ref_len[replay_pkt - 1];
+
+    CHECK_RETURN(srtp_unprotect_batch(srtp_recv, desc, BATCH_TAGS_NUM_PKTS),
+                 srtp_err_status_auth_fail);
+    for (size_t i = 0; i < BATCH_TAGS_NUM_PKTS; i++) {
+        if (i == bad_pkt) {
+            CHECK_RETURN(desc[i].status, srtp_err_status_auth_fail);
+            continue;
+        }
+        if (i == replay_pkt) {
+            CHECK_RETURN(desc[i].status, srtp_err_status_replay_fail);
+            continue;
+        }
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == rtp_len[i]);
+        CHECK(pkt[i][hdr_len] == 0xab);
+        CHECK(pkt[i][rtp_len[i] - 1] == 0xab);
     }
 
-    // allocate enough for max trailer and 4 byte overrun detection
-    len = *rtp_len + SRTP_MAX_TRAILER_LEN + 4;
+    free(replay);
+    for (size_t i = 0; i < BATCH_TAGS_NUM_PKTS; i++) {
+        free(ref[i]);
+        free(pkt[i]);
+    }
 
-    buffer = (uint8_t *)malloc(len);
-    if (!buffer) {
-        printf("rtp test packet allocation failed\n");
-        exit(1);
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_batch_keystream() checks the batch functions on short packets
+ * of streams with different keys, interleaved so that a set has the
+ * keystream of all of them computed together, with a packet longer than
+ * the keystream a set computes, one whose payload was changed and a
+ * forged copy of it
+ */
+#define BATCH_KEYSTREAM_NUM_STREAMS 5
+#define BATCH_KEYSTREAM_NUM_PKTS 40
+
+srtp_err_status_t srtp_test_batch_keystream(void)
+{
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    uint8_t key[46];
+    uint8_t *ref[BATCH_KEYSTREAM_NUM_PKTS];
+    uint8_t *pkt[BATCH_KEYSTREAM_NUM_PKTS];
+    size_t ref_len[BATCH_KEYSTREAM_NUM_PKTS];
+    size_t rtp_len[BATCH_KEYSTREAM_NUM_PKTS];
+    size_t payload_len[BATCH_KEYSTREAM_NUM_PKTS];
+    srtp_packet_desc_t desc[BATCH_KEYSTREAM_NUM_PKTS];
+    uint8_t *copy[3];
+    size_t buffer_len;
+    const size_t long_pkt = 9;
+    const size_t bad_pkt = 22;
+
+    CHECK_OK(srtp_create(&srtp_ref, NULL));
+    CHECK_OK(srtp_create(&srtp_snd, NULL));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    memcpy(key, test_key, sizeof(key));
+    for (uint32_t j = 0; j < BATCH_KEYSTREAM_NUM_STREAMS; j++) {
+        key[0] = (uint8_t)j;
+        CHECK_OK(srtp_policy_set_ssrc(
+            policy, (srtp_ssrc_t){ ssrc_specific, 0xcafe0000 + j }));
+        CHECK_OK(policy_set_key(policy, key));
+        CHECK_OK(srtp_stream_add(srtp_ref, policy));
+        CHECK_OK(srtp_stream_add(srtp_snd, policy));
+        CHECK_OK(srtp_stream_add(srtp_recv, policy));
+    }
+
+    /* every other packet has a header extension to skip */
+    for (size_t i = 0; i < BATCH_KEYSTREAM_NUM_PKTS; i++) {
+        uint32_t ssrc = 0xcafe0000 + (uint32_t)i % BATCH_KEYSTREAM_NUM_STREAMS;
+        bool xtn = i % 2 == 1;
+
+        payload_len[i] = i == long_pkt ? 5000 : 100 + 13 * (i % 7);
+        ref[i] = create_rtp_test_packet(payload_len[i], ssrc, (uint16_t)(7 + i),
+                                        0, xtn, &ref_len[i], &buffer_len);
+        pkt[i] = create_rtp_test_packet(payload_len[i], ssrc, (uint16_t)(7 + i),
+                                        0, xtn, &rtp_len[i], &buffer_len);
+        CHECK_OK(srtp_protect(srtp_ref, ref[i], ref_len[i], ref[i],
+                              &buffer_len, 0));
+        ref_len[i] = buffer_len;
+
+        desc[i].in = pkt[i];
+        desc[i].in_len = rtp_len[i];
+        desc[i].out = pkt[i];
+        desc[i].out_len = rtp_len[i] + SRTP_MAX_TRAILER_LEN;
+        desc[i].mki_index = 0;
+        desc[i].status = srtp_err_status_fail;
+    }
+
+    CHECK_OK(srtp_protect_batch(srtp_snd, desc, BATCH_KEYSTREAM_NUM_PKTS));
+    for (size_t i = 0; i < BATCH_KEYSTREAM_NUM_PKTS; i++) {
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == ref_len[i]);
+        CHECK_BUFFER_EQUAL(pkt[i], ref[i], ref_len[i]);
+    }
+
+    /* a changed payload fails to authenticate and is left alone */
+    pkt[bad_pkt][rtp_len[bad_pkt] - 1] ^= 0x01;
+
+    for (size_t i = 0; i < BATCH_KEYSTREAM_NUM_PKTS; i++) {
+        desc[i].in_len = desc[i].out_len;
+        desc[i].status = srtp_err_status_fail;
     }
 
-    overrun_check_prepare(buffer, 0, len);
+    CHECK_RETURN(
+        srtp_unprotect_batch(srtp_recv, desc, BATCH_KEYSTREAM_NUM_PKTS),
+        srtp_err_status_auth_fail);
+    for (size_t i = 0; i < BATCH_KEYSTREAM_NUM_PKTS; i++) {
+        if (i == bad_pkt) {
+            CHECK_RETURN(desc[i].status, srtp_err_status_auth_fail);
+            continue;
+        }
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == rtp_len[i]);
+        for (size_t k = rtp_len[i] - payload_len[i]; k < rtp_len[i]; k++) {
+            CHECK(pkt[i][k] == 0xab);
+        }
+    }
 
-    hdr = (srtp_hdr_t *)buffer;
-    hdr->version = 2;
-    hdr->p = 0;
-    hdr->x = add_hdr_xtn ? 1 : 0;
-    hdr->cc = 0;
-    hdr->m = 0;
-    hdr->pt = 0xf;
-    hdr->seq = htons(seq);
-    hdr->ts = htonl(ts);
-    hdr->ssrc = htonl(ssrc);
-    buffer += bytes_in_hdr;
+    /*
+     * a forged packet in front of the genuine one with the same index does
+     * not keep it out, a copy after it is a replay
+     */
+    for (size_t i = 0; i < 3; i++) {
+        copy[i] = malloc(ref_len[bad_pkt]);
+        CHECK(copy[i] != NULL);
+        memcpy(copy[i], ref[bad_pkt], ref_len[bad_pkt]);
+        desc[i].in = copy[i];
+        desc[i].in_len = ref_len[bad_pkt];
+        desc[i].out = copy[i];
+        desc[i].out_len = ref_len[bad_pkt];
+        desc[i].status = srtp_err_status_fail;
+    }
+    copy[0][ref_len[bad_pkt] - 1] ^= 0x01;
 
-    if (add_hdr_xtn) {
-        memcpy(buffer, rtp_test_packet_extension_header,
-               sizeof(rtp_test_packet_extension_header));
-        buffer += sizeof(rtp_test_packet_extension_header);
+    CHECK_RETURN(srtp_unprotect_batch(srtp_recv, desc, 3),
+                 srtp_err_status_auth_fail);
+    CHECK_RETURN(desc[0].status, srtp_err_status_auth_fail);
+    CHECK_OK(desc[1].status);
+    CHECK(desc[1].out_len == rtp_len[bad_pkt]);
+    CHECK(copy[1][rtp_len[bad_pkt] - 1] == 0xab);
+    CHECK_RETURN(desc[2].status, srtp_err_status_replay_fail);
+
+    for (size_t i = 0; i < 3; i++) {
+        free(copy[i]);
     }
 
-    /* set RTP data to 0xab */
-    memset(buffer, 0xab, payload_len);
-    buffer += payload_len;
+    for (size_t i = 0; i < BATCH_KEYSTREAM_NUM_PKTS; i++) {
+        free(ref[i]);
+        free(pkt[i]);
+    }
 
-    if (buffer_len) {
-        *buffer_len = len;
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_protect_strided() checks that packets protected in a strided
+ * buffer, more of them than srtp_protect_strided() batches at a time,
+ * match packets protected one by one, and that a packet longer than the
+ * stride or with no room for its trailer fails alone
+ */
+#define STRIDED_TEST_NUM_PKTS 70
+#define STRIDED_TEST_STRIDE 1200
+
+srtp_err_status_t srtp_test_protect_strided(void)
+{
+    srtp_t srtp_ref, srtp_snd;
+    srtp_policy_t policy;
+    uint8_t *buf;
+    uint8_t *ref[STRIDED_TEST_NUM_PKTS];
+    size_t ref_len[STRIDED_TEST_NUM_PKTS];
+    size_t lens[STRIDED_TEST_NUM_PKTS];
+    size_t buffer_len;
+    const size_t long_pkt = 17;
+    const size_t full_pkt = 66;
+    const uint32_t ssrc = 0xcafebabe;
+
+    CHECK_OK(srtp_create(&srtp_ref, NULL));
+    CHECK_OK(srtp_create(&srtp_snd, NULL));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_stream_add(srtp_ref, policy));
+    CHECK_OK(srtp_stream_add(srtp_snd, policy));
+
+    buf = malloc(STRIDED_TEST_NUM_PKTS * STRIDED_TEST_STRIDE);
+    CHECK(buf != NULL);
+    memset(buf, 0, STRIDED_TEST_NUM_PKTS * STRIDED_TEST_STRIDE);
+
+    for (size_t i = 0; i < STRIDED_TEST_NUM_PKTS; i++) {
+        size_t payload_len = 1000 + 7 * (i % 20);
+        uint8_t *pkt;
+
+        if (i == full_pkt) {
+            payload_len = STRIDED_TEST_STRIDE - 12;
+        }
+        ref[i] = create_rtp_test_packet(payload_len, ssrc, (uint16_t)(3 + i),
+                                        0, false, &ref_len[i], &buffer_len);
+        pkt = create_rtp_test_packet(payload_len, ssrc, (uint16_t)(3 + i), 0,
+                                     false, &lens[i], &buffer_len);
+        CHECK(lens[i] <= STRIDED_TEST_STRIDE);
+        memcpy(buf + i * STRIDED_TEST_STRIDE, pkt, lens[i]);
+        free(pkt);
+
+        if (i == long_pkt) {
+            lens[i] = STRIDED_TEST_STRIDE + 1;
+        } else if (i != full_pkt) {
+            CHECK_OK(srtp_protect(srtp_ref, ref[i], ref_len[i], ref[i],
+                                  &buffer_len, 0));
+            ref_len[i] = buffer_len;
+        }
+    }
+    CHECK(lens[full_pkt] == STRIDED_TEST_STRIDE);
+
+    CHECK_RETURN(srtp_protect_strided(srtp_snd, buf, STRIDED_TEST_STRIDE, lens,
+                                      STRIDED_TEST_NUM_PKTS, 0),
+                 srtp_err_status_bad_param);
+    for (size_t i = 0; i < STRIDED_TEST_NUM_PKTS; i++) {
+        if (i == long_pkt || i == full_pkt) {
+            CHECK(lens[i] == 0);
+            continue;
+        }
+        CHECK(lens[i] == ref_len[i]);
+        CHECK_BUFFER_EQUAL(buf + i * STRIDED_TEST_STRIDE, ref[i], ref_len[i]);
+    }
+
+    /* the status of the first failure is returned */
+    lens[0] = STRIDED_TEST_STRIDE;
+    CHECK_RETURN(srtp_protect_strided(srtp_snd, buf, STRIDED_TEST_STRIDE, lens,
+                                      1, 0),
+                 srtp_err_status_buffer_small);
+    CHECK(lens[0] == 0);
+
+    CHECK_RETURN(srtp_protect_strided(NULL, buf, STRIDED_TEST_STRIDE, lens,
+                                      1, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_protect_strided(srtp_snd, buf, 0, lens, 1, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_protect_strided(srtp_snd, buf, STRIDED_TEST_STRIDE, NULL,
+                                      1, 0),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_protect_strided(srtp_snd, NULL, STRIDED_TEST_STRIDE, NULL,
+                                  0, 0));
+
+    for (size_t i = 0; i < STRIDED_TEST_NUM_PKTS; i++) {
+        free(ref[i]);
     }
+    free(buf);
+
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    srtp_policy_destroy(policy);
 
-    return buffer - *rtp_len;
+    return srtp_err_status_ok;
 }
 
-uint8_t *create_rtcp_test_packet(size_t payload_len,
-                                 uint32_t ssrc,
-                                 size_t *rtcp_len,
-                                 size_t *buffer_len)
+/*
+ * srtp_test_protect_rtcp_batch() is the SRTCP version of
+ * srtp_test_protect_batch(), it also checks that a packet replayed within
+ * the batch is rejected
+ */
+srtp_err_status_t srtp_test_protect_rtcp_batch(bool thread_safe)
 {
-    uint8_t *buffer;
-    srtcp_hdr_t *hdr;
-    size_t bytes_in_hdr = 8;
-    size_t len = 0;
-
-    *rtcp_len = payload_len + bytes_in_hdr;
+    const uint32_t ssrcs[BATCH_TEST_NUM_PKTS] = {
+        0xcafebabe, 0xcafebabe, 0xcafebabe, 0xdecafbad,
+        0xdecafbad, 0xcafebabe, 0xfeedface, 0xfeedface,
+    };
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    uint8_t *ref[BATCH_TEST_NUM_PKTS];
+    uint8_t *pkt[BATCH_TEST_NUM_PKTS];
+    size_t ref_len[BATCH_TEST_NUM_PKTS];
+    size_t rtcp_len[BATCH_TEST_NUM_PKTS];
+    srtp_packet_desc_t desc[BATCH_TEST_NUM_PKTS];
+    size_t buffer_len;
+    const size_t hdr_len = 8;
+    const size_t bad_pkt = 3;
+    const size_t replayed_pkt = 7;
 
-    // allocate enough for max trailer and 4 byte overrun detection
-    len = *rtcp_len + SRTP_MAX_SRTCP_TRAILER_LEN + 4;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_create(&srtp_ref, policy));
+    CHECK_OK(srtp_create(&srtp_snd, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_snd, thread_safe));
+    CHECK_OK(srtp_stream_add(srtp_snd, policy));
 
-    buffer = (uint8_t *)malloc(len);
-    if (!buffer) {
-        printf("rtcp test packet allocation failed\n");
-        exit(1);
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_recv, thread_safe));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        ref[i] = create_rtcp_test_packet(28 + 4 * i, ssrcs[i], &ref_len[i],
+                                         &buffer_len);
+        pkt[i] = create_rtcp_test_packet(28 + 4 * i, ssrcs[i], &rtcp_len[i],
+                                         &buffer_len);
+        CHECK_OK(srtp_protect_rtcp(srtp_ref, ref[i], ref_len[i], ref[i],
+                                   &buffer_len, 0));
+        ref_len[i] = buffer_len;
+
+        desc[i].in = pkt[i];
+        desc[i].in_len = rtcp_len[i];
+        desc[i].out = pkt[i];
+        desc[i].out_len = rtcp_len[i] + SRTP_MAX_SRTCP_TRAILER_LEN;
+        desc[i].mki_index = 0;
+        desc[i].status = srtp_err_status_fail;
+    }
+
+    CHECK_OK(srtp_protect_rtcp_batch(srtp_snd, desc, BATCH_TEST_NUM_PKTS));
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == ref_len[i]);
+        CHECK_BUFFER_EQUAL(pkt[i], ref[i], ref_len[i]);
     }
 
-    overrun_check_prepare(buffer, 0, len);
-
-    hdr = (srtcp_hdr_t *)buffer;
-    hdr->version = 2; /* RTP version two     */
-    hdr->p = 0;       /* no padding needed   */
-    hdr->rc = 0;      /* no reports          */
-    hdr->pt = 0xc8;   /* sender report (200) */
-    hdr->len = ((bytes_in_hdr + payload_len) % 4) - 1;
-    hdr->ssrc = htonl(ssrc); /* synch. source       */
-    buffer += bytes_in_hdr;
+    /*
+     * corrupt the payload of one packet and replace the last one with a
+     * copy of the packet before it
+     */
+    pkt[bad_pkt][hdr_len] ^= 0xff;
+    free(pkt[replayed_pkt]);
+    pkt[replayed_pkt] = (uint8_t *)malloc(ref_len[replayed_pkt - 1]);
+    CHECK(pkt[replayed_pkt] != NULL);
+    memcpy(pkt[replayed_pkt], ref[replayed_pkt - 1], ref_len[replayed_pkt - 1]);
+    desc[replayed_pkt].in = pkt[replayed_pkt];
+    desc[replayed_pkt].out = pkt[replayed_pkt];
+    desc[replayed_pkt].out_len = ref_len[replayed_pkt - 1];
 
-    /* set data to 0xab */
-    memset(buffer, 0xab, payload_len);
-    buffer += payload_len;
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        desc[i].in_len = desc[i].out_len;
+        desc[i].status = srtp_err_status_fail;
+    }
 
-    if (buffer_len) {
-        *buffer_len = len;
+    CHECK_RETURN(
+        srtp_unprotect_rtcp_batch(srtp_recv, desc, BATCH_TEST_NUM_PKTS),
+        srtp_err_status_auth_fail);
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        if (i == bad_pkt) {
+            CHECK_RETURN(desc[i].status, srtp_err_status_auth_fail);
+            continue;
+        }
+        if (i == replayed_pkt) {
+            CHECK_RETURN(desc[i].status, srtp_err_status_replay_fail);
+            continue;
+        }
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == rtcp_len[i]);
+        CHECK(pkt[i][hdr_len] == 0xab);
     }
 
-    return buffer - *rtcp_len;
-}
+    /* the bad packet did not update the replay database */
+    CHECK_OK(srtp_unprotect_rtcp(srtp_recv, ref[bad_pkt], ref_len[bad_pkt],
+                                 ref[bad_pkt], &ref_len[bad_pkt]));
 
-static uint16_t get_xtn_profile(const uint8_t *packet)
-{
-    const srtp_hdr_t *hdr = (const srtp_hdr_t *)packet;
-    const srtp_hdr_xtnd_t *xtn_hdr;
+    CHECK_RETURN(srtp_protect_rtcp_batch(NULL, desc, BATCH_TEST_NUM_PKTS),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_unprotect_rtcp_batch(srtp_recv, NULL, 0));
 
-    if (!hdr->x) {
-        return 0;
+    for (size_t i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+        free(ref[i]);
+        free(pkt[i]);
     }
 
-    xtn_hdr = (const srtp_hdr_xtnd_t *)(packet + sizeof(srtp_hdr_t) +
-                                        (hdr->cc * sizeof(uint32_t)));
-    return ntohs(xtn_hdr->profile_specific);
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
 }
 
-void srtp_do_timing(const test_policy_t *policy)
+/*
+ * srtp_test_unprotect_framed() checks srtp_unprotect_framed() on a stream
+ * of SRTP and SRTCP frames at an odd offset, with a frame whose tag is
+ * wrong, an empty frame and an incomplete frame at the end
+ */
+#define FRAMED_TEST_NUM_PKTS 7
+
+srtp_err_status_t srtp_test_unprotect_framed(void)
 {
-    int len;
+    const bool is_rtcp[FRAMED_TEST_NUM_PKTS] = {
+        false, false, true, false, false, true, false,
+    };
+    const size_t bad_pkt = 3;
+    const size_t empty_pkt = 4;
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_frame_desc_t frames[FRAMED_TEST_NUM_PKTS + 1];
+    size_t pkt_len[FRAMED_TEST_NUM_PKTS];
+    size_t offset[FRAMED_TEST_NUM_PKTS];
+    uint8_t *stream_buf;
+    uint8_t *buf;
+    uint8_t *pkt;
+    size_t len, buffer_len, partial_len;
+    size_t buf_len = 0;
+    size_t num_frames, consumed;
+    uint16_t seq = 1;
 
-    /*
-     * note: the output of this function is formatted so that it
-     * can be used in gnuplot.  '#' indicates a comment, and "\r\n"
-     * terminates a record
-     */
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    printf("# testing srtp throughput:\r\n");
-    printf("# mesg length (octets)\tthroughput (megabits per second)\r\n");
+    stream_buf = malloc(4096);
+    CHECK(stream_buf != NULL);
+    buf = stream_buf + 1;
+
+    for (size_t i = 0; i < FRAMED_TEST_NUM_PKTS; i++) {
+        if (i == empty_pkt) {
+            pkt_len[i] = 0;
+        } else if (is_rtcp[i]) {
+            pkt = create_rtcp_test_packet(40, 0xcafebabe, &pkt_len[i],
+                                          &buffer_len);
+            len = buffer_len;
+            CHECK_OK(srtp_protect_rtcp(srtp_snd, pkt, pkt_len[i], pkt, &len,
+                                       0));
+            memcpy(buf + buf_len + 2, pkt, len);
+            free(pkt);
+        } else {
+            pkt = create_rtp_test_packet(30 + i, 0xcafebabe, seq++, 0, false,
+                                         &pkt_len[i], &buffer_len);
+            len = buffer_len;
+            CHECK_OK(srtp_protect(srtp_snd, pkt, pkt_len[i], pkt, &len, 0));
+            memcpy(buf + buf_len + 2, pkt, len);
+            free(pkt);
+        }
+        if (i == empty_pkt) {
+            len = 0;
+        }
+        if (i == bad_pkt) {
+            buf[buf_len + 2 + len - 1] ^= 0x01;
+        }
+        buf[buf_len] = (uint8_t)(len >> 8);
+        buf[buf_len + 1] = (uint8_t)len;
+        offset[i] = buf_len + 2;
+        buf_len += 2 + len;
+    }
+
+    /* the last frame is missing the end of its packet */
+    pkt = create_rtp_test_packet(100, 0xcafebabe, seq, 0, false, &len,
+                                 &buffer_len);
+    partial_len = len;
+    len = buffer_len;
+    CHECK_OK(srtp_protect(srtp_snd, pkt, partial_len, pkt, &len, 0));
+    buf[buf_len] = (uint8_t)(len >> 8);
+    buf[buf_len + 1] = (uint8_t)len;
+    memcpy(buf + buf_len + 2, pkt, len / 2);
+    free(pkt);
 
-    for (len = 16; len <= 2048; len *= 2) {
-        printf("%d\t\t\t%f\r\n", len,
-               srtp_bits_per_second(len, policy) / 1.0E6);
+    CHECK_RETURN(srtp_unprotect_framed(srtp_recv, buf, buf_len + 2 + len / 2,
+                                       frames, FRAMED_TEST_NUM_PKTS + 1,
+                                       &num_frames, &consumed),
+                 srtp_err_status_auth_fail);
+    CHECK(num_frames == FRAMED_TEST_NUM_PKTS);
+    CHECK(consumed == buf_len);
+    for (size_t i = 0; i < FRAMED_TEST_NUM_PKTS; i++) {
+        CHECK(frames[i].offset == offset[i]);
+        if (i == empty_pkt) {
+            CHECK_RETURN(frames[i].status, srtp_err_status_bad_param);
+            continue;
+        }
+        CHECK(frames[i].rtcp == is_rtcp[i]);
+        if (i == bad_pkt) {
+            CHECK_RETURN(frames[i].status, srtp_err_status_auth_fail);
+            continue;
+        }
+        CHECK_OK(frames[i].status);
+        CHECK(frames[i].len == pkt_len[i]);
+        CHECK(buf[offset[i] + pkt_len[i] - 1] == 0xab);
     }
 
-    /* these extra linefeeds let gnuplot know that a dataset is done */
-    printf("\r\n\r\n");
-}
+    /* no more frames than there is room for are taken */
+    CHECK_OK(srtp_unprotect_framed(srtp_recv, buf, buf_len, frames, 0,
+                                   &num_frames, &consumed));
+    CHECK(num_frames == 0);
+    CHECK(consumed == 0);
 
-void srtp_do_rejection_timing(const test_policy_t *policy)
-{
-    int len;
+    free(stream_buf);
 
-    /*
-     * note: the output of this function is formatted so that it
-     * can be used in gnuplot.  '#' indicates a comment, and "\r\n"
-     * terminates a record
-     */
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    printf("# testing srtp rejection throughput:\r\n");
-    printf("# mesg length (octets)\trejections per second\r\n");
+    return srtp_err_status_ok;
+}
 
-    for (len = 8; len <= 2048; len *= 2) {
-        printf("%d\t\t\t%e\r\n", len, srtp_rejections_per_second(len, policy));
+/*
+ * srtp_test_send_and_receive() protects a fresh packet with the given
+ * SSRC and sequence number and unprotects it with srtp_recv
+ */
+static srtp_err_status_t srtp_test_send_and_receive(srtp_t srtp_snd,
+                                                         srtp_t srtp_recv,
+                                                         uint32_t ssrc,
+                                                         uint16_t seq)
+{
+    srtp_err_status_t status;
+    uint8_t *pkt;
+    size_t len, buffer_len;
+
+    pkt = create_rtp_test_packet(64, ssrc, seq, 0, false, &len, &buffer_len);
+    status = srtp_protect(srtp_snd, pkt, len, pkt, &buffer_len, 0);
+    if (status == srtp_err_status_ok) {
+        len = buffer_len;
+        status = srtp_unprotect(srtp_recv, pkt, len, pkt, &len);
     }
+    free(pkt);
 
-    /* these extra linefeeds let gnuplot know that a dataset is done */
-    printf("\r\n\r\n");
+    return status;
 }
 
-#define MAX_MSG_LEN 1024
-
-double srtp_bits_per_second(size_t msg_len_octets,
-                            const test_policy_t *test_policy)
+/*
+ * srtp_test_stream_pool() checks that streams cloned from the template
+ * are taken from and returned to the preallocated pool
+ */
+srtp_err_status_t srtp_test_stream_pool(void)
 {
-    srtp_t srtp;
+    srtp_t srtp_snd, srtp_recv;
     srtp_policy_t policy;
-    uint8_t *mesg;
-    clock_t timer;
-    size_t num_trials = 100000;
-    size_t input_len, len;
-    uint32_t ssrc;
-    srtp_err_status_t status;
+    srtp_stream_t first, second;
 
-    CHECK_OK(policy_from_test_policy(&policy, test_policy, false));
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
-    /*
-     * allocate and initialize an srtp session
-     */
-    status = srtp_create(&srtp, policy);
-    if (status) {
-        printf("error: srtp_create() failed with error code %d\n", status);
-        exit(1);
-    }
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
 
-    srtp_policy_destroy(policy);
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_policy_set_stream_pool_size(policy, 2));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    /*
-     * if the ssrc is unspecified, use a predetermined one
-     */
-    if (test_policy->ssrc.type != ssrc_specific) {
-        ssrc = 0xdeadbeef;
-    } else {
-        ssrc = test_policy->ssrc.value;
+    /* more SSRCs than the pool holds */
+    for (uint32_t ssrc = 1; ssrc <= 3; ssrc++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 0));
     }
+    first = srtp_get_stream(srtp_recv, htonl(1));
+    second = srtp_get_stream(srtp_recv, htonl(2));
+    CHECK(first != NULL && second != NULL);
+
+    /* a removed stream is reused for the next new SSRC */
+    CHECK_OK(srtp_stream_remove(srtp_recv, 1));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, 0));
+    CHECK(srtp_get_stream(srtp_recv, htonl(4)) == first);
 
     /*
-     * create a test packet
+     * and starts out with an empty replay database, so a new sender can
+     * start over with the same SSRC and sequence number
      */
-    mesg = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1, false, &input_len,
-                                  NULL);
-    if (mesg == NULL) {
-        return 0.0; /* indicate failure by returning zero */
-    }
-    timer = clock();
-    for (size_t i = 0; i < num_trials; i++) {
-        len = input_len;
-        /* srtp protect message */
-        status = call_srtp_protect(srtp, mesg, &len, 0);
-        if (status) {
-            printf("error: srtp_protect() failed with error code %d\n", status);
-            exit(1);
-        }
+    CHECK_OK(srtp_stream_remove(srtp_recv, 4));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 0));
+    CHECK(srtp_get_stream(srtp_recv, htonl(1)) == first);
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
 
-        /* increment message number */
-        {
-            /* hack sequence to avoid problems with macros for htons/ntohs on
-             * some systems */
-            srtp_hdr_t *hdr = (srtp_hdr_t *)mesg;
-            short new_seq = ntohs(hdr->seq) + 1;
-            hdr->seq = htons(new_seq);
-        }
-    }
-    timer = clock() - timer;
+    /* updating the template to a different replay window refills the pool */
+    CHECK_OK(srtp_stream_remove(srtp_recv, 2));
+    CHECK_OK(srtp_policy_set_window_size(policy, 256));
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 5, 1));
+    CHECK(srtp_get_stream(srtp_recv, htonl(5)) != NULL);
+    CHECK_OK(srtp_stream_remove(srtp_recv, 5));
 
-    free(mesg);
+    CHECK_RETURN(srtp_policy_set_stream_pool_size(NULL, 1),
+                 srtp_err_status_bad_param);
 
-    status = srtp_dealloc(srtp);
-    if (status) {
-        printf("error: srtp_dealloc() failed with error code %d\n", status);
-        exit(1);
-    }
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    return msg_len_octets * 8.0 * num_trials * CLOCKS_PER_SEC / timer;
+    return srtp_err_status_ok;
 }
 
-double srtp_rejections_per_second(size_t msg_len_octets,
-                                  const test_policy_t *test_policy)
+/*
+ * srtp_test_template_rekey() checks that an update of the template that
+ * only changes the master keys rekeys it and its clones in place, keeping
+ * their replay state and counters, while one that changes the profile
+ * still replaces them
+ */
+srtp_err_status_t srtp_test_template_rekey(void)
 {
-    srtp_ctx_t *srtp;
+    srtp_t srtp_snd, srtp_recv;
     srtp_policy_t policy;
-    uint8_t *mesg;
-    size_t len;
-    clock_t timer;
-    size_t num_trials = 1000000;
-    uint32_t ssrc = test_policy->ssrc.value;
-    srtp_err_status_t status;
+    srtp_stream_t stream_template, first;
+    uint8_t *pkt;
+    size_t len, buffer_len;
 
-    CHECK_OK(policy_from_test_policy(&policy, test_policy, false));
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
-    /*
-     * allocate and initialize an srtp session
-     */
-    status = srtp_create(&srtp, policy);
-    if (status) {
-        printf("error: srtp_create() failed with error code %d\n", status);
-        exit(1);
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    for (uint32_t ssrc = 1; ssrc <= 3; ssrc++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 1));
     }
+    stream_template = srtp_recv->stream_template;
+    first = srtp_get_stream(srtp_recv, htonl(1));
+    CHECK(first != NULL);
 
-    srtp_policy_destroy(policy);
+    /* a packet protected with the old keys */
+    pkt = create_rtp_test_packet(64, 1, 2, 0, false, &len, &buffer_len);
+    CHECK(pkt != NULL);
+    CHECK_OK(srtp_protect(srtp_snd, pkt, len, pkt, &buffer_len, 0));
 
-    mesg =
-        create_rtp_test_packet(msg_len_octets, ssrc, 1, 1, false, &len, NULL);
-    if (mesg == NULL) {
-        return 0.0; /* indicate failure by returning zero */
-    }
-    call_srtp_protect(srtp, mesg, &len, 0);
+    CHECK_OK(policy_set_key(policy, test_key_2));
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_update(srtp_snd, policy));
+    CHECK(srtp_recv->stream_template == stream_template);
+    CHECK(srtp_get_stream(srtp_recv, htonl(1)) == first);
+    CHECK(first->stats.rtp_packets_unprotected == 1);
 
-    timer = clock();
-    for (size_t i = 0; i < num_trials; i++) {
-        len = msg_len_octets;
-        call_srtp_unprotect(srtp, mesg, &len);
+    CHECK_RETURN(srtp_unprotect(srtp_recv, pkt, buffer_len, pkt, &buffer_len),
+                 srtp_err_status_auth_fail);
+    free(pkt);
+
+    /* the clones keep their replay databases */
+    for (uint32_t ssrc = 1; ssrc <= 3; ssrc++) {
+        CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 1),
+                     srtp_err_status_replay_fail);
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 3));
     }
-    timer = clock() - timer;
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, 1));
+    CHECK(first->stats.rtp_packets_unprotected == 2);
 
-    free(mesg);
+    /* a different profile replaces the template */
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_32));
+    CHECK_OK(srtp_update(srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK(srtp_recv->stream_template != stream_template);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 4));
 
-    status = srtp_dealloc(srtp);
-    if (status) {
-        printf("error: srtp_dealloc() failed with error code %d\n", status);
-        exit(1);
-    }
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    return (double)num_trials * CLOCKS_PER_SEC / timer;
+    return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_test(const test_policy_t *policy,
-                            bool test_extension_headers,
-                            bool use_mki,
-                            size_t mki_index)
+/*
+ * srtp_test_thread_safe() checks that a thread safe session gives streams
+ * cloned from its template their own cipher and auth, and otherwise
+ * behaves like any other session
+ */
+srtp_err_status_t srtp_test_thread_safe(void)
 {
-    size_t i;
-    srtp_t srtp_sender;
-    srtp_t srtp_rcvr;
-    srtp_err_status_t status = srtp_err_status_ok;
-    uint8_t *hdr, *hdr2;
-    uint8_t hdr_enc[128];
-    size_t msg_len_octets, msg_len_enc, msg_len;
-    size_t len, len2;
-    size_t tag_length;
-    size_t buffer_len;
-    uint32_t ssrc;
-    srtp_policy_t send_policy;
-    srtp_policy_t rcvr_policy;
-    uint8_t header = 1;
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stream_t first, second;
+    srtp_stream_stats_t before, stats;
+    uint8_t *rtcp;
+    size_t rtcp_len;
+    uint32_t roc;
 
-    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
-    if (test_extension_headers) {
-        CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(send_policy, header));
-    }
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
 
-    CHECK_OK(srtp_create(&srtp_sender, send_policy));
+    CHECK_RETURN(srtp_set_thread_safe(NULL, true), srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_set_thread_safe(srtp_snd, true),
+                 srtp_err_status_bad_param);
 
-    /* print out policy */
-    CHECK_OK(srtp_session_print_policy(srtp_sender));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_recv, true));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
 
-    /*
-     * initialize data buffer, using the ssrc in the policy unless that
-     * value is a wildcard, in which case we'll just use an arbitrary
-     * one
-     */
-    if (policy->ssrc.type != ssrc_specific) {
-        ssrc = 0xdecafbad;
-    } else {
-        ssrc = policy->ssrc.value;
-    }
-    msg_len_octets = 28;
-    hdr = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
-                                 test_extension_headers, &len, &buffer_len);
-    hdr2 = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
-                                  test_extension_headers, &len2, NULL);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 0));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 0));
 
-    /* save original msg len */
-    msg_len = len;
+    first = srtp_get_stream(srtp_recv, htonl(1));
+    second = srtp_get_stream(srtp_recv, htonl(2));
+    CHECK(first != NULL && second != NULL);
+    CHECK(first->session_keys[0].rtp_cipher !=
+          second->session_keys[0].rtp_cipher);
+    CHECK(first->session_keys[0].rtp_auth != second->session_keys[0].rtp_auth);
 
-    if (hdr == NULL) {
-        free(hdr2);
-        return srtp_err_status_alloc_fail;
-    }
-    if (hdr2 == NULL) {
-        free(hdr);
-        return srtp_err_status_alloc_fail;
-    }
+    CHECK_OK(srtp_stream_get_roc(srtp_recv, 1, &roc));
+    CHECK(roc == 0);
+    CHECK_RETURN(srtp_stream_get_roc(srtp_recv, 4, &roc),
+                 srtp_err_status_bad_param);
 
-    debug_print(mod_driver, "before protection:\n%s",
-                srtp_packet_to_string(hdr, len));
+    /* SRTCP has its own lock and counters, reported with those of RTP */
+    CHECK_OK(srtp_stream_get_stats(srtp_recv, 1, &before));
+    rtcp = create_rtcp_test_packet(28, 1, &rtcp_len, NULL);
+    CHECK_OK(call_srtp_protect_rtcp(srtp_snd, rtcp, &rtcp_len, 0));
+    CHECK_OK(call_srtp_unprotect_rtcp(srtp_recv, rtcp, &rtcp_len));
+    free(rtcp);
+    rtcp = create_rtcp_test_packet(28, 1, &rtcp_len, NULL);
+    CHECK_OK(call_srtp_protect_rtcp(srtp_snd, rtcp, &rtcp_len, 0));
+    rtcp[rtcp_len - 1] ^= 0xff;
+    CHECK_RETURN(call_srtp_unprotect_rtcp(srtp_recv, rtcp, &rtcp_len),
+                 srtp_err_status_auth_fail);
+    free(rtcp);
+    CHECK_OK(srtp_stream_get_stats(srtp_recv, 1, &stats));
+    CHECK(stats.rtp_packets_unprotected == before.rtp_packets_unprotected);
+    CHECK(stats.rtcp_packets_unprotected ==
+          before.rtcp_packets_unprotected + 1);
+    CHECK(stats.auth_fail == before.auth_fail + 1);
 
-#if PRINT_REFERENCE_PACKET
-    debug_print(mod_driver, "reference packet before protection:\n%s",
-                octet_string_hex_string(hdr, len));
-#endif
-    CHECK_OK(call_srtp_protect(srtp_sender, hdr, &len, mki_index));
+    /* clones are rekeyed by an update of the template */
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK(srtp_get_stream(srtp_recv, htonl(1)) != NULL);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 1));
 
-    debug_print(mod_driver, "after protection:\n%s",
-                srtp_packet_to_string(hdr, len));
-#if PRINT_REFERENCE_PACKET
-    debug_print(mod_driver, "after protection:\n%s",
-                octet_string_hex_string(hdr, len));
-#endif
+    CHECK_OK(srtp_stream_remove(srtp_recv, 2));
+    CHECK(srtp_get_stream(srtp_recv, htonl(2)) == NULL);
 
-    /* save protected message and length */
-    memcpy(hdr_enc, hdr, len);
-    msg_len_enc = len;
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    /*
-     * check for overrun of the srtp_protect() function
-     *
-     * The packet is followed by a value of 0xffffffff; if the value of the
-     * data following the packet is different, then we know that the
-     * protect function is overwriting the end of the packet.
-     */
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_key_cache() checks that streams added for specific SSRCs with
+ * the keys of an earlier stream get their own copy of its keys, which
+ * stays usable after the earlier stream is removed
+ */
+srtp_err_status_t srtp_test_key_cache(void)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stream_t first, second;
+    bool can_clone;
+
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
     CHECK_OK(
-        srtp_get_protect_trailer_length(srtp_sender, mki_index, &tag_length));
-    CHECK_OVERRUN(hdr, msg_len + tag_length, buffer_len);
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
 
-    /*
-     * if the policy includes confidentiality, check that ciphertext is
-     * different than plaintext
-     *
-     * Note that this check will give false negatives, with some small
-     * probability, especially if the packets are short.  For that
-     * reason, we skip this check if the plaintext is less than four
-     * octets long.
-     */
-    if ((policy->rtp_sec_serv & sec_serv_conf) && (msg_len_octets >= 4)) {
-        printf("testing that ciphertext is distinct from plaintext...");
-        status = srtp_err_status_algo_fail;
-        for (i = 12; i < msg_len_octets + 12; i++) {
-            if (hdr[i] != hdr2[i]) {
-                status = srtp_err_status_ok;
-            }
-        }
-        if (status) {
-            printf("failed\n");
-            free(hdr);
-            free(hdr2);
-            return status;
-        }
-        printf("passed\n");
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    for (uint32_t ssrc = 1; ssrc <= 3; ssrc++) {
+        CHECK_OK(
+            srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+        CHECK_OK(srtp_stream_add(srtp_recv, policy));
     }
 
-    CHECK_OK(srtp_policy_clone(send_policy, &rcvr_policy));
-    CHECK_OK(srtp_policy_set_ssrc(rcvr_policy,
-                                  (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    first = srtp_get_stream(srtp_recv, htonl(1));
+    second = srtp_get_stream(srtp_recv, htonl(2));
+    CHECK(first != NULL && second != NULL);
 
-    CHECK_OK(srtp_create(&srtp_rcvr, rcvr_policy));
+    /* keys are only cached by backends that can clone them */
+    can_clone = srtp_stream_keys_can_clone(first);
+    if (can_clone) {
+        CHECK(first->key_entry != NULL &&
+              first->key_entry == second->key_entry);
+    } else {
+        CHECK(first->key_entry == NULL && second->key_entry == NULL);
+    }
+    CHECK(first->session_keys[0].rtp_cipher !=
+          second->session_keys[0].rtp_cipher);
+    CHECK(first->session_keys[0].rtp_auth != second->session_keys[0].rtp_auth);
 
-    CHECK_OK(call_srtp_unprotect(srtp_rcvr, hdr, &len));
+    for (uint32_t ssrc = 1; ssrc <= 3; ssrc++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 0));
+    }
 
-    debug_print(mod_driver, "after unprotection:\n%s",
-                srtp_packet_to_string(hdr, len));
+    /* the keys outlive the stream they were first derived for */
+    CHECK_OK(srtp_stream_remove(srtp_recv, 1));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 4 }));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, 0));
 
-    /* verify that the unprotected packet matches the original one */
-    for (i = 0; i < len; i++) {
-        if (hdr[i] != hdr2[i]) {
-            fprintf(stdout, "mismatch at octet %zu\n", i);
-            status = srtp_err_status_algo_fail;
-        }
-    }
-    if (status) {
-        free(hdr);
-        free(hdr2);
-        return status;
+    /* a stream with other keys does not share them */
+    CHECK_OK(policy_set_key(policy, test_alt_key));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 5 }));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+    CHECK(!can_clone || srtp_get_stream(srtp_recv, htonl(5))->key_entry !=
+                            srtp_get_stream(srtp_recv, htonl(2))->key_entry);
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, 5, 0),
+                 srtp_err_status_auth_fail);
+
+    for (uint32_t ssrc = 2; ssrc <= 5; ssrc++) {
+        CHECK_OK(srtp_stream_remove(srtp_recv, ssrc));
     }
+    CHECK(srtp_recv->key_cache.count == 0);
 
-    /*
-     * if the policy includes authentication, then test for false positives
-     */
-    if (policy->rtp_sec_serv & sec_serv_auth) {
-        uint8_t *data = hdr + (test_extension_headers ? 24 : 12);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-        printf("testing for false positives in replay check...");
+    return srtp_err_status_ok;
+}
 
-        /* unprotect a second time - should fail with a replay error */
-        status = call_srtp_unprotect(srtp_rcvr, hdr, &msg_len_enc);
-        if (status != srtp_err_status_replay_fail) {
-            printf("failed with error code %d\n", status);
-            free(hdr);
-            free(hdr2);
-            return srtp_err_status_algo_fail;
-        } else {
-            printf("passed\n");
-        }
+/*
+ * srtp_test_key_store() checks that sessions keyed separately with the
+ * same keys share their expanded keys, which outlive the session that
+ * made them, and that the expansions are freed with the last session
+ */
+srtp_err_status_t srtp_test_key_store(void)
+{
+    srtp_t srtp_snd, srtp_recv, srtp_alt;
+    srtp_policy_t policy;
+    size_t initial, count;
 
-        printf("testing for false positives in auth check...");
+    /* only the internal crypto expands keys through the key store */
+#if !defined(OPENSSL) && !defined(WOLFSSL) && !defined(MBEDTLS) &&            \
+    !defined(NSS) && !defined(CNG) && !defined(COMMONCRYPTO)
+    const bool internal_crypto = true;
+#else
+    const bool internal_crypto = false;
+#endif
 
-        /* increment sequence number in header */
-        ((srtp_hdr_t *)hdr)->seq++;
+    initial = srtp_key_store_count();
 
-        /* apply protection */
-        CHECK_OK(call_srtp_protect(srtp_sender, hdr, &len, mki_index));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK(!internal_crypto || srtp_key_store_count() > initial);
+    count = srtp_key_store_count();
 
-        /* flip bits in packet */
-        data[0] ^= 0xff;
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    CHECK(srtp_key_store_count() == count);
 
-        /* unprotect, and check for authentication failure */
-        status = call_srtp_unprotect(srtp_rcvr, hdr, &len);
-        if (status != srtp_err_status_auth_fail) {
-            printf("failed with error code %d\n", status);
-            printf("failed\n");
-            free(hdr);
-            free(hdr2);
-            return srtp_err_status_algo_fail;
-        } else {
-            printf("passed\n");
-        }
-    }
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 0));
 
-    CHECK_OK(srtp_dealloc(srtp_sender));
-    CHECK_OK(srtp_dealloc(srtp_rcvr));
+    /* other keys are expanded on their own */
+    CHECK_OK(policy_set_key(policy, test_alt_key));
+    CHECK_OK(srtp_create(&srtp_alt, policy));
+    CHECK(!internal_crypto || srtp_key_store_count() > count);
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_alt, 1, 1),
+                 srtp_err_status_auth_fail);
+    CHECK_OK(srtp_dealloc(srtp_alt));
+    CHECK(srtp_key_store_count() == count);
+
+    /* the expansions stay valid after the session that made them is gone */
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 2));
 
-    srtp_policy_destroy(send_policy);
-    srtp_policy_destroy(rcvr_policy);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    CHECK(srtp_key_store_count() == initial);
+    srtp_policy_destroy(policy);
 
-    free(hdr);
-    free(hdr2);
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_test_io_lengths(const test_policy_t *policy,
-                                       bool test_extension_headers,
-                                       bool use_mki,
-                                       size_t mki_index)
+/*
+ * srtp_test_shared_key_region() checks that the keys expanded by the
+ * creator of a shared region are placed there and found by a process
+ * attached to it, and that the region cannot be detached while in use
+ */
+srtp_err_status_t srtp_test_shared_key_region(void)
 {
-    srtp_t srtp_sender;
-    srtp_policy_t send_policy;
-    uint32_t ssrc;
-    uint16_t seq = 1;
-    uint32_t ts = 1234;
-    uint8_t *rtp;
-    size_t rtp_len, buffer_len, srtp_len;
-    size_t rtp_header_len = 12;
-    uint8_t xtn_header_id = 1;
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    const size_t size = 16384;
+    uint8_t *buffer;
+    void *region;
+    size_t initial;
 
-    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+#if !defined(OPENSSL) && !defined(WOLFSSL) && !defined(MBEDTLS) &&            \
+    !defined(NSS) && !defined(CNG) && !defined(COMMONCRYPTO)
+    const bool internal_crypto = true;
+#else
+    const bool internal_crypto = false;
+#endif
 
-    if (test_extension_headers) {
-        CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(send_policy, xtn_header_id));
-        rtp_header_len += sizeof(rtp_test_packet_extension_header);
-    }
+    buffer = (uint8_t *)malloc(size + 64);
+    CHECK(buffer != NULL);
+    region = buffer + (64 - (uintptr_t)buffer % 64) % 64;
 
-    CHECK_OK(srtp_create(&srtp_sender, send_policy));
+    CHECK_RETURN(srtp_shared_key_region_create(buffer + 1, size),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_shared_key_region_create(region, 64),
+                 srtp_err_status_bad_param);
 
-    // get required trailer length
-    size_t trailer_len;
-    CHECK_OK(
-        srtp_get_protect_trailer_length(srtp_sender, mki_index, &trailer_len));
+    initial = srtp_key_store_count();
 
-    CHECK_OK(srtp_session_print_policy(srtp_sender));
+    CHECK_OK(srtp_shared_key_region_create(region, size));
+    CHECK_RETURN(srtp_shared_key_region_attach(region, size),
+                 srtp_err_status_fail);
 
-    if (policy->ssrc.type != ssrc_specific) {
-        ssrc = 0xdecafbad;
-    } else {
-        ssrc = policy->ssrc.value;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK(srtp_key_store_count() == initial);
+    CHECK(!internal_crypto || srtp_key_store_shared_count() > 0);
+    if (internal_crypto) {
+        CHECK_RETURN(srtp_shared_key_region_detach(), srtp_err_status_fail);
     }
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK(srtp_key_store_shared_count() == 0);
+    CHECK_OK(srtp_shared_key_region_detach());
 
-    // 0 byte input
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = buffer_len;
-    overrun_check_prepare(rtp, 0, buffer_len);
-    CHECK_RETURN(call_srtp_protect2(srtp_sender, rtp, 0, &srtp_len, mki_index),
+    /* a region of another size, or that has been overwritten, is refused */
+    CHECK_RETURN(srtp_shared_key_region_attach(region, size / 2),
                  srtp_err_status_bad_param);
-    CHECK_OVERRUN(rtp, 0, buffer_len);
-    free(rtp);
 
-    // 1 byte input
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = buffer_len;
-    overrun_check_prepare(rtp, 1, buffer_len);
-    CHECK_RETURN(call_srtp_protect2(srtp_sender, rtp, 1, &srtp_len, mki_index),
+    /* as another process would, read the expansions the creator left */
+    CHECK_OK(srtp_shared_key_region_attach(region, size));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    CHECK(srtp_key_store_count() == initial);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 0));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+
+    /* keys that are not in the region are expanded privately */
+    CHECK_OK(policy_set_key(policy, test_alt_key));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    CHECK(!internal_crypto || srtp_key_store_count() > initial);
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 1),
+                 srtp_err_status_auth_fail);
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    CHECK(srtp_key_store_count() == initial);
+    CHECK_OK(srtp_shared_key_region_detach());
+    srtp_policy_destroy(policy);
+
+    memset(region, 0, size);
+    CHECK_RETURN(srtp_shared_key_region_attach(region, size),
                  srtp_err_status_bad_param);
-    CHECK_OVERRUN(rtp, 1, buffer_len);
-    free(rtp);
+    free(buffer);
 
-    // too short header
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = buffer_len;
-    overrun_check_prepare(rtp, rtp_header_len - 1, buffer_len);
-    CHECK_RETURN(call_srtp_protect2(srtp_sender, rtp, rtp_header_len - 1,
-                                    &srtp_len, mki_index),
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_breaker() checks that forged packets for new SSRCs open the
+ * breaker, which then rejects packets for new SSRCs without verifying
+ * them but not those of known streams, and closes once one is accepted
+ */
+srtp_err_status_t srtp_test_breaker(void)
+{
+    srtp_t srtp_snd, srtp_forger, srtp_recv;
+    srtp_policy_t policy;
+    uint64_t rejected;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    CHECK_OK(policy_set_key(policy, test_alt_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_forger, policy));
+
+    CHECK_RETURN(srtp_session_set_breaker(NULL, 3, 5),
                  srtp_err_status_bad_param);
-    CHECK_OVERRUN(rtp, rtp_header_len - 1, buffer_len);
-    free(rtp);
+    CHECK_RETURN(srtp_session_set_breaker(srtp_recv, 3, 0),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_session_set_breaker(srtp_recv, 3, 5));
 
-    // zero payload
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = buffer_len;
-    overrun_check_prepare(rtp, rtp_header_len, buffer_len);
-    CHECK_OK(call_srtp_protect2(srtp_sender, rtp, rtp_header_len, &srtp_len,
-                                mki_index));
-    CHECK(srtp_len == rtp_header_len + trailer_len);
-    CHECK_OVERRUN(rtp, srtp_len, buffer_len);
-    free(rtp);
+    /* a known stream */
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 0));
 
-    // 1 byte payload
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = buffer_len;
-    overrun_check_prepare(rtp, rtp_header_len + 1, buffer_len);
-    CHECK_OK(call_srtp_protect2(srtp_sender, rtp, rtp_header_len + 1, &srtp_len,
-                                mki_index));
-    CHECK(srtp_len == rtp_header_len + 1 + trailer_len);
-    CHECK_OVERRUN(rtp, srtp_len, buffer_len);
-    free(rtp);
+    /* the third forgery in a row opens the breaker */
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK_RETURN(srtp_test_send_and_receive(srtp_forger, srtp_recv,
+                                                100 + i, 0),
+                     srtp_err_status_auth_fail);
+    }
+    CHECK_OK(srtp_session_get_breaker_rejections(srtp_recv, &rejected));
+    CHECK(rejected == 0);
 
-    // 0 byte output
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = 0;
-    overrun_check_prepare(rtp, rtp_len, buffer_len);
-    CHECK_RETURN(
-        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
-        srtp_err_status_buffer_small);
-    CHECK_OVERRUN(rtp, rtp_len, buffer_len);
-    free(rtp);
+    /* while open, even genuine packets of new SSRCs are rejected */
+    for (uint32_t i = 0; i < 4; i++) {
+        CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, i),
+                     srtp_err_status_no_ctx);
+    }
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 1));
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_forger, srtp_recv, 103, 0),
+                 srtp_err_status_no_ctx);
+    CHECK_OK(srtp_session_get_breaker_rejections(srtp_recv, &rejected));
+    CHECK(rejected == 5);
 
-    // 1 byte output
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = 1;
-    overrun_check_prepare(rtp, rtp_len, buffer_len);
-    CHECK_RETURN(
-        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
-        srtp_err_status_buffer_small);
-    CHECK_OVERRUN(rtp, rtp_len, buffer_len);
-    free(rtp);
+    /* the packet let through closes it once accepted */
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 4));
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_forger, srtp_recv, 104, 0),
+                 srtp_err_status_auth_fail);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 3, 0));
 
-    if (trailer_len != 0) {
-        // no space for trailer output
-        rtp = create_rtp_test_packet(
-            28, ssrc, seq++, ts, test_extension_headers, &rtp_len, &buffer_len);
-        srtp_len = rtp_len;
-        overrun_check_prepare(rtp, rtp_len, buffer_len);
-        CHECK_RETURN(
-            call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
-            srtp_err_status_buffer_small);
-        CHECK_OVERRUN(rtp, rtp_len, buffer_len);
-        free(rtp);
+    /* or fails and reopens it at once */
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK_RETURN(srtp_test_send_and_receive(srtp_forger, srtp_recv,
+                                                105 + i, 0),
+                     srtp_err_status_auth_fail);
+    }
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, i),
+                     srtp_err_status_no_ctx);
     }
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_forger, srtp_recv, 108, 0),
+                 srtp_err_status_auth_fail);
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, 5),
+                 srtp_err_status_no_ctx);
+    CHECK_OK(srtp_session_get_breaker_rejections(srtp_recv, &rejected));
+    CHECK(rejected == 11);
 
-    // 1 byte too small output
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = rtp_len + trailer_len - 1;
-    overrun_check_prepare(rtp, rtp_len, buffer_len);
-    CHECK_RETURN(
-        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index),
-        srtp_err_status_buffer_small);
-    CHECK_OVERRUN(rtp, rtp_len, buffer_len);
-    free(rtp);
+    /* turned off, every packet is verified again */
+    CHECK_OK(srtp_session_set_breaker(srtp_recv, 0, 0));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, 6));
 
-    // full payload
-    rtp = create_rtp_test_packet(28, ssrc, seq++, ts, test_extension_headers,
-                                 &rtp_len, &buffer_len);
-    srtp_len = buffer_len;
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_forger));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_reader_profile(profile) records packets of a stream across a
+ * rollover and checks that readers decrypt them in any order and more
+ * than once, given their ROC, without changing the receiving session
+ */
+static srtp_err_status_t srtp_test_reader_profile(srtp_profile_t profile)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_reader_t reader, other;
+    srtp_policy_t policy;
+    const uint32_t ssrc = 0xcafebabe;
+    const uint16_t seqs[] = { 0xfffe, 0xffff, 0, 1 };
+    const uint32_t rocs[] = { 0, 0, 1, 1 };
+    uint8_t *plain[4], *srtp[4];
+    size_t plain_len, srtp_len[4], len, buffer_len;
+    uint8_t out[128];
+    uint32_t roc;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(policy_set_key(policy, test_key));
     CHECK_OK(
-        call_srtp_protect2(srtp_sender, rtp, rtp_len, &srtp_len, mki_index));
-    CHECK(srtp_len == rtp_len + trailer_len);
-    CHECK_OVERRUN(rtp, srtp_len, buffer_len);
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    CHECK_OK(srtp_dealloc(srtp_sender));
+    for (size_t i = 0; i < 4; i++) {
+        plain[i] = create_rtp_test_packet(64, ssrc, seqs[i], 0, false,
+                                          &plain_len, NULL);
+        srtp[i] = create_rtp_test_packet(64, ssrc, seqs[i], 0, false, &len,
+                                         &buffer_len);
+        CHECK_OK(srtp_protect(srtp_snd, srtp[i], len, srtp[i], &buffer_len, 0));
+        srtp_len[i] = buffer_len;
+    }
+    CHECK_OK(srtp_stream_get_roc(srtp_snd, ssrc, &roc));
+    CHECK(roc == 1);
 
-    // unprotect
-    srtp_t srtp_receiver;
-    srtp_policy_t receive_policy;
+    CHECK_RETURN(srtp_reader_create(srtp_recv, ssrc + 1, &reader),
+                 srtp_err_status_no_ctx);
+    /* readers clone the keys of the stream, which not every backend can */
+    if (!srtp_stream_keys_can_clone(srtp_get_stream(srtp_recv, htonl(ssrc)))) {
+        CHECK_RETURN(srtp_reader_create(srtp_recv, ssrc, &reader),
+                     srtp_err_status_no_such_op);
+    } else {
+        CHECK_OK(srtp_reader_create(srtp_recv, ssrc, &reader));
+        CHECK_OK(srtp_reader_create(srtp_recv, ssrc, &other));
+
+        /* backwards, then each packet again */
+        for (size_t n = 0; n < 8; n++) {
+            size_t i = n < 4 ? 3 - n : n - 4;
+
+            len = sizeof(out);
+            CHECK_OK(srtp_reader_unprotect(reader, rocs[i], srtp[i],
+                                           srtp_len[i], out, &len));
+            CHECK(len == plain_len);
+            CHECK_BUFFER_EQUAL(out, plain[i], len);
+        }
 
-    CHECK_OK(srtp_policy_clone(send_policy, &receive_policy));
-    CHECK_OK(srtp_policy_set_ssrc(receive_policy,
-                                  (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+        /* the other reader is independent, and the ROC must be right */
+        len = sizeof(out);
+        CHECK_OK(srtp_reader_unprotect(other, rocs[2], srtp[2], srtp_len[2],
+                                       out, &len));
+        CHECK_BUFFER_EQUAL(out, plain[2], len);
+        len = sizeof(out);
+        CHECK_RETURN(srtp_reader_unprotect(other, 0, srtp[2], srtp_len[2], out,
+                                           &len),
+                     srtp_err_status_auth_fail);
+
+        /* the session is left as it was */
+        CHECK_OK(srtp_stream_get_roc(srtp_recv, ssrc, &roc));
+        CHECK(roc == 0);
+        len = srtp_len[0];
+        CHECK_OK(srtp_unprotect(srtp_recv, srtp[0], len, srtp[0], &len));
+
+        CHECK_OK(srtp_reader_dealloc(reader));
+        CHECK_OK(srtp_reader_dealloc(other));
+    }
+    for (size_t i = 0; i < 4; i++) {
+        free(plain[i]);
+        free(srtp[i]);
+    }
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    CHECK_OK(srtp_create(&srtp_receiver, receive_policy));
+    return srtp_err_status_ok;
+}
 
-    // unprotect zero byte input
-    rtp_len = buffer_len;
-    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, 0, &rtp_len),
-                 srtp_err_status_bad_param);
+/*
+ * srtp_test_reader() runs srtp_test_reader_profile() with counter mode
+ * and, where available, GCM
+ */
+srtp_err_status_t srtp_test_reader(void)
+{
+    CHECK_OK(srtp_test_reader_profile(srtp_profile_aes128_cm_sha1_80));
+#ifdef GCM
+    CHECK_OK(srtp_test_reader_profile(srtp_profile_aead_aes_128_gcm));
+#endif
 
-    // unprotect 1 byte input
-    rtp_len = buffer_len;
-    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, 1, &rtp_len),
-                 srtp_err_status_bad_param);
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_unprotect_headers_profile(profile, aead) checks that
+ * srtp_unprotect_headers() returns the decrypted header of a cryptex
+ * packet, rejects a forgery, and leaves the replay database alone unless
+ * asked to update it
+ */
+static srtp_err_status_t srtp_test_unprotect_headers_profile(
+    srtp_profile_t profile,
+    bool aead)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    const uint32_t ssrc = 0xcafebabe;
+    uint8_t *plain, *pkt;
+    size_t plain_len, hdr_len, srtp_len, len, buffer_len;
+    uint8_t out[128], forged[128];
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    plain = create_rtp_test_packet(64, ssrc, 1, 0, true, &plain_len, NULL);
+    hdr_len = plain_len - 64;
+    pkt = create_rtp_test_packet(64, ssrc, 1, 0, true, &len, &buffer_len);
+    CHECK_OK(srtp_protect(srtp_snd, pkt, len, pkt, &buffer_len, 0));
+    srtp_len = buffer_len;
+    CHECK(srtp_len <= sizeof(forged));
+
+    /* without the replay database the packet verifies every time */
+    for (size_t i = 0; i < 2; i++) {
+        len = sizeof(out);
+        CHECK_OK(srtp_unprotect_headers(srtp_recv, pkt, srtp_len, out, &len,
+                                        false));
+        CHECK(len == hdr_len);
+        CHECK_BUFFER_EQUAL(out, plain, hdr_len);
+    }
+
+    /* room for the header is enough unless GCM has to decrypt it all */
+    if (!aead) {
+        len = hdr_len;
+        CHECK_OK(srtp_unprotect_headers(srtp_recv, pkt, srtp_len, out, &len,
+                                        false));
+        len = hdr_len - 1;
+        CHECK_RETURN(srtp_unprotect_headers(srtp_recv, pkt, srtp_len, out,
+                                            &len, false),
+                     srtp_err_status_buffer_small);
+    }
 
-    // unprotect short header
-    rtp_len = buffer_len;
+    memcpy(forged, pkt, srtp_len);
+    forged[srtp_len - 1] ^= 0x01;
+    len = sizeof(out);
+    CHECK_RETURN(srtp_unprotect_headers(srtp_recv, forged, srtp_len, out, &len,
+                                        false),
+                 srtp_err_status_auth_fail);
+
+    /* with it, the packet is recorded as srtp_unprotect() would */
+    len = sizeof(out);
+    CHECK_OK(
+        srtp_unprotect_headers(srtp_recv, pkt, srtp_len, out, &len, true));
+    len = sizeof(out);
     CHECK_RETURN(
-        call_srtp_unprotect2(srtp_receiver, rtp, rtp_header_len - 1, &rtp_len),
-        srtp_err_status_bad_param);
+        srtp_unprotect_headers(srtp_recv, pkt, srtp_len, out, &len, true),
+        srtp_err_status_replay_fail);
+    len = sizeof(out);
+    CHECK_RETURN(srtp_unprotect(srtp_recv, pkt, srtp_len, out, &len),
+                 srtp_err_status_replay_fail);
 
-    // 0 byte output
-    rtp_len = 0;
-    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len),
-                 srtp_err_status_buffer_small);
+    free(plain);
+    free(pkt);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    // 1 byte output
-    rtp_len = 1;
-    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len),
-                 srtp_err_status_buffer_small);
+    return srtp_err_status_ok;
+}
 
-    // 1 byte too small output
-    rtp_len = srtp_len - trailer_len - 1;
-    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len),
-                 srtp_err_status_buffer_small);
+srtp_err_status_t srtp_test_unprotect_headers(void)
+{
+    CHECK_OK(srtp_test_unprotect_headers_profile(
+        srtp_profile_aes128_cm_sha1_80, false));
+#ifdef GCM
+    CHECK_OK(srtp_test_unprotect_headers_profile(srtp_profile_aead_aes_128_gcm,
+                                                 true));
+#endif
 
-    // full unprotect
-    rtp_len = buffer_len;
-    CHECK_OK(call_srtp_unprotect2(srtp_receiver, rtp, srtp_len, &rtp_len));
-    CHECK(rtp_len == srtp_len - trailer_len);
+    return srtp_err_status_ok;
+}
 
-    free(rtp);
+/*
+ * srtp_test_transcrypt() checks that a packet forwarded by
+ * srtp_transcrypt() is received by each subscriber as it was sent, with
+ * the SSRC and sequence number rewritten where asked for, that a target
+ * failing leaves no decrypted packet in its buffer, and that a packet
+ * failing verification is forwarded to none of them
+ */
+srtp_err_status_t srtp_test_transcrypt(void)
+{
+    srtp_t srtp_pub, srtp_sfu, srtp_out[2], srtp_sub[2], srtp_bad;
+    srtp_policy_t policy;
+    srtp_transcrypt_target_t targets[3];
+    uint8_t *pkt, *ref;
+    uint8_t out[3][128];
+    uint8_t zeros[128] = { 0 };
+    size_t len, buffer_len, sub_len;
+    const srtp_hdr_t *hdr;
 
-    CHECK_OK(srtp_dealloc(srtp_receiver));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_pub, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_sfu, policy));
+
+    /* each subscriber has keys of its own */
+    for (size_t i = 0; i < 2; i++) {
+        CHECK_OK(policy_set_key(policy, i == 0 ? test_key_2 : test_alt_key));
+        CHECK_OK(srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+        CHECK_OK(srtp_create(&srtp_out[i], policy));
+        CHECK_OK(srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+        CHECK_OK(srtp_create(&srtp_sub[i], policy));
+    }
 
-    srtp_policy_destroy(send_policy);
-    srtp_policy_destroy(receive_policy);
+    /* and a session without a stream for the packet fails to protect it */
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 0x9999 }));
+    CHECK_OK(srtp_create(&srtp_bad, policy));
+
+    ref = create_rtp_test_packet(64, 0x1111, 5, 0, false, &len, &buffer_len);
+    pkt = create_rtp_test_packet(64, 0x1111, 5, 0, false, &len, &buffer_len);
+    CHECK(ref != NULL && pkt != NULL);
+    CHECK_OK(srtp_protect(srtp_pub, pkt, len, pkt, &buffer_len, 0));
+
+    memset(targets, 0, sizeof(targets));
+    targets[0].session = srtp_out[0];
+    targets[0].out = out[0];
+    targets[0].out_len = sizeof(out[0]);
+    targets[1].session = srtp_out[1];
+    targets[1].rewrite = true;
+    targets[1].ssrc = 0x2222;
+    targets[1].seq = 7;
+    targets[1].out = out[1];
+    targets[1].out_len = sizeof(out[1]);
+    CHECK_OK(srtp_transcrypt(srtp_sfu, pkt, buffer_len, targets, 2));
+    CHECK_OK(targets[0].status);
+    CHECK_OK(targets[1].status);
+
+    sub_len = targets[0].out_len;
+    CHECK_OK(srtp_unprotect(srtp_sub[0], out[0], sub_len, out[0], &sub_len));
+    CHECK(sub_len == len);
+    CHECK_BUFFER_EQUAL(out[0], ref, len);
+
+    sub_len = targets[1].out_len;
+    CHECK_OK(srtp_unprotect(srtp_sub[1], out[1], sub_len, out[1], &sub_len));
+    CHECK(sub_len == len);
+    hdr = (const srtp_hdr_t *)out[1];
+    CHECK(hdr->ssrc == htonl(0x2222) && hdr->seq == htons(7));
+    CHECK_BUFFER_EQUAL(out[1] + 12, ref + 12, len - 12);
+
+    /* the buffer of a target in the middle that fails is wiped */
+    free(pkt);
+    pkt = create_rtp_test_packet(64, 0x1111, 6, 0, false, &len, &buffer_len);
+    CHECK(pkt != NULL);
+    CHECK_OK(srtp_protect(srtp_pub, pkt, len, pkt, &buffer_len, 0));
+
+    memset(targets, 0, sizeof(targets));
+    memset(out, 0xff, sizeof(out));
+    for (size_t i = 0; i < 3; i++) {
+        targets[i].out = out[i];
+        targets[i].out_len = sizeof(out[i]);
+    }
+    targets[0].session = srtp_out[0];
+    targets[1].session = srtp_bad;
+    targets[2].session = srtp_out[1];
+    CHECK_RETURN(srtp_transcrypt(srtp_sfu, pkt, buffer_len, targets, 3),
+                 srtp_err_status_no_ctx);
+    CHECK_OK(targets[0].status);
+    CHECK_RETURN(targets[1].status, srtp_err_status_no_ctx);
+    CHECK_OK(targets[2].status);
+    CHECK_BUFFER_EQUAL(out[1], zeros, len);
+
+    sub_len = targets[2].out_len;
+    CHECK_OK(srtp_unprotect(srtp_sub[1], out[2], sub_len, out[2], &sub_len));
+    CHECK(sub_len == len);
+    CHECK_BUFFER_EQUAL(out[2] + 12, ref + 12, len - 12);
+
+    /* a replay is forwarded to none of the subscribers */
+    targets[0].out_len = sizeof(out[0]);
+    targets[1].out_len = sizeof(out[1]);
+    CHECK_RETURN(srtp_transcrypt(srtp_sfu, pkt, buffer_len, targets, 2),
+                 srtp_err_status_replay_fail);
+    CHECK_RETURN(targets[0].status, srtp_err_status_replay_fail);
+    CHECK_RETURN(targets[1].status, srtp_err_status_replay_fail);
+
+    CHECK_RETURN(srtp_transcrypt(srtp_sfu, pkt, buffer_len, targets, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_transcrypt(NULL, pkt, buffer_len, targets, 2),
+                 srtp_err_status_bad_param);
+
+    free(pkt);
+    free(ref);
+    for (size_t i = 0; i < 2; i++) {
+        CHECK_OK(srtp_dealloc(srtp_out[i]));
+        CHECK_OK(srtp_dealloc(srtp_sub[i]));
+    }
+    CHECK_OK(srtp_dealloc(srtp_pub));
+    CHECK_OK(srtp_dealloc(srtp_sfu));
+    CHECK_OK(srtp_dealloc(srtp_bad));
+    srtp_policy_destroy(policy);
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtcp_test(const test_policy_t *policy,
-                             bool use_mki,
-                             size_t mki_index)
+/*
+ * srtp_test_double_profile(profile) sends a double encrypted packet from
+ * an endpoint through a media distributor that changes its header to
+ * another endpoint, and checks that the distributor can neither read nor
+ * change the end-to-end payload
+ */
+static srtp_err_status_t srtp_test_double_profile(srtp_profile_t profile)
 {
-    srtp_t srtcp_sender;
-    srtp_t srtcp_rcvr;
-    srtp_err_status_t status = srtp_err_status_ok;
-    uint8_t *hdr, *hdr2;
-    uint8_t hdr_enc[128];
-    size_t msg_len_octets, msg_len_enc, msg_len;
-    size_t len, len2;
-    size_t buffer_len;
-    size_t tag_length;
-    uint32_t ssrc;
-    srtp_policy_t send_policy;
-    srtp_policy_t rcvr_policy;
-
-    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
-
-    CHECK_OK(srtp_create(&srtcp_sender, send_policy));
+    /* the end-to-end keys, then those of the first and of the second hop */
+    const uint8_t *keys[3] = { test_key, test_key_2, test_alt_key };
+    srtp_t snd[3], rcv[3], srtp_check;
+    srtp_policy_t policy;
+    srtp_hop_header_t changes;
+    const uint32_t ssrc = 0xcafebabe;
+    uint8_t *ref;
+    uint8_t pkt[256], hop[256], check[256], inner[256];
+    size_t len, hdr_len, pkt_len, hop_len, check_len, inner_len;
+    const srtp_hdr_t *hdr;
 
-    /* print out policy */
-    CHECK_OK(srtp_session_print_policy(srtcp_sender));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    for (size_t i = 0; i < 3; i++) {
+        CHECK_OK(policy_set_key(policy, keys[i]));
+        CHECK_OK(srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+        CHECK_OK(srtp_create(&snd[i], policy));
+        CHECK_OK(srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+        CHECK_OK(srtp_create(&rcv[i], policy));
+    }
+    CHECK_OK(srtp_create(&srtp_check, policy));
+
+    ref = create_rtp_test_packet(64, ssrc, 5, 0, true, &len, NULL);
+    CHECK(ref != NULL);
+    hdr_len = len - 64;
+
+    pkt_len = sizeof(pkt);
+    CHECK_OK(srtp_protect_double(snd[0], snd[1], ref, len, pkt, &pkt_len, 0));
+    CHECK(memcmp(pkt + hdr_len, ref + hdr_len, 64) != 0);
+
+    /* the distributor sees the header extension but not the payload */
+    hop_len = sizeof(hop);
+    CHECK_OK(srtp_unprotect_hop(rcv[1], pkt, pkt_len, hop, &hop_len));
+    CHECK(hop[hop_len - 1] == 0);
+    CHECK_BUFFER_EQUAL(hop, ref, hdr_len);
+    CHECK(memcmp(hop + hdr_len, ref + hdr_len, 64) != 0);
+    inner_len = hop_len - hdr_len - 1;
+    memcpy(inner, hop + hdr_len, inner_len);
+
+    memset(&changes, 0, sizeof(changes));
+    changes.set_pt = true;
+    changes.pt = 99;
+    changes.set_seq = true;
+    changes.seq = 100;
+    changes.set_marker = true;
+    changes.marker = true;
+    pkt_len = sizeof(pkt);
+    CHECK_OK(srtp_protect_hop(snd[2], hop, hop_len, pkt, &pkt_len, 0,
+                              &changes));
+
+    /* the original values are recorded and the inner layer is untouched */
+    check_len = sizeof(check);
+    CHECK_OK(srtp_unprotect_hop(srtp_check, pkt, pkt_len, check, &check_len));
+    CHECK(check_len == hop_len + 3);
+    CHECK_BUFFER_EQUAL(check + hdr_len, inner, inner_len);
+    CHECK(check[check_len - 4] == 0xf);
+    CHECK(check[check_len - 3] == 0 && check[check_len - 2] == 5);
+    CHECK(check[check_len - 1] == 0x0b);
+
+    len = sizeof(check);
+    CHECK_OK(srtp_unprotect_double(rcv[0], rcv[2], pkt, pkt_len, check, &len));
+    CHECK(len == hdr_len + 64);
+    hdr = (const srtp_hdr_t *)check;
+    CHECK(hdr->pt == 99 && hdr->seq == htons(100) && hdr->m == 1);
+    CHECK_BUFFER_EQUAL(check + 4, ref + 4, len - 4);
+
+    /* a payload changed by the distributor fails the end-to-end check */
+    free(ref);
+    ref = create_rtp_test_packet(64, ssrc, 6, 0, true, &len, NULL);
+    CHECK(ref != NULL);
+    pkt_len = sizeof(pkt);
+    CHECK_OK(srtp_protect_double(snd[0], snd[1], ref, len, pkt, &pkt_len, 0));
+    hop_len = sizeof(hop);
+    CHECK_OK(srtp_unprotect_hop(rcv[1], pkt, pkt_len, hop, &hop_len));
+    hop[hdr_len] ^= 0x01;
+    changes.seq = 101;
+    pkt_len = sizeof(pkt);
+    CHECK_OK(srtp_protect_hop(snd[2], hop, hop_len, pkt, &pkt_len, 0,
+                              &changes));
+    len = sizeof(check);
+    CHECK_RETURN(
+        srtp_unprotect_double(rcv[0], rcv[2], pkt, pkt_len, check, &len),
+        srtp_err_status_auth_fail);
 
-    /*
-     * initialize data buffer, using the ssrc in the policy unless that
-     * value is a wildcard, in which case we'll just use an arbitrary
-     * one
-     */
-    if (policy->ssrc.type != ssrc_specific) {
-        ssrc = 0xdecafbad;
-    } else {
-        ssrc = policy->ssrc.value;
-    }
-    msg_len_octets = 28;
-    hdr = create_rtcp_test_packet(msg_len_octets, ssrc, &len, &buffer_len);
-    /* save message len */
-    msg_len = len;
+    /* an OHB with reserved bits set is refused */
+    hop[hop_len - 1] = 0x80;
+    pkt_len = sizeof(pkt);
+    CHECK_RETURN(
+        srtp_protect_hop(snd[2], hop, hop_len, pkt, &pkt_len, 0, NULL),
+        srtp_err_status_parse_err);
 
-    if (hdr == NULL) {
-        return srtp_err_status_alloc_fail;
-    }
-    hdr2 = create_rtcp_test_packet(msg_len_octets, ssrc, &len2, NULL);
-    if (hdr2 == NULL) {
-        free(hdr);
-        return srtp_err_status_alloc_fail;
+    free(ref);
+    for (size_t i = 0; i < 3; i++) {
+        CHECK_OK(srtp_dealloc(snd[i]));
+        CHECK_OK(srtp_dealloc(rcv[i]));
     }
+    CHECK_OK(srtp_dealloc(srtp_check));
+    srtp_policy_destroy(policy);
 
-    debug_print(mod_driver, "before protection:\n%s",
-                srtp_rtcp_packet_to_string(hdr, len));
+    return srtp_err_status_ok;
+}
 
-#if PRINT_REFERENCE_PACKET
-    debug_print(mod_driver, "reference packet before protection:\n%s",
-                octet_string_hex_string(hdr, len));
+srtp_err_status_t srtp_test_double(void)
+{
+    CHECK_OK(srtp_test_double_profile(srtp_profile_aes128_cm_sha1_80));
+#ifdef GCM
+    CHECK_OK(srtp_test_double_profile(srtp_profile_aead_aes_128_gcm));
 #endif
-    CHECK_OK(call_srtp_protect_rtcp(srtcp_sender, hdr, &len, mki_index));
 
-    debug_print(mod_driver, "after protection:\n%s",
-                srtp_rtcp_packet_to_string(hdr, len));
-#if PRINT_REFERENCE_PACKET
-    debug_print(mod_driver, "after protection:\n%s",
-                octet_string_hex_string(hdr, len));
-#endif
+    return srtp_err_status_ok;
+}
 
-    /* save protected message and length */
-    memcpy(hdr_enc, hdr, len);
-    msg_len_enc = len;
+/*
+ * srtp_test_keystream_cache() checks that packets protected with
+ * keystream computed ahead of time are those protected without it,
+ * whether or not the keystream covers them
+ */
+srtp_err_status_t srtp_test_keystream_cache(void)
+{
+    srtp_t srtp_cached, srtp_plain, srtp_recv;
+    srtp_policy_t policy;
+    const uint32_t ssrc = 0xcafebabe;
+    uint8_t *cached, *plain;
+    size_t cached_len, plain_len, len, payload_len;
 
-    /*
-     * check for overrun of the srtp_protect_rtcp() function
-     *
-     * The packet is followed by a value of 0xffffffff; if the value of the
-     * data following the packet is different, then we know that the
-     * protect function is overwriting the end of the packet.
-     */
-    srtp_get_protect_rtcp_trailer_length(srtcp_sender, mki_index, &tag_length);
-    CHECK_OVERRUN(hdr, msg_len + tag_length, buffer_len);
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_create(&srtp_cached, policy));
+    CHECK_OK(srtp_create(&srtp_plain, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    /*
-     * if the policy includes confidentiality, check that ciphertext is
-     * different than plaintext
-     *
-     * Note that this check will give false negatives, with some small
-     * probability, especially if the packets are short.  For that
-     * reason, we skip this check if the plaintext is less than four
-     * octets long.
-     */
-    if ((policy->rtcp_sec_serv & sec_serv_conf) && (msg_len_octets >= 4)) {
-        printf("testing that ciphertext is distinct from plaintext...");
-        status = srtp_err_status_algo_fail;
-        for (size_t i = 12; i < msg_len_octets + 12; i++) {
-            if (hdr[i] != hdr2[i]) {
-                status = srtp_err_status_ok;
-            }
-        }
-        if (status) {
-            printf("failed\n");
-            free(hdr);
-            free(hdr2);
-            return status;
+    CHECK_RETURN(srtp_stream_fill_keystream(srtp_cached, ssrc, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_stream_set_keystream_cache(srtp_cached, ssrc, 4, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_stream_set_keystream_cache(srtp_cached, ssrc + 1, 4, 64),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_stream_set_keystream_cache(srtp_cached, ssrc, 4, 64));
+
+    for (uint16_t seq = 1; seq <= 10; seq++) {
+        /* every third packet is too long for the keystream */
+        payload_len = seq % 3 == 0 ? 100 : 48;
+        if (seq % 2 == 1) {
+            CHECK_OK(srtp_stream_fill_keystream(srtp_cached, ssrc, 0));
         }
-        printf("passed\n");
-    }
 
-    CHECK_OK(srtp_policy_clone(send_policy, &rcvr_policy));
-    if (policy->ssrc.type == ssrc_any_outbound) {
-        CHECK_OK(srtp_policy_set_ssrc(rcvr_policy,
-                                      (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
-    }
+        cached = create_rtp_test_packet(payload_len, ssrc, seq, 0, false,
+                                        &len, &cached_len);
+        CHECK_OK(srtp_protect(srtp_cached, cached, len, cached, &cached_len,
+                              0));
+        plain = create_rtp_test_packet(payload_len, ssrc, seq, 0, false, &len,
+                                       &plain_len);
+        CHECK_OK(
+            srtp_protect(srtp_plain, plain, len, plain, &plain_len, 0));
+        CHECK(cached_len == plain_len);
+        CHECK_BUFFER_EQUAL(cached, plain, plain_len);
 
-    CHECK_OK(srtp_create(&srtcp_rcvr, rcvr_policy));
+        len = cached_len;
+        CHECK_OK(srtp_unprotect(srtp_recv, cached, cached_len, cached, &len));
 
-    CHECK_OK(call_srtp_unprotect_rtcp(srtcp_rcvr, hdr, &len));
+        free(cached);
+        free(plain);
+    }
 
-    debug_print(mod_driver, "after unprotection:\n%s",
-                srtp_rtcp_packet_to_string(hdr, len));
+    CHECK_OK(srtp_stream_set_keystream_cache(srtp_cached, ssrc, 0, 0));
+    CHECK_RETURN(srtp_stream_fill_keystream(srtp_cached, ssrc, 0),
+                 srtp_err_status_bad_param);
 
-    /* verify that the unprotected packet matches the original one */
-    for (size_t i = 0; i < len; i++) {
-        if (hdr[i] != hdr2[i]) {
-            fprintf(stdout, "mismatch at octet %zu\n", i);
-            status = srtp_err_status_algo_fail;
+    CHECK_OK(srtp_dealloc(srtp_cached));
+    CHECK_OK(srtp_dealloc(srtp_plain));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+
+    /* with cryptex the CSRCs take the keystream ahead of the payload */
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+    CHECK_OK(srtp_create(&srtp_cached, policy));
+    CHECK_OK(srtp_create(&srtp_plain, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    CHECK_OK(srtp_stream_set_keystream_cache(srtp_cached, ssrc, 2, 64));
+
+    for (uint16_t seq = 1; seq <= 4; seq++) {
+        uint8_t rtp[128];
+        uint8_t cached_pkt[128 + SRTP_MAX_TRAILER_LEN];
+        uint8_t plain_pkt[128 + SRTP_MAX_TRAILER_LEN];
+        const size_t rtp_len = 12 + 3 * 4 + 8 + 40;
+        uint32_t ssrc_net = htonl(ssrc);
+
+        /* three CSRCs, a one-byte header extension and the payload */
+        memset(rtp, 0xab, rtp_len);
+        rtp[0] = 0x93;
+        rtp[1] = 0x0f;
+        rtp[2] = (uint8_t)(seq >> 8);
+        rtp[3] = (uint8_t)seq;
+        memcpy(rtp + 8, &ssrc_net, 4);
+        rtp[24] = 0xbe;
+        rtp[25] = 0xde;
+        rtp[26] = 0x00;
+        rtp[27] = 0x01;
+
+        if (seq % 2 == 1) {
+            CHECK_OK(srtp_stream_fill_keystream(srtp_cached, ssrc, 0));
         }
-    }
-    if (status) {
-        free(hdr);
-        free(hdr2);
-        return status;
-    }
+        cached_len = sizeof(cached_pkt);
+        plain_len = sizeof(plain_pkt);
+        CHECK_OK(srtp_protect(srtp_cached, rtp, rtp_len, cached_pkt,
+                              &cached_len, 0));
+        CHECK_OK(srtp_protect(srtp_plain, rtp, rtp_len, plain_pkt,
+                              &plain_len, 0));
+        CHECK(cached_len == plain_len);
+        CHECK_BUFFER_EQUAL(cached_pkt, plain_pkt, plain_len);
+
+        len = cached_len;
+        CHECK_OK(srtp_unprotect(srtp_recv, cached_pkt, cached_len, cached_pkt,
+                                &len));
+        CHECK(len == rtp_len);
+        CHECK_BUFFER_EQUAL(cached_pkt, rtp, rtp_len);
+    }
+
+    CHECK_OK(srtp_dealloc(srtp_cached));
+    CHECK_OK(srtp_dealloc(srtp_plain));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    CHECK_OK(srtp_policy_set_cryptex(policy, false));
 
-    /*
-     * if the policy includes authentication, then test for false positives
-     */
-    if (policy->rtcp_sec_serv & sec_serv_auth) {
-        uint8_t *data = hdr + 12;
+#ifdef GCM
+    /* the keystream of GCM depends on the packet */
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aead_aes_128_gcm));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_create(&srtp_cached, policy));
+    CHECK_RETURN(srtp_stream_set_keystream_cache(srtp_cached, ssrc, 4, 64),
+                 srtp_err_status_no_such_op);
+    CHECK_OK(srtp_dealloc(srtp_cached));
+#endif
 
-        printf("testing for false positives in replay check...");
+    srtp_policy_destroy(policy);
 
-        /* unprotect a second time - should fail with a replay error */
-        status = call_srtp_unprotect_rtcp(srtcp_rcvr, hdr, &msg_len_enc);
-        if (status != srtp_err_status_replay_fail) {
-            printf("failed with error code %d\n", status);
-            free(hdr);
-            free(hdr2);
-            return srtp_err_status_algo_fail;
-        } else {
-            printf("passed\n");
-        }
+    return srtp_err_status_ok;
+}
 
-        printf("testing for false positives in auth check...");
+/*
+ * the offload engine of srtp_test_batch_offload() is a skeleton of a
+ * hardware backend: it keeps the batches it is given and completes them
+ * in reverse order when polled, as a device with several queues might
+ */
+#define OFFLOAD_TEST_NUM_BATCHES 4
 
-        /* apply protection */
-        CHECK_OK(call_srtp_protect_rtcp(srtcp_sender, hdr, &len, mki_index));
+typedef struct {
+    srtp_batch_t pending[OFFLOAD_TEST_NUM_BATCHES];
+    size_t num_pending;
+    bool refuse;
+} offload_test_engine_t;
 
-        /* flip bits in packet */
-        data[0] ^= 0xff;
+typedef struct {
+    srtp_batch_t done[OFFLOAD_TEST_NUM_BATCHES];
+    size_t num_done;
+} offload_test_completions_t;
 
-        /* unprotect, and check for authentication failure */
-        status = call_srtp_unprotect_rtcp(srtcp_rcvr, hdr, &len);
-        if (status != srtp_err_status_auth_fail) {
-            printf("failed with error code %d\n", status);
-            printf("failed\n");
-            free(hdr);
-            free(hdr2);
-            return srtp_err_status_algo_fail;
-        } else {
-            printf("passed\n");
-        }
+static srtp_err_status_t offload_test_submit(void *engine_data,
+                                             srtp_batch_t batch)
+{
+    offload_test_engine_t *engine = (offload_test_engine_t *)engine_data;
+
+    if (engine->refuse || engine->num_pending == OFFLOAD_TEST_NUM_BATCHES) {
+        return srtp_err_status_alloc_fail;
     }
+    engine->pending[engine->num_pending++] = batch;
+    return srtp_err_status_ok;
+}
 
-    CHECK_OK(srtp_dealloc(srtcp_sender));
-    CHECK_OK(srtp_dealloc(srtcp_rcvr));
+static size_t offload_test_poll(void *engine_data)
+{
+    offload_test_engine_t *engine = (offload_test_engine_t *)engine_data;
+    size_t num_run = engine->num_pending;
+
+    while (engine->num_pending > 0) {
+        srtp_batch_run(engine->pending[--engine->num_pending]);
+    }
+    return num_run;
+}
 
-    srtp_policy_destroy(send_policy);
-    srtp_policy_destroy(rcvr_policy);
+static void offload_test_done(srtp_batch_t batch, void *user_data)
+{
+    offload_test_completions_t *completions =
+        (offload_test_completions_t *)user_data;
 
-    free(hdr);
-    free(hdr2);
-    return srtp_err_status_ok;
+    completions->done[completions->num_done++] = batch;
 }
 
-srtp_err_status_t srtcp_test_io_lengths(const test_policy_t *policy,
-                                        bool use_mki,
-                                        size_t mki_index)
+/*
+ * srtp_test_batch_offload() checks that batches handed to an offload
+ * engine complete in submission order, whatever order the engine runs
+ * them in, and produce the same packets as srtp_protect()
+ */
+srtp_err_status_t srtp_test_batch_offload(void)
 {
-    srtp_t srtp_sender;
-    srtp_policy_t send_policy;
-    uint32_t ssrc;
-    uint8_t *rtcp;
-    size_t rtcp_len, buffer_len, srtcp_len;
-    size_t rtcp_header_len = 8;
+    const srtp_offload_engine_t engine = { offload_test_submit,
+                                           offload_test_poll };
+    offload_test_engine_t engine_data = { { NULL }, 0, false };
+    offload_test_completions_t completions = { { NULL }, 0 };
+    const uint32_t ssrc = 0xcafebabe;
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_batch_t batches[OFFLOAD_TEST_NUM_BATCHES];
+    srtp_batch_t batch;
+    uint8_t *ref[OFFLOAD_TEST_NUM_BATCHES];
+    uint8_t *pkt[OFFLOAD_TEST_NUM_BATCHES];
+    size_t ref_len[OFFLOAD_TEST_NUM_BATCHES];
+    size_t rtp_len[OFFLOAD_TEST_NUM_BATCHES];
+    srtp_packet_desc_t desc[OFFLOAD_TEST_NUM_BATCHES];
+    size_t buffer_len;
 
-    CHECK_OK(policy_from_test_policy(&send_policy, policy, use_mki));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_create(&srtp_ref, policy));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
 
-    CHECK_OK(srtp_create(&srtp_sender, send_policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    // get required trailer length
-    size_t trailer_len;
-    CHECK_OK(srtp_get_protect_rtcp_trailer_length(srtp_sender, mki_index,
-                                                  &trailer_len));
+    CHECK_RETURN(srtp_session_set_offload(NULL, &engine, &engine_data),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_session_set_offload(srtp_snd, &engine, &engine_data));
+    CHECK_OK(srtp_session_set_offload(srtp_recv, &engine, &engine_data));
+
+    /* one packet per batch, so each batch depends on the index before */
+    for (size_t i = 0; i < OFFLOAD_TEST_NUM_BATCHES; i++) {
+        ref[i] = create_rtp_test_packet(64, ssrc, (uint16_t)i, 0, false,
+                                        &ref_len[i], &buffer_len);
+        pkt[i] = create_rtp_test_packet(64, ssrc, (uint16_t)i, 0, false,
+                                        &rtp_len[i], &buffer_len);
+        CHECK_OK(srtp_protect(srtp_ref, ref[i], ref_len[i], ref[i],
+                              &buffer_len, 0));
+        ref_len[i] = buffer_len;
+
+        desc[i].in = pkt[i];
+        desc[i].in_len = rtp_len[i];
+        desc[i].out = pkt[i];
+        desc[i].out_len = rtp_len[i] + SRTP_MAX_TRAILER_LEN;
+        desc[i].mki_index = 0;
+        desc[i].status = srtp_err_status_fail;
+
+        CHECK_OK(srtp_batch_submit(srtp_snd, srtp_batch_protect, &desc[i], 1,
+                                   offload_test_done, &completions,
+                                   &batches[i]));
+    }
+
+    /* a refused batch is not queued */
+    engine_data.refuse = true;
+    CHECK_RETURN(srtp_batch_submit(srtp_snd, srtp_batch_protect, desc, 0,
+                                   NULL, NULL, &batch),
+                 srtp_err_status_alloc_fail);
+    engine_data.refuse = false;
+
+    CHECK_RETURN(srtp_batch_get_status(batches[0]),
+                 srtp_err_status_in_progress);
+    CHECK_RETURN(srtp_batch_dealloc(batches[0]), srtp_err_status_in_progress);
+    CHECK_RETURN(srtp_session_set_offload(srtp_snd, NULL, NULL),
+                 srtp_err_status_in_progress);
+    CHECK_RETURN(srtp_dealloc(srtp_snd), srtp_err_status_in_progress);
+
+    CHECK(srtp_session_poll(srtp_snd) == OFFLOAD_TEST_NUM_BATCHES);
+    CHECK(completions.num_done == OFFLOAD_TEST_NUM_BATCHES);
+    for (size_t i = 0; i < OFFLOAD_TEST_NUM_BATCHES; i++) {
+        CHECK(completions.done[i] == batches[i]);
+        CHECK_OK(srtp_batch_get_status(batches[i]));
+        CHECK_RETURN(srtp_batch_run(batches[i]), srtp_err_status_bad_param);
+        CHECK_OK(srtp_batch_dealloc(batches[i]));
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == ref_len[i]);
+        CHECK_BUFFER_EQUAL(pkt[i], ref[i], ref_len[i]);
+    }
+
+    /* all packets in one batch, after the receiver lost its engine */
+    CHECK_OK(srtp_session_set_offload(srtp_recv, NULL, NULL));
+    for (size_t i = 0; i < OFFLOAD_TEST_NUM_BATCHES; i++) {
+        desc[i].in_len = desc[i].out_len;
+        desc[i].status = srtp_err_status_fail;
+    }
+    CHECK_OK(srtp_batch_submit(srtp_recv, srtp_batch_unprotect, desc,
+                               OFFLOAD_TEST_NUM_BATCHES, NULL, NULL, &batch));
+    CHECK_OK(srtp_batch_get_status(batch));
+    CHECK_OK(srtp_batch_dealloc(batch));
+    for (size_t i = 0; i < OFFLOAD_TEST_NUM_BATCHES; i++) {
+        CHECK_OK(desc[i].status);
+        CHECK(desc[i].out_len == rtp_len[i]);
+        CHECK(pkt[i][12] == 0xab);
+    }
+    CHECK(srtp_session_poll(srtp_recv) == 0);
+
+    for (size_t i = 0; i < OFFLOAD_TEST_NUM_BATCHES; i++) {
+        free(ref[i]);
+        free(pkt[i]);
+    }
+
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    CHECK_OK(srtp_session_print_policy(srtp_sender));
+    return srtp_err_status_ok;
+}
 
-    if (policy->ssrc.type != ssrc_specific) {
-        ssrc = 0xdecafbad;
-    } else {
-        ssrc = policy->ssrc.value;
+static bool pending_key_wiped(const srtp_pending_keys_t *pending)
+{
+    for (size_t i = 0; i < sizeof(pending->master_key); i++) {
+        if (pending->master_key[i] != 0) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // 0 byte input
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = buffer_len;
-    overrun_check_prepare(rtcp, 0, buffer_len);
-    CHECK_RETURN(
-        call_srtp_protect_rtcp2(srtp_sender, rtcp, 0, &srtcp_len, mki_index),
-        srtp_err_status_bad_param);
-    CHECK_OVERRUN(rtcp, 0, buffer_len);
-    free(rtcp);
+/*
+ * srtp_test_lazy_keys() checks that the SRTCP and header extension keys
+ * of a stream are only derived once a packet needs them, or by
+ * srtp_session_gc(), and that the master key is wiped then
+ */
+srtp_err_status_t srtp_test_lazy_keys(void)
+{
+    const uint32_t ssrc = 0xcafebabe;
+    srtp_t srtp_snd, srtp_recv, srtp_gc;
+    srtp_policy_t policy;
+    srtp_stream_t stream;
+    uint8_t *rtp, *ref, *rtcp;
+    size_t rtp_len, ref_len, rtcp_len, len, buffer_len;
 
-    // 1 byte input
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = buffer_len;
-    overrun_check_prepare(rtcp, 1, buffer_len);
-    CHECK_RETURN(
-        call_srtp_protect_rtcp2(srtp_sender, rtcp, 1, &srtcp_len, mki_index),
-        srtp_err_status_bad_param);
-    CHECK_OVERRUN(rtcp, 1, buffer_len);
-    free(rtcp);
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(policy, 1));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    // too short header
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = buffer_len;
-    overrun_check_prepare(rtcp, rtcp_header_len - 1, buffer_len);
-    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_header_len - 1,
-                                         &srtcp_len, mki_index),
-                 srtp_err_status_bad_param);
-    CHECK_OVERRUN(rtcp, rtcp_header_len - 1, buffer_len);
-    free(rtcp);
+    stream = srtp_get_stream(srtp_snd, htonl(ssrc));
+    CHECK(stream != NULL);
+    CHECK(stream->session_keys[0].rtcp_pending);
+    CHECK(stream->session_keys[0].xtn_hdr_pending);
+
+    /* a packet without extensions leaves the extension keys pending */
+    rtp = create_rtp_test_packet(64, ssrc, 1, 0, false, &rtp_len, &buffer_len);
+    len = buffer_len;
+    CHECK_OK(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &len, 0));
+    CHECK(stream->session_keys[0].xtn_hdr_pending);
+    CHECK_OK(srtp_unprotect(srtp_recv, rtp, len, rtp, &len));
+    CHECK(len == rtp_len);
+    free(rtp);
 
-    // zero payload
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = buffer_len;
-    overrun_check_prepare(rtcp, rtcp_header_len, buffer_len);
-    CHECK_OK(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_header_len,
-                                     &srtcp_len, mki_index));
-    CHECK(srtcp_len == rtcp_header_len + trailer_len);
-    CHECK_OVERRUN(rtcp, srtcp_len, buffer_len);
-    free(rtcp);
+    rtp = create_rtp_test_packet(64, ssrc, 2, 0, true, &rtp_len, &buffer_len);
+    ref = create_rtp_test_packet(64, ssrc, 2, 0, true, &ref_len, NULL);
+    len = buffer_len;
+    CHECK_OK(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &len, 0));
+    CHECK(!stream->session_keys[0].xtn_hdr_pending);
+    CHECK(stream->session_keys[0].rtcp_pending);
+    CHECK(memcmp(rtp, ref, ref_len) != 0);
+    CHECK_OK(srtp_unprotect(srtp_recv, rtp, len, rtp, &len));
+    CHECK(len == ref_len);
+    CHECK_BUFFER_EQUAL(rtp, ref, ref_len);
+    free(rtp);
+    free(ref);
 
-    // 1 byte payload
     rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = buffer_len;
-    overrun_check_prepare(rtcp, rtcp_header_len + 1, buffer_len);
-    CHECK_OK(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_header_len + 1,
-                                     &srtcp_len, mki_index));
-    CHECK(srtcp_len == rtcp_header_len + 1 + trailer_len);
-    CHECK_OVERRUN(rtcp, srtcp_len, buffer_len);
+    len = buffer_len;
+    CHECK_OK(srtp_protect_rtcp(srtp_snd, rtcp, rtcp_len, rtcp, &len, 0));
+    CHECK(!stream->session_keys[0].rtcp_pending);
+    CHECK(pending_key_wiped(stream->session_keys[0].pending));
+    CHECK_OK(srtp_unprotect_rtcp(srtp_recv, rtcp, len, rtcp, &len));
+    CHECK(len == rtcp_len);
     free(rtcp);
 
-    // 0 byte output
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = 0;
-    overrun_check_prepare(rtcp, rtcp_len, buffer_len);
-    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
-                                         &srtcp_len, mki_index),
-                 srtp_err_status_buffer_small);
-    CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
-    free(rtcp);
+    /* without packets the keys are derived by the next collection */
+    CHECK_OK(srtp_create(&srtp_gc, policy));
+    stream = srtp_get_stream(srtp_gc, htonl(ssrc));
+    CHECK(stream != NULL);
+    CHECK(!pending_key_wiped(stream->session_keys[0].pending));
+    CHECK_OK(srtp_session_gc(srtp_gc));
+    CHECK(pending_key_wiped(stream->session_keys[0].pending));
+
+    rtp = create_rtp_test_packet(64, ssrc, 3, 0, true, &rtp_len, &buffer_len);
+    ref = create_rtp_test_packet(64, ssrc, 3, 0, true, &ref_len, NULL);
+    len = buffer_len;
+    CHECK_OK(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &len, 0));
+    CHECK_OK(srtp_unprotect(srtp_gc, rtp, len, rtp, &len));
+    CHECK(len == ref_len);
+    CHECK_BUFFER_EQUAL(rtp, ref, ref_len);
+    free(rtp);
+    free(ref);
 
-    // 1 byte output
     rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = 1;
-    overrun_check_prepare(rtcp, rtcp_len, buffer_len);
-    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
-                                         &srtcp_len, mki_index),
-                 srtp_err_status_buffer_small);
-    CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
+    len = buffer_len;
+    CHECK_OK(srtp_protect_rtcp(srtp_snd, rtcp, rtcp_len, rtcp, &len, 0));
+    CHECK_OK(srtp_unprotect_rtcp(srtp_gc, rtcp, len, rtcp, &len));
+    CHECK(len == rtcp_len);
     free(rtcp);
 
-    if (trailer_len != 0) {
-        // no space for trailer output
-        rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-        srtcp_len = rtcp_len;
-        overrun_check_prepare(rtcp, rtcp_len, buffer_len);
-        CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
-                                             &srtcp_len, mki_index),
-                     srtp_err_status_buffer_small);
-        CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
-        free(rtcp);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    CHECK_OK(srtp_dealloc(srtp_gc));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_sender_window() checks that streams of an outbound template
+ * get the small sender window whatever the policy window size, and that
+ * it still catches a repeated index
+ */
+srtp_err_status_t srtp_test_sender_window(void)
+{
+    const uint32_t ssrc = 0xcafebabe;
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stream_t stream;
+    uint8_t *rtp;
+    size_t rtp_len, len, buffer_len;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_window_size(policy, 1024));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    stream = srtp_get_stream(srtp_recv, htonl(ssrc));
+    CHECK(stream != NULL);
+    CHECK(stream->rtp_rdbx.window.length == 1024);
+
+    rtp = create_rtp_test_packet(64, ssrc, 1, 0, false, &rtp_len, &buffer_len);
+    len = buffer_len;
+    CHECK_OK(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &len, 0));
+    stream = srtp_get_stream(srtp_snd, htonl(ssrc));
+    CHECK(stream != NULL);
+    CHECK(stream->rtp_rdbx.window.length == SRTP_RDBX_SENDER_WINDOW_SIZE);
+    CHECK_OK(srtp_unprotect(srtp_recv, rtp, len, rtp, &len));
+    free(rtp);
+
+    /* a repeated index is refused */
+    rtp = create_rtp_test_packet(64, ssrc, 1, 0, false, &rtp_len, &buffer_len);
+    len = buffer_len;
+    CHECK_RETURN(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &len, 0),
+                 srtp_err_status_replay_fail);
+    free(rtp);
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_adaptive_window() checks that the streams cloned for an
+ * adaptive policy start with a small window that grows as packets arrive
+ * reordered further, so that they are accepted where the initial window
+ * would have refused them, while replays are still caught
+ */
+srtp_err_status_t srtp_test_adaptive_window(void)
+{
+    const uint32_t ssrc = 0xcafebabe;
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stream_t stream;
+    uint8_t *rtp, *buf, *held[2] = { NULL, NULL };
+    size_t rtp_len, len, buffer_len, held_len[2];
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_window_size(policy, 1024));
+    CHECK_OK(srtp_policy_set_adaptive_window(policy, true));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_exportable(srtp_recv, true));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    /* packets 10 and 150 are held back until 100 and 350 have arrived */
+    for (uint16_t seq = 1; seq <= 350; seq++) {
+        rtp = create_rtp_test_packet(64, ssrc, seq, 0, false, &rtp_len,
+                                     &buffer_len);
+        len = buffer_len;
+        CHECK_OK(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &len, 0));
+        if (seq == 10 || seq == 150) {
+            held[seq == 150] = rtp;
+            held_len[seq == 150] = len;
+            continue;
+        }
+        CHECK_OK(srtp_unprotect(srtp_recv, rtp, len, rtp, &len));
+        free(rtp);
+
+        stream = srtp_get_stream(srtp_recv, htonl(ssrc));
+        CHECK(stream != NULL);
+        if (seq == 100) {
+            CHECK(stream->rtp_rdbx.window.length ==
+                  SRTP_RDBX_ADAPTIVE_WINDOW_SIZE);
+            len = held_len[0];
+            CHECK_OK(srtp_unprotect(srtp_recv, held[0], len, held[0], &len));
+            CHECK(stream->rtp_rdbx.window.length ==
+                  2 * SRTP_RDBX_ADAPTIVE_WINDOW_SIZE);
+        }
     }
 
-    // 1 byte too small output
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = rtcp_len + trailer_len - 1;
-    overrun_check_prepare(rtcp, rtcp_len, buffer_len);
-    CHECK_RETURN(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len,
-                                         &srtcp_len, mki_index),
-                 srtp_err_status_buffer_small);
-    CHECK_OVERRUN(rtcp, rtcp_len, buffer_len);
-    free(rtcp);
+    /* 200 packets late, beyond the initial window */
+    stream = srtp_get_stream(srtp_recv, htonl(ssrc));
+    len = held_len[1];
+    memcpy(held[0], held[1], len);
+    CHECK_OK(srtp_unprotect(srtp_recv, held[1], len, held[1], &len));
+    CHECK(stream->rtp_rdbx.window.length ==
+          4 * SRTP_RDBX_ADAPTIVE_WINDOW_SIZE);
 
-    // full payload
-    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &buffer_len);
-    srtcp_len = buffer_len;
-    CHECK_OK(call_srtp_protect_rtcp2(srtp_sender, rtcp, rtcp_len, &srtcp_len,
-                                     mki_index));
-    CHECK(srtcp_len == rtcp_len + trailer_len);
-    CHECK_OVERRUN(rtcp, srtcp_len, buffer_len);
+    /* an import carries on with the grown window */
+    len = 0;
+    CHECK_RETURN(srtp_session_export(srtp_recv, NULL, 0, NULL, NULL, &len),
+                 srtp_err_status_buffer_small);
+    buf = (uint8_t *)malloc(len);
+    CHECK(buf != NULL);
+    CHECK_OK(srtp_session_export(srtp_recv, NULL, 0, NULL, buf, &len));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    CHECK_OK(srtp_session_import(&srtp_recv, buf, len, NULL, 0));
+    free(buf);
+    stream = srtp_get_stream(srtp_recv, htonl(ssrc));
+    CHECK(stream != NULL);
+    CHECK(stream->rtp_rdbx.window.length ==
+          4 * SRTP_RDBX_ADAPTIVE_WINDOW_SIZE);
+
+    /* and not twice */
+    len = held_len[1];
+    CHECK_RETURN(srtp_unprotect(srtp_recv, held[0], len, held[0], &len),
+                 srtp_err_status_replay_fail);
+    free(held[0]);
+    free(held[1]);
 
-    CHECK_OK(srtp_dealloc(srtp_sender));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    // unprotect
-    srtp_t srtp_receiver;
-    srtp_policy_t receive_policy;
+    return srtp_err_status_ok;
+}
 
-    CHECK_OK(srtp_policy_clone(send_policy, &receive_policy));
-    CHECK_OK(srtp_policy_set_ssrc(receive_policy,
-                                  (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+/*
+ * srtp_test_session_export() checks that a session imported from an
+ * export carries on with the keys, replay databases and counters of the
+ * exported session, and that a wrapped export needs its key
+ */
+srtp_err_status_t srtp_test_session_export(void)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stream_stats_t stats;
+    const uint32_t ssrc = 0xcafebabe;
+    uint8_t *rtp, *rtcp, *replayed, *buf;
+    size_t rtp_len, rtcp_len, len, buffer_len, replayed_len;
+    const uint8_t wrap_key[SRTP_AES_128_KEY_LEN] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+    const uint8_t nonce[SRTP_SESSION_EXPORT_NONCE_LEN] = { 1 };
 
-    CHECK_OK(srtp_create(&srtp_receiver, receive_policy));
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
 
-    // unprotect zero byte input
-    rtcp_len = buffer_len;
-    CHECK_RETURN(call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, 0, &rtcp_len),
+    /* a session that is not exportable keeps no policies */
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    len = 0;
+    CHECK_RETURN(srtp_session_export(srtp_snd, NULL, 0, NULL, NULL, &len),
                  srtp_err_status_bad_param);
-
-    // unprotect 1 byte input
-    rtcp_len = buffer_len;
-    CHECK_RETURN(call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, 1, &rtcp_len),
+    CHECK_RETURN(srtp_set_exportable(srtp_snd, true),
                  srtp_err_status_bad_param);
+    CHECK_OK(srtp_dealloc(srtp_snd));
 
-    // unprotect short header
-    rtcp_len = buffer_len;
-    CHECK_RETURN(call_srtp_unprotect_rtcp2(srtp_receiver, rtcp,
-                                           rtcp_header_len - 1, &rtcp_len),
-                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_create(&srtp_snd, NULL));
+    CHECK_OK(srtp_set_exportable(srtp_snd, true));
+    CHECK_OK(srtp_stream_add(srtp_snd, policy));
 
-    // 0 byte output
-    rtcp_len = 0;
-    CHECK_RETURN(
-        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len),
-        srtp_err_status_buffer_small);
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_exportable(srtp_recv, true));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    for (uint16_t seq = 1; seq <= 3; seq++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, seq));
+    }
 
-    // 1 byte output
-    rtcp_len = 1;
-    CHECK_RETURN(
-        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len),
-        srtp_err_status_buffer_small);
+    /* keep an SRTP and an SRTCP packet to replay after the import */
+    rtp = create_rtp_test_packet(64, ssrc, 4, 0, false, &rtp_len, &buffer_len);
+    CHECK_OK(srtp_protect(srtp_snd, rtp, rtp_len, rtp, &buffer_len, 0));
+    rtp_len = buffer_len;
+    replayed = (uint8_t *)malloc(rtp_len);
+    CHECK(replayed != NULL);
+    memcpy(replayed, rtp, rtp_len);
+    replayed_len = rtp_len;
+    CHECK_OK(srtp_unprotect(srtp_recv, rtp, rtp_len, rtp, &rtp_len));
+    free(rtp);
 
-    // 1 byte too small output
-    rtcp_len = srtcp_len - trailer_len - 1;
+    rtcp = create_rtcp_test_packet(64, ssrc, &rtcp_len, &buffer_len);
+    CHECK_OK(srtp_protect_rtcp(srtp_snd, rtcp, rtcp_len, rtcp, &buffer_len, 0));
+    rtcp_len = buffer_len;
+    rtp = (uint8_t *)malloc(rtcp_len);
+    CHECK(rtp != NULL);
+    memcpy(rtp, rtcp, rtcp_len);
+    len = rtcp_len;
+    CHECK_OK(srtp_unprotect_rtcp(srtp_recv, rtcp, rtcp_len, rtcp, &len));
+
+    /* the length needed is returned for a buffer that is too small */
+    len = 0;
+    CHECK_RETURN(srtp_session_export(srtp_recv, NULL, 0, NULL, NULL, &len),
+                 srtp_err_status_buffer_small);
+    buf = (uint8_t *)malloc(len);
+    CHECK(buf != NULL);
+    buffer_len = len - 1;
     CHECK_RETURN(
-        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len),
+        srtp_session_export(srtp_recv, NULL, 0, NULL, buf, &buffer_len),
         srtp_err_status_buffer_small);
+    CHECK(buffer_len == len);
+    CHECK_OK(srtp_session_export(srtp_recv, NULL, 0, NULL, buf, &len));
+    CHECK_OK(srtp_dealloc(srtp_recv));
 
-    // full unprotect
-    rtcp_len = buffer_len;
-    CHECK_OK(
-        call_srtp_unprotect_rtcp2(srtp_receiver, rtcp, srtcp_len, &rtcp_len));
-    CHECK(rtcp_len == srtcp_len - trailer_len);
-
+    CHECK_RETURN(srtp_session_import(&srtp_recv, buf, len - 1, NULL, 0),
+                 srtp_err_status_parse_err);
+    CHECK_OK(srtp_session_import(&srtp_recv, buf, len, NULL, 0));
+    free(buf);
+
+    /* the imported receiver rejects what the exported one accepted */
+    CHECK_RETURN(srtp_unprotect(srtp_recv, replayed, replayed_len, replayed,
+                                &replayed_len),
+                 srtp_err_status_replay_fail);
+    len = rtcp_len;
+    CHECK_RETURN(srtp_unprotect_rtcp(srtp_recv, rtp, rtcp_len, rtp, &len),
+                 srtp_err_status_replay_fail);
+    CHECK_OK(srtp_stream_get_stats(srtp_recv, ssrc, &stats));
+    CHECK(stats.rtp_packets_unprotected == 4);
+    CHECK(stats.rtcp_packets_unprotected == 1);
+    CHECK(stats.replay_fail == 2);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 5));
+    free(replayed);
+    free(rtp);
     free(rtcp);
 
-    CHECK_OK(srtp_dealloc(srtp_receiver));
+#ifdef GCM
+    srtp_t imported;
 
-    srtp_policy_destroy(send_policy);
-    srtp_policy_destroy(receive_policy);
+    /* a wrapped export can only be imported with its key */
+    len = 0;
+    CHECK_RETURN(srtp_session_export(srtp_snd, wrap_key, sizeof(wrap_key),
+                                     nonce, NULL, &len),
+                 srtp_err_status_buffer_small);
+    buf = (uint8_t *)malloc(len);
+    CHECK(buf != NULL);
+    CHECK_OK(srtp_session_export(srtp_snd, wrap_key, sizeof(wrap_key), nonce,
+                                 buf, &len));
+    CHECK_RETURN(srtp_session_import(&imported, buf, len, NULL, 0),
+                 srtp_err_status_bad_param);
+    buf[len - 1] ^= 1;
+    CHECK_RETURN(srtp_session_import(&imported, buf, len, wrap_key,
+                                     sizeof(wrap_key)),
+                 srtp_err_status_auth_fail);
+    buf[len - 1] ^= 1;
+    CHECK_OK(srtp_session_import(&imported, buf, len, wrap_key,
+                                 sizeof(wrap_key)));
+    free(buf);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    srtp_snd = imported;
+
+    /* the imported sender does not reuse the exported one's indices */
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 5),
+                 srtp_err_status_replay_fail);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 6));
+#else
+    /* wrapping an export needs AES-GCM */
+    len = 0;
+    CHECK_RETURN(srtp_session_export(srtp_snd, wrap_key, sizeof(wrap_key),
+                                     nonce, NULL, &len),
+                 srtp_err_status_no_such_op);
+#endif
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
     return srtp_err_status_ok;
 }
 
-struct srtp_session_print_stream_data {
-    // set by callback to indicate failure
-    srtp_err_status_t status;
-    // indicates if it is the template stream or a regular stream
-    int is_template;
-};
-
-bool srtp_session_print_stream(srtp_stream_t stream, void *raw_data)
+/*
+ * srtp_test_prepare_commit() checks that streams prepared outside of a
+ * session work once committed, and that updating a thread safe session
+ * with keys derived before it is locked rekeys its streams
+ */
+srtp_err_status_t srtp_test_prepare_commit(void)
 {
-    static const char *serv_descr[4] = { "none", "confidentiality",
-                                         "authentication",
-                                         "confidentiality and authentication" };
-    static const char *direction[3] = { "unknown", "outbound", "inbound" };
-
-    struct srtp_session_print_stream_data *data =
-        (struct srtp_session_print_stream_data *)raw_data;
-    srtp_session_keys_t *session_keys = &stream->session_keys[0];
-    char ssrc_text[32];
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_prepared_stream_t prepared;
 
-    if (!data->is_template && stream->rtp_services > sec_serv_conf_and_auth) {
-        data->status = srtp_err_status_bad_param;
-        return false;
-    }
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
-    if (data->is_template) {
-        snprintf(ssrc_text, sizeof(ssrc_text), "any %s",
-                 direction[stream->direction]);
-    } else {
-        snprintf(ssrc_text, sizeof(ssrc_text), "0x%08x", stream->ssrc);
-    }
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
 
-    printf("# SSRC:          %s\r\n"
-           "# rtp cipher:    %s\r\n"
-           "# rtp auth:      %s\r\n"
-           "# rtp services:  %s\r\n"
-           "# rtcp cipher:   %s\r\n"
-           "# rtcp auth:     %s\r\n"
-           "# rtcp services: %s\r\n"
-           "# num keys:      %zu\r\n"
-           "# use mki:       %s\r\n"
-           "# mki size:      %zu\r\n"
-           "# window size:   %zu\r\n"
-           "# tx rtx allowed:%s\r\n",
-           ssrc_text, session_keys->rtp_cipher->type->description,
-           session_keys->rtp_auth->type->description,
-           serv_descr[stream->rtp_services],
-           session_keys->rtcp_cipher->type->description,
-           session_keys->rtcp_auth->type->description,
-           serv_descr[stream->rtcp_services], stream->num_master_keys,
-           stream->use_mki ? "true" : "false", stream->mki_size,
-           srtp_rdbx_get_window_size(&stream->rtp_rdbx),
-           stream->allow_repeat_tx ? "true" : "false");
+    CHECK_RETURN(srtp_stream_prepare(NULL, &prepared),
+                 srtp_err_status_bad_param);
+    CHECK(prepared == NULL);
 
-    printf("# Encrypted extension headers: ");
-    if (stream->enc_xtn_hdr && stream->enc_xtn_hdr_count > 0) {
-        uint8_t *enc_xtn_hdr = stream->enc_xtn_hdr;
-        size_t count = stream->enc_xtn_hdr_count;
-        while (count > 0) {
-            printf("%d ", *enc_xtn_hdr);
-            enc_xtn_hdr++;
-            count--;
-        }
-        printf("\n");
-    } else {
-        printf("none\n");
-    }
+    CHECK_OK(srtp_create(&srtp_snd, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_snd, true));
+    CHECK_OK(srtp_stream_prepare(policy, &prepared));
+    CHECK_OK(srtp_stream_commit(srtp_snd, prepared));
 
-    return true;
-}
+    /* a session has a single template */
+    CHECK_OK(srtp_stream_prepare(policy, &prepared));
+    CHECK_RETURN(srtp_stream_commit(srtp_snd, prepared),
+                 srtp_err_status_bad_param);
 
-srtp_err_status_t srtp_session_print_policy(srtp_t srtp)
-{
-    struct srtp_session_print_stream_data data = { srtp_err_status_ok, 0 };
+    /* a prepared stream that is not needed is simply deallocated */
+    CHECK_OK(srtp_stream_prepare(policy, &prepared));
+    srtp_prepared_stream_dealloc(prepared);
 
-    /* sanity checking */
-    if (srtp == NULL) {
-        return srtp_err_status_fail;
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_recv, true));
+    for (uint32_t ssrc = 1; ssrc <= 2; ssrc++) {
+        CHECK_OK(
+            srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+        CHECK_OK(srtp_stream_prepare(policy, &prepared));
+        CHECK_OK(srtp_stream_commit(srtp_recv, prepared));
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 0));
     }
-
-    /* if there's a template stream, print it out */
-    if (srtp->stream_template != NULL) {
-        data.is_template = 1;
-        srtp_session_print_stream(srtp->stream_template, &data);
+    /* committed streams share cached keys where they can be cloned */
+    if (srtp_stream_keys_can_clone(srtp_get_stream(srtp_recv, htonl(1)))) {
+        CHECK(srtp_get_stream(srtp_recv, htonl(1))->key_entry != NULL);
+        CHECK(srtp_get_stream(srtp_recv, htonl(1))->key_entry ==
+              srtp_get_stream(srtp_recv, htonl(2))->key_entry);
     }
 
-    /* loop over streams in session, printing the policy of each */
-    data.is_template = 0;
-    srtp_stream_list_for_each(srtp->stream_list, srtp_session_print_stream,
-                              &data);
+    /* rekey the sender and one of the receiving streams */
+    CHECK_OK(policy_set_key(policy, test_alt_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_update(srtp_snd, policy));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_stream_update(srtp_recv, policy));
 
-    return data.status;
-}
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 1));
+    CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 1),
+                 srtp_err_status_auth_fail);
 
-srtp_err_status_t srtp_print_policy(const test_policy_t *test_policy)
-{
-    srtp_err_status_t status;
-    srtp_policy_t policy;
-    srtp_t session;
-    CHECK_OK(policy_from_test_policy(&policy, test_policy, false));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    status = srtp_create(&session, policy);
-    if (status) {
-        return status;
-    }
-    status = srtp_session_print_policy(session);
-    if (status) {
-        return status;
-    }
-    status = srtp_dealloc(session);
-    if (status) {
-        return status;
-    }
     return srtp_err_status_ok;
 }
 
 /*
- * srtp_print_packet(...) is for debugging only
- * it prints an RTP packet to the stdout
- *
- * note that this function is *not* threadsafe
+ * srtp_test_stream_add_many_session(srtp_snd, thread_safe) checks adding
+ * and removing many streams at once to a receiving session
  */
+static srtp_err_status_t srtp_test_stream_add_many_session(srtp_t srtp_snd,
+                                                           bool thread_safe)
+{
+    enum { num_streams = 100 };
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
+    srtp_policy_t policies[num_streams + 1];
+    uint32_t ssrcs[num_streams + 1];
+    srtp_alloc_stats_t before, after;
+    srtp_t srtp_recv;
+
+    for (size_t i = 0; i <= num_streams; i++) {
+        ssrcs[i] = (uint32_t)i + 1;
+        CHECK_OK(srtp_policy_create(&policies[i]));
+        CHECK_OK(srtp_policy_set_profile(policies[i],
+                                         srtp_profile_aes128_cm_sha1_80));
+        CHECK_OK(srtp_policy_set_ssrc(
+            policies[i], (srtp_ssrc_t){ ssrc_specific, ssrcs[i] }));
+        if (i < num_streams) {
+            CHECK_OK(policy_set_key(policies[i], test_key));
+        }
+    }
 
-#include <stdio.h>
-
-#define MTU 2048
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_recv, thread_safe));
 
-char packet_string[MTU];
+    /* a policy without keys fails the whole call up front */
+    CHECK_OK(srtp_get_alloc_stats(&before));
+    CHECK_RETURN(srtp_stream_add_many(srtp_recv, policies, num_streams + 1),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_get_alloc_stats(&after));
+    CHECK(after.live_allocations == before.live_allocations);
+    CHECK(srtp_get_stream(srtp_recv, htonl(1)) == NULL);
 
-char *srtp_packet_to_string(uint8_t *packet, size_t pkt_octet_len)
-{
-    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
-    size_t octets_in_rtp_header = 12;
-    uint8_t *data = packet + octets_in_rtp_header;
-    size_t data_len = pkt_octet_len - octets_in_rtp_header;
+    CHECK_RETURN(srtp_stream_add_many(srtp_recv, NULL, 1),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_stream_add_many(srtp_recv, NULL, 0));
 
-    /* sanity checking */
-    if ((hdr == NULL) || (pkt_octet_len > MTU)) {
-        return NULL;
+    CHECK_OK(srtp_stream_add_many(srtp_recv, policies, num_streams));
+    for (size_t i = 0; i < num_streams; i += 33) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrcs[i],
+                                            (uint16_t)(thread_safe ? 1 : 0)));
     }
 
-    /* write packet into string */
-    int offset = snprintf(packet_string, sizeof(packet_string),
-                          "(s)rtp packet: {\n"
-                          "   version:\t%d\n"
-                          "   p:\t\t%d\n"
-                          "   x:\t\t%d\n"
-                          "   cc:\t\t%d\n"
-                          "   m:\t\t%d\n"
-                          "   pt:\t\t%x\n"
-                          "   seq:\t\t%x\n"
-                          "   ts:\t\t%x\n"
-                          "   ssrc:\t%x",
-                          hdr->version, hdr->p, hdr->x, hdr->cc, hdr->m,
-                          hdr->pt, hdr->seq, hdr->ts, hdr->ssrc);
-
-    if (hdr->cc) {
-        offset += snprintf(packet_string + offset,
-                           sizeof(packet_string) - offset, "\n   csrc:\t");
-        for (int i = 0; i < hdr->cc; i++) {
-            offset +=
-                snprintf(packet_string + offset, sizeof(packet_string) - offset,
-                         "%x ", *((&hdr->ssrc) + 1 + i));
-        }
-        data += 4 * hdr->cc;
-        data_len -= 4 * hdr->cc;
+    /* all streams are removed even though the last SSRC has none */
+    CHECK_RETURN(srtp_stream_remove_many(srtp_recv, ssrcs, num_streams + 1),
+                 srtp_err_status_no_ctx);
+    for (size_t i = 0; i < num_streams; i++) {
+        CHECK(srtp_get_stream(srtp_recv, htonl(ssrcs[i])) == NULL);
     }
+    CHECK_RETURN(srtp_stream_remove_many(srtp_recv, NULL, 1),
+                 srtp_err_status_bad_param);
 
-    if (hdr->x) {
-        uint16_t profile = *((uint16_t *)data);
-        data += 2;
-        data_len -= 2;
-        uint16_t length = ntohs(*((uint16_t *)data)) * 4;
-        data += 2;
-        data_len -= 2;
-        offset += snprintf(packet_string + offset,
-                           sizeof(packet_string) - offset, "\n   xtn:\t\t%x %s",
-                           profile, octet_string_hex_string(data, length));
-        data += length;
-        data_len -= length;
-    }
+    /* the session takes new streams after being emptied */
+    CHECK_OK(srtp_stream_add_many(srtp_recv, policies, 2));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrcs[1],
+                                        (uint16_t)(thread_safe ? 3 : 2)));
 
-    snprintf(packet_string + offset, sizeof(packet_string) - offset,
-             "\n   data:\t%s\n"
-             "} (%zu octets in total)\n",
-             octet_string_hex_string(data, data_len), pkt_octet_len);
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    for (size_t i = 0; i <= num_streams; i++) {
+        srtp_policy_destroy(policies[i]);
+    }
 
-    return packet_string;
+    return srtp_err_status_ok;
 }
 
-char *srtp_rtcp_packet_to_string(uint8_t *packet, size_t pkt_octet_len)
+/*
+ * srtp_test_stream_add_many() checks srtp_stream_add_many() and
+ * srtp_stream_remove_many() with and without a thread safe session
+ */
+srtp_err_status_t srtp_test_stream_add_many(void)
 {
-    srtcp_hdr_t *hdr = (srtcp_hdr_t *)packet;
-    size_t octets_in_rtcp_header = 8;
-    uint8_t *data = packet + octets_in_rtcp_header;
-    size_t hex_len = pkt_octet_len - octets_in_rtcp_header;
-
-    /* sanity checking */
-    if ((hdr == NULL) || (pkt_octet_len > MTU)) {
-        return NULL;
-    }
+    srtp_t srtp_snd;
+    srtp_policy_t policy;
 
-    /* write packet into string */
-    snprintf(packet_string, sizeof(packet_string),
-             "(s)rtcp packet: {\n"
-             "   version:\t%d\n"
-             "   p:\t\t%d\n"
-             "   rc:\t\t%d\n"
-             "   pt:\t\t%x\n"
-             "   len:\t\t%x\n"
-             "   ssrc:\t%x\n"
-             "   data:\t%s\n"
-             "} (%zu octets in total)\n",
-             hdr->version, hdr->p, hdr->rc, hdr->pt, hdr->len, hdr->ssrc,
-             octet_string_hex_string(data, hex_len), pkt_octet_len);
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    srtp_policy_destroy(policy);
 
-    return packet_string;
+    CHECK_OK(srtp_test_stream_add_many_session(srtp_snd, false));
+    CHECK_OK(srtp_test_stream_add_many_session(srtp_snd, true));
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+
+    return srtp_err_status_ok;
 }
 
 /*
- * mips_estimate() is a simple function to estimate the number of
- * instructions per second that the host can perform.  note that this
- * function can be grossly wrong; you may want to have a manual sanity
- * check of its output!
- *
- * the 'ignore' pointer is there to convince the compiler to not just
- * optimize away the function
+ * srtp_test_dealloc_deferred() checks that sessions with many streams,
+ * explicit and cloned from the template, are deallocated completely by
+ * srtp_dealloc() and by srtp_reclaim() after srtp_dealloc_deferred()
  */
-
-double mips_estimate(size_t num_trials, size_t *ignore)
+srtp_err_status_t srtp_test_dealloc_deferred(void)
 {
-    clock_t t;
-    volatile size_t sum;
+    enum { num_streams = 300 };
+    srtp_policy_t policies[num_streams];
+    srtp_alloc_stats_t before, after;
+    srtp_t srtp_snd, srtp_recv;
+    srtp_retired_t retired = NULL;
 
-    sum = 0;
-    t = clock();
-    for (size_t i = 0; i < num_trials; i++) {
-        sum += i;
+    CHECK_OK(srtp_get_alloc_stats(&before));
+
+    for (size_t i = 0; i < num_streams; i++) {
+        CHECK_OK(srtp_policy_create(&policies[i]));
+        CHECK_OK(srtp_policy_set_profile(policies[i],
+                                         srtp_profile_aes128_cm_sha1_80));
+        CHECK_OK(policy_set_key(policies[i], i % 2 ? test_key : test_alt_key));
+        CHECK_OK(srtp_policy_set_ssrc(
+            policies[i],
+            (srtp_ssrc_t){ i == 0 ? ssrc_any_outbound : ssrc_specific,
+                           (uint32_t)i + 1 }));
     }
-    t = clock() - t;
-    if (t < 1) {
-        t = 1;
+
+    for (int deferred = 0; deferred < 2; deferred++) {
+        CHECK_OK(srtp_create(&srtp_snd, NULL));
+        CHECK_OK(srtp_set_thread_safe(srtp_snd, deferred != 0));
+        CHECK_OK(srtp_stream_add(srtp_snd, policies[0]));
+        CHECK_OK(
+            srtp_stream_add_many(srtp_snd, policies + 1, num_streams - 1));
+
+        /* a packet for an explicit stream and one for a clone */
+        CHECK_OK(srtp_create(&srtp_recv, NULL));
+        CHECK_OK(srtp_stream_add(srtp_recv, policies[1]));
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 0));
+        CHECK_RETURN(srtp_test_send_and_receive(srtp_snd, srtp_recv,
+                                                num_streams + 1, 0),
+                     srtp_err_status_no_ctx);
+        CHECK_OK(srtp_dealloc(srtp_recv));
+
+        if (deferred) {
+            CHECK_RETURN(srtp_dealloc_deferred(srtp_snd, NULL),
+                         srtp_err_status_bad_param);
+            CHECK_OK(srtp_dealloc_deferred(srtp_snd, &retired));
+            CHECK(retired != NULL);
+            CHECK_OK(srtp_reclaim(retired));
+        } else {
+            CHECK_OK(srtp_dealloc(srtp_snd));
+        }
     }
+    CHECK_OK(srtp_reclaim(NULL));
 
-    /*   printf("%d\n", sum); */
-    *ignore = sum;
+    for (size_t i = 0; i < num_streams; i++) {
+        srtp_policy_destroy(policies[i]);
+    }
 
-    return (double)num_trials * CLOCKS_PER_SEC / t;
+    CHECK_OK(srtp_get_alloc_stats(&after));
+    CHECK(after.live_allocations == before.live_allocations);
+    CHECK(after.live_bytes == before.live_bytes);
+
+    return srtp_err_status_ok;
 }
 
 /*
- * srtp_validate() verifies the correctness of libsrtp by comparing
- * some computed packets against some pre-computed reference values.
- * These packets were made with the default SRTP policy.
+ * srtp_test_event_queue() checks that the events of a session with an
+ * event queue are queued once per stream until polled, and that events
+ * lost to a full queue are reported
  */
-
-srtp_err_status_t srtp_validate(void)
+srtp_err_status_t srtp_test_event_queue(void)
 {
-    // clang-format off
-    uint8_t srtp_plaintext_ref[28] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab
-    };
-    uint8_t srtp_plaintext[38] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
-    uint8_t srtp_ciphertext[38] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0x4e, 0x55, 0xdc, 0x4c,
-        0xe7, 0x99, 0x78, 0xd8, 0x8c, 0xa4, 0xd2, 0x15,
-        0x94, 0x9d, 0x24, 0x02, 0xb7, 0x8d, 0x6a, 0xcc,
-        0x99, 0xea, 0x17, 0x9b, 0x8d, 0xbb
-    };
-    uint8_t rtcp_plaintext_ref[24] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-    };
-    uint8_t rtcp_plaintext[38] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
-    uint8_t srtcp_ciphertext[38] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0x71, 0x28, 0x03, 0x5b, 0xe4, 0x87, 0xb9, 0xbd,
-        0xbe, 0xf8, 0x90, 0x41, 0xf9, 0x77, 0xa5, 0xa8,
-        0x80, 0x00, 0x00, 0x01, 0x99, 0x3e, 0x08, 0xcd,
-        0x54, 0xd6, 0xc1, 0x23, 0x07, 0x98
-    };
-    // clang-format on
-
-    srtp_t srtp_snd, srtp_recv;
-    srtp_err_status_t status;
-    size_t len;
+    srtp_t srtp_a, srtp_b;
     srtp_policy_t policy;
+    srtp_event_data_t events[8];
+    size_t num_events;
 
-    /*
-     * create a session with a single stream using the default srtp
-     * policy and with the SSRC value 0xcafebabe
-     */
     CHECK_OK(srtp_policy_create(&policy));
     CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
     CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_a, policy));
+    CHECK_OK(srtp_create(&srtp_b, policy));
+    srtp_policy_destroy(policy);
 
-    status = srtp_create(&srtp_snd, policy);
-    if (status) {
-        return status;
-    }
+    CHECK_RETURN(srtp_session_poll_events(srtp_a, events, 8, &num_events),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_session_set_event_queue(srtp_a, 3));
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 8, &num_events));
+    CHECK(num_events == 0);
 
     /*
-     * protect plaintext, then compare with ciphertext
+     * a stream of a that sends and also receives what b sends with the
+     * same SSRC and keys reports a collision for every packet received
      */
-    len = 28;
-    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
-    if (status || (len != 38)) {
-        return srtp_err_status_fail;
-    }
+    for (uint32_t ssrc = 1; ssrc <= 6; ssrc++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_a, srtp_b, ssrc, 0));
+    }
+    for (uint16_t seq = 1; seq <= 3; seq++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_b, srtp_a, 1, seq));
+    }
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 8, &num_events));
+    CHECK(num_events == 1);
+    CHECK(events[0].session == srtp_a);
+    CHECK(events[0].ssrc == 1);
+    CHECK(events[0].event == event_ssrc_collision);
+
+    /* once polled the stream queues the event again */
+    CHECK_OK(srtp_test_send_and_receive(srtp_b, srtp_a, 1, 4));
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 0, &num_events));
+    CHECK(num_events == 0);
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 8, &num_events));
+    CHECK(num_events == 1);
+    CHECK(events[0].ssrc == 1);
+
+    /* the queue of four events overflows with six streams */
+    for (uint32_t ssrc = 1; ssrc <= 6; ssrc++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_b, srtp_a, ssrc, 5));
+    }
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 3, &num_events));
+    CHECK(num_events == 3);
+    CHECK(events[0].event == event_queue_overflow);
+    CHECK(events[1].ssrc == 1);
+    CHECK(events[2].ssrc == 2);
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 8, &num_events));
+    CHECK(num_events == 2);
+    CHECK(events[0].ssrc == 3);
+    CHECK(events[1].ssrc == 4);
+
+    /* the streams whose events were dropped queue them later */
+    CHECK_OK(srtp_test_send_and_receive(srtp_b, srtp_a, 6, 6));
+    CHECK_OK(srtp_session_poll_events(srtp_a, events, 8, &num_events));
+    CHECK(num_events == 1);
+    CHECK(events[0].ssrc == 6);
+
+    CHECK_OK(srtp_session_set_event_queue(srtp_a, 0));
+    CHECK_RETURN(srtp_session_poll_events(srtp_a, events, 8, &num_events),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_session_poll_events(srtp_b, NULL, 1, &num_events),
+                 srtp_err_status_bad_param);
 
-    debug_print(mod_driver, "ciphertext:\n  %s",
-                octet_string_hex_string(srtp_plaintext, len));
-    debug_print(mod_driver, "ciphertext reference:\n  %s",
-                octet_string_hex_string(srtp_ciphertext, len));
+    CHECK_OK(srtp_dealloc(srtp_a));
+    CHECK_OK(srtp_dealloc(srtp_b));
 
-    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+    return srtp_err_status_ok;
+}
 
-    /*
-     * protect plaintext rtcp, then compare with srtcp ciphertext
-     */
-    len = 24;
-    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
-    if (status || (len != 38)) {
-        return srtp_err_status_fail;
+/*
+ * srtp_test_protect_packet() returns a fresh packet with the given SSRC
+ * and sequence number protected by srtp_snd, or NULL on failure
+ */
+static uint8_t *srtp_test_protect_packet(srtp_t srtp_snd,
+                                         uint32_t ssrc,
+                                         uint16_t seq,
+                                         size_t *len)
+{
+    uint8_t *pkt;
+    size_t buffer_len;
+
+    pkt = create_rtp_test_packet(64, ssrc, seq, 0, false, len, &buffer_len);
+    if (srtp_protect(srtp_snd, pkt, *len, pkt, &buffer_len, 0)) {
+        free(pkt);
+        return NULL;
     }
+    *len = buffer_len;
 
-    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
-                octet_string_hex_string(rtcp_plaintext, len));
-    debug_print(mod_driver, "srtcp ciphertext reference:\n  %s",
-                octet_string_hex_string(srtcp_ciphertext, len));
+    return pkt;
+}
 
-    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+static srtp_err_status_t srtp_test_key_overlap_profile(srtp_profile_t profile)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    uint8_t *late[2][2];
+    size_t late_len[2][2];
+    srtp_stream_t stream;
 
-    /*
-     * create a receiver session context comparable to the one created
-     * above - we need to do this so that the replay checking doesn't
-     * complain
-     */
-    status = srtp_create(&srtp_recv, policy);
-    if (status) {
-        return status;
-    }
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
-    /*
-     * unprotect ciphertext, then compare with plaintext
-     */
-    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
-    if (status || (len != 28)) {
-        return status;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    /* SSRC 1 has a stream of its own, SSRC 2 is cloned from the template */
+    for (uint32_t ssrc = 1; ssrc <= 2; ssrc++) {
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 0));
+        for (uint16_t i = 0; i < 2; i++) {
+            late[ssrc - 1][i] = srtp_test_protect_packet(
+                srtp_snd, ssrc, i + 1, &late_len[ssrc - 1][i]);
+            CHECK(late[ssrc - 1][i] != NULL);
+        }
     }
 
-    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
-    }
+    /* the receiver keeps the previous keys for four more packets */
+    CHECK_OK(policy_set_key(policy, test_alt_key));
+    CHECK_OK(srtp_policy_set_key_overlap(policy, 4));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_update(srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_stream_update(srtp_recv, policy));
 
-    /*
-     * unprotect srtcp ciphertext, then compare with rtcp plaintext
-     */
-    len = 38;
-    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
-    if (status || (len != 24)) {
-        return status;
-    }
+    for (uint32_t ssrc = 1; ssrc <= 2; ssrc++) {
+        uint8_t **pkts = late[ssrc - 1];
+        size_t *lens = late_len[ssrc - 1];
 
-    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
-    }
+        CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, 3));
 
-    status = srtp_dealloc(srtp_snd);
-    if (status) {
-        return status;
-    }
+        /* a packet sent before the sender switched keys arrives late */
+        CHECK_OK(
+            srtp_unprotect(srtp_recv, pkts[0], lens[0], pkts[0], &lens[0]));
+        stream = srtp_get_stream(srtp_recv, htonl(ssrc));
+        CHECK(stream->cold != NULL && stream->cold->overlap.previous != NULL);
 
-    status = srtp_dealloc(srtp_recv);
-    if (status) {
-        return status;
+        for (uint16_t seq = 4; seq <= 6; seq++) {
+            CHECK_OK(
+                srtp_test_send_and_receive(srtp_snd, srtp_recv, ssrc, seq));
+        }
+
+        /* the fourth packet under the new keys retired the previous ones */
+        stream = srtp_get_stream(srtp_recv, htonl(ssrc));
+        CHECK(stream->cold->overlap.previous == NULL);
+        CHECK_RETURN(
+            srtp_unprotect(srtp_recv, pkts[1], lens[1], pkts[1], &lens[1]),
+            srtp_err_status_auth_fail);
+
+        free(pkts[0]);
+        free(pkts[1]);
     }
 
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
     srtp_policy_destroy(policy);
 
     return srtp_err_status_ok;
 }
 
 /*
- * srtp_validate_mki() verifies the correctness of libsrtp by comparing
- * some computed packets against some pre-computed reference values.
- * These packets were made with the default SRTP policy.
+ * srtp_test_key_overlap() checks that after an update with a key overlap
+ * packets protected with the previous keys are still accepted, until the
+ * new keys have been used for the given number of packets
  */
+srtp_err_status_t srtp_test_key_overlap(void)
+{
+    CHECK_OK(srtp_test_key_overlap_profile(srtp_profile_aes128_cm_sha1_80));
+#ifdef GCM
+    CHECK_OK(srtp_test_key_overlap_profile(srtp_profile_aead_aes_128_gcm));
+#endif
+
+    return srtp_err_status_ok;
+}
+
+static void srtp_test_stream_stats_cb(const srtp_stream_stats_t *stats,
+                                      void *data)
+{
+    srtp_stream_stats_t *total = (srtp_stream_stats_t *)data;
 
-srtp_err_status_t srtp_validate_mki(void)
-{
-    // clang-format off
-    uint8_t srtp_plaintext_ref[28] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab
-    };
-    uint8_t srtp_plaintext[42] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00
-    };
-    uint8_t srtp_ciphertext[42] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0x4e, 0x55, 0xdc, 0x4c,
-        0xe7, 0x99, 0x78, 0xd8, 0x8c, 0xa4, 0xd2, 0x15,
-        0x94, 0x9d, 0x24, 0x02, 0xe1, 0xf9, 0x7a, 0x0d,
-        0xb7, 0x8d, 0x6a, 0xcc, 0x99, 0xea, 0x17, 0x9b,
-        0x8d, 0xbb
-    };
-    uint8_t rtcp_plaintext_ref[24] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-    };
-    uint8_t rtcp_plaintext[42] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00
-    };
-    uint8_t srtcp_ciphertext[42] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0x71, 0x28, 0x03, 0x5b, 0xe4, 0x87, 0xb9, 0xbd,
-        0xbe, 0xf8, 0x90, 0x41, 0xf9, 0x77, 0xa5, 0xa8,
-        0x80, 0x00, 0x00, 0x01, 0xe1, 0xf9, 0x7a, 0x0d,
-        0x99, 0x3e, 0x08, 0xcd, 0x54, 0xd6, 0xc1, 0x23,
-        0x07, 0x98
-    };
-    // clang-format on
-
+    total->ssrc++;
+    total->rtp_packets_unprotected += stats->rtp_packets_unprotected;
+    total->auth_fail += stats->auth_fail;
+}
+
+/*
+ * srtp_test_stream_stats_session() checks the counters of a receiving
+ * stream cloned from the template, which must survive an update
+ */
+static srtp_err_status_t srtp_test_stream_stats_session(bool thread_safe)
+{
     srtp_t srtp_snd, srtp_recv;
-    srtp_err_status_t status;
-    size_t len;
     srtp_policy_t policy;
+    srtp_stream_stats_t stats, total;
+    uint8_t *pkt, *replay;
+    size_t len, replay_len;
 
-    /*
-     * create a session with a single stream using the default srtp
-     * policy and with the SSRC value 0xcafebabe
-     */
     CHECK_OK(srtp_policy_create(&policy));
     CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
-    CHECK_OK(srtp_policy_use_mki(policy, TEST_MKI_ID_SIZE));
-    CHECK_OK(policy_add_keys(policy, test_keys, 2));
-
-    status = srtp_create(&srtp_snd, policy);
-    if (status) {
-        return status;
-    }
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_recv, thread_safe));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    /* a packet failing authentication before the stream exists is lost */
+    pkt = srtp_test_protect_packet(srtp_snd, 1, 1, &len);
+    CHECK(pkt != NULL);
+    pkt[len - 1] ^= 0xff;
+    CHECK_RETURN(srtp_unprotect(srtp_recv, pkt, len, pkt, &len),
+                 srtp_err_status_auth_fail);
+    free(pkt);
+    CHECK_RETURN(srtp_stream_get_stats(srtp_recv, 1, &stats),
+                 srtp_err_status_bad_param);
 
-    /*
-     * protect plaintext, then compare with ciphertext
-     */
-    len = 28;
-    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
-    if (status) {
-        return status;
-    }
+    replay = srtp_test_protect_packet(srtp_snd, 1, 2, &replay_len);
+    CHECK(replay != NULL);
+    len = replay_len;
+    pkt = malloc(replay_len);
+    CHECK(pkt != NULL);
+    memcpy(pkt, replay, replay_len);
+    CHECK_OK(srtp_unprotect(srtp_recv, pkt, len, pkt, &len));
+    CHECK_RETURN(srtp_unprotect(srtp_recv, replay, replay_len, replay,
+                                &replay_len),
+                 srtp_err_status_replay_fail);
+    free(pkt);
+    free(replay);
 
-    debug_print(mod_driver, "ciphertext:\n  %s",
-                octet_string_hex_string(srtp_plaintext, len));
-    debug_print(
-        mod_driver, "ciphertext reference:\n  %s",
-        octet_string_hex_string(srtp_ciphertext, sizeof(srtp_ciphertext)));
+    pkt = srtp_test_protect_packet(srtp_snd, 1, 3, &len);
+    CHECK(pkt != NULL);
+    pkt[len - 1] ^= 0xff;
+    CHECK_RETURN(srtp_unprotect(srtp_recv, pkt, len, pkt, &len),
+                 srtp_err_status_auth_fail);
+    free(pkt);
 
-    if (len != sizeof(srtp_ciphertext)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_OK(srtp_stream_get_stats(srtp_snd, 1, &stats));
+    CHECK(stats.ssrc == 1);
+    CHECK(stats.rtp_packets_protected == 3);
+    CHECK(stats.rtp_bytes_protected == 3 * 76);
+    CHECK(stats.rtp_packets_unprotected == 0);
+
+    /* the counters are kept when the template is updated */
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK_OK(srtp_stream_get_stats(srtp_recv, 1, &stats));
+    CHECK(stats.ssrc == 1);
+    CHECK(stats.rtp_packets_protected == 0);
+    CHECK(stats.rtp_packets_unprotected == 1);
+    CHECK(stats.rtp_bytes_unprotected == 76);
+    CHECK(stats.auth_fail == 1);
+    CHECK(stats.replay_fail == 1);
+    CHECK(stats.replay_old == 0);
+    CHECK(stats.bad_mki == 0);
+
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 1));
+    memset(&total, 0, sizeof(total));
+    CHECK_OK(srtp_session_for_each_stats(srtp_recv, srtp_test_stream_stats_cb,
+                                         &total));
+    CHECK(total.ssrc == 2);
+    CHECK(total.rtp_packets_unprotected == 2);
+    CHECK(total.auth_fail == 1);
 
-    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    /*
-     * protect plaintext rtcp, then compare with srtcp ciphertext
-     */
-    len = 24;
-    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
-    if (status) {
-        return status;
-    }
+    return srtp_err_status_ok;
+}
 
-    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
-                octet_string_hex_string(rtcp_plaintext, len));
-    debug_print(
-        mod_driver, "srtcp ciphertext reference:\n  %s",
-        octet_string_hex_string(srtcp_ciphertext, sizeof(srtcp_ciphertext)));
+/*
+ * srtp_test_stream_stats() checks the counters returned by
+ * srtp_stream_get_stats() and srtp_session_for_each_stats()
+ */
+srtp_err_status_t srtp_test_stream_stats(void)
+{
+    CHECK_OK(srtp_test_stream_stats_session(false));
+    CHECK_OK(srtp_test_stream_stats_session(true));
 
-    if (len != sizeof(srtcp_ciphertext)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_RETURN(srtp_stream_get_stats(NULL, 1, NULL),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_session_for_each_stats(NULL, srtp_test_stream_stats_cb,
+                                             NULL),
+                 srtp_err_status_bad_param);
 
-    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+    return srtp_err_status_ok;
+}
 
-    /*
-     * create a receiver session context comparable to the one created
-     * above - we need to do this so that the replay checking doesn't
-     * complain
-     */
-    status = srtp_create(&srtp_recv, policy);
-    if (status) {
-        return status;
-    }
+/*
+ * srtp_test_stream_cold() checks that a stream only carrying RTP has no
+ * SRTCP state and that the state set up by the first SRTCP packet is
+ * kept when the stream is updated
+ */
+srtp_err_status_t srtp_test_stream_cold(void)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stream_t stream;
+    uint8_t *pkt, *rtcp;
+    size_t len, rtcp_len, srtcp_len, buffer_len;
+    uint8_t replay[128];
 
-    /*
-     * unprotect ciphertext, then compare with plaintext
-     */
-    len = 42;
-    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
-    if (status || (len != 28)) {
-        return status;
-    }
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
 
-    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
 
-    /*
-     * unprotect srtcp ciphertext, then compare with rtcp plaintext
-     */
-    len = 42;
-    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
-    if (status || (len != 24)) {
-        return status;
-    }
+    pkt = srtp_test_protect_packet(srtp_snd, 1, 1, &len);
+    CHECK(pkt != NULL);
+    CHECK_OK(srtp_unprotect(srtp_recv, pkt, len, pkt, &len));
+    free(pkt);
+    stream = srtp_get_stream(srtp_recv, htonl(1));
+    CHECK(stream != NULL && stream->cold == NULL);
 
-    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
-    }
+    rtcp = create_rtcp_test_packet(28, 1, &rtcp_len, &buffer_len);
+    srtcp_len = buffer_len;
+    CHECK_OK(srtp_protect_rtcp(srtp_snd, rtcp, rtcp_len, rtcp, &srtcp_len, 0));
+    CHECK(srtcp_len <= sizeof(replay));
+    memcpy(replay, rtcp, srtcp_len);
+    len = srtcp_len;
+    CHECK_OK(srtp_unprotect_rtcp(srtp_recv, rtcp, len, rtcp, &len));
+    free(rtcp);
+    CHECK(stream->cold != NULL);
 
-    status = srtp_dealloc(srtp_snd);
-    if (status) {
-        return status;
-    }
+    len = srtcp_len;
+    CHECK_RETURN(srtp_unprotect_rtcp(srtp_recv, replay, len, replay, &len),
+                 srtp_err_status_replay_fail);
 
-    status = srtp_dealloc(srtp_recv);
-    if (status) {
-        return status;
-    }
+    /* the SRTCP replay database survives an update of the template */
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    stream = srtp_get_stream(srtp_recv, htonl(1));
+    CHECK(stream != NULL && stream->cold != NULL);
+    len = srtcp_len;
+    CHECK_RETURN(srtp_unprotect_rtcp(srtp_recv, replay, len, replay, &len),
+                 srtp_err_status_replay_fail);
 
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
     srtp_policy_destroy(policy);
 
     return srtp_err_status_ok;
 }
 
 /*
- * srtp_validate_null_sha1_80() verifies the correctness of libsrtp by comparing
- * some computed packets against some pre-computed reference values.
- * These packets were made with a policy that applies null encryption
- * and HMAC authentication.
+ * srtp_test_clone_limits_session() checks that the least recently used
+ * clone makes room for a new SSRC and that idle clones are collected
  */
-
-srtp_err_status_t srtp_validate_null_sha1_80(void)
+static srtp_err_status_t srtp_test_clone_limits_session(bool thread_safe)
 {
-    // clang-format off
-    uint8_t srtp_plaintext_ref[28] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab
-    };
-    uint8_t srtp_plaintext[38] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
-    uint8_t srtp_ciphertext[38] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xa1, 0x36, 0x27,
-        0x0b, 0x67, 0x91, 0x34, 0xce, 0x9b
-    };
-    uint8_t rtcp_plaintext_ref[24] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-    };
-    uint8_t rtcp_plaintext[38] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
-    uint8_t srtcp_ciphertext[38] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0x00, 0x00, 0x00, 0x01, 0xfe, 0x88, 0xc7, 0xfd,
-        0xfd, 0x37, 0xeb, 0xce, 0x61, 0x5d,
-    };
-    // clang-format on
-
     srtp_t srtp_snd, srtp_recv;
-    srtp_err_status_t status;
-    size_t len;
     srtp_policy_t policy;
 
-    /*
-     * create a session with a single stream using the null cipher
-     * and sha1_80 policy and with the SSRC value 0xcafebabe
-     */
+    extern srtp_stream_t srtp_get_stream(srtp_t srtp, uint32_t ssrc);
+
     CHECK_OK(srtp_policy_create(&policy));
-    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_null_sha1_80));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
     CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_policy_set_max_clones(policy, 2));
+    CHECK_OK(srtp_policy_set_clone_idle_timeout(policy, 1));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+    CHECK_OK(srtp_set_thread_safe(srtp_recv, thread_safe));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 1, 1));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 1));
+
+    /* SSRC 2 was used in the new epoch, so SSRC 1 makes room for 3 */
+    CHECK_OK(srtp_session_gc(srtp_recv));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 2, 2));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 3, 1));
+    CHECK(srtp_get_stream(srtp_recv, htonl(1)) == NULL);
+    CHECK(srtp_get_stream(srtp_recv, htonl(2)) != NULL);
+    CHECK(srtp_get_stream(srtp_recv, htonl(3)) != NULL);
+
+    /* a clone is kept for one idle epoch */
+    CHECK_OK(srtp_session_gc(srtp_recv));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 3, 2));
+    CHECK(srtp_get_stream(srtp_recv, htonl(2)) != NULL);
+    CHECK_OK(srtp_session_gc(srtp_recv));
+    CHECK(srtp_get_stream(srtp_recv, htonl(2)) == NULL);
+    CHECK(srtp_get_stream(srtp_recv, htonl(3)) != NULL);
+
+    /* the limits survive an update of the template */
+    CHECK_OK(srtp_update(srtp_recv, policy));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 4, 1));
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 5, 1));
+    CHECK(srtp_get_stream(srtp_recv, htonl(3)) == NULL);
+    CHECK(srtp_get_stream(srtp_recv, htonl(4)) != NULL);
+    CHECK(srtp_get_stream(srtp_recv, htonl(5)) != NULL);
 
-    status = srtp_create(&srtp_snd, policy);
-    if (status) {
-        return status;
-    }
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
 
-    /*
-     * protect plaintext, then compare with ciphertext
-     */
-    len = 28;
-    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
-    if (status || (len != 38)) {
-        return srtp_err_status_fail;
-    }
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_clone_limits() checks srtp_policy_set_max_clones(),
+ * srtp_policy_set_clone_idle_timeout() and srtp_session_gc()
+ */
+srtp_err_status_t srtp_test_clone_limits(void)
+{
+    CHECK_OK(srtp_test_clone_limits_session(false));
+    CHECK_OK(srtp_test_clone_limits_session(true));
+
+    CHECK_RETURN(srtp_session_gc(NULL), srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_max_clones(NULL, 1),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_clone_idle_timeout(NULL, 1),
+                 srtp_err_status_bad_param);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_memory_usage() checks that srtp_session_get_memory_usage()
+ * follows the streams of a session and its categories add up; the clones
+ * share the expanded keys of the template, so the memory they take is
+ * all accounted to the session
+ */
+#define MEMORY_TEST_NUM_CLONES 10
+
+static bool memory_usage_adds_up(const srtp_session_memory_t *usage)
+{
+    return usage->total == usage->session + usage->streams + usage->clones +
+                               usage->templates + usage->pool +
+                               usage->keys + usage->replay +
+                               usage->key_cache;
+}
+
+srtp_err_status_t srtp_test_memory_usage(void)
+{
+    srtp_t session;
+    srtp_policy_t policy;
+    srtp_session_memory_t empty, cloned, removed, added;
+    srtp_alloc_stats_t before, after;
+    uint8_t *rtp;
+    size_t rtp_len, srtp_len;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&session, policy));
 
-    debug_print(mod_driver, "ciphertext:\n  %s",
-                octet_string_hex_string(srtp_plaintext, len));
-    debug_print(mod_driver, "ciphertext reference:\n  %s",
-                octet_string_hex_string(srtp_ciphertext, len));
+    CHECK_RETURN(srtp_session_get_memory_usage(NULL, &empty),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_session_get_memory_usage(session, NULL),
+                 srtp_err_status_bad_param);
 
-    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
-        return srtp_err_status_fail;
+    CHECK_OK(srtp_session_get_memory_usage(session, &empty));
+    CHECK(memory_usage_adds_up(&empty));
+    CHECK(empty.session > 0 && empty.templates > 0 && empty.keys > 0);
+    CHECK(empty.streams == 0 && empty.clones == 0);
+    CHECK(empty.num_streams == 0 && empty.num_clones == 0);
+
+    CHECK_OK(srtp_get_alloc_stats(&before));
+    for (uint32_t i = 0; i < MEMORY_TEST_NUM_CLONES; i++) {
+        rtp = create_rtp_test_packet(64, 0x1000 + i, 1, 0, false, &rtp_len,
+                                     &srtp_len);
+        CHECK(rtp != NULL);
+        CHECK_OK(srtp_protect(session, rtp, rtp_len, rtp, &srtp_len, 0));
+        free(rtp);
     }
+    CHECK_OK(srtp_get_alloc_stats(&after));
 
-    /*
-     * protect plaintext rtcp, then compare with srtcp ciphertext
-     */
-    len = 24;
-    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
-    if (status || (len != 38)) {
-        return srtp_err_status_fail;
+    CHECK_OK(srtp_session_get_memory_usage(session, &cloned));
+    CHECK(memory_usage_adds_up(&cloned));
+    CHECK(cloned.num_streams == MEMORY_TEST_NUM_CLONES);
+    CHECK(cloned.num_clones == MEMORY_TEST_NUM_CLONES);
+    CHECK(cloned.clones >= MEMORY_TEST_NUM_CLONES * sizeof(srtp_stream_ctx_t));
+    CHECK(cloned.replay > empty.replay);
+    CHECK(cloned.templates == empty.templates);
+    CHECK(cloned.total - empty.total ==
+          after.live_bytes - before.live_bytes);
+
+    /* removing the clones gives their memory back */
+    for (uint32_t i = 0; i < MEMORY_TEST_NUM_CLONES; i++) {
+        CHECK_OK(srtp_stream_remove(session, 0x1000 + i));
     }
+    CHECK_OK(srtp_session_get_memory_usage(session, &removed));
+    CHECK(memory_usage_adds_up(&removed));
+    CHECK(removed.num_streams == 0 && removed.clones == 0);
+    CHECK(removed.keys == empty.keys && removed.replay == empty.replay);
 
-    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
-                octet_string_hex_string(rtcp_plaintext, len));
-    debug_print(mod_driver, "srtcp ciphertext reference:\n  %s",
-                octet_string_hex_string(srtcp_ciphertext, len));
+    /* an explicit stream with a larger replay window */
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0x2000 }));
+    CHECK_OK(srtp_policy_set_window_size(policy, 4096));
+    CHECK_OK(srtp_stream_add(session, policy));
+    CHECK_OK(srtp_session_get_memory_usage(session, &added));
+    CHECK(memory_usage_adds_up(&added));
+    CHECK(added.num_streams == 1 && added.num_clones == 0);
+    CHECK(added.streams > 0 && added.keys > removed.keys);
+    CHECK(added.replay >= removed.replay + 4096 / 8);
 
-    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_OK(srtp_dealloc(session));
+    srtp_policy_destroy(policy);
 
-    /*
-     * create a receiver session context comparable to the one created
-     * above - we need to do this so that the replay checking doesn't
-     * complain
-     */
-    status = srtp_create(&srtp_recv, policy);
-    if (status) {
-        return status;
-    }
+    return srtp_err_status_ok;
+}
 
-    /*
-     * unprotect ciphertext, then compare with plaintext
-     */
-    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
-    if (status || (len != 28)) {
-        return status;
-    }
+/*
+ * srtp_report_stream_memory() prints the memory taken by a stream of
+ * policy, as the growth of the allocation statistics when it is added to
+ * a session and after it protected its first SRTCP packet
+ */
+void srtp_report_stream_memory(const test_policy_t *policy)
+{
+    srtp_t srtp;
+    srtp_policy_t p;
+    srtp_alloc_stats_t before, added, rtcp_used;
+    srtp_session_memory_t usage;
+    uint8_t *rtcp;
+    size_t rtcp_len, srtcp_len;
+    uint32_t ssrc = 0xdecafbad;
 
-    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
+    if (policy_from_test_policy(&p, policy, false) ||
+        srtp_policy_set_ssrc(p, (srtp_ssrc_t){ ssrc_specific, ssrc }) ||
+        srtp_create(&srtp, NULL)) {
+        printf("error: could not create a session\n");
+        exit(1);
     }
 
-    /*
-     * unprotect srtcp ciphertext, then compare with rtcp plaintext
-     */
-    len = 38;
-    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
-    if (status || (len != 24)) {
-        return status;
+    rtcp = create_rtcp_test_packet(28, ssrc, &rtcp_len, &srtcp_len);
+    if (srtp_get_alloc_stats(&before) || srtp_stream_add(srtp, p) ||
+        srtp_get_alloc_stats(&added) ||
+        srtp_protect_rtcp(srtp, rtcp, rtcp_len, rtcp, &srtcp_len, 0) ||
+        srtp_get_alloc_stats(&rtcp_used) ||
+        srtp_session_get_memory_usage(srtp, &usage)) {
+        printf("error: could not add a stream\n");
+        exit(1);
     }
+    free(rtcp);
 
-    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
+    printf("octets per stream: %zu in %zu allocations, %zu after SRTCP\n",
+           added.live_bytes - before.live_bytes,
+           added.live_allocations - before.live_allocations,
+           rtcp_used.live_bytes - before.live_bytes);
+    printf("session: %zu octets, stream %zu, keys %zu, replay %zu\n\n",
+           usage.total, usage.streams, usage.keys, usage.replay);
+
+    srtp_dealloc(srtp);
+    srtp_policy_destroy(p);
+}
+
+/*
+ * srtp_test_stage_profile() checks that srtp_get_stage_profile() counts
+ * the packets protected and unprotected, RTP and RTCP, and that
+ * srtp_reset_stage_profile() clears the counts; without the counters
+ * built in both report srtp_err_status_no_such_op
+ */
+#define STAGE_TEST_NUM_PKTS 3
+
+static uint64_t stage_ticks(const srtp_stage_counts_t *counts)
+{
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < SRTP_NUM_STAGES; i++) {
+        sum += counts->ticks[i];
     }
+    return sum;
+}
 
-    status = srtp_dealloc(srtp_snd);
-    if (status) {
-        return status;
+srtp_err_status_t srtp_test_stage_profile(void)
+{
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_stage_profile_t profile;
+    uint8_t *pkt;
+    size_t len, buffer_len;
+    srtp_err_status_t status;
+    const uint32_t ssrc = 0xcafebabe;
+
+    CHECK_OK(srtp_create(&srtp_snd, NULL));
+    CHECK_OK(srtp_create(&srtp_recv, NULL));
+
+    CHECK_RETURN(srtp_get_stage_profile(NULL, &profile),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_get_stage_profile(srtp_snd, NULL),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_reset_stage_profile(NULL), srtp_err_status_bad_param);
+
+    status = srtp_get_stage_profile(srtp_snd, &profile);
+    if (status == srtp_err_status_no_such_op) {
+        CHECK_RETURN(srtp_reset_stage_profile(srtp_snd),
+                     srtp_err_status_no_such_op);
+        CHECK_OK(srtp_dealloc(srtp_snd));
+        CHECK_OK(srtp_dealloc(srtp_recv));
+        return srtp_err_status_ok;
     }
+    CHECK_OK(status);
+    CHECK(profile.protect.packets == 0 && profile.unprotect.packets == 0);
+    CHECK(stage_ticks(&profile.protect) == 0);
 
-    status = srtp_dealloc(srtp_recv);
-    if (status) {
-        return status;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_stream_add(srtp_snd, policy));
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+
+    for (uint16_t seq = 0; seq < STAGE_TEST_NUM_PKTS; seq++) {
+        pkt = create_rtp_test_packet(100, ssrc, seq, 0, true, &len,
+                                     &buffer_len);
+        CHECK_OK(srtp_protect(srtp_snd, pkt, len, pkt, &buffer_len, 0));
+        len = buffer_len;
+        CHECK_OK(srtp_unprotect(srtp_recv, pkt, len, pkt, &len));
+        free(pkt);
     }
+    pkt = create_rtcp_test_packet(28, ssrc, &len, &buffer_len);
+    CHECK_OK(srtp_protect_rtcp(srtp_snd, pkt, len, pkt, &buffer_len, 0));
+    len = buffer_len;
+    CHECK_OK(srtp_unprotect_rtcp(srtp_recv, pkt, len, pkt, &len));
+    free(pkt);
+
+    CHECK_OK(srtp_get_stage_profile(srtp_snd, &profile));
+    CHECK(profile.protect.packets == STAGE_TEST_NUM_PKTS + 1);
+    CHECK(profile.unprotect.packets == 0);
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+    CHECK(stage_ticks(&profile.protect) != 0);
+#endif
+
+    CHECK_OK(srtp_get_stage_profile(srtp_recv, &profile));
+    CHECK(profile.protect.packets == 0);
+    CHECK(profile.unprotect.packets == STAGE_TEST_NUM_PKTS + 1);
+
+    CHECK_OK(srtp_reset_stage_profile(srtp_recv));
+    CHECK_OK(srtp_get_stage_profile(srtp_recv, &profile));
+    CHECK(profile.unprotect.packets == 0);
+    CHECK(stage_ticks(&profile.unprotect) == 0);
 
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
     srtp_policy_destroy(policy);
 
     return srtp_err_status_ok;
 }
 
 /*
- * srtp_validate_null_null() verifies the correctness of libsrtp by comparing
- * some computed packets against some pre-computed reference values.
- * These packets were made with a policy that applies null encryption
- * and null authentication.
+ * srtp_report_stage_profile() protects and unprotects packets with
+ * policy and prints the ticks each stage took per packet
  */
+#define STAGE_REPORT_NUM_PKTS 10000
 
-srtp_err_status_t srtp_validate_null_null(void)
+static void srtp_print_stage_counts(const char *name,
+                                    const srtp_stage_counts_t *counts)
 {
-    // clang-format off
-    uint8_t srtp_plaintext_ref[28] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab
-    };
-    uint8_t srtp_plaintext[28] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab,
-    };
-    uint8_t srtp_ciphertext[28] = {
-        0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
-        0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab,
-    };
-    uint8_t rtcp_plaintext_ref[24] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-    };
-    uint8_t rtcp_plaintext[28] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0x00, 0x00, 0x00, 0x00,
-    };
-    uint8_t srtcp_ciphertext[28] = {
-        0x81, 0xc8, 0x00, 0x0b, 0xca, 0xfe, 0xba, 0xbe,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
-        0x00, 0x00, 0x00, 0x01,
+    static const char *const stages[SRTP_NUM_STAGES] = {
+        "lookup", "index", "cipher", "auth", "header", "copy", "other"
     };
-    // clang-format on
+    uint64_t packets = counts->packets ? counts->packets : 1;
+
+    printf("%-10s", name);
+    for (size_t i = 0; i < SRTP_NUM_STAGES; i++) {
+        printf(" %s %.1f", stages[i], (double)counts->ticks[i] / packets);
+    }
+    printf(" ticks/packet\n");
+}
 
+void srtp_report_stage_profile(const test_policy_t *policy)
+{
     srtp_t srtp_snd, srtp_recv;
-    srtp_err_status_t status;
-    size_t len;
-    srtp_policy_t policy;
+    srtp_policy_t p;
+    srtp_stage_profile_t profile;
+    uint8_t *pkt, *srtp_pkt;
+    size_t rtp_len, buffer_len, srtp_len, len;
+    uint32_t ssrc = 0xdecafbad;
+
+    if (policy_from_test_policy(&p, policy, false) ||
+        srtp_policy_set_ssrc(p, (srtp_ssrc_t){ ssrc_specific, ssrc }) ||
+        srtp_create(&srtp_snd, NULL) || srtp_create(&srtp_recv, NULL) ||
+        srtp_stream_add(srtp_snd, p) || srtp_stream_add(srtp_recv, p)) {
+        printf("error: could not create a session\n");
+        exit(1);
+    }
 
-    /*
-     * create a session with a single stream using the null cipher
-     * and null hmac policy and with the SSRC value 0xcafebabe
-     */
-    CHECK_OK(srtp_policy_create(&policy));
-    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_null_null));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    pkt = create_rtp_test_packet(1000, ssrc, 0, 0, true, &rtp_len,
+                                 &buffer_len);
+    srtp_pkt = malloc(buffer_len);
+    if (srtp_pkt == NULL) {
+        printf("error: malloc failed\n");
+        exit(1);
+    }
+    for (uint16_t seq = 0; seq < STAGE_REPORT_NUM_PKTS; seq++) {
+        ((srtp_hdr_t *)pkt)->seq = htons(seq);
+        srtp_len = buffer_len;
+        if (srtp_protect(srtp_snd, pkt, rtp_len, srtp_pkt, &srtp_len, 0)) {
+            printf("error: srtp_protect() failed\n");
+            exit(1);
+        }
+        len = srtp_len;
+        if (srtp_unprotect(srtp_recv, srtp_pkt, srtp_len, srtp_pkt, &len)) {
+            printf("error: srtp_unprotect() failed\n");
+            exit(1);
+        }
+    }
+    free(srtp_pkt);
+    free(pkt);
 
-    CHECK_OK(srtp_policy_validate(policy));
+    if (srtp_get_stage_profile(srtp_snd, &profile)) {
+        printf("stage profile not built in, see ENABLE_STAGE_PROFILE\n\n");
+    } else {
+        srtp_print_stage_counts("protect", &profile.protect);
+        srtp_get_stage_profile(srtp_recv, &profile);
+        srtp_print_stage_counts("unprotect", &profile.unprotect);
+        printf("\n");
+    }
 
-    CHECK_OK(srtp_create(&srtp_snd, policy));
+    srtp_dealloc(srtp_snd);
+    srtp_dealloc(srtp_recv);
+    srtp_policy_destroy(p);
+}
 
-    /*
-     * protect plaintext, then compare with ciphertext
-     */
-    len = 28;
-    status = call_srtp_protect(srtp_snd, srtp_plaintext, &len, 0);
-    if (!status && (len != 28)) {
-        status = srtp_err_status_fail;
-    }
-    if (status) {
-        return status;
-    }
+/*
+ * srtp_test_protect_iov_profile() checks that srtp_protect_iov() and
+ * srtp_unprotect_iov() give the same results as srtp_protect() and
+ * srtp_unprotect() for a packet split into segments of odd lengths, both
+ * for streams cloned from the template and for known streams
+ */
+#define IOV_TEST_NUM_SEGS 4
 
-    debug_print(mod_driver, "ciphertext:\n  %s",
-                octet_string_hex_string(srtp_plaintext, len));
-    debug_print(mod_driver, "ciphertext reference:\n  %s",
-                octet_string_hex_string(srtp_ciphertext, len));
+static void srtp_test_iov_split(uint8_t *pkt,
+                                size_t len,
+                                size_t hdr_len,
+                                srtp_iovec_t *iov)
+{
+    const size_t seg_len[IOV_TEST_NUM_SEGS - 1] = { 5, 37, 0 };
+
+    iov[0].base = pkt;
+    iov[0].len = hdr_len + seg_len[0];
+    len -= iov[0].len;
+    pkt += iov[0].len;
+    for (size_t i = 1; i < IOV_TEST_NUM_SEGS - 1; i++) {
+        iov[i].base = pkt;
+        iov[i].len = seg_len[i];
+        len -= seg_len[i];
+        pkt += seg_len[i];
+    }
+    iov[IOV_TEST_NUM_SEGS - 1].base = pkt;
+    iov[IOV_TEST_NUM_SEGS - 1].len = len;
+}
 
-    if (!srtp_octet_string_equal(srtp_plaintext, srtp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+static srtp_err_status_t srtp_test_protect_iov_profile(srtp_profile_t profile,
+                                                        size_t mki_size)
+{
+    const size_t hdr_len = 12 + sizeof(rtp_test_packet_extension_header);
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    srtp_policy_t policy;
+    srtp_iovec_t iov[IOV_TEST_NUM_SEGS];
+    uint8_t trailer[SRTP_MAX_TRAILER_LEN];
+    uint8_t *ref, *pkt, *plain;
+    size_t ref_len, rtp_len, trailer_len, buffer_len;
 
-    /*
-     * protect plaintext rtcp, then compare with srtcp ciphertext
-     */
-    len = 24;
-    status = call_srtp_protect_rtcp(srtp_snd, rtcp_plaintext, &len, 0);
-    if (!status && (len != 28)) {
-        status = srtp_err_status_fail;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    if (mki_size) {
+        CHECK_OK(srtp_policy_use_mki(policy, mki_size));
+        CHECK_OK(srtp_policy_add_key(policy, test_key, SRTP_AES_128_KEY_LEN,
+                                     test_key + SRTP_AES_128_KEY_LEN,
+                                     SRTP_SALT_LEN, test_mki_id, mki_size));
+    } else {
+        CHECK_OK(policy_set_key(policy, test_key));
     }
-    if (status) {
-        return status;
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_ref, policy));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    srtp_policy_destroy(policy);
+
+    for (uint16_t seq = 0; seq < 2; seq++) {
+        ref = create_rtp_test_packet(100, 0xcafebabe, seq, 0, true, &ref_len,
+                                     &buffer_len);
+        pkt = create_rtp_test_packet(100, 0xcafebabe, seq, 0, true, &rtp_len,
+                                     &buffer_len);
+        plain = create_rtp_test_packet(100, 0xcafebabe, seq, 0, true,
+                                       &rtp_len, &buffer_len);
+        CHECK_OK(srtp_protect(srtp_ref, ref, ref_len, ref, &buffer_len, 0));
+        ref_len = buffer_len;
+
+        srtp_test_iov_split(pkt, rtp_len, hdr_len, iov);
+        trailer_len = 2;
+        CHECK_RETURN(srtp_protect_iov(srtp_snd, iov, IOV_TEST_NUM_SEGS,
+                                      trailer, &trailer_len, 0),
+                     srtp_err_status_buffer_small);
+        trailer_len = sizeof(trailer);
+        CHECK_OK(srtp_protect_iov(srtp_snd, iov, IOV_TEST_NUM_SEGS, trailer,
+                                  &trailer_len, 0));
+        CHECK(rtp_len + trailer_len == ref_len);
+        CHECK_BUFFER_EQUAL(pkt, ref, rtp_len);
+        CHECK_BUFFER_EQUAL(trailer, ref + rtp_len, trailer_len);
+
+        /* a modified packet is rejected and left alone */
+        pkt[rtp_len - 1] ^= 0x01;
+        CHECK_RETURN(srtp_unprotect_iov(srtp_recv, iov, IOV_TEST_NUM_SEGS,
+                                        trailer, trailer_len),
+                     srtp_err_status_auth_fail);
+        pkt[rtp_len - 1] ^= 0x01;
+        CHECK_BUFFER_EQUAL(pkt, ref, rtp_len);
+
+        CHECK_OK(srtp_unprotect_iov(srtp_recv, iov, IOV_TEST_NUM_SEGS,
+                                    trailer, trailer_len));
+        CHECK_BUFFER_EQUAL(pkt, plain, rtp_len);
+        CHECK_RETURN(srtp_unprotect(srtp_recv, ref, ref_len, ref, &ref_len),
+                     srtp_err_status_replay_fail);
+
+        free(ref);
+        free(pkt);
+        free(plain);
     }
 
-    debug_print(mod_driver, "srtcp ciphertext:\n  %s",
-                octet_string_hex_string(rtcp_plaintext, len));
-    debug_print(mod_driver, "srtcp ciphertext reference:\n  %s",
-                octet_string_hex_string(srtcp_ciphertext, len));
+    /* the header has to be in the first segment */
+    pkt = create_rtp_test_packet(100, 0xcafebabe, 2, 0, true, &rtp_len,
+                                 &buffer_len);
+    srtp_test_iov_split(pkt, rtp_len, hdr_len, iov);
+    iov[0].len = hdr_len - 1;
+    trailer_len = sizeof(trailer);
+    CHECK_RETURN(srtp_protect_iov(srtp_snd, iov, IOV_TEST_NUM_SEGS, trailer,
+                                  &trailer_len, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_unprotect_iov(srtp_recv, iov, IOV_TEST_NUM_SEGS,
+                                    trailer, trailer_len),
+                 srtp_err_status_bad_param);
+    free(pkt);
 
-    if (!srtp_octet_string_equal(rtcp_plaintext, srtcp_ciphertext, len)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
 
-    /*
-     * create a receiver session context comparable to the one created
-     * above - we need to do this so that the replay checking doesn't
-     * complain
-     */
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_protect_iov(void)
+{
+    CHECK_OK(srtp_test_protect_iov_profile(srtp_profile_aes128_cm_sha1_80, 0));
+    CHECK_OK(srtp_test_protect_iov_profile(srtp_profile_aes128_cm_sha1_80,
+                                           TEST_MKI_ID_SIZE));
+    CHECK_OK(srtp_test_protect_iov_profile(srtp_profile_aes128_cm_sha1_32, 0));
+    CHECK_OK(srtp_test_protect_iov_profile(srtp_profile_null_sha1_80, 0));
+#ifdef GCM
+    CHECK_OK(srtp_test_protect_iov_profile(srtp_profile_aead_aes_128_gcm, 0));
+#endif
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_protect_buffer_profile() checks srtp_protect_buffer() and
+ * srtp_unprotect_buffer() with a cryptex packet that has CSRCs, without AEAD
+ * the in place result has to match the result of not in place io
+ */
+static srtp_err_status_t srtp_test_protect_buffer_profile(
+    srtp_profile_t profile,
+    bool aead)
+{
+    const uint8_t rtp_hdr[] = {
+        0x92, 0x0f, 0x00, 0x01, 0x00, 0x00, 0x03, 0xe8, 0xca, 0xfe,
+        0xba, 0xbe, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02,
+        0xbe, 0xde, 0x00, 0x01, 0x12, 0x34, 0x56, 0x00,
+    };
+    const size_t payload_len = 40;
+    const size_t rtp_len = sizeof(rtp_hdr) + payload_len;
+    srtp_policy_t policy;
+    srtp_t srtp_ref, srtp_snd, srtp_recv;
+    uint8_t plain[128];
+    uint8_t ref[128 + SRTP_MAX_TRAILER_LEN];
+    uint8_t pkt[128 + SRTP_MAX_TRAILER_LEN];
+    size_t ref_len = sizeof(ref);
+    srtp_buffer_t buf;
+
+    memcpy(plain, rtp_hdr, sizeof(rtp_hdr));
+    memset(plain + sizeof(rtp_hdr), 0xab, payload_len);
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+    CHECK_OK(srtp_create(&srtp_ref, policy));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
     CHECK_OK(srtp_create(&srtp_recv, policy));
+    srtp_policy_destroy(policy);
 
-    /*
-     * unprotect ciphertext, then compare with plaintext
-     */
-    status = call_srtp_unprotect(srtp_recv, srtp_ciphertext, &len);
-    if (!status && (len != 28)) {
-        status = srtp_err_status_fail;
-    }
-    if (status) {
-        return status;
-    }
+    memcpy(pkt, plain, rtp_len);
+    buf.data = pkt;
+    buf.len = rtp_len;
+    buf.tailroom = 2;
+    CHECK_RETURN(srtp_protect_buffer(srtp_snd, &buf, 0),
+                 srtp_err_status_buffer_small);
+    CHECK(buf.len == rtp_len);
 
-    if (!srtp_octet_string_equal(srtp_ciphertext, srtp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
-    }
+    buf.tailroom = sizeof(pkt) - rtp_len;
+    CHECK_OK(srtp_protect_buffer(srtp_snd, &buf, 0));
+    CHECK(buf.len > rtp_len);
+    CHECK(buf.len + buf.tailroom == sizeof(pkt));
+    CHECK(get_xtn_profile(pkt) == 0xc0de);
 
-    /*
-     * unprotect srtcp ciphertext, then compare with rtcp plaintext
-     */
-    len = 28;
-    status = call_srtp_unprotect_rtcp(srtp_recv, srtcp_ciphertext, &len);
-    if (!status && (len != 24)) {
-        status = srtp_err_status_fail;
+    if (!aead) {
+        CHECK_OK(srtp_protect(srtp_ref, plain, rtp_len, ref, &ref_len, 0));
+        CHECK(ref_len == buf.len);
+        CHECK_BUFFER_EQUAL(pkt, ref, ref_len);
     }
 
-    if (!srtp_octet_string_equal(srtcp_ciphertext, rtcp_plaintext_ref, len)) {
-        return srtp_err_status_fail;
-    }
+    CHECK_OK(srtp_unprotect_buffer(srtp_recv, &buf));
+    CHECK(buf.len == rtp_len);
+    CHECK(buf.len + buf.tailroom == sizeof(pkt));
+    CHECK_BUFFER_EQUAL(pkt, plain, rtp_len);
 
-    status = srtp_dealloc(srtp_snd);
-    if (status) {
-        return status;
-    }
+    CHECK_RETURN(srtp_protect_buffer(srtp_snd, NULL, 0),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_unprotect_buffer(srtp_recv, NULL),
+                 srtp_err_status_bad_param);
 
-    status = srtp_dealloc(srtp_recv);
-    if (status) {
-        return status;
-    }
+    CHECK_OK(srtp_dealloc(srtp_ref));
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
 
-    srtp_policy_destroy(policy);
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_protect_buffer(void)
+{
+    CHECK_OK(srtp_test_protect_buffer_profile(srtp_profile_aes128_cm_sha1_80,
+                                              false));
+#ifdef GCM
+    CHECK_OK(srtp_test_protect_buffer_profile(srtp_profile_aead_aes_128_gcm,
+                                              true));
+#endif
 
     return srtp_err_status_ok;
 }
 
 /*
- * srtp_validate_cryptex() verifies the correctness of libsrtp by comparing
- * some computed packets against some pre-computed reference values.
- * These packets were made with the default SRTP policy.
+ * srtp_test_lazy_profile() creates a sender and a receiver with profile and
+ * sends a packet between them, which runs any deferred self-tests first
  */
-srtp_err_status_t srtp_validate_cryptex(void)
+static srtp_err_status_t srtp_test_lazy_profile(srtp_profile_t profile)
 {
-    // clang-format off
-    /* Plaintext packet with 1-byte header extension */
-    const char *srtp_1bytehdrext_ref =
-        "900f1235"
-        "decafbad"
-        "cafebabe"
-        "bede0001"
-        "51000200"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
+    srtp_t srtp_snd, srtp_recv;
+    srtp_policy_t policy;
 
-    /* AES-CTR/HMAC-SHA1 Ciphertext packet with 1-byte header extension */
-    const char *srtp_1bytehdrext_cryptex =
-        "900f1235"
-        "decafbad"
-        "cafebabe"
-        "c0de0001"
-        "eb923652"
-        "51c3e036"
-        "f8de27e9"
-        "c27ee3e0"
-        "b4651d9f"
-        "bc4218a7"
-        "0244522f"
-        "34a5";
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+    srtp_policy_destroy(policy);
 
-    /* Plaintext packet with 2-byte header extension */
-    const char *srtp_2bytehdrext_ref =
-        "900f1236"
-        "decafbad"
-        "cafebabe"
-        "10000001"
-        "05020002"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 0xcafebabe, 1));
 
-    /* AES-CTR/HMAC-SHA1 Ciphertext packet with 2-byte header extension */
-    const char *srtp_2bytehdrext_cryptex =
-        "900f1236"
-        "decafbad"
-        "cafebabe"
-        "c2de0001"
-        "4ed9cc4e"
-        "6a712b30"
-        "96c5ca77"
-        "339d4204"
-        "ce0d7739"
-        "6cab6958"
-        "5fbce381"
-        "94a5";
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
 
-    /* Plaintext packet with 1-byte header extension and CSRC fields. */
-    const char *srtp_1bytehdrext_cc_ref =
-        "920f1238"
-        "decafbad"
-        "cafebabe"
-        "0001e240"
-        "0000b26e"
-        "bede0001"
-        "51000200"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
+    return srtp_err_status_ok;
+}
 
-    const char *srtp_1bytehdrext_cc_cryptex =
-        "920f1238"
-        "decafbad"
-        "cafebabe"
-        "8bb6e12b"
-        "5cff16dd"
-        "c0de0001"
-        "92838c8c"
-        "09e58393"
-        "e1de3a9a"
-        "74734d67"
-        "45671338"
-        "c3acf11d"
-        "a2df8423"
-        "bee0";
+/*
+ * srtp_test_init_lazy_self_tests() checks that sessions can be used after
+ * initializing with SRTP_INIT_LAZY_SELF_TESTS
+ */
+srtp_err_status_t srtp_test_init_lazy_self_tests(void)
+{
+    CHECK_RETURN(srtp_init_ex(0x80), srtp_err_status_bad_param);
 
-    /* Plaintext packet with 2-byte header extension and CSRC fields. */
-    const char *srtp_2bytehdrext_cc_ref =
-        "920f1239"
-        "decafbad"
-        "cafebabe"
-        "0001e240"
-        "0000b26e"
-        "10000001"
-        "05020002"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
+    CHECK_OK(srtp_shutdown());
+    CHECK_OK(srtp_init_ex(SRTP_INIT_LAZY_SELF_TESTS));
 
-    const char *srtp_2bytehdrext_cc_cryptex =
-        "920f1239"
-        "decafbad"
-        "cafebabe"
-        "f70e513e"
-        "b90b9b25"
-        "c2de0001"
-        "bbed4848"
-        "faa64466"
-        "5f3d7f34"
-        "125914e9"
-        "f4d0ae92"
-        "3c6f479b"
-        "95a0f7b5"
-        "3133";
+    CHECK_OK(srtp_test_lazy_profile(srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_test_lazy_profile(srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_test_lazy_profile(srtp_profile_null_sha1_80));
+#if defined(GCM) && !defined(SRTP_NO_AES_256)
+    CHECK_OK(srtp_test_lazy_profile(srtp_profile_aead_aes_256_gcm));
+#endif
 
-    /* Plaintext packet with empty 1-byte header extension and CSRC fields. */
-    const char *srtp_1byte_empty_hdrext_cc_ref =
-        "920f123a"
-        "decafbad"
-        "cafebabe"
-        "0001e240"
-        "0000b26e"
-        "bede0000"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
+    CHECK_OK(srtp_shutdown());
+    CHECK_OK(srtp_init());
 
-    const char *srtp_1byte_empty_hdrext_cc_cryptex =
-        "920f123a"
-        "decafbad"
-        "cafebabe"
-        "7130b6ab"
-        "fe2ab0e3"
-        "c0de0000"
-        "e3d9f64b"
-        "25c9e74c"
-        "b4cf8e43"
-        "fb92e378"
-        "1c2c0cea"
-        "b6b3a499"
-        "a14c";
+    return srtp_err_status_ok;
+}
 
-    /* Plaintext packet with empty 2-byte header extension and CSRC fields. */
-    const char *srtp_2byte_empty_hdrext_cc_ref =
-        "920f123b"
-        "decafbad"
-        "cafebabe"
-        "0001e240"
-        "0000b26e"
-        "10000000"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
+static const srtp_cipher_type_t *calibrate_builtin;
+static srtp_cipher_type_t calibrate_slow, calibrate_broken;
+static volatile size_t calibrate_sink;
 
-    const char *srtp_2byte_empty_hdrext_cc_cryptex =
-        "920f123b"
-        "decafbad"
-        "cafebabe"
-        "cbf24c12"
-        "4330e1c8"
-        "c2de0000"
-        "599dd45b"
-        "c9d687b6"
-        "03e8b59d"
-        "771fd38e"
-        "88b170e0"
-        "cd31e125"
-        "eabe";
+/* encrypts like the original implementation, only more slowly */
+static srtp_err_status_t calibrate_slow_encrypt(void *state,
+                                                const uint8_t *src,
+                                                size_t src_len,
+                                                uint8_t *dst,
+                                                size_t *dst_len)
+{
+    for (size_t i = 0; i < src_len * 64; i++) {
+        calibrate_sink += i;
+    }
+    return calibrate_builtin->encrypt(state, src, src_len, dst, dst_len);
+}
 
-    // clang-format on
+static srtp_err_status_t calibrate_slow_alloc(srtp_cipher_pointer_t *c,
+                                              size_t key_len,
+                                              size_t tag_len)
+{
+    srtp_err_status_t status;
 
-    const struct test_vectors_t vectors[6] = {
-        { "Plaintext packet with 1-byte header extension", srtp_1bytehdrext_ref,
-          srtp_1bytehdrext_cryptex },
-        { "Plaintext packet with 2-byte header extension", srtp_2bytehdrext_ref,
-          srtp_2bytehdrext_cryptex },
-        { "Plaintext packet with 1-byte header extension and CSRC fields",
-          srtp_1bytehdrext_cc_ref, srtp_1bytehdrext_cc_cryptex },
-        { "Plaintext packet with 2-byte header extension and CSRC fields",
-          srtp_2bytehdrext_cc_ref, srtp_2bytehdrext_cc_cryptex },
-        { "Plaintext packet with empty 1-byte header extension and CSRC fields",
-          srtp_1byte_empty_hdrext_cc_ref, srtp_1byte_empty_hdrext_cc_cryptex },
-        { "Plaintext packet with empty 2-byte header extension and CSRC fields",
-          srtp_2byte_empty_hdrext_cc_ref, srtp_2byte_empty_hdrext_cc_cryptex },
-    };
-    const size_t num_vectors = sizeof(vectors) / sizeof(vectors[0]);
+    status = calibrate_builtin->alloc(c, key_len, tag_len);
+    if (status == srtp_err_status_ok) {
+        (*c)->type = &calibrate_slow;
+    }
+    return status;
+}
 
-    srtp_t srtp_snd, srtp_recv;
-    size_t len, ref_len, enc_len;
-    srtp_policy_t policy;
+static srtp_err_status_t calibrate_broken_encrypt(void *state,
+                                                  const uint8_t *src,
+                                                  size_t src_len,
+                                                  uint8_t *dst,
+                                                  size_t *dst_len)
+{
+    srtp_err_status_t status;
 
-    /*
-     * create a session with a single stream using the default srtp
-     * policy and with the SSRC value 0xcafebabe
-     */
-    CHECK_OK(srtp_policy_create(&policy));
-    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
-    CHECK_OK(policy_set_key(policy, test_key));
-    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+    status = calibrate_builtin->encrypt(state, src, src_len, dst, dst_len);
+    if (*dst_len > 0) {
+        dst[0] ^= 1;
+    }
+    return status;
+}
 
-    for (size_t i = 0; i < num_vectors; ++i) {
-        uint8_t packet[1400];
-        uint8_t reference[1400];
-        uint8_t ciphertext[1400];
+static srtp_err_status_t calibrate_broken_alloc(srtp_cipher_pointer_t *c,
+                                                size_t key_len,
+                                                size_t tag_len)
+{
+    srtp_err_status_t status;
 
-        /* Initialize reference test vectors */
-        ref_len = hex_string_to_octet_string(reference, vectors[i].plaintext,
-                                             sizeof(reference)) /
-                  2;
-        enc_len = hex_string_to_octet_string(ciphertext, vectors[i].ciphertext,
-                                             sizeof(ciphertext)) /
-                  2;
+    status = calibrate_builtin->alloc(c, key_len, tag_len);
+    if (status == srtp_err_status_ok) {
+        (*c)->type = &calibrate_broken;
+    }
+    return status;
+}
 
-        /* Initialize test packet */
-        len = ref_len;
-        memcpy(packet, reference, len);
-        printf("%s\n", vectors[i].name);
-        /*
-         * protect plaintext, then compare with ciphertext
-         */
-        debug_print(mod_driver, "test vector: %s\n", vectors[i].name);
+/*
+ * srtp_test_calibrate_crypto() checks that srtp_calibrate_crypto() puts
+ * the faster of two implementations of a cipher type in use, and that
+ * an implementation that fails the self-tests cannot be added
+ */
+srtp_err_status_t srtp_test_calibrate_crypto(void)
+{
+    calibrate_builtin = srtp_get_cipher_type(SRTP_AES_ICM_128);
+    CHECK(calibrate_builtin != NULL);
+    CHECK(srtp_get_auth_type(SRTP_HMAC_SHA1) != NULL);
+
+    calibrate_slow = *calibrate_builtin;
+    calibrate_slow.alloc = calibrate_slow_alloc;
+    calibrate_slow.encrypt = calibrate_slow_encrypt;
+    calibrate_slow.description = "slow AES-128 integer counter mode";
+    calibrate_broken = *calibrate_builtin;
+    calibrate_broken.alloc = calibrate_broken_alloc;
+    calibrate_broken.encrypt = calibrate_broken_encrypt;
+    calibrate_broken.description = "broken AES-128 integer counter mode";
+
+    CHECK(srtp_add_cipher_type(&calibrate_broken, SRTP_AES_ICM_128) !=
+          srtp_err_status_ok);
+    CHECK_RETURN(srtp_add_cipher_type(&calibrate_slow, SRTP_AES_ICM_256),
+                 srtp_err_status_bad_param);
 
-        CHECK_OK(srtp_create(&srtp_snd, policy));
+    /* nothing to choose between */
+    CHECK_OK(srtp_calibrate_crypto());
+    CHECK(srtp_get_cipher_type(SRTP_AES_ICM_128) == calibrate_builtin);
 
-        CHECK_OK(call_srtp_protect(srtp_snd, packet, &len, 0));
-        CHECK(len == enc_len);
+    CHECK_OK(srtp_add_cipher_type(&calibrate_slow, SRTP_AES_ICM_128));
+    CHECK(srtp_get_cipher_type(SRTP_AES_ICM_128) == calibrate_builtin);
+    CHECK_OK(srtp_replace_cipher_type(&calibrate_slow, SRTP_AES_ICM_128));
+    CHECK(srtp_get_cipher_type(SRTP_AES_ICM_128) == &calibrate_slow);
 
-        debug_print(mod_driver, "ciphertext:\n  %s",
-                    octet_string_hex_string(packet, len));
-        debug_print(mod_driver, "ciphertext reference:\n  %s",
-                    octet_string_hex_string(ciphertext, len));
+    CHECK_OK(srtp_calibrate_crypto());
+    CHECK(srtp_get_cipher_type(SRTP_AES_ICM_128) == calibrate_builtin);
+    CHECK_OK(srtp_test_lazy_profile(srtp_profile_aes128_cm_sha1_80));
 
-        CHECK_BUFFER_EQUAL(packet, ciphertext, len);
+    /* the added implementations go with the crypto kernel */
+    CHECK_OK(srtp_shutdown());
+    CHECK_OK(srtp_init());
 
-        CHECK_OK(srtp_dealloc(srtp_snd));
+    return srtp_err_status_ok;
+}
 
-        CHECK_OK(srtp_create(&srtp_recv, policy));
+/*
+ * srtp_test_unaligned_profile() protects and unprotects RTP and RTCP
+ * packets at every offset within a word, in place and to another offset,
+ * and checks that the results are the same as for aligned packets
+ */
+static srtp_err_status_t srtp_test_unaligned_profile(srtp_profile_t profile,
+                                                     bool cryptex)
+{
+    const uint32_t ssrc = 0x1234abcd;
+    srtp_policy_t policy;
+    uint8_t *rtp, *rtcp;
+    uint8_t ref_srtp[256], ref_srtcp[256];
+    size_t rtp_len, rtcp_len, ref_srtp_len, ref_srtcp_len;
 
-        /*
-         * unprotect ciphertext, then compare with plaintext
-         */
-        CHECK_OK(call_srtp_unprotect(srtp_recv, packet, &len));
-        CHECK(len == ref_len);
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_policy_set_cryptex(policy, cryptex));
+
+    rtp = create_rtp_test_packet(83, ssrc, 1, 0, true, &rtp_len, NULL);
+    rtcp = create_rtcp_test_packet(37, ssrc, &rtcp_len, NULL);
+    CHECK(rtp != NULL && rtcp != NULL);
+
+    for (size_t off = 0; off < 8; off++) {
+        /* the output goes to another offset than the input */
+        const size_t out_off = (off * 3 + 1) % 8;
+        uint8_t in[256 + 8], out[256 + 8];
+        srtp_t snd, rcv;
+        size_t len;
+
+        CHECK_OK(srtp_create(&snd, policy));
+        CHECK_OK(srtp_create(&rcv, policy));
+
+        memcpy(in + off, rtp, rtp_len);
+        len = sizeof(in) - off;
+        CHECK_OK(srtp_protect(snd, in + off, rtp_len, in + off, &len, 0));
+        if (off == 0) {
+            memcpy(ref_srtp, in, len);
+            ref_srtp_len = len;
+        }
+        CHECK(len == ref_srtp_len);
+        CHECK_BUFFER_EQUAL(in + off, ref_srtp, len);
+
+        len = sizeof(out) - out_off;
+        CHECK_OK(srtp_unprotect(rcv, in + off, ref_srtp_len, out + out_off,
+                                &len));
+        CHECK(len == rtp_len);
+        CHECK_BUFFER_EQUAL(out + out_off, rtp, rtp_len);
+
+        memcpy(in + off, rtcp, rtcp_len);
+        len = sizeof(out) - out_off;
+        CHECK_OK(srtp_protect_rtcp(snd, in + off, rtcp_len, out + out_off,
+                                   &len, 0));
+        if (off == 0) {
+            memcpy(ref_srtcp, out + out_off, len);
+            ref_srtcp_len = len;
+        }
+        CHECK(len == ref_srtcp_len);
+        CHECK_BUFFER_EQUAL(out + out_off, ref_srtcp, len);
 
-        CHECK_BUFFER_EQUAL(packet, reference, len);
+        len = ref_srtcp_len;
+        CHECK_OK(srtp_unprotect_rtcp(rcv, out + out_off, ref_srtcp_len,
+                                     out + out_off, &len));
+        CHECK(len == rtcp_len);
+        CHECK_BUFFER_EQUAL(out + out_off, rtcp, rtcp_len);
 
-        CHECK_OK(srtp_dealloc(srtp_recv));
+        CHECK_OK(srtp_dealloc(snd));
+        CHECK_OK(srtp_dealloc(rcv));
     }
 
+    free(rtp);
+    free(rtcp);
     srtp_policy_destroy(policy);
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_test_cryptex_csrc_but_no_extension_header(void)
+srtp_err_status_t srtp_test_unaligned(void)
 {
-    // clang-format off
-    /* Plaintext packet with no header extension but CSRC fields. */
-    const char *srtp_cc_ref =
-        "820f1238"
-        "decafbad"
-        "cafebabe"
-        "0001e240"
-        "0000b26e"
-        "abababab"
-        "abababab"
-        "abababab"
-        "abababab";
-    // clang-format on
+    CHECK_OK(srtp_test_unaligned_profile(srtp_profile_aes128_cm_sha1_80,
+                                         false));
+    CHECK_OK(srtp_test_unaligned_profile(srtp_profile_aes128_cm_sha1_80,
+                                         true));
+#ifndef SRTP_NO_AES_256
+    CHECK_OK(srtp_test_unaligned_profile(srtp_profile_aes256_cm_sha1_32,
+                                         true));
+#endif
+#ifdef GCM
+    CHECK_OK(srtp_test_unaligned_profile(srtp_profile_aead_aes_128_gcm,
+                                         false));
+#ifndef SRTP_NO_AES_256
+    CHECK_OK(srtp_test_unaligned_profile(srtp_profile_aead_aes_256_gcm,
+                                         true));
+#endif
+#endif
 
-    /*
-     * create a session with a single stream using the default srtp
-     * policy and with the SSRC value 0xcafebabe
-     */
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_stream_handle() checks that packets processed with a stream
+ * handle match those of srtp_protect() and srtp_unprotect(), and that a
+ * handle is refused once its stream has been removed or replaced
+ */
+srtp_err_status_t srtp_test_stream_handle(bool thread_safe)
+{
+    const uint32_t ssrc = 0xcafebabe;
     srtp_policy_t policy;
+    srtp_t snd, snd_ref, rcv;
+    srtp_stream_handle_t snd_handle, rcv_handle;
+    uint8_t *rtp, *other;
+    uint8_t srtp[256], ref[256], out[256];
+    size_t rtp_len, other_len, srtp_len, ref_len, out_len;
+
     CHECK_OK(srtp_policy_create(&policy));
     CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
     CHECK_OK(policy_set_key(policy, test_key));
-    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    CHECK_OK(srtp_create(&snd, policy));
+    CHECK_OK(srtp_create(&snd_ref, policy));
+    CHECK_OK(srtp_create(&rcv, policy));
+    CHECK_OK(srtp_set_thread_safe(snd, thread_safe));
+    CHECK_OK(srtp_set_thread_safe(rcv, thread_safe));
 
-    srtp_t srtp_snd;
-    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_RETURN(srtp_stream_lookup(NULL, ssrc, &snd_handle),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_stream_lookup(snd, ssrc, NULL),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_stream_lookup(snd, ssrc + 1, &snd_handle),
+                 srtp_err_status_no_ctx);
+    CHECK_OK(srtp_stream_lookup(snd, ssrc, &snd_handle));
+    CHECK_OK(srtp_stream_lookup(rcv, ssrc, &rcv_handle));
+
+    for (uint16_t seq = 1; seq <= 10; seq++) {
+        rtp = create_rtp_test_packet(64 + seq, ssrc, seq, seq * 160, seq & 1,
+                                     &rtp_len, NULL);
+        CHECK(rtp != NULL);
+
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect_stream(snd, &snd_handle, rtp, rtp_len, srtp,
+                                     &srtp_len, 0));
+        ref_len = sizeof(ref);
+        CHECK_OK(srtp_protect(snd_ref, rtp, rtp_len, ref, &ref_len, 0));
+        CHECK(srtp_len == ref_len);
+        CHECK_BUFFER_EQUAL(srtp, ref, srtp_len);
+
+        out_len = sizeof(out);
+        CHECK_OK(srtp_unprotect_stream(rcv, &rcv_handle, srtp, srtp_len, out,
+                                       &out_len));
+        CHECK(out_len == rtp_len);
+        CHECK_BUFFER_EQUAL(out, rtp, rtp_len);
+
+        /* a replay is caught as by srtp_unprotect() */
+        out_len = sizeof(out);
+        CHECK_RETURN(srtp_unprotect_stream(rcv, &rcv_handle, srtp, srtp_len,
+                                           out, &out_len),
+                     srtp_err_status_replay_fail);
+        free(rtp);
+    }
+
+    /* a packet of another SSRC does not belong to the stream */
+    other = create_rtp_test_packet(64, ssrc + 1, 1, 0, false, &other_len,
+                                   NULL);
+    CHECK(other != NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_RETURN(srtp_protect_stream(snd, &snd_handle, other, other_len, srtp,
+                                     &srtp_len, 0),
+                 srtp_err_status_bad_param);
+    out_len = sizeof(out);
+    CHECK_RETURN(srtp_unprotect_stream(rcv, &rcv_handle, other, other_len,
+                                       out, &out_len),
+                 srtp_err_status_bad_param);
+    free(other);
+
+    /* handles go stale when a stream is replaced or removed */
+    rtp = create_rtp_test_packet(64, ssrc, 11, 0, false, &rtp_len, NULL);
+    CHECK(rtp != NULL);
+    CHECK_OK(srtp_stream_update(snd, policy));
+    srtp_len = sizeof(srtp);
+    CHECK_RETURN(srtp_protect_stream(snd, &snd_handle, rtp, rtp_len, srtp,
+                                     &srtp_len, 0),
+                 srtp_err_status_no_ctx);
+    CHECK_OK(srtp_stream_lookup(snd, ssrc, &snd_handle));
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect_stream(snd, &snd_handle, rtp, rtp_len, srtp,
+                                 &srtp_len, 0));
+
+    CHECK_OK(srtp_stream_remove(rcv, ssrc));
+    out_len = sizeof(out);
+    CHECK_RETURN(srtp_unprotect_stream(rcv, &rcv_handle, srtp, srtp_len, out,
+                                       &out_len),
+                 srtp_err_status_no_ctx);
+    CHECK_RETURN(srtp_stream_lookup(rcv, ssrc, &rcv_handle),
+                 srtp_err_status_no_ctx);
+    free(rtp);
 
+    CHECK_OK(srtp_dealloc(snd));
+    CHECK_OK(srtp_dealloc(snd_ref));
+    CHECK_OK(srtp_dealloc(rcv));
     srtp_policy_destroy(policy);
 
-    uint8_t packet[1400];
-    size_t packet_len =
-        hex_string_to_octet_string(packet, srtp_cc_ref, sizeof(packet)) / 2;
+    return srtp_err_status_ok;
+}
 
-    CHECK_RETURN(call_srtp_protect(srtp_snd, packet, &packet_len, 0),
-                 srtp_err_status_cryptex_err);
+/*
+ * srtp_test_protect_parsed() checks the description srtp_rtp_header_parse()
+ * gives of a header with CSRCs and an extension, that srtp_protect_parsed()
+ * protects packets like srtp_protect() with and without header extension
+ * encryption and cryptex, and that descriptions that do not fit the packet
+ * are refused
+ */
+srtp_err_status_t srtp_test_protect_parsed(void)
+{
+    const uint32_t ssrc = 0xcafebabe;
+    const uint8_t xtn[] = { 0xbe, 0xde, 0x00, 0x01, 0x10, 0xaa, 0x20, 0xbb };
+    srtp_policy_t policy;
+    srtp_t snd, snd_ref, rcv;
+    srtp_hdr_t *hdr;
+    srtp_rtp_header_desc_t desc, bad;
+    uint8_t rtp[68], srtp[128], ref[128], out[128];
+    size_t srtp_len, ref_len, out_len;
 
-    CHECK_OK(srtp_dealloc(srtp_snd));
+    /* 2 CSRCs, an extension of one word and 40 octets of payload */
+    memset(rtp, 0xab, sizeof(rtp));
+    hdr = (srtp_hdr_t *)rtp;
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->x = 1;
+    hdr->cc = 2;
+    hdr->m = 0;
+    hdr->pt = 0xf;
+    hdr->ts = htonl(160);
+    hdr->ssrc = htonl(ssrc);
+    memset(rtp + 12, 0x11, 8);
+    memcpy(rtp + 20, xtn, sizeof(xtn));
+
+    CHECK_OK(srtp_rtp_header_parse(rtp, sizeof(rtp), &desc));
+    CHECK(desc.header_len == 28);
+    CHECK(desc.csrc_count == 2);
+    CHECK(desc.xtn_offset == 20);
+    CHECK(desc.xtn_len == 8);
+    CHECK(desc.xtn_profile == 0xbede);
+    CHECK(desc.payload_len == 40);
+    CHECK_RETURN(srtp_rtp_header_parse(rtp, 24, &desc),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_rtp_header_parse(rtp, sizeof(rtp), NULL),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_rtp_header_parse(rtp, sizeof(rtp), &desc));
+
+    for (int mode = 0; mode < 3; mode++) {
+        CHECK_OK(srtp_policy_create(&policy));
+        CHECK_OK(
+            srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+        CHECK_OK(policy_set_key(policy, test_key));
+        CHECK_OK(srtp_policy_set_ssrc(policy,
+                                      (srtp_ssrc_t){ ssrc_specific, ssrc }));
+        if (mode == 1) {
+            CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(policy, 1));
+        } else if (mode == 2) {
+            CHECK_OK(srtp_policy_set_cryptex(policy, true));
+        }
+        CHECK_OK(srtp_create(&snd, policy));
+        CHECK_OK(srtp_create(&snd_ref, policy));
+        CHECK_OK(srtp_create(&rcv, policy));
+
+        for (uint16_t seq = 1; seq <= 4; seq++) {
+            hdr->seq = htons(seq);
+
+            srtp_len = sizeof(srtp);
+            CHECK_OK(srtp_protect_parsed(snd, rtp, sizeof(rtp), &desc, srtp,
+                                         &srtp_len, 0));
+            ref_len = sizeof(ref);
+            CHECK_OK(srtp_protect(snd_ref, rtp, sizeof(rtp), ref, &ref_len, 0));
+            CHECK(srtp_len == ref_len);
+            CHECK_BUFFER_EQUAL(srtp, ref, srtp_len);
+
+            out_len = sizeof(out);
+            CHECK_OK(srtp_unprotect(rcv, srtp, srtp_len, out, &out_len));
+            CHECK(out_len == sizeof(rtp));
+            CHECK_BUFFER_EQUAL(out, rtp, sizeof(rtp));
+        }
+
+        /* descriptions that do not fit the packet are refused */
+        srtp_len = sizeof(srtp);
+        CHECK_RETURN(srtp_protect_parsed(snd, rtp, sizeof(rtp), NULL, srtp,
+                                         &srtp_len, 0),
+                     srtp_err_status_bad_param);
+        bad = desc;
+        bad.csrc_count = 1;
+        CHECK_RETURN(srtp_protect_parsed(snd, rtp, sizeof(rtp), &bad, srtp,
+                                         &srtp_len, 0),
+                     srtp_err_status_bad_param);
+        bad = desc;
+        bad.xtn_len = SIZE_MAX - 3;
+        CHECK_RETURN(srtp_protect_parsed(snd, rtp, sizeof(rtp), &bad, srtp,
+                                         &srtp_len, 0),
+                     srtp_err_status_bad_param);
+        bad = desc;
+        bad.header_len += 4;
+        bad.payload_len -= 4;
+        CHECK_RETURN(srtp_protect_parsed(snd, rtp, sizeof(rtp), &bad, srtp,
+                                         &srtp_len, 0),
+                     srtp_err_status_bad_param);
+        bad = desc;
+        bad.payload_len += 4;
+        CHECK_RETURN(srtp_protect_parsed(snd, rtp, sizeof(rtp), &bad, srtp,
+                                         &srtp_len, 0),
+                     srtp_err_status_bad_param);
+
+        CHECK_OK(srtp_dealloc(snd));
+        CHECK_OK(srtp_dealloc(snd_ref));
+        CHECK_OK(srtp_dealloc(rcv));
+        srtp_policy_destroy(policy);
+    }
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_test_cryptex_disable(void)
+static void *test_alloc_func(size_t size, void *data)
 {
-    const uint32_t test_ssrc = 0xcafebabe;
-    srtp_policy_t policy;
-    srtp_t srtp_snd, srtp_recv;
+    (*(size_t *)data)++;
+    return malloc(size);
+}
 
-    CHECK_OK(srtp_policy_create(&policy));
-    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
-    CHECK_OK(srtp_policy_set_ssrc(policy,
-                                  (srtp_ssrc_t){ ssrc_specific, test_ssrc }));
-    CHECK_OK(policy_set_key(policy, test_key));
-    CHECK_OK(srtp_policy_set_cryptex(policy, true));
+static void test_free_func(void *ptr, void *data)
+{
+    (*(size_t *)data)--;
+    free(ptr);
+}
 
-    CHECK_OK(srtp_create(&srtp_snd, policy));
-    CHECK_OK(srtp_create(&srtp_recv, policy));
+/*
+ * srtp_test_allocator() checks that a custom allocator is used for all
+ * memory and that the allocation counters track it
+ */
+srtp_err_status_t srtp_test_allocator(void)
+{
+    srtp_t session;
+    srtp_policy_t policy;
+    srtp_alloc_stats_t before, after;
+    size_t outstanding = 0;
 
-    size_t packet_len;
-    uint8_t *packet = create_rtp_test_packet(100, test_ssrc, 1, 1000, true,
-                                             &packet_len, NULL);
+    CHECK_RETURN(srtp_install_allocator(test_alloc_func, NULL, &outstanding),
+                 srtp_err_status_bad_param);
 
-    uint8_t clear_text[1400];
-    memcpy(clear_text, packet, packet_len);
-    size_t clear_text_len = packet_len;
+    /* the crypto kernel holds memory while libSRTP is initialized */
+    CHECK_RETURN(
+        srtp_install_allocator(test_alloc_func, test_free_func, &outstanding),
+        srtp_err_status_fail);
 
-    CHECK_OK(call_srtp_protect(srtp_snd, packet, &packet_len, 0));
-    CHECK(packet_len > clear_text_len);
-    CHECK(memcmp(packet, clear_text, clear_text_len) != 0);
+    CHECK_OK(srtp_shutdown());
+    CHECK_OK(
+        srtp_install_allocator(test_alloc_func, test_free_func, &outstanding));
+    CHECK_OK(srtp_init());
+    CHECK(outstanding != 0);
 
-    // clear text uses original one byte header extension profile
-    CHECK(get_xtn_profile(clear_text) == 0xbede);
-    // packet uses cryptex one byte header extension profile
-    CHECK(get_xtn_profile(packet) == 0xc0de);
+    CHECK_OK(srtp_get_alloc_stats(&before));
+    CHECK(before.live_allocations == outstanding);
 
-    CHECK_OK(call_srtp_unprotect(srtp_recv, packet, &packet_len));
-    CHECK(packet_len == clear_text_len);
-    CHECK_BUFFER_EQUAL(packet, clear_text, clear_text_len);
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(srtp_create(&session, policy));
+    srtp_policy_destroy(policy);
 
-    // update squence number for next packet
-    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
-    hdr->seq = htons(ntohs(hdr->seq) + 1);
-    memcpy(clear_text, packet, packet_len);
+    CHECK_OK(srtp_get_alloc_stats(&after));
+    CHECK(after.live_bytes > before.live_bytes);
+    CHECK(after.live_allocations == outstanding);
+    CHECK(after.total_allocations > before.total_allocations);
 
-    // disable cryptex at sender only
-    CHECK_OK(srtp_policy_set_cryptex(policy, false));
-    CHECK_OK(srtp_update(srtp_snd, policy));
+    CHECK_OK(srtp_dealloc(session));
+    CHECK_OK(srtp_get_alloc_stats(&after));
+    CHECK(after.live_bytes == before.live_bytes);
+    CHECK(after.live_allocations == before.live_allocations);
 
-    CHECK_OK(call_srtp_protect(srtp_snd, packet, &packet_len, 0));
-    CHECK(packet_len > clear_text_len);
-    CHECK(memcmp(packet, clear_text, clear_text_len) != 0);
+    CHECK_OK(srtp_shutdown());
+    CHECK(outstanding == 0);
+    CHECK_OK(srtp_install_allocator(NULL, NULL, NULL));
+    CHECK_OK(srtp_init());
 
-    // both use original one byte header extension profile as cryptex is
-    // disabled
-    CHECK(get_xtn_profile(clear_text) == 0xbede);
-    CHECK(get_xtn_profile(packet) == 0xbede);
+    CHECK_RETURN(srtp_get_alloc_stats(NULL), srtp_err_status_bad_param);
 
-    // unprotect should work as cryptex is detected dynamically
-    CHECK_OK(call_srtp_unprotect(srtp_recv, packet, &packet_len));
-    CHECK(packet_len == clear_text_len);
-    CHECK_BUFFER_EQUAL(packet, clear_text, clear_text_len);
+    return srtp_err_status_ok;
+}
 
-    free(packet);
-    CHECK_OK(srtp_dealloc(srtp_snd));
-    CHECK_OK(srtp_dealloc(srtp_recv));
-    srtp_policy_destroy(policy);
+/*
+ * test_node_allocs_t counts the allocations made on each NUMA node by
+ * test_node_alloc_func(), with those not bound to a node in any
+ */
+typedef struct {
+    size_t outstanding;
+    size_t any;
+    size_t on_node[2];
+} test_node_allocs_t;
 
-    return srtp_err_status_ok;
+static void *test_node_alloc_func(size_t size, int node, void *data)
+{
+    test_node_allocs_t *allocs = (test_node_allocs_t *)data;
+
+    if (node == SRTP_NUMA_NODE_ANY) {
+        allocs->any++;
+    } else if (node >= 0 && node < 2) {
+        allocs->on_node[node]++;
+    } else {
+        return NULL;
+    }
+    allocs->outstanding++;
+    return malloc(size);
 }
 
-srtp_err_status_t srtp_test_missing_session_keys(void)
+static void test_node_free_func(void *ptr, void *data)
 {
-    // Not sure if this test is valid as this is not a state that should be
-    // possible to reach with the public API.
+    ((test_node_allocs_t *)data)->outstanding--;
+    free(ptr);
+}
 
-    srtp_t srtp_receiver;
+/*
+ * srtp_test_numa_node() checks that the allocations of a session go to
+ * the node it was created on or migrated to, and that its streams carry
+ * on after a migration
+ */
+srtp_err_status_t srtp_test_numa_node(void)
+{
+    srtp_t srtp_snd, srtp_recv;
     srtp_policy_t policy;
-    srtp_stream_ctx_t *stream;
-    srtp_session_keys_t *session_keys;
-    size_t num_master_keys;
-    uint8_t *packet;
-    size_t packet_len;
-    size_t buffer_len;
+    test_node_allocs_t allocs;
+    uint8_t *pkt, *replay;
+    size_t len, buffer_len;
+
+    memset(&allocs, 0, sizeof(allocs));
+    CHECK_RETURN(srtp_install_node_allocator(test_node_alloc_func, NULL,
+                                             &allocs),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_shutdown());
+    CHECK_OK(srtp_install_node_allocator(test_node_alloc_func,
+                                         test_node_free_func, &allocs));
+    CHECK_OK(srtp_init());
+
+    CHECK_RETURN(srtp_create_on_node(&srtp_snd, NULL, -2),
+                 srtp_err_status_bad_param);
 
     CHECK_OK(srtp_policy_create(&policy));
-    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
-    CHECK_OK(
-        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
     CHECK_OK(policy_set_key(policy, test_key));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
 
-    CHECK_OK(srtp_create(&srtp_receiver, policy));
-    CHECK(srtp_receiver->stream_template != NULL);
+    /* everything allocated for the session goes to its node */
+    allocs.any = 0;
+    CHECK_OK(srtp_create_on_node(&srtp_snd, policy, 1));
+    CHECK(allocs.any == 0);
+    CHECK(allocs.on_node[1] != 0);
 
-    stream = srtp_receiver->stream_template;
-    session_keys = stream->session_keys;
-    num_master_keys = stream->num_master_keys;
-    stream->session_keys = NULL;
-    stream->num_master_keys = 0;
+    /* a session with streams can only be migrated if it is exportable */
+    CHECK_RETURN(srtp_session_migrate(srtp_snd, 0), srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_session_migrate(NULL, 0), srtp_err_status_bad_param);
 
-    packet = create_rtp_test_packet(0, 0xcafebabe, 1, 1, false, &packet_len,
-                                    &buffer_len);
-    packet_len = buffer_len;
-    CHECK_RETURN(call_srtp_unprotect2(srtp_receiver, packet, sizeof(srtp_hdr_t),
-                                      &packet_len),
-                 srtp_err_status_no_ctx);
+    CHECK_OK(srtp_create_on_node(&srtp_recv, NULL, 1));
+    CHECK_OK(srtp_session_migrate(srtp_recv, 0));
+    CHECK_OK(srtp_set_exportable(srtp_recv, true));
+    CHECK_OK(
+        srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_inbound, 0 }));
+    allocs.on_node[0] = 0;
+    allocs.on_node[1] = 0;
+    CHECK_OK(srtp_stream_add(srtp_recv, policy));
+    CHECK(allocs.on_node[0] != 0);
+    CHECK(allocs.on_node[1] == 0);
+    srtp_policy_destroy(policy);
 
-    stream->session_keys = session_keys;
-    stream->num_master_keys = num_master_keys;
+    pkt = create_rtp_test_packet(64, 0x1234, 1, 0, false, &len, &buffer_len);
+    replay = create_rtp_test_packet(64, 0x1234, 1, 0, false, &len, NULL);
+    allocs.any = 0;
+    CHECK_OK(srtp_protect(srtp_snd, pkt, len, pkt, &buffer_len, 0));
+    CHECK(allocs.any == 0);
+    memcpy(replay, pkt, buffer_len);
+    len = buffer_len;
+    CHECK_OK(srtp_unprotect(srtp_recv, pkt, len, pkt, &len));
+
+    /* the streams move to the new node with their replay databases */
+    allocs.on_node[0] = 0;
+    allocs.on_node[1] = 0;
+    CHECK_OK(srtp_session_migrate(srtp_recv, 1));
+    CHECK(allocs.on_node[0] == 0);
+    CHECK(allocs.on_node[1] != 0);
+    len = buffer_len;
+    CHECK_RETURN(srtp_unprotect(srtp_recv, replay, len, replay, &len),
+                 srtp_err_status_replay_fail);
+    CHECK_OK(srtp_test_send_and_receive(srtp_snd, srtp_recv, 0x1234, 2));
+    CHECK(allocs.on_node[0] == 0);
+    free(pkt);
+    free(replay);
 
-    free(packet);
-    CHECK_OK(srtp_dealloc(srtp_receiver));
-    srtp_policy_destroy(policy);
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+
+    CHECK_OK(srtp_shutdown());
+    CHECK(allocs.outstanding == 0);
+    CHECK_OK(srtp_install_allocator(NULL, NULL, NULL));
+    CHECK_OK(srtp_init());
 
     return srtp_err_status_ok;
 }
@@ -3893,14 +8847,6 @@ srtp_err_status_t srtp_validate_gcm_cryptex(void)
          */
         debug_print(mod_driver, "test vector: %s\n", vectors[i].name);
 
-        const srtp_hdr_t *hdr = (const srtp_hdr_t *)reference;
-        if (use_srtp_not_in_place_io_api && hdr->cc) {
-            // the combination of cryptex, cc, GCM & not inplace is not
-            // supported
-            CHECK_RETURN(call_srtp_protect(srtp_snd, packet, &len, 0),
-                         srtp_err_status_cryptex_err);
-            continue;
-        }
         CHECK_OK(call_srtp_protect(srtp_snd, packet, &len, 0));
         CHECK(len == enc_len);
 
@@ -4191,6 +9137,112 @@ srtp_err_status_t srtp_validate_encrypted_extensions_headers_gcm(void)
     return srtp_err_status_ok;
 }
 
+/*
+ * build a packet with a two-byte header extension block of 304 bytes:
+ * element 1 with 200 bytes of data followed by element 3 with 100 bytes,
+ * so that the keystream for element 3 starts in the first 256 bytes and
+ * ends past them
+ */
+static size_t srtp_build_long_xtn_packet(uint8_t *packet)
+{
+    const uint8_t header[16] = { 0x90, 0x0f, 0x12, 0x34, 0xde, 0xca,
+                                 0xfb, 0xad, 0xca, 0xfe, 0xba, 0xbe,
+                                 0x10, 0x00, 0x00, 76 }; /* 304 / 4 */
+    size_t len = sizeof(header);
+
+    memcpy(packet, header, len);
+    packet[len++] = 1;
+    packet[len++] = 200;
+    memset(packet + len, 0x11, 200);
+    len += 200;
+    packet[len++] = 3;
+    packet[len++] = 100;
+    memset(packet + len, 0x33, 100);
+    len += 100;
+    memset(packet + len, 0xab, 16);
+    return len + 16;
+}
+
+static srtp_err_status_t srtp_protect_long_xtn_packet(const uint8_t *ids,
+                                                      size_t id_count,
+                                                      uint8_t *packet,
+                                                      size_t *len,
+                                                      bool round_trip)
+{
+    uint8_t key[30] = { 0 };
+    srtp_policy_t policy;
+    srtp_t srtp_snd, srtp_recv;
+    uint8_t plain[400];
+    size_t plain_len = srtp_build_long_xtn_packet(plain);
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy,
+                                  (srtp_ssrc_t){ ssrc_specific, 0xcafebabe }));
+    CHECK_OK(policy_set_key(policy, key));
+    for (size_t i = 0; i < id_count; i++) {
+        CHECK_OK(srtp_policy_add_enc_hdr_xtnd_id(policy, ids[i]));
+    }
+    CHECK_OK(srtp_create(&srtp_snd, policy));
+    CHECK_OK(srtp_create(&srtp_recv, policy));
+
+    memcpy(packet, plain, plain_len);
+    *len = plain_len;
+    CHECK_OK(call_srtp_protect(srtp_snd, packet, len, 0));
+
+    if (round_trip) {
+        uint8_t copy[400];
+        size_t copy_len = *len;
+
+        memcpy(copy, packet, copy_len);
+        CHECK_OK(call_srtp_unprotect(srtp_recv, copy, &copy_len));
+        CHECK(copy_len == plain_len);
+        CHECK_BUFFER_EQUAL(copy, plain, plain_len);
+    }
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_encrypted_extensions_headers_long() checks that the
+ * keystream used for an element only depends on its position in the
+ * block, also when the block is longer than the keystream buffer
+ */
+srtp_err_status_t srtp_test_encrypted_extensions_headers_long(void)
+{
+    const uint8_t only_three[] = { 3 };
+    const uint8_t both[] = { 1, 3 };
+    uint8_t plain[400];
+    uint8_t a[400], b[400];
+    size_t a_len, b_len;
+    const size_t one = 16 + 2;
+    const size_t three = one + 200 + 2;
+
+    srtp_build_long_xtn_packet(plain);
+    CHECK_OK(srtp_protect_long_xtn_packet(only_three, 1, a, &a_len, true));
+    CHECK_OK(srtp_protect_long_xtn_packet(both, 2, b, &b_len, true));
+    CHECK(a_len == b_len);
+
+    /* element 1 is only encrypted when asked for */
+    CHECK_BUFFER_EQUAL(a + one, plain + one, 200);
+    CHECK(memcmp(b + one, plain + one, 200) != 0);
+
+    /* element 3 is encrypted the same either way */
+    CHECK(memcmp(a + three, plain + three, 100) != 0);
+    CHECK_BUFFER_EQUAL(a + three, b + three, 100);
+
+    /* the element headers are never touched */
+    CHECK_BUFFER_EQUAL(a + one - 2, plain + one - 2, 2);
+    CHECK_BUFFER_EQUAL(a + three - 2, plain + three - 2, 2);
+
+    return srtp_err_status_ok;
+}
+
+#ifndef SRTP_NO_AES_192
 /*
  * srtp_validate_aes_192() verifies the correctness of libsrtp by comparing
  * some computed packets against some pre-computed reference values.
@@ -4288,7 +9340,9 @@ srtp_err_status_t srtp_validate_aes_192(void)
     return srtp_err_status_ok;
 }
 #endif
+#endif
 
+#ifndef SRTP_NO_AES_256
 /*
  * srtp_validate_aes_256() verifies the correctness of libsrtp by comparing
  * some computed packets against some pre-computed reference values.
@@ -4403,6 +9457,7 @@ srtp_err_status_t srtp_validate_aes_256(void)
 
     return srtp_err_status_ok;
 }
+#endif
 
 srtp_err_status_t srtp_test_empty_payload(void)
 {
@@ -4895,6 +9950,160 @@ srtp_err_status_t srtp_test_update_mki(void)
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_test_many_mki_create(srtp, num_keys, mki_size) creates a session
+ * with a stream for SSRC 1 that has num_keys master keys, key i has an
+ * MKI of mki_size octets that is i in network byte order
+ */
+static srtp_err_status_t srtp_test_many_mki_create(srtp_t *srtp,
+                                                   size_t num_keys,
+                                                   size_t mki_size)
+{
+    srtp_policy_t policy;
+    uint8_t mki[TEST_MKI_ID_SIZE] = { 0 };
+
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes128_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_policy_use_mki(policy, mki_size));
+    for (size_t i = 0; i < num_keys; i++) {
+        mki[mki_size - 1] = (uint8_t)i;
+        if (mki_size > 1) {
+            mki[mki_size - 2] = (uint8_t)(i >> 8);
+        }
+        CHECK_OK(srtp_policy_add_key(policy, test_key, SRTP_AES_128_KEY_LEN,
+                                     test_key + SRTP_AES_128_KEY_LEN,
+                                     SRTP_SALT_LEN, mki, mki_size));
+    }
+    CHECK_OK(srtp_create(srtp, policy));
+    srtp_policy_destroy(policy);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_many_mki_protect(srtp, seq, mki_index, len) returns a packet
+ * for SSRC 1 protected with the given master key, or NULL on failure
+ */
+static uint8_t *srtp_test_many_mki_protect(srtp_t srtp,
+                                           uint16_t seq,
+                                           size_t mki_index,
+                                           size_t *len)
+{
+    uint8_t *pkt;
+    size_t buffer_len;
+
+    pkt = create_rtp_test_packet(64, 1, seq, 0, false, len, &buffer_len);
+    if (srtp_protect(srtp, pkt, *len, pkt, &buffer_len, mki_index)) {
+        free(pkt);
+        return NULL;
+    }
+    *len = buffer_len;
+
+    return pkt;
+}
+
+static srtp_err_status_t srtp_test_many_mki_size(size_t mki_size)
+{
+    const size_t num_keys =
+        mki_size == 1 && SRTP_MAX_NUM_MASTER_KEYS > 255
+            ? 255
+            : SRTP_MAX_NUM_MASTER_KEYS;
+    /* the MKI follows the payload and comes before the 10 octet tag */
+    const size_t tag_len = 10;
+    srtp_t srtp_snd, srtp_recv;
+    uint8_t *pkt;
+    size_t len;
+
+    CHECK_OK(srtp_test_many_mki_create(&srtp_snd, num_keys, mki_size));
+    CHECK_OK(srtp_test_many_mki_create(&srtp_recv, num_keys, mki_size));
+
+    /* the receiver finds every key, in any order */
+    for (size_t i = 0; i < num_keys; i++) {
+        size_t mki_index = num_keys - 1 - i;
+        pkt = srtp_test_many_mki_protect(srtp_snd, (uint16_t)i, mki_index,
+                                         &len);
+        CHECK(pkt != NULL);
+        CHECK_OK(srtp_unprotect(srtp_recv, pkt, len, pkt, &len));
+        free(pkt);
+    }
+
+    /* an MKI that is not one of the keys is rejected */
+    pkt = srtp_test_many_mki_protect(srtp_snd, (uint16_t)num_keys, 0, &len);
+    CHECK(pkt != NULL);
+    pkt[len - tag_len - mki_size] = 0xff;
+    CHECK_RETURN(srtp_unprotect(srtp_recv, pkt, len, pkt, &len),
+                 srtp_err_status_bad_mki);
+    free(pkt);
+
+    CHECK_OK(srtp_dealloc(srtp_snd));
+    CHECK_OK(srtp_dealloc(srtp_recv));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_many_mki() checks that a stream with the maximum number of
+ * master keys finds the key for every MKI, both for one octet MKIs and
+ * for longer ones
+ */
+srtp_err_status_t srtp_test_many_mki(void)
+{
+    CHECK_OK(srtp_test_many_mki_size(1));
+    CHECK_OK(srtp_test_many_mki_size(TEST_MKI_ID_SIZE));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_mki_lookups_per_second(num_keys) returns the number of packets
+ * with an unknown MKI that srtp_unprotect() rejects per second, on a
+ * stream with num_keys master keys; that is dominated by the MKI lookup
+ */
+double srtp_mki_lookups_per_second(size_t num_keys)
+{
+    const size_t num_lookups = 1000000;
+    const size_t tag_len = 10;
+    srtp_t srtp_snd, srtp_recv;
+    uint8_t *pkt;
+    size_t len;
+    size_t rejected = 0;
+    clock_t timer;
+
+    if (srtp_test_many_mki_create(&srtp_snd, num_keys, TEST_MKI_ID_SIZE)) {
+        return 0;
+    }
+    if (srtp_test_many_mki_create(&srtp_recv, num_keys, TEST_MKI_ID_SIZE)) {
+        return 0;
+    }
+
+    pkt = srtp_test_many_mki_protect(srtp_snd, 0, 0, &len);
+    if (pkt == NULL) {
+        return 0;
+    }
+    pkt[len - tag_len - 1] = 0xff;
+
+    timer = clock();
+    for (size_t i = 0; i < num_lookups; i++) {
+        size_t out_len = len;
+        if (srtp_unprotect(srtp_recv, pkt, len, pkt, &out_len) ==
+            srtp_err_status_bad_mki) {
+            rejected++;
+        }
+    }
+    timer = clock() - timer;
+
+    free(pkt);
+    srtp_dealloc(srtp_snd);
+    srtp_dealloc(srtp_recv);
+
+    if (rejected != num_lookups || timer == 0) {
+        return 0;
+    }
+
+    return (double)num_lookups * CLOCKS_PER_SEC / timer;
+}
+
 srtp_err_status_t srtp_test_setup_protect_trailer_streams(
     srtp_t *srtp_send,
     srtp_t *srtp_send_mki,
@@ -5109,6 +10318,98 @@ srtp_err_status_t srtp_test_protect_rtcp_trailer_length(void)
     return srtp_err_status_ok;
 }
 
+static srtp_err_status_t srtp_test_trailer_policy(srtp_policy_t *policy,
+                                                  srtp_profile_t profile,
+                                                  uint32_t ssrc,
+                                                  bool use_mki)
+{
+    CHECK_OK(srtp_policy_create(policy));
+    CHECK_OK(srtp_policy_set_profile(*policy, profile));
+    CHECK_OK(
+        srtp_policy_set_ssrc(*policy, (srtp_ssrc_t){ ssrc_specific, ssrc }));
+    if (use_mki) {
+        CHECK_OK(srtp_policy_use_mki(*policy, TEST_MKI_ID_SIZE));
+        CHECK_OK(policy_add_keys(*policy, test_keys, 2));
+    } else {
+        CHECK_OK(policy_set_key(*policy, test_key));
+    }
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_protect_trailer_length_changes() checks that the session wide
+ * trailer lengths follow streams being added, removed and updated, and
+ * the lengths of single streams
+ */
+srtp_err_status_t srtp_test_protect_trailer_length_changes(void)
+{
+    srtp_t srtp;
+    srtp_policy_t policy_32, policy_80, policy_mki;
+    size_t length = 0;
+
+    CHECK_OK(srtp_test_trailer_policy(
+        &policy_32, srtp_profile_aes128_cm_sha1_32, 1, false));
+    CHECK_OK(srtp_test_trailer_policy(
+        &policy_80, srtp_profile_aes128_cm_sha1_80, 2, false));
+    CHECK_OK(srtp_test_trailer_policy(
+        &policy_mki, srtp_profile_aes128_cm_sha1_32, 3, true));
+
+    CHECK_OK(srtp_create(&srtp, policy_32));
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 0, &length));
+    CHECK(length == 4);
+
+    /* adding a stream with a longer tag raises the cached length */
+    CHECK_OK(srtp_stream_add(srtp, policy_80));
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 0, &length));
+    CHECK(length == 10);
+    CHECK_OK(srtp_get_protect_rtcp_trailer_length(srtp, 0, &length));
+    CHECK(length == 14);
+
+    /* and removing it lowers it again */
+    CHECK_OK(srtp_stream_remove(srtp, 2));
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 0, &length));
+    CHECK(length == 4);
+
+    /* the MKI stream only counts for the indexes of its keys */
+    CHECK_OK(srtp_stream_add(srtp, policy_mki));
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 0, &length));
+    CHECK(length == 4 + TEST_MKI_ID_SIZE);
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 1, &length));
+    CHECK(length == 4 + TEST_MKI_ID_SIZE);
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 2, &length));
+    CHECK(length == 4);
+    CHECK_OK(srtp_stream_remove(srtp, 3));
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 1, &length));
+    CHECK(length == 4);
+
+    /* an update can change the tag length of a stream */
+    CHECK_OK(srtp_policy_set_ssrc(policy_80,
+                                  (srtp_ssrc_t){ ssrc_specific, 1 }));
+    CHECK_OK(srtp_stream_update(srtp, policy_80));
+    CHECK_OK(srtp_get_protect_trailer_length(srtp, 0, &length));
+    CHECK(length == 10);
+
+    /* the lengths of single streams */
+    CHECK_OK(srtp_stream_add(srtp, policy_mki));
+    CHECK_OK(srtp_stream_get_protect_trailer_length(srtp, 1, 0, &length));
+    CHECK(length == 10);
+    CHECK_OK(srtp_stream_get_protect_rtcp_trailer_length(srtp, 1, 0, &length));
+    CHECK(length == 14);
+    CHECK_OK(srtp_stream_get_protect_trailer_length(srtp, 3, 1, &length));
+    CHECK(length == 4 + TEST_MKI_ID_SIZE);
+    CHECK_RETURN(srtp_stream_get_protect_trailer_length(srtp, 3, 2, &length),
+                 srtp_err_status_bad_mki);
+    CHECK_RETURN(srtp_stream_get_protect_trailer_length(srtp, 4, 0, &length),
+                 srtp_err_status_bad_param);
+
+    CHECK_OK(srtp_dealloc(srtp));
+    srtp_policy_destroy(policy_32);
+    srtp_policy_destroy(policy_80);
+    srtp_policy_destroy(policy_mki);
+
+    return srtp_err_status_ok;
+}
+
 srtp_err_status_t srtp_test_out_of_order_after_rollover(void)
 {
     srtp_err_status_t status;
@@ -5950,6 +11251,7 @@ const test_policy_t aes128_gcm_cauth_policy = {
     TEST_MKI_ID_SIZE,
 };
 
+#ifndef SRTP_NO_AES_256
 const test_policy_t aes256_gcm_policy = {
     { ssrc_any_outbound, 0 },
     srtp_profile_aead_aes_256_gcm,
@@ -5970,6 +11272,9 @@ const test_policy_t aes256_gcm_cauth_policy = {
     TEST_MKI_ID_SIZE,
 };
 #endif
+#endif
+
+#ifndef SRTP_NO_AES_256
 
 const test_policy_t null_policy = {
     { ssrc_any_outbound, 0 },
@@ -6036,6 +11341,7 @@ const test_policy_t aes_256_hmac_32_policy = {
     2,
     TEST_MKI_ID_SIZE,
 };
+#endif
 
 const test_policy_t hmac_only_with_no_master_key = { { ssrc_any_outbound, 0 },
                                                      srtp_profile_null_sha1_32,
@@ -6063,12 +11369,16 @@ const test_policy_t *policy_array[] = {
 #ifdef GCM
     &aes128_gcm_policy,
     &aes128_gcm_cauth_policy,
+#ifndef SRTP_NO_AES_256
     &aes256_gcm_policy,
     &aes256_gcm_cauth_policy,
 #endif
+#endif
+#ifndef SRTP_NO_AES_256
     &null_policy, //what happens ?
     &aes_256_hmac_policy,
     &aes_256_hmac_32_policy,
+#endif
     NULL
 };
 // clang-format on
@@ -6134,6 +11444,130 @@ bool stream_list_test_remove_all_cb(srtp_stream_t stream, void *data)
     return true;
 }
 
+static uint32_t stream_list_test_ssrc(size_t i)
+{
+    /* multiplication by an odd constant is a bijection, so SSRCs are unique */
+    return (uint32_t)i * 0x9e3779b1U;
+}
+
+bool stream_list_test_remove_odd_cb(srtp_stream_t stream, void *data)
+{
+    srtp_stream_list_t *list = (srtp_stream_list_t *)data;
+    if (stream->ssrc & 1) {
+        srtp_stream_list_remove(*list, stream);
+        stream_list_test_free_stream(stream);
+    }
+    return true;
+}
+
+static srtp_err_status_t stream_list_test_scale(size_t num_streams)
+{
+    srtp_stream_list_t list;
+    size_t num_odd = 0;
+
+    if (srtp_stream_list_alloc(&list)) {
+        return srtp_err_status_fail;
+    }
+
+    for (size_t i = 0; i < num_streams; i++) {
+        uint32_t ssrc = stream_list_test_ssrc(i);
+        if (srtp_stream_list_insert(list,
+                                    stream_list_test_create_stream(ssrc))) {
+            return srtp_err_status_fail;
+        }
+        if (ssrc & 1) {
+            num_odd++;
+        }
+    }
+
+    for (size_t i = 0; i < num_streams; i++) {
+        uint32_t ssrc = stream_list_test_ssrc(i);
+        srtp_stream_t stream = srtp_stream_list_get(list, ssrc);
+        if (stream == NULL || stream->ssrc != ssrc) {
+            return srtp_err_status_fail;
+        }
+    }
+
+    /* find not in list */
+    if (srtp_stream_list_get(list, stream_list_test_ssrc(num_streams))) {
+        return srtp_err_status_fail;
+    }
+
+    size_t count = 0;
+    srtp_stream_list_for_each(list, stream_list_test_count_cb, &count);
+    if (count != num_streams) {
+        return srtp_err_status_fail;
+    }
+
+    /* remove every other stream while iterating */
+    srtp_stream_list_for_each(list, stream_list_test_remove_odd_cb, &list);
+
+    count = 0;
+    srtp_stream_list_for_each(list, stream_list_test_count_cb, &count);
+    if (count != num_streams - num_odd) {
+        return srtp_err_status_fail;
+    }
+
+    for (size_t i = 0; i < num_streams; i++) {
+        uint32_t ssrc = stream_list_test_ssrc(i);
+        srtp_stream_t stream = srtp_stream_list_get(list, ssrc);
+        if ((ssrc & 1) != (stream == NULL)) {
+            return srtp_err_status_fail;
+        }
+    }
+
+    srtp_stream_list_for_each(list, stream_list_test_remove_all_cb, &list);
+
+    if (srtp_stream_list_dealloc(list)) {
+        return srtp_err_status_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_list_lookups_per_second(num_streams) returns the number of
+ * srtp_stream_list_get() calls per second on a list holding num_streams
+ * streams
+ */
+double srtp_stream_list_lookups_per_second(size_t num_streams)
+{
+    srtp_stream_list_t list;
+    const size_t num_lookups = 1000000;
+    size_t found = 0;
+    clock_t timer;
+
+    if (srtp_stream_list_alloc(&list)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < num_streams; i++) {
+        uint32_t ssrc = stream_list_test_ssrc(i);
+        if (srtp_stream_list_insert(list,
+                                    stream_list_test_create_stream(ssrc))) {
+            return 0;
+        }
+    }
+
+    timer = clock();
+    for (size_t i = 0; i < num_lookups; i++) {
+        if (srtp_stream_list_get(list,
+                                 stream_list_test_ssrc(i % num_streams))) {
+            found++;
+        }
+    }
+    timer = clock() - timer;
+
+    srtp_stream_list_for_each(list, stream_list_test_remove_all_cb, &list);
+    srtp_stream_list_dealloc(list);
+
+    if (found != num_lookups || timer == 0) {
+        return 0;
+    }
+
+    return (double)num_lookups * CLOCKS_PER_SEC / timer;
+}
+
 srtp_err_status_t srtp_stream_list_test(void)
 {
     srtp_stream_list_t list;
@@ -6238,6 +11672,13 @@ srtp_err_status_t srtp_stream_list_test(void)
         return srtp_err_status_fail;
     }
 
+    /* scale from a single stream up to a large conference */
+    for (size_t n = 1; n <= STREAM_LIST_TEST_MAX_STREAMS; n *= 10) {
+        if (stream_list_test_scale(n)) {
+            return srtp_err_status_fail;
+        }
+    }
+
     return srtp_err_status_ok;
 }
 
@@ -0,0 +1,355 @@
+/*
+ * test_srtp_cpp.cpp
+ *
+ * Unit tests for the C++ interface in srtp.hpp
+ *
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "cutest.h"
+
+#include "srtp.hpp"
+#include "util.h"
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+const std::array<std::uint8_t, 32> master_key = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0, 0xd6, 0x4f, 0xa3,
+    0x2c, 0x06, 0xde, 0x41, 0x39, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60,
+    0x70, 0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf0, 0x00,
+};
+const std::array<std::uint8_t, 14> master_salt = {
+    0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35, 0x77,
+    0x93, 0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6,
+};
+const std::array<std::uint8_t, 4> mki = { 0x01, 0x02, 0x03, 0x04 };
+
+constexpr std::size_t rtp_len = 40;
+constexpr std::size_t rtcp_len = 24;
+
+/* the buffers can be sized from the profile at compile time */
+using rtp_buffer = std::array<
+    std::uint8_t,
+    rtp_len + srtp::rtp_trailer_length(srtp_profile_aes128_cm_sha1_80)>;
+using rtcp_buffer = std::array<
+    std::uint8_t,
+    rtcp_len + srtp::rtcp_trailer_length(srtp_profile_aes128_cm_sha1_80)>;
+
+static_assert(srtp::rtp_trailer_length(srtp_profile_aes128_cm_sha1_32) == 4);
+static_assert(srtp::rtcp_trailer_length(srtp_profile_aes128_cm_sha1_32) ==
+              14);
+static_assert(srtp::rtp_trailer_length(srtp_profile_aead_aes_128_gcm, 4) ==
+              20);
+static_assert(srtp::rtp_trailer_length(srtp_profile_null_null) == 0);
+static_assert(srtp::rtp_trailer_length(srtp_profile_aes256_cm_sha1_80) <=
+              SRTP_MAX_TRAILER_LEN);
+
+const std::array<srtp_profile_t, 11> all_profiles = {
+    srtp_profile_null_null,         srtp_profile_aes128_cm_sha1_80,
+    srtp_profile_aes128_cm_sha1_32, srtp_profile_aes192_cm_sha1_80,
+    srtp_profile_aes192_cm_sha1_32, srtp_profile_aes256_cm_sha1_80,
+    srtp_profile_aes256_cm_sha1_32, srtp_profile_null_sha1_80,
+    srtp_profile_null_sha1_32,      srtp_profile_aead_aes_128_gcm,
+    srtp_profile_aead_aes_256_gcm,
+};
+
+srtp::Policy make_policy(
+    srtp_ssrc_type_t type,
+    srtp_profile_t profile = srtp_profile_aes128_cm_sha1_80,
+    bool use_mki = false)
+{
+    srtp::Policy policy;
+    CHECK_OK(srtp::Policy::create(policy));
+    CHECK_OK(policy.set_ssrc(srtp_ssrc_t{ type, 0 }));
+    CHECK_OK(policy.set_profile(profile));
+    if (profile == srtp_profile_null_null) {
+        return policy;
+    }
+    std::span<const std::uint8_t> key(master_key);
+    std::span<const std::uint8_t> salt(master_salt);
+    std::span<const std::uint8_t> key_mki;
+    if (use_mki) {
+        CHECK_OK(policy.use_mki(mki.size()));
+        key_mki = mki;
+    }
+    CHECK_OK(policy.add_key(
+        key.first(srtp_profile_get_master_key_length(profile)),
+        salt.first(srtp_profile_get_master_salt_length(profile)), key_mki));
+    return policy;
+}
+
+void fill_rtp(std::span<std::uint8_t> packet, std::uint16_t seq)
+{
+    for (std::size_t i = 0; i < packet.size(); i++) {
+        packet[i] = static_cast<std::uint8_t>(i);
+    }
+    packet[0] = 0x80;
+    packet[1] = 0x0f;
+    packet[2] = static_cast<std::uint8_t>(seq >> 8);
+    packet[3] = static_cast<std::uint8_t>(seq);
+    packet[8] = 0xca;
+    packet[9] = 0xfe;
+    packet[10] = 0xba;
+    packet[11] = 0xbe;
+}
+
+void fill_rtcp(std::span<std::uint8_t> packet)
+{
+    for (std::size_t i = 0; i < packet.size(); i++) {
+        packet[i] = static_cast<std::uint8_t>(i);
+    }
+    packet[0] = 0x81;
+    packet[1] = 0xc9; /* receiver report */
+    packet[2] = 0x00;
+    packet[3] = static_cast<std::uint8_t>(packet.size() / 4 - 1);
+    packet[4] = 0xca;
+    packet[5] = 0xfe;
+    packet[6] = 0xba;
+    packet[7] = 0xbe;
+}
+
+void srtp_cpp_trailer_lengths_match_sessions()
+{
+    CHECK_OK(srtp_init());
+    for (srtp_profile_t profile : all_profiles) {
+        srtp::Policy probe;
+        CHECK_OK(srtp::Policy::create(probe));
+        if (probe.set_profile(profile) != srtp_err_status_ok) {
+            continue; /* not built */
+        }
+        for (bool use_mki : { false, true }) {
+            if (use_mki && profile == srtp_profile_null_null) {
+                continue;
+            }
+            srtp::Policy policy =
+                make_policy(ssrc_any_outbound, profile, use_mki);
+            srtp::Session session;
+            CHECK_OK(srtp::Session::create(session, policy));
+
+            std::size_t mki_len = use_mki ? mki.size() : 0;
+            std::size_t length = 0;
+            CHECK_OK(
+                srtp_get_protect_trailer_length(session.get(), 0, &length));
+            CHECK(length == srtp::rtp_trailer_length(profile, mki_len));
+            CHECK_OK(srtp_get_protect_rtcp_trailer_length(session.get(), 0,
+                                                          &length));
+            CHECK(length == srtp::rtcp_trailer_length(profile, mki_len));
+        }
+    }
+    CHECK_OK(srtp_shutdown());
+}
+
+void srtp_cpp_protect_unprotect()
+{
+    CHECK_OK(srtp_init());
+    srtp::Session sender;
+    srtp::Session receiver;
+    CHECK_OK(srtp::Session::create(sender, make_policy(ssrc_any_outbound)));
+    CHECK_OK(srtp::Session::create(receiver, make_policy(ssrc_any_inbound)));
+
+    /* out of place */
+    std::array<std::uint8_t, rtp_len> rtp;
+    fill_rtp(rtp, 1);
+    rtp_buffer srtp;
+    srtp::Result protected_rtp = sender.protect(rtp, srtp);
+    CHECK(static_cast<bool>(protected_rtp));
+    CHECK(protected_rtp.packet.data() == srtp.data());
+    CHECK(protected_rtp.packet.size() == srtp.size());
+
+    rtp_buffer plain;
+    srtp::Result unprotected_rtp =
+        receiver.unprotect(protected_rtp.packet, plain);
+    CHECK(static_cast<bool>(unprotected_rtp));
+    CHECK(unprotected_rtp.packet.size() == rtp_len);
+    CHECK_BUFFER_EQUAL(unprotected_rtp.packet.data(), rtp.data(), rtp_len);
+
+    /* in place */
+    rtp_buffer buffer;
+    fill_rtp(buffer, 2);
+    protected_rtp = sender.protect_in_place(buffer, rtp_len);
+    CHECK(static_cast<bool>(protected_rtp));
+    CHECK(protected_rtp.packet.size() == buffer.size());
+    unprotected_rtp = receiver.unprotect_in_place(protected_rtp.packet);
+    CHECK(static_cast<bool>(unprotected_rtp));
+    CHECK(unprotected_rtp.packet.data() == buffer.data());
+    fill_rtp(rtp, 2);
+    CHECK_BUFFER_EQUAL(buffer.data(), rtp.data(), rtp_len);
+
+    /* a replay is reported in the result */
+    unprotected_rtp = receiver.unprotect(srtp, plain);
+    CHECK_RETURN(unprotected_rtp.status, srtp_err_status_replay_fail);
+    CHECK(unprotected_rtp.packet.empty());
+
+    /* rtcp */
+    rtcp_buffer rtcp_packet;
+    fill_rtcp(std::span(rtcp_packet).first(rtcp_len));
+    std::array<std::uint8_t, rtcp_len> rtcp;
+    std::copy_n(rtcp_packet.begin(), rtcp_len, rtcp.begin());
+    srtp::Result protected_rtcp =
+        sender.protect_rtcp_in_place(rtcp_packet, rtcp_len);
+    CHECK(static_cast<bool>(protected_rtcp));
+    CHECK(protected_rtcp.packet.size() == rtcp_packet.size());
+    rtcp_buffer plain_rtcp;
+    srtp::Result unprotected_rtcp =
+        receiver.unprotect_rtcp(protected_rtcp.packet, plain_rtcp);
+    CHECK(static_cast<bool>(unprotected_rtcp));
+    CHECK(unprotected_rtcp.packet.size() == rtcp_len);
+    CHECK_BUFFER_EQUAL(unprotected_rtcp.packet.data(), rtcp.data(),
+                       rtcp_len);
+
+    sender.reset();
+    receiver.reset();
+    CHECK_OK(srtp_shutdown());
+}
+
+void srtp_cpp_protect_buffer_too_small()
+{
+    CHECK_OK(srtp_init());
+    srtp::Session sender;
+    CHECK_OK(srtp::Session::create(sender, make_policy(ssrc_any_outbound)));
+
+    std::array<std::uint8_t, rtp_len> rtp;
+    fill_rtp(rtp, 1);
+    std::array<std::uint8_t, rtp_len + 1> srtp;
+    srtp::Result result = sender.protect(rtp, srtp);
+    CHECK_RETURN(result.status, srtp_err_status_buffer_small);
+    CHECK(result.packet.empty());
+
+    /* rtp_len has to fit in the buffer */
+    result = sender.protect_in_place(rtp, rtp_len + 1);
+    CHECK_RETURN(result.status, srtp_err_status_bad_param);
+
+    sender.reset();
+    CHECK_OK(srtp_shutdown());
+}
+
+void srtp_cpp_batch()
+{
+    CHECK_OK(srtp_init());
+    srtp::Session sender;
+    srtp::Session receiver;
+    CHECK_OK(srtp::Session::create(sender, make_policy(ssrc_any_outbound)));
+    CHECK_OK(srtp::Session::create(receiver, make_policy(ssrc_any_inbound)));
+
+    std::array<rtp_buffer, 4> packets;
+    std::array<srtp_packet_desc_t, 4> pkts;
+    for (std::size_t i = 0; i < pkts.size(); i++) {
+        fill_rtp(std::span(packets[i]).first(rtp_len),
+                 static_cast<std::uint16_t>(i + 1));
+        pkts[i] = srtp_packet_desc_t{ packets[i].data(),
+                                      rtp_len,
+                                      packets[i].data(),
+                                      packets[i].size(),
+                                      0,
+                                      srtp_err_status_fail };
+    }
+    CHECK_OK(sender.protect_batch(pkts));
+    for (srtp_packet_desc_t &pkt : pkts) {
+        CHECK_OK(pkt.status);
+        pkt.in_len = pkt.out_len;
+    }
+    CHECK_OK(receiver.unprotect_batch(pkts));
+
+    std::array<std::uint8_t, rtp_len> rtp;
+    for (std::size_t i = 0; i < pkts.size(); i++) {
+        CHECK_OK(pkts[i].status);
+        CHECK(pkts[i].out_len == rtp_len);
+        fill_rtp(rtp, static_cast<std::uint16_t>(i + 1));
+        CHECK_BUFFER_EQUAL(packets[i].data(), rtp.data(), rtp_len);
+    }
+
+    sender.reset();
+    receiver.reset();
+    CHECK_OK(srtp_shutdown());
+}
+
+void srtp_cpp_move_only()
+{
+    static_assert(!std::is_copy_constructible_v<srtp::Session>);
+    static_assert(!std::is_copy_assignable_v<srtp::Session>);
+    static_assert(std::is_nothrow_move_constructible_v<srtp::Session>);
+    static_assert(!std::is_copy_constructible_v<srtp::Policy>);
+    static_assert(std::is_nothrow_move_assignable_v<srtp::Policy>);
+
+    CHECK_OK(srtp_init());
+    srtp::Policy policy = make_policy(ssrc_any_outbound);
+    srtp::Policy cloned;
+    CHECK_OK(policy.clone(cloned));
+    CHECK(static_cast<bool>(cloned));
+    CHECK(cloned.get() != policy.get());
+
+    srtp::Policy moved(std::move(policy));
+    CHECK(!policy);
+    CHECK(static_cast<bool>(moved));
+
+    srtp::Session session;
+    CHECK(!session);
+    CHECK_OK(srtp::Session::create(session, moved));
+    srtp_t ctx = session.get();
+    srtp::Session other = std::move(session);
+    CHECK(!session);
+    CHECK(other.get() == ctx);
+
+    /* assigning deallocates the session that was held */
+    CHECK_OK(srtp::Session::create(session, cloned));
+    other = std::move(session);
+    CHECK(!session);
+    CHECK(other.get() != ctx);
+
+    srtp_t released = other.release();
+    CHECK(!other);
+    CHECK_OK(srtp_dealloc(released));
+    CHECK_OK(srtp_shutdown());
+}
+
+} // namespace
+
+TEST_LIST = {
+    { "srtp_cpp_trailer_lengths_match_sessions()",
+      srtp_cpp_trailer_lengths_match_sessions },
+    { "srtp_cpp_protect_unprotect()", srtp_cpp_protect_unprotect },
+    { "srtp_cpp_protect_buffer_too_small()",
+      srtp_cpp_protect_buffer_too_small },
+    { "srtp_cpp_batch()", srtp_cpp_batch },
+    { "srtp_cpp_move_only()", srtp_cpp_move_only },
+    { nullptr, nullptr }
+};
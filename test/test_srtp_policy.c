@@ -36,6 +36,10 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "cutest.h"
 
 #include "srtp.h"
@@ -147,6 +151,54 @@ static void srtp_policy_clone_success_and_independent(void)
     srtp_policy_destroy(policy);
 }
 
+static void add_mki_key(srtp_policy_t policy, uint8_t index)
+{
+    uint8_t key[sizeof(base_master_key)];
+    uint8_t mki[sizeof(mki4)];
+
+    memcpy(key, base_master_key, sizeof(key));
+    memcpy(mki, mki4, sizeof(mki));
+    key[0] ^= index;
+    mki[0] ^= index;
+    CHECK_OK(srtp_policy_add_key(policy, key, sizeof(key), base_master_salt,
+                                 sizeof(base_master_salt), mki, sizeof(mki)));
+}
+
+static void srtp_policy_clone_shares_keys_until_changed(void)
+{
+    srtp_policy_t policy;
+    srtp_policy_t cloned = NULL;
+    srtp_policy_t cloned2 = NULL;
+
+    create_policy_with_profile(&policy, srtp_profile_aes128_cm_sha1_80);
+    CHECK_OK(srtp_policy_use_mki(policy, sizeof(mki4)));
+    add_mki_key(policy, 0);
+    add_mki_key(policy, 1);
+
+    CHECK_OK(srtp_policy_clone(policy, &cloned));
+    CHECK_OK(srtp_policy_clone(cloned, &cloned2));
+
+    /* adding to the clone must copy the keys first */
+    add_mki_key(cloned, 2);
+    add_mki_key(cloned, 3);
+    add_mki_key(cloned, 4);
+
+    /* removing from the original must leave both clones their keys */
+    CHECK_OK(srtp_policy_remove_keys(policy));
+    CHECK_RETURN(srtp_policy_validate(policy), srtp_err_status_bad_param);
+    srtp_policy_destroy(policy);
+
+    CHECK_OK(srtp_policy_validate(cloned));
+    CHECK_OK(srtp_policy_validate(cloned2));
+    assert_policy_creates_session(cloned);
+    srtp_policy_destroy(cloned);
+
+    assert_policy_creates_session(cloned2);
+    add_mki_key(cloned2, 2);
+    CHECK_OK(srtp_policy_validate(cloned2));
+    srtp_policy_destroy(cloned2);
+}
+
 static void srtp_policy_clone_null_output_fails(void)
 {
     srtp_policy_t policy;
@@ -167,19 +219,43 @@ static void srtp_policy_set_ssrc_invalid_type_fails(void)
 
 static void srtp_policy_set_get_profile_roundtrip(void)
 {
+#ifndef SRTP_NO_AES_256
+    const srtp_profile_t set = srtp_profile_aes256_cm_sha1_80;
+#else
+    const srtp_profile_t set = srtp_profile_aes128_cm_sha1_32;
+#endif
     srtp_policy_t policy;
     srtp_profile_t profile = srtp_profile_reserved;
     CHECK_OK(srtp_policy_create(&policy));
     CHECK_OK(
         srtp_policy_set_ssrc(policy, (srtp_ssrc_t){ ssrc_any_outbound, 0 }));
 
-    CHECK_OK(srtp_policy_set_profile(policy, srtp_profile_aes256_cm_sha1_80));
+    CHECK_OK(srtp_policy_set_profile(policy, set));
     CHECK_OK(srtp_policy_get_profile(policy, &profile));
-    CHECK(profile == srtp_profile_aes256_cm_sha1_80);
+    CHECK(profile == set);
 
     srtp_policy_destroy(policy);
 }
 
+#if defined(SRTP_NO_AES_192) || !defined(GCM)
+static void srtp_policy_set_profile_not_built_fails(void)
+{
+    srtp_policy_t policy;
+    CHECK_OK(srtp_policy_create(&policy));
+#ifdef SRTP_NO_AES_192
+    CHECK_RETURN(
+        srtp_policy_set_profile(policy, srtp_profile_aes192_cm_sha1_80),
+        srtp_err_status_bad_param);
+#endif
+#ifndef GCM
+    CHECK_RETURN(
+        srtp_policy_set_profile(policy, srtp_profile_aead_aes_128_gcm),
+        srtp_err_status_bad_param);
+#endif
+    srtp_policy_destroy(policy);
+}
+#endif
+
 static void srtp_policy_set_profile_reserved_fails(void)
 {
     srtp_policy_t policy;
@@ -486,6 +562,35 @@ static void srtp_policy_set_window_size_valid_values_ok(void)
     srtp_policy_destroy(policy);
 }
 
+static void srtp_policy_set_rtcp_window_size_invalid_values_fail(void)
+{
+    srtp_policy_t policy;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_RETURN(srtp_policy_set_rtcp_window_size(policy, 1),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_rtcp_window_size(policy, 63),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_rtcp_window_size(policy, 1025),
+                 srtp_err_status_bad_param);
+    srtp_policy_destroy(policy);
+}
+
+static void srtp_policy_set_rtcp_window_size_valid_values_ok(void)
+{
+    srtp_policy_t policy;
+    create_valid_policy(&policy);
+
+    CHECK_OK(srtp_policy_set_rtcp_window_size(policy, 0));
+    CHECK_OK(srtp_policy_validate(policy));
+    CHECK_OK(srtp_policy_set_rtcp_window_size(policy, 64));
+    CHECK_OK(srtp_policy_validate(policy));
+    CHECK_OK(srtp_policy_set_rtcp_window_size(policy, 1024));
+    CHECK_OK(srtp_policy_validate(policy));
+
+    assert_policy_creates_session(policy);
+    srtp_policy_destroy(policy);
+}
+
 static void srtp_policy_set_allow_repeat_tx_values_ok(void)
 {
     srtp_policy_t policy;
@@ -500,6 +605,24 @@ static void srtp_policy_set_allow_repeat_tx_values_ok(void)
     srtp_policy_destroy(policy);
 }
 
+static void srtp_policy_set_adaptive_window_values_ok(void)
+{
+    srtp_policy_t policy;
+    create_valid_policy(&policy);
+
+    CHECK_OK(srtp_policy_set_adaptive_window(policy, true));
+    CHECK_OK(srtp_policy_validate(policy));
+    assert_policy_creates_session(policy);
+    CHECK_OK(srtp_policy_set_window_size(policy, 1024));
+    CHECK_OK(srtp_policy_validate(policy));
+    assert_policy_creates_session(policy);
+    CHECK_OK(srtp_policy_set_adaptive_window(policy, false));
+    CHECK_OK(srtp_policy_validate(policy));
+
+    assert_policy_creates_session(policy);
+    srtp_policy_destroy(policy);
+}
+
 static void srtp_policy_set_cryptex_values_ok(void)
 {
     srtp_policy_t policy;
@@ -665,10 +788,16 @@ static void srtp_policy_all_functions_null_policy(void)
     CHECK_RETURN(srtp_policy_remove_keys(NULL), srtp_err_status_bad_param);
     CHECK_RETURN(srtp_policy_set_window_size(NULL, 128),
                  srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_rtcp_window_size(NULL, 128),
+                 srtp_err_status_bad_param);
     CHECK_RETURN(srtp_policy_set_allow_repeat_tx(NULL, true),
                  srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_adaptive_window(NULL, true),
+                 srtp_err_status_bad_param);
     CHECK_RETURN(srtp_policy_set_cryptex(NULL, true),
                  srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_policy_set_key_overlap(NULL, 64),
+                 srtp_err_status_bad_param);
     CHECK_RETURN(srtp_policy_add_enc_hdr_xtnd_id(NULL, hdr_id),
                  srtp_err_status_bad_param);
     CHECK_RETURN(srtp_policy_remove_enc_hdr_xtnd_ids(NULL),
@@ -685,6 +814,8 @@ TEST_LIST = {
     { "srtp_policy_minimal()", srtp_policy_minimal },
     { "srtp_policy_clone_success_and_independent()",
       srtp_policy_clone_success_and_independent },
+    { "srtp_policy_clone_shares_keys_until_changed()",
+      srtp_policy_clone_shares_keys_until_changed },
     { "srtp_policy_clone_null_output_fails()",
       srtp_policy_clone_null_output_fails },
     { "srtp_policy_set_ssrc_invalid_type_fails()",
@@ -693,6 +824,10 @@ TEST_LIST = {
       srtp_policy_set_get_profile_roundtrip },
     { "srtp_policy_set_profile_reserved_fails()",
       srtp_policy_set_profile_reserved_fails },
+#if defined(SRTP_NO_AES_192) || !defined(GCM)
+    { "srtp_policy_set_profile_not_built_fails()",
+      srtp_policy_set_profile_not_built_fails },
+#endif
     { "srtp_policy_set_sec_serv_requires_profile()",
       srtp_policy_set_sec_serv_requires_profile },
     { "srtp_policy_null_sha1_80_requires_128_bit_key()",
@@ -715,8 +850,14 @@ TEST_LIST = {
       srtp_policy_set_window_size_invalid_values_fail },
     { "srtp_policy_set_window_size_valid_values_ok()",
       srtp_policy_set_window_size_valid_values_ok },
+    { "srtp_policy_set_rtcp_window_size_invalid_values_fail()",
+      srtp_policy_set_rtcp_window_size_invalid_values_fail },
+    { "srtp_policy_set_rtcp_window_size_valid_values_ok()",
+      srtp_policy_set_rtcp_window_size_valid_values_ok },
     { "srtp_policy_set_allow_repeat_tx_values_ok()",
       srtp_policy_set_allow_repeat_tx_values_ok },
+    { "srtp_policy_set_adaptive_window_values_ok()",
+      srtp_policy_set_adaptive_window_values_ok },
     { "srtp_policy_set_cryptex_values_ok()",
       srtp_policy_set_cryptex_values_ok },
     { "srtp_policy_cryptex_and_enc_hdr_xtnd_ids_invalid()",
@@ -0,0 +1,350 @@
+/*
+ * thread_driver.c
+ *
+ * test driver for thread safe sessions: several threads protect and
+ * unprotect packets of their own SSRCs through shared sessions while
+ * another thread adds and removes streams, and pairs of threads send the
+ * RTP and RTCP packets of one SSRC at once. The checks only catch lost or
+ * corrupted packets; build with ENABLE_SANITIZE_THREAD to have the data
+ * races themselves reported.
+ *
+ */
+/*
+ *
+ * Copyright (c) 2026
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>  /* for printf()  */
+#include <string.h> /* for memcmp()  */
+
+#include <pthread.h>
+
+#include "srtp.h"
+#include "util.h"
+
+#define NUM_WORKERS 4
+#define NUM_PACKETS 2000
+#define NUM_CHURNS 500
+#define NUM_ROUNDS 32
+#define PAYLOAD_LEN 160
+
+/* the SSRCs of the workers, and the first one the churn thread adds */
+#define WORKER_SSRC 0x1000
+#define CHURN_SSRC 0x2000
+
+/* the first SSRC whose RTP and RTCP are sent from two threads */
+#define SHARED_SSRC 0x3000
+
+static const uint8_t test_key[46] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0, 0xd6, 0x4f, 0xa3, 0x2c,
+    0x06, 0xde, 0x41, 0x39, 0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73, 0xc3, 0x17, 0xf2, 0xda,
+    0xbe, 0x35, 0x77, 0x93, 0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+typedef struct {
+    srtp_t tx;              /* protects, SSRC_ANY_OUTBOUND template */
+    srtp_t rx;              /* unprotects, SSRC_ANY_INBOUND template */
+    srtp_profile_t profile; /* of the templates and the churned streams */
+} thread_test_t;
+
+typedef struct {
+    thread_test_t *test;
+    uint32_t ssrc;
+    pthread_t thread;
+} worker_t;
+
+static void set_policy(srtp_policy_t policy,
+                       srtp_profile_t profile,
+                       srtp_ssrc_t ssrc)
+{
+    size_t key_len = srtp_profile_get_master_key_length(profile);
+    size_t salt_len = srtp_profile_get_master_salt_length(profile);
+
+    CHECK_OK(srtp_policy_set_profile(policy, profile));
+    CHECK_OK(srtp_policy_remove_keys(policy));
+    CHECK_OK(srtp_policy_add_key(policy, test_key, key_len, test_key + key_len,
+                                 salt_len, NULL, 0));
+    CHECK_OK(srtp_policy_set_ssrc(policy, ssrc));
+}
+
+static size_t make_rtp(uint8_t *pkt, uint32_t ssrc, uint16_t seq)
+{
+    pkt[0] = 0x80;
+    pkt[1] = 0x60;
+    pkt[2] = (uint8_t)(seq >> 8);
+    pkt[3] = (uint8_t)seq;
+    pkt[4] = 0;
+    pkt[5] = 0;
+    pkt[6] = (uint8_t)(seq >> 8);
+    pkt[7] = (uint8_t)seq;
+    pkt[8] = (uint8_t)(ssrc >> 24);
+    pkt[9] = (uint8_t)(ssrc >> 16);
+    pkt[10] = (uint8_t)(ssrc >> 8);
+    pkt[11] = (uint8_t)ssrc;
+    for (size_t i = 0; i < PAYLOAD_LEN; i++) {
+        pkt[12 + i] = (uint8_t)(seq + i);
+    }
+    return 12 + PAYLOAD_LEN;
+}
+
+static size_t make_rtcp(uint8_t *pkt, uint32_t ssrc, uint16_t n)
+{
+    /* a sender report without report blocks */
+    pkt[0] = 0x80;
+    pkt[1] = 200;
+    pkt[2] = 0;
+    pkt[3] = 6;
+    pkt[4] = (uint8_t)(ssrc >> 24);
+    pkt[5] = (uint8_t)(ssrc >> 16);
+    pkt[6] = (uint8_t)(ssrc >> 8);
+    pkt[7] = (uint8_t)ssrc;
+    for (size_t i = 8; i < 28; i++) {
+        pkt[i] = (uint8_t)(n + i);
+    }
+    return 28;
+}
+
+/* sends a packet of ssrc from tx to rx and checks that it arrives intact */
+static void send_rtp(thread_test_t *test, uint32_t ssrc, uint16_t seq)
+{
+    uint8_t rtp[12 + PAYLOAD_LEN];
+    uint8_t srtp[sizeof(rtp) + SRTP_MAX_TRAILER_LEN];
+    uint8_t out[sizeof(srtp)];
+    size_t rtp_len = make_rtp(rtp, ssrc, seq);
+    size_t srtp_len = sizeof(srtp);
+    size_t out_len = sizeof(out);
+
+    CHECK_OK(srtp_protect(test->tx, rtp, rtp_len, srtp, &srtp_len, 0));
+    CHECK_OK(srtp_unprotect(test->rx, srtp, srtp_len, out, &out_len));
+    CHECK(out_len == rtp_len && memcmp(out, rtp, rtp_len) == 0);
+}
+
+static void send_rtcp(thread_test_t *test, uint32_t ssrc, uint16_t n)
+{
+    uint8_t rtcp[28];
+    uint8_t srtcp[sizeof(rtcp) + SRTP_MAX_SRTCP_TRAILER_LEN];
+    uint8_t out[sizeof(srtcp)];
+    size_t rtcp_len = make_rtcp(rtcp, ssrc, n);
+    size_t srtcp_len = sizeof(srtcp);
+    size_t out_len = sizeof(out);
+
+    CHECK_OK(
+        srtp_protect_rtcp(test->tx, rtcp, rtcp_len, srtcp, &srtcp_len, 0));
+    CHECK_OK(srtp_unprotect_rtcp(test->rx, srtcp, srtcp_len, out, &out_len));
+    CHECK(out_len == rtcp_len && memcmp(out, rtcp, rtcp_len) == 0);
+}
+
+/*
+ * a worker sends the RTP and RTCP packets of its SSRC, whose streams are
+ * cloned from the templates by its first packets
+ */
+static void *worker_run(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+
+    for (uint16_t seq = 0; seq < NUM_PACKETS; seq++) {
+        send_rtp(w->test, w->ssrc, seq);
+        if (seq % 16 == 0) {
+            send_rtcp(w->test, w->ssrc, seq);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * the churn thread adds and removes streams for SSRCs of its own, and
+ * removes the inbound streams of the workers, which are cloned again by
+ * their next packet
+ */
+static void *churn_run(void *arg)
+{
+    thread_test_t *test = (thread_test_t *)arg;
+    srtp_policy_t policy;
+    srtp_err_status_t status;
+
+    CHECK_OK(srtp_policy_create(&policy));
+    for (uint32_t i = 0; i < NUM_CHURNS; i++) {
+        uint32_t ssrc = CHURN_SSRC + i % 8;
+
+        set_policy(policy, test->profile, (srtp_ssrc_t){ ssrc_specific, ssrc });
+        CHECK_OK(srtp_stream_add(test->tx, policy));
+        CHECK_OK(srtp_stream_add(test->rx, policy));
+        send_rtp(test, ssrc, (uint16_t)i);
+        send_rtcp(test, ssrc, (uint16_t)i);
+        CHECK_OK(srtp_stream_remove(test->tx, ssrc));
+        CHECK_OK(srtp_stream_remove(test->rx, ssrc));
+
+        if (i % 32 == 0) {
+            status =
+                srtp_stream_remove(test->rx, WORKER_SSRC + i % NUM_WORKERS);
+            CHECK(status == srtp_err_status_ok ||
+                  status == srtp_err_status_no_ctx);
+        }
+    }
+    srtp_policy_destroy(policy);
+    return NULL;
+}
+
+/*
+ * the threads of a pair send the RTP and the RTCP packets of one SSRC, so
+ * that the first RTCP packet derives the SRTCP keys while RTP packets are
+ * protected with the same session keys
+ */
+static void *shared_rtp_run(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+
+    for (uint16_t seq = 0; seq < 256; seq++) {
+        send_rtp(w->test, w->ssrc, seq);
+    }
+    return NULL;
+}
+
+static void *shared_rtcp_run(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+
+    for (uint16_t n = 0; n < 64; n++) {
+        send_rtcp(w->test, w->ssrc, n);
+    }
+    return NULL;
+}
+
+static void shared_ssrc_test(srtp_profile_t profile)
+{
+    thread_test_t test;
+    worker_t rtp, rtcp;
+    srtp_policy_t policy;
+
+    test.profile = profile;
+    CHECK_OK(srtp_policy_create(&policy));
+    CHECK_OK(srtp_create(&test.tx, NULL));
+    CHECK_OK(srtp_set_thread_safe(test.tx, true));
+    CHECK_OK(srtp_create(&test.rx, NULL));
+    CHECK_OK(srtp_set_thread_safe(test.rx, true));
+
+    for (uint32_t i = 0; i < NUM_ROUNDS; i++) {
+        uint32_t ssrc = SHARED_SSRC + i;
+
+        /* fresh streams, whose SRTCP keys are still to be derived */
+        set_policy(policy, profile, (srtp_ssrc_t){ ssrc_specific, ssrc });
+        CHECK_OK(srtp_stream_add(test.tx, policy));
+        CHECK_OK(srtp_stream_add(test.rx, policy));
+
+        rtp.test = rtcp.test = &test;
+        rtp.ssrc = rtcp.ssrc = ssrc;
+        CHECK(pthread_create(&rtp.thread, NULL, shared_rtp_run, &rtp) == 0);
+        CHECK(pthread_create(&rtcp.thread, NULL, shared_rtcp_run, &rtcp) == 0);
+        CHECK(pthread_join(rtp.thread, NULL) == 0);
+        CHECK(pthread_join(rtcp.thread, NULL) == 0);
+
+        CHECK_OK(srtp_stream_remove(test.tx, ssrc));
+        CHECK_OK(srtp_stream_remove(test.rx, ssrc));
+    }
+
+    CHECK_OK(srtp_dealloc(test.tx));
+    CHECK_OK(srtp_dealloc(test.rx));
+    srtp_policy_destroy(policy);
+}
+
+static void thread_test(srtp_profile_t profile)
+{
+    thread_test_t test;
+    worker_t workers[NUM_WORKERS];
+    pthread_t churn;
+    srtp_policy_t policy;
+
+    test.profile = profile;
+    CHECK_OK(srtp_policy_create(&policy));
+
+    CHECK_OK(srtp_create(&test.tx, NULL));
+    CHECK_OK(srtp_set_thread_safe(test.tx, true));
+    set_policy(policy, profile, (srtp_ssrc_t){ ssrc_any_outbound, 0 });
+    CHECK_OK(srtp_stream_add(test.tx, policy));
+
+    CHECK_OK(srtp_create(&test.rx, NULL));
+    CHECK_OK(srtp_set_thread_safe(test.rx, true));
+    set_policy(policy, profile, (srtp_ssrc_t){ ssrc_any_inbound, 0 });
+    CHECK_OK(srtp_stream_add(test.rx, policy));
+
+    for (size_t i = 0; i < NUM_WORKERS; i++) {
+        workers[i].test = &test;
+        workers[i].ssrc = WORKER_SSRC + (uint32_t)i;
+        CHECK(pthread_create(&workers[i].thread, NULL, worker_run,
+                             &workers[i]) == 0);
+    }
+    CHECK(pthread_create(&churn, NULL, churn_run, &test) == 0);
+
+    for (size_t i = 0; i < NUM_WORKERS; i++) {
+        CHECK(pthread_join(workers[i].thread, NULL) == 0);
+    }
+    CHECK(pthread_join(churn, NULL) == 0);
+
+    CHECK_OK(srtp_dealloc(test.tx));
+    CHECK_OK(srtp_dealloc(test.rx));
+    srtp_policy_destroy(policy);
+}
+
+int main(void)
+{
+    printf("thread safe session test driver\n");
+
+    CHECK_OK(srtp_init());
+
+    printf("testing aes128_cm_sha1_80 from %d threads...", NUM_WORKERS + 1);
+    fflush(stdout);
+    thread_test(srtp_profile_aes128_cm_sha1_80);
+    printf("passed\n");
+
+    printf("testing aes128_cm_sha1_80 RTP and RTCP of one SSRC...");
+    fflush(stdout);
+    shared_ssrc_test(srtp_profile_aes128_cm_sha1_80);
+    printf("passed\n");
+
+#ifdef GCM
+    printf("testing aead_aes_128_gcm from %d threads...", NUM_WORKERS + 1);
+    fflush(stdout);
+    thread_test(srtp_profile_aead_aes_128_gcm);
+    printf("passed\n");
+
+    printf("testing aead_aes_128_gcm RTP and RTCP of one SSRC...");
+    fflush(stdout);
+    shared_ssrc_test(srtp_profile_aead_aes_128_gcm);
+    printf("passed\n");
+#endif
+
+    CHECK_OK(srtp_shutdown());
+    return 0;
+}
@@ -46,6 +46,10 @@
 
 #include "srtp.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // test check macros and functions
 void check_ok_impl(srtp_err_status_t status, const char *file, int line);
 void check_return_impl(srtp_err_status_t status,
@@ -96,4 +100,8 @@ typedef struct policy_params_t {
 srtp_err_status_t create_policy_from_params(srtp_policy_t *policy,
                                             const policy_params_t *params);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif